@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+
+"""Tokenized log decoder
+
+A build with LOG_TOKENIZED logs each LOG_DEBUG/LOG_INFO/LOG_TRACE as a '$' and base64 line: the FNV-1a hash of its format
+string (worked out by the compiler) and its raw arguments, see LogTokenWriter in src/RedirectablePrint.h.  This puts the text
+back, by hashing every LOG_ format string in our source the same way.
+
+To use, capture the serial log to a file (or pipe it in), then run:
+$ bin/log_decoder.py log.txt
+To decode against the source of the build that made the log rather than this checkout, use the -s option, e.g.:
+$ bin/log_decoder.py -s ../firmware-2.2.0/src log.txt
+To see the dictionary (token, format) itself:
+$ bin/log_decoder.py --dump
+"""
+
+import argparse
+import base64
+import os
+import re
+import struct
+import sys
+
+TAG_INT, TAG_UINT, TAG_FLOAT, TAG_STRING = range(4)
+
+CALL_RE = re.compile(r"\bLOG_(?:DEBUG|INFO|WARN|ERROR|CRIT|TRACE)\s*\(\s*((?:\"(?:[^\"\\\n]|\\.)*\"\s*)+)")
+LITERAL_RE = re.compile(r"\"((?:[^\"\\\n]|\\.)*)\"")
+ESCAPE_RE = re.compile(r"\\(x[0-9a-fA-F]+|[0-7]{1,3}|.)")
+SPEC_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGaAcspn%])")
+TOKEN_RE = re.compile(r"\$([A-Za-z0-9+/]+={0,2})")
+
+SIMPLE_ESCAPES = {"n": "\n", "t": "\t", "r": "\r", "a": "\a", "b": "\b", "f": "\f", "v": "\v"}
+
+
+def unescape(literal):
+    """The value of the body of a C string literal, as bytes"""
+
+    def one(m):
+        e = m.group(1)
+        if e[0] == "x":
+            return chr(int(e[1:], 16) & 0xFF)
+        if e[0] in "01234567":
+            return chr(int(e, 8) & 0xFF)
+        return SIMPLE_ESCAPES.get(e, e)
+
+    # chr() of a byte value round trips through latin-1, the rest of the literal is the UTF-8 it was written in
+    text = literal.encode("utf-8").decode("latin-1")
+    return ESCAPE_RE.sub(one, text).encode("latin-1")
+
+
+def fnv1a(data):
+    """logTokenHash() in src/RedirectablePrint.h"""
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def build_dictionary(src_dirs):
+    """{token: format} for every LOG_ call in the .c/.cpp/.h files under src_dirs"""
+    formats = {}
+    for src in src_dirs:
+        for root, _, files in os.walk(src):
+            for name in files:
+                if not name.endswith((".c", ".cpp", ".h", ".hpp", ".ino")):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="replace") as f:
+                    text = f.read()
+                for m in CALL_RE.finditer(text):
+                    fmt = b"".join(unescape(l) for l in LITERAL_RE.findall(m.group(1)))
+                    formats[fnv1a(fmt)] = fmt.decode("utf-8", errors="replace")
+    return formats
+
+
+class Reader:
+    """Reads the arguments LogTokenWriter wrote"""
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        v = shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def args(self):
+        out = []
+        try:
+            while self.pos < len(self.data):
+                tag = self.byte()
+                if tag == TAG_INT:
+                    v = self.varint()
+                    out.append((v >> 1) ^ -(v & 1))
+                elif tag == TAG_UINT:
+                    out.append(self.varint())
+                elif tag == TAG_FLOAT:
+                    out.append(struct.unpack_from("<f", self.data, self.pos)[0])
+                    self.pos += 4
+                elif tag == TAG_STRING:
+                    end = self.data.index(b"\0", self.pos) if b"\0" in self.data[self.pos :] else len(self.data)
+                    out.append(self.data[self.pos : end].decode("utf-8", errors="replace"))
+                    self.pos = end + 1
+                else:
+                    break
+        except (IndexError, struct.error):
+            pass  # cut short because it didn't fit
+        return out
+
+
+def render(fmt, args):
+    """printf(fmt, args...) with Python's % (which lacks the C length modifiers and %p)"""
+    args = list(args)
+
+    def one(m):
+        flags, width, precision, _, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(args.pop(0)) if args else ""
+        if precision == "*":
+            precision = str(args.pop(0)) if args else ""
+        if not args:
+            return "<?>"  # the rest didn't fit in the record
+        v = args.pop(0)
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        try:
+            if conv == "p":
+                return (spec + "s") % hex(v)
+            if conv in "diouxXc":
+                if isinstance(v, float):
+                    v = int(v)
+                if conv in "ouxX" and v < 0:
+                    v &= 0xFFFFFFFF  # our ints are 32 bits
+                return (spec + ("d" if conv == "i" else conv)) % v
+            if conv in "eEfFgGaA":
+                return (spec + ("f" if conv in "aA" else conv)) % float(v)
+            return (spec + "s") % (v,)
+        except (TypeError, ValueError, OverflowError):
+            return "<%r>" % (v,)
+
+    return SPEC_RE.sub(one, fmt)
+
+
+def decode_record(formats, b64):
+    try:
+        data = base64.b64decode(b64)
+    except ValueError:
+        return None
+    if len(data) < 4:
+        return None
+    token = struct.unpack_from("<I", data)[0]
+    fmt = formats.get(token)
+    if fmt is None:
+        return "<unknown log token 0x%08x>\n" % token
+    return render(fmt, Reader(data[4:]).args())
+
+
+def decode_line(formats, line):
+    """A log line with any '$' record in it put back to text (which brings its own newline)"""
+    m = TOKEN_RE.search(line)
+    if not m or m.end() != len(line.rstrip("\r\n")):
+        return line
+    text = decode_record(formats, m.group(1))
+    if text is None:
+        return line
+    return line[: m.start()] + text
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode a log from a LOG_TOKENIZED build")
+    parser.add_argument(
+        "-s",
+        "--src",
+        action="append",
+        help="source directory whose LOG_ formats to use (default: src of this checkout)",
+    )
+    parser.add_argument("--dump", action="store_true", help="print the dictionary (token, format) and exit")
+    parser.add_argument("file", nargs="?", type=argparse.FileType("r", errors="replace"), default=sys.stdin)
+    args = parser.parse_args()
+
+    src_dirs = args.src or [os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")]
+    formats = build_dictionary(src_dirs)
+
+    if args.dump:
+        for token, fmt in sorted(formats.items()):
+            print("%08x %r" % (token, fmt))
+        return
+
+    for line in args.file:
+        sys.stdout.write(decode_line(formats, line))
+
+
+if __name__ == "__main__":
+    main()
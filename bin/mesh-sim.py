@@ -0,0 +1,406 @@
+#!/usr/bin/env python3
+"""Multi-node mesh simulator for the native (portduino) build.
+
+Starts N instances of the native firmware (build it with "pio run -e native"), each with its own TCP port, filesystem and
+node number, and acts as the radio channel between them.  It talks to every node over the usual stream API, like the
+Python interactive simulator does: when a node's SimRadio starts sending it hands us the packet (as SIMULATOR_APP), and we
+hand it on to every node in range with an rx_snr/rx_rssi from our propagation model.  Each node's SimRadio then keeps
+itself busy receiving for the packet's airtime (RadioInterface::getPacketTime()), so overlapping packets collide (unless one
+is strong enough to capture the receiver) and packets which arrive while a node is sending are lost, just like on the air.
+
+We inject text broadcasts from random nodes and watch which nodes get them, so at the end we can report delivery ratio,
+transmissions per message (flood efficiency) and airtime, e.g. to see how flooding holds up as the mesh grows:
+
+    bin/mesh-sim.py --nodes 50 --area 4000 --duration 600 --report report.json
+
+Everything the simulator decides (placement, per link shadowing, per packet fading and loss, traffic) comes from one
+random generator seeded with --seed, so runs are repeatable as far as the simulator goes.  The nodes themselves still run
+on the host's clock (portduino's millis() is real time) and pick their own random delays, so individual collisions will
+differ between runs.
+
+Needs the meshtastic Python package (for its protobufs).
+"""
+
+import argparse
+import heapq
+import json
+import math
+import os
+import random
+import select
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+try:
+    from meshtastic.protobuf import mesh_pb2, portnums_pb2
+except ImportError:
+    from meshtastic import mesh_pb2, portnums_pb2
+
+START1 = 0x94
+START2 = 0xC3
+HEADER_LEN = 4
+MAX_FRAME_LEN = 512
+BROADCAST = 0xFFFFFFFF
+PACKET_HEADER_LEN = 16  # sizeof(PacketHeader)
+
+MESSAGE_PREFIX = b"sim:"
+
+
+def lora_airtime_msec(pl, bw_khz, sf, cr, preamble):
+    """The same math as RadioInterface::computePacketTime(), pl includes the PacketHeader"""
+    t_sym = (1 << sf) / (bw_khz * 1000.0)
+    low_data_opt = t_sym > 16e-3
+    t_preamble = (preamble + 4.25) * t_sym
+    num_payload_sym = 8 + max(math.ceil((8.0 * pl - 4 * sf + 28 + 16) / (4 * (sf - 2 * low_data_opt))) * cr, 0.0)
+    return int((t_preamble + num_payload_sym * t_sym) * 1000)
+
+
+class LinkModel:
+    """Log-distance path loss with fixed per link shadowing (the same both ways) and per packet fading"""
+
+    def __init__(self, args, rng):
+        self.args = args
+        self.rng = rng
+        self.shadowing = {}
+
+    def mean_rssi(self, a, b):
+        key = (min(a.index, b.index), max(a.index, b.index))
+        if key not in self.shadowing:
+            self.shadowing[key] = self.rng.gauss(0, self.args.shadowing)
+        d = max(math.hypot(a.x - b.x, a.y - b.y), 1.0)
+        path_loss = self.args.ref_loss + 10 * self.args.path_loss_exponent * math.log10(d)
+        return self.args.tx_power - path_loss - self.shadowing[key]
+
+    def hear(self, sender, receiver):
+        """@return (snr, rssi) if receiver hears this packet from sender, else None"""
+        rssi = self.mean_rssi(sender, receiver) + self.rng.gauss(0, self.args.fading)
+        snr = rssi - self.args.noise_floor
+        if snr < self.args.snr_threshold or self.rng.random() < self.args.loss:
+            return None
+        return snr, rssi
+
+
+class Node:
+    def __init__(self, index, x, y):
+        self.index = index
+        self.x = x
+        self.y = y
+        self.port = 0
+        self.proc = None
+        self.sock = None
+        self.buf = b""
+        self.num = 0
+        self.config_nonce = 0
+        self.configured = False
+        self.tx_count = 0
+        self.tx_airtime_msec = 0
+
+
+def place_nodes(args, rng):
+    if args.positions:
+        with open(args.positions) as f:
+            return [Node(i, p[0], p[1]) for i, p in enumerate(json.load(f))]
+
+    nodes = []
+    for i in range(args.nodes):
+        if args.topology == "line":
+            nodes.append(Node(i, i * args.spacing, 0))
+        elif args.topology == "grid":
+            side = math.ceil(math.sqrt(args.nodes))
+            nodes.append(Node(i, (i % side) * args.spacing, (i // side) * args.spacing))
+        else:
+            nodes.append(Node(i, rng.uniform(0, args.area), rng.uniform(0, args.area)))
+    return nodes
+
+
+def send_to_radio(node, to_radio):
+    data = to_radio.SerializeToString()
+    node.sock.sendall(bytes([START1, START2, len(data) >> 8, len(data) & 0xFF]) + data)
+
+
+def read_from_radio(node):
+    """@return the FromRadio messages now complete in node's stream (anything between frames is debug output, skipped)"""
+    chunk = node.sock.recv(4096)
+    if not chunk:
+        raise ConnectionError(f"node {node.index} closed its connection")
+    node.buf += chunk
+
+    messages = []
+    while True:
+        start = node.buf.find(bytes([START1, START2]))
+        if start < 0:
+            node.buf = node.buf[-1:]
+            return messages
+        node.buf = node.buf[start:]
+        if len(node.buf) < HEADER_LEN:
+            return messages
+
+        length = (node.buf[2] << 8) | node.buf[3]
+        if length > MAX_FRAME_LEN:
+            node.buf = node.buf[1:]  # not really a frame start, keep looking
+            continue
+        if len(node.buf) < HEADER_LEN + length:
+            return messages
+
+        msg = mesh_pb2.FromRadio()
+        try:
+            msg.ParseFromString(node.buf[HEADER_LEN : HEADER_LEN + length])
+            messages.append(msg)
+        except Exception:
+            pass  # garbled by debug output, drop it
+        node.buf = node.buf[HEADER_LEN + length :]
+
+
+def start_node(args, node, workdir):
+    node.port = args.base_port + node.index
+    fsdir = os.path.join(workdir, f"node{node.index}")
+    os.makedirs(fsdir, exist_ok=True)
+    log = open(os.path.join(workdir, f"node{node.index}.log"), "w")
+    # --hwid gives every instance its own MAC address, and so its own node number
+    cmd = [args.program, "--port", str(node.port), "--fsdir", fsdir, "--hwid", str(node.index + 1)]
+    node.proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+
+
+def connect_node(node, timeout):
+    deadline = time.time() + timeout
+    while True:
+        try:
+            node.sock = socket.create_connection(("localhost", node.port), timeout=1)
+            node.sock.setblocking(False)
+            break
+        except OSError:
+            if time.time() > deadline:
+                raise
+            time.sleep(0.5)
+
+    node.config_nonce = node.index + 1
+    to_radio = mesh_pb2.ToRadio()
+    to_radio.want_config_id = node.config_nonce
+    node.sock.setblocking(True)
+    send_to_radio(node, to_radio)
+    node.sock.setblocking(False)
+
+
+class Simulator:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.nodes = place_nodes(args, self.rng)
+        self.links = LinkModel(args, self.rng)
+        self.by_sock = {}
+        self.deliveries = []  # heap of (msec, seq, receiver index, ToRadio)
+        self.seq = 0
+
+        self.messages = {}  # message number -> {"from": index, "sent": msec, "heard": {index: msec}}
+        self.transmissions = 0
+        self.airtime_msec = 0
+        self.start = time.time()
+        self.end_msec = 0
+
+    def now_msec(self):
+        return int((time.time() - self.start) * 1000)
+
+    def handle_from_radio(self, node, msg):
+        which = msg.WhichOneof("payload_variant")
+        if which == "my_info":
+            node.num = msg.my_info.my_node_num
+        elif which == "config_complete_id" and msg.config_complete_id == node.config_nonce:
+            node.configured = True
+        elif which == "packet":
+            p = msg.packet
+            if p.HasField("decoded") and p.decoded.portnum == portnums_pb2.PortNum.SIMULATOR_APP:
+                self.handle_transmission(node, p)
+            elif p.HasField("decoded") and p.decoded.portnum == portnums_pb2.PortNum.TEXT_MESSAGE_APP:
+                self.handle_text(node, p)
+
+    def handle_transmission(self, sender, p):
+        """sender's radio just started sending p, put it on the air for everyone in range"""
+        airtime = lora_airtime_msec(PACKET_HEADER_LEN + len(p.decoded.payload), self.args.bw, self.args.sf, self.args.cr,
+                                    self.args.preamble)
+        self.transmissions += 1
+        self.airtime_msec += airtime
+        sender.tx_count += 1
+        sender.tx_airtime_msec += airtime
+
+        now = self.now_msec()
+        for receiver in self.nodes:
+            if receiver is sender:
+                continue
+            heard = self.links.hear(sender, receiver)
+            if not heard:
+                continue
+
+            to_radio = mesh_pb2.ToRadio()
+            to_radio.packet.CopyFrom(p)
+            to_radio.packet.rx_snr = heard[0]
+            to_radio.packet.rx_rssi = int(heard[1])
+            to_radio.packet.rx_time = 0
+            self.seq += 1
+            heapq.heappush(self.deliveries, (now + self.args.propagation, self.seq, receiver.index, to_radio))
+
+    def handle_text(self, node, p):
+        payload = p.decoded.payload
+        if not payload.startswith(MESSAGE_PREFIX):
+            return
+        try:
+            num = int(payload[len(MESSAGE_PREFIX) :])
+        except ValueError:
+            return
+        m = self.messages.get(num)
+        if m and node.index != m["from"] and node.index not in m["heard"]:
+            m["heard"][node.index] = self.now_msec() - m["sent"]
+
+    def send_message(self):
+        source = self.rng.choice(self.nodes)
+        num = len(self.messages)
+        self.messages[num] = {"from": source.index, "sent": self.now_msec(), "heard": {}}
+
+        to_radio = mesh_pb2.ToRadio()
+        to_radio.packet.to = BROADCAST
+        to_radio.packet.hop_limit = self.args.hop_limit
+        to_radio.packet.decoded.portnum = portnums_pb2.PortNum.TEXT_MESSAGE_APP
+        to_radio.packet.decoded.payload = MESSAGE_PREFIX + str(num).encode()
+        self.write(source, to_radio)
+
+    def write(self, node, to_radio):
+        node.sock.setblocking(True)
+        send_to_radio(node, to_radio)
+        node.sock.setblocking(False)
+
+    def poll(self, timeout):
+        readable, _, _ = select.select(list(self.by_sock.keys()), [], [], max(timeout, 0))
+        for sock in readable:
+            node = self.by_sock[sock]
+            for msg in read_from_radio(node):
+                self.handle_from_radio(node, msg)
+
+        now = self.now_msec()
+        while self.deliveries and self.deliveries[0][0] <= now:
+            _, _, index, to_radio = heapq.heappop(self.deliveries)
+            self.write(self.nodes[index], to_radio)
+
+    def run(self, workdir):
+        for node in self.nodes:
+            start_node(self.args, node, workdir)
+        for node in self.nodes:
+            connect_node(node, self.args.startup_timeout)
+            self.by_sock[node.sock] = node
+
+        deadline = time.time() + self.args.startup_timeout
+        while not all(n.configured for n in self.nodes):
+            if time.time() > deadline:
+                raise TimeoutError("not every node finished sending its config")
+            self.poll(0.1)
+        print(f"{len(self.nodes)} nodes up, running for {self.args.duration}s", file=sys.stderr)
+
+        # Measure from here, so startup chatter doesn't count against the mesh
+        self.start = time.time()
+        self.transmissions = self.airtime_msec = 0
+        for node in self.nodes:
+            node.tx_count = node.tx_airtime_msec = 0
+
+        end = self.args.duration * 1000
+        traffic_end = end - self.args.settle * 1000
+        next_message = self.rng.expovariate(1.0 / self.args.interval) * 1000
+        while self.now_msec() < end:
+            now = self.now_msec()
+            if next_message <= now and now < traffic_end:
+                self.send_message()
+                next_message += self.rng.expovariate(1.0 / self.args.interval) * 1000
+            wake = min([next_message, end] + [d[0] for d in self.deliveries[:1]])
+            self.poll((wake - now) / 1000.0)
+        self.end_msec = self.now_msec()
+
+    def report(self):
+        n = len(self.nodes)
+        duration_msec = max(self.end_msec, 1)
+        ratios = [len(m["heard"]) / (n - 1) for m in self.messages.values()] if n > 1 else []
+        latencies = sorted(t for m in self.messages.values() for t in m["heard"].values())
+        heard = sum(len(m["heard"]) for m in self.messages.values())
+        return {
+            "nodes": n,
+            "seed": self.args.seed,
+            "duration_sec": duration_msec / 1000,
+            "messages": len(self.messages),
+            "delivery_ratio": sum(ratios) / len(ratios) if ratios else 0,
+            "fully_delivered": sum(1 for r in ratios if r == 1.0),
+            "latency_msec_median": latencies[len(latencies) // 2] if latencies else 0,
+            "latency_msec_p90": latencies[int(len(latencies) * 0.9)] if latencies else 0,
+            "transmissions": self.transmissions,
+            "transmissions_per_message": self.transmissions / len(self.messages) if self.messages else 0,
+            "deliveries_per_transmission": heard / self.transmissions if self.transmissions else 0,
+            "airtime_msec": self.airtime_msec,
+            "channel_utilization_percent": 100.0 * self.airtime_msec / duration_msec,
+            "max_node_tx_utilization_percent": 100.0 * max(nd.tx_airtime_msec for nd in self.nodes) / duration_msec,
+        }
+
+    def stop(self):
+        for node in self.nodes:
+            if node.sock:
+                node.sock.close()
+            if node.proc:
+                node.proc.terminate()
+        for node in self.nodes:
+            if node.proc:
+                try:
+                    node.proc.wait(5)
+                except subprocess.TimeoutExpired:
+                    node.proc.kill()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--program", default=".pio/build/native/program", help="native firmware binary")
+    parser.add_argument("--nodes", type=int, default=10)
+    parser.add_argument("--topology", choices=["random", "grid", "line"], default="random")
+    parser.add_argument("--positions", help="JSON file of [x, y] node positions in metres (overrides --nodes/--topology)")
+    parser.add_argument("--area", type=float, default=3000, help="side of the square random nodes are placed in (m)")
+    parser.add_argument("--spacing", type=float, default=1000, help="distance between grid/line neighbours (m)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--duration", type=float, default=300, help="seconds to run once all nodes are up")
+    parser.add_argument("--settle", type=float, default=30, help="seconds at the end without new messages")
+    parser.add_argument("--interval", type=float, default=10, help="mean seconds between injected messages")
+    parser.add_argument("--hop-limit", type=int, default=3)
+    parser.add_argument("--base-port", type=int, default=4403)
+    parser.add_argument("--startup-timeout", type=float, default=60)
+    parser.add_argument("--workdir", help="where node filesystems and logs go (default: a new temporary directory)")
+    parser.add_argument("--report", help="also write the JSON report here")
+
+    radio = parser.add_argument_group("propagation model")
+    radio.add_argument("--tx-power", type=float, default=20, help="dBm")
+    radio.add_argument("--ref-loss", type=float, default=40, help="path loss at 1 m (dB)")
+    radio.add_argument("--path-loss-exponent", type=float, default=2.9)
+    radio.add_argument("--shadowing", type=float, default=4, help="per link log-normal shadowing sigma (dB)")
+    radio.add_argument("--fading", type=float, default=2, help="per packet fading sigma (dB)")
+    radio.add_argument("--noise-floor", type=float, default=-120, help="dBm")
+    radio.add_argument("--snr-threshold", type=float, default=-17.5, help="lowest SNR we can demodulate (dB)")
+    radio.add_argument("--loss", type=float, default=0, help="extra random loss probability per link and packet")
+    radio.add_argument("--propagation", type=int, default=0, help="msecs between a send starting and receivers hearing it")
+
+    modem = parser.add_argument_group("modem (for airtime, must match the nodes, default LONG_FAST)")
+    modem.add_argument("--bw", type=float, default=250, help="kHz")
+    modem.add_argument("--sf", type=int, default=11)
+    modem.add_argument("--cr", type=int, default=5, help="4/cr")
+    modem.add_argument("--preamble", type=int, default=16, help="symbols")
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="mesh-sim-")
+    sim = Simulator(args)
+    try:
+        sim.run(workdir)
+    finally:
+        sim.stop()
+
+    report = sim.report()
+    print(json.dumps(report, indent=2))
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump(report, f, indent=2)
+    print(f"node logs are in {workdir}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
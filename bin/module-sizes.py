@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Report the flash and RAM each of our source files (so each module) costs, from the linker map of a build.
+
+Build with a map first, e.g. add -Wl,-Map,.pio/build/output.map to the environment's build_flags, then
+    bin/module-sizes.py .pio/build/output.map
+Flash is code and constant data plus the initial values of initialised data, RAM is initialised and zeroed data.  Heap
+and stacks (OSThreads, buffers a module allocates when it starts) aren't in the map, see the heap lines in our log for
+those."""
+
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+# An input section, either on one line or with its address, size and object on the line after its name
+SECTION = re.compile(r"^ (\.?[\w.$]+|COMMON)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+))?\s*$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+)\s*$")
+
+FLASH_PREFIXES = (".text", ".literal", ".rodata", ".irom", ".flash", ".iram", ".init_array", ".ARM")
+DATA_PREFIXES = (".data", ".dram0.data", ".sdata")
+BSS_PREFIXES = (".bss", ".dram0.bss", ".sbss", "COMMON", ".noinit", ".rtc")
+
+
+def kind(section):
+    if section.startswith(DATA_PREFIXES):
+        return "data"
+    if section.startswith(BSS_PREFIXES):
+        return "bss"
+    if section.startswith(FLASH_PREFIXES):
+        return "flash"
+    return None
+
+
+def owner(obj, all_objects):
+    """Our source file an object came from (src/modules/SerialModule.cpp.o -> modules/SerialModule), or None"""
+    m = re.search(r"(?:^|[/\\])src[/\\](.+?)\.(?:c|cpp|cc|S)\.o$", obj)
+    if m:
+        return m.group(1).replace("\\", "/")
+    if all_objects:
+        m = re.search(r"([^/\\]+\.a)\(|[/\\](lib[^/\\]+)[/\\]", obj)
+        return "[" + (m.group(1) or m.group(2)) + "]" if m else "[other]"
+    return None
+
+
+def parse(path, all_objects):
+    sizes = defaultdict(lambda: {"flash": 0, "data": 0, "bss": 0})
+    in_discarded = False
+    pending = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            if line.startswith("Discarded input sections"):
+                in_discarded = True
+            elif line.startswith("Memory Configuration") or line.startswith("Linker script and memory map"):
+                in_discarded = False
+            if in_discarded:
+                continue
+
+            if pending:
+                m = CONTINUATION.match(line)
+                section, pending = pending, None
+                if m:
+                    add(sizes, section, int(m.group(1), 16), int(m.group(2), 16), m.group(3), all_objects)
+                    continue
+
+            m = SECTION.match(line)
+            if not m:
+                continue
+            if m.group(4):
+                add(sizes, m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4), all_objects)
+            else:
+                pending = m.group(1)
+    return sizes
+
+
+def add(sizes, section, address, size, obj, all_objects):
+    k = kind(section)
+    who = owner(obj, all_objects)
+    if k and who and address and size:
+        sizes[who][k] += size
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="the linker map of a build")
+    parser.add_argument("--all", action="store_true", help="also list libraries and framework objects")
+    parser.add_argument("--sort", choices=["flash", "ram"], default="flash")
+    parser.add_argument("--top", type=int, default=0, help="only list this many")
+    args = parser.parse_args()
+
+    sizes = parse(args.map, args.all)
+    if not sizes:
+        sys.exit("No sections from our sources in %s, is it a GNU ld map?" % args.map)
+
+    rows = [(who, s["flash"] + s["data"], s["data"] + s["bss"]) for who, s in sizes.items()]
+    rows.sort(key=lambda r: r[1] if args.sort == "flash" else r[2], reverse=True)
+    if args.top:
+        rows = rows[: args.top]
+
+    width = max(len(r[0]) for r in rows)
+    print("%-*s %9s %9s" % (width, "source", "flash", "ram"))
+    for who, flash, ram in rows:
+        print("%-*s %9d %9d" % (width, who, flash, ram))
+    print("%-*s %9d %9d" % (width, "total", sum(r[1] for r in rows), sum(r[2] for r in rows)))
+
+
+if __name__ == "__main__":
+    main()
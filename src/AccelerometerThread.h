@@ -1,3 +1,4 @@
+#include "GPS.h"
 #include "PowerFSM.h"
 #include "concurrency/OSThread.h"
 #include "configuration.h"
@@ -11,11 +12,19 @@
 #include <bma.h>
 
 BMA423 bmaSensor;
-bool BMA_IRQ = false;
 
 #define ACCELEROMETER_CHECK_INTERVAL_MS 100
 #define ACCELEROMETER_CLICK_THRESHOLD 40
 
+/// The pin our accelerometer's interrupt output is wired to, where the board has one, so its motion and taps wake us rather
+/// than our polling it over I2C
+#if !defined(ACCELEROMETER_INT_PIN) && defined(BMA4XX_INT)
+#define ACCELEROMETER_INT_PIN BMA4XX_INT
+#endif
+
+/// The thread ACCELEROMETER_INT_PIN wakes
+concurrency::OSThread *accelerometerIntThread;
+
 uint16_t readRegister(uint8_t address, uint8_t reg, uint8_t *data, uint16_t len)
 {
     Wire.beginTransmission(address);
@@ -58,6 +67,7 @@ class AccelerometerThread : public concurrency::OSThread
 
         acceleremoter_type = type;
         LOG_DEBUG("AccelerometerThread initializing\n");
+        GPS::noteMotion(true); // so it can skip fixes while we say nothing
 
         if (acceleremoter_type == ScanI2C::DeviceType::MPU6050 && mpu.begin(accelerometer_found.address)) {
             LOG_DEBUG("MPU6050 initializing\n");
@@ -67,6 +77,7 @@ class AccelerometerThread : public concurrency::OSThread
             mpu.setMotionDetectionDuration(20);
             mpu.setInterruptPinLatch(true); // Keep it latched.  Will turn off when reinitialized.
             mpu.setInterruptPinPolarity(true);
+            mpu.setMotionInterrupt(true);
         } else if (acceleremoter_type == ScanI2C::DeviceType::LIS3DH && lis.begin(accelerometer_found.address)) {
             LOG_DEBUG("LIS3DH initializing\n");
             lis.setRange(LIS3DH_RANGE_2_G);
@@ -91,17 +102,6 @@ class AccelerometerThread : public concurrency::OSThread
             // The correct trigger interrupt needs to be configured as needed
             bmaSensor.setINTPinConfig(pin_config, BMA4_INTR1_MAP);
 
-#ifdef BMA423_INT
-            pinMode(BMA4XX_INT, INPUT);
-            attachInterrupt(
-                BMA4XX_INT,
-                [] {
-                    // Set interrupt to set irq value to true
-                    BMA_IRQ = true;
-                },
-                RISING); // Select the interrupt mode according to the actual circuit
-#endif
-
             struct bma423_axes_remap remap_data;
             remap_data.x_axis = 0;
             remap_data.x_axis_sign = 1;
@@ -122,6 +122,19 @@ class AccelerometerThread : public concurrency::OSThread
             // It corresponds to isDoubleClick interrupt
             bmaSensor.enableWakeupInterrupt();
         }
+
+#ifdef ACCELEROMETER_INT_PIN
+        // Either edge, as the sensors differ in polarity, we read what it was for over I2C anyway
+        accelerometerIntThread = this;
+        pinMode(ACCELEROMETER_INT_PIN, INPUT);
+        attachInterrupt(
+            ACCELEROMETER_INT_PIN,
+            [] {
+                BaseType_t higherWake = 0;
+                accelerometerIntThread->wakeFromISR(&higherWake);
+            },
+            CHANGE);
+#endif
     }
 
   protected:
@@ -130,9 +143,11 @@ class AccelerometerThread : public concurrency::OSThread
         canSleep = true; // Assume we should not keep the board awake
 
         if (acceleremoter_type == ScanI2C::DeviceType::MPU6050 && mpu.getMotionInterruptStatus()) {
+            GPS::noteMotion();
             wakeScreen();
         } else if (acceleremoter_type == ScanI2C::DeviceType::LIS3DH && lis.getClick() > 0) {
             uint8_t click = lis.getClick();
+            GPS::noteMotion(); // a tap is the closest the LIS3DH comes to telling us we moved
             if (!config.device.double_tap_as_button_press) {
                 wakeScreen();
             }
@@ -143,12 +158,17 @@ class AccelerometerThread : public concurrency::OSThread
             }
         } else if (acceleremoter_type == ScanI2C::DeviceType::BMA423 && bmaSensor.getINT()) {
             if (bmaSensor.isTilt() || bmaSensor.isDoubleClick()) {
+                GPS::noteMotion();
                 wakeScreen();
                 return 500;
             }
         }
 
+#ifdef ACCELEROMETER_INT_PIN
+        return INT32_MAX; // until the sensor's interrupt wakes us
+#else
         return ACCELEROMETER_CHECK_INTERVAL_MS;
+#endif
     }
 
   private:
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Who is using the channel: airtime by key (an originating node, or a portnum), for the K keys which used most of it.
+ * A Space-Saving sketch, so memory stays fixed however many nodes we hear: a new key takes over the entry of whoever
+ * has used least, starting from that count (which we keep as its error, how much we may be overcounting it).  Any key
+ * with more than 1/K of the total is sure to be in here.
+ *
+ * Counts are kept in two windows, rotate() starts a new one, and get() is the sum of both: a sliding window of between one
+ * and two rotations.  Entries nobody used in either window are freed.
+ */
+template <uint8_t K> class AirtimeSketch
+{
+  public:
+    struct Entry {
+        uint32_t key;
+        uint32_t msec[2]; // this window, and the last
+        uint32_t error;   // we may be overcounting by up to this
+
+        uint32_t getMsec() const { return msec[0] + msec[1]; }
+    };
+
+    void add(uint32_t key, uint32_t msec)
+    {
+        Entry *e = find(key);
+        if (!e) {
+            if (numEntries < K) {
+                e = &entries[numEntries++];
+                *e = Entry{key, {0, 0}, 0};
+            } else {
+                // Space-Saving: whoever has least gives us their entry, and their count as our error
+                e = &entries[0];
+                for (uint8_t i = 1; i < K; i++)
+                    if (entries[i].getMsec() < e->getMsec())
+                        e = &entries[i];
+                uint32_t min = e->getMsec();
+                *e = Entry{key, {min, 0}, min};
+            }
+        }
+        e->msec[0] += msec;
+        total += msec;
+    }
+
+    /// Start a new window, forgetting the one before the last
+    void rotate()
+    {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < numEntries; i++) {
+            Entry e = entries[i];
+            e.msec[1] = e.msec[0];
+            e.msec[0] = 0;
+            if (e.error > e.msec[1])
+                e.error = e.msec[1];
+            if (e.msec[1])
+                entries[n++] = e;
+        }
+        numEntries = n;
+        totalLast = total;
+        total = 0;
+    }
+
+    /// @return the airtime key used in our two windows, 0 if it isn't in our top K
+    uint32_t get(uint32_t key) const
+    {
+        for (uint8_t i = 0; i < numEntries; i++)
+            if (entries[i].key == key)
+                return entries[i].getMsec();
+        return 0;
+    }
+
+    /// @return all the airtime we have counted in our two windows, whoever used it
+    uint32_t getTotalMsec() const { return total + totalLast; }
+
+    /// Put (at most max of) our entries in out, most airtime first.  @return how many
+    uint8_t getTop(const Entry **out, uint8_t max) const
+    {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < numEntries; i++) {
+            // insertion sort, K is small
+            uint8_t j = n < max ? n++ : max;
+            while (j > 0 && out[j - 1]->getMsec() < entries[i].getMsec()) {
+                if (j < max)
+                    out[j] = out[j - 1];
+                j--;
+            }
+            if (j < max)
+                out[j] = &entries[i];
+        }
+        return n;
+    }
+
+  private:
+    Entry entries[K];
+    uint8_t numEntries = 0;
+    uint32_t total = 0, totalLast = 0;
+
+    Entry *find(uint32_t key)
+    {
+        for (uint8_t i = 0; i < numEntries; i++)
+            if (entries[i].key == key)
+                return &entries[i];
+        return NULL;
+    }
+};
@@ -1,5 +1,8 @@
 #include "BluetoothCommon.h"
 #include "configuration.h"
+#include "main.h"
+#include "mesh/PhoneAPI.h"
+#include <algorithm>
 
 // NRF52 wants these constants as byte arrays
 // Generated here https://yupana-engineering.com/online-uuid-to-c-array-converter - but in REVERSE BYTE ORDER
@@ -10,4 +13,175 @@ const uint8_t TORADIO_UUID_16[16u] = {0xe7, 0x01, 0x44, 0x12, 0x66, 0x78, 0xdd,
 const uint8_t FROMRADIO_UUID_16[16u] = {0x02, 0x00, 0x12, 0xac, 0x42, 0x02, 0x78, 0xb8,
                                         0xed, 0x11, 0x93, 0x49, 0x9e, 0xe6, 0x55, 0x2c};
 const uint8_t FROMNUM_UUID_16[16u] = {0x53, 0x44, 0xe3, 0x47, 0x75, 0xaa, 0x70, 0xa6,
-                                      0x66, 0x4f, 0x00, 0xa8, 0x8c, 0xa1, 0x9d, 0xed};
\ No newline at end of file
+                                      0x66, 0x4f, 0x00, 0xa8, 0x8c, 0xa1, 0x9d, 0xed};
+const uint8_t FROMRADIO_STREAM_UUID_16[16u] = {0x84, 0x52, 0x5b, 0xea, 0x74, 0x77, 0x0a, 0xa1,
+                                               0xef, 0x4d, 0x66, 0x01, 0x77, 0x0e, 0xc5, 0xec};
+
+BluetoothFromRadioStream::BluetoothFromRadioStream(PhoneAPI *_api) : concurrency::OSThread("BLEStream"), api(_api)
+{
+    enabled = false; // until someone subscribes
+}
+
+void BluetoothFromRadioStream::onSubscribe(bool subscribed)
+{
+    LOG_INFO("BLE FromRadio stream %s\n", subscribed ? "subscribed" : "unsubscribed");
+    frameLen = frameSent = 0;
+    chunkLen = 0;
+    if (subscribed)
+        wake();
+}
+
+void BluetoothFromRadioStream::wake()
+{
+    enabled = true;
+    setIntervalFromNow(0);
+    runASAP = true;
+}
+
+bool BluetoothFromRadioStream::fillChunk(size_t maxLen)
+{
+    while (chunkLen < maxLen) {
+        if (frameSent == frameLen) {
+            size_t len = api->getFromRadio(frame + 4);
+            if (!len)
+                break;
+            // The same framing as StreamAPI::emitTxBuffer()
+            frame[0] = 0x94;
+            frame[1] = 0xc3;
+            frame[2] = (len >> 8) & 0xff;
+            frame[3] = len & 0xff;
+            frameLen = len + 4;
+            frameSent = 0;
+        }
+
+        size_t n = std::min(maxLen - chunkLen, frameLen - frameSent);
+        memcpy(chunk + chunkLen, frame + frameSent, n);
+        chunkLen += n;
+        frameSent += n;
+    }
+    return chunkLen > 0;
+}
+
+int32_t BluetoothFromRadioStream::runOnce()
+{
+    if (!isSubscribed())
+        return disable();
+
+    size_t maxChunk = std::min(getMaxChunk(), sizeof(chunk));
+    for (int i = 0; i < FROMRADIO_STREAM_CHUNKS_PER_RUN; i++) {
+        if (!chunkLen && !fillChunk(maxChunk))
+            return disable(); // nothing more for now, wake() brings us back
+        if (!notify(chunk, chunkLen))
+            return 20; // the stack is still busy with our earlier notifications
+        chunkLen = 0;
+    }
+    return 0; // more to come, but let everyone else have a turn
+}
+
+BluetoothFromNumNotifier::BluetoothFromNumNotifier() : concurrency::OSThread("BLEFromNum")
+{
+    enabled = false; // until a burst needs us
+}
+
+void BluetoothFromNumNotifier::onNowHasData(uint32_t fromRadioNum)
+{
+    pendingNum = fromRadioNum;
+    numChanges++;
+    if (pending)
+        return; // the notification we have coming will carry it
+
+    pending = true;
+    uint32_t since = millis() - lastSentMsec;
+    if (!everSent || since >= FROMNUM_COALESCE_MSEC) {
+        sendPending();
+    } else {
+        enabled = true;
+        setIntervalFromNow(FROMNUM_COALESCE_MSEC - since);
+    }
+}
+
+void BluetoothFromNumNotifier::sendPending()
+{
+    pending = false;
+    everSent = true;
+    lastSentMsec = millis();
+    numSent++;
+    LOG_DEBUG("BLE notify fromNum %u (%u notifications for %u changes)\n", pendingNum, numSent, numChanges);
+    notify(pendingNum);
+}
+
+int32_t BluetoothFromNumNotifier::runOnce()
+{
+    if (pending)
+        sendPending();
+    return disable();
+}
+
+static const char *linkModeNames[] = {"none", "fast", "idle"};
+
+BluetoothLinkManager::BluetoothLinkManager(PhoneAPI *_api) : concurrency::OSThread("BLELink"), api(_api)
+{
+    enabled = false; // until a client connects
+}
+
+void BluetoothLinkManager::onConnect()
+{
+    lastActivityMsec = millis();
+    connected = true;
+    enabled = true;
+    wake();
+}
+
+void BluetoothLinkManager::onDisconnect()
+{
+    connected = false;
+    wake();
+}
+
+void BluetoothLinkManager::noteActivity()
+{
+    lastActivityMsec = millis();
+    if (mode == LINK_IDLE)
+        wake(); // speed the link up now rather than at our next poll
+}
+
+uint32_t BluetoothLinkManager::getModeMsec(Mode m) const
+{
+    return modeMsec[m] + (m == mode ? millis() - modeSinceMsec : 0);
+}
+
+void BluetoothLinkManager::setMode(Mode m)
+{
+    if (m == mode)
+        return;
+
+    uint32_t now = millis();
+    uint32_t spent = now - modeSinceMsec;
+    modeMsec[mode] += spent;
+    LOG_INFO("BLE link %s, after %u s %s (%u s fast, %u s idle so far)\n", linkModeNames[m], spent / 1000, linkModeNames[mode],
+             modeMsec[LINK_FAST] / 1000, modeMsec[LINK_IDLE] / 1000);
+    mode = m;
+    modeSinceMsec = now;
+    numSwitches++;
+
+    bool ok = true;
+    if (m == LINK_FAST)
+        ok = requestParams(BLE_LINK_FAST_MIN_INTERVAL, BLE_LINK_FAST_MAX_INTERVAL, BLE_LINK_FAST_LATENCY, BLE_LINK_FAST_TIMEOUT);
+    else if (m == LINK_IDLE)
+        ok = requestParams(BLE_LINK_IDLE_MIN_INTERVAL, BLE_LINK_IDLE_MAX_INTERVAL, BLE_LINK_IDLE_LATENCY, BLE_LINK_IDLE_TIMEOUT);
+    if (!ok)
+        LOG_WARN("BLE link: couldn't ask for %s connection parameters\n", linkModeNames[m]);
+}
+
+int32_t BluetoothLinkManager::runOnce()
+{
+    if (!connected) {
+        setMode(LINK_NONE);
+        return disable(); // onConnect() brings us back
+    }
+
+    bool busy = api->isSendingConfig() || api->getForPhoneBacklog() >= BLE_LINK_BUSY_BACKLOG ||
+                millis() - lastActivityMsec < BLE_LINK_IDLE_SECS * 1000UL;
+    setMode(busy ? LINK_FAST : LINK_IDLE);
+    return 1000;
+}
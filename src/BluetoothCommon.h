@@ -1,7 +1,11 @@
 #pragma once
 
+#include "concurrency/OSThread.h"
+#include "mesh/mesh-pb-constants.h"
 #include <Arduino.h>
 
+class PhoneAPI;
+
 /**
  * Common lib functions for all platforms that have bluetooth
  */
@@ -12,9 +16,61 @@
 #define FROMRADIO_UUID "2c55e69e-4993-11ed-b878-0242ac120002"
 #define FROMNUM_UUID "ed9da18c-a800-4f66-a670-aa7547e34453"
 
+/// Notify only: clients which subscribe get all their FromRadios pushed, see BluetoothFromRadioStream
+#define FROMRADIO_STREAM_UUID "ecc50e77-0166-4def-a10a-7774ea5b5284"
+
+/// The most we put in one FROMRADIO_STREAM notification (the largest attribute value BLE allows), less if the MTU is smaller
+#define FROMRADIO_STREAM_CHUNK_SIZE 512
+
+/// How many notifications BluetoothFromRadioStream sends before letting the rest of the system run
+#ifndef FROMRADIO_STREAM_CHUNKS_PER_RUN
+#define FROMRADIO_STREAM_CHUNKS_PER_RUN 8
+#endif
+
+/// The connection we ask for while the client is busy with us (a config download or a burst of packets): intervals in units
+/// of 1.25 msec (7.5 msec is the fastest BLE allows), no slave latency, supervision timeout in units of 10 msec
+#ifndef BLE_LINK_FAST_MIN_INTERVAL
+#define BLE_LINK_FAST_MIN_INTERVAL 6
+#endif
+#ifndef BLE_LINK_FAST_MAX_INTERVAL
+#define BLE_LINK_FAST_MAX_INTERVAL 12
+#endif
+#define BLE_LINK_FAST_LATENCY 0
+#define BLE_LINK_FAST_TIMEOUT 200
+
+/// ...and once it has gone quiet, so both radios sleep between connection events (and ours skips up to LATENCY of them when
+/// we have nothing to send).  The timeout has to outlast (1 + latency) max intervals, twice over
+#ifndef BLE_LINK_IDLE_MIN_INTERVAL
+#define BLE_LINK_IDLE_MIN_INTERVAL 80
+#endif
+#ifndef BLE_LINK_IDLE_MAX_INTERVAL
+#define BLE_LINK_IDLE_MAX_INTERVAL 160
+#endif
+#ifndef BLE_LINK_IDLE_LATENCY
+#define BLE_LINK_IDLE_LATENCY 4
+#endif
+#define BLE_LINK_IDLE_TIMEOUT 600
+
+/// How long nothing has to go either way before we slow the link down
+#ifndef BLE_LINK_IDLE_SECS
+#define BLE_LINK_IDLE_SECS 10
+#endif
+
+/// FROMNUM notifications closer together than this go out as one (with the newest fromNum), so a burst of packets for the
+/// phone is one notification rather than a storm of them
+#ifndef FROMNUM_COALESCE_MSEC
+#define FROMNUM_COALESCE_MSEC 100
+#endif
+
+/// This many packets waiting for the client is a burst worth a fast link
+#ifndef BLE_LINK_BUSY_BACKLOG
+#define BLE_LINK_BUSY_BACKLOG 4
+#endif
+
 // NRF52 wants these constants as byte arrays
 // Generated here https://yupana-engineering.com/online-uuid-to-c-array-converter - but in REVERSE BYTE ORDER
-extern const uint8_t MESH_SERVICE_UUID_16[], TORADIO_UUID_16[16u], FROMRADIO_UUID_16[], FROMNUM_UUID_16[];
+extern const uint8_t MESH_SERVICE_UUID_16[], TORADIO_UUID_16[16u], FROMRADIO_UUID_16[], FROMNUM_UUID_16[],
+    FROMRADIO_STREAM_UUID_16[];
 
 /// Given a level between 0-100, update the BLE attribute
 void updateBatteryLevel(uint8_t level);
@@ -27,4 +83,122 @@ class BluetoothApi
     virtual void clearBonds();
     virtual bool isConnected();
     virtual int getRssi() = 0;
-};
\ No newline at end of file
+};
+
+/**
+ * Our high throughput mode: rather than reading FROMRADIO once per frame (a round trip each), a client can subscribe to
+ * FROMRADIO_STREAM and we push it everything getFromRadio() has, as fast as the link takes it.  The frames are framed like
+ * StreamAPI's (0x94 0xc3, then a big endian 16 bit length), so as many of them as fit go in each notification and a frame
+ * can straddle two.  Subscribing also asks for the longest data length the link supports (BluetoothLinkManager keeps the
+ * connection interval short while the client is busy).
+ */
+class BluetoothFromRadioStream : public concurrency::OSThread
+{
+    PhoneAPI *api;
+
+    /// The frame we are sending, and how much of it went out already
+    uint8_t frame[4 + meshtastic_FromRadio_size];
+    size_t frameLen = 0, frameSent = 0;
+
+    /// The notification we built, but which the BLE stack didn't have room for yet
+    uint8_t chunk[FROMRADIO_STREAM_CHUNK_SIZE];
+    size_t chunkLen = 0;
+
+    /// Pack as many frame bytes as fit into chunk (continuing any frame we started), @return false if we had none
+    bool fillChunk(size_t maxLen);
+
+  public:
+    explicit BluetoothFromRadioStream(PhoneAPI *_api);
+
+    /// The client subscribed (or unsubscribed), a new subscription starts with a fresh frame
+    void onSubscribe(bool subscribed);
+
+    /// The client might have something new to fetch (call after handing it a ToRadio, or when we have a new FromRadio)
+    void wake();
+
+  protected:
+    virtual int32_t runOnce() override;
+
+    /// @return true if the client is subscribed to FROMRADIO_STREAM
+    virtual bool isSubscribed() = 0;
+
+    /// @return how many bytes fit in one notification, given the MTU we negotiated
+    virtual size_t getMaxChunk() = 0;
+
+    /// Notify the client of len bytes, @return false if the BLE stack had no room (we try the same bytes again later)
+    virtual bool notify(const uint8_t *bytes, size_t len) = 0;
+};
+
+/**
+ * Sends our FROMNUM notifications: the first of a burst straight away, then at most one per FROMNUM_COALESCE_MSEC carrying
+ * the newest fromNum (a client only needs to know there is something new, it reads everything up to there anyway).
+ */
+class BluetoothFromNumNotifier : public concurrency::OSThread
+{
+    uint32_t pendingNum = 0;
+    bool pending = false;
+    uint32_t lastSentMsec = 0;
+    bool everSent = false;
+
+    /// How many fromNums we were told of, and how many notifications those took
+    uint32_t numChanges = 0, numSent = 0;
+
+    void sendPending();
+
+  public:
+    BluetoothFromNumNotifier();
+
+    /// fromRadioNum is new, notify the client now or when FROMNUM_COALESCE_MSEC since the last notification is up
+    void onNowHasData(uint32_t fromRadioNum);
+
+  protected:
+    virtual int32_t runOnce() override;
+
+    /// Notify the client of FROMNUM's new value
+    virtual void notify(uint32_t fromRadioNum) = 0;
+};
+
+/**
+ * Picks the connection parameters to ask the central for: the fastest interval while the client downloads its config, has a
+ * backlog of packets waiting or has talked to us in the last BLE_LINK_IDLE_SECS, and a long interval with slave latency
+ * once it's quiet, to save power on the phone and on us.  How long the link spends each way is added up (and logged when
+ * it changes), so the saving can be seen.  The central has the last word, it may pick within what we ask for or ignore us.
+ */
+class BluetoothLinkManager : public concurrency::OSThread
+{
+  public:
+    enum Mode { LINK_NONE, LINK_FAST, LINK_IDLE, LINK_NUM_MODES };
+
+    explicit BluetoothLinkManager(PhoneAPI *_api);
+
+    /// A client connected (it's about to download its config) or went, call from any task
+    void onConnect();
+    void onDisconnect();
+
+    /// The client wrote or read something (what we push it unasked doesn't count, a backlog of that does), call from any task
+    void noteActivity();
+
+    Mode getMode() const { return mode; }
+
+    /// @return msecs spent in mode m since boot, including the stretch we're in now
+    uint32_t getModeMsec(Mode m) const;
+
+    uint32_t getNumSwitches() const { return numSwitches; }
+
+  protected:
+    virtual int32_t runOnce() override;
+
+    /// Ask the central for these parameters (see BLE_LINK_FAST_MIN_INTERVAL for the units), @return false if we couldn't
+    virtual bool requestParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) = 0;
+
+  private:
+    PhoneAPI *api;
+    volatile bool connected = false;
+    Mode mode = LINK_NONE;
+    uint32_t modeSinceMsec = 0;
+    volatile uint32_t lastActivityMsec = 0;
+    uint32_t modeMsec[LINK_NUM_MODES] = {};
+    uint32_t numSwitches = 0;
+
+    void setMode(Mode m);
+};
@@ -0,0 +1,85 @@
+#include "BootTimeline.h"
+#include <Arduino.h>
+#include <stdio.h>
+
+BootTimeline bootTimeline;
+
+void BootTimeline::add(const char *name, bool isMilestone)
+{
+    if (numEntries >= BOOT_TIMELINE_ENTRIES)
+        return;
+    Entry &e = entries[numEntries];
+    e.name = name;
+    e.atMsec = millis();
+    e.isMilestone = isMilestone;
+    numEntries++; // last, for the phone or web server reading us from another task
+}
+
+void BootTimeline::mark(const char *name)
+{
+    add(name, false);
+}
+
+void BootTimeline::milestone(const char *name)
+{
+    for (uint8_t i = 0; i < numEntries; i++)
+        if (entries[i].isMilestone && entries[i].name == name)
+            return;
+    add(name, true);
+    if (setupMsec)
+        LOG_DEBUG("Boot %s at %ums\n", name, entries[numEntries - 1].atMsec);
+}
+
+void BootTimeline::firstRx()
+{
+    firstRxMsec = millis() | 1; // never 0, which means we've heard nothing yet
+    LOG_INFO("Boot first packet heard at %ums\n", firstRxMsec);
+}
+
+void BootTimeline::finish()
+{
+    setupMsec = millis() | 1;
+    log();
+}
+
+uint32_t BootTimeline::getStageMsec(uint8_t i) const
+{
+    if (entries[i].isMilestone)
+        return 0;
+    // from the last stage before us, milestones aren't stages
+    uint32_t from = 0;
+    for (uint8_t j = i; j-- > 0;)
+        if (!entries[j].isMilestone) {
+            from = entries[j].atMsec;
+            break;
+        }
+    return entries[i].atMsec - from;
+}
+
+bool BootTimeline::getSummaryLine(uint8_t line, char *buf, size_t bufLen) const
+{
+    if (line < numEntries) {
+        const Entry &e = entries[line];
+        if (e.isMilestone)
+            snprintf(buf, bufLen, "%s at %ums", e.name, e.atMsec);
+        else
+            snprintf(buf, bufLen, "%s %ums (at %ums)", e.name, getStageMsec(line), e.atMsec);
+        return true;
+    }
+
+    if (line == numEntries) {
+        snprintf(buf, bufLen, "setup %ums first rx %ums", setupMsec, firstRxMsec);
+        return true;
+    }
+
+    return false;
+}
+
+void BootTimeline::log() const
+{
+    char line[64];
+    for (uint8_t i = 0; i < getNumLines(); i++) {
+        getSummaryLine(i, line, sizeof(line));
+        LOG_INFO("Boot %s\n", line);
+    }
+}
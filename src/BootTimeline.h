@@ -0,0 +1,92 @@
+#pragma once
+
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Time each stage of setup(), and how long after power on we first heard the mesh
+#ifndef BOOT_TIMELINE
+#define BOOT_TIMELINE 1
+#endif
+
+/// The most stages and milestones we keep, any more are left out
+#ifndef BOOT_TIMELINE_ENTRIES
+#define BOOT_TIMELINE_ENTRIES 32
+#endif
+
+/**
+ * Where our boot time goes.  setup() marks the end of each of its stages with BOOT_STAGE("name"), and each stage is charged
+ * the time since the one before it (the first, since reset), so a stage that's grown slow stands out without anyone having
+ * to go and instrument it.  What finishes after setup() has returned, on its own thread (GPS probing, Bluetooth coming up), is
+ * a milestone instead: BOOT_MILESTONE("name") keeps when it first happened.  So does the first packet the radio hears, which
+ * is what a sensor that wakes on a schedule wants to bring forward.
+ *
+ * Logged once setup() is done, and shown in /json/report and to the phone as log records, like RadioStats.
+ */
+class BootTimeline
+{
+  public:
+    /// The stage name (a string literal, which we keep a pointer to) has just finished
+    void mark(const char *name);
+
+    /// name (a string literal) has happened, if it hasn't already
+    void milestone(const char *name);
+
+    /// The radio has heard a packet, cheap enough for every one
+    void markFirstRx()
+    {
+        if (!firstRxMsec)
+            firstRx();
+    }
+
+    /// setup() is done, log the timeline
+    void finish();
+
+    /// msec since reset setup() took, 0 until it's done
+    uint32_t getSetupMsec() const { return setupMsec; }
+
+    /// msec since reset we first heard a packet, 0 if we haven't yet
+    uint32_t getFirstRxMsec() const { return firstRxMsec; }
+
+    struct Entry {
+        const char *name;
+        uint32_t atMsec; // since reset
+        bool isMilestone;
+    };
+
+    uint8_t getNumEntries() const { return numEntries; }
+    const Entry &getEntry(uint8_t i) const { return entries[i]; }
+
+    /// msec entry i took, from the stage before it.  0 for a milestone
+    uint32_t getStageMsec(uint8_t i) const;
+
+    /// One line per entry, then one for the total
+    uint8_t getNumLines() const { return numEntries + 1; }
+
+    /// Like RadioStats::getSummaryLine().  @return false if there is no such line
+    bool getSummaryLine(uint8_t line, char *buf, size_t bufLen) const;
+
+    void log() const;
+
+  private:
+    Entry entries[BOOT_TIMELINE_ENTRIES];
+    uint8_t numEntries = 0;
+    uint32_t setupMsec = 0, firstRxMsec = 0;
+
+    void add(const char *name, bool isMilestone);
+    void firstRx();
+};
+
+extern BootTimeline bootTimeline;
+
+#if BOOT_TIMELINE
+#define BOOT_STAGE(name) bootTimeline.mark(name)
+#define BOOT_MILESTONE(name) bootTimeline.milestone(name)
+#define BOOT_FIRST_RX() bootTimeline.markFirstRx()
+#define BOOT_FINISHED() bootTimeline.finish()
+#else
+#define BOOT_STAGE(name)
+#define BOOT_MILESTONE(name)
+#define BOOT_FIRST_RX()
+#define BOOT_FINISHED()
+#endif
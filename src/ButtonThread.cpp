@@ -22,14 +22,18 @@
 using namespace concurrency;
 
 volatile ButtonThread::ButtonEventType ButtonThread::btnEvent = ButtonThread::BUTTON_EVENT_NONE;
+ButtonThread *ButtonThread::instance;
 
 ButtonThread::ButtonThread() : OSThread("Button")
 {
+    instance = this;
+    setPriority(PRIORITY_UI);
 #if defined(ARCH_PORTDUINO) || defined(BUTTON_PIN)
 #if defined(ARCH_PORTDUINO)
-    if (settingsMap.count(user) != 0 && settingsMap[user] != RADIOLIB_NC) {
-        userButton = OneButton(settingsMap[user], true, true);
-        LOG_DEBUG("Using GPIO%02d for button\n", settingsMap[user]);
+    if (portduinoSettings.userButton != RADIOLIB_NC) {
+        userButtonPin = portduinoSettings.userButton;
+        userButton = OneButton(userButtonPin, true, true);
+        LOG_DEBUG("Using GPIO%02d for button\n", userButtonPin);
     }
 #elif defined(BUTTON_PIN)
     int pin = config.device.button_gpio ? config.device.button_gpio : BUTTON_PIN;
@@ -52,16 +56,17 @@ ButtonThread::ButtonThread() : OSThread("Button")
     userButton.attachLongPressStop(userButtonPressedLongStop);
 #endif
 #if defined(ARCH_PORTDUINO)
-    if (settingsMap.count(user) != 0 && settingsMap[user] != RADIOLIB_NC)
-        wakeOnIrq(settingsMap[user], FALLING);
+    if (userButtonPin >= 0)
+        wakeOnIrq(userButtonPin, CHANGE);
 #else
     static OneButton *pBtn = &userButton; // only one instance of ButtonThread is created, so static is safe
     attachInterrupt(
         pin,
         []() {
-            BaseType_t higherWake = 0;
-            mainDelay.interruptFromISR(&higherWake);
+            // Ticking here too catches a press shorter than it takes us to run
             pBtn->tick();
+            BaseType_t higherWake = 0;
+            instance->wakeFromISR(&higherWake);
         },
         CHANGE);
 #endif
@@ -79,13 +84,13 @@ ButtonThread::ButtonThread() : OSThread("Button")
     userButtonAlt.attachDoubleClick(userButtonDoublePressed);
     userButtonAlt.attachLongPressStart(userButtonPressedLongStart);
     userButtonAlt.attachLongPressStop(userButtonPressedLongStop);
-    wakeOnIrq(BUTTON_PIN_ALT, FALLING);
+    wakeOnIrq(BUTTON_PIN_ALT, CHANGE);
 #endif
 
 #ifdef BUTTON_PIN_TOUCH
     userButtonTouch = OneButton(BUTTON_PIN_TOUCH, true, true);
     userButtonTouch.attachClick(touchPressed);
-    wakeOnIrq(BUTTON_PIN_TOUCH, FALLING);
+    wakeOnIrq(BUTTON_PIN_TOUCH, CHANGE);
 #endif
 }
 
@@ -98,7 +103,7 @@ int32_t ButtonThread::runOnce()
     userButton.tick();
     canSleep &= userButton.isIdle();
 #elif defined(ARCH_PORTDUINO)
-    if (settingsMap.count(user) != 0 && settingsMap[user] != RADIOLIB_NC) {
+    if (userButtonPin >= 0) {
         userButton.tick();
         canSleep &= userButton.isIdle();
     }
@@ -125,8 +130,7 @@ int32_t ButtonThread::runOnce()
             }
 #endif
 #if defined(ARCH_PORTDUINO)
-            if ((settingsMap.count(user) != 0 && settingsMap[user] != RADIOLIB_NC) &&
-                    (settingsMap[user] != moduleConfig.canned_message.inputbroker_pin_press) ||
+            if ((userButtonPin >= 0 && userButtonPin != (int)moduleConfig.canned_message.inputbroker_pin_press) ||
                 !moduleConfig.canned_message.enabled) {
                 powerFSM.trigger(EVENT_PRESS);
             }
@@ -186,11 +190,19 @@ int32_t ButtonThread::runOnce()
         btnEvent = BUTTON_EVENT_NONE;
     }
 
-    return 50;
+    // Idle buttons only change on an edge, which wakes us
+    bool waitForEdge = canSleep;
+#ifdef BUTTON_PIN
+    // ... unless the canned message input broker took the interrupt of a pin we share with it
+    if (moduleConfig.canned_message.enabled &&
+        (config.device.button_gpio ? config.device.button_gpio : BUTTON_PIN) == moduleConfig.canned_message.inputbroker_pin_press)
+        waitForEdge = false;
+#endif
+    return waitForEdge ? INT32_MAX : c_busyPollTime;
 }
 
 /**
- * Watch a GPIO and if we get an IRQ, wake the main thread.
+ * Watch a GPIO and if we get an IRQ, wake us (and so the main thread).
  * Use to add wake on button press
  */
 void ButtonThread::wakeOnIrq(int irq, int mode)
@@ -199,9 +211,9 @@ void ButtonThread::wakeOnIrq(int irq, int mode)
         irq,
         [] {
             BaseType_t higherWake = 0;
-            mainDelay.interruptFromISR(&higherWake);
+            instance->wakeFromISR(&higherWake);
         },
-        FALLING);
+        mode);
 }
 
 void ButtonThread::userButtonPressedLongStart()
@@ -9,6 +9,7 @@ class ButtonThread : public concurrency::OSThread
   public:
     static const uint32_t c_longPressTime = 5000; // shutdown after 5s
     static const uint32_t c_holdOffTime = 30000;  // hold off 30s after boot
+    static const uint32_t c_busyPollTime = 50;    // how often we tick our buttons while one of them isn't idle
 
     enum ButtonEventType {
         BUTTON_EVENT_NONE,
@@ -35,11 +36,16 @@ class ButtonThread : public concurrency::OSThread
 #endif
 #if defined(ARCH_PORTDUINO)
     OneButton userButton;
+    int userButtonPin = -1; // from portduinoSettings, -1 for none
 #endif
 
+    /// The one of us, for our interrupts to wake
+    static ButtonThread *instance;
+
     // set during IRQ
     static volatile ButtonEventType btnEvent;
 
+    /// Have each edge on irq wake us, so we only need tick our buttons while one is pressed (or its click is pending)
     static void wakeOnIrq(int irq, int mode);
 
     // IRQ callbacks
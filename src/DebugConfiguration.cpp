@@ -89,6 +89,13 @@ void Syslog::enable()
 void Syslog::disable()
 {
     this->_enabled = false;
+#if SYSLOG_BATCH_BYTES
+    // We have lost the network, so what we were holding is lost too
+    this->_numDropped += this->_batchLines;
+    this->_numDroppedUnreported += this->_batchLines;
+    this->_batchLen = 0;
+    this->_batchLines = 0;
+#endif
 }
 
 bool Syslog::isEnabled()
@@ -126,6 +133,11 @@ bool Syslog::vlogf(uint16_t pri, const char *appName, const char *fmt, va_list a
     return result;
 }
 
+bool Syslog::log(uint16_t pri, const char *appName, const char *message)
+{
+    return this->_sendLog(pri, appName ? appName : this->_appName, message);
+}
+
 inline bool Syslog::_sendLog(uint16_t pri, const char *appName, const char *message)
 {
     int result;
@@ -144,14 +156,28 @@ inline bool Syslog::_sendLog(uint16_t pri, const char *appName, const char *mess
     if ((pri & LOG_FACMASK) == 0)
         pri = LOG_MAKEPRI(LOG_FAC(this->_priDefault), pri);
 
+#if SYSLOG_BATCH_BYTES
+    if (this->_appendLog(pri, appName, message))
+        return true;
+    if (this->_batchLen) {
+        this->flush();
+        if (this->_appendLog(pri, appName, message))
+            return true;
+    }
+    // Too long for a batch of its own, so it goes by itself
+#endif
+
     if (this->_server != NULL) {
         result = this->_client->beginPacket(this->_server, this->_port);
     } else {
         result = this->_client->beginPacket(this->_ip, this->_port);
     }
 
-    if (result != 1)
+    if (result != 1) {
+        this->_numDropped++;
+        this->_numDroppedUnreported++;
         return false;
+    }
 
     this->_client->print('<');
     this->_client->print(pri);
@@ -164,8 +190,74 @@ inline bool Syslog::_sendLog(uint16_t pri, const char *appName, const char *mess
     this->_client->print(int(millis() / 1000));
     this->_client->print(F("]: "));
     this->_client->print(message);
-    this->_client->endPacket();
+    if (!this->_client->endPacket()) {
+        this->_numDropped++;
+        this->_numDroppedUnreported++;
+        return false;
+    }
+    this->_numSent++;
+
+    return true;
+}
+
+#if SYSLOG_BATCH_BYTES
+bool Syslog::_appendLog(uint16_t pri, const char *appName, const char *message)
+{
+    // Our log lines end in a newline, which is what separates the lines of a batch
+    size_t len = strlen(message);
+    const char *newline = (len && message[len - 1] == '\n') ? "" : "\n";
+    size_t room = sizeof(this->_batch) - this->_batchLen;
+    int n = snprintf(this->_batch + this->_batchLen, room, "<%u>1 - %s %s - - - \xEF\xBB\xBF[%u]: %s%s", pri,
+                     this->_deviceHostname, appName, (unsigned)(millis() / 1000), message, newline);
+    if (n < 0 || (size_t)n >= room)
+        return false;
+    this->_batchLen += n;
+    this->_batchLines++;
+    return true;
+}
+#endif
+
+void Syslog::flush()
+{
+#if SYSLOG_BATCH_BYTES
+    if (!this->_batchLen)
+        return;
+
+    // Say what we have lost, if there's room
+    uint32_t reported = this->_numDroppedUnreported;
+    if (reported) {
+        char line[48];
+        snprintf(line, sizeof(line), "(%u syslog lines dropped)\n", (unsigned)reported);
+        if (this->_appendLog(LOG_MAKEPRI(LOG_FAC(this->_priDefault), SYSLOG_WARN), this->_appName, line)) {
+            this->_batchLines--; // not one of the lines we were given
+            this->_numDroppedUnreported = 0;
+        } else {
+            reported = 0;
+        }
+    }
+
+    if (!this->_sendDatagram(this->_batch, this->_batchLen, this->_batchLines))
+        this->_numDroppedUnreported += reported; // so we try to report those again
+    this->_batchLen = 0;
+    this->_batchLines = 0;
+#endif
+}
+
+bool Syslog::_sendDatagram(const char *data, size_t len, uint16_t lines)
+{
+    int result;
+    if (this->_server != NULL) {
+        result = this->_client->beginPacket(this->_server, this->_port);
+    } else {
+        result = this->_client->beginPacket(this->_ip, this->_port);
+    }
 
+    if (result != 1 || this->_client->write((const uint8_t *)data, len) != len || !this->_client->endPacket()) {
+        this->_numDropped += lines;
+        this->_numDroppedUnreported += lines;
+        return false;
+    }
+    this->_numSent++;
     return true;
 }
 
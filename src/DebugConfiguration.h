@@ -16,6 +16,12 @@
 #define SERIAL_BAUD 115200 // Serial debug baud rate
 #endif
 
+/// Keep LOG_DEBUG/LOG_INFO/LOG_TRACE formats out of the image, logging just a hash of each and the raw arguments.  Read the
+/// log through bin/log_decoder.py (which hashes the formats in our source) to get the text back.  Warnings and worse stay text
+#ifndef LOG_TOKENIZED
+#define LOG_TOKENIZED 0
+#endif
+
 #define MESHTASTIC_LOG_LEVEL_DEBUG "DEBUG"
 #define MESHTASTIC_LOG_LEVEL_INFO "INFO "
 #define MESHTASTIC_LOG_LEVEL_WARN "WARN "
@@ -37,12 +43,18 @@
 #define LOG_TRACE(...) SEGGER_RTT_printf(0, __VA_ARGS__)
 #else
 #ifdef DEBUG_PORT
+#if LOG_TOKENIZED
+#define LOG_DEBUG(fmt, ...) DEBUG_PORT.logTokenized(MESHTASTIC_LOG_LEVEL_DEBUG, LOG_TOKEN(fmt), ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...) DEBUG_PORT.logTokenized(MESHTASTIC_LOG_LEVEL_INFO, LOG_TOKEN(fmt), ##__VA_ARGS__)
+#define LOG_TRACE(fmt, ...) DEBUG_PORT.logTokenized(MESHTASTIC_LOG_LEVEL_TRACE, LOG_TOKEN(fmt), ##__VA_ARGS__)
+#else
 #define LOG_DEBUG(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_DEBUG, __VA_ARGS__)
 #define LOG_INFO(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_TRACE(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_TRACE, __VA_ARGS__)
+#endif
 #define LOG_WARN(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_WARN, __VA_ARGS__)
 #define LOG_ERROR(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_ERROR, __VA_ARGS__)
 #define LOG_CRIT(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_CRIT, __VA_ARGS__)
-#define LOG_TRACE(...) DEBUG_PORT.log(MESHTASTIC_LOG_LEVEL_TRACE, __VA_ARGS__)
 #else
 #define LOG_DEBUG(...)
 #define LOG_INFO(...)
@@ -119,6 +131,19 @@
 
 #if HAS_WIFI || HAS_ETHERNET
 
+/// Syslog lines are packed (one per line) into datagrams of up to this many bytes, so a burst of debug logging is a few
+/// datagrams rather than one per line.  Under a 1500 byte MTU less the IP and UDP headers, 0 sends each line by itself as
+/// RFC 5426 has it, for collectors which take each datagram as one message
+#ifndef SYSLOG_BATCH_BYTES
+#define SYSLOG_BATCH_BYTES 1400
+#endif
+
+/**
+ * Sends our log lines to a remote syslog server.  log() only adds a line to our batch, flush() (which
+ * RedirectablePrint::drainLog() calls once it has written out all the lines waiting in its ring, from the console's low
+ * priority thread) sends it.  Lines we couldn't send, because the network stack had no room or we lost the network, are
+ * counted and the count goes out in the next batch.
+ */
 class Syslog
 {
   private:
@@ -132,8 +157,23 @@ class Syslog
     uint8_t _priMask = 0xff;
     bool _enabled = false;
 
+#if SYSLOG_BATCH_BYTES
+    char _batch[SYSLOG_BATCH_BYTES];
+    size_t _batchLen = 0;
+    uint16_t _batchLines = 0;
+#endif
+    uint32_t _numSent = 0, _numDropped = 0, _numDroppedUnreported = 0;
+
     bool _sendLog(uint16_t pri, const char *appName, const char *message);
 
+#if SYSLOG_BATCH_BYTES
+    /// Add a line to our batch, @return false if it doesn't fit in what room the batch has left
+    bool _appendLog(uint16_t pri, const char *appName, const char *message);
+#endif
+
+    /// Send len bytes holding lines lines as one datagram, counting them dropped if we can't
+    bool _sendDatagram(const char *data, size_t len, uint16_t lines);
+
   public:
     explicit Syslog(UDP &client);
 
@@ -150,6 +190,18 @@ class Syslog
 
     bool vlogf(uint16_t pri, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
     bool vlogf(uint16_t pri, const char *appName, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
+
+    /// Send an already formatted message, as appName (or our default if NULL)
+    bool log(uint16_t pri, const char *appName, const char *message);
+
+    /// Send the lines we have batched up
+    void flush();
+
+    /// @return how many datagrams we have sent
+    uint32_t getNumSent() const { return _numSent; }
+
+    /// @return how many lines we have had to drop
+    uint32_t getNumDropped() const { return _numDropped; }
 };
 
 #endif // HAS_ETHERNET || HAS_WIFI
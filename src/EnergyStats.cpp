@@ -0,0 +1,165 @@
+#include "EnergyStats.h"
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+
+EnergyStats energyStats;
+
+static const char *subsystemNames[EnergyStats::NUM_SUBSYSTEMS] = {"tx", "rx", "cpu", "gps", "screen", "bluetooth"};
+
+/// What the subsystems which are simply on or off draw while they're on (0 for those we work out otherwise)
+static const float onMilliAmps[EnergyStats::NUM_SUBSYSTEMS] = {0, 0, 0, ENERGY_GPS_MA, ENERGY_SCREEN_MA, ENERGY_BLUETOOTH_MA};
+
+/// uA-msecs in a mAh
+static const float UA_MSEC_PER_MAH = 3.6e9;
+
+const char *EnergyStats::getSubsystemName(Subsystem s)
+{
+    return subsystemNames[s];
+}
+
+float EnergyStats::txMilliAmps(int8_t dBm)
+{
+    float milliWatts = powf(10, dBm / 10.0f);
+    return ENERGY_TX_BASE_MA + milliWatts / (ENERGY_PA_EFFICIENCY * ENERGY_SUPPLY_VOLTS);
+}
+
+void EnergyStats::addTx(uint32_t msec, int8_t dBm, bool relayed)
+{
+    uint64_t c = (uint64_t)msec * (uint32_t)(txMilliAmps(dBm) * 1000);
+    charge[TX] += c;
+    onMsec[TX] += msec;
+    txMsec += msec; // which the radio didn't spend listening
+    if (relayed) {
+        forwardedCharge += c;
+        forwarded++;
+    }
+}
+
+void EnergyStats::setOn(Subsystem s, bool isOn)
+{
+    if (on[s] != isOn) {
+        update(); // charge for the time it was in its old state
+        on[s] = isOn;
+    }
+}
+
+void EnergyStats::setRxMilliAmps(float milliAmps)
+{
+    update();
+    rxMilliAmps = milliAmps;
+}
+
+void EnergyStats::update()
+{
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastUpdateMsec;
+    lastUpdateMsec = now;
+
+    uint32_t listen = elapsed > txMsec ? elapsed - txMsec : 0;
+    charge[RX] += (uint64_t)listen * (uint32_t)(rxMilliAmps * 1000);
+    onMsec[RX] += listen;
+    txMsec = 0;
+
+    uint32_t asleep = sleepMsec < elapsed ? sleepMsec : elapsed;
+    uint32_t idle = idleMsec < elapsed - asleep ? idleMsec : elapsed - asleep;
+    uint32_t active = elapsed - asleep - idle;
+    charge[CPU] += (uint64_t)active * (uint32_t)(ENERGY_CPU_ACTIVE_MA * 1000) +
+                   (uint64_t)idle * (uint32_t)(ENERGY_CPU_IDLE_MA * 1000) +
+                   (uint64_t)asleep * (uint32_t)(ENERGY_CPU_SLEEP_MA * 1000);
+    onMsec[CPU] += active;
+    idleMsec = sleepMsec = 0;
+
+    for (uint8_t s = GPS; s < NUM_SUBSYSTEMS; s++) {
+        if (on[s]) {
+            charge[s] += (uint64_t)elapsed * (uint32_t)(onMilliAmps[s] * 1000);
+            onMsec[s] += elapsed;
+        }
+    }
+}
+
+uint64_t EnergyStats::getTotalCharge()
+{
+    update();
+    uint64_t total = 0;
+    for (uint8_t s = 0; s < NUM_SUBSYSTEMS; s++)
+        total += charge[s];
+    return total;
+}
+
+void EnergyStats::calibrate(float milliAmps)
+{
+    uint32_t now = millis();
+    uint64_t total = getTotalCharge();
+    uint32_t msec = now - lastCalibrationMsec;
+
+    // The first reading only starts our window, and one too soon after the last tells us little
+    if (lastCalibrationMsec && msec >= 1000 && milliAmps > 0) {
+        float estimated = (float)(total - lastCalibrationCharge) / msec / 1000;
+        if (estimated > 0) {
+            float ratio = milliAmps / estimated;
+            ratio = ratio < 0.25f ? 0.25f : (ratio > 4 ? 4 : ratio); // a reading that far off is more likely a glitch
+            calibrations++;
+            calibration += (ratio - calibration) / (calibrations < ENERGY_CALIBRATION_WEIGHT ? calibrations
+                                                                                              : ENERGY_CALIBRATION_WEIGHT);
+        }
+    }
+    lastCalibrationMsec = now | 1; // never 0, which means we've no reading yet
+    lastCalibrationCharge = total;
+}
+
+float EnergyStats::getMilliAmpHours(Subsystem s)
+{
+    update();
+    return charge[s] / UA_MSEC_PER_MAH;
+}
+
+float EnergyStats::getTotalMilliAmpHours()
+{
+    return getTotalCharge() * calibration / UA_MSEC_PER_MAH;
+}
+
+float EnergyStats::getAverageMilliAmps()
+{
+    uint32_t now = millis();
+    return now ? getTotalCharge() * calibration / now / 1000 : 0;
+}
+
+float EnergyStats::getForwardedMicroAmpHours()
+{
+    return forwarded ? forwardedCharge * calibration / forwarded / (UA_MSEC_PER_MAH / 1000) : 0;
+}
+
+uint32_t EnergyStats::getOnSecs(Subsystem s)
+{
+    update();
+    return onMsec[s] / 1000;
+}
+
+bool EnergyStats::getSummaryLine(uint8_t line, char *buf, size_t bufLen)
+{
+    if (line < NUM_SUBSYSTEMS) {
+        Subsystem s = (Subsystem)line;
+        int len = snprintf(buf, bufLen, "%s %.2fmAh on=%us", subsystemNames[s], getMilliAmpHours(s), getOnSecs(s));
+        if (s == TX && len > 0 && (size_t)len < bufLen)
+            snprintf(buf + len, bufLen - len, " fwd n=%u avg=%.1fuAh", forwarded, getForwardedMicroAmpHours());
+        return true;
+    }
+
+    if (line == NUM_SUBSYSTEMS) {
+        snprintf(buf, bufLen, "total %.2fmAh avg=%.2fmA cal=%.2f (n=%u)", getTotalMilliAmpHours(), getAverageMilliAmps(),
+                 calibration, calibrations);
+        return true;
+    }
+
+    return false;
+}
+
+void EnergyStats::log()
+{
+    char line[128];
+    for (uint8_t i = 0; i < NUM_SUMMARY_LINES; i++) {
+        getSummaryLine(i, line, sizeof(line));
+        LOG_DEBUG("Energy %s\n", line);
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// What each subsystem draws, in mA, for our estimates.  Variants can override any of these with the figures for their parts.
+#if defined(ARCH_ESP32)
+#ifndef ENERGY_CPU_ACTIVE_MA
+#define ENERGY_CPU_ACTIVE_MA 40.0 // running, at 80MHz and above
+#endif
+#ifndef ENERGY_CPU_IDLE_MA
+#define ENERGY_CPU_IDLE_MA 25.0 // waiting in mainDelay() (the idle task, nothing more)
+#endif
+#ifndef ENERGY_CPU_SLEEP_MA
+#define ENERGY_CPU_SLEEP_MA 0.8 // light sleep
+#endif
+#elif defined(ARCH_NRF52)
+#ifndef ENERGY_CPU_ACTIVE_MA
+#define ENERGY_CPU_ACTIVE_MA 3.5
+#endif
+#ifndef ENERGY_CPU_IDLE_MA
+#define ENERGY_CPU_IDLE_MA 0.6 // FreeRTOS tickless idle, System ON
+#endif
+#ifndef ENERGY_CPU_SLEEP_MA
+#define ENERGY_CPU_SLEEP_MA 0.6
+#endif
+#endif
+#ifndef ENERGY_CPU_ACTIVE_MA
+#define ENERGY_CPU_ACTIVE_MA 25.0
+#endif
+#ifndef ENERGY_CPU_IDLE_MA
+#define ENERGY_CPU_IDLE_MA 20.0
+#endif
+#ifndef ENERGY_CPU_SLEEP_MA
+#define ENERGY_CPU_SLEEP_MA 1.0
+#endif
+
+/// The radio listening, until the radio driver tells us better (see EnergyStats::setRxMilliAmps())
+#ifndef ENERGY_RX_MA
+#define ENERGY_RX_MA 6.0
+#endif
+
+/// TX is ENERGY_TX_BASE_MA plus the RF power we make, over the PA's efficiency at ENERGY_SUPPLY_VOLTS
+#ifndef ENERGY_TX_BASE_MA
+#define ENERGY_TX_BASE_MA 10.0
+#endif
+#ifndef ENERGY_PA_EFFICIENCY
+#define ENERGY_PA_EFFICIENCY 0.4
+#endif
+#ifndef ENERGY_SUPPLY_VOLTS
+#define ENERGY_SUPPLY_VOLTS 3.3
+#endif
+
+#ifndef ENERGY_GPS_MA
+#define ENERGY_GPS_MA 25.0
+#endif
+
+#ifndef ENERGY_SCREEN_MA
+#ifdef USE_EINK
+#define ENERGY_SCREEN_MA 0.0 // only draws while refreshing
+#else
+#define ENERGY_SCREEN_MA 10.0
+#endif
+#endif
+
+#ifndef ENERGY_BLUETOOTH_MA
+#if defined(ARCH_ESP32)
+#define ENERGY_BLUETOOTH_MA 10.0 // on top of the CPU, the radio keeps it from idling
+#elif defined(ARCH_NRF52)
+#define ENERGY_BLUETOOTH_MA 0.5
+#else
+#define ENERGY_BLUETOOTH_MA 0.0
+#endif
+#endif
+
+/// Each INA reading moves our calibration 1/ENERGY_CALIBRATION_WEIGHT of the way to what it measured
+#ifndef ENERGY_CALIBRATION_WEIGHT
+#define ENERGY_CALIBRATION_WEIGHT 8
+#endif
+
+/**
+ * An estimate of where our charge goes, for tuning routers that run on a battery and a solar panel: the time each
+ * subsystem spends in each of its states, times what it draws in that state.
+ *
+ * TX: each packet's airtime, at the current the PA needs for our configured power (RadioInterface::limitPower()).  Those we
+ * relay are also kept apart, for what one forwarded packet costs us.
+ * RX: the rest of the time, listening (or duty cycle listening, which the SX126x driver tells us about).
+ * CPU: running, waiting in mainDelay(), or in light sleep.
+ * GPS, SCREEN, BLUETOOTH: the time each is on.
+ *
+ * None of these figures are measured, so when PowerTelemetry has an INA sensor its readings calibrate our total.
+ *
+ * Shown in /json/report, in our log and to the phone as log records once it has downloaded our config, like RadioStats.
+ */
+class EnergyStats
+{
+  public:
+    enum Subsystem { TX, RX, CPU, GPS, SCREEN, BLUETOOTH, NUM_SUBSYSTEMS };
+
+    /// A packet spent msec on the air at dBm.  relayed if it was someone else's
+    void addTx(uint32_t msec, int8_t dBm, bool relayed);
+
+    /// We spent msec waiting in mainDelay()
+    void addIdle(uint32_t msec) { idleMsec += msec; }
+
+    /// We spent msec in light sleep
+    void addSleep(uint32_t msec) { sleepMsec += msec; }
+
+    /// A subsystem that's simply on or off has been turned on or off
+    void setOn(Subsystem s, bool on);
+
+    /// What the radio draws while it's receiving, duty cycling included
+    void setRxMilliAmps(float milliAmps);
+
+    /// An INA sensor measured milliAmps, what we've estimated since its last reading should have been that on average
+    void calibrate(float milliAmps);
+
+    /// Charge s has used since boot, in mAh, uncalibrated
+    float getMilliAmpHours(Subsystem s);
+
+    /// All our subsystems' charge, in mAh, calibrated if we've had an INA reading
+    float getTotalMilliAmpHours();
+
+    /// Our average current since boot, in mA, calibrated
+    float getAverageMilliAmps();
+
+    /// What one packet we forward costs us on average, in uAh (calibrated), or 0 if we've forwarded none
+    float getForwardedMicroAmpHours();
+
+    uint32_t getForwardedCount() const { return forwarded; }
+
+    /// Our INA measured over our estimate, 1 if we've had no readings
+    float getCalibration() const { return calibration; }
+
+    uint32_t getOnSecs(Subsystem s);
+
+    static const char *getSubsystemName(Subsystem s);
+
+    /// One line per subsystem, then one for the total
+    static const uint8_t NUM_SUMMARY_LINES = NUM_SUBSYSTEMS + 1;
+
+    /// Like RadioStats::getSummaryLine().  @return false if there is no such line
+    bool getSummaryLine(uint8_t line, char *buf, size_t bufLen);
+
+    void log();
+
+  private:
+    /// Charge in uA-msec, which uint64 holds for far longer than we'll be up
+    uint64_t charge[NUM_SUBSYSTEMS] = {};
+    uint64_t onMsec[NUM_SUBSYSTEMS] = {};
+    bool on[NUM_SUBSYSTEMS] = {};
+
+    uint64_t forwardedCharge = 0;
+    uint32_t forwarded = 0;
+
+    float rxMilliAmps = ENERGY_RX_MA;
+
+    // Not yet charged for by update()
+    uint32_t txMsec = 0, idleMsec = 0, sleepMsec = 0;
+    uint32_t lastUpdateMsec = 0;
+
+    float calibration = 1;
+    uint32_t calibrations = 0;
+    uint64_t lastCalibrationCharge = 0;
+    uint32_t lastCalibrationMsec = 0;
+
+    /// Charge everything for the time since our last update
+    void update();
+
+    uint64_t getTotalCharge();
+
+    static float txMilliAmps(int8_t dBm);
+};
+
+extern EnergyStats energyStats;
@@ -10,6 +10,8 @@
  */
 #include "FSCommon.h"
 #include "configuration.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
 
 #ifdef HAS_SDCARD
 #include <SD.h>
@@ -34,7 +36,7 @@ SPIClass SPI1(HSPI);
 bool copyFile(const char *from, const char *to)
 {
 #ifdef FSCom
-    unsigned char cbuffer[16];
+    unsigned char cbuffer[FS_STREAM_BLOCK_SIZE];
 
     File f1 = FSCom.open(from, FILE_O_READ);
     if (!f1) {
@@ -49,7 +51,9 @@ bool copyFile(const char *from, const char *to)
     }
 
     while (f1.available() > 0) {
-        byte i = f1.read(cbuffer, 16);
+        int i = f1.read(cbuffer, sizeof(cbuffer));
+        if (i <= 0)
+            break;
         f2.write(cbuffer, i);
     }
 
@@ -60,6 +64,73 @@ bool copyFile(const char *from, const char *to)
 #endif
 }
 
+#ifdef FSCom
+bool BufferedFileStream::readcb(pb_istream_t *stream, uint8_t *out, size_t count)
+{
+    BufferedFileStream *s = (BufferedFileStream *)stream->state;
+    size_t left = stream->bytes_left; // still counts this read, nanopb takes it off once we return
+
+    while (count) {
+        if (s->pos == s->len) {
+            // Never read ahead of what the stream allows, whatever follows in the file isn't ours
+            int n = s->file.read(s->buf, std::min(sizeof(s->buf), left));
+            if (n <= 0)
+                return false;
+            s->pos = 0;
+            s->len = n;
+            s->numBytes += n;
+            s->crc = crc32Update(s->buf, n, s->crc);
+        }
+
+        size_t n = std::min(count, s->len - s->pos);
+        if (out) { // NULL when nanopb is skipping a field
+            memcpy(out, s->buf + s->pos, n);
+            out += n;
+        }
+        s->pos += n;
+        count -= n;
+        left -= n;
+    }
+
+    // At the end of the file, tell nanopb the message is over (rather than letting it try to read on to bytes_left)
+    if (s->pos == s->len && s->file.available() == 0)
+        stream->bytes_left = 0;
+
+    return true;
+}
+
+bool BufferedFileStream::writecb(pb_ostream_t *stream, const uint8_t *in, size_t count)
+{
+    BufferedFileStream *s = (BufferedFileStream *)stream->state;
+
+    while (count) {
+        if (s->len == sizeof(s->buf) && !s->flush())
+            return false;
+
+        size_t n = std::min(count, sizeof(s->buf) - s->len);
+        memcpy(s->buf + s->len, in, n);
+        s->len += n;
+        in += n;
+        count -= n;
+    }
+    return true;
+}
+
+bool BufferedFileStream::flush()
+{
+    bool okay = !len || file.write(buf, len) == len;
+    numBytes += len;
+    crc = crc32Update(buf, len, crc);
+    len = 0;
+    return okay;
+}
+
+uint32_t BufferedFileStream::getCRC() const
+{
+    return crc32Final(crc);
+}
+#endif
+
 /**
  * Renames a file from pathFrom to pathTo.
  *
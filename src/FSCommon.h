@@ -11,12 +11,16 @@
 #define FSBegin() true
 #define FILE_O_WRITE "w"
 #define FILE_O_READ "r"
+#define FILE_O_PATCH "r+"
 #endif
 
 #if defined(ARCH_STM32WL)
 #include "platform/stm32wl/InternalFileSystem.h" // STM32WL version
 #define FSCom InternalFS
 #define FSBegin() FSCom.begin()
+#define FSBeginBatch() FSCom.beginBatch()
+#define FSEndBatch() FSCom.endBatch()
+#define FILE_O_PATCH FILE_O_WRITE // doesn't truncate, so seek() and write() patch the file in place
 using namespace LittleFS_Namespace;
 #endif
 
@@ -27,6 +31,7 @@ using namespace LittleFS_Namespace;
 #define FSBegin() FSCom.begin() // set autoformat
 #define FILE_O_WRITE "w"
 #define FILE_O_READ "r"
+#define FILE_O_PATCH "r+"
 #endif
 
 #if defined(ARCH_ESP32)
@@ -36,6 +41,7 @@ using namespace LittleFS_Namespace;
 #define FSBegin() FSCom.begin(true) // format on failure
 #define FILE_O_WRITE "w"
 #define FILE_O_READ "r"
+#define FILE_O_PATCH "r+"
 #endif
 
 #if defined(ARCH_NRF52)
@@ -43,9 +49,60 @@ using namespace LittleFS_Namespace;
 #include "InternalFileSystem.h"
 #define FSCom InternalFS
 #define FSBegin() FSCom.begin() // InternalFS formats on failure
+#define FILE_O_PATCH FILE_O_WRITE // doesn't truncate, so seek() and write() patch the file in place
 using namespace Adafruit_LittleFS_Namespace;
 #endif
 
+/// Around a run of writes, for filesystems which save flash operations by writing them back all at once at the end
+#ifndef FSBeginBatch
+#define FSBeginBatch()
+#define FSEndBatch()
+#endif
+
+/// Size of the block our buffered file streams read and write at a time, as every small call into LittleFS costs a lot
+#ifndef FS_STREAM_BLOCK_SIZE
+#define FS_STREAM_BLOCK_SIZE 512
+#endif
+
+#ifdef FSCom
+#include <pb.h>
+
+/**
+ * A nanopb stream to or from a File, which turns nanopb's many tiny reads and writes into a few block sized ones.  Reads
+ * stop at the end of the file, like a stream which was given the file's exact size.  Data written is only guaranteed to
+ * have reached the file once flush() returns true.
+ */
+class BufferedFileStream
+{
+    File &file;
+    uint8_t buf[FS_STREAM_BLOCK_SIZE];
+    size_t pos = 0, len = 0;   // reading: next unread byte and end of data, writing: len is how much we are holding
+    size_t numBytes = 0;       // read from or written to the file so far
+    uint32_t crc = 0xffffffff; // running crc32Update() of those bytes
+
+    static bool readcb(pb_istream_t *stream, uint8_t *out, size_t count);
+    static bool writecb(pb_ostream_t *stream, const uint8_t *in, size_t count);
+
+  public:
+    explicit BufferedFileStream(File &f) : file(f) {}
+
+    /// A stream reading at most maxSize bytes from our file
+    pb_istream_t istream(size_t maxSize) { return pb_istream_t{&readcb, this, maxSize}; }
+
+    /// A stream writing at most maxSize bytes to our file
+    pb_ostream_t ostream(size_t maxSize) { return pb_ostream_t{&writecb, this, maxSize, 0}; }
+
+    /// Write out whatever we are still holding, @return true if everything written so far made it to the file
+    bool flush();
+
+    /// How many bytes we have read from (or written to) the file, reads never go past the end of what the stream allows
+    size_t getNumBytes() const { return numBytes; }
+
+    /// @return the crc32Buffer() of the bytes we have read from (or written to) the file
+    uint32_t getCRC() const;
+};
+#endif
+
 void fsInit();
 bool copyFile(const char *from, const char *to);
 bool renameFile(const char *pathFrom, const char *pathTo);
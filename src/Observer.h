@@ -1,16 +1,33 @@
 #pragma once
 
 #include <Arduino.h>
-#include <list>
+#include <assert.h>
 
 template <class T> class Observable;
+template <class T> class Observer;
+
+/**
+ * One Observer watching one Observable: an entry in the Observable's (doubly linked) list of observers, which lives in the
+ * Observer, so neither observing nor notifying touches the heap
+ */
+template <class T> struct ObserverLink {
+    Observable<T> *source = NULL; // NULL while this link is free
+    Observer<T> *observer = NULL;
+    ObserverLink *prev = NULL, *next = NULL;
+};
 
 /**
  * An observer which can be mixed in as a baseclass.  Implement onNotify as a method in your class.
+ *
+ * It can watch one Observable at a time, or more if a subclass gives it room for the links (see CallbackObserver).
  */
 template <class T> class Observer
 {
-    std::list<Observable<T> *> observables;
+    ObserverLink<T> firstLink;
+    ObserverLink<T> *moreLinks;
+    uint8_t numMoreLinks;
+
+    ObserverLink<T> *findLink(const Observable<T> *o);
 
   public:
     virtual ~Observer();
@@ -25,6 +42,16 @@ template <class T> class Observer
     friend class Observable<T>;
 
   protected:
+    /// more is room for the links to all but one of the Observables we can watch at once
+    explicit Observer(ObserverLink<T> *more = NULL, uint8_t numMore = 0) : moreLinks(more), numMoreLinks(numMore) {}
+
+    /// A copy watches nothing (so a subclass can be initialized from a temporary)
+    Observer(const Observer &) : Observer() {}
+    Observer &operator=(const Observer &) = delete;
+
+    /// Stop watching everything, for a subclass's destructor if it holds our links
+    void unobserveAll();
+
     /**
      * returns 0 if other observers should continue to be called
      * returns !0 if the observe calls should be aborted and this result code returned for notifyObservers
@@ -32,18 +59,36 @@ template <class T> class Observer
     virtual int onNotify(T arg) = 0;
 };
 
+/// Room for the links of an Observer which watches more than one Observable
+template <class T, uint8_t N> struct ObserverLinks {
+    ObserverLink<T> links[N];
+    ObserverLink<T> *get() { return links; }
+};
+
+template <class T> struct ObserverLinks<T, 0> {
+    ObserverLink<T> *get() { return NULL; }
+};
+
 /**
- * An observer that calls an arbitrary method
+ * An observer that calls an arbitrary method, watching up to NumSources Observables at once
  */
-template <class Callback, class T> class CallbackObserver : public Observer<T>
+template <class Callback, class T, uint8_t NumSources = 1> class CallbackObserver : public Observer<T>
 {
     typedef int (Callback::*ObserverCallback)(T arg);
 
+    ObserverLinks<T, NumSources - 1> extraLinks;
     Callback *objPtr;
     ObserverCallback method;
 
   public:
-    CallbackObserver(Callback *_objPtr, ObserverCallback _method) : objPtr(_objPtr), method(_method) {}
+    CallbackObserver(Callback *_objPtr, ObserverCallback _method)
+        : Observer<T>(extraLinks.get(), NumSources - 1), objPtr(_objPtr), method(_method)
+    {
+    }
+
+    CallbackObserver(const CallbackObserver &other) : CallbackObserver(other.objPtr, other.method) {}
+
+    virtual ~CallbackObserver() { this->unobserveAll(); } // while extraLinks still exist
 
   protected:
     virtual int onNotify(T arg) override { return (objPtr->*method)(arg); }
@@ -55,9 +100,26 @@ template <class Callback, class T> class CallbackObserver : public Observer<T>
  */
 template <class T> class Observable
 {
-    std::list<Observer<T> *> observers;
+    ObserverLink<T> *head = NULL, *tail = NULL;
+
+    /// Where each notifyObservers() in progress (usually none, or one) goes next, so an observer can unobserve from onNotify
+    struct Cursor {
+        ObserverLink<T> *next;
+        Cursor *outer;
+    };
+    Cursor *cursors = NULL;
 
   public:
+    Observable() {}
+    Observable(const Observable &) = delete;
+    Observable &operator=(const Observable &) = delete;
+
+    ~Observable()
+    {
+        while (head)
+            removeLink(head);
+    }
+
     /**
      * Tell all observers about a change, observers can process arg as they wish
      *
@@ -65,42 +127,90 @@ template <class T> class Observable
      */
     int notifyObservers(T arg)
     {
-        for (typename std::list<Observer<T> *>::const_iterator iterator = observers.begin(); iterator != observers.end();
-             ++iterator) {
-            int result = (*iterator)->onNotify(arg);
-            if (result != 0)
-                return result;
+        Cursor cursor = {head, cursors};
+        cursors = &cursor;
+
+        int result = 0;
+        while (cursor.next && !result) {
+            ObserverLink<T> *l = cursor.next;
+            cursor.next = l->next;
+            result = l->observer->onNotify(arg);
         }
 
-        return 0;
+        cursors = cursor.outer;
+        return result;
     }
 
   private:
     friend class Observer<T>;
 
     // Not called directly, instead call observer.observe
-    void addObserver(Observer<T> *o) { observers.push_back(o); }
+    void addLink(ObserverLink<T> *l)
+    {
+        l->source = this;
+        l->prev = tail;
+        l->next = NULL;
+        if (tail)
+            tail->next = l;
+        else
+            head = l;
+        tail = l;
+    }
 
-    void removeObserver(Observer<T> *o) { observers.remove(o); }
+    void removeLink(ObserverLink<T> *l)
+    {
+        for (Cursor *c = cursors; c; c = c->outer)
+            if (c->next == l)
+                c->next = l->next;
+
+        if (l->prev)
+            l->prev->next = l->next;
+        else
+            head = l->next;
+        if (l->next)
+            l->next->prev = l->prev;
+        else
+            tail = l->prev;
+        l->source = NULL;
+        l->prev = l->next = NULL;
+    }
 };
 
+template <class T> ObserverLink<T> *Observer<T>::findLink(const Observable<T> *o)
+{
+    if (firstLink.source == o)
+        return &firstLink;
+    for (uint8_t i = 0; i < numMoreLinks; i++)
+        if (moreLinks[i].source == o)
+            return &moreLinks[i];
+    return NULL;
+}
+
 template <class T> Observer<T>::~Observer()
 {
-    for (typename std::list<Observable<T> *>::const_iterator iterator = observables.begin(); iterator != observables.end();
-         ++iterator) {
-        (*iterator)->removeObserver(this);
-    }
-    observables.clear();
+    unobserveAll();
+}
+
+template <class T> void Observer<T>::unobserveAll()
+{
+    if (firstLink.source)
+        firstLink.source->removeLink(&firstLink);
+    for (uint8_t i = 0; i < numMoreLinks; i++)
+        if (moreLinks[i].source)
+            moreLinks[i].source->removeLink(&moreLinks[i]);
 }
 
 template <class T> void Observer<T>::unobserve(Observable<T> *o)
 {
-    o->removeObserver(this);
-    observables.remove(o);
+    ObserverLink<T> *l = findLink(o);
+    if (l)
+        o->removeLink(l);
 }
 
 template <class T> void Observer<T>::observe(Observable<T> *o)
 {
-    observables.push_back(o);
-    o->addObserver(this);
-}
\ No newline at end of file
+    ObserverLink<T> *l = findLink(NULL);
+    assert(l); // we need a bigger NumSources
+    l->observer = this;
+    o->addLink(l);
+}
@@ -168,37 +168,69 @@ class AnalogBatteryLevel : public HasBatteryLevel
     30 // Set the number of samples, it has an effect of increasing sensitivity in complex electromagnetic environment.
 #endif
 
+/// Each reading moves the voltage we report 1/BATTERY_FILTER_WEIGHT of the way to it
+#ifndef BATTERY_FILTER_WEIGHT
+#define BATTERY_FILTER_WEIGHT 4
+#endif
+
+/// A reading this far (mV) from the filtered voltage is taken as it is, being a real change rather than noise
+#ifndef BATTERY_FILTER_STEP_MV
+#define BATTERY_FILTER_STEP_MV 150
+#endif
+
+/// How many samples the nRF52 SAADC averages for each reading, a power of 2 up to 256
+#ifndef BATTERY_SENSE_OVERSAMPLING
+#define BATTERY_SENSE_OVERSAMPLING 32
+#endif
+
+#ifdef BATTERY_PIN
+        // Power::runOnce() samples in the background, so asking costs nothing unless nobody has yet
+        if (!last_read_time_ms)
+            sample();
+        return last_read_value;
+#endif // BATTERY_PIN
+        return 0;
+    }
+
+  public:
+    /**
+     * Take a reading of the battery, and filter it into the one getBattVoltage() gives.  Called by Power::runOnce(), rather
+     * than whenever someone wants the voltage, so nobody waits for the ADC.
+     */
+    void sample()
+    {
 #ifdef BATTERY_PIN
         // Override variant or default ADC_MULTIPLIER if we have the override pref
         float operativeAdcMultiplier =
             config.power.adc_multiplier_override > 0 ? config.power.adc_multiplier_override : ADC_MULTIPLIER;
-        // Do not call analogRead() often.
-        const uint32_t min_read_interval = 5000;
-        if (millis() - last_read_time_ms > min_read_interval) {
-            last_read_time_ms = millis();
 
-            uint32_t raw = 0;
-            float scaled = 0;
+        uint32_t raw = 0;
+        float scaled = 0;
 
 #ifdef ARCH_ESP32 // ADC block for espressif platforms
-            raw = espAdcRead();
-            scaled = esp_adc_cal_raw_to_voltage(raw, adc_characs);
-            scaled *= operativeAdcMultiplier;
+        raw = espAdcRead();
+        scaled = esp_adc_cal_raw_to_voltage(raw, adc_characs);
+        scaled *= operativeAdcMultiplier;
+#elif defined(ARCH_NRF52)
+        // The SAADC oversamples this in hardware (see analogInit()), one conversion with no loop of ours
+        raw = analogRead(BATTERY_PIN);
+        scaled = operativeAdcMultiplier * ((1000 * AREF_VOLTAGE) / pow(2, BATTERY_SENSE_RESOLUTION_BITS)) * raw;
 #else // block for all other platforms
-            for (uint32_t i = 0; i < BATTERY_SENSE_SAMPLES; i++) {
-                raw += analogRead(BATTERY_PIN);
-            }
-            raw = raw / BATTERY_SENSE_SAMPLES;
-            scaled = operativeAdcMultiplier * ((1000 * AREF_VOLTAGE) / pow(2, BATTERY_SENSE_RESOLUTION_BITS)) * raw;
+        for (uint32_t i = 0; i < BATTERY_SENSE_SAMPLES; i++) {
+            raw += analogRead(BATTERY_PIN);
+        }
+        raw = raw / BATTERY_SENSE_SAMPLES;
+        scaled = operativeAdcMultiplier * ((1000 * AREF_VOLTAGE) / pow(2, BATTERY_SENSE_RESOLUTION_BITS)) * raw;
 #endif
-            // LOG_DEBUG("battery gpio %d raw val=%u scaled=%u\n", BATTERY_PIN, raw, (uint32_t)(scaled));
+        // LOG_DEBUG("battery gpio %d raw val=%u scaled=%u\n", BATTERY_PIN, raw, (uint32_t)(scaled));
+
+        // Smooth out the noise, but follow a real step (a charger plugged in, a battery taken out) at once
+        if (!last_read_time_ms || fabsf(scaled - last_read_value) > BATTERY_FILTER_STEP_MV)
             last_read_value = scaled;
-            return scaled;
-        } else {
-            return last_read_value;
-        }
+        else
+            last_read_value += (scaled - last_read_value) / BATTERY_FILTER_WEIGHT;
+        last_read_time_ms = millis() | 1; // never 0, which means we've no reading yet
 #endif // BATTERY_PIN
-        return 0;
     }
 
 #if defined(ARCH_ESP32) && !defined(HAS_PMU) && defined(BATTERY_PIN)
@@ -438,6 +470,8 @@ bool Power::analogInit()
 #else
     analogReference(AR_INTERNAL); // 3.6V
 #endif
+    // The SAADC averages BATTERY_SENSE_OVERSAMPLING samples in one burst, rather than us looping over analogRead()
+    analogOversampling(BATTERY_SENSE_OVERSAMPLING);
 #endif // ARCH_NRF52
 
 #ifndef ARCH_ESP32
@@ -544,7 +578,7 @@ void Power::readPowerStatus()
         if (lastheap != memGet.getFreeHeap()) {
             LOG_DEBUG("Threads running:");
             int running = 0;
-            for (int i = 0; i < MAX_THREADS; i++) {
+            for (int i = 0; i < concurrency::mainController.size(); i++) {
                 auto thread = concurrency::mainController.get(i);
                 if ((thread != nullptr) && (thread->enabled)) {
                     LOG_DEBUG(" %s", thread->ThreadName.c_str());
@@ -553,7 +587,7 @@ void Power::readPowerStatus()
             }
             LOG_DEBUG("\n");
             LOG_DEBUG("Heap status: %d/%d bytes free (%d), running %d/%d threads\n", memGet.getFreeHeap(), memGet.getHeapSize(),
-                      memGet.getFreeHeap() - lastheap, running, concurrency::mainController.size(false));
+                      memGet.getFreeHeap() - lastheap, running, concurrency::mainController.size());
             lastheap = memGet.getFreeHeap();
         }
 #ifdef DEBUG_HEAP_MQTT
@@ -568,12 +602,12 @@ void Power::readPowerStatus()
             std::string heapTopic =
                 (*moduleConfig.mqtt.root ? moduleConfig.mqtt.root : "msh") + std::string("/2/heap/") + std::string(mac);
             std::string heapString = std::to_string(newHeap);
-            mqtt->pubSub.publish(heapTopic.c_str(), heapString.c_str(), false);
+            mqtt->publish(heapTopic.c_str(), heapString.c_str(), false);
             auto wifiRSSI = WiFi.RSSI();
             std::string wifiTopic =
                 (*moduleConfig.mqtt.root ? moduleConfig.mqtt.root : "msh") + std::string("/2/wifi/") + std::string(mac);
             std::string wifiString = std::to_string(wifiRSSI);
-            mqtt->pubSub.publish(wifiTopic.c_str(), wifiString.c_str(), false);
+            mqtt->publish(wifiTopic.c_str(), wifiString.c_str(), false);
         }
 #endif
 
@@ -607,6 +641,10 @@ void Power::readPowerStatus()
 
 int32_t Power::runOnce()
 {
+#ifdef BATTERY_PIN
+    if (batteryLevel == &analogLevel)
+        analogLevel.sample();
+#endif
     readPowerStatus();
 
 #ifdef HAS_PMU
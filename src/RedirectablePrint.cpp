@@ -22,6 +22,14 @@ NoopPrint noopPrint;
 #if HAS_WIFI || HAS_ETHERNET
 extern Syslog syslog;
 #endif
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+
+RedirectablePrint::RedirectablePrint(Print *_dest) : dest(_dest)
+{
+    for (uint32_t i = 0; i < LOG_RING_SLOTS; i++)
+        ring[i].seq.store(i, std::memory_order_relaxed);
+}
+
 void RedirectablePrint::rpInit()
 {
 #ifdef HAS_FREE_RTOS
@@ -70,113 +78,238 @@ size_t RedirectablePrint::vprintf(const char *format, va_list arg)
     return len;
 }
 
-size_t RedirectablePrint::log(const char *logLevel, const char *format, ...)
+bool RedirectablePrint::isSuppressed(const char *logLevel)
 {
 #ifdef ARCH_PORTDUINO
-    if (settingsMap[logoutputlevel] < level_debug && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0)
-        return 0;
-    else if (settingsMap[logoutputlevel] < level_info && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_INFO) == 0)
-        return 0;
-    else if (settingsMap[logoutputlevel] < level_warn && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_WARN) == 0)
-        return 0;
+    if (portduinoSettings.logLevel < level_debug && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0)
+        return true;
+    else if (portduinoSettings.logLevel < level_info && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_INFO) == 0)
+        return true;
+    else if (portduinoSettings.logLevel < level_warn && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_WARN) == 0)
+        return true;
 #endif
-    if (moduleConfig.serial.override_console_serial_port && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0) {
+    return moduleConfig.serial.override_console_serial_port && strcmp(logLevel, MESHTASTIC_LOG_LEVEL_DEBUG) == 0;
+}
+
+RedirectablePrint::LogSlot *RedirectablePrint::claimSlot(const char *logLevel, uint32_t &pos)
+{
+    // A bounded MPMC queue (after Dmitry Vyukov's) with just the one reader: each slot's seq says whose turn it is
+    LogSlot *s;
+    pos = writePos.load(std::memory_order_relaxed);
+    for (;;) {
+        s = &ring[pos % LOG_RING_SLOTS];
+        int32_t diff = (int32_t)(s->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            numDropped.fetch_add(1, std::memory_order_relaxed); // drainLog() hasn't got to the line a lap before us
+            return NULL;
+        } else {
+            pos = writePos.load(std::memory_order_relaxed); // someone else took this one
+        }
+    }
+
+    s->logLevel = logLevel;
+    s->msec = millis();
+    s->continuation = isContinuationMessage;
+    auto thread = concurrency::OSThread::currentThread;
+    strncpy(s->thread, thread ? thread->ThreadName.c_str() : "", sizeof(s->thread) - 1);
+    s->thread[sizeof(s->thread) - 1] = '\0';
+    return s;
+}
+
+void RedirectablePrint::commitSlot(LogSlot *s, uint32_t pos)
+{
+    bool isError = s->logLevel[0] == 'E' || s->logLevel[0] == 'C';
+    s->seq.store(pos + 1, std::memory_order_release); // from here s is drainLog()'s
+
+    if (!deferred || isError) {
+        drainLog(); // before setup() is done nothing drains us, and errors might be the last thing we get to say
+    } else if (pos == readPos.load(std::memory_order_acquire)) {
+        onLogQueued();
+    }
+}
+
+size_t RedirectablePrint::log(const char *logLevel, const char *format, ...)
+{
+    if (isSuppressed(logLevel))
         return 0;
+
+    // Cope with 0 len format strings, but look for new line terminator
+    bool hasNewline = *format && format[strlen(format) - 1] == '\n';
+
+    size_t len = 0;
+    uint32_t pos;
+    LogSlot *s = claimSlot(logLevel, pos);
+    if (s) {
+        va_list arg;
+        va_start(arg, format);
+        len = vsnprintf(s->text, sizeof(s->text), format, arg);
+        va_end(arg);
+
+        // If the resulting string is longer than sizeof(text)-1 characters, the remaining characters are still counted for
+        // the return value
+        if (len > sizeof(s->text) - 1) {
+            len = sizeof(s->text) - 1;
+            s->text[sizeof(s->text) - 2] = '\n';
+        }
+        s->len = len;
+        s->formatter = NULL;
+        commitSlot(s, pos);
+    }
+
+    isContinuationMessage = !hasNewline;
+    return len;
+}
+
+void RedirectablePrint::logLazy(const char *logLevel, LogFormatter formatter, const void *data, size_t len)
+{
+    if (isSuppressed(logLevel))
+        return;
+
+    uint32_t pos;
+    LogSlot *s = claimSlot(logLevel, pos);
+    if (s) {
+        assert(len <= sizeof(s->data));
+        memcpy(s->data, data, len);
+        s->len = len;
+        s->formatter = formatter;
+        commitSlot(s, pos);
+    }
+    isContinuationMessage = false;
+}
+
+size_t RedirectablePrint::formatTokenized(const void *data, char *buf, size_t bufLen)
+{
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const LogTokenWriter *w = (const LogTokenWriter *)data;
+    size_t n = 0;
+    buf[n++] = '$';
+    for (size_t i = 0; i < w->len && n + 5 < bufLen; i += 3) {
+        uint32_t v = w->buf[i] << 16;
+        if (i + 1 < w->len)
+            v |= w->buf[i + 1] << 8;
+        if (i + 2 < w->len)
+            v |= w->buf[i + 2];
+        buf[n++] = base64[(v >> 18) & 0x3f];
+        buf[n++] = base64[(v >> 12) & 0x3f];
+        buf[n++] = i + 1 < w->len ? base64[(v >> 6) & 0x3f] : '=';
+        buf[n++] = i + 2 < w->len ? base64[v & 0x3f] : '=';
     }
-    size_t r = 0;
+    buf[n++] = '\n';
+    buf[n] = '\0';
+    return n;
+}
+
+void RedirectablePrint::drainLog()
+{
 #ifdef HAS_FREE_RTOS
-    if (inDebugPrint != nullptr && xSemaphoreTake(inDebugPrint, portMAX_DELAY) == pdTRUE) {
+    if (inDebugPrint == nullptr || xSemaphoreTake(inDebugPrint, portMAX_DELAY) != pdTRUE)
+        return;
 #else
-    if (!inDebugPrint) {
-        inDebugPrint = true;
+    if (inDebugPrint)
+        return;
+    inDebugPrint = true;
 #endif
 
-        va_list arg;
-        va_start(arg, format);
+    uint32_t pos = readPos.load(std::memory_order_relaxed);
+    for (;;) {
+        LogSlot &s = ring[pos % LOG_RING_SLOTS];
+        if (s.seq.load(std::memory_order_acquire) != pos + 1)
+            break; // not written yet
+        writeSlot(s);
+        s.seq.store(pos + LOG_RING_SLOTS, std::memory_order_release); // free for the writer a lap from now
+        readPos.store(++pos, std::memory_order_release);
+    }
 
-        // Cope with 0 len format strings, but look for new line terminator
-        bool hasNewline = *format && format[strlen(format) - 1] == '\n';
-
-        // If we are the first message on a report, include the header
-        if (!isContinuationMessage) {
-            uint32_t rtc_sec = getValidTime(RTCQuality::RTCQualityDevice);
-            if (rtc_sec > 0) {
-                long hms = rtc_sec % SEC_PER_DAY;
-                // hms += tz.tz_dsttime * SEC_PER_HOUR;
-                // hms -= tz.tz_minuteswest * SEC_PER_MIN;
-                // mod `hms` to ensure in positive range of [0...SEC_PER_DAY)
-                hms = (hms + SEC_PER_DAY) % SEC_PER_DAY;
-
-                // Tear apart hms into h:m:s
-                int hour = hms / SEC_PER_HOUR;
-                int min = (hms % SEC_PER_HOUR) / SEC_PER_MIN;
-                int sec = (hms % SEC_PER_HOUR) % SEC_PER_MIN; // or hms % SEC_PER_MIN
+    uint32_t dropped = numDropped.exchange(0, std::memory_order_relaxed);
+    if (dropped)
+        printf("(%u log lines dropped)\r\n", (unsigned)dropped);
+
+#if (HAS_WIFI || HAS_ETHERNET) && !defined(ARCH_PORTDUINO)
+    // All that was waiting goes to syslog together
+    syslog.flush();
+#endif
+
+#ifdef HAS_FREE_RTOS
+    xSemaphoreGive(inDebugPrint);
+#else
+    inDebugPrint = false;
+#endif
+}
+
+void RedirectablePrint::writeSlot(const LogSlot &s)
+{
+    // If we are the first message on a report, include the header
+    if (!s.continuation) {
+        uint32_t rtc_sec = getValidTime(RTCQuality::RTCQualityDevice);
+        uint32_t agoSec = (millis() - s.msec) / 1000; // we write it out a little after it was logged
+        if (rtc_sec > agoSec) {
+            long hms = (rtc_sec - agoSec) % SEC_PER_DAY;
+            // hms += tz.tz_dsttime * SEC_PER_HOUR;
+            // hms -= tz.tz_minuteswest * SEC_PER_MIN;
+            // mod `hms` to ensure in positive range of [0...SEC_PER_DAY)
+            hms = (hms + SEC_PER_DAY) % SEC_PER_DAY;
+
+            // Tear apart hms into h:m:s
+            int hour = hms / SEC_PER_HOUR;
+            int min = (hms % SEC_PER_HOUR) / SEC_PER_MIN;
+            int sec = (hms % SEC_PER_HOUR) % SEC_PER_MIN; // or hms % SEC_PER_MIN
 #ifdef ARCH_PORTDUINO
-                r += ::printf("%s | %02d:%02d:%02d %u ", logLevel, hour, min, sec, millis() / 1000);
+            ::printf("%s | %02d:%02d:%02d %u ", s.logLevel, hour, min, sec, (unsigned)(s.msec / 1000));
 #else
-                r += printf("%s | %02d:%02d:%02d %u ", logLevel, hour, min, sec, millis() / 1000);
+            printf("%s | %02d:%02d:%02d %u ", s.logLevel, hour, min, sec, (unsigned)(s.msec / 1000));
 #endif
-            } else
+        } else
 #ifdef ARCH_PORTDUINO
-                r += ::printf("%s | ??:??:?? %u ", logLevel, millis() / 1000);
+            ::printf("%s | ??:??:?? %u ", s.logLevel, (unsigned)(s.msec / 1000));
 #else
-                r += printf("%s | ??:??:?? %u ", logLevel, millis() / 1000);
+            printf("%s | ??:??:?? %u ", s.logLevel, (unsigned)(s.msec / 1000));
 #endif
 
-            auto thread = concurrency::OSThread::currentThread;
-            if (thread) {
-                print("[");
-                // printf("%p ", thread);
-                // assert(thread->ThreadName.length());
-                print(thread->ThreadName);
-                print("] ");
-            }
+        if (s.thread[0]) {
+            print("[");
+            print(s.thread);
+            print("] ");
         }
-        r += vprintf(format, arg);
+    }
+
+    const char *text = s.text;
+    size_t len = s.len;
+    char lazyBuf[LOG_LINE_LEN];
+    if (s.formatter) {
+        len = s.formatter(s.data, lazyBuf, sizeof(lazyBuf));
+        text = lazyBuf;
+    }
+    Print::write(text, len);
 
 #if (HAS_WIFI || HAS_ETHERNET) && !defined(ARCH_PORTDUINO)
-        // if syslog is in use, collect the log messages and send them to syslog
-        if (syslog.isEnabled()) {
-            int ll = 0;
-            switch (logLevel[0]) {
-            case 'D':
-                ll = SYSLOG_DEBUG;
-                break;
-            case 'I':
-                ll = SYSLOG_INFO;
-                break;
-            case 'W':
-                ll = SYSLOG_WARN;
-                break;
-            case 'E':
-                ll = SYSLOG_ERR;
-                break;
-            case 'C':
-                ll = SYSLOG_CRIT;
-                break;
-            default:
-                ll = 0;
-            }
-            auto thread = concurrency::OSThread::currentThread;
-            if (thread) {
-                syslog.vlogf(ll, thread->ThreadName.c_str(), format, arg);
-            } else {
-                syslog.vlogf(ll, format, arg);
-            }
+    // if syslog is in use, collect the log messages and send them to syslog
+    if (syslog.isEnabled()) {
+        int ll = 0;
+        switch (s.logLevel[0]) {
+        case 'D':
+            ll = SYSLOG_DEBUG;
+            break;
+        case 'I':
+            ll = SYSLOG_INFO;
+            break;
+        case 'W':
+            ll = SYSLOG_WARN;
+            break;
+        case 'E':
+            ll = SYSLOG_ERR;
+            break;
+        case 'C':
+            ll = SYSLOG_CRIT;
+            break;
+        default:
+            ll = 0;
         }
-#endif
-
-        va_end(arg);
-
-        isContinuationMessage = !hasNewline;
-#ifdef HAS_FREE_RTOS
-        xSemaphoreGive(inDebugPrint);
-#else
-        inDebugPrint = false;
-#endif
+        syslog.log(ll, s.thread[0] ? s.thread : NULL, text); // both our buffers end with a NUL
     }
-
-    return r;
+#endif
 }
 
 void RedirectablePrint::hexDump(const char *logLevel, unsigned char *buf, uint16_t len)
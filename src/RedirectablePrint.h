@@ -2,29 +2,186 @@
 
 #include "../freertosinc.h"
 #include <Print.h>
+#include <atomic>
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
 #include <string>
+#include <type_traits>
+
+/// How many log lines can wait for drainLog() to write them out, a power of two.  A line logged while they are all taken is
+/// dropped (and counted), rather than making the code which logged it wait for the UART
+#ifndef LOG_RING_SLOTS
+#define LOG_RING_SLOTS 32
+#endif
+
+/// The longest log line we keep, longer ones are cut short
+#ifndef LOG_LINE_LEN
+#define LOG_LINE_LEN 160
+#endif
+
+/// Turns what was copied by RedirectablePrint::logLazy() into a log line (ending with a newline), @return its length
+typedef size_t (*LogFormatter)(const void *data, char *buf, size_t bufLen);
+
+/// FNV-1a of a log format string, worked out by the compiler, so a tokenized log call (see LOG_TOKENIZED) leaves the string
+/// itself out of the image.  bin/log_decoder.py works out the same hash for each LOG_ format in our source
+constexpr uint32_t logTokenHash(const char *s, uint32_t h = 2166136261UL)
+{
+    return *s ? logTokenHash(s + 1, (h ^ (uint8_t)*s) * 16777619UL) : h;
+}
+
+#define LOG_TOKEN(fmt) (std::integral_constant<uint32_t, logTokenHash(fmt)>::value)
+
+/// The most a tokenized log call keeps (its token and arguments), what fits in a line as base64
+#define LOG_TOKEN_MAX_BYTES ((LOG_LINE_LEN - 3) / 4 * 3)
+
+/**
+ * Packs the token and arguments of a tokenized log call: the token (4 bytes, little endian), then for each argument (while
+ * they fit) a tag byte and its value.  Integers are varints (signed ones zigzagged), floats 4 bytes, strings end in a NUL.
+ */
+class LogTokenWriter
+{
+  public:
+    uint8_t len = 0; // first, so what logLazy() copies says how long it is
+    uint8_t buf[LOG_TOKEN_MAX_BYTES];
+
+  private:
+    void putByte(uint8_t b)
+    {
+        if (len < sizeof(buf))
+            buf[len++] = b;
+    }
+
+    void putVarint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            putByte((uint8_t)v | 0x80);
+            v >>= 7;
+        }
+        putByte((uint8_t)v);
+    }
+
+  public:
+    enum Tag : uint8_t { TAG_INT, TAG_UINT, TAG_FLOAT, TAG_STRING };
+
+    explicit LogTokenWriter(uint32_t token)
+    {
+        for (int i = 0; i < 4; i++)
+            putByte(token >> (8 * i));
+    }
+
+    template <typename T> typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T v)
+    {
+        putByte(TAG_INT);
+        putVarint(((uint64_t)(int64_t)v << 1) ^ (uint64_t)((int64_t)v >> 63));
+    }
+
+    template <typename T> typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type add(T v)
+    {
+        putByte(TAG_UINT);
+        putVarint(v);
+    }
+
+    template <typename T> typename std::enable_if<std::is_enum<T>::value>::type add(T v) { add((int32_t)v); }
+
+    template <typename T> typename std::enable_if<std::is_floating_point<T>::value>::type add(T v)
+    {
+        float f = v;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        putByte(TAG_FLOAT);
+        for (int i = 0; i < 4; i++)
+            putByte(bits >> (8 * i));
+    }
+
+    void add(const char *s)
+    {
+        putByte(TAG_STRING);
+        for (s = s ? s : "(null)"; *s && len < sizeof(buf) - 1; s++)
+            putByte(*s);
+        putByte(0);
+    }
+
+    void add(char *s) { add((const char *)s); }
+
+    /// %p
+    template <typename T> typename std::enable_if<std::is_pointer<T>::value>::type add(T p) { add((uintptr_t)p); }
+
+    void addAll() {}
+
+    template <typename T, typename... Rest> void addAll(T first, Rest... rest)
+    {
+        add(first);
+        addAll(rest...);
+    }
+};
 
 /**
  * A Printable that can be switched to squirt its bytes to a different sink.
  * This class is mostly useful to allow debug printing to be redirected away from Serial
  * to some other transport if we switch Serial usage (on the fly) to some other purpose.
+ *
+ * Once setDeferred(true), log() only formats its line into a lock free ring (any task can log at once) and drainLog()
+ * writes it out (with its time and thread header, and to syslog) later, from whichever thread drains us.  Errors, and
+ * everything logged before then, are still written before log() returns.
  */
 class RedirectablePrint : public Print
 {
     Print *dest;
 
     /// Used to allow multiple logDebug messages to appear on a single log line
-    bool isContinuationMessage = false;
+    std::atomic<bool> isContinuationMessage{false};
+
+    /// Do we leave what we log for drainLog()
+    bool deferred = false;
+
+    /// One log() (or logLazy()) waiting for drainLog()
+    struct LogSlot {
+        std::atomic<uint32_t> seq; // pos when free for a writer, pos + 1 once written, see claimSlot()
+        const char *logLevel;
+        uint32_t msec;     // millis() when it was logged
+        char thread[12];   // the OSThread which logged it
+        bool continuation; // of the line before, so no header
+        uint16_t len;
+        LogFormatter formatter; // NULL if data is already our text
+        union {
+            char text[LOG_LINE_LEN];
+            uint32_t data[LOG_LINE_LEN / 4];
+        };
+    };
+    LogSlot ring[LOG_RING_SLOTS];
+    std::atomic<uint32_t> writePos{0}, readPos{0};
+    std::atomic<uint32_t> numDropped{0};
 
+    /// Guards drainLog(), the one reader of ring
 #ifdef HAS_FREE_RTOS
     SemaphoreHandle_t inDebugPrint = nullptr;
     StaticSemaphore_t _MutexStorageSpace;
 #else
     volatile bool inDebugPrint = false;
 #endif
+
+    /// Should we leave out lines of this level
+    bool isSuppressed(const char *logLevel);
+
+    /// Take the next free slot in ring, and fill in its header.  @return NULL if there are none
+    LogSlot *claimSlot(const char *logLevel, uint32_t &pos);
+
+    /// Hand a slot claimSlot() gave us to drainLog()
+    void commitSlot(LogSlot *s, uint32_t pos);
+
+    /// Write out one line of ring
+    void writeSlot(const LogSlot &s);
+
+    /// The LogFormatter for logTokenized()
+    static size_t formatTokenized(const void *data, char *buf, size_t bufLen);
+
+  protected:
+    /// Called (from any task) when a line goes into an empty ring while deferred, so a subclass can have drainLog() run soon
+    virtual void onLogQueued() {}
+
   public:
-    explicit RedirectablePrint(Print *_dest) : dest(_dest) {}
+    explicit RedirectablePrint(Print *_dest);
 
     /**
      * Set a new destination
@@ -43,6 +200,30 @@ class RedirectablePrint : public Print
      */
     size_t log(const char *logLevel, const char *format, ...) __attribute__((format(printf, 3, 4)));
 
+    /**
+     * Log a line made by formatter from a copy of data (at most LOG_LINE_LEN bytes), only once it's written out, so a hot
+     * path (like printPacket()) pays for a copy rather than for formatting.  Pointers in data must outlive that (say
+     * string literals)
+     */
+    void logLazy(const char *logLevel, LogFormatter formatter, const void *data, size_t len);
+
+    /// A log() whose format the compiler turned into token (see LOG_TOKEN()), kept as just that and the raw arguments, and
+    /// written as a '$' and base64 line for bin/log_decoder.py
+    template <typename... Args> void logTokenized(const char *logLevel, uint32_t token, Args... args)
+    {
+        if (isSuppressed(logLevel))
+            return;
+        LogTokenWriter w(token);
+        w.addAll(args...);
+        logLazy(logLevel, formatTokenized, &w, offsetof(LogTokenWriter, buf) + w.len);
+    }
+
+    /// Start (or stop) leaving what we log for drainLog()
+    void setDeferred(bool d) { deferred = d; }
+
+    /// Write out all the lines which are waiting, from the task which owns our port
+    void drainLog();
+
     /** like printf but va_list based */
     size_t vprintf(const char *format, va_list arg);
 
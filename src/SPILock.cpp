@@ -1,12 +1,55 @@
 #include "SPILock.h"
+#include "RadioStats.h"
 #include "configuration.h"
 #include <Arduino.h>
 #include <assert.h>
 
-concurrency::Lock *spiLock;
+SPIArbiter *spiArbiter;
+
+void SPIArbiter::acquire(SPIClient client)
+{
+    if (client == SPI_CLIENT_RADIO) {
+        radioWaiting++;
+        uint32_t start = micros();
+        lock.lock();
+        radioWaiting--;
+        radioStats.record(RadioStats::SPI_WAIT, micros() - start);
+    } else {
+        // Don't take the bus from under a radio which is waiting for it (the lock doesn't know who should go first)
+        while (isRadioWaiting())
+            delay(1);
+        lock.lock();
+        displaySinceMicros = micros();
+    }
+}
+
+void SPIArbiter::release(SPIClient client)
+{
+    if (client != SPI_CLIENT_RADIO)
+        radioStats.record(RadioStats::SPI_HOLD, micros() - displaySinceMicros);
+    lock.unlock();
+}
+
+void SPIArbiter::yieldToRadio(SPIClient client)
+{
+    if (!isRadioWaiting())
+        return;
+    release(client);
+    acquire(client);
+}
+
+SPIGuard::SPIGuard(SPIClient c) : client(c)
+{
+    spiArbiter->acquire(client);
+}
+
+SPIGuard::~SPIGuard()
+{
+    spiArbiter->release(client);
+}
 
 void initSPI()
 {
-    assert(!spiLock);
-    spiLock = new concurrency::Lock();
-}
\ No newline at end of file
+    assert(!spiArbiter);
+    spiArbiter = new SPIArbiter();
+}
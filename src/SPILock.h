@@ -1,12 +1,61 @@
 #pragma once
 
-#include "../concurrency/LockGuard.h"
+#include "../concurrency/Lock.h"
+#include <atomic>
+#include <stdint.h>
+
+/// Who wants the SPI bus, the radio goes first
+enum SPIClient : uint8_t { SPI_CLIENT_RADIO, SPI_CLIENT_DISPLAY };
+
+/**
+ * Gives out the SPI bus, which the radio shares with the display on some boards.
+ *
+ * A display pushing a whole frame can hold the bus for far longer than the radio can wait to read a packet (or restart
+ * receive) after an interrupt, so between chunks of a long transfer (for the TFT, each row) its owner calls
+ * yieldToRadio(), which hands the bus to the radio if it's waiting and takes it back once the radio is done.
+ *
+ * How long the radio waited for the bus (RadioStats::SPI_WAIT) and how long the display held it at a stretch
+ * (RadioStats::SPI_HOLD) go in radioStats.
+ */
+class SPIArbiter
+{
+    concurrency::Lock lock;
+
+    /// How many radio transactions are waiting for the bus, the display doesn't take it back while there are any
+    std::atomic<uint8_t> radioWaiting{0};
+
+    /// When the display took the bus
+    uint32_t displaySinceMicros = 0;
+
+  public:
+    /// Wait for the bus, must be on the same task as the release()
+    void acquire(SPIClient client);
+    void release(SPIClient client);
+
+    /// Is the radio waiting for the bus we hold
+    bool isRadioWaiting() const { return radioWaiting.load(std::memory_order_relaxed) != 0; }
+
+    /// Between chunks of a long transfer: if the radio is waiting let it have the bus, then wait to take it back
+    void yieldToRadio(SPIClient client);
+};
 
 /**
- * Used to provide mutual exclusion for access to the SPI bus.  Usage:
- * concurrency::LockGuard g(spiLock);
+ * Holds the SPI bus for as long as it's in scope. Usage:
+ * SPIGuard g(SPI_CLIENT_DISPLAY);
  */
-extern concurrency::Lock *spiLock;
+class SPIGuard
+{
+    SPIClient client;
+
+  public:
+    explicit SPIGuard(SPIClient c);
+    ~SPIGuard();
+
+    SPIGuard(const SPIGuard &) = delete;
+    SPIGuard &operator=(const SPIGuard &) = delete;
+};
+
+extern SPIArbiter *spiArbiter;
 
-/** Setup SPI access and create the spiLock lock. */
-void initSPI();
\ No newline at end of file
+/** Setup SPI access and create spiArbiter. */
+void initSPI();
@@ -2,6 +2,7 @@
 #include "NodeDB.h"
 #include "PowerFSM.h"
 #include "configuration.h"
+#include "sleep.h"
 
 #define Port Serial
 // Defaulting to the formerly removed phone_timeout_secs value of 15 minutes
@@ -19,6 +20,7 @@ void consolePrintf(const char *format, ...)
 {
     va_list arg;
     va_start(arg, format);
+    console->drainLog(); // after what was logged before us
     console->vprintf(format, arg);
     va_end(arg);
     console->flush();
@@ -31,7 +33,14 @@ SerialConsole::SerialConsole() : StreamAPI(&Port), RedirectablePrint(&Port), con
     canWrite = false; // We don't send packets to our port until it has talked to us first
                       // setDestination(&noopPrint); for testing, try turning off 'all' debug output and see what leaks
 
+    setPriority(PRIORITY_UI); // writing out the log (and serving a client) can wait for the radio
+
     Port.begin(SERIAL_BAUD);
+#if defined(ARCH_ESP32) && !ARDUINO_USB_CDC_ON_BOOT
+    // A real UART, whose driver tells us when bytes arrive, so between packets we need not poll it
+    Port.onReceive([this]() { wake(); }, false);
+    setWakeSource(true);
+#endif
 #if defined(ARCH_NRF52) || defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(ARCH_RP2040)
     time_t timeout = millis();
     while (!Port) {
@@ -47,11 +56,13 @@ SerialConsole::SerialConsole() : StreamAPI(&Port), RedirectablePrint(&Port), con
 
 int32_t SerialConsole::runOnce()
 {
+    drainLog();
     return runOncePart();
 }
 
 void SerialConsole::flush()
 {
+    drainLog();
     Port.flush();
 }
 
@@ -62,6 +73,12 @@ bool SerialConsole::checkIsConnected()
     return (now - lastContactMsec) < SERIAL_CONNECTION_TIMEOUT;
 }
 
+void SerialConsole::onConnectionChanged(bool connected)
+{
+    setSerialClientAwake(connected);
+    StreamAPI::onConnectionChanged(connected);
+}
+
 /**
  * we override this to notice when we've received a protobuf over the serial
  * stream.  Then we shunt off debug serial output.
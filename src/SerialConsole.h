@@ -31,6 +31,15 @@ class SerialConsole : public StreamAPI, public RedirectablePrint, private concur
   protected:
     /// Check the current underlying physical link to see if the client is currently connected
     virtual bool checkIsConnected() override;
+
+    /// Packets for our client don't wait for our next poll
+    virtual void onNowHasData(uint32_t fromRadioNum) override { wake(); }
+
+    /// Nor do log lines, which runOnce() writes out
+    virtual void onLogQueued() override { wake(); }
+
+    /// Our UART can't receive while we light sleep, so we stay awake as long as a client is connected
+    virtual void onConnectionChanged(bool connected) override;
 };
 
 // A simple wrapper to allow non class aware code write to the console
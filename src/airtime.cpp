@@ -1,6 +1,17 @@
 #include "airtime.h"
+#include "EnergyStats.h"
 #include "NodeDB.h"
+#include "PacketTrace.h"
+#include "RadioStats.h"
+#include "concurrency/OSThread.h"
 #include "configuration.h"
+#include "memGet.h"
+#include <algorithm>
+#include <stdio.h>
+
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/SpidevHal.h"
+#endif
 
 AirTime *airTime = NULL;
 
@@ -51,6 +62,18 @@ void AirTime::airtimeRotatePeriod()
 
     if (this->airtimes.lastPeriodIndex != this->currentPeriodIndex()) {
         LOG_DEBUG("Rotating airtimes to a new period = %u\n", this->currentPeriodIndex());
+        radioStats.log(); // once a period is often enough to see where our packet latency goes
+        energyStats.log();
+#if defined(ARCH_PORTDUINO) && PORTDUINO_SPIDEV_HAL
+        spidevStats.log();
+#endif
+#if PACKET_TRACE
+        packetTrace.log();
+#endif
+#if OSTHREAD_PROFILE
+        concurrency::logProfiles();
+#endif
+        memGet.logHeap();
 
         for (int i = PERIODS_TO_LOG - 2; i >= 0; --i) {
             this->airtimes.periodTX[i + 1] = this->airtimes.periodTX[i];
@@ -121,10 +144,28 @@ float AirTime::utilizationTXPercent()
     return (float(sum) / float(MS_IN_HOUR)) * 100;
 }
 
+void AirTime::logChannelSample(bool busy)
+{
+    // A plain average until we have a window's worth, then a moving one
+    if (numChannelSamples < CHANNEL_SAMPLE_WINDOW)
+        numChannelSamples++;
+    sampledBusy += ((busy ? 1.0f : 0.0f) - sampledBusy) / numChannelSamples;
+}
+
+float AirTime::sampledBusyPercent() const
+{
+    return numChannelSamples >= CHANNEL_SAMPLE_WINDOW / 8 ? sampledBusy * 100 : -1;
+}
+
+float AirTime::channelBusyPercent()
+{
+    return std::max(channelUtilizationPercent(), sampledBusyPercent());
+}
+
 bool AirTime::isTxAllowedChannelUtil(bool polite)
 {
     uint8_t percentage = (polite ? polite_channel_util_percent : max_channel_util_percent);
-    if (channelUtilizationPercent() < percentage) {
+    if (channelBusyPercent() < percentage) {
         return true;
     } else {
         LOG_WARN("Channel utilization is >%d percent. Skipping this opportunity to send.\n", percentage);
@@ -159,6 +200,44 @@ uint8_t AirTime::getSilentMinutes(float txPercent, float dutyCycle)
     return MINUTES_IN_HOUR;
 }
 
+uint8_t AirTime::getNumAccountingLines() const
+{
+    const NodeAirtime::Entry *nodes[AIRTIME_TOP_NODES];
+    const PortAirtime::Entry *ports[AIRTIME_TOP_PORTS];
+    return nodeAirtime.getTop(nodes, AIRTIME_TOP_NODES) + portAirtime.getTop(ports, AIRTIME_TOP_PORTS);
+}
+
+bool AirTime::getAccountingLine(uint8_t line, char *buf, size_t bufLen) const
+{
+    const NodeAirtime::Entry *nodes[AIRTIME_TOP_NODES];
+    uint8_t numNodes = nodeAirtime.getTop(nodes, AIRTIME_TOP_NODES);
+    if (line < numNodes) {
+        const NodeAirtime::Entry &e = *nodes[line];
+        uint32_t total = nodeAirtime.getTotalMsec();
+        snprintf(buf, bufLen, "node 0x%08x %ums (%u%%) err<=%ums", e.key, e.getMsec(), total ? e.getMsec() * 100 / total : 0,
+                 e.error);
+        return true;
+    }
+
+    const PortAirtime::Entry *ports[AIRTIME_TOP_PORTS];
+    uint8_t numPorts = portAirtime.getTop(ports, AIRTIME_TOP_PORTS);
+    if (line < numNodes + numPorts) {
+        const PortAirtime::Entry &e = *ports[line - numNodes];
+        uint32_t total = portAirtime.getTotalMsec();
+        snprintf(buf, bufLen, "port %u %ums (%u%%) err<=%ums", e.key, e.getMsec(), total ? e.getMsec() * 100 / total : 0,
+                 e.error);
+        return true;
+    }
+    return false;
+}
+
+void AirTime::logAccounting() const
+{
+    char line[64];
+    for (uint8_t i = 0; getAccountingLine(i, line, sizeof(line)); i++)
+        LOG_DEBUG("AirTime by %s\n", line);
+}
+
 AirTime::AirTime() : concurrency::OSThread("AirTime"), airtimes({}) {}
 
 int32_t AirTime::runOnce()
@@ -195,6 +274,13 @@ int32_t AirTime::runOnce()
     } else {
         this->airtimeRotatePeriod();
 
+        // Start a new window of who is using the channel, after saying who did in the last two
+        if (secSinceBoot % AIRTIME_WINDOW_SECS == 0) {
+            logAccounting();
+            nodeAirtime.rotate();
+            portAirtime.rotate();
+        }
+
         // Reset the channelUtilization window when we roll over
         if (lastUtilPeriod != utilPeriod) {
             lastUtilPeriod = utilPeriod;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "AirtimeSketch.h"
+#include "ChannelSampler.h"
 #include "MeshRadio.h"
 #include "concurrency/OSThread.h"
 #include "configuration.h"
@@ -33,6 +35,19 @@
 #define MS_IN_MINUTE (SECONDS_IN_MINUTE * 1000)
 #define MS_IN_HOUR (MINUTES_IN_HOUR * SECONDS_IN_MINUTE * 1000)
 
+/// How long each window of our per node and per port airtime lasts, we count the current one and the one before it
+#ifndef AIRTIME_WINDOW_SECS
+#define AIRTIME_WINDOW_SECS 600
+#endif
+
+/// How many of the nodes and portnums using most airtime we keep count of
+#ifndef AIRTIME_TOP_NODES
+#define AIRTIME_TOP_NODES 16
+#endif
+#ifndef AIRTIME_TOP_PORTS
+#define AIRTIME_TOP_PORTS 8
+#endif
+
 enum reportTypes { TX_LOG, RX_LOG, RX_ALL_LOG };
 
 void logAirtime(reportTypes reportType, uint32_t airtime_ms);
@@ -46,9 +61,43 @@ class AirTime : private concurrency::OSThread
     AirTime();
 
     void logAirtime(reportTypes reportType, uint32_t airtime_ms);
+
+    typedef AirtimeSketch<AIRTIME_TOP_NODES> NodeAirtime;
+    typedef AirtimeSketch<AIRTIME_TOP_PORTS> PortAirtime;
+
+    /// Charge airtime_ms we heard or sent to the node it came from (its originator, for a packet we relay)
+    void logNodeAirtime(NodeNum from, uint32_t airtime_ms) { nodeAirtime.add(from, airtime_ms); }
+
+    /// Charge airtime_ms of a packet we heard to its portnum (meshtastic_PortNum_UNKNOWN_APP if we couldn't decode it)
+    void logPortAirtime(uint32_t portnum, uint32_t airtime_ms) { portAirtime.add(portnum, airtime_ms); }
+
+    /// Who has been using the channel, over the last one to two AIRTIME_WINDOW_SECS
+    const NodeAirtime &getNodeAirtime() const { return nodeAirtime; }
+    const PortAirtime &getPortAirtime() const { return portAirtime; }
+
+    /// One line per node, then one per portnum, of our busiest (for the log and the phone)
+    uint8_t getNumAccountingLines() const;
+
+    /// Like RadioStats::getSummaryLine().  @return false if there is no such line
+    bool getAccountingLine(uint8_t line, char *buf, size_t bufLen) const;
+
+    void logAccounting() const;
+
     float channelUtilizationPercent();
     float utilizationTXPercent();
 
+    /// ChannelSampler just found the channel busy, or not
+    void logChannelSample(bool busy);
+
+    /// How much of the time ChannelSampler finds the channel busy, lately.  @return -1 until it has enough samples
+    float sampledBusyPercent() const;
+
+    /**
+     * How busy the channel is: the more of channelUtilizationPercent() (what we sent and demodulated) and
+     * sampledBusyPercent(), which also catches what we couldn't demodulate (weak or colliding packets, other radios)
+     */
+    float channelBusyPercent();
+
     float UtilizationPercentTX();
     uint32_t channelUtilization[CHANNEL_UTILIZATION_PERIODS] = {0};
     uint32_t utilizationTX[MINUTES_IN_HOUR] = {0};
@@ -71,6 +120,12 @@ class AirTime : private concurrency::OSThread
     uint8_t polite_channel_util_percent = 25;
     uint8_t polite_duty_cycle_percent = 50; // half of Duty Cycle allowance is ok for metadata
 
+    NodeAirtime nodeAirtime;
+    PortAirtime portAirtime;
+
+    float sampledBusy = 0; // of ChannelSampler's samples, 0 to 1, averaged over about CHANNEL_SAMPLE_WINDOW of them
+    uint32_t numChannelSamples = 0;
+
     struct airtimeStruct {
         uint32_t periodTX[PERIODS_TO_LOG];     // AirTime transmitted
         uint32_t periodRX[PERIODS_TO_LOG];     // AirTime received and repeated (Only valid mesh packets)
@@ -0,0 +1,227 @@
+#include "RtttlPlayer.h"
+#include "configuration.h"
+#include <Arduino.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(ARCH_ESP32) && !defined(ARCH_RP2040) && !defined(ARCH_PORTDUINO)
+#include "Tone.h"
+#endif
+
+// Portduino and the STM32WL have no buzzer to play on
+#if defined(ARCH_PORTDUINO) || defined(ARCH_STM32WL)
+#define RTTTL_NO_TONE
+#endif
+
+/// Each note's frequency in octave 4, from C
+static const uint16_t octave4[] = {262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494};
+
+size_t RtttlPlayer::parse(const char *rtttl, Note *notes, size_t size)
+{
+    // name:d=4,o=6,b=63:8c,8p,4e#.5,...
+    const char *p = strchr(rtttl, ':');
+    if (!p)
+        return 0;
+    p++;
+
+    unsigned defaultDuration = 4, defaultOctave = 6, bpm = 63;
+    while (*p && *p != ':') {
+        char key = tolower(*p++);
+        if (*p != '=')
+            continue;
+        char *end;
+        unsigned value = strtoul(p + 1, &end, 10);
+        p = end;
+        if (key == 'd' && value)
+            defaultDuration = value;
+        else if (key == 'o' && value <= 8)
+            defaultOctave = value;
+        else if (key == 'b' && value)
+            bpm = value;
+    }
+    if (*p++ != ':')
+        return 0;
+    uint32_t wholeMsec = 4 * 60000 / bpm;
+
+    size_t n = 0;
+    while (*p && n < size) {
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (!*p)
+            break;
+
+        char *end;
+        unsigned duration = strtoul(p, &end, 10);
+        p = end;
+        int semitone;
+        switch (tolower(*p)) {
+        case 'c':
+            semitone = 0;
+            break;
+        case 'd':
+            semitone = 2;
+            break;
+        case 'e':
+            semitone = 4;
+            break;
+        case 'f':
+            semitone = 5;
+            break;
+        case 'g':
+            semitone = 7;
+            break;
+        case 'a':
+            semitone = 9;
+            break;
+        case 'b':
+            semitone = 11;
+            break;
+        case 'p':
+            semitone = -1;
+            break;
+        default:
+            // Not a note, so skip to the next
+            while (*p && *p != ',')
+                p++;
+            continue;
+        }
+        p++;
+        if (*p == '#') {
+            semitone++;
+            p++;
+        }
+        uint32_t msec = wholeMsec / (duration ? duration : defaultDuration);
+        unsigned octave = defaultOctave;
+        // The dot can come before the octave or after it
+        if (*p == '.') {
+            msec += msec / 2;
+            p++;
+        }
+        if (isdigit(*p))
+            octave = *p++ - '0';
+        if (*p == '.') {
+            msec += msec / 2;
+            p++;
+        }
+
+        uint32_t frequency = 0;
+        if (semitone >= 0) {
+            frequency = semitone < 12 ? octave4[semitone] : octave4[0] * 2; // b# is the next octave's c
+            frequency = octave >= 4 ? frequency << (octave - 4) : frequency >> (4 - octave);
+        }
+        notes[n].frequency = frequency < UINT16_MAX ? frequency : UINT16_MAX;
+        notes[n].msec = msec < 1 ? 1 : (msec < UINT16_MAX ? msec : UINT16_MAX);
+        n++;
+
+        while (*p && *p != ',')
+            p++;
+    }
+    return n;
+}
+
+bool RtttlPlayer::play(uint8_t pin, const char *rtttl)
+{
+    stop();
+#ifdef RTTTL_NO_TONE
+    return false;
+#else
+    numNotes = parse(rtttl, notes, RTTTL_MAX_NOTES);
+    if (!numNotes)
+        return false;
+    durationMsec = 0;
+    for (size_t i = 0; i < numNotes; i++)
+        durationMsec += notes[i].msec;
+
+    this->pin = pin;
+    next = 0;
+    playing = true;
+#ifdef ARCH_ESP32
+    if (!timer) {
+        esp_timer_create_args_t args = {};
+        args.callback = onTimer;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "rtttl";
+        if (esp_timer_create(&args, &timer) != ESP_OK) {
+            LOG_ERROR("No timer to play the ringtone with\n");
+            timer = NULL;
+            playing = false;
+            return false;
+        }
+    }
+    startedAtMsec = millis();
+    esp_timer_start_once(timer, startNext() * 1000ULL);
+#else
+    nextAtMsec = millis() + startNext();
+#endif
+    return true;
+#endif
+}
+
+void RtttlPlayer::stop()
+{
+#ifdef ARCH_ESP32
+    if (timer)
+        esp_timer_stop(timer);
+#endif
+#ifndef RTTTL_NO_TONE
+    if (playing)
+        noTone(pin);
+#endif
+    playing = false;
+}
+
+uint32_t RtttlPlayer::startNext()
+{
+#ifndef RTTTL_NO_TONE
+    if (next >= numNotes) {
+        noTone(pin);
+        playing = false;
+        return 0;
+    }
+    const Note &n = notes[next++];
+    if (!n.frequency)
+        noTone(pin);
+#ifdef ARCH_ESP32
+    else
+        tone(pin, n.frequency); // until the timer starts the next
+#else
+    else
+        tone(pin, n.frequency, n.msec);
+#endif
+    return n.msec;
+#else
+    return 0;
+#endif
+}
+
+#ifdef ARCH_ESP32
+void RtttlPlayer::onTimer(void *arg)
+{
+    RtttlPlayer *player = static_cast<RtttlPlayer *>(arg);
+    uint32_t msec = player->startNext();
+    if (msec)
+        esp_timer_start_once(player->timer, msec * 1000ULL);
+}
+#endif
+
+uint32_t RtttlPlayer::service()
+{
+    if (!playing)
+        return 0;
+    uint32_t now = millis();
+#ifdef ARCH_ESP32
+    // The timer's playing it, we just say how long it has left
+    uint32_t played = now - startedAtMsec;
+    return played < durationMsec ? durationMsec - played : 1;
+#else
+    if ((int32_t)(now - nextAtMsec) >= 0) {
+        uint32_t msec = startNext();
+        if (!msec)
+            return 0;
+        nextAtMsec += msec;
+    }
+    return (int32_t)(nextAtMsec - now) > 0 ? nextAtMsec - now : 1;
+#endif
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARCH_ESP32
+#include <esp_timer.h>
+#endif
+
+/// The most notes of a ringtone we play, the rest are left off
+#ifndef RTTTL_MAX_NOTES
+#define RTTTL_MAX_NOTES 128
+#endif
+
+/**
+ * Plays an RTTTL ringtone on a PWM buzzer.  The ringtone is parsed into notes once, when it starts, rather than note by note
+ * as it plays.  On ESP32 each note is then started from a timer (the LEDC peripheral makes the tone itself), so nothing in
+ * the main loop need run until the song's over, and the caller can just come back after getDurationMsec().  Elsewhere
+ * tone() is given each note's length, and service() must be called again when it says, which is once per note.
+ */
+class RtttlPlayer
+{
+  public:
+    struct Note {
+        uint16_t frequency; // Hz, 0 for a pause
+        uint16_t msec;
+    };
+
+    /// Start playing rtttl on pin.  @return false if it has no notes
+    bool play(uint8_t pin, const char *rtttl);
+
+    void stop();
+
+    bool isPlaying() const { return playing; }
+
+    /// How long the song we're playing takes, all told
+    uint32_t getDurationMsec() const { return durationMsec; }
+
+    /// Start the next note if it's time.  @return msec until we need calling again, or 0 once the song's over
+    uint32_t service();
+
+    /// Parse rtttl into at most size notes.  @return how many
+    static size_t parse(const char *rtttl, Note *notes, size_t size);
+
+  private:
+    Note notes[RTTTL_MAX_NOTES];
+    size_t numNotes = 0;
+    volatile size_t next = 0; // the note we start next
+    volatile bool playing = false;
+    uint8_t pin = 0;
+    uint32_t durationMsec = 0;
+    uint32_t nextAtMsec = 0;
+
+    /// Start the next note, or end the song.  @return how long the note lasts, or 0 once the song's over
+    uint32_t startNext();
+
+#ifdef ARCH_ESP32
+    esp_timer_handle_t timer = NULL;
+    uint32_t startedAtMsec = 0;
+    static void onTimer(void *arg);
+#endif
+};
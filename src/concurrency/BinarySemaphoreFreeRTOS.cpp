@@ -22,7 +22,9 @@ BinarySemaphoreFreeRTOS::~BinarySemaphoreFreeRTOS()
  */
 bool BinarySemaphoreFreeRTOS::take(uint32_t msec)
 {
-    return xSemaphoreTake(semaphore, pdMS_TO_TICKS(msec));
+    // pdMS_TO_TICKS() overflows (to a short wait) for the long delays of a Scheduler with nothing due
+    uint64_t ticks = (uint64_t)msec * configTICK_RATE_HZ / 1000;
+    return xSemaphoreTake(semaphore, ticks < portMAX_DELAY ? (TickType_t)ticks : portMAX_DELAY - 1);
 }
 
 void BinarySemaphoreFreeRTOS::give()
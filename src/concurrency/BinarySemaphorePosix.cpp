@@ -15,13 +15,25 @@ BinarySemaphorePosix::~BinarySemaphorePosix() {}
  */
 bool BinarySemaphorePosix::take(uint32_t msec)
 {
-    delay(msec); // FIXME
-    return false;
+    std::unique_lock<std::mutex> lock(mutex);
+    bool r = cv.wait_for(lock, std::chrono::milliseconds(msec), [this] { return given; });
+    given = false;
+    return r;
 }
 
-void BinarySemaphorePosix::give() {}
+void BinarySemaphorePosix::give()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        given = true;
+    }
+    cv.notify_one();
+}
 
-IRAM_ATTR void BinarySemaphorePosix::giveFromISR(BaseType_t *pxHigherPriorityTaskWoken) {}
+IRAM_ATTR void BinarySemaphorePosix::giveFromISR(BaseType_t *pxHigherPriorityTaskWoken)
+{
+    give(); // our "interrupts" are just other threads
+}
 
 } // namespace concurrency
 
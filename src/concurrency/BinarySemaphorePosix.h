@@ -2,14 +2,23 @@
 
 #include "../freertosinc.h"
 
+#ifndef HAS_FREE_RTOS
+#include <condition_variable>
+#include <mutex>
+#endif
+
 namespace concurrency
 {
 
 #ifndef HAS_FREE_RTOS
 
+/// A binary semaphore from the C++ standard library, so give() from another thread (the packet task, a GPIO interrupt or a
+/// socket watcher) really does wake whoever is in take()
 class BinarySemaphorePosix
 {
-    // SemaphoreHandle_t semaphore;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool given = false;
 
   public:
     BinarySemaphorePosix();
@@ -16,7 +16,9 @@ bool InterruptableDelay::delay(uint32_t msec)
     // LOG_DEBUG("delay %u ", msec);
 
     // sem take will return false if we timed out (i.e. were not interrupted)
+    uint32_t start = millis();
     bool r = semaphore.take(msec);
+    idleMsec += millis() - start;
 
     // LOG_DEBUG("interrupt=%d\n", r);
     return !r;
@@ -24,6 +24,9 @@ class InterruptableDelay
 {
     BinarySemaphore semaphore;
 
+    /// How long we've spent in delay(), so idle/(idle + busy) says how much of the time our task could sleep
+    uint32_t idleMsec = 0;
+
   public:
     InterruptableDelay();
     ~InterruptableDelay();
@@ -36,6 +39,8 @@ class InterruptableDelay
     void interrupt();
 
     void interruptFromISR(BaseType_t *pxHigherPriorityTaskWoken);
+
+    uint32_t getIdleMsec() const { return idleMsec; }
 };
 
 } // namespace concurrency
\ No newline at end of file
@@ -24,9 +24,15 @@ void Lock::unlock()
 #else
 Lock::Lock() {}
 
-void Lock::lock() {}
+void Lock::lock()
+{
+    mutex.lock();
+}
 
-void Lock::unlock() {}
+void Lock::unlock()
+{
+    mutex.unlock();
+}
 #endif
 
 } // namespace concurrency
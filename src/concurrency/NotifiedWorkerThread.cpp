@@ -1,4 +1,5 @@
 #include "NotifiedWorkerThread.h"
+#include "PacketTask.h"
 #include "configuration.h"
 #include "main.h"
 
@@ -15,7 +16,7 @@ bool NotifiedWorkerThread::notify(uint32_t v, bool overwrite)
     bool r = notifyCommon(v, overwrite);
 
     if (r)
-        mainDelay.interrupt();
+        getDelay().interrupt();
 
     return r;
 }
@@ -50,9 +51,19 @@ IRAM_ATTR bool NotifiedWorkerThread::notifyCommon(uint32_t v, bool overwrite)
  */
 IRAM_ATTR bool NotifiedWorkerThread::notifyFromISR(BaseType_t *highPriWoken, uint32_t v, bool overwrite)
 {
+#if NOTIFY_TASK
+    if (notifyTask) {
+        // Our task looks at notification, our Scheduler need not
+        if (!overwrite && notification)
+            return false;
+        notification = v;
+        vTaskNotifyGiveFromISR(notifyTask, highPriWoken);
+        return true;
+    }
+#endif
     bool r = notifyCommon(v, overwrite);
     if (r)
-        mainDelay.interruptFromISR(highPriWoken);
+        getDelay().interruptFromISR(highPriWoken);
 
     return r;
 }
@@ -83,6 +94,48 @@ void NotifiedWorkerThread::checkNotification()
     }
 }
 
+#if NOTIFY_TASK
+void NotifiedWorkerThread::notifyTaskLoop(void *thread)
+{
+    NotifiedWorkerThread *t = (NotifiedWorkerThread *)thread;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Whoever is running a thread now finishes first (at our priority, the lock is a mutex), then it's us
+        packetLock->lock();
+        t->checkNotification();
+        packetLock->unlock();
+    }
+}
+#endif
+
+void NotifiedWorkerThread::startNotifyTask(const char *taskName)
+{
+#if NOTIFY_TASK
+    assert(packetLock && !notifyTask);
+#ifdef ARCH_RP2040
+    BaseType_t r = xTaskCreate(notifyTaskLoop, taskName, NOTIFY_TASK_STACK / sizeof(StackType_t), this, NOTIFY_TASK_PRIORITY,
+                               &notifyTask);
+    assert(r == pdPASS);
+    vTaskCoreAffinitySet(notifyTask, 1 << PACKET_TASK_CORE);
+#else
+    BaseType_t r = xTaskCreatePinnedToCore(notifyTaskLoop, taskName, NOTIFY_TASK_STACK, this, NOTIFY_TASK_PRIORITY, &notifyTask,
+                                           PACKET_TASK_CORE);
+    assert(r == pdPASS);
+#endif
+    LOG_INFO("%s notify task started on core %d\n", taskName, PACKET_TASK_CORE);
+#endif
+}
+
+bool NotifiedWorkerThread::inNotifyTask() const
+{
+#if NOTIFY_TASK
+    return notifyTask && xTaskGetCurrentTaskHandle() == notifyTask;
+#else
+    return false;
+#endif
+}
+
 int32_t NotifiedWorkerThread::runOnce()
 {
     enabled = false; // Only run once per notification
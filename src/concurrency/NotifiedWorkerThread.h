@@ -1,6 +1,28 @@
 #pragma once
 
 #include "OSThread.h"
+#include "configuration.h"
+
+/// Let a NotifiedWorkerThread have a task of its own which notifyFromISR() wakes directly (see startNotifyTask()), rather
+/// than waiting for its Scheduler to get round to it.  It takes turns with everything else through the packet task's lock,
+/// so only with one, on FreeRTOS
+#ifndef NOTIFY_TASK
+#if USE_PACKET_TASK && (defined(ARCH_ESP32) || defined(ARCH_RP2040))
+#define NOTIFY_TASK 1
+#else
+#define NOTIFY_TASK 0
+#endif
+#endif
+
+/// Above the packet task, so an interrupt is handled as soon as whatever holds its lock lets go
+#ifndef NOTIFY_TASK_PRIORITY
+#define NOTIFY_TASK_PRIORITY 4
+#endif
+
+/// In bytes on every platform.  onNotify() runs on it, so as much as the packet task
+#ifndef NOTIFY_TASK_STACK
+#define NOTIFY_TASK_STACK 8192
+#endif
 
 namespace concurrency
 {
@@ -15,8 +37,15 @@ class NotifiedWorkerThread : public OSThread
      */
     uint32_t notification = 0;
 
+#if NOTIFY_TASK
+    /// Our own task, if startNotifyTask() started one
+    TaskHandle_t notifyTask = NULL;
+
+    static void notifyTaskLoop(void *thread);
+#endif
+
   public:
-    NotifiedWorkerThread(const char *name) : OSThread(name) {}
+    NotifiedWorkerThread(const char *name, Scheduler *controller = &mainController) : OSThread(name, 0, controller) {}
 
     /**
      * Notify this thread so it can run
@@ -35,6 +64,14 @@ class NotifiedWorkerThread : public OSThread
      */
     bool notifyLater(uint32_t delay, uint32_t v, bool overwrite);
 
+    /**
+     * From now on, notifyFromISR() wakes a task of our own (at NOTIFY_TASK_PRIORITY, on the packet task's core), which
+     * runs onNotify() as soon as it has the packet task's lock - rather than our Scheduler running us on its next pass,
+     * after whatever it runs first.  Other notifications still go through our Scheduler.  Call after startPacketTask(),
+     * does nothing without NOTIFY_TASK
+     */
+    void startNotifyTask(const char *taskName);
+
   protected:
     virtual void onNotify(uint32_t notification) = 0;
 
@@ -46,6 +83,9 @@ class NotifiedWorkerThread : public OSThread
     /// any notifications are currently pending they will be handled immediately.
     void checkNotification();
 
+    /// @return true if we're being called from our own task (see startNotifyTask()), rather than by our Scheduler
+    bool inNotifyTask() const;
+
   private:
     /**
      * Notify this thread so it can run
@@ -1,7 +1,9 @@
 #include "OSThread.h"
+#include "PacketTask.h"
 #include "configuration.h"
 #include "memGet.h"
 #include <assert.h>
+#include <stdio.h>
 
 namespace concurrency
 {
@@ -17,17 +19,24 @@ bool OSThread::showWaiting = false;
 
 const OSThread *OSThread::currentThread;
 
-ThreadController mainController, timerController;
+Scheduler mainController("mainController");
 InterruptableDelay mainDelay;
 
-void OSThread::setup()
-{
-    mainController.ThreadName = "mainController";
-    timerController.ThreadName = "timerController";
-}
+#if USE_PACKET_TASK
+static Scheduler packetTaskController("packetController");
+static InterruptableDelay packetTaskDelay;
+
+Scheduler &packetController = packetTaskController;
+InterruptableDelay &packetDelay = packetTaskDelay;
+#else
+Scheduler &packetController = mainController;
+InterruptableDelay &packetDelay = mainDelay;
+#endif
+
+void OSThread::setup() {}
 
-OSThread::OSThread(const char *_name, uint32_t period, ThreadController *_controller)
-    : Thread(NULL, period), controller(_controller)
+OSThread::OSThread(const char *_name, uint32_t period, Scheduler *_controller)
+    : Thread(NULL, period), controller(_controller), controllerDelay(_controller == &packetController ? &packetDelay : &mainDelay)
 {
     assertIsSetup();
 
@@ -55,6 +64,7 @@ void OSThread::setIntervalFromNow(unsigned long _interval)
 
     // Cache the next run based on the last_run
     _cached_next_run = millis() + interval;
+    requeue();
 }
 
 bool OSThread::shouldRun(unsigned long time)
@@ -80,9 +90,41 @@ void OSThread::run()
 {
 #ifdef DEBUG_HEAP
     auto heap = memGet.getFreeHeap();
+#endif
+#if OSTHREAD_PROFILE
+    int32_t late = millis() - dueMsec;
+#endif
+#if USE_PACKET_TASK
+    // Everything outside the packet task takes turns with it (one runOnce at a time), see PacketTask.h
+    Lock *lock = controller != &packetController ? packetLock : NULL;
+    if (lock)
+        lock->lock();
 #endif
     currentThread = this;
+#if OSTHREAD_PROFILE
+    uint32_t startMicros = micros();
+#endif
     auto newDelay = runOnce();
+#if OSTHREAD_PROFILE
+    uint32_t took = micros() - startMicros;
+#endif
+#if USE_PACKET_TASK
+    if (lock)
+        lock->unlock();
+#endif
+#if OSTHREAD_PROFILE
+    profile.runs++;
+    profile.totalMicros += took;
+    if (took > profile.maxMicros)
+        profile.maxMicros = took;
+    if (late > 0) {
+        profile.totalLateMsec += late;
+        if ((uint32_t)late > profile.maxLateMsec)
+            profile.maxLateMsec = late;
+    }
+    if (controller)
+        controller->sampleStack(this);
+#endif
 #ifdef DEBUG_HEAP
     auto newHeap = memGet.getFreeHeap();
     if (newHeap < heap)
@@ -93,8 +135,12 @@ void OSThread::run()
 
     runned();
 
+    if (hasWakeSource && newDelay > 0 && newDelay < OSTHREAD_WAKE_SOURCE_POLL_MSEC)
+        newDelay = OSTHREAD_WAKE_SOURCE_POLL_MSEC;
+
+    // Our Scheduler looks at where we are due once we've run, so no need to requeue()
     if (newDelay >= 0)
-        setInterval(newDelay);
+        Thread::setInterval(newDelay);
 
     currentThread = NULL;
 }
@@ -102,7 +148,7 @@ void OSThread::run()
 int32_t OSThread::disable()
 {
     enabled = false;
-    setInterval(INT32_MAX);
+    Thread::setInterval(INT32_MAX);
 
     return INT32_MAX;
 }
@@ -139,4 +185,95 @@ void assertIsSetup()
     assert(hasBeenSetup);
 }
 
+#if OSTHREAD_PROFILE
+/// Our Schedulers, packetController only if it's one of its own
+static int getControllers(const Scheduler **out)
+{
+    out[0] = &mainController;
+    if (&packetController == &mainController)
+        return 1;
+    out[1] = &packetController;
+    return 2;
+}
+
+int getCostliestThreads(OSThread **out, int max)
+{
+    const Scheduler *controllers[2];
+    int numControllers = getControllers(controllers), n = 0;
+    for (int c = 0; c < numControllers; c++) {
+        for (int i = 0; i < controllers[c]->size(); i++) {
+            OSThread *t = controllers[c]->get(i);
+            uint64_t total = t->getProfile().totalMicros;
+            if (!t->getProfile().runs)
+                continue;
+
+            // Insertion sort, keeping only the max costliest
+            int j = n < max ? n++ : max;
+            for (; j > 0 && out[j - 1]->getProfile().totalMicros < total; j--)
+                if (j < max)
+                    out[j] = out[j - 1];
+            if (j < max)
+                out[j] = t;
+        }
+    }
+    return n;
+}
+
+int getNumProfileLines()
+{
+    const Scheduler *controllers[2];
+    OSThread *costliest[OSTHREAD_PROFILE_TOP];
+    return getControllers(controllers) + getCostliestThreads(costliest, OSTHREAD_PROFILE_TOP);
+}
+
+/// " stack_free=N" if we know it
+static void formatStackFree(char *buf, size_t bufLen, uint32_t free)
+{
+    if (free == UINT32_MAX)
+        *buf = '\0';
+    else
+        snprintf(buf, bufLen, " stack_free=%u", (unsigned)free);
+}
+
+void getProfileLine(int line, char *buf, size_t bufLen)
+{
+    char stack[24];
+    const Scheduler *controllers[2];
+    int numControllers = getControllers(controllers);
+    if (line < numControllers) {
+        const Scheduler *c = controllers[line];
+        const InterruptableDelay &d = line ? packetDelay : mainDelay;
+        formatStackFree(stack, sizeof(stack), c->getMinStackFree());
+        uint32_t now = millis();
+        snprintf(buf, bufLen, "%s threads=%d idle=%u%%%s", c->getName(), c->size(),
+                 (unsigned)(now ? (uint64_t)d.getIdleMsec() * 100 / now : 0), stack);
+        return;
+    }
+
+    OSThread *costliest[OSTHREAD_PROFILE_TOP];
+    int n = getCostliestThreads(costliest, OSTHREAD_PROFILE_TOP);
+    line -= numControllers;
+    if (line >= n) {
+        *buf = '\0';
+        return;
+    }
+    const OSThread::Profile &p = costliest[line]->getProfile();
+    formatStackFree(stack, sizeof(stack), p.minStackFree);
+    snprintf(buf, bufLen, "thread %s runs=%u total=%ums avg=%uus max=%uus late avg=%ums max=%ums%s",
+             costliest[line]->ThreadName.c_str(), (unsigned)p.runs, (unsigned)(p.totalMicros / 1000),
+             (unsigned)(p.totalMicros / p.runs), (unsigned)p.maxMicros, (unsigned)(p.totalLateMsec / p.runs),
+             (unsigned)p.maxLateMsec, stack);
+}
+
+void logProfiles()
+{
+    char line[160];
+    int n = getNumProfileLines();
+    for (int i = 0; i < n; i++) {
+        getProfileLine(i, line, sizeof(line));
+        LOG_DEBUG("%s\n", line);
+    }
+}
+#endif
+
 } // namespace concurrency
@@ -4,21 +4,34 @@
 #include <stdint.h>
 
 #include "Thread.h"
-#include "ThreadController.h"
 #include "concurrency/InterruptableDelay.h"
+#include "concurrency/Scheduler.h"
+#include "freertosinc.h"
 
 namespace concurrency
 {
 
-extern ThreadController mainController, timerController;
+extern Scheduler mainController;
 extern InterruptableDelay mainDelay;
 
+/// The controller (and its delay) for the packet path, run by the packet task if USE_PACKET_TASK, otherwise just
+/// mainController/mainDelay
+extern Scheduler &packetController;
+extern InterruptableDelay &packetDelay;
+
 #define RUN_SAME -1
 
+/// The least a thread which has a wake source (see OSThread::setWakeSource()) waits between runs it asks for, so that polling
+/// for what it gets woken for anyway doesn't keep us from sleeping
+#ifndef OSTHREAD_WAKE_SOURCE_POLL_MSEC
+#define OSTHREAD_WAKE_SOURCE_POLL_MSEC 1000
+#endif
+
 /**
  * @brief Base threading
  *
  * This is a pseudo threading layer that is super easy to port, well suited to our slow network and very ram & power efficient.
+ * Each thread is run by a Scheduler (mainController unless we say otherwise), see Scheduler.h.
  *
  * TODO FIXME @geeksville
  *
@@ -30,7 +43,44 @@ extern InterruptableDelay mainDelay;
  */
 class OSThread : public Thread
 {
-    ThreadController *controller;
+  public:
+    /// Which of the threads due at once a Scheduler runs first, lower first
+    enum Priority : uint8_t { PRIORITY_RADIO, PRIORITY_ROUTER, PRIORITY_DEFAULT, PRIORITY_UI };
+
+    /// What running us has cost, kept by run()
+    struct Profile {
+        uint32_t runs = 0;
+        uint64_t totalMicros = 0; // in runOnce(), not counting the wait for packetLock
+        uint32_t maxMicros = 0;
+        uint32_t totalLateMsec = 0; // how long after we were due (or woken) we started, summed
+        uint32_t maxLateMsec = 0;
+        uint32_t minStackFree = UINT32_MAX; // the least stack our task had left, if that was lowest just after we ran
+    };
+
+    /// Thread::enabled, but telling our Scheduler when it's set (so subclasses keep writing enabled = true)
+    class EnabledFlag
+    {
+        OSThread *thread;
+
+      public:
+        explicit EnabledFlag(OSThread *t) : thread(t) {}
+        operator bool() const { return thread->Thread::enabled; }
+        EnabledFlag &operator=(const EnabledFlag &other) { return *this = (bool)other; }
+        EnabledFlag &operator=(bool e)
+        {
+            thread->Thread::enabled = e;
+            thread->requeue();
+            return *this;
+        }
+    };
+
+  private:
+    friend class Scheduler;
+
+    Scheduler *controller;
+
+    /// What our controller's loop sleeps on
+    InterruptableDelay *controllerDelay;
 
     /// Show debugging info for disabled threads
     static bool showDisabled;
@@ -41,11 +91,47 @@ class OSThread : public Thread
     /// Show debugging info for threads we decide not to run;
     static bool showWaiting;
 
+    /// Where our Scheduler keeps us
+    enum SchedState : uint8_t { SCHED_IDLE, SCHED_WAITING, SCHED_READY, SCHED_RAN };
+    SchedState schedState = SCHED_IDLE;
+    int16_t heapIndex = -1; // in Scheduler::waiting
+    uint32_t deadline = 0;  // _cached_next_run when we went into Scheduler::waiting
+    Priority priority = PRIORITY_DEFAULT;
+    bool hasWakeSource = false;
+    std::atomic<bool> isRequeued{false}; // are we on our Scheduler's requeued list
+    OSThread *nextRequeued = NULL;
+
+#if OSTHREAD_PROFILE
+    Profile profile;
+    uint32_t dueMsec = 0;      // when we were due to run, or woken if that was later
+    uint32_t requeuedMsec = 0; // when we last went on our Scheduler's requeued list
+#endif
+
+    /// Our schedule last changed at since, so we are due at the later of that and deadline
+    void setDueSince(uint32_t since)
+    {
+#if OSTHREAD_PROFILE
+        dueMsec = (int32_t)(deadline - since) > 0 ? deadline : since;
+#else
+        (void)since;
+#endif
+    }
+
+    /// Have our Scheduler look at our schedule again
+    void requeue()
+    {
+        if (controller)
+            controller->requeue(this);
+    }
+
   public:
     /// For debug printing only (might be null)
     static const OSThread *currentThread;
 
-    OSThread(const char *name, uint32_t period = 0, ThreadController *controller = &mainController);
+    /// Shadows Thread::enabled
+    EnabledFlag enabled{this};
+
+    OSThread(const char *name, uint32_t period = 0, Scheduler *controller = &mainController);
 
     virtual ~OSThread();
 
@@ -60,7 +146,52 @@ class OSThread : public Thread
      */
     void setIntervalFromNow(unsigned long _interval);
 
+    /// Wait a specified number msecs from when we last ran, safe from any task or ISR
+    void setInterval(unsigned long _interval)
+    {
+        Thread::setInterval(_interval);
+        requeue();
+    }
+
+    /// Run us as soon as our Scheduler can, say when something we read from arrived.  Doesn't enable us
+    void wake()
+    {
+        setInterval(0);
+        controllerDelay->interrupt();
+    }
+
+    /// wake() from an ISR
+    void wakeFromISR(BaseType_t *higherPriWoken)
+    {
+        setInterval(0);
+        controllerDelay->interruptFromISR(higherPriWoken);
+    }
+
+    /// The delay our controller's loop sleeps on, interrupt() it (after setInterval(0)) to have us run ASAP
+    InterruptableDelay &getDelay() const { return *controllerDelay; }
+
+#if OSTHREAD_PROFILE
+    /// What running us has cost so far.  Read from another task it might be a run out of date, it's only for showing
+    const Profile &getProfile() const { return profile; }
+
+    const Scheduler *getController() const { return controller; }
+#endif
+
   protected:
+    /// Run ahead of (or behind) the other threads due at the same time as us
+    void setPriority(Priority p)
+    {
+        priority = p;
+        requeue();
+    }
+
+    /**
+     * Say that something (an interrupt, a driver callback, onNowHasData()) calls wake() whenever there's work for us, so
+     * any interval runOnce() returns short of OSTHREAD_WAKE_SOURCE_POLL_MSEC (but for 0, more work now) is only a fallback
+     * poll and gets stretched to that
+     */
+    void setWakeSource(bool has) { hasWakeSource = has; }
+
     /**
      * The method that will be called each time our thread gets a chance to run
      *
@@ -88,4 +219,19 @@ extern bool hasBeenSetup;
 
 void assertIsSetup();
 
+#if OSTHREAD_PROFILE
+/// The threads of mainController and packetController which have spent longest running, longest first.  @return how many
+/// (at most max) we put in out
+int getCostliestThreads(OSThread **out, int max);
+
+/// How many lines getProfileLine() has: one per Scheduler, then one per thread getCostliestThreads() finds
+int getNumProfileLines();
+
+/// One line of our thread profiles (for the log or the phone)
+void getProfileLine(int line, char *buf, size_t bufLen);
+
+/// Log all of getProfileLine(), so we can see what keeps our loop from the radio
+void logProfiles();
+#endif
+
 } // namespace concurrency
\ No newline at end of file
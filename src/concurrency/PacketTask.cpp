@@ -0,0 +1,59 @@
+#include "PacketTask.h"
+
+#if USE_PACKET_TASK
+
+#include "concurrency/OSThread.h"
+
+#if !(defined(ARCH_ESP32) && !CONFIG_FREERTOS_UNICORE) && !defined(ARCH_RP2040) && !defined(ARCH_PORTDUINO)
+#error "USE_PACKET_TASK needs a dual core ESP32, an RP2040 or Portduino"
+#endif
+
+#ifdef ARCH_PORTDUINO
+#include <thread>
+#endif
+
+namespace concurrency
+{
+
+Lock *packetLock;
+
+static void packetTaskLoop(void *)
+{
+    for (;;) {
+        packetLock->lock();
+        long delayMsec = packetController.runOrDelay();
+        packetLock->unlock();
+
+        // Never spin, the idle task on this core has to run to keep the task watchdog happy
+        packetDelay.delay(delayMsec > 0 ? delayMsec : 1);
+    }
+}
+
+void startPacketTask()
+{
+    assert(!packetLock);
+    packetLock = new Lock();
+
+#if defined(ARCH_PORTDUINO)
+    // A plain thread, Linux puts it on whichever core is free
+    std::thread(packetTaskLoop, (void *)NULL).detach();
+    LOG_INFO("Packet task started\n");
+#elif defined(ARCH_RP2040)
+    // arduino-pico's FreeRTOS is the SMP port, which counts stack in words and pins a task by its core affinity
+    TaskHandle_t task;
+    BaseType_t r = xTaskCreate(packetTaskLoop, "packet", PACKET_TASK_STACK / sizeof(StackType_t), NULL, PACKET_TASK_PRIORITY,
+                               &task);
+    assert(r == pdPASS);
+    vTaskCoreAffinitySet(task, 1 << PACKET_TASK_CORE);
+    LOG_INFO("Packet task started on core %d\n", PACKET_TASK_CORE);
+#else
+    BaseType_t r = xTaskCreatePinnedToCore(packetTaskLoop, "packet", PACKET_TASK_STACK, NULL, PACKET_TASK_PRIORITY, NULL,
+                                           PACKET_TASK_CORE);
+    assert(r == pdPASS);
+    LOG_INFO("Packet task started on core %d\n", PACKET_TASK_CORE);
+#endif
+}
+
+} // namespace concurrency
+
+#endif
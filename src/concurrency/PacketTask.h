@@ -0,0 +1,46 @@
+#pragma once
+
+#include "configuration.h"
+
+#if USE_PACKET_TASK
+
+#include "concurrency/Lock.h"
+
+/// The packet task runs on whichever core loop() isn't on
+#ifndef PACKET_TASK_CORE
+#ifdef ARCH_RP2040
+#define PACKET_TASK_CORE 1 // arduino-pico runs loop() on core 0
+#else
+#define PACKET_TASK_CORE (ARDUINO_RUNNING_CORE ? 0 : 1)
+#endif
+#endif
+
+/// Above loop() (priority 1) but below the WiFi and bluetooth stacks
+#ifndef PACKET_TASK_PRIORITY
+#define PACKET_TASK_PRIORITY 3
+#endif
+
+/// Received packets are handled all the way through the modules on this task, so it needs as much stack as loop() does (in
+/// bytes, on every platform)
+#ifndef PACKET_TASK_STACK
+#define PACKET_TASK_STACK 8192
+#endif
+
+namespace concurrency
+{
+
+/**
+ * Held by the packet task while it runs packetController, and by everything else around each runOnce (see OSThread::run).
+ * The packet path and the rest of the firmware still never touch the mesh state at the same time, but the packet path now
+ * only waits for one thread to finish rather than for a whole pass of the main loop, and wakes straight away on an interrupt.
+ *
+ * NULL until startPacketTask(), setup() runs single threaded.
+ */
+extern Lock *packetLock;
+
+/// Start the task running packetController, call once at the end of setup()
+void startPacketTask();
+
+} // namespace concurrency
+
+#endif
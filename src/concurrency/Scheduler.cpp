@@ -0,0 +1,303 @@
+#include "Scheduler.h"
+#include "concurrency/OSThread.h"
+#include "configuration.h"
+#include <assert.h>
+
+namespace concurrency
+{
+
+bool Scheduler::isReadyBefore(const OSThread *a, const OSThread *b)
+{
+    return a->priority != b->priority ? a->priority < b->priority : isBefore(a->deadline, b->deadline);
+}
+
+void Scheduler::setWaiting(int i, OSThread *t)
+{
+    waiting[i] = t;
+    t->heapIndex = i;
+}
+
+void Scheduler::siftUpWaiting(int i)
+{
+    OSThread *t = waiting[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!isBefore(t->deadline, waiting[parent]->deadline))
+            break;
+        setWaiting(i, waiting[parent]);
+        i = parent;
+    }
+    setWaiting(i, t);
+}
+
+void Scheduler::siftDownWaiting(int i)
+{
+    OSThread *t = waiting[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= numWaiting)
+            break;
+        if (child + 1 < numWaiting && isBefore(waiting[child + 1]->deadline, waiting[child]->deadline))
+            child++;
+        if (!isBefore(waiting[child]->deadline, t->deadline))
+            break;
+        setWaiting(i, waiting[child]);
+        i = child;
+    }
+    setWaiting(i, t);
+}
+
+void Scheduler::pushWaiting(OSThread *t)
+{
+    t->deadline = t->_cached_next_run;
+    t->schedState = OSThread::SCHED_WAITING;
+    setWaiting(numWaiting, t);
+    siftUpWaiting(numWaiting++);
+}
+
+void Scheduler::removeWaiting(OSThread *t)
+{
+    int i = t->heapIndex;
+    t->schedState = OSThread::SCHED_IDLE;
+    t->heapIndex = -1;
+    if (i != --numWaiting) {
+        OSThread *moved = waiting[numWaiting];
+        setWaiting(i, moved);
+        siftUpWaiting(i);
+        siftDownWaiting(moved->heapIndex);
+    }
+}
+
+void Scheduler::pushReady(OSThread *t)
+{
+    t->schedState = OSThread::SCHED_READY;
+    int i = numReady++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!isReadyBefore(t, pass[parent]))
+            break;
+        pass[i] = pass[parent];
+        i = parent;
+    }
+    pass[i] = t;
+}
+
+void Scheduler::siftDownReady(int i)
+{
+    OSThread *t = pass[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= numReady)
+            break;
+        if (child + 1 < numReady && isReadyBefore(pass[child + 1], pass[child]))
+            child++;
+        if (!isReadyBefore(pass[child], t))
+            break;
+        pass[i] = pass[child];
+        i = child;
+    }
+    pass[i] = t;
+}
+
+OSThread *Scheduler::popReady()
+{
+    OSThread *top = pass[0];
+    if (--numReady) {
+        pass[0] = pass[numReady];
+        siftDownReady(0);
+    }
+    return top;
+}
+
+bool Scheduler::add(OSThread *t)
+{
+    if (numThreads == SCHEDULER_MAX_THREADS) {
+        LOG_ERROR("%s has no room for thread %s\n", name, t->ThreadName.c_str());
+        return false;
+    }
+    threads[numThreads++] = t;
+    requeue(t); // it isn't constructed yet, so we look at it from our next pass
+    return true;
+}
+
+void Scheduler::remove(OSThread *t)
+{
+    applyRequeued(); // so it's no longer on that list
+
+    for (int i = 0; i < numThreads; i++) {
+        if (threads[i] == t) {
+            threads[i] = threads[--numThreads];
+            break;
+        }
+    }
+
+    switch (t->schedState) {
+    case OSThread::SCHED_WAITING:
+        removeWaiting(t);
+        break;
+    case OSThread::SCHED_READY:
+        // Removed by a thread which ran before it this pass, rare enough to just look for it
+        for (int i = 0; i < numReady; i++) {
+            if (pass[i] == t) {
+                pass[i] = pass[--numReady];
+                for (int j = numReady / 2 - 1; j >= 0; j--)
+                    siftDownReady(j);
+                break;
+            }
+        }
+        break;
+    case OSThread::SCHED_RAN:
+        for (int i = SCHEDULER_MAX_THREADS - numRan; i < SCHEDULER_MAX_THREADS; i++) {
+            if (pass[i] == t) {
+                pass[i] = pass[SCHEDULER_MAX_THREADS - numRan--];
+                break;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    t->schedState = OSThread::SCHED_IDLE;
+    if (nextThread == t)
+        nextThread = NULL;
+}
+
+IRAM_ATTR void Scheduler::requeue(OSThread *t)
+{
+#if SCHEDULER_CRITICAL_SECTION
+    // Only plain loads and stores in here, which the M0+ does without a lock
+    uint32_t saved = spin_lock_blocking(requeueLock);
+    if (!t->isRequeued.load(std::memory_order_relaxed)) {
+        t->isRequeued.store(true, std::memory_order_relaxed);
+#if OSTHREAD_PROFILE
+        t->requeuedMsec = millis();
+#endif
+        t->nextRequeued = requeued.load(std::memory_order_relaxed);
+        requeued.store(t, std::memory_order_relaxed);
+    }
+    spin_unlock(requeueLock, saved);
+#else
+    if (t->isRequeued.exchange(true))
+        return; // already waiting for us to look at it
+#if OSTHREAD_PROFILE
+    t->requeuedMsec = millis();
+#endif
+
+    OSThread *head = requeued.load();
+    do {
+        t->nextRequeued = head;
+    } while (!requeued.compare_exchange_weak(head, t));
+#endif
+}
+
+void Scheduler::applyRequeued()
+{
+#if SCHEDULER_CRITICAL_SECTION
+    uint32_t saved = spin_lock_blocking(requeueLock);
+    OSThread *t = requeued.load(std::memory_order_relaxed);
+    requeued.store(NULL, std::memory_order_relaxed);
+    spin_unlock(requeueLock, saved);
+#else
+    OSThread *t = requeued.exchange(NULL);
+#endif
+    while (t) {
+        OSThread *next = t->nextRequeued;
+        t->isRequeued.store(false); // before we look, so a change after this puts it on the list again
+#if OSTHREAD_PROFILE
+        reschedule(t, t->requeuedMsec);
+#else
+        reschedule(t, 0);
+#endif
+        t = next;
+    }
+}
+
+void Scheduler::reschedule(OSThread *t, uint32_t since)
+{
+    bool isEnabled = t->Thread::enabled;
+    switch (t->schedState) {
+    case OSThread::SCHED_IDLE:
+        if (isEnabled) {
+            pushWaiting(t);
+            t->setDueSince(since);
+        }
+        break;
+    case OSThread::SCHED_WAITING:
+        if (!isEnabled) {
+            removeWaiting(t);
+        } else if (t->deadline != t->_cached_next_run) {
+            bool sooner = isBefore(t->_cached_next_run, t->deadline);
+            t->deadline = t->_cached_next_run;
+            t->setDueSince(since);
+            if (sooner)
+                siftUpWaiting(t->heapIndex);
+            else
+                siftDownWaiting(t->heapIndex);
+        }
+        break;
+    default:
+        break; // this pass looks at it again before running it, or once it ends
+    }
+}
+
+long Scheduler::runOrDelay()
+{
+    for (;;) {
+        applyRequeued();
+
+        // Everything due goes to the front of pass, highest priority first
+        uint32_t now = millis();
+        while (numWaiting && !isBefore(now, waiting[0]->deadline)) {
+            OSThread *t = waiting[0];
+            removeWaiting(t);
+            pushReady(t);
+        }
+        if (!numReady)
+            break;
+
+        OSThread *t = popReady();
+        t->schedState = OSThread::SCHED_RAN;
+        pass[SCHEDULER_MAX_THREADS - ++numRan] = t;
+        // It might have been disabled, or put off, since it was due
+        if (t->shouldRun(now))
+            t->run();
+    }
+
+    // What ran this pass waits for its next turn
+    while (numRan) {
+        OSThread *t = pass[SCHEDULER_MAX_THREADS - numRan--];
+        t->schedState = OSThread::SCHED_IDLE;
+        reschedule(t, millis());
+    }
+    applyRequeued();
+
+    nextThread = numWaiting ? waiting[0] : NULL;
+    if (!nextThread)
+        return INT32_MAX;
+    int32_t delay = nextThread->deadline - millis();
+    return delay > 0 ? delay : 0;
+}
+
+#if OSTHREAD_PROFILE
+void Scheduler::sampleStack(OSThread *t)
+{
+#ifdef HAS_FREE_RTOS
+    if (++runsSinceStack < OSTHREAD_PROFILE_STACK_EVERY)
+        return;
+    runsSinceStack = 0;
+
+    uint32_t free = uxTaskGetStackHighWaterMark(NULL);
+#ifndef ARDUINO_ARCH_ESP32
+    free *= sizeof(StackType_t); // only the ESP32 port counts it in bytes
+#endif
+    if (free < minStackFree) {
+        minStackFree = free;
+        t->profile.minStackFree = free;
+    }
+#else
+    (void)t;
+#endif
+}
+#endif
+
+} // namespace concurrency
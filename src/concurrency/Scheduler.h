@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Whether requeue() guards our requeued list with a critical section rather than a lock free exchange and compare-and-swap,
+/// as MEMORYPOOL_CRITICAL_SECTION does MemoryPool: on the RP2040 those fall back to a lock, which wakeFromISR() would wait
+/// on forever if it interrupted the holder
+#ifndef SCHEDULER_CRITICAL_SECTION
+#ifdef ARCH_RP2040
+#define SCHEDULER_CRITICAL_SECTION 1
+#else
+#define SCHEDULER_CRITICAL_SECTION 0
+#endif
+#endif
+
+#if SCHEDULER_CRITICAL_SECTION
+#include <hardware/sync.h>
+#endif
+
+/// How many OSThreads one Scheduler can run
+#ifndef SCHEDULER_MAX_THREADS
+#define SCHEDULER_MAX_THREADS 48
+#endif
+
+/// Keep what each OSThread costs us to run (see OSThread::Profile), a couple of micros() calls a run
+#ifndef OSTHREAD_PROFILE
+#define OSTHREAD_PROFILE 1
+#endif
+
+/// How many OSThread runs between looks at how much stack the task running them has left, which scans what's left of it
+#ifndef OSTHREAD_PROFILE_STACK_EVERY
+#define OSTHREAD_PROFILE_STACK_EVERY 16
+#endif
+
+/// How many of the costliest threads we show in the log, to the phone and in /json/report
+#ifndef OSTHREAD_PROFILE_TOP
+#define OSTHREAD_PROFILE_TOP 8
+#endif
+
+namespace concurrency
+{
+
+class OSThread;
+
+/**
+ * Runs OSThreads when they are due, in place of ArduinoThread's ThreadController (which asked every thread on every loop).
+ *
+ * The threads which are waiting are kept in a min-heap by when they next want to run, so a pass only looks at the threads
+ * which are due rather than all of them.  Of the threads due, the one with the highest OSThread::Priority runs first, and
+ * anything it wakes which outranks those still waiting their turn runs next.  Each thread runs at most once a pass, so one
+ * which keeps asking to run again can't keep loop() from the rest of its work.  Disabled threads cost nothing.
+ *
+ * A thread's schedule can change from any task or ISR (OSThread::setInterval(), enabled, OSThread::wake()), so all that does
+ * is push the thread onto a lock free list (see SCHEDULER_CRITICAL_SECTION for the RP2040).  The task which runs us applies
+ * that list before each thread it runs.
+ */
+class Scheduler
+{
+    const char *name;
+
+    /// Every thread we run
+    OSThread *threads[SCHEDULER_MAX_THREADS] = {};
+    int numThreads = 0;
+
+    /// The enabled threads which aren't due yet, a min-heap by OSThread::deadline
+    OSThread *waiting[SCHEDULER_MAX_THREADS] = {};
+    int numWaiting = 0;
+
+    /// This pass: the threads which are due, a heap by priority from the front, and those which already ran from the back
+    OSThread *pass[SCHEDULER_MAX_THREADS] = {};
+    int numReady = 0, numRan = 0;
+
+    /// The threads whose schedule changed since we last looked, linked through OSThread::nextRequeued
+    std::atomic<OSThread *> requeued;
+#if SCHEDULER_CRITICAL_SECTION
+    /// Held, with interrupts off, around each change to requeued (and the isRequeued of the threads on it)
+    spin_lock_t *requeueLock = spin_lock_instance(next_striped_spin_lock_num());
+#endif
+
+    static bool isBefore(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+    static bool isReadyBefore(const OSThread *a, const OSThread *b);
+
+    void setWaiting(int i, OSThread *t);
+    void siftUpWaiting(int i);
+    void siftDownWaiting(int i);
+    void pushWaiting(OSThread *t);
+    void removeWaiting(OSThread *t);
+
+    void siftDownReady(int i);
+    void pushReady(OSThread *t);
+    OSThread *popReady();
+
+    /// Look again at every thread on our requeued list
+    void applyRequeued();
+
+    /// Put t where its enabled and deadline say it belongs, unless it's part of this pass.  since is when that changed
+    void reschedule(OSThread *t, uint32_t since);
+
+#if OSTHREAD_PROFILE
+    /// The least stack (in bytes) the task which runs us has had left, UINT32_MAX until we've looked
+    uint32_t minStackFree = UINT32_MAX;
+    uint16_t runsSinceStack = 0;
+#endif
+
+  public:
+    /// For debug printing only: the thread which is due next after our last pass (might be null)
+    OSThread *nextThread = NULL;
+
+    explicit Scheduler(const char *_name) : name(_name), requeued(NULL) {}
+
+    const char *getName() const { return name; }
+
+    /// Start running t, @return false if we have no room for it
+    bool add(OSThread *t);
+
+    /// Stop running t, from the task which runs us
+    void remove(OSThread *t);
+
+    /// Safe from any task or ISR: look again at when t wants to run, and whether it's enabled, before we run anything else
+    void requeue(OSThread *t);
+
+    /// Run the threads which are due, @return how many msecs until the next one is
+    long runOrDelay();
+
+    int size() const { return numThreads; }
+
+    /// @return one of our threads, for debug printing
+    OSThread *get(int i) const { return i < numThreads ? threads[i] : NULL; }
+
+#if OSTHREAD_PROFILE
+    /// From OSThread::run() on the task which runs us, once t has run: now and then see how little stack that task has
+    /// left, and if that's the least yet blame t for it
+    void sampleStack(OSThread *t);
+
+    /// @return the least stack (in bytes) our task has had left, UINT32_MAX if we can't tell
+    uint32_t getMinStackFree() const { return minStackFree; }
+#endif
+};
+
+} // namespace concurrency
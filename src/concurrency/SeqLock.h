@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/// How many times a reader copies something a SeqLock guards before giving up, so a reader which interrupted the writer
+/// (an ISR, or a task on the same core at a higher priority) can't spin forever waiting for a write that can't finish
+#ifndef SEQLOCK_READ_TRIES
+#define SEQLOCK_READ_TRIES 8
+#endif
+
+namespace concurrency
+{
+
+/**
+ * @brief Lets readers on any task, core or ISR take a consistent copy of something one writer changes in place, without
+ * the writer ever waiting for them (or them for each other)
+ *
+ * The count is odd while a write is under way and bumped again once it's done, so a reader which saw the same even count
+ * before and after its copy knows no write touched it, otherwise it copies again.  Readers never write anything, so any
+ * number of them cost the writer just the two bumps.  One writer task only: beginWrite() and endWrite() may nest (the
+ * outermost pair is what readers see), but two tasks writing at once would need a lock of their own.
+ *
+ *     uint32_t seq;
+ *     do {
+ *         seq = lock.readBegin();
+ *         copy = shared;
+ *     } while (lock.readRetry(seq));
+ */
+class SeqLock
+{
+    std::atomic<uint32_t> seq{0};
+    uint8_t depth = 0; // only the writer touches this
+
+  public:
+    SeqLock() {}
+    SeqLock(const SeqLock &) = delete;
+    SeqLock &operator=(const SeqLock &) = delete;
+
+    void beginWrite()
+    {
+        if (depth++)
+            return;
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // readers see the odd count before any of our changes
+    }
+
+    void endWrite()
+    {
+        if (--depth)
+            return;
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Start a copy, @return what to hand readRetry() once it's taken
+    uint32_t readBegin() const { return seq.load(std::memory_order_acquire); }
+
+    /// @return true if a write started before or ran during the copy we started with readBegin(), so it may be torn
+    bool readRetry(uint32_t begun) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire); // our copy is done before we look again
+        return (begun & 1) || seq.load(std::memory_order_relaxed) != begun;
+    }
+};
+
+/**
+ * @brief RAII SeqLock write, see LockGuard
+ */
+class SeqWriteGuard
+{
+  public:
+    explicit SeqWriteGuard(SeqLock &lock) : lock(lock) { lock.beginWrite(); }
+    ~SeqWriteGuard() { lock.endWrite(); }
+
+    SeqWriteGuard(const SeqWriteGuard &) = delete;
+    SeqWriteGuard &operator=(const SeqWriteGuard &) = delete;
+
+  private:
+    SeqLock &lock;
+};
+
+} // namespace concurrency
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace concurrency
+{
+
+/**
+ * @brief Hands the latest of a stream of values from one task to another, without either ever waiting for the other
+ *
+ * Of our three copies one is the writer's, one the reader's and one the latest published: publish() and update() just swap
+ * theirs for that one, so values the reader doesn't get round to are skipped rather than queued.  One writer task and one
+ * reader task only.
+ */
+template <class T> class TripleBuffer
+{
+    static const uint8_t FRESH = 0x4; // in middle, while it holds a value the reader hasn't taken
+
+    T buffers[3];
+    uint8_t writing = 0, reading = 1;
+    std::atomic<uint8_t> middle{2};
+
+  public:
+    TripleBuffer() {}
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    /// The writer's copy, to fill in then publish().  It holds some older value, so fill in all of it
+    T &edit() { return buffers[writing]; }
+
+    /// Make edit() the latest value
+    void publish() { writing = middle.exchange(writing | FRESH) & ~FRESH; }
+
+    /// Take the latest value (if there's one we haven't), @return whether read() changed
+    bool update()
+    {
+        if (!(middle.load() & FRESH))
+            return false;
+        reading = middle.exchange(reading) & ~FRESH;
+        return true;
+    }
+
+    /// The reader's copy, which only update() changes
+    const T &read() const { return buffers[reading]; }
+};
+
+} // namespace concurrency
@@ -216,6 +216,103 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define HAS_BLUETOOTH 0
 #endif
 
+// Use a fixed size, statically allocated pool for MeshPackets instead of malloc/free.  Defaults to on for the small heap
+// platforms where packet churn fragments the heap, variants can override with -DUSE_STATIC_PACKET_POOL=0/1
+#ifndef USE_STATIC_PACKET_POOL
+#if defined(ARCH_NRF52) || defined(ARCH_RP2040) || defined(ARCH_STM32WL)
+#define USE_STATIC_PACKET_POOL 1
+#else
+#define USE_STATIC_PACKET_POOL 0
+#endif
+#endif
+
+// Pack small packets (acks, naks, tiny telemetry) which are waiting to go out together into one LoRa frame, so they share one
+// preamble and header.  Older firmware can't unpack these frames, so even when built in we only do it once we haven't heard
+// any radio which doesn't advertise support for a while.  Opt in with -DUSE_PACKET_AGGREGATION=1
+#ifndef USE_PACKET_AGGREGATION
+#define USE_PACKET_AGGREGATION 0
+#endif
+
+// Send our direct messages along the route we learned to their destination (see NextHopTable) instead of flooding them,
+// falling back to a flood when that route is stale or our first try goes unacked.  Whether built in or not we always stay
+// quiet for other nodes' routed messages when we know we're not on their route.  Opt out with -DUSE_NEXT_HOP_ROUTING=0
+#ifndef USE_NEXT_HOP_ROUTING
+#define USE_NEXT_HOP_ROUTING 1
+#endif
+
+// Send our reliable direct messages with only as many hops as a trace route showed their destination is away, plus
+// HOP_DISTANCE_MARGIN, rather than our whole hop limit.  Retries go out with the whole limit, and acks (which nobody retries)
+// always do.  Our packets carry no hop_start, so we never guess a distance from the hop_limit a packet arrived with.  Opt in
+// with -DUSE_HOP_DISTANCE_LIMIT=1
+#ifndef USE_HOP_DISTANCE_LIMIT
+#define USE_HOP_DISTANCE_LIMIT 0
+#endif
+
+// Take firmware images for our hardware model over the mesh, broadcast chunk by chunk on the admin channel by a distributor
+// (see FirmwareUpdateModule), and let the native build be one.  Opt in with -DUSE_MESH_FIRMWARE_UPDATE=1
+#ifndef USE_MESH_FIRMWARE_UPDATE
+#define USE_MESH_FIRMWARE_UPDATE 0
+#endif
+
+// Run the packet path (radio notifications, the Router and its retransmissions) in its own FreeRTOS task, pinned to the core
+// loop() isn't on, so a slow screen redraw or MQTT reconnect no longer waits in line in front of RX handling and TX timing.
+// Dual core ESP32, RP2040 and Portduino (on by default in its gateway mode), opt in with -DUSE_PACKET_TASK=1
+#ifndef USE_PACKET_TASK
+#define USE_PACKET_TASK 0
+#endif
+
+// Let SX126x radios sleep between short preamble checks while they listen (RX duty cycle), rather than keeping the receiver
+// on continuously.  Saves a good part of the idle listening current on battery relays, the windows are worked out from the
+// modem preset (see RadioInterface::applyModemConfig()).  Opt in with -DUSE_SX126X_RX_DUTY_CYCLE=1
+#ifndef USE_SX126X_RX_DUTY_CYCLE
+#define USE_SX126X_RX_DUTY_CYCLE 0
+#endif
+
+// Leave modules out of the build, for variants short of flash or RAM.  A variant sets -DMESHTASTIC_EXCLUDE_<MODULE>=1 for
+// each module it can do without (see setupModules(), which builds the rest only once they're enabled in moduleConfig)
+#ifndef MESHTASTIC_EXCLUDE_WAYPOINT
+#define MESHTASTIC_EXCLUDE_WAYPOINT 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_TRACEROUTE
+#define MESHTASTIC_EXCLUDE_TRACEROUTE 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_NEIGHBORINFO
+#define MESHTASTIC_EXCLUDE_NEIGHBORINFO 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_ATAK
+#define MESHTASTIC_EXCLUDE_ATAK 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_REMOTEHARDWARE
+#define MESHTASTIC_EXCLUDE_REMOTEHARDWARE 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_CANNEDMESSAGES
+#define MESHTASTIC_EXCLUDE_CANNEDMESSAGES 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_DETECTIONSENSOR
+#define MESHTASTIC_EXCLUDE_DETECTIONSENSOR 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_SERIAL
+#define MESHTASTIC_EXCLUDE_SERIAL 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_RANGETEST
+#define MESHTASTIC_EXCLUDE_RANGETEST 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_EXTERNALNOTIFICATION
+#define MESHTASTIC_EXCLUDE_EXTERNALNOTIFICATION 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_STOREFORWARD
+#define MESHTASTIC_EXCLUDE_STOREFORWARD 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_PAXCOUNTER
+#define MESHTASTIC_EXCLUDE_PAXCOUNTER 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_AUDIO
+#define MESHTASTIC_EXCLUDE_AUDIO 0
+#endif
+#ifndef MESHTASTIC_EXCLUDE_POWER_TELEMETRY
+#define MESHTASTIC_EXCLUDE_POWER_TELEMETRY 0
+#endif
+
 #include "DebugConfiguration.h"
 #include "RF95Configuration.h"
 
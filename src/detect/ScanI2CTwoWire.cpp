@@ -1,7 +1,11 @@
 #include "ScanI2CTwoWire.h"
 
+#include "FSCommon.h"
 #include "concurrency/LockGuard.h"
+#include "concurrency/OSThread.h"
 #include "configuration.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
 #if defined(ARCH_PORTDUINO)
 #include "linux/LinuxHardwareI2C.h"
 #endif
@@ -135,175 +139,374 @@ uint16_t ScanI2CTwoWire::getRegisterValue(const ScanI2CTwoWire::RegisterLocation
         type = T;                                                                                                                \
         break;
 
-void ScanI2CTwoWire::scanPort(I2CPort port)
+bool ScanI2CTwoWire::ping(TwoWire *i2cBus, ScanI2C::DeviceAddress addr) const
 {
-    concurrency::LockGuard guard((concurrency::Lock *)&lock);
+    i2cBus->beginTransmission(addr.address);
+#ifdef ARCH_PORTDUINO
+    return i2cBus->read() != -1;
+#else
+    uint8_t err = i2cBus->endTransmission();
+    if (err == 4)
+        LOG_ERROR("Unknown error at address 0x%x\n", addr.address);
+    return err == 0;
+#endif
+}
 
-    LOG_DEBUG("Scanning for i2c devices on port %d\n", port);
+ScanI2C::DeviceType ScanI2CTwoWire::identify(TwoWire *i2cBus, ScanI2C::DeviceAddress addr)
+{
+    uint16_t registerValue = 0x00;
+    ScanI2C::DeviceType type = NONE;
 
-    uint8_t err;
+    switch (addr.address) {
+    case SSD1306_ADDRESS:
+        type = probeOLED(addr);
+        break;
 
-    DeviceAddress addr(port, 0x00);
+#if !defined(ARCH_PORTDUINO) && !defined(ARCH_STM32WL)
+    case ATECC608B_ADDR:
+        type = ATECC608B;
+        if (atecc.begin(addr.address) == true) {
+            LOG_INFO("ATECC608B initialized\n");
+        } else {
+            LOG_WARN("ATECC608B initialization failed\n");
+        }
+        printATECCInfo();
+        break;
+#endif
 
-    uint16_t registerValue = 0x00;
-    ScanI2C::DeviceType type;
-    TwoWire *i2cBus;
 #ifdef RV3028_RTC
-    Melopero_RV3028 rtc;
+    case RV3028_RTC: {
+        // foundDevices[addr] = RTC_RV3028;
+        type = RTC_RV3028;
+        LOG_INFO("RV3028 RTC found\n");
+        Melopero_RV3028 rtc;
+        rtc.initI2C(*i2cBus);
+        rtc.writeToRegister(0x35, 0x07); // no Clkout
+        rtc.writeToRegister(0x37, 0xB4);
+        break;
+    }
 #endif
 
-#ifdef I2C_SDA1
-    if (port == I2CPort::WIRE1) {
-        i2cBus = &Wire1;
-    } else {
+#ifdef PCF8563_RTC
+        SCAN_SIMPLE_CASE(PCF8563_RTC, RTC_PCF8563, "PCF8563 RTC found\n")
 #endif
-        i2cBus = &Wire;
-#ifdef I2C_SDA1
-    }
+
+    case CARDKB_ADDR:
+        // Do we have the RAK14006 instead?
+        registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0x04), 1);
+        if (registerValue == 0x02) {
+            // KEYPAD_VERSION
+            LOG_INFO("RAK14004 found\n");
+            type = RAK14004;
+        } else {
+            LOG_INFO("m5 cardKB found\n");
+            type = CARDKB;
+        }
+        break;
+
+        SCAN_SIMPLE_CASE(TDECK_KB_ADDR, TDECKKB, "T-Deck keyboard found\n");
+        SCAN_SIMPLE_CASE(BBQ10_KB_ADDR, BBQ10KB, "BB Q10 keyboard found\n");
+        SCAN_SIMPLE_CASE(ST7567_ADDRESS, SCREEN_ST7567, "st7567 display found\n");
+#ifdef HAS_NCP5623
+        SCAN_SIMPLE_CASE(NCP5623_ADDR, NCP5623, "NCP5623 RGB LED found\n");
+#endif
+#ifdef HAS_PMU
+        SCAN_SIMPLE_CASE(XPOWERS_AXP192_AXP2101_ADDRESS, PMU_AXP192_AXP2101, "axp192/axp2101 PMU found\n")
 #endif
+    case BME_ADDR:
+    case BME_ADDR_ALTERNATE:
+        registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0xD0), 1); // GET_ID
+        switch (registerValue) {
+        case 0x61:
+            LOG_INFO("BME-680 sensor found at address 0x%x\n", (uint8_t)addr.address);
+            type = BME_680;
+            break;
+        case 0x60:
+            LOG_INFO("BME-280 sensor found at address 0x%x\n", (uint8_t)addr.address);
+            type = BME_280;
+            break;
+        default:
+            LOG_INFO("BMP-280 sensor found at address 0x%x\n", (uint8_t)addr.address);
+            type = BMP_280;
+        }
+        break;
+
+    case INA_ADDR:
+    case INA_ADDR_ALTERNATE:
+        registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0xFE), 2);
+        LOG_DEBUG("Register MFG_UID: 0x%x\n", registerValue);
+        if (registerValue == 0x5449) {
+            LOG_INFO("INA260 sensor found at address 0x%x\n", (uint8_t)addr.address);
+            type = INA260;
+        } else { // Assume INA219 if INA260 ID is not found
+            LOG_INFO("INA219 sensor found at address 0x%x\n", (uint8_t)addr.address);
+            type = INA219;
+        }
+        break;
+    case INA3221_ADDR:
+        LOG_INFO("INA3221 sensor found at address 0x%x\n", (uint8_t)addr.address);
+        type = INA3221;
+        break;
+    case MCP9808_ADDR:
+        registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0x07), 2);
+        if (registerValue == 0x0400) {
+            type = MCP9808;
+            LOG_INFO("MCP9808 sensor found\n");
+        } else {
+            type = LIS3DH;
+            LOG_INFO("LIS3DH accelerometer found\n");
+        }
+
+        break;
+
+        SCAN_SIMPLE_CASE(SHT31_ADDR, SHT31, "SHT31 sensor found\n")
+        SCAN_SIMPLE_CASE(SHTC3_ADDR, SHTC3, "SHTC3 sensor found\n")
+
+    case LPS22HB_ADDR_ALT:
+        SCAN_SIMPLE_CASE(LPS22HB_ADDR, LPS22HB, "LPS22HB sensor found\n")
+
+        SCAN_SIMPLE_CASE(QMC6310_ADDR, QMC6310, "QMC6310 Highrate 3-Axis magnetic sensor found\n")
+        SCAN_SIMPLE_CASE(QMI8658_ADDR, QMI8658, "QMI8658 Highrate 6-Axis inertial measurement sensor found\n")
+        SCAN_SIMPLE_CASE(QMC5883L_ADDR, QMC5883L, "QMC5883L Highrate 3-Axis magnetic sensor found\n")
+
+        SCAN_SIMPLE_CASE(PMSA0031_ADDR, PMSA0031, "PMSA0031 air quality sensor found\n")
+        SCAN_SIMPLE_CASE(MPU6050_ADDR, MPU6050, "MPU6050 accelerometer found\n");
+        SCAN_SIMPLE_CASE(BMA423_ADDR, BMA423, "BMA423 accelerometer found\n");
+
+    default:
+        LOG_INFO("Device found at address 0x%x was not able to be enumerated\n", addr.address);
+    }
+    return type;
+}
+
+void ScanI2CTwoWire::addDevice(ScanI2C::DeviceAddress addr, ScanI2C::DeviceType type)
+{
+    concurrency::LockGuard guard((concurrency::Lock *)&lock);
+    deviceAddresses[type] = addr;
+    foundDevices[addr] = type;
+}
+
+void ScanI2CTwoWire::scanPort(I2CPort port)
+{
+    LOG_DEBUG("Scanning for i2c devices on port %d\n", port);
+
+    DeviceAddress addr(port, 0x00);
+    TwoWire *i2cBus = fetchI2CBus(addr);
 
     for (addr.address = 1; addr.address < 127; addr.address++) {
-        i2cBus->beginTransmission(addr.address);
-#ifdef ARCH_PORTDUINO
-        if (i2cBus->read() != -1)
-            err = 0;
-        else
-            err = 2;
-#else
-        err = i2cBus->endTransmission();
+        if (!ping(i2cBus, addr))
+            continue;
+        LOG_DEBUG("I2C device found at address 0x%x\n", addr.address);
+
+        // Check if a type was found for the enumerated device - save, if so
+        ScanI2C::DeviceType type = identify(i2cBus, addr);
+        if (type != NONE)
+            addDevice(addr, type);
+    }
+}
+
+#if I2C_SCAN_CACHE
+/**
+ * Once we have booted trusting the cache, scans the rest of each bus for devices which have been added since.  It runs on
+ * the main loop, like everything else which uses the buses.
+ */
+class I2CRescanThread : public concurrency::OSThread
+{
+    ScanI2CTwoWire scanner;
+    const ScanI2C::I2CPort *ports;
+    uint8_t numPorts;
+
+  public:
+    I2CRescanThread(const ScanI2C::I2CPort *ports, uint8_t numPorts,
+                    const std::map<ScanI2C::DeviceAddress, ScanI2C::DeviceType> &found)
+        : concurrency::OSThread("I2CRescan", I2C_RESCAN_DELAY_MSEC), ports(ports), numPorts(numPorts)
+    {
+        for (auto &d : found)
+            scanner.addDevice(d.first, d.second);
+    }
+
+  protected:
+    virtual int32_t runOnce() override
+    {
+        scanner.rescanPorts(ports, numPorts);
+        return disable();
+    }
+};
 #endif
-        type = NONE;
-        if (err == 0) {
-            LOG_DEBUG("I2C device found at address 0x%x\n", addr.address);
 
-            switch (addr.address) {
-            case SSD1306_ADDRESS:
-                type = probeOLED(addr);
-                break;
+#if (defined(ARCH_ESP32) || defined(ARCH_NRF52)) && defined(I2C_SDA1)
+/// A second port, scanned by its own task while the caller scans the first
+struct PortScan {
+    ScanI2CTwoWire *scanner;
+    ScanI2C::I2CPort port;
+    TaskHandle_t caller;
+};
 
-#if !defined(ARCH_PORTDUINO) && !defined(ARCH_STM32WL)
-            case ATECC608B_ADDR:
-                type = ATECC608B;
-                if (atecc.begin(addr.address) == true) {
-                    LOG_INFO("ATECC608B initialized\n");
-                } else {
-                    LOG_WARN("ATECC608B initialization failed\n");
-                }
-                printATECCInfo();
-                break;
+static void scanPortTask(void *arg)
+{
+    PortScan *scan = (PortScan *)arg;
+    scan->scanner->scanPort(scan->port);
+    xTaskNotifyGive(scan->caller);
+    vTaskDelete(NULL);
+}
 #endif
 
-#ifdef RV3028_RTC
-            case RV3028_RTC:
-                // foundDevices[addr] = RTC_RV3028;
-                type = RTC_RV3028;
-                LOG_INFO("RV3028 RTC found\n");
-                rtc.initI2C(*i2cBus);
-                rtc.writeToRegister(0x35, 0x07); // no Clkout
-                rtc.writeToRegister(0x37, 0xB4);
-                break;
+bool ScanI2CTwoWire::scanPorts(const ScanI2C::I2CPort *ports, uint8_t numPorts)
+{
+#if I2C_SCAN_CACHE
+    if (verifyCache(ports, numPorts))
+        return true;
 #endif
 
-#ifdef PCF8563_RTC
-                SCAN_SIMPLE_CASE(PCF8563_RTC, RTC_PCF8563, "PCF8563 RTC found\n")
+    uint8_t first = 0;
+#if (defined(ARCH_ESP32) || defined(ARCH_NRF52)) && defined(I2C_SDA1)
+    // Each bus has its own controller, so they can be scanned at once
+    PortScan scan = {this, numPorts > 1 ? ports[0] : I2CPort::NO_I2C, xTaskGetCurrentTaskHandle()};
+    if (numPorts > 1 && xTaskCreate(scanPortTask, "i2cscan", 4096, &scan, uxTaskPriorityGet(NULL), NULL) == pdPASS)
+        first = 1;
+#endif
+    for (uint8_t i = first; i < numPorts; i++)
+        scanPort(ports[i]);
+#if (defined(ARCH_ESP32) || defined(ARCH_NRF52)) && defined(I2C_SDA1)
+    if (first)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 #endif
 
-            case CARDKB_ADDR:
-                // Do we have the RAK14006 instead?
-                registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0x04), 1);
-                if (registerValue == 0x02) {
-                    // KEYPAD_VERSION
-                    LOG_INFO("RAK14004 found\n");
-                    type = RAK14004;
-                } else {
-                    LOG_INFO("m5 cardKB found\n");
-                    type = CARDKB;
-                }
-                break;
-
-                SCAN_SIMPLE_CASE(TDECK_KB_ADDR, TDECKKB, "T-Deck keyboard found\n");
-                SCAN_SIMPLE_CASE(BBQ10_KB_ADDR, BBQ10KB, "BB Q10 keyboard found\n");
-                SCAN_SIMPLE_CASE(ST7567_ADDRESS, SCREEN_ST7567, "st7567 display found\n");
-#ifdef HAS_NCP5623
-                SCAN_SIMPLE_CASE(NCP5623_ADDR, NCP5623, "NCP5623 RGB LED found\n");
+#if I2C_SCAN_CACHE
+    saveCache();
 #endif
-#ifdef HAS_PMU
-                SCAN_SIMPLE_CASE(XPOWERS_AXP192_AXP2101_ADDRESS, PMU_AXP192_AXP2101, "axp192/axp2101 PMU found\n")
+    return false;
+}
+
+void ScanI2CTwoWire::rescanLater(const ScanI2C::I2CPort *ports, uint8_t numPorts) const
+{
+#if I2C_SCAN_CACHE
+    static ScanI2C::I2CPort laterPorts[2];
+    numPorts = std::min<uint8_t>(numPorts, 2);
+    memcpy(laterPorts, ports, numPorts * sizeof(*ports));
+    new I2CRescanThread(laterPorts, numPorts, foundDevices);
 #endif
-            case BME_ADDR:
-            case BME_ADDR_ALTERNATE:
-                registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0xD0), 1); // GET_ID
-                switch (registerValue) {
-                case 0x61:
-                    LOG_INFO("BME-680 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                    type = BME_680;
-                    break;
-                case 0x60:
-                    LOG_INFO("BME-280 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                    type = BME_280;
-                    break;
-                default:
-                    LOG_INFO("BMP-280 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                    type = BMP_280;
-                }
-                break;
-
-            case INA_ADDR:
-            case INA_ADDR_ALTERNATE:
-                registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0xFE), 2);
-                LOG_DEBUG("Register MFG_UID: 0x%x\n", registerValue);
-                if (registerValue == 0x5449) {
-                    LOG_INFO("INA260 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                    type = INA260;
-                } else { // Assume INA219 if INA260 ID is not found
-                    LOG_INFO("INA219 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                    type = INA219;
-                }
-                break;
-            case INA3221_ADDR:
-                LOG_INFO("INA3221 sensor found at address 0x%x\n", (uint8_t)addr.address);
-                type = INA3221;
-                break;
-            case MCP9808_ADDR:
-                registerValue = getRegisterValue(ScanI2CTwoWire::RegisterLocation(addr, 0x07), 2);
-                if (registerValue == 0x0400) {
-                    type = MCP9808;
-                    LOG_INFO("MCP9808 sensor found\n");
-                } else {
-                    type = LIS3DH;
-                    LOG_INFO("LIS3DH accelerometer found\n");
-                }
-
-                break;
-
-                SCAN_SIMPLE_CASE(SHT31_ADDR, SHT31, "SHT31 sensor found\n")
-                SCAN_SIMPLE_CASE(SHTC3_ADDR, SHTC3, "SHTC3 sensor found\n")
-
-            case LPS22HB_ADDR_ALT:
-                SCAN_SIMPLE_CASE(LPS22HB_ADDR, LPS22HB, "LPS22HB sensor found\n")
-
-                SCAN_SIMPLE_CASE(QMC6310_ADDR, QMC6310, "QMC6310 Highrate 3-Axis magnetic sensor found\n")
-                SCAN_SIMPLE_CASE(QMI8658_ADDR, QMI8658, "QMI8658 Highrate 6-Axis inertial measurement sensor found\n")
-                SCAN_SIMPLE_CASE(QMC5883L_ADDR, QMC5883L, "QMC5883L Highrate 3-Axis magnetic sensor found\n")
-
-                SCAN_SIMPLE_CASE(PMSA0031_ADDR, PMSA0031, "PMSA0031 air quality sensor found\n")
-                SCAN_SIMPLE_CASE(MPU6050_ADDR, MPU6050, "MPU6050 accelerometer found\n");
-                SCAN_SIMPLE_CASE(BMA423_ADDR, BMA423, "BMA423 accelerometer found\n");
-
-            default:
-                LOG_INFO("Device found at address 0x%x was not able to be enumerated\n", addr.address);
-            }
-        } else if (err == 4) {
-            LOG_ERROR("Unknown error at address 0x%x\n", addr);
+}
+
+void ScanI2CTwoWire::rescanPorts(const ScanI2C::I2CPort *ports, uint8_t numPorts)
+{
+    size_t known = countDevices();
+    for (uint8_t i = 0; i < numPorts; i++) {
+        DeviceAddress addr(ports[i], 0x00);
+        TwoWire *i2cBus = fetchI2CBus(addr);
+        for (addr.address = 1; addr.address < 127; addr.address++) {
+            if (foundDevices.find(addr) != foundDevices.end() || !ping(i2cBus, addr))
+                continue;
+            ScanI2C::DeviceType type = identify(i2cBus, addr);
+            if (type != NONE)
+                addDevice(addr, type);
         }
+    }
+    if (countDevices() != known) {
+        LOG_INFO("%u I2C devices have been added since we booted, they will be used after a reboot\n",
+                 (unsigned)(countDevices() - known));
+#if I2C_SCAN_CACHE
+        saveCache();
+#endif
+    }
+}
 
-        // Check if a type was found for the enumerated device - save, if so
-        if (type != NONE) {
-            deviceAddresses[type] = addr;
-            foundDevices[addr] = type;
+#if I2C_SCAN_CACHE
+static const char *i2cCacheFileName = "/prefs/i2c.dat";
+
+#define I2C_CACHE_MAGIC 0x49324330 // "I2C0"
+
+struct I2CCacheFile {
+    uint32_t magic;
+    uint32_t fingerprint;
+    uint8_t numDevices;
+    struct {
+        uint8_t port, address, type;
+    } devices[I2C_SCAN_CACHE_DEVICES];
+};
+
+uint32_t ScanI2CTwoWire::getHardwareFingerprint()
+{
+    // Our board, how its buses are wired and the firmware (whose DeviceType numbers might not match another's)
+    const char *version = optstr(APP_VERSION);
+    int32_t hardware[] = {
+        HW_VENDOR,
+#ifdef I2C_SDA
+        I2C_SDA,
+        I2C_SCL,
+#endif
+#ifdef I2C_SDA1
+        I2C_SDA1,
+        I2C_SCL1,
+#endif
+    };
+    uint32_t crc = crc32Update(hardware, sizeof(hardware), 0xffffffff);
+    return crc32Final(crc32Update(version, strlen(version), crc));
+}
+
+bool ScanI2CTwoWire::verifyCache(const ScanI2C::I2CPort *ports, uint8_t numPorts)
+{
+#ifdef FSCom
+    I2CCacheFile c;
+    auto f = FSCom.open(i2cCacheFileName, FILE_O_READ);
+    if (!f)
+        return false;
+    bool okay = f.read((uint8_t *)&c, sizeof(c)) == (int)sizeof(c) && c.magic == I2C_CACHE_MAGIC &&
+                c.fingerprint == getHardwareFingerprint() && c.numDevices <= I2C_SCAN_CACHE_DEVICES;
+    f.close();
+    // An empty bus is quick to scan whole, and then if something has been plugged in since we'll see it now
+    if (!okay || !c.numDevices)
+        return false;
+
+    for (uint8_t i = 0; i < c.numDevices; i++) {
+        DeviceAddress addr((I2CPort)c.devices[i].port, c.devices[i].address);
+        bool ours = false;
+        for (uint8_t p = 0; p < numPorts; p++)
+            ours |= ports[p] == addr.port;
+        TwoWire *i2cBus = fetchI2CBus(addr);
+        if (!ours || !ping(i2cBus, addr) || identify(i2cBus, addr) != c.devices[i].type) {
+            LOG_INFO("I2C device at 0x%x on port %d has changed, scanning every address\n", addr.address, addr.port);
+            concurrency::LockGuard guard((concurrency::Lock *)&lock);
+            deviceAddresses.clear();
+            foundDevices.clear();
+            return false;
         }
+        addDevice(addr, (DeviceType)c.devices[i].type);
+    }
+    LOG_INFO("Found the %u I2C devices we had last boot\n", c.numDevices);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ScanI2CTwoWire::saveCache() const
+{
+#ifdef FSCom
+    I2CCacheFile c = {};
+    c.magic = I2C_CACHE_MAGIC;
+    c.fingerprint = getHardwareFingerprint();
+    for (auto &d : foundDevices) {
+        if (c.numDevices == I2C_SCAN_CACHE_DEVICES)
+            break;
+        c.devices[c.numDevices].port = d.first.port;
+        c.devices[c.numDevices].address = d.first.address;
+        c.devices[c.numDevices].type = d.second;
+        c.numDevices++;
     }
+
+    FSCom.mkdir("/prefs");
+    if (FSCom.exists(i2cCacheFileName))
+        FSCom.remove(i2cCacheFileName); // not every platform's FILE_O_WRITE truncates
+    auto f = FSCom.open(i2cCacheFileName, FILE_O_WRITE);
+    bool okay = f && f.write((const uint8_t *)&c, sizeof(c)) == sizeof(c);
+    if (f)
+        f.close();
+    if (!okay)
+        LOG_ERROR("Error: can't write %s\n", i2cCacheFileName);
+#endif
 }
+#endif
 
 TwoWire *ScanI2CTwoWire::fetchI2CBus(ScanI2C::DeviceAddress address) const
 {
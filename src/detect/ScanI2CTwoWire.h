@@ -11,11 +11,43 @@
 
 #include "../concurrency/Lock.h"
 
+/// Remember the devices we found (in /prefs/i2c.dat), so the next boot need only check they are still there
+#ifndef I2C_SCAN_CACHE
+#ifdef ARCH_PORTDUINO
+#define I2C_SCAN_CACHE 0 // the buses come from our settings, and are rarely the same hardware for long
+#else
+#define I2C_SCAN_CACHE 1
+#endif
+#endif
+
+/// The most devices we remember
+#define I2C_SCAN_CACHE_DEVICES 16
+
+/// After a boot which trusted the cache, how long before we scan the rest of each bus for devices added since
+#ifndef I2C_RESCAN_DELAY_MSEC
+#define I2C_RESCAN_DELAY_MSEC (60 * 1000)
+#endif
+
 class ScanI2CTwoWire : public ScanI2C
 {
   public:
     void scanPort(ScanI2C::I2CPort) override;
 
+    /**
+     * Find the devices on ports.  If this is the hardware we last booted on, and every device we found then still answers
+     * as the same type, that's all we check.  Otherwise each port is scanned whole, concurrently where the platform has a
+     * task for each, and what we find is remembered.  @return true if we trusted what we remembered
+     */
+    bool scanPorts(const ScanI2C::I2CPort *ports, uint8_t numPorts);
+
+    /// After scanPorts() has trusted what it remembered, scan the rest of ports in I2C_RESCAN_DELAY_MSEC, on the main loop
+    void rescanLater(const ScanI2C::I2CPort *ports, uint8_t numPorts) const;
+
+    /// Scan every address of ports where we haven't already found a device, and remember the result if it has changed
+    void rescanPorts(const ScanI2C::I2CPort *ports, uint8_t numPorts);
+
+    void addDevice(ScanI2C::DeviceAddress addr, ScanI2C::DeviceType type);
+
     ScanI2C::FoundDevice find(ScanI2C::DeviceType) const override;
 
     TwoWire *fetchI2CBus(ScanI2C::DeviceAddress) const;
@@ -53,4 +85,17 @@ class ScanI2CTwoWire : public ScanI2C
     uint16_t getRegisterValue(const RegisterLocation &, ResponseWidth) const;
 
     DeviceType probeOLED(ScanI2C::DeviceAddress) const;
+
+    /// @return true if a device acknowledges addr
+    bool ping(TwoWire *i2cBus, ScanI2C::DeviceAddress addr) const;
+
+    /// Work out what sort of device answered at addr, setting it up if it needs it.  @return NONE if we don't know it
+    DeviceType identify(TwoWire *i2cBus, ScanI2C::DeviceAddress addr);
+
+#if I2C_SCAN_CACHE
+    /// Check the devices we last found on ports are all still there.  @return false if any isn't (or we've no record)
+    bool verifyCache(const ScanI2C::I2CPort *ports, uint8_t numPorts);
+    void saveCache() const;
+    static uint32_t getHardwareFingerprint();
+#endif
 };
@@ -1,4 +1,6 @@
 #include "GPS.h"
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "NodeDB.h"
 #include "RTC.h"
 #include "configuration.h"
@@ -24,6 +26,9 @@ HardwareSerial *GPS::_serial_gps = NULL;
 
 GPS *gps = nullptr;
 
+bool GPS::hasMotionSensor;
+volatile uint32_t GPS::lastMotionMsec;
+
 /// Multiple GPS instances might use the same serial port (in sequence), but we can
 /// only init that port once.
 static bool didSerialInit;
@@ -427,6 +432,30 @@ bool GPS::setup()
                 if (getACK(0x06, 0x01, 300) != GNSS_RESPONSE_OK) {
                     LOG_WARN("Unable to enable NMEA GGA.\n");
                 }
+#if GPS_UBX_NAV_PVT
+                if (uBloxProtocolVersion >= 14) { // the first with NAV-PVT
+                    msglen = makeUBXPacket(0x06, 0x01, sizeof(_message_NAV_PVT), _message_NAV_PVT);
+                    _serial_gps->write(UBXscratch, msglen);
+                    if (getACK(0x06, 0x01, 300) != GNSS_RESPONSE_OK) {
+                        LOG_WARN("Unable to enable UBX NAV-PVT, staying with NMEA.\n");
+                    } else {
+                        // Now the NMEA we turned on above is just more of the same
+                        const uint8_t *nmea[] = {_message_GSA, _message_RMC, _message_GGA};
+                        for (const uint8_t *msg : nmea) {
+                            uint8_t off[sizeof(_message_RMC)];
+                            memcpy(off, msg, sizeof(off));
+                            off[3] = 0x00; // rate for UART1
+                            msglen = makeUBXPacket(0x06, 0x01, sizeof(off), off);
+                            _serial_gps->write(UBXscratch, msglen);
+                            if (getACK(0x06, 0x01, 300) != GNSS_RESPONSE_OK) {
+                                LOG_WARN("Unable to disable NMEA %02x.\n", msg[1]);
+                            }
+                        }
+                        ubxPVT = true;
+                        LOG_INFO("GNSS sending UBX NAV-PVT rather than NMEA\n");
+                    }
+                }
+#endif
                 clearBuffer();
                 if (uBloxProtocolVersion >= 18) {
                     msglen = makeUBXPacket(0x06, 0x86, sizeof(_message_PMS), _message_PMS);
@@ -493,12 +522,13 @@ GPS::~GPS()
 {
     // we really should unregister our sleep observer
     notifyDeepSleepObserver.unobserve(&notifyDeepSleep);
-    notifyGPSSleepObserver.observe(&notifyGPSSleep);
+    notifyGPSSleepObserver.unobserve(&notifyGPSSleep);
 }
 
 void GPS::setGPSPower(bool on, bool standbyOnly, uint32_t sleepTime)
 {
     LOG_INFO("Setting GPS power=%d\n", on);
+    energyStats.setOn(EnergyStats::GPS, on);
     if (on) {
         clearBuffer(); // drop any old data waiting in the buffer before re-enabling
         if (en_gpio)
@@ -587,36 +617,156 @@ void GPS::setAwake(bool on)
 
         if (on) {
             lastWakeStartMsec = millis();
+            wakeStart = startAfter(0);
+            motionlessSkips = 0;
+            wakeAssisted = false;
+#if GPS_UBX_ASSIST
+            // A hot start still has good ephemeris, anything we send it would only hold it up
+            if (wakeStart != START_HOT && gnssModel == GNSS_MODEL_UBLOX && uBloxProtocolVersion >= 15)
+                assistStep = ASSIST_TIME;
+#endif
         } else {
+            assistStep = ASSIST_NONE;
             lastSleepStartMsec = millis();
-            if (GPSCycles == 1) { // Skipping initial lock time, as it will likely be much longer than average
-                averageLockTime = lastSleepStartMsec - lastWakeStartMsec;
-            } else if (GPSCycles > 1) {
-                averageLockTime += ((int32_t)(lastSleepStartMsec - lastWakeStartMsec) - averageLockTime) / (int32_t)GPSCycles;
+            uint32_t took = lastSleepStartMsec - lastWakeStartMsec;
+            powerStats.awakeMsec += took;
+            if (hasValidLocation) {
+                // Learn from fixes only, a wake which timed out says nothing of how long a fix takes
+                uint32_t &learned = lockMsec[wakeStart];
+                learned = (int32_t)learned + ((int32_t)took - (int32_t)learned) / 4;
+                lastFixMsec = lastSleepStartMsec ? lastSleepStartMsec : 1;
+                powerStats.fixes++;
+                powerStats.fixMsec += took;
+                if (wakeAssisted) {
+                    powerStats.assistedFixes++;
+                    powerStats.assistedFixMsec += took;
+                }
             }
-            GPSCycles++;
-            LOG_DEBUG("GPS Lock took %d, average %d\n", (lastSleepStartMsec - lastWakeStartMsec) / 1000, averageLockTime / 1000);
+            static const char *const startNames[START_COUNT] = {"hot", "warm", "cold"};
+            uint32_t perFix =
+                powerStats.fixes ? (uint64_t)powerStats.awakeMsec * GPS_ACQUIRE_MA / 1000 / powerStats.fixes : 0; // mAs
+            LOG_DEBUG("GPS %s start took %us (%s%s, now learned %us), ~%u mAs a fix over %u fixes (%u assisted)\n",
+                      startNames[wakeStart], took / 1000, hasValidLocation ? "fix" : "no fix", wakeAssisted ? ", assisted" : "",
+                      lockMsec[wakeStart] / 1000, perFix, powerStats.fixes, powerStats.assistedFixes);
         }
-        if ((int32_t)getSleepTime() - averageLockTime >
+        // How long a fix will take when we next wake, which is that much off our sleep
+        int32_t lockTime = lockMsec[startAfter(getSleepTime())] + GPS_PREWAKE_MARGIN_MSEC;
+        if ((int32_t)getSleepTime() - lockTime >
             15 * 60 * 1000) { // 15 minutes is probably long enough to make a complete poweroff worth it.
-            setGPSPower(on, false, getSleepTime() - averageLockTime);
+            setGPSPower(on, false, getSleepTime() - lockTime);
             return;
-        } else if ((int32_t)getSleepTime() - averageLockTime > 10000) { // 10 seconds is enough for standby
+        } else if ((int32_t)getSleepTime() - lockTime > 10000) { // 10 seconds is enough for standby
 #ifdef GPS_UC6580
-            setGPSPower(on, false, getSleepTime() - averageLockTime);
+            setGPSPower(on, false, getSleepTime() - lockTime);
 #else
-            setGPSPower(on, true, getSleepTime() - averageLockTime);
+            setGPSPower(on, true, getSleepTime() - lockTime);
 #endif
             return;
         }
-        if (averageLockTime > 20000) {
-            averageLockTime -= 1000; // eventually want to sleep again.
-        }
         if (on)
             setGPSPower(true, true, 0); // make sure we don't have a fallthrough where GPS is stuck off
     }
 }
 
+void GPS::injectAssist()
+{
+    uint8_t msglen;
+    if (assistStep == ASSIST_TIME) {
+        assistStep = ASSIST_POS;
+        uint32_t now = getValidTime(RTCQualityDevice);
+        if (!now)
+            return;
+
+        // UBX-MGA-INI-TIME_UTC, for now (no time mark), leap seconds unknown
+        time_t t = now;
+        struct tm *tm = gmtime(&t);
+        uint16_t year = tm->tm_year + 1900;
+        uint16_t accSecs = getRTCQuality() >= RTCQualityNTP ? 1 : 10;
+        uint8_t msg[24] = {0x10, 0x00, 0x00, 0x80, (uint8_t)(year & 0xff), (uint8_t)(year >> 8), (uint8_t)(tm->tm_mon + 1),
+                           (uint8_t)tm->tm_mday, (uint8_t)tm->tm_hour, (uint8_t)tm->tm_min, (uint8_t)tm->tm_sec};
+        msg[16] = accSecs & 0xff;
+        msg[17] = accSecs >> 8;
+        msglen = makeUBXPacket(0x13, 0x40, sizeof(msg), msg);
+        _serial_gps->write(UBXscratch, msglen);
+        wakeAssisted = true;
+        return;
+    }
+
+    if (assistStep == ASSIST_POS) {
+        assistStep = ASSIST_FRAMES;
+        assistOffset = 0;
+        const meshtastic_NodeInfoLite *us = nodeDB.getMeshNode(nodeDB.getNodeNum());
+        if (!us || !us->has_position || (!us->position.latitude_i && !us->position.longitude_i))
+            return;
+
+        // UBX-MGA-INI-POS_LLH, where we last were, give or take how far we might have gone since
+        uint8_t msg[20] = {0x01, 0x00};
+        int32_t fields[4] = {us->position.latitude_i, us->position.longitude_i, us->position.altitude * 100,
+                             GPS_ASSIST_POS_ACC_M * 100};
+        for (int f = 0; f < 4; f++)
+            for (int i = 0; i < 4; i++)
+                msg[4 + f * 4 + i] = ((uint32_t)fields[f] >> (8 * i)) & 0xff;
+        msglen = makeUBXPacket(0x13, 0x40, sizeof(msg), msg);
+        _serial_gps->write(UBXscratch, msglen);
+        wakeAssisted = true;
+        return;
+    }
+
+    // Then what we have cached, a few messages at a time
+    if (assistOffset == 0 && !GnssAssist::isFresh(getValidTime(RTCQualityDevice))) {
+        assistStep = ASSIST_NONE;
+        return;
+    }
+    uint8_t frame[GNSS_ASSIST_MAX_FRAME];
+    for (int i = 0; i < GPS_ASSIST_FRAMES_PER_RUN; i++) {
+        size_t len = GnssAssist::readFrame(assistOffset, frame);
+        if (!len) {
+            LOG_DEBUG("GPS given %u bytes of cached assistance\n", assistOffset);
+            assistStep = ASSIST_NONE;
+            return;
+        }
+        _serial_gps->write(frame, len);
+        wakeAssisted = true;
+    }
+}
+
+GPS::StartType GPS::startAfter(uint32_t offMsec) const
+{
+    if (!lastFixMsec)
+        return START_COLD;
+    uint32_t age = millis() - lastFixMsec;
+    age = (offMsec > UINT32_MAX - age) ? UINT32_MAX : age + offMsec;
+    if (age < GPS_HOT_START_MSEC)
+        return START_HOT;
+    if (age < GPS_WARM_START_MSEC)
+        return START_WARM;
+    return START_COLD;
+}
+
+bool GPS::shouldWake(uint32_t timeAsleep, uint32_t sleepTime)
+{
+    // Powered down we need a fix's worth of head start, which depends on how cold the receiver will have gone
+    uint32_t lead = isInPowersave ? lockMsec[startAfter(0)] + GPS_PREWAKE_MARGIN_MSEC : 0;
+    bool due = timeAsleep > sleepTime || sleepTime - timeAsleep < lead;
+    if (!due && lead && positionModule) {
+        // Or in time for the next broadcast, if it's sooner and would otherwise send an older fix
+        uint32_t untilBroadcast = positionModule->msecUntilNextBroadcast();
+        due = untilBroadcast && untilBroadcast <= lead && (!lastFixMsec || millis() - lastFixMsec > lead);
+    }
+    if (!due)
+        return false;
+
+    bool moved = lastMotionMsec && (int32_t)(lastMotionMsec - lastFixMsec) > 0;
+    if (hasMotionSensor && lastFixMsec && hasValidLocation && !moved && motionlessSkips < GPS_MOTIONLESS_MAX_SKIPS) {
+        motionlessSkips++;
+        powerStats.skipped++;
+        lastSleepStartMsec = millis(); // another sleep's worth, our last fix is still where we are
+        LOG_DEBUG("GPS not woken, we haven't moved since our last fix (%u skipped in a row)\n", motionlessSkips);
+        return false;
+    }
+    return true;
+}
+
 /** Get how long we should stay looking for each acquisition in msecs
  */
 uint32_t GPS::getWakeTime() const
@@ -672,6 +822,7 @@ int32_t GPS::runOnce()
         }
         if (!setup())
             return 2000; // Setup failed, re-run in two seconds
+        BOOT_MILESTONE("gps probed");
 
         // We have now loaded our saved preferences from flash
         if (config.position.gps_mode != meshtastic_Config_PositionConfig_GpsMode_ENABLED) {
@@ -682,7 +833,7 @@ int32_t GPS::runOnce()
             LOG_WARN("GPS FactoryReset requested\n");
             if (gps->factoryReset()) { // If we don't succeed try again next time
                 devicestate.did_gps_reset = true;
-                nodeDB.saveToDisk(SEGMENT_DEVICESTATE);
+                nodeDB.saveToDiskSoon(SEGMENT_DEVICESTATE);
             }
         }
         GPSInitFinished = true;
@@ -702,7 +853,7 @@ int32_t GPS::runOnce()
             if (devicestate.did_gps_reset && (millis() - lastWakeStartMsec > 60000) && !hasFlow()) {
                 LOG_DEBUG("GPS is not communicating, trying factory reset on next bootup.\n");
                 devicestate.did_gps_reset = false;
-                nodeDB.saveDeviceStateToDisk();
+                nodeDB.saveToDiskSoon(SEGMENT_DEVICESTATE);
                 return disable(); // Stop the GPS thread as it can do nothing useful until next reboot.
             }
         }
@@ -719,17 +870,19 @@ int32_t GPS::runOnce()
     uint32_t timeAsleep = now - lastSleepStartMsec;
 
     auto sleepTime = getSleepTime();
-    if (!isAwake && (sleepTime != UINT32_MAX) &&
-        ((timeAsleep > sleepTime) || (isInPowersave && timeAsleep > (sleepTime - averageLockTime)))) {
+    if (!isAwake && (sleepTime != UINT32_MAX) && shouldWake(timeAsleep, sleepTime)) {
         // We now want to be awake - so wake up the GPS
         setAwake(true);
     }
 
     // While we are awake
     if (isAwake) {
+        if (assistStep != ASSIST_NONE)
+            injectAssist();
+
         // LOG_DEBUG("looking for location\n");
-        // If we've already set time from the GPS, no need to ask the GPS
-        bool gotTime = (getRTCQuality() >= RTCQualityGPS);
+        // If we've already set time from the GPS, no need to ask the GPS (unless our PPS time base needs one)
+        bool gotTime = (getRTCQuality() >= RTCQualityGPS) && !ppsNeedsTime();
         if (!gotTime && lookForTime()) { // Note: we count on this && short-circuiting and not resetting the RTC time
             gotTime = true;
             shouldPublish = true;
@@ -772,6 +925,7 @@ int32_t GPS::runOnce()
 
     // 9600bps is approx 1 byte per msec, so considering our buffer size we never need to wake more often than 200ms
     // if not awake we can run super infrquently (once every 5 secs?) to see if we need to wake.
+    // With GPS_WAKE_ON_RX our UART wakes us for each sentence, and GPS_THREAD_INTERVAL is only a fallback poll
     return isAwake ? GPS_THREAD_INTERVAL : 5000;
 }
 
@@ -954,7 +1108,7 @@ GPS *GPS::createGps()
         _en_gpio = PIN_GPS_EN;
 #endif
 #ifdef ARCH_PORTDUINO
-    if (!settingsMap[has_gps])
+    if (!portduinoSettings.hasGps)
         return nullptr;
 #endif
     if (!_rx_gpio || !_serial_gps) // Configured to have no GPS at all
@@ -972,8 +1126,10 @@ GPS *GPS::createGps()
     }
 
 #ifdef PIN_GPS_PPS
-    // pulse per second
+    // pulse per second, for our PPS time base (see getPpsTimeMsec())
     pinMode(PIN_GPS_PPS, INPUT);
+    if (PIN_GPS_PPS >= 0)
+        attachInterrupt(PIN_GPS_PPS, onPulsePerSecond, RISING);
 #endif
 
 // Currently disabled per issue #525 (TinyGPS++ crash bug)
@@ -1017,6 +1173,16 @@ GPS *GPS::createGps()
 #if defined(GPS_UC6580)
         _serial_gps->updateBaudRate(115200);
 #endif
+
+#if GPS_WAKE_ON_RX
+        // Called from the UART's event task once the line has been idle a moment, i.e. after each sentence (or burst of them)
+        _serial_gps->onReceive(
+            []() {
+                if (gps)
+                    gps->wakeOnRx();
+            },
+            true);
+#endif
     }
     return new_gps;
 }
@@ -1084,6 +1250,22 @@ bool GPS::factoryReset()
  */
 bool GPS::lookForTime()
 {
+    if (ubxPVT) {
+        if ((pvt.valid & 0x07) != 0x07) // date, time, and the time fully resolved
+            return false;
+        struct tm t;
+        t.tm_sec = pvt.sec;
+        t.tm_min = pvt.min;
+        t.tm_hour = pvt.hour;
+        t.tm_mday = pvt.day;
+        t.tm_mon = pvt.month - 1;
+        t.tm_year = pvt.year - 1900;
+        t.tm_isdst = false;
+        LOG_DEBUG("UBX GPS time %02d-%02d-%02d %02d:%02d:%02d\n", pvt.year, pvt.month, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        perhapsSetRTC(RTCQualityGPS, t);
+        return true;
+    }
+
     auto ti = reader.time;
     auto d = reader.date;
     if (ti.isValid() && d.isValid()) { // Note: we don't check for updated, because we'll only be called if needed
@@ -1118,6 +1300,9 @@ The Unix epoch (or Unix time or POSIX time or Unix timestamp) is the number of s
  */
 bool GPS::lookForLocation()
 {
+    if (ubxPVT)
+        return lookForPVTLocation();
+
     // By default, TinyGPS++ does not parse GPGSA lines, which give us
     //   the 2D/3D fixType (see NMEAGPS.h)
     // At a minimum, use the fixQuality indicator in GPGGA (FIXME?)
@@ -1263,7 +1448,126 @@ bool GPS::hasLock()
 
 bool GPS::hasFlow()
 {
-    return reader.passedChecksum() > 0;
+    return reader.passedChecksum() > 0 || pvtFrames > 0;
+}
+
+static inline uint16_t ubxU16(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+static inline uint32_t ubxU32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+bool GPS::parseUBX(uint8_t c)
+{
+    // Sync on 0xB5 0x62, then take only class 0x01 id 0x07 (NAV-PVT): 92 bytes, or 84 from protocol 14
+    if (pvtPos == 0) {
+        if (c == 0xB5)
+            pvtFrame[pvtPos++] = c;
+        return false;
+    }
+    if (pvtPos == 1) {
+        if (c == 0x62)
+            pvtFrame[pvtPos++] = c;
+        else
+            pvtPos = c == 0xB5;
+        return false;
+    }
+    pvtFrame[pvtPos++] = c;
+    if (pvtPos < 6)
+        return false;
+    uint16_t len = ubxU16(&pvtFrame[4]);
+    if (pvtPos == 6 && (pvtFrame[2] != 0x01 || pvtFrame[3] != 0x07 || len < 84 || len > sizeof(pvtFrame) - 8)) {
+        pvtPos = 0; // not one of ours
+        return false;
+    }
+    if (pvtPos < len + 8)
+        return false;
+    pvtPos = 0;
+
+    uint8_t CK_A = 0, CK_B = 0;
+    for (size_t i = 2; i < len + 6u; i++) {
+        CK_A += pvtFrame[i];
+        CK_B += CK_A;
+    }
+    if (CK_A != pvtFrame[len + 6] || CK_B != pvtFrame[len + 7]) {
+        LOG_WARN("UBX NAV-PVT failed its checksum\n");
+        return false;
+    }
+
+    const uint8_t *b = &pvtFrame[6];
+    pvt.year = ubxU16(&b[4]);
+    pvt.month = b[6];
+    pvt.day = b[7];
+    pvt.hour = b[8];
+    pvt.min = b[9];
+    pvt.sec = b[10];
+    pvt.valid = b[11];
+    pvt.fixType = b[20];
+    pvt.flags = b[21];
+    pvt.numSV = b[23];
+    pvt.lon = ubxU32(&b[24]);
+    pvt.lat = ubxU32(&b[28]);
+    pvt.height = ubxU32(&b[32]);
+    pvt.hMSL = ubxU32(&b[36]);
+    pvt.hAcc = ubxU32(&b[40]);
+    pvt.gSpeed = ubxU32(&b[60]);
+    pvt.headMot = ubxU32(&b[64]);
+    pvt.pDOP = ubxU16(&b[76]);
+    pvtUpdated = true;
+    pvtFrames++;
+    return true;
+}
+
+bool GPS::lookForPVTLocation()
+{
+    fixQual = (pvt.flags & 0x01) ? ((pvt.flags & 0x02) ? 2 : 1) : 0; // as GPGGA would have it
+#ifndef TINYGPS_OPTION_NO_CUSTOM_FIELDS
+    fixType = pvt.fixType == 4 ? 3 : pvt.fixType; // dead reckoning on top of a 3D fix is still 3D
+#endif
+
+    if (!hasLock() || !pvtUpdated)
+        return false;
+    pvtUpdated = false;
+
+    p.location_source = meshtastic_Position_LocSource_LOC_INTERNAL;
+    p.latitude_i = pvt.lat; // already 1e-7 degrees, as toDegInt() gives
+    p.longitude_i = pvt.lon;
+
+    p.altitude = pvt.hMSL / 1000;
+    p.altitude_hae = pvt.height / 1000;
+    p.altitude_geoidal_separation = (pvt.height - pvt.hMSL) / 1000;
+
+    // NAV-PVT has no HDOP, and PDOP is never less
+    p.PDOP = pvt.pDOP;
+    p.HDOP = pvt.pDOP;
+    p.gps_accuracy = pvt.hAcc;
+
+    p.fix_quality = fixQual;
+    p.fix_type = pvt.fixType;
+
+    if ((pvt.valid & 0x03) == 0x03) {
+        struct tm t;
+        t.tm_sec = pvt.sec;
+        t.tm_min = pvt.min;
+        t.tm_hour = pvt.hour;
+        t.tm_mday = pvt.day;
+        t.tm_mon = pvt.month - 1;
+        t.tm_year = pvt.year - 1900;
+        t.tm_isdst = false;
+        p.timestamp = mktime(&t);
+    }
+
+    p.sats_in_view = pvt.numSV;
+    if (pvt.headMot >= 0 && pvt.headMot < 36000000) // sanity check
+        p.ground_track = pvt.headMot;               // degrees * 10^-5, as expected
+    if (pvt.gSpeed >= 0)
+        p.ground_speed = pvt.gSpeed * 36 / 10000; // mm/s to km/h
+
+    return true;
 }
 
 bool GPS::whileIdle()
@@ -1276,28 +1580,38 @@ bool GPS::whileIdle()
     }
 #ifdef SERIAL_BUFFER_SIZE
     if (_serial_gps->available() >= SERIAL_BUFFER_SIZE - 1) {
-        LOG_WARN("GPS Buffer full with %u bytes waiting. Flushing to avoid corruption.\n", _serial_gps->available());
-        clearBuffer();
+        // What's in the buffer is still good, only what didn't fit is gone, and the checksum throws out the sentence it cut
+        LOG_WARN("GPS Buffer full with %u bytes waiting (%u times so far)\n", _serial_gps->available(), ++rxOverruns);
     }
 #endif
     // if (_serial_gps->available() > 0)
     // LOG_DEBUG("GPS Bytes Waiting: %u\n", _serial_gps->available());
-    // First consume any chars that have piled up at the receiver
-    while (_serial_gps->available() > 0) {
-        int c = _serial_gps->read();
-        UBXscratch[charsInBuf] = c;
+    // First consume any chars that have piled up at the receiver, a chunk at a time
+    uint8_t chunk[GPS_RX_CHUNK];
+    int avail;
+    while ((avail = _serial_gps->available()) > 0) {
+        size_t got = _serial_gps->readBytes(chunk, avail < (int)sizeof(chunk) ? avail : sizeof(chunk));
+        for (size_t i = 0; i < got; i++) {
+            uint8_t c = chunk[i];
+            UBXscratch[charsInBuf] = c;
 #ifdef GPS_DEBUG
-        LOG_DEBUG("%c", c);
+            LOG_DEBUG("%c", c);
 #endif
-        isValid |= reader.encode(c);
-        if (charsInBuf > sizeof(UBXscratch) - 10 || c == '\r') {
-            if (strnstr((char *)UBXscratch, "$GPTXT,01,01,02,u-blox ag - www.u-blox.com*50", charsInBuf)) {
-                rebootsSeen++;
+            if (ubxPVT)
+                isValid |= parseUBX(c);
+            else
+                isValid |= reader.encode(c);
+            if (charsInBuf > sizeof(UBXscratch) - 10 || c == '\r') {
+                if (strnstr((char *)UBXscratch, "$GPTXT,01,01,02,u-blox ag - www.u-blox.com*50", charsInBuf)) {
+                    rebootsSeen++;
+                }
+                charsInBuf = 0;
+            } else {
+                charsInBuf++;
             }
-            charsInBuf = 0;
-        } else {
-            charsInBuf++;
         }
+        if (!got)
+            break;
     }
     return isValid;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GPSStatus.h"
+#include "GnssAssist.h"
 #include "Observer.h"
 #include "TinyGPS++.h"
 #include "concurrency/OSThread.h"
@@ -13,6 +14,51 @@
 #define GPS_EN_ACTIVE 1
 #endif
 
+/// Have our UART wake us (from its own event task) when the line goes idle after a sentence, rather than polling it every
+/// GPS_THREAD_INTERVAL.  Needs HardwareSerial::onReceive(), which only the ESP32 core has
+#ifndef GPS_WAKE_ON_RX
+#ifdef ARCH_ESP32
+#define GPS_WAKE_ON_RX 1
+#else
+#define GPS_WAKE_ON_RX 0
+#endif
+#endif
+
+/// How many bytes whileIdle() takes from our UART at a time
+#ifndef GPS_RX_CHUNK
+#define GPS_RX_CHUNK 64
+#endif
+
+/// A wake this soon after our last fix is a hot start (the receiver still has good ephemeris), up to GPS_WARM_START_MSEC a warm
+/// one (it still has its almanac and rough time), past that cold.  We learn how long a fix takes for each
+#ifndef GPS_HOT_START_MSEC
+#define GPS_HOT_START_MSEC (30 * 60 * 1000)
+#endif
+#ifndef GPS_WARM_START_MSEC
+#define GPS_WARM_START_MSEC (4 * 60 * 60 * 1000)
+#endif
+
+/// Wake the receiver this much sooner than the fix we've learned it needs
+#ifndef GPS_PREWAKE_MARGIN_MSEC
+#define GPS_PREWAKE_MARGIN_MSEC 2000
+#endif
+
+/// With a motion sensor (see GPS::noteMotion()), skip up to this many fixes in a row while it says we haven't moved.  0 never
+#ifndef GPS_MOTIONLESS_MAX_SKIPS
+#define GPS_MOTIONLESS_MAX_SKIPS 3
+#endif
+
+/// What a typical receiver draws (mA) while acquiring, for the energy a fix costs.  We can't measure the GPS rail itself
+#ifndef GPS_ACQUIRE_MA
+#define GPS_ACQUIRE_MA 25
+#endif
+
+/// Have a u-blox (protocol 14 and up, short of the M10) send us only UBX-NAV-PVT, a binary struct a fix, rather than the NMEA
+/// sentences TinyGPS++ parses: less to send, less to parse, and it tells us its accuracy.  If it NAKs NAV-PVT we stay on NMEA
+#ifndef GPS_UBX_NAV_PVT
+#define GPS_UBX_NAV_PVT 0
+#endif
+
 struct uBloxGnssModelInfo {
     char swVersion[30];
     char hwVersion[10];
@@ -62,8 +108,14 @@ class GPS : private concurrency::OSThread
     uint32_t rx_gpio = 0;
     uint32_t tx_gpio = 0;
     uint32_t en_gpio = 0;
-    int32_t averageLockTime = 0;
-    uint32_t GPSCycles = 0;
+
+    /// How old our last fix is when we wake, see GPS_HOT_START_MSEC
+    enum StartType { START_HOT, START_WARM, START_COLD, START_COUNT };
+
+    uint32_t lockMsec[START_COUNT] = {5000, 30000, 60000}; // how long a fix takes from each, learned as we go
+    StartType wakeStart = START_COLD;                      // of the wake we're in (or last had)
+    uint32_t lastFixMsec = 0;                              // when we last went to sleep with a fix, 0 for never
+    uint8_t motionlessSkips = 0;                           // fixes in a row we've skipped for not having moved
 
     int speedSelect = 0;
     int probeTries = 2;
@@ -87,10 +139,56 @@ class GPS : private concurrency::OSThread
 
     uint8_t numSatellites = 0;
 
+    /// Whether the accelerometer is watching for motion, and when it last saw some (0 for never), see noteMotion()
+    static bool hasMotionSensor;
+    static volatile uint32_t lastMotionMsec;
+
+    uint32_t rxOverruns = 0; // times our UART's buffer filled before whileIdle() got to it
+
+    /// What injectAssist() sends the receiver next, see GPS_UBX_ASSIST
+    enum AssistStep { ASSIST_NONE, ASSIST_TIME, ASSIST_POS, ASSIST_FRAMES };
+    AssistStep assistStep = ASSIST_NONE;
+    uint32_t assistOffset = 0; // into our cached messages
+    bool wakeAssisted = false; // we gave the receiver something this wake
+
+    /// The fields we use of a UBX-NAV-PVT, see GPS_UBX_NAV_PVT
+    struct NavPvt {
+        uint16_t year;
+        uint8_t month, day, hour, min, sec;
+        uint8_t valid;   // bit 0 date, bit 1 time, bit 2 fully resolved
+        uint8_t fixType; // 0 none, 2 2D, 3 3D, 4 GNSS and dead reckoning, 5 time only
+        uint8_t flags;   // bit 0 gnssFixOK, bit 1 diffSoln
+        uint8_t numSV;
+        int32_t lon, lat;     // 1e-7 degrees
+        int32_t height, hMSL; // mm, above the ellipsoid and mean sea level
+        uint32_t hAcc;        // mm
+        int32_t gSpeed;       // mm/s
+        int32_t headMot;      // 1e-5 degrees
+        uint16_t pDOP;        // 0.01
+    };
+
+    bool ubxPVT = false;      // the GPS is sending us NAV-PVT (and no NMEA)
+    NavPvt pvt = {};          // the last NAV-PVT it sent
+    bool pvtUpdated = false;  // pvt is one lookForLocation() hasn't seen
+    uint32_t pvtFrames = 0;   // that passed their checksum
+    uint16_t pvtPos = 0;      // how much of a frame pvtFrame holds
+    uint8_t pvtFrame[8 + 92]; // header, the biggest NAV-PVT payload, checksum
+
     CallbackObserver<GPS, void *> notifyDeepSleepObserver = CallbackObserver<GPS, void *>(this, &GPS::prepareDeepSleep);
     CallbackObserver<GPS, void *> notifyGPSSleepObserver = CallbackObserver<GPS, void *>(this, &GPS::prepareDeepSleep);
 
   public:
+    /// What our duty cycling has cost and saved since boot
+    struct PowerStats {
+        uint32_t fixes = 0;     // wakes which ended with a fix
+        uint32_t fixMsec = 0;   // how long those took to their fix
+        uint32_t awakeMsec = 0; // over all our wakes
+        uint32_t skipped = 0;   // wakes we skipped for not having moved
+
+        /// Of the fixes, those we had injected assistance for (GPS_UBX_ASSIST), and how long they took
+        uint32_t assistedFixes = 0, assistedFixMsec = 0;
+    };
+
     /** If !NULL we will use this serial port to construct our GPS */
     static HardwareSerial *_serial_gps;
 
@@ -115,11 +213,17 @@ class GPS : private concurrency::OSThread
     static const uint8_t _message_AID[];
     static const uint8_t _message_GGA[];
     static const uint8_t _message_PMS[];
+    static const uint8_t _message_NAV_PVT[];
     static const uint8_t _message_SAVE[];
 
     meshtastic_Position p = meshtastic_Position_init_default;
 
-    GPS() : concurrency::OSThread("GPS") {}
+    GPS() : concurrency::OSThread("GPS")
+    {
+#if GPS_WAKE_ON_RX
+        setWakeSource(true); // our UART, see wakeOnRx()
+#endif
+    }
 
     virtual ~GPS();
 
@@ -156,6 +260,25 @@ class GPS : private concurrency::OSThread
     // Empty the input buffer as quickly as possible
     void clearBuffer();
 
+    /// The accelerometer has seen us move, safe from any task (and before we exist).  The first call (watching = true, from
+    /// its setup) says it's watching, so that not hearing from it means we're still
+    static void noteMotion(bool watching = false)
+    {
+        if (watching)
+            hasMotionSensor = true;
+        else
+            lastMotionMsec = millis() | 1;
+    }
+
+    const PowerStats &getPowerStats() const { return powerStats; }
+
+    /// Our UART has a sentence (or more) for us, safe from any task.  With GPS_WAKE_ON_RX this, not polling, is what runs us
+    void wakeOnRx()
+    {
+        if (isAwake && GPSInitFinished)
+            wake();
+    }
+
     // Create a ublox packet for editing in memory
     uint8_t makeUBXPacket(uint8_t class_id, uint8_t msg_id, uint8_t payload_size, const uint8_t *msg);
 
@@ -221,6 +344,23 @@ class GPS : private concurrency::OSThread
     virtual bool lookForLocation();
 
   private:
+    PowerStats powerStats;
+
+    /// What sort of start a wake offMsec from now would be
+    StartType startAfter(uint32_t offMsec) const;
+
+    /// Whether to wake for a fix now, timeAsleep into a sleep of sleepTime
+    bool shouldWake(uint32_t timeAsleep, uint32_t sleepTime);
+
+    /// Take one byte of UBX, @return true if it finished a NAV-PVT (which is now in pvt)
+    bool parseUBX(uint8_t c);
+
+    /// lookForLocation() from pvt rather than TinyGPS++
+    bool lookForPVTLocation();
+
+    /// Send the receiver the next of its assistance (our time, our last position, then a few of GnssAssist's messages)
+    void injectAssist();
+
     /// Prepare the GPS for the cpu entering deep sleep, expect to be gone for at least 100s of msecs
     /// always returns 0 to indicate okay to sleep
     int prepareDeepSleep(void *unused);
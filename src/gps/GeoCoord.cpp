@@ -41,12 +41,12 @@ void GeoCoord::setCoords()
 
 void GeoCoord::updateCoords(int32_t lat, int32_t lon, int32_t alt)
 {
-    // If marked dirty or new coordinates
-    if (_dirty || _latitude != lat || _longitude != lon || _altitude != alt) {
+    // If marked dirty or new coordinates (the altitude takes no converting)
+    _altitude = alt;
+    if (_dirty || _latitude != lat || _longitude != lon) {
         _dirty = true;
         _latitude = lat;
         _longitude = lon;
-        _altitude = alt;
         setCoords();
     }
 }
@@ -55,12 +55,12 @@ void GeoCoord::updateCoords(const double lat, const double lon, const int32_t al
 {
     int32_t iLat = lat * 1e+7;
     int32_t iLon = lon * 1e+7;
-    // If marked dirty or new coordinates
-    if (_dirty || _latitude != iLat || _longitude != iLon || _altitude != alt) {
+    // If marked dirty or new coordinates (the altitude takes no converting)
+    _altitude = alt;
+    if (_dirty || _latitude != iLat || _longitude != iLon) {
         _dirty = true;
         _latitude = iLat;
         _longitude = iLon;
-        _altitude = alt;
         setCoords();
     }
 }
@@ -69,12 +69,12 @@ void GeoCoord::updateCoords(const float lat, const float lon, const int32_t alt)
 {
     int32_t iLat = lat * 1e+7;
     int32_t iLon = lon * 1e+7;
-    // If marked dirty or new coordinates
-    if (_dirty || _latitude != iLat || _longitude != iLon || _altitude != alt) {
+    // If marked dirty or new coordinates (the altitude takes no converting)
+    _altitude = alt;
+    if (_dirty || _latitude != iLat || _longitude != iLon) {
         _dirty = true;
         _latitude = iLat;
         _longitude = iLon;
-        _altitude = alt;
         setCoords();
     }
 }
@@ -396,6 +396,91 @@ float GeoCoord::latLongToMeter(double lat_a, double lng_a, double lat_b, double
     return (float)(6366000 * tt);
 }
 
+void GeoCoord::deadReckon(int32_t lat_i, int32_t lon_i, uint32_t speedKmh, uint32_t track, uint32_t secs, int32_t &lat,
+                          int32_t &lon)
+{
+    double meters = speedKmh / 3.6 * secs;
+    double heading = toRadians(track * 1e-5);
+    double cosLat = cos(toRadians(lat_i * 1e-7));
+
+    // Same earth radius as latLongToMeter(), so that distance says we're where we predicted
+    double dLat = toDegrees(meters * cos(heading) / 6366000);
+    double dLon = cosLat > 1e-6 ? toDegrees(meters * sin(heading) / (6366000 * cosLat)) : 0;
+
+    double newLat = lat_i + round(dLat * 1e7);
+    double newLon = lon_i + round(dLon * 1e7);
+    if (newLat > 900000000)
+        newLat = 900000000;
+    else if (newLat < -900000000)
+        newLat = -900000000;
+    if (newLon > 1800000000)
+        newLon -= 3600000000.0;
+    else if (newLon < -1800000000)
+        newLon += 3600000000.0;
+    lat = (int32_t)newLat;
+    lon = (int32_t)newLon;
+}
+
+float GeoCoord::fastAtan2(float y, float x)
+{
+    float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0 && ay == 0)
+        return 0;
+    // atan of a in [0, 1], then fold back to y / x's octant
+    float a = ax > ay ? ay / ax : ax / ay;
+    float s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    if (ay > ax)
+        r = (float)PI / 2 - r;
+    if (x < 0)
+        r = (float)PI - r;
+    return y < 0 ? -r : r;
+}
+
+/// Flat earth about the two points' mean latitude, metres north and east from a to b, and how far the meridians turn (radians)
+/// between a and half way.  @return false if that's no good here (too far, or too near a pole), for double precision instead
+static bool equirectangular(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b, float &north, float &east,
+                            float &convergence)
+{
+#if GEOCOORD_FAST_MATH
+    if (abs(lat_a) > 850000000 || abs(lat_b) > 850000000)
+        return false;
+    int64_t dLon = (int64_t)lng_b - lng_a;
+    if (dLon > 1800000000)
+        dLon -= 3600000000LL;
+    else if (dLon < -1800000000)
+        dLon += 3600000000LL;
+
+    const float radians = 1e-7f * (float)PI / 180;
+    float meanLat = ((float)lat_a + (float)lat_b) / 2 * radians;
+    north = (float)((int64_t)lat_b - lat_a) * radians * 6366000; // same radius as latLongToMeter()
+    east = (float)dLon * radians * cosf(meanLat) * 6366000;
+    convergence = (float)dLon * radians / 2 * sinf(meanLat);
+    return fabsf(north) < GEOCOORD_FAST_MAX_METERS && fabsf(east) < GEOCOORD_FAST_MAX_METERS;
+#else
+    return false;
+#endif
+}
+
+float GeoCoord::distanceE7(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b)
+{
+    float north, east, convergence;
+    if (equirectangular(lat_a, lng_a, lat_b, lng_b, north, east, convergence))
+        return sqrtf(north * north + east * east);
+    return latLongToMeter(lat_a * 1e-7, lng_a * 1e-7, lat_b * 1e-7, lng_b * 1e-7);
+}
+
+float GeoCoord::bearingE7(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    float north, east, convergence;
+    if (equirectangular(lat1, lon1, lat2, lon2, north, east, convergence)) {
+        // The great circle leaves a a little poleward of the straight line across our flat earth
+        float b = fastAtan2(east, north) - convergence;
+        return b > (float)PI ? b - 2 * (float)PI : (b < -(float)PI ? b + 2 * (float)PI : b);
+    }
+    return bearing(lat1 * 1e-7, lon1 * 1e-7, lat2 * 1e-7, lon2 * 1e-7);
+}
+
 /**
  * Computes the bearing in degrees between two points on Earth.  Ported from my
  * old Gaggle android app.
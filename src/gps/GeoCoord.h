@@ -12,6 +12,19 @@
 #define PI 3.1415926535897932384626433832795
 #define OLC_CODE_LEN 11
 
+/// Have distanceE7() and bearingE7() work in float, flat earth (equirectangular) and with a polynomial atan2, out to
+/// GEOCOORD_FAST_MAX_METERS - rather than latLongToMeter() and bearing()'s double trig, which the nRF52's single precision FPU
+/// and the RP2040 (no FPU at all) do in software.  0 for double precision everywhere
+#ifndef GEOCOORD_FAST_MATH
+#define GEOCOORD_FAST_MATH 1
+#endif
+
+/// How far flat earth is good for: out to here it's within 0.15% (and 0.05 degrees of bearing) of the great circle, short of
+/// 85 degrees north or south, past which we always use double precision
+#ifndef GEOCOORD_FAST_MAX_METERS
+#define GEOCOORD_FAST_MAX_METERS 100000
+#endif
+
 // Helper functions
 // Raises a number to an exponent, handling negative exponents.
 static inline double pow_neg(double base, double exponent)
@@ -117,6 +130,18 @@ class GeoCoord
     static float rangeRadiansToMeters(double range_radians);
     static float rangeMetersToRadians(double range_meters);
 
+    /// latLongToMeter() and bearing() (radians), straight from 1e-7 degrees as in meshtastic_Position, see GEOCOORD_FAST_MATH
+    static float distanceE7(int32_t lat_a, int32_t lng_a, int32_t lat_b, int32_t lng_b);
+    static float bearingE7(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2);
+
+    /// atan2f() to within 0.0001 radians, by polynomial
+    static float fastAtan2(float y, float x);
+
+    /// Where something at lat_i, lon_i (1e-7 degrees) going speedKmh on track (1e-5 degrees) will be secs later.  Flat earth,
+    /// which is plenty for the few km of a dead reckoned position
+    static void deadReckon(int32_t lat_i, int32_t lon_i, uint32_t speedKmh, uint32_t track, uint32_t secs, int32_t &lat,
+                           int32_t &lon);
+
     // Point to point conversions
     int32_t distanceTo(const GeoCoord &pointB);
     int32_t bearingTo(const GeoCoord &pointB);
@@ -0,0 +1,137 @@
+#include "GnssAssist.h"
+#include "FSCommon.h"
+#include <string.h>
+
+static const char *assistFileName = "/prefs/gnssassist.bin";
+
+static uint32_t get32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        b[i] = (v >> (8 * i)) & 0xff;
+}
+
+/// @return the length of the UBX message at the start of data (of len), or 0 if there isn't a whole good one there
+static size_t frameLength(const uint8_t *data, size_t len)
+{
+    if (len < 8 || data[0] != 0xb5 || data[1] != 0x62)
+        return 0;
+    size_t frameLen = 8 + (data[4] | (data[5] << 8));
+    if (frameLen > len || frameLen > GNSS_ASSIST_MAX_FRAME)
+        return 0;
+
+    uint8_t a = 0, b = 0;
+    for (size_t i = 2; i < frameLen - 2; i++) {
+        a += data[i];
+        b += a;
+    }
+    return (a == data[frameLen - 2] && b == data[frameLen - 1]) ? frameLen : 0;
+}
+
+namespace GnssAssist
+{
+
+bool isValid(const uint8_t *data, size_t len)
+{
+    if (!len || len > GNSS_ASSIST_MAX_LEN)
+        return false;
+    for (size_t off = 0; off < len;) {
+        size_t n = frameLength(data + off, len - off);
+        if (!n || data[off + 2] != 0x13) // MGA only, nothing which could reconfigure the receiver
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+bool save(uint32_t issued, uint32_t expires, const uint8_t *data, size_t len)
+{
+#ifdef FSCom
+    FSCom.mkdir("/prefs");
+    FSCom.remove(assistFileName); // some of our filesystems don't truncate what they open for writing
+    auto f = FSCom.open(assistFileName, FILE_O_WRITE);
+    if (!f)
+        return false;
+
+    uint8_t header[GNSS_ASSIST_HEADER_LEN];
+    put32(header, issued);
+    put32(header + 4, expires);
+    bool ok = f.write(header, sizeof(header)) == sizeof(header) && f.write(data, len) == len;
+    f.close();
+    if (!ok)
+        FSCom.remove(assistFileName);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+bool getInfo(uint32_t &issued, uint32_t &expires)
+{
+#ifdef FSCom
+    auto f = FSCom.open(assistFileName, FILE_O_READ);
+    if (!f)
+        return false;
+
+    uint8_t header[GNSS_ASSIST_HEADER_LEN];
+    bool ok = f.read(header, sizeof(header)) == sizeof(header);
+    f.close();
+    if (ok) {
+        issued = get32(header);
+        expires = get32(header + 4);
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
+bool isFresh(uint32_t now)
+{
+    uint32_t issued, expires;
+    return getInfo(issued, expires) && (!now || now < expires);
+}
+
+size_t readFrame(uint32_t &offset, uint8_t *frame)
+{
+#ifdef FSCom
+    auto f = FSCom.open(assistFileName, FILE_O_READ);
+    if (!f)
+        return 0;
+
+    size_t len = 0;
+    if (f.seek(GNSS_ASSIST_HEADER_LEN + offset) && f.read(frame, 6) == 6) {
+        size_t frameLen = 8 + (frame[4] | (frame[5] << 8));
+        if (frameLen <= GNSS_ASSIST_MAX_FRAME && f.read(frame + 6, frameLen - 6) == frameLen - 6 &&
+            frameLength(frame, frameLen) == frameLen) {
+            len = frameLen;
+            offset += frameLen;
+        }
+    }
+    f.close();
+    return len;
+#else
+    return 0;
+#endif
+}
+
+size_t readAll(uint8_t *buf, size_t bufLen)
+{
+#ifdef FSCom
+    auto f = FSCom.open(assistFileName, FILE_O_READ);
+    if (!f)
+        return 0;
+
+    size_t len = f.read(buf, bufLen);
+    f.close();
+    return len > GNSS_ASSIST_HEADER_LEN ? len : 0;
+#else
+    return 0;
+#endif
+}
+
+} // namespace GnssAssist
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Inject what assistance we have into a u-blox (protocol 15 and up, the M8 on) when it wakes for a warm or cold start
+#ifndef GPS_UBX_ASSIST
+#define GPS_UBX_ASSIST 1
+#endif
+
+/// How far we may have gone from our last position by the time the receiver uses it (m), what we tell it that's good to
+#ifndef GPS_ASSIST_POS_ACC_M
+#define GPS_ASSIST_POS_ACC_M 100000
+#endif
+
+/// Cached UBX-MGA messages we send the receiver each GPS::runOnce() while we inject, so we don't overrun its UART
+#ifndef GPS_ASSIST_FRAMES_PER_RUN
+#define GPS_ASSIST_FRAMES_PER_RUN 4
+#endif
+
+/// Most bytes of UBX-MGA messages we cache, about a day of AssistNow Offline or one AssistNow Online download
+#define GNSS_ASSIST_MAX_LEN 6000
+
+/// The longest UBX message we take (an MGA-GPS-EPH is 76 bytes of payload, an MGA-ANO 84)
+#define GNSS_ASSIST_MAX_FRAME (8 + 128)
+
+/**
+ * Our cache (in flash) of the AssistNow data the phone, a gateway's MQTT or a neighboring router gave us: a run of UBX-MGA
+ * messages (ephemeris, almanac, AssistNow Offline orbits) as u-blox's services hand them out, and when they were issued and
+ * go stale.  GPS sends them to the receiver, after the time and rough position we know, whenever it wakes cold enough to
+ * need them.
+ */
+namespace GnssAssist
+{
+
+/// @return true if data is a run of whole UBX-MGA messages, every checksum good and none longer than GNSS_ASSIST_MAX_FRAME
+bool isValid(const uint8_t *data, size_t len);
+
+/// Replace our cache with data (which isValid()), issued and going stale at these times (secs since 1970)
+bool save(uint32_t issued, uint32_t expires, const uint8_t *data, size_t len);
+
+/// When what we have was issued and goes stale.  @return false if we have nothing
+bool getInfo(uint32_t &issued, uint32_t &expires);
+
+/// @return true if we have data which isn't stale at now (secs since 1970, 0 if we don't know the time)
+bool isFresh(uint32_t now);
+
+/**
+ * Read the message at offset into our data (0 for the first) into frame (GNSS_ASSIST_MAX_FRAME bytes).
+ * @return its length, and offset moved past it, or 0 if there are no more
+ */
+size_t readFrame(uint32_t &offset, uint8_t *frame);
+
+/// The whole cache, header and all, as we pass it on (at most GNSS_ASSIST_HEADER_LEN + GNSS_ASSIST_MAX_LEN bytes into buf)
+size_t readAll(uint8_t *buf, size_t bufLen);
+
+} // namespace GnssAssist
+
+/// Ahead of the messages, in our file and on the wire: issued (4), expires (4), both little endian
+#define GNSS_ASSIST_HEADER_LEN 8
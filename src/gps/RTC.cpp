@@ -17,6 +17,58 @@ static uint32_t
     timeStartMsec; // Once we have a GPS lock, this is where we hold the initial msec clock that corresponds to that time
 static uint64_t zeroOffsetSecs; // GPS based time in secs since 1970 - only updated once on initial lock
 
+/// When our GPS's last PPS pulse came (by millis()), and the second it started (0 until perhapsSetRTC() has told us which
+/// second one of them was).  Written by onPulsePerSecond() alone
+static volatile uint32_t ppsMsec, ppsSecs;
+
+#ifdef ARCH_ESP32
+#define PPS_ISR_ATTR IRAM_ATTR
+#else
+#define PPS_ISR_ATTR
+#endif
+
+void PPS_ISR_ATTR onPulsePerSecond()
+{
+    uint32_t now = millis();
+    // Counting the seconds since the last pulse, not the pulses, so we keep our place while the GPS sleeps through some.  Past
+    // PPS_RECOUNT_MSEC our own clock may have drifted too far to be sure of the count, so we wait to be told the second again
+    if (now - ppsMsec > PPS_RECOUNT_MSEC)
+        ppsSecs = 0;
+    else if (ppsSecs)
+        ppsSecs += (now - ppsMsec + 500) / 1000;
+    ppsMsec = now;
+}
+
+bool ppsNeedsTime()
+{
+    return ppsMsec && !ppsSecs && millis() - ppsMsec < PPS_STALE_MSEC;
+}
+
+/// @return false (and leaves secs and atMsec alone) if our PPS time base isn't good now
+static bool getLastPulse(uint32_t &secs, uint32_t &atMsec)
+{
+    uint32_t s, at;
+    do { // the pulse may come in the middle of our reading them
+        s = ppsSecs;
+        at = ppsMsec;
+    } while (s != ppsSecs || at != ppsMsec);
+
+    if (!s || millis() - at > PPS_STALE_MSEC)
+        return false;
+    secs = s;
+    atMsec = at;
+    return true;
+}
+
+bool getPpsTimeMsec(uint64_t &msec)
+{
+    uint32_t secs, atMsec;
+    if (!getLastPulse(secs, atMsec))
+        return false;
+    msec = (uint64_t)secs * 1000 + (millis() - atMsec);
+    return true;
+}
+
 /**
  * Reads the current date and time from the RTC module and updates the system time.
  * @return True if the RTC was successfully read and the system time was updated, false otherwise.
@@ -101,6 +153,13 @@ bool perhapsSetRTC(RTCQuality q, const struct timeval *tv)
     static uint32_t lastSetMsec = 0;
     uint32_t now = millis();
 
+    // A GPS time is for the second its last pulse started (its sentences come just after), which is the anchor our PPS
+    // time base counts on from
+    if (q == RTCQualityGPS && ppsMsec && now - ppsMsec < 1000 && ppsSecs != (uint32_t)tv->tv_sec) {
+        LOG_DEBUG("PPS time base now %ld\n", tv->tv_sec);
+        ppsSecs = tv->tv_sec;
+    }
+
     bool shouldSet;
     if (q > currentQuality) {
         shouldSet = true;
@@ -196,6 +255,9 @@ bool perhapsSetRTC(RTCQuality q, struct tm &t)
  */
 uint32_t getTime()
 {
+    uint32_t secs, atMsec;
+    if (currentQuality == RTCQualityGPS && getLastPulse(secs, atMsec))
+        return secs + (millis() - atMsec) / 1000;
     return (((uint32_t)millis() - timeStartMsec) / 1000) + zeroOffsetSecs;
 }
 
@@ -4,6 +4,16 @@
 #include "sys/time.h"
 #include <Arduino.h>
 
+/// Past this long without a pulse from our GPS's PPS output, we stop trusting the time base it gave us (see getPpsTimeMsec())
+#ifndef PPS_STALE_MSEC
+#define PPS_STALE_MSEC 5000
+#endif
+
+/// A gap between PPS pulses longer than this (the GPS asleep) and we no longer trust ourselves to count the seconds across it
+#ifndef PPS_RECOUNT_MSEC
+#define PPS_RECOUNT_MSEC (10 * 60 * 1000UL)
+#endif
+
 enum RTCQuality {
 
     /// We haven't had our RTC set yet
@@ -36,6 +46,19 @@ uint32_t getValidTime(RTCQuality minQuality);
 
 void readFromRTC();
 
+/// Our GPS's pulse per second interrupt (attached by GPS::createGps(), for boards with a PIN_GPS_PPS), at the top of each second
+void onPulsePerSecond();
+
+/**
+ * A time base all our GPS nodes share to well within a msec: the msecs since 1970, counted from the last PPS pulse, rather
+ * than from whenever we happened to parse a GPS time.  @return false if we haven't had a pulse in PPS_STALE_MSEC (or haven't
+ * yet been told which second one of them started)
+ */
+bool getPpsTimeMsec(uint64_t &msec);
+
+/// @return true if pulses are coming from our GPS's PPS, but we need a GPS time to know which second they start
+bool ppsNeedsTime();
+
 #define SEC_PER_DAY 86400
 #define SEC_PER_HOUR 3600
 #define SEC_PER_MIN 60
\ No newline at end of file
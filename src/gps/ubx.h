@@ -292,6 +292,18 @@ const uint8_t GPS::_message_PMS[] = {
     0x00, 0x00  // reserved, generated by u-center
 };
 
+// Enable UBX-NAV-PVT, once per navigation solution.  In about 100 bytes it has all we take from RMC, GGA and GSA, and their
+// accuracy besides, see GPS_UBX_NAV_PVT
+const uint8_t GPS::_message_NAV_PVT[] = {
+    0x01, 0x07, // UBX ID for NAV-PVT
+    0x00,       // Rate for DDC
+    0x01,       // Rate for UART1
+    0x00,       // Rate for UART2
+    0x00,       // Rate for USB
+    0x00,       // Rate for SPI
+    0x00        // Reserved
+};
+
 const uint8_t GPS::_message_SAVE[] = {
     0x00, 0x00, 0x00, 0x00, // clearMask: no sections cleared
     0xFF, 0xFF, 0x00, 0x00, // saveMask: save all sections
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "configuration.h"
+#include <OLEDDisplay.h>
+#include <Wire.h>
+#include <algorithm>
+#include <string.h>
+
+/// Send our I2C OLEDs just the columns of each page which changed, rather than the box around everything that changed
+#ifndef OLED_DIRTY_PAGES
+#define OLED_DIRTY_PAGES 1
+#endif
+
+/// Changed columns of a page closer together than this go out as one window, a window costs about this many bytes of commands
+#ifndef OLED_SPAN_MERGE_GAP
+#define OLED_SPAN_MERGE_GAP 8
+#endif
+
+/// Data bytes in each I2C transmission, what the Wire buffer holds after our control byte
+#ifndef OLED_I2C_CHUNK
+#if defined(ARCH_ESP32)
+#define OLED_I2C_CHUNK 127
+#elif defined(ARCH_RP2040)
+#define OLED_I2C_CHUNK 255
+#else
+#define OLED_I2C_CHUNK 31
+#endif
+#endif
+
+/// How the controller behind the display addresses its RAM, OLED_CONTROLLER_OTHER for the library's own display()
+enum OLEDController { OLED_CONTROLLER_OTHER, OLED_CONTROLLER_SSD1306, OLED_CONTROLLER_SH1106 };
+
+/**
+ * One of the OLED library's I2C displays (SSD1306Wire, SH1106Wire, AutoOLEDWire), with a display() which only sends what
+ * changed.  The library's own diffs the frame against its back buffer too, but sends the whole box around the changes, in
+ * transmissions of 16 bytes - so a clock in one corner and the heartbeat pixel in the other still send most of the panel.
+ * Each page (8 rows, a byte a column) here sends only its changed column windows, each as one transmission of
+ * commands setting the window and as few data transmissions as the Wire buffer allows.  So a frame where a clock ticks
+ * takes a few dozen bytes, and the bus is free again for our sensors and keyboards sooner.
+ *
+ * The Arduino Wire APIs we build on have no DMA, so it's fewer and longer transmissions, at the library's own (fast) clock.
+ */
+template <class Base> class DirtyOLEDWire : public Base
+{
+    uint8_t address;
+    TwoWire *wire;
+    OLEDController controller;
+
+    void sendCommands(const uint8_t *cmds, size_t len)
+    {
+        wire->beginTransmission(address);
+        wire->write(0x00); // a stream of commands follows
+        wire->write(cmds, len);
+        wire->endTransmission();
+    }
+
+    /// Send columns [start, end) of page p
+    void sendWindow(uint8_t p, uint16_t start, uint16_t end)
+    {
+        if (controller == OLED_CONTROLLER_SSD1306) {
+            // Horizontal addressing, as the library sets it up.  Narrow panels sit in the middle of the controller's 128 columns
+            uint8_t offset = this->displayWidth < 128 ? (128 - this->displayWidth) / 2 : 0;
+            const uint8_t cmds[] = {0x21, (uint8_t)(offset + start), (uint8_t)(offset + end - 1), 0x22, p, p};
+            sendCommands(cmds, sizeof(cmds));
+        } else {
+            // Page addressing, and the SH1106's 132 columns have the panel's 128 from column 2
+            uint8_t column = start + 2;
+            const uint8_t cmds[] = {(uint8_t)(0xb0 | p), (uint8_t)(column & 0x0f), (uint8_t)(0x10 | (column >> 4))};
+            sendCommands(cmds, sizeof(cmds));
+        }
+
+        const uint8_t *data = this->buffer + p * this->displayWidth + start;
+        for (uint16_t i = start; i < end;) {
+            uint16_t n = std::min<uint16_t>(end - i, OLED_I2C_CHUNK);
+            wire->beginTransmission(address);
+            wire->write(0x40); // display data follows
+            wire->write(data, n);
+            wire->endTransmission();
+            data += n;
+            i += n;
+        }
+    }
+
+  public:
+    DirtyOLEDWire(uint8_t _address, int sda, int scl, OLEDDISPLAY_GEOMETRY geometry, HW_I2C i2cBus, OLEDController _controller)
+        : Base(_address, sda, scl, geometry, i2cBus), address(_address), controller(_controller)
+    {
+#ifdef I2C_SDA1
+        wire = i2cBus == HW_I2C::I2C_TWO ? &Wire1 : &Wire;
+#else
+        wire = &Wire;
+#endif
+    }
+
+    /// For AutoOLEDWire, once we know which controller it found
+    void setController(OLEDController c) { controller = c; }
+
+    virtual void display() override
+    {
+#if OLED_DIRTY_PAGES && defined(OLEDDISPLAY_DOUBLE_BUFFER)
+        if (controller != OLED_CONTROLLER_OTHER && this->displayWidth <= 128) {
+            uint16_t width = this->displayWidth;
+            for (uint8_t p = 0; p < this->displayHeight / 8; p++) {
+                const uint8_t *page = this->buffer + p * width;
+                uint8_t *before = this->buffer_back + p * width;
+                uint16_t x = 0;
+                for (;;) {
+                    while (x < width && page[x] == before[x])
+                        x++;
+                    if (x == width)
+                        break;
+
+                    // Take in what changes next along the page, as long as the gap to it is small
+                    uint16_t start = x, end = x + 1;
+                    for (x++; x < width && x - end <= OLED_SPAN_MERGE_GAP; x++)
+                        if (page[x] != before[x])
+                            end = x + 1;
+                    sendWindow(p, start, end);
+                    memcpy(before + start, page + start, end - start);
+                    x = end;
+                }
+            }
+            return;
+        }
+#endif
+        Base::display();
+    }
+};
@@ -5,7 +5,9 @@
 #include "GxEPD2_BW.h"
 #include "SPILock.h"
 #include "main.h"
+#include "memGet.h"
 #include <SPI.h>
+#include <assert.h>
 
 #if defined(HELTEC_WIRELESS_PAPER) || defined(HELTEC_WIRELESS_PAPER_V1_0)
 SPIClass *hspi = NULL;
@@ -123,7 +125,7 @@ uint32_t lastDrawMsec;
 bool EInkDisplay::forceDisplay(uint32_t msecLimit)
 {
     // No need to grab this lock because we are on our own SPI bus
-    // concurrency::LockGuard g(spiLock);
+    // SPIGuard g(SPI_CLIENT_DISPLAY);
 
 #if defined(USE_EINK_DYNAMIC_PARTIAL)
     // Decide if update is partial or full
@@ -154,6 +156,7 @@ bool EInkDisplay::forceDisplay(uint32_t msecLimit)
     }
 
     LOG_DEBUG("Updating E-Paper... ");
+    uint32_t refreshStartMsec = millis();
 
 #if defined(TTGO_T_ECHO)
     adafruitDisplay->nextPage();
@@ -184,7 +187,19 @@ bool EInkDisplay::forceDisplay(uint32_t msecLimit)
 
     // Put screen to sleep to save power (possibly not necessary because we already did poweroff inside of display)
     adafruitDisplay->hibernate();
-    LOG_DEBUG("done\n");
+
+    RefreshStats &s = refreshStats;
+    uint32_t took = millis() - refreshStartMsec;
+    s.refreshes++;
+#if defined(USE_EINK_DYNAMIC_PARTIAL)
+    if (isFullRefreshMode)
+        s.fullRefreshes++;
+#endif
+    s.refreshMsec += took;
+    s.energyMilliJoules = (uint64_t)s.refreshMsec * EINK_REFRESH_MW / 1000;
+    LOG_DEBUG("done in %ums (refreshes=%u full=%u merged=%u skipped=%u energy=%umJ)\n", (unsigned)took, (unsigned)s.refreshes,
+              (unsigned)s.fullRefreshes, (unsigned)s.mergedUpdates, (unsigned)s.skippedUpdates,
+              (unsigned)s.energyMilliJoules);
 
     return true;
 }
@@ -353,7 +368,7 @@ void EInkDisplay::highPriority()
     isHighPriority = true;
 }
 
-// Suggest that subsequent updates should use full-refresh
+// Suggest that subsequent updates aren't urgent (rate limited, and may clean the panel with a full-refresh)
 void EInkDisplay::lowPriority()
 {
     isHighPriority = false;
@@ -381,38 +396,56 @@ void EInkDisplay::configForFullRefresh()
 #endif
 }
 
-bool EInkDisplay::newImageMatchesOld()
+uint32_t EInkDisplay::imageHash()
 {
-    uint32_t newImageHash = 0;
+    uint32_t hash = 0;
+    for (uint32_t b = 0; b < displayBufferSize; b++)
+        hash = hash * 31 + buffer[b];
+    return hash;
+}
 
-    // Generate hash: sum all bytes in the image buffer
-    for (uint16_t b = 0; b < (displayWidth / 8) * displayHeight; b++) {
-        newImageHash += buffer[b];
+uint32_t EInkDisplay::countChanges(uint32_t *perRegion)
+{
+    memset(perRegion, 0, sizeof(ghost));
+
+    // The buffer is in the pages the OLED lib uses: each byte is 8 pixels of one column, top to bottom
+    uint32_t total = 0;
+    for (uint32_t b = 0; b < displayBufferSize; b++) {
+        uint8_t diff = buffer[b] ^ shownImage[b];
+        if (!diff)
+            continue;
+
+        uint32_t x = b % displayWidth, y = (b / displayWidth) * 8;
+        if (y >= displayHeight)
+            y = displayHeight - 1; // the padding rows of a page that hangs off the bottom
+        uint32_t n = __builtin_popcount(diff);
+        perRegion[(y * EINK_REGIONS_Y / displayHeight) * EINK_REGIONS_X + x * EINK_REGIONS_X / displayWidth] += n;
+        total += n;
     }
-
-    // Compare hashes
-    bool hashMatches = (newImageHash == prevImageHash);
-
-    // Update the cached hash
-    prevImageHash = newImageHash;
-
-    // Return the comparison result
-    return hashMatches;
+    return total;
 }
 
-// Change between partial and full refresh config, or skip update, balancing urgency and display health.
+// Change between partial and full refresh config, merge or skip update, spending our ghosting budget
 bool EInkDisplay::determineRefreshMode()
 {
     uint32_t now = millis();
     uint32_t sinceLast = now - lastUpdateMsec;
 
-    // If rate-limiting dropped a high-priority update:
+    // If rate-limiting (or merging) held back a high-priority update:
     // promote this update, so it runs ASAP
     if (missedHighPriorityUpdate) {
         isHighPriority = true;
         missedHighPriorityUpdate = false;
     }
 
+    // Is the image still changing, in a burst of updates we could show as one?
+    uint32_t newImageHash = imageHash();
+    bool changing = newImageHash != prevImageHash && now - lastChangeMsec < EINK_MERGE_MSEC;
+    if (newImageHash != prevImageHash) {
+        prevImageHash = newImageHash;
+        lastChangeMsec = now;
+    }
+
     // Abort: if too soon for a new frame
     if (isHighPriority && partialRefreshCount > 0 && sinceLast < highPriorityLimitMsec) {
         LOG_DEBUG("Update skipped: exceeded EINK_HIGHPRIORITY_LIMIT_SECONDS\n");
@@ -423,47 +456,75 @@ bool EInkDisplay::determineRefreshMode()
         return false;
     }
 
-    // Check if old image (partial) should be redrawn (as full), for image quality
-    if (partialRefreshCount > 0 && !isHighPriority)
-        needsFull = true;
+    // We don't know what's on the panel until we've drawn all of it
+    bool firstDraw = !shownImage;
+    if (firstDraw) {
+        shownImage = static_cast<uint8_t *>(memGet.place(HEAP_SITE_SCREEN, displayBufferSize, true));
+        assert(shownImage);
+    }
+
+    uint32_t changed[EINK_REGIONS_X * EINK_REGIONS_Y];
+    uint32_t totalChanged = countChanges(changed);
 
-    // If too many partials, require a full-refresh (display health)
-    if (partialRefreshCount >= partialRefreshLimit)
-        needsFull = true;
+    // Clean up ghosting once nothing has changed for a while
+    bool idleClean =
+        !isHighPriority && partialRefreshCount > 0 && now - lastChangeMsec >= (uint32_t)1000 * EINK_IDLE_CLEAN_SECONDS;
 
-    // If image matches
-    if (newImageMatchesOld()) {
+    // If image matches, and we aren't cleaning: skip it
+    if (!totalChanged && !idleClean && !firstDraw) {
         // If low priority: limit rate
-        // otherwise, every loop() will run the hash method
+        // otherwise, every loop() will diff the image
         if (!isHighPriority)
             lastUpdateMsec = now;
+        refreshStats.skippedUpdates++;
+        pendingSinceMsec = 0;
+        return false;
+    }
 
-        // If update is *not* for display health or image quality, skip it
-        if (!needsFull)
-            return false;
+    // Hold back a change while more are coming, so they cost one refresh
+    if (isHighPriority && changing && !firstDraw && (!pendingSinceMsec || now - pendingSinceMsec < EINK_MERGE_MAX_MSEC)) {
+        if (!pendingSinceMsec)
+            pendingSinceMsec = now;
+        refreshStats.mergedUpdates++;
+        missedHighPriorityUpdate = true;
+        return false;
     }
 
+    // Would a partial refresh overdraw any region's ghosting budget?
+    const uint32_t budget =
+        (uint32_t)displayWidth * displayHeight / (EINK_REGIONS_X * EINK_REGIONS_Y) * EINK_GHOST_BUDGET_PERCENT / 100;
+    bool budgetSpent = partialRefreshCount >= partialRefreshLimit;
+    for (uint8_t r = 0; r < EINK_REGIONS_X * EINK_REGIONS_Y; r++)
+        if (ghost[r] + changed[r] > budget)
+            budgetSpent = true;
+
     // Conditions assessed - not skipping - load the appropriate config
 
-    // If options require a full refresh
-    if (!isHighPriority || needsFull) {
-        if (partialRefreshCount > 0)
+    // If the panel needs a clean (or we don't know what's on it)
+    if (firstDraw || budgetSpent || idleClean) {
+        if (!isFullRefreshMode)
             configForFullRefresh();
+        isFullRefreshMode = true;
 
-        LOG_DEBUG("Conditions met for full-refresh\n");
+        LOG_DEBUG("Conditions met for full-refresh (%s)\n", firstDraw ? "first" : budgetSpent ? "ghosting budget" : "idle");
         partialRefreshCount = 0;
-        needsFull = false;
+        memset(ghost, 0, sizeof(ghost));
     }
 
-    // If options allow a partial refresh
+    // Otherwise a partial refresh will do
     else {
-        if (partialRefreshCount == 0)
+        if (isFullRefreshMode)
             configForPartialRefresh();
+        isFullRefreshMode = false;
 
-        LOG_DEBUG("Conditions met for partial-refresh\n");
+        LOG_DEBUG("Conditions met for partial-refresh (%u pixels)\n", (unsigned)totalChanged);
         partialRefreshCount++;
+        for (uint8_t r = 0; r < EINK_REGIONS_X * EINK_REGIONS_Y; r++)
+            ghost[r] += changed[r];
     }
 
+    memcpy(shownImage, buffer, displayBufferSize);
+    pendingSinceMsec = 0;
     lastUpdateMsec = now; // Mark time for rate limiting
     return true;          // Instruct calling method to continue with update
 }
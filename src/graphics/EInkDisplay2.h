@@ -2,6 +2,11 @@
 
 #include <OLEDDisplay.h>
 
+/// What a refresh costs while the panel's driver is busy, for the energy estimate in EInkDisplay::RefreshStats
+#ifndef EINK_REFRESH_MW
+#define EINK_REFRESH_MW 20
+#endif
+
 #if defined(HELTEC_WIRELESS_PAPER_V1_0)
 // Re-enable SPI after deep sleep: rtc_gpio_hold_dis()
 #include "driver/rtc_io.h"
@@ -24,6 +29,18 @@ class EInkDisplay : public OLEDDisplay
     uint32_t slowUpdateMsec = 5 * 60 * 1000;
 
   public:
+    /// What refreshing the panel has cost since boot (logged after each refresh)
+    struct RefreshStats {
+        uint32_t refreshes = 0;
+        uint32_t fullRefreshes = 0;  // of those, with USE_EINK_DYNAMIC_PARTIAL (otherwise we don't choose)
+        uint32_t mergedUpdates = 0;  // held back to go out with the next change
+        uint32_t skippedUpdates = 0; // nothing on screen would have changed
+        uint32_t refreshMsec = 0;    // waiting for the panel
+        uint32_t energyMilliJoules = 0;
+    };
+
+    const RefreshStats &getRefreshStats() const { return refreshStats; }
+
     /* constructor
     FIXME - the parameters are not used, just a temporary hack to keep working like the old displays
     */
@@ -55,27 +72,29 @@ class EInkDisplay : public OLEDDisplay
     // Connect to the display
     virtual bool connect() override;
 
+    RefreshStats refreshStats;
+
 #if defined(USE_EINK_DYNAMIC_PARTIAL)
-    // Full, partial, or skip: balance urgency with display health
+    // Full, partial, merge or skip: spend a ghosting budget rather than a fixed count of partials
 
-    // Use partial refresh if EITHER:
-    // * highPriority() was set
-    // * a highPriority() update was previously skipped, for rate-limiting - (EINK_HIGHPRIORITY_LIMIT_SECONDS)
+    // Every partial refresh leaves a little ghosting behind where pixels changed.  We split the panel into
+    // EINK_REGIONS_X x EINK_REGIONS_Y regions, and add up the pixels each partial refresh changes in each of them.  A region
+    // may change EINK_GHOST_BUDGET_PERCENT of its pixels before it needs cleaning with a full refresh.
 
     // Use full refresh if EITHER:
-    // * lowPriority() was set
-    // * too many partial updates in a row: protect display - (EINK_PARTIAL_REPEAT_LIMIT)
-    // * no recent updates, and last update was partial: redraw for image quality (EINK_LOWPRIORITY_LIMIT_SECONDS)
+    // * a region has spent its ghosting budget (or EINK_PARTIAL_REPEAT_LIMIT partials in a row, as a backstop)
+    // * lowPriority(), we've been idle for EINK_IDLE_CLEAN_SECONDS and there's ghosting to clean up
+
+    // Otherwise use partial refresh, for changes at either priority
+
+    // Merge (hold back) a highPriority() change while the image is still changing (EINK_MERGE_MSEC), for at most
+    // EINK_MERGE_MAX_MSEC, so a burst of updates goes out as one refresh
 
     // Rate limit if:
     // * lowPriority() - (EINK_LOWPRIORITY_LIMIT_SECONDS)
     // * highPriority(), if multiple partials have run back-to-back - (EINK_HIGHPRIORITY_LIMIT_SECONDS)
 
-    // Skip update entirely if ALL criteria met:
-    // * new image matches old image
-    // * lowPriority()
-    // * not redrawing for image quality
-    // * not refreshing for display health
+    // Skip update entirely if nothing on screen would change, and we aren't cleaning
 
     // ------------------------------------
 
@@ -91,22 +110,46 @@ class EInkDisplay : public OLEDDisplay
         #define EINK_PARTIAL_REPEAT_LIMIT 5
     */
 
+#ifndef EINK_REGIONS_X
+#define EINK_REGIONS_X 4
+#endif
+#ifndef EINK_REGIONS_Y
+#define EINK_REGIONS_Y 2
+#endif
+#ifndef EINK_GHOST_BUDGET_PERCENT
+#define EINK_GHOST_BUDGET_PERCENT 50
+#endif
+#ifndef EINK_MERGE_MSEC
+#define EINK_MERGE_MSEC 500
+#endif
+#ifndef EINK_MERGE_MAX_MSEC
+#define EINK_MERGE_MAX_MSEC 3000
+#endif
+#ifndef EINK_IDLE_CLEAN_SECONDS
+#define EINK_IDLE_CLEAN_SECONDS EINK_LOWPRIORITY_LIMIT_SECONDS
+#endif
+
   public:
     void highPriority(); // Suggest partial refresh
-    void lowPriority();  // Suggest full refresh
+    void lowPriority();  // Not urgent: rate limited, and may clean the panel with a full refresh
 
   protected:
     void configForPartialRefresh(); // Display specific code to select partial refresh mode
     void configForFullRefresh();    // Display specific code to return to full refresh mode
-    bool newImageMatchesOld();      // Is the new update actually different to the last image?
-    bool determineRefreshMode();    // Called immediately before data written to display - choose refresh mode, or abort update
+    uint32_t imageHash();           // Of the new image, to tell whether it's still changing
+    uint32_t countChanges(uint32_t *perRegion); // Pixels which differ from shownImage, @return how many in all
+    bool determineRefreshMode(); // Called immediately before data written to display - choose refresh mode, or abort update
 
     bool isHighPriority = true;            // Does the method calling update believe that this is urgent?
-    bool needsFull = false;                // Is a full refresh forced? (display health)
-    bool missedHighPriorityUpdate = false; // Was a high priority update skipped for rate-limiting?
+    bool missedHighPriorityUpdate = false; // Was a high priority update skipped for rate-limiting (or merged)?
+    bool isFullRefreshMode = true;         // Which mode the panel is configured for
     uint16_t partialRefreshCount = 0;      // How many partials have occurred since last full refresh?
     uint32_t lastUpdateMsec = 0;           // When did the last update occur?
-    uint32_t prevImageHash = 0;            // Used to check if update will change screen image (skippable or not)
+    uint32_t prevImageHash = 0;            // Of the image we were last asked to show, to tell whether it's still changing
+    uint32_t lastChangeMsec = 0;           // When that last changed
+    uint32_t pendingSinceMsec = 0;         // When we first held back the change we haven't shown yet, 0 if none
+    uint8_t *shownImage = NULL;            // What's on the panel, to find what changed
+    uint32_t ghost[EINK_REGIONS_X * EINK_REGIONS_Y] = {}; // Pixels partials have changed in each region since a full
 
     // Set in variant.h
     const uint32_t lowPriorityLimitMsec = (uint32_t)1000 * EINK_LOWPRIORITY_LIMIT_SECONDS;   // Max rate for partial refreshes
@@ -24,7 +24,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #if HAS_SCREEN
 #include <OLEDDisplay.h>
 
+#include "TextRasterCache.h"
+
 #include "DisplayFormatters.h"
+#include "EnergyStats.h"
 #include "GPS.h"
 #include "MeshService.h"
 #include "NodeDB.h"
@@ -43,6 +46,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "sleep.h"
 #include "target_specific.h"
 
+#if SCREEN_RENDER_TASK
+#include "concurrency/PacketTask.h"
+#include "concurrency/TripleBuffer.h"
+
+#if !USE_PACKET_TASK
+#error "SCREEN_RENDER_TASK needs USE_PACKET_TASK"
+#endif
+#endif
+
 #if HAS_WIFI && !defined(ARCH_PORTDUINO)
 #include "mesh/wifi/WiFiAPClient.h"
 #endif
@@ -73,13 +85,42 @@ namespace graphics
 #define IDLE_FRAMERATE 1 // in fps
 
 // DEBUG
-#define NUM_EXTRA_FRAMES 3 // text message and debug frame
+#define NUM_EXTRA_FRAMES 6 // critical fault, text message, waypoint and debug frames
 // if defined a pixel will blink to show redraws
 // #define SHOW_REDRAWS
 
-// A text message frame + debug frame + all the node infos
-static FrameCallback normalFrames[MAX_NUM_NODES + NUM_EXTRA_FRAMES];
+// The module frames + a text message frame + debug frames + a window of node infos
+static FrameCallback normalFrames[MAX_UI_FRAME_MODULES + NUM_EXTRA_FRAMES + SCREEN_NODE_FRAMES];
 static uint32_t targetFramerate = IDLE_FRAMERATE;
+
+/// How long what the frame being drawn shows stays right by itself (UINT32_MAX if it didn't say), see frameChangesIn()
+static uint32_t frameValidMsec = UINT32_MAX;
+
+/// For a frame to say when its contents next change by themselves (a clock ticking, an age going up), so that while nothing
+/// else changes SCREEN_FRAME_GOVERNOR doesn't redraw it sooner.  Frames which don't say get drawn IDLE_FRAMERATE times a second
+static void frameChangesIn(uint32_t msec)
+{
+    if (msec < frameValidMsec)
+        frameValidMsec = msec;
+}
+
+/// @return how long until the next of unitSecs after secs
+static uint32_t msecUntilNext(uint32_t secs, uint32_t unitSecs)
+{
+    return (unitSecs - secs % unitSecs) * 1000;
+}
+
+/// @return how long until Screen::drawTimeDelta() of seconds ago changes
+static uint32_t msecUntilTimeDeltaChanges(uint32_t seconds)
+{
+    if (seconds < 60)
+        return msecUntilNext(seconds, 1);
+    if (seconds < 2 * 60 * 60)
+        return msecUntilNext(seconds, 60);
+    if (seconds < 2 * 24 * 60 * 60)
+        return msecUntilNext(seconds, 60 * 60);
+    return msecUntilNext(seconds, 24 * 60 * 60);
+}
 static char btPIN[16] = "888888";
 
 uint32_t logo_timeout = 5000; // 4 seconds for EACH logo
@@ -96,6 +137,69 @@ uint32_t dopThresholds[5] = {2000, 1000, 500, 200, 100};
 // we'll need to hold onto pointers for the modules that can draw a frame.
 std::vector<MeshModule *> moduleFrames;
 
+/// One of the nodes our node frames show, as it was when our thread last looked
+struct NodeSummary {
+    NodeNum num = 0;
+    bool hasUser = false;
+    char longName[sizeof(meshtastic_User::long_name)] = "";
+    float snr = 0;
+    uint32_t lastHeard = 0;
+    int32_t lat = 0, lon = 0; // 0, 0 for no (valid) position
+    bool hasDistance = false; // nodeDB had them worked out for us
+    float distance = 0, bearing = 0;
+};
+
+/**
+ * What our frames show of the mesh state, as it was when our thread last looked (holding packetLock, see publishSnapshot()).
+ * Our frames draw from this rather than from nodeDB, devicestate or channels - which, with SCREEN_RENDER_TASK, the packet task
+ * changes while our render task draws.  What is only ever a word (our statuses, config, airTime) they still read directly
+ */
+struct ScreenSnapshot {
+    size_t numNodes = 0;
+    int32_t ourLat = 0, ourLon = 0;        // 0, 0 for no (valid) position
+    NodeSummary nodes[SCREEN_NODE_FRAMES]; // what our node window shows, one per frame
+
+    bool hasText = false; // and shouldDrawMessage()
+    uint32_t textRxTime = 0;
+    char textFrom[sizeof(meshtastic_User::short_name)] = ""; // "" if we don't know them
+    char text[237] = "";
+
+    bool hasWaypoint = false; // and shouldDrawMessage()
+    uint32_t waypointRxTime = 0;
+    char waypointFrom[sizeof(meshtastic_User::short_name)] = "";
+    bool hasWaypointName = false; // we could decode it
+    char waypointName[sizeof(meshtastic_Waypoint::name)] = "";
+
+    char channelName[20] = "";
+};
+
+#if SCREEN_RENDER_TASK
+static concurrency::TripleBuffer<ScreenSnapshot> snapshots;
+#else
+static ScreenSnapshot snapshot;
+#endif
+
+/// What our frames draw from
+static const ScreenSnapshot &getSnapshot()
+{
+#if SCREEN_RENDER_TASK
+    return snapshots.read();
+#else
+    return snapshot;
+#endif
+}
+
+/// Whether what draws now may read the mesh state directly (module frames, MeshModule): always, unless our render task is
+/// drawing without packetLock
+static bool meshStateLocked = !SCREEN_RENDER_TASK;
+
+/// When t (in seconds, by getTime()) was, like sinceLastSeen()
+static uint32_t secondsSince(uint32_t t)
+{
+    int delta = (int)(getTime() - t);
+    return delta < 0 ? 0 : delta; // our clock must be slightly off still - not set from GPS yet
+}
+
 // Stores the last 4 of our hardware ID, to make finding the device for pairing easier
 static char ourId[5];
 
@@ -139,6 +243,9 @@ static uint16_t displayWidth, displayHeight;
 
 #define getStringCenteredX(s) ((SCREEN_WIDTH - display->getStringWidth(s)) / 2)
 
+/// The labels our frames draw every tick (names, our id, the channel), rendered once
+static TextRasterCache textCache(Screen::customFontTableLookup);
+
 /**
  * Draw the icon with extra info printed around the corners
  */
@@ -313,6 +420,10 @@ static void drawModuleFrame(OLEDDisplay *display, OLEDDisplayUiState *state, int
         // LOG_DEBUG("Screen is not in transition.  Frame: %d\n\n", module_frame);
     }
     // LOG_DEBUG("Drawing Module Frame %d\n\n", module_frame);
+    if (!meshStateLocked) { // our render task didn't see this frame coming, draw it next time (holding packetLock)
+        screen->setDamaged();
+        return;
+    }
     MeshModule &pi = *moduleFrames.at(module_frame);
     pi.drawFrame(display, state, x, y);
 }
@@ -340,18 +451,20 @@ static void drawFrameBluetooth(OLEDDisplay *display, OLEDDisplayUiState *state,
     deviceName.concat(getDeviceName());
     y_offset = display->height() == 64 ? y_offset + FONT_HEIGHT_LARGE - 6 : y_offset + FONT_HEIGHT_LARGE + 5;
     display->drawString(x_offset + x, y_offset + y, deviceName);
+    frameChangesIn(SCREEN_MAX_STATIC_MSEC);
 }
 
 static void drawFrameFirmware(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y)
 {
-    display->setTextAlignment(TEXT_ALIGN_CENTER);
+    display->setTextAlignment(TEXT_ALIGN_LEFT);
     display->setFont(FONT_MEDIUM);
-    display->drawString(64 + x, y, "Updating");
+    textCache.drawString(display, 64 + x - textCache.getStringWidth(display, FONT_MEDIUM, "Updating") / 2, y, FONT_MEDIUM,
+                         "Updating");
 
     display->setFont(FONT_SMALL);
-    display->setTextAlignment(TEXT_ALIGN_LEFT);
     display->drawStringMaxWidth(0 + x, 2 + y + FONT_HEIGHT_SMALL * 2, x + display->getWidth(),
                                 "Please be patient and do not power off.");
+    frameChangesIn(SCREEN_MAX_STATIC_MSEC);
 }
 
 /// Draw the last text message we received
@@ -366,6 +479,7 @@ static void drawCriticalFaultFrame(OLEDDisplay *display, OLEDDisplayUiState *sta
     display->setTextAlignment(TEXT_ALIGN_LEFT);
     display->setFont(FONT_SMALL);
     display->drawString(0 + x, FONT_HEIGHT_MEDIUM + y, "For help, please visit \nmeshtastic.org");
+    frameChangesIn(SCREEN_MAX_STATIC_MSEC);
 }
 
 // Ignore messages originating from phone (from the current node 0x0) unless range test or store and forward module are enabled
@@ -380,10 +494,8 @@ static void drawTextMessageFrame(OLEDDisplay *display, OLEDDisplayUiState *state
     // the max length of this buffer is much longer than we can possibly print
     static char tempBuf[237];
 
-    const meshtastic_MeshPacket &mp = devicestate.rx_text_message;
-    meshtastic_NodeInfoLite *node = nodeDB.getMeshNode(getFrom(&mp));
-    // LOG_DEBUG("drawing text message from 0x%x: %s\n", mp.from,
-    // mp.decoded.variant.data.decoded.bytes);
+    const ScreenSnapshot &snap = getSnapshot();
+    const char *from = snap.textFrom[0] ? snap.textFrom : "???";
 
     // Demo for drawStringMaxWidth:
     // with the third parameter you can define the width after which words will
@@ -395,22 +507,22 @@ static void drawTextMessageFrame(OLEDDisplay *display, OLEDDisplayUiState *state
         display->setColor(BLACK);
     }
 
-    uint32_t seconds = sinceReceived(&mp);
+    uint32_t seconds = secondsSince(snap.textRxTime);
     uint32_t minutes = seconds / 60;
     uint32_t hours = minutes / 60;
     uint32_t days = hours / 24;
 
     if (config.display.heading_bold) {
         display->drawStringf(1 + x, 0 + y, tempBuf, "%s ago from %s",
-                             screen->drawTimeDelta(days, hours, minutes, seconds).c_str(),
-                             (node && node->has_user) ? node->user.short_name : "???");
+                             screen->drawTimeDelta(days, hours, minutes, seconds).c_str(), from);
     }
     display->drawStringf(0 + x, 0 + y, tempBuf, "%s ago from %s", screen->drawTimeDelta(days, hours, minutes, seconds).c_str(),
-                         (node && node->has_user) ? node->user.short_name : "???");
+                         from);
+
+    frameChangesIn(msecUntilTimeDeltaChanges(seconds));
 
     display->setColor(WHITE);
-    snprintf(tempBuf, sizeof(tempBuf), "%s", mp.decoded.payload.bytes);
-    display->drawStringMaxWidth(0 + x, 0 + y + FONT_HEIGHT_SMALL, x + display->getWidth(), tempBuf);
+    display->drawStringMaxWidth(0 + x, 0 + y + FONT_HEIGHT_SMALL, x + display->getWidth(), snap.text);
 }
 
 /// Draw the last waypoint we received
@@ -418,8 +530,8 @@ static void drawWaypointFrame(OLEDDisplay *display, OLEDDisplayUiState *state, i
 {
     static char tempBuf[237];
 
-    meshtastic_MeshPacket &mp = devicestate.rx_waypoint;
-    meshtastic_NodeInfoLite *node = nodeDB.getMeshNode(getFrom(&mp));
+    const ScreenSnapshot &snap = getSnapshot();
+    const char *from = snap.waypointFrom[0] ? snap.waypointFrom : "???";
 
     display->setTextAlignment(TEXT_ALIGN_LEFT);
     display->setFont(FONT_SMALL);
@@ -428,24 +540,23 @@ static void drawWaypointFrame(OLEDDisplay *display, OLEDDisplayUiState *state, i
         display->setColor(BLACK);
     }
 
-    uint32_t seconds = sinceReceived(&mp);
+    uint32_t seconds = secondsSince(snap.waypointRxTime);
     uint32_t minutes = seconds / 60;
     uint32_t hours = minutes / 60;
     uint32_t days = hours / 24;
 
     if (config.display.heading_bold) {
         display->drawStringf(1 + x, 0 + y, tempBuf, "%s ago from %s",
-                             screen->drawTimeDelta(days, hours, minutes, seconds).c_str(),
-                             (node && node->has_user) ? node->user.short_name : "???");
+                             screen->drawTimeDelta(days, hours, minutes, seconds).c_str(), from);
     }
     display->drawStringf(0 + x, 0 + y, tempBuf, "%s ago from %s", screen->drawTimeDelta(days, hours, minutes, seconds).c_str(),
-                         (node && node->has_user) ? node->user.short_name : "???");
+                         from);
+
+    frameChangesIn(msecUntilTimeDeltaChanges(seconds));
 
     display->setColor(WHITE);
-    meshtastic_Waypoint scratch;
-    memset(&scratch, 0, sizeof(scratch));
-    if (pb_decode_from_bytes(mp.decoded.payload.bytes, mp.decoded.payload.size, &meshtastic_Waypoint_msg, &scratch)) {
-        snprintf(tempBuf, sizeof(tempBuf), "Received waypoint: %s", scratch.name);
+    if (snap.hasWaypointName) {
+        snprintf(tempBuf, sizeof(tempBuf), "Received waypoint: %s", snap.waypointName);
         display->drawStringMaxWidth(0 + x, 0 + y + FONT_HEIGHT_SMALL, x + display->getWidth(), tempBuf);
     }
 }
@@ -459,9 +570,9 @@ static void drawColumns(OLEDDisplay *display, int16_t x, int16_t y, const char *
     const char **f = fields;
     int xo = x, yo = y;
     while (*f) {
-        display->drawString(xo, yo, *f);
+        textCache.drawString(display, xo, yo, FONT_SMALL, *f);
         if ((display->getColor() == BLACK) && config.display.heading_bold)
-            display->drawString(xo + 1, yo, *f);
+            textCache.drawString(display, xo + 1, yo, FONT_SMALL, *f);
 
         display->setColor(WHITE);
         yo += FONT_HEIGHT_SMALL;
@@ -584,14 +695,62 @@ static void drawGPSAltitude(OLEDDisplay *display, int16_t x, int16_t y, const GP
         // displayLine = "No GPS Lock";
         // display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(displayLine))) / 2, y, displayLine);
     } else {
-        geoCoord.updateCoords(int32_t(gps->getLatitude()), int32_t(gps->getLongitude()), int32_t(gps->getAltitude()));
-        displayLine = "Altitude: " + String(geoCoord.getAltitude()) + "m";
+        int32_t altitude = gps->getAltitude(); // no need for geoCoord's conversions here
+        displayLine = "Altitude: " + String(altitude) + "m";
         if (config.display.units == meshtastic_Config_DisplayConfig_DisplayUnits_IMPERIAL)
-            displayLine = "Altitude: " + String(geoCoord.getAltitude() * METERS_TO_FEET) + "ft";
+            displayLine = "Altitude: " + String(altitude * METERS_TO_FEET) + "ft";
         display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(displayLine))) / 2, y, displayLine);
     }
 }
 
+/// Our coordinates as drawGPScoordinates() shows them, only converted and formatted again when we move (or the format changes)
+static struct {
+    bool valid = false;
+    int32_t lat, lon;
+    meshtastic_Config_DisplayConfig_GpsCoordinateFormat format;
+    char coordinateLine[22];
+    char latLine[22], lonLine[22]; // for DMS, which takes two
+} coordsCache;
+
+static void formatGPScoordinates(int32_t lat, int32_t lon, meshtastic_Config_DisplayConfig_GpsCoordinateFormat gpsFormat)
+{
+    if (coordsCache.valid && coordsCache.lat == lat && coordsCache.lon == lon && coordsCache.format == gpsFormat)
+        return;
+    coordsCache.valid = true;
+    coordsCache.lat = lat;
+    coordsCache.lon = lon;
+    coordsCache.format = gpsFormat;
+
+    geoCoord.updateCoords(lat, lon, geoCoord.getAltitude());
+
+    char *coordinateLine = coordsCache.coordinateLine;
+    const size_t lineLen = sizeof(coordsCache.coordinateLine);
+    if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_DEC) { // Decimal Degrees
+        snprintf(coordinateLine, lineLen, "%f %f", geoCoord.getLatitude() * 1e-7, geoCoord.getLongitude() * 1e-7);
+    } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_UTM) { // Universal Transverse Mercator
+        snprintf(coordinateLine, lineLen, "%2i%1c %06u %07u", geoCoord.getUTMZone(), geoCoord.getUTMBand(),
+                 geoCoord.getUTMEasting(), geoCoord.getUTMNorthing());
+    } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_MGRS) { // Military Grid Reference System
+        snprintf(coordinateLine, lineLen, "%2i%1c %1c%1c %05u %05u", geoCoord.getMGRSZone(), geoCoord.getMGRSBand(),
+                 geoCoord.getMGRSEast100k(), geoCoord.getMGRSNorth100k(), geoCoord.getMGRSEasting(), geoCoord.getMGRSNorthing());
+    } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_OLC) { // Open Location Code
+        geoCoord.getOLCCode(coordinateLine);
+    } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_OSGR) { // Ordnance Survey Grid Reference
+        if (geoCoord.getOSGRE100k() == 'I' || geoCoord.getOSGRN100k() == 'I') // OSGR is only valid around the UK region
+            snprintf(coordinateLine, lineLen, "%s", "Out of Boundary");
+        else
+            snprintf(coordinateLine, lineLen, "%1c%1c %05u %05u", geoCoord.getOSGRE100k(), geoCoord.getOSGRN100k(),
+                     geoCoord.getOSGREasting(), geoCoord.getOSGRNorthing());
+    } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_DMS) {
+        snprintf(coordsCache.latLine, sizeof(coordsCache.latLine), "%2i° %2i' %2u\" %1c", geoCoord.getDMSLatDeg(),
+                 geoCoord.getDMSLatMin(), geoCoord.getDMSLatSec(), geoCoord.getDMSLatCP());
+        snprintf(coordsCache.lonLine, sizeof(coordsCache.lonLine), "%3i° %2i' %2u\" %1c", geoCoord.getDMSLonDeg(),
+                 geoCoord.getDMSLonMin(), geoCoord.getDMSLonSec(), geoCoord.getDMSLonCP());
+    } else {
+        coordinateLine[0] = '\0';
+    }
+}
+
 // Draw GPS status coordinates
 static void drawGPScoordinates(OLEDDisplay *display, int16_t x, int16_t y, const GPSStatus *gps)
 {
@@ -606,29 +765,10 @@ static void drawGPScoordinates(OLEDDisplay *display, int16_t x, int16_t y, const
         display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(displayLine))) / 2, y, displayLine);
     } else {
 
-        geoCoord.updateCoords(int32_t(gps->getLatitude()), int32_t(gps->getLongitude()), int32_t(gps->getAltitude()));
+        formatGPScoordinates(int32_t(gps->getLatitude()), int32_t(gps->getLongitude()), gpsFormat);
 
         if (gpsFormat != meshtastic_Config_DisplayConfig_GpsCoordinateFormat_DMS) {
-            char coordinateLine[22];
-            if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_DEC) { // Decimal Degrees
-                snprintf(coordinateLine, sizeof(coordinateLine), "%f %f", geoCoord.getLatitude() * 1e-7,
-                         geoCoord.getLongitude() * 1e-7);
-            } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_UTM) { // Universal Transverse Mercator
-                snprintf(coordinateLine, sizeof(coordinateLine), "%2i%1c %06u %07u", geoCoord.getUTMZone(), geoCoord.getUTMBand(),
-                         geoCoord.getUTMEasting(), geoCoord.getUTMNorthing());
-            } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_MGRS) { // Military Grid Reference System
-                snprintf(coordinateLine, sizeof(coordinateLine), "%2i%1c %1c%1c %05u %05u", geoCoord.getMGRSZone(),
-                         geoCoord.getMGRSBand(), geoCoord.getMGRSEast100k(), geoCoord.getMGRSNorth100k(),
-                         geoCoord.getMGRSEasting(), geoCoord.getMGRSNorthing());
-            } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_OLC) { // Open Location Code
-                geoCoord.getOLCCode(coordinateLine);
-            } else if (gpsFormat == meshtastic_Config_DisplayConfig_GpsCoordinateFormat_OSGR) { // Ordnance Survey Grid Reference
-                if (geoCoord.getOSGRE100k() == 'I' || geoCoord.getOSGRN100k() == 'I') // OSGR is only valid around the UK region
-                    snprintf(coordinateLine, sizeof(coordinateLine), "%s", "Out of Boundary");
-                else
-                    snprintf(coordinateLine, sizeof(coordinateLine), "%1c%1c %05u %05u", geoCoord.getOSGRE100k(),
-                             geoCoord.getOSGRN100k(), geoCoord.getOSGREasting(), geoCoord.getOSGRNorthing());
-            }
+            const char *coordinateLine = coordsCache.coordinateLine;
 
             // If fixed position, display text "Fixed GPS" alternating with the coordinates.
             if (config.position.fixed_position) {
@@ -641,12 +781,7 @@ static void drawGPScoordinates(OLEDDisplay *display, int16_t x, int16_t y, const
                 display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(coordinateLine))) / 2, y, coordinateLine);
             }
         } else {
-            char latLine[22];
-            char lonLine[22];
-            snprintf(latLine, sizeof(latLine), "%2i° %2i' %2u\" %1c", geoCoord.getDMSLatDeg(), geoCoord.getDMSLatMin(),
-                     geoCoord.getDMSLatSec(), geoCoord.getDMSLatCP());
-            snprintf(lonLine, sizeof(lonLine), "%3i° %2i' %2u\" %1c", geoCoord.getDMSLonDeg(), geoCoord.getDMSLonMin(),
-                     geoCoord.getDMSLonSec(), geoCoord.getDMSLonCP());
+            const char *latLine = coordsCache.latLine, *lonLine = coordsCache.lonLine;
             display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(latLine))) / 2, y - FONT_HEIGHT_SMALL * 1, latLine);
             display->drawString(x + (SCREEN_WIDTH - (display->getStringWidth(lonLine))) / 2, y, lonLine);
         }
@@ -702,11 +837,17 @@ static void drawLine(OLEDDisplay *d, const Point &p1, const Point &p2)
  * We keep a series of "after you've gone 10 meters, what is your heading since
  * the last reference point?"
  */
-static float estimatedHeading(double lat, double lon)
+static float estimatedHeading(int32_t lat, int32_t lon)
 {
-    static double oldLat, oldLon;
+    static int32_t oldLat, oldLon, lastLat, lastLon;
     static float b;
 
+    // We get asked every frame, but only have to think again once we move
+    if (lat == lastLat && lon == lastLon)
+        return b;
+    lastLat = lat;
+    lastLon = lon;
+
     if (oldLat == 0) {
         // just prepare for next time
         oldLat = lat;
@@ -715,11 +856,11 @@ static float estimatedHeading(double lat, double lon)
         return b;
     }
 
-    float d = GeoCoord::latLongToMeter(oldLat, oldLon, lat, lon);
+    float d = GeoCoord::distanceE7(oldLat, oldLon, lat, lon);
     if (d < 10) // haven't moved enough, just keep current bearing
         return b;
 
-    b = GeoCoord::bearing(oldLat, oldLon, lat, lon);
+    b = GeoCoord::bearingE7(oldLat, oldLon, lat, lon);
     oldLat = lat;
     oldLon = lon;
 
@@ -751,10 +892,57 @@ static uint16_t getCompassDiam(OLEDDisplay *display)
     return diam - 20;
 };
 
-/// We will skip one node - the one for us, so we just blindly loop over all
-/// nodes
-static size_t nodeIndex;
-static int8_t prevFrame = -1;
+/// Our node frames show a window onto the other nodes, most recently heard first: frame firstNodeFrame + i shows the one at
+/// nodeCursor + i (wrapping round).  We skip one node - the one for us
+static uint8_t firstNodeFrame, numNodeFrames;
+static std::atomic<size_t> nodeCursor{0};      // moved on by render(), read by publishSnapshot()
+static NodeNum nodeWindow[SCREEN_NODE_FRAMES]; // what the window shows, so nodes stay put while heard from (and so reordered)
+static std::atomic<bool> nodeWindowStale{true}; // look the window up again, next snapshot
+static bool wasShowingNodeFrame;
+
+/// @return how many node frames setFrames() would make, for numNodes nodes
+static uint8_t countNodeFrames(size_t numNodes)
+{
+    size_t numOthers = numNodes;
+    if (numOthers > 0)
+        numOthers--;
+    return min(numOthers, (size_t)SCREEN_NODE_FRAMES);
+}
+
+/// Find the nodes our window shows now, walking the order once rather than for every frame
+static void fillNodeWindow()
+{
+    nodeWindowStale = false; // before we look, so moving on while we do makes it stale again
+    size_t numNodes = nodeDB.getNumMeshNodes(), numOthers = numNodes ? numNodes - 1 : 0;
+    for (uint8_t i = 0; i < SCREEN_NODE_FRAMES; i++)
+        nodeWindow[i] = 0;
+    if (!numOthers)
+        return;
+
+    size_t cursor = nodeCursor % numOthers;
+    size_t other = 0;
+    for (size_t x = 0; x < numNodes; x++) {
+        NodeNum num = nodeDB.getMeshNodeInOrder(NODE_ORDER_LAST_HEARD, x)->num;
+        if (num == nodeDB.getNodeNum())
+            continue;
+        // Which window frame (if any) this one is for
+        size_t i = (other + numOthers - cursor) % numOthers;
+        if (i < SCREEN_NODE_FRAMES)
+            nodeWindow[i] = num;
+        other++;
+    }
+}
+
+/// Move the window on once we leave the node frames, so next time we come round they show the next nodes
+static void noteCurrentFrame(uint8_t currentFrame)
+{
+    bool showingNodeFrame = currentFrame >= firstNodeFrame && currentFrame < firstNodeFrame + numNodeFrames;
+    if (wasShowingNodeFrame && !showingNodeFrame) {
+        nodeCursor += numNodeFrames;
+        nodeWindowStale = true;
+    }
+    wasShowingNodeFrame = showingNodeFrame;
+}
 
 // Draw the arrow pointing to a node's location
 static void drawNodeHeading(OLEDDisplay *display, int16_t compassX, int16_t compassY, float headingRadian)
@@ -797,26 +985,100 @@ static void drawCompassNorth(OLEDDisplay *display, int16_t compassX, int16_t com
     drawLine(display, N1, N4);
 }
 
-/// Convert an integer GPS coords to a floating point
-#define DegD(i) (i * 1e-7)
+/// What a node frame shows that takes working out, keyed by what it's worked out from - so we only do the trig (and the
+/// formatting) again when the node or we move, and animation frames are just drawing
+struct NodeFrameCache {
+    NodeNum num = 0;
+    int32_t lat = 0, lon = 0, ourLat = 0, ourLon = 0; // 0, 0 for no (valid) position
+    meshtastic_Config_DisplayConfig_DisplayUnits units = meshtastic_Config_DisplayConfig_DisplayUnits_METRIC;
+    bool hasBearing = false;
+    float bearing = 0; // radians from true north, to the node
+    char distStr[20] = "";
+    int signalPercent = -1;
+    char signalStr[20] = "";
+    uint32_t agoSecs = UINT32_MAX;
+    char lastStr[20] = "";
+};
+static NodeFrameCache nodeFrameCaches[SCREEN_NODE_FRAMES];
 
-static void drawNodeInfo(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y)
+static void updateNodeFrameCache(NodeFrameCache &c, const NodeSummary &node, int32_t ourLat, int32_t ourLon)
 {
-    // We only advance our nodeIndex if the frame # has changed - because
-    // drawNodeInfo will be called repeatedly while the frame is shown
-    if (state->currentFrame != prevFrame) {
-        prevFrame = state->currentFrame;
-
-        nodeIndex = (nodeIndex + 1) % nodeDB.getNumMeshNodes();
-        meshtastic_NodeInfoLite *n = nodeDB.getMeshNodeByIndex(nodeIndex);
-        if (n->num == nodeDB.getNodeNum()) {
-            // Don't show our node, just skip to next
-            nodeIndex = (nodeIndex + 1) % nodeDB.getNumMeshNodes();
-            n = nodeDB.getMeshNodeByIndex(nodeIndex);
+    int signalPercent = clamp((int)((node.snr + 10) * 5), 0, 100);
+    if (c.num != node.num || c.signalPercent != signalPercent) {
+        c.signalPercent = signalPercent;
+        snprintf(c.signalStr, sizeof(c.signalStr), "Signal: %d%%", signalPercent);
+    }
+
+    uint32_t agoSecs = secondsSince(node.lastHeard);
+    if (c.num != node.num || c.agoSecs != agoSecs) {
+        c.agoSecs = agoSecs;
+        if (agoSecs < 120) // last 2 mins?
+            snprintf(c.lastStr, sizeof(c.lastStr), "%u seconds ago", agoSecs);
+        else if (agoSecs < 120 * 60) // last 2 hrs
+            snprintf(c.lastStr, sizeof(c.lastStr), "%u minutes ago", agoSecs / 60);
+        else {
+            // Only show hours ago if it's been less than 6 months. Otherwise, we may have bad
+            //   data.
+            if ((agoSecs / 60 / 60) < (hours_in_month * 6)) {
+                snprintf(c.lastStr, sizeof(c.lastStr), "%u hours ago", agoSecs / 60 / 60);
+            } else {
+                snprintf(c.lastStr, sizeof(c.lastStr), "unknown age");
+            }
         }
     }
 
-    meshtastic_NodeInfoLite *node = nodeDB.getMeshNodeByIndex(nodeIndex);
+    bool ourValid = ourLat || ourLon, theirValid = node.lat || node.lon;
+    int32_t lat = node.lat, lon = node.lon;
+    auto units = config.display.units;
+    if (c.num == node.num && c.lat == lat && c.lon == lon && c.ourLat == ourLat && c.ourLon == ourLon && c.units == units &&
+        c.distStr[0])
+        return;
+    c.num = node.num;
+    c.lat = lat;
+    c.lon = lon;
+    c.ourLat = ourLat;
+    c.ourLon = ourLon;
+    c.units = units;
+
+    c.hasBearing = ourValid && theirValid;
+    if (!c.hasBearing) {
+        // might not have location data
+        strncpy(c.distStr, units == meshtastic_Config_DisplayConfig_DisplayUnits_IMPERIAL ? "? mi" : "? km", sizeof(c.distStr));
+        return;
+    }
+
+    float d = node.distance;
+    c.bearing = node.bearing;
+    if (!node.hasDistance) { // a node from the extended tier, work it out ourselves
+        d = GeoCoord::distanceE7(lat, lon, ourLat, ourLon);
+        c.bearing = GeoCoord::bearingE7(ourLat, ourLon, lat, lon);
+    }
+
+    if (units == meshtastic_Config_DisplayConfig_DisplayUnits_IMPERIAL) {
+        if (d < (2 * MILES_TO_FEET))
+            snprintf(c.distStr, sizeof(c.distStr), "%.0f ft", d * METERS_TO_FEET);
+        else
+            snprintf(c.distStr, sizeof(c.distStr), "%.1f mi", d * METERS_TO_FEET / MILES_TO_FEET);
+    } else {
+        if (d < 2000)
+            snprintf(c.distStr, sizeof(c.distStr), "%.0f m", d);
+        else
+            snprintf(c.distStr, sizeof(c.distStr), "%.1f km", d / 1000);
+    }
+}
+
+static void drawNodeInfo(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y)
+{
+    // While sliding in, state is still that of the frame we came from: we are the window's first frame (or its last, if we
+    // came backwards)
+    uint8_t i = 0;
+    if (state->currentFrame >= firstNodeFrame + numNodeFrames)
+        i = numNodeFrames - 1;
+    else if (state->currentFrame >= firstNodeFrame)
+        i = state->currentFrame - firstNodeFrame;
+
+    const ScreenSnapshot &snap = getSnapshot();
+    const NodeSummary &node = snap.nodes[i];
 
     display->setFont(FONT_SMALL);
 
@@ -827,35 +1089,16 @@ static void drawNodeInfo(OLEDDisplay *display, OLEDDisplayUiState *state, int16_
         display->fillRect(0 + x, 0 + y, x + display->getWidth(), y + FONT_HEIGHT_SMALL);
     }
 
-    const char *username = node->has_user ? node->user.long_name : "Unknown Name";
+    const char *username = node.hasUser ? node.longName : "Unknown Name";
 
-    static char signalStr[20];
-    snprintf(signalStr, sizeof(signalStr), "Signal: %d%%", clamp((int)((node->snr + 10) * 5), 0, 100));
+    NodeFrameCache &cache = nodeFrameCaches[i];
+    updateNodeFrameCache(cache, node, snap.ourLat, snap.ourLon);
 
-    uint32_t agoSecs = sinceLastSeen(node);
-    static char lastStr[20];
-    if (agoSecs < 120) // last 2 mins?
-        snprintf(lastStr, sizeof(lastStr), "%u seconds ago", agoSecs);
-    else if (agoSecs < 120 * 60) // last 2 hrs
-        snprintf(lastStr, sizeof(lastStr), "%u minutes ago", agoSecs / 60);
-    else {
-        // Only show hours ago if it's been less than 6 months. Otherwise, we may have bad
-        //   data.
-        if ((agoSecs / 60 / 60) < (hours_in_month * 6)) {
-            snprintf(lastStr, sizeof(lastStr), "%u hours ago", agoSecs / 60 / 60);
-        } else {
-            snprintf(lastStr, sizeof(lastStr), "unknown age");
-        }
-    }
-
-    static char distStr[20];
-    if (config.display.units == meshtastic_Config_DisplayConfig_DisplayUnits_IMPERIAL) {
-        strncpy(distStr, "? mi", sizeof(distStr)); // might not have location data
-    } else {
-        strncpy(distStr, "? km", sizeof(distStr));
-    }
-    meshtastic_NodeInfoLite *ourNode = nodeDB.getMeshNode(nodeDB.getNodeNum());
-    const char *fields[] = {username, distStr, signalStr, lastStr, NULL};
+    // Its age ticks up by itself, but nobody tells us when the node is heard from again - so look at least every 10s
+    uint32_t agoSecs = cache.agoSecs;
+    frameChangesIn(std::min(agoSecs < 120 ? msecUntilNext(agoSecs, 1) : msecUntilNext(agoSecs, agoSecs < 120 * 60 ? 60 : 60 * 60),
+                            (uint32_t)10 * 1000));
+    const char *fields[] = {username, cache.distStr, cache.signalStr, cache.lastStr, NULL};
     int16_t compassX = 0, compassY = 0;
 
     // coordinates for the center of the compass/circle
@@ -868,32 +1111,15 @@ static void drawNodeInfo(OLEDDisplay *display, OLEDDisplayUiState *state, int16_
     }
     bool hasNodeHeading = false;
 
-    if (ourNode && hasValidPosition(ourNode)) {
-        const meshtastic_PositionLite &op = ourNode->position;
-        float myHeading = estimatedHeading(DegD(op.latitude_i), DegD(op.longitude_i));
+    if (snap.ourLat || snap.ourLon) {
+        float myHeading = estimatedHeading(snap.ourLat, snap.ourLon);
         drawCompassNorth(display, compassX, compassY, myHeading);
 
-        if (hasValidPosition(node)) {
+        if (cache.hasBearing) {
             // display direction toward node
             hasNodeHeading = true;
-            const meshtastic_PositionLite &p = node->position;
-            float d =
-                GeoCoord::latLongToMeter(DegD(p.latitude_i), DegD(p.longitude_i), DegD(op.latitude_i), DegD(op.longitude_i));
-
-            if (config.display.units == meshtastic_Config_DisplayConfig_DisplayUnits_IMPERIAL) {
-                if (d < (2 * MILES_TO_FEET))
-                    snprintf(distStr, sizeof(distStr), "%.0f ft", d * METERS_TO_FEET);
-                else
-                    snprintf(distStr, sizeof(distStr), "%.1f mi", d * METERS_TO_FEET / MILES_TO_FEET);
-            } else {
-                if (d < 2000)
-                    snprintf(distStr, sizeof(distStr), "%.0f m", d);
-                else
-                    snprintf(distStr, sizeof(distStr), "%.1f km", d / 1000);
-            }
+            float bearingToOther = cache.bearing;
 
-            float bearingToOther =
-                GeoCoord::bearing(DegD(op.latitude_i), DegD(op.longitude_i), DegD(p.latitude_i), DegD(p.longitude_i));
             // If the top of the compass is a static north then bearingToOther can be drawn on the compass directly
             // If the top of the compass is not a static north we need adjust bearingToOther based on heading
             if (!config.display.compass_north_top)
@@ -913,19 +1139,55 @@ static void drawNodeInfo(OLEDDisplay *display, OLEDDisplayUiState *state, int16_
     if (config.display.displaymode == meshtastic_Config_DisplayConfig_DisplayMode_INVERTED) {
         display->setColor(BLACK);
     }
-    // Must be after distStr is populated
+    // Must be after the cache is up to date
     drawColumns(display, x, y, fields);
 }
 
+#if SCREEN_RENDER_TASK
+/// Keeps our render task off ui and dispdev while we use them from another task (on the render task itself, does nothing)
+class RenderGuard
+{
+    concurrency::Lock *lock;
+
+  public:
+    explicit RenderGuard(Screen *s) : lock(xTaskGetCurrentTaskHandle() != s->renderTask ? s->renderLock : NULL)
+    {
+        if (lock)
+            lock->lock();
+    }
+    ~RenderGuard()
+    {
+        if (lock)
+            lock->unlock();
+    }
+    RenderGuard(const RenderGuard &) = delete;
+    RenderGuard &operator=(const RenderGuard &) = delete;
+};
+#else
+class RenderGuard
+{
+  public:
+    explicit RenderGuard(Screen *) {}
+};
+#endif
+
 Screen::Screen(ScanI2C::DeviceAddress address, meshtastic_Config_DisplayConfig_OledType screenType, OLEDDISPLAY_GEOMETRY geometry)
     : concurrency::OSThread("Screen"), address_found(address), model(screenType), geometry(geometry), cmdQueue(32)
 {
+    setPriority(PRIORITY_UI);
 #if defined(USE_SH1106) || defined(USE_SH1107) || defined(USE_SH1107_128_64)
-    dispdev = new SH1106Wire(address.address, -1, -1, geometry,
-                             (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
+#ifdef USE_SH1106
+    OLEDController controller = OLED_CONTROLLER_SH1106;
+#else
+    OLEDController controller = OLED_CONTROLLER_OTHER; // the SH1107 addresses its RAM differently
+#endif
+    dispdev = new DirtyOLEDWire<SH1106Wire>(address.address, -1, -1, geometry,
+                                            (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE,
+                                            controller);
 #elif defined(USE_SSD1306)
-    dispdev = new SSD1306Wire(address.address, -1, -1, geometry,
-                              (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
+    dispdev = new DirtyOLEDWire<SSD1306Wire>(address.address, -1, -1, geometry,
+                                             (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE,
+                                             OLED_CONTROLLER_SSD1306);
 #elif defined(ST7735_CS) || defined(ILI9341_DRIVER) || defined(ST7789_CS) || defined(RAK14014)
     dispdev = new TFTDisplay(address.address, -1, -1, geometry,
                              (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
@@ -936,18 +1198,21 @@ Screen::Screen(ScanI2C::DeviceAddress address, meshtastic_Config_DisplayConfig_O
     dispdev = new ST7567Wire(address.address, -1, -1, geometry,
                              (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
 #elif ARCH_PORTDUINO
-    if (settingsMap[displayPanel] != no_screen) {
+    if (portduinoSettings.displayPanel != no_screen) {
         LOG_DEBUG("Making TFTDisplay!\n");
         dispdev = new TFTDisplay(address.address, -1, -1, geometry,
                                  (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
     } else {
-        dispdev = new AutoOLEDWire(address.address, -1, -1, geometry,
-                                   (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
+        dispdev = new DirtyOLEDWire<AutoOLEDWire>(address.address, -1, -1, geometry,
+                                                  (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO
+                                                                                            : HW_I2C::I2C_ONE,
+                                                  OLED_CONTROLLER_OTHER);
         isAUTOOled = true;
     }
 #else
-    dispdev = new AutoOLEDWire(address.address, -1, -1, geometry,
-                               (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE);
+    dispdev = new DirtyOLEDWire<AutoOLEDWire>(address.address, -1, -1, geometry,
+                                              (address.port == ScanI2C::I2CPort::WIRE1) ? HW_I2C::I2C_TWO : HW_I2C::I2C_ONE,
+                                              OLED_CONTROLLER_OTHER); // until setup() knows which
     isAUTOOled = true;
 #endif
 
@@ -962,10 +1227,13 @@ Screen::Screen(ScanI2C::DeviceAddress address, meshtastic_Config_DisplayConfig_O
 void Screen::doDeepSleep()
 {
 #ifdef USE_EINK
-    static FrameCallback sleepFrames[] = {drawSleepScreen};
-    static const int sleepFrameCount = sizeof(sleepFrames) / sizeof(sleepFrames[0]);
-    ui->setFrames(sleepFrames, sleepFrameCount);
-    ui->update();
+    {
+        RenderGuard g(this);
+        static FrameCallback sleepFrames[] = {drawSleepScreen};
+        static const int sleepFrameCount = sizeof(sleepFrames) / sizeof(sleepFrames[0]);
+        ui->setFrames(sleepFrames, sleepFrameCount);
+        ui->update();
+    }
 #endif
     setOn(false);
 }
@@ -975,6 +1243,7 @@ void Screen::handleSetOn(bool on)
     if (!useDisplay)
         return;
 
+    RenderGuard g(this); // setOn(false) comes straight here, from wherever
     if (on != screenOn) {
         if (on) {
             LOG_INFO("Turning on screen\n");
@@ -986,6 +1255,7 @@ void Screen::handleSetOn(bool on)
 #endif
             dispdev->displayOn();
             enabled = true;
+            damaged = true;
             setInterval(0); // Draw ASAP
             runASAP = true;
         } else {
@@ -997,6 +1267,7 @@ void Screen::handleSetOn(bool on)
             enabled = false;
         }
         screenOn = on;
+        energyStats.setOn(EnergyStats::SCREEN, on);
     }
 }
 
@@ -1007,8 +1278,14 @@ void Screen::setup()
     useDisplay = true;
 
 #ifdef AutoOLEDWire_h
-    if (isAUTOOled)
-        static_cast<AutoOLEDWire *>(dispdev)->setDetected(model);
+    if (isAUTOOled) {
+        auto *autoOled = static_cast<DirtyOLEDWire<AutoOLEDWire> *>(dispdev);
+        autoOled->setDetected(model);
+        if (model == meshtastic_Config_DisplayConfig_OledType_OLED_SSD1306)
+            autoOled->setController(OLED_CONTROLLER_SSD1306);
+        else if (model == meshtastic_Config_DisplayConfig_OledType_OLED_SH1106)
+            autoOled->setController(OLED_CONTROLLER_SH1106);
+    }
 #endif
 
 #ifdef USE_SH1107_128_64
@@ -1085,7 +1362,7 @@ void Screen::setup()
     serialSinceMsec = millis();
 
 #if ARCH_PORTDUINO
-    if (settingsMap[touchscreenModule]) {
+    if (portduinoSettings.touchscreenModule) {
         touchScreenImpl1 =
             new TouchScreenImpl1(dispdev->getWidth(), dispdev->getHeight(), static_cast<TFTDisplay *>(dispdev)->getTouch);
         touchScreenImpl1->init();
@@ -1113,12 +1390,102 @@ void Screen::forceDisplay()
 {
     // Nasty hack to force epaper updates for 'key' frames.  FIXME, cleanup.
 #ifdef USE_EINK
+    RenderGuard g(this);
     static_cast<EInkDisplay *>(dispdev)->forceDisplay();
 #endif
 }
 
 static uint32_t lastScreenTransition;
 
+/// The last waypoint publishSnapshot() decoded, so it decodes each one only once
+static struct {
+    uint32_t id = 0, rxTime = 0;
+    bool ok = false;
+    char name[sizeof(meshtastic_Waypoint::name)] = "";
+} waypointCache;
+
+/// The short name of node num, "" if we don't know it
+static void copyShortName(char (&out)[sizeof(meshtastic_User::short_name)], NodeNum num)
+{
+    const meshtastic_NodeInfoLite *node = nodeDB.getMeshNode(num);
+    snprintf(out, sizeof(out), "%s", node && node->has_user ? node->user.short_name : "");
+}
+
+void Screen::publishSnapshot()
+{
+#if SCREEN_RENDER_TASK
+    ScreenSnapshot &s = snapshots.edit();
+#else
+    ScreenSnapshot &s = snapshot;
+#endif
+
+    s.numNodes = nodeDB.getNumMeshNodes();
+    const meshtastic_NodeInfoLite *ourNode = nodeDB.getMeshNode(nodeDB.getNodeNum());
+    bool ourValid = ourNode && hasValidPosition(ourNode);
+    s.ourLat = ourValid ? ourNode->position.latitude_i : 0;
+    s.ourLon = ourValid ? ourNode->position.longitude_i : 0;
+
+    if (nodeWindowStale)
+        fillNodeWindow();
+    for (uint8_t i = 0; i < SCREEN_NODE_FRAMES; i++) {
+        NodeSummary &n = s.nodes[i];
+        const meshtastic_NodeInfoLite *node = nodeDB.getMeshNode(nodeWindow[i]);
+        if (!node && s.numNodes) // we just forgot it
+            node = nodeDB.getMeshNodeInOrder(NODE_ORDER_LAST_HEARD, i % s.numNodes);
+        if (!node) {
+            n = NodeSummary();
+            continue;
+        }
+        n.num = node->num;
+        n.hasUser = node->has_user;
+        snprintf(n.longName, sizeof(n.longName), "%s", node->has_user ? node->user.long_name : "");
+        n.snr = node->snr;
+        n.lastHeard = node->last_heard;
+        bool valid = hasValidPosition(node);
+        n.lat = valid ? node->position.latitude_i : 0;
+        n.lon = valid ? node->position.longitude_i : 0;
+        if (valid && positionModule && positionModule->predictPosition(node->num, n.lat, n.lon))
+            n.hasDistance = false; // nodeDB's is to where it last said it was, not where that says it is now
+        else
+            n.hasDistance = valid && ourValid && nodeDB.getDistanceAndBearing(node, n.distance, n.bearing);
+    }
+
+    const meshtastic_MeshPacket &text = devicestate.rx_text_message;
+    s.hasText = devicestate.has_rx_text_message && shouldDrawMessage(&text);
+    if (s.hasText) {
+        s.textRxTime = text.rx_time;
+        copyShortName(s.textFrom, getFrom(&text));
+        snprintf(s.text, sizeof(s.text), "%.*s", (int)text.decoded.payload.size, (const char *)text.decoded.payload.bytes);
+    }
+
+    const meshtastic_MeshPacket &wp = devicestate.rx_waypoint;
+    s.hasWaypoint = devicestate.has_rx_waypoint && shouldDrawMessage(&wp);
+    if (s.hasWaypoint) {
+        if (waypointCache.id != wp.id || waypointCache.rxTime != wp.rx_time) {
+            meshtastic_Waypoint scratch;
+            memset(&scratch, 0, sizeof(scratch));
+            waypointCache.id = wp.id;
+            waypointCache.rxTime = wp.rx_time;
+            waypointCache.ok = pb_decode_from_bytes(wp.decoded.payload.bytes, wp.decoded.payload.size, &meshtastic_Waypoint_msg,
+                                                    &scratch);
+            snprintf(waypointCache.name, sizeof(waypointCache.name), "%s", waypointCache.ok ? scratch.name : "");
+        }
+        s.waypointRxTime = wp.rx_time;
+        copyShortName(s.waypointFrom, getFrom(&wp));
+        s.hasWaypointName = waypointCache.ok;
+        memcpy(s.waypointName, waypointCache.name, sizeof(s.waypointName));
+    }
+
+    {
+        concurrency::LockGuard guard(&debugInfo.lock);
+        snprintf(s.channelName, sizeof(s.channelName), "%s", channels.getPrimaryName());
+    }
+
+#if SCREEN_RENDER_TASK
+    snapshots.publish();
+#endif
+}
+
 int32_t Screen::runOnce()
 {
     // If we don't have a screen, don't ever spend any CPU for us.
@@ -1127,6 +1494,68 @@ int32_t Screen::runOnce()
         return RUN_SAME;
     }
 
+    publishSnapshot();
+#if SCREEN_RENDER_TASK
+    if (!renderTask) {
+        renderLock = new concurrency::Lock();
+        BaseType_t r = xTaskCreatePinnedToCore(renderTaskLoop, "render", SCREEN_RENDER_TASK_STACK, this,
+                                               SCREEN_RENDER_TASK_PRIORITY, &renderTask, SCREEN_RENDER_TASK_CORE);
+        assert(r == pdPASS);
+        LOG_INFO("Screen render task started on core %d\n", SCREEN_RENDER_TASK_CORE);
+    }
+
+    // Our render task says when it wants its next snapshot, once it has drawn this one
+    setInterval(SCREEN_MAX_STATIC_MSEC);
+    xTaskNotifyGive(renderTask);
+    return RUN_SAME;
+#else
+    return render();
+#endif
+}
+
+#if SCREEN_RENDER_TASK
+bool Screen::rendersMeshState()
+{
+    OLEDDisplayUiState *state = ui->getUiState();
+    uint32_t carouselMsec = config.display.auto_screen_carousel_secs * 1000;
+    bool carouselDue = carouselMsec && millis() - lastScreenTransition > carouselMsec;
+    bool nearModuleFrame = showingNormalScreen && !moduleFrames.empty() &&
+                           (state->frameState == IN_TRANSITION || state->currentFrame < moduleFrames.size() || carouselDue);
+    return nearModuleFrame || framesChanged || !cmdQueue.isEmpty();
+}
+
+void Screen::renderTaskLoop(void *screen)
+{
+    Screen *s = (Screen *)screen;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        snapshots.update();
+
+        // Module frames (and setFrames(), and some commands) still read the mesh state directly, so we take packetLock for
+        // those - and always before renderLock, as everyone else who holds both does
+        uint32_t damageCount = s->damageCount;
+        bool needMesh = s->rendersMeshState();
+        if (needMesh)
+            concurrency::packetLock->lock();
+        s->renderLock->lock();
+        meshStateLocked = needMesh;
+        uint32_t sleepMsec = s->render();
+        meshStateLocked = false;
+        s->renderLock->unlock();
+        if (needMesh)
+            concurrency::packetLock->unlock();
+
+        // Have our thread take our next snapshot when we want to draw again (now, if we were told of a change meanwhile)
+        if (s->damageCount != damageCount)
+            sleepMsec = 0;
+        s->setInterval(sleepMsec);
+        s->getDelay().interrupt();
+    }
+}
+#endif
+
+uint32_t Screen::render()
+{
     // Show boot screen for first logo_timeout seconds, then switch to normal operation.
     // serialSinceMsec adjusts for additional serial wait time during nRF52 bootup
     static bool showingBootScreen = true;
@@ -1161,6 +1590,8 @@ int32_t Screen::runOnce()
 
     // Process incoming commands.
     for (;;) {
+        if (!meshStateLocked) // it came after our render task looked, so it's next time's (holding packetLock)
+            break;
         ScreenCmd cmd;
         if (!cmdQueue.dequeue(&cmd, 0)) {
             break;
@@ -1212,6 +1643,12 @@ int32_t Screen::runOnce()
         }
     }
 
+    // What our observers asked for
+    if (meshStateLocked && framesChanged.exchange(false) && showingNormalScreen)
+        setFrames();
+    if (wantFastFramerate.exchange(false) && showingNormalScreen)
+        setFastFramerate();
+
     if (!screenOn) { // If we didn't just wake and the screen is still off, then
                      // stop updating until it is on again
         enabled = false;
@@ -1220,7 +1657,9 @@ int32_t Screen::runOnce()
 
     // this must be before the frameState == FIXED check, because we always
     // want to draw at least one FIXED frame before doing forceDisplay
-    ui->update();
+    uint32_t sleepMsec = governFrames();
+    if (showingNormalScreen)
+        noteCurrentFrame(ui->getUiState()->currentFrame);
 
     // Switch to a low framerate (to save CPU) when we are not in transition
     // but we should only call setTargetFPS when framestate changes, because
@@ -1242,6 +1681,11 @@ int32_t Screen::runOnce()
             LOG_DEBUG("LastScreenTransition exceeded %ums transitioning to next frame\n", (millis() - lastScreenTransition));
             handleOnPress();
         }
+        if (config.display.auto_screen_carousel_secs > 0) {
+            uint32_t sinceTransition = millis() - lastScreenTransition;
+            uint32_t carouselMsec = config.display.auto_screen_carousel_secs * 1000;
+            sleepMsec = std::min(sleepMsec, sinceTransition < carouselMsec ? carouselMsec - sinceTransition : 0);
+        }
     }
 
     // LOG_DEBUG("want fps %d, fixed=%d\n", targetFramerate,
@@ -1249,9 +1693,93 @@ int32_t Screen::runOnce()
     // soon, otherwise just 1 fps (to save CPU) We also ask to be called twice
     // as fast as we really need so that any rounding errors still result with
     // the correct framerate
-    return (1000 / targetFramerate);
+    return sleepMsec;
+}
+
+uint32_t Screen::governFrames()
+{
+    OLEDDisplayUiState *state = ui->getUiState();
+    uint32_t now = millis();
+    const uint32_t idleMsec = 1000 / IDLE_FRAMERATE;
+    bool governing = false;
+#if SCREEN_FRAME_GOVERNOR
+    // Nothing changed, and our frame is still right: sleep until it isn't (or something changes and wakes us)
+    governing = showingNormalScreen && targetFramerate == IDLE_FRAMERATE && state->frameState == FIXED;
+    if (governing && !damaged && now - lastFrameMsec < validMsec)
+        return validMsec - (now - lastFrameMsec);
+#endif
+
+    uint32_t lastUpdate = state->lastUpdate;
+    frameValidMsec = UINT32_MAX;
+    bool wasDamaged = damaged.exchange(false); // before we draw, so a change while we do gets drawn too
+    uint32_t startMicros = micros();
+    ui->update();
+    uint32_t took = micros() - startMicros;
+
+    uint32_t interval = 1000 / targetFramerate;
+    if ((uint32_t)state->lastUpdate == lastUpdate) { // too soon after its last frame for ui, come back when it isn't
+        if (wasDamaged)
+            damaged = true;
+        uint32_t sinceUpdate = now - lastUpdate;
+        return sinceUpdate < interval ? interval - sinceUpdate : 0;
+    }
+
+    // The frames we slept through, which we would have drawn IDLE_FRAMERATE times a second
+    if (governing && lastFrameMsec && now - lastFrameMsec >= 2 * idleMsec)
+        frameStats.skipped += (now - lastFrameMsec) / idleMsec - 1;
+    frameStats.drawn++;
+    frameStats.drawMicros += took;
+    if (inputBroker)
+        inputBroker->noteFrameDrawn(); // which shows what input did
+    lastFrameMsec = now;
+    validMsec = frameValidMsec == UINT32_MAX ? idleMsec : std::min(frameValidMsec, (uint32_t)SCREEN_MAX_STATIC_MSEC);
+
+#if SCREEN_FRAME_GOVERNOR
+    const FrameStats &s = frameStats;
+    if (s.drawn % SCREEN_STATS_EVERY_FRAMES == 0) {
+        uint32_t avgMicros = s.drawMicros / s.drawn;
+        LOG_DEBUG("Screen: drew %u frames (avg %uus), skipped %u, saving about %ums of CPU\n", (unsigned)s.drawn,
+                  (unsigned)avgMicros, (unsigned)s.skipped, (unsigned)((uint64_t)s.skipped * avgMicros / 1000));
+    }
+#endif
+
+    return governing ? validMsec : interval;
+}
+
+#ifdef ARCH_PORTDUINO
+size_t Screen::getBenchmarkFrames(OLEDDisplay *display, BenchmarkFrame *frames, size_t maxFrames)
+{
+    // Our frames lay themselves out for the display setup() found, this one instead
+    displayWidth = display->width();
+    displayHeight = display->height();
+
+    // The node frames come first, as if the benchmark's state were on our frame set
+    firstNodeFrame = 0;
+    numNodeFrames = countNodeFrames(nodeDB.getNumMeshNodes());
+    nodeWindowStale = true;
+    publishSnapshot();
+
+    static const BenchmarkFrame all[] = {
+        {"drawNodeInfo", drawNodeInfo},
+        {"compass", [](OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y) {
+             // Just the rose and the arrow drawNodeInfo() draws, for a node due north east of us while we head east
+             int16_t compassX = x + SCREEN_WIDTH - getCompassDiam(display) / 2 - 5, compassY = y + SCREEN_HEIGHT / 2;
+             drawCompassNorth(display, compassX, compassY, PI / 2);
+             drawNodeHeading(display, compassX, compassY, PI / 4 - PI / 2);
+             display->drawCircle(compassX, compassY, getCompassDiam(display) / 2);
+         }},
+        {"drawTextMessageFrame", drawTextMessageFrame},
+        {"drawFrameFirmware", drawFrameFirmware},
+        {"DebugInfo::drawFrame", drawDebugInfoTrampoline},
+        {"DebugInfo::drawFrameSettings", drawDebugInfoSettingsTrampoline},
+    };
+    size_t n = std::min(maxFrames, sizeof(all) / sizeof(all[0]));
+    for (size_t i = 0; i < n; i++)
+        frames[i] = all[i];
+    return n;
 }
 
+#endif
 void Screen::drawDebugInfoTrampoline(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y)
 {
     Screen *screen2 = reinterpret_cast<Screen *>(state->userData);
@@ -1276,6 +1804,7 @@ void Screen::setSSLFrames()
 {
     if (address_found.address) {
         // LOG_DEBUG("showing SSL frames\n");
+        RenderGuard g(this);
         static FrameCallback sslFrames[] = {drawSSLScreen};
         ui->setFrames(sslFrames, 1);
         ui->update();
@@ -1301,15 +1830,10 @@ void Screen::setFrames()
 
     moduleFrames = MeshModule::GetMeshModulesWithUIFrames();
     LOG_DEBUG("Showing %d module frames\n", moduleFrames.size());
-#ifdef DEBUG_PORT
-    int totalFrameCount = MAX_NUM_NODES + NUM_EXTRA_FRAMES + moduleFrames.size();
-    LOG_DEBUG("Total frame count: %d\n", totalFrameCount);
-#endif
-
-    // We don't show the node info our our node (if we have it yet - we should)
-    size_t numMeshNodes = nodeDB.getNumMeshNodes();
-    if (numMeshNodes > 0)
-        numMeshNodes--;
+    if (moduleFrames.size() > MAX_UI_FRAME_MODULES) {
+        LOG_WARN("Only showing %d of %d module frames\n", MAX_UI_FRAME_MODULES, moduleFrames.size());
+        moduleFrames.resize(MAX_UI_FRAME_MODULES);
+    }
 
     size_t numframes = 0;
 
@@ -1330,18 +1854,20 @@ void Screen::setFrames()
         normalFrames[numframes++] = drawCriticalFaultFrame;
 
     // If we have a text message - show it next, unless it's a phone message and we aren't using any special modules
-    if (devicestate.has_rx_text_message && shouldDrawMessage(&devicestate.rx_text_message)) {
+    const ScreenSnapshot &snap = getSnapshot();
+    if (snap.hasText) {
         normalFrames[numframes++] = drawTextMessageFrame;
     }
     // If we have a waypoint - show it next, unless it's a phone message and we aren't using any special modules
-    if (devicestate.has_rx_waypoint && shouldDrawMessage(&devicestate.rx_waypoint)) {
+    if (snap.hasWaypoint) {
         normalFrames[numframes++] = drawWaypointFrame;
     }
 
-    // then all the nodes
-    // We only show a few nodes in our scrolling list - because meshes with many nodes would have too many screens
-    size_t numToShow = min(numMeshNodes, 4U);
-    for (size_t i = 0; i < numToShow; i++)
+    // then a window onto the nodes (we don't show the node info of our node)
+    // We only show a few nodes at a time - because meshes with many nodes would have too many screens
+    firstNodeFrame = numframes;
+    numNodeFrames = countNodeFrames(snap.numNodes);
+    for (uint8_t i = 0; i < numNodeFrames; i++)
         normalFrames[numframes++] = drawNodeInfo;
 
     // then the debug info
@@ -1365,8 +1891,8 @@ void Screen::setFrames()
     ui->setFrames(normalFrames, numframes);
     ui->enableAllIndicators();
 
-    prevFrame = -1; // Force drawNodeInfo to pick a new node (because our list
-                    // just changed)
+    nodeWindowStale = true; // Force drawNodeInfo to find its nodes again (because our list just changed)
+    wasShowingNodeFrame = false;
 
     setFastFramerate(); // Draw ASAP
 }
@@ -1424,6 +1950,7 @@ void Screen::handleStartFirmwareUpdateScreen()
 
 void Screen::blink()
 {
+    RenderGuard g(this);
     setFastFramerate();
     uint8_t count = 10;
     dispdev->setBrightness(254);
@@ -1508,6 +2035,7 @@ void Screen::setFastFramerate()
 {
     // We are about to start a transition so speed up fps
     targetFramerate = SCREEN_TRANSITION_FRAMERATE;
+    damaged = true;
 
     ui->setTargetFPS(targetFramerate);
     setInterval(0); // redraw ASAP
@@ -1526,12 +2054,7 @@ void DebugInfo::drawFrame(OLEDDisplay *display, OLEDDisplayUiState *state, int16
         display->setColor(BLACK);
     }
 
-    char channelStr[20];
-    {
-        concurrency::LockGuard guard(&lock);
-        auto chName = channels.getPrimaryName();
-        snprintf(channelStr, sizeof(channelStr), "%s", chName);
-    }
+    const char *channelStr = getSnapshot().channelName;
 
     // Display power status
     if (powerStatus->getHasBattery()) {
@@ -1566,7 +2089,8 @@ void DebugInfo::drawFrame(OLEDDisplay *display, OLEDDisplayUiState *state, int16
 
     display->setColor(WHITE);
     // Draw the channel name
-    display->drawString(x, y + FONT_HEIGHT_SMALL, channelStr);
+    textCache.drawString(display, x, y + FONT_HEIGHT_SMALL, FONT_SMALL, channelStr);
+    uint16_t ourIdWidth = textCache.getStringWidth(display, FONT_SMALL, ourId);
     // Draw our hardware ID to assist with bluetooth pairing. Either prefix with Info or S&F Logo
     if (moduleConfig.store_forward.enabled) {
 #ifdef ARCH_ESP32
@@ -1574,24 +2098,18 @@ void DebugInfo::drawFrame(OLEDDisplay *display, OLEDDisplayUiState *state, int16
             (storeForwardModule->heartbeatInterval * 1200)) { // no heartbeat, overlap a bit
 #if (defined(USE_EINK) || defined(ILI9341_DRIVER) || defined(ST7735_CS) || defined(ST7789_CS)) &&                                \
     !defined(DISPLAY_FORCE_SMALL_FONTS)
-            display->drawFastImage(x + SCREEN_WIDTH - 14 - display->getStringWidth(ourId), y + 3 + FONT_HEIGHT_SMALL, 12, 8,
-                                   imgQuestionL1);
-            display->drawFastImage(x + SCREEN_WIDTH - 14 - display->getStringWidth(ourId), y + 11 + FONT_HEIGHT_SMALL, 12, 8,
-                                   imgQuestionL2);
+            display->drawFastImage(x + SCREEN_WIDTH - 14 - ourIdWidth, y + 3 + FONT_HEIGHT_SMALL, 12, 8, imgQuestionL1);
+            display->drawFastImage(x + SCREEN_WIDTH - 14 - ourIdWidth, y + 11 + FONT_HEIGHT_SMALL, 12, 8, imgQuestionL2);
 #else
-            display->drawFastImage(x + SCREEN_WIDTH - 10 - display->getStringWidth(ourId), y + 2 + FONT_HEIGHT_SMALL, 8, 8,
-                                   imgQuestion);
+            display->drawFastImage(x + SCREEN_WIDTH - 10 - ourIdWidth, y + 2 + FONT_HEIGHT_SMALL, 8, 8, imgQuestion);
 #endif
         } else {
 #if (defined(USE_EINK) || defined(ILI9341_DRIVER) || defined(ST7735_CS) || defined(ST7789_CS)) &&                                \
     !defined(DISPLAY_FORCE_SMALL_FONTS)
-            display->drawFastImage(x + SCREEN_WIDTH - 18 - display->getStringWidth(ourId), y + 3 + FONT_HEIGHT_SMALL, 16, 8,
-                                   imgSFL1);
-            display->drawFastImage(x + SCREEN_WIDTH - 18 - display->getStringWidth(ourId), y + 11 + FONT_HEIGHT_SMALL, 16, 8,
-                                   imgSFL2);
+            display->drawFastImage(x + SCREEN_WIDTH - 18 - ourIdWidth, y + 3 + FONT_HEIGHT_SMALL, 16, 8, imgSFL1);
+            display->drawFastImage(x + SCREEN_WIDTH - 18 - ourIdWidth, y + 11 + FONT_HEIGHT_SMALL, 16, 8, imgSFL2);
 #else
-            display->drawFastImage(x + SCREEN_WIDTH - 13 - display->getStringWidth(ourId), y + 2 + FONT_HEIGHT_SMALL, 11, 8,
-                                   imgSF);
+            display->drawFastImage(x + SCREEN_WIDTH - 13 - ourIdWidth, y + 2 + FONT_HEIGHT_SMALL, 11, 8, imgSF);
 #endif
         }
 #endif
@@ -1599,16 +2117,14 @@ void DebugInfo::drawFrame(OLEDDisplay *display, OLEDDisplayUiState *state, int16
         // TODO: Raspberry Pi supports more than just the one screen size
 #if (defined(USE_EINK) || defined(ILI9341_DRIVER) || defined(ST7735_CS) || defined(ST7789_CS) || ARCH_PORTDUINO) &&              \
     !defined(DISPLAY_FORCE_SMALL_FONTS)
-        display->drawFastImage(x + SCREEN_WIDTH - 14 - display->getStringWidth(ourId), y + 3 + FONT_HEIGHT_SMALL, 12, 8,
-                               imgInfoL1);
-        display->drawFastImage(x + SCREEN_WIDTH - 14 - display->getStringWidth(ourId), y + 11 + FONT_HEIGHT_SMALL, 12, 8,
-                               imgInfoL2);
+        display->drawFastImage(x + SCREEN_WIDTH - 14 - ourIdWidth, y + 3 + FONT_HEIGHT_SMALL, 12, 8, imgInfoL1);
+        display->drawFastImage(x + SCREEN_WIDTH - 14 - ourIdWidth, y + 11 + FONT_HEIGHT_SMALL, 12, 8, imgInfoL2);
 #else
-        display->drawFastImage(x + SCREEN_WIDTH - 10 - display->getStringWidth(ourId), y + 2 + FONT_HEIGHT_SMALL, 8, 8, imgInfo);
+        display->drawFastImage(x + SCREEN_WIDTH - 10 - ourIdWidth, y + 2 + FONT_HEIGHT_SMALL, 8, 8, imgInfo);
 #endif
     }
 
-    display->drawString(x + SCREEN_WIDTH - display->getStringWidth(ourId), y + FONT_HEIGHT_SMALL, ourId);
+    textCache.drawString(display, x + SCREEN_WIDTH - ourIdWidth, y + FONT_HEIGHT_SMALL, FONT_SMALL, ourId);
 
     // Draw any log messages
     display->drawLogBuffer(x, y + (FONT_HEIGHT_SMALL * 2));
@@ -1731,16 +2247,17 @@ void DebugInfo::drawFrameSettings(OLEDDisplay *display, OLEDDisplayUiState *stat
             display->drawString(x + 1, y, batStr);
     } else {
         // Line 1
-        display->drawString(x, y, String("USB"));
+        textCache.drawString(display, x, y, FONT_SMALL, "USB");
         if (config.display.heading_bold)
-            display->drawString(x + 1, y, String("USB"));
+            textCache.drawString(display, x + 1, y, FONT_SMALL, "USB");
     }
 
     auto mode = DisplayFormatters::getModemPresetDisplayName(config.lora.modem_preset, true);
+    uint16_t modeWidth = textCache.getStringWidth(display, FONT_SMALL, mode);
 
-    display->drawString(x + SCREEN_WIDTH - display->getStringWidth(mode), y, mode);
+    textCache.drawString(display, x + SCREEN_WIDTH - modeWidth, y, FONT_SMALL, mode);
     if (config.display.heading_bold)
-        display->drawString(x + SCREEN_WIDTH - display->getStringWidth(mode) - 1, y, mode);
+        textCache.drawString(display, x + SCREEN_WIDTH - modeWidth - 1, y, FONT_SMALL, mode);
 
     // Line 2
     uint32_t currentMillis = millis();
@@ -1806,12 +2323,15 @@ int Screen::handleStatusUpdate(const meshtastic::Status *arg)
     // LOG_DEBUG("Screen got status update %d\n", arg->getStatusType());
     switch (arg->getStatusType()) {
     case STATUS_TYPE_NODE:
-        if (showingNormalScreen && nodeStatus->getLastNumTotal() != nodeStatus->getNumTotal()) {
-            setFrames(); // Regen the list of screens
+        // Our node frames are a window onto the nodes, so new nodes only need new frames while we have fewer than it shows
+        if (showingNormalScreen && nodeStatus->getLastNumTotal() != nodeStatus->getNumTotal() &&
+            countNodeFrames(nodeDB.getNumMeshNodes()) != numNodeFrames) {
+            framesChanged = true; // Regen the list of screens
         }
         nodeDB.updateGUI = false;
         break;
     }
+    setDamaged(); // our debug frames show most of what these say
 
     return 0;
 }
@@ -1819,7 +2339,8 @@ int Screen::handleStatusUpdate(const meshtastic::Status *arg)
 int Screen::handleTextMessage(const meshtastic_MeshPacket *packet)
 {
     if (showingNormalScreen) {
-        setFrames(); // Regen the list of screens (will show new text message)
+        framesChanged = true; // Regen the list of screens (will show new text message)
+        setDamaged();
     }
 
     return 0;
@@ -1829,9 +2350,11 @@ int Screen::handleUIFrameEvent(const UIFrameEvent *event)
 {
     if (showingNormalScreen) {
         if (event->frameChanged) {
-            setFrames(); // Regen the list of screens (will show new text message)
+            framesChanged = true; // Regen the list of screens (will show new text message)
+            setDamaged();
         } else if (event->needRedraw) {
-            setFastFramerate();
+            wantFastFramerate = true; // which also tells SCREEN_FRAME_GOVERNOR to redraw
+            setDamaged();
             // TODO: We might also want switch to corresponding frame,
             //       but we don't know the exact frame number.
             // ui->switchToFrame(0);
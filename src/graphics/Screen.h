@@ -45,6 +45,7 @@ class Screen
 // the SH1106/SSD1306 variant is auto-detected
 #include <AutoOLEDWire.h>
 #endif
+#include "DirtyOLEDWire.h"
 
 #include "EInkDisplay2.h"
 #include "TFTDisplay.h"
@@ -55,6 +56,7 @@ class Screen
 #include "input/InputBroker.h"
 #include "mesh/MeshModule.h"
 #include "power.h"
+#include <atomic>
 #include <string>
 
 // 0 to 255, though particular variants might define different defaults
@@ -72,6 +74,58 @@ class Screen
 #define MILES_TO_FEET 5280
 #endif
 
+// How many modules with UI frames (see MeshModule::observeUIEvents()) we can watch
+#ifndef MAX_UI_FRAME_MODULES
+#define MAX_UI_FRAME_MODULES 4
+#endif
+
+// How many node frames we show at once.  They are a window onto our nodes, most recently heard first, which moves on to the
+// next ones each time we leave it - so however many nodes we have, they cost no more frames
+#ifndef SCREEN_NODE_FRAMES
+#define SCREEN_NODE_FRAMES 4
+#endif
+
+// Only redraw when something we show changed (or a frame says its contents change by themselves, like a clock), rather than
+// several times a second whether or not.  Off for e-ink, whose refresh scheduler wants calling regularly
+#ifndef SCREEN_FRAME_GOVERNOR
+#ifdef USE_EINK
+#define SCREEN_FRAME_GOVERNOR 0
+#else
+#define SCREEN_FRAME_GOVERNOR 1
+#endif
+#endif
+
+// With SCREEN_FRAME_GOVERNOR, the longest we leave a frame without redrawing it, for changes nobody tells us about
+#ifndef SCREEN_MAX_STATIC_MSEC
+#define SCREEN_MAX_STATIC_MSEC 30000
+#endif
+
+// With SCREEN_FRAME_GOVERNOR, log what it saved every this many frames drawn
+#ifndef SCREEN_STATS_EVERY_FRAMES
+#define SCREEN_STATS_EVERY_FRAMES 100
+#endif
+
+// Draw our frames from a task of our own, from snapshots of the mesh state they show which our thread takes holding
+// packetLock - so however slow a frame is, the packet task doesn't wait for it.  Needs USE_PACKET_TASK, opt in with
+// -DSCREEN_RENDER_TASK=1 (meant for the ESP32-S3 boards, whose frames are big)
+#ifndef SCREEN_RENDER_TASK
+#define SCREEN_RENDER_TASK 0
+#endif
+
+// On the core loop() runs on (the packet task has the other), at loop()'s priority
+#ifndef SCREEN_RENDER_TASK_CORE
+#define SCREEN_RENDER_TASK_CORE ARDUINO_RUNNING_CORE
+#endif
+
+#ifndef SCREEN_RENDER_TASK_PRIORITY
+#define SCREEN_RENDER_TASK_PRIORITY 1
+#endif
+
+// Module frames draw on it too
+#ifndef SCREEN_RENDER_TASK_STACK
+#define SCREEN_RENDER_TASK_STACK 6144
+#endif
+
 namespace graphics
 {
 
@@ -105,6 +159,9 @@ class DebugInfo
  * @details Other than setup(), this class is thread-safe as long as drawFrame is not called
  *          multiple times simultaneously. All state-changing calls are queued and executed
  *          when the main loop calls us.
+ *
+ *          Our frames draw from a snapshot of what they show (see publishSnapshot()), so with SCREEN_RENDER_TASK our
+ *          thread only takes those and commands, frames and the display are left to our render task.
  */
 class Screen : public concurrency::OSThread
 {
@@ -116,8 +173,8 @@ class Screen : public concurrency::OSThread
         CallbackObserver<Screen, const meshtastic::Status *>(this, &Screen::handleStatusUpdate);
     CallbackObserver<Screen, const meshtastic_MeshPacket *> textMessageObserver =
         CallbackObserver<Screen, const meshtastic_MeshPacket *>(this, &Screen::handleTextMessage);
-    CallbackObserver<Screen, const UIFrameEvent *> uiFrameEventObserver =
-        CallbackObserver<Screen, const UIFrameEvent *>(this, &Screen::handleUIFrameEvent);
+    CallbackObserver<Screen, const UIFrameEvent *, MAX_UI_FRAME_MODULES> uiFrameEventObserver =
+        CallbackObserver<Screen, const UIFrameEvent *, MAX_UI_FRAME_MODULES>(this, &Screen::handleUIFrameEvent);
     CallbackObserver<Screen, const InputEvent *> inputObserver =
         CallbackObserver<Screen, const InputEvent *>(this, &Screen::handleInputEvent);
 
@@ -154,6 +211,23 @@ class Screen : public concurrency::OSThread
 
     void blink();
 
+    /// What SCREEN_FRAME_GOVERNOR has drawn, and not drawn, since boot
+    struct FrameStats {
+        uint32_t drawn = 0;
+        uint32_t skipped = 0;     // IDLE_FRAMERATE frames we would have drawn but for the governor
+        uint64_t drawMicros = 0;  // in ui->update(), for the frames we drew
+    };
+
+    const FrameStats &getFrameStats() const { return frameStats; }
+
+    /// Something we show has changed: redraw soon, even if our frame is static
+    void setDamaged()
+    {
+        damaged = true;
+        damageCount++;
+        wake();
+    }
+
     /// Handle button press, trackball or swipe action)
     void onPress() { enqueueCmd(ScreenCmd{.cmd = Cmd::ON_PRESS}); }
     void showPrevFrame() { enqueueCmd(ScreenCmd{.cmd = Cmd::SHOW_PREV_FRAME}); }
@@ -318,6 +392,18 @@ class Screen : public concurrency::OSThread
 
     void setWelcomeFrames();
 
+#ifdef ARCH_PORTDUINO
+    /// One of the frames our screen benchmark renders (see runScreenBenchmark())
+    struct BenchmarkFrame {
+        const char *name;
+        FrameCallback draw;
+    };
+
+    /// Take a snapshot of the mesh state as our thread would, and put the frames worth timing on display in frames (a node
+    /// frame shows the node at state->currentFrame in the snapshot's window).  @return how many there are
+    size_t getBenchmarkFrames(OLEDDisplay *display, BenchmarkFrame *frames, size_t maxFrames);
+#endif
+
   protected:
     /// Updates the UI.
     //
@@ -327,6 +413,38 @@ class Screen : public concurrency::OSThread
     bool isAUTOOled = false;
 
   private:
+    std::atomic<bool> damaged{true};      // something changed since we last drew
+    std::atomic<uint32_t> damageCount{0}; // how many times setDamaged() has been called
+    uint32_t lastFrameMsec = 0;           // when we last drew
+    uint32_t validMsec = 0;               // how long our frame's contents stay right by themselves, from lastFrameMsec
+    FrameStats frameStats;
+
+    /// Draw if anything changed (or the frame's contents would have), @return how long we could sleep
+    uint32_t governFrames();
+
+    /// Take a snapshot of the mesh state our frames show, for render() to draw from
+    void publishSnapshot();
+
+    /// Run our commands and draw (if need be), @return how long we could sleep
+    uint32_t render();
+
+    /// Set by our observers (which run wherever the mesh does) for render() to do, so only it touches ui
+    std::atomic<bool> framesChanged{false}, wantFastFramerate{false};
+
+#if SCREEN_RENDER_TASK
+    friend class RenderGuard;
+
+    TaskHandle_t renderTask = NULL;
+
+    /// Held by our render task while it renders, and by anything else which uses ui or dispdev once the task is running
+    concurrency::Lock *renderLock = NULL;
+
+    /// Will render() draw (or run) anything which reads the mesh state directly, so it needs packetLock
+    bool rendersMeshState();
+
+    static void renderTaskLoop(void *screen);
+#endif
+
     struct ScreenCmd {
         Cmd cmd;
         union {
@@ -343,6 +461,7 @@ class Screen : public concurrency::OSThread
         else {
             bool success = cmdQueue.enqueue(cmd, 0);
             enabled = true; // handle ASAP (we are the registered reader for cmdQueue, but might have been disabled)
+            setDamaged();   // and don't sleep through it, if our frame is static
             return success;
         }
     }
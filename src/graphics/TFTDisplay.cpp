@@ -114,6 +114,7 @@ static LGFX *tft = nullptr;
 
 #elif defined(RAK14014)
 #include <TFT_eSPI.h>
+#define TFT_PUSH_ESPI // no pushPixelsDMA() unless we set TFT_eSPI's DMA up, so we push without it
 TFT_eSPI *tft = nullptr;
 
 #elif defined(ST7789_CS)
@@ -333,6 +334,7 @@ static LGFX *tft = nullptr;
 
 #elif defined(ST7735_CS)
 #include <TFT_eSPI.h> // Graphics and font library for ILI9341 driver chip
+#define TFT_PUSH_ESPI
 
 static TFT_eSPI *tft = nullptr; // Invoke library, pins defined in User_Setup.h
 #elif ARCH_PORTDUINO
@@ -348,50 +350,50 @@ class LGFX : public lgfx::LGFX_Device
   public:
     LGFX(void)
     {
-        if (settingsMap[displayPanel] == st7789)
+        if (portduinoSettings.displayPanel == st7789)
             _panel_instance = new lgfx::Panel_ST7789;
-        else if (settingsMap[displayPanel] == st7735)
+        else if (portduinoSettings.displayPanel == st7735)
             _panel_instance = new lgfx::Panel_ST7735;
-        else if (settingsMap[displayPanel] == st7735s)
+        else if (portduinoSettings.displayPanel == st7735s)
             _panel_instance = new lgfx::Panel_ST7735S;
-        else if (settingsMap[displayPanel] == ili9341)
+        else if (portduinoSettings.displayPanel == ili9341)
             _panel_instance = new lgfx::Panel_ILI9341;
         auto buscfg = _bus_instance.config();
         buscfg.spi_mode = 0;
 
-        buscfg.pin_dc = settingsMap[displayDC]; // Set SPI DC pin number (-1 = disable)
+        buscfg.pin_dc = portduinoSettings.displayDC; // Set SPI DC pin number (-1 = disable)
 
         _bus_instance.config(buscfg);            // applies the set value to the bus.
         _panel_instance->setBus(&_bus_instance); // set the bus on the panel.
 
         auto cfg = _panel_instance->config(); // Gets a structure for display panel settings.
-        LOG_DEBUG("Height: %d, Width: %d \n", settingsMap[displayHeight], settingsMap[displayWidth]);
-        cfg.pin_cs = settingsMap[displayCS]; // Pin number where CS is connected (-1 = disable)
-        cfg.pin_rst = settingsMap[displayReset];
-        cfg.panel_width = settingsMap[displayWidth];   // actual displayable width
-        cfg.panel_height = settingsMap[displayHeight]; // actual displayable height
-        cfg.offset_x = settingsMap[displayOffsetX];    // Panel offset amount in X direction
-        cfg.offset_y = settingsMap[displayOffsetY];    // Panel offset amount in Y direction
-        cfg.offset_rotation = 0;                       // Rotation direction value offset 0~7 (4~7 is mirrored)
-        cfg.invert = settingsMap[displayInvert];       // Set to true if the light/darkness of the panel is reversed
+        LOG_DEBUG("Height: %d, Width: %d \n", portduinoSettings.displayHeight, portduinoSettings.displayWidth);
+        cfg.pin_cs = portduinoSettings.displayCS; // Pin number where CS is connected (-1 = disable)
+        cfg.pin_rst = portduinoSettings.displayReset;
+        cfg.panel_width = portduinoSettings.displayWidth;   // actual displayable width
+        cfg.panel_height = portduinoSettings.displayHeight; // actual displayable height
+        cfg.offset_x = portduinoSettings.displayOffsetX;    // Panel offset amount in X direction
+        cfg.offset_y = portduinoSettings.displayOffsetY;    // Panel offset amount in Y direction
+        cfg.offset_rotation = 0;                            // Rotation direction value offset 0~7 (4~7 is mirrored)
+        cfg.invert = portduinoSettings.displayInvert;       // Set to true if the light/darkness of the panel is reversed
 
         _panel_instance->config(cfg);
 
         // Configure settings for touch  control.
-        if (settingsMap[touchscreenModule]) {
-            if (settingsMap[touchscreenModule] == xpt2046) {
+        if (portduinoSettings.touchscreenModule) {
+            if (portduinoSettings.touchscreenModule == xpt2046) {
                 _touch_instance = new lgfx::Touch_XPT2046;
-            } else if (settingsMap[touchscreenModule] == stmpe610) {
+            } else if (portduinoSettings.touchscreenModule == stmpe610) {
                 _touch_instance = new lgfx::Touch_STMPE610;
             }
             auto touch_cfg = _touch_instance->config();
 
-            touch_cfg.pin_cs = settingsMap[touchscreenCS];
+            touch_cfg.pin_cs = portduinoSettings.touchscreenCS;
             touch_cfg.x_min = 0;
-            touch_cfg.x_max = settingsMap[displayHeight] - 1;
+            touch_cfg.x_max = portduinoSettings.displayHeight - 1;
             touch_cfg.y_min = 0;
-            touch_cfg.y_max = settingsMap[displayWidth] - 1;
-            touch_cfg.pin_int = settingsMap[touchscreenIRQ];
+            touch_cfg.y_max = portduinoSettings.displayWidth - 1;
+            touch_cfg.pin_int = portduinoSettings.touchscreenIRQ;
             touch_cfg.bus_shared = true;
             touch_cfg.offset_rotation = 1;
 
@@ -409,16 +411,19 @@ static LGFX *tft = nullptr;
 #if defined(ST7735_CS) || defined(ST7789_CS) || defined(ILI9341_DRIVER) || defined(RAK14014) || ARCH_PORTDUINO
 #include "SPILock.h"
 #include "TFTDisplay.h"
+#include "memGet.h"
 #include <SPI.h>
+#include <assert.h>
+#include <string.h>
 
 TFTDisplay::TFTDisplay(uint8_t address, int sda, int scl, OLEDDISPLAY_GEOMETRY geometry, HW_I2C i2cBus)
 {
     LOG_DEBUG("TFTDisplay!\n");
 #if ARCH_PORTDUINO
-    if (settingsMap[displayRotate]) {
-        setGeometry(GEOMETRY_RAWMODE, settingsMap[configNames::displayHeight], settingsMap[configNames::displayWidth]);
+    if (portduinoSettings.displayRotate) {
+        setGeometry(GEOMETRY_RAWMODE, portduinoSettings.displayHeight, portduinoSettings.displayWidth);
     } else {
-        setGeometry(GEOMETRY_RAWMODE, settingsMap[configNames::displayWidth], settingsMap[configNames::displayHeight]);
+        setGeometry(GEOMETRY_RAWMODE, portduinoSettings.displayWidth, portduinoSettings.displayHeight);
     }
 
 #elif defined(SCREEN_ROTATE)
@@ -428,49 +433,231 @@ TFTDisplay::TFTDisplay(uint8_t address, int sda, int scl, OLEDDISPLAY_GEOMETRY g
 #endif
 }
 
+/// Changed pixels closer together than this on a row go out as one span, setting a window costs about this many pixels
+#ifndef TFT_SPAN_MERGE_GAP
+#define TFT_SPAN_MERGE_GAP 6
+#endif
+
+/// Log what our frames cost every this many of them (0 for never)
+#ifndef TFT_STATS_EVERY_FRAMES
+#define TFT_STATS_EVERY_FRAMES 100
+#endif
+
+/// What setting a window costs on the bus: CASET, RASET and RAMWR with their arguments
+#define TFT_WINDOW_BYTES 11
+
+/// Our 1bpp buffer's two colors in RGB565
+static const uint16_t palette[2] = {TFT_BLACK, TFT_MESH};
+
+/// Room for two rows of RGB565, so we can fill one while the other is still going out by DMA
+static uint16_t *spanPixels;
+static bool spanHalf;
+
+static TFTDisplay::FrameStats frameStats;
+
+const TFTDisplay::FrameStats &TFTDisplay::getFrameStats()
+{
+    return frameStats;
+}
+
+/// Send pixels x to x + w - 1 of row y of page (the buffer rows y is in), @return the bytes that cost on the bus
+static uint32_t pushSpan(const uint8_t *page, uint16_t x, uint16_t y, uint16_t w, uint16_t displayWidth)
+{
+    uint16_t *pixels = spanPixels + (spanHalf ? displayWidth : 0);
+    spanHalf = !spanHalf;
+
+    uint8_t bit = y & 7;
+    for (uint16_t i = 0; i < w; i++)
+        pixels[i] = palette[(page[x + i] >> bit) & 1];
+
+    tft->setAddrWindow(x, y, w, 1);
+#ifdef TFT_PUSH_ESPI
+    tft->pushPixels(pixels, w);
+#else
+    tft->pushPixelsDMA(pixels, w); // waits for the span before, which used the other half of spanPixels
+#endif
+    return TFT_WINDOW_BYTES + 2 * w;
+}
+
+/// Send the spans of row y which differ between page and before (NULL if the panel is blank), @return the bytes that cost
+static uint32_t pushDirtySpans(const uint8_t *page, const uint8_t *before, uint16_t y, uint16_t displayWidth)
+{
+    uint8_t mask = 1 << (y & 7);
+    uint32_t bytes = 0;
+    uint16_t x = 0;
+    for (;;) {
+        while (x < displayWidth && !((page[x] ^ (before ? before[x] : 0)) & mask))
+            x++;
+        if (x == displayWidth)
+            return bytes;
+
+        // Take in what changes next along the row, as long as the gap to it is small
+        uint16_t start = x, end = x + 1;
+        for (x++; x < displayWidth && x - end <= TFT_SPAN_MERGE_GAP; x++)
+            if ((page[x] ^ (before ? before[x] : 0)) & mask)
+                end = x + 1;
+
+        bytes += pushSpan(page, start, y, end - start, displayWidth);
+        x = end;
+    }
+}
+
+#if TFT_PUSH_TASK
+/// The last frame display() gave us, and the one our push task is sending (display() never has to wait for a push)
+static uint8_t *pendingFrame, *sendingFrame;
+static bool hasPendingFrame, pendingFromBlank;
+static concurrency::Lock *pendingLock;
+
+/// Held by our push task while it sends a frame, and by anything else which uses tft once the task is running
+static concurrency::Lock *panelLock;
+static TaskHandle_t pushTask;
+
+void TFTDisplay::pushTaskLoop(void *display)
+{
+    TFTDisplay *d = (TFTDisplay *)display;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        pendingLock->lock();
+        bool has = hasPendingFrame, fromBlank = pendingFromBlank;
+        if (has) {
+            uint8_t *f = sendingFrame;
+            sendingFrame = pendingFrame;
+            pendingFrame = f;
+            hasPendingFrame = pendingFromBlank = false;
+        }
+        pendingLock->unlock();
+
+        if (has) {
+            panelLock->lock();
+            d->pushFrame(sendingFrame, fromBlank);
+            panelLock->unlock();
+        }
+    }
+}
+#endif
+
+/// Keeps our push task off the panel while we use tft
+class PanelGuard
+{
+  public:
+    PanelGuard()
+    {
+#if TFT_PUSH_TASK
+        if (panelLock)
+            panelLock->lock();
+#endif
+    }
+    ~PanelGuard()
+    {
+#if TFT_PUSH_TASK
+        if (panelLock)
+            panelLock->unlock();
+#endif
+    }
+};
+
 // Write the buffer to the display memory
 void TFTDisplay::display(bool fromBlank)
 {
-    if (fromBlank)
+#if TFT_PUSH_TASK
+    size_t frameBytes = displayWidth * (displayHeight / 8);
+    if (!pushTask) {
+        pendingFrame = static_cast<uint8_t *>(memGet.place(HEAP_SITE_SCREEN, frameBytes));
+        sendingFrame = static_cast<uint8_t *>(memGet.place(HEAP_SITE_SCREEN, frameBytes));
+        assert(pendingFrame && sendingFrame);
+        pendingLock = new concurrency::Lock();
+        panelLock = new concurrency::Lock();
+        BaseType_t r = xTaskCreate(pushTaskLoop, "tft", TFT_PUSH_TASK_STACK, this, TFT_PUSH_TASK_PRIORITY, &pushTask);
+        assert(r == pdPASS);
+    }
+
+    pendingLock->lock();
+    memcpy(pendingFrame, buffer, frameBytes);
+    hasPendingFrame = true;
+    pendingFromBlank |= fromBlank; // even if the blanked frame itself gets skipped
+    pendingLock->unlock();
+    xTaskNotifyGive(pushTask);
+#else
+    pushFrame(buffer, fromBlank);
+#endif
+}
+
+void TFTDisplay::pushFrame(const uint8_t *frame, bool fromBlank)
+{
+    uint32_t startMicros = micros();
+    uint32_t bytes = 0;
+    if (fromBlank) {
         tft->fillScreen(TFT_BLACK);
+        bytes += TFT_WINDOW_BYTES + 2 * displayWidth * displayHeight;
+    }
     // tft->clear();
-    concurrency::LockGuard g(spiLock);
-
-    uint16_t x, y;
-
-    for (y = 0; y < displayHeight; y++) {
-        for (x = 0; x < displayWidth; x++) {
-            auto isset = buffer[x + (y / 8) * displayWidth] & (1 << (y & 7));
-            if (!fromBlank) {
-                // get src pixel in the page based ordering the OLED lib uses FIXME, super inefficent
-                auto dblbuf_isset = buffer_back[x + (y / 8) * displayWidth] & (1 << (y & 7));
-                if (isset != dblbuf_isset) {
-                    tft->drawPixel(x, y, isset ? TFT_MESH : TFT_BLACK);
-                }
-            } else if (isset) {
-                tft->drawPixel(x, y, TFT_MESH);
-            }
-        }
+    SPIGuard g(SPI_CLIENT_DISPLAY);
+
+    if (!spanPixels) {
+        spanPixels = (uint16_t *)memGet.place(HEAP_SITE_SCREEN, 2 * displayWidth * sizeof(uint16_t), false, MEM_REGION_DMA);
+        assert(spanPixels);
     }
-    // Copy the Buffer to the Back Buffer
-    for (y = 0; y < (displayHeight / 8); y++) {
-        for (x = 0; x < displayWidth; x++) {
-            uint16_t pos = x + y * displayWidth;
-            buffer_back[pos] = buffer[pos];
+#ifdef TFT_PUSH_ESPI
+    bool swapBytes = tft->getSwapBytes();
+    tft->setSwapBytes(true); // our pixels are native uint16_t
+#endif
+
+    // The buffer is in pages of 8 rows (one byte a column), so we find which rows of a page changed at all in one pass
+    for (uint16_t p = 0; p * 8 < displayHeight; p++) {
+        const uint8_t *page = frame + p * displayWidth;
+        const uint8_t *before = fromBlank ? NULL : buffer_back + p * displayWidth;
+        uint8_t dirtyRows = 0;
+        for (uint16_t x = 0; x < displayWidth; x++)
+            dirtyRows |= page[x] ^ (before ? before[x] : 0);
+
+        for (uint16_t y = p * 8; dirtyRows && y < p * 8 + 8 && y < displayHeight; y++) {
+            if (!(dirtyRows & (1 << (y & 7))))
+                continue;
+            spiArbiter->yieldToRadio(SPI_CLIENT_DISPLAY); // a row at a time, so the radio never waits for a whole frame
+            tft->startWrite();
+            bytes += pushDirtySpans(page, before, y, displayWidth);
+#ifndef TFT_PUSH_ESPI
+            tft->waitDMA();
+#endif
+            tft->endWrite();
         }
     }
+
+#ifdef TFT_PUSH_ESPI
+    tft->setSwapBytes(swapBytes);
+#endif
+    // What's on the panel now
+    memcpy(buffer_back, frame, displayWidth * (displayHeight / 8));
+
+    uint32_t took = micros() - startMicros;
+    frameStats.frames++;
+    frameStats.lastMicros = took;
+    frameStats.totalMicros += took;
+    if (took > frameStats.maxMicros)
+        frameStats.maxMicros = took;
+    frameStats.lastBytes = bytes;
+    frameStats.totalBytes += bytes;
+#if TFT_STATS_EVERY_FRAMES
+    if (frameStats.frames % TFT_STATS_EVERY_FRAMES == 0)
+        LOG_DEBUG("TFT frames=%u avg=%uus max=%uus avg_spi_bytes=%u\n", (unsigned)frameStats.frames,
+                  (unsigned)(frameStats.totalMicros / frameStats.frames), (unsigned)frameStats.maxMicros,
+                  (unsigned)(frameStats.totalBytes / frameStats.frames));
+#endif
 }
 
 // Send a command to the display (low level function)
 void TFTDisplay::sendCommand(uint8_t com)
 {
+    PanelGuard g;
+
     // handle display on/off directly
     switch (com) {
     case DISPLAYON: {
 #if ARCH_PORTDUINO
         display(true);
-        if (settingsMap[displayBacklight] > 0)
-            digitalWrite(settingsMap[displayBacklight], TFT_BACKLIGHT_ON);
+        if (portduinoSettings.displayBacklight > 0)
+            digitalWrite(portduinoSettings.displayBacklight, TFT_BACKLIGHT_ON);
 #elif defined(ST7735_BACKLIGHT_EN_V03) && defined(TFT_BACKLIGHT_ON)
         if (heltec_version == 3) {
             digitalWrite(ST7735_BACKLIGHT_EN_V03, TFT_BACKLIGHT_ON);
@@ -501,8 +688,8 @@ void TFTDisplay::sendCommand(uint8_t com)
     case DISPLAYOFF: {
 #if ARCH_PORTDUINO
         tft->clear();
-        if (settingsMap[displayBacklight] > 0)
-            digitalWrite(settingsMap[displayBacklight], !TFT_BACKLIGHT_ON);
+        if (portduinoSettings.displayBacklight > 0)
+            digitalWrite(portduinoSettings.displayBacklight, !TFT_BACKLIGHT_ON);
 #elif defined(ST7735_BACKLIGHT_EN_V03) && defined(TFT_BACKLIGHT_ON)
         if (heltec_version == 3) {
             digitalWrite(ST7735_BACKLIGHT_EN_V03, !TFT_BACKLIGHT_ON);
@@ -540,6 +727,7 @@ void TFTDisplay::flipScreenVertically()
 {
 #if defined(T_WATCH_S3)
     LOG_DEBUG("Flip TFT vertically\n"); // T-Watch S3 right-handed orientation
+    PanelGuard g;
     tft->setRotation(0);
 #endif
 }
@@ -558,6 +746,7 @@ bool TFTDisplay::getTouch(int16_t *x, int16_t *y)
 {
 #ifdef RAK14014
 #elif !defined(M5STACK)
+    PanelGuard g;
     return tft->getTouch(x, y);
 #else
     return false;
@@ -572,7 +761,7 @@ void TFTDisplay::setDetected(uint8_t detected)
 // Connect to the display
 bool TFTDisplay::connect()
 {
-    concurrency::LockGuard g(spiLock);
+    SPIGuard g(SPI_CLIENT_DISPLAY);
     LOG_INFO("Doing TFT init\n");
 #ifdef RAK14014
     tft = new TFT_eSPI;
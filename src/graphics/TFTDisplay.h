@@ -2,11 +2,33 @@
 
 #include <OLEDDisplay.h>
 
+/// Push frames to the panel from a task of our own (ESP32 only), so display() only copies the frame.  Screen runs holding
+/// packetLock, so otherwise the packet task waits for every frame to go out over SPI
+#ifndef TFT_PUSH_TASK
+#ifdef ARCH_ESP32
+#define TFT_PUSH_TASK 1
+#else
+#define TFT_PUSH_TASK 0
+#endif
+#endif
+
+/// loop()'s priority, below the packet task so pushing a frame never keeps the radio waiting
+#ifndef TFT_PUSH_TASK_PRIORITY
+#define TFT_PUSH_TASK_PRIORITY 1
+#endif
+
+#ifndef TFT_PUSH_TASK_STACK
+#define TFT_PUSH_TASK_STACK 4096
+#endif
+
 /**
  * An adapter class that allows using the LovyanGFX library as if it was an OLEDDisplay implementation.
  *
+ * display() only sends the rows which changed since the last frame, each as a few spans of RGB565 (one window apiece).
+ * With TFT_PUSH_TASK it just hands the frame to our push task, which sends the latest frame it has been given whenever it
+ * gets to it (so if Screen draws faster than the panel takes them, the frames in between are skipped rather than queued).
+ *
  * Remaining TODO:
- * optimize display() to only draw changed pixels (see other OLED subclasses for examples)
  * Use the fast NRF52 SPI API rather than the slow standard arduino version
  *
  * turn radio back on - currently with both on spi bus is fucked? or are we leaving chip select asserted?
@@ -14,6 +36,17 @@
 class TFTDisplay : public OLEDDisplay
 {
   public:
+    /// What pushing our frames to the panel has cost
+    struct FrameStats {
+        uint32_t frames = 0;
+        uint32_t lastMicros = 0, maxMicros = 0;
+        uint64_t totalMicros = 0;
+        uint32_t lastBytes = 0; // on the SPI bus (commands and pixels), roughly
+        uint64_t totalBytes = 0;
+    };
+
+    static const FrameStats &getFrameStats();
+
     /* constructor
     FIXME - the parameters are not used, just a temporary hack to keep working like the old displays
     */
@@ -45,4 +78,12 @@ class TFTDisplay : public OLEDDisplay
 
     // Connect to the display
     virtual bool connect() override;
+
+  private:
+    /// Send what differs between frame and buffer_back (or all of frame if the panel is blank) to the panel
+    void pushFrame(const uint8_t *frame, bool fromBlank);
+
+#if TFT_PUSH_TASK
+    static void pushTaskLoop(void *display);
+#endif
 };
\ No newline at end of file
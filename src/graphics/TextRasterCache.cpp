@@ -0,0 +1,113 @@
+#include "configuration.h"
+
+#if HAS_SCREEN
+#include "TextRasterCache.h"
+#include <string.h>
+
+#if TEXT_RASTER_CACHE
+/// A display with nothing behind it, for rendering strings into its buffer
+class TextRasterCache::ScratchDisplay : public OLEDDisplay
+{
+  public:
+    ScratchDisplay() { setGeometry(GEOMETRY_RAWMODE, TEXT_RASTER_MAX_WIDTH, TEXT_RASTER_MAX_HEIGHT); }
+
+    const uint8_t *getBuffer() const { return buffer; }
+
+    virtual void display() override {}
+
+  protected:
+    virtual int getBufferOffset() override { return 0; }
+    virtual void sendCommand(uint8_t com) override {}
+    virtual bool connect() override { return true; }
+};
+#endif
+
+TextRasterCache::Entry *TextRasterCache::find(const uint8_t *font, const char *s)
+{
+#if TEXT_RASTER_CACHE
+    if (strlen(s) > TEXT_RASTER_MAX_LEN || strchr(s, '\n'))
+        return NULL;
+
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (const char *c = s; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+    useCount++;
+    Entry *oldest = &entries[0];
+    for (Entry &e : entries) {
+        if (e.font == font && e.hash == hash && strcmp(e.text, s) == 0) {
+            e.lastUse = useCount;
+            numHits++;
+            return &e;
+        }
+        if (!e.font || (oldest->font && e.lastUse < oldest->lastUse))
+            oldest = &e; // an empty one, or else the one drawn longest ago
+    }
+
+    numMisses++;
+    if (!render(*oldest, font, s, hash))
+        return NULL;
+    oldest->lastUse = useCount;
+    return oldest;
+#else
+    return NULL;
+#endif
+}
+
+bool TextRasterCache::render(Entry &e, const uint8_t *font, const char *s, uint32_t hash)
+{
+#if TEXT_RASTER_CACHE
+    if (!scratch) {
+        scratch = new ScratchDisplay();
+        if (!scratch->init()) {
+            delete scratch;
+            scratch = NULL;
+            return false;
+        }
+        scratch->setFontTableLookupFunction(fontTableLookup);
+    }
+    scratch->setFont(font);
+    scratch->setTextAlignment(TEXT_ALIGN_LEFT);
+    scratch->setColor(WHITE);
+
+    e.font = font;
+    e.hash = hash;
+    strcpy(e.text, s);
+    e.width = scratch->getStringWidth(s);
+    e.height = font[1] + 1; // height is position 1
+    e.raster.clear();
+    if (!e.width || e.width > TEXT_RASTER_MAX_WIDTH || e.height > TEXT_RASTER_MAX_HEIGHT)
+        return true; // we still know its width, but it's drawn the usual way
+
+    scratch->clear();
+    scratch->drawString(0, 0, s);
+
+    // The display buffer is a row of pages (8 pixels high, a byte a column), drawFastImage() wants the pages column by column
+    const uint8_t *buf = scratch->getBuffer();
+    uint8_t pages = (e.height + 7) / 8;
+    e.raster.resize(e.width * pages);
+    for (uint16_t x = 0; x < e.width; x++)
+        for (uint8_t p = 0; p < pages; p++)
+            e.raster[x * pages + p] = buf[x + p * TEXT_RASTER_MAX_WIDTH];
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TextRasterCache::drawString(OLEDDisplay *display, int16_t x, int16_t y, const uint8_t *font, const char *s)
+{
+    Entry *e = find(font, s);
+    if (e && !e->raster.empty())
+        display->drawFastImage(x, y, e->width, e->height, e->raster.data());
+    else
+        display->drawString(x, y, s);
+}
+
+uint16_t TextRasterCache::getStringWidth(OLEDDisplay *display, const uint8_t *font, const char *s)
+{
+    Entry *e = find(font, s);
+    return e ? e->width : display->getStringWidth(s);
+}
+
+#endif
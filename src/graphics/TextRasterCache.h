@@ -0,0 +1,75 @@
+#pragma once
+
+#include "configuration.h"
+#include <OLEDDisplay.h>
+#include <stdint.h>
+#include <vector>
+
+/// Keep the strings our frames draw again and again rendered, so drawing one is one blit rather than a glyph at a time
+#ifndef TEXT_RASTER_CACHE
+#define TEXT_RASTER_CACHE 1
+#endif
+
+/// How many strings we keep rendered, the one drawn longest ago makes room for a new one
+#ifndef TEXT_RASTER_CACHE_ENTRIES
+#define TEXT_RASTER_CACHE_ENTRIES 16
+#endif
+
+/// Longer strings (in bytes, or pixels wide or high) are drawn the usual way
+#define TEXT_RASTER_MAX_LEN 31
+#ifndef TEXT_RASTER_MAX_WIDTH
+#define TEXT_RASTER_MAX_WIDTH 128
+#endif
+#define TEXT_RASTER_MAX_HEIGHT 32
+
+/**
+ * Strings rendered once and kept, keyed by font and text, for the labels our frames draw every tick: what OLEDDisplay's
+ * drawString() does a glyph at a time (looking each one up in the font's jump table on the way) becomes one
+ * drawFastImage() of the whole run, and the width is worked out once rather than by getStringWidth() on every frame.
+ *
+ * A string is rendered into a scratch display of our own (with the same font table lookup as the real one), and its pixels
+ * kept column by column, as drawFastImage() takes them - so they are drawn in the display's current colour, like the text
+ * would be.  Strings which change all the time (the time, our uptime) are better drawn the usual way, they would only push
+ * the labels out.
+ */
+class TextRasterCache
+{
+  public:
+    explicit TextRasterCache(FontTableLookupFunction lookup) : fontTableLookup(lookup) {}
+
+    /// Draw s in font (the display's current font) at x, y, as display->drawString() would with TEXT_ALIGN_LEFT
+    void drawString(OLEDDisplay *display, int16_t x, int16_t y, const uint8_t *font, const char *s);
+
+    /// @return display->getStringWidth(s) in font (the display's current font)
+    uint16_t getStringWidth(OLEDDisplay *display, const uint8_t *font, const char *s);
+
+    uint32_t getNumHits() const { return numHits; }
+    uint32_t getNumMisses() const { return numMisses; }
+
+  private:
+    struct Entry {
+        const uint8_t *font = NULL; // NULL for an empty entry
+        uint32_t hash = 0;
+        uint32_t lastUse = 0;
+        uint16_t width = 0, height = 0;
+        char text[TEXT_RASTER_MAX_LEN + 1] = "";
+        std::vector<uint8_t> raster; // width * ceil(height / 8) bytes, a column at a time
+    };
+
+#if TEXT_RASTER_CACHE
+    /// Where we render strings, created when we first need it
+    class ScratchDisplay;
+    ScratchDisplay *scratch = NULL;
+
+    Entry entries[TEXT_RASTER_CACHE_ENTRIES];
+#endif
+    FontTableLookupFunction fontTableLookup;
+    uint32_t useCount = 0;
+    uint32_t numHits = 0, numMisses = 0;
+
+    /// @return the entry for s in font, rendering it if need be, or NULL if we don't keep it
+    Entry *find(const uint8_t *font, const char *s);
+
+    /// Render s in font into e
+    bool render(Entry &e, const uint8_t *font, const char *s, uint32_t hash);
+};
@@ -1,9 +1,15 @@
 #include "InputBroker.h"
 #include "PowerFSM.h" // needed for event trigger
+#include "configuration.h"
+#include "mesh/generated/meshtastic/module_config.pb.h"
 
 InputBroker *inputBroker;
 
-InputBroker::InputBroker(){};
+InputBroker::InputBroker() : concurrency::OSThread("InputBroker"), queue(INPUT_BROKER_QUEUE_LEN)
+{
+    setPriority(PRIORITY_UI);
+    queue.setReader(this);
+}
 
 void InputBroker::registerSource(Observable<const InputEvent *> *source)
 {
@@ -12,7 +18,91 @@ void InputBroker::registerSource(Observable<const InputEvent *> *source)
 
 int InputBroker::handleInputEvent(const InputEvent *event)
 {
-    powerFSM.trigger(EVENT_INPUT);
-    this->notifyObservers(event);
+    QueuedEvent q;
+    q.event = *event;
+    q.atMsec = millis();
+    stats.events++;
+    if (!queue.enqueue(q, 0)) // wakes us
+        stats.dropped++;
     return 0;
-}
\ No newline at end of file
+}
+
+/// Moves (unlike keys) say nothing but which way, so more of the same straight after are the same move
+static bool isMove(const InputEvent &e)
+{
+    if (e.kbchar)
+        return false;
+    switch (e.inputEvent) {
+    case meshtastic_ModuleConfig_CannedMessageConfig_InputEventChar_UP:
+    case meshtastic_ModuleConfig_CannedMessageConfig_InputEventChar_DOWN:
+    case meshtastic_ModuleConfig_CannedMessageConfig_InputEventChar_LEFT:
+    case meshtastic_ModuleConfig_CannedMessageConfig_InputEventChar_RIGHT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int32_t InputBroker::runOnce()
+{
+    uint32_t now = millis();
+    if (queue.isEmpty())
+        return INT32_MAX; // until a source wakes us
+    if (lastBatchMsec && now - lastBatchMsec < INPUT_BROKER_BATCH_MSEC)
+        return INPUT_BROKER_BATCH_MSEC - (now - lastBatchMsec); // part of a burst, so wait for the rest of it
+
+    powerFSM.trigger(EVENT_INPUT);
+
+    // Only what is already queued, so a source which keeps on can't keep us here
+    int n = queue.numUsed();
+    uint32_t firstMsec = 0;
+    bool handedOn = false;
+    for (int i = 0; i < n; i++) {
+        QueuedEvent q;
+        if (!queue.dequeue(&q, 0))
+            break;
+        if (!firstMsec)
+            firstMsec = q.atMsec ? q.atMsec : 1;
+
+        if (isMove(q.event)) {
+            const InputEvent &last = lastMove.event;
+            if (INPUT_BROKER_COALESCE_MSEC && lastMove.atMsec && last.source == q.event.source &&
+                last.inputEvent == q.event.inputEvent && q.atMsec - lastMove.atMsec < INPUT_BROKER_COALESCE_MSEC) {
+                stats.coalesced++;
+                continue;
+            }
+            lastMove = q;
+        }
+        this->notifyObservers(&q.event);
+        handedOn = true;
+    }
+
+    lastBatchMsec = now;
+    stats.batches++;
+    if (handedOn) {
+        uint32_t none = 0;
+        undrawnSinceMsec.compare_exchange_strong(none, firstMsec); // unless an earlier batch is still waiting for a frame
+    }
+
+    const Stats &s = stats;
+    if (s.batches % INPUT_BROKER_STATS_EVERY == 0) {
+        LOG_DEBUG("Input: %u events in %u batches (%u coalesced, %u dropped), to pixels avg %ums max %ums\n",
+                  (unsigned)s.events, (unsigned)s.batches, (unsigned)s.coalesced, (unsigned)s.dropped,
+                  (unsigned)(s.frames ? s.totalLatencyMsec / s.frames : 0), (unsigned)s.maxLatencyMsec);
+    }
+
+    // Anything which came while we handed on waits for the rest of its batch
+    return queue.isEmpty() ? INT32_MAX : INPUT_BROKER_BATCH_MSEC;
+}
+
+void InputBroker::noteFrameDrawn()
+{
+    uint32_t since = undrawnSinceMsec.exchange(0);
+    if (!since)
+        return;
+    uint32_t latency = millis() - since;
+    stats.frames++;
+    stats.totalLatencyMsec += latency;
+    if (latency > stats.maxLatencyMsec)
+        stats.maxLatencyMsec = latency;
+}
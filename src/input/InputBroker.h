@@ -1,25 +1,90 @@
 #pragma once
 #include "Observer.h"
+#include "TypedQueue.h"
+#include "concurrency/OSThread.h"
+#include <atomic>
 
 #define ANYKEY 0xFF
 #define MATRIXKEY 0xFE
 
+/// How many input devices (each an Observable) we can listen to at once
+#ifndef INPUT_BROKER_MAX_SOURCES
+#define INPUT_BROKER_MAX_SOURCES 8
+#endif
+
+/// How many events our sources can get ahead of us by (past that they're dropped, and counted)
+#ifndef INPUT_BROKER_QUEUE_LEN
+#define INPUT_BROKER_QUEUE_LEN 32
+#endif
+
+/// Hand on what arrives within this long of our last batch as one more batch, so a burst of keys costs a redraw a frame
+/// (SCREEN_TRANSITION_FRAMERATE) rather than one a key.  A key on its own still goes straight through
+#ifndef INPUT_BROKER_BATCH_MSEC
+#define INPUT_BROKER_BATCH_MSEC 33
+#endif
+
+/// The same move (up, down, left or right, no key) from the same source again within this long is the same move: a bouncing
+/// trackball or fast spun encoder gives one step a frame rather than one per edge.  0 to hand on every one
+#ifndef INPUT_BROKER_COALESCE_MSEC
+#define INPUT_BROKER_COALESCE_MSEC 33
+#endif
+
+/// Log our stats every this many batches
+#ifndef INPUT_BROKER_STATS_EVERY
+#define INPUT_BROKER_STATS_EVERY 50
+#endif
+
 typedef struct _InputEvent {
     const char *source;
     char inputEvent;
     char kbchar;
 } InputEvent;
-class InputBroker : public Observable<const InputEvent *>
+
+/**
+ * Our input devices' events, queued as they come (from whichever thread polls each device) and handed on to our observers
+ * in batches by our own thread.  See INPUT_BROKER_BATCH_MSEC and INPUT_BROKER_COALESCE_MSEC
+ */
+class InputBroker : public Observable<const InputEvent *>, public concurrency::OSThread
 {
-    CallbackObserver<InputBroker, const InputEvent *> inputEventObserver =
-        CallbackObserver<InputBroker, const InputEvent *>(this, &InputBroker::handleInputEvent);
+    CallbackObserver<InputBroker, const InputEvent *, INPUT_BROKER_MAX_SOURCES> inputEventObserver =
+        CallbackObserver<InputBroker, const InputEvent *, INPUT_BROKER_MAX_SOURCES>(this, &InputBroker::handleInputEvent);
 
   public:
+    /// What has come through us since boot
+    struct Stats {
+        uint32_t events = 0;    // that our sources gave us
+        uint32_t coalesced = 0; // of those, repeated moves we merged into the one before
+        uint32_t dropped = 0;   // of those, ones our queue had no room for
+        uint32_t batches = 0;
+        uint32_t frames = 0;           // drawn after a batch, see noteFrameDrawn()
+        uint64_t totalLatencyMsec = 0; // from each of those batches' first event to its frame
+        uint32_t maxLatencyMsec = 0;
+    };
+
     InputBroker();
     void registerSource(Observable<const InputEvent *> *source);
 
+    /// The screen drew a frame (which shows whatever our observers did with what we handed on), safe from any task
+    void noteFrameDrawn();
+
+    const Stats &getStats() const { return stats; }
+
   protected:
     int handleInputEvent(const InputEvent *event);
+
+    virtual int32_t runOnce() override;
+
+  private:
+    struct QueuedEvent {
+        InputEvent event;
+        uint32_t atMsec;
+    };
+
+    TypedQueue<QueuedEvent> queue;
+    QueuedEvent lastMove = {}; // the last move we handed on, what repeats of it coalesce into
+    uint32_t lastBatchMsec = 0;
+    std::atomic<uint32_t> undrawnSinceMsec{0}; // when the first event we've handed on but nothing has drawn arrived, 0 for none
+    Stats stats;
 };
 
-extern InputBroker *inputBroker;
\ No newline at end of file
+extern InputBroker *inputBroker;
@@ -19,6 +19,7 @@
 
 LinuxInput::LinuxInput(const char *name) : concurrency::OSThread(name)
 {
+    setPriority(PRIORITY_UI);
     this->_originName = name;
 }
 
@@ -31,9 +32,9 @@ int32_t LinuxInput::runOnce()
 {
 
     if (firstTime) {
-        if (settingsStrings[keyboardDevice] == "")
+        if (portduinoSettings.keyboardDevice == "")
             return disable();
-        fd = open(settingsStrings[keyboardDevice].c_str(), O_RDWR);
+        fd = open(portduinoSettings.keyboardDevice.c_str(), O_RDWR);
         if (fd < 0)
             return disable();
         ret = ioctl(fd, EVIOCGRAB, (void *)1);
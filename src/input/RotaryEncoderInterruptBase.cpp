@@ -3,6 +3,7 @@
 
 RotaryEncoderInterruptBase::RotaryEncoderInterruptBase(const char *name) : concurrency::OSThread(name)
 {
+    setPriority(PRIORITY_UI);
     this->_originName = name;
 }
 
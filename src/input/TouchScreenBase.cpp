@@ -18,6 +18,7 @@ TouchScreenBase::TouchScreenBase(const char *name, uint16_t width, uint16_t heig
     : concurrency::OSThread(name), _display_width(width), _display_height(height), _first_x(0), _last_x(0), _first_y(0),
       _last_y(0), _start(0), _tapped(false), _originName(name)
 {
+    setPriority(PRIORITY_UI);
 }
 
 void TouchScreenBase::init(bool hasTouch)
@@ -1,7 +1,11 @@
 #include "TrackballInterruptBase.h"
 #include "configuration.h"
 
-TrackballInterruptBase::TrackballInterruptBase(const char *name) : concurrency::OSThread(name), _originName(name) {}
+TrackballInterruptBase::TrackballInterruptBase(const char *name) : concurrency::OSThread(name), _originName(name)
+{
+    setPriority(PRIORITY_UI);
+    setWakeSource(true); // our interrupts, so a move shows without waiting for our next poll
+}
 
 void TrackballInterruptBase::init(uint8_t pinDown, uint8_t pinUp, uint8_t pinLeft, uint8_t pinRight, uint8_t pinPress,
                                   char eventDown, char eventUp, char eventLeft, char eventRight, char eventPressed,
@@ -69,27 +73,34 @@ int32_t TrackballInterruptBase::runOnce()
     return 100;
 }
 
+void TrackballInterruptBase::onInterrupt(TrackballInterruptBaseActionType a)
+{
+    this->action = a;
+    BaseType_t higherWake = 0;
+    wakeFromISR(&higherWake);
+}
+
 void TrackballInterruptBase::intPressHandler()
 {
-    this->action = TB_ACTION_PRESSED;
+    onInterrupt(TB_ACTION_PRESSED);
 }
 
 void TrackballInterruptBase::intDownHandler()
 {
-    this->action = TB_ACTION_DOWN;
+    onInterrupt(TB_ACTION_DOWN);
 }
 
 void TrackballInterruptBase::intUpHandler()
 {
-    this->action = TB_ACTION_UP;
+    onInterrupt(TB_ACTION_UP);
 }
 
 void TrackballInterruptBase::intLeftHandler()
 {
-    this->action = TB_ACTION_LEFT;
+    onInterrupt(TB_ACTION_LEFT);
 }
 
 void TrackballInterruptBase::intRightHandler()
 {
-    this->action = TB_ACTION_RIGHT;
+    onInterrupt(TB_ACTION_RIGHT);
 }
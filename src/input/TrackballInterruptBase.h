@@ -31,6 +31,9 @@ class TrackballInterruptBase : public Observable<const InputEvent *>, public con
     volatile TrackballInterruptBaseActionType action = TB_ACTION_NONE;
 
   private:
+    /// Note what happened and have runOnce() hand it on
+    void onInterrupt(TrackballInterruptBaseActionType a);
+
     uint8_t _pinDown = 0;
     uint8_t _pinUp = 0;
     uint8_t _pinLeft = 0;
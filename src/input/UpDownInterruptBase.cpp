@@ -1,8 +1,10 @@
 #include "UpDownInterruptBase.h"
 #include "configuration.h"
 
-UpDownInterruptBase::UpDownInterruptBase(const char *name)
+UpDownInterruptBase::UpDownInterruptBase(const char *name) : concurrency::OSThread(name)
 {
+    setPriority(PRIORITY_UI);
+    setWakeSource(true); // our interrupts
     this->_originName = name;
 }
 
@@ -26,29 +28,38 @@ void UpDownInterruptBase::init(uint8_t pinDown, uint8_t pinUp, uint8_t pinPress,
     LOG_DEBUG("Up/down/press GPIO initialized (%d, %d, %d)\n", this->_pinUp, this->_pinDown, pinPress);
 }
 
+int32_t UpDownInterruptBase::runOnce()
+{
+    char event = this->action;
+    this->action = 0;
+    if (event) {
+        InputEvent e;
+        e.source = this->_originName;
+        e.inputEvent = event;
+        e.kbchar = 0x00;
+        this->notifyObservers(&e);
+    }
+    return INT32_MAX;
+}
+
+void UpDownInterruptBase::onInterrupt(char event)
+{
+    this->action = event;
+    BaseType_t higherWake = 0;
+    wakeFromISR(&higherWake);
+}
+
 void UpDownInterruptBase::intPressHandler()
 {
-    InputEvent e;
-    e.source = this->_originName;
-    LOG_DEBUG("GPIO event Press\n");
-    e.inputEvent = this->_eventPressed;
-    this->notifyObservers(&e);
+    onInterrupt(this->_eventPressed);
 }
 
 void UpDownInterruptBase::intDownHandler()
 {
-    InputEvent e;
-    e.source = this->_originName;
-    LOG_DEBUG("GPIO event Down\n");
-    e.inputEvent = this->_eventDown;
-    this->notifyObservers(&e);
+    onInterrupt(this->_eventDown);
 }
 
 void UpDownInterruptBase::intUpHandler()
 {
-    InputEvent e;
-    e.source = this->_originName;
-    LOG_DEBUG("GPIO event Up\n");
-    e.inputEvent = this->_eventUp;
-    this->notifyObservers(&e);
+    onInterrupt(this->_eventUp);
 }
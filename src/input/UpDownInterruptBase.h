@@ -3,7 +3,8 @@
 #include "InputBroker.h"
 #include "mesh/NodeDB.h"
 
-class UpDownInterruptBase : public Observable<const InputEvent *>
+/// Our interrupts only note what happened and wake us, we hand it on from runOnce() (not from the ISR)
+class UpDownInterruptBase : public Observable<const InputEvent *>, public concurrency::OSThread
 {
   public:
     explicit UpDownInterruptBase(const char *name);
@@ -13,7 +14,16 @@ class UpDownInterruptBase : public Observable<const InputEvent *>
     void intDownHandler();
     void intUpHandler();
 
+    virtual int32_t runOnce() override;
+
+  protected:
+    /// The last of our pins to fire since runOnce(), 0 for none
+    volatile char action = 0;
+
   private:
+    /// Note what happened and have runOnce() hand it on
+    void onInterrupt(char event);
+
     uint8_t _pinDown = 0;
     uint8_t _pinUp = 0;
     char _eventDown = meshtastic_ModuleConfig_CannedMessageConfig_InputEventChar_NONE;
@@ -8,6 +8,7 @@ extern uint8_t kb_model;
 
 KbI2cBase::KbI2cBase(const char *name) : concurrency::OSThread(name)
 {
+    setPriority(PRIORITY_UI);
     this->_originName = name;
 }
 
@@ -32,6 +32,7 @@ unsigned char KeyMap[3][sizeof(keys_rows)][sizeof(keys_cols)] = {{{' ', '.', 'm'
 
 KbMatrixBase::KbMatrixBase(const char *name) : concurrency::OSThread(name)
 {
+    setPriority(PRIORITY_UI);
     this->_originName = name;
 }
 
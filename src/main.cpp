@@ -1,7 +1,10 @@
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "GPS.h"
 #include "MeshRadio.h"
 #include "MeshService.h"
 #include "NodeDB.h"
+#include "PacketCapture.h"
 #include "PowerFSM.h"
 #include "ReliableRouter.h"
 #include "airtime.h"
@@ -14,6 +17,7 @@
 #include "RTC.h"
 #include "SPILock.h"
 #include "concurrency/OSThread.h"
+#include "concurrency/PacketTask.h"
 #include "concurrency/Periodic.h"
 #include "detect/ScanI2C.h"
 #include "detect/ScanI2CTwoWire.h"
@@ -23,6 +27,7 @@
 #include "graphics/Screen.h"
 #include "main.h"
 #include "mesh/generated/meshtastic/config.pb.h"
+#include "modules/FirmwareUpdateModule.h"
 #include "modules/Modules.h"
 #include "shutdown.h"
 #include "sleep.h"
@@ -54,21 +59,23 @@ NRF52Bluetooth *nrf52Bluetooth;
 #endif
 #include "mqtt/MQTT.h"
 
-#include "LLCC68Interface.h"
 #include "RF95Interface.h"
+#include "RadioDetect.h"
 #include "SX1262Interface.h"
-#include "SX1268Interface.h"
 #include "SX1280Interface.h"
-#ifdef ARCH_STM32WL
-#include "STM32WLE5JCInterface.h"
-#endif
 #if !HAS_RADIO && defined(ARCH_PORTDUINO)
 #include "platform/portduino/SimRadio.h"
 #endif
 
 #ifdef ARCH_PORTDUINO
 #include "linux/LinuxHardwareI2C.h"
+#include "platform/portduino/Benchmark.h"
+#include "platform/portduino/EpollAPIServer.h"
+#include "platform/portduino/LoadGenerator.h"
+#include "platform/portduino/PacketReplay.h"
 #include "platform/portduino/PortduinoGlue.h"
+#include "platform/portduino/ScreenBenchmark.h"
+#include "platform/portduino/SpidevHal.h"
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -200,6 +207,18 @@ static OSThread *accelerometerThread;
 static OSThread *ambientLightingThread;
 SPISettings spiSettings(4000000, MSBFIRST, SPI_MODE0);
 
+#ifdef ARCH_PORTDUINO
+/// The HAL for the radio our config names
+static LockingArduinoHal *newRadioHal()
+{
+#if PORTDUINO_SPIDEV_HAL
+    return newSpidevHal(SPI, spiSettings);
+#else
+    return new LockingArduinoHal(SPI, spiSettings);
+#endif
+}
+#endif
+
 RadioInterface *rIf = NULL;
 
 /**
@@ -210,6 +229,7 @@ __attribute__((weak, noinline)) bool loopCanSleep()
     return true;
 }
 
+#ifndef PIO_UNIT_TESTING // unit tests bring their own setup() and loop()
 void setup()
 {
     concurrency::hasBeenSetup = true;
@@ -232,6 +252,7 @@ void setup()
 #endif
 
     serialSinceMsec = millis();
+    BOOT_STAGE("console");
 
     LOG_INFO("\n\n//\\ E S H T /\\ S T / C\n\n");
 
@@ -335,6 +356,7 @@ void setup()
     ledPeriodic = new Periodic("Blink", ledBlinker);
 
     fsInit();
+    BOOT_STAGE("fs");
 
 #if defined(_SEEED_XIAO_NRF52840_SENSE_H_)
 
@@ -364,9 +386,9 @@ void setup()
 #elif defined(I2C_SDA) && !defined(ARCH_RP2040)
     Wire.begin(I2C_SDA, I2C_SCL);
 #elif defined(ARCH_PORTDUINO)
-    if (settingsStrings[i2cdev] != "") {
-        LOG_INFO("Using %s as I2C device.\n", settingsStrings[i2cdev]);
-        Wire.begin(settingsStrings[i2cdev].c_str());
+    if (portduinoSettings.i2cdev != "") {
+        LOG_INFO("Using %s as I2C device.\n", portduinoSettings.i2cdev.c_str());
+        Wire.begin(portduinoSettings.i2cdev.c_str());
     } else {
         LOG_INFO("No I2C device configured, skipping.\n");
     }
@@ -411,6 +433,7 @@ void setup()
     power->setStatusHandler(powerStatus);
     powerStatus->observe(&power->newStatus);
     power->setup(); // Must be after status handler is installed, so that handler gets notified of the initial configuration
+    BOOT_STAGE("power");
 
     // We need to scan here to decide if we have a screen for nodeDB.init() and because power has been applied to
     // accessories
@@ -419,32 +442,37 @@ void setup()
     LOG_INFO("Scanning for i2c devices...\n");
 #endif
 
+    // Start every bus first, so scanPorts() can scan them side by side
+    ScanI2C::I2CPort i2cPorts[2];
+    uint8_t numI2CPorts = 0;
 #if defined(I2C_SDA1) && defined(ARCH_RP2040)
     Wire1.setSDA(I2C_SDA1);
     Wire1.setSCL(I2C_SCL1);
     Wire1.begin();
-    i2cScanner->scanPort(ScanI2C::I2CPort::WIRE1);
+    i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE1;
 #elif defined(I2C_SDA1) && !defined(ARCH_RP2040)
     Wire1.begin(I2C_SDA1, I2C_SCL1);
-    i2cScanner->scanPort(ScanI2C::I2CPort::WIRE1);
+    i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE1;
 #endif
 
 #if defined(I2C_SDA) && defined(ARCH_RP2040)
     Wire.setSDA(I2C_SDA);
     Wire.setSCL(I2C_SCL);
     Wire.begin();
-    i2cScanner->scanPort(ScanI2C::I2CPort::WIRE);
+    i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE;
 #elif defined(I2C_SDA) && !defined(ARCH_RP2040)
     Wire.begin(I2C_SDA, I2C_SCL);
-    i2cScanner->scanPort(ScanI2C::I2CPort::WIRE);
+    i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE;
 #elif defined(ARCH_PORTDUINO)
-    if (settingsStrings[i2cdev] != "") {
+    if (portduinoSettings.i2cdev != "") {
         LOG_INFO("Scanning for i2c devices...\n");
-        i2cScanner->scanPort(ScanI2C::I2CPort::WIRE);
+        i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE;
     }
 #elif HAS_WIRE
-    i2cScanner->scanPort(ScanI2C::I2CPort::WIRE);
+    i2cPorts[numI2CPorts++] = ScanI2C::I2CPort::WIRE;
 #endif
+    bool i2cFromCache = i2cScanner->scanPorts(i2cPorts, numI2CPorts);
+    BOOT_STAGE("i2c scan");
 
     auto i2cCount = i2cScanner->countDevices();
     if (i2cCount == 0) {
@@ -455,6 +483,11 @@ void setup()
 #endif
     } else {
         LOG_INFO("%i I2C devices found\n", i2cCount);
+#if !SCREEN_RENDER_TASK // which would draw on the bus while we scanned it
+        // We only checked the devices we had last time, so look for any new ones once we're up
+        if (i2cFromCache)
+            i2cScanner->rescanLater(i2cPorts, numI2CPorts);
+#endif
     }
 
 #ifdef ARCH_ESP32
@@ -593,9 +626,12 @@ void setup()
     rp2040Setup();
 #endif
 
+    BOOT_STAGE("cpu");
+
     // We do this as early as possible because this loads preferences from flash
     // but we need to do this after main cpu init (esp32setup), because we need the random seed set
     nodeDB.init();
+    BOOT_STAGE("nodedb");
 
     // If we're taking on the repeater role, use flood router and turn off 3V3_S rail because peripherals are not needed
     if (config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER) {
@@ -664,7 +700,7 @@ void setup()
     SPI.begin(false);
 #endif // HW_SPI1_DEVICE
 #elif ARCH_PORTDUINO
-    SPI.begin(settingsStrings[spidev].c_str());
+    SPI.begin(portduinoSettings.spidev.c_str());
 #elif !defined(ARCH_ESP32) // ARCH_RP2040
     SPI.begin();
 #else
@@ -674,6 +710,8 @@ void setup()
     SPI.setFrequency(4000000);
 #endif
 
+    BOOT_STAGE("spi");
+
     // Initialize the screen first so we can show the logo while we start up everything else.
     screen = new graphics::Screen(screen_found, screen_model, screen_geometry);
 
@@ -690,6 +728,7 @@ void setup()
         LOG_DEBUG("Running without GPS.\n");
     }
     nodeStatus->observe(&nodeDB.newStatus);
+    BOOT_STAGE("screen, gps");
 
 #ifdef HAS_I2S
     LOG_DEBUG("Starting audio thread\n");
@@ -697,9 +736,11 @@ void setup()
 #endif
 
     service.init();
+    BOOT_STAGE("service");
 
     // Now that the mesh service is created, create any modules
     setupModules();
+    BOOT_STAGE("modules");
 
 // Do this after service.init (because that clears error_code)
 #ifdef HAS_PMU
@@ -712,7 +753,7 @@ void setup()
 #if defined(ST7735_CS) || defined(USE_EINK) || defined(ILI9341_DRIVER) || defined(ST7789_CS)
     screen->setup();
 #elif defined(ARCH_PORTDUINO)
-    if (screen_found.port != ScanI2C::I2CPort::NO_I2C || settingsMap[displayPanel]) {
+    if (screen_found.port != ScanI2C::I2CPort::NO_I2C || portduinoSettings.displayPanel) {
         screen->setup();
     }
 #else
@@ -721,6 +762,7 @@ void setup()
 #endif
 
     screen->print("Started...\n");
+    BOOT_STAGE("screen setup");
 
 #ifdef SX126X_ANT_SW
     // make analog PA vs not PA switch on SX126x eval board work properly
@@ -729,12 +771,12 @@ void setup()
 #endif
 
 #ifdef ARCH_PORTDUINO
-    if (settingsMap[use_sx1262]) {
+    if (portduinoSettings.loraModule == lora_sx1262) {
         if (!rIf) {
-            LOG_DEBUG("Attempting to activate sx1262 radio on SPI port %s\n", settingsStrings[spidev].c_str());
-            LockingArduinoHal *RadioLibHAL = new LockingArduinoHal(SPI, spiSettings);
-            rIf = new SX1262Interface((LockingArduinoHal *)RadioLibHAL, settingsMap[cs], settingsMap[irq], settingsMap[reset],
-                                      settingsMap[busy]);
+            LOG_DEBUG("Attempting to activate sx1262 radio on SPI port %s\n", portduinoSettings.spidev.c_str());
+            LockingArduinoHal *RadioLibHAL = newRadioHal();
+            rIf = new SX1262Interface((LockingArduinoHal *)RadioLibHAL, portduinoSettings.cs, portduinoSettings.irq,
+                                      portduinoSettings.reset, portduinoSettings.busy);
             if (!rIf->init()) {
                 LOG_ERROR("Failed to find SX1262 radio\n");
                 delete rIf;
@@ -743,12 +785,12 @@ void setup()
                 LOG_INFO("SX1262 Radio init succeeded, using SX1262 radio\n");
             }
         }
-    } else if (settingsMap[use_rf95]) {
+    } else if (portduinoSettings.loraModule == lora_rf95) {
         if (!rIf) {
-            LOG_DEBUG("Attempting to activate rf95 radio on SPI port %s\n", settingsStrings[spidev].c_str());
-            LockingArduinoHal *RadioLibHAL = new LockingArduinoHal(SPI, spiSettings);
-            rIf = new RF95Interface((LockingArduinoHal *)RadioLibHAL, settingsMap[cs], settingsMap[irq], settingsMap[reset],
-                                    settingsMap[busy]);
+            LOG_DEBUG("Attempting to activate rf95 radio on SPI port %s\n", portduinoSettings.spidev.c_str());
+            LockingArduinoHal *RadioLibHAL = newRadioHal();
+            rIf = new RF95Interface((LockingArduinoHal *)RadioLibHAL, portduinoSettings.cs, portduinoSettings.irq,
+                                    portduinoSettings.reset, portduinoSettings.busy);
             if (!rIf->init()) {
                 LOG_ERROR("Failed to find RF95 radio\n");
                 delete rIf;
@@ -758,12 +800,12 @@ void setup()
                 LOG_INFO("RF95 Radio init succeeded, using RF95 radio\n");
             }
         }
-    } else if (settingsMap[use_sx1280]) {
+    } else if (portduinoSettings.loraModule == lora_sx1280) {
         if (!rIf) {
-            LOG_DEBUG("Attempting to activate sx1280 radio on SPI port %s\n", settingsStrings[spidev].c_str());
-            LockingArduinoHal *RadioLibHAL = new LockingArduinoHal(SPI, spiSettings);
-            rIf = new SX1280Interface((LockingArduinoHal *)RadioLibHAL, settingsMap[cs], settingsMap[irq], settingsMap[reset],
-                                      settingsMap[busy]);
+            LOG_DEBUG("Attempting to activate sx1280 radio on SPI port %s\n", portduinoSettings.spidev.c_str());
+            LockingArduinoHal *RadioLibHAL = newRadioHal();
+            rIf = new SX1280Interface((LockingArduinoHal *)RadioLibHAL, portduinoSettings.cs, portduinoSettings.irq,
+                                      portduinoSettings.reset, portduinoSettings.busy);
             if (!rIf->init()) {
                 LOG_ERROR("Failed to find SX1280 radio\n");
                 delete rIf;
@@ -782,19 +824,6 @@ void setup()
 #endif
 
     // radio init MUST BE AFTER service.init, so we have our radio config settings (from nodedb init)
-#if defined(USE_STM32WLx)
-    if (!rIf) {
-        rIf = new STM32WLE5JCInterface(RadioLibHAL, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find STM32WL radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("STM32WL Radio init succeeded, using STM32WL radio\n");
-        }
-    }
-#endif
-
 #if !HAS_RADIO && defined(ARCH_PORTDUINO)
     if (!rIf) {
         rIf = new SimRadio;
@@ -808,70 +837,12 @@ void setup()
     }
 #endif
 
-#if defined(RF95_IRQ)
-    if (!rIf) {
-        rIf = new RF95Interface(RadioLibHAL, LORA_CS, RF95_IRQ, RF95_RESET, RF95_DIO1);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find RF95 radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("RF95 Radio init succeeded, using RF95 radio\n");
-        }
-    }
-#endif
-
-#if defined(USE_SX1262) && !defined(ARCH_PORTDUINO)
-    if (!rIf) {
-        rIf = new SX1262Interface(RadioLibHAL, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find SX1262 radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("SX1262 Radio init succeeded, using SX1262 radio\n");
-        }
-    }
-#endif
-
-#if defined(USE_SX1268)
-    if (!rIf) {
-        rIf = new SX1268Interface(RadioLibHAL, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find SX1268 radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("SX1268 Radio init succeeded, using SX1268 radio\n");
-        }
-    }
-#endif
-
-#if defined(USE_LLCC68)
-    if (!rIf) {
-        rIf = new LLCC68Interface(RadioLibHAL, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find LLCC68 radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("LLCC68 Radio init succeeded, using LLCC68 radio\n");
-        }
-    }
+#ifndef ARCH_PORTDUINO
+    if (!rIf)
+        rIf = detectRadio(RadioLibHAL);
 #endif
 
-#if defined(USE_SX1280)
-    if (!rIf) {
-        rIf = new SX1280Interface(RadioLibHAL, SX128X_CS, SX128X_DIO1, SX128X_RESET, SX128X_BUSY);
-        if (!rIf->init()) {
-            LOG_WARN("Failed to find SX1280 radio\n");
-            delete rIf;
-            rIf = NULL;
-        } else {
-            LOG_INFO("SX1280 Radio init succeeded, using SX1280 radio\n");
-        }
-    }
-#endif
+    BOOT_STAGE("radio");
 
     // check if the radio chip matches the selected region
 
@@ -905,12 +876,19 @@ void setup()
     webServerThread = new WebServerThread();
 #endif
 
-#ifdef ARCH_PORTDUINO
+#if defined(ARCH_PORTDUINO) && PORTDUINO_GATEWAY
+    initGatewayApiServer(TCPPort);
+#elif defined(ARCH_PORTDUINO)
     initApiServer(TCPPort);
 #endif
 
+    BOOT_STAGE("network");
+
     // Start airtime logger thread.
     airTime = new AirTime();
+#if PACKET_CAPTURE
+    packetCapture = new PacketCapture();
+#endif
 
     if (!rIf)
         RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_NO_RADIO);
@@ -927,7 +905,43 @@ void setup()
     PowerFSM_setup(); // we will transition to ON in a couple of seconds, FIXME, only do this for cold boots, not waking from SDS
     powerFSMthread = new PowerFSMThread();
     setCPUFast(false); // 80MHz is fine for our slow peripherals
+#if defined(ARCH_ESP32) && ESP32_AUTO_LIGHT_SLEEP
+    if (config.power.is_power_saving)
+        enableAutoLightSleep(); // after setCPUFast(), whose speed it keeps
+#endif
+
+#ifdef ARCH_PORTDUINO
+    if (benchmarkMode) {
+        runBenchmarks();
+        exit(0);
+    }
+    if (screenBenchmarkFrames) {
+        runScreenBenchmark(screenBenchmarkFrames);
+        exit(0);
+    }
+    if (loadGeneratorMode)
+        new LoadGenerator(loadGeneratorSpec);
+    if (replayFileName && !PacketReplay::open(replayFileName, replaySpeed))
+        exit(EXIT_FAILURE);
+#if USE_MESH_FIRMWARE_UPDATE
+    if (firmwareDistributeFile &&
+        !firmwareUpdateModule->startDistribution(firmwareDistributeFile, (meshtastic_HardwareModel)firmwareDistributeHwModel,
+                                                 firmwareDistributeVersion, firmwareDistributeFlags))
+        exit(EXIT_FAILURE);
+#endif
+#endif
+
+    console->setDeferred(true); // from here loop() runs our console, which writes out what we log
+
+#if USE_PACKET_TASK
+    concurrency::startPacketTask(); // Last, from here on the radio and Router no longer run from loop()
+    if (RadioLibInterface::instance)
+        RadioLibInterface::instance->startInterruptTask();
+#endif
+
+    BOOT_FINISHED();
 }
+#endif
 
 uint32_t rebootAtMsec;   // If not zero we will reboot at this time (used to reboot shortly after the update completes)
 uint32_t shutdownAtMsec; // If not zero we will shutdown at this time (used to shutdown from python or mobile client)
@@ -952,6 +966,7 @@ extern meshtastic_DeviceMetadata getDeviceMetadata()
     return deviceMetadata;
 }
 
+#ifndef PIO_UNIT_TESTING
 void loop()
 {
     runASAP = false;
@@ -979,10 +994,13 @@ void loop()
     }
 #endif
 
-    // TODO: This should go into a thread handled by FreeRTOS.
-    // handleWebResponse();
-
+#if USE_PACKET_TASK
+    concurrency::packetLock->lock();
+#endif
     service.loop();
+#if USE_PACKET_TASK
+    concurrency::packetLock->unlock();
+#endif
 
     long delayMsec = mainController.runOrDelay();
 
@@ -993,7 +1011,10 @@ void loop()
     // We want to sleep as long as possible here - because it saves power
     if (!runASAP && loopCanSleep()) {
         // if(delayMsec > 100) LOG_DEBUG("sleeping %ld\n", delayMsec);
+        uint32_t idleStart = millis();
         mainDelay.delay(delayMsec);
+        energyStats.addIdle(millis() - idleStart);
     }
     // if (didWake) LOG_DEBUG("wake!\n");
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -65,6 +65,10 @@ const char *getDeviceName();
 
 extern uint32_t timeLastPowered;
 
+/// Our LoRa radio, NULL if we found none
+class RadioInterface;
+extern RadioInterface *rIf;
+
 extern uint32_t rebootAtMsec;
 extern uint32_t shutdownAtMsec;
 
@@ -6,9 +6,18 @@
  * information about free heap, heap size, free psram and psram size. The functions are
  * implemented for ESP32 and NRF52 architectures. If the platform does not have heap
  * management function implemented, the functions return UINT32_MAX or 0.
+ *
+ * It also keeps what each HeapSite has allocated, and with MEMGET_TRACE_NEW replaces operator new to find out.
  */
 #include "memGet.h"
 #include "configuration.h"
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ARCH_ESP32
+#include <esp_heap_caps.h>
+#endif
 
 MemGet memGet;
 
@@ -70,4 +79,305 @@ uint32_t MemGet::getPsramSize()
 #else
     return 0;
 #endif
-}
\ No newline at end of file
+}
+
+/**
+ * Returns the biggest block the heap could allocate right now, which shrinks long before the free heap does as the heap
+ * fragments.
+ * @return uint32_t The size in bytes, UINT32_MAX if this platform can't tell us.
+ */
+uint32_t MemGet::getLargestFreeBlock()
+{
+#ifdef ARCH_ESP32
+    return ESP.getMaxAllocHeap();
+#else
+    return UINT32_MAX;
+#endif
+}
+
+/**
+ * Returns the least free heap there has been since boot.
+ * @return uint32_t The low water mark in bytes, UINT32_MAX if this platform can't tell us.
+ */
+uint32_t MemGet::getMinFreeHeap()
+{
+#ifdef ARCH_ESP32
+    return ESP.getMinFreeHeap();
+#else
+    return UINT32_MAX;
+#endif
+}
+
+uint32_t MemGet::getHeapFragmentation()
+{
+    uint32_t free = getFreeHeap(), largest = getLargestFreeBlock();
+    if (free == UINT32_MAX || largest == UINT32_MAX || !free || largest > free)
+        return 0;
+    return 100 - (uint32_t)((uint64_t)largest * 100 / free);
+}
+
+void MemGet::noteAlloc(HeapSite site, size_t bytes)
+{
+    HeapSiteStats &s = sites[site];
+    s.allocs.fetch_add(1, std::memory_order_relaxed);
+    uint32_t live = s.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    uint32_t peak = s.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !s.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void MemGet::noteFree(HeapSite site, size_t bytes)
+{
+    HeapSiteStats &s = sites[site];
+    s.frees.fetch_add(1, std::memory_order_relaxed);
+    s.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+const char *MemGet::getSiteName(HeapSite site)
+{
+    static const char *const names[HEAP_SITE_COUNT] = {"packets", "pools", "pending", "json",  "mqtt",
+                                                       "http",    "nodedb", "stream",  "screen", "other"};
+    return site < HEAP_SITE_COUNT ? names[site] : "?";
+}
+
+MemRegion MemGet::getPlacement(HeapSite site)
+{
+    switch (site) {
+    case HEAP_SITE_MQTT:
+        return MEMGET_PLACE_MQTT;
+    case HEAP_SITE_HTTP:
+        return MEMGET_PLACE_HTTP;
+    case HEAP_SITE_NODEDB:
+        return MEMGET_PLACE_NODEDB;
+    case HEAP_SITE_STREAM:
+        return MEMGET_PLACE_STREAM;
+    case HEAP_SITE_SCREEN:
+        return MEMGET_PLACE_SCREEN;
+    default:
+        return MEM_REGION_INTERNAL;
+    }
+}
+
+const char *MemGet::getRegionName(MemRegion region)
+{
+    static const char *const names[MEM_REGION_COUNT] = {"internal", "psram", "dma"};
+    return region < MEM_REGION_COUNT ? names[region] : "?";
+}
+
+uint32_t MemGet::getRegionFree(MemRegion region)
+{
+#ifdef ARCH_ESP32
+    static const uint32_t caps[MEM_REGION_COUNT] = {MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+                                                    MALLOC_CAP_DMA};
+    return heap_caps_get_free_size(caps[region]);
+#else
+    return region == MEM_REGION_PSRAM ? 0 : getFreeHeap();
+#endif
+}
+
+/// What place() puts ahead of each buffer, so unplace() knows whose it was and where (8 bytes, keeping alignment)
+union PlacedHeader {
+    struct {
+        uint32_t bytes;
+        HeapSite site;
+        MemRegion region;
+    } h;
+    uint64_t align;
+};
+
+void *MemGet::place(HeapSite site, size_t bytes, bool zero, MemRegion region)
+{
+    if (region == MEM_REGION_COUNT)
+        region = getPlacement(site);
+    size_t total = sizeof(PlacedHeader) + bytes;
+    PlacedHeader *p;
+#ifdef ARCH_ESP32
+    if (region == MEM_REGION_PSRAM) {
+        p = (PlacedHeader *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!p) {
+            LOG_DEBUG("No PSRAM for %u bytes of %s, taking internal SRAM\n", bytes, getSiteName(site));
+            region = MEM_REGION_INTERNAL;
+        }
+    }
+    if (region == MEM_REGION_INTERNAL)
+        p = (PlacedHeader *)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    else if (region == MEM_REGION_DMA)
+        p = (PlacedHeader *)heap_caps_malloc(total, MALLOC_CAP_DMA);
+#else
+    region = MEM_REGION_INTERNAL; // it's all the same to us
+    p = (PlacedHeader *)malloc(total);
+#endif
+    if (!p) {
+        LOG_ERROR("No %s memory for %u bytes of %s\n", getRegionName(region), bytes, getSiteName(site));
+        return NULL;
+    }
+    p->h.bytes = bytes;
+    p->h.site = site;
+    p->h.region = region;
+    if (zero)
+        memset(p + 1, 0, bytes);
+    noteAlloc(site, bytes);
+    placedBytes[region].fetch_add(bytes, std::memory_order_relaxed);
+    return p + 1;
+}
+
+void MemGet::unplace(void *ptr)
+{
+    if (!ptr)
+        return;
+    PlacedHeader *p = (PlacedHeader *)ptr - 1;
+    noteFree(p->h.site, p->h.bytes);
+    placedBytes[p->h.region].fetch_sub(p->h.bytes, std::memory_order_relaxed);
+    free(p); // heap_caps_malloc()'s too
+}
+
+/// @return the nth site which has allocated anything, HEAP_SITE_COUNT if there are fewer
+static HeapSite getActiveSite(const MemGet &m, int n)
+{
+    for (int i = 0; i < HEAP_SITE_COUNT; i++)
+        if (m.getSiteStats((HeapSite)i).allocs.load(std::memory_order_relaxed) && n-- == 0)
+            return (HeapSite)i;
+    return HEAP_SITE_COUNT;
+}
+
+int MemGet::getNumHeapLines()
+{
+    int n = 1 + MEM_REGION_COUNT;
+    while (getActiveSite(*this, n - 1 - MEM_REGION_COUNT) != HEAP_SITE_COUNT)
+        n++;
+    return n;
+}
+
+void MemGet::getHeapLine(int line, char *buf, size_t bufLen)
+{
+    if (line == 0) {
+        snprintf(buf, bufLen, "heap free=%u min=%u largest=%u frag=%u%%", (unsigned)getFreeHeap(), (unsigned)getMinFreeHeap(),
+                 (unsigned)getLargestFreeBlock(), (unsigned)getHeapFragmentation());
+        return;
+    }
+
+    if (line <= MEM_REGION_COUNT) {
+        MemRegion region = (MemRegion)(line - 1);
+        snprintf(buf, bufLen, "heap region %s placed_bytes=%u free=%u", getRegionName(region), (unsigned)getPlacedBytes(region),
+                 (unsigned)getRegionFree(region));
+        return;
+    }
+
+    HeapSite site = getActiveSite(*this, line - 1 - MEM_REGION_COUNT);
+    if (site == HEAP_SITE_COUNT) {
+        *buf = '\0';
+        return;
+    }
+    const HeapSiteStats &s = sites[site];
+    uint32_t allocs = s.allocs.load(std::memory_order_relaxed), frees = s.frees.load(std::memory_order_relaxed);
+    snprintf(buf, bufLen, "heap site %s allocs=%u live=%u live_bytes=%u peak_bytes=%u", getSiteName(site), (unsigned)allocs,
+             (unsigned)(allocs - frees), (unsigned)s.liveBytes.load(std::memory_order_relaxed),
+             (unsigned)s.peakBytes.load(std::memory_order_relaxed));
+}
+
+void MemGet::logHeap()
+{
+    char line[120];
+    int n = getNumHeapLines();
+    for (int i = 0; i < n; i++) {
+        getHeapLine(i, line, sizeof(line));
+        LOG_DEBUG("%s\n", line);
+    }
+}
+
+#if MEMGET_TRACE_NEW
+/// The site operator new counts against on this task
+static thread_local HeapSite currentSite = HEAP_SITE_OTHER;
+
+HeapSiteScope::HeapSiteScope(HeapSite site) : outer(currentSite)
+{
+    currentSite = site;
+}
+
+HeapSiteScope::~HeapSiteScope()
+{
+    currentSite = outer;
+}
+
+/// What operator new puts ahead of each allocation, so operator delete knows whose it was (8 bytes, keeping alignment)
+union HeapHeader {
+    struct {
+        uint32_t bytes;
+        HeapSite site;
+    } h;
+    uint64_t align;
+};
+
+static void *tracedAlloc(size_t bytes)
+{
+    HeapHeader *p = (HeapHeader *)malloc(sizeof(HeapHeader) + bytes);
+    if (!p)
+        return NULL;
+    p->h.bytes = bytes;
+    p->h.site = currentSite;
+    memGet.noteAlloc(currentSite, bytes);
+    return p + 1;
+}
+
+static void tracedFree(void *ptr)
+{
+    if (!ptr)
+        return;
+    HeapHeader *p = (HeapHeader *)ptr - 1;
+    memGet.noteFree(p->h.site, p->h.bytes);
+    free(p);
+}
+
+static void *tracedNew(size_t bytes)
+{
+    void *p = tracedAlloc(bytes);
+    if (!p) {
+#if __cpp_exceptions
+        throw std::bad_alloc();
+#else
+        abort();
+#endif
+    }
+    return p;
+}
+
+void *operator new(size_t bytes)
+{
+    return tracedNew(bytes);
+}
+
+void *operator new[](size_t bytes)
+{
+    return tracedNew(bytes);
+}
+
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept
+{
+    return tracedAlloc(bytes);
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t &) noexcept
+{
+    return tracedAlloc(bytes);
+}
+
+void operator delete(void *p) noexcept
+{
+    tracedFree(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    tracedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    tracedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    tracedFree(p);
+}
+#endif
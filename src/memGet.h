@@ -3,16 +3,199 @@
 #define _MT_MEMGET_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+
+/// Count every operator new by the HeapSite of the HeapSiteScope it happens in (everything else goes to HEAP_SITE_OTHER), so
+/// std::string and the like show up too.  Each allocation gets an 8 byte header saying whose it is, so this is for debug
+/// builds chasing fragmentation, and only where we can replace operator new
+#ifndef MEMGET_TRACE_NEW
+#define MEMGET_TRACE_NEW 0
+#endif
+
+/// Whose heap allocations these are, see MemGet::getSiteStats()
+enum HeapSite : uint8_t {
+    HEAP_SITE_PACKETS, // packetPool, when it's on the heap
+    HEAP_SITE_POOLS,   // our other MemoryDynamic/MemoryRecycled allocators
+    HEAP_SITE_PENDING, // ReliableRouter's pending retransmissions
+    HEAP_SITE_JSON,    // JSONValue trees
+    HEAP_SITE_MQTT,    // with MEMGET_TRACE_NEW, whatever MQTT allocates
+    HEAP_SITE_HTTP,    // with MEMGET_TRACE_NEW, whatever the web server allocates
+    HEAP_SITE_NODEDB,  // the extended NodeDB tier's tables
+    HEAP_SITE_STREAM,  // StreamAPI's rx and tx buffers
+    HEAP_SITE_SCREEN,  // our displays' frame copies and pixel buffers
+    HEAP_SITE_OTHER,   // with MEMGET_TRACE_NEW, any other operator new
+    HEAP_SITE_COUNT
+};
+
+/// Where MemGet::place() puts a buffer
+enum MemRegion : uint8_t {
+    MEM_REGION_INTERNAL, // internal SRAM, which BLE, WiFi and TLS need all they can get of
+    MEM_REGION_PSRAM,    // external PSRAM, slower but plentiful (falls back to internal SRAM when full, or where there is none)
+    MEM_REGION_DMA,      // internal SRAM our DMA engines can reach
+    MEM_REGION_COUNT
+};
+
+/// Where each HeapSite's placed buffers go by default.  Big buffers which no ISR or DMA touches go in PSRAM where the
+/// variant has it, leaving internal SRAM for the radio stacks and TLS.  A variant can place any site itself
+#ifndef MEMGET_PLACE_LARGE
+#ifdef BOARD_HAS_PSRAM
+#define MEMGET_PLACE_LARGE MEM_REGION_PSRAM
+#else
+#define MEMGET_PLACE_LARGE MEM_REGION_INTERNAL
+#endif
+#endif
+#ifndef MEMGET_PLACE_MQTT
+#define MEMGET_PLACE_MQTT MEMGET_PLACE_LARGE
+#endif
+#ifndef MEMGET_PLACE_HTTP
+#define MEMGET_PLACE_HTTP MEMGET_PLACE_LARGE
+#endif
+#ifndef MEMGET_PLACE_NODEDB
+#define MEMGET_PLACE_NODEDB MEMGET_PLACE_LARGE
+#endif
+#ifndef MEMGET_PLACE_STREAM
+#define MEMGET_PLACE_STREAM MEMGET_PLACE_LARGE
+#endif
+#ifndef MEMGET_PLACE_SCREEN
+#define MEMGET_PLACE_SCREEN MEMGET_PLACE_LARGE
+#endif
+
+/// What one HeapSite has done to the heap since boot
+struct HeapSiteStats {
+    std::atomic<uint32_t> allocs{0};
+    std::atomic<uint32_t> frees{0};
+    std::atomic<uint32_t> liveBytes{0};
+    std::atomic<uint32_t> peakBytes{0};
+};
 
 class MemGet
 {
+    HeapSiteStats sites[HEAP_SITE_COUNT];
+
+    /// Bytes place() has handed out (and not had back) in each region
+    std::atomic<uint32_t> placedBytes[MEM_REGION_COUNT] = {};
+
   public:
     uint32_t getFreeHeap();
     uint32_t getHeapSize();
     uint32_t getFreePsram();
     uint32_t getPsramSize();
+
+    /// @return the biggest single allocation the heap could give us now, UINT32_MAX if we can't tell
+    uint32_t getLargestFreeBlock();
+
+    /// @return the least the free heap has been since boot, UINT32_MAX if we can't tell
+    uint32_t getMinFreeHeap();
+
+    /// @return how much of the free heap is in pieces too small for getLargestFreeBlock(), in percent (0 if we can't tell)
+    uint32_t getHeapFragmentation();
+
+    /// Safe from any task: site took (or gave back) bytes of heap
+    void noteAlloc(HeapSite site, size_t bytes);
+    void noteFree(HeapSite site, size_t bytes);
+
+    const HeapSiteStats &getSiteStats(HeapSite site) const { return sites[site]; }
+
+    static const char *getSiteName(HeapSite site);
+
+    /// Where site's placed buffers go (see MEMGET_PLACE_LARGE)
+    static MemRegion getPlacement(HeapSite site);
+
+    /**
+     * bytes for site, from region (getPlacement(site) if MEM_REGION_COUNT), zeroed if asked.  A PSRAM buffer comes from
+     * internal SRAM when there's no PSRAM left, a DMA one never comes from anywhere else.  Counted against site and the region
+     * it ended up in, until unplace().  @return NULL if there's no room
+     */
+    void *place(HeapSite site, size_t bytes, bool zero = false, MemRegion region = MEM_REGION_COUNT);
+
+    /// Give back what place() gave us (NULL is fine)
+    void unplace(void *p);
+
+    /// @return bytes place() has out in region
+    uint32_t getPlacedBytes(MemRegion region) const { return placedBytes[region].load(std::memory_order_relaxed); }
+
+    /// @return how much of region is free, UINT32_MAX if we can't tell
+    uint32_t getRegionFree(MemRegion region);
+
+    static const char *getRegionName(MemRegion region);
+
+    /// How many lines getHeapLine() has: the heap as a whole, each region, then each site which has allocated anything
+    int getNumHeapLines();
+
+    /// One line of our heap telemetry (for the log or the phone)
+    void getHeapLine(int line, char *buf, size_t bufLen);
+
+    /// Log all of getHeapLine(), so we can see who is fragmenting the heap
+    void logHeap();
 };
 
 extern MemGet memGet;
 
+/**
+ * While one of these is alive, operator new on this task counts against site (with MEMGET_TRACE_NEW, otherwise it costs
+ * nothing).  Put one at the top of a subsystem's entry points (its runOnce, its callbacks)
+ */
+class HeapSiteScope
+{
+#if MEMGET_TRACE_NEW
+    HeapSite outer;
+#endif
+
+  public:
+    explicit HeapSiteScope(HeapSite site);
+    ~HeapSiteScope();
+    HeapSiteScope(const HeapSiteScope &) = delete;
+    HeapSiteScope &operator=(const HeapSiteScope &) = delete;
+};
+
+#if !MEMGET_TRACE_NEW
+inline HeapSiteScope::HeapSiteScope(HeapSite) {}
+inline HeapSiteScope::~HeapSiteScope() {}
+#endif
+
+/// A std allocator which counts what a container takes from the heap against Site
+template <class T, HeapSite Site> struct HeapSiteAllocator {
+    typedef T value_type;
+
+    template <class U> struct rebind {
+        typedef HeapSiteAllocator<U, Site> other;
+    };
+
+    HeapSiteAllocator() {}
+    template <class U> HeapSiteAllocator(const HeapSiteAllocator<U, Site> &) {}
+
+    T *allocate(size_t n)
+    {
+#if MEMGET_TRACE_NEW
+        HeapSiteScope scope(Site); // operator new counts it, and its delete knows whose it was
+#else
+        memGet.noteAlloc(Site, n * sizeof(T));
+#endif
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+#if !MEMGET_TRACE_NEW
+        memGet.noteFree(Site, n * sizeof(T));
+#else
+        (void)n;
+#endif
+        ::operator delete(p);
+    }
+};
+
+template <class T, class U, HeapSite Site>
+bool operator==(const HeapSiteAllocator<T, Site> &, const HeapSiteAllocator<U, Site> &)
+{
+    return true;
+}
+
+template <class T, class U, HeapSite Site>
+bool operator!=(const HeapSiteAllocator<T, Site> &, const HeapSiteAllocator<U, Site> &)
+{
+    return false;
+}
+
 #endif
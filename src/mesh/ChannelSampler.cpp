@@ -0,0 +1,39 @@
+#include "ChannelSampler.h"
+#include "RadioLibInterface.h"
+#include "airtime.h"
+#include <math.h>
+
+ChannelSampler::ChannelSampler(RadioLibInterface *_radio)
+    : concurrency::OSThread("ChannelSampler", CHANNEL_SAMPLE_INTERVAL_MSEC, &concurrency::packetController), radio(_radio)
+{
+    if (!CHANNEL_SAMPLE_INTERVAL_MSEC)
+        disable();
+}
+
+bool ChannelSampler::isRssiBusy(float rssi)
+{
+    if (!numRssi++ || rssi < noiseFloor) {
+        noiseFloor = rssi; // the quietest we've heard
+        return false;
+    }
+
+    bool busy = rssi > noiseFloor + CHANNEL_SAMPLE_RSSI_BUSY_DB;
+    if (!busy)
+        noiseFloor += (rssi - noiseFloor) / CHANNEL_SAMPLE_WINDOW; // creep up, in case the floor has risen for good
+    return busy;
+}
+
+int32_t ChannelSampler::runOnce()
+{
+    bool withCad = CHANNEL_SAMPLE_CAD_EVERY && numSamples % CHANNEL_SAMPLE_CAD_EVERY == 0;
+    float rssi = NAN;
+    bool detected = false;
+    if (airTime && radio->sampleChannel(withCad, rssi, detected)) {
+        bool busy = detected || (!isnan(rssi) && isRssiBusy(rssi));
+        airTime->logChannelSample(busy);
+        numSamples++;
+    }
+
+    // Jittered, so we don't keep landing on the same part of anything periodic
+    return random(CHANNEL_SAMPLE_INTERVAL_MSEC / 2, CHANNEL_SAMPLE_INTERVAL_MSEC * 3 / 2);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "concurrency/OSThread.h"
+#include "configuration.h"
+
+/// How often (on average) we sample the channel while we are just listening, 0 for never
+#ifndef CHANNEL_SAMPLE_INTERVAL_MSEC
+#define CHANNEL_SAMPLE_INTERVAL_MSEC 5000
+#endif
+
+/// Every this many samples also runs Channel Activity Detection, which takes the radio off receive for a couple of symbols
+#ifndef CHANNEL_SAMPLE_CAD_EVERY
+#define CHANNEL_SAMPLE_CAD_EVERY 4
+#endif
+
+/// An RSSI reading this many dB above the noise floor we've learned means something is on the air
+#ifndef CHANNEL_SAMPLE_RSSI_BUSY_DB
+#define CHANNEL_SAMPLE_RSSI_BUSY_DB 10
+#endif
+
+/// AirTime's busy estimate averages about this many samples, and only counts once it has an eighth of them
+#ifndef CHANNEL_SAMPLE_WINDOW
+#define CHANNEL_SAMPLE_WINDOW 64
+#endif
+
+class RadioLibInterface;
+
+/**
+ * Looks at the channel now and then while our radio is just listening, for what AirTime can't see: it only counts the
+ * packets we demodulate, so weak or colliding LoRa and other radios on our frequency never show up in
+ * channelUtilizationPercent().  Each sample reads the radio's instantaneous RSSI against the noise floor we've learned, and
+ * every CHANNEL_SAMPLE_CAD_EVERY samples runs Channel Activity Detection as well.  AirTime averages what we find into
+ * channelBusyPercent().
+ *
+ * Runs with the radio (on packetController), and only while it's idle: never while we send, hear a packet, have one
+ * waiting to go out, or sleep between duty cycle listens.
+ */
+class ChannelSampler : private concurrency::OSThread
+{
+    RadioLibInterface *radio;
+    uint32_t numSamples = 0, numRssi = 0;
+    float noiseFloor = 0; // dBm
+
+    /// @return true if an RSSI reading of rssi dBm means something is on the air, learning our noise floor from the rest
+    bool isRssiBusy(float rssi);
+
+  public:
+    explicit ChannelSampler(RadioLibInterface *radio);
+
+    float getNoiseFloor() const { return noiseFloor; }
+
+  protected:
+    virtual int32_t runOnce() override;
+};
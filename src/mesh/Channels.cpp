@@ -2,6 +2,7 @@
 #include "CryptoEngine.h"
 #include "DisplayFormatters.h"
 #include "NodeDB.h"
+#include "PhoneAPI.h"
 #include "configuration.h"
 
 #include <assert.h>
@@ -67,10 +68,24 @@ meshtastic_Channel &Channels::fixupChannel(ChannelIndex chIndex)
     }
 
     hashes[chIndex] = generateHash(chIndex);
+    rebuildHashTable();
 
     return ch;
 }
 
+void Channels::rebuildHashTable()
+{
+    static_assert(MAX_NUM_CHANNELS <= 8, "channelsByHash needs a wider bitmask");
+    static_assert(MAX_NUM_CHANNELS <= CRYPTO_KEY_SLOTS, "CryptoEngine needs a key slot for each channel");
+
+    memset(channelsByHash, 0, sizeof(channelsByHash));
+    for (int i = 0; i < getNumChannels() && i < MAX_NUM_CHANNELS; i++)
+        if (hashes[i] >= 0)
+            channelsByHash[hashes[i]] |= 1 << i;
+
+    generation++;
+}
+
 /**
  * Write a default channel to the specified channel index
  */
@@ -167,8 +182,8 @@ int16_t Channels::setCrypto(ChannelIndex chIndex)
     if (k.length < 0)
         return -1;
     else {
-        // Tell our crypto engine about the psk
-        crypto->setKey(k);
+        // Tell our crypto engine about the psk (each channel gets its own key slot, so it only expands the key when it changes)
+        crypto->setKeyForSlot(chIndex, k);
         return getHash(chIndex);
     }
 }
@@ -183,6 +198,8 @@ void Channels::initDefaults()
 
 void Channels::onConfigChanged()
 {
+    PhoneAPI::invalidateConfigFrames();
+
     // Make sure the phone hasn't mucked anything up
     for (int i = 0; i < channelFile.channels_count; i++) {
         const meshtastic_Channel &ch = fixupChannel(i);
@@ -232,6 +249,7 @@ void Channels::setChannel(const meshtastic_Channel &c)
                 channelFile.channels[i].role = meshtastic_Channel_Role_SECONDARY;
 
     old = c; // slam in the new settings/role
+    generation++;
 }
 
 const char *Channels::getName(size_t chIndex)
@@ -28,6 +28,12 @@ class Channels
     /// the precomputed hashes for each of our channels, or -1 for invalid
     int16_t hashes[MAX_NUM_CHANNELS] = {};
 
+    /// For every possible channel hash, a bitmask of the channels which have that hash (see getChannelsForHash())
+    uint8_t channelsByHash[256] = {};
+
+    /// Bumped whenever a channel might have changed, see getGeneration()
+    uint32_t generation = 0;
+
   public:
     Channels() {}
 
@@ -94,6 +100,12 @@ class Channels
      */
     bool decryptForHash(ChannelIndex chIndex, ChannelHash channelHash);
 
+    /// @return a bitmask (bit n for channel n) of the channels an inbound packet with this hash might be for
+    uint8_t getChannelsForHash(ChannelHash channelHash) { return channelsByHash[channelHash]; }
+
+    /// @return a number which changes whenever our channels do, so others can cache things they work out from them
+    uint32_t getGeneration() const { return generation; }
+
     /** Given a channel index setup crypto for encoding that channel (or the primary channel if that channel is unsecured)
      *
      * This method is called before encoding outbound packets
@@ -121,6 +133,9 @@ class Channels
 
     int16_t getHash(ChannelIndex i) { return hashes[i]; }
 
+    /// Refill channelsByHash from hashes
+    void rebuildHashTable();
+
     /**
      * Validate a channel, fixing any errors as needed
      */
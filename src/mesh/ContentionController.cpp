@@ -0,0 +1,76 @@
+#include "ContentionController.h"
+#include "configuration.h"
+#include <math.h>
+
+/// How much each new event moves a rate
+static const float RATE_WEIGHT = 1.0f / 16;
+
+static float updateRate(float rate, bool bad)
+{
+    return rate + ((bad ? 1.0f : 0.0f) - rate) * RATE_WEIGHT;
+}
+
+void ContentionController::adjustBias(float delta)
+{
+    cwBias += delta;
+    if (cwBias < CW_BIAS_MIN)
+        cwBias = CW_BIAS_MIN;
+    else if (cwBias > CW_BIAS_MAX)
+        cwBias = CW_BIAS_MAX;
+}
+
+void ContentionController::onChannelBusy()
+{
+    numBusy++;
+    busyRate = updateRate(busyRate, true);
+    adjustBias(0.25f);
+}
+
+void ContentionController::onChannelClear()
+{
+    busyRate = updateRate(busyRate, false);
+    adjustBias(-0.0625f);
+}
+
+void ContentionController::onAckTimeout()
+{
+    numAckTimeouts++;
+    ackFailRate = updateRate(ackFailRate, true);
+    adjustBias(0.5f);
+    logStats();
+}
+
+void ContentionController::onAckReceived()
+{
+    ackFailRate = updateRate(ackFailRate, false);
+    adjustBias(-0.125f);
+}
+
+void ContentionController::onReceived(bool isDuplicate)
+{
+    if (isDuplicate)
+        numDuplicates++;
+    duplicateRate = updateRate(duplicateRate, isDuplicate);
+}
+
+int8_t ContentionController::getCWBias(bool flooding) const
+{
+    float bias = cwBias;
+    // Past half our receptions being duplicates, spread rebroadcasts out by up to another doubling of the window
+    if (flooding && duplicateRate > 0.5f)
+        bias += (duplicateRate - 0.5f) * 2;
+    return (int8_t)lroundf(bias);
+}
+
+uint32_t ContentionController::adjustSlotTime(uint32_t slotTimeMsec) const
+{
+    // Only the acks lost while CAD kept saying the channel was clear count, busy CAD means the slot time is doing its job
+    float missed = ackFailRate * (1 - busyRate);
+    return slotTimeMsec + (uint32_t)(slotTimeMsec * missed);
+}
+
+void ContentionController::logStats() const
+{
+    LOG_DEBUG("Contention: CW bias %.2f, busy %.2f (%u), ack fail %.2f (%u), duplicates %.2f (%u)\n", cwBias, busyRate, numBusy,
+              ackFailRate, numAckTimeouts, duplicateRate, numDuplicates);
+}
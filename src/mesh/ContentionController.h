@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Learns how crowded the channel really is from what happens to our packets, and uses that to nudge the contention window
+ * RadioInterface picks from channel utilization (or SNR).
+ *
+ * It is fed by the places which already see the outcomes:
+ * - RadioInterface implementations, each time CAD finds the channel busy or clear just before we send
+ * - ReliableRouter, each time a reliable send times out waiting for its ack, or gets acked
+ * - FloodingRouter, each time a packet it receives turns out to be a duplicate (or not)
+ *
+ * Busy channels and lost acks grow the window (they mean we are stepping on each other), quiet stretches shrink it again so
+ * an idle mesh goes back to the short delays.  Lots of duplicates means lots of neighbours are rebroadcasting the same floods,
+ * so we spread our rebroadcasts out further to give FloodingRouter a better chance to cancel ours.  Acks which go missing even
+ * though CAD said the channel was clear usually mean someone started inside our CAD slot, so those also stretch the slot time.
+ */
+class ContentionController
+{
+    /// Fraction (0..1) of recent events which were bad, each an exponentially weighted average over about the last 16 events
+    float busyRate = 0, ackFailRate = 0, duplicateRate = 0;
+
+    /// Added to the contention window exponent, in [CW_BIAS_MIN, CW_BIAS_MAX]
+    float cwBias = 0;
+
+    static constexpr float CW_BIAS_MIN = -1, CW_BIAS_MAX = 2;
+
+    /// Debugging counts
+    uint32_t numBusy = 0, numAckTimeouts = 0, numDuplicates = 0;
+
+    void adjustBias(float delta);
+
+  public:
+    /// CAD found someone else transmitting when we wanted to send
+    void onChannelBusy();
+
+    /// CAD found the channel clear and we are about to send
+    void onChannelClear();
+
+    /// A reliable send of ours timed out without an ack (so we are retransmitting or giving up)
+    void onAckTimeout();
+
+    /// One of our reliable sends was acked (or nak'd, either way it got through)
+    void onAckReceived();
+
+    /// FloodingRouter has just looked at a received packet, isDuplicate if we had already seen it
+    void onReceived(bool isDuplicate);
+
+    /**
+     * @param flooding if this is for rebroadcasting someone else's packet (rather than sending our own)
+     * @return how much to add to the contention window exponent picked from channel utilization or SNR
+     */
+    int8_t getCWBias(bool flooding) const;
+
+    /// @return slotTimeMsec, stretched by up to 2x while our acks keep going missing
+    uint32_t adjustSlotTime(uint32_t slotTimeMsec) const;
+
+    void logStats() const;
+};
@@ -1,5 +1,6 @@
 #include "CryptoEngine.h"
 #include "configuration.h"
+#include <assert.h>
 
 concurrency::Lock *cryptLock;
 
@@ -7,6 +8,29 @@ void CryptoEngine::setKey(const CryptoKey &k)
 {
     LOG_DEBUG("Using AES%d key!\n", k.length * 8);
     key = k;
+
+    // Subclasses install k into the context for activeSlot, so remember what that slot now holds
+    slotKeys[activeSlot] = k;
+    slotValid[activeSlot] = true;
+
+#if CRYPTO_KEYSTREAM_AHEAD
+    // Whatever we worked out under the slot's old key is no use now
+    for (Keystream &ks : keystreams)
+        if (ks.slot == activeSlot)
+            ks.valid = false;
+#endif
+}
+
+void CryptoEngine::setKeyForSlot(uint8_t slot, const CryptoKey &k)
+{
+    assert(slot < CRYPTO_KEY_SLOTS);
+    activeSlot = slot;
+
+    const CryptoKey &old = slotKeys[slot];
+    if (slotValid[slot] && old.length == k.length && (k.length <= 0 || memcmp(old.bytes, k.bytes, k.length) == 0))
+        key = k; // already expanded for this slot, nothing else to do
+    else
+        setKey(k);
 }
 
 /**
@@ -24,6 +48,56 @@ void CryptoEngine::decrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes
     LOG_WARN("noop decryption!\n");
 }
 
+void CryptoEngine::encryptBatch(const CryptoJob *jobs, size_t numJobs)
+{
+    for (size_t i = 0; i < numJobs; i++)
+        encrypt(jobs[i].fromNode, jobs[i].packetId, jobs[i].numBytes, jobs[i].bytes);
+}
+
+void CryptoEngine::decryptBatch(const CryptoJob *jobs, size_t numJobs)
+{
+    for (size_t i = 0; i < numJobs; i++)
+        decrypt(jobs[i].fromNode, jobs[i].packetId, jobs[i].numBytes, jobs[i].bytes);
+}
+
+bool CryptoEngine::precomputeKeystream(uint32_t fromNode, uint64_t packetId)
+{
+#if CRYPTO_KEYSTREAM_AHEAD
+    Keystream &ks = keystreams[packetId % CRYPTO_KEYSTREAM_AHEAD];
+    if (key.length <= 0 || (ks.valid && ks.slot == activeSlot && ks.fromNode == fromNode && ks.packetId == packetId))
+        return false;
+
+    // In CTR mode the keystream is what encrypting zeros gives
+    memset(ks.bytes, 0, sizeof(ks.bytes));
+    encrypt(fromNode, packetId, sizeof(ks.bytes), ks.bytes);
+    ks.slot = activeSlot;
+    ks.fromNode = fromNode;
+    ks.packetId = packetId;
+    ks.valid = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CryptoEngine::encryptPrecomputed(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes)
+{
+#if CRYPTO_KEYSTREAM_AHEAD
+    Keystream &ks = keystreams[packetId % CRYPTO_KEYSTREAM_AHEAD];
+    if (key.length > 0 && ks.valid && ks.slot == activeSlot && ks.fromNode == fromNode && ks.packetId == packetId &&
+        numBytes <= sizeof(ks.bytes)) {
+        for (size_t i = 0; i < numBytes; i++)
+            bytes[i] ^= ks.bytes[i];
+        ks.valid = false; // make room for the next packet id which maps here
+        keystreamUsed = true;
+        keystreamHits++;
+        return true;
+    }
+    keystreamMisses++;
+#endif
+    return false;
+}
+
 /**
  * Init our 128 bit nonce for a new packet
  */
@@ -19,6 +19,32 @@ struct CryptoKey {
 
 #define MAX_BLOCKSIZE 256
 
+/// How many keys an engine keeps expanded at once (one per channel)
+#define CRYPTO_KEY_SLOTS 8
+
+/// How many of our own next packet ids to keep keystream ready for on the primary channel (0 for none), for the MCUs where
+/// AES runs in software, so sending a packet is an XOR rather than working through the cipher
+#ifndef CRYPTO_KEYSTREAM_AHEAD
+#if defined(ARCH_NRF52) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
+#define CRYPTO_KEYSTREAM_AHEAD 4
+#else
+#define CRYPTO_KEYSTREAM_AHEAD 0
+#endif
+#endif
+
+/// Bytes of keystream kept for each, longer packets are encrypted the usual way (positions, telemetry and nodeinfo fit)
+#ifndef CRYPTO_KEYSTREAM_BYTES
+#define CRYPTO_KEYSTREAM_BYTES 96
+#endif
+
+/// One packet for encryptBatch()/decryptBatch()
+struct CryptoJob {
+    uint32_t fromNode;
+    uint64_t packetId;
+    size_t numBytes;
+    uint8_t *bytes; // updated in place
+};
+
 class CryptoEngine
 {
   protected:
@@ -27,6 +53,27 @@ class CryptoEngine
 
     CryptoKey key = {};
 
+    /// Which of our key slots setKey() installs into and encrypt()/decrypt() use
+    uint8_t activeSlot = 0;
+
+    /// The key most recently installed into each slot (length 0 and never used for slots we haven't touched)
+    CryptoKey slotKeys[CRYPTO_KEY_SLOTS] = {};
+    bool slotValid[CRYPTO_KEY_SLOTS] = {};
+
+#if CRYPTO_KEYSTREAM_AHEAD
+    /// Keystream worked out ahead of time for one packet, kept at [packetId % CRYPTO_KEYSTREAM_AHEAD]
+    struct Keystream {
+        bool valid;
+        uint8_t slot;
+        uint32_t fromNode;
+        uint64_t packetId;
+        uint8_t bytes[CRYPTO_KEYSTREAM_BYTES];
+    };
+    Keystream keystreams[CRYPTO_KEYSTREAM_AHEAD] = {};
+#endif
+    uint32_t keystreamHits = 0, keystreamMisses = 0;
+    bool keystreamUsed = false;
+
   public:
     virtual ~CryptoEngine() {}
 
@@ -41,6 +88,14 @@ class CryptoEngine
      */
     virtual void setKey(const CryptoKey &k);
 
+    /**
+     * Select the key for a slot (normally the channel index) and make it current.
+     *
+     * Engines keep a separately expanded key schedule per slot, so if this slot already holds k this just switches to it
+     * without redoing the (slow) key setup.  Otherwise the new key is installed with setKey().
+     */
+    void setKeyForSlot(uint8_t slot, const CryptoKey &k);
+
     /**
      * Encrypt a packet
      *
@@ -49,6 +104,40 @@ class CryptoEngine
     virtual void encrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes);
     virtual void decrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes);
 
+    /**
+     * Encrypt several packets with the current key, for bulk senders which have them all in hand at once.  Engines which
+     * can do better than one encrypt() after another (logging, locking and setting up their hardware once for the lot)
+     * override this.
+     */
+    virtual void encryptBatch(const CryptoJob *jobs, size_t numJobs);
+    virtual void decryptBatch(const CryptoJob *jobs, size_t numJobs);
+
+    /**
+     * Work out the keystream packetId from fromNode will be encrypted with under the current key, for when it's sent.  Call
+     * when there's time to spare, for the packet ids we're about to hand out.
+     *
+     * @return false if there was nothing to do (we already have it, or there's no key)
+     */
+    bool precomputeKeystream(uint32_t fromNode, uint64_t packetId);
+
+    /**
+     * Encrypt a packet with keystream precomputeKeystream() already worked out for it under the current key
+     *
+     * @return false if we don't have it (or not enough of it), and the packet must go through encrypt()
+     */
+    bool encryptPrecomputed(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes);
+
+    /// @return true (once) if encryptPrecomputed() used up some keystream since we last asked, so it's time to top up
+    bool takeKeystreamUsed()
+    {
+        bool used = keystreamUsed;
+        keystreamUsed = false;
+        return used;
+    }
+
+    uint32_t getKeystreamHits() const { return keystreamHits; }
+    uint32_t getKeystreamMisses() const { return keystreamMisses; }
+
   protected:
     /**
      * Init our 128 bit nonce for a new packet
@@ -0,0 +1,248 @@
+#include "ExtendedNodeDB.h"
+#include "configuration.h"
+#include "memGet.h"
+#include <stdlib.h>
+
+#if NODEDB_EXTENDED_FLASH
+#include "FSCommon.h"
+
+static const char *extendedFileName = "/prefs/extnodes.dat";
+#endif
+
+static_assert(NODEDB_EXTENDED_NODES < UINT16_MAX, "NODEDB_EXTENDED_NODES is too big for our index");
+
+/// Our tables go where MEMGET_PLACE_NODEDB says, PSRAM where we have it
+static void *allocTable(size_t num, size_t size)
+{
+    return memGet.place(HEAP_SITE_NODEDB, num * size, true);
+}
+
+bool ExtendedNodeDB::init()
+{
+#if NODEDB_EXTENDED_NODES
+    // Keep the index at most half full, so probe runs stay short
+    uint32_t indexSize = 1;
+    while (indexSize < NODEDB_EXTENDED_NODES * 2)
+        indexSize <<= 1;
+
+    summaries = static_cast<Summary *>(allocTable(NODEDB_EXTENDED_NODES, sizeof(Summary)));
+    index = static_cast<uint16_t *>(allocTable(indexSize, sizeof(uint16_t)));
+    freeRecords = static_cast<uint16_t *>(allocTable(NODEDB_EXTENDED_NODES, sizeof(uint16_t)));
+    size_t bytes = NODEDB_EXTENDED_NODES * (sizeof(Summary) + sizeof(uint16_t)) + indexSize * sizeof(uint16_t);
+    bool okay = summaries && index && freeRecords;
+#if !NODEDB_EXTENDED_FLASH
+    nodes = static_cast<meshtastic_NodeInfoLite *>(allocTable(NODEDB_EXTENDED_NODES, sizeof(meshtastic_NodeInfoLite)));
+    bytes += NODEDB_EXTENDED_NODES * sizeof(meshtastic_NodeInfoLite);
+    okay = okay && nodes;
+    if (!okay) {
+        memGet.unplace(nodes);
+        nodes = NULL;
+    }
+#endif
+    if (!okay) {
+        LOG_WARN("No room for an extended NodeDB of %u nodes\n", NODEDB_EXTENDED_NODES);
+        memGet.unplace(summaries);
+        memGet.unplace(index);
+        memGet.unplace(freeRecords);
+        summaries = NULL;
+        index = NULL;
+        freeRecords = NULL;
+        return false;
+    }
+
+    capacity = NODEDB_EXTENDED_NODES;
+    indexMask = indexSize - 1;
+    clear();
+    LOG_INFO("Extended NodeDB holds up to %u nodes (%u bytes resident)\n", capacity, bytes);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int32_t ExtendedNodeDB::findSlot(NodeNum n) const
+{
+    if (!capacity)
+        return -1;
+
+    for (uint32_t i = indexSlot(n);; i = (i + 1) & indexMask) {
+        uint16_t entry = index[i];
+        if (!entry)
+            return -1; // hit the end of the probe run
+        if (summaries[entry - 1].num == n)
+            return i;
+    }
+}
+
+#if NODEDB_EXTENDED_FLASH
+meshtastic_NodeInfoLite *ExtendedNodeDB::readRecord(uint16_t record)
+{
+    bool okay = false;
+#ifdef FSCom
+    auto f = FSCom.open(extendedFileName, FILE_O_READ);
+    if (f) {
+        okay = f.seek(record * sizeof(faulted)) && f.read((uint8_t *)&faulted, sizeof(faulted)) == (int)sizeof(faulted);
+        f.close();
+    }
+#endif
+    if (!okay) {
+        LOG_ERROR("Error: can't read extended node record %u\n", record);
+        return NULL;
+    }
+    return &faulted;
+}
+
+bool ExtendedNodeDB::writeRecord(uint16_t record, const meshtastic_NodeInfoLite &n)
+{
+    bool okay = false;
+#ifdef FSCom
+    // Our records are only ever read back by this boot of this firmware, so they are just the raw struct
+    auto f = FSCom.open(extendedFileName, numFileRecords ? FILE_O_PATCH : FILE_O_WRITE);
+    if (f) {
+        okay = f.seek(record * sizeof(n)) && f.write((const uint8_t *)&n, sizeof(n)) == sizeof(n);
+        f.close();
+    }
+#endif
+    if (!okay) {
+        LOG_ERROR("Error: can't write extended node record %u\n", record);
+        return false;
+    }
+    if (record == numFileRecords)
+        numFileRecords++;
+    return true;
+}
+#else
+meshtastic_NodeInfoLite *ExtendedNodeDB::readRecord(uint16_t record)
+{
+    return &nodes[record];
+}
+
+bool ExtendedNodeDB::writeRecord(uint16_t record, const meshtastic_NodeInfoLite &n)
+{
+    nodes[record] = n;
+    return true;
+}
+#endif
+
+meshtastic_NodeInfoLite *ExtendedNodeDB::find(NodeNum n)
+{
+    int32_t slot = findSlot(n);
+    return (slot < 0) ? NULL : readRecord(summaries[index[slot] - 1].record);
+}
+
+const ExtendedNodeDB::Summary *ExtendedNodeDB::getSummary(NodeNum n) const
+{
+    int32_t slot = findSlot(n);
+    return (slot < 0) ? NULL : &summaries[index[slot] - 1];
+}
+
+void ExtendedNodeDB::removeAt(uint32_t i)
+{
+    freeRecords[numFreeRecords++] = summaries[i].record;
+
+    // Backward shift deletion (no tombstones), see PacketHistory::removeSlot()
+    uint32_t s = findSlot(summaries[i].num), j = s;
+    for (;;) {
+        j = (j + 1) & indexMask;
+        if (!index[j])
+            break;
+
+        uint32_t k = indexSlot(summaries[index[j] - 1].num);
+        bool stays = (s <= j) ? (s < k && k <= j) : (s < k || k <= j);
+        if (!stays) {
+            index[s] = index[j];
+            s = j;
+        }
+    }
+    index[s] = 0;
+
+    // Swap the last summary into the hole, its record stays where it is
+    uint32_t last = numNodes - 1;
+    if (i != last) {
+        int32_t slot = findSlot(summaries[last].num);
+        summaries[i] = summaries[last];
+        index[slot] = i + 1;
+    }
+    numNodes--;
+}
+
+NodeNum ExtendedNodeDB::add(const meshtastic_NodeInfoLite &n, uint32_t generation)
+{
+    NodeNum forgotten = 0;
+    if (!capacity || !n.num)
+        return forgotten;
+
+    int32_t slot = findSlot(n.num);
+    if (slot >= 0)
+        removeAt(index[slot] - 1); // replaced below, with the summary brought up to date
+
+    if (numNodes >= capacity) {
+        // Make room by replacing whichever of a few nodes we heard from longest ago
+        uint32_t victim = replaceHand % numNodes;
+        for (uint32_t k = 1; k < REPLACE_SAMPLES; k++) {
+            uint32_t j = (replaceHand + k) % numNodes;
+            if (summaries[j].last_heard < summaries[victim].last_heard)
+                victim = j;
+        }
+        replaceHand = (replaceHand + REPLACE_SAMPLES) % capacity;
+        LOG_DEBUG("Extended NodeDB full, forgetting node 0x%x (last heard %u)\n", summaries[victim].num,
+                  summaries[victim].last_heard);
+        forgotten = summaries[victim].num;
+        removeAt(victim);
+    }
+
+    uint16_t record = freeRecords[numFreeRecords - 1];
+    if (!writeRecord(record, n))
+        return n.num; // we lose this node (and our caller mostly cares about that one), but what we had stays consistent
+    numFreeRecords--;
+
+    summaries[numNodes] = Summary{n.num, n.last_heard, generation, record, n.channel, n.has_user};
+    uint32_t i = indexSlot(n.num);
+    while (index[i]) // we are never more than half full, so there is always an empty slot
+        i = (i + 1) & indexMask;
+    index[i] = ++numNodes;
+    return forgotten;
+}
+
+bool ExtendedNodeDB::take(NodeNum n, meshtastic_NodeInfoLite *out)
+{
+    int32_t slot = findSlot(n);
+    if (slot < 0)
+        return false;
+
+    uint32_t i = index[slot] - 1;
+    const meshtastic_NodeInfoLite *found = readRecord(summaries[i].record);
+    if (found)
+        *out = *found;
+    removeAt(i);
+    return found != NULL;
+}
+
+void ExtendedNodeDB::remove(NodeNum n)
+{
+    int32_t slot = findSlot(n);
+    if (slot >= 0)
+        removeAt(index[slot] - 1);
+}
+
+void ExtendedNodeDB::clear()
+{
+    if (!capacity)
+        return;
+
+    numNodes = 0;
+    memset(index, 0, (indexMask + 1) * sizeof(uint16_t));
+
+    // Hand out the lowest records first
+    numFreeRecords = capacity;
+    for (uint32_t i = 0; i < capacity; i++)
+        freeRecords[i] = capacity - 1 - i;
+
+#if NODEDB_EXTENDED_FLASH
+    numFileRecords = 0;
+#ifdef FSCom
+    if (FSCom.exists(extendedFileName))
+        FSCom.remove(extendedFileName);
+#endif
+#endif
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "mesh/generated/meshtastic/deviceonly.pb.h"
+
+/// How many nodes the extended NodeDB tier can hold, 0 to leave it out.  On by default where we have PSRAM to put it in, or
+/// (with NODEDB_EXTENDED_FLASH) where RAM is tight but flash isn't.
+#ifndef NODEDB_EXTENDED_NODES
+#if defined(ARCH_ESP32) && defined(BOARD_HAS_PSRAM)
+#define NODEDB_EXTENDED_NODES 3000
+#elif defined(ARCH_NRF52)
+#define NODEDB_EXTENDED_NODES 400
+#else
+#define NODEDB_EXTENDED_NODES 0
+#endif
+#endif
+
+/// Page the extended tier's nodes out to a file, keeping only a Summary of each in RAM
+#ifndef NODEDB_EXTENDED_FLASH
+#ifdef ARCH_NRF52
+#define NODEDB_EXTENDED_FLASH 1
+#else
+#define NODEDB_EXTENDED_FLASH 0
+#endif
+#endif
+
+/**
+ * The second tier of our NodeDB: nodes which were evicted from NodeDB's own (small, saved to flash) table end up here rather
+ * than being forgotten, and move back up as soon as we hear from them again.  So a big mesh doesn't keep churning through the
+ * NodeDB, losing names and positions of nodes we only hear from now and then.
+ *
+ * Every node has a resident Summary, which is all that routing decisions need.  The whole NodeInfoLite lives in a record,
+ * either in PSRAM or (with NODEDB_EXTENDED_FLASH) in a file, from which it is read back whenever someone asks for it.  Never
+ * carried over a reboot, and of a fixed size: once it is full, the node we heard from longest ago of a few samples makes
+ * room for a new one.  Lookups go through an open addressing (linear probing) index, like NodeDB's own.
+ */
+class ExtendedNodeDB
+{
+  public:
+    /// What we keep resident for every node
+    struct Summary {
+        NodeNum num;
+        uint32_t last_heard;
+        uint32_t generation; // NodeDB's generation when the node last changed
+        uint16_t record;     // where its NodeInfoLite lives
+        uint8_t channel;
+        bool has_user;
+    };
+
+  private:
+    /// How many nodes we look at when picking one to replace
+    static const uint32_t REPLACE_SAMPLES = 8;
+
+    Summary *summaries = NULL;
+    uint32_t capacity = 0, numNodes = 0;
+
+    /// NodeNum to 1 + its index in summaries, 0 marks an empty slot
+    uint16_t *index = NULL;
+    uint32_t indexMask = 0;
+
+    /// Records nobody is using, a stack so we reuse the ones we wrote most recently
+    uint16_t *freeRecords = NULL;
+    uint32_t numFreeRecords = 0;
+
+    /// Where our next search for a node to replace starts
+    uint32_t replaceHand = 0;
+
+#if NODEDB_EXTENDED_FLASH
+    /// How many records our file holds, records are handed out lowest first so the file only ever grows by one at a time
+    uint32_t numFileRecords = 0;
+
+    /// The last node we read back from our file
+    meshtastic_NodeInfoLite faulted;
+#else
+    meshtastic_NodeInfoLite *nodes = NULL;
+#endif
+
+    uint32_t indexSlot(NodeNum n) const { return (uint32_t)(n * 2654435761UL) & indexMask; }
+
+    /// @return the index slot holding n, or -1 if it's not there
+    int32_t findSlot(NodeNum n) const;
+
+    /// Remove summaries[i] (freeing its record), moving the last node into its place
+    void removeAt(uint32_t i);
+
+    /// @return the node in a record, or NULL if we couldn't read it.  A node read from our file stays valid until the next read
+    meshtastic_NodeInfoLite *readRecord(uint16_t record);
+
+    bool writeRecord(uint16_t record, const meshtastic_NodeInfoLite &n);
+
+  public:
+    /// Allocate our tables (in PSRAM where we have it), @return false if the tier is left out or there's no room for it
+    bool init();
+
+    /// @return the node, or NULL if we don't have it.  With NODEDB_EXTENDED_FLASH this reads flash (so isn't ISR safe) and the
+    /// node is only valid until our next read, use getSummary() when that is all you need
+    meshtastic_NodeInfoLite *find(NodeNum n);
+
+    /// @return the resident summary of a node, or NULL if we don't have it.  Never touches flash
+    const Summary *getSummary(NodeNum n) const;
+
+    /// Keep a copy of a node evicted from NodeDB, which last changed at NodeDB generation.  @return the node we forgot to make
+    /// room for it (or n itself, if we couldn't store it), or 0 if we didn't forget any
+    NodeNum add(const meshtastic_NodeInfoLite &n, uint32_t generation = 0);
+
+    /// If we have n, copy it to out and forget it (it's moving back to NodeDB).  @return true if we had it
+    bool take(NodeNum n, meshtastic_NodeInfoLite *out);
+
+    void remove(NodeNum n);
+
+    void clear();
+
+    size_t getNumNodes() const { return numNodes; }
+
+    /// For walking through all our nodes, i < getNumNodes().  Valid until the next read, like find()
+    const meshtastic_NodeInfoLite *getByIndex(size_t i) { return readRecord(summaries[i].record); }
+
+    /// @return the NodeDB generation when the node getByIndex(i) last changed
+    uint32_t getGeneration(size_t i) const { return summaries[i].generation; }
+};
@@ -1,4 +1,8 @@
 #include "FloodingRouter.h"
+#include "Metrics.h"
+#include "NextHopTable.h"
+#include "NodeDB.h"
+#include "RadioStats.h"
 #include "configuration.h"
 #include "mesh-pb-constants.h"
 
@@ -12,27 +16,199 @@ FloodingRouter::FloodingRouter() {}
 ErrorCode FloodingRouter::send(meshtastic_MeshPacket *p)
 {
     // Add any messages _we_ send to the seen message list (so we will ignore all retransmissions we see)
-    wasSeenRecently(p); // FIXME, move this to a sniffSent method
+    bool isRetry = wasSeenRecently(p); // FIXME, move this to a sniffSent method
+
+    NodeNum from = getFrom(p);
+    if (isRetry && nextHops.isRouted(from, p->id)) {
+        // Our routed try went unacked, so that route is probably stale: forget it and let the retries flood
+        LOG_INFO("No ack along our route to 0x%x, flooding instead\n", p->to);
+        nextHops.setRouted(from, p->to, p->id, false);
+        nextHops.forgetRoute(from, p->to);
+    }
+#if USE_HOP_DISTANCE_LIMIT
+    if (isRetry && from == getNodeNum() && p->to != NODENUM_BROADCAST)
+        nodeDB.forgetHopsAway(p->to); // it went unacked, so it may be further away than we thought
+#endif
+#if USE_NEXT_HOP_ROUTING
+    // Only reliable DMs, so there is always a flooded retry to fall back on
+    else if (!isRetry && p->want_ack && p->to != NODENUM_BROADCAST && p->id && nextHops.hasRoute(p->to)) {
+        LOG_DEBUG("Sending along our route to 0x%x\n", p->to);
+        nextHops.setRouted(from, p->to, p->id, true);
+    }
+#endif
+#if USE_HOP_DISTANCE_LIMIT
+    // Our own reliable DMs need only go as far as their destination is.  ReliableRouter kept its copy for the retries before
+    // we got here, so those still get the whole hop limit.  Anything without want_ack (acks included) gets no second try, so
+    // it always gets the whole limit too
+    if (!isRetry && p->want_ack && from == getNodeNum() && p->to != NODENUM_BROADCAST) {
+        uint8_t hopLimit = nodeDB.getHopLimitFor(p->to, p->hop_limit);
+        if (hopLimit < p->hop_limit) {
+            LOG_DEBUG("0x%x is near, hop_limit %u rather than %u\n", p->to, hopLimit, p->hop_limit);
+            p->hop_limit = hopLimit;
+        }
+    }
+#endif
 
     return Router::send(p);
 }
 
+Router::CutThroughAction FloodingRouter::checkCutThrough(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi)
+{
+    // Only our header says a packet is routed, note it so we keep the flag if we pass the packet on
+    if (h->to != NODENUM_BROADCAST)
+        nextHops.setRouted(h->from, h->to, h->id, h->flags & PACKET_FLAGS_ROUTED_MASK);
+
+    if (config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER ||
+        config.device.rebroadcast_mode != meshtastic_Config_DeviceConfig_RebroadcastMode_ALL_SKIP_DECODING) {
+        // We might want to look inside, use the normal path unless we've seen it already
+        return dropHeardDuplicate(h, payloadLen, snr, rssi) ? CUT_THROUGH_DROP : CUT_THROUGH_NONE;
+    }
+
+    // The same filters handleReceived() and shouldFilterReceived() would apply, but using only the header
+    bool viaMqtt = !!(h->flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    if (is_in_repeated(config.lora.ignore_incoming, h->from) || (config.lora.ignore_mqtt && viaMqtt)) {
+        LOG_DEBUG("Ignoring incoming message, 0x%x is in our ignore list or came via MQTT\n", h->from);
+        return CUT_THROUGH_DROP;
+    }
+
+    if (h->id == 0) {
+        LOG_DEBUG("Ignoring a simple (0 id) broadcast\n");
+        return CUT_THROUGH_DROP;
+    }
+
+    bool isDuplicate = wasSeenRecently(h->from, h->id); // Note: this will also add a recent packet record
+    if (isDuplicate && !nextHops.takeReflood(h->from, h->id)) {
+        metrics.count(Metrics::RX_DUPLICATE);
+        LOG_DEBUG("Ignoring incoming msg fr=0x%x,id=0x%x, because we've already seen it\n", h->from, h->id);
+        return CUT_THROUGH_DROP;
+    }
+
+    // Nothing to pass on, and a repeater has no use for it itself
+    if ((h->flags & PACKET_FLAGS_HOP_MASK) == 0 || h->to == getNodeNum() || h->from == getNodeNum())
+        return CUT_THROUGH_DROP;
+
+    return CUT_THROUGH_REBROADCAST;
+}
+
+bool FloodingRouter::dropHeardDuplicate(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi)
+{
+#if FLOOD_EARLY_DUPLICATE_DROP
+    // Ones we would ignore anyway, our own coming back (ReliableRouter's implicit acks) and those we kept quiet for while
+    // they were routed (we may have to pass them on now) go the full way, as does everything we haven't seen
+    bool viaMqtt = !!(h->flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    if (h->id == 0 || h->from == getNodeNum() || is_in_repeated(config.lora.ignore_incoming, h->from) ||
+        (config.lora.ignore_mqtt && viaMqtt) || !wasSeenRecently(h->from, h->id, false) || nextHops.mayReflood(h->from, h->id))
+        return false;
+
+    wasSeenRecently(h->from, h->id); // freshen its record, as shouldFilterReceived() would
+    if (iface)
+        iface->getContention().onReceived(true);
+    metrics.count(Metrics::RX_DUPLICATE);
+    countDuplicate(h->from, h->id, snr, rssi);
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool FloodingRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
 {
-    if (wasSeenRecently(p)) { // Note: this will also add a recent packet record
+    bool isDuplicate = wasSeenRecently(p); // Note: this will also add a recent packet record
+    if (isDuplicate && nextHops.takeReflood(getFrom(p), p->id)) {
+        // We kept quiet for the routed copy, but its sender has given up on that route and is flooding it now
+        printPacket("Passing on msg we didn't relay while it was routed", p);
+        isDuplicate = false;
+    }
+    if (iface)
+        iface->getContention().onReceived(isDuplicate);
+
+    if (isDuplicate) {
         printPacket("Ignoring incoming msg, because we've already seen it", p);
-        if (!moduleConfig.mqtt.enabled && config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER &&
-            config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT &&
-            config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER) {
-            // cancel rebroadcast of this message *if* there was already one, unless we're a router/repeater!
-            Router::cancelSending(p->from, p->id);
-        }
+        metrics.count(Metrics::RX_DUPLICATE);
+        countDuplicate(getFrom(p), p->id, p->rx_snr, p->rx_rssi);
         return true;
     }
 
     return Router::shouldFilterReceived(p);
 }
 
+FloodingRouter::SuppressionPolicy FloodingRouter::getSuppressionPolicy()
+{
+    if (moduleConfig.mqtt.enabled)
+        return SuppressionPolicy{0, FLOOD_SUPPRESS_SNR_NEVER}; // as ever, gateways always rebroadcast
+
+    switch (config.device.role) {
+    case meshtastic_Config_DeviceConfig_Role_ROUTER:
+    case meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT:
+    case meshtastic_Config_DeviceConfig_Role_REPEATER:
+        return SuppressionPolicy{FLOOD_SUPPRESS_ROUTER_DUPLICATES, FLOOD_SUPPRESS_ROUTER_SNR};
+    default:
+        return SuppressionPolicy{FLOOD_SUPPRESS_CLIENT_DUPLICATES, FLOOD_SUPPRESS_CLIENT_SNR};
+    }
+}
+
+void FloodingRouter::countDuplicate(NodeNum from, PacketId id, float snr, int32_t rssi)
+{
+    PendingRebroadcast *r = NULL;
+    for (PendingRebroadcast &i : pendingRebroadcasts)
+        if (i.from == from && i.id == id)
+            r = &i;
+    if (!r)
+        return; // we never meant to rebroadcast it, or already gave up on that
+
+    SuppressionPolicy policy = getSuppressionPolicy();
+    r->numDuplicates++;
+    bool haveEnough = policy.maxDuplicates && r->numDuplicates >= policy.maxDuplicates;
+    bool isStrong = (snr != 0 || rssi != 0) && snr >= policy.minSnr; // only if it came over our radio
+    if (!haveEnough && !isStrong) {
+        LOG_DEBUG("Heard %u duplicate(s) of fr=0x%x,id=0x%x, still rebroadcasting it\n", r->numDuplicates, from, id);
+        return;
+    }
+
+    uint32_t airtimeMsec = 0;
+    if (Router::cancelSending(from, id, &airtimeMsec)) {
+        numSuppressed++;
+        suppressedAirtimeMsec += airtimeMsec;
+        LOG_DEBUG("Cancelled our rebroadcast of fr=0x%x,id=0x%x after %u duplicate(s), the last at snr %.1f, saving %ums airtime "
+                  "(%u of %u rebroadcasts cancelled, %ums saved so far)\n",
+                  from, id, r->numDuplicates, snr, airtimeMsec, numSuppressed, numRebroadcasts, suppressedAirtimeMsec);
+    }
+    r->from = 0; // either way we're done with it (it may well have gone out already)
+}
+
+bool FloodingRouter::isRateLimited(NodeNum from)
+{
+#if FLOOD_RATE_LIMIT_PER_MINUTE
+    uint32_t now = millis();
+
+    // Our bucket for from, or else we take over the one which has waited longest (it would be full again by now anyway)
+    RateBucket *b = NULL, *oldest = &rateBuckets[0];
+    for (RateBucket &i : rateBuckets) {
+        if (i.from == from) {
+            b = &i;
+            break;
+        }
+        if (now - i.lastMsec > now - oldest->lastMsec)
+            oldest = &i;
+    }
+    if (!b) {
+        b = oldest;
+        b->from = from;
+        b->tokens = FLOOD_RATE_LIMIT_BURST;
+    } else {
+        b->tokens += (now - b->lastMsec) * (FLOOD_RATE_LIMIT_PER_MINUTE / 60000.0f);
+        if (b->tokens > FLOOD_RATE_LIMIT_BURST)
+            b->tokens = FLOOD_RATE_LIMIT_BURST;
+    }
+    b->lastMsec = now;
+
+    if (b->tokens < 1)
+        return true;
+    b->tokens -= 1;
+#endif
+    return false;
+}
+
 void FloodingRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Routing *c)
 {
     bool isAck =
@@ -42,28 +218,53 @@ void FloodingRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
         LOG_DEBUG("Receiving an ACK not for me, but don't need to rebroadcast this direct message anymore.\n");
         Router::cancelSending(p->to, p->decoded.request_id); // cancel rebroadcast for this DM
     }
+    if (isAck)
+        nextHops.noteAck(p); // the route it came back on works, and we may be on it
+    if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag && p->decoded.request_id && traceRouteModule &&
+        traceRouteModule->wantPacket(p))
+        traceRouteModule->updateNextHops(p);
+
     if ((p->to != getNodeNum()) && (p->hop_limit > 0) && (getFrom(p) != getNodeNum())) {
         if (p->id != 0) {
-            if (config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE) {
-                meshtastic_MeshPacket *tosend = packetPool.allocCopy(*p); // keep a copy because we will be sending it
-
-                tosend->hop_limit--; // bump down the hop count
-
-                if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-                    // If it is a traceRoute request, update the route that it went via me
-                    if (traceRouteModule && traceRouteModule->wantPacket(p))
-                        traceRouteModule->updateRoute(tosend);
-                    // If it is a neighborInfo packet, update last_sent_by_id
-                    if (neighborInfoModule && neighborInfoModule->wantPacket(p))
-                        neighborInfoModule->updateLastSentById(tosend);
-                }
-
-                LOG_INFO("Rebroadcasting received floodmsg to neighbors\n");
-                // Note: we are careful to resend using the original senders node id
-                // We are careful not to call our hooked version of send() - because we don't want to check this again
-                Router::send(tosend);
-            } else {
+            NodeNum from = getFrom(p);
+            if (p->to != NODENUM_BROADCAST && nextHops.isRouted(from, p->id) && !nextHops.shouldRelay(from, p->to)) {
+                LOG_DEBUG("Not rebroadcasting a routed DM, we're not on its route\n");
+                nextHops.noteSuppressed(from, p->id);
+            } else if (config.device.role == meshtastic_Config_DeviceConfig_Role_CLIENT_MUTE) {
                 LOG_DEBUG("Not rebroadcasting. Role = Role_ClientMute\n");
+            } else if (isRateLimited(from)) {
+                LOG_INFO("Not rebroadcasting fr=0x%x,id=0x%x, that node is over its rebroadcast rate limit\n", from, p->id);
+                radioStats.countError(RadioStats::TX_RATE_LIMITED);
+            } else {
+                meshtastic_MeshPacket *tosend = packetPool.tryAllocCopy(*p); // keep a copy because we will be sending it
+                if (!tosend) {
+                    // Rebroadcasts are the first thing we give up on when short of packet buffers
+                    LOG_WARN("packetPool is running low, not rebroadcasting\n");
+                } else {
+                    tosend->hop_limit--; // bump down the hop count
+
+                    if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+                        // If it is a traceRoute request, update the route that it went via me
+                        if (traceRouteModule && traceRouteModule->wantPacket(p))
+                            traceRouteModule->updateRoute(tosend);
+                        // If it is a neighborInfo packet, update last_sent_by_id
+                        if (neighborInfoModule && neighborInfoModule->wantPacket(p))
+                            neighborInfoModule->updateLastSentById(tosend);
+                    }
+
+                    if (p->to != NODENUM_BROADCAST && p->want_ack)
+                        nextHops.noteRelayed(p); // if its ack comes back, we're on the route
+
+                    LOG_INFO("Rebroadcasting received floodmsg to neighbors\n");
+                    // Note: we are careful to resend using the original senders node id
+                    // We are careful not to call our hooked version of send() - because we don't want to check this again
+                    Router::send(tosend);
+
+                    // Keep count of the duplicates we hear while it waits, see countDuplicate()
+                    pendingRebroadcasts[nextPendingRebroadcast] = PendingRebroadcast{from, p->id, 0};
+                    nextPendingRebroadcast = (nextPendingRebroadcast + 1) % MAX_TX_QUEUE;
+                    numRebroadcasts++;
+                }
             }
         } else {
             LOG_DEBUG("Ignoring a simple (0 id) broadcast\n");
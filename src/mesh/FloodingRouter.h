@@ -5,6 +5,58 @@
 #include "modules/NeighborInfoModule.h"
 #include "modules/TraceRouteModule.h"
 
+/// A FLOOD_SUPPRESS_*_SNR which no duplicate can reach
+#define FLOOD_SUPPRESS_SNR_NEVER 127
+
+// Which set of the FLOOD_SUPPRESS_* defaults below a deployment gets, picked with -DFLOOD_SUPPRESS_POLICY=... (any of them
+// can still be set on its own)
+//  - FLOOD_SUPPRESS_POLICY_CLASSIC: a client cancels its rebroadcast on the first duplicate it hears, routers and repeaters
+//    never do, just as before suppression could be tuned
+//  - FLOOD_SUPPRESS_POLICY_DENSE: for busy meshes, where a client waits for a second duplicate (or one strong one) and routers
+//    for a fourth, so fewer rebroadcasts are cancelled by a single distant node
+#define FLOOD_SUPPRESS_POLICY_CLASSIC 0
+#define FLOOD_SUPPRESS_POLICY_DENSE 1
+#ifndef FLOOD_SUPPRESS_POLICY
+#define FLOOD_SUPPRESS_POLICY FLOOD_SUPPRESS_POLICY_CLASSIC
+#endif
+
+// While our rebroadcast of a packet waits out its delay, a client cancels it once it has heard this many other nodes
+// rebroadcast the same packet, or as soon as it hears one of them at least this strong (dB, they cover about what we would)
+#ifndef FLOOD_SUPPRESS_CLIENT_DUPLICATES
+#define FLOOD_SUPPRESS_CLIENT_DUPLICATES (FLOOD_SUPPRESS_POLICY == FLOOD_SUPPRESS_POLICY_DENSE ? 2 : 1)
+#endif
+#ifndef FLOOD_SUPPRESS_CLIENT_SNR
+#define FLOOD_SUPPRESS_CLIENT_SNR 8
+#endif
+
+// The same for routers, router clients and repeaters.  They are placed to reach where others can't, so they want more
+// duplicates and don't care how strong those are.  0 duplicates means never cancel
+#ifndef FLOOD_SUPPRESS_ROUTER_DUPLICATES
+#define FLOOD_SUPPRESS_ROUTER_DUPLICATES (FLOOD_SUPPRESS_POLICY == FLOOD_SUPPRESS_POLICY_DENSE ? 4 : 0)
+#endif
+#ifndef FLOOD_SUPPRESS_ROUTER_SNR
+#define FLOOD_SUPPRESS_ROUTER_SNR FLOOD_SUPPRESS_SNR_NEVER
+#endif
+
+// Optionally cap how many of any one node's packets we rebroadcast: each originator gets a token bucket which refills at
+// FLOOD_RATE_LIMIT_PER_MINUTE packets a minute up to FLOOD_RATE_LIMIT_BURST.  Off (0) by default, as the TX queue already
+// shares our airtime fairly between originators (see MeshPacketQueue)
+#ifndef FLOOD_RATE_LIMIT_PER_MINUTE
+#define FLOOD_RATE_LIMIT_PER_MINUTE 0
+#endif
+#ifndef FLOOD_RATE_LIMIT_BURST
+#define FLOOD_RATE_LIMIT_BURST 10
+#endif
+
+/// Drop the packets we know we've seen from their raw header, before the interface allocates, copies, logs or queues them.
+/// Those which still need the full path (our own coming back, ones we may have to reflood) take it as before
+#ifndef FLOOD_EARLY_DUPLICATE_DROP
+#define FLOOD_EARLY_DUPLICATE_DROP 1
+#endif
+
+/// Originators we keep a rate limit bucket for, the one idle longest makes room for a new one
+#define FLOOD_RATE_LIMIT_NODES 16
+
 /**
  * This is a mixin that extends Router with the ability to do Naive Flooding (in the standard mesh protocol sense)
  *
@@ -27,10 +79,53 @@
 
   Any entries in recentBroadcasts that are older than X seconds (longer than the
   max time a flood can take) will be discarded.
+
+  While our rebroadcast waits for its turn we count the duplicates we hear, and once enough of our neighbours have
+  rebroadcast it (see SuppressionPolicy) we cancel ours, as it would hardly reach anyone new.
  */
 class FloodingRouter : public Router, protected PacketHistory
 {
   private:
+    /// When to give up on our pending rebroadcast of a packet, per role (see getSuppressionPolicy())
+    struct SuppressionPolicy {
+        uint8_t maxDuplicates; // cancel once we have heard this many, 0 for never
+        int8_t minSnr;         // or as soon as one is this strong, FLOOD_SUPPRESS_SNR_NEVER for never
+    };
+
+    /// A rebroadcast of ours which may still be waiting in a TX queue
+    struct PendingRebroadcast {
+        NodeNum from; // 0 for an unused entry
+        PacketId id;
+        uint8_t numDuplicates;
+    };
+
+    /// Oldest first, by the time we wrap around what's been overwritten has long since been sent
+    PendingRebroadcast pendingRebroadcasts[MAX_TX_QUEUE] = {};
+    uint8_t nextPendingRebroadcast = 0;
+
+    /// What suppression has saved us, for the log
+    uint32_t numRebroadcasts = 0, numSuppressed = 0, suppressedAirtimeMsec = 0;
+
+#if FLOOD_RATE_LIMIT_PER_MINUTE
+    struct RateBucket {
+        NodeNum from; // 0 for an unused bucket
+        uint32_t lastMsec;
+        float tokens; // rebroadcasts from's packets may still have
+    };
+
+    RateBucket rateBuckets[FLOOD_RATE_LIMIT_NODES] = {};
+#endif
+
+    /// @return true if we should not rebroadcast this packet from from, because of FLOOD_RATE_LIMIT_PER_MINUTE (and if not,
+    /// take its token)
+    bool isRateLimited(NodeNum from);
+
+    static SuppressionPolicy getSuppressionPolicy();
+
+    /// We heard someone else rebroadcast from's packet id (at snr and rssi, both 0 if not over our radio), cancel our own
+    /// rebroadcast of it if that makes enough of them
+    void countDuplicate(NodeNum from, PacketId id, float snr, int32_t rssi);
+
   public:
     /**
      * Constructor
@@ -45,7 +140,20 @@ class FloodingRouter : public Router, protected PacketHistory
      */
     virtual ErrorCode send(meshtastic_MeshPacket *p) override;
 
+    /**
+     * Drop duplicates from the raw header (see FLOOD_EARLY_DUPLICATE_DROP), and if we are a REPEATER which never decodes, do
+     * all of our filtering and dedupe there so the interface can drop or rebroadcast the packet without it ever going
+     * through the receive queue.
+     */
+    virtual CutThroughAction checkCutThrough(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi) override;
+
   protected:
+    /**
+     * Do what shouldFilterReceived() would for a received packet we have already seen, from its raw header.
+     * @return false if it isn't a duplicate, or one which needs the full path after all
+     */
+    virtual bool dropHeardDuplicate(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi);
+
     /**
      * Should this incoming filter be dropped?
      *
@@ -0,0 +1,263 @@
+#include "Geofence.h"
+#include "FSCommon.h"
+#include "configuration.h"
+#include "gps/GeoCoord.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(GEOFENCE_MAX_ZONES <= 16, "GEOFENCE_MAX_ZONES is too big for our membership masks");
+
+static const char *geofenceFileName = "/prefs/geofence.dat";
+
+/// What our file starts with, so zones a different build laid out differently aren't misread
+struct GeofenceFileHeader {
+    uint32_t magic;
+    uint16_t zoneSize;
+    uint8_t maxVertices;
+    uint8_t numZones;
+};
+#define GEOFENCE_FILE_MAGIC 0x47454f46 // "GEOF"
+
+#define METRES_PER_E7_LAT 0.011119f // 1e-7 degrees of latitude, on latLongToMeter()'s earth
+
+Geofence geofence;
+
+/// 1e-7 degrees from a to b the short way round, for longitudes
+static int64_t lonDelta(int32_t a, int32_t b)
+{
+    int64_t d = (int64_t)b - a;
+    if (d > 1800000000)
+        d -= 3600000000LL;
+    else if (d < -1800000000)
+        d += 3600000000LL;
+    return d;
+}
+
+Geofence::Geofence()
+{
+    clear();
+}
+
+void Geofence::clear()
+{
+    memset(inside, 0, sizeof(inside));
+    memset(known, 0, sizeof(known));
+}
+
+void Geofence::forget(uint16_t zoneMask)
+{
+    for (size_t i = 0; i < MAX_NUM_NODES; i++) {
+        inside[i] &= ~zoneMask;
+        known[i] &= ~zoneMask;
+    }
+}
+
+void Geofence::computeBox(size_t z)
+{
+    const GeofenceZone &zone = zones[z];
+    Box &b = boxes[z];
+    if (zone.shape == GEOFENCE_CIRCLE) {
+        b.lat = zone.lat;
+        b.lon = zone.lon;
+        b.halfLat = zone.radius / METRES_PER_E7_LAT + 1;
+        float cosLat = cosf(zone.lat * 1e-7f * (float)PI / 180);
+        b.halfLon = cosLat > 0.01f ? (uint32_t)std::min(b.halfLat / cosLat, 1800000000.0f) : 1800000000;
+        return;
+    }
+
+    // Corners relative to the first, so a polygon straddling the antimeridian still gets a small box
+    int64_t minLat = zone.vertices[0][0], maxLat = minLat, minLon = 0, maxLon = 0;
+    for (uint8_t v = 1; v < zone.numVertices; v++) {
+        int64_t dLon = lonDelta(zone.vertices[0][1], zone.vertices[v][1]);
+        minLat = std::min(minLat, (int64_t)zone.vertices[v][0]);
+        maxLat = std::max(maxLat, (int64_t)zone.vertices[v][0]);
+        minLon = std::min(minLon, dLon);
+        maxLon = std::max(maxLon, dLon);
+    }
+    b.lat = (minLat + maxLat) / 2;
+    b.halfLat = (maxLat - minLat) / 2 + 1;
+    int64_t lon = zone.vertices[0][1] + (minLon + maxLon) / 2;
+    b.lon = lon > 1800000000 ? lon - 3600000000LL : (lon < -1800000000 ? lon + 3600000000LL : lon);
+    b.halfLon = (maxLon - minLon) / 2 + 1;
+}
+
+bool Geofence::contains(const GeofenceZone &zone, int32_t lat, int32_t lon)
+{
+    if (zone.shape == GEOFENCE_CIRCLE)
+        return GeoCoord::distanceE7(zone.lat, zone.lon, lat, lon) <= zone.radius;
+
+    // Crossing number, with the corners relative to our point: an edge crosses the ray east from it iff its ends are either
+    // side of its latitude and it meets that latitude east of it.  Any polygon up to half the globe across keeps each
+    // product under 2^62
+    bool in = false;
+    for (uint8_t v = 0, w = zone.numVertices - 1; v < zone.numVertices; w = v++) {
+        int64_t yv = (int64_t)zone.vertices[v][0] - lat, yw = (int64_t)zone.vertices[w][0] - lat;
+        if ((yv > 0) == (yw > 0))
+            continue;
+        int64_t xv = lonDelta(lon, zone.vertices[v][1]), xw = lonDelta(lon, zone.vertices[w][1]);
+        int64_t cross = xv * yw - xw * yv; // which side of the edge we're on, times the sign of yw - yv
+        if ((cross > 0) == (yw > yv))
+            in = !in;
+    }
+    return in;
+}
+
+uint16_t Geofence::zonesAt(int32_t lat, int32_t lon) const
+{
+    uint16_t mask = 0;
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++) {
+        if (!zones[z].id)
+            continue;
+        const Box &b = boxes[z];
+        if ((uint32_t)std::abs((int64_t)lat - b.lat) > b.halfLat || (uint64_t)std::abs(lonDelta(b.lon, lon)) > b.halfLon)
+            continue; // the best part of every update stops here
+        if (contains(zones[z], lat, lon))
+            mask |= 1 << z;
+    }
+    return mask;
+}
+
+void Geofence::update(size_t i, NodeNum num, bool hasPosition, int32_t lat, int32_t lon)
+{
+    if (!hasPosition) {
+        remove(i); // we don't know where it is, which isn't leaving
+        return;
+    }
+
+    uint16_t now = zonesAt(lat, lon), live = 0;
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++)
+        if (zones[z].id)
+            live |= 1 << z;
+    uint16_t changed = (now ^ inside[i]) & known[i];
+    inside[i] = now;
+    known[i] = live;
+
+    for (size_t z = 0; changed; z++, changed >>= 1) {
+        if (!(changed & 1))
+            continue;
+        GeofenceEvent e = {num, &zones[z], (now & (1 << z)) != 0, lat, lon};
+        LOG_INFO("Geofence: node 0x%x %s zone %u (%s)\n", num, e.entered ? "entered" : "left", zones[z].id, zones[z].name);
+        notifyObservers(&e);
+    }
+}
+
+void Geofence::move(size_t from, size_t to)
+{
+    inside[to] = inside[from];
+    known[to] = known[from];
+    remove(from);
+}
+
+bool Geofence::isInside(size_t i, uint8_t id) const
+{
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++)
+        if (zones[z].id == id)
+            return inside[i] & (1 << z);
+    return false;
+}
+
+const GeofenceZone *Geofence::getZone(uint8_t id) const
+{
+    for (size_t z = 0; id && z < GEOFENCE_MAX_ZONES; z++)
+        if (zones[z].id == id)
+            return &zones[z];
+    return NULL;
+}
+
+bool Geofence::setZone(const GeofenceZone &zone)
+{
+    if (!zone.id || (zone.shape == GEOFENCE_POLYGON && (zone.numVertices < 3 || zone.numVertices > GEOFENCE_MAX_VERTICES)) ||
+        (zone.shape == GEOFENCE_CIRCLE && !zone.radius)) {
+        LOG_WARN("Geofence: zone %u is no good\n", zone.id);
+        return false;
+    }
+
+    int slot = -1;
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++) {
+        if (zones[z].id == zone.id) {
+            slot = z;
+            break;
+        }
+        if (!zones[z].id && slot < 0)
+            slot = z;
+    }
+    if (slot < 0) {
+        LOG_WARN("Geofence: no room for zone %u\n", zone.id);
+        return false;
+    }
+
+    zones[slot] = zone;
+    zones[slot].name[sizeof(zones[slot].name) - 1] = '\0';
+    computeBox(slot);
+    forget(1 << slot);
+    return saveToDisk();
+}
+
+bool Geofence::removeZone(uint8_t id)
+{
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++) {
+        if (zones[z].id == id) {
+            zones[z] = GeofenceZone();
+            forget(1 << z);
+            return saveToDisk();
+        }
+    }
+    return false;
+}
+
+void Geofence::loadFromDisk()
+{
+#ifdef FSCom
+    auto f = FSCom.open(geofenceFileName, FILE_O_READ);
+    if (!f)
+        return; // no zones yet
+    GeofenceFileHeader h;
+    bool okay = f.read((uint8_t *)&h, sizeof(h)) == (int)sizeof(h) && h.magic == GEOFENCE_FILE_MAGIC &&
+                h.zoneSize == sizeof(GeofenceZone) && h.maxVertices == GEOFENCE_MAX_VERTICES;
+    size_t loaded = 0;
+    for (size_t n = 0; okay && n < h.numZones && loaded < GEOFENCE_MAX_ZONES; n++) {
+        okay = f.read((uint8_t *)&zones[loaded], sizeof(GeofenceZone)) == (int)sizeof(GeofenceZone);
+        if (okay && zones[loaded].id)
+            computeBox(loaded++);
+    }
+    f.close();
+    for (size_t z = loaded; z < GEOFENCE_MAX_ZONES; z++)
+        zones[z] = GeofenceZone();
+    forget(0xFFFF);
+    if (!okay)
+        LOG_WARN("Geofence: can't read %s, kept %u zones\n", geofenceFileName, loaded);
+    else
+        LOG_INFO("Geofence: loaded %u zones\n", loaded);
+#endif
+}
+
+bool Geofence::saveToDisk()
+{
+#ifdef FSCom
+    bool okay = false;
+    // Our zones are only ever read back by a build with the same layout (see GeofenceFileHeader), so they are the raw structs
+    GeofenceFileHeader h = {GEOFENCE_FILE_MAGIC, sizeof(GeofenceZone), GEOFENCE_MAX_VERTICES, 0};
+    for (size_t z = 0; z < GEOFENCE_MAX_ZONES; z++)
+        if (zones[z].id)
+            h.numZones++;
+
+    FSCom.mkdir("/prefs");
+    if (FSCom.exists(geofenceFileName))
+        FSCom.remove(geofenceFileName); // not every platform's FILE_O_WRITE truncates
+    auto f = FSCom.open(geofenceFileName, FILE_O_WRITE);
+    if (f) {
+        okay = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+        for (size_t z = 0; okay && z < GEOFENCE_MAX_ZONES; z++)
+            if (zones[z].id)
+                okay = f.write((const uint8_t *)&zones[z], sizeof(GeofenceZone)) == sizeof(GeofenceZone);
+        f.close();
+    }
+    if (!okay)
+        LOG_ERROR("Error: can't write %s\n", geofenceFileName);
+    return okay;
+#else
+    return true; // nowhere to keep them, so they last until we reboot
+#endif
+}
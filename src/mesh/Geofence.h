@@ -0,0 +1,103 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "Observer.h"
+#include "mesh-pb-constants.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// How many zones we keep (at most 16, one bit each in our membership masks)
+#ifndef GEOFENCE_MAX_ZONES
+#define GEOFENCE_MAX_ZONES 8
+#endif
+
+/// The most corners a polygon zone can have
+#ifndef GEOFENCE_MAX_VERTICES
+#define GEOFENCE_MAX_VERTICES 12
+#endif
+
+enum GeofenceShape : uint8_t {
+    GEOFENCE_CIRCLE,  // radius metres around lat, lon
+    GEOFENCE_POLYGON, // inside numVertices corners
+};
+
+/// One zone, in 1e-7 degrees like meshtastic_PositionLite
+struct GeofenceZone {
+    uint8_t id = 0; // 1 and up, 0 for an empty slot
+    GeofenceShape shape = GEOFENCE_CIRCLE;
+    uint8_t numVertices = 0;
+    char name[17] = "";
+    int32_t lat = 0, lon = 0; // circle centre
+    uint32_t radius = 0;      // circle, metres
+    int32_t vertices[GEOFENCE_MAX_VERTICES][2] = {}; // polygon corners, lat then lon, in order (either way round)
+};
+
+/// What Geofence tells its observers: node went into (or out of) zone
+struct GeofenceEvent {
+    NodeNum node;
+    const GeofenceZone *zone;
+    bool entered;
+    int32_t lat, lon; // where node is now
+};
+
+/**
+ * Which of our zones each of NodeDB's meshNodes (by their index there, like NodeGeoIndex) is in, so modules can act on a node
+ * going into or out of one rather than loop over zones themselves.  NodeDB feeds us every position change; each zone has a
+ * bounding box to try first, which is all most updates cost, and polygons are tested in integer maths.  Zones are kept in
+ * their own file (there's no room for them in our protobuf config), set through setZone() and removeZone().
+ *
+ * A node's first position after boot (or after a zone changes) just tells us where it is, only changes from there are events.
+ */
+class Geofence : public Observable<const GeofenceEvent *>
+{
+    /// A zone's bounding box, as a centre and half extents (so it works across the antimeridian)
+    struct Box {
+        int32_t lat, lon;
+        uint32_t halfLat, halfLon;
+    };
+
+    GeofenceZone zones[GEOFENCE_MAX_ZONES];
+    Box boxes[GEOFENCE_MAX_ZONES];
+    uint16_t inside[MAX_NUM_NODES]; // a bit for each zone the node is in
+    uint16_t known[MAX_NUM_NODES];  // a bit for each zone we know whether the node is in
+
+    void computeBox(size_t z);
+    bool saveToDisk();
+
+    /// Every node's membership of zone z (a bit mask) is now unknown
+    void forget(uint16_t zoneMask);
+
+  public:
+    Geofence();
+
+    /// Read our zones back, once the filesystem is up
+    void loadFromDisk();
+
+    /// Add zone (or replace the one with its id), @return false if it's no good or we're full
+    bool setZone(const GeofenceZone &zone);
+    bool removeZone(uint8_t id);
+
+    /// @return the zone with id, NULL if there's none
+    const GeofenceZone *getZone(uint8_t id) const;
+
+    /// @return a bit (1 << slot) for each zone the point is in
+    uint16_t zonesAt(int32_t lat, int32_t lon) const;
+
+    /// @return whether the point is in zone (which needn't be one of ours)
+    static bool contains(const GeofenceZone &zone, int32_t lat, int32_t lon);
+
+    /// @return whether node i (in meshNodes) was in zone id at its last position
+    bool isInside(size_t i, uint8_t id) const;
+
+    /// Node i (which is num) has a new position, or no longer has one
+    void update(size_t i, NodeNum num, bool hasPosition, int32_t lat, int32_t lon);
+
+    void remove(size_t i) { inside[i] = known[i] = 0; }
+
+    /// Node from moved to index to in meshNodes (whatever was at to is gone)
+    void move(size_t from, size_t to);
+
+    void clear();
+};
+
+extern Geofence geofence;
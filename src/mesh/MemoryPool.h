@@ -2,8 +2,25 @@
 
 #include <Arduino.h>
 #include <assert.h>
+#include <atomic>
 
 #include "PointerQueue.h"
+#include "memGet.h"
+
+/// Whether MemoryPool guards its state with a critical section rather than relying on lock free compare-and-swap.  The
+/// RP2040's Cortex-M0+ has no exclusive loads and stores, so read-modify-writes of a std::atomic there fall back to a lock,
+/// which an ISR that interrupted its holder would wait on forever
+#ifndef MEMORYPOOL_CRITICAL_SECTION
+#ifdef ARCH_RP2040
+#define MEMORYPOOL_CRITICAL_SECTION 1
+#else
+#define MEMORYPOOL_CRITICAL_SECTION 0
+#endif
+#endif
+
+#if MEMORYPOOL_CRITICAL_SECTION
+#include <hardware/sync.h>
+#endif
 
 template <class T> class Allocator
 {
@@ -25,7 +42,7 @@ template <class T> class Allocator
     /// don't want this version).
     T *allocZeroed(TickType_t maxWait)
     {
-        T *p = alloc(maxWait);
+        T *p = alloc(maxWait, false);
 
         if (p)
             memset(p, 0, sizeof(T));
@@ -35,7 +52,7 @@ template <class T> class Allocator
     /// Return a queable object which is a copy of some other object
     T *allocCopy(const T &src, TickType_t maxWait = portMAX_DELAY)
     {
-        T *p = alloc(maxWait);
+        T *p = alloc(maxWait, false);
         assert(p);
 
         if (p)
@@ -43,33 +60,370 @@ template <class T> class Allocator
         return p;
     }
 
-    /// Return a buffer for use by others
+    /// Like allocZeroed() but for objects we can afford to lose (received packets, rebroadcasts, copies for the phone).
+    /// Returns NULL instead of panicking, and fails early once the pool is down to its reserve - so our own sends and acks
+    /// can still get a buffer.
+    /// Note: this method is safe to call from regular OR ISR code
+    T *tryAllocZeroed()
+    {
+        T *p = alloc(0, true);
+
+        if (p)
+            memset(p, 0, sizeof(T));
+        return p;
+    }
+
+    /// Like allocCopy() but returns NULL if the pool is running low (see tryAllocZeroed())
+    T *tryAllocCopy(const T &src)
+    {
+        T *p = alloc(0, true);
+
+        if (p)
+            *p = src;
+        return p;
+    }
+
+    /// Return a buffer for use by others.  If it is shared (see share()) it is only freed once everybody has released it
     virtual void release(T *p) = 0;
 
+    /// Another reference to p, which must have come from this allocator (never a copy on the stack or from new), so a packet
+    /// heard once can wait for the phone, MQTT and whoever else without being copied for each.  Each reference is released as
+    /// usual, and nobody may change a shared object: call makeWritable() first.  Allocators which don't count references make
+    /// a copy instead.
+    virtual T *share(const T *p) { return allocCopy(*p); }
+
+    /// @return true if somebody else holds a reference to p too
+    virtual bool isShared(const T *p) { return false; }
+
+    /// Copy on write: @return p if nobody else holds it, else our own copy of it (and our reference to p is released)
+    T *makeWritable(T *p)
+    {
+        if (!isShared(p))
+            return p;
+
+        T *copy = allocCopy(*p);
+        release(p);
+        return copy;
+    }
+
+    /// @return the number of objects which could still be allocated, or -1 if we don't have a fixed size
+    virtual int getFree() { return -1; }
+
+    /// @return the most objects which have ever been allocated at once (or 0 if we don't keep track)
+    virtual int getMaxUsed() { return 0; }
+
+    /// @return the number of allocations we refused because the pool was exhausted (or down to its reserve)
+    virtual uint32_t getAllocFailures() { return 0; }
+
   protected:
-    // Alloc some storage
-    virtual T *alloc(TickType_t maxWait) = 0;
+    /// Alloc some storage, if lowPriority is set the allocator is allowed to refuse even if a few objects are still free
+    virtual T *alloc(TickType_t maxWait, bool lowPriority) = 0;
 };
 
 /**
- * An allocator that just uses regular free/malloc
+ * An allocator that just uses regular free/malloc, counting what it has out against a HeapSite
  */
 template <class T> class MemoryDynamic : public Allocator<T>
 {
+    /// What we malloc, obj first so a T * is a Block *
+    struct Block {
+        T obj;
+        std::atomic<uint8_t> extraRefs; // how many share()s haven't been released yet
+        uint32_t magic;                 // BLOCK_MAGIC while we own it, so we can tell a T we didn't alloc
+    };
+
+    static const uint32_t BLOCK_MAGIC = 0x4d44594eUL;
+
+    /// The Block p is the obj of, it must be one of ours (not on the stack or from new, where there's no extraRefs after it)
+    static Block *blockOf(const T *p)
+    {
+        Block *b = (Block *)p;
+        assert(b->magic == BLOCK_MAGIC); // If this fails, someone handed us a pointer we never allocated (or freed it twice)
+        return b;
+    }
+
+    HeapSite site;
+
+  public:
+    explicit MemoryDynamic(HeapSite _site = HEAP_SITE_POOLS) : site(_site) {}
+
+    /// Return a buffer for use by others
+    virtual void release(T *p) override
+    {
+        assert(p);
+        Block *b = blockOf(p);
+        uint8_t r = b->extraRefs;
+        while (r && !b->extraRefs.compare_exchange_weak(r, r - 1))
+            ;
+        if (r)
+            return; // somebody else still holds it
+
+        b->magic = 0;
+        memGet.noteFree(site, sizeof(Block));
+        free(b);
+    }
+
+    virtual T *share(const T *p) override
+    {
+        Block *b = blockOf(p);
+        uint8_t old = b->extraRefs++;
+        assert(old < UINT8_MAX);
+        (void)old;
+        return &b->obj;
+    }
+
+    virtual bool isShared(const T *p) override { return blockOf(p)->extraRefs != 0; }
+
+  protected:
+    // Alloc some storage
+    virtual T *alloc(TickType_t maxWait, bool lowPriority) override
+    {
+        Block *b = (Block *)malloc(sizeof(Block));
+        assert(b);
+        b->extraRefs = 0;
+        b->magic = BLOCK_MAGIC;
+        memGet.noteAlloc(site, sizeof(Block));
+        return &b->obj;
+    }
+};
+
+/**
+ * Like MemoryDynamic, but up to KeepFree released objects are kept for the next allocs rather than freed, so a steady flow
+ * of them (somebody allocating what somebody else releases) stops touching the heap.  Only uses what it needs, unlike a
+ * MemoryPool.  Each kept object sits in an atomic slot, so alloc and release can be on different threads (lock free where
+ * std::atomic is, not on the RP2040, so not from an ISR there).
+ * What we have taken from the heap (the kept objects too) counts against a HeapSite.  Doesn't count references, share()
+ * copies.
+ */
+template <class T, int KeepFree> class MemoryRecycled : public Allocator<T>
+{
+    static_assert(KeepFree > 0, "MemoryRecycled must keep at least one object");
+
+    std::atomic<T *> kept[KeepFree];
+    HeapSite site;
+
   public:
+    explicit MemoryRecycled(HeapSite _site = HEAP_SITE_POOLS) : site(_site)
+    {
+        for (int i = 0; i < KeepFree; i++)
+            kept[i] = NULL;
+    }
+
     /// Return a buffer for use by others
     virtual void release(T *p) override
     {
         assert(p);
+        for (int i = 0; i < KeepFree; i++) {
+            T *empty = NULL;
+            if (kept[i].compare_exchange_strong(empty, p))
+                return;
+        }
+        memGet.noteFree(site, sizeof(T));
         free(p);
     }
 
   protected:
-    // Alloc some storage
-    virtual T *alloc(TickType_t maxWait) override
+    virtual T *alloc(TickType_t maxWait, bool lowPriority) override
     {
+        for (int i = 0; i < KeepFree; i++) {
+            T *p = kept[i].exchange(NULL);
+            if (p)
+                return p;
+        }
         T *p = (T *)malloc(sizeof(T));
         assert(p);
+        memGet.noteAlloc(site, sizeof(T));
         return p;
     }
 };
+
+/**
+ * Held around each change to a MemoryPool, see MEMORYPOOL_CRITICAL_SECTION.  Interrupts off and a hardware spinlock (so the
+ * other core waits too), or nothing at all where compare-and-swap is lock free.
+ */
+class PoolCriticalSection
+{
+#if MEMORYPOOL_CRITICAL_SECTION
+    spin_lock_t *lock = spin_lock_instance(next_striped_spin_lock_num());
+
+  public:
+    uint32_t enter() { return spin_lock_blocking(lock); }
+    void exit(uint32_t saved) { spin_unlock(lock, saved); }
+#else
+  public:
+    uint32_t enter() { return 0; }
+    void exit(uint32_t saved) {}
+#endif
+
+    /// RAII enter() and exit()
+    class Guard
+    {
+        PoolCriticalSection &cs;
+        uint32_t saved;
+
+      public:
+        explicit Guard(PoolCriticalSection &cs) : cs(cs), saved(cs.enter()) {}
+        ~Guard() { cs.exit(saved); }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+};
+
+/**
+ * A fixed size pool of MaxSize objects, allocated once at build time so we never touch the heap (and never fragment it).
+ *
+ * Free slots are tracked in a bitmap of atomic words.  Where compare-and-swap is lock free (the Cortex-M4 of the nRF52 and
+ * STM32WL, the ESP32s, hosts) alloc and release are lock free and safe to call from ISRs (an interrupted compare-and-swap
+ * just retries).  On the RP2040 they run in a short critical section instead (see MEMORYPOOL_CRITICAL_SECTION): still safe
+ * from ISRs and either core, but an ISR may delay the other core for a few instructions.
+ *
+ * The last lowPriorityReserve slots are only handed out to regular allocZeroed/allocCopy callers, tryAllocZeroed/tryAllocCopy
+ * will fail first so we drop incoming/rebroadcast packets rather than being unable to send our own.
+ *
+ * Each slot has a count of its extra references (see share()), a slot is only freed once they have all been released.
+ */
+template <class T, int MaxSize> class MemoryPool : public Allocator<T>
+{
+    static_assert(MaxSize > 0, "MemoryPool must have at least one slot");
+
+    static constexpr int NUM_WORDS = (MaxSize + 31) / 32;
+
+    T buf[MaxSize];
+
+    /// One bit per slot in buf, set if that slot is in use
+    std::atomic<uint32_t> inUse[NUM_WORDS];
+
+    /// For each slot in buf, how many share()s of it haven't been released yet
+    std::atomic<uint8_t> extraRefs[MaxSize];
+
+    /// Number of slots not yet claimed, we claim a slot here _before_ searching the bitmap for it
+    std::atomic<int> numFree;
+
+    std::atomic<int> maxUsed;
+    std::atomic<uint32_t> allocFailures;
+
+    const int lowPriorityReserve;
+
+    PoolCriticalSection critical;
+
+  public:
+    explicit MemoryPool(int _lowPriorityReserve = 0)
+        : numFree(MaxSize), maxUsed(0), allocFailures(0), lowPriorityReserve(_lowPriorityReserve)
+    {
+        for (int i = 0; i < NUM_WORDS; i++)
+            inUse[i] = 0;
+        for (int i = 0; i < MaxSize; i++)
+            extraRefs[i] = 0;
+
+        // Mark the unused bits at the end of the last word as permanently taken
+        if (MaxSize % 32)
+            inUse[NUM_WORDS - 1] = ~(((uint32_t)1 << (MaxSize % 32)) - 1);
+    }
+
+    /// Return a buffer for use by others
+    virtual void release(T *p) override
+    {
+        PoolCriticalSection::Guard g(critical);
+        int index = indexOf(p);
+        uint8_t r = extraRefs[index];
+        while (r && !swapIf(extraRefs[index], r, (uint8_t)(r - 1)))
+            ;
+        if (r)
+            return; // somebody else still holds it
+
+        uint32_t mask = (uint32_t)1 << (index % 32);
+
+        uint32_t old = inUse[index / 32];
+        while (!swapIf(inUse[index / 32], old, old & ~mask))
+            ;
+        assert(old & mask); // Double free
+        (void)old;
+
+        add(numFree, 1);
+    }
+
+    virtual T *share(const T *p) override
+    {
+        PoolCriticalSection::Guard g(critical);
+        int index = indexOf(p);
+        uint8_t old = add(extraRefs[index], (uint8_t)1);
+        assert(old < UINT8_MAX);
+        (void)old;
+        return &buf[index];
+    }
+
+    virtual bool isShared(const T *p) override { return extraRefs[indexOf(p)] != 0; }
+
+    virtual int getFree() override { return numFree; }
+
+    virtual int getMaxUsed() override { return maxUsed; }
+
+    virtual uint32_t getAllocFailures() override { return allocFailures; }
+
+  protected:
+    int indexOf(const T *p) const
+    {
+        assert(p >= buf && p < buf + MaxSize); // If this fails, someone handed us a pointer we never allocated
+        return p - buf;
+    }
+
+    /// Compare-and-swap, or with MEMORYPOOL_CRITICAL_SECTION (where our caller is in the critical section, so nobody can
+    /// change a between our look and our store) just a compare and a store, so we never need a std::atomic lock
+    template <class V> static bool swapIf(std::atomic<V> &a, V &expected, V desired)
+    {
+#if MEMORYPOOL_CRITICAL_SECTION
+        V now = a.load(std::memory_order_relaxed);
+        if (now != expected) {
+            expected = now;
+            return false;
+        }
+        a.store(desired, std::memory_order_relaxed);
+        return true;
+#else
+        return a.compare_exchange_weak(expected, desired);
+#endif
+    }
+
+    /// a += delta with swapIf(), @return what a was
+    template <class V> static V add(std::atomic<V> &a, V delta)
+    {
+        V old = a;
+        while (!swapIf(a, old, (V)(old + delta)))
+            ;
+        return old;
+    }
+
+    /// Alloc some storage, we never block so maxWait is ignored
+    virtual T *alloc(TickType_t maxWait, bool lowPriority) override
+    {
+        PoolCriticalSection::Guard g(critical);
+
+        // First claim a slot from the free count, this guarantees there is a free bit waiting for us below
+        int minFree = lowPriority ? lowPriorityReserve : 0;
+        int f = numFree;
+        do {
+            if (f <= minFree) {
+                add(allocFailures, (uint32_t)1);
+                return NULL;
+            }
+        } while (!swapIf(numFree, f, f - 1));
+
+        int used = MaxSize - f + 1;
+        int m = maxUsed;
+        while (used > m && !swapIf(maxUsed, m, used))
+            ;
+
+        // Now find (and take) the free bit we have a claim on
+        for (;;) {
+            for (int i = 0; i < NUM_WORDS; i++) {
+                uint32_t w = inUse[i];
+                while (~w) {
+                    int bit = __builtin_ctz(~w);
+                    if (swapIf(inUse[i], w, w | ((uint32_t)1 << bit)))
+                        return &buf[i * 32 + bit];
+                }
+            }
+        }
+    }
+};
@@ -4,10 +4,16 @@
 #include "NodeDB.h"
 #include "configuration.h"
 #include "modules/RoutingModule.h"
+#include <algorithm>
 #include <assert.h>
 
 std::vector<MeshModule *> *MeshModule::modules;
 
+std::vector<MeshModule::PortDispatch> MeshModule::dispatchTable;
+std::vector<MeshModule *> MeshModule::anyPortModules, MeshModule::encryptedModules;
+bool MeshModule::dispatchDirty = true;
+uint32_t MeshModule::boundChannelsGeneration;
+
 const meshtastic_MeshPacket *MeshModule::currentRequest;
 
 /**
@@ -23,6 +29,7 @@ MeshModule::MeshModule(const char *_name) : name(_name)
         modules = new std::vector<MeshModule *>();
 
     modules->push_back(this);
+    dispatchDirty = true;
 }
 
 void MeshModule::setup() {}
@@ -67,6 +74,93 @@ meshtastic_MeshPacket *MeshModule::allocErrorResponse(meshtastic_Routing_Error e
     return r;
 }
 
+void MeshModule::buildDispatchTable()
+{
+    dispatchTable.clear();
+    anyPortModules.clear();
+    encryptedModules.clear();
+
+    std::vector<meshtastic_PortNum> ports;
+
+    // First find every portnum someone listed
+    for (auto m : *modules) {
+        ports.clear();
+        m->getPortNums(ports);
+
+        if (ports.empty())
+            anyPortModules.push_back(m);
+        if (m->encryptedOk)
+            encryptedModules.push_back(m);
+
+        for (auto port : ports) {
+            auto d = std::lower_bound(dispatchTable.begin(), dispatchTable.end(), port,
+                                      [](const PortDispatch &a, meshtastic_PortNum b) { return a.portnum < b; });
+            if (d == dispatchTable.end() || d->portnum != port)
+                dispatchTable.insert(d, PortDispatch{port, {}});
+        }
+    }
+
+    // Then give each portnum everyone who listed it plus everyone who wants anything, still in registration order
+    for (auto m : *modules) {
+        ports.clear();
+        m->getPortNums(ports);
+
+        for (auto &d : dispatchTable)
+            if (ports.empty() || std::find(ports.begin(), ports.end(), d.portnum) != ports.end())
+                d.modules.push_back(m);
+    }
+
+    dispatchDirty = false;
+    LOG_DEBUG("Built module dispatch table, %u modules, %u portnums\n", modules->size(), dispatchTable.size());
+}
+
+void MeshModule::resolveBoundChannels()
+{
+    for (auto m : *modules) {
+        m->boundChannelMask = 0;
+        if (m->boundChannel)
+            for (ChannelIndex i = 0; i < channels.getNumChannels() && i < MAX_NUM_CHANNELS; i++)
+                if (strcasecmp(channels.getByIndex(i).settings.name, m->boundChannel) == 0)
+                    m->boundChannelMask |= 1 << i;
+    }
+
+    boundChannelsGeneration = channels.getGeneration();
+}
+
+const std::vector<MeshModule *> &MeshModule::getCandidates(const meshtastic_MeshPacket &mp, bool isDecoded)
+{
+    if (!isDecoded)
+        return encryptedModules; // we can't see the portnum, so only those who take encrypted packets
+    return getPortCandidates(mp.decoded.portnum);
+}
+
+const std::vector<MeshModule *> &MeshModule::getPortCandidates(meshtastic_PortNum port)
+{
+    auto d = std::lower_bound(dispatchTable.begin(), dispatchTable.end(), port,
+                              [](const PortDispatch &a, meshtastic_PortNum b) { return a.portnum < b; });
+    return (d != dispatchTable.end() && d->portnum == port) ? d->modules : anyPortModules;
+}
+
+bool MeshModule::wantsDecodedTransit(meshtastic_PortNum port)
+{
+    if (dispatchDirty)
+        buildDispatchTable();
+    for (auto m : getPortCandidates(port))
+        if (m->isPromiscuous && !m->encryptedOk)
+            return true;
+    return false;
+}
+
+bool MeshModule::mayAlter(const meshtastic_MeshPacket &mp)
+{
+    if (dispatchDirty)
+        buildDispatchTable();
+    for (auto m : getCandidates(mp, mp.which_payload_variant == meshtastic_MeshPacket_decoded_tag))
+        if (m->altersReceived)
+            return true;
+    return false;
+}
+
 void MeshModule::callPlugins(meshtastic_MeshPacket &mp, RxSource src)
 {
     // LOG_DEBUG("In call modules\n");
@@ -83,7 +177,14 @@ void MeshModule::callPlugins(meshtastic_MeshPacket &mp, RxSource src)
     auto ourNodeNum = nodeDB.getNodeNum();
     bool toUs = mp.to == NODENUM_BROADCAST || mp.to == ourNodeNum;
 
-    for (auto i = modules->begin(); i != modules->end(); ++i) {
+    if (dispatchDirty)
+        buildDispatchTable();
+    if (boundChannelsGeneration != channels.getGeneration())
+        resolveBoundChannels();
+
+    const std::vector<MeshModule *> &candidates = getCandidates(mp, isDecoded);
+
+    for (auto i = candidates.begin(); i != candidates.end(); ++i) {
         auto &pi = **i;
 
         pi.currentRequest = &mp;
@@ -103,16 +204,14 @@ void MeshModule::callPlugins(meshtastic_MeshPacket &mp, RxSource src)
 
             moduleFound = true;
 
-            /// received channel (or NULL if not decoded)
-            meshtastic_Channel *ch = isDecoded ? &channels.getByIndex(mp.channel) : NULL;
-
             /// Is the channel this packet arrived on acceptable? (security check)
             /// Note: we can't know channel names for encrypted packets, so those are NEVER sent to boundChannel modules
 
             /// Also: if a packet comes in on the local PC interface, we don't check for bound channels, because it is TRUSTED and
             /// it needs to to be able to fetch the initial admin packets without yet knowing any channels.
 
-            bool rxChannelOk = !pi.boundChannel || (mp.from == 0) || (strcasecmp(ch->settings.name, pi.boundChannel) == 0);
+            bool rxChannelOk = !pi.boundChannel || (mp.from == 0) ||
+                               (isDecoded && mp.channel < MAX_NUM_CHANNELS && (pi.boundChannelMask & (1 << mp.channel)));
 
             if (!rxChannelOk) {
                 // no one should have already replied!
@@ -126,6 +225,7 @@ void MeshModule::callPlugins(meshtastic_MeshPacket &mp, RxSource src)
             } else {
                 ProcessMessage handled = pi.handleReceived(mp);
 
+                assert(!pi.altersReceived || !packetPool.isShared(&mp)); // see mayAlter()
                 pi.alterReceived(mp);
 
                 // Possibly send replies (but only if the message was directed to us specifically, i.e. not for promiscious
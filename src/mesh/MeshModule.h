@@ -54,6 +54,25 @@ class MeshModule
 {
     static std::vector<MeshModule *> *modules;
 
+    /// The modules which might want a particular portnum, in the order they were registered (see buildDispatchTable())
+    struct PortDispatch {
+        meshtastic_PortNum portnum;
+        std::vector<MeshModule *> modules;
+    };
+
+    /// Sorted by portnum
+    static std::vector<PortDispatch> dispatchTable;
+
+    /// Modules which didn't tell us their portnums (so might want anything), and those which want encrypted packets
+    static std::vector<MeshModule *> anyPortModules, encryptedModules;
+
+    /// Set whenever a module is added, we build the table on first use because subclasses aren't constructed yet in our
+    /// constructor
+    static bool dispatchDirty;
+
+    /// The Channels generation our boundChannelMasks were resolved for
+    static uint32_t boundChannelsGeneration;
+
   public:
     /** Constructor
      * name is for debugging output
@@ -66,6 +85,14 @@ class MeshModule
      */
     static void callPlugins(meshtastic_MeshPacket &mp, RxSource src = RX_SRC_RADIO);
 
+    /// @return true if a module would look inside a packet on port addressed to someone else: a promiscuous one which lists
+    /// port (or wants every port), and can't make do with the packet still encrypted
+    static bool wantsDecodedTransit(meshtastic_PortNum port);
+
+    /// @return true if a module might still change mp in alterReceived(), so whoever wants to keep it while callPlugins() is
+    /// running must take a copy rather than share() it
+    static bool mayAlter(const meshtastic_MeshPacket &mp);
+
     static std::vector<MeshModule *> GetMeshModulesWithUIFrames();
     static void observeUIEvents(Observer<const UIFrameEvent *> *observer);
     static AdminMessageHandleResult handleAdminMessageForAllPlugins(const meshtastic_MeshPacket &mp,
@@ -91,6 +118,9 @@ class MeshModule
      * flag */
     bool encryptedOk = false;
 
+    /// Modules whose alterReceived() changes packets must set this, so nobody shares a packet they're still going to change
+    bool altersReceived = false;
+
     /* We allow modules to ignore a request without sending an error if they have a specific reason for it. */
     bool ignoreRequest = false;
 
@@ -102,6 +132,9 @@ class MeshModule
      */
     const char *boundChannel = NULL;
 
+    /// The channels named boundChannel (bit n for channel n), kept up to date by callPlugins()
+    uint8_t boundChannelMask = 0;
+
     /**
      * If this module is currently handling a request currentRequest will be preset
      * to the packet with the request.  This is mostly useful for reply handlers.
@@ -127,6 +160,12 @@ class MeshModule
      */
     virtual bool wantPacket(const meshtastic_MeshPacket *p) = 0;
 
+    /**
+     * Add every portnum wantPacket() might return true for to ports.  We only call wantPacket() for modules which listed the
+     * portnum of the packet, modules which don't list any are asked about every packet.
+     */
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) {}
+
     /** Called to handle a particular incoming message
 
     @return ProcessMessage::STOP if you've guaranteed you've handled this message and no other handlers should be considered for
@@ -189,6 +228,18 @@ class MeshModule
      * to generate the reply message, and if !NULL that message will be delivered to whoever sent req
      */
     void sendResponse(const meshtastic_MeshPacket &req);
+
+    /// Fill dispatchTable, anyPortModules and encryptedModules from modules
+    static void buildDispatchTable();
+
+    /// Recompute each module's boundChannelMask from the current channel names
+    static void resolveBoundChannels();
+
+    /// @return the modules which might want mp, in the order they should be called
+    static const std::vector<MeshModule *> &getCandidates(const meshtastic_MeshPacket &mp, bool isDecoded);
+
+    /// @return the modules which might want a decoded packet on port, in the order they should be called
+    static const std::vector<MeshModule *> &getPortCandidates(meshtastic_PortNum port);
 };
 
 /** set the destination and packet parameters of packet p intended as a reply to a particular "to" packet
@@ -1,130 +1,338 @@
 #include "MeshPacketQueue.h"
+#include "RadioStats.h"
+#include "airtime.h"
 #include "configuration.h"
 #include <assert.h>
 
-#include <algorithm>
+MeshPacketQueue::MeshPacketQueue(size_t _maxLen) : maxLen(_maxLen), entries(_maxLen), flows(_maxLen)
+{
+    assert(maxLen > 0 && maxLen < INT16_MAX);
+
+    // Chain all the entries and flows onto their free lists
+    for (size_t i = 0; i < maxLen; i++) {
+        entries[i].p = NULL;
+        entries[i].next = (i + 1 < maxLen) ? i + 1 : -1;
+        flows[i].numQueued = 0;
+        flows[i].next = (i + 1 < maxLen) ? i + 1 : -1;
+    }
+    freeList = 0;
+    freeFlows = 0;
+
+    for (int l = 0; l < NUM_LEVELS; l++) {
+        current[l] = -1;
+        dropped[l] = 0;
+    }
+
+    // Keep the index at most half full, so probe runs stay short
+    size_t indexSize = 1;
+    while (indexSize < maxLen * 2)
+        indexSize <<= 1;
+    index.assign(indexSize, -1);
+    indexMask = indexSize - 1;
+}
 
-/// @return the priority of the specified packet
-inline uint32_t getPriority(const meshtastic_MeshPacket *p)
+MeshPacketQueue::Level MeshPacketQueue::getLevel(const WirePacket *p)
 {
     auto pri = p->priority;
-    return pri;
+
+    if (pri >= meshtastic_MeshPacket_Priority_MAX)
+        return LEVEL_MAX;
+    else if (pri >= meshtastic_MeshPacket_Priority_ACK)
+        return LEVEL_ACK;
+    else if (pri >= meshtastic_MeshPacket_Priority_RELIABLE)
+        return LEVEL_RELIABLE;
+    else if (pri >= meshtastic_MeshPacket_Priority_DEFAULT)
+        return LEVEL_DEFAULT;
+    else if (pri >= meshtastic_MeshPacket_Priority_BACKGROUND)
+        return LEVEL_BACKGROUND;
+    else
+        return LEVEL_MIN;
+}
+
+uint32_t MeshPacketQueue::indexSlot(NodeNum from, PacketId id) const
+{
+    return ((uint32_t)(from * 2654435761UL) ^ (uint32_t)(id * 2246822519UL)) & indexMask;
+}
+
+int32_t MeshPacketQueue::findSlot(NodeNum from, PacketId id) const
+{
+    for (uint32_t i = indexSlot(from, id);; i = (i + 1) & indexMask) {
+        int16_t e = index[i];
+        if (e < 0)
+            return -1; // hit the end of the probe run
+
+        const WirePacket *p = entries[e].p;
+        if (p->header.id == id && p->header.from == from)
+            return i;
+    }
 }
 
-/// @return "true" if "p1" is ordered before "p2"
-bool CompareMeshPacketFunc(const meshtastic_MeshPacket *p1, const meshtastic_MeshPacket *p2)
+int16_t MeshPacketQueue::findFlow(uint8_t l, NodeNum from) const
 {
-    assert(p1 && p2);
-    auto p1p = getPriority(p1), p2p = getPriority(p2);
+    int16_t f = current[l];
+    if (f >= 0)
+        do {
+            if (flows[f].from == from)
+                return f;
+            f = flows[f].next;
+        } while (f != current[l]);
+    return -1;
+}
 
-    // If priorities differ, use that
-    // for equal priorities, order by id (older packets have higher priority - this will briefly be wrong when IDs roll over but
-    // no big deal)
-    return (p1p != p2p) ? (p1p < p2p)         // prefer bigger priorities
-                        : (p1->id >= p2->id); // prefer smaller packet ids
+/// @return how much of the channel from has been using lately, as far as AirTime knows
+static uint32_t getRecentAirtime(NodeNum from)
+{
+    return airTime ? airTime->getNodeAirtime().get(from) : 0;
 }
 
-MeshPacketQueue::MeshPacketQueue(size_t _maxLen) : maxLen(_maxLen) {}
+int16_t MeshPacketQueue::findBiggestFlow(uint8_t l) const
+{
+    // Between flows with as many queued, whoever has had most of the channel lately
+    int16_t biggest = current[l], f = current[l];
+    if (f >= 0)
+        do {
+            if (flows[f].numQueued > flows[biggest].numQueued ||
+                (flows[f].numQueued == flows[biggest].numQueued && f != biggest &&
+                 getRecentAirtime(flows[f].from) > getRecentAirtime(flows[biggest].from)))
+                biggest = f;
+            f = flows[f].next;
+        } while (f != current[l]);
+    return biggest;
+}
 
 bool MeshPacketQueue::empty()
 {
-    return queue.empty();
+    return numQueued == 0;
 }
 
-/**
- * Some clients might not properly set priority, therefore we fix it here.
- */
-void fixPriority(meshtastic_MeshPacket *p)
+void MeshPacketQueue::append(WirePacket *p)
 {
-    // We might receive acks from other nodes (and since generated remotely, they won't have priority assigned.  Check for that
-    // and fix it
-    if (p->priority == meshtastic_MeshPacket_Priority_UNSET) {
-        // if acks give high priority
-        // if a reliable message give a bit higher default priority
-        p->priority = (p->decoded.portnum == meshtastic_PortNum_ROUTING_APP)
-                          ? meshtastic_MeshPacket_Priority_ACK
-                          : (p->want_ack ? meshtastic_MeshPacket_Priority_RELIABLE : meshtastic_MeshPacket_Priority_DEFAULT);
+    int16_t e = freeList;
+    assert(e >= 0);
+    freeList = entries[e].next;
+
+    Level l = getLevel(p);
+    int16_t f = findFlow(l, p->header.from);
+    if (f < 0) {
+        // A new flow joins its level's round at the back, just before whoever's turn it is
+        f = freeFlows;
+        assert(f >= 0); // there are as many flows as entries
+        freeFlows = flows[f].next;
+
+        Flow &fl = flows[f];
+        fl.from = p->header.from;
+        fl.level = l;
+        fl.head = fl.tail = -1;
+        fl.numQueued = 0;
+        fl.deficit = 0;
+        fl.hasQuantum = false;
+        if (current[l] >= 0) {
+            fl.next = current[l];
+            fl.prev = flows[current[l]].prev;
+            flows[fl.prev].next = f;
+            flows[current[l]].prev = f;
+        } else {
+            fl.prev = fl.next = f;
+            current[l] = f;
+        }
     }
+
+    Flow &fl = flows[f];
+    entries[e].p = p;
+    entries[e].flow = f;
+    entries[e].next = -1;
+    entries[e].prev = fl.tail;
+    if (fl.tail >= 0)
+        entries[fl.tail].next = e;
+    else
+        fl.head = e;
+    fl.tail = e;
+    fl.numQueued++;
+
+    uint32_t i = indexSlot(p->header.from, p->header.id);
+    while (index[i] >= 0) // we are never more than half full, so there is always an empty slot
+        i = (i + 1) & indexMask;
+    index[i] = e;
+
+    numQueued++;
 }
 
-/** enqueue a packet, return false if full */
-bool MeshPacketQueue::enqueue(meshtastic_MeshPacket *p)
+void MeshPacketQueue::unlink(int16_t e)
 {
-    fixPriority(p);
+    Entry &en = entries[e];
+    int16_t f = en.flow;
+    Flow &fl = flows[f];
 
+    if (en.prev >= 0)
+        entries[en.prev].next = en.next;
+    else
+        fl.head = en.next;
+    if (en.next >= 0)
+        entries[en.next].prev = en.prev;
+    else
+        fl.tail = en.prev;
+
+    if (--fl.numQueued == 0) {
+        // The flow leaves its round (the next flow's turn, if it was ours), and whatever deficit it had left goes with it
+        uint8_t l = fl.level;
+        if (fl.next == f) {
+            current[l] = -1;
+        } else {
+            flows[fl.prev].next = fl.next;
+            flows[fl.next].prev = fl.prev;
+            if (current[l] == f)
+                current[l] = fl.next;
+        }
+        fl.next = freeFlows;
+        freeFlows = f;
+    }
+
+    // Find our own slot in the index (there might be other packets with the same from and id), then fill the hole by
+    // moving back any later entries of the probe run which are allowed to live there
+    uint32_t i = indexSlot(en.p->header.from, en.p->header.id);
+    while (index[i] != e)
+        i = (i + 1) & indexMask;
+    for (uint32_t j = (i + 1) & indexMask; index[j] >= 0; j = (j + 1) & indexMask) {
+        const WirePacket *p = entries[index[j]].p;
+        uint32_t k = indexSlot(p->header.from, p->header.id);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            index[i] = index[j];
+            i = j;
+        }
+    }
+    index[i] = -1;
+
+    en.p = NULL;
+    en.next = freeList;
+    freeList = e;
+    numQueued--;
+}
+
+/** enqueue a packet, return false if full */
+bool MeshPacketQueue::enqueue(WirePacket *p)
+{
+    // Note: WirePacket::fromMeshPacket() has already fixed up any missing priority
     // no space - try to replace a lower priority packet in the queue
-    if (queue.size() >= maxLen) {
+    if (numQueued >= maxLen) {
         return replaceLowerPriorityPacket(p);
     }
 
-    queue.push_back(p);
-    std::push_heap(queue.begin(), queue.end(), &CompareMeshPacketFunc);
+    append(p);
     return true;
 }
 
-meshtastic_MeshPacket *MeshPacketQueue::dequeue()
+int16_t MeshPacketQueue::pickFlow()
 {
-    if (empty()) {
-        return NULL;
-    }
+    for (int l = NUM_LEVELS - 1; l >= 0; l--) {
+        int16_t f = current[l];
+        if (f < 0)
+            continue;
 
-    auto *p = queue.front();
-    std::pop_heap(queue.begin(), queue.end(), &CompareMeshPacketFunc);
-    queue.pop_back();
+        // Each flow gets QUANTUM more bytes when its turn comes round, and keeps the turn while that covers its next packet.
+        // QUANTUM covers any packet, so this finds one within a round
+        for (;;) {
+            Flow &fl = flows[f];
+            if (!fl.hasQuantum) {
+                fl.deficit += QUANTUM;
+                fl.hasQuantum = true;
+            }
+            if (fl.deficit >= (int32_t)entries[fl.head].p->getLength()) {
+                current[l] = f;
+                return f;
+            }
+            fl.hasQuantum = false; // the rest carries over to its next turn
+            f = fl.next;
+        }
+    }
 
-    return p;
+    return -1;
 }
 
-meshtastic_MeshPacket *MeshPacketQueue::getFront()
+WirePacket *MeshPacketQueue::dequeue()
 {
-    if (empty()) {
+    int16_t f = pickFlow();
+    if (f < 0)
         return NULL;
-    }
 
-    auto *p = queue.front();
+    int16_t e = flows[f].head;
+    auto *p = entries[e].p;
+    flows[f].deficit -= p->getLength();
+    unlink(e);
     return p;
 }
 
+WirePacket *MeshPacketQueue::getFront()
+{
+    int16_t f = pickFlow();
+    return f >= 0 ? entries[flows[f].head].p : NULL;
+}
+
 /** Attempt to find and remove a packet from this queue.  Returns a pointer to the removed packet, or NULL if not found */
-meshtastic_MeshPacket *MeshPacketQueue::remove(NodeNum from, PacketId id)
-{
-    for (auto it = queue.begin(); it != queue.end(); it++) {
-        auto p = (*it);
-        if (getFrom(p) == from && p->id == id) {
-            queue.erase(it);
-            std::make_heap(queue.begin(), queue.end(), &CompareMeshPacketFunc);
-            return p;
-        }
-    }
+WirePacket *MeshPacketQueue::remove(NodeNum from, PacketId id)
+{
+    int32_t slot = findSlot(from, id);
+    if (slot < 0)
+        return NULL;
 
-    return NULL;
+    int16_t e = index[slot];
+    auto *p = entries[e].p;
+    unlink(e);
+    return p;
 }
 
-/** Attempt to find and remove a packet from this queue.  Returns the packet which was removed from the queue */
-bool MeshPacketQueue::replaceLowerPriorityPacket(meshtastic_MeshPacket *p)
+/** Attempt to replace a lower priority packet with p.  Returns true if p was queued */
+bool MeshPacketQueue::replaceLowerPriorityPacket(WirePacket *p)
 {
-    std::sort_heap(queue.begin(), queue.end(), &CompareMeshPacketFunc); // sort ascending based on priority (0 -> 127)
+    Level l = getLevel(p);
 
-    // find first packet which does not compare less (in priority) than parameter packet
-    auto low = std::lower_bound(queue.begin(), queue.end(), p, &CompareMeshPacketFunc);
-
-    if (low == queue.begin()) { // if already at start, there are no packets with lower priority
-        return false;
+    // Throw out a packet of the lowest level we have, provided that is below us: the newest of whoever has the most queued there
+    for (int lower = 0; lower < l; lower++) {
+        int16_t f = findBiggestFlow(lower);
+        if (f >= 0) {
+            auto *victim = entries[flows[f].tail].p;
+            dropped[lower]++;
+            LOG_WARN("TX queue full, dropping id=0x%x (priority %d) for id=0x%x (priority %d), %u drops at that level\n",
+                     victim->header.id, victim->priority, p->header.id, p->priority, dropped[lower]);
+            unlink(flows[f].tail);
+            WirePacket::release(victim); // deallocate and drop the packet we're replacing
+            append(p);
+            return true;
+        }
     }
 
-    if (low == queue.end()) {
-        // all priorities in the vector are smaller than the incoming packet. Replace the lowest priority (first) element
-        low = queue.begin();
-    } else {
-        // 'low' iterator points to first packet which does not compare less than parameter
-        --low; // iterate to lower priority packet
+    // At our own level, someone with (clearly) more queued than p's originator gives up their newest one, so a node flooding
+    // the mesh can't crowd everyone else out of our queue
+    int16_t f = findBiggestFlow(l), ours = findFlow(l, p->header.from);
+    if (f >= 0 && f != ours && flows[f].numQueued > (ours >= 0 ? flows[ours].numQueued : 0) + 1) {
+        auto *victim = entries[flows[f].tail].p;
+        dropped[l]++;
+        fairDrops++;
+        radioStats.countError(RadioStats::TX_FAIR_DROPPED);
+        LOG_WARN("TX queue full, dropping id=0x%x from 0x%x (%u queued) for id=0x%x from 0x%x, %u fair drops\n", victim->header.id,
+                 victim->header.from, flows[f].numQueued, p->header.id, p->header.from, fairDrops);
+        unlink(flows[f].tail);
+        WirePacket::release(victim);
+        append(p);
+        return true;
     }
 
-    if (getPriority(p) > getPriority(*low)) {
-        packetPool.release(*low); // deallocate and drop the packet we're replacing
-        *low = p;                 // replace low-pri packet at this position with incoming packet with higher priority
-    }
+    dropped[l]++;
+    LOG_WARN("TX queue full, refusing id=0x%x (priority %d), %u drops at that level\n", p->header.id, p->priority, dropped[l]);
+    return false;
+}
 
-    std::make_heap(queue.begin(), queue.end(), &CompareMeshPacketFunc);
-    return true;
+void MeshPacketQueue::printDropped()
+{
+    uint32_t total = 0;
+    for (int l = 0; l < NUM_LEVELS; l++)
+        total += dropped[l];
+
+    // Only when they've changed, we're asked on every QueueStatus
+    if (total + fairDrops == printedDrops)
+        return;
+    printedDrops = total + fairDrops;
+    LOG_DEBUG("TX queue drops: min=%u,background=%u,default=%u,reliable=%u,ack=%u,max=%u (fair=%u)\n", dropped[LEVEL_MIN],
+              dropped[LEVEL_BACKGROUND], dropped[LEVEL_DEFAULT], dropped[LEVEL_RELIABLE], dropped[LEVEL_ACK], dropped[LEVEL_MAX],
+              fairDrops);
 }
@@ -1,40 +1,129 @@
 #pragma once
 
 #include "MeshTypes.h"
+#include "RadioInterface.h"
 
-#include <queue>
+#include <vector>
 
 /**
- * A priority queue of packets
+ * A priority queue of packets waiting to go on the air (kept in their compact WirePacket form)
+ *
+ * Within each priority level every originator (header.from) has its own FIFO, a flow.  The flows of a level take turns by
+ * deficit round robin: each round a flow may send up to QUANTUM bytes, so one node spamming the mesh only gets its share of
+ * our airtime rather than everything that arrives before the others' packets.  When we are full, the newest packet of the
+ * flow with the most queued (of those, the one whose originator AirTime says has used most of the channel) makes way.
+ * Flows are doubly linked lists threaded through a fixed array of entries, and a small (from, id) hash index lets us find
+ * packets to cancel without searching.  Packets of one flow always leave in the order they arrived.
  */
 class MeshPacketQueue
 {
-    size_t maxLen;
-    std::vector<meshtastic_MeshPacket *> queue;
+  public:
+    /// Our priority levels, every named meshtastic_MeshPacket_Priority gets its own level (values in between are rounded down)
+    enum Level { LEVEL_MIN, LEVEL_BACKGROUND, LEVEL_DEFAULT, LEVEL_RELIABLE, LEVEL_ACK, LEVEL_MAX, NUM_LEVELS };
+
+    /// Bytes each flow may send per round, enough for any one packet so every turn sends at least one
+    static const uint32_t QUANTUM = MAX_RHPACKETLEN;
+
+  private:
+    struct Entry {
+        WirePacket *p;
+        int16_t prev, next; // neighbours in our flow's FIFO (or the free list), -1 for none
+        int16_t flow;       // the flow we were queued on
+    };
+
+    /// The packets of one originator at one level
+    struct Flow {
+        NodeNum from;
+        uint8_t level;
+        int16_t head, tail;  // oldest and newest of our entries
+        uint16_t numQueued;  // how many of our packets are queued
+        int32_t deficit;     // bytes we may still send this round
+        bool hasQuantum;     // we have been given this round's QUANTUM
+        int16_t prev, next;  // neighbours in our level's round (a ring), next also chains the free list
+    };
+
+    size_t maxLen, numQueued = 0;
+
+    /// maxLen entries, the unused ones are chained together from freeList
+    std::vector<Entry> entries;
+    int16_t freeList;
+
+    /// maxLen flows (each needs at least one packet), the unused ones are chained together from freeFlows
+    std::vector<Flow> flows;
+    int16_t freeFlows;
+
+    /// The flow of each level whose turn it is, -1 if the level is empty
+    int16_t current[NUM_LEVELS];
+
+    /// How many packets of each level we have thrown away because the queue was full
+    uint32_t dropped[NUM_LEVELS];
+
+    /// How many of those we dropped from another originator's flow, because it had more queued than the newcomer's
+    uint32_t fairDrops = 0;
+
+    /// The drops (of every level, and fair ones) as of when printDropped() last logged them
+    uint32_t printedDrops = 0;
+
+    /// Open addressing (linear probing) hash from (from, id) to entry number, -1 marks an empty slot
+    std::vector<int16_t> index;
+    uint32_t indexMask;
+
+    static Level getLevel(const WirePacket *p);
+
+    uint32_t indexSlot(NodeNum from, PacketId id) const;
+
+    /// @return the index slot for a packet matching from and id, or -1 if we don't have one
+    int32_t findSlot(NodeNum from, PacketId id) const;
+
+    /// @return the flow of from at level l, or -1 if it has nothing queued there
+    int16_t findFlow(uint8_t l, NodeNum from) const;
+
+    /// @return the flow of level l with the most packets queued (of those, the one whose originator has used most airtime
+    /// lately), or -1 if the level is empty
+    int16_t findBiggestFlow(uint8_t l) const;
+
+    /// @return the flow whose head packet should go out next (advancing the rounds as needed), or -1 if we are empty
+    int16_t pickFlow();
+
+    /// Put p at the back of its flow's FIFO (making the flow if need be), there must be a free entry
+    void append(WirePacket *p);
+
+    /// Take entry e out of its flow (and the flow out of its round if that empties it), our index and put it back on the free
+    /// list
+    void unlink(int16_t e);
 
     /** Replace a lower priority package in the queue with 'mp' (provided there are lower pri packages). Return true if replaced.
      */
-    bool replaceLowerPriorityPacket(meshtastic_MeshPacket *mp);
+    bool replaceLowerPriorityPacket(WirePacket *mp);
 
   public:
     explicit MeshPacketQueue(size_t _maxLen);
 
     /** enqueue a packet, return false if full */
-    bool enqueue(meshtastic_MeshPacket *p);
+    bool enqueue(WirePacket *p);
 
     /** return true if the queue is empty */
     bool empty();
 
     /** return amount of free packets in Queue */
-    size_t getFree() { return maxLen - queue.size(); }
+    size_t getFree() { return maxLen - numQueued; }
 
     /** return total size of the Queue */
     size_t getMaxLen() { return maxLen; }
 
-    meshtastic_MeshPacket *dequeue();
+    /** return how many packets of priority level l were dropped (or refused) because the queue was full */
+    uint32_t getDropped(Level l) { return dropped[l]; }
+
+    /** return how many packets we dropped to make room for a packet from an originator with fewer queued */
+    uint32_t getFairDrops() { return fairDrops; }
+
+    /** log our per level drop counters (if they changed since we last did) */
+    void printDropped();
+
+    WirePacket *dequeue();
 
-    meshtastic_MeshPacket *getFront();
+    WirePacket *getFront();
 
     /** Attempt to find and remove a packet from this queue.  Returns the packet which was removed from the queue */
-    meshtastic_MeshPacket *remove(NodeNum from, PacketId id);
+    WirePacket *remove(NodeNum from, PacketId id);
 };
@@ -6,14 +6,20 @@
 #include "BluetoothCommon.h" // needed for updateBatteryLevel, FIXME, eventually when we pull mesh out into a lib we shouldn't be whacking bluetooth from here
 #include "GPS.h"
 #include "MeshService.h"
+#include "Metrics.h"
 #include "NodeDB.h"
+#include "PhoneAPI.h"
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "TypeConversions.h"
+#include "concurrency/LockGuard.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
+#include "mesh/generated/meshtastic/telemetry.pb.h"
+#include "modules/AdminModule.h"
 #include "modules/NodeInfoModule.h"
 #include "modules/PositionModule.h"
+#include "modules/TraceRouteModule.h"
 #include "power.h"
 
 #ifdef ARCH_ESP32
@@ -52,9 +58,11 @@ FIXME in the initial proof of concept we just skip the entire want/deny flow and
 
 MeshService service;
 
-static MemoryDynamic<meshtastic_MqttClientProxyMessage> staticMqttClientProxyMessagePool;
+/// MQTT hands us a message for every publish through the phone, and the phone gives them back as it takes them
+static MemoryRecycled<meshtastic_MqttClientProxyMessage, 4> staticMqttClientProxyMessagePool;
 
-static MemoryDynamic<meshtastic_QueueStatus> staticQueueStatusPool;
+/// At most one report and the odd failure are waiting for the phone at once, so a couple kept cover them
+static MemoryRecycled<meshtastic_QueueStatus, 2> staticQueueStatusPool;
 
 Allocator<meshtastic_MqttClientProxyMessage> &mqttClientProxyMessagePool = staticMqttClientProxyMessagePool;
 
@@ -63,7 +71,7 @@ Allocator<meshtastic_QueueStatus> &queueStatusPool = staticQueueStatusPool;
 #include "Router.h"
 
 MeshService::MeshService()
-    : toPhoneQueue(MAX_RX_TOPHONE), toPhoneQueueStatusQueue(MAX_RX_TOPHONE), toPhoneMqttProxyQueue(MAX_RX_TOPHONE)
+    : toPhoneQueueStatusQueue(MAX_RX_TOPHONE), toPhoneMqttProxyQueue(MAX_RX_TOPHONE)
 {
     lastQueueStatus = {0, 0, 16, 0};
 }
@@ -73,6 +81,11 @@ void MeshService::init()
     // moved much earlier in boot (called from setup())
     // nodeDB.init();
 
+    toPhoneLock = new concurrency::Lock();
+#if PHONE_INBOX
+    inbox.init();
+#endif
+
     if (gps)
         gpsObserver.observe(&gps->newStatus);
 }
@@ -87,14 +100,21 @@ int MeshService::handleFromRadio(const meshtastic_MeshPacket *mp)
         LOG_DEBUG(
             "Received telemetry response. Skip sending our NodeInfo because this potentially a Repeater which will ignore our "
             "request for its NodeInfo.\n");
-    } else if (mp->which_payload_variant == meshtastic_MeshPacket_decoded_tag && !nodeDB.getMeshNode(mp->from)->has_user &&
+    } else if (mp->which_payload_variant == meshtastic_MeshPacket_decoded_tag && !nodeDB.hasUser(mp->from) &&
                nodeInfoModule) {
         LOG_INFO("Heard a node on channel %d we don't know, sending NodeInfo and asking for a response.\n", mp->channel);
         nodeInfoModule->sendOurNodeInfo(mp->from, true, mp->channel);
     }
 
     printPacket("Forwarding to phone", mp);
-    sendToPhone(packetPool.allocCopy(*mp));
+    // A decoded packet nobody changes any more, so the phone queue shares it rather than keeping a copy.  sendToPhone() would
+    // try to decode anything else again, and a module after us in callPlugins() may still change it in alterReceived()
+    bool canShare = mp->which_payload_variant == meshtastic_MeshPacket_decoded_tag && !MeshModule::mayAlter(*mp);
+    meshtastic_MeshPacket *copy = canShare ? packetPool.share(mp) : packetPool.tryAllocCopy(*mp);
+    if (copy)
+        sendToPhone(copy);
+    else
+        LOG_WARN("packetPool is running low, not forwarding to phone\n");
 
     return 0;
 }
@@ -123,6 +143,7 @@ bool MeshService::reloadConfig(int saveWhat)
     bool didReset = nodeDB.resetRadioConfig(); // Don't let the phone send us fatally bad settings
 
     configChanged.notifyObservers(NULL); // This will cause radio hardware to change freqs etc
+    PhoneAPI::invalidateConfigFrames();
     nodeDB.saveToDisk(saveWhat);
 
     return didReset;
@@ -144,19 +165,174 @@ void MeshService::reloadOwner(bool shouldSave)
 // search the queue for a request id and return the matching nodenum
 NodeNum MeshService::getNodenumFromRequestId(uint32_t request_id)
 {
+    concurrency::LockGuard g(toPhoneLock);
     NodeNum nodenum = 0;
-    for (int i = 0; i < toPhoneQueue.numUsed(); i++) {
-        meshtastic_MeshPacket *p = toPhoneQueue.dequeuePtr(0);
-        if (p->id == request_id) {
-            nodenum = p->to;
-            // make sure to continue this to make one full loop
-        }
-        // put it right back on the queue
-        toPhoneQueue.enqueue(p, 0);
+    for (uint32_t s = toPhoneHead; s != toPhoneTail; s++) {
+        const meshtastic_MeshPacket *p = toPhonePackets[s % MAX_RX_TOPHONE];
+        if (p->id == request_id)
+            nodenum = p->to; // the newest one wins
     }
     return nodenum;
 }
 
+void MeshService::addPhoneReader(ToPhoneReader *reader)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    reader->next = toPhoneHead;
+    reader->overruns = 0;
+    toPhoneReaders.push_back(reader);
+}
+
+void MeshService::removePhoneReader(const ToPhoneReader *reader)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    for (auto i = toPhoneReaders.begin(); i != toPhoneReaders.end(); i++) {
+        if (*i == reader) {
+            toPhoneReaders.erase(i);
+            break;
+        }
+    }
+    trimToPhone();
+    inbox.checkpoint();
+}
+
+bool MeshService::copyForPhone(ToPhoneReader &reader, meshtastic_MeshPacket &out)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    if (inbox.nextPending(out))
+        return true;
+
+    if ((int32_t)(reader.next - toPhoneHead) < 0) {
+        LOG_WARN("Phone missed %u packets, the ToPhone queue was full\n", toPhoneHead - reader.next);
+        reader.overruns += toPhoneHead - reader.next;
+        reader.next = toPhoneHead;
+    }
+    // Skip what its filter doesn't want, without copying it
+    uint32_t now = millis();
+    while (reader.next != toPhoneTail && !reader.filter.pass(*toPhonePackets[reader.next % MAX_RX_TOPHONE], now))
+        reader.next++;
+    if (reader.next == toPhoneTail) {
+        trimToPhone();
+        return false;
+    }
+
+    out = *toPhonePackets[reader.next++ % MAX_RX_TOPHONE];
+    trimToPhone();
+    return true;
+}
+
+bool MeshService::hasForPhone(const ToPhoneReader &reader)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    if (inbox.hasPending())
+        return true;
+    // Rate limited ones count, copyForPhone() finds out whether they are due
+    for (uint32_t s = reader.next; (int32_t)(toPhoneTail - s) > 0; s++)
+        if ((int32_t)(s - toPhoneHead) < 0 || reader.filter.wants(*toPhonePackets[s % MAX_RX_TOPHONE]))
+            return true;
+    return false;
+}
+
+uint32_t MeshService::getForPhoneBacklog(const ToPhoneReader &reader)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    uint32_t from = (int32_t)(reader.next - toPhoneHead) < 0 ? toPhoneHead : reader.next;
+    return (toPhoneTail - from) + (inbox.hasPending() ? 1 : 0) + toPhoneMqttProxyQueue.numUsed();
+}
+
+bool MeshService::setPhoneFilter(ToPhoneReader &reader, const uint8_t *payload, size_t len)
+{
+    concurrency::LockGuard g(toPhoneLock);
+    return reader.filter.set(payload, len);
+}
+
+bool MeshService::isWantedByPhones(const meshtastic_MeshPacket *p) const
+{
+    if (toPhoneReaders.empty())
+        return true; // keep it for whoever connects next
+    for (const ToPhoneReader *reader : toPhoneReaders)
+        if (reader->filter.wants(*p))
+            return true;
+    return false;
+}
+
+void MeshService::trimToPhone()
+{
+    if (toPhoneReaders.empty())
+        return; // keep them for the next phone to connect
+
+    while (toPhoneHead != toPhoneTail) {
+        for (const ToPhoneReader *reader : toPhoneReaders)
+            if ((int32_t)(reader->next - toPhoneHead) <= 0)
+                return; // somebody still wants it
+        releaseToPool(toPhonePackets[toPhoneHead++ % MAX_RX_TOPHONE]);
+    }
+}
+
+MeshService::ToPhonePolicy MeshService::getToPhonePolicy(const meshtastic_MeshPacket *p)
+{
+    if (p->which_payload_variant != meshtastic_MeshPacket_decoded_tag)
+        return TOPHONE_DROPPABLE;
+    if (isTextPayload(p))
+        return TOPHONE_KEEP;
+#if TOPHONE_COALESCE_TELEMETRY
+    if (p->decoded.portnum == meshtastic_PortNum_TELEMETRY_APP && !p->decoded.request_id)
+        return TOPHONE_COALESCE;
+#endif
+    return TOPHONE_DROPPABLE;
+}
+
+/// @return which kind of metrics a telemetry packet holds, 0 if we can't tell
+static pb_size_t getTelemetryVariant(const meshtastic_MeshPacket *p)
+{
+    meshtastic_Telemetry t = meshtastic_Telemetry_init_zero;
+    if (!pb_decode_from_bytes(p->decoded.payload.bytes, p->decoded.payload.size, &meshtastic_Telemetry_msg, &t))
+        return 0;
+    return t.which_variant;
+}
+
+bool MeshService::coalesceForPhone(meshtastic_MeshPacket *p)
+{
+    // Only packets no reader has downloaded yet can be replaced
+    uint32_t unread = toPhoneHead;
+    for (const ToPhoneReader *reader : toPhoneReaders)
+        if ((int32_t)(reader->next - unread) > 0)
+            unread = reader->next;
+
+    pb_size_t variant = 0;
+    for (uint32_t s = toPhoneTail; s != unread;) {
+        meshtastic_MeshPacket *&q = toPhonePackets[--s % MAX_RX_TOPHONE];
+        if (q->from != p->from || q->to != p->to || q->channel != p->channel || getToPhonePolicy(q) != TOPHONE_COALESCE)
+            continue;
+        if (!variant)
+            variant = getTelemetryVariant(p);
+        if (variant && getTelemetryVariant(q) == variant) {
+            LOG_DEBUG("Replacing the older telemetry from 0x%x waiting for the phone\n", p->from);
+            releaseToPool(q);
+            q = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MeshService::dropForPhone(uint32_t s)
+{
+    metrics.count(Metrics::TOPHONE_DROPPED);
+    releaseToPool(toPhonePackets[s % MAX_RX_TOPHONE]);
+    for (uint32_t i = s; i != toPhoneHead; i--)
+        toPhonePackets[i % MAX_RX_TOPHONE] = toPhonePackets[(i - 1) % MAX_RX_TOPHONE];
+
+    // Everybody who hadn't got past it loses it, and the packets before it moved up by one
+    for (ToPhoneReader *reader : toPhoneReaders) {
+        if ((int32_t)(reader->next - toPhoneHead) >= 0 && (int32_t)(reader->next - s) <= 0) {
+            reader->next++;
+            reader->overruns++;
+        }
+    }
+    toPhoneHead++;
+}
+
 /**
  *  Given a ToRadio buffer parse it and properly handle it (setup radio, owner or send packet into the mesh)
  * Called by PhoneAPI.handleToRadio.  Note: p is a scratch buffer, this function is allowed to write to it but it can not keep a
@@ -201,16 +377,27 @@ void MeshService::handleToRadio(meshtastic_MeshPacket &p)
     p.rx_time = getValidTime(RTCQualityFromNet); // Record the time the packet arrived from the phone
                                                  // (so we update our nodedb for the local node)
 
+    // A history request our own inbox covers needn't go to a S&F server
+    {
+        concurrency::LockGuard g(toPhoneLock);
+        if (inbox.answerHistoryRequest(p)) {
+            fromNum++;
+            return;
+        }
+    }
+
+    // A trace route we did lately needn't flood the mesh again, and a remote settings edit can go in one transfer
+    if ((traceRouteModule && traceRouteModule->answerFromCache(p)) || (adminModule && adminModule->bundleFromPhone(p)))
+        return;
+
     // Send the packet into the mesh
 
     sendToMesh(packetPool.allocCopy(p), RX_SRC_USER);
 
     bool loopback = false; // if true send any packet the phone sends back itself (for testing)
     if (loopback) {
-        // no need to copy anymore because handle from radio assumes it should _not_ delete
-        // packetPool.allocCopy(r.variant.packet);
-        handleFromRadio(&p);
-        // handleFromRadio will tell the phone a new packet arrived
+        // p isn't from packetPool, so it can't be shared like handleFromRadio() would
+        sendToPhone(packetPool.allocCopy(p));
     }
 }
 
@@ -222,24 +409,46 @@ bool MeshService::cancelSending(PacketId id)
 
 ErrorCode MeshService::sendQueueStatusToPhone(const meshtastic_QueueStatus &qs, ErrorCode res, uint32_t mesh_packet_id)
 {
-    meshtastic_QueueStatus *copied = queueStatusPool.allocCopy(qs);
-
-    copied->res = res;
-    copied->mesh_packet_id = mesh_packet_id;
-
-    if (toPhoneQueueStatusQueue.numFree() == 0) {
-        LOG_DEBUG("NOTE: tophone queue status queue is full, discarding oldest\n");
-        meshtastic_QueueStatus *d = toPhoneQueueStatusQueue.dequeuePtr(0);
-        if (d)
-            releaseQueueStatusToPool(d);
+    lastQueueStatus = qs;
+    lastQueueStatus.res = res;
+    lastQueueStatus.mesh_packet_id = mesh_packet_id;
+
+    bool queued = true;
+    if (res == ERRNO_OK) {
+        // A burst of sends makes one report, the phone only needs to know where the queue stands after it
+        concurrency::LockGuard g(toPhoneLock);
+        if (queueStatusReportPending)
+            queueStatusCoalesced++;
+        queueStatusReport = lastQueueStatus;
+        queueStatusReportPending = true;
+    } else {
+        meshtastic_QueueStatus *copied = queueStatusPool.allocCopy(lastQueueStatus);
+        if (toPhoneQueueStatusQueue.numFree() == 0) {
+            LOG_DEBUG("NOTE: tophone queue status queue is full, discarding oldest\n");
+            meshtastic_QueueStatus *d = toPhoneQueueStatusQueue.dequeuePtr(0);
+            if (d)
+                releaseQueueStatusToPool(d);
+        }
+        queued = toPhoneQueueStatusQueue.enqueue(copied, 0);
     }
-
-    lastQueueStatus = *copied;
-
-    res = toPhoneQueueStatusQueue.enqueue(copied, 0);
     fromNum++;
 
-    return res ? ERRNO_OK : ERRNO_UNKNOWN;
+    return queued ? ERRNO_OK : ERRNO_UNKNOWN;
+}
+
+meshtastic_QueueStatus *MeshService::getQueueStatusForPhone()
+{
+    meshtastic_QueueStatus *qs = toPhoneQueueStatusQueue.dequeuePtr(0);
+    if (qs)
+        return qs;
+
+    concurrency::LockGuard g(toPhoneLock);
+    if (!queueStatusReportPending)
+        return NULL;
+    queueStatusReportPending = false;
+    LOG_DEBUG("QueueStatus report for phone, free %u (%u folded into reports so far)\n", queueStatusReport.free,
+              queueStatusCoalesced);
+    return queueStatusPool.allocCopy(queueStatusReport);
 }
 
 void MeshService::sendToMesh(meshtastic_MeshPacket *p, RxSource src, bool ccToPhone)
@@ -247,6 +456,9 @@ void MeshService::sendToMesh(meshtastic_MeshPacket *p, RxSource src, bool ccToPh
     uint32_t mesh_packet_id = p->id;
     nodeDB.updateFrom(*p); // update our local DB for this packet (because phone might have sent position packets etc...)
 
+    // As we are sending it, before sendLocal() encrypts it (and takes it from us)
+    meshtastic_MeshPacket *cc = ccToPhone ? packetPool.share(p) : NULL;
+
     // Note: We might return !OK if our fifo was full, at that point the only option we have is to drop it
     ErrorCode res = router->sendLocal(p, src);
 
@@ -258,9 +470,8 @@ void MeshService::sendToMesh(meshtastic_MeshPacket *p, RxSource src, bool ccToPh
         LOG_DEBUG("Can't send status to phone");
     }
 
-    if (ccToPhone) {
-        sendToPhone(packetPool.allocCopy(*p));
-    }
+    if (cc)
+        sendToPhone(cc);
 }
 
 void MeshService::sendNetworkPing(NodeNum dest, bool wantReplies)
@@ -286,21 +497,47 @@ void MeshService::sendToPhone(meshtastic_MeshPacket *p)
 {
     perhapsDecode(p);
 
-    if (toPhoneQueue.numFree() == 0) {
-        if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP ||
-            p->decoded.portnum == meshtastic_PortNum_RANGE_TEST_APP) {
-            LOG_WARN("ToPhone queue is full, discarding oldest\n");
-            meshtastic_MeshPacket *d = toPhoneQueue.dequeuePtr(0);
-            if (d)
-                releaseToPool(d);
-        } else {
-            LOG_WARN("ToPhone queue is full, dropping packet.\n");
+    concurrency::LockGuard g(toPhoneLock);
+    ToPhonePolicy policy = getToPhonePolicy(p);
+#if PHONE_INBOX
+    if (inbox.isReady() && PhoneInbox::wants(*p)) {
+        // With nobody downloading, or older messages still to come from the inbox, it waits there rather than in RAM
+        bool live = !toPhoneReaders.empty() && !inbox.hasPending();
+        if (inbox.append(*p, live) && !live) {
             releaseToPool(p);
+            fromNum++;
             return;
         }
     }
+#endif
+    if (!isWantedByPhones(p)) {
+        metrics.count(Metrics::TOPHONE_FILTERED);
+        releaseToPool(p);
+        return;
+    }
+    if (policy == TOPHONE_COALESCE && coalesceForPhone(p)) {
+        fromNum++;
+        return;
+    }
+
+    if (toPhoneTail - toPhoneHead >= MAX_RX_TOPHONE) {
+        // Make room by dropping the oldest packet we may drop, or else the oldest of the ones we keep, if p is one of those
+        uint32_t victim = toPhoneHead;
+        while (victim != toPhoneTail && getToPhonePolicy(toPhonePackets[victim % MAX_RX_TOPHONE]) == TOPHONE_KEEP)
+            victim++;
+        if (victim == toPhoneTail) {
+            if (policy != TOPHONE_KEEP) {
+                LOG_WARN("ToPhone queue is full, dropping packet.\n");
+                releaseToPool(p);
+                return;
+            }
+            victim = toPhoneHead;
+        }
+        LOG_WARN("ToPhone queue is full, discarding an older packet\n");
+        dropForPhone(victim);
+    }
 
-    assert(toPhoneQueue.enqueue(p, 0));
+    toPhonePackets[toPhoneTail++ % MAX_RX_TOPHONE] = p;
     fromNum++;
 }
 
@@ -314,6 +551,7 @@ void MeshService::sendMqttMessageToClientProxy(meshtastic_MqttClientProxyMessage
             releaseMqttClientProxyMessageToPool(d);
     }
 
+    mqttProxyInFlight++;
     assert(toPhoneMqttProxyQueue.enqueue(m, 0));
     fromNum++;
 }
@@ -332,8 +570,8 @@ meshtastic_NodeInfoLite *MeshService::refreshLocalMeshNode()
     meshtastic_PositionLite &position = node->position;
 
     // Update our local node info with our time (even if we don't decide to update anyone else)
-    node->last_heard =
-        getValidTime(RTCQualityFromNet); // This nodedb timestamp might be stale, so update it if our clock is kinda valid
+    nodeDB.setLastHeard(
+        node, getValidTime(RTCQualityFromNet)); // This nodedb timestamp might be stale, so update it if our clock is kinda valid
 
     position.time = getValidTime(RTCQualityFromNet);
 
@@ -380,5 +618,6 @@ int MeshService::onGPSChanged(const meshtastic::GPSStatus *newStatus)
 
 bool MeshService::isToPhoneQueueEmpty()
 {
-    return toPhoneQueue.isEmpty();
+    concurrency::LockGuard g(toPhoneLock);
+    return toPhoneHead == toPhoneTail;
 }
\ No newline at end of file
@@ -2,18 +2,35 @@
 
 #include <Arduino.h>
 #include <assert.h>
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "GPSStatus.h"
 #include "MemoryPool.h"
 #include "MeshRadio.h"
 #include "MeshTypes.h"
 #include "Observer.h"
+#include "PhoneFilter.h"
+#include "PhoneInbox.h"
 #include "PointerQueue.h"
+#include "concurrency/Lock.h"
+#include "mesh-pb-constants.h"
 #if defined(ARCH_PORTDUINO) && !HAS_RADIO
 #include "../platform/portduino/SimRadio.h"
 #endif
 
+/// Keep just the newest telemetry of each kind from each node waiting for the phone, rather than every report
+#ifndef TOPHONE_COALESCE_TELEMETRY
+#define TOPHONE_COALESCE_TELEMETRY 1
+#endif
+
+/// How many MqttClientProxyMessages we hand the client proxy before it has taken the earlier ones, MQTT keeps the rest in its
+/// outbox meanwhile (rather than us discarding the oldest)
+#ifndef MQTT_PROXY_WINDOW
+#define MQTT_PROXY_WINDOW 8
+#endif
+
 extern Allocator<meshtastic_QueueStatus> &queueStatusPool;
 extern Allocator<meshtastic_MqttClientProxyMessage> &mqttClientProxyMessagePool;
 
@@ -26,18 +43,38 @@ class MeshService
     CallbackObserver<MeshService, const meshtastic::GPSStatus *> gpsObserver =
         CallbackObserver<MeshService, const meshtastic::GPSStatus *>(this, &MeshService::onGPSChanged);
 
-    /// received packets waiting for the phone to process them
-    /// FIXME, change to a DropOldestQueue and keep a count of the number of dropped packets to ensure
-    /// we never hang because android hasn't been there in a while
-    /// FIXME - save this to flash on deep sleep
-    PointerQueue<meshtastic_MeshPacket> toPhoneQueue;
+    /// Received packets waiting for the phones to download them.  toPhoneHead and toPhoneTail count every packet we ever queued,
+    /// packet s lives in toPhonePackets[s % MAX_RX_TOPHONE].  Each connected PhoneAPI reads them through its own cursor (see
+    /// addPhoneReader()), and a packet goes back to the pool once every reader has it, or when we need its room (see
+    /// getToPhonePolicy()).
+    /// FIXME - save this to flash on deep sleep (text messages already wait in inbox instead, see sendToPhone())
+    meshtastic_MeshPacket *toPhonePackets[MAX_RX_TOPHONE] = {};
+    uint32_t toPhoneHead = 0, toPhoneTail = 0;
 
-    // keep list of QueueStatus packets to be send to the phone
+    /// The text messages we received, on flash, touched only with toPhoneLock held like the rest of our packets for the phone
+    PhoneInbox inbox;
+
+    /// Phones read from the BLE task, so our toPhone ring (and its readers) are only touched with this held
+    concurrency::Lock *toPhoneLock = NULL;
+
+    // keep list of QueueStatus packets to be send to the phone: each packet we couldn't queue for sending, so the phone hears
+    // of every one of those
     PointerQueue<meshtastic_QueueStatus> toPhoneQueueStatusQueue;
 
+    /// The packets we did queue share one cumulative report instead (the newest state of our TX queue and the last packet
+    /// which got in), rather than a QueueStatus each.  Touched with toPhoneLock held
+    meshtastic_QueueStatus queueStatusReport = meshtastic_QueueStatus_init_zero;
+    bool queueStatusReportPending = false;
+
+    /// How many QueueStatus we folded into a report already waiting for the phone, for debugging
+    uint32_t queueStatusCoalesced = 0;
+
     // keep list of MqttClientProxyMessages to be send to the client for delivery
     PointerQueue<meshtastic_MqttClientProxyMessage> toPhoneMqttProxyQueue;
 
+    /// The MqttClientProxyMessages we have been given and not released yet: queued, or held by a PhoneAPI until it sends them
+    std::atomic<int> mqttProxyInFlight{0};
+
     // This holds the last QueueStatus send
     meshtastic_QueueStatus lastQueueStatus;
 
@@ -47,6 +84,27 @@ class MeshService
     /// Updated in loop() to detect when fromNum changes
     uint32_t oldFromNum = 0;
 
+  public:
+    /// A PhoneAPI's place in our packets for the phone
+    struct ToPhoneReader {
+        uint32_t next = 0;     // the next packet it downloads
+        uint32_t overruns = 0; // how many packets it lost, because it didn't keep up
+        PhoneFilter filter;    // which of them it wants, set with setPhoneFilter()
+    };
+
+    /// What we do with a packet for the phone when our queue is full
+    enum ToPhonePolicy {
+        TOPHONE_KEEP,      // only dropped (oldest first) for another one of these, when there is nothing else left to drop
+        TOPHONE_COALESCE,  // replaces an older one from the same node which nobody downloaded yet, otherwise as droppable
+        TOPHONE_DROPPABLE, // the oldest of these goes first
+    };
+
+    static ToPhonePolicy getToPhonePolicy(const meshtastic_MeshPacket *p);
+
+  private:
+    /// Everybody downloading our toPhonePackets
+    std::vector<ToPhoneReader *> toPhoneReaders;
+
   public:
     static bool isTextPayload(const meshtastic_MeshPacket *p)
     {
@@ -56,6 +114,14 @@ class MeshService
         return p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP ||
                p->decoded.portnum == meshtastic_PortNum_DETECTION_SENSOR_APP;
     }
+
+    /// Add every portnum isTextPayload() might return true for to ports (for MeshModule::getPortNums())
+    static void getTextPayloadPortNums(std::vector<meshtastic_PortNum> &ports)
+    {
+        ports.push_back(meshtastic_PortNum_RANGE_TEST_APP);
+        ports.push_back(meshtastic_PortNum_TEXT_MESSAGE_APP);
+        ports.push_back(meshtastic_PortNum_DETECTION_SENSOR_APP);
+    }
     /// Called when some new packets have arrived from one of the radios
     Observable<uint32_t> fromNumChanged;
 
@@ -69,27 +135,58 @@ class MeshService
     /// Do idle processing (mostly processing messages which have been queued from the radio)
     void loop();
 
-    /// Return the next packet destined to the phone.  FIXME, somehow use fromNum to allow the phone to retry the
-    /// last few packets if needs to.
-    meshtastic_MeshPacket *getForPhone() { return toPhoneQueue.dequeuePtr(0); }
+    /// A PhoneAPI starts downloading the packets for the phone, from the oldest one we still have
+    void addPhoneReader(ToPhoneReader *reader);
+
+    void removePhoneReader(const ToPhoneReader *reader);
+
+    /// Copy the next packet for reader to out, and move it past that packet.  Messages waiting in our inbox come first, whoever
+    /// reads them.  @return false if there is none
+    bool copyForPhone(ToPhoneReader &reader, meshtastic_MeshPacket &out);
+
+    /// @return true if reader has packets left to download
+    bool hasForPhone(const ToPhoneReader &reader);
+
+    /// @return about how many packets reader has left to download (before its filter, which it might not want)
+    uint32_t getForPhoneBacklog(const ToPhoneReader &reader);
+
+    /// Set the filter a client sent us in payload for reader (see PhoneFilter), @return false if it isn't one
+    bool setPhoneFilter(ToPhoneReader &reader, const uint8_t *payload, size_t len);
+
+    const PhoneInbox &getInbox() const { return inbox; }
 
     /// Allows the bluetooth handler to free packets after they have been sent
     void releaseToPool(meshtastic_MeshPacket *p) { packetPool.release(p); }
 
-    /// Return the next QueueStatus packet destined to the phone.
-    meshtastic_QueueStatus *getQueueStatusForPhone() { return toPhoneQueueStatusQueue.dequeuePtr(0); }
+    /// Return the next QueueStatus packet destined to the phone (our failures first, then the cumulative report), release it
+    /// with releaseQueueStatusToPool()
+    meshtastic_QueueStatus *getQueueStatusForPhone();
 
     /// Return the next MqttClientProxyMessage packet destined to the phone.
     meshtastic_MqttClientProxyMessage *getMqttClientProxyMessageForPhone() { return toPhoneMqttProxyQueue.dequeuePtr(0); }
 
+    /// How many more MqttClientProxyMessages we can queue for the phone before we start discarding the oldest
+    int getMqttClientProxyQueueFree() { return toPhoneMqttProxyQueue.numFree(); }
+
+    /// How many more MqttClientProxyMessages the client proxy's window has room for, each one it takes makes room for another
+    int getMqttClientProxyWindowFree()
+    {
+        int free = MQTT_PROXY_WINDOW - mqttProxyInFlight, queueFree = getMqttClientProxyQueueFree();
+        return free < queueFree ? free : queueFree;
+    }
+
     // search the queue for a request id and return the matching nodenum
     NodeNum getNodenumFromRequestId(uint32_t request_id);
 
     // Release QueueStatus packet to pool
     void releaseQueueStatusToPool(meshtastic_QueueStatus *p) { queueStatusPool.release(p); }
 
-    // Release MqttClientProxyMessage packet to pool
-    void releaseMqttClientProxyMessageToPool(meshtastic_MqttClientProxyMessage *p) { mqttClientProxyMessagePool.release(p); }
+    // Release MqttClientProxyMessage packet to pool, which makes room in the client proxy's window
+    void releaseMqttClientProxyMessageToPool(meshtastic_MqttClientProxyMessage *p)
+    {
+        mqttClientProxyMessagePool.release(p);
+        mqttProxyInFlight--;
+    }
 
     /**
      *  Given a ToRadio buffer parse it and properly handle it (setup radio, owner or send packet into the mesh)
@@ -132,6 +229,18 @@ class MeshService
     ErrorCode sendQueueStatusToPhone(const meshtastic_QueueStatus &qs, ErrorCode res, uint32_t mesh_packet_id);
 
   private:
+    /// @return false if every connected reader's filter rejects p, so no slot need hold it.  Call with toPhoneLock held
+    bool isWantedByPhones(const meshtastic_MeshPacket *p) const;
+
+    /// Release the packets every reader has downloaded, call with toPhoneLock held
+    void trimToPhone();
+
+    /// Put p in place of an older packet it coalesces with, @return false if there is none.  Call with toPhoneLock held
+    bool coalesceForPhone(meshtastic_MeshPacket *p);
+
+    /// Drop our packet s, moving the older ones up to fill its place.  Call with toPhoneLock held
+    void dropForPhone(uint32_t s);
+
     /// Called when our gps position has changed - updates nodedb and sends Location message out into the mesh
     /// returns 0 to allow further processing
     int onGPSChanged(const meshtastic::GPSStatus *arg);
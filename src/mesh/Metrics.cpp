@@ -0,0 +1,332 @@
+#include "Metrics.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "RadioLibInterface.h"
+#include "RadioStats.h"
+#include "airtime.h"
+#include "concurrency/OSThread.h"
+#include "concurrency/Scheduler.h"
+#include "configuration.h"
+#include "gps/GPS.h"
+#include "memGet.h"
+#include "mqtt/MQTT.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+Metrics metrics;
+
+#if (HAS_WIFI || HAS_ETHERNET) && !defined(ARCH_PORTDUINO)
+extern Syslog syslog;
+#endif
+
+MetricsWriter::MetricsWriter(char *_buf, size_t _size, Print *_out) : buf(_buf), size(_size), out(_out)
+{
+    if (size)
+        buf[0] = 0;
+    else
+        overflow = true;
+}
+
+void MetricsWriter::flush()
+{
+    if (out && len && !overflow) {
+        out->write((const uint8_t *)buf, len);
+        len = 0;
+        buf[0] = 0;
+    }
+}
+
+void MetricsWriter::put(const char *s, size_t n)
+{
+    while (n && !overflow) {
+        size_t room = size - 1 - len; // keeping room for our NUL terminator
+        if (!room) {
+            if (!out || size < 2) {
+                overflow = true;
+                return;
+            }
+            flush();
+            continue;
+        }
+        size_t chunk = n < room ? n : room;
+        memcpy(buf + len, s, chunk);
+        len += chunk;
+        s += chunk;
+        n -= chunk;
+        buf[len] = 0;
+    }
+}
+
+void MetricsWriter::put(const char *s)
+{
+    put(s, strlen(s));
+}
+
+void MetricsWriter::put(char c)
+{
+    put(&c, 1);
+}
+
+void MetricsWriter::putLabel(const char *name, const char *value)
+{
+    put(name);
+    put("=\"");
+    for (const char *s = value ? value : ""; *s; s++) {
+        if (*s == '\\' || *s == '"')
+            put('\\');
+        if (*s == '\n')
+            put("\\n");
+        else
+            put(*s);
+    }
+    put('"');
+}
+
+void MetricsWriter::putValue(uint32_t v)
+{
+    char digits[11];
+    put(digits, snprintf(digits, sizeof(digits), "%u", (unsigned)v));
+}
+
+void MetricsWriter::putValue(double v)
+{
+    if (isnan(v)) {
+        put("NaN");
+    } else if (isinf(v)) {
+        put(v > 0 ? "+Inf" : "-Inf");
+    } else {
+        char digits[24];
+        put(digits, snprintf(digits, sizeof(digits), "%.9g", v));
+    }
+}
+
+void MetricsWriter::family(const char *name, const char *type, const char *help)
+{
+    put("# HELP ");
+    put(name);
+    put(' ');
+    put(help);
+    put("\n# TYPE ");
+    put(name);
+    put(' ');
+    put(type);
+    put('\n');
+}
+
+void MetricsWriter::sample(const char *name, const char *label1, const char *value1, const char *label2, const char *value2,
+                           double v)
+{
+    put(name);
+    put('{');
+    putLabel(label1, value1);
+    put(',');
+    putLabel(label2, value2);
+    put("} ");
+    putValue(v);
+    put('\n');
+}
+
+/// One metric (and its samples, for each label value it has), and where write() gets it from
+struct MetricFamily {
+    const char *name, *type, *help;
+    void (*write)(MetricsWriter &w, const char *name);
+};
+
+static const MetricFamily families[] = {
+    {"meshtastic_uptime_seconds", "gauge", "Seconds since boot",
+     [](MetricsWriter &w, const char *name) { w.sample(name, (uint32_t)(millis() / 1000)); }},
+
+    {"meshtastic_rx_packets_total", "counter", "Packets our radio received, by whether we could read them",
+     [](MetricsWriter &w, const char *name) {
+         if (RadioLibInterface::instance) {
+             w.sample(name, "result", "good", RadioLibInterface::instance->rxGood);
+             w.sample(name, "result", "bad", RadioLibInterface::instance->rxBad);
+         }
+     }},
+    {"meshtastic_tx_packets_total", "counter", "Packets our radio sent",
+     [](MetricsWriter &w, const char *name) {
+         if (RadioLibInterface::instance)
+             w.sample(name, RadioLibInterface::instance->txGood);
+     }},
+    {"meshtastic_radio_errors_total", "counter", "Packets lost between our radio and the Router (queue drops included)",
+     [](MetricsWriter &w, const char *name) {
+         for (uint8_t i = 0; i < RadioStats::NUM_ERRORS; i++) {
+             RadioStats::Error e = (RadioStats::Error)i;
+             w.sample(name, "error", RadioStats::getErrorName(e), radioStats.getErrorCount(e));
+         }
+     }},
+    {"meshtastic_rx_duplicates_total", "counter", "Packets we had already seen",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::RX_DUPLICATE)); }},
+    {"meshtastic_tx_retransmissions_total", "counter", "Reliable packets we sent again, not having heard an ack",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TX_RETRANSMISSION)); }},
+    {"meshtastic_tx_retransmission_failures_total", "counter", "Reliable packets we gave up on",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TX_RETRANSMISSION_FAILED)); }},
+    {"meshtastic_tophone_dropped_total", "counter", "Packets for the phones we dropped to make room for others",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TOPHONE_DROPPED)); }},
+    {"meshtastic_tophone_filtered_total", "counter", "Packets for the phones no connected client's filter wanted",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TOPHONE_FILTERED)); }},
+#if PHONE_INBOX
+    {"meshtastic_phone_inbox_messages", "gauge", "Text messages we hold on flash for the phones",
+     [](MetricsWriter &w, const char *name) { w.sample(name, service.getInbox().getNumMessages()); }},
+    {"meshtastic_phone_inbox_lost_total", "counter", "Messages our phone inbox wrote over before a phone downloaded them",
+     [](MetricsWriter &w, const char *name) { w.sample(name, service.getInbox().getNumLost()); }},
+    {"meshtastic_phone_inbox_history_answered_total", "counter", "S&F history requests we answered from our phone inbox",
+     [](MetricsWriter &w, const char *name) { w.sample(name, service.getInbox().getNumAnswered()); }},
+#endif
+#if (HAS_WIFI || HAS_ETHERNET) && !defined(ARCH_PORTDUINO)
+    {"meshtastic_syslog_datagrams_total", "counter", "Datagrams (each a batch of log lines) we sent to our syslog server",
+     [](MetricsWriter &w, const char *name) { w.sample(name, syslog.getNumSent()); }},
+    {"meshtastic_syslog_dropped_total", "counter", "Log lines we couldn't send to our syslog server",
+     [](MetricsWriter &w, const char *name) { w.sample(name, syslog.getNumDropped()); }},
+#endif
+    {"meshtastic_rebroadcasts_total", "counter",
+     "Packets we went to send on for others, by how we picked when (csma or slotted), and whether CAD let us (sent or busy)",
+     [](MetricsWriter &w, const char *name) {
+         w.sample(name, "mode", "csma", "result", "sent", (double)metrics.get(Metrics::REBROADCAST_CSMA));
+         w.sample(name, "mode", "csma", "result", "busy", (double)metrics.get(Metrics::REBROADCAST_BUSY_CSMA));
+         w.sample(name, "mode", "slotted", "result", "sent", (double)metrics.get(Metrics::REBROADCAST_SLOTTED));
+         w.sample(name, "mode", "slotted", "result", "busy", (double)metrics.get(Metrics::REBROADCAST_BUSY_SLOTTED));
+     }},
+    {"meshtastic_tx_deferred_total", "counter", "Times our background traffic waited for the channel to get quieter",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TX_DEFERRED)); }},
+    {"meshtastic_tx_defer_expired_total", "counter", "Background packets we sent on a busy channel, having waited too long",
+     [](MetricsWriter &w, const char *name) { w.sample(name, metrics.get(Metrics::TX_DEFER_EXPIRED)); }},
+    {"meshtastic_channel_utilization_ratio", "gauge", "How busy the channel has been lately, 0 to 1",
+     [](MetricsWriter &w, const char *name) {
+         if (airTime)
+             w.sample(name, (double)airTime->channelUtilizationPercent() / 100);
+     }},
+    {"meshtastic_channel_busy_ratio", "gauge",
+     "How busy the channel is, counting what our samples of it heard but we couldn't demodulate, 0 to 1",
+     [](MetricsWriter &w, const char *name) {
+         if (!airTime)
+             return;
+         w.sample(name, "source", "combined", (double)airTime->channelBusyPercent() / 100);
+         if (airTime->sampledBusyPercent() >= 0)
+             w.sample(name, "source", "sampled", (double)airTime->sampledBusyPercent() / 100);
+     }},
+    {"meshtastic_tx_utilization_ratio", "gauge", "How much of the last hour we spent sending, 0 to 1",
+     [](MetricsWriter &w, const char *name) {
+         if (airTime)
+             w.sample(name, (double)airTime->utilizationTXPercent() / 100);
+     }},
+
+    {"meshtastic_airtime_node_seconds", "gauge", "Airtime of the busiest nodes (as originators), over the last 1-2 windows",
+     [](MetricsWriter &w, const char *name) {
+         if (!airTime)
+             return;
+         const AirTime::NodeAirtime::Entry *top[AIRTIME_TOP_NODES];
+         uint8_t n = airTime->getNodeAirtime().getTop(top, AIRTIME_TOP_NODES);
+         for (uint8_t i = 0; i < n; i++) {
+             char node[12];
+             snprintf(node, sizeof(node), "!%08x", top[i]->key);
+             w.sample(name, "node", node, top[i]->getMsec() / 1000.0);
+         }
+     }},
+    {"meshtastic_airtime_port_seconds", "gauge", "Airtime of the busiest portnums we heard, over the last 1-2 windows",
+     [](MetricsWriter &w, const char *name) {
+         if (!airTime)
+             return;
+         const AirTime::PortAirtime::Entry *top[AIRTIME_TOP_PORTS];
+         uint8_t n = airTime->getPortAirtime().getTop(top, AIRTIME_TOP_PORTS);
+         for (uint8_t i = 0; i < n; i++) {
+             char port[12];
+             snprintf(port, sizeof(port), "%u", top[i]->key);
+             w.sample(name, "port", port, top[i]->getMsec() / 1000.0);
+         }
+     }},
+
+    {"meshtastic_flash_writes_total", "counter", "Files we wrote to flash, or skipped writing as they were unchanged",
+     [](MetricsWriter &w, const char *name) {
+         w.sample(name, "result", "written", nodeDB.getNumDiskWrites());
+         w.sample(name, "result", "skipped", nodeDB.getNumSkippedDiskWrites());
+     }},
+    {"meshtastic_flash_write_seconds_total", "counter", "Time we spent writing files to flash",
+     [](MetricsWriter &w, const char *name) { w.sample(name, nodeDB.getTotalDiskWriteMsec() / 1000.0); }},
+
+    {"meshtastic_gps_fixes_total", "counter", "GPS wakes which ended with a fix, by whether we injected assistance",
+     [](MetricsWriter &w, const char *name) {
+         if (gps) {
+             const GPS::PowerStats &stats = gps->getPowerStats();
+             w.sample(name, "assisted", "true", stats.assistedFixes);
+             w.sample(name, "assisted", "false", stats.fixes - stats.assistedFixes);
+         }
+     }},
+    {"meshtastic_gps_fix_seconds_total", "counter", "Time our GPS took to those fixes, from waking",
+     [](MetricsWriter &w, const char *name) {
+         if (gps) {
+             const GPS::PowerStats &stats = gps->getPowerStats();
+             w.sample(name, "assisted", "true", stats.assistedFixMsec / 1000.0);
+             w.sample(name, "assisted", "false", (stats.fixMsec - stats.assistedFixMsec) / 1000.0);
+         }
+     }},
+
+    {"meshtastic_mqtt_queued_messages", "gauge", "Messages waiting in our outbox for the MQTT server",
+     [](MetricsWriter &w, const char *name) {
+         if (mqtt)
+             w.sample(name, mqtt->getOutbox().getNumMessages());
+     }},
+    {"meshtastic_mqtt_outbox_total", "counter", "What happened to messages which went through our outbox",
+     [](MetricsWriter &w, const char *name) {
+         if (mqtt) {
+             const MQTTOutbox &outbox = mqtt->getOutbox();
+             w.sample(name, "result", "sent", outbox.getNumSent());
+             w.sample(name, "result", "spilled", outbox.getNumSpilled());
+             w.sample(name, "result", "dropped", outbox.getNumDropped());
+         }
+     }},
+    {"meshtastic_mqtt_uplink_total", "counter", "Packets we uplinked to MQTT, or chose not to",
+     [](MetricsWriter &w, const char *name) {
+         if (mqtt) {
+             static const char *verdicts[MQTTUplinkPolicy::NUM_VERDICTS] = {"uplinked", "duplicate", "rate_limited",
+                                                                             "unchanged"};
+             const MQTTUplinkPolicy &policy = mqtt->getUplinkPolicy();
+             for (uint8_t i = 0; i < MQTTUplinkPolicy::NUM_VERDICTS; i++)
+                 w.sample(name, "verdict", verdicts[i], policy.getCount((MQTTUplinkPolicy::Verdict)i));
+         }
+     }},
+
+    {"meshtastic_heap_free_bytes", "gauge", "Free heap",
+     [](MetricsWriter &w, const char *name) { w.sample(name, memGet.getFreeHeap()); }},
+    {"meshtastic_heap_min_free_bytes", "gauge", "The least free heap we have had since boot",
+     [](MetricsWriter &w, const char *name) { w.sample(name, memGet.getMinFreeHeap()); }},
+    {"meshtastic_heap_placed_bytes", "gauge", "Our big buffers, by the memory region they were placed in",
+     [](MetricsWriter &w, const char *name) {
+         for (int i = 0; i < MEM_REGION_COUNT; i++)
+             w.sample(name, "region", MemGet::getRegionName((MemRegion)i), memGet.getPlacedBytes((MemRegion)i));
+     }},
+    {"meshtastic_heap_region_free_bytes", "gauge", "What is free of each memory region",
+     [](MetricsWriter &w, const char *name) {
+         for (int i = 0; i < MEM_REGION_COUNT; i++)
+             w.sample(name, "region", MemGet::getRegionName((MemRegion)i), memGet.getRegionFree((MemRegion)i));
+     }},
+
+#if OSTHREAD_PROFILE
+    // Only the costliest threads, as getProfileLine() shows, so a build with many modules doesn't have a long tail of idle ones
+    {"meshtastic_thread_cpu_seconds_total", "counter", "Time each of our costliest threads has spent running",
+     [](MetricsWriter &w, const char *name) {
+         concurrency::OSThread *costliest[OSTHREAD_PROFILE_TOP];
+         int n = concurrency::getCostliestThreads(costliest, OSTHREAD_PROFILE_TOP);
+         for (int i = 0; i < n; i++)
+             w.sample(name, "thread", costliest[i]->ThreadName.c_str(), "scheduler", costliest[i]->getController()->getName(),
+                      costliest[i]->getProfile().totalMicros / 1e6);
+     }},
+    {"meshtastic_thread_runs_total", "counter", "How many times each of our costliest threads has run",
+     [](MetricsWriter &w, const char *name) {
+         concurrency::OSThread *costliest[OSTHREAD_PROFILE_TOP];
+         int n = concurrency::getCostliestThreads(costliest, OSTHREAD_PROFILE_TOP);
+         for (int i = 0; i < n; i++)
+             w.sample(name, "thread", costliest[i]->ThreadName.c_str(), "scheduler", costliest[i]->getController()->getName(),
+                      (double)costliest[i]->getProfile().runs);
+     }},
+#endif
+};
+
+void Metrics::write(MetricsWriter &w) const
+{
+    for (const MetricFamily &f : families) {
+        w.family(f.name, f.type, f.help);
+        f.write(w, f.name);
+    }
+}
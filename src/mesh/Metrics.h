@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Print.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Writes the Prometheus text exposition format (https://prometheus.io/docs/instrumenting/exposition_formats/) straight into
+ * a buffer, flushing it to a Print whenever it fills, like JSONWriter.  Nothing is allocated: metric and label names are
+ * string literals (written as they are), label values are escaped.
+ *
+ *     MetricsWriter w(buf, sizeof(buf), res);
+ *     w.family("meshtastic_rx_packets_total", "counter", "Packets our radio received");
+ *     w.sample("meshtastic_rx_packets_total", "result", "good", rxGood);
+ *     w.flush();
+ */
+class MetricsWriter
+{
+    char *buf;
+    size_t size, len = 0;
+    Print *out;
+    bool overflow = false;
+
+    void put(char c);
+    void put(const char *s);
+    void put(const char *s, size_t n);
+    void putLabel(const char *name, const char *value);
+    void putValue(uint32_t v);
+    void putValue(double v);
+
+    template <typename T> void line(const char *name, const char *label, const char *labelValue, T v)
+    {
+        put(name);
+        if (label) {
+            put('{');
+            putLabel(label, labelValue);
+            put('}');
+        }
+        put(' ');
+        putValue(v);
+        put('\n');
+    }
+
+  public:
+    /// Write into buf, flushing to out whenever it fills up (if we have one)
+    MetricsWriter(char *buf, size_t size, Print *out = NULL);
+
+    /// The HELP and TYPE lines (type is "counter" or "gauge") which come before a metric's samples
+    void family(const char *name, const char *type, const char *help);
+
+    void sample(const char *name, uint32_t v) { line(name, NULL, NULL, v); }
+    void sample(const char *name, double v) { line(name, NULL, NULL, v); }
+    void sample(const char *name, const char *label, const char *labelValue, uint32_t v) { line(name, label, labelValue, v); }
+    void sample(const char *name, const char *label, const char *labelValue, double v) { line(name, label, labelValue, v); }
+
+    /// A sample with two labels, e.g. a thread and its scheduler
+    void sample(const char *name, const char *label1, const char *value1, const char *label2, const char *value2, double v);
+
+    /// Write whatever is left in our buffer to our Print
+    void flush();
+
+    /// @return true if the metrics didn't fit our buffer (and we have no Print to flush it to)
+    bool overflowed() const { return overflow; }
+
+    /// @return the length of the text so far, which (unless we overflowed) is NUL terminated in our buffer
+    size_t length() const { return len; }
+};
+
+/**
+ * Our metrics registry, for scraping a fleet of nodes.  The counters below are the ones nothing else kept, which their
+ * owners bump with count().  Everything else (RadioLibInterface's packet counts, RadioStats' errors, NodeDB's flash writes,
+ * MQTT's outbox and uplink counts, the OSThread profiles) write() reads from where it is already kept, through the table
+ * of metric families in Metrics.cpp, so adding a metric is adding a line there.
+ *
+ * Served as /metrics by our web server.
+ */
+class Metrics
+{
+  public:
+    enum Counter {
+        RX_DUPLICATE,             // packets we had already seen, FloodingRouter filtered them
+        TX_RETRANSMISSION,        // ReliableRouter sent a packet again, not having heard its ack
+        TX_RETRANSMISSION_FAILED, // ReliableRouter gave up on a packet, and sent ourselves a nak
+        TOPHONE_DROPPED,          // MeshService dropped a packet for the phones to make room for another
+        TOPHONE_FILTERED,         // ... or because no connected client's PhoneFilter wanted it
+        REBROADCAST_CSMA,         // someone else's packet we sent on after a random contention delay
+        REBROADCAST_SLOTTED,      // ... or in our slot, see RadioInterface::getSlottedTxDelayMsec()
+        REBROADCAST_BUSY_CSMA,    // CAD found the channel busy as we went to send one on, after a contention delay
+        REBROADCAST_BUSY_SLOTTED, // ... or in our slot
+        TX_DEFERRED,              // times our background traffic waited for a quieter channel, see USE_TX_DEFERRAL
+        TX_DEFER_EXPIRED,         // ... and times one had waited TX_DEFER_MAX_SECS, so went out on a busy channel
+        NUM_COUNTERS
+    };
+
+    void count(Counter c) { counters[c]++; }
+    uint32_t get(Counter c) const { return counters[c]; }
+
+    /// Write all of our metric families, in the Prometheus text format
+    void write(MetricsWriter &w) const;
+
+  private:
+    uint32_t counters[NUM_COUNTERS] = {};
+};
+
+extern Metrics metrics;
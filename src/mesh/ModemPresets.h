@@ -0,0 +1,137 @@
+#pragma once
+
+#include "mesh/generated/meshtastic/config.pb.h"
+#include <stdint.h>
+
+/**
+ * The LoRa timing formulas, constexpr so our preset tables below are worked out by the compiler, and RadioInterface uses
+ * the very same math at runtime for custom modem settings.  The float math is done in the same order (and precision) as it
+ * always was, so a table entry is exactly what the old runtime calculation gave.
+ */
+
+/// Symbol time in seconds, bw in kHz
+constexpr float loraSymbolSecs(uint8_t sf, float bw)
+{
+    return (1 << sf) / (bw * 1000.0f);
+}
+
+/// Low data rate optimization is needed if a symbol is longer than 16ms
+constexpr bool loraLowDataRate(uint8_t sf, float bw)
+{
+    return loraSymbolSecs(sf, bw) > 16e-3;
+}
+
+constexpr float loraCeil(float x)
+{
+    return (float)(int32_t)x == x ? x : (x > 0 ? (float)((int32_t)x + 1) : (float)(int32_t)x);
+}
+
+/// Payload symbols (past the preamble) of a packet of pl bytes, always with an explicit header
+constexpr float loraPayloadSymbols(uint8_t sf, uint8_t cr, bool lowDataRate, uint32_t pl)
+{
+    return 8 + (loraCeil(((8.0f * pl - 4 * sf + 28 + 16) / (4 * (sf - 2 * lowDataRate))) * cr) > 0.0f
+                    ? loraCeil(((8.0f * pl - 4 * sf + 28 + 16) / (4 * (sf - 2 * lowDataRate))) * cr)
+                    : 0.0f);
+}
+
+/**
+ * Airtime in msecs of a packet of pl bytes, per
+ * https://www.rs-online.com/designspark/rel-assets/ds-assets/uploads/knowledge-items/application-notes-for-the-internet-of-things/LoRa%20Design%20Guide.pdf
+ * section 4
+ */
+constexpr uint32_t loraPacketMsec(uint8_t sf, float bw, uint8_t cr, uint16_t preambleLength, uint32_t pl)
+{
+    return ((preambleLength + 4.25f) * loraSymbolSecs(sf, bw) +
+            loraPayloadSymbols(sf, cr, loraLowDataRate(sf, bw), pl) * loraSymbolSecs(sf, bw)) *
+           1000;
+}
+
+/** Slot time is the minimum time to wait, consisting of:
+  - CAD duration (maximum of SX126x and SX127x);
+  - roundtrip air propagation time (assuming max. 30km between nodes);
+  - Tx/Rx turnaround time (maximum of SX126x and SX127x);
+  - MAC processing time (measured on T-beam) */
+constexpr uint32_t loraSlotTimeMsec(uint8_t sf, float bw)
+{
+    return 8.5 * (1 << sf) / bw + 0.2 + 0.4 + 7;
+}
+
+/// The preamble we send, in symbols.  8 is the LoRa default, we use longer to let receivers sleep for longer
+#define LORA_PREAMBLE_LENGTH 16
+
+/// The contention window sizes (as a power of two number of slots) we pick from, for every preset
+#define LORA_CW_MIN 2
+#define LORA_CW_MAX 8
+
+/// A modem preset's settings, and the timing which follows from them
+struct ModemPresetInfo {
+    meshtastic_Config_LoRaConfig_ModemPreset preset;
+    float bw; // kHz
+    uint8_t sf, cr;
+    bool lowDataRate;
+    uint32_t symbolUsec;
+    uint32_t slotTimeMsec;
+    uint32_t emptyPacketMsec; // the airtime of a packet with no payload, with our LORA_PREAMBLE_LENGTH
+};
+
+#define MODEM_PRESET(name, bw, sf, cr)                                                                                           \
+    {                                                                                                                            \
+        meshtastic_Config_LoRaConfig_ModemPreset_##name, bw, sf, cr, loraLowDataRate(sf, bw),                                   \
+            (uint32_t)(loraSymbolSecs(sf, bw) * 1e6f), loraSlotTimeMsec(sf, bw),                                                 \
+            loraPacketMsec(sf, bw, cr, LORA_PREAMBLE_LENGTH, 0)                                                                  \
+    }
+
+/// Indexed by meshtastic_Config_LoRaConfig_ModemPreset, for regions without wide LoRa
+constexpr ModemPresetInfo modemPresets[] = {
+    MODEM_PRESET(LONG_FAST, 250, 11, 5),     MODEM_PRESET(LONG_SLOW, 125, 12, 8),   MODEM_PRESET(VERY_LONG_SLOW, 62.5, 12, 8),
+    MODEM_PRESET(MEDIUM_SLOW, 250, 10, 5),   MODEM_PRESET(MEDIUM_FAST, 250, 9, 5),  MODEM_PRESET(SHORT_SLOW, 250, 8, 5),
+    MODEM_PRESET(SHORT_FAST, 250, 7, 5),     MODEM_PRESET(LONG_MODERATE, 125, 11, 8),
+};
+
+/// The same for 2.4GHz wide LoRa, which has the same spreading factors and coding rates at 3.25 times the bandwidth
+constexpr ModemPresetInfo wideModemPresets[] = {
+    MODEM_PRESET(LONG_FAST, 812.5, 11, 5),   MODEM_PRESET(LONG_SLOW, 406.25, 12, 8), MODEM_PRESET(VERY_LONG_SLOW, 203.125, 12, 8),
+    MODEM_PRESET(MEDIUM_SLOW, 812.5, 10, 5), MODEM_PRESET(MEDIUM_FAST, 812.5, 9, 5), MODEM_PRESET(SHORT_SLOW, 812.5, 8, 5),
+    MODEM_PRESET(SHORT_FAST, 812.5, 7, 5),   MODEM_PRESET(LONG_MODERATE, 406.25, 11, 8),
+};
+
+static_assert(sizeof(modemPresets) / sizeof(modemPresets[0]) == _meshtastic_Config_LoRaConfig_ModemPreset_ARRAYSIZE,
+              "modemPresets needs an entry for every preset");
+static_assert(sizeof(wideModemPresets) / sizeof(wideModemPresets[0]) == _meshtastic_Config_LoRaConfig_ModemPreset_ARRAYSIZE,
+              "wideModemPresets needs an entry for every preset");
+
+constexpr bool modemPresetsInOrder(const ModemPresetInfo *table, uint32_t i)
+{
+    return i == _meshtastic_Config_LoRaConfig_ModemPreset_ARRAYSIZE ||
+           (table[i].preset == (meshtastic_Config_LoRaConfig_ModemPreset)i && modemPresetsInOrder(table, i + 1));
+}
+static_assert(modemPresetsInOrder(modemPresets, 0) && modemPresetsInOrder(wideModemPresets, 0),
+              "modem preset tables must be in meshtastic_Config_LoRaConfig_ModemPreset order");
+
+// What the runtime math gave for these before it was constexpr, so a change to the formulas above shows up here
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST].slotTimeMsec == 77, "LongFast slot time");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST].emptyPacketMsec == 231, "LongFast airtime");
+static_assert(!modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST].lowDataRate, "LongFast low data rate");
+static_assert(loraPacketMsec(11, 250, 5, LORA_PREAMBLE_LENGTH, 253) == 2115, "LongFast airtime of a full packet");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_SLOW].slotTimeMsec == 286, "LongSlow slot time");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_SLOW].lowDataRate, "LongSlow low data rate");
+static_assert(loraPacketMsec(12, 125, 8, LORA_PREAMBLE_LENGTH, 253) == 14163, "LongSlow airtime of a full packet");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_VERY_LONG_SLOW].emptyPacketMsec == 1851,
+              "VeryLongSlow airtime");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_MODERATE].slotTimeMsec == 146, "LongModerate slot time");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_SHORT_FAST].slotTimeMsec == 11, "ShortFast slot time");
+static_assert(modemPresets[meshtastic_Config_LoRaConfig_ModemPreset_SHORT_FAST].emptyPacketMsec == 15, "ShortFast airtime");
+static_assert(wideModemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST].slotTimeMsec == 29, "wide LongFast slot time");
+static_assert(wideModemPresets[meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST].emptyPacketMsec == 71,
+              "wide LongFast airtime");
+static_assert(wideModemPresets[meshtastic_Config_LoRaConfig_ModemPreset_VERY_LONG_SLOW].lowDataRate,
+              "wide VeryLongSlow low data rate");
+
+/// The settings for preset, LONG_FAST if it's not one we know (as a config from newer firmware might have)
+static inline const ModemPresetInfo &getModemPreset(meshtastic_Config_LoRaConfig_ModemPreset preset, bool wideLora)
+{
+    const ModemPresetInfo *table = wideLora ? wideModemPresets : modemPresets;
+    if ((uint32_t)preset >= _meshtastic_Config_LoRaConfig_ModemPreset_ARRAYSIZE)
+        preset = meshtastic_Config_LoRaConfig_ModemPreset_LONG_FAST;
+    return table[preset];
+}
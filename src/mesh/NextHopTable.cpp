@@ -0,0 +1,154 @@
+#include "NextHopTable.h"
+#include "NodeDB.h"
+#include "configuration.h"
+#include <algorithm>
+
+NextHopTable nextHops;
+
+static bool isFresh(uint32_t learnedMsec)
+{
+    return millis() - learnedMsec < NEXT_HOP_ROUTE_TTL_SECS * 1000UL;
+}
+
+NextHopTable::Route *NextHopTable::findRoute(NodeNum a, NodeNum b)
+{
+    if (a > b)
+        std::swap(a, b);
+
+    for (Route &r : routes)
+        if (r.a == a && r.b == b)
+            return &r;
+    return NULL;
+}
+
+const NextHopTable::Route *NextHopTable::findFreshRoute(NodeNum a, NodeNum b) const
+{
+    const Route *r = const_cast<NextHopTable *>(this)->findRoute(a, b);
+    return r && isFresh(r->learnedMsec) ? r : NULL;
+}
+
+void NextHopTable::learnRoute(NodeNum a, NodeNum b, bool viaUs)
+{
+    if (!a || !b || a == b || a == NODENUM_BROADCAST || b == NODENUM_BROADCAST)
+        return;
+
+    Route *r = findRoute(a, b);
+    if (!r) {
+        // An unused entry, or else the one we learned about longest ago
+        r = &routes[0];
+        for (Route &i : routes) {
+            if (!i.a) {
+                r = &i;
+                break;
+            }
+            if (millis() - i.learnedMsec > millis() - r->learnedMsec)
+                r = &i;
+        }
+        r->a = a < b ? a : b;
+        r->b = a < b ? b : a;
+    }
+
+    if (!r->viaUs && viaUs)
+        LOG_DEBUG("We're on the route between 0x%x and 0x%x\n", a, b);
+    r->learnedMsec = millis();
+    r->viaUs = viaUs;
+}
+
+void NextHopTable::forgetRoute(NodeNum a, NodeNum b)
+{
+    Route *r = findRoute(a, b);
+    if (r)
+        r->a = r->b = 0;
+}
+
+bool NextHopTable::hasRoute(NodeNum dest) const
+{
+    return findFreshRoute(nodeDB.getNodeNum(), dest) != NULL;
+}
+
+bool NextHopTable::shouldRelay(NodeNum from, NodeNum to) const
+{
+    const Route *r = findFreshRoute(from, to);
+    return !r || r->viaUs;
+}
+
+NextHopTable::Packet *NextHopTable::findPacket(NodeNum from, PacketId id)
+{
+    for (Packet &p : packets)
+        if (p.from == from && p.id == id)
+            return &p;
+    return NULL;
+}
+
+const NextHopTable::Packet *NextHopTable::findPacket(NodeNum from, PacketId id) const
+{
+    return const_cast<NextHopTable *>(this)->findPacket(from, id);
+}
+
+NextHopTable::Packet *NextHopTable::addPacket(NodeNum from, NodeNum to, PacketId id)
+{
+    Packet *p = findPacket(from, id);
+    if (!p) {
+        // Oldest first, by the time we wrap around its ack is long overdue
+        p = &packets[nextPacket];
+        nextPacket = (nextPacket + 1) % NEXT_HOP_MAX_PACKETS;
+        *p = Packet{from, to, id, false, false, false};
+    }
+    return p;
+}
+
+void NextHopTable::noteRelayed(const meshtastic_MeshPacket *p)
+{
+    addPacket(getFrom(p), p->to, p->id)->relayed = true;
+}
+
+void NextHopTable::noteAck(const meshtastic_MeshPacket *p)
+{
+    NodeNum sender = p->to, dest = getFrom(p); // of the DM being acked
+    if (sender == NODENUM_BROADCAST || !p->decoded.request_id)
+        return;
+
+    if (sender == nodeDB.getNodeNum()) {
+        learnRoute(sender, dest, false); // our end of it, nobody needs us to relay
+        return;
+    }
+
+    const Packet *dm = findPacket(sender, p->decoded.request_id);
+    learnRoute(sender, dest, dm && dm->relayed && dm->to == dest);
+}
+
+void NextHopTable::setRouted(NodeNum from, NodeNum to, PacketId id, bool routed)
+{
+    Packet *p = routed ? addPacket(from, to, id) : findPacket(from, id);
+    if (p)
+        p->routed = routed;
+}
+
+bool NextHopTable::isRouted(NodeNum from, PacketId id) const
+{
+    const Packet *p = findPacket(from, id);
+    return p && p->routed;
+}
+
+void NextHopTable::noteSuppressed(NodeNum from, PacketId id)
+{
+    Packet *p = findPacket(from, id);
+    if (p)
+        p->suppressed = true;
+}
+
+bool NextHopTable::takeReflood(NodeNum from, PacketId id)
+{
+    Packet *p = findPacket(from, id);
+    if (!p || !p->suppressed || p->routed)
+        return false;
+
+    p->suppressed = false;
+    return true;
+}
+
+bool NextHopTable::mayReflood(NodeNum from, PacketId id) const
+{
+    const Packet *p = findPacket(from, id);
+    return p && p->suppressed && !p->routed;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+/// How long what we learned about the route between two nodes stays good, every ack or trace route along it refreshes it
+#ifndef NEXT_HOP_ROUTE_TTL_SECS
+#define NEXT_HOP_ROUTE_TTL_SECS (15 * 60)
+#endif
+
+/// Pairs of nodes we keep a route for, the one we learned about longest ago makes room for a new one
+#ifndef NEXT_HOP_MAX_ROUTES
+#define NEXT_HOP_MAX_ROUTES 32
+#endif
+
+/// Direct messages we remember (that we relayed them, whether they were routed) until their ack comes back
+#define NEXT_HOP_MAX_PACKETS 32
+
+/**
+ * What we have learned about which nodes relay direct messages between two others, so a DM with a known route is passed on
+ * only by the nodes on that route rather than flooding the whole mesh.
+ *
+ * Our PacketHeader has no room to name a relay, so each node works out for itself whether it is on the route between two
+ * nodes: from the acks it passes on (or just overhears), from trace route replies (which list their route) and from
+ * NeighborInfo (two neighbors need nobody in between).  A sender with a fresh route to the destination sets
+ * PACKET_FLAGS_ROUTED_MASK on its first try, and nodes which know they are off that route stay quiet.  Retries go out
+ * without the flag and flood as before, with the nodes which stayed quiet for the routed copy joining in.  Nodes which know
+ * nothing fresh (and older firmware, which drops the flag when passing a packet on) always flood.
+ */
+class NextHopTable
+{
+    struct Route {
+        NodeNum a, b; // a < b, a == 0 for an unused entry
+        uint32_t learnedMsec;
+        bool viaUs; // we relay between a and b (otherwise they get by without us)
+    };
+
+    struct Packet {
+        NodeNum from, to; // from == 0 for an unused entry
+        PacketId id;
+        bool relayed;    // we passed it on
+        bool routed;     // the last copy we heard (or sent) had PACKET_FLAGS_ROUTED_MASK set
+        bool suppressed; // we didn't pass on the routed copy, because we're not on its route
+    };
+
+    Route routes[NEXT_HOP_MAX_ROUTES] = {};
+    Packet packets[NEXT_HOP_MAX_PACKETS] = {};
+    uint8_t nextPacket = 0;
+
+    Route *findRoute(NodeNum a, NodeNum b);
+    const Route *findFreshRoute(NodeNum a, NodeNum b) const;
+    Packet *findPacket(NodeNum from, PacketId id);
+    const Packet *findPacket(NodeNum from, PacketId id) const;
+    Packet *addPacket(NodeNum from, NodeNum to, PacketId id);
+
+  public:
+    /// Note that packets between a and b (in either direction) get through, and whether that takes us as a relay
+    void learnRoute(NodeNum a, NodeNum b, bool viaUs);
+
+    void forgetRoute(NodeNum a, NodeNum b);
+
+    /// @return true if we have a fresh route to dest, so a DM to it need not flood
+    bool hasRoute(NodeNum dest) const;
+
+    /// @return false if we know a fresh route between from and to which doesn't need us
+    bool shouldRelay(NodeNum from, NodeNum to) const;
+
+    /// We are passing on this DM, so if its ack comes back we know we're on its route
+    void noteRelayed(const meshtastic_MeshPacket *p);
+
+    /// p is an ack which we received or overheard, learn what it tells us about the route it answers
+    void noteAck(const meshtastic_MeshPacket *p);
+
+    /// Note whether this copy of a packet was routed.  An unrouted copy of a packet we know nothing about isn't remembered
+    void setRouted(NodeNum from, NodeNum to, PacketId id, bool routed);
+
+    bool isRouted(NodeNum from, PacketId id) const;
+
+    /// We didn't pass on this routed packet, because we're not on its route
+    void noteSuppressed(NodeNum from, PacketId id);
+
+    /**
+     * @return true (once) if we kept quiet for the routed copy of this packet, and the copy we just heard isn't routed anymore
+     * (its sender gave up on the route), so we should pass it on after all
+     */
+    bool takeReflood(NodeNum from, PacketId id);
+
+    /// @return true if takeReflood() would, without taking it
+    bool mayReflood(NodeNum from, PacketId id) const;
+};
+
+extern NextHopTable nextHops;
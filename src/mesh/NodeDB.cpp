@@ -5,18 +5,22 @@
 #include "CryptoEngine.h"
 #include "FSCommon.h"
 #include "GPS.h"
+#include "Geofence.h"
 #include "MeshRadio.h"
 #include "NodeDB.h"
 #include "PacketHistory.h"
+#include "PhoneAPI.h"
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "Router.h"
 #include "TypeConversions.h"
+#include "concurrency/OSThread.h"
 #include "error.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
 #include "modules/NeighborInfoModule.h"
 #include <ErriezCRC32.h>
+#include <algorithm>
 #include <pb_decode.h>
 #include <pb_encode.h>
 
@@ -31,6 +35,16 @@
 #include "platform/portduino/PortduinoGlue.h"
 #endif
 
+#if NODE_STORE_MMAP
+#include "concurrency/Periodic.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifdef ARCH_NRF52
 #include <bluefruit.h>
 #include <utility/bonding.h>
@@ -38,6 +52,34 @@
 
 NodeDB nodeDB;
 
+/**
+ * Writes the segments queued up by NodeDB::saveToDiskSoon().  Sleeps (disabled) until something is queued, then waits out
+ * the coalesce window so that everything queued in the meantime goes out in a single write.
+ */
+class SaveToDiskThread : public concurrency::OSThread
+{
+  public:
+    SaveToDiskThread() : OSThread("SaveToDisk") { disable(); }
+
+    /// Start the coalesce window, unless one is already running
+    void schedule()
+    {
+        if (!enabled) {
+            enabled = true;
+            setIntervalFromNow(NODEDB_SAVE_COALESCE_MSECS);
+        }
+    }
+
+  protected:
+    virtual int32_t runOnce() override
+    {
+        nodeDB.flushPendingSaves();
+        return disable();
+    }
+};
+
+static SaveToDiskThread *saveToDiskThread;
+
 // we have plenty of ram so statically alloc this tempbuf (for now)
 EXT_RAM_ATTR meshtastic_DeviceState devicestate;
 meshtastic_MyNodeInfo &myNodeInfo = devicestate.my_node;
@@ -68,7 +110,13 @@ uint32_t error_address = 0;
 
 static uint8_t ourMacAddr[6];
 
-NodeDB::NodeDB() : meshNodes(devicestate.node_db_lite), numMeshNodes(&devicestate.node_db_lite_count) {}
+NodeDB::NodeDB() : meshNodes(devicestate.node_db_lite), numMeshNodes(&devicestate.node_db_lite_count)
+{
+    memset(nodeIndex, 0, sizeof(nodeIndex));
+    memset(nodeChances, 0, sizeof(nodeChances));
+    memset(dirtyNodes, 0, sizeof(dirtyNodes));
+    std::fill(nodeHops, nodeHops + MAX_NUM_NODES, HopsAway{HOPS_UNKNOWN, false, 0});
+}
 
 /**
  * Most (but not always) of the time we want to treat packets 'from' the local phone (where from == 0), as if they originated on
@@ -128,8 +176,12 @@ bool NodeDB::resetRadioConfig(bool factory_reset)
 bool NodeDB::factoryReset()
 {
     LOG_INFO("Performing factory reset!\n");
+#if NODE_STORE_MMAP
+    unmapNodeStore(); // before its file goes
+#endif
     // first, remove the "/prefs" (this removes most prefs)
     rmDir("/prefs");
+    invalidateWarmBoot();
     // second, install default state (this will deal with the duplicate mac address issue)
     installDefaultDeviceState();
     installDefaultConfig();
@@ -207,7 +259,7 @@ void NodeDB::installDefaultConfig()
     bool hasScreen = true;
 #elif ARCH_PORTDUINO
     bool hasScreen = false;
-    if (settingsMap[displayPanel])
+    if (portduinoSettings.displayPanel)
         hasScreen = true;
     else
         hasScreen = screen_found.port != ScanI2C::I2CPort::NO_I2C;
@@ -354,8 +406,13 @@ void NodeDB::installDefaultChannels()
 
 void NodeDB::resetNodes()
 {
-    devicestate.node_db_lite_count = 1;
-    std::fill(&devicestate.node_db_lite[1], &devicestate.node_db_lite[MAX_NUM_NODES - 1], meshtastic_NodeInfoLite());
+    concurrency::SeqWriteGuard guard(nodesLock);
+    *numMeshNodes = 1;
+    std::fill(&meshNodes[1], &meshNodes[MAX_NUM_NODES - 1], meshtastic_NodeInfoLite());
+    rebuildNodeIndex();
+    extendedNodes.clear();
+    forgetSyncs();
+    nodeStoreStale = true; // start the node store over with just us
     saveDeviceStateToDisk();
     if (neighborInfoModule && moduleConfig.neighbor_info.enabled)
         neighborInfoModule->resetNeighbors();
@@ -363,37 +420,186 @@ void NodeDB::resetNodes()
 
 void NodeDB::removeNodeByNum(uint nodeNum)
 {
+    concurrency::SeqWriteGuard guard(nodesLock);
     int newPos = 0, removed = 0;
     for (int i = 0; i < *numMeshNodes; i++) {
-        if (meshNodes[i].num != nodeNum)
+        if (meshNodes[i].num != nodeNum) {
+            if (newPos != i)
+                markNodeDirty(newPos);
+            nodeGenerations[newPos] = nodeGenerations[i];
+            nodeHops[newPos] = nodeHops[i];
+            nodeSummaries[newPos] = nodeSummaries[i];
             meshNodes[newPos++] = meshNodes[i];
-        else
+        } else
             removed++;
     }
+    for (int i = newPos; i < *numMeshNodes; i++)
+        markNodeDirty(i); // these records are empty now
     *numMeshNodes -= removed;
+    rebuildNodeIndex();
+    extendedNodes.remove(nodeNum);
+    noteNodeRemoved(nodeNum);
     LOG_DEBUG("NodeDB::removeNodeByNum purged %d entries. Saving changes...\n", removed);
     saveDeviceStateToDisk();
 }
 
 void NodeDB::cleanupMeshDB()
 {
+    concurrency::SeqWriteGuard guard(nodesLock);
     int newPos = 0, removed = 0;
     for (int i = 0; i < *numMeshNodes; i++) {
-        if (meshNodes[i].has_user)
+        if (meshNodes[i].has_user) {
+            nodeGenerations[newPos] = nodeGenerations[i];
+            nodeHops[newPos] = nodeHops[i];
+            nodeSummaries[newPos] = nodeSummaries[i];
             meshNodes[newPos++] = meshNodes[i];
-        else
+        } else {
+            noteNodeRemoved(meshNodes[i].num);
             removed++;
+        }
     }
     *numMeshNodes -= removed;
+    rebuildNodeIndex();
+    if (removed)
+        nodeStoreStale = true;
     LOG_DEBUG("cleanupMeshDB purged %d entries\n", removed);
 }
 
+void NodeDB::rebuildNodeIndex()
+{
+    concurrency::SeqWriteGuard guard(nodesLock);
+    memset(nodeIndex, 0, sizeof(nodeIndex));
+    memset(nodeChances, 0, sizeof(nodeChances)); // nodes may have moved, so start the clock over
+    onlineNodes.clear();
+    staleOrders = (1 << NUM_NODE_ORDERS) - 1;
+    geoIndex.clear();
+    geoIndex.setOrigin(false, 0, 0);
+    geofence.clear(); // so nobody seems to cross a fence just because we reloaded
+    for (int i = 0; i < *numMeshNodes; i++)
+        refreshNodeSummary(i); // before the index, findNodeIndexSlot() checks its entries against these
+    for (int i = 0; i < *numMeshNodes; i++) {
+        if (findNodeIndexSlot(meshNodes[i].num) < 0) // If there are duplicates, the first one wins (like the old linear search)
+            addToNodeIndex(meshNodes[i].num, i);
+        onlineNodes.add(meshNodes[i].last_heard);
+        updateGeoIndex(i);
+    }
+}
+
+void NodeDB::addToNodeIndex(NodeNum n, size_t index)
+{
+    uint32_t i = nodeIndexSlot(n);
+    while (nodeIndex[i]) // we are never more than half full, so there is always an empty slot
+        i = (i + 1) & (NODE_INDEX_SIZE - 1);
+    nodeIndex[i] = index + 1;
+}
+
+int32_t NodeDB::findNodeIndexSlot(NodeNum n, uint32_t *entry)
+{
+    // Capped, so a reader on another task racing a writer can't follow a probe run which never ends
+    for (uint32_t i = nodeIndexSlot(n), probes = 0; probes < NODE_INDEX_SIZE; i = (i + 1) & (NODE_INDEX_SIZE - 1), probes++) {
+        uint16_t e = nodeIndex[i]; // read once, so what we check is what we hand back
+        if (!e)
+            return -1; // hit the end of the probe run
+
+        // Double check the entry, so a half updated index can never hand back the wrong node (or one past the end)
+        if (e <= *numMeshNodes && e <= MAX_NUM_NODES && nodeSummaries[e - 1].num == n) {
+            if (entry)
+                *entry = e - 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void NodeDB::removeFromNodeIndex(NodeNum n)
+{
+    int32_t found = findNodeIndexSlot(n);
+    if (found < 0)
+        return;
+
+    // Backward shift deletion (no tombstones), see PacketHistory::removeSlot()
+    uint32_t i = found, j = found;
+    for (;;) {
+        j = (j + 1) & (NODE_INDEX_SIZE - 1);
+        if (!nodeIndex[j])
+            break;
+
+        uint32_t k = nodeIndexSlot(nodeSummaries[nodeIndex[j] - 1].num);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            nodeIndex[i] = nodeIndex[j];
+            i = j;
+        }
+    }
+    nodeIndex[i] = 0;
+}
+
+void NodeDB::noteNodeRemoved(NodeNum n)
+{
+    if (numRemovedNodes >= NODEDB_SYNC_TOMBSTONES) {
+        // The removal we are about to forget is one a client which synced before it would miss
+        oldestSyncGeneration = removedNodes[numRemovedNodes % NODEDB_SYNC_TOMBSTONES].generation;
+    }
+    removedNodes[numRemovedNodes++ % NODEDB_SYNC_TOMBSTONES] = RemovedNode{n, ++nodeGeneration};
+}
+
+void NodeDB::evictMeshNode()
+{
+    // Every pass of the hand takes a chance away from each node it skips, and a node never has more than two, so we are
+    // guaranteed to find a victim within three passes
+    for (;;) {
+        if (evictHand >= *numMeshNodes)
+            evictHand = 1; // slot 0 is always us
+        if (nodeChances[evictHand] == 0)
+            break;
+        nodeChances[evictHand]--;
+        evictHand++;
+    }
+
+    uint32_t victim = evictHand, last = *numMeshNodes - 1;
+    LOG_DEBUG("Evicting node 0x%x (last heard %u), %u evictions so far\n", nodeSummaries[victim].num,
+              nodeSummaries[victim].last_heard, numEvictions);
+    NodeNum forgotten = extendedNodes.add(meshNodes[victim], nodeGenerations[victim]);
+    if (forgotten)
+        noteNodeRemoved(forgotten);
+    else if (!extendedNodes.getSummary(meshNodes[victim].num))
+        noteNodeRemoved(meshNodes[victim].num); // no extended tier, it's gone
+    onlineNodes.remove(meshNodes[victim].last_heard);
+    staleOrders = (1 << NUM_NODE_ORDERS) - 1;
+
+    // Swap the last node into the hole, so we never have to shuffle the whole array down
+    concurrency::SeqWriteGuard guard(nodesLock);
+    removeFromNodeIndex(meshNodes[victim].num);
+    markNodeDirty(victim);
+    markNodeDirty(last);
+    geoIndex.remove(victim);
+    geofence.remove(victim);
+    if (victim != last) {
+        int32_t slot = findNodeIndexSlot(nodeSummaries[last].num);
+        meshNodes[victim] = meshNodes[last];
+        nodeSummaries[victim] = nodeSummaries[last];
+        nodeChances[victim] = nodeChances[last];
+        nodeGenerations[victim] = nodeGenerations[last];
+        nodeHops[victim] = nodeHops[last];
+        geoIndex.move(last, victim);
+        geofence.move(last, victim);
+        if (slot >= 0)
+            nodeIndex[slot] = victim + 1;
+    }
+    (*numMeshNodes)--;
+    numEvictions++;
+}
+
 void NodeDB::installDefaultDeviceState()
 {
     LOG_INFO("Installing default DeviceState\n");
     memset(&devicestate, 0, sizeof(meshtastic_DeviceState));
 
     *numMeshNodes = 0;
+    rebuildNodeIndex();
+    extendedNodes.clear();
+    forgetSyncs();
+    nodeStoreStale = true;
 
     // init our devicestate with valid flags so protobuf writing/reading will work
     devicestate.has_my_node = true;
@@ -415,6 +621,9 @@ void NodeDB::installDefaultDeviceState()
 void NodeDB::init()
 {
     LOG_INFO("Initializing NodeDB\n");
+    saveToDiskThread = new SaveToDiskThread();
+    extendedNodes.init();
+    geofence.loadFromDisk(); // before our nodes, which it places
     loadFromDisk();
     cleanupMeshDB();
 
@@ -437,8 +646,11 @@ void NodeDB::init()
 
     // Include our owner in the node db under our nodenum
     meshtastic_NodeInfoLite *info = getOrCreateMeshNode(getNodeNum());
+    nodeLocks[info - meshNodes].beginWrite();
     info->user = owner;
     info->has_user = true;
+    refreshNodeSummary(info - meshNodes);
+    nodeLocks[info - meshNodes].endWrite();
 
 #ifdef ARCH_ESP32
     Preferences preferences;
@@ -457,6 +669,8 @@ void NodeDB::init()
         saveWhat |= SEGMENT_CONFIG;
     if (channelFileCRC != crc32Buffer(&channelFile, sizeof(channelFile)))
         saveWhat |= SEGMENT_CHANNELS;
+    if (nodeStoreStale) // a new node store, or one we are moving out of the DeviceState of older firmware
+        saveWhat |= SEGMENT_DEVICESTATE;
 
     if (!devicestate.node_remote_hardware_pins) {
         meshtastic_NodeRemoteHardwarePin empty[12] = {meshtastic_RemoteHardwarePin_init_default};
@@ -502,6 +716,205 @@ static const char *configFileName = "/prefs/config.proto";
 static const char *moduleConfigFileName = "/prefs/module.proto";
 static const char *channelFileName = "/prefs/channels.proto";
 static const char *oemConfigFile = "/oem/oem.proto";
+static const char *nodeStoreFileName = "/prefs/nodes.dat";
+static const char *ownNodeFileName = "/prefs/ournode.dat";
+
+/**
+ * A copy of the config, module config and channels as we last loaded or saved them, kept in RAM which survives deep sleep
+ * and reboots (RTC memory on ESP32, other variants can provide somewhere with WARM_BOOT_ATTR).  So a warm boot can skip
+ * decoding them from flash.  Only trusted if its CRC checks out and it was written by this very build.
+ */
+#if !defined(WARM_BOOT_ATTR) && defined(ARCH_ESP32)
+#define WARM_BOOT_ATTR RTC_NOINIT_ATTR
+#endif
+
+#ifdef WARM_BOOT_ATTR
+struct WarmBootSnapshot {
+    uint32_t build; // warmBootBuildCRC() of the firmware which wrote it
+    meshtastic_LocalConfig config;
+    meshtastic_LocalModuleConfig moduleConfig;
+    meshtastic_ChannelFile channelFile;
+    uint32_t crc; // of everything above
+};
+static_assert(sizeof(WarmBootSnapshot) <= 4096, "WarmBootSnapshot is too big for RTC memory");
+
+static WARM_BOOT_ATTR WarmBootSnapshot warmBoot;
+
+static uint32_t warmBootCRC()
+{
+    return crc32Buffer(&warmBoot, offsetof(WarmBootSnapshot, crc));
+}
+
+static uint32_t warmBootBuildCRC()
+{
+    static const char *build = xstr(APP_VERSION) " " __DATE__ " " __TIME__;
+    return crc32Buffer(build, strlen(build));
+}
+#endif
+
+/**
+ * The node store keeps our nodes out of DeviceState, so hearing from a few nodes doesn't rewrite a 17KB file.  It starts with
+ * a NodeStoreHeader, followed by one fixed size record per meshNodes index: a NodeRecordHeader and the encoded NodeInfoLite,
+ * padded out to meshtastic_NodeInfoLite_size.  So a node which changed is patched in place, new nodes are appended, and
+ * removed nodes leave empty records at the end until there are enough of those to compact the store.
+ *
+ * Our own node, meshNodes[0], changes with nearly every save, and patching the front of a file makes LittleFS rewrite all
+ * of the file after the patch.  So its newest copy is one record alone in ownNodeFileName, written whole each time, and its
+ * record in the store only catches up when the store is rewritten.
+ */
+#define NODE_STORE_MAGIC 0x4e4f4445 // "NODE"
+
+struct NodeStoreHeader {
+    uint32_t magic;
+    uint16_t version;    // DEVICESTATE_CUR_VER
+    uint16_t recordSize; // NODE_RECORD_SIZE, so a store written for a different NodeInfoLite is never misread
+};
+
+struct NodeRecordHeader {
+    NodeNum num;  // 0 for an empty record
+    uint32_t crc; // of the encoded NodeInfoLite, so a record torn by a power cut is dropped rather than misread
+    uint16_t len;
+    uint16_t reserved;
+};
+
+#define NODE_RECORD_SIZE (sizeof(NodeRecordHeader) + meshtastic_NodeInfoLite_size)
+
+/**
+ * Each protobuf we save is kept in two slots, filename.a and filename.b: the encoded protobuf followed by a SlotTrailer.  A
+ * save rewrites whichever slot doesn't hold our newest copy, under the next sequence number, front to back without ever
+ * seeking back, and a load takes the newest slot which checks out.  So a save cut short at any point leaves the copy before
+ * it intact, without a rename per save.
+ *
+ * A plain filename (uploaded by XModem or an HTTP restore since we last saved, or kept by firmware before the slots) is newer
+ * than either slot, so loads take it first, and our next save of it removes it.
+ */
+#define PROTO_SLOT_MAGIC 0x534c4f54 // "SLOT"
+
+struct SlotTrailer {
+    uint32_t magic;    // PROTO_SLOT_MAGIC, the last thing a save writes
+    uint32_t sequence; // of the save which wrote this slot, the larger one is newer
+    uint32_t len;      // of the encoded protobuf before us, the file is exactly that and us
+    uint32_t crc;      // of the encoded protobuf
+};
+
+#ifdef FSCom
+/// Which slot of a file holds our newest copy of it, once we have loaded or saved it
+struct SlotState {
+    const char *filename;
+    uint32_t sequence;
+    uint32_t crc; // of the protobuf in our newest slot, so saving one which hasn't changed can be skipped
+    uint8_t slot;
+    bool hasCRC;       // we know crc (it's not a file we loaded from somewhere else)
+    bool hasPlainFile; // we loaded it from the single file older firmware kept, which goes once we save
+};
+
+#define MAX_SLOT_FILES 12
+
+static SlotState slotStates[MAX_SLOT_FILES];
+static uint8_t numSlotStates;
+
+static SlotState *findSlotState(const char *filename)
+{
+    for (uint8_t i = 0; i < numSlotStates; i++)
+        if (strcmp(slotStates[i].filename, filename) == 0)
+            return &slotStates[i];
+    return NULL;
+}
+
+/// Note which slot holds the newest copy of filename, and the crc of its protobuf (if we know it)
+static void noteSlot(const char *filename, uint8_t slot, uint32_t sequence, const uint32_t *crc, bool hasPlainFile = false)
+{
+    SlotState *state = findSlotState(filename);
+    if (!state && numSlotStates < MAX_SLOT_FILES) {
+        state = &slotStates[numSlotStates++];
+        state->filename = filename;
+    }
+    if (state) // otherwise saves go by the slot trailers alone
+        *state = SlotState{filename, sequence, crc ? *crc : 0, slot, crc != NULL, hasPlainFile};
+}
+
+/// A nanopb stream which writes nowhere, it just takes the crc32Update() of what goes through it
+static bool crcWritecb(pb_ostream_t *stream, const uint8_t *buf, size_t count)
+{
+    uint32_t *crc = (uint32_t *)stream->state;
+    *crc = crc32Update(buf, count, *crc);
+    return true;
+}
+
+static String slotFileName(const char *filename, uint8_t slot)
+{
+    String name = filename;
+    name += slot ? ".b" : ".a";
+    return name;
+}
+
+/// Read the trailer at the end of a slot, @return true if it's there and vouches for the rest of the file
+static bool readTrailer(File &f, SlotTrailer &t)
+{
+    size_t size = f.size();
+    return size >= sizeof(t) && f.seek(size - sizeof(t)) && f.read((uint8_t *)&t, sizeof(t)) == (int)sizeof(t) &&
+           t.magic == PROTO_SLOT_MAGIC && t.len == size - sizeof(t);
+}
+
+/**
+ * Read the trailers (but not check the crc) of both slots of filename.
+ * @return a bit mask of the slots which have a trailer, its sequence number is in sequence[slot]
+ */
+static uint8_t peekSlots(const char *filename, uint32_t sequence[2])
+{
+    uint8_t found = 0;
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        auto f = FSCom.open(slotFileName(filename, slot).c_str(), FILE_O_READ);
+        if (f) {
+            SlotTrailer t;
+            if (readTrailer(f, t)) {
+                found |= 1 << slot;
+                sequence[slot] = t.sequence;
+            }
+            f.close();
+        }
+    }
+    return found;
+}
+
+/// @return the newest of the slots peekSlots() found
+static uint8_t newestSlot(uint8_t found, const uint32_t sequence[2])
+{
+    if (found == 3)
+        return (int32_t)(sequence[1] - sequence[0]) > 0;
+    return found == 2;
+}
+
+/// Decode one slot of filename into dest_struct, @return true if it checks out
+static bool loadSlot(const char *filename, uint8_t slot, size_t protoSize, size_t objSize, const pb_msgdesc_t *fields,
+                     void *dest_struct)
+{
+    String name = slotFileName(filename, slot);
+    auto f = FSCom.open(name.c_str(), FILE_O_READ);
+    if (!f)
+        return false;
+
+    bool okay = false;
+    SlotTrailer t;
+    if (readTrailer(f, t) && t.len <= protoSize && f.seek(0)) {
+        LOG_INFO("Loading %s\n", name.c_str());
+        BufferedFileStream buffered(f);
+        pb_istream_t stream = buffered.istream(t.len);
+
+        memset(dest_struct, 0, objSize);
+        if (!pb_decode(&stream, fields, dest_struct)) {
+            LOG_ERROR("Error: can't decode protobuf %s\n", PB_GET_ERROR(&stream));
+        } else if (buffered.getNumBytes() != t.len || buffered.getCRC() != t.crc) {
+            LOG_ERROR("Error: %s is corrupt\n", name.c_str());
+        } else {
+            okay = true;
+            noteSlot(filename, slot, t.sequence, &t.crc);
+        }
+    }
+    f.close();
+    return okay;
+}
+#endif
 
 /** Load a protobuf from a file, return true for success */
 bool NodeDB::loadProto(const char *filename, size_t protoSize, size_t objSize, const pb_msgdesc_t *fields, void *dest_struct)
@@ -510,13 +923,17 @@ bool NodeDB::loadProto(const char *filename, size_t protoSize, size_t objSize, c
 #ifdef FSCom
     // static DeviceState scratch; We no longer read into a tempbuf because this structure is 15KB of valuable RAM
 
-    auto f = FSCom.open(filename, FILE_O_READ);
+    uint32_t sequence[2];
+    uint8_t found = peekSlots(filename, sequence);
+    uint8_t newest = newestSlot(found, sequence);
 
+    // A plain file is newer than our slots, an upload or from firmware which kept the single file
+    auto f = FSCom.open(filename, FILE_O_READ);
+    bool hasPlainFile = (bool)f;
     if (f) {
         LOG_INFO("Loading %s\n", filename);
-        pb_istream_t stream = {&readcb, &f, protoSize};
-
-        // LOG_DEBUG("Preload channel name=%s\n", channelSettings.name);
+        BufferedFileStream buffered(f);
+        pb_istream_t stream = buffered.istream(protoSize);
 
         memset(dest_struct, 0, objSize);
         if (!pb_decode(&stream, fields, dest_struct)) {
@@ -526,8 +943,24 @@ bool NodeDB::loadProto(const char *filename, size_t protoSize, size_t objSize, c
         }
 
         f.close();
+    }
+    bool fromPlainFile = okay;
+
+    // Otherwise the newest slot, then the other one if that doesn't check out
+    for (uint8_t i = 0; i < 2 && !okay; i++) {
+        uint8_t slot = newest ^ i;
+        if (found & (1 << slot))
+            okay = loadSlot(filename, slot, protoSize, objSize, fields, dest_struct);
+    }
+
+    SlotState *state = findSlotState(filename);
+    if (okay && !fromPlainFile && state) {
+        state->hasPlainFile = hasPlainFile; // a broken one goes at our next save too
     } else {
-        LOG_INFO("No %s preferences found\n", filename);
+        // From the plain file, or nothing checked out: our next save goes past whatever sequence numbers are in the slots
+        noteSlot(filename, newest ^ 1, found ? sequence[newest] : 0, NULL, hasPlainFile);
+        if (!okay && !hasPlainFile)
+            LOG_INFO("No %s preferences found\n", filename);
     }
 #else
     LOG_ERROR("ERROR: Filesystem not implemented\n");
@@ -537,6 +970,8 @@ bool NodeDB::loadProto(const char *filename, size_t protoSize, size_t objSize, c
 
 void NodeDB::loadFromDisk()
 {
+    uint32_t start = millis();
+
     // static DeviceState scratch; We no longer read into a tempbuf because this structure is 15KB of valuable RAM
     if (!loadProto(prefFileName, meshtastic_DeviceState_size, sizeof(meshtastic_DeviceState), &meshtastic_DeviceState_msg,
                    &devicestate)) {
@@ -547,9 +982,34 @@ void NodeDB::loadFromDisk()
             factoryReset();
         } else {
             LOG_INFO("Loaded saved devicestate version %d\n", devicestate.version);
+            loadNodesFromDisk();
         }
     }
+#if NODE_STORE_MMAP
+    mapNodeStore(false); // unless it's mapped already, start the map with whatever nodes we have
+#endif
+    rebuildNodeIndex();
 
+    uint32_t configStart = millis();
+    bool warm = loadWarmBoot();
+    if (warm) {
+        LOG_INFO("Warm boot, using the config, module config and channels we kept in RAM\n");
+    } else {
+        loadConfigFromDisk();
+        saveWarmBoot(SEGMENT_CONFIG | SEGMENT_MODULECONFIG | SEGMENT_CHANNELS);
+    }
+    uint32_t configMsec = millis() - configStart;
+
+    if (loadProto(oemConfigFile, meshtastic_OEMStore_size, sizeof(meshtastic_OEMStore), &meshtastic_OEMStore_msg, &oemStore)) {
+        LOG_INFO("Loaded OEMStore\n");
+    }
+
+    LOG_INFO("Loaded our DB in %u ms (config, module config and channels %u ms, %s boot)\n", millis() - start, configMsec,
+             warm ? "warm" : "cold");
+}
+
+void NodeDB::loadConfigFromDisk()
+{
     if (!loadProto(configFileName, meshtastic_LocalConfig_size, sizeof(meshtastic_LocalConfig), &meshtastic_LocalConfig_msg,
                    &config)) {
         installDefaultConfig(); // Our in RAM copy might now be corrupt
@@ -585,10 +1045,49 @@ void NodeDB::loadFromDisk()
             LOG_INFO("Loaded saved channelFile version %d\n", channelFile.version);
         }
     }
+}
 
-    if (loadProto(oemConfigFile, meshtastic_OEMStore_size, sizeof(meshtastic_OEMStore), &meshtastic_OEMStore_msg, &oemStore)) {
-        LOG_INFO("Loaded OEMStore\n");
-    }
+bool NodeDB::loadWarmBoot()
+{
+#ifdef WARM_BOOT_ATTR
+    if (warmBoot.build != warmBootBuildCRC() || warmBoot.crc != warmBootCRC())
+        return false;
+
+    config = warmBoot.config;
+    moduleConfig = warmBoot.moduleConfig;
+    channelFile = warmBoot.channelFile;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NodeDB::saveWarmBoot(int saveWhat)
+{
+#ifdef WARM_BOOT_ATTR
+    const int all = SEGMENT_CONFIG | SEGMENT_MODULECONFIG | SEGMENT_CHANNELS;
+    if ((saveWhat & all) != all && (warmBoot.build != warmBootBuildCRC() || warmBoot.crc != warmBootCRC()))
+        return; // we don't know what the rest of it should be
+
+    if (saveWhat & SEGMENT_CONFIG)
+        warmBoot.config = config;
+    if (saveWhat & SEGMENT_MODULECONFIG)
+        warmBoot.moduleConfig = moduleConfig;
+    if (saveWhat & SEGMENT_CHANNELS)
+        warmBoot.channelFile = channelFile;
+    warmBoot.build = warmBootBuildCRC();
+    warmBoot.crc = warmBootCRC();
+#endif
+}
+
+void NodeDB::invalidateWarmBoot()
+{
+#ifdef WARM_BOOT_ATTR
+    warmBoot.build = 0;
+#endif
+#ifdef FSCom
+    numSlotStates = 0; // nor do we know what's in the files saveProto() wrote anymore
+#endif
 }
 
 /** Save a protobuf from a file, return true for success */
@@ -597,28 +1096,69 @@ bool NodeDB::saveProto(const char *filename, size_t protoSize, const pb_msgdesc_
     bool okay = false;
 #ifdef FSCom
     // static DeviceState scratch; We no longer read into a tempbuf because this structure is 15KB of valuable RAM
-    String filenameTmp = filename;
-    filenameTmp += ".tmp";
-    auto f = FSCom.open(filenameTmp.c_str(), FILE_O_WRITE);
+
+    // Overwrite the slot which doesn't hold our newest copy
+    uint8_t slot = 0;
+    uint32_t sequence = 1;
+    SlotState *state = findSlotState(filename);
+    if (state) {
+        slot = state->slot ^ 1;
+        sequence = state->sequence + 1;
+
+        // No need to write what our newest slot already holds
+        uint32_t crc = 0xffffffff;
+        pb_ostream_t fingerprint = {&crcWritecb, &crc, protoSize, 0};
+        if (state->hasCRC && pb_encode(&fingerprint, fields, dest_struct) && crc32Final(crc) == state->crc) {
+            numSkippedDiskWrites++;
+            LOG_DEBUG("Not saving %s, it hasn't changed (%u writes skipped)\n", filename, numSkippedDiskWrites);
+            return true;
+        }
+    } else {
+        // Not a file we've loaded, so go by the trailers alone
+        uint32_t found[2];
+        uint8_t mask = peekSlots(filename, found);
+        if (mask) {
+            uint8_t newest = newestSlot(mask, found);
+            slot = newest ^ 1;
+            sequence = found[newest] + 1;
+        }
+    }
+
+    String slotName = slotFileName(filename, slot);
+    uint32_t start = millis();
+
+    // From scratch, as the Adafruit LittleFS opens for writing at the end of the file (which it doesn't truncate).  It's our
+    // older copy, and until its trailer is in (last of all) it doesn't check out, so loads take the other one
+    FSCom.remove(slotName.c_str());
+    auto f = FSCom.open(slotName.c_str(), FILE_O_WRITE);
     if (f) {
-        LOG_INFO("Saving %s\n", filename);
-        pb_ostream_t stream = {&writecb, &f, protoSize};
+        LOG_INFO("Saving %s\n", slotName.c_str());
+        BufferedFileStream buffered(f);
+        pb_ostream_t stream = buffered.ostream(protoSize);
 
+        SlotTrailer t = {PROTO_SLOT_MAGIC, sequence, 0, 0};
         if (!pb_encode(&stream, fields, dest_struct)) {
             LOG_ERROR("Error: can't encode protobuf %s\n", PB_GET_ERROR(&stream));
+        } else if (!buffered.flush()) {
+            LOG_ERROR("Error: can't write %s\n", slotName.c_str());
         } else {
-            okay = true;
+            t.len = buffered.getNumBytes();
+            t.crc = buffered.getCRC();
+            okay = f.write((const uint8_t *)&t, sizeof(t)) == sizeof(t);
+            if (!okay)
+                LOG_ERROR("Error: can't write %s\n", slotName.c_str());
         }
         f.flush();
         f.close();
 
-        // brief window of risk here ;-)
-        if (FSCom.exists(filename) && !FSCom.remove(filename)) {
-            LOG_WARN("Can't remove old pref file\n");
-        }
-        if (!renameFile(filenameTmp.c_str(), filename)) {
-            LOG_ERROR("Error: can't rename new pref file\n");
+        if (okay) {
+            bool hadPlainFile = state && state->hasPlainFile;
+            noteSlot(filename, slot, sequence, &t.crc);
+            if (hadPlainFile && FSCom.exists(filename) && !FSCom.remove(filename))
+                LOG_WARN("Can't remove old pref file\n");
         }
+
+        countDiskWrite(slotName.c_str(), start);
     } else {
         LOG_ERROR("Can't write prefs\n");
 #ifdef ARCH_NRF52
@@ -637,6 +1177,379 @@ bool NodeDB::saveProto(const char *filename, size_t protoSize, const pb_msgdesc_
     return okay;
 }
 
+void NodeDB::countDiskWrite(const char *filename, uint32_t startMsec)
+{
+    uint32_t elapsed = millis() - startMsec;
+    numDiskWrites++;
+    totalDiskWriteMsec += elapsed;
+    if (elapsed > maxDiskWriteMsec)
+        maxDiskWriteMsec = elapsed;
+    LOG_DEBUG("Saved %s in %u ms (%u writes, %u skipped, %u ms total, %u ms max)\n", filename, elapsed, numDiskWrites,
+              numSkippedDiskWrites, totalDiskWriteMsec, maxDiskWriteMsec);
+}
+
+#ifdef FSCom
+/// Write a node's record (or an empty one if n is NULL) at the current position in f, @return true for success
+/// Decode a record writeNodeRecord() wrote into n, @return false if it's empty or doesn't check out
+static bool readNodeRecord(const uint8_t *buf, meshtastic_NodeInfoLite *n)
+{
+    NodeRecordHeader rh;
+    memcpy(&rh, buf, sizeof(rh));
+    memset(n, 0, sizeof(*n));
+    pb_istream_t stream = pb_istream_from_buffer(buf + sizeof(rh), rh.len);
+    return rh.num && rh.len <= meshtastic_NodeInfoLite_size && rh.crc == crc32Buffer(buf + sizeof(rh), rh.len) &&
+           pb_decode(&stream, &meshtastic_NodeInfoLite_msg, n) && n->num == rh.num;
+}
+
+static bool writeNodeRecord(File &f, const meshtastic_NodeInfoLite *n)
+{
+    static uint8_t buf[NODE_RECORD_SIZE]; // only used while saving our DB, keep it off the stack
+    NodeRecordHeader h = {};
+
+    memset(buf, 0, sizeof(buf));
+    if (n) {
+        pb_ostream_t stream = pb_ostream_from_buffer(buf + sizeof(h), meshtastic_NodeInfoLite_size);
+        if (!pb_encode(&stream, &meshtastic_NodeInfoLite_msg, n)) {
+            LOG_ERROR("Error: can't encode node 0x%x %s\n", n->num, PB_GET_ERROR(&stream));
+            return false;
+        }
+        h.num = n->num;
+        h.len = stream.bytes_written;
+        h.crc = crc32Buffer(buf + sizeof(h), h.len);
+    }
+    memcpy(buf, &h, sizeof(h));
+
+    return f.write(buf, sizeof(buf)) == sizeof(buf);
+}
+#endif
+
+#if NODE_STORE_MMAP
+/**
+ * The mapped node store is a NodeMapHeader followed by MAX_NUM_NODES raw NodeInfoLites, meshNodes itself.  Nothing is
+ * encoded, so it's only good for a build with the same NodeInfoLite, which the header checks.  A crash leaves everything we
+ * wrote in the kernel's page cache, to reach the file anyway; only a power cut can lose what came since our last msync().
+ */
+#define NODE_MAP_MAGIC 0x4e4d4150 // "NMAP"
+
+struct NodeMapHeader {
+    uint32_t magic;
+    uint16_t version;    // DEVICESTATE_CUR_VER
+    uint16_t recordSize; // sizeof(meshtastic_NodeInfoLite)
+    uint16_t maxNodes;   // MAX_NUM_NODES
+    pb_size_t count;     // *numMeshNodes points here
+    uint32_t reserved;
+};
+static_assert(sizeof(NodeMapHeader) % 8 == 0, "NodeMapHeader must keep the nodes after it aligned");
+
+#define NODE_MAP_SIZE (sizeof(NodeMapHeader) + MAX_NUM_NODES * sizeof(meshtastic_NodeInfoLite))
+
+static const char *nodeMapFileName = "/prefs/nodes.map";
+static NodeMapHeader *nodeMap; // NULL unless our nodes are in it
+static concurrency::Periodic *nodeMapSyncThread;
+
+static void syncNodeMap()
+{
+    if (nodeMap && msync(nodeMap, NODE_MAP_SIZE, MS_SYNC) != 0)
+        LOG_ERROR("Error: can't sync %s: %s\n", nodeMapFileName, strerror(errno));
+}
+
+static int32_t syncNodeMapPeriodically()
+{
+    syncNodeMap();
+    return NODE_STORE_MMAP_SYNC_SECS * 1000;
+}
+
+bool NodeDB::mapNodeStore(bool keep)
+{
+    if (nodeMap)
+        return true;
+
+    // FSCom paths are relative to the portduino VFS root, mmap() wants the real one
+    FSCom.mkdir("/prefs");
+    const char *root = portduinoVFS->mountpoint();
+    std::string path = std::string(root ? root : ".") + nodeMapFileName;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (st.st_size < (off_t)NODE_MAP_SIZE && ftruncate(fd, NODE_MAP_SIZE) != 0)) {
+        LOG_ERROR("Can't open %s, keeping our nodes in devicestate: %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, NODE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the map keeps the file open
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Can't map %s, keeping our nodes in devicestate: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    NodeMapHeader *h = (NodeMapHeader *)map;
+    meshtastic_NodeInfoLite *nodes = (meshtastic_NodeInfoLite *)(h + 1);
+    if (keep) {
+        if (h->magic != NODE_MAP_MAGIC || h->version < DEVICESTATE_MIN_VER || h->recordSize != sizeof(meshtastic_NodeInfoLite) ||
+            h->maxNodes != MAX_NUM_NODES || h->count > MAX_NUM_NODES) {
+            if (h->magic)
+                LOG_WARN("%s is from another build, discarding\n", nodeMapFileName);
+            munmap(map, NODE_MAP_SIZE);
+            return false;
+        }
+        LOG_INFO("Mapped %u nodes from %s\n", h->count, nodeMapFileName);
+    } else {
+        LOG_INFO("Moving %u nodes to %s\n", *numMeshNodes, nodeMapFileName);
+        NodeMapHeader fresh = {NODE_MAP_MAGIC, DEVICESTATE_CUR_VER, sizeof(meshtastic_NodeInfoLite), MAX_NUM_NODES,
+                               *numMeshNodes, 0};
+        std::copy(meshNodes, meshNodes + *numMeshNodes, nodes);
+        std::fill(nodes + *numMeshNodes, nodes + MAX_NUM_NODES, meshtastic_NodeInfoLite());
+        *h = fresh;
+    }
+
+    nodeMap = h;
+    meshNodes = nodes;
+    numMeshNodes = &h->count;
+    devicestate.node_db_lite_count = 0; // so it stays out of db.proto
+    memset(dirtyNodes, 0, sizeof(dirtyNodes));
+    nodeStoreStale = false;
+    if (!keep)
+        syncNodeMap();
+    if (!nodeMapSyncThread)
+        nodeMapSyncThread = new concurrency::Periodic("NodeMapSync", syncNodeMapPeriodically);
+    return true;
+}
+
+void NodeDB::unmapNodeStore()
+{
+    if (!nodeMap)
+        return;
+    munmap(nodeMap, NODE_MAP_SIZE);
+    nodeMap = NULL;
+    meshNodes = devicestate.node_db_lite;
+    numMeshNodes = &devicestate.node_db_lite_count;
+    *numMeshNodes = 0;
+    nodeStoreStale = true;
+}
+#endif
+
+void NodeDB::loadNodesFromDisk()
+{
+    numNodeRecords = 0;
+    nodeStoreStale = true;
+
+#if NODE_STORE_MMAP
+    if (!*numMeshNodes && mapNodeStore(true))
+        return;
+#endif
+
+    if (*numMeshNodes) {
+        LOG_INFO("Moving %u nodes from our old devicestate to %s\n", *numMeshNodes, nodeStoreFileName);
+        return;
+    }
+
+#ifdef FSCom
+    auto f = FSCom.open(nodeStoreFileName, FILE_O_READ);
+    if (!f) {
+        LOG_INFO("No %s found\n", nodeStoreFileName);
+        return;
+    }
+
+    NodeStoreHeader h;
+    if (f.read((uint8_t *)&h, sizeof(h)) != (int)sizeof(h) || h.magic != NODE_STORE_MAGIC || h.version < DEVICESTATE_MIN_VER ||
+        h.recordSize != NODE_RECORD_SIZE) {
+        LOG_WARN("%s is from another version, discarding\n", nodeStoreFileName);
+        f.close();
+        return;
+    }
+
+    // As long as every node came from the record at its own index, we can carry on patching the store in place
+    static uint8_t buf[NODE_RECORD_SIZE];
+    bool aligned = true;
+    while (*numMeshNodes < MAX_NUM_NODES && f.read(buf, sizeof(buf)) == (int)sizeof(buf)) {
+        NodeRecordHeader rh;
+        memcpy(&rh, buf, sizeof(rh));
+        uint32_t record = numNodeRecords++;
+        if (!rh.num)
+            continue; // empty, only the records after our last node should be
+
+        meshtastic_NodeInfoLite *n = &meshNodes[*numMeshNodes];
+        if (!readNodeRecord(buf, n)) {
+            LOG_WARN("Dropping corrupt record %u for node 0x%x\n", record, rh.num);
+            aligned = false;
+            continue;
+        }
+
+        if (record != *numMeshNodes)
+            aligned = false;
+        (*numMeshNodes)++;
+    }
+    f.close();
+
+    LOG_INFO("Loaded %u nodes from %u records\n", *numMeshNodes, numNodeRecords);
+    nodeStoreStale = !aligned;
+    loadOwnNode();
+#endif
+}
+
+void NodeDB::loadOwnNode()
+{
+#ifdef FSCom
+    if (!*numMeshNodes)
+        return;
+    auto f = FSCom.open(ownNodeFileName, FILE_O_READ);
+    if (!f)
+        return;
+
+    static uint8_t buf[NODE_RECORD_SIZE];
+    static meshtastic_NodeInfoLite n; // only while we load, keep it off the stack
+    if (f.read(buf, sizeof(buf)) == (int)sizeof(buf) && readNodeRecord(buf, &n) && n.num == meshNodes[0].num)
+        meshNodes[0] = n;
+    else
+        LOG_WARN("Ignoring %s, the node store's copy of us will do\n", ownNodeFileName);
+    f.close();
+#endif
+}
+
+bool NodeDB::saveOwnNode()
+{
+    bool okay = false;
+#ifdef FSCom
+    // From scratch, as the Adafruit LittleFS doesn't truncate.  Cut short, the store's (older) copy of us is still there
+    FSCom.remove(ownNodeFileName);
+    auto f = FSCom.open(ownNodeFileName, FILE_O_WRITE);
+    if (f) {
+        okay = writeNodeRecord(f, &meshNodes[0]);
+        f.flush();
+        f.close();
+    }
+    if (!okay)
+        LOG_ERROR("Error: can't write %s\n", ownNodeFileName);
+#endif
+    return okay;
+}
+
+bool NodeDB::rewriteNodeStore()
+{
+    bool okay = false;
+#ifdef FSCom
+    String filenameTmp = nodeStoreFileName;
+    filenameTmp += ".tmp";
+    uint32_t start = millis();
+
+    // Some filesystems don't truncate when opening for write, so get rid of anything a power cut left behind
+    if (FSCom.exists(filenameTmp.c_str()))
+        FSCom.remove(filenameTmp.c_str());
+    auto f = FSCom.open(filenameTmp.c_str(), FILE_O_WRITE);
+    if (!f) {
+        LOG_ERROR("Can't write %s\n", nodeStoreFileName);
+        return false;
+    }
+
+    // Our own record first, so it's never older than the store's copy of us
+    if (*numMeshNodes)
+        saveOwnNode();
+
+    LOG_INFO("Saving %s\n", nodeStoreFileName);
+    NodeStoreHeader h = {NODE_STORE_MAGIC, DEVICESTATE_CUR_VER, NODE_RECORD_SIZE};
+    okay = f.write((uint8_t *)&h, sizeof(h)) == sizeof(h);
+    for (uint32_t i = 0; okay && i < *numMeshNodes; i++)
+        okay = writeNodeRecord(f, &meshNodes[i]);
+    f.flush();
+    f.close();
+
+    if (!okay) {
+        LOG_ERROR("Error: can't write %s\n", nodeStoreFileName);
+        FSCom.remove(filenameTmp.c_str());
+        return false;
+    }
+
+    if (FSCom.exists(nodeStoreFileName) && !FSCom.remove(nodeStoreFileName))
+        LOG_WARN("Can't remove old %s\n", nodeStoreFileName);
+    if (!renameFile(filenameTmp.c_str(), nodeStoreFileName)) {
+        LOG_ERROR("Error: can't rename new %s\n", nodeStoreFileName);
+        return false;
+    }
+
+    numNodeRecords = *numMeshNodes;
+    nodeStoreStale = false;
+    memset(dirtyNodes, 0, sizeof(dirtyNodes));
+    countDiskWrite(nodeStoreFileName, start);
+#endif
+    return okay;
+}
+
+void NodeDB::saveNodesToDisk()
+{
+#if NODE_STORE_MMAP
+    if (nodeMap) {
+        // Our nodes are already in the file, just make sure they've reached it
+        uint32_t start = millis();
+        syncNodeMap();
+        memset(dirtyNodes, 0, sizeof(dirtyNodes));
+        countDiskWrite(nodeMapFileName, start);
+        return;
+    }
+#endif
+#ifdef FSCom
+    uint32_t numNodes = *numMeshNodes;
+    if (numNodeRecords >= numNodes + NODE_STORE_COMPACT_SLACK) {
+        LOG_INFO("Compacting %s, %u records for %u nodes\n", nodeStoreFileName, numNodeRecords, numNodes);
+        nodeStoreStale = true;
+    }
+    if (nodeStoreStale) {
+        rewriteNodeStore();
+        return;
+    }
+
+    uint32_t start = millis(), numWritten = 0;
+    if (numNodeRecords && (dirtyNodes[0] & 1)) {
+        // Our own node, in a file of its own rather than patched into the front of the store
+        dirtyNodes[0] &= ~1;
+        if (!saveOwnNode())
+            nodeStoreStale = true; // so the store's copy of us catches up next time
+        numWritten++;
+    }
+
+    bool anyDirty = numNodes > numNodeRecords;
+    for (uint8_t d : dirtyNodes)
+        anyDirty |= d != 0;
+    if (!anyDirty) {
+        if (numWritten)
+            countDiskWrite(ownNodeFileName, start);
+        return;
+    }
+
+    auto f = FSCom.open(nodeStoreFileName, FILE_O_PATCH);
+    if (!f) {
+        LOG_WARN("Can't open %s, rewriting it\n", nodeStoreFileName);
+        rewriteNodeStore();
+        return;
+    }
+
+    // Records we already have are patched in place, the rest are appended in order (so each is written where the file ends)
+    bool okay = true;
+    uint32_t end = std::max(numNodes, numNodeRecords);
+    for (uint32_t i = 0; okay && i < end; i++) {
+        if (i < numNodeRecords && !(dirtyNodes[i / 8] & (1 << (i % 8))))
+            continue;
+
+        okay = f.seek(sizeof(NodeStoreHeader) + i * NODE_RECORD_SIZE) && writeNodeRecord(f, i < numNodes ? &meshNodes[i] : NULL);
+        if (okay && i == numNodeRecords)
+            numNodeRecords++;
+        numWritten++;
+    }
+    f.flush();
+    f.close();
+    memset(dirtyNodes, 0, sizeof(dirtyNodes));
+
+    if (!okay) {
+        LOG_ERROR("Error: can't patch %s, rewriting it next time\n", nodeStoreFileName);
+        nodeStoreStale = true;
+        return;
+    }
+
+    LOG_DEBUG("Wrote %u of %u node records\n", numWritten, numNodeRecords);
+    countDiskWrite(nodeStoreFileName, start);
+#endif
+}
+
 void NodeDB::saveChannelsToDisk()
 {
     if (!devicestate.no_save) {
@@ -653,18 +1566,52 @@ void NodeDB::saveDeviceStateToDisk()
 #ifdef FSCom
         FSCom.mkdir("/prefs");
 #endif
+        // Our nodes live in the node store, so leave them out (just while we encode the rest)
+        pb_size_t numNodes = devicestate.node_db_lite_count;
+        devicestate.node_db_lite_count = 0;
         saveProto(prefFileName, meshtastic_DeviceState_size, &meshtastic_DeviceState_msg, &devicestate);
+        devicestate.node_db_lite_count = numNodes;
+
+        // Our own node is changed from all over (owner, position), so write it along with the rest of our state
+        markNodeDirty(0);
+        saveNodesToDisk();
+    }
+}
+
+void NodeDB::saveToDiskSoon(int saveWhat)
+{
+    pendingSaves |= saveWhat;
+    if (saveToDiskThread)
+        saveToDiskThread->schedule();
+    else
+        flushPendingSaves(); // too early in boot for our thread, just write it now
+}
+
+void NodeDB::flushPendingSaves()
+{
+    if (pendingSaves) {
+        LOG_DEBUG("Writing coalesced segments 0x%x\n", pendingSaves);
+        saveToDisk(pendingSaves);
     }
 }
 
 void NodeDB::saveToDisk(int saveWhat)
 {
+    if (saveWhat & SEGMENT_DEVICESTATE)
+        saveWhat |= SEGMENT_NODES; // saveDeviceStateToDisk() writes those too
+
+    // Anything we write now no longer needs writing later
+    pendingSaves &= ~saveWhat;
+
     if (!devicestate.no_save) {
 #ifdef FSCom
+        FSBeginBatch(); // every segment we write in one go
         FSCom.mkdir("/prefs");
 #endif
         if (saveWhat & SEGMENT_DEVICESTATE) {
             saveDeviceStateToDisk();
+        } else if (saveWhat & SEGMENT_NODES) {
+            saveNodesToDisk();
         }
 
         if (saveWhat & SEGMENT_CONFIG) {
@@ -692,17 +1639,96 @@ void NodeDB::saveToDisk(int saveWhat)
         if (saveWhat & SEGMENT_CHANNELS) {
             saveChannelsToDisk();
         }
+
+        if ((saveWhat & SEGMENT_NEIGHBORS) && neighborInfoModule)
+            neighborInfoModule->saveProtoForModule();
+
+        if (saveWhat & (SEGMENT_CONFIG | SEGMENT_MODULECONFIG | SEGMENT_CHANNELS))
+            PhoneAPI::invalidateConfigFrames();
+
+        saveWarmBoot(saveWhat);
+#ifdef FSCom
+        FSEndBatch();
+#endif
     } else {
         LOG_DEBUG("***** DEVELOPMENT MODE - DO NOT RELEASE - not saving to flash *****\n");
     }
 }
 
-const meshtastic_NodeInfoLite *NodeDB::readNextMeshNode(uint32_t &readIndex)
+const meshtastic_NodeInfoLite *NodeDB::readNextMeshNode(MeshNodeWalk &walk, uint32_t minGeneration)
 {
-    if (readIndex < *numMeshNodes)
-        return &meshNodes[readIndex++];
+    if (walk.index == 0) {
+        sortNodeOrder(NODE_ORDER_LAST_HEARD);
+        walk.orderLen = *numMeshNodes;
+        memcpy(walk.order, nodeOrders[NODE_ORDER_LAST_HEARD], walk.orderLen * sizeof(walk.order[0]));
+    }
+
+    while (walk.index < walk.orderLen) {
+        uint16_t i = walk.order[walk.index++];
+        if (i >= *numMeshNodes)
+            continue; // it went away part way through our walk
+        if (nodeGenerations[i] >= minGeneration || nodeSummaries[i].num == getNodeNum())
+            return &meshNodes[i];
+    }
+
+    while (walk.index - walk.orderLen < extendedNodes.getNumNodes()) {
+        size_t i = walk.index++ - walk.orderLen;
+        if (extendedNodes.getGeneration(i) >= minGeneration)
+            return extendedNodes.getByIndex(i);
+    }
+    return NULL;
+}
+
+NodeNum NodeDB::readNextRemovedNode(uint32_t &readIndex, uint32_t minGeneration)
+{
+    // readIndex counts removals since boot, so skip whatever our ring has forgotten since the walk started
+    if (numRemovedNodes - readIndex > NODEDB_SYNC_TOMBSTONES)
+        readIndex = numRemovedNodes - NODEDB_SYNC_TOMBSTONES;
+
+    while (readIndex < numRemovedNodes) {
+        const RemovedNode &r = removedNodes[readIndex++ % NODEDB_SYNC_TOMBSTONES];
+        if (r.generation >= minGeneration)
+            return r.num;
+    }
+    return 0;
+}
+
+meshtastic_NodeInfoLite *NodeDB::getMeshNodeInOrder(NodeOrder order, size_t x)
+{
+    assert(x < *numMeshNodes);
+    sortNodeOrder(order);
+    return &meshNodes[nodeOrders[order][x]];
+}
+
+void NodeDB::sortNodeOrder(NodeOrder order)
+{
+    if (!(staleOrders & (1 << order)))
+        return;
+
+    uint16_t *o = nodeOrders[order];
+    for (uint16_t i = 0; i < *numMeshNodes; i++)
+        o[i] = i;
+
+    // Ties go in meshNodes order, so an order only changes when the nodes do
+    const MeshNodeSummary *nodes = nodeSummaries;
+    if (order == NODE_ORDER_LAST_HEARD)
+        std::sort(o, o + *numMeshNodes, [nodes](uint16_t a, uint16_t b) {
+            if (nodes[a].last_heard != nodes[b].last_heard)
+                return nodes[a].last_heard > nodes[b].last_heard;
+            return a < b;
+        });
     else
-        return NULL;
+        std::sort(o, o + *numMeshNodes, [nodes](uint16_t a, uint16_t b) {
+            // An snr of 0 means we have none (not that it was 0dB), those go last
+            bool hasA = nodes[a].snr != 0, hasB = nodes[b].snr != 0;
+            if (hasA != hasB)
+                return hasA;
+            if (nodes[a].snr != nodes[b].snr)
+                return nodes[a].snr > nodes[b].snr;
+            return a < b;
+        });
+
+    staleOrders &= ~(1 << order);
 }
 
 /// Given a node, return how many seconds in the past (vs now) that we last heard from it
@@ -728,18 +1754,28 @@ uint32_t sinceReceived(const meshtastic_MeshPacket *p)
     return delta;
 }
 
-#define NUM_ONLINE_SECS (60 * 60 * 2) // 2 hrs to consider someone offline
-
 size_t NodeDB::getNumOnlineMeshNodes()
 {
-    size_t numseen = 0;
+    return onlineNodes.count(getTime());
+}
 
-    // FIXME this implementation is kinda expensive
-    for (int i = 0; i < *numMeshNodes; i++)
-        if (sinceLastSeen(&meshNodes[i]) < NUM_ONLINE_SECS)
-            numseen++;
+void NodeDB::setLastHeard(meshtastic_NodeInfoLite *n, uint32_t lastHeard)
+{
+    if (n->last_heard == lastHeard)
+        return;
 
-    return numseen;
+    // Only meshNodes are counted, not nodes of the extended tier
+    if (n >= meshNodes && n < meshNodes + *numMeshNodes) {
+        onlineNodes.remove(n->last_heard);
+        onlineNodes.add(lastHeard);
+        staleOrders |= 1 << NODE_ORDER_LAST_HEARD;
+        noteNodeChanged(n - meshNodes);
+        concurrency::SeqWriteGuard guard(nodeLocks[n - meshNodes]);
+        nodeSummaries[n - meshNodes].last_heard = lastHeard;
+        n->last_heard = lastHeard;
+        return;
+    }
+    n->last_heard = lastHeard;
 }
 
 #include "MeshModule.h"
@@ -753,6 +1789,7 @@ void NodeDB::updatePosition(uint32_t nodeId, const meshtastic_Position &p, RxSou
         return;
     }
 
+    nodeLocks[info - meshNodes].beginWrite();
     if (src == RX_SRC_LOCAL) {
         // Local packet, fully authoritative
         LOG_INFO("updatePosition LOCAL pos@%x, time=%u, latI=%d, lonI=%d, alt=%d\n", p.timestamp, p.time, p.latitude_i,
@@ -784,10 +1821,54 @@ void NodeDB::updatePosition(uint32_t nodeId, const meshtastic_Position &p, RxSou
             info->position.time = tmp_time;
     }
     info->has_position = true;
+    nodeLocks[info - meshNodes].endWrite();
+    updateGeoIndex(info - meshNodes);
     updateGUIforNode = info;
     notifyObservers(true); // Force an update whether or not our node counts have changed
 }
 
+void NodeDB::updateGeoIndex(size_t index)
+{
+    const meshtastic_NodeInfoLite &n = meshNodes[index];
+    // Like Screen's hasValidPosition(), 0,0 is what we get from nodes which don't know where they are
+    bool hasPosition = n.has_position && (n.position.latitude_i || n.position.longitude_i);
+    geoIndex.update(index, hasPosition, n.position.latitude_i, n.position.longitude_i);
+    geofence.update(index, n.num, hasPosition, n.position.latitude_i, n.position.longitude_i);
+    if (n.num == getNodeNum())
+        geoIndex.setOrigin(hasPosition, n.position.latitude_i, n.position.longitude_i);
+}
+
+void NodeDB::notePositionChanged(const meshtastic_NodeInfoLite *n)
+{
+    if (n >= meshNodes && n < meshNodes + *numMeshNodes) {
+        updateGeoIndex(n - meshNodes);
+        noteNodeChanged(n - meshNodes);
+    }
+}
+
+bool NodeDB::getDistanceAndBearing(const meshtastic_NodeInfoLite *n, float &metres, float &bearing)
+{
+    return n >= meshNodes && n < meshNodes + *numMeshNodes && geoIndex.getDistanceAndBearing(n - meshNodes, metres, bearing);
+}
+
+size_t NodeDB::getNodesWithin(int32_t lat, int32_t lon, float metres, meshtastic_NodeInfoLite **out, size_t maxOut)
+{
+    uint16_t found[MAX_NUM_NODES];
+    size_t n = geoIndex.findWithin(lat, lon, metres, found, std::min(maxOut, (size_t)MAX_NUM_NODES));
+    for (size_t i = 0; i < n; i++)
+        out[i] = &meshNodes[found[i]];
+    return n;
+}
+
+size_t NodeDB::getNearestNodes(int32_t lat, int32_t lon, size_t k, meshtastic_NodeInfoLite **out)
+{
+    uint16_t found[MAX_NUM_NODES];
+    size_t n = geoIndex.findNearest(lat, lon, std::min(k, (size_t)MAX_NUM_NODES), found);
+    for (size_t i = 0; i < n; i++)
+        out[i] = &meshNodes[found[i]];
+    return n;
+}
+
 /** Update telemetry info for this node based on received metrics
  *  We only care about device telemetry here
  */
@@ -805,8 +1886,11 @@ void NodeDB::updateTelemetry(uint32_t nodeId, const meshtastic_Telemetry &t, RxS
     } else {
         LOG_DEBUG("updateTelemetry REMOTE node=0x%x \n", nodeId);
     }
-    info->device_metrics = t.variant.device_metrics;
-    info->has_device_metrics = true;
+    {
+        concurrency::SeqWriteGuard guard(nodeLocks[info - meshNodes]);
+        info->device_metrics = t.variant.device_metrics;
+        info->has_device_metrics = true;
+    }
     updateGUIforNode = info;
     notifyObservers(true); // Force an update whether or not our node counts have changed
 }
@@ -825,20 +1909,23 @@ bool NodeDB::updateUser(uint32_t nodeId, const meshtastic_User &p, uint8_t chann
     // Both of info->user and p start as filled with zero so I think this is okay
     bool changed = memcmp(&info->user, &p, sizeof(info->user)) || (info->channel != channelIndex);
 
+    nodeLocks[info - meshNodes].beginWrite();
     info->user = p;
     if (nodeId != getNodeNum())
         info->channel = channelIndex; // Set channel we need to use to reach this node (but don't set our own channel)
+    info->has_user = true;
+    refreshNodeSummary(info - meshNodes);
+    nodeLocks[info - meshNodes].endWrite();
     LOG_DEBUG("updating changed=%d user %s/%s/%s, channel=%d\n", changed, info->user.id, info->user.long_name,
               info->user.short_name, info->channel);
-    info->has_user = true;
 
     if (changed) {
         updateGUIforNode = info;
         powerFSM.trigger(EVENT_NODEDB_UPDATED);
         notifyObservers(true); // Force an update whether or not our node counts have changed
 
-        // We just changed something important about the user, store our DB
-        saveToDisk(SEGMENT_DEVICESTATE);
+        // We just changed something important about the user, store our DB (once this burst of updates has settled down)
+        saveToDiskSoon(SEGMENT_NODES);
     }
 
     return changed;
@@ -857,66 +1944,181 @@ void NodeDB::updateFrom(const meshtastic_MeshPacket &mp)
         }
 
         if (mp.rx_time) // if the packet has a valid timestamp use it to update our last_heard
-            info->last_heard = mp.rx_time;
+            setLastHeard(info, mp.rx_time);
 
-        if (mp.rx_snr)
+        if (mp.rx_snr && info->snr != mp.rx_snr) {
+            concurrency::SeqWriteGuard guard(nodeLocks[info - meshNodes]);
             info->snr = mp.rx_snr; // keep the most recent SNR we received for this node.
+            nodeSummaries[info - meshNodes].snr = mp.rx_snr;
+            staleOrders |= 1 << NODE_ORDER_SNR;
+        }
     }
 }
 
-uint8_t NodeDB::getMeshNodeChannel(NodeNum n)
+void NodeDB::noteHopsAway(NodeNum n, uint8_t hops, bool exact)
 {
-    const meshtastic_NodeInfoLite *info = getMeshNode(n);
-    if (!info) {
-        return 0; // defaults to PRIMARY
+    uint32_t entry;
+    if (findNodeIndexSlot(n, &entry) < 0)
+        return; // only meshNodes, an extended node's DMs just get our whole hop limit
+    HopsAway &h = nodeHops[entry];
+
+    // A fresh trace route beats an estimate
+    bool fresh = h.hops != HOPS_UNKNOWN && millis() - h.msec < HOP_DISTANCE_TTL_SECS * 1000UL;
+    if (!exact && h.exact && fresh)
+        return;
+    if (h.hops != hops)
+        LOG_DEBUG("Node 0x%x is %u hops away%s\n", n, hops, exact ? " (trace route)" : "");
+    h = HopsAway{hops, exact, millis()};
+}
+
+void NodeDB::forgetHopsAway(NodeNum n)
+{
+    uint32_t entry;
+    if (findNodeIndexSlot(n, &entry) >= 0)
+        nodeHops[entry].hops = HOPS_UNKNOWN;
+}
+
+uint8_t NodeDB::getHopLimitFor(NodeNum n, uint8_t hopLimit)
+{
+    uint32_t entry;
+    if (findNodeIndexSlot(n, &entry) < 0)
+        return hopLimit;
+    // Only a trace route tells us for sure, a hop_limit guess is too often short (the sender used a smaller limit than ours)
+    const HopsAway &h = nodeHops[entry];
+    if (h.hops == HOPS_UNKNOWN || !h.exact || millis() - h.msec >= HOP_DISTANCE_TTL_SECS * 1000UL)
+        return hopLimit;
+    return std::min<uint8_t>(hopLimit, h.hops + HOP_DISTANCE_MARGIN);
+}
+
+bool NodeDB::copySummary(NodeNum n, MeshNodeSummary &summary)
+{
+    // Read like copyMeshNode(), just the summary, as routing may be on another task.  If every read was torn (we interrupted
+    // the write), we answer as if we didn't have it
+    for (uint32_t tries = 0; tries < SEQLOCK_READ_TRIES; tries++) {
+        uint32_t structure = nodesLock.readBegin();
+        uint32_t entry;
+        if (findNodeIndexSlot(n, &entry) < 0) {
+            if (nodesLock.readRetry(structure))
+                continue;
+            break;
+        }
+        uint32_t version = nodeLocks[entry].readBegin();
+        summary = nodeSummaries[entry];
+        // Still n once we have our copy, or it moved (or was replaced) while we looked
+        if (!nodeLocks[entry].readRetry(version) && !nodesLock.readRetry(structure) && summary.num == n)
+            return true;
     }
-    return info->channel;
+
+    // Just the summary of an extended node, so routing never has to page one in from flash
+    const ExtendedNodeDB::Summary *extended = extendedNodes.getSummary(n);
+    if (!extended)
+        return false;
+    summary = MeshNodeSummary{extended->num, extended->last_heard, 0, extended->channel, extended->has_user};
+    return true;
+}
+
+uint8_t NodeDB::getMeshNodeChannel(NodeNum n)
+{
+    MeshNodeSummary summary;
+    return copySummary(n, summary) ? summary.channel : 0; // defaults to PRIMARY
+}
+
+bool NodeDB::hasUser(NodeNum n)
+{
+    MeshNodeSummary summary;
+    return copySummary(n, summary) && summary.has_user;
 }
 
 /// Find a node in our DB, return null for missing
-/// NOTE: This function might be called from an ISR
+/// NOTE: This function might be called from an ISR (but with NODEDB_EXTENDED_FLASH, not for nodes in the extended tier).
+/// What it points to is only safe to read on the mesh thread though, anywhere else use copyMeshNode()
 meshtastic_NodeInfoLite *NodeDB::getMeshNode(NodeNum n)
 {
-    for (int i = 0; i < *numMeshNodes; i++)
-        if (meshNodes[i].num == n)
-            return &meshNodes[i];
+    uint32_t entry;
+    return (findNodeIndexSlot(n, &entry) < 0) ? extendedNodes.find(n) : &meshNodes[entry];
+}
 
-    return NULL;
+bool NodeDB::copyMeshNode(NodeNum n, meshtastic_NodeInfoLite &out)
+{
+    for (uint32_t tries = 0; tries < SEQLOCK_READ_TRIES; tries++) {
+        uint32_t structure = nodesLock.readBegin();
+        uint32_t entry;
+        if (findNodeIndexSlot(n, &entry) < 0) {
+            if (nodesLock.readRetry(structure))
+                continue; // it may only have been moving
+            return false;
+        }
+        uint32_t version = nodeLocks[entry].readBegin();
+        out = meshNodes[entry];
+        // Still n once we have our copy, or it moved (or was replaced) while we looked
+        if (!nodeLocks[entry].readRetry(version) && !nodesLock.readRetry(structure) && out.num == n)
+            return true;
+    }
+    return false;
+}
+
+size_t NodeDB::snapshotMeshNodeSummaries(MeshNodeSummary *out, size_t maxOut)
+{
+    for (uint32_t tries = 0; tries < SEQLOCK_READ_TRIES; tries++) {
+        uint32_t structure = nodesLock.readBegin();
+        size_t n = std::min<size_t>(*numMeshNodes, std::min<size_t>(maxOut, MAX_NUM_NODES));
+        bool torn = false;
+        for (size_t i = 0; i < n && !torn; i++) {
+            uint32_t version = nodeLocks[i].readBegin();
+            out[i] = nodeSummaries[i];
+            torn = nodeLocks[i].readRetry(version);
+        }
+        if (!torn && !nodesLock.readRetry(structure))
+            return n;
+    }
+    return 0;
 }
 
 /// Find a node in our DB, create an empty NodeInfo if missing
 meshtastic_NodeInfoLite *NodeDB::getOrCreateMeshNode(NodeNum n)
 {
-    meshtastic_NodeInfoLite *lite = getMeshNode(n);
+    uint32_t entry;
+    meshtastic_NodeInfoLite *lite = (findNodeIndexSlot(n, &entry) < 0) ? NULL : &meshNodes[entry];
 
     if (!lite) {
+        // A node we evicted earlier moves back up from the extended tier (before an eviction can push it out of there)
+        static meshtastic_NodeInfoLite promoted; // big, keep it off the stack
+        bool wasExtended = extendedNodes.take(n, &promoted);
+
         if ((*numMeshNodes >= MAX_NUM_NODES) || (memGet.getFreeHeap() < meshtastic_NodeInfoLite_size * 3)) {
-            if (screen)
-                screen->print("warning: node_db_lite full! erasing oldest entry\n");
-            LOG_INFO("warning: node_db_lite full! erasing oldest entry\n");
-            // look for oldest node and erase it
-            uint32_t oldest = UINT32_MAX;
-            int oldestIndex = -1;
-            for (int i = 1; i < *numMeshNodes; i++) {
-                if (meshNodes[i].last_heard < oldest) {
-                    oldest = meshNodes[i].last_heard;
-                    oldestIndex = i;
-                }
-            }
-            // Shove the remaining nodes down the chain
-            for (int i = oldestIndex; i < *numMeshNodes - 1; i++) {
-                meshNodes[i] = meshNodes[i + 1];
+            if (*numMeshNodes > 1) {
+                if (screen)
+                    screen->print("warning: node_db_lite full! erasing an old entry\n");
+                LOG_INFO("warning: node_db_lite full! erasing an old entry\n");
+                evictMeshNode();
             }
-            (*numMeshNodes)--;
         }
         // add the node at the end
-        lite = &meshNodes[(*numMeshNodes)++];
+        concurrency::SeqWriteGuard guard(nodesLock);
+        lite = &meshNodes[*numMeshNodes];
 
-        // everything is missing except the nodenum
-        memset(lite, 0, sizeof(*lite));
-        lite->num = n;
+        if (wasExtended) {
+            *lite = promoted;
+        } else {
+            // everything is missing except the nodenum
+            memset(lite, 0, sizeof(*lite));
+            lite->num = n;
+        }
+        nodeHops[*numMeshNodes] = HopsAway{HOPS_UNKNOWN, false, 0};
+        refreshNodeSummary(*numMeshNodes); // before it goes in the index, findNodeIndexSlot() checks against it
+        addToNodeIndex(n, (*numMeshNodes)++);
+        onlineNodes.add(lite->last_heard);
+        staleOrders = (1 << NUM_NODE_ORDERS) - 1;
+        updateGeoIndex(lite - meshNodes);
     }
 
+    // We just heard from this node, so give it another chance before the eviction hand comes around
+    nodeChances[lite - meshNodes] = lite->has_user ? 2 : 1;
+
+    // Our callers are all about to change it
+    markNodeDirty(lite - meshNodes);
+    noteNodeChanged(lite - meshNodes);
+
     return lite;
 }
 
@@ -4,8 +4,12 @@
 #include <Arduino.h>
 #include <assert.h>
 
+#include "ExtendedNodeDB.h"
 #include "MeshTypes.h"
+#include "NodeGeoIndex.h"
 #include "NodeStatus.h"
+#include "OnlineNodeCounter.h"
+#include "concurrency/SeqLock.h"
 #include "mesh-pb-constants.h"
 #include "mesh/generated/meshtastic/mesh.pb.h" // For CriticalErrorCode
 
@@ -18,10 +22,53 @@ DeviceState versions used to be defined in the .proto file but really only this
 #define SEGMENT_MODULECONFIG 2
 #define SEGMENT_DEVICESTATE 4
 #define SEGMENT_CHANNELS 8
+#define SEGMENT_NODES 16     // just the node records which changed (SEGMENT_DEVICESTATE writes those too)
+#define SEGMENT_NEIGHBORS 32 // NeighborInfoModule's neighbors
 
 #define DEVICESTATE_CUR_VER 22
 #define DEVICESTATE_MIN_VER DEVICESTATE_CUR_VER
 
+/// How long saveToDiskSoon() lets requests pile up before writing them, so a burst of nodeinfos costs one flash write
+#ifndef NODEDB_SAVE_COALESCE_MSECS
+#define NODEDB_SAVE_COALESCE_MSECS (30 * 1000)
+#endif
+
+/// Once this many records at the end of the node store are empty (because nodes were removed), it gets compacted
+#ifndef NODE_STORE_COMPACT_SLACK
+#define NODE_STORE_COMPACT_SLACK 16
+#endif
+
+/// On Linux, keep meshNodes in a file we map (see NodeDB::mapNodeStore()), so a change to a node is just a memory write and a
+/// restart just maps it again, rather than decoding every node's record
+#ifndef NODE_STORE_MMAP
+#ifdef ARCH_PORTDUINO
+#define NODE_STORE_MMAP 1
+#else
+#define NODE_STORE_MMAP 0
+#endif
+#endif
+
+/// How often we msync() the mapped node store, on top of whenever we'd have written node records
+#ifndef NODE_STORE_MMAP_SYNC_SECS
+#define NODE_STORE_MMAP_SYNC_SECS 30
+#endif
+
+/// Hops we allow on top of how far away we have learned a node is (see NodeDB::getHopLimitFor())
+#ifndef HOP_DISTANCE_MARGIN
+#define HOP_DISTANCE_MARGIN 1
+#endif
+
+/// How long what we learned about how far away a node is stays good
+#ifndef HOP_DISTANCE_TTL_SECS
+#define HOP_DISTANCE_TTL_SECS (30 * 60)
+#endif
+
+/// How many removed nodes we remember for incremental syncs (see PhoneAPI), a client which last synced before the oldest of
+/// them gets our whole node list again
+#ifndef NODEDB_SYNC_TOMBSTONES
+#define NODEDB_SYNC_TOMBSTONES 32
+#endif
+
 extern meshtastic_DeviceState devicestate;
 extern meshtastic_ChannelFile channelFile;
 extern meshtastic_MyNodeInfo &myNodeInfo;
@@ -37,17 +84,116 @@ uint32_t sinceLastSeen(const meshtastic_NodeInfoLite *n);
 /// Given a packet, return how many seconds in the past (vs now) it was received
 uint32_t sinceReceived(const meshtastic_MeshPacket *p);
 
+/// Orders NodeDB::getMeshNodeInOrder() can walk our nodes in
+enum NodeOrder {
+    NODE_ORDER_LAST_HEARD, // most recently heard first
+    NODE_ORDER_SNR,        // best SNR first, nodes we don't have an SNR for (such as ourselves) last
+    NUM_NODE_ORDERS
+};
+
+/// The fields of a node which scans over all our nodes look at, see NodeDB::getMeshNodeSummaryByIndex()
+struct MeshNodeSummary {
+    NodeNum num;
+    uint32_t last_heard;
+    float snr;
+    uint8_t channel;
+    bool has_user;
+};
+
 class NodeDB
 {
     // NodeNum provisionalNodeNum; // if we are trying to find a node num this is our current attempt
 
     // A NodeInfo for every node we've seen
-    // Eventually use a smarter datastructure
-    // HashMap<NodeNum, NodeInfo> nodes;
     // Note: these two references just point into our static array we serialize to/from disk
     meshtastic_NodeInfoLite *meshNodes;
     pb_size_t *numMeshNodes;
 
+    /// Size of our NodeNum lookup table, kept at least twice MAX_NUM_NODES so probe runs stay short
+    static const uint32_t NODE_INDEX_BITS = 8;
+    static const uint32_t NODE_INDEX_SIZE = 1 << NODE_INDEX_BITS;
+    static_assert(MAX_NUM_NODES * 2 <= NODE_INDEX_SIZE, "NODE_INDEX_BITS is too small for MAX_NUM_NODES");
+
+    /// Open addressing (linear probing) hash from NodeNum to 1 + its index in meshNodes, 0 marks an empty slot.
+    /// Fixed size and never allocates, so getMeshNode() stays safe to call from an ISR.
+    uint16_t nodeIndex[NODE_INDEX_SIZE];
+
+    /// What index probes, sorts and scans look at of each of meshNodes, parallel to meshNodes.  Packed together like this
+    /// a scan reads a few cache lines rather than a few hundred bytes of protobuf struct per node.  meshNodes stays the
+    /// master copy (and what we save), so this is refreshed from it by every change to those fields.
+    MeshNodeSummary nodeSummaries[MAX_NUM_NODES];
+
+    /// Written around every change to which node is at which index of meshNodes (and nodeIndex, and how many there are), so
+    /// readers on other tasks or cores can tell that a copy they took was torn and take it again (see copyMeshNode())
+    concurrency::SeqLock nodesLock;
+
+    /// Written around every change to one of meshNodes (and its summary) in place, parallel to meshNodes
+    concurrency::SeqLock nodeLocks[MAX_NUM_NODES];
+
+    /// Clock (second chance) eviction state, parallel to meshNodes.  A node gets a chance each time we hear from it (two if
+    /// we have its user info), and the eviction hand spends one chance per pass - so we evict a node not heard from recently
+    /// without having to search for the oldest.
+    uint8_t nodeChances[MAX_NUM_NODES];
+    uint32_t evictHand = 1;
+
+    /// How many nodes we have thrown out of a full DB since boot
+    uint32_t numEvictions = 0;
+
+    /// meshNodes indexes in each NodeOrder, only sorted again when asked for after a change (bit per order in staleOrders)
+    uint16_t nodeOrders[NUM_NODE_ORDERS][MAX_NUM_NODES];
+    uint8_t staleOrders = (1 << NUM_NODE_ORDERS) - 1;
+
+
+    /// Where evicted nodes go (if we have the PSRAM for it), rather than being forgotten
+    ExtendedNodeDB extendedNodes;
+
+    /// Which of meshNodes are online, kept up to date by every change to their last_heard
+    OnlineNodeCounter onlineNodes;
+
+    /// Where meshNodes are, kept up to date by every change to their position
+    NodeGeoIndex geoIndex;
+
+    /// Segments saveToDiskSoon() has been asked to write, but which haven't been written yet
+    int pendingSaves = 0;
+
+    /// Flash write statistics, see getNumDiskWrites()
+    uint32_t numDiskWrites = 0, maxDiskWriteMsec = 0, totalDiskWriteMsec = 0, numSkippedDiskWrites = 0;
+
+    /// Nodes whose record in the node store is out of date, one bit per meshNodes index
+    uint8_t dirtyNodes[(MAX_NUM_NODES + 7) / 8];
+
+    /// How many records (live or empty) the node store holds
+    uint32_t numNodeRecords = 0;
+
+    /// The node store's records don't line up with meshNodes anymore (or it's missing), so rewrite it from scratch
+    bool nodeStoreStale = true;
+
+    /// Bumped by every change to our nodes, so a reconnecting client can be sent just what changed since it last synced
+    uint32_t nodeGeneration = 1;
+
+    /// The nodeGeneration each of meshNodes last changed at (0 for nodes untouched since boot), parallel to meshNodes
+    uint32_t nodeGenerations[MAX_NUM_NODES];
+
+    /// How many relays it takes to reach each of meshNodes, parallel to meshNodes.  Never saved, we learn it again soon enough
+    struct HopsAway {
+        uint8_t hops;  // HOPS_UNKNOWN until we learn it
+        bool exact;    // from a trace route, not worked out from a hop_limit
+        uint32_t msec; // when we learned it
+    };
+    HopsAway nodeHops[MAX_NUM_NODES];
+    static const uint8_t HOPS_UNKNOWN = 0xff;
+
+    /// The last NODEDB_SYNC_TOMBSTONES nodes we removed (or forgot from the extended tier), a ring numRemovedNodes goes round
+    struct RemovedNode {
+        NodeNum num;
+        uint32_t generation;
+    };
+    RemovedNode removedNodes[NODEDB_SYNC_TOMBSTONES];
+    uint32_t numRemovedNodes = 0;
+
+    /// Clients which synced before this generation may have missed a removal, so canSyncSince() says no
+    uint32_t oldestSyncGeneration = 1;
+
   public:
     bool updateGUI = false; // we think the gui should definitely be redrawn, screen will clear this once handled
     meshtastic_NodeInfoLite *updateGUIforNode = NULL; // if currently showing this node, we think you should update the GUI
@@ -64,6 +210,27 @@ class NodeDB
     void saveToDisk(int saveWhat = SEGMENT_CONFIG | SEGMENT_MODULECONFIG | SEGMENT_DEVICESTATE | SEGMENT_CHANNELS),
         saveChannelsToDisk(), saveDeviceStateToDisk();
 
+    /// Mark segments as dirty, they will be written by a background thread within NODEDB_SAVE_COALESCE_MSECS.
+    /// Use this for frequent, non critical changes (new nodes, user updates), saveToDisk() still writes immediately.
+    void saveToDiskSoon(int saveWhat);
+
+    /// Write any segments saveToDiskSoon() is still holding, call before we reboot, shutdown or sleep
+    void flushPendingSaves();
+
+    /// Forget our warm boot copy of the config, module config and channels (and what saveProto() knows of the files it wrote),
+    /// call after changing those files behind our back
+    void invalidateWarmBoot();
+
+    /// @return how many files we have written to flash since boot
+    uint32_t getNumDiskWrites() { return numDiskWrites; }
+
+    /// @return how many saves we skipped since boot, because the file already held exactly what we'd have written
+    uint32_t getNumSkippedDiskWrites() { return numSkippedDiskWrites; }
+
+    /// @return the slowest and total time (in msecs) we have spent writing files to flash since boot
+    uint32_t getMaxDiskWriteMsec() { return maxDiskWriteMsec; }
+    uint32_t getTotalDiskWriteMsec() { return totalDiskWriteMsec; }
+
     /** Reinit radio config if needed, because either:
      * a) sometimes a buggy android app might send us bogus settings or
      * b) the client set factory_reset
@@ -108,9 +275,27 @@ class NodeDB
     // get channel channel index we heard a nodeNum on, defaults to 0 if not found
     uint8_t getMeshNodeChannel(NodeNum n);
 
-    /// Return the number of nodes we've heard from recently (within the last 2 hrs?)
+    /// @return true if we have n's User.  Like getMeshNodeChannel() only reads the summary, so it's safe from any task and
+    /// never pages a node in from flash
+    bool hasUser(NodeNum n);
+
+    /// Return the number of nodes we've heard from recently (within NUM_ONLINE_SECS, give or take ONLINE_BUCKET_SECS)
     size_t getNumOnlineMeshNodes();
 
+    /// n is hops relays away from us, exact if a trace route told us (rather than a hop_limit we assumed it started from)
+    void noteHopsAway(NodeNum n, uint8_t hops, bool exact);
+
+    /// Our reliable send to n went unacked, so we may be wrong about how far away it is
+    void forgetHopsAway(NodeNum n);
+
+    /// @return the hop_limit (no more than hopLimit) our packets for n need: how many relays away a trace route showed it
+    /// is, plus HOP_DISTANCE_MARGIN, or hopLimit if we don't know for sure
+    uint8_t getHopLimitFor(NodeNum n, uint8_t hopLimit);
+
+    /// Set when we last heard from a node, always go through here so our count of online nodes stays right.  Like every
+    /// change to our nodes, only from the mesh thread
+    void setLastHeard(meshtastic_NodeInfoLite *n, uint32_t lastHeard);
+
     void initConfigIntervals(), initModuleConfigIntervals(), resetNodes(), removeNodeByNum(uint nodeNum);
 
     bool factoryReset();
@@ -120,7 +305,44 @@ class NodeDB
 
     void installRoleDefaults(meshtastic_Config_DeviceConfig_Role role);
 
-    const meshtastic_NodeInfoLite *readNextMeshNode(uint32_t &readIndex);
+    /// Where one readNextMeshNode() walk is up to.  Each walker owns its own, so one starting over never upsets another
+    struct MeshNodeWalk {
+        uint32_t index = 0; // set back to 0 to start again
+        /// The NODE_ORDER_LAST_HEARD order being walked, taken when the walk starts so it never skips a node which was
+        /// heard from (and so moved up) part way through
+        uint16_t order[MAX_NUM_NODES];
+        pb_size_t orderLen = 0;
+    };
+
+    /// Walk all our nodes, meshNodes most recently heard first then the extended tier.  Only nodes which changed at or
+    /// after minGeneration are visited, apart from our own (which changes all the time, not always via us)
+    const meshtastic_NodeInfoLite *readNextMeshNode(MeshNodeWalk &walk, uint32_t minGeneration = 0);
+
+    /// Walk the nodes we removed at or after minGeneration, @return 0 when there are no more.  Start with readIndex = 0
+    NodeNum readNextRemovedNode(uint32_t &readIndex, uint32_t minGeneration);
+
+    /// @return the generation of our nodes now, a client which has seen them all has seen everything up to here
+    uint32_t getNodeGeneration() { return nodeGeneration; }
+
+    /// @return true if readNextMeshNode() and readNextRemovedNode() can still tell a client everything which changed after
+    /// generation (we haven't forgotten any removals since)
+    bool canSyncSince(uint32_t generation) { return generation >= oldestSyncGeneration; }
+
+    /// @return the node at position x < getNumMeshNodes() of an order, valid until our nodes next change
+    meshtastic_NodeInfoLite *getMeshNodeInOrder(NodeOrder order, size_t x);
+
+    /// Call after changing a node's position other than through updatePosition()
+    void notePositionChanged(const meshtastic_NodeInfoLite *n);
+
+    /// Distance (metres) and bearing (radians) from us to n, cached until one of us moves.  @return false if either of us
+    /// has no position, or n isn't one of meshNodes
+    bool getDistanceAndBearing(const meshtastic_NodeInfoLite *n, float &metres, float &bearing);
+
+    /// Find meshNodes within metres of a point (1e-7 degrees), @return how many (at most maxOut) went in out
+    size_t getNodesWithin(int32_t lat, int32_t lon, float metres, meshtastic_NodeInfoLite **out, size_t maxOut);
+
+    /// Find the (at most) k meshNodes nearest to a point (1e-7 degrees), nearest first, @return how many went in out
+    size_t getNearestNodes(int32_t lat, int32_t lon, size_t k, meshtastic_NodeInfoLite **out);
 
     meshtastic_NodeInfoLite *getMeshNodeByIndex(size_t x)
     {
@@ -128,9 +350,33 @@ class NodeDB
         return &meshNodes[x];
     }
 
+    /// @return what scans need of getMeshNodeByIndex(x), without touching the rest of it
+    const MeshNodeSummary &getMeshNodeSummaryByIndex(size_t x)
+    {
+        assert(x < *numMeshNodes);
+        return nodeSummaries[x];
+    }
+
+    /// Find a node in our DB (either tier), return null for missing
     meshtastic_NodeInfoLite *getMeshNode(NodeNum n);
+
+    /// Copy node n (one of meshNodes, not the extended tier) as it was at one moment, safe from any task, core or ISR while
+    /// the mesh thread changes it.  @return false if we don't have it, or couldn't get a copy in SEQLOCK_READ_TRIES
+    bool copyMeshNode(NodeNum n, meshtastic_NodeInfoLite &out);
+
+    /// Copy the summaries of (at most maxOut of) meshNodes in index order, all as they were at one moment, safe like
+    /// copyMeshNode().  @return how many went in out, 0 if we couldn't get a copy in SEQLOCK_READ_TRIES
+    size_t snapshotMeshNodeSummaries(MeshNodeSummary *out, size_t maxOut);
+
+    /// @return how many nodes getMeshNodeByIndex() can reach, those in the extended tier are only visited by readNextMeshNode()
     size_t getNumMeshNodes() { return *numMeshNodes; }
 
+    /// @return how many nodes we know about in the extended tier, on top of getNumMeshNodes()
+    size_t getNumExtendedNodes() { return extendedNodes.getNumNodes(); }
+
+    /// @return how many nodes we have evicted to make room for new ones since boot
+    uint32_t getNumEvictions() { return numEvictions; }
+
     void setLocalPosition(meshtastic_Position position)
     {
         LOG_DEBUG("Setting local position: latitude=%i, longitude=%i, time=%i\n", position.latitude_i, position.longitude_i,
@@ -142,20 +388,108 @@ class NodeDB
     /// Find a node in our DB, create an empty NodeInfoLite if missing
     meshtastic_NodeInfoLite *getOrCreateMeshNode(NodeNum n);
 
+    /// Copy n's summary, from meshNodes or the extended tier (its snr is then 0).  @return false if we don't have it
+    bool copySummary(NodeNum n, MeshNodeSummary &summary);
+
     /// Notify observers of changes to the DB
     void notifyObservers(bool forceUpdate = false)
     {
         // Notify observers of the current node state
-        const meshtastic::NodeStatus status = meshtastic::NodeStatus(getNumOnlineMeshNodes(), getNumMeshNodes(), forceUpdate);
+        const meshtastic::NodeStatus status =
+            meshtastic::NodeStatus(getNumOnlineMeshNodes(), getNumMeshNodes() + getNumExtendedNodes(), forceUpdate);
         newStatus.notifyObservers(&status);
     }
 
     /// read our db from flash
     void loadFromDisk();
 
+    /// read our config, module config and channels from flash
+    void loadConfigFromDisk();
+
+    /// Use our warm boot copy of the config, module config and channels (if it is good), @return true if we did
+    bool loadWarmBoot();
+
+    /// Update these segments of our warm boot copy, which we just loaded or saved
+    void saveWarmBoot(int saveWhat);
+
+    /// Read the node store into meshNodes, unless DeviceState (from older firmware) already brought its own nodes
+    void loadNodesFromDisk();
+
+    /// Patch the records of nodes which changed into the node store, or rewrite (and so compact) the whole store if needed
+    void saveNodesToDisk();
+
+    /// Write all of meshNodes to a new node store, @return true for success
+    bool rewriteNodeStore();
+
+    /// Write our own node (meshNodes[0]) to its own record file, see ownNodeFileName.  @return true for success
+    bool saveOwnNode();
+
+    /// Take our own node from its record file, if that holds a newer copy than the node store did
+    void loadOwnNode();
+
+#if NODE_STORE_MMAP
+    /**
+     * Map our node file and point meshNodes and numMeshNodes into it.  If keep, only if it holds nodes written by a build
+     * with our NodeInfoLite, and we then use those.  Otherwise the file is started over with the nodes we have now.
+     * @return true if our nodes are now in the map
+     */
+    bool mapNodeStore(bool keep);
+
+    /// Go back to keeping meshNodes in devicestate (which we leave empty), for when the map's file is about to go
+    void unmapNodeStore();
+#endif
+
+    /// The node at this meshNodes index changed (or a different one moved there), so its record needs writing
+    void markNodeDirty(size_t index) { dirtyNodes[index / 8] |= 1 << (index % 8); }
+
+    /// The node at this meshNodes index changed, so clients which synced before now need it again
+    void noteNodeChanged(size_t index) { nodeGenerations[index] = ++nodeGeneration; }
+
+    /// We no longer have n (in either tier), so clients which synced before now need to hear it's gone
+    void noteNodeRemoved(NodeNum n);
+
+    /// We threw all our nodes away, every client needs our whole node list again
+    void forgetSyncs() { oldestSyncGeneration = ++nodeGeneration; }
+
+    /// Update the flash write statistics for a file we started writing at startMsec
+    void countDiskWrite(const char *filename, uint32_t startMsec);
+
     /// purge db entries without user info
     void cleanupMeshDB();
 
+    /// Copy meshNodes[index]'s fields into nodeSummaries[index], after they changed (or a different node moved there)
+    void refreshNodeSummary(size_t index)
+    {
+        const meshtastic_NodeInfoLite &n = meshNodes[index];
+        nodeSummaries[index] = MeshNodeSummary{n.num, n.last_heard, n.snr, (uint8_t)n.channel, n.has_user};
+    }
+
+    /// Throw away nodeIndex and rebuild it from meshNodes, needed whenever nodes move around in the array
+    void rebuildNodeIndex();
+
+    /// Sort nodeOrders[order] again, if it is out of date
+    void sortNodeOrder(NodeOrder order);
+
+    /// File meshNodes[index] (which may be us) in geoIndex by its current position
+    void updateGeoIndex(size_t index);
+
+    /// Add meshNodes[index] to nodeIndex (it must not already be there)
+    void addToNodeIndex(NodeNum n, size_t index);
+
+    /// @return the nodeIndex slot holding n, or -1 if it's not there
+    /// @param entry if not NULL, set to the index in meshNodes we checked holds n.  Readers on other tasks must use this rather
+    /// than read nodeIndex[slot] again, which a writer may have changed under them
+    int32_t findNodeIndexSlot(NodeNum n, uint32_t *entry = NULL);
+
+    /// Remove n from nodeIndex, moving later entries of its probe run back so they can still be found
+    void removeFromNodeIndex(NodeNum n);
+
+    /// Make room in a full DB by moving one node (never our own), picked by the clock hand, to the extended tier
+    void evictMeshNode();
+
+    /// Home slot in nodeIndex for a node
+    static uint32_t nodeIndexSlot(NodeNum n) { return (uint32_t)(n * 2654435761UL) >> (32 - NODE_INDEX_BITS); }
+
     /// Reinit device state from scratch (not loading from disk)
     void installDefaultDeviceState(), installDefaultChannels(), installDefaultConfig(), installDefaultModuleConfig();
 };
@@ -0,0 +1,174 @@
+#include "NodeGeoIndex.h"
+#include "gps/GeoCoord.h"
+#include <algorithm>
+
+#define EARTH_RADIUS_METRES 6366000.0f // as GeoCoord::latLongToMeter()
+#define METRES_PER_CELL (GEO_CELL_E7 * 1e-7f * (float)PI / 180 * EARTH_RADIUS_METRES)
+#define CELLS_AROUND ((int32_t)(3600000000LL / GEO_CELL_E7)) // so cells wrap around at the antimeridian
+
+int32_t NodeGeoIndex::cellY(int32_t lat)
+{
+    return (lat + 900000000) / GEO_CELL_E7;
+}
+
+int32_t NodeGeoIndex::cellX(int32_t lon)
+{
+    return (int32_t)(((int64_t)lon + 1800000000) / GEO_CELL_E7) % CELLS_AROUND;
+}
+
+uint32_t NodeGeoIndex::bucketOf(int32_t y, int32_t x)
+{
+    return ((uint32_t)y * 73856093u ^ (uint32_t)x * 19349663u) & (GEO_INDEX_BUCKETS - 1);
+}
+
+void NodeGeoIndex::clear()
+{
+    for (size_t i = 0; i < MAX_NUM_NODES; i++) {
+        entries[i].indexed = false;
+        entries[i].cacheGen = 0;
+    }
+    for (size_t b = 0; b < GEO_INDEX_BUCKETS; b++)
+        buckets[b] = -1;
+}
+
+void NodeGeoIndex::unlink(size_t i)
+{
+    int16_t *link = &buckets[bucketOf(cellY(entries[i].lat), cellX(entries[i].lon))];
+    while (*link != (int16_t)i)
+        link = &entries[*link].next;
+    *link = entries[i].next;
+    entries[i].indexed = false;
+}
+
+void NodeGeoIndex::update(size_t i, bool hasPosition, int32_t lat, int32_t lon)
+{
+    Entry &e = entries[i];
+    if (e.indexed && hasPosition && e.lat == lat && e.lon == lon)
+        return; // nothing moved, so what we cached still holds
+
+    if (e.indexed)
+        unlink(i);
+    e.cacheGen = 0;
+    if (!hasPosition)
+        return;
+
+    e.lat = lat;
+    e.lon = lon;
+    int16_t &head = buckets[bucketOf(cellY(lat), cellX(lon))];
+    e.next = head;
+    head = i;
+    e.indexed = true;
+}
+
+void NodeGeoIndex::move(size_t from, size_t to)
+{
+    remove(to);
+    if (!entries[from].indexed)
+        return;
+
+    uint16_t cacheGen = entries[from].cacheGen;
+    float distance = entries[from].distance, bearing = entries[from].bearing;
+    update(to, true, entries[from].lat, entries[from].lon);
+    remove(from);
+    entries[to].cacheGen = cacheGen;
+    entries[to].distance = distance;
+    entries[to].bearing = bearing;
+}
+
+void NodeGeoIndex::setOrigin(bool hasPosition, int32_t lat, int32_t lon)
+{
+    if (hasPosition == hasOrigin && (!hasPosition || (lat == originLat && lon == originLon)))
+        return;
+
+    hasOrigin = hasPosition;
+    originLat = lat;
+    originLon = lon;
+    if (++originGen == 0)
+        originGen = 1; // 0 stays "never"
+}
+
+bool NodeGeoIndex::getDistanceAndBearing(size_t i, float &metres, float &bearing)
+{
+    Entry &e = entries[i];
+    if (!hasOrigin || !e.indexed)
+        return false;
+
+    if (e.cacheGen != originGen) {
+        e.distance = GeoCoord::distanceE7(e.lat, e.lon, originLat, originLon);
+        e.bearing = GeoCoord::bearingE7(originLat, originLon, e.lat, e.lon);
+        e.cacheGen = originGen;
+    }
+    metres = e.distance;
+    bearing = e.bearing;
+    return true;
+}
+
+float NodeGeoIndex::approxDistance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    int64_t dLon = (int64_t)lon2 - lon1;
+    if (dLon > 1800000000)
+        dLon -= 3600000000LL;
+    else if (dLon < -1800000000)
+        dLon += 3600000000LL;
+
+    const float radians = 1e-7f * (float)PI / 180;
+    float meanLat = ((float)lat1 + (float)lat2) / 2 * radians;
+    float x = dLon * radians * cosf(meanLat), y = ((int64_t)lat2 - lat1) * radians;
+    return EARTH_RADIUS_METRES * sqrtf(x * x + y * y);
+}
+
+size_t NodeGeoIndex::findWithin(int32_t lat, int32_t lon, float metres, uint16_t *out, size_t maxOut) const
+{
+    size_t found = 0;
+
+    // The cells a circle of metres around us could reach, there are more to the east and west the further we are from the
+    // equator
+    float cosLat = cosf(lat * 1e-7f * (float)PI / 180);
+    float ySpan = metres / METRES_PER_CELL + 1;
+    float xSpan = ySpan / std::max(cosLat, 0.01f);
+
+    if ((2 * ySpan + 1) * (2 * xSpan + 1) > GEO_INDEX_BUCKETS || 2 * xSpan + 1 >= CELLS_AROUND) {
+        // We'd visit every bucket anyway, so just look at every node
+        for (size_t i = 0; i < MAX_NUM_NODES && found < maxOut; i++)
+            if (entries[i].indexed && approxDistance(lat, lon, entries[i].lat, entries[i].lon) <= metres)
+                out[found++] = i;
+        return found;
+    }
+
+    int32_t y0 = cellY(lat), x0 = cellX(lon), dyMax = (int32_t)ySpan, dxMax = (int32_t)xSpan;
+    for (int32_t dy = -dyMax; dy <= dyMax; dy++) {
+        for (int32_t dx = -dxMax; dx <= dxMax; dx++) {
+            int32_t y = y0 + dy, x = ((x0 + dx) % CELLS_AROUND + CELLS_AROUND) % CELLS_AROUND;
+            for (int16_t i = buckets[bucketOf(y, x)]; i >= 0; i = entries[i].next) {
+                const Entry &e = entries[i];
+                // Other cells share this bucket, only take the nodes of ours (so each node is only looked at once)
+                if (cellY(e.lat) == y && cellX(e.lon) == x && found < maxOut && approxDistance(lat, lon, e.lat, e.lon) <= metres)
+                    out[found++] = i;
+            }
+        }
+    }
+    return found;
+}
+
+size_t NodeGeoIndex::findNearest(int32_t lat, int32_t lon, size_t k, uint16_t *out) const
+{
+    if (!k)
+        return 0;
+
+    // Widen the circle until it holds at least k nodes (or every node we have), the k nearest are then all inside it
+    uint16_t found[MAX_NUM_NODES];
+    size_t n = 0;
+    for (float metres = METRES_PER_CELL;; metres *= 2) {
+        n = findWithin(lat, lon, metres, found, MAX_NUM_NODES);
+        if (n >= k || metres > 8 * EARTH_RADIUS_METRES) // past the farthest approxDistance() can give
+            break;
+    }
+
+    float distances[MAX_NUM_NODES];
+    for (size_t i = 0; i < n; i++)
+        distances[found[i]] = approxDistance(lat, lon, entries[found[i]].lat, entries[found[i]].lon);
+    k = std::min(k, n);
+    std::partial_sort(found, found + k, found + n, [&distances](uint16_t a, uint16_t b) { return distances[a] < distances[b]; });
+    std::copy(found, found + k, out);
+    return k;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mesh-pb-constants.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Size of a grid cell (in 1e-7 degrees, like PositionLite), 0.1 degree is about 11km north to south
+#ifndef GEO_CELL_E7
+#define GEO_CELL_E7 1000000
+#endif
+
+/// Buckets of our cell hash, a search which would visit more cells than this looks at every node instead
+#define GEO_INDEX_BUCKETS 64
+
+/**
+ * A grid over the positions of NodeDB's meshNodes (by their index there), so "which nodes are within R metres" and "which
+ * are the k nearest" only look at the nodes in nearby cells.  Cells hash into a fixed number of buckets, each a chain of
+ * nodes, so we never allocate.  Searches go by a flat earth approximation, good for the distances a mesh covers, and
+ * distance and bearing from our own position (the exact great circle ones) are kept for each node until either end moves.
+ */
+class NodeGeoIndex
+{
+    struct Entry {
+        int32_t lat, lon;  // where we filed the node, in 1e-7 degrees
+        int16_t next;      // in its bucket's chain, -1 at the end
+        bool indexed;      // it has a position (and so is in a chain)
+        uint16_t cacheGen; // originGen when distance and bearing were worked out, 0 for never
+        float distance;    // metres from our own position
+        float bearing;     // radians from our own position, as GeoCoord::bearing()
+    };
+
+    Entry entries[MAX_NUM_NODES];
+    int16_t buckets[GEO_INDEX_BUCKETS];
+
+    int32_t originLat = 0, originLon = 0;
+    bool hasOrigin = false;
+    uint16_t originGen = 1; // bumped whenever our own position changes, so every cached distance is out of date
+
+    static int32_t cellY(int32_t lat);
+    static int32_t cellX(int32_t lon);
+    static uint32_t bucketOf(int32_t y, int32_t x);
+
+    void unlink(size_t i);
+
+  public:
+    NodeGeoIndex() { clear(); }
+
+    void clear();
+
+    /// Node i has a (new) position, or no longer has one
+    void update(size_t i, bool hasPosition, int32_t lat, int32_t lon);
+
+    void remove(size_t i) { update(i, false, 0, 0); }
+
+    /// Node from moved to index to in meshNodes (whatever was at to is gone), keeping what we worked out for it
+    void move(size_t from, size_t to);
+
+    /// Our own position changed (or we lost it)
+    void setOrigin(bool hasPosition, int32_t lat, int32_t lon);
+
+    /// Distance (metres) and bearing (radians) from our own position to node i, @return false if either has no position
+    bool getDistanceAndBearing(size_t i, float &metres, float &bearing);
+
+    /// Find the nodes within metres of a point, @return how many (at most maxOut) of their indexes went in out
+    size_t findWithin(int32_t lat, int32_t lon, float metres, uint16_t *out, size_t maxOut) const;
+
+    /// Find the (at most) k nodes nearest to a point, nearest first, @return how many of their indexes went in out
+    size_t findNearest(int32_t lat, int32_t lon, size_t k, uint16_t *out) const;
+
+    /// @return roughly how many metres apart two points are (flat earth, so only good up to a few hundred km)
+    static float approxDistance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2);
+};
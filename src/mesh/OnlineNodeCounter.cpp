@@ -0,0 +1,41 @@
+#include "OnlineNodeCounter.h"
+#include <string.h>
+
+void OnlineNodeCounter::add(uint32_t lastHeard)
+{
+    uint32_t period = lastHeard / ONLINE_BUCKET_SECS;
+    Bucket &b = buckets[period % NUM_BUCKETS];
+    if (b.period != period) {
+        if (b.count && b.period > period)
+            return; // the bucket moved on to a newer period, so this node is long offline
+        b.period = period;
+        b.count = 0;
+    }
+    b.count++;
+}
+
+void OnlineNodeCounter::remove(uint32_t lastHeard)
+{
+    uint32_t period = lastHeard / ONLINE_BUCKET_SECS;
+    Bucket &b = buckets[period % NUM_BUCKETS];
+    if (b.period == period && b.count) // otherwise add() never counted it, or it dropped out when its bucket was reused
+        b.count--;
+}
+
+void OnlineNodeCounter::clear()
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+uint32_t OnlineNodeCounter::count(uint32_t now) const
+{
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < NUM_BUCKETS; i++) {
+        const Bucket &b = buckets[i];
+        // Going by the newest node a bucket could hold, those heard "in the future" (our clock is off) count as online
+        uint32_t newest = b.period * ONLINE_BUCKET_SECS + ONLINE_BUCKET_SECS - 1;
+        if (b.count && (int32_t)(now - newest) < NUM_ONLINE_SECS)
+            total += b.count;
+    }
+    return total;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/// How long since we last heard from a node before we consider it offline
+#ifndef NUM_ONLINE_SECS
+#define NUM_ONLINE_SECS (60 * 60 * 2) // 2 hrs
+#endif
+
+/// How finely we bucket last_heard, a node may stay online up to this much longer than NUM_ONLINE_SECS
+#ifndef ONLINE_BUCKET_SECS
+#define ONLINE_BUCKET_SECS (5 * 60)
+#endif
+
+/**
+ * How many nodes are online, kept up to date as nodes come, go and are heard from, so asking costs the same however big
+ * the NodeDB.
+ *
+ * Nodes are counted in buckets by their last_heard, in a ring with room for all the buckets which can still be online.  A
+ * bucket is reused for a newer period once its own nodes are long offline, so they just drop out of the count.
+ */
+class OnlineNodeCounter
+{
+    struct Bucket {
+        uint32_t period; // last_heard / ONLINE_BUCKET_SECS of the nodes in it
+        uint16_t count;
+    };
+
+    static const uint32_t NUM_BUCKETS = NUM_ONLINE_SECS / ONLINE_BUCKET_SECS + 2;
+
+    Bucket buckets[NUM_BUCKETS] = {};
+
+  public:
+    /// Count a node last heard at lastHeard
+    void add(uint32_t lastHeard);
+
+    /// Stop counting a node last heard at lastHeard (it's gone, or we heard from it again)
+    void remove(uint32_t lastHeard);
+
+    void clear();
+
+    /// @return how many of the nodes we count were heard from within NUM_ONLINE_SECS of now
+    uint32_t count(uint32_t now) const;
+};
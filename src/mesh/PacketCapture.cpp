@@ -0,0 +1,124 @@
+#include "PacketCapture.h"
+#include <string.h>
+
+bool PacketCapture::checkHeader(const uint8_t *data, size_t len)
+{
+    FileHeader h;
+    if (len < sizeof(h))
+        return false;
+    memcpy(&h, data, sizeof(h));
+    return h.magic == FILE_MAGIC && h.frameHeaderSize == sizeof(PacketHeader);
+}
+
+#if PACKET_CAPTURE
+
+#include "FSCommon.h"
+#include "concurrency/LockGuard.h"
+#include "configuration.h"
+#include <Arduino.h>
+#include <math.h>
+
+PacketCapture *packetCapture;
+
+const char *PacketCapture::fileName = "/capture.bin";
+const char *PacketCapture::oldFileName = "/capture.1.bin";
+
+// Where writing a file without truncating it appends
+#if defined(ARCH_NRF52) || defined(ARCH_STM32WL)
+#define CAPTURE_APPEND FILE_O_WRITE
+#else
+#define CAPTURE_APPEND "a"
+#endif
+
+static_assert(sizeof(PacketCapture::Record) == 8, "PacketCapture::Record has padding");
+static_assert(PACKET_CAPTURE_BUFFER >= sizeof(PacketCapture::Record) + UINT8_MAX, "PACKET_CAPTURE_BUFFER is too small");
+
+PacketCapture::PacketCapture() : concurrency::OSThread("PacketCapture")
+{
+    LOG_INFO("Capturing received frames to %s\n", fileName);
+}
+
+void PacketCapture::record(const PacketHeader &h, const uint8_t *payload, size_t payloadLen, float snr, int32_t rssi,
+                           uint32_t msec)
+{
+    size_t len = sizeof(h) + payloadLen;
+    if (len > UINT8_MAX) {
+        numDropped++;
+        return;
+    }
+
+    Record r;
+    r.msec = msec;
+    r.rssi = rssi < INT16_MIN ? INT16_MIN : (rssi > INT16_MAX ? INT16_MAX : rssi);
+    long quarters = lroundf(snr * 4);
+    r.snr = quarters < INT8_MIN ? INT8_MIN : (quarters > INT8_MAX ? INT8_MAX : quarters);
+    r.len = len;
+
+    concurrency::LockGuard g(&lock);
+    if (used + sizeof(r) + len > sizeof(buf))
+        writeOut();
+    if (!used)
+        oldestMsec = millis();
+    memcpy(buf + used, &r, sizeof(r));
+    memcpy(buf + used + sizeof(r), &h, sizeof(h));
+    memcpy(buf + used + sizeof(r) + sizeof(h), payload, payloadLen);
+    used += sizeof(r) + len;
+    numRecorded++;
+}
+
+void PacketCapture::flush()
+{
+    concurrency::LockGuard g(&lock);
+    writeOut();
+}
+
+void PacketCapture::writeOut()
+{
+    if (!used)
+        return;
+
+#ifdef FSCom
+    // Start a new file when this one is full, keeping the last one
+    bool fresh = !FSCom.exists(fileName);
+    if (!fresh) {
+        File f = FSCom.open(fileName, FILE_O_READ);
+        size_t size = f ? f.size() : 0;
+        if (f)
+            f.close();
+        if (size + used > PACKET_CAPTURE_FILE_MAX) {
+            LOG_INFO("Capture file full, moving it to %s\n", oldFileName);
+            FSCom.remove(oldFileName);
+            renameFile(fileName, oldFileName);
+            fresh = true;
+        }
+    }
+
+    File f = FSCom.open(fileName, fresh ? FILE_O_WRITE : CAPTURE_APPEND);
+    if (!f) {
+        LOG_ERROR("There was an error opening %s, dropping %u bytes of capture\n", fileName, used);
+    } else {
+        if (fresh) {
+            FileHeader h = {FILE_MAGIC, sizeof(PacketHeader)};
+            f.write((const uint8_t *)&h, sizeof(h));
+        }
+        if (f.write(buf, used) != used)
+            LOG_ERROR("Capture write failed\n");
+        f.close();
+        LOG_DEBUG("Wrote %u bytes of capture (%u frames so far, %u too long to keep)\n", used, numRecorded, numDropped);
+    }
+#endif
+    used = 0;
+}
+
+int32_t PacketCapture::runOnce()
+{
+    concurrency::LockGuard g(&lock);
+    uint32_t held = millis() - oldestMsec;
+    if (!used || held >= PACKET_CAPTURE_FLUSH_SECS * 1000) {
+        writeOut();
+        return PACKET_CAPTURE_FLUSH_SECS * 1000;
+    }
+    return PACKET_CAPTURE_FLUSH_SECS * 1000 - held;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "RadioInterface.h"
+#include "concurrency/Lock.h"
+#include "concurrency/OSThread.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Record every frame our radio hears to flash, for PacketReplay to feed through the Router again, opt in with
+/// -DPACKET_CAPTURE=1
+#ifndef PACKET_CAPTURE
+#define PACKET_CAPTURE 0
+#endif
+
+/// How much of the capture we hold in RAM before writing it out
+#ifndef PACKET_CAPTURE_BUFFER
+#define PACKET_CAPTURE_BUFFER 2048
+#endif
+
+/// And the longest we hold it
+#ifndef PACKET_CAPTURE_FLUSH_SECS
+#define PACKET_CAPTURE_FLUSH_SECS 30
+#endif
+
+/// How big a capture file grows before we start another, we keep it and the one before (so the capture is a ring on flash)
+#ifndef PACKET_CAPTURE_FILE_MAX
+#define PACKET_CAPTURE_FILE_MAX 65536
+#endif
+
+/**
+ * Packet capture, for field problems (dedupe misses, queue blowups, flood storms) we can't make happen on the bench: every
+ * frame handleReceivedPacket() gets (the parts of an aggregate frame separately) is recorded as it came off the air, header
+ * and still encrypted payload, with its RSSI, SNR and when we heard it.  Before anything looks at it, so the frames the
+ * cut-through check drops are in there too.
+ *
+ * Records are gathered in a RAM buffer and appended to /capture.bin together, like RangeTestLog, once it is full or
+ * PACKET_CAPTURE_FLUSH_SECS after the oldest of them.  When that file reaches PACKET_CAPTURE_FILE_MAX it becomes
+ * /capture.1.bin (replacing the one before) and we start again.  Download them like any other file (the web server, or a
+ * client's xmodem file transfer), and on the native build feed them back in with --replay (see PacketReplay).
+ */
+class PacketCapture : private concurrency::OSThread
+{
+  public:
+    /// What a capture file starts with, so a different layout isn't misread
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t frameHeaderSize; // sizeof(PacketHeader) of the build which wrote it
+    };
+    static const uint32_t FILE_MAGIC = 0x50435031; // "PCP1"
+
+    /// Before each frame
+    struct Record {
+        uint32_t msec; // millis() when our radio's interrupt came
+        int16_t rssi;
+        int8_t snr;  // in quarter dB
+        uint8_t len; // of the frame which follows, PacketHeader and payload
+    };
+
+    static const char *fileName, *oldFileName;
+
+    PacketCapture();
+
+    /// A frame we heard, its header and payload
+    void record(const PacketHeader &h, const uint8_t *payload, size_t payloadLen, float snr, int32_t rssi, uint32_t msec);
+
+    /// Write out whatever we're holding
+    void flush();
+
+    /// @return true if data starts with a header of a capture file we can read
+    static bool checkHeader(const uint8_t *data, size_t len);
+
+  protected:
+    virtual int32_t runOnce() override;
+
+  private:
+    uint8_t buf[PACKET_CAPTURE_BUFFER];
+    size_t used = 0;
+    uint32_t oldestMsec = 0;
+    uint32_t numRecorded = 0, numDropped = 0;
+
+    /// Our writes come from the radio's thread, our flushes from ours
+    concurrency::Lock lock;
+
+    /// Write out buf, with lock held
+    void writeOut();
+};
+
+extern PacketCapture *packetCapture;
+
+#if PACKET_CAPTURE
+#define PACKET_CAPTURE_RECORD(h, payload, len, snr, rssi, msec)                                                                  \
+    do {                                                                                                                         \
+        if (packetCapture)                                                                                                       \
+            packetCapture->record(h, payload, len, snr, rssi, msec);                                                             \
+    } while (0)
+#else
+#define PACKET_CAPTURE_RECORD(h, payload, len, snr, rssi, msec)
+#endif
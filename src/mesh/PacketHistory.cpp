@@ -4,8 +4,22 @@
 
 PacketHistory::PacketHistory()
 {
-    recentPackets.reserve(MAX_NUM_NODES); // Prealloc the worst case # of records - to prevent heap fragmentation
-                                          // setup our periodic task
+    memset(recentPackets, 0, sizeof(recentPackets)); // all slots start empty (id == 0)
+}
+
+/**
+ * Mix sender and id together so (sender, id) pairs that only differ in a few low bits don't land on neighbouring slots.
+ * This is the murmur3 finalizer, applied after folding the sender in with a golden ratio multiply.
+ */
+uint32_t PacketHistory::homeSlot(NodeNum sender, PacketId id)
+{
+    uint32_t h = (sender * 0x9E3779B1UL) ^ id;
+    h ^= h >> 16;
+    h *= 0x85EBCA6BUL;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35UL;
+    h ^= h >> 16;
+    return h & (PACKETHISTORY_MAX - 1);
 }
 
 /**
@@ -18,59 +32,138 @@ bool PacketHistory::wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpd
         return false; // Not a floodable message ID, so we don't care
     }
 
-    uint32_t now = millis();
+    bool seenRecently = wasSeenRecently(getFrom(p), p->id, withUpdate);
+    if (seenRecently) {
+        LOG_DEBUG("Found existing packet record for fr=0x%x,to=0x%x,id=0x%x\n", p->from, p->to, p->id);
+    }
+    if (withUpdate) {
+        printPacket("Add packet record", p);
+    }
+    return seenRecently;
+}
+
+bool PacketHistory::wasSeenRecently(NodeNum sender, PacketId id, bool withUpdate)
+{
+    return wasSeenRecently(sender, id, withUpdate, millis());
+}
 
-    PacketRecord r;
-    r.id = p->id;
-    r.sender = getFrom(p);
-    r.rxTimeMsec = now;
+bool PacketHistory::wasSeenRecently(NodeNum sender, PacketId id, bool withUpdate, uint32_t now)
+{
+    if (id == 0)
+        return false; // Not a floodable message ID, so we don't care
 
-    auto found = recentPackets.find(r);
-    bool seenRecently = (found != recentPackets.end()); // found not equal to .end() means packet was seen recently
+    expireSome(now);
 
-    if (seenRecently && (now - found->rxTimeMsec) >= FLOOD_EXPIRE_TIME) { // Check whether found packet has already expired
-        recentPackets.erase(found);                                       // Erase and pretend packet has not been seen recently
-        found = recentPackets.end();
-        seenRecently = false;
-    }
+    uint32_t home = homeSlot(sender, id);
+    for (uint32_t n = 0; n < MAX_PROBES; n++) {
+        PacketRecord &r = recentPackets[(home + n) & (PACKETHISTORY_MAX - 1)];
 
-    if (seenRecently) {
-        LOG_DEBUG("Found existing packet record for fr=0x%x,to=0x%x,id=0x%x\n", p->from, p->to, p->id);
+        // Records are never stored past an empty slot in their probe run, so it isn't in the table
+        if (isEmpty(r))
+            break;
+
+        if (r.sender == sender && r.id == id) {
+            // An expired record is treated as not seen, the sweep just hasn't got to it yet
+            bool seenRecently = (now - r.rxTimeMsec) < FLOOD_EXPIRE_TIME;
+            if (withUpdate)
+                r.rxTimeMsec = now; // update in place
+            return seenRecently;
+        }
     }
 
     if (withUpdate) {
-        if (found != recentPackets.end()) { // delete existing to updated timestamp (re-insert)
-            recentPackets.erase(found);     // as unsorted_set::iterator is const (can't update timestamp - so re-insert..)
-        }
-        recentPackets.insert(r);
-        printPacket("Add packet record", p);
+        if (numRecords >= PACKETHISTORY_MAX_RECORDS)
+            dropOne(now); // before we look for a slot, it may move records about
+        insert(sender, id, now);
     }
+    return false;
+}
 
-    // Capacity is reerved, so only purge expired packets if recentPackets fills past 90% capacity
-    // Expiry is normally dealt with after having searched/found a packet (above)
-    if (recentPackets.size() > (MAX_NUM_NODES * 0.9)) {
-        clearExpiredRecentPackets();
+void PacketHistory::insert(NodeNum sender, PacketId id, uint32_t now)
+{
+    uint32_t home = homeSlot(sender, id);
+    uint32_t slot = home, oldestAge = 0;
+    bool found = false;
+    for (uint32_t n = 0; n < MAX_PROBES; n++) {
+        uint32_t i = (home + n) & (PACKETHISTORY_MAX - 1);
+        const PacketRecord &r = recentPackets[i];
+        if (isEmpty(r)) {
+            slot = i;
+            found = true;
+            break;
+        }
+        uint32_t age = now - r.rxTimeMsec;
+        if (age > oldestAge) {
+            oldestAge = age;
+            slot = i;
+        }
     }
 
-    return seenRecently;
+    // If our whole probe window is taken, recycle the oldest record in it
+    if (found)
+        numRecords++;
+    PacketRecord &r = recentPackets[slot];
+    r.sender = sender;
+    r.id = id;
+    r.rxTimeMsec = now;
 }
 
 /**
- * Iterate through all recent packets, and remove all older than FLOOD_EXPIRE_TIME
+ * Remove the record in slot i.  With linear probing we can't just clear the slot (that would hide any records that probed
+ * past it), so we walk the rest of the run and move back each record which is allowed to live in the hole.
  */
-void PacketHistory::clearExpiredRecentPackets()
+void PacketHistory::removeSlot(uint32_t i)
 {
-    uint32_t now = millis();
+    const uint32_t mask = PACKETHISTORY_MAX - 1;
 
-    LOG_DEBUG("recentPackets size=%ld\n", recentPackets.size());
+    // The hole is always empty, so however full the table is we stop once we come round to it
+    memset(&recentPackets[i], 0, sizeof(recentPackets[i]));
+    numRecords--;
+    for (uint32_t j = (i + 1) & mask, n = 1; n < PACKETHISTORY_MAX && !isEmpty(recentPackets[j]); j = (j + 1) & mask, n++) {
+        uint32_t k = homeSlot(recentPackets[j].sender, recentPackets[j].id);
 
-    for (auto it = recentPackets.begin(); it != recentPackets.end();) {
-        if ((now - it->rxTimeMsec) >= FLOOD_EXPIRE_TIME) {
-            it = recentPackets.erase(it); // erase returns iterator pointing to element immediately following the one erased
-        } else {
-            ++it;
+        // If the record at j has its home cyclically in (i, j] it must stay where it is
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            recentPackets[i] = recentPackets[j];
+            memset(&recentPackets[j], 0, sizeof(recentPackets[j]));
+            i = j;
         }
     }
+}
+
+/**
+ * Check a few slots at our sweep cursor and drop any records older than FLOOD_EXPIRE_TIME.  Called on every lookup, so the
+ * whole table is swept every PACKETHISTORY_MAX / EXPIRE_PER_LOOKUP packets without ever doing a full pass at once.
+ */
+void PacketHistory::expireSome(uint32_t now)
+{
+    for (uint32_t n = 0; n < EXPIRE_PER_LOOKUP; n++) {
+        const PacketRecord &r = recentPackets[expireCursor];
+
+        if (!isEmpty(r) && (now - r.rxTimeMsec) >= FLOOD_EXPIRE_TIME)
+            removeSlot(expireCursor); // a later record might have moved into this slot, so check it again next time
+        else
+            expireCursor = (expireCursor + 1) & (PACKETHISTORY_MAX - 1);
+    }
+}
 
-    LOG_DEBUG("recentPackets size=%ld (after clearing expired packets)\n", recentPackets.size());
-}
\ No newline at end of file
+void PacketHistory::dropOne(uint32_t now)
+{
+    // The oldest record in the next few slots from our sweep cursor (further if they're all empty), so what we drop is
+    // never much newer than it must be
+    const uint32_t mask = PACKETHISTORY_MAX - 1;
+    uint32_t oldest = 0, oldestAge = 0;
+    bool found = false;
+    for (uint32_t n = 0; n < PACKETHISTORY_MAX && (!found || n < 2 * MAX_PROBES); n++) {
+        uint32_t i = (expireCursor + n) & mask;
+        const PacketRecord &r = recentPackets[i];
+        if (!isEmpty(r) && (!found || now - r.rxTimeMsec > oldestAge)) {
+            oldest = i;
+            oldestAge = now - r.rxTimeMsec;
+            found = true;
+        }
+    }
+    if (found)
+        removeSlot(oldest);
+}
@@ -1,11 +1,20 @@
 #pragma once
 
 #include "Router.h"
-#include <unordered_set>
 
 /// We clear our old flood record 10 minutes after we see the last of it
 #define FLOOD_EXPIRE_TIME (10 * 60 * 1000L)
 
+/// Number of slots in our history table, must be a power of two.  Independent of MAX_NUM_NODES because busy meshes see many
+/// more packets per FLOOD_EXPIRE_TIME than they have nodes, variants with lots of RAM can raise this.
+#ifndef PACKETHISTORY_MAX
+#define PACKETHISTORY_MAX 256
+#endif
+
+/// The most records we keep at once.  Below PACKETHISTORY_MAX, so probe runs stay short and removeSlot() always has an
+/// empty slot to stop at; past it we make room by dropping the oldest record near our expiry sweep
+#define PACKETHISTORY_MAX_RECORDS (PACKETHISTORY_MAX - PACKETHISTORY_MAX / 4)
+
 /**
  * A record of a recent message broadcast
  */
@@ -17,21 +26,47 @@ struct PacketRecord {
     bool operator==(const PacketRecord &p) const { return sender == p.sender && id == p.id; }
 };
 
-class PacketRecordHashFunction
-{
-  public:
-    size_t operator()(const PacketRecord &p) const { return (std::hash<NodeNum>()(p.sender)) ^ (std::hash<PacketId>()(p.id)); }
-};
-
 /**
  * This is a mixin that adds a record of past packets we have seen
+ *
+ * Records live in a fixed size open addressing (linear probing) table, so we never allocate and a lookup only touches a few
+ * neighbouring slots.  Rather than periodically sweeping the whole table, every lookup also expires a few slots at a sweep
+ * cursor, so old records age out without ever stalling the RX path.
  */
 class PacketHistory
 {
   private:
-    std::unordered_set<PacketRecord, PacketRecordHashFunction> recentPackets;
+    static_assert((PACKETHISTORY_MAX & (PACKETHISTORY_MAX - 1)) == 0, "PACKETHISTORY_MAX must be a power of two");
+
+    /// A record is never more than this many slots from its home slot, if they are all taken we replace the oldest
+    static const uint32_t MAX_PROBES = 16;
+
+    /// How many slots we check for expiry on each lookup
+    static const uint32_t EXPIRE_PER_LOOKUP = 2;
+
+    PacketRecord recentPackets[PACKETHISTORY_MAX];
+
+    /// Where our incremental expiry sweep is up to
+    uint32_t expireCursor = 0;
+
+    /// How many of recentPackets hold records, never more than PACKETHISTORY_MAX_RECORDS
+    uint32_t numRecords = 0;
 
-    void clearExpiredRecentPackets(); // clear all recentPackets older than FLOOD_EXPIRE_TIME
+    static uint32_t homeSlot(NodeNum sender, PacketId id);
+
+    static bool isEmpty(const PacketRecord &r) { return r.id == 0; } // we never store records with a zero id
+
+    /// Remove the record in slot i, moving any later records in its probe run back so lookups still find them
+    void removeSlot(uint32_t i);
+
+    /// Expire a few slots, starting at our sweep cursor
+    void expireSome(uint32_t now);
+
+    /// Drop the oldest record near our sweep cursor, however new, to keep under PACKETHISTORY_MAX_RECORDS
+    void dropOne(uint32_t now);
+
+    /// Store a record we didn't find, in its probe run
+    void insert(NodeNum sender, PacketId id, uint32_t now);
 
   public:
     PacketHistory();
@@ -42,4 +77,15 @@ class PacketHistory
      * @param withUpdate if true and not found we add an entry to recentPackets
      */
     bool wasSeenRecently(const meshtastic_MeshPacket *p, bool withUpdate = true);
+
+    /**
+     * Like wasSeenRecently(p) but for callers who only have the sender and id (i.e. a raw packet header)
+     */
+    bool wasSeenRecently(NodeNum sender, PacketId id, bool withUpdate = true);
+
+    /// Like wasSeenRecently(sender, id, withUpdate), at now (by millis())
+    bool wasSeenRecently(NodeNum sender, PacketId id, bool withUpdate, uint32_t now);
+
+    /// @return how many records we hold
+    uint32_t getNumRecords() const { return numRecords; }
 };
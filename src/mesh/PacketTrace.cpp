@@ -0,0 +1,132 @@
+#include "PacketTrace.h"
+
+#if PACKET_TRACE
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+PacketTrace packetTrace;
+
+static const char *pointNames[PacketTrace::NUM_POINTS] = {"rx_isr",    "rx_dequeue", "rx_decoded", "rx_handled",
+                                                          "to_phone",  "tx_enqueue", "tx_start",   "tx_done"};
+
+const char *PacketTrace::getPointName(Point p)
+{
+    return pointNames[p];
+}
+
+PacketTrace::Trace *PacketTrace::find(NodeNum from, PacketId id)
+{
+    // Newest first, a packet is usually still on its way through when we hear of it again
+    for (uint8_t n = 0; n < numTraces; n++) {
+        Trace &t = traces[(next + PACKET_TRACE_SIZE - 1 - n) % PACKET_TRACE_SIZE];
+        if (t.from == from && t.id == id)
+            return &t;
+    }
+    return NULL;
+}
+
+void PacketTrace::begin(NodeNum from, PacketId id, Point p, uint32_t msec)
+{
+    if (!from || !id)
+        return; // nothing we could find it by again (an aggregate frame, a simple broadcast)
+
+    Trace *t = find(from, id);
+    if (!t) {
+        t = &traces[next];
+        next = (next + 1) % PACKET_TRACE_SIZE;
+        if (numTraces < PACKET_TRACE_SIZE)
+            numTraces++;
+        memset(t, 0, sizeof(*t));
+        t->from = from;
+        t->id = id;
+    }
+    t->atMsec[p] = msec ? msec : 1; // 0 means we never got there
+    if (p == TX_ENQUEUE) {
+        t->atMsec[TX_START] = t->atMsec[TX_DONE] = 0; // from a send before this one
+        t->numSends++;
+    }
+}
+
+void PacketTrace::mark(NodeNum from, PacketId id, Point p)
+{
+    if (p == TX_ENQUEUE) {
+        begin(from, id, p, millis());
+        return;
+    }
+    Trace *t = find(from, id);
+    if (t) {
+        uint32_t now = millis();
+        t->atMsec[p] = now ? now : 1;
+    }
+}
+
+/// @return the first point t got to, NUM_POINTS if none
+static uint8_t firstPoint(const PacketTrace::Trace &t)
+{
+    uint8_t first = 0;
+    while (first < PacketTrace::NUM_POINTS && !t.atMsec[first])
+        first++;
+    return first;
+}
+
+bool PacketTrace::getSummaryLine(uint8_t line, char *buf, size_t bufLen) const
+{
+    size_t len;
+    if (line < numTraces) {
+        // the msecs from the first point it got to, to each of the others
+        const Trace &t = traces[(next + PACKET_TRACE_SIZE - 1 - line) % PACKET_TRACE_SIZE];
+        uint8_t first = firstPoint(t);
+        len = snprintf(buf, bufLen, "%08x/%08x", t.from, t.id);
+        for (uint8_t i = 0; i < NUM_POINTS && len < bufLen; i++) {
+            char sep = i ? ',' : ' ';
+            if (t.atMsec[i])
+                len += snprintf(buf + len, bufLen - len, "%c+%u", sep, t.atMsec[i] - t.atMsec[first]);
+            else
+                len += snprintf(buf + len, bufLen - len, "%c-", sep);
+        }
+        if (t.numSends > 1 && len < bufLen)
+            snprintf(buf + len, bufLen - len, " x%u", t.numSends);
+        return true;
+    }
+
+    if (line == numTraces) {
+        // the same, averaged over every trace which got to each point
+        len = snprintf(buf, bufLen, "avg n=%u", numTraces);
+        for (uint8_t i = 0; i < NUM_POINTS && len < bufLen; i++) {
+            uint32_t total = 0, n = 0;
+            for (uint8_t j = 0; j < numTraces; j++) {
+                const Trace &t = traces[j];
+                if (t.atMsec[i]) {
+                    total += t.atMsec[i] - t.atMsec[firstPoint(t)];
+                    n++;
+                }
+            }
+            char sep = i ? ',' : ' ';
+            if (n)
+                len += snprintf(buf + len, bufLen - len, "%c+%u", sep, total / n);
+            else
+                len += snprintf(buf + len, bufLen - len, "%c-", sep);
+        }
+        if (len < bufLen)
+            snprintf(buf + len, bufLen - len, "ms");
+        return true;
+    }
+
+    return false;
+}
+
+void PacketTrace::log() const
+{
+    char line[96];
+    size_t len = 0;
+    for (uint8_t i = 0; i < NUM_POINTS; i++)
+        len += snprintf(line + len, sizeof(line) - len, "%s%s", i ? "," : "", pointNames[i]);
+    LOG_DEBUG("Packet traces (from/id, msec from the first point to %s)\n", line);
+
+    for (uint8_t i = 0; getSummaryLine(i, line, sizeof(line)); i++)
+        LOG_DEBUG("Trace %s\n", line);
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Keep when each packet we handle passed each point of our packet path, opt in with -DPACKET_TRACE=1
+#ifndef PACKET_TRACE
+#define PACKET_TRACE 0
+#endif
+
+/// How many packets we keep the traces of, the oldest are overwritten
+#ifndef PACKET_TRACE_SIZE
+#define PACKET_TRACE_SIZE 32
+#endif
+
+/**
+ * Per packet latency tracing, for when "messages take 30s" and we need to know which part of our packet path that went to.
+ * RadioStats has the histograms of each stage over all packets, this follows single packets (by sender and id) from point
+ * to point: the radio's interrupt, out of the Router's queue, decoded, through the modules, downloaded by a phone, into our
+ * TX queue, on the air and done.  A packet we retransmit goes through the TX points again, we keep the last and count them.
+ *
+ * The traces are in a fixed ring (PACKET_TRACE_SIZE of them, nothing is allocated), logged with each airtime period and
+ * sent to the phone as log records like RadioStats.  Packets we sent inside an aggregate frame stop at TX_ENQUEUE.
+ */
+class PacketTrace
+{
+  public:
+    enum Point {
+        RX_ISR,      // our radio's interrupt for it
+        RX_DEQUEUE,  // out of the Router's fromRadioQueue
+        RX_DECODED,  // decrypted and decoded
+        RX_HANDLED,  // all our modules have had it
+        TO_PHONE,    // a phone downloaded it
+        TX_ENQUEUE,  // into our TX queue
+        TX_START,    // we started sending it, after the contention window
+        TX_DONE,     // the radio finished sending it
+        NUM_POINTS
+    };
+
+    struct Trace {
+        NodeNum from; // 0 for an unused trace
+        PacketId id;
+        uint32_t atMsec[NUM_POINTS]; // millis() at each point, 0 if it never got there
+        uint8_t numSends;
+    };
+
+    /// A new packet passed point p, at msec (for RX_ISR, when the interrupt came)
+    void begin(NodeNum from, PacketId id, Point p, uint32_t msec);
+
+    /// A packet we may be tracing passed point p.  TX_ENQUEUE begins a trace if we don't have one
+    void mark(NodeNum from, PacketId id, Point p);
+
+    static const char *getPointName(Point p);
+
+    /// One line per trace, newest first, then one for the average time between points
+    uint8_t getNumLines() const { return numTraces + 1; }
+
+    /// Like RadioStats::getSummaryLine().  @return false if there is no such line
+    bool getSummaryLine(uint8_t line, char *buf, size_t bufLen) const;
+
+    void log() const;
+
+  private:
+    Trace traces[PACKET_TRACE_SIZE] = {};
+    uint8_t next = 0, numTraces = 0;
+
+    Trace *find(NodeNum from, PacketId id);
+};
+
+extern PacketTrace packetTrace;
+
+#if PACKET_TRACE
+#define PACKET_TRACE_BEGIN(from, id, point, msec) packetTrace.begin(from, id, PacketTrace::point, msec)
+#define PACKET_TRACE_MARK(from, id, point) packetTrace.mark(from, id, PacketTrace::point)
+#else
+#define PACKET_TRACE_BEGIN(from, id, point, msec)
+#define PACKET_TRACE_MARK(from, id, point)
+#endif
@@ -0,0 +1,126 @@
+#include "PayloadCompression.h"
+#include "configuration.h"
+#include <string.h>
+
+extern "C" {
+#include "mesh/compression/unishox2.h"
+}
+
+#if !UNISHOX_API_WITH_OUTPUT_LEN
+#error "Build unishox2 with -DUNISHOX_API_WITH_OUTPUT_LEN=1, we expand payloads from the air with it"
+#endif
+
+PayloadCompression payloadCompression;
+
+// USX_PSET_DFLT (what the _simple API uses), spelled out as C++ has no compound literals
+static const unsigned char usxHcodes[] = {0x00, 0x40, 0x80, 0xC0, 0xE0};
+static const unsigned char usxHcodeLens[] = {2, 2, 2, 3, 3};
+static const char *usxFreqSeq[] = {"\": \"", "\": ", "</", "=\"", "\":\"", "://"};
+static const char *usxTemplates[] = {"tfff-of-tfTtf:rf:rf.fffZ", "tfff-of-tf", "(fff) fff-ffff", "tf:rf:rf", 0};
+
+// With an output length unishox2 returns more than it (olen + 1) rather than write past it
+int unishoxCompress(const char *in, size_t inLen, char *out, size_t outLen)
+{
+    if (inLen > meshtastic_Constants_DATA_PAYLOAD_LEN || !outLen)
+        return -1;
+    int len = unishox2_compress(in, inLen, out, outLen, usxHcodes, usxHcodeLens, usxFreqSeq, usxTemplates);
+    return (len < 0 || (size_t)len > outLen) ? -1 : len;
+}
+
+int unishoxDecompress(const char *in, size_t inLen, char *out, size_t outLen)
+{
+    if (!outLen)
+        return -1;
+    int len = unishox2_decompress(in, inLen, out, outLen, usxHcodes, usxHcodeLens, usxFreqSeq, usxTemplates);
+    return (len < 0 || (size_t)len > outLen) ? -1 : len;
+}
+
+static int compressText(const meshtastic_MeshPacket &, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return unishoxCompress((const char *)in, inLen, (char *)out, outLen);
+}
+
+static int decompressText(const meshtastic_MeshPacket &, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return unishoxDecompress((const char *)in, inLen, (char *)out, outLen);
+}
+
+PayloadCompression::PayloadCompression()
+{
+    add({meshtastic_PortNum_TEXT_MESSAGE_APP, meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP, "unishox2", compressText,
+         decompressText});
+}
+
+bool PayloadCompression::add(const PayloadCodec &codec)
+{
+    if (numCodecs >= MAX_PAYLOAD_CODECS || codec.portNum == codec.compressedPortNum || findByPortNum(codec.portNum) ||
+        findByCompressedPortNum(codec.compressedPortNum) || findByPortNum(codec.compressedPortNum) ||
+        findByCompressedPortNum(codec.portNum))
+        return false;
+
+    codecs[numCodecs++] = codec;
+    return true;
+}
+
+const PayloadCodec *PayloadCompression::findByPortNum(meshtastic_PortNum portnum) const
+{
+    for (size_t i = 0; i < numCodecs; i++)
+        if (codecs[i].portNum == portnum)
+            return &codecs[i];
+    return NULL;
+}
+
+const PayloadCodec *PayloadCompression::findByCompressedPortNum(meshtastic_PortNum portnum) const
+{
+    for (size_t i = 0; i < numCodecs; i++)
+        if (codecs[i].compressedPortNum == portnum)
+            return &codecs[i];
+    return NULL;
+}
+
+size_t PayloadCompression::perhapsCompress(meshtastic_MeshPacket &p)
+{
+    meshtastic_Data &d = p.decoded;
+    const PayloadCodec *codec = findByPortNum(d.portnum);
+    if (!codec || d.payload.size == 0 || (!PAYLOAD_COMPRESSION && codec->portNum == meshtastic_PortNum_TEXT_MESSAGE_APP))
+        return 0;
+
+    uint8_t compressed[sizeof(d.payload.bytes)];
+    // Only worth it if we actually come out smaller
+    int len = codec->compress(p, d.payload.bytes, d.payload.size, compressed, d.payload.size - 1);
+    if (len < 0) {
+        LOG_DEBUG("%s: not compressing %d bytes on port %d\n", codec->name, d.payload.size, d.portnum);
+        return 0;
+    }
+
+    size_t saved = d.payload.size - len;
+    memcpy(d.payload.bytes, compressed, len);
+    d.payload.size = len;
+    d.portnum = codec->compressedPortNum;
+
+    bytesSaved += saved;
+    numCompressed++;
+    LOG_DEBUG("%s: compressed to %d bytes, saved %u (%u in %u packets since boot)\n", codec->name, len, (unsigned)saved, bytesSaved,
+              numCompressed);
+    return saved;
+}
+
+bool PayloadCompression::perhapsDecompress(meshtastic_MeshPacket &p)
+{
+    meshtastic_Data &d = p.decoded;
+    const PayloadCodec *codec = findByCompressedPortNum(d.portnum);
+    if (!codec)
+        return true;
+
+    uint8_t expanded[sizeof(d.payload.bytes)];
+    int len = codec->decompress(p, d.payload.bytes, d.payload.size, expanded, sizeof(expanded));
+    if (len < 0) {
+        LOG_WARN("%s: can't decompress %d bytes on port %d\n", codec->name, d.payload.size, d.portnum);
+        return false;
+    }
+
+    memcpy(d.payload.bytes, expanded, len);
+    d.payload.size = len;
+    d.portnum = codec->portNum;
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "mesh/generated/meshtastic/mesh.pb.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Compress the payloads we send with their portnum's codec.  Off by default, so what we send is what older firmware
+/// expects, we always expand what we receive.  Codecs registered by modules (TAK, positions) don't need this.
+#ifndef PAYLOAD_COMPRESSION
+#define PAYLOAD_COMPRESSION 0
+#endif
+
+/// The most codecs anyone can register, the table is fixed size so registering never allocates
+#ifndef MAX_PAYLOAD_CODECS
+#define MAX_PAYLOAD_CODECS 8
+#endif
+
+/**
+ * A way of shrinking the payload of one portnum before it goes out over the mesh.
+ *
+ * The compressed form is sent as compressedPortNum rather than portNum - that is the flag on the wire which tells receivers
+ * to expand it, and nodes which don't have the codec just see a portnum they don't handle (rather than garbage on portNum).
+ * Both ends must of course agree on the codec (and any dictionary it was trained with) for a given compressedPortNum.
+ */
+struct PayloadCodec {
+    meshtastic_PortNum portNum;
+    meshtastic_PortNum compressedPortNum;
+
+    /// For debug output
+    const char *name;
+
+    /**
+     * Compress inLen bytes from in (p's payload) to out, which has room for outLen bytes.  p is there for codecs which keep
+     * state per sender or channel (its from and channel index are set), which they should only change when they succeed.
+     * @return the compressed length, or -1 if this payload can't be compressed (or wouldn't fit)
+     */
+    int (*compress)(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+
+    /**
+     * Expand a payload made by compress(), which arrived in p (whose channel is an index by now).
+     * @return the original length, or -1 if the payload was invalid (or wouldn't fit in outLen)
+     */
+    int (*decompress)(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+};
+
+/**
+ * The registry of PayloadCodecs, used by the Router as it encodes and decodes packets.  Unishox2 compression of text
+ * messages is built in, modules can add codecs for their own portnums from their constructor or setup().
+ */
+class PayloadCompression
+{
+    PayloadCodec codecs[MAX_PAYLOAD_CODECS];
+    size_t numCodecs = 0;
+
+    /// Debugging counts
+    uint32_t bytesSaved = 0, numCompressed = 0;
+
+  public:
+    PayloadCompression();
+
+    /**
+     * Add a codec.
+     * @return false if the table is full or portNum/compressedPortNum are already taken by another codec
+     */
+    bool add(const PayloadCodec &codec);
+
+    /** @return the codec for sending portnum, or NULL if none */
+    const PayloadCodec *findByPortNum(meshtastic_PortNum portnum) const;
+
+    /** @return the codec for received packets on compressed portnum, or NULL if none */
+    const PayloadCodec *findByCompressedPortNum(meshtastic_PortNum portnum) const;
+
+    /**
+     * If there is a codec for p's portnum and it makes the payload smaller, replace the payload (and portnum) with the
+     * compressed form.  Text messages only with PAYLOAD_COMPRESSION.
+     * @return the number of bytes saved (0 if we left p alone)
+     */
+    size_t perhapsCompress(meshtastic_MeshPacket &p);
+
+    /**
+     * If p arrived on a compressed portnum expand it in place and restore the original portnum.
+     * @return false if p needed decompressing but it failed (p is left untouched)
+     */
+    bool perhapsDecompress(meshtastic_MeshPacket &p);
+
+    /// Total payload bytes we have kept off the air since boot
+    uint32_t getBytesSaved() const { return bytesSaved; }
+};
+
+extern PayloadCompression payloadCompression;
+
+/// unishox2 with its default presets, never writing more than outLen bytes to out (whatever is in in, which may have come
+/// off the air).  @return the length, or -1 if in was invalid or the result wouldn't fit
+int unishoxCompress(const char *in, size_t inLen, char *out, size_t outLen);
+
+/// Like unishoxCompress(), the other way
+int unishoxDecompress(const char *in, size_t inLen, char *out, size_t outLen);
@@ -1,14 +1,23 @@
 #include "PhoneAPI.h"
+#include "BootTimeline.h"
 #include "Channels.h"
+#include "EnergyStats.h"
 #include "GPS.h"
 #include "MeshService.h"
 #include "NodeDB.h"
+#include "PacketTrace.h"
 #include "PowerFSM.h"
+#include "RTC.h"
 #include "RadioInterface.h"
+#include "RadioStats.h"
 #include "TypeConversions.h"
+#include "concurrency/LockGuard.h"
+#include "concurrency/OSThread.h"
 #include "configuration.h"
 #include "main.h"
+#include "memGet.h"
 #include "xmodem.h"
+#include <ErriezCRC32.h>
 
 #if FromRadio_size > MAX_TO_FROM_RADIO_SIZE
 #error FromRadio is too big
@@ -20,7 +29,29 @@
 
 #include "mqtt/MQTT.h"
 
-PhoneAPI::PhoneAPI()
+#ifdef ARCH_PORTDUINO
+#include "platform/portduino/SpidevHal.h"
+#endif
+
+/// Where each part of the config phase starts in our configFrames
+#define NUM_CONFIG_FRAMES (_meshtastic_AdminMessage_ConfigType_MAX - _meshtastic_AdminMessage_ConfigType_MIN + 1)
+#define NUM_MODULECONFIG_FRAMES                                                                                                  \
+    (_meshtastic_AdminMessage_ModuleConfigType_MAX - _meshtastic_AdminMessage_ModuleConfigType_MIN + 1)
+#define CONFIG_FRAMES_CONFIG MAX_NUM_CHANNELS
+#define CONFIG_FRAMES_MODULECONFIG (CONFIG_FRAMES_CONFIG + NUM_CONFIG_FRAMES)
+#define NUM_CONFIG_PHASE_FRAMES (CONFIG_FRAMES_MODULECONFIG + NUM_MODULECONFIG_FRAMES)
+
+uint32_t PhoneAPI::configGeneration = 1;
+
+meshtastic_FromRadio PhoneAPI::fromRadioScratch;
+concurrency::Lock PhoneAPI::fromRadioLock;
+meshtastic_ToRadio PhoneAPI::toRadioScratch;
+concurrency::Lock PhoneAPI::toRadioLock;
+
+PhoneAPI::SyncPoint PhoneAPI::syncPoints[PHONEAPI_SYNC_POINTS];
+uint8_t PhoneAPI::nextSyncPoint;
+
+PhoneAPI::PhoneAPI() : Observer<uint32_t>(observerLinks.get(), 1)
 {
     lastContactMsec = millis();
 }
@@ -28,6 +59,7 @@ PhoneAPI::PhoneAPI()
 PhoneAPI::~PhoneAPI()
 {
     close();
+    unobserveAll(); // while observerLinks still exist
 }
 
 void PhoneAPI::handleStartConfig()
@@ -37,14 +69,52 @@ void PhoneAPI::handleStartConfig()
         onConnectionChanged(true);
         observe(&service.fromNumChanged);
         observe(&xModem.packetReady);
+        service.addPhoneReader(&toPhoneReader);
     }
 
     // even if we were already connected - restart our state machine
     state = STATE_SEND_MY_INFO;
 
     LOG_INFO("Starting API client config\n");
-    nodeInfoForPhone.num = 0; // Don't keep returning old nodeinfos
+    nodeNumForPhone = 0; // Don't keep returning old nodeinfos
     resetReadIndex();
+    startNodeSync();
+    refreshConfigFrames();
+}
+
+void PhoneAPI::startNodeSync()
+{
+    syncStartGeneration = nodeDB.getNodeGeneration();
+    syncMinGeneration = 0;
+    sendForgetAllNodes = false;
+    if ((config_nonce & PHONEAPI_SYNC_NONCE_MASK) != PHONEAPI_SYNC_NONCE_TAG)
+        return;
+
+    for (const SyncPoint &s : syncPoints) {
+        if (s.nonce == config_nonce && nodeDB.canSyncSince(s.generation)) {
+            syncMinGeneration = s.generation + 1;
+            LOG_INFO("Sending the nodes changed since generation %u (now %u)\n", s.generation, syncStartGeneration);
+            return;
+        }
+    }
+    LOG_INFO("Can't sync nodes incrementally from nonce=%u, sending them all\n", config_nonce);
+    sendForgetAllNodes = true;
+}
+
+void PhoneAPI::saveSyncPoint()
+{
+    if ((config_nonce & PHONEAPI_SYNC_NONCE_MASK) != PHONEAPI_SYNC_NONCE_TAG)
+        return;
+
+    SyncPoint *save = NULL;
+    for (SyncPoint &s : syncPoints)
+        if (s.nonce == config_nonce)
+            save = &s; // this client syncing again, replace its old one
+    if (!save) {
+        save = &syncPoints[nextSyncPoint];
+        nextSyncPoint = (nextSyncPoint + 1) % PHONEAPI_SYNC_POINTS;
+    }
+    *save = SyncPoint{config_nonce, syncStartGeneration};
 }
 
 void PhoneAPI::close()
@@ -54,7 +124,10 @@ void PhoneAPI::close()
 
         unobserve(&service.fromNumChanged);
         unobserve(&xModem.packetReady);
-        releasePhonePacket(); // Don't leak phone packets on shutdown
+        service.removePhoneReader(&toPhoneReader);
+        toPhoneReader.filter.clear(); // the next client sets its own
+        if (toPhoneReader.overruns)
+            LOG_WARN("Client missed %u packets, it didn't keep up\n", toPhoneReader.overruns);
         releaseQueueStatusPhonePacket();
         releaseMqttClientProxyPhonePacket();
 
@@ -85,6 +158,7 @@ bool PhoneAPI::handleToRadio(const uint8_t *buf, size_t bufLength)
 
     // return (lastContactMsec != 0) &&
 
+    concurrency::LockGuard g(&toRadioLock);
     memset(&toRadioScratch, 0, sizeof(toRadioScratch));
     if (pb_decode_from_bytes(buf, bufLength, &meshtastic_ToRadio_msg, &toRadioScratch)) {
         switch (toRadioScratch.which_payload_variant) {
@@ -121,6 +195,165 @@ bool PhoneAPI::handleToRadio(const uint8_t *buf, size_t bufLength)
     return false;
 }
 
+/// Fill in the FromRadio for one of our channels, as the config phase sends them
+static void fillChannelFrame(meshtastic_FromRadio &f, uint8_t index)
+{
+    f.which_payload_variant = meshtastic_FromRadio_channel_tag;
+    f.channel = channels.getByIndex(index);
+}
+
+/// Fill in the FromRadio for one type of config (a meshtastic_Config payload tag)
+static void fillConfigFrame(meshtastic_FromRadio &f, uint8_t type)
+{
+    f.which_payload_variant = meshtastic_FromRadio_config_tag;
+    switch (type) {
+    case meshtastic_Config_device_tag:
+        f.config.which_payload_variant = meshtastic_Config_device_tag;
+        f.config.payload_variant.device = config.device;
+        break;
+    case meshtastic_Config_position_tag:
+        f.config.which_payload_variant = meshtastic_Config_position_tag;
+        f.config.payload_variant.position = config.position;
+        break;
+    case meshtastic_Config_power_tag:
+        f.config.which_payload_variant = meshtastic_Config_power_tag;
+        f.config.payload_variant.power = config.power;
+        f.config.payload_variant.power.ls_secs = default_ls_secs;
+        break;
+    case meshtastic_Config_network_tag:
+        f.config.which_payload_variant = meshtastic_Config_network_tag;
+        f.config.payload_variant.network = config.network;
+        break;
+    case meshtastic_Config_display_tag:
+        f.config.which_payload_variant = meshtastic_Config_display_tag;
+        f.config.payload_variant.display = config.display;
+        break;
+    case meshtastic_Config_lora_tag:
+        f.config.which_payload_variant = meshtastic_Config_lora_tag;
+        f.config.payload_variant.lora = config.lora;
+        break;
+    case meshtastic_Config_bluetooth_tag:
+        f.config.which_payload_variant = meshtastic_Config_bluetooth_tag;
+        f.config.payload_variant.bluetooth = config.bluetooth;
+        break;
+    default:
+        LOG_ERROR("Unknown config type %d\n", type);
+    }
+    // NOTE: The phone app needs to know the ls_secs value so it can properly expect sleep behavior.
+    // So even if we internally use 0 to represent 'use default' we still need to send the value we are
+    // using to the app (so that even old phone apps work with new device loads).
+}
+
+/// Fill in the FromRadio for one type of module config (a meshtastic_ModuleConfig payload tag)
+static void fillModuleConfigFrame(meshtastic_FromRadio &f, uint8_t type)
+{
+    f.which_payload_variant = meshtastic_FromRadio_moduleConfig_tag;
+    switch (type) {
+    case meshtastic_ModuleConfig_mqtt_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_mqtt_tag;
+        f.moduleConfig.payload_variant.mqtt = moduleConfig.mqtt;
+        break;
+    case meshtastic_ModuleConfig_serial_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_serial_tag;
+        f.moduleConfig.payload_variant.serial = moduleConfig.serial;
+        break;
+    case meshtastic_ModuleConfig_external_notification_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_external_notification_tag;
+        f.moduleConfig.payload_variant.external_notification = moduleConfig.external_notification;
+        break;
+    case meshtastic_ModuleConfig_store_forward_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_store_forward_tag;
+        f.moduleConfig.payload_variant.store_forward = moduleConfig.store_forward;
+        break;
+    case meshtastic_ModuleConfig_range_test_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_range_test_tag;
+        f.moduleConfig.payload_variant.range_test = moduleConfig.range_test;
+        break;
+    case meshtastic_ModuleConfig_telemetry_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_telemetry_tag;
+        f.moduleConfig.payload_variant.telemetry = moduleConfig.telemetry;
+        break;
+    case meshtastic_ModuleConfig_canned_message_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_canned_message_tag;
+        f.moduleConfig.payload_variant.canned_message = moduleConfig.canned_message;
+        break;
+    case meshtastic_ModuleConfig_audio_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_audio_tag;
+        f.moduleConfig.payload_variant.audio = moduleConfig.audio;
+        break;
+    case meshtastic_ModuleConfig_remote_hardware_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_remote_hardware_tag;
+        f.moduleConfig.payload_variant.remote_hardware = moduleConfig.remote_hardware;
+        break;
+    case meshtastic_ModuleConfig_neighbor_info_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_neighbor_info_tag;
+        f.moduleConfig.payload_variant.neighbor_info = moduleConfig.neighbor_info;
+        break;
+    case meshtastic_ModuleConfig_detection_sensor_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_detection_sensor_tag;
+        f.moduleConfig.payload_variant.detection_sensor = moduleConfig.detection_sensor;
+        break;
+    case meshtastic_ModuleConfig_ambient_lighting_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_ambient_lighting_tag;
+        f.moduleConfig.payload_variant.ambient_lighting = moduleConfig.ambient_lighting;
+        break;
+    case meshtastic_ModuleConfig_paxcounter_tag:
+        f.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_paxcounter_tag;
+        f.moduleConfig.payload_variant.paxcounter = moduleConfig.paxcounter;
+        break;
+    default:
+        LOG_ERROR("Unknown module config type %d\n", type);
+    }
+}
+
+void PhoneAPI::refreshConfigFrames()
+{
+    // Someone might have changed them directly, without telling us
+    uint32_t crc = 0xffffffff;
+    crc = crc32Update(&config, sizeof(config), crc);
+    crc = crc32Update(&moduleConfig, sizeof(moduleConfig), crc);
+    crc = crc32Update(&channelFile, sizeof(channelFile), crc);
+    crc = crc32Final(crc);
+    if (configFramesGeneration == configGeneration && configFramesCRC == crc && !configFrames.empty())
+        return;
+
+    concurrency::LockGuard g(&fromRadioLock);
+    uint32_t start = millis();
+    configFrames.clear();
+    configFrameEnds.clear();
+    for (size_t frame = 0; frame < NUM_CONFIG_PHASE_FRAMES; frame++) {
+        memset(&fromRadioScratch, 0, sizeof(fromRadioScratch));
+        if (frame < CONFIG_FRAMES_CONFIG)
+            fillChannelFrame(fromRadioScratch, frame);
+        else if (frame < CONFIG_FRAMES_MODULECONFIG)
+            fillConfigFrame(fromRadioScratch, frame - CONFIG_FRAMES_CONFIG + _meshtastic_AdminMessage_ConfigType_MIN + 1);
+        else
+            fillModuleConfigFrame(fromRadioScratch,
+                                  frame - CONFIG_FRAMES_MODULECONFIG + _meshtastic_AdminMessage_ModuleConfigType_MIN + 1);
+
+        // Encode straight onto the end of our frames, then drop what it didn't use
+        size_t offset = configFrames.size();
+        configFrames.resize(offset + meshtastic_FromRadio_size);
+        size_t numbytes =
+            pb_encode_to_bytes(&configFrames[offset], meshtastic_FromRadio_size, &meshtastic_FromRadio_msg, &fromRadioScratch);
+        configFrames.resize(offset + numbytes);
+        configFrameEnds.push_back(configFrames.size());
+    }
+    configFrames.shrink_to_fit();
+
+    configFramesGeneration = configGeneration;
+    configFramesCRC = crc;
+    LOG_DEBUG("Encoded %u config frames (%u bytes) in %u ms\n", configFrameEnds.size(), configFrames.size(), millis() - start);
+}
+
+size_t PhoneAPI::copyConfigFrame(size_t frame, uint8_t *buf)
+{
+    size_t start = frame ? configFrameEnds[frame - 1] : 0, numbytes = configFrameEnds[frame] - start;
+    memcpy(buf, &configFrames[start], numbytes);
+    LOG_DEBUG("copying cached config frame %u to phone, %d bytes\n", frame, numbytes);
+    return numbytes;
+}
+
 /**
  * Get the next packet we want to send to the phone, or NULL if no such packet is available.
  *
@@ -142,8 +375,16 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
         // LOG_DEBUG("getFromRadio=not available\n");
         return 0;
     }
+
+    concurrency::LockGuard g(&fromRadioLock);
+    return encodeFromRadio(buf);
+}
+
+size_t PhoneAPI::encodeFromRadio(uint8_t *buf)
+{
     // In case we send a FromRadio packet
     memset(&fromRadioScratch, 0, sizeof(fromRadioScratch));
+    int configFrame = -1; // or which of our configFrames to send
 
     // Advance states as needed
     switch (state) {
@@ -172,26 +413,33 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
     case STATE_SEND_NODEINFO: {
         LOG_INFO("getFromRadio=STATE_SEND_NODEINFO\n");
 
-        if (nodeInfoForPhone.num != 0) {
-            LOG_INFO("nodeinfo: num=0x%x, lastseen=%u, id=%s, name=%s\n", nodeInfoForPhone.num, nodeInfoForPhone.last_heard,
-                     nodeInfoForPhone.user.id, nodeInfoForPhone.user.long_name);
+        if (nodeNumForPhone != 0) {
+            meshtastic_NodeInfo &info = fromRadioScratch.node_info;
+            const meshtastic_NodeInfoLite *node = nodeForPhoneRemoved ? NULL : nodeDB.getMeshNode(nodeNumForPhone);
+            if (node) {
+                info = TypeConversions::ConvertToNodeInfo(node);
+            } else {
+                // A removal, or it went away since available() picked it, which the client may as well hear as one
+                info = meshtastic_NodeInfo_init_default;
+                info.num = nodeNumForPhone;
+            }
+            LOG_INFO("nodeinfo: num=0x%x, lastseen=%u, id=%s, name=%s\n", info.num, info.last_heard, info.user.id,
+                     info.user.long_name);
             fromRadioScratch.which_payload_variant = meshtastic_FromRadio_node_info_tag;
-            fromRadioScratch.node_info = nodeInfoForPhone;
             // Stay in current state until done sending nodeinfos
-            nodeInfoForPhone.num = 0; // We just consumed a nodeinfo, will need a new one next time
+            nodeNumForPhone = 0; // We just consumed a nodeinfo, will need a new one next time
         } else {
             LOG_INFO("Done sending nodeinfos\n");
             state = STATE_SEND_CHANNELS;
             // Go ahead and send that ID right now
-            return getFromRadio(buf);
+            return available() ? encodeFromRadio(buf) : 0;
         }
         break;
     }
 
     case STATE_SEND_CHANNELS:
         LOG_INFO("getFromRadio=STATE_SEND_CHANNELS\n");
-        fromRadioScratch.which_payload_variant = meshtastic_FromRadio_channel_tag;
-        fromRadioScratch.channel = channels.getByIndex(config_state);
+        configFrame = config_state;
         config_state++;
         // Advance when we have sent all of our Channels
         if (config_state >= MAX_NUM_CHANNELS) {
@@ -202,44 +450,7 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
 
     case STATE_SEND_CONFIG:
         LOG_INFO("getFromRadio=STATE_SEND_CONFIG\n");
-        fromRadioScratch.which_payload_variant = meshtastic_FromRadio_config_tag;
-        switch (config_state) {
-        case meshtastic_Config_device_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_device_tag;
-            fromRadioScratch.config.payload_variant.device = config.device;
-            break;
-        case meshtastic_Config_position_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_position_tag;
-            fromRadioScratch.config.payload_variant.position = config.position;
-            break;
-        case meshtastic_Config_power_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_power_tag;
-            fromRadioScratch.config.payload_variant.power = config.power;
-            fromRadioScratch.config.payload_variant.power.ls_secs = default_ls_secs;
-            break;
-        case meshtastic_Config_network_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_network_tag;
-            fromRadioScratch.config.payload_variant.network = config.network;
-            break;
-        case meshtastic_Config_display_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_display_tag;
-            fromRadioScratch.config.payload_variant.display = config.display;
-            break;
-        case meshtastic_Config_lora_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_lora_tag;
-            fromRadioScratch.config.payload_variant.lora = config.lora;
-            break;
-        case meshtastic_Config_bluetooth_tag:
-            fromRadioScratch.config.which_payload_variant = meshtastic_Config_bluetooth_tag;
-            fromRadioScratch.config.payload_variant.bluetooth = config.bluetooth;
-            break;
-        default:
-            LOG_ERROR("Unknown config type %d\n", config_state);
-        }
-        // NOTE: The phone app needs to know the ls_secs value so it can properly expect sleep behavior.
-        // So even if we internally use 0 to represent 'use default' we still need to send the value we are
-        // using to the app (so that even old phone apps work with new device loads).
-
+        configFrame = CONFIG_FRAMES_CONFIG + config_state - (_meshtastic_AdminMessage_ConfigType_MIN + 1);
         config_state++;
         // Advance when we have sent all of our config objects
         if (config_state > (_meshtastic_AdminMessage_ConfigType_MAX + 1)) {
@@ -250,64 +461,7 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
 
     case STATE_SEND_MODULECONFIG:
         LOG_INFO("getFromRadio=STATE_SEND_MODULECONFIG\n");
-        fromRadioScratch.which_payload_variant = meshtastic_FromRadio_moduleConfig_tag;
-        switch (config_state) {
-        case meshtastic_ModuleConfig_mqtt_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_mqtt_tag;
-            fromRadioScratch.moduleConfig.payload_variant.mqtt = moduleConfig.mqtt;
-            break;
-        case meshtastic_ModuleConfig_serial_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_serial_tag;
-            fromRadioScratch.moduleConfig.payload_variant.serial = moduleConfig.serial;
-            break;
-        case meshtastic_ModuleConfig_external_notification_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_external_notification_tag;
-            fromRadioScratch.moduleConfig.payload_variant.external_notification = moduleConfig.external_notification;
-            break;
-        case meshtastic_ModuleConfig_store_forward_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_store_forward_tag;
-            fromRadioScratch.moduleConfig.payload_variant.store_forward = moduleConfig.store_forward;
-            break;
-        case meshtastic_ModuleConfig_range_test_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_range_test_tag;
-            fromRadioScratch.moduleConfig.payload_variant.range_test = moduleConfig.range_test;
-            break;
-        case meshtastic_ModuleConfig_telemetry_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_telemetry_tag;
-            fromRadioScratch.moduleConfig.payload_variant.telemetry = moduleConfig.telemetry;
-            break;
-        case meshtastic_ModuleConfig_canned_message_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_canned_message_tag;
-            fromRadioScratch.moduleConfig.payload_variant.canned_message = moduleConfig.canned_message;
-            break;
-        case meshtastic_ModuleConfig_audio_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_audio_tag;
-            fromRadioScratch.moduleConfig.payload_variant.audio = moduleConfig.audio;
-            break;
-        case meshtastic_ModuleConfig_remote_hardware_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_remote_hardware_tag;
-            fromRadioScratch.moduleConfig.payload_variant.remote_hardware = moduleConfig.remote_hardware;
-            break;
-        case meshtastic_ModuleConfig_neighbor_info_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_neighbor_info_tag;
-            fromRadioScratch.moduleConfig.payload_variant.neighbor_info = moduleConfig.neighbor_info;
-            break;
-        case meshtastic_ModuleConfig_detection_sensor_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_detection_sensor_tag;
-            fromRadioScratch.moduleConfig.payload_variant.detection_sensor = moduleConfig.detection_sensor;
-            break;
-        case meshtastic_ModuleConfig_ambient_lighting_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_ambient_lighting_tag;
-            fromRadioScratch.moduleConfig.payload_variant.ambient_lighting = moduleConfig.ambient_lighting;
-            break;
-        case meshtastic_ModuleConfig_paxcounter_tag:
-            fromRadioScratch.moduleConfig.which_payload_variant = meshtastic_ModuleConfig_paxcounter_tag;
-            fromRadioScratch.moduleConfig.payload_variant.paxcounter = moduleConfig.paxcounter;
-            break;
-        default:
-            LOG_ERROR("Unknown module config type %d\n", config_state);
-        }
-
+        configFrame = CONFIG_FRAMES_MODULECONFIG + config_state - (_meshtastic_AdminMessage_ModuleConfigType_MIN + 1);
         config_state++;
         // Advance when we have sent all of our ModuleConfig objects
         if (config_state > (_meshtastic_AdminMessage_ModuleConfigType_MAX + 1)) {
@@ -320,8 +474,10 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
         LOG_INFO("getFromRadio=STATE_SEND_COMPLETE_ID\n");
         fromRadioScratch.which_payload_variant = meshtastic_FromRadio_config_complete_id_tag;
         fromRadioScratch.config_complete_id = config_nonce;
+        saveSyncPoint();
         config_nonce = 0;
         state = STATE_SEND_PACKETS;
+        statsLineForPhone = 0; // There is no protobuf for our radio stats, so they follow the config as log records
         break;
 
     case STATE_SEND_PACKETS:
@@ -339,13 +495,81 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
             fromRadioScratch.which_payload_variant = meshtastic_FromRadio_xmodemPacket_tag;
             fromRadioScratch.xmodemPacket = xmodemPacketForPhone;
             xmodemPacketForPhone = meshtastic_XModem_init_zero;
-        } else if (packetForPhone) {
-            printPacket("phone downloaded packet", packetForPhone);
+        } else if (statsLineForPhone >= 0) {
+            fromRadioScratch.which_payload_variant = meshtastic_FromRadio_log_record_tag;
+            meshtastic_LogRecord &r = fromRadioScratch.log_record;
+            int numLines = RadioStats::NUM_SUMMARY_LINES;
+            if (statsLineForPhone < RadioStats::NUM_SUMMARY_LINES) {
+                radioStats.getSummaryLine(statsLineForPhone, r.message, sizeof(r.message));
+                strncpy(r.source, "radio", sizeof(r.source));
+            }
+            // then where our charge goes
+            int firstEnergyLine = numLines;
+            numLines += EnergyStats::NUM_SUMMARY_LINES;
+            if (statsLineForPhone >= firstEnergyLine && statsLineForPhone < numLines) {
+                energyStats.getSummaryLine(statsLineForPhone - firstEnergyLine, r.message, sizeof(r.message));
+                strncpy(r.source, "energy", sizeof(r.source));
+            }
+            // then who has been using the channel
+            int firstAirtimeLine = numLines;
+            numLines += airTime ? airTime->getNumAccountingLines() : 0;
+            if (statsLineForPhone >= firstAirtimeLine && statsLineForPhone < numLines) {
+                airTime->getAccountingLine(statsLineForPhone - firstAirtimeLine, r.message, sizeof(r.message));
+                strncpy(r.source, "airtime", sizeof(r.source));
+            }
+#if BOOT_TIMELINE
+            // then where our boot time went
+            int firstBootLine = numLines;
+            numLines += bootTimeline.getNumLines();
+            if (statsLineForPhone >= firstBootLine && statsLineForPhone < numLines) {
+                bootTimeline.getSummaryLine(statsLineForPhone - firstBootLine, r.message, sizeof(r.message));
+                strncpy(r.source, "boot", sizeof(r.source));
+            }
+#endif
+#if defined(ARCH_PORTDUINO) && PORTDUINO_SPIDEV_HAL
+            // then what talking to the radio costs us
+            int firstSpidevLine = numLines;
+            numLines += SpidevStats::NUM_SUMMARY_LINES;
+            if (statsLineForPhone >= firstSpidevLine && statsLineForPhone < numLines) {
+                spidevStats.getSummaryLine(statsLineForPhone - firstSpidevLine, r.message, sizeof(r.message));
+                strncpy(r.source, "spidev", sizeof(r.source));
+            }
+#endif
+#if PACKET_TRACE
+            // then where the time went for our latest packets
+            int firstTraceLine = numLines;
+            numLines += packetTrace.getNumLines();
+            if (statsLineForPhone >= firstTraceLine && statsLineForPhone < numLines) {
+                packetTrace.getSummaryLine(statsLineForPhone - firstTraceLine, r.message, sizeof(r.message));
+                strncpy(r.source, "trace", sizeof(r.source));
+            }
+#endif
+#if OSTHREAD_PROFILE
+            // then what our threads cost us, so the phone can see which of them keep us from the radio
+            int firstThreadLine = numLines;
+            numLines += concurrency::getNumProfileLines();
+            if (statsLineForPhone >= firstThreadLine && statsLineForPhone < numLines) {
+                concurrency::getProfileLine(statsLineForPhone - firstThreadLine, r.message, sizeof(r.message));
+                strncpy(r.source, "threads", sizeof(r.source));
+            }
+#endif
+            // and who is fragmenting our heap
+            int firstHeapLine = numLines;
+            numLines += memGet.getNumHeapLines();
+            if (statsLineForPhone >= firstHeapLine) {
+                memGet.getHeapLine(statsLineForPhone - firstHeapLine, r.message, sizeof(r.message));
+                strncpy(r.source, "heap", sizeof(r.source));
+            }
+            r.time = getValidTime(RTCQualityFromNet);
+            r.level = meshtastic_LogRecord_Level_INFO;
+            if (++statsLineForPhone >= numLines)
+                statsLineForPhone = -1;
+        } else if (service.copyForPhone(toPhoneReader, fromRadioScratch.packet)) {
+            printPacket("phone downloaded packet", &fromRadioScratch.packet);
+            PACKET_TRACE_MARK(getFrom(&fromRadioScratch.packet), fromRadioScratch.packet.id, TO_PHONE);
 
             // Encapsulate as a FromRadio packet
             fromRadioScratch.which_payload_variant = meshtastic_FromRadio_packet_tag;
-            fromRadioScratch.packet = *packetForPhone;
-            releasePhonePacket();
         }
         break;
 
@@ -353,6 +577,9 @@ size_t PhoneAPI::getFromRadio(uint8_t *buf)
         LOG_ERROR("getFromRadio unexpected state %d\n", state);
     }
 
+    if (configFrame >= 0)
+        return copyConfigFrame(configFrame, buf);
+
     // Do we have a message from the mesh?
     if (fromRadioScratch.which_payload_variant != 0) {
         // Encapsulate as a FromRadio packet
@@ -371,14 +598,6 @@ void PhoneAPI::handleDisconnect()
     LOG_INFO("PhoneAPI disconnect\n");
 }
 
-void PhoneAPI::releasePhonePacket()
-{
-    if (packetForPhone) {
-        service.releaseToPool(packetForPhone); // we just copied the bytes, so don't need this buffer anymore
-        packetForPhone = NULL;
-    }
-}
-
 void PhoneAPI::releaseQueueStatusPhonePacket()
 {
     if (queueStatusPacketForPhone) {
@@ -392,9 +611,16 @@ void PhoneAPI::releaseMqttClientProxyPhonePacket()
     if (mqttClientProxyMessageForPhone) {
         service.releaseMqttClientProxyMessageToPool(mqttClientProxyMessageForPhone);
         mqttClientProxyMessageForPhone = NULL;
+        if (mqtt)
+            mqtt->onClientProxyTaken(); // there's room in its window for whatever MQTT has waiting
     }
 }
 
+uint32_t PhoneAPI::getForPhoneBacklog()
+{
+    return service.getForPhoneBacklog(toPhoneReader);
+}
+
 /**
  * Return true if we have data available to send to the phone
  */
@@ -412,10 +638,21 @@ bool PhoneAPI::available()
         return true;
 
     case STATE_SEND_NODEINFO:
-        if (nodeInfoForPhone.num == 0) {
-            auto nextNode = nodeDB.readNextMeshNode(readIndex);
+        if (nodeNumForPhone == 0 && sendForgetAllNodes) {
+            nodeNumForPhone = NODENUM_BROADCAST;
+            nodeForPhoneRemoved = true;
+            sendForgetAllNodes = false;
+        }
+        if (nodeNumForPhone == 0 && syncMinGeneration) {
+            // Removals first, so a node which went away and came back ends up in the client's list
+            nodeNumForPhone = nodeDB.readNextRemovedNode(removedReadIndex, syncMinGeneration);
+            nodeForPhoneRemoved = true;
+        }
+        if (nodeNumForPhone == 0) {
+            auto nextNode = nodeDB.readNextMeshNode(nodeWalk, syncMinGeneration);
             if (nextNode) {
-                nodeInfoForPhone = TypeConversions::ConvertToNodeInfo(nextNode);
+                nodeNumForPhone = nextNode->num;
+                nodeForPhoneRemoved = false;
             }
         }
         return true; // Always say we have something, because we might need to advance our state machine
@@ -436,9 +673,10 @@ bool PhoneAPI::available()
             return true;
         }
 
-        if (!packetForPhone)
-            packetForPhone = service.getForPhone();
-        hasPacket = !!packetForPhone;
+        if (statsLineForPhone >= 0)
+            return true;
+
+        hasPacket = service.hasForPhone(toPhoneReader);
         // LOG_DEBUG("available hasPacket=%d\n", hasPacket);
         return hasPacket;
     }
@@ -455,6 +693,13 @@ bool PhoneAPI::available()
 bool PhoneAPI::handleToRadioPacket(meshtastic_MeshPacket &p)
 {
     printPacket("PACKET FROM PHONE", &p);
+    if (p.which_payload_variant == meshtastic_MeshPacket_decoded_tag && p.decoded.portnum == PHONE_FILTER_PORTNUM &&
+        p.to == nodeDB.getNodeNum()) {
+        // Our filter, not one for the mesh
+        if (!service.setPhoneFilter(toPhoneReader, p.decoded.payload.bytes, p.decoded.payload.size))
+            LOG_WARN("Ignoring a malformed packet filter from the client\n");
+        return false;
+    }
     service.handleToRadio(p);
 
     return true;
@@ -1,12 +1,31 @@
 #pragma once
 
+#include "MeshService.h"
+#include "NodeDB.h"
 #include "Observer.h"
+#include "concurrency/Lock.h"
 #include "mesh-pb-constants.h"
 #include <string>
+#include <vector>
 
 // Make sure that we never let our packets grow too large for one BLE packet
 #define MAX_TO_FROM_RADIO_SIZE 512
 
+/**
+ * Incremental node sync, for clients which reconnect often.  A client which picks want_config_ids with this top byte can
+ * reconnect with the want_config_id of the last config download it completed.  If we still remember that download, its
+ * node list only holds the nodes which changed since, after a NodeInfo with nothing but the num set for each node removed
+ * since.  Otherwise (and on its first download) it gets all our nodes, after such a NodeInfo for NODENUM_BROADCAST, meaning
+ * forget every node you had.  Clients which don't use the tag always get the whole list, as before.
+ */
+#define PHONEAPI_SYNC_NONCE_MASK 0xff000000
+#define PHONEAPI_SYNC_NONCE_TAG 0x5c000000
+
+/// How many completed config downloads we remember for clients to sync from, the oldest makes room for a new one
+#ifndef PHONEAPI_SYNC_POINTS
+#define PHONEAPI_SYNC_POINTS 4
+#endif
+
 /**
  * Provides our protobuf based API which phone/PC clients can use to talk to our device
  * over UDP, bluetooth or serial.
@@ -33,6 +52,9 @@ class PhoneAPI
 
     State state = STATE_SEND_NOTHING;
 
+    /// We watch both service.fromNumChanged and xModem.packetReady
+    ObserverLinks<uint32_t, 1> observerLinks;
+
     uint8_t config_state = 0;
 
     /**
@@ -40,30 +62,78 @@ class PhoneAPI
      */
     uint32_t fromRadioNum = 0;
 
-    /// We temporarily keep the packet here between the call to available and getFromRadio.  We will free it after the phone
-    /// downloads it
-    meshtastic_MeshPacket *packetForPhone = NULL;
+    /// Where we are in MeshService's packets for the phone, every connection downloads all of them
+    MeshService::ToPhoneReader toPhoneReader;
 
     // file transfer packets destined for phone. Push it to the queue then free it.
     meshtastic_XModem xmodemPacketForPhone = meshtastic_XModem_init_zero;
 
-    // Keep QueueStatus packet just as packetForPhone
+    // We temporarily keep the QueueStatus packet here between the call to available and getFromRadio
     meshtastic_QueueStatus *queueStatusPacketForPhone = NULL;
 
-    // Keep MqttClientProxyMessage packet just as packetForPhone
+    // Likewise for the MqttClientProxyMessage
     meshtastic_MqttClientProxyMessage *mqttClientProxyMessageForPhone = NULL;
 
-    /// We temporarily keep the nodeInfo here between the call to available and getFromRadio
-    meshtastic_NodeInfo nodeInfoForPhone = meshtastic_NodeInfo_init_default;
+    /// Next line of our RadioStats summary to send the phone (as a log record) after its config download, -1 when done
+    int16_t statsLineForPhone = -1;
+
+    /// The node available() picked for getFromRadio() to send next, 0 for none.  Only its num, getFromRadio() converts it
+    /// straight into the FromRadio it encodes, rather than every connection keeping a NodeInfo between the two calls
+    NodeNum nodeNumForPhone = 0;
 
-    meshtastic_ToRadio toRadioScratch = {
-        0}; // this is a static scratch object, any data must be copied elsewhere before returning
+    /// Send nodeNumForPhone as a NodeInfo with nothing but its num set, a removal (or NODENUM_BROADCAST, forget all nodes)
+    bool nodeForPhoneRemoved = false;
+
+    /// Any data in here must be copied elsewhere before handleToRadio() returns, only one connection at a time decodes into it
+    static meshtastic_ToRadio toRadioScratch;
+    static concurrency::Lock toRadioLock;
 
     /// Use to ensure that clients don't get confused about old messages from the radio
     uint32_t config_nonce = 0;
-    uint32_t readIndex = 0;
+    NodeDB::MeshNodeWalk nodeWalk; // ours alone, so another client starting its download can't move us
+    uint32_t removedReadIndex = 0;
+
+    void resetReadIndex() { nodeWalk.index = removedReadIndex = 0; }
+
+    /// A completed config download an incremental sync can start from, see PHONEAPI_SYNC_NONCE_TAG
+    struct SyncPoint {
+        uint32_t nonce, generation;
+    };
+    static SyncPoint syncPoints[PHONEAPI_SYNC_POINTS];
+    static uint8_t nextSyncPoint;
+
+    /// Our node download sends the nodes (and removals) from this NodeDB generation on, 0 for all of our nodes
+    uint32_t syncMinGeneration = 0;
+
+    /// NodeDB's generation when our config download started, the client has seen everything up to there once it completes
+    uint32_t syncStartGeneration = 0;
 
-    void resetReadIndex() { readIndex = 0; }
+    /// Tell the client to forget all its nodes before we send our full list
+    bool sendForgetAllNodes = false;
+
+    /// Pick a full or an incremental node download for config_nonce
+    void startNodeSync();
+
+    /// Remember our completed config download, for the client to sync from next time
+    void saveSyncPoint();
+
+    /// The config phase's FromRadio frames (channels, config and module config), encoded back to back so each want_config
+    /// just copies them out, until invalidateConfigFrames() or a change to what they were encoded from
+    std::vector<uint8_t> configFrames;
+    std::vector<uint16_t> configFrameEnds;
+    uint32_t configFramesGeneration = 0, configFramesCRC = 0;
+
+    /// Bumped by invalidateConfigFrames()
+    static uint32_t configGeneration;
+
+    /// Encode our configFrames again, if they are out of date
+    void refreshConfigFrames();
+
+    /// Copy one of our configFrames into buf, @return its length
+    size_t copyConfigFrame(size_t frame, uint8_t *buf);
+
+    /// getFromRadio(), with fromRadioLock held
+    size_t encodeFromRadio(uint8_t *buf);
 
   public:
     PhoneAPI();
@@ -96,11 +166,22 @@ class PhoneAPI
 
     bool isConnected() { return state != STATE_SEND_NOTHING; }
 
+    /// @return true while the client is downloading its config (our info, nodes, channels and settings)
+    bool isSendingConfig() const { return state != STATE_SEND_NOTHING && state != STATE_SEND_PACKETS; }
+
+    /// @return about how many packets this client has yet to download from us
+    uint32_t getForPhoneBacklog();
+
+    /// Config, module config or channels changed, so every connection has to encode its config frames again
+    static void invalidateConfigFrames() { configGeneration++; }
+
     void setInitialState() { state = STATE_SEND_MY_INFO; }
 
   protected:
-    /// Our fromradio packet while it is being assembled
-    meshtastic_FromRadio fromRadioScratch = {};
+    /// Our fromradio packet while it is being assembled.  A big union we only need while encoding one, so all our connections
+    /// (BLE, serial, each TCP client, HTTP) share it, holding fromRadioLock, rather than each keeping its own
+    static meshtastic_FromRadio fromRadioScratch;
+    static concurrency::Lock fromRadioLock;
 
     /** the last msec we heard from the client on the other side of this link */
     uint32_t lastContactMsec = 0;
@@ -125,8 +206,6 @@ class PhoneAPI
     virtual void handleDisconnect();
 
   private:
-    void releasePhonePacket();
-
     void releaseQueueStatusPhonePacket();
 
     void releaseMqttClientProxyPhonePacket();
@@ -0,0 +1,84 @@
+#include "PhoneFilter.h"
+#include "NodeDB.h"
+#include "configuration.h"
+#include <string.h>
+
+bool PhoneFilter::set(const uint8_t *payload, size_t len)
+{
+    if (!len) {
+        LOG_INFO("Client cleared its packet filter\n");
+        clear();
+        return true;
+    }
+    Spec s;
+    if (len < sizeof(s))
+        return false;
+    memcpy(&s, payload, sizeof(s));
+    if (s.numPorts > PHONE_FILTER_MAX_PORTS || s.numFrom > PHONE_FILTER_MAX_NODES || s.numTo > PHONE_FILTER_MAX_NODES)
+        return false;
+
+    spec = s;
+    memset(passed, 0, sizeof(passed));
+    active = true;
+    LOG_INFO("Client set a packet filter: %u ports, %u from nodes, %u to nodes, channel %u, flags 0x%x\n", s.numPorts,
+             s.numFrom, s.numTo, s.channel, s.flags);
+    return true;
+}
+
+int PhoneFilter::findPort(const meshtastic_MeshPacket &p) const
+{
+    if (p.which_payload_variant != meshtastic_MeshPacket_decoded_tag)
+        return -1;
+    for (uint8_t i = 0; i < spec.numPorts; i++)
+        if (spec.ports[i] == p.decoded.portnum)
+            return i;
+    return -1;
+}
+
+/// @return true if nodes (the first num of them) hold n
+static bool hasNode(const uint32_t *nodes, uint8_t num, NodeNum n)
+{
+    for (uint8_t i = 0; i < num; i++)
+        if (nodes[i] == n)
+            return true;
+    return false;
+}
+
+/// @return true if p is an ack (or nak) for something we sent, which the client needs whatever its filter says
+static bool isRoutingForUs(const meshtastic_MeshPacket &p)
+{
+    return p.to == nodeDB.getNodeNum() && p.which_payload_variant == meshtastic_MeshPacket_decoded_tag &&
+           p.decoded.portnum == meshtastic_PortNum_ROUTING_APP;
+}
+
+bool PhoneFilter::wants(const meshtastic_MeshPacket &p) const
+{
+    if (!active || isRoutingForUs(p))
+        return true;
+
+    NodeNum ourNum = nodeDB.getNodeNum();
+    if ((spec.flags & PHONE_FILTER_FLAG_NO_SNIFFED) && p.to != ourNum && p.to != NODENUM_BROADCAST)
+        return false;
+    if (spec.channel != ANY_CHANNEL && p.channel != spec.channel)
+        return false;
+    if (spec.numFrom && !hasNode(spec.from, spec.numFrom, getFrom(&p)))
+        return false;
+    if (spec.numTo && !hasNode(spec.to, spec.numTo, p.to))
+        return false;
+    return !spec.numPorts || findPort(p) >= 0;
+}
+
+bool PhoneFilter::pass(const meshtastic_MeshPacket &p, uint32_t nowMsec)
+{
+    if (!wants(p))
+        return false;
+
+    int port = active && !isRoutingForUs(p) ? findPort(p) : -1;
+    if (port < 0 || !spec.intervalSecs[port])
+        return true;
+    if (passed[port] && nowMsec - lastPassMsec[port] < spec.intervalSecs[port] * 1000UL)
+        return false;
+    passed[port] = true;
+    lastPassMsec[port] = nowMsec;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Until there is a ToRadio field for it, a client sets its filter with a packet to us on this portnum from the private range
+#define PHONE_FILTER_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 21))
+
+/// Most ports (and nodes of each set) one filter lists
+#define PHONE_FILTER_MAX_PORTS 8
+#define PHONE_FILTER_MAX_NODES 8
+
+/// Only packets to us or broadcast, none of those we overheard for others
+#define PHONE_FILTER_FLAG_NO_SNIFFED 0x01
+
+/**
+ * Which of our packets for the phone one connection wants, so a client which only cares about messages isn't sent every
+ * sniffed packet and every node's telemetry over its (slow BLE) link first.
+ *
+ * A client sets it with a packet to our node on PHONE_FILTER_PORTNUM holding a Spec, before (or along with) its
+ * want_config, and it lasts until the connection closes.  Such a packet with no payload clears it again.  The filter
+ * lets through the packets on one of its ports (if it lists any), from one of its from nodes (if any), to one of its to
+ * nodes (if any) and on its channel (unless ANY_CHANNEL).  A port with an interval lets through at most one
+ * packet every that many seconds.  Routing packets to us always get through, they are the acks for what the client sent.
+ *
+ * MeshService drops a packet before it takes one of its toPhone slots if every connected client's filter rejects it, and
+ * skips the packets a client's filter rejects as it downloads.
+ */
+class PhoneFilter
+{
+  public:
+    static const uint8_t ANY_CHANNEL = 0xff;
+
+#pragma pack(push, 1)
+    /// What a client sends us
+    struct Spec {
+        uint8_t flags;   // PHONE_FILTER_FLAG_*
+        uint8_t channel; // or ANY_CHANNEL
+        uint8_t numPorts, numFrom, numTo;
+        uint16_t ports[PHONE_FILTER_MAX_PORTS];
+        uint16_t intervalSecs[PHONE_FILTER_MAX_PORTS]; // for each of ports, 0 for no rate limit
+        uint32_t from[PHONE_FILTER_MAX_NODES];
+        uint32_t to[PHONE_FILTER_MAX_NODES];
+    };
+#pragma pack(pop)
+
+  private:
+    Spec spec;
+    bool active = false;
+
+    /// When each of our ports last let a packet through
+    uint32_t lastPassMsec[PHONE_FILTER_MAX_PORTS];
+    bool passed[PHONE_FILTER_MAX_PORTS];
+
+    /// @return which of spec.ports p is on, -1 if none
+    int findPort(const meshtastic_MeshPacket &p) const;
+
+  public:
+    /// Take the filter a client sent in payload, or clear ours if it is empty.  @return false if it isn't a Spec
+    bool set(const uint8_t *payload, size_t len);
+
+    void clear() { active = false; }
+
+    bool isActive() const { return active; }
+
+    /// @return false if we never let p through, whenever it came (so it needn't be queued for us at all)
+    bool wants(const meshtastic_MeshPacket &p) const;
+
+    /// @return true if we let p through now, counting it against its port's rate limit if so
+    bool pass(const meshtastic_MeshPacket &p, uint32_t nowMsec);
+};
@@ -0,0 +1,248 @@
+#include "PhoneInbox.h"
+#include "FSCommon.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "gps/RTC.h"
+#include "mesh/generated/meshtastic/storeforward.pb.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
+#include <string.h>
+
+#if PHONE_INBOX && defined(FSCom)
+#define PHONE_INBOX_USE_FLASH 1
+#else
+#define PHONE_INBOX_USE_FLASH 0
+#endif
+
+#if PHONE_INBOX_USE_FLASH
+static const char *inboxFileName = "/prefs/inbox.dat";
+static const char *stateFileName = "/prefs/inboxstate.dat";
+
+/// How far the phones got, what we save in stateFileName
+struct SavedState {
+    uint32_t magic;
+    uint32_t drainSeq;
+};
+static const uint32_t STATE_MAGIC = 0x50494231;
+#endif
+
+/// The slot seq goes in, seq 1 in the first so the file grows one slot at a time
+static uint32_t slotFor(uint32_t seq)
+{
+    return (seq - 1) % PHONE_INBOX_SLOTS;
+}
+
+uint32_t PhoneInbox::crcSlot(const Header &h, const uint8_t *packet)
+{
+    Header zeroed = h;
+    zeroed.crc = 0;
+    uint32_t crc = 0xffffffff;
+    crc = crc32Update(&zeroed, sizeof(zeroed), crc);
+    crc = crc32Update(packet, h.len, crc);
+    return crc32Final(crc);
+}
+
+bool PhoneInbox::init()
+{
+#if PHONE_INBOX_USE_FLASH
+    FSCom.mkdir("/prefs");
+
+    // Find the newest message we have, and the run of older ones before it
+    uint32_t seqs[PHONE_INBOX_SLOTS] = {};
+    uint32_t newestSeq = 0;
+    auto f = FSCom.open(inboxFileName, FILE_O_READ);
+    if (f) {
+        fileSlots = std::min<uint32_t>(f.size() / SLOT_SIZE, PHONE_INBOX_SLOTS);
+        uint8_t slot[SLOT_SIZE];
+        for (uint32_t i = 0; i < fileSlots; i++) {
+            if (!f.seek(i * SLOT_SIZE) || f.read(slot, SLOT_SIZE) != (int)SLOT_SIZE)
+                break;
+            Header h;
+            memcpy(&h, slot, sizeof(h));
+            if (h.magic != HEADER_MAGIC || !h.seq || h.len > meshtastic_MeshPacket_size ||
+                crcSlot(h, slot + sizeof(h)) != h.crc || slotFor(h.seq) != i)
+                continue; // one we didn't finish writing
+            seqs[i] = h.seq;
+            epochs[i] = h.epoch;
+            newestSeq = std::max(newestSeq, h.seq);
+        }
+        f.close();
+    }
+    if (newestSeq) {
+        nextSeq = newestSeq + 1;
+        firstSeq = newestSeq;
+        while (firstSeq > 1 && nextSeq - (firstSeq - 1) <= PHONE_INBOX_SLOTS && seqs[slotFor(firstSeq - 1)] == firstSeq - 1)
+            firstSeq--;
+    }
+    loadState();
+    bootSeq = nextSeq;
+    ready = true;
+    LOG_INFO("Phone inbox holds %u messages, %u not yet downloaded\n", getNumMessages(), nextSeq - drainSeq);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PhoneInbox::wants(const meshtastic_MeshPacket &p)
+{
+    if (p.which_payload_variant != meshtastic_MeshPacket_decoded_tag)
+        return false;
+    // Range test packets are text too, but come far too often for our flash
+    return p.decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP ||
+           (p.to == nodeDB.getNodeNum() && MeshService::isTextPayload(&p));
+}
+
+bool PhoneInbox::readSlot(uint32_t seq, Header &h, uint8_t *packet)
+{
+    bool okay = false;
+#if PHONE_INBOX_USE_FLASH
+    auto f = FSCom.open(inboxFileName, FILE_O_READ);
+    if (f) {
+        okay = f.seek(slotFor(seq) * SLOT_SIZE) && f.read((uint8_t *)&h, sizeof(h)) == (int)sizeof(h) &&
+               h.magic == HEADER_MAGIC && h.seq == seq && h.len <= meshtastic_MeshPacket_size &&
+               f.read(packet, h.len) == (int)h.len && crcSlot(h, packet) == h.crc;
+        f.close();
+    }
+#endif
+    return okay;
+}
+
+bool PhoneInbox::append(const meshtastic_MeshPacket &p, bool delivered)
+{
+    if (!ready)
+        return false;
+
+    uint8_t slot[SLOT_SIZE] = {};
+    Header h = {HEADER_MAGIC, 0, nextSeq, getValidTime(RTCQualityFromNet), 0};
+    h.len = pb_encode_to_bytes(slot + sizeof(h), meshtastic_MeshPacket_size, &meshtastic_MeshPacket_msg, &p);
+    h.crc = crcSlot(h, slot + sizeof(h));
+    memcpy(slot, &h, sizeof(h));
+
+    bool okay = false;
+#if PHONE_INBOX_USE_FLASH
+    uint32_t i = slotFor(nextSeq);
+    auto f = FSCom.open(inboxFileName, fileSlots ? FILE_O_PATCH : FILE_O_WRITE);
+    if (f) {
+        okay = f.seek(i * SLOT_SIZE) && f.write(slot, SLOT_SIZE) == SLOT_SIZE;
+        f.close();
+    }
+#endif
+    if (!okay) {
+        LOG_ERROR("Error: can't write message %u to our phone inbox\n", nextSeq);
+        uint32_t now = getValidTime(RTCQualityFromNet);
+        lostEpoch = now ? std::max(lostEpoch, now) : UINT32_MAX; // our history has a hole from here
+        return false;
+    }
+
+    if (nextSeq - firstSeq == PHONE_INBOX_SLOTS) {
+        // We wrote over our oldest, so we no longer hold all of what we heard since it came
+        if ((int32_t)(firstSeq - bootSeq) >= 0)
+            lostEpoch = std::max(lostEpoch, epochs[slotFor(firstSeq)] ? epochs[slotFor(firstSeq)] : h.epoch);
+        if (drainSeq == firstSeq) {
+            LOG_WARN("Phone inbox is full, discarding a message no phone downloaded\n");
+            numLost++;
+            drainSeq++;
+        }
+        firstSeq++;
+    }
+#if PHONE_INBOX_USE_FLASH
+    if (i == fileSlots)
+        fileSlots++;
+#endif
+    epochs[slotFor(nextSeq)] = h.epoch;
+    if (delivered && drainSeq == nextSeq)
+        drainSeq++;
+    nextSeq++;
+    numStored++;
+    return true;
+}
+
+bool PhoneInbox::nextPending(meshtastic_MeshPacket &out)
+{
+    uint8_t packet[meshtastic_MeshPacket_size];
+    while (ready && drainSeq != nextSeq) {
+        Header h;
+        uint32_t seq = drainSeq++;
+        bool okay = readSlot(seq, h, packet) && pb_decode_from_bytes(packet, h.len, &meshtastic_MeshPacket_msg, &out);
+        if (drainSeq == nextSeq)
+            saveState(); // caught up
+        if (okay)
+            return true;
+        LOG_ERROR("Error: can't read message %u from our phone inbox\n", seq);
+    }
+    return false;
+}
+
+bool PhoneInbox::covers(uint32_t sinceEpoch) const
+{
+    uint32_t now = getValidTime(RTCQualityFromNet);
+    if (!ready || !now || !sinceEpoch)
+        return false;
+
+    // We heard everything since we booted, and kept it since the newest one we wrote over
+    uint32_t bootEpoch = now - millis() / 1000;
+    return sinceEpoch >= bootEpoch && sinceEpoch > lostEpoch;
+}
+
+bool PhoneInbox::answerHistoryRequest(const meshtastic_MeshPacket &p)
+{
+    if (!ready || p.which_payload_variant != meshtastic_MeshPacket_decoded_tag ||
+        p.decoded.portnum != meshtastic_PortNum_STORE_FORWARD_APP)
+        return false;
+    meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
+    if (!pb_decode_from_bytes(p.decoded.payload.bytes, p.decoded.payload.size, &meshtastic_StoreAndForward_msg, &sf) ||
+        sf.rr != meshtastic_StoreAndForward_RequestResponse_CLIENT_HISTORY)
+        return false;
+
+    uint32_t windowMins = PHONE_INBOX_HISTORY_WINDOW_MINS;
+    if (sf.which_variant == meshtastic_StoreAndForward_history_tag && sf.variant.history.window)
+        windowMins = sf.variant.history.window;
+    uint32_t now = getValidTime(RTCQualityFromNet);
+    if (!now || windowMins >= now / 60 || !covers(now - windowMins * 60))
+        return false;
+
+    // The oldest message of this boot which came within the window, those with no time came before we knew it
+    uint32_t sinceEpoch = now - windowMins * 60;
+    uint32_t seq = std::max(firstSeq, bootSeq);
+    while (seq != nextSeq && epochs[slotFor(seq)] && epochs[slotFor(seq)] < sinceEpoch)
+        seq++;
+    if ((int32_t)(seq - drainSeq) < 0)
+        drainSeq = seq;
+    numAnswered++;
+    LOG_INFO("We hold the last %u minutes of messages ourselves, the phone downloads %u of them again rather than asking a S&F "
+             "server\n",
+             windowMins, nextSeq - seq);
+    return true;
+}
+
+#if PHONE_INBOX_USE_FLASH
+void PhoneInbox::saveState()
+{
+    SavedState s = {STATE_MAGIC, drainSeq};
+    auto f = FSCom.open(stateFileName, FILE_O_WRITE);
+    if (!f || f.write((const uint8_t *)&s, sizeof(s)) != sizeof(s))
+        LOG_ERROR("Error: can't write %s\n", stateFileName);
+    if (f)
+        f.close();
+}
+
+void PhoneInbox::loadState()
+{
+    SavedState s;
+    bool okay = false;
+    auto f = FSCom.open(stateFileName, FILE_O_READ);
+    if (f) {
+        okay = f.read((uint8_t *)&s, sizeof(s)) == (int)sizeof(s) && s.magic == STATE_MAGIC;
+        f.close();
+    }
+    // With no record of how far the phones got, they get everything again (and drop what they already have)
+    drainSeq = okay ? s.drainSeq : firstSeq;
+    if ((int32_t)(drainSeq - firstSeq) < 0 || (int32_t)(nextSeq - drainSeq) < 0)
+        drainSeq = firstSeq;
+}
+#else
+void PhoneInbox::saveState() {}
+
+void PhoneInbox::loadState() {}
+#endif
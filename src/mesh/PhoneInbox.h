@@ -0,0 +1,123 @@
+#pragma once
+
+#include "configuration.h"
+#include "mesh-pb-constants.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Keep the text messages we receive on flash too, so a phone which was away doesn't lose them (see PhoneInbox).  Opt in with
+/// -DPHONE_INBOX=1
+#ifndef PHONE_INBOX
+#define PHONE_INBOX 0
+#endif
+
+/// How many messages our inbox holds, once full the oldest is written over
+#ifndef PHONE_INBOX_SLOTS
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define PHONE_INBOX_SLOTS 256
+#else
+#define PHONE_INBOX_SLOTS 32
+#endif
+#endif
+
+/// The S&F history a client asks for when its request doesn't give a window, the same as StoreForwardModule's default
+#ifndef PHONE_INBOX_HISTORY_WINDOW_MINS
+#define PHONE_INBOX_HISTORY_WINDOW_MINS 240
+#endif
+
+/**
+ * The text messages we received, kept on flash for phones which weren't connected when they came.  A phone away for a day
+ * otherwise gets at most MAX_RX_TOPHONE of them from MeshService, and asks a Store & Forward server for the rest, spending
+ * airtime on messages its own node already heard.
+ *
+ * Every text message (broadcast or direct) we receive is appended here, with the RTC time it came.  While a phone downloads
+ * them as they come, they are marked delivered as they're appended; otherwise they wait here rather than in RAM, and a phone
+ * which connects downloads them (from the oldest) before anything in the toPhone queue.  The file is a ring of
+ * PHONE_INBOX_SLOTS fixed size slots, so appending a message is one write of one slot, and after a reboot we find our
+ * messages again by their seqs and CRCs.  How far we delivered is saved whenever a phone catches up or goes away, so at worst a
+ * reboot has a phone download a few messages again, which it already drops as duplicates.
+ *
+ * Since we heard everything since we booted (and have kept it, back to the newest message we wrote over), a phone asking a
+ * S&F server for the history of a window we cover needn't ask anyone: MeshService::handleToRadio() gives the request to
+ * answerHistoryRequest(), which has the phone download the window from us again instead.
+ */
+class PhoneInbox
+{
+    /// What each slot starts with, the encoded MeshPacket follows
+    struct Header {
+        uint16_t magic;
+        uint16_t len;
+        uint32_t seq; // counting from 1, every message we ever appended
+        uint32_t epoch;
+        uint32_t crc; // of all of this (with crc 0) and the packet
+    };
+    static const uint16_t HEADER_MAGIC = 0x5049;
+    static const size_t SLOT_SIZE = sizeof(Header) + meshtastic_MeshPacket_size;
+
+    /// The messages we hold are seqs firstSeq up to (not including) nextSeq, seq s in slot (s - 1) % PHONE_INBOX_SLOTS
+    uint32_t firstSeq = 1, nextSeq = 1;
+    /// The oldest message a phone is yet to download
+    uint32_t drainSeq = 1;
+    /// The first seq we appended this boot, the ones before came while we were off or before a reboot
+    uint32_t bootSeq = 1;
+    /// When each slot's message came, so we find a window without reading the file
+    uint32_t epochs[PHONE_INBOX_SLOTS] = {};
+    /// How many slots the file has so far
+    uint32_t fileSlots = 0;
+    /// The newest message we wrote over, we only cover the time after it
+    uint32_t lostEpoch = 0;
+    bool ready = false;
+
+    uint32_t numStored = 0, numLost = 0, numAnswered = 0;
+
+    static uint32_t crcSlot(const Header &h, const uint8_t *packet);
+
+    /// Read the slot for seq, @return false if it doesn't hold a whole message with that seq
+    bool readSlot(uint32_t seq, Header &h, uint8_t *packet);
+
+    void saveState();
+    void loadState();
+
+  public:
+    /// Find the messages we left on flash, @return false if we can't keep an inbox
+    bool init();
+
+    bool isReady() const { return ready; }
+
+    /// @return true if we keep p for the phones
+    static bool wants(const meshtastic_MeshPacket &p);
+
+    /// Append p, already downloaded by a phone if delivered.  @return false if it couldn't be written
+    bool append(const meshtastic_MeshPacket &p, bool delivered);
+
+    /// @return true if we hold messages a phone is yet to download
+    bool hasPending() const { return drainSeq != nextSeq; }
+
+    /// Copy the oldest message a phone is yet to download to out, and mark it delivered.  @return false if there is none
+    bool nextPending(meshtastic_MeshPacket &out);
+
+    /// A phone went away (or caught up), remember how far it got
+    void checkpoint()
+    {
+        if (ready)
+            saveState();
+    }
+
+    /// @return true if we have every text message we received from sinceEpoch until now
+    bool covers(uint32_t sinceEpoch) const;
+
+    /**
+     * If p is a S&F history request we can answer from what we hold, have the phones download that window again.  @return true
+     * if so, so the request needn't go out
+     */
+    bool answerHistoryRequest(const meshtastic_MeshPacket &p);
+
+    uint32_t getNumMessages() const { return nextSeq - firstSeq; }
+    uint32_t getNumStored() const { return numStored; }
+
+    /// How many messages we wrote over before a phone downloaded them
+    uint32_t getNumLost() const { return numLost; }
+
+    /// How many S&F history requests we answered ourselves
+    uint32_t getNumAnswered() const { return numAnswered; }
+};
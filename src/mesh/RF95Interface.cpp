@@ -20,6 +20,8 @@ RF95Interface::RF95Interface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE cs, RADIO
     : RadioLibInterface(hal, cs, irq, rst, busy)
 {
     LOG_WARN("RF95Interface(cs=%d, irq=%d, rst=%d, busy=%d)\n", cs, irq, rst, busy);
+    spiProbeRegister = RADIOLIB_SX127X_REG_VERSION;
+    spiProbeLen = 1;
 }
 
 /** Some boards require GPIO control of tx vs rx paths */
@@ -28,16 +30,16 @@ void RF95Interface::setTransmitEnable(bool txon)
 #ifdef RF95_TXEN
     digitalWrite(RF95_TXEN, txon ? 1 : 0);
 #elif ARCH_PORTDUINO
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[txen], txon ? 1 : 0);
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.txen, txon ? 1 : 0);
     }
 #endif
 
 #ifdef RF95_RXEN
     digitalWrite(RF95_RXEN, txon ? 0 : 1);
 #elif ARCH_PORTDUINO
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[rxen], txon ? 0 : 1);
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.rxen, txon ? 0 : 1);
     }
 #endif
 }
@@ -76,13 +78,13 @@ bool RF95Interface::init()
     digitalWrite(RF95_RXEN, 1);
 #endif
 #if ARCH_PORTDUINO
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        pinMode(settingsMap[txen], OUTPUT);
-        digitalWrite(settingsMap[txen], 0);
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        pinMode(portduinoSettings.txen, OUTPUT);
+        digitalWrite(portduinoSettings.txen, 0);
     }
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        pinMode(settingsMap[rxen], OUTPUT);
-        digitalWrite(settingsMap[rxen], 0);
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        pinMode(portduinoSettings.rxen, OUTPUT);
+        digitalWrite(portduinoSettings.rxen, 0);
     }
 #endif
     setTransmitEnable(false);
@@ -155,10 +157,15 @@ bool RF95Interface::reconfigure()
 /**
  * Add SNR data to received messages
  */
-void RF95Interface::addReceiveMetadata(meshtastic_MeshPacket *mp)
+void RF95Interface::getReceiveMetadata(float &snr, int32_t &rssi)
 {
-    mp->rx_snr = lora->getSNR();
-    mp->rx_rssi = lround(lora->getRSSI());
+    snr = lora->getSNR();
+    rssi = lround(lora->getRSSI());
+}
+
+bool RF95Interface::setTxPower(int8_t dBm)
+{
+    return lora->setOutputPower(dBm) == RADIOLIB_ERR_NONE;
 }
 
 void RF95Interface::setStandby()
@@ -190,7 +197,7 @@ void RF95Interface::startReceive()
     isReceiving = true;
 
     // Must be done AFTER, starting receive, because startReceive clears (possibly stale) interrupt pending register bits
-    enableInterrupt(isrRxLevel0);
+    armInterrupt(isrRxLevel0);
 }
 
 bool RF95Interface::isChannelActive()
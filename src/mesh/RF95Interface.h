@@ -56,7 +56,9 @@ class RF95Interface : public RadioLibInterface
     /**
      * Add SNR data to received messages
      */
-    virtual void addReceiveMetadata(meshtastic_MeshPacket *mp) override;
+    virtual void getReceiveMetadata(float &snr, int32_t &rssi) override;
+
+    virtual bool setTxPower(int8_t dBm) override;
 
     virtual void setStandby() override;
 
@@ -0,0 +1,172 @@
+#include "RadioDetect.h"
+#include "FSCommon.h"
+#include "LLCC68Interface.h"
+#include "RF95Interface.h"
+#include "SX1262Interface.h"
+#include "SX1268Interface.h"
+#include "SX1280Interface.h"
+#include <ErriezCRC32.h>
+#ifdef ARCH_STM32WL
+#include "STM32WLE5JCInterface.h"
+#endif
+
+/// Every chip we know.  Their numbers are saved, so only ever add to the end
+enum RadioChip : uint8_t { CHIP_NONE, CHIP_STM32WL, CHIP_RF95, CHIP_SX1262, CHIP_SX1268, CHIP_LLCC68, CHIP_SX1280, NUM_CHIPS };
+
+static const char *chipNames[NUM_CHIPS] = {"none", "STM32WL", "RF95", "SX1262", "SX1268", "LLCC68", "SX1280"};
+
+/// The chips this build can drive, in the order we try them
+static const RadioChip supportedChips[] = {
+#if defined(USE_STM32WLx)
+    CHIP_STM32WL,
+#endif
+#if defined(RF95_IRQ)
+    CHIP_RF95,
+#endif
+#if defined(USE_SX1262) && !defined(ARCH_PORTDUINO)
+    CHIP_SX1262,
+#endif
+#if defined(USE_SX1268)
+    CHIP_SX1268,
+#endif
+#if defined(USE_LLCC68)
+    CHIP_LLCC68,
+#endif
+#if defined(USE_SX1280)
+    CHIP_SX1280,
+#endif
+    CHIP_NONE, // last, so there's always one
+};
+
+/// Make the interface for chip, if this build supports it
+static RadioInterface *newRadio(RadioChip chip, LockingArduinoHal *hal)
+{
+    switch (chip) {
+#if defined(USE_STM32WLx)
+    case CHIP_STM32WL:
+        return new STM32WLE5JCInterface(hal, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
+#endif
+#if defined(RF95_IRQ)
+    case CHIP_RF95:
+        return new RF95Interface(hal, LORA_CS, RF95_IRQ, RF95_RESET, RF95_DIO1);
+#endif
+#if defined(USE_SX1262) && !defined(ARCH_PORTDUINO)
+    case CHIP_SX1262:
+        return new SX1262Interface(hal, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
+#endif
+#if defined(USE_SX1268)
+    case CHIP_SX1268:
+        return new SX1268Interface(hal, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
+#endif
+#if defined(USE_LLCC68)
+    case CHIP_LLCC68:
+        return new LLCC68Interface(hal, SX126X_CS, SX126X_DIO1, SX126X_RESET, SX126X_BUSY);
+#endif
+#if defined(USE_SX1280)
+    case CHIP_SX1280:
+        return new SX1280Interface(hal, SX128X_CS, SX128X_DIO1, SX128X_RESET, SX128X_BUSY);
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/// Try chip.  @return its interface, initialised, or NULL if it isn't there (or this build doesn't support it)
+static RadioInterface *tryRadio(RadioChip chip, LockingArduinoHal *hal)
+{
+    RadioInterface *rIf = newRadio(chip, hal);
+    if (!rIf)
+        return NULL;
+    if (!rIf->init()) {
+        LOG_WARN("Failed to find %s radio\n", chipNames[chip]);
+        delete rIf;
+        return NULL;
+    }
+    LOG_INFO("%s Radio init succeeded, using %s radio\n", chipNames[chip], chipNames[chip]);
+    return rIf;
+}
+
+#if RADIO_DETECT_CACHE
+static const char *radioCacheFileName = "/prefs/radio.dat";
+
+#define RADIO_CACHE_MAGIC 0x52414430 // "RAD0"
+
+struct RadioCacheFile {
+    uint32_t magic;
+    uint32_t fingerprint;
+    uint8_t chip;
+};
+
+static uint32_t getHardwareFingerprint()
+{
+    // Our board, the chips this build looks for and the firmware
+    const char *version = optstr(APP_VERSION);
+    int32_t vendor = HW_VENDOR;
+    uint32_t crc = crc32Update(&vendor, sizeof(vendor), 0xffffffff);
+    crc = crc32Update(supportedChips, sizeof(supportedChips), crc);
+    return crc32Final(crc32Update(version, strlen(version), crc));
+}
+
+static RadioChip loadChip()
+{
+#ifdef FSCom
+    RadioCacheFile c;
+    auto f = FSCom.open(radioCacheFileName, FILE_O_READ);
+    if (!f)
+        return CHIP_NONE;
+    bool okay = f.read((uint8_t *)&c, sizeof(c)) == (int)sizeof(c) && c.magic == RADIO_CACHE_MAGIC &&
+                c.fingerprint == getHardwareFingerprint() && c.chip < NUM_CHIPS;
+    f.close();
+    return okay ? (RadioChip)c.chip : CHIP_NONE;
+#else
+    return CHIP_NONE;
+#endif
+}
+
+static void saveChip(RadioChip chip)
+{
+#ifdef FSCom
+    RadioCacheFile c = {};
+    c.magic = RADIO_CACHE_MAGIC;
+    c.fingerprint = getHardwareFingerprint();
+    c.chip = chip;
+
+    FSCom.mkdir("/prefs");
+    if (FSCom.exists(radioCacheFileName))
+        FSCom.remove(radioCacheFileName); // not every platform's FILE_O_WRITE truncates
+    auto f = FSCom.open(radioCacheFileName, FILE_O_WRITE);
+    bool okay = f && f.write((const uint8_t *)&c, sizeof(c)) == sizeof(c);
+    if (f)
+        f.close();
+    if (!okay)
+        LOG_ERROR("Error: can't write %s\n", radioCacheFileName);
+#endif
+}
+#endif
+
+RadioInterface *detectRadio(LockingArduinoHal *hal)
+{
+    RadioChip cached = CHIP_NONE;
+#if RADIO_DETECT_CACHE
+    cached = loadChip();
+    if (cached != CHIP_NONE) {
+        LOG_DEBUG("Trying the %s radio we found last boot\n", chipNames[cached]);
+        RadioInterface *rIf = tryRadio(cached, hal);
+        if (rIf)
+            return rIf;
+    }
+#endif
+
+    for (RadioChip c : supportedChips) {
+        if (c == cached)
+            continue; // it just failed
+        RadioInterface *rIf = tryRadio(c, hal);
+        if (rIf) {
+#if RADIO_DETECT_CACHE
+            saveChip(c);
+#endif
+            return rIf;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "RadioLibInterface.h"
+#include "configuration.h"
+
+/// Remember which radio chip we found (in /prefs/radio.dat), so the next boot tries it before any other
+#ifndef RADIO_DETECT_CACHE
+#define RADIO_DETECT_CACHE 1
+#endif
+
+/**
+ * Find our radio: each chip this build supports is tried in turn (STM32WL, RF95, SX1262, SX1268, LLCC68, then SX1280) until
+ * one inits, and each that isn't there costs us its driver's timeouts.  So the one we found is remembered, with a
+ * fingerprint of our board and firmware, and the next boot inits it first; only if that fails do we go on to try the rest.
+ *
+ * @return the radio, initialised, or NULL if there's none
+ */
+RadioInterface *detectRadio(LockingArduinoHal *hal);
@@ -2,14 +2,29 @@
 #include "Channels.h"
 #include "MeshRadio.h"
 #include "MeshService.h"
+#include "ModemPresets.h"
+#include "NextHopTable.h"
 #include "NodeDB.h"
+#include "RTC.h"
 #include "Router.h"
 #include "configuration.h"
 #include "main.h"
+#include "modules/NeighborInfoModule.h"
 #include "sleep.h"
+#include <algorithm>
 #include <assert.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
+#include <stdarg.h>
+
+// How often getTxDelayMsecWeighted() checks whether our neighbors have changed enough to rebuild its table
+#define FLOOD_CW_TABLE_CHECK_MSECS (60 * 1000)
+
+// Nodes heard within this long count as neighbors (when NeighborInfoModule doesn't know enough of them)
+#define FLOOD_NEIGHBOR_MAX_AGE_SECS (2 * 60 * 60)
+
+// Below this many neighbors we know too little about SNRs around here, and spread over the whole FLOOD_SNR_MIN..MAX range
+#define FLOOD_MIN_NEIGHBORS 3
 
 #define RDEF(name, freq_start, freq_end, duty_cycle, spacing, power_limit, audio_permitted, frequency_switching, wide_lora)      \
     {                                                                                                                            \
@@ -144,8 +159,6 @@ const RegionInfo regions[] = {
 
 const RegionInfo *myRegion;
 
-static uint8_t bytes[MAX_RHPACKETLEN];
-
 void initRegion()
 {
     const RegionInfo *r = regions;
@@ -169,144 +182,323 @@ separated by 2.16 MHz with respect to the adjacent channels. Channel zero starts
 // 1kb was too small
 #define RADIO_STACK_SIZE 4096
 
-/**
- * Calculate airtime per
- * https://www.rs-online.com/designspark/rel-assets/ds-assets/uploads/knowledge-items/application-notes-for-the-internet-of-things/LoRa%20Design%20Guide.pdf
- * section 4
- *
- * @return num msecs for the packet
- */
-uint32_t RadioInterface::getPacketTime(uint32_t pl)
+/// @return num msecs for the packet, see loraPacketMsec()
+uint32_t RadioInterface::computePacketTime(uint32_t pl)
 {
-    float bandwidthHz = bw * 1000.0f;
-    bool headDisable = false; // we currently always use the header
-    float tSym = (1 << sf) / bandwidthHz;
+    return loraPacketMsec(sf, bw, cr, preambleLength, pl);
+}
 
-    bool lowDataOptEn = tSym > 16e-3 ? true : false; // Needed if symbol time is >16ms
+void RadioInterface::buildPacketTimeTable()
+{
+    for (uint32_t pl = 0; pl <= MAX_RHPACKETLEN; pl++)
+        packetTimeTable[pl] = computePacketTime(pl);
 
-    float tPreamble = (preambleLength + 4.25f) * tSym;
-    float numPayloadSym =
-        8 + max(ceilf(((8.0f * pl - 4 * sf + 28 + 16 - 20 * headDisable) / (4 * (sf - 2 * lowDataOptEn))) * cr), 0.0f);
-    float tPayload = numPayloadSym * tSym;
-    float tPacket = tPreamble + tPayload;
+    packetTimeTableBw = bw;
+    packetTimeTableSf = sf;
+    packetTimeTableCr = cr;
+    packetTimeTablePreambleLength = preambleLength;
 
-    uint32_t msecs = tPacket * 1000;
+    LOG_DEBUG("(bw=%d, sf=%d, cr=4/%d) packet time %u ms (empty) to %u ms (%d bytes)\n", (int)bw, sf, cr, packetTimeTable[0],
+              packetTimeTable[MAX_RHPACKETLEN], MAX_RHPACKETLEN);
+}
 
-    LOG_DEBUG("(bw=%d, sf=%d, cr=4/%d) packet symLen=%d ms, payloadSize=%u, time %d ms\n", (int)bw, sf, cr, (int)(tSym * 1000),
-              pl, msecs);
-    return msecs;
+uint32_t RadioInterface::getPacketTime(uint32_t pl)
+{
+    // Some radios tweak their settings (preamble length) after applyModemConfig(), so double check our table still applies
+    if (bw != packetTimeTableBw || sf != packetTimeTableSf || cr != packetTimeTableCr ||
+        preambleLength != packetTimeTablePreambleLength)
+        buildPacketTimeTable();
+
+    return (pl <= MAX_RHPACKETLEN) ? packetTimeTable[pl] : computePacketTime(pl);
 }
 
-uint32_t RadioInterface::getPacketTime(const meshtastic_MeshPacket *p)
+uint32_t RadioInterface::getPacketLength(const meshtastic_MeshPacket *p)
 {
-    uint32_t pl = 0;
+    size_t numbytes;
     if (p->which_payload_variant == meshtastic_MeshPacket_encrypted_tag) {
-        pl = p->encrypted.size + sizeof(PacketHeader);
-    } else {
-        size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
-        pl = numbytes + sizeof(PacketHeader);
+        numbytes = p->encrypted.size;
+    } else if (!pb_get_encoded_size(&numbytes, &meshtastic_Data_msg, &p->decoded)) {
+        numbytes = meshtastic_Constants_DATA_PAYLOAD_LEN; // can't happen, but assume the worst
     }
-    return getPacketTime(pl);
+    return numbytes + sizeof(PacketHeader);
+}
+
+uint32_t RadioInterface::getPacketTime(const meshtastic_MeshPacket *p)
+{
+    return getPacketTime(getPacketLength(p));
 }
 
 /** The delay to use for retransmitting dropped packets */
 uint32_t RadioInterface::getRetransmissionMsec(const meshtastic_MeshPacket *p)
 {
-    size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
-    uint32_t packetAirtime = getPacketTime(numbytes + sizeof(PacketHeader));
+    return getRetransmissionMsecForAirtime(getPacketTime(p));
+}
+
+uint32_t RadioInterface::getRetransmissionMsecForAirtime(uint32_t packetAirtime)
+{
     // Make sure enough time has elapsed for this packet to be sent and an ACK is received.
     // LOG_DEBUG("Waiting for flooding message with airtime %d and slotTime is %d\n", packetAirtime, slotTimeMsec);
-    float channelUtil = airTime->channelUtilizationPercent();
-    uint8_t CWsize = map(channelUtil, 0, 100, CWmin, CWmax);
+    float channelUtil = airTime->channelBusyPercent();
+    uint8_t CWsize = adaptCWsize(map(channelUtil, 0, 100, CWmin, CWmax), false);
     // Assuming we pick max. of CWsize and there will be a client with SNR at half the range
-    return 2 * packetAirtime + (pow(2, CWsize) + 2 * CWmax + pow(2, int((CWmax + CWmin) / 2))) * slotTimeMsec +
+    return 2 * packetAirtime +
+           (pow(2, CWsize) + 2 * CWmax + pow(2, int((CWmax + CWmin) / 2))) * contention.adjustSlotTime(slotTimeMsec) +
            PROCESSING_TIME_MSEC;
 }
 
+uint8_t RadioInterface::adaptCWsize(uint8_t CWsize, bool flooding)
+{
+    int adapted = CWsize + contention.getCWBias(flooding);
+    return constrain(adapted, CWmin - 1, CWmax + 2);
+}
+
 /** The delay to use when we want to send something */
 uint32_t RadioInterface::getTxDelayMsec()
 {
     /** We wait a random multiple of 'slotTimes' (see definition in header file) in order to avoid collisions.
     The pool to take a random multiple from is the contention window (CW), which size depends on the
     current channel utilization. */
-    float channelUtil = airTime->channelUtilizationPercent();
-    uint8_t CWsize = map(channelUtil, 0, 100, CWmin, CWmax);
+    float channelUtil = airTime->channelBusyPercent();
+    uint8_t CWsize = adaptCWsize(map(channelUtil, 0, 100, CWmin, CWmax), false);
     // LOG_DEBUG("Current channel utilization is %f so setting CWsize to %d\n", channelUtil, CWsize);
-    return random(0, pow(2, CWsize)) * slotTimeMsec;
+    return random(0, pow(2, CWsize)) * contention.adjustSlotTime(slotTimeMsec);
 }
 
-/** The delay to use when we want to flood a message */
-uint32_t RadioInterface::getTxDelayMsecWeighted(float snr)
+void RadioInterface::updateFloodCWTable()
 {
-    // The minimum value for a LoRa SNR
-    const uint32_t SNR_MIN = -20;
+    bool isBuilt = floodCWTableCheckMsec != 0;
+    floodCWTableCheckMsec = millis();
+    if (!floodCWTableCheckMsec)
+        floodCWTableCheckMsec = 1; // 0 means never
+
+    // How many of our neighbors we hear at each SNR.  The ones NeighborInfoModule knows are our real (0 hop) neighbors, but
+    // it only learns them from other nodes' NeighborInfo, so we fall back on everyone NodeDB has heard lately
+    uint16_t histogram[FLOOD_SNR_MAX - FLOOD_SNR_MIN + 1] = {};
+    uint16_t numNeighbors = 0;
+    auto count = [&](float snr) {
+        histogram[constrain((int)roundf(snr), FLOOD_SNR_MIN, FLOOD_SNR_MAX) - FLOOD_SNR_MIN]++;
+        numNeighbors++;
+    };
+
+    if (neighborInfoModule && neighborInfoModule->getNumNeighbors() >= FLOOD_MIN_NEIGHBORS) {
+        for (size_t i = 0; i < neighborInfoModule->getNumNeighbors(); i++)
+            count(neighborInfoModule->getNeighborByIndex(i)->snr);
+    } else {
+        uint32_t now = getTime();
+        for (size_t i = 0; i < nodeDB.getNumMeshNodes(); i++) {
+            const MeshNodeSummary &node = nodeDB.getMeshNodeSummaryByIndex(i);
+            if (node.num != nodeDB.getNodeNum() && node.snr != 0 && now - node.last_heard < FLOOD_NEIGHBOR_MAX_AGE_SECS)
+                count(node.snr);
+        }
+    }
 
-    // The maximum value for a LoRa SNR
-    const uint32_t SNR_MAX = 15;
+    // Spread the window over the middle 80% of those SNRs (or everything, if we know too few neighbors), so we tell apart
+    // the neighbors we actually have rather than the whole range LoRa can do
+    int8_t lowSnr = FLOOD_SNR_MIN, highSnr = FLOOD_SNR_MAX;
+    if (numNeighbors >= FLOOD_MIN_NEIGHBORS) {
+        uint16_t seen = 0;
+        bool haveLow = false;
+        for (int8_t i = 0; i <= FLOOD_SNR_MAX - FLOOD_SNR_MIN; i++) {
+            seen += histogram[i];
+            if (!haveLow && seen > numNeighbors / 10) {
+                lowSnr = FLOOD_SNR_MIN + i;
+                haveLow = true;
+            }
+            if (seen >= numNeighbors - numNeighbors / 10) {
+                highSnr = FLOOD_SNR_MIN + i;
+                break;
+            }
+        }
+        // At least a few dB apart, or a little fading would swing us from one end of the window to the other
+        if (highSnr - lowSnr < 6) {
+            lowSnr = constrain((lowSnr + highSnr) / 2 - 3, FLOOD_SNR_MIN, FLOOD_SNR_MAX - 6);
+            highSnr = lowSnr + 6;
+        }
+    }
+
+    if (isBuilt && numNeighbors == floodCWTableNeighbors && lowSnr == floodCWTableLowSnr && highSnr == floodCWTableHighSnr)
+        return;
+
+    // More neighbors means more of them racing to rebroadcast each packet, so the closest ones get a wider window to keep
+    // them out of the way of the edge nodes: one more for 8 and two more for 16 or more
+    uint8_t densityBonus = numNeighbors >= 16 ? 2 : numNeighbors >= 8 ? 1 : 0;
 
     //  high SNR = large CW size (Long Delay)
     //  low SNR = small CW size (Short Delay)
+    for (int8_t i = 0; i <= FLOOD_SNR_MAX - FLOOD_SNR_MIN; i++)
+        floodCWTable[i] = map(constrain(FLOOD_SNR_MIN + i, lowSnr, highSnr), lowSnr, highSnr, CWmin, CWmax + densityBonus);
+    floodCWTableMax = CWmax + densityBonus;
+
+    LOG_DEBUG("Flood contention window now CW %u..%u over snr %d..%d, from %u neighbors\n", CWmin, floodCWTableMax, lowSnr,
+              highSnr, numNeighbors);
+    floodCWTableNeighbors = numNeighbors;
+    floodCWTableLowSnr = lowSnr;
+    floodCWTableHighSnr = highSnr;
+}
+
+/** The delay to use when we want to flood a message */
+uint32_t RadioInterface::getTxDelayMsecWeighted(float snr)
+{
+    if (!floodCWTableCheckMsec || millis() - floodCWTableCheckMsec > FLOOD_CW_TABLE_CHECK_MSECS)
+        updateFloodCWTable();
+
     uint32_t delay = 0;
-    uint8_t CWsize = map(snr, SNR_MIN, SNR_MAX, CWmin, CWmax);
+    uint8_t CWsize =
+        adaptCWsize(floodCWTable[constrain((int)roundf(snr), FLOOD_SNR_MIN, FLOOD_SNR_MAX) - FLOOD_SNR_MIN], true);
+    uint32_t slotMsec = contention.adjustSlotTime(slotTimeMsec);
     // LOG_DEBUG("rx_snr of %f so setting CWsize to:%d\n", snr, CWsize);
     if (config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER ||
         config.device.role == meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT ||
         config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER) {
-        delay = random(0, 2 * CWsize) * slotTimeMsec;
+        delay = random(0, 2 * CWsize) * slotMsec;
         LOG_DEBUG("rx_snr found in packet. As a router, setting tx delay:%d\n", delay);
     } else {
-        // offset the maximum delay for routers: (2 * CWmax * slotTimeMsec)
-        delay = (2 * CWmax * slotTimeMsec) + random(0, pow(2, CWsize)) * slotTimeMsec;
+        // offset the maximum delay for routers: (2 * CWmax * slotMsec), or more if ours is stretched (theirs probably is too)
+        uint8_t routerCWmax = max(floodCWTableMax, adaptCWsize(floodCWTableMax, true));
+        delay = (2 * routerCWmax * slotMsec) + random(0, 1L << CWsize) * slotMsec;
         LOG_DEBUG("rx_snr found in packet. Setting tx delay:%d\n", delay);
     }
 
     return delay;
 }
 
-void printPacket(const char *prefix, const meshtastic_MeshPacket *p)
+bool RadioInterface::getSlottedTxDelayMsec(PacketId id, uint32_t &delay)
 {
-#ifdef DEBUG_PORT
-    std::string out = DEBUG_PORT.mt_sprintf("%s (id=0x%08x fr=0x%02x to=0x%02x, WantAck=%d, HopLim=%d Ch=0x%x", prefix, p->id,
-                                            p->from & 0xff, p->to & 0xff, p->want_ack, p->hop_limit, p->channel);
-    if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-        auto &s = p->decoded;
-
-        out += DEBUG_PORT.mt_sprintf(" Portnum=%d", s.portnum);
+#if USE_SLOTTED_REBROADCAST
+    if (config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER &&
+        config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT &&
+        config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER)
+        return false;
+    uint64_t nowMsec;
+    if (!getPpsTimeMsec(nowMsec))
+        return false;
+
+    // A different slot for each router (two share one for a packet 1 in SLOTTED_REBROADCAST_SLOTS times) and for each packet,
+    // so no router is always the last to go.  Our slots are slotTimeMsec as it is, without contention's stretching, as
+    // everyone on this modem config must agree on them
+    uint32_t h = nodeDB.getNodeNum() ^ (id * 0x9e3779b9UL);
+    h ^= h >> 16;
+    h *= 0x85ebca6bUL;
+    h ^= h >> 13;
+    uint32_t frameMsec = SLOTTED_REBROADCAST_SLOTS * slotTimeMsec;
+    uint32_t slotStart = (h % SLOTTED_REBROADCAST_SLOTS) * slotTimeMsec;
+    delay = (slotStart + frameMsec - (uint32_t)(nowMsec % frameMsec)) % frameMsec;
+    LOG_DEBUG("Rebroadcast in slot %u of %u, tx delay:%d\n", h % SLOTTED_REBROADCAST_SLOTS, SLOTTED_REBROADCAST_SLOTS, delay);
+    return true;
+#else
+    return false;
+#endif
+}
 
-        if (s.want_response)
-            out += DEBUG_PORT.mt_sprintf(" WANTRESP");
+#ifdef DEBUG_PORT
+/// What printPacket() shows of a packet, copied into the log and only formatted once it's written out
+struct PacketLogLine {
+    const char *prefix; // always a string literal
+    uint32_t id, from, to, source, dest, requestId, rxTime;
+    float rxSnr;
+    int32_t rxRssi;
+    uint16_t portnum;
+    uint8_t hopLimit, channel, priority;
+    bool wantAck, decoded, wantResponse, viaMqtt;
+};
 
-        if (s.source != 0)
-            out += DEBUG_PORT.mt_sprintf(" source=%08x", s.source);
+/// snprintf() onto the end of buf, never past bufLen
+static void appendf(char *buf, size_t bufLen, size_t &len, const char *format, ...)
+{
+    if (len >= bufLen)
+        return;
+    va_list arg;
+    va_start(arg, format);
+    int n = vsnprintf(buf + len, bufLen - len, format, arg);
+    va_end(arg);
+    if (n > 0)
+        len = std::min(len + n, bufLen - 1);
+}
 
-        if (s.dest != 0)
-            out += DEBUG_PORT.mt_sprintf(" dest=%08x", s.dest);
+static size_t formatPacketLogLine(const void *data, char *buf, size_t bufLen)
+{
+    const PacketLogLine &l = *(const PacketLogLine *)data;
+    size_t len = 0;
+    appendf(buf, bufLen, len, "%s (id=0x%08x fr=0x%02x to=0x%02x, WantAck=%d, HopLim=%d Ch=0x%x", l.prefix, l.id,
+            l.from & 0xff, l.to & 0xff, l.wantAck, l.hopLimit, l.channel);
+    if (l.decoded) {
+        appendf(buf, bufLen, len, " Portnum=%d", l.portnum);
+        if (l.wantResponse)
+            appendf(buf, bufLen, len, " WANTRESP");
+        if (l.source != 0)
+            appendf(buf, bufLen, len, " source=%08x", l.source);
+        if (l.dest != 0)
+            appendf(buf, bufLen, len, " dest=%08x", l.dest);
+        if (l.requestId)
+            appendf(buf, bufLen, len, " requestId=%0x", l.requestId);
+    } else {
+        appendf(buf, bufLen, len, " encrypted");
+    }
 
-        if (s.request_id)
-            out += DEBUG_PORT.mt_sprintf(" requestId=%0x", s.request_id);
+    if (l.rxTime != 0)
+        appendf(buf, bufLen, len, " rxtime=%u", l.rxTime);
+    if (l.rxSnr != 0.0)
+        appendf(buf, bufLen, len, " rxSNR=%g", l.rxSnr);
+    if (l.rxRssi != 0)
+        appendf(buf, bufLen, len, " rxRSSI=%i", l.rxRssi);
+    if (l.viaMqtt)
+        appendf(buf, bufLen, len, " via MQTT");
+    if (l.priority != 0)
+        appendf(buf, bufLen, len, " priority=%d", l.priority);
+
+    // Cut short if need be, but always a whole line
+    appendf(buf, bufLen, len, ")\n");
+    if (len == bufLen - 1)
+        buf[len - 1] = '\n';
+    return len;
+}
+#endif
 
-        /* now inside Data and therefore kinda opaque
-        if (s.which_ackVariant == SubPacket_success_id_tag)
-            out += DEBUG_PORT.mt_sprintf(" successId=%08x", s.ackVariant.success_id);
-        else if (s.which_ackVariant == SubPacket_fail_id_tag)
-            out += DEBUG_PORT.mt_sprintf(" failId=%08x", s.ackVariant.fail_id); */
-    } else {
-        out += " encrypted";
+void printPacket(const char *prefix, const meshtastic_MeshPacket *p)
+{
+#ifdef DEBUG_PORT
+    PacketLogLine l = {};
+    l.prefix = prefix;
+    l.id = p->id;
+    l.from = p->from;
+    l.to = p->to;
+    l.wantAck = p->want_ack;
+    l.hopLimit = p->hop_limit;
+    l.channel = p->channel;
+    if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+        auto &s = p->decoded;
+        l.decoded = true;
+        l.portnum = s.portnum;
+        l.wantResponse = s.want_response;
+        l.source = s.source;
+        l.dest = s.dest;
+        l.requestId = s.request_id;
     }
+    l.rxTime = p->rx_time;
+    l.rxSnr = p->rx_snr;
+    l.rxRssi = p->rx_rssi;
+    l.viaMqtt = p->via_mqtt;
+    l.priority = p->priority;
+    DEBUG_PORT.logLazy(MESHTASTIC_LOG_LEVEL_DEBUG, formatPacketLogLine, &l, sizeof(l));
+#endif
+}
 
-    if (p->rx_time != 0)
-        out += DEBUG_PORT.mt_sprintf(" rxtime=%u", p->rx_time);
-    if (p->rx_snr != 0.0)
-        out += DEBUG_PORT.mt_sprintf(" rxSNR=%g", p->rx_snr);
-    if (p->rx_rssi != 0)
-        out += DEBUG_PORT.mt_sprintf(" rxRSSI=%i", p->rx_rssi);
-    if (p->via_mqtt != 0)
-        out += DEBUG_PORT.mt_sprintf(" via MQTT");
-    if (p->priority != 0)
-        out += DEBUG_PORT.mt_sprintf(" priority=%d", p->priority);
-
-    out += ")";
-    LOG_DEBUG("%s\n", out.c_str());
+void printPacket(const char *prefix, const WirePacket *p)
+{
+#ifdef DEBUG_PORT
+    PacketLogLine l = {};
+    l.prefix = prefix;
+    l.id = p->header.id;
+    l.from = p->header.from;
+    l.to = p->header.to;
+    l.wantAck = !!(p->header.flags & PACKET_FLAGS_WANT_ACK_MASK);
+    l.hopLimit = p->getHopLimit();
+    l.channel = p->header.channel;
+    l.rxSnr = p->rx_snr;
+    l.rxRssi = p->rx_rssi;
+    l.viaMqtt = !!(p->header.flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    l.priority = p->priority;
+    DEBUG_PORT.logLazy(MESHTASTIC_LOG_LEVEL_DEBUG, formatPacketLogLine, &l, sizeof(l));
 #endif
 }
 
@@ -402,48 +594,11 @@ void RadioInterface::applyModemConfig()
     meshtastic_Config_LoRaConfig &loraConfig = config.lora;
     if (loraConfig.use_preset) {
 
-        switch (loraConfig.modem_preset) {
-        case meshtastic_Config_LoRaConfig_ModemPreset_SHORT_FAST:
-            bw = (myRegion->wideLora) ? 812.5 : 250;
-            cr = 5;
-            sf = 7;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_SHORT_SLOW:
-            bw = (myRegion->wideLora) ? 812.5 : 250;
-            cr = 5;
-            sf = 8;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_MEDIUM_FAST:
-            bw = (myRegion->wideLora) ? 812.5 : 250;
-            cr = 5;
-            sf = 9;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_MEDIUM_SLOW:
-            bw = (myRegion->wideLora) ? 812.5 : 250;
-            cr = 5;
-            sf = 10;
-            break;
-        default: // Config_LoRaConfig_ModemPreset_LONG_FAST is default. Gracefully use this is preset is something illegal.
-            bw = (myRegion->wideLora) ? 812.5 : 250;
-            cr = 5;
-            sf = 11;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_LONG_MODERATE:
-            bw = (myRegion->wideLora) ? 406.25 : 125;
-            cr = 8;
-            sf = 11;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_LONG_SLOW:
-            bw = (myRegion->wideLora) ? 406.25 : 125;
-            cr = 8;
-            sf = 12;
-            break;
-        case meshtastic_Config_LoRaConfig_ModemPreset_VERY_LONG_SLOW:
-            bw = (myRegion->wideLora) ? 203.125 : 62.5;
-            cr = 8;
-            sf = 12;
-            break;
-        }
+        const ModemPresetInfo &preset = getModemPreset(loraConfig.modem_preset, myRegion->wideLora);
+        bw = preset.bw;
+        cr = preset.cr;
+        sf = preset.sf;
+        slotTimeMsec = preset.slotTimeMsec;
     } else {
         sf = loraConfig.spread_factor;
         cr = loraConfig.coding_rate;
@@ -461,6 +616,7 @@ void RadioInterface::applyModemConfig()
             bw = 812.5;
         if (bw == 1600)
             bw = 1625.0;
+        slotTimeMsec = loraSlotTimeMsec(sf, bw);
     }
 
     power = loraConfig.tx_power;
@@ -499,9 +655,17 @@ void RadioInterface::applyModemConfig()
     saveChannelNum(channel_num);
     saveFreq(freq + loraConfig.frequency_offset);
 
+    buildPacketTimeTable();
     preambleTimeMsec = getPacketTime((uint32_t)0);
     maxPacketTimeMsec = getPacketTime(meshtastic_Constants_DATA_PAYLOAD_LEN + sizeof(PacketHeader));
 
+    // However a preamble lines up with our listen/sleep cycle it must still cover one whole listen window, so the worst case
+    // (starting just after a window opened, too late to be caught by it) is listen + sleep + listen <= preamble
+    float symbolUsec = (1 << sf) * 1000.0f / bw;
+    rxDutyCycleWakeUsec = RX_DUTY_CYCLE_MIN_SYMBOLS * symbolUsec;
+    float sleepUsec = (preambleLength - 2 * RX_DUTY_CYCLE_MIN_SYMBOLS) * symbolUsec - RX_DUTY_CYCLE_WAKE_USEC;
+    rxDutyCycleSleepUsec = sleepUsec >= RX_DUTY_CYCLE_WAKE_USEC ? sleepUsec : 0; // not worth waking up for less
+
     LOG_INFO("Radio freq=%.3f, config.lora.frequency_offset=%.3f\n", freq, loraConfig.frequency_offset);
     LOG_INFO("Set radio: region=%s, name=%s, config=%u, ch=%d, power=%d\n", myRegion->name, channelName, loraConfig.modem_preset,
              channel_num, power);
@@ -539,34 +703,112 @@ void RadioInterface::deliverToReceiver(meshtastic_MeshPacket *p)
 }
 
 /***
- * given a packet set sendingPacket and decode the protobufs into radiobuf.  Returns # of payload bytes to send
+ * given a packet set sendingPacket and copy it into radiobuf.  Returns # of bytes to send (including the PacketHeader)
  */
-size_t RadioInterface::beginSending(meshtastic_MeshPacket *p)
+size_t RadioInterface::beginSending(WirePacket *p)
 {
     assert(!sendingPacket);
 
     // LOG_DEBUG("sending queued packet on mesh (txGood=%d,rxGood=%d,rxBad=%d)\n", rf95.txGood(), rf95.rxGood(), rf95.rxBad());
-    assert(p->which_payload_variant == meshtastic_MeshPacket_encrypted_tag); // It should have already been encoded by now
-
     lastTxStart = millis();
 
-    PacketHeader *h = (PacketHeader *)radiobuf;
+    memcpy(radiobuf, &p->header, sizeof(PacketHeader));
+    memcpy(radiobuf + sizeof(PacketHeader), p->payload, p->size);
 
+    sendingPacket = p;
+    return p->getLength();
+}
+
+#if USE_STATIC_PACKET_POOL
+/// Enough for a full TX queue, the packet on the air, one on its way into the queue and an aggregate being put together
+#define MAX_WIRE_PACKETS (MAX_TX_QUEUE + 3)
+
+static MemoryPool<WireSlab, MAX_WIRE_PACKETS> wirePool;
+#endif
+
+WirePacket *WirePacket::alloc(size_t size)
+{
+    assert(size <= MAX_RHPACKETLEN - sizeof(PacketHeader));
+#if USE_STATIC_PACKET_POOL
+    return (WirePacket *)wirePool.allocZeroed(0);
+#else
+    return (WirePacket *)malloc(sizeof(WirePacket) + size); // there's heap to spare, so just what we need
+#endif
+}
+
+void WirePacket::release(WirePacket *w)
+{
+#if USE_STATIC_PACKET_POOL
+    wirePool.release((WireSlab *)w);
+#else
+    free(w);
+#endif
+}
+
+WirePacket *WirePacket::fromMeshPacket(const meshtastic_MeshPacket *p)
+{
+    assert(p->which_payload_variant == meshtastic_MeshPacket_encrypted_tag); // It should have already been encoded by now
+
+    WirePacket *w = alloc(p->encrypted.size);
+    if (!w)
+        return NULL;
+
+    PacketHeader *h = &w->header;
     h->from = p->from;
     h->to = p->to;
     h->id = p->id;
     h->channel = p->channel;
-    if (p->hop_limit > HOP_MAX) {
-        LOG_WARN("hop limit %d is too high, setting to %d\n", p->hop_limit, HOP_RELIABLE);
-        p->hop_limit = HOP_RELIABLE;
+    uint8_t hopLimit = p->hop_limit;
+    if (hopLimit > HOP_MAX) {
+        LOG_WARN("hop limit %d is too high, setting to %d\n", hopLimit, HOP_RELIABLE);
+        hopLimit = HOP_RELIABLE;
     }
-    h->flags = p->hop_limit | (p->want_ack ? PACKET_FLAGS_WANT_ACK_MASK : 0) | (p->via_mqtt ? PACKET_FLAGS_VIA_MQTT_MASK : 0);
+    h->flags = hopLimit | (p->want_ack ? PACKET_FLAGS_WANT_ACK_MASK : 0) | (p->via_mqtt ? PACKET_FLAGS_VIA_MQTT_MASK : 0);
+#if USE_PACKET_AGGREGATION
+    h->flags |= PACKET_FLAGS_AGGREGATE_OK_MASK; // let everyone who hears us know we can unpack aggregate frames
+#endif
+    if (nextHops.isRouted(p->from, p->id))
+        h->flags |= PACKET_FLAGS_ROUTED_MASK;
 
     // if the sender nodenum is zero, that means uninitialized
     assert(h->from);
 
-    memcpy(radiobuf + sizeof(PacketHeader), p->encrypted.bytes, p->encrypted.size);
+    w->rx_snr = p->rx_snr;
+    w->rx_rssi = p->rx_rssi;
+    w->queuedMsec = millis();
 
-    sendingPacket = p;
-    return p->encrypted.size + sizeof(PacketHeader);
+    // Some clients might not properly set priority, therefore we fix it here (we can't see the portnum anymore, acks we
+    // generate ourselves already have their priority set)
+    w->priority = p->priority;
+    if (w->priority == meshtastic_MeshPacket_Priority_UNSET)
+        w->priority = p->want_ack ? meshtastic_MeshPacket_Priority_RELIABLE : meshtastic_MeshPacket_Priority_DEFAULT;
+
+    w->size = p->encrypted.size;
+    memcpy(w->payload, p->encrypted.bytes, p->encrypted.size);
+
+    return w;
+}
+
+meshtastic_MeshPacket *WirePacket::toMeshPacket() const
+{
+    meshtastic_MeshPacket *p = packetPool.tryAllocZeroed();
+    if (!p)
+        return NULL;
+
+    p->from = header.from;
+    p->to = header.to;
+    p->id = header.id;
+    p->channel = header.channel;
+    p->hop_limit = getHopLimit();
+    p->want_ack = !!(header.flags & PACKET_FLAGS_WANT_ACK_MASK);
+    p->via_mqtt = !!(header.flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    p->rx_snr = rx_snr;
+    p->rx_rssi = rx_rssi;
+    p->priority = (meshtastic_MeshPacket_Priority)priority;
+
+    p->which_payload_variant = meshtastic_MeshPacket_encrypted_tag;
+    memcpy(p->encrypted.bytes, payload, size);
+    p->encrypted.size = size;
+
+    return p;
 }
@@ -1,18 +1,63 @@
 #pragma once
 
+#include "ContentionController.h"
 #include "MemoryPool.h"
+#include "ModemPresets.h"
 #include "MeshTypes.h"
 #include "Observer.h"
 #include "PointerQueue.h"
 #include "airtime.h"
 
-#define MAX_TX_QUEUE 16 // max number of packets which can be waiting for transmission
+// max number of packets which can be waiting for transmission
+#ifndef MAX_TX_QUEUE
+#ifdef ARCH_NRF52
+#define MAX_TX_QUEUE 32 // queued packets are much smaller than MeshPackets (see WirePacket), so we can afford more
+#else
+#define MAX_TX_QUEUE 16
+#endif
+#endif
 
 #define MAX_RHPACKETLEN 256
 
+// The SNRs (in whole dB) getTxDelayMsecWeighted() tells apart, anything beyond counts as the nearest end
+#define FLOOD_SNR_MIN -20
+#define FLOOD_SNR_MAX 15
+
+/// Rebroadcasts from our infrastructure roles go out in a slot picked from our NodeNum and the packet id, on the time base
+/// our GPS's PPS gives us, rather than after a random contention delay (see getSlottedTxDelayMsec()), opt in with
+/// -DUSE_SLOTTED_REBROADCAST=1
+#ifndef USE_SLOTTED_REBROADCAST
+#define USE_SLOTTED_REBROADCAST 0
+#endif
+
+/// How many slots (of slotTimeMsec) a slotted rebroadcast picks from, by default as many as a router's contention window
+#ifndef SLOTTED_REBROADCAST_SLOTS
+#define SLOTTED_REBROADCAST_SLOTS (2 * LORA_CW_MAX)
+#endif
+
+/// Our own background traffic (telemetry, node and neighbor info, store and forward replays: anything queued at
+/// Priority_BACKGROUND or below) waits in the TX queue while AirTime says the channel is busier than its polite
+/// threshold, so it doesn't compete with messages people are waiting for.  Opt out with -DUSE_TX_DEFERRAL=0
+#ifndef USE_TX_DEFERRAL
+#define USE_TX_DEFERRAL 1
+#endif
+
+/// How often a deferred packet looks at the channel again
+#ifndef TX_DEFER_RECHECK_MSEC
+#define TX_DEFER_RECHECK_MSEC (5 * 1000)
+#endif
+
+/// The longest a packet is deferred for, after that it goes out (contending as usual) however busy the channel is
+#ifndef TX_DEFER_MAX_SECS
+#define TX_DEFER_MAX_SECS (5 * 60)
+#endif
+
 #define PACKET_FLAGS_HOP_MASK 0x07
 #define PACKET_FLAGS_WANT_ACK_MASK 0x08
 #define PACKET_FLAGS_VIA_MQTT_MASK 0x10
+#define PACKET_FLAGS_AGGREGATE_OK_MASK 0x20 // the radio which sent this frame can unpack aggregate frames
+#define PACKET_FLAGS_AGGREGATE_MASK 0x40    // this frame holds several packets, see RadioLibInterface::aggregate()
+#define PACKET_FLAGS_ROUTED_MASK 0x80       // only the nodes on the route we learned should pass this on, see NextHopTable
 
 /**
  * This structure has to exactly match the wire layout when sent over the radio link.  Used to keep compatibility
@@ -34,6 +79,52 @@ typedef struct {
     uint8_t channel;
 } PacketHeader;
 
+/**
+ * A packet which is ready to go on the air, this is what we keep in our TX queue.
+ *
+ * Once a packet has been encrypted there is nothing left of it but a header and some encrypted bytes, so rather than
+ * holding on to a whole meshtastic_MeshPacket we keep the header exactly as it will be sent, the little bit of radio
+ * metadata the TX path needs and only as many payload bytes as the packet really has.
+ */
+struct WirePacket {
+    PacketHeader header;
+
+    /// How well we heard this packet if we are relaying it (used to weight our TX delay), both 0 if we made it ourselves
+    float rx_snr;
+    int32_t rx_rssi;
+
+    uint32_t queuedMsec; // when we were made (just before going in the TX queue), for RadioStats
+
+    uint8_t priority; // a meshtastic_MeshPacket_Priority
+    uint8_t size;     // number of bytes in payload
+
+    /// The encrypted payload, WirePackets are allocated with room for at least size bytes (see alloc())
+    uint8_t payload[];
+
+    /// @return a new WirePacket with room for size payload bytes (up to a whole frame), or NULL if we are out of memory.
+    /// With USE_STATIC_PACKET_POOL every one is a max size slab from a fixed pool, so a busy TX queue never fragments the heap
+    static WirePacket *alloc(size_t size);
+
+    /// @return a new WirePacket for p (which must already be encrypted), or NULL if we are out of memory
+    static WirePacket *fromMeshPacket(const meshtastic_MeshPacket *p);
+
+    /// Free a WirePacket made by alloc() or fromMeshPacket()
+    static void release(WirePacket *w);
+
+    /// @return a MeshPacket (from packetPool) holding our still encrypted contents, or NULL if the pool is empty
+    meshtastic_MeshPacket *toMeshPacket() const;
+
+    uint8_t getHopLimit() const { return header.flags & PACKET_FLAGS_HOP_MASK; }
+
+    /// @return the number of bytes we take on the air (header included)
+    uint32_t getLength() const { return sizeof(PacketHeader) + size; }
+};
+
+/// Room for a WirePacket of the biggest frame we can send (an aggregate included), what WirePacket::alloc() hands out
+struct WireSlab {
+    alignas(WirePacket) uint8_t bytes[sizeof(WirePacket) + MAX_RHPACKETLEN - sizeof(PacketHeader)];
+};
+
 /**
  * Basic operations all radio chipsets must implement.
  *
@@ -58,21 +149,59 @@ class RadioInterface
     float bw = 125;
     uint8_t sf = 9;
     uint8_t cr = 5;
-    /** Slottime is the minimum time to wait, consisting of:
-      - CAD duration (maximum of SX126x and SX127x);
-      - roundtrip air propagation time (assuming max. 30km between nodes);
-      - Tx/Rx turnaround time (maximum of SX126x and SX127x);
-      - MAC processing time (measured on T-beam) */
-    uint32_t slotTimeMsec = 8.5 * pow(2, sf) / bw + 0.2 + 0.4 + 7;
-    uint16_t preambleLength = 16;      // 8 is default, but we use longer to increase the amount of sleep time when receiving
+    /// See loraSlotTimeMsec(), set for our modem config by applyModemConfig()
+    uint32_t slotTimeMsec = loraSlotTimeMsec(sf, bw);
+    uint16_t preambleLength = LORA_PREAMBLE_LENGTH;
     uint32_t preambleTimeMsec = 165;   // calculated on startup, this is the default for LongFast
     uint32_t maxPacketTimeMsec = 3246; // calculated on startup, this is the default for LongFast
+
+    /// Symbols the receiver must listen for to be sure of detecting a preamble
+    static const uint8_t RX_DUTY_CYCLE_MIN_SYMBOLS = 6;
+
+    /// Time the receiver needs to come back from its sleep phase, taken off every sleep period
+    static const uint32_t RX_DUTY_CYCLE_WAKE_USEC = 1000;
+
+    /**
+     * Low power listening for radios which support it (see USE_SX126X_RX_DUTY_CYCLE), worked out in applyModemConfig():
+     * listen for rxDutyCycleWakeUsec, then sleep for rxDutyCycleSleepUsec.  A sleep of 0 means our preamble is too short to
+     * sleep at all with this modem config, so we must listen continuously.
+     */
+    uint32_t rxDutyCycleWakeUsec = 0, rxDutyCycleSleepUsec = 0;
+
+    /// Airtime in msecs for every possible packet length, rebuilt whenever the modem settings change (see getPacketTime())
+    uint32_t packetTimeTable[MAX_RHPACKETLEN + 1];
+
+    /// The modem settings packetTimeTable was built for (bw == 0 means it hasn't been built yet)
+    float packetTimeTableBw = 0;
+    uint8_t packetTimeTableSf = 0, packetTimeTableCr = 0;
+    uint16_t packetTimeTablePreambleLength = 0;
     const uint32_t PROCESSING_TIME_MSEC =
         4500;                // time to construct, process and construct a packet again (empirically determined)
-    const uint8_t CWmin = 2; // minimum CWsize
-    const uint8_t CWmax = 8; // maximum CWsize
+    const uint8_t CWmin = LORA_CW_MIN; // minimum CWsize
+    const uint8_t CWmax = LORA_CW_MAX; // maximum CWsize
+
+    /**
+     * Flood contention window (CWsize, before ContentionController's bias) for each SNR from FLOOD_SNR_MIN to FLOOD_SNR_MAX,
+     * spread over the SNRs we actually hear our neighbors at, see updateFloodCWTable()
+     */
+    uint8_t floodCWTable[FLOOD_SNR_MAX - FLOOD_SNR_MIN + 1];
+    uint8_t floodCWTableMax = CWmax; // the biggest entry, for the router offset
+
+    /// When we last looked at our neighbors for floodCWTable (0 for never), and what we built it from
+    uint32_t floodCWTableCheckMsec = 0;
+    uint16_t floodCWTableNeighbors = 0;
+    int8_t floodCWTableLowSnr = 0, floodCWTableHighSnr = 0;
+
+    /// Rebuild floodCWTable if our neighbors (their number or the SNRs we hear them at) have changed
+    void updateFloodCWTable();
 
-    meshtastic_MeshPacket *sendingPacket = NULL; // The packet we are currently sending
+    /// Tunes our contention window from what actually happens to our packets (see ContentionController)
+    ContentionController contention;
+
+    /// @return CWsize moved by what contention has learned, kept within one below CWmin to two above CWmax
+    uint8_t adaptCWsize(uint8_t CWsize, bool flooding);
+
+    WirePacket *sendingPacket = NULL; // The packet we are currently sending
     uint32_t lastTxStart = 0L;
 
     /**
@@ -126,8 +255,14 @@ class RadioInterface
         return qs;
     }
 
-    /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-    virtual bool cancelSending(NodeNum from, PacketId id) { return false; }
+    /** Return how many more packets our TX queue can take right now (cheaper than getQueueStatus()) */
+    virtual size_t getFreeTxSlots() { return 0; }
+
+    /**
+     * Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel, and if airtimeMsec is
+     * given sets it to how long that packet would have been on the air
+     */
+    virtual bool cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec = NULL) { return false; }
 
     // methods from radiohead
 
@@ -144,12 +279,29 @@ class RadioInterface
     /** The delay to use for retransmitting dropped packets */
     uint32_t getRetransmissionMsec(const meshtastic_MeshPacket *p);
 
+    /// So the routers can feed it what they see happening to our packets
+    ContentionController &getContention() { return contention; }
+
+    /** The delay to use for retransmitting a dropped packet, if we already know its airtime (see getPacketTime()) */
+    uint32_t getRetransmissionMsecForAirtime(uint32_t packetAirtime);
+
     /** The delay to use when we want to send something */
     uint32_t getTxDelayMsec();
 
-    /** The delay to use when we want to flood a message. Use a weighted scale based on SNR */
+    /**
+     * The delay to use when we want to flood a message. Use a weighted scale based on SNR: the further away (weaker) the
+     * sender was, compared to our other neighbors, the sooner we pass it on, as we'll reach more nodes it couldn't
+     */
     uint32_t getTxDelayMsecWeighted(float snr);
 
+    /**
+     * With USE_SLOTTED_REBROADCAST, for a router, repeater or router client with a PPS time base: set delay to how long
+     * until our slot for rebroadcasting packet id.  Frames of SLOTTED_REBROADCAST_SLOTS slots follow each other on the time
+     * base every GPS node shares, so routers which heard the same packet pick different slots rather than racing each other
+     * in one contention window.  @return false if we should use getTxDelayMsecWeighted() instead (clients keep CSMA)
+     */
+    bool getSlottedTxDelayMsec(PacketId id, uint32_t &delay);
+
     /**
      * Calculate airtime per
      * https://www.rs-online.com/designspark/rel-assets/ds-assets/uploads/knowledge-items/application-notes-for-the-internet-of-things/LoRa%20Design%20Guide.pdf
@@ -158,8 +310,12 @@ class RadioInterface
      * @return num msecs for the packet
      */
     uint32_t getPacketTime(const meshtastic_MeshPacket *p);
+    uint32_t getPacketTime(const WirePacket *p) { return getPacketTime(p->getLength()); }
     uint32_t getPacketTime(uint32_t totalPacketLen);
 
+    /// @return the number of bytes p will take on the air (header included), without encoding it into a buffer
+    static uint32_t getPacketLength(const meshtastic_MeshPacket *p);
+
     /**
      * Get the channel we saved.
      */
@@ -173,6 +329,10 @@ class RadioInterface
     /// Some boards (1st gen Pinetab Lora module) have broken IRQ wires, so we need to poll via i2c registers
     virtual bool isIRQPending() { return false; }
 
+    /// Time ops burst reads of our radio's registers over SPI, the least each call into its driver costs us.  @return
+    /// nanoseconds per read, 0 if we can't (no radio on SPI, or none with a register we may read at any time)
+    virtual uint32_t timeSpiRead(uint32_t ops) { return 0; }
+
   protected:
     int8_t power = 17; // Set by applyModemConfig()
 
@@ -180,12 +340,12 @@ class RadioInterface
     uint32_t savedChannelNum;
 
     /***
-     * given a packet set sendingPacket and decode the protobufs into radiobuf.  Returns # of bytes to send (including the
+     * given a packet set sendingPacket and copy it into radiobuf.  Returns # of bytes to send (including the
      * PacketHeader & payload).
      *
      * Used as the first step of
      */
-    size_t beginSending(meshtastic_MeshPacket *p);
+    size_t beginSending(WirePacket *p);
 
     /**
      * Some regulatory regions limit xmit power.
@@ -203,6 +363,12 @@ class RadioInterface
      */
     virtual void saveChannelNum(uint32_t savedChannelNum);
 
+    /**
+     * Do the actual airtime math for a packet of pl bytes (slow, use getPacketTime() instead).  This is the LoRa formula,
+     * radios running some other modulation override it.
+     */
+    virtual uint32_t computePacketTime(uint32_t pl);
+
   private:
     /**
      * Convert our modemConfig enum into wf, sf, etc...
@@ -211,6 +377,9 @@ class RadioInterface
      */
     void applyModemConfig();
 
+    /// Fill packetTimeTable for our current modem settings
+    void buildPacketTimeTable();
+
     /// Return 0 if sleep is okay
     int preflightSleepCb(void *unused = NULL) { return canSleep() ? 0 : 1; }
 
@@ -225,3 +394,4 @@ class RadioInterface
 
 /// Debug printing for packets
 void printPacket(const char *prefix, const meshtastic_MeshPacket *p);
+void printPacket(const char *prefix, const WirePacket *p);
@@ -1,33 +1,45 @@
 #include "RadioLibInterface.h"
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "MeshTypes.h"
+#include "Metrics.h"
 #include "NodeDB.h"
+#include "PacketCapture.h"
+#include "PacketTrace.h"
+#include "RadioStats.h"
+#include "Router.h"
 #include "SPILock.h"
+#include "TxPowerControl.h"
 #include "configuration.h"
 #include "error.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
+#include "sleep.h"
+#include <algorithm>
 #include <pb_decode.h>
 #include <pb_encode.h>
 
 void LockingArduinoHal::spiBeginTransaction()
 {
-    spiLock->lock();
+    spiArbiter->acquire(SPI_CLIENT_RADIO);
 
     ArduinoHal::spiBeginTransaction();
 }
 
 void LockingArduinoHal::spiEndTransaction()
 {
-    spiLock->unlock();
+    spiArbiter->release(SPI_CLIENT_RADIO);
 
     ArduinoHal::spiEndTransaction();
 }
 
 RadioLibInterface::RadioLibInterface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE cs, RADIOLIB_PIN_TYPE irq, RADIOLIB_PIN_TYPE rst,
                                      RADIOLIB_PIN_TYPE busy, PhysicalLayer *_iface)
-    : NotifiedWorkerThread("RadioIf"), module(hal, cs, irq, rst, busy), iface(_iface)
+    : NotifiedWorkerThread("RadioIf", &concurrency::packetController), module(hal, cs, irq, rst, busy), iface(_iface),
+      channelSampler(this)
 {
     instance = this;
+    setPriority(PRIORITY_RADIO); // ahead of anything else due, so we never keep the radio waiting
 #if defined(ARCH_STM32WL) && defined(USE_SX1262)
     module.setCb_digitalWrite(stm32wl_emulate_digitalWrite);
     module.setCb_digitalRead(stm32wl_emulate_digitalRead);
@@ -44,6 +56,8 @@ RadioLibInterface::RadioLibInterface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE c
 void INTERRUPT_ATTR RadioLibInterface::isrLevel0Common(PendingISR cause)
 {
     instance->disableInterrupt();
+    instance->isrMsec = millis();
+    instance->isrUsec = micros();
 
     BaseType_t xHigherPriorityTaskWoken;
     instance->notifyFromISR(&xHigherPriorityTaskWoken, cause, true);
@@ -68,6 +82,13 @@ void INTERRUPT_ATTR RadioLibInterface::isrTxLevel0()
  */
 RadioLibInterface *RadioLibInterface::instance;
 
+void RadioLibInterface::armInterrupt(void (*callback)())
+{
+    enableInterrupt(callback);
+    // Should our ISR beat us to it, its detach also disabled the pin's interrupt: a level can then only wake us, once
+    radioInterruptArmed();
+}
+
 /** Could we send right now (i.e. either not actively receiving or transmitting)? */
 bool RadioLibInterface::canSendImmediately()
 {
@@ -109,12 +130,14 @@ ErrorCode RadioLibInterface::send(meshtastic_MeshPacket *p)
         if (disabled || !config.lora.tx_enabled) {
             LOG_WARN("send - !config.lora.tx_enabled\n");
             packetPool.release(p);
+            radioStats.countError(RadioStats::TX_DISABLED);
             return ERRNO_DISABLED;
         }
 
     } else {
         LOG_WARN("send - lora tx disable because RegionCode_Unset\n");
         packetPool.release(p);
+        radioStats.countError(RadioStats::TX_DISABLED);
         return ERRNO_DISABLED;
     }
 
@@ -123,6 +146,7 @@ ErrorCode RadioLibInterface::send(meshtastic_MeshPacket *p)
     if (disabled || !config.lora.tx_enabled) {
         LOG_WARN("send - !config.lora.tx_enabled\n");
         packetPool.release(p);
+        radioStats.countError(RadioStats::TX_DISABLED);
         return ERRNO_DISABLED;
     }
 
@@ -132,13 +156,25 @@ ErrorCode RadioLibInterface::send(meshtastic_MeshPacket *p)
 #ifndef LORA_DISABLE_SENDING
     printPacket("enqueuing for send", p);
 
-    LOG_DEBUG("txGood=%d,rxGood=%d,rxBad=%d\n", txGood, rxGood, rxBad);
-    ErrorCode res = txQueue.enqueue(p) ? ERRNO_OK : ERRNO_UNKNOWN;
+    LOG_DEBUG("txGood=%d,rxGood=%d,rxBad=%d,poolFree=%d,poolMaxUsed=%d,poolFailures=%u\n", txGood, rxGood, rxBad,
+              packetPool.getFree(), packetPool.getMaxUsed(), packetPool.getAllocFailures());
+
+    // Once encrypted all we need to keep is what goes on the air, so swap p for its compact form
+    WirePacket *w = WirePacket::fromMeshPacket(p);
+    packetPool.release(p);
+    if (!w) {
+        LOG_WARN("Out of memory, dropping tx packet\n");
+        return ERRNO_UNKNOWN;
+    }
+
+    ErrorCode res = txQueue.enqueue(w) ? ERRNO_OK : ERRNO_UNKNOWN;
 
     if (res != ERRNO_OK) { // we weren't able to queue it, so we must drop it to prevent leaks
-        packetPool.release(p);
+        radioStats.countError(RadioStats::TX_QUEUE_FULL);
+        WirePacket::release(w);
         return res;
     }
+    PACKET_TRACE_MARK(w->header.from, w->header.id, TX_ENQUEUE);
 
     // set (random) transmit delay to let others reconfigure their radio,
     // to avoid collisions and implement timing-based flooding
@@ -159,6 +195,7 @@ meshtastic_QueueStatus RadioLibInterface::getQueueStatus()
     qs.res = qs.mesh_packet_id = 0;
     qs.free = txQueue.getFree();
     qs.maxlen = txQueue.getMaxLen();
+    txQueue.printDropped(); // QueueStatus has no room for these, so at least get them into the log
 
     return qs;
 }
@@ -172,12 +209,28 @@ bool RadioLibInterface::canSleep()
     return res;
 }
 
+uint32_t RadioLibInterface::timeSpiRead(uint32_t ops)
+{
+    if (!spiProbeLen || !ops)
+        return 0;
+
+    uint8_t buf[32];
+    size_t len = std::min<size_t>(spiProbeLen, sizeof(buf));
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < ops; i++)
+        module.SPIreadRegisterBurst(spiProbeRegister, len, buf);
+    return (uint64_t)(micros() - start) * 1000 / ops;
+}
+
 /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-bool RadioLibInterface::cancelSending(NodeNum from, PacketId id)
+bool RadioLibInterface::cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec)
 {
     auto p = txQueue.remove(from, id);
-    if (p)
-        packetPool.release(p); // free the packet we just removed
+    if (p) {
+        if (airtimeMsec)
+            *airtimeMsec = getPacketTime(p);
+        WirePacket::release(p); // free the packet we just removed
+    }
 
     bool result = (p != NULL);
     LOG_DEBUG("cancelSending id=0x%x, removed=%d\n", id, result);
@@ -189,10 +242,13 @@ We never immediately transmit after any operation (either Rx or Tx). Instead we
 'slotTimes' (see definition in RadioInterface.h) taken from a contention window (CW) to lower the chance of collision.
 The CW size is determined by setTransmitDelay() and depends either on the current channel utilization or SNR in case
 of a flooding message. After this, we perform channel activity detection (CAD) and reset the transmit delay if it is
-currently active.
+currently active.  Background traffic at the front of the queue first waits for the channel to quieten (see shouldDefer()).
 */
 void RadioLibInterface::onNotify(uint32_t notification)
 {
+    if (notification == ISR_TX || notification == ISR_RX)
+        radioStats.record(inNotifyTask() ? RadioStats::ISR_DIRECT : RadioStats::ISR_DEFERRED, micros() - isrUsec);
+
     switch (notification) {
     case ISR_TX:
         handleTransmitInterrupt();
@@ -216,19 +272,42 @@ void RadioLibInterface::onNotify(uint32_t notification)
                 // LOG_DEBUG("Currently Rx/Tx-ing: set random delay\n");
                 setTransmitDelay(); // currently Rx/Tx-ing: reset random delay
             } else {
-                if (isChannelActive()) { // check if there is currently a LoRa packet on the channel
+                bool relaying = txQueue.getFront()->header.from != nodeDB.getNodeNum();
+                if (shouldDefer(txQueue.getFront())) {
+                    // Nothing more urgent is waiting (it would be at the front), so look again once the channel has had
+                    // a while to calm down.  send() cuts this short if something more urgent turns up
+                    txDeferring = true;
+                    metrics.count(Metrics::TX_DEFERRED);
+                    notifyLater(TX_DEFER_RECHECK_MSEC, TRANSMIT_DELAY_COMPLETED, false);
+                } else if (isChannelActive()) { // check if there is currently a LoRa packet on the channel
                     // LOG_DEBUG("Channel is active, try receiving first.\n");
+                    contention.onChannelBusy();
+                    if (relaying)
+                        metrics.count(txDelaySlotted ? Metrics::REBROADCAST_BUSY_SLOTTED : Metrics::REBROADCAST_BUSY_CSMA);
                     startReceive(); // try receiving this packet, afterwards we'll be trying to transmit again
                     setTransmitDelay();
                 } else {
+                    contention.onChannelClear();
+                    if (relaying)
+                        metrics.count(txDelaySlotted ? Metrics::REBROADCAST_SLOTTED : Metrics::REBROADCAST_CSMA);
+
                     // Send any outgoing packets we have ready
-                    meshtastic_MeshPacket *txp = txQueue.dequeue();
+                    WirePacket *txp = txQueue.dequeue();
                     assert(txp);
+                    radioStats.record(RadioStats::TX_QUEUE, millis() - txp->queuedMsec);
+#if USE_PACKET_AGGREGATION
+                    txp = aggregate(txp);
+#endif
+                    // Work this out before startSend(), which might free txp
+                    uint32_t xmitMsec = getPacketTime(txp);
+                    NodeNum from = txp->header.from;
+                    bool relayed = from != nodeDB.getNodeNum();
                     startSend(txp);
 
                     // Packet has been sent, count it toward our TX airtime utilization.
-                    uint32_t xmitMsec = getPacketTime(txp);
                     airTime->logAirtime(TX_LOG, xmitMsec);
+                    airTime->logNodeAirtime(from, xmitMsec);
+                    energyStats.addTx(xmitMsec, lastTxPower, relayed);
                 }
             }
         } else {
@@ -242,7 +321,7 @@ void RadioLibInterface::onNotify(uint32_t notification)
 
 void RadioLibInterface::setTransmitDelay()
 {
-    meshtastic_MeshPacket *p = txQueue.getFront();
+    WirePacket *p = txQueue.getFront();
     // We want all sending/receiving to be done by our daemon thread.
     // We use a delay here because this packet might have been sent in response to a packet we just received.
     // So we want to make sure the other side has had a chance to reconfigure its radio.
@@ -251,35 +330,63 @@ void RadioLibInterface::setTransmitDelay()
      *   This assumption is valid because of the offset generated by the radio to account for the noise
      *   floor.
      */
+    uint32_t slotDelay;
+    txDelaySlotted = false;
+    // A deferred packet's recheck may be a while off, whatever we are timing now shouldn't wait for it
+    bool overwrite = txDeferring;
+    txDeferring = false;
     if (p->rx_snr == 0 && p->rx_rssi == 0) {
-        startTransmitTimer(true);
+        startTransmitTimer(true, overwrite);
+    } else if (getSlottedTxDelayMsec(p->header.id, slotDelay)) {
+        txDelaySlotted = true;
+        radioStats.record(RadioStats::TX_DELAY, slotDelay);
+        notifyLater(slotDelay, TRANSMIT_DELAY_COMPLETED, overwrite); // This will implicitly enable
     } else {
         // If there is a SNR, start a timer scaled based on that SNR.
-        LOG_DEBUG("rx_snr found. hop_limit:%d rx_snr:%f\n", p->hop_limit, p->rx_snr);
-        startTransmitTimerSNR(p->rx_snr);
+        LOG_DEBUG("rx_snr found. hop_limit:%d rx_snr:%f\n", p->getHopLimit(), p->rx_snr);
+        startTransmitTimerSNR(p->rx_snr, overwrite);
     }
 }
 
-void RadioLibInterface::startTransmitTimer(bool withDelay)
+void RadioLibInterface::startTransmitTimer(bool withDelay, bool overwrite)
 {
     // If we have work to do and the timer wasn't already scheduled, schedule it now
     if (!txQueue.empty()) {
         uint32_t delay = !withDelay ? 1 : getTxDelayMsec();
+        radioStats.record(RadioStats::TX_DELAY, delay);
         // LOG_DEBUG("xmit timer %d\n", delay);
-        notifyLater(delay, TRANSMIT_DELAY_COMPLETED, false); // This will implicitly enable
+        notifyLater(delay, TRANSMIT_DELAY_COMPLETED, overwrite); // This will implicitly enable
     }
 }
 
-void RadioLibInterface::startTransmitTimerSNR(float snr)
+void RadioLibInterface::startTransmitTimerSNR(float snr, bool overwrite)
 {
     // If we have work to do and the timer wasn't already scheduled, schedule it now
     if (!txQueue.empty()) {
         uint32_t delay = getTxDelayMsecWeighted(snr);
+        radioStats.record(RadioStats::TX_DELAY, delay);
         // LOG_DEBUG("xmit timer %d\n", delay);
-        notifyLater(delay, TRANSMIT_DELAY_COMPLETED, false); // This will implicitly enable
+        notifyLater(delay, TRANSMIT_DELAY_COMPLETED, overwrite); // This will implicitly enable
     }
 }
 
+bool RadioLibInterface::shouldDefer(const WirePacket *p)
+{
+#if USE_TX_DEFERRAL
+    if (p->priority > meshtastic_MeshPacket_Priority_BACKGROUND || !airTime || airTime->isTxAllowedChannelUtil(true))
+        return false;
+    if (millis() - p->queuedMsec >= TX_DEFER_MAX_SECS * 1000) {
+        LOG_DEBUG("Background packet 0x%08x has waited %us for a quieter channel, sending it anyway\n", p->header.id,
+                  TX_DEFER_MAX_SECS);
+        metrics.count(Metrics::TX_DEFER_EXPIRED);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void RadioLibInterface::handleTransmitInterrupt()
 {
     // LOG_DEBUG("handling lora TX interrupt\n");
@@ -298,10 +405,11 @@ void RadioLibInterface::completeSending()
 
     if (p) {
         txGood++;
+        PACKET_TRACE_MARK(p->header.from, p->header.id, TX_DONE);
         printPacket("Completed sending", p);
 
         // We are done sending that packet, release it
-        packetPool.release(p);
+        WirePacket::release(p);
         // LOG_DEBUG("Done with send\n");
     }
 }
@@ -319,6 +427,11 @@ void RadioLibInterface::handleReceiveInterrupt()
 
     isReceiving = false;
 
+    uint32_t latency = millis() - isrMsec;
+    radioStats.record(RadioStats::ISR_LATENCY, latency);
+    const LatencyHistogram &h = radioStats.getHistogram(RadioStats::ISR_LATENCY);
+    LOG_DEBUG("RX handled %ums after interrupt (avg %ums, max %ums)\n", latency, h.getAverage(), h.getMax());
+
     // read the number of actually received bytes
     size_t length = iface->getPacketLength();
 
@@ -328,6 +441,7 @@ void RadioLibInterface::handleReceiveInterrupt()
     if (state != RADIOLIB_ERR_NONE) {
         LOG_ERROR("ignoring received packet due to error=%d\n", state);
         rxBad++;
+        radioStats.countError(RadioStats::RX_READ_FAILED);
 
         airTime->logAirtime(RX_ALL_LOG, xmitMsec);
 
@@ -340,62 +454,228 @@ void RadioLibInterface::handleReceiveInterrupt()
         if (payloadLen < 0) {
             LOG_WARN("ignoring received packet too short\n");
             rxBad++;
+            radioStats.countError(RadioStats::RX_TOO_SHORT);
             airTime->logAirtime(RX_ALL_LOG, xmitMsec);
         } else {
-            const PacketHeader *h = (PacketHeader *)radiobuf;
+            PacketHeader h;
+            memcpy(&h, radiobuf, sizeof(h));
             rxGood++;
-            // altered packet with "from == 0" can do Remote Node Administration without permission
-            if (h->from == 0) {
-                LOG_WARN("ignoring received packet without sender\n");
+            airTime->logAirtime(RX_LOG, xmitMsec);
+            airTime->logNodeAirtime(h.from, xmitMsec); // for an aggregate frame, whoever put it together
+
+#if USE_PACKET_AGGREGATION
+            if (!(h.flags & PACKET_FLAGS_AGGREGATE_OK_MASK))
+                lastLegacyRxMsec = millis(); // someone in range couldn't unpack an aggregate frame
+
+            if (h.flags & PACKET_FLAGS_AGGREGATE_MASK) {
+                handleAggregate(payload, payloadLen);
                 return;
             }
+#endif
+
+            handleReceivedPacket(h, payload, payloadLen);
+        }
+    }
+}
 
-            // Note: we deliver _all_ packets to our router (i.e. our interface is intentionally promiscuous).
-            // This allows the router and other apps on our node to sniff packets (usually routing) between other
-            // nodes.
-            meshtastic_MeshPacket *mp = packetPool.allocZeroed();
+void RadioLibInterface::handleReceivedPacket(const PacketHeader &h, const uint8_t *payload, size_t payloadLen)
+{
+    float snr;
+    int32_t rssi;
+    getReceiveMetadata(snr, rssi);
+    PACKET_CAPTURE_RECORD(h, payload, payloadLen, snr, rssi, isrMsec);
 
-            mp->from = h->from;
-            mp->to = h->to;
-            mp->id = h->id;
-            mp->channel = h->channel;
-            assert(HOP_MAX <= PACKET_FLAGS_HOP_MASK); // If hopmax changes, carefully check this code
-            mp->hop_limit = h->flags & PACKET_FLAGS_HOP_MASK;
-            mp->want_ack = !!(h->flags & PACKET_FLAGS_WANT_ACK_MASK);
-            mp->via_mqtt = !!(h->flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    deliverReceivedPacket(h, payload, payloadLen, snr, rssi, isrMsec, isrUsec);
+}
 
-            addReceiveMetadata(mp);
+void RadioLibInterface::deliverReceivedPacket(const PacketHeader &h, const uint8_t *payload, size_t payloadLen, float snr,
+                                              int32_t rssi, uint32_t rxMsec, uint32_t rxUsec)
+{
+    // altered packet with "from == 0" can do Remote Node Administration without permission
+    if (h.from == 0) {
+        LOG_WARN("ignoring received packet without sender\n");
+        radioStats.countError(RadioStats::RX_NO_SENDER);
+        return;
+    }
 
-            mp->which_payload_variant =
-                meshtastic_MeshPacket_encrypted_tag; // Mark that the payload is still encrypted at this point
-            assert(((uint32_t)payloadLen) <= sizeof(mp->encrypted.bytes));
-            memcpy(mp->encrypted.bytes, payload, payloadLen);
-            mp->encrypted.size = payloadLen;
+    // Duplicates, and everything a repeater which never decodes hears, can be dealt with from the header alone, before we
+    // spend a packet on them
+    Router::CutThroughAction action = router ? router->checkCutThrough(&h, payloadLen, snr, rssi) : Router::CUT_THROUGH_NONE;
+    if (action == Router::CUT_THROUGH_DROP)
+        return;
+    PACKET_TRACE_BEGIN(h.from, h.id, RX_ISR, rxMsec);
+
+    // Note: we deliver _all_ packets to our router (i.e. our interface is intentionally promiscuous).
+    // This allows the router and other apps on our node to sniff packets (usually routing) between other
+    // nodes.
+    meshtastic_MeshPacket *mp = packetPool.tryAllocZeroed();
+    if (!mp) {
+        LOG_WARN("packetPool is running low (%d free, %u failures), dropping received packet\n", packetPool.getFree(),
+                 packetPool.getAllocFailures());
+        radioStats.countError(RadioStats::RX_POOL_EMPTY);
+        return;
+    }
 
-            printPacket("Lora RX", mp);
+    mp->from = h.from;
+    mp->to = h.to;
+    mp->id = h.id;
+    mp->channel = h.channel;
+    assert(HOP_MAX <= PACKET_FLAGS_HOP_MASK); // If hopmax changes, carefully check this code
+    mp->hop_limit = h.flags & PACKET_FLAGS_HOP_MASK;
+    mp->want_ack = !!(h.flags & PACKET_FLAGS_WANT_ACK_MASK);
+    mp->via_mqtt = !!(h.flags & PACKET_FLAGS_VIA_MQTT_MASK);
+    mp->rx_snr = snr;
+    mp->rx_rssi = rssi;
+
+    mp->which_payload_variant = meshtastic_MeshPacket_encrypted_tag; // Mark that the payload is still encrypted at this point
+    assert(payloadLen <= sizeof(mp->encrypted.bytes));
+    memcpy(mp->encrypted.bytes, payload, payloadLen);
+    mp->encrypted.size = payloadLen;
+
+    BOOT_FIRST_RX();
+    printPacket("Lora RX", mp);
+
+    if (action == Router::CUT_THROUGH_REBROADCAST)
+        router->sendCutThrough(mp); // straight to our tx queue, skipping the receive queue and all modules
+    else if (router)
+        router->enqueueReceivedMessage(mp, rxUsec);
+    else
+        packetPool.release(mp);
+}
 
-            airTime->logAirtime(RX_LOG, xmitMsec);
+#if USE_PACKET_AGGREGATION
+/**
+ * An aggregate frame is a PacketHeader (from us, to broadcast, id 0 and hop limit 0, so older firmware which can't decrypt it
+ * never passes it on) followed by its parts, each a one byte length and then the part's own PacketHeader and payload.
+ */
+WirePacket *RadioLibInterface::aggregate(WirePacket *first)
+{
+    // Only if everyone we have heard lately can unpack it, and there is something small to go with first
+    if (millis() - lastLegacyRxMsec < AGGREGATE_LEGACY_HOLDOFF_MSECS || first->size > AGGREGATE_MAX_PAYLOAD)
+        return first;
+
+    WirePacket *parts[AGGREGATE_MAX_PARTS];
+    uint8_t numParts = 0;
+    size_t len = sizeof(PacketHeader);
+
+    parts[numParts++] = first;
+    len += 1 + first->getLength();
+
+    WirePacket *next;
+    while (numParts < AGGREGATE_MAX_PARTS && (next = txQueue.getFront()) != NULL && next->size <= AGGREGATE_MAX_PAYLOAD &&
+           len + 1 + next->getLength() <= MAX_RHPACKETLEN) {
+        parts[numParts++] = txQueue.dequeue();
+        len += 1 + next->getLength();
+    }
+
+    if (numParts == 1)
+        return first;
+
+    WirePacket *agg = WirePacket::alloc(len - sizeof(PacketHeader));
+    if (!agg) {
+        // Just send them one by one (they came out of the queue, so there is room to put them back)
+        for (uint8_t i = 1; i < numParts; i++)
+            txQueue.enqueue(parts[i]);
+        return first;
+    }
+
+    agg->header.from = nodeDB.getNodeNum();
+    agg->header.to = NODENUM_BROADCAST;
+    agg->header.id = 0;
+    agg->header.flags = PACKET_FLAGS_AGGREGATE_MASK | PACKET_FLAGS_AGGREGATE_OK_MASK;
+    agg->header.channel = 0;
+    agg->rx_snr = 0;
+    agg->rx_rssi = 0;
+    agg->queuedMsec = first->queuedMsec;
+    agg->priority = first->priority; // the highest priority of the lot, it came out of the queue first
+    agg->size = len - sizeof(PacketHeader);
+
+    uint32_t separateMsec = 0;
+    uint8_t *out = agg->payload;
+    for (uint8_t i = 0; i < numParts; i++) {
+        WirePacket *p = parts[i];
+        separateMsec += getPacketTime(p);
+
+        *out++ = p->getLength();
+        memcpy(out, &p->header, sizeof(PacketHeader));
+        out += sizeof(PacketHeader);
+        memcpy(out, p->payload, p->size);
+        out += p->size;
+
+        if (i) // the first was already counted when it came out of the queue
+            radioStats.record(RadioStats::TX_QUEUE, millis() - p->queuedMsec);
+        WirePacket::release(p);
+    }
 
-            deliverToReceiver(mp);
+    uint32_t aggMsec = getPacketTime(agg);
+    aggregatesSent++;
+    if (separateMsec > aggMsec)
+        aggregateSavedMsec += separateMsec - aggMsec;
+    LOG_DEBUG("Aggregated %d packets into one %d byte frame, %u msec of airtime instead of %u (%u aggregates saved %u msec)\n",
+              numParts, agg->getLength(), aggMsec, separateMsec, aggregatesSent, aggregateSavedMsec);
+
+    return agg;
+}
+
+void RadioLibInterface::handleAggregate(const uint8_t *buf, size_t len)
+{
+    size_t off = 0;
+    while (off < len) {
+        uint8_t partLen = buf[off++];
+        if (partLen < sizeof(PacketHeader) || off + partLen > len) {
+            LOG_WARN("ignoring rest of malformed aggregate frame\n");
+            rxBad++;
+            radioStats.countError(RadioStats::RX_TOO_SHORT);
+            return;
         }
+
+        PacketHeader h; // copied out, parts are not aligned
+        memcpy(&h, buf + off, sizeof(h));
+        handleReceivedPacket(h, buf + off + sizeof(PacketHeader), partLen - sizeof(PacketHeader));
+        off += partLen;
     }
 }
+#endif
 
 /** start an immediate transmit */
-void RadioLibInterface::startSend(meshtastic_MeshPacket *txp)
+int8_t RadioLibInterface::setPowerForSend(const WirePacket *txp)
+{
+#if USE_TX_POWER_CONTROL
+    // Only our own packets to one node, what we relay may be wanted by anyone who can hear it
+    int8_t want = txp->header.from == nodeDB.getNodeNum() ? txPowerControl.getPower(txp->header.to, power, sf) : power;
+    if (want < power || txPowerReduced) {
+        if (!setTxPower(want)) {
+            LOG_WARN("Couldn't set TX power %ddBm\n", want);
+            return power; // and we'll try again next time
+        }
+        txPowerReduced = want < power;
+        if (txPowerReduced)
+            LOG_DEBUG("Sending to 0x%x at %ddBm (full power %ddBm)\n", txp->header.to, want, power);
+    }
+    return want;
+#else
+    return power;
+#endif
+}
+
+void RadioLibInterface::startSend(WirePacket *txp)
 {
     printPacket("Starting low level send", txp);
     if (disabled || !config.lora.tx_enabled) {
         LOG_WARN("startSend is dropping tx packet because we are disabled\n");
-        packetPool.release(txp);
+        radioStats.countError(RadioStats::TX_DISABLED);
+        WirePacket::release(txp);
     } else {
+        PACKET_TRACE_MARK(txp->header.from, txp->header.id, TX_START);
         configHardwareForSend(); // must be after setStandby
+        lastTxPower = setPowerForSend(txp);
 
         size_t numbytes = beginSending(txp);
 
         int res = iface->startTransmit(radiobuf, numbytes);
         if (res != RADIOLIB_ERR_NONE) {
             LOG_ERROR("startTransmit failed, error=%d\n", res);
+            radioStats.countError(RadioStats::TX_START_FAILED);
             RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_RADIO_SPI_BUG);
 
             // This send failed, but make sure to 'complete' it properly
@@ -405,6 +685,6 @@ void RadioLibInterface::startSend(meshtastic_MeshPacket *txp)
 
         // Must be done AFTER, starting transmit, because startTransmit clears (possibly stale) interrupt pending register
         // bits
-        enableInterrupt(isrTxLevel0);
+        armInterrupt(isrTxLevel0);
     }
 }
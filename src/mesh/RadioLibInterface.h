@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ChannelSampler.h"
 #include "MeshPacketQueue.h"
 #include "RadioInterface.h"
 #include "concurrency/NotifiedWorkerThread.h"
@@ -55,8 +56,41 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
      */
     uint32_t rxBad = 0, rxGood = 0, txGood = 0;
 
+    /// When our last interrupt fired, so we can tell how long the packet path took to get round to handling it.  millis() for
+    /// the capture (which spans far longer than micros() takes to wrap), micros() for the Router to time the packet from
+    volatile uint32_t isrMsec = 0, isrUsec = 0;
+
     MeshPacketQueue txQueue = MeshPacketQueue(MAX_TX_QUEUE);
 
+#if USE_PACKET_AGGREGATION
+    /// Only packets with at most this many payload bytes are worth packing together
+    static const uint8_t AGGREGATE_MAX_PAYLOAD = 48;
+
+    /// Most packets we put in one aggregate frame
+    static const uint8_t AGGREGATE_MAX_PARTS = 8;
+
+    /// Don't aggregate until we have gone this long without hearing a radio that can't unpack aggregates
+    static const uint32_t AGGREGATE_LEGACY_HOLDOFF_MSECS = 15 * 60 * 1000;
+
+    /// When we last heard a radio which doesn't set PACKET_FLAGS_AGGREGATE_OK_MASK (we start out assuming we just did)
+    uint32_t lastLegacyRxMsec = 0;
+
+    /// How many aggregate frames we have sent, and how much airtime they saved versus sending their parts one by one
+    uint32_t aggregatesSent = 0, aggregateSavedMsec = 0;
+
+    /**
+     * If first and the next few packets in our queue are all small, pack them into one frame.
+     * @return first, or an aggregate WirePacket holding it (in which case first and the other parts have been freed)
+     */
+    WirePacket *aggregate(WirePacket *first);
+
+    /// Unpack an aggregate frame and handle each packet in it
+    void handleAggregate(const uint8_t *buf, size_t len);
+#endif
+
+    /// Turn one received packet into a MeshPacket and hand it to the router
+    void handleReceivedPacket(const PacketHeader &h, const uint8_t *payload, size_t payloadLen);
+
   protected:
     /**
      * We use a meshtastic sync word, but hashed with the Channel name.  For releases before 1.2 we used 0x12 (or for very old
@@ -83,6 +117,11 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
     /// are _trying_ to receive a packet currently (note - we might just be waiting for one)
     bool isReceiving = false;
 
+    /// A register reading which changes nothing (so timeSpiRead() may, however busy the radio is), set by subclasses which
+    /// have one, and how many bytes from it
+    uint16_t spiProbeRegister = 0;
+    uint8_t spiProbeLen = 0;
+
   public:
     /** Our ISR code currently needs this to find our active instance
      */
@@ -98,10 +137,23 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
      */
     virtual void enableInterrupt(void (*)()) = 0;
 
+    /// enableInterrupt(), so that it also wakes us from light sleep (see radioInterruptArmed())
+    void armInterrupt(void (*callback)());
+
   public:
     RadioLibInterface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE cs, RADIOLIB_PIN_TYPE irq, RADIOLIB_PIN_TYPE rst,
                       RADIOLIB_PIN_TYPE busy, PhysicalLayer *iface = NULL);
 
+    /// So instance never points at a radio we probed for but didn't find
+    virtual ~RadioLibInterface()
+    {
+        if (instance == this)
+            instance = NULL;
+    }
+
+    /// Handle our interrupts on a task of our own from now on, see NotifiedWorkerThread::startNotifyTask()
+    void startInterruptTask() { startNotifyTask("radioisr"); }
+
     virtual ErrorCode send(meshtastic_MeshPacket *p) override;
 
     /**
@@ -126,19 +178,54 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
      */
     virtual bool isActivelyReceiving() = 0;
 
-    /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-    virtual bool cancelSending(NodeNum from, PacketId id) override;
+    /**
+     * Take a sample of the channel for ChannelSampler, if we are just listening: our radio's instantaneous RSSI (left NAN if it
+     * can't read one) and, with withCad, whether Channel Activity Detection hears LoRa.  @return false if we took no sample
+     */
+    virtual bool sampleChannel(bool withCad, float &rssi, bool &detected) { return false; }
+
+    virtual size_t getFreeTxSlots() override { return txQueue.getFree(); }
+
+    virtual uint32_t timeSpiRead(uint32_t ops) override;
+
+    /**
+     * Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel, and if airtimeMsec is
+     * given sets it to how long that packet would have been on the air
+     */
+    virtual bool cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec = NULL) override;
+
+    /**
+     * Turn one packet we heard (at rxMsec, or rxUsec by micros()) into a MeshPacket and hand it to the router: the cut-through
+     * check, then our router's receive queue (or straight to our TX queue).  Static so PacketReplay can feed captured frames
+     * through it too
+     */
+    static void deliverReceivedPacket(const PacketHeader &h, const uint8_t *payload, size_t payloadLen, float snr,
+                                      int32_t rssi, uint32_t rxMsec, uint32_t rxUsec);
 
   private:
     /** if we have something waiting to send, start a short (random) timer so we can come check for collision before actually
      * doing the transmit */
     void setTransmitDelay();
 
-    /** random timer with certain min. and max. settings */
-    void startTransmitTimer(bool withDelay = true);
+    /** random timer with certain min. and max. settings, overwrite replaces a timer which was already scheduled */
+    void startTransmitTimer(bool withDelay = true, bool overwrite = false);
 
     /** timer scaled to SNR of to be flooded packet */
-    void startTransmitTimerSNR(float snr);
+    void startTransmitTimerSNR(float snr, bool overwrite = false);
+
+    /// @return true if p (at the front of txQueue) is background traffic which should wait for a quieter channel (see
+    /// USE_TX_DEFERRAL), false once it has waited TX_DEFER_MAX_SECS
+    bool shouldDefer(const WirePacket *p);
+
+    /// If the timer we have scheduled is a deferred packet's recheck rather than a TX delay
+    bool txDeferring = false;
+
+    /// @return the power to send txp at, and set our radio to it
+    int8_t setPowerForSend(const WirePacket *txp);
+
+    /// If the delay setTransmitDelay() last started for a rebroadcast was a slot (see getSlottedTxDelayMsec()), for the
+    /// metrics comparing what happens to slotted rebroadcasts with what happens to the ones contending for the channel
+    bool txDelaySlotted = false;
 
     void handleTransmitInterrupt();
     void handleReceiveInterrupt();
@@ -150,7 +237,7 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
     /** start an immediate transmit
      *  This method is virtual so subclasses can hook as needed, subclasses should not call directly
      */
-    virtual void startSend(meshtastic_MeshPacket *txp);
+    virtual void startSend(WirePacket *txp);
 
     meshtastic_QueueStatus getQueueStatus();
 
@@ -171,9 +258,24 @@ class RadioLibInterface : public RadioInterface, protected concurrency::Notified
     void completeSending();
 
     /**
-     * Add SNR data to received messages
+     * How well we heard the packet we just read
      */
-    virtual void addReceiveMetadata(meshtastic_MeshPacket *mp) = 0;
+    virtual void getReceiveMetadata(float &snr, int32_t &rssi) = 0;
+
+    /// Set the power (no more than power, which reconfigure() set) our next packet goes out at, @return false if we couldn't
+    virtual bool setTxPower(int8_t dBm) = 0;
 
     virtual void setStandby() = 0;
+
+    /// @return true if we are waiting for a packet and nothing else: not sending, hearing one or with one to send
+    bool isIdleListening() { return isReceiving && !sendingPacket && txQueue.empty() && !isActivelyReceiving(); }
+
+  private:
+    /// If the last packet we sent went out below power (see TxPowerControl), so the next may need to put it back
+    bool txPowerReduced = false;
+
+    /// The power (in dBm) the last packet we sent went out at
+    int8_t lastTxPower = 0;
+
+    ChannelSampler channelSampler;
 };
@@ -0,0 +1,97 @@
+#include "RadioStats.h"
+#include "configuration.h"
+#include <stdio.h>
+
+RadioStats radioStats;
+
+static const char *stageNames[RadioStats::NUM_STAGES] = {"isr_latency", "rx_queue", "decode",       "tx_delay",  "tx_queue",
+                                                          "spi_wait",    "spi_hold", "isr_deferred", "isr_direct"};
+static const char *stageUnits[RadioStats::NUM_STAGES] = {"ms", "ms", "us", "ms", "ms", "us", "us", "us", "us"};
+
+static const char *errorNames[RadioStats::NUM_ERRORS] = {
+    "rx_read_failed", "rx_too_short",    "rx_no_sender", "rx_pool_empty",   "rx_queue_full",  "rx_undecodable",
+    "tx_queue_full",  "tx_start_failed", "tx_disabled",  "tx_fair_dropped", "tx_rate_limited"};
+
+void LatencyHistogram::record(uint32_t value)
+{
+    uint8_t i = 0;
+    for (uint32_t v = value; v && i < LATENCY_HISTOGRAM_BUCKETS - 1; v >>= 1)
+        i++;
+    buckets[i]++;
+
+    count++;
+    total += value;
+    if (value > maxValue)
+        maxValue = value;
+}
+
+uint32_t LatencyHistogram::getPercentile(float fraction) const
+{
+    uint32_t wanted = count * fraction, seen = 0;
+    for (uint8_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen > wanted) {
+            uint32_t top = getBucketStart(i + 1) - 1; // the top of bucket i, unless we never saw anything that big
+            return top < maxValue ? top : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+void LatencyHistogram::log(const char *name, const char *unit) const
+{
+    char line[LATENCY_HISTOGRAM_BUCKETS * 11 + 1];
+    size_t len = 0;
+    for (uint8_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+        len += snprintf(line + len, sizeof(line) - len, " %u", buckets[i]);
+
+    LOG_DEBUG("%s: n=%u avg=%u%s p90=%u%s max=%u%s, log2 buckets%s\n", name, count, getAverage(), unit, getPercentile(0.9f),
+              unit, maxValue, unit, line);
+}
+
+const char *RadioStats::getStageName(Stage stage)
+{
+    return stageNames[stage];
+}
+
+const char *RadioStats::getStageUnit(Stage stage)
+{
+    return stageUnits[stage];
+}
+
+const char *RadioStats::getErrorName(Error e)
+{
+    return errorNames[e];
+}
+
+bool RadioStats::getSummaryLine(uint8_t line, char *buf, size_t bufLen) const
+{
+    if (line < NUM_STAGES) {
+        const LatencyHistogram &h = histograms[line];
+        const char *unit = stageUnits[line];
+        snprintf(buf, bufLen, "%s n=%u avg=%u%s p90=%u%s max=%u%s", stageNames[line], h.getCount(), h.getAverage(), unit,
+                 h.getPercentile(0.9f), unit, h.getMax(), unit);
+        return true;
+    }
+
+    if (line == NUM_STAGES) {
+        // Only the errors which have happened, most of them usually haven't
+        size_t len = snprintf(buf, bufLen, "errors");
+        for (uint8_t i = 0; i < NUM_ERRORS && len < bufLen; i++)
+            if (errors[i])
+                len += snprintf(buf + len, bufLen - len, " %s=%u", errorNames[i], errors[i]);
+        return true;
+    }
+
+    return false;
+}
+
+void RadioStats::log() const
+{
+    for (uint8_t i = 0; i < NUM_STAGES; i++)
+        histograms[i].log(stageNames[i], stageUnits[i]);
+
+    char line[128];
+    getSummaryLine(NUM_STAGES, line, sizeof(line));
+    LOG_DEBUG("%s\n", line);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Buckets in each LatencyHistogram, bucket 0 counts zeros and bucket i values in [2^(i-1), 2^i), the last also counts all
+/// bigger values
+#define LATENCY_HISTOGRAM_BUCKETS 16
+
+/**
+ * A fixed size, log2 bucketed histogram.  Recording is a handful of instructions and it never allocates, so it can stay on
+ * in production builds.  The unit is up to the user.
+ */
+class LatencyHistogram
+{
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS] = {};
+    uint32_t count = 0, total = 0, maxValue = 0;
+
+  public:
+    void record(uint32_t value);
+
+    uint32_t getCount() const { return count; }
+    uint32_t getMax() const { return maxValue; }
+    uint32_t getAverage() const { return count ? total / count : 0; }
+    uint32_t getBucket(uint8_t i) const { return buckets[i]; }
+
+    /// @return the smallest value bucket i counts
+    static uint32_t getBucketStart(uint8_t i) { return i ? 1UL << (i - 1) : 0; }
+
+    /// @return roughly the value below which fraction (0..1) of our samples fall (the top of that bucket)
+    uint32_t getPercentile(float fraction) const;
+
+    void log(const char *name, const char *unit) const;
+};
+
+/**
+ * Where the time goes (and what goes wrong) on the way between our radio and the Router, in both directions.
+ *
+ * RX: radio interrupt -> RadioLibInterface::handleReceiveInterrupt() (ISR_LATENCY) -> Router::enqueueReceivedMessage() ->
+ * Router::runOnce() (RX_QUEUE, from the interrupt, so it includes ISR_LATENCY) -> perhapsDecode() (DECODE)
+ *
+ * TX: RadioLibInterface::send() -> random contention delay (TX_DELAY) -> on the air (TX_QUEUE, which includes the delays)
+ *
+ * Both: each radio SPI transaction waits for the bus (SPI_WAIT), which the display holds a row of pixels at a time (SPI_HOLD),
+ * and each RX or TX done interrupt waits to be handled - by our Scheduler (ISR_DEFERRED) or the radio's own task if it has
+ * one (ISR_DIRECT, see NOTIFY_TASK)
+ *
+ * Shown in /json/report, in our log and to the phone as a log record once it has downloaded our config.
+ */
+class RadioStats
+{
+  public:
+    enum Stage {
+        ISR_LATENCY,  // msecs
+        RX_QUEUE,     // msecs
+        DECODE,       // usecs
+        TX_DELAY,     // msecs
+        TX_QUEUE,     // msecs
+        SPI_WAIT,     // usecs
+        SPI_HOLD,     // usecs
+        ISR_DEFERRED, // usecs
+        ISR_DIRECT,   // usecs
+        NUM_STAGES
+    };
+
+    enum Error {
+        RX_READ_FAILED,  // the radio said it had a packet but we couldn't read it (usually a CRC error)
+        RX_TOO_SHORT,    // smaller than a PacketHeader
+        RX_NO_SENDER,    // from == 0
+        RX_POOL_EMPTY,   // no packet left in packetPool to receive into
+        RX_QUEUE_FULL,   // the Router's fromRadioQueue was full, or nearly so and the packet could be shed
+        RX_UNDECODABLE,  // not for any of our channels (or we weren't allowed to decode it)
+        TX_QUEUE_FULL,   // no room in our txQueue
+        TX_START_FAILED, // the radio refused to start sending
+        TX_DISABLED,     // dropped because transmit is turned off
+        TX_FAIR_DROPPED, // dropped from a full txQueue to make room for an originator with fewer packets queued
+        TX_RATE_LIMITED, // a rebroadcast we didn't make, because its originator used up its FLOOD_RATE_LIMIT_* allowance
+        NUM_ERRORS
+    };
+
+    void record(Stage stage, uint32_t value) { histograms[stage].record(value); }
+    const LatencyHistogram &getHistogram(Stage stage) const { return histograms[stage]; }
+
+    void countError(Error e) { errors[e]++; }
+    uint32_t getErrorCount(Error e) const { return errors[e]; }
+
+    static const char *getStageName(Stage stage);
+    static const char *getStageUnit(Stage stage);
+    static const char *getErrorName(Error e);
+
+    /// One line per stage, then one for the errors
+    static const uint8_t NUM_SUMMARY_LINES = NUM_STAGES + 1;
+
+    /**
+     * Write line number line of our summary to buf (truncated to fit, lines are kept short enough for a
+     * meshtastic_LogRecord message).  @return false if there is no such line
+     */
+    bool getSummaryLine(uint8_t line, char *buf, size_t bufLen) const;
+
+    void log() const;
+
+  private:
+    LatencyHistogram histograms[NUM_STAGES];
+    uint32_t errors[NUM_ERRORS] = {};
+};
+
+extern RadioStats radioStats;
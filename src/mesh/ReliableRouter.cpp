@@ -1,8 +1,11 @@
 #include "ReliableRouter.h"
 #include "MeshModule.h"
 #include "MeshTypes.h"
+#include "Metrics.h"
+#include "TxPowerControl.h"
 #include "configuration.h"
 #include "mesh-pb-constants.h"
+#include <algorithm>
 
 // ReliableRouter::ReliableRouter() {}
 
@@ -27,9 +30,16 @@ ErrorCode ReliableRouter::send(meshtastic_MeshPacket *p)
     /* If we have pending retransmissions, add the airtime of this packet to it, because during that time we cannot receive an
        (implicit) ACK. Otherwise, we might retransmit too early.
      */
-    for (auto i = pending.begin(); i != pending.end(); i++) {
-        if (i->first.id != p->id) {
-            i->second.nextTxMsec += iface->getPacketTime(p);
+    if (!pending.empty()) {
+        uint32_t packetTime = iface->getPacketTime(p);
+        retransmissionDelay += packetTime;
+
+        // Except for this packet itself, so take it back out of its own record (if it has one)
+        auto key = GlobalPacketId(getFrom(p), p->id);
+        auto own = findPendingPacket(key);
+        if (own) {
+            own->nextTxMsec -= packetTime;
+            scheduleRetransmission(key, own);
         }
     }
 
@@ -67,9 +77,8 @@ bool ReliableRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
        because while receiving this packet, we could not have received an (implicit) ACK for it.
        If we don't add this, we will likely retransmit too early.
     */
-    for (auto i = pending.begin(); i != pending.end(); i++) {
-        i->second.nextTxMsec += iface->getPacketTime(p);
-    }
+    if (!pending.empty())
+        retransmissionDelay += iface->getPacketTime(p);
 
     /* Resend implicit ACKs for repeated packets (assuming the original packet was sent with HOP_RELIABLE)
      * this way if an implicit ACK is dropped and a packet is resent we'll rebroadcast again.
@@ -86,6 +95,21 @@ bool ReliableRouter::shouldFilterReceived(const meshtastic_MeshPacket *p)
     return FloodingRouter::shouldFilterReceived(p);
 }
 
+bool ReliableRouter::dropHeardDuplicate(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi)
+{
+    // A retry of a reliable flood wants its implicit ack repeated, see shouldFilterReceived()
+    if ((h->flags & PACKET_FLAGS_HOP_MASK) == HOP_RELIABLE && h->to != nodeDB.getNodeNum())
+        return false;
+
+    if (!FloodingRouter::dropHeardDuplicate(h, payloadLen, snr, rssi))
+        return false;
+
+    // We couldn't hear an ack while this was on the air either
+    if (!pending.empty())
+        retransmissionDelay += iface->getPacketTime(sizeof(PacketHeader) + payloadLen);
+    return true;
+}
+
 /**
  * If we receive a want_ack packet (do not check for wasSeenRecently), send back an ack (this might generate multiple ack sends in
  * case the our first ack gets lost)
@@ -122,6 +146,13 @@ void ReliableRouter::sniffReceived(const meshtastic_MeshPacket *p, const meshtas
 
         // We intentionally don't check wasSeenRecently, because it is harmless to delete non existent retransmission records
         if (ackId || nakId) {
+            // Only count the ones we were actually waiting for
+            if (iface && findPendingPacket(p->to, ackId ? ackId : nakId)) {
+                iface->getContention().onAckReceived();
+                if (!p->via_mqtt && (p->rx_snr != 0 || p->rx_rssi != 0)) // heard on our radio
+                    txPowerControl.onAck(getFrom(p), p->rx_snr);
+            }
+
             if (ackId) {
                 LOG_DEBUG("Received an ack for 0x%x, stopping retransmissions\n", ackId);
                 stopRetransmission(p->to, ackId);
@@ -191,10 +222,20 @@ PendingPacket *ReliableRouter::startRetransmission(meshtastic_MeshPacket *p)
 
     stopRetransmission(getFrom(p), p->id);
 
-    setNextTx(&rec);
+    assert(iface);
+    rec.packetTimeMsec = iface->getPacketTime(p);
     pending[id] = rec;
 
-    return &pending[id];
+    auto stored = &pending[id];
+    setNextTx(id, stored);
+
+    return stored;
+}
+
+/// Heap order for our schedule, the soonest timer ends up on top (signed difference, so this copes with millis() rollover)
+static bool laterTimer(const RetransmissionTimer &a, const RetransmissionTimer &b)
+{
+    return (int32_t)(a.nextTxMsec - b.nextTxMsec) > 0;
 }
 
 /**
@@ -203,56 +244,82 @@ PendingPacket *ReliableRouter::startRetransmission(meshtastic_MeshPacket *p)
 int32_t ReliableRouter::doRetransmissions()
 {
     uint32_t now = millis();
-    int32_t d = INT32_MAX;
-
-    // FIXME, we should use a better datastructure rather than walking through this map.
-    // for(auto el: pending) {
-    for (auto it = pending.begin(), nextIt = it; it != pending.end(); it = nextIt) {
-        ++nextIt; // we use this odd pattern because we might be deleting it...
-        auto &p = it->second;
-
-        bool stillValid = true; // assume we'll keep this record around
-
-        // FIXME, handle 51 day rolloever here!!!
-        if (p.nextTxMsec <= now) {
-            if (p.numRetransmissions == 0) {
-                LOG_DEBUG("Reliable send failed, returning a nak for fr=0x%x,to=0x%x,id=0x%x\n", p.packet->from, p.packet->to,
-                          p.packet->id);
-                sendAckNak(meshtastic_Routing_Error_MAX_RETRANSMIT, getFrom(p.packet), p.packet->id, p.packet->channel);
-                // Note: we don't stop retransmission here, instead the Nak packet gets processed in sniffReceived
-                stopRetransmission(it->first);
-                stillValid = false; // just deleted it
-            } else {
-                LOG_DEBUG("Sending reliable retransmission fr=0x%x,to=0x%x,id=0x%x, tries left=%d\n", p.packet->from,
-                          p.packet->to, p.packet->id, p.numRetransmissions);
-
-                // Note: we call the superclass version because we don't want to have our version of send() add a new
-                // retransmission record
-                FloodingRouter::send(packetPool.allocCopy(*p.packet));
 
-                // Queue again
-                --p.numRetransmissions;
-                setNextTx(&p);
-            }
+    while (!schedule.empty()) {
+        RetransmissionTimer next = schedule.front();
+        auto key = next.key;
+        auto p = findPendingPacket(key);
+        bool stale = !p || p->generation != next.generation; // this packet was stopped or rescheduled since
+
+        if (!stale) {
+            // Signed difference, so this keeps working when millis() rolls over
+            int32_t d = (int32_t)(next.nextTxMsec + retransmissionDelay - now);
+            if (d > 0)
+                return d; // the soonest retransmission isn't due yet
         }
 
-        if (stillValid) {
-            // Update our desired sleep delay
-            int32_t t = p.nextTxMsec - now;
+        std::pop_heap(schedule.begin(), schedule.end(), laterTimer);
+        schedule.pop_back();
+
+        if (stale)
+            continue;
+
+        iface->getContention().onAckTimeout();
+        txPowerControl.onAckTimeout(p->packet->to);
+
+        if (p->numRetransmissions == 0) {
+            LOG_DEBUG("Reliable send failed, returning a nak for fr=0x%x,to=0x%x,id=0x%x\n", p->packet->from, p->packet->to,
+                      p->packet->id);
+            metrics.count(Metrics::TX_RETRANSMISSION_FAILED);
+            sendAckNak(meshtastic_Routing_Error_MAX_RETRANSMIT, getFrom(p->packet), p->packet->id, p->packet->channel);
+            // Note: we don't stop retransmission here, instead the Nak packet gets processed in sniffReceived
+            stopRetransmission(key);
+        } else {
+            LOG_DEBUG("Sending reliable retransmission fr=0x%x,to=0x%x,id=0x%x, tries left=%d\n", p->packet->from, p->packet->to,
+                      p->packet->id, p->numRetransmissions);
+
+            // Note: we call the superclass version because we don't want to have our version of send() add a new
+            // retransmission record
+            FloodingRouter::send(packetPool.allocCopy(*p->packet));
+            metrics.count(Metrics::TX_RETRANSMISSION);
 
-            d = min(t, d);
+            // Queue again
+            --p->numRetransmissions;
+            setNextTx(key, p);
         }
     }
 
-    return d;
+    return INT32_MAX;
 }
 
-void ReliableRouter::setNextTx(PendingPacket *pending)
+void ReliableRouter::setNextTx(const GlobalPacketId &key, PendingPacket *pending)
 {
     assert(iface);
-    auto d = iface->getRetransmissionMsec(pending->packet);
-    pending->nextTxMsec = millis() + d;
+    auto d = iface->getRetransmissionMsecForAirtime(pending->packetTimeMsec);
+    pending->nextTxMsec = millis() + d - retransmissionDelay;
+    scheduleRetransmission(key, pending);
     LOG_DEBUG("Setting next retransmission in %u msecs: ", d);
     printPacket("", pending->packet);
     setReceivedMessage(); // Run ASAP, so we can figure out our correct sleep time
 }
+
+void ReliableRouter::scheduleRetransmission(const GlobalPacketId &key, PendingPacket *pending)
+{
+    // Don't let stale entries pile up if packets keep getting acked or rescheduled before they are due
+    if (schedule.size() >= 2 * this->pending.size() + 8)
+        compactSchedule();
+
+    // Any entry we already had for this packet is now stale
+    pending->generation = ++lastGeneration;
+
+    schedule.push_back(RetransmissionTimer{pending->nextTxMsec, key, pending->generation});
+    std::push_heap(schedule.begin(), schedule.end(), laterTimer);
+}
+
+void ReliableRouter::compactSchedule()
+{
+    schedule.clear();
+    for (auto &i : pending)
+        schedule.push_back(RetransmissionTimer{i.second.nextTxMsec, i.first, i.second.generation});
+    std::make_heap(schedule.begin(), schedule.end(), laterTimer);
+}
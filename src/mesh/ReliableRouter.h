@@ -1,7 +1,9 @@
 #pragma once
 
 #include "FloodingRouter.h"
+#include "memGet.h"
 #include <unordered_map>
+#include <vector>
 
 /**
  * An identifier for a globalally unique message - a pair of the sending nodenum and the packet id assigned
@@ -32,12 +34,18 @@ struct GlobalPacketId {
 struct PendingPacket {
     meshtastic_MeshPacket *packet;
 
-    /** The next time we should try to retransmit this packet */
+    /** The next time we should try to retransmit this packet (less ReliableRouter::retransmissionDelay, see there) */
     uint32_t nextTxMsec = 0;
 
+    /** Set every time we reschedule, so we can tell which of our entries in the retransmission schedule is current */
+    uint32_t generation = 0;
+
     /** Starts at NUM_RETRANSMISSIONS -1(normally 3) and counts down.  Once zero it will be removed from the list */
     uint8_t numRetransmissions = 0;
 
+    /** Airtime of packet, worked out once when we start retransmitting so each retry doesn't need to re-encode it */
+    uint32_t packetTimeMsec = 0;
+
     PendingPacket() {}
     explicit PendingPacket(meshtastic_MeshPacket *p);
 };
@@ -48,13 +56,44 @@ class GlobalPacketIdHashFunction
     size_t operator()(const GlobalPacketId &p) const { return (std::hash<NodeNum>()(p.node)) ^ (std::hash<PacketId>()(p.id)); }
 };
 
+/**
+ * An entry in ReliableRouter's retransmission schedule
+ */
+struct RetransmissionTimer {
+    /** Same time base as PendingPacket::nextTxMsec */
+    uint32_t nextTxMsec;
+
+    GlobalPacketId key;
+
+    /** If this doesn't match the PendingPacket's generation (or the packet is gone) this entry is stale and just skipped */
+    uint32_t generation;
+};
+
 /**
  * This is a mixin that extends Router with the ability to do (one hop only) reliable message sends.
  */
 class ReliableRouter : public FloodingRouter
 {
   private:
-    std::unordered_map<GlobalPacketId, PendingPacket, GlobalPacketIdHashFunction> pending;
+    std::unordered_map<GlobalPacketId, PendingPacket, GlobalPacketIdHashFunction, std::equal_to<GlobalPacketId>,
+                       HeapSiteAllocator<std::pair<const GlobalPacketId, PendingPacket>, HEAP_SITE_PENDING>>
+        pending;
+
+    /**
+     * Min-heap of RetransmissionTimers on nextTxMsec, so we only ever look at the packets which are due.  Rescheduling or
+     * stopping a retransmission doesn't search the heap, it just leaves a stale entry behind to be skipped (and thrown away
+     * once there are too many of them).
+     */
+    std::vector<RetransmissionTimer, HeapSiteAllocator<RetransmissionTimer, HEAP_SITE_PENDING>> schedule;
+
+    /**
+     * Added to every nextTxMsec.  When the channel was busy we push all our retransmissions back by bumping this, rather
+     * than touching each pending packet.
+     */
+    uint32_t retransmissionDelay = 0;
+
+    /** Last generation handed out by scheduleRetransmission(), unique across all pending packets */
+    uint32_t lastGeneration = 0;
 
   public:
     /**
@@ -98,6 +137,9 @@ class ReliableRouter : public FloodingRouter
      */
     virtual bool shouldFilterReceived(const meshtastic_MeshPacket *p) override;
 
+    /// Our retransmission timers and the implicit acks we repeat need what shouldFilterReceived() does for a duplicate too
+    virtual bool dropHeardDuplicate(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi) override;
+
     /**
      * Add p to the list of packets to retransmit occasionally.  We will free it once we stop retransmitting.
      */
@@ -119,5 +161,11 @@ class ReliableRouter : public FloodingRouter
      */
     int32_t doRetransmissions();
 
-    void setNextTx(PendingPacket *pending);
+    void setNextTx(const GlobalPacketId &key, PendingPacket *pending);
+
+    /** Add (or move) pending's entry in our schedule, call whenever its nextTxMsec changes */
+    void scheduleRetransmission(const GlobalPacketId &key, PendingPacket *pending);
+
+    /** Rebuild our schedule from pending, dropping all stale entries */
+    void compactSchedule();
 };
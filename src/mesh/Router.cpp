@@ -3,16 +3,18 @@
 #include "CryptoEngine.h"
 #include "MeshRadio.h"
 #include "NodeDB.h"
+#include "PacketTrace.h"
+#include "PayloadCompression.h"
 #include "RTC.h"
+#include "RadioStats.h"
 #include "configuration.h"
 #include "main.h"
 #include "mesh-pb-constants.h"
 #include "modules/RoutingModule.h"
-extern "C" {
-#include "mesh/compression/unishox2.h"
-}
 
 #include "mqtt/MQTT.h"
+#include <algorithm>
+#include <pb_decode.h>
 
 /**
  * Router todo
@@ -23,17 +25,21 @@ extern "C" {
  *
  **/
 
-#define MAX_RX_FROMRADIO                                                                                                         \
-    4 // max number of packets destined to our queue, we dispatch packets quickly so it doesn't need to be big
-
-// I think this is right, one packet for each of the three fifos + one packet being currently assembled for TX or RX
-// And every TX packet might have a retransmission packet or an ack alive at any moment
+// I think this is right, one packet for each of the rx fifos + one packet being currently assembled for TX or RX
+// Queued TX packets are kept as WirePackets (not from this pool), but every one might have a retransmission packet or an ack
+// alive at any moment
 #define MAX_PACKETS                                                                                                              \
-    (MAX_RX_TOPHONE + MAX_RX_FROMRADIO + 2 * MAX_TX_QUEUE +                                                                      \
+    (MAX_RX_TOPHONE + MAX_RX_FROMRADIO + MAX_TX_QUEUE +                                                                          \
      2) // max number of packets which can be in flight (either queued from reception or queued for sending)
 
-// static MemoryPool<MeshPacket> staticPool(MAX_PACKETS);
-static MemoryDynamic<meshtastic_MeshPacket> staticPool;
+// Keep this many packets back from low priority (tryAlloc) users, so we can still send our own packets and acks when busy
+#define MAX_PACKETS_RESERVED (MAX_TX_QUEUE / 2)
+
+#if USE_STATIC_PACKET_POOL
+static MemoryPool<meshtastic_MeshPacket, MAX_PACKETS> staticPool(MAX_PACKETS_RESERVED);
+#else
+static MemoryDynamic<meshtastic_MeshPacket> staticPool(HEAP_SITE_PACKETS);
+#endif
 
 Allocator<meshtastic_MeshPacket> &packetPool = staticPool;
 
@@ -44,16 +50,16 @@ static uint8_t bytes[MAX_RHPACKETLEN];
  *
  * Currently we only allow one interface, that may change in the future
  */
-Router::Router() : concurrency::OSThread("Router"), fromRadioQueue(MAX_RX_FROMRADIO)
+Router::Router() : concurrency::OSThread("Router", 0, &concurrency::packetController)
 {
+    setPriority(PRIORITY_ROUTER);
+
     // This is called pre main(), don't touch anything here, the following code is not safe
 
     /* LOG_DEBUG("Size of NodeInfo %d\n", sizeof(NodeInfo));
     LOG_DEBUG("Size of SubPacket %d\n", sizeof(SubPacket));
     LOG_DEBUG("Size of MeshPacket %d\n", sizeof(MeshPacket)); */
 
-    fromRadioQueue.setReader(this);
-
     // init Lockguard for crypt operations
     assert(!cryptLock);
     cryptLock = new concurrency::Lock();
@@ -66,54 +72,99 @@ Router::Router() : concurrency::OSThread("Router"), fromRadioQueue(MAX_RX_FROMRA
 int32_t Router::runOnce()
 {
     meshtastic_MeshPacket *mp;
-    while ((mp = fromRadioQueue.dequeuePtr(0)) != NULL) {
+    while ((mp = fromRadioQueue.dequeue(&rxUsec)) != NULL) {
+        radioStats.record(RadioStats::RX_QUEUE, (micros() - rxUsec) / 1000);
+        PACKET_TRACE_MARK(getFrom(mp), mp->id, RX_DEQUEUE);
         // printPacket("handle fromRadioQ", mp);
         perhapsHandleReceived(mp);
     }
 
+    precomputeKeystreams();
+
     // LOG_DEBUG("sleeping forever!\n");
     return INT32_MAX; // Wait a long time - until we get woken for the message queue
 }
 
+void Router::precomputeKeystreams()
+{
+#if CRYPTO_KEYSTREAM_AHEAD
+    // The packets we make ourselves take the next ids generatePacketId() hands out, and mostly go on the primary channel
+    concurrency::LockGuard g(cryptLock);
+    if (channels.setActiveByIndex(channels.getPrimaryIndex()) < 0)
+        return;
+    for (uint32_t i = 0; i < CRYPTO_KEYSTREAM_AHEAD; i++)
+        crypto->precomputeKeystream(nodeDB.getNodeNum(), peekPacketId(i));
+#endif
+}
+
 /**
  * RadioInterface calls this to queue up packets that have been received from the radio.  The router is now responsible for
  * freeing the packet
  */
-void Router::enqueueReceivedMessage(meshtastic_MeshPacket *p)
+void Router::enqueueReceivedMessage(meshtastic_MeshPacket *p, uint32_t rxUsec)
 {
-    if (fromRadioQueue.enqueue(p, 0)) { // NOWAIT - fixme, if queue is full, delete older messages
+    size_t numFree = fromRadioQueue.numFree();
+    if (numFree <= RX_FROMRADIO_RESERVED && numFree > 0 && isSheddable(p)) {
+        rxQueueShed++;
+        radioStats.countError(RadioStats::RX_QUEUE_FULL);
+        printPacket("fromRadioQueue nearly full, shedding", p);
+        packetPool.release(p);
+    } else if (fromRadioQueue.enqueue(p, rxUsec)) {
+        size_t used = fromRadioQueue.numUsed();
+        if (used > rxQueueHighWater) {
+            rxQueueHighWater = used;
+            LOG_DEBUG("fromRadioQueue high water mark now %d of %d\n", used, MAX_RX_FROMRADIO);
+        }
 
         // Nasty hack because our threading is primitive.  interfaces shouldn't need to know about routers FIXME
         setReceivedMessage();
+        getDelay().interrupt();
     } else {
-        printPacket("BUG! fromRadioQueue is full! Discarding!", p);
+        rxQueueDropped++;
+        radioStats.countError(RadioStats::RX_QUEUE_FULL);
+        LOG_WARN("fromRadioQueue is full! Discarding! (dropped %u, shed %u)\n", rxQueueDropped, rxQueueShed);
+        printPacket("Discarded", p);
         packetPool.release(p);
     }
 }
 
-/// Generate a unique packet id
-// FIXME, move this someplace better
-PacketId generatePacketId()
+bool Router::isSheddable(const meshtastic_MeshPacket *p)
 {
-    static uint32_t i; // Note: trying to keep this in noinit didn't help for working across reboots
-    static bool didInit = false;
+    return p->to != nodeDB.getNodeNum() && !p->want_ack;
+}
 
-    uint32_t numPacketId = UINT32_MAX;
+/// Generate a unique packet id
+// FIXME, move this someplace better
+static uint32_t packetIdCounter; // Note: trying to keep this in noinit didn't help for working across reboots
+static bool packetIdDidInit = false;
+static const uint32_t numPacketId = UINT32_MAX;
 
-    if (!didInit) {
-        didInit = true;
+static void initPacketId()
+{
+    if (!packetIdDidInit) {
+        packetIdDidInit = true;
 
         // pick a random initial sequence number at boot (to prevent repeated reboots always starting at 0)
         // Note: we mask the high order bit to ensure that we never pass a 'negative' number to random
-        i = random(numPacketId & 0x7fffffff);
-        LOG_DEBUG("Initial packet id %u, numPacketId %u\n", i, numPacketId);
+        packetIdCounter = random(numPacketId & 0x7fffffff);
+        LOG_DEBUG("Initial packet id %u, numPacketId %u\n", packetIdCounter, numPacketId);
     }
+}
 
-    i++;
-    PacketId id = (i % numPacketId) + 1; // return number between 1 and numPacketId (ie - never zero)
+PacketId generatePacketId()
+{
+    initPacketId();
+    packetIdCounter++;
+    PacketId id = (packetIdCounter % numPacketId) + 1; // return number between 1 and numPacketId (ie - never zero)
     return id;
 }
 
+PacketId peekPacketId(uint32_t ahead)
+{
+    initPacketId();
+    return ((packetIdCounter + 1 + ahead) % numPacketId) + 1;
+}
+
 meshtastic_MeshPacket *Router::allocForSending()
 {
     meshtastic_MeshPacket *p = packetPool.allocZeroed();
@@ -151,18 +202,56 @@ void Router::setReceivedMessage()
     runASAP = true;
 }
 
+void Router::addInterface(RadioInterface *_iface)
+{
+    if (numInterfaces >= MAX_RADIO_INTERFACES) {
+        LOG_ERROR("Too many radio interfaces, ignoring this one (raise MAX_RADIO_INTERFACES)\n");
+        return;
+    }
+
+    ifaces[numInterfaces++] = _iface;
+    if (!iface)
+        iface = _iface;
+}
+
+RadioInterface *Router::pickInterface()
+{
+    RadioInterface *best = iface;
+    if (numInterfaces > 1) {
+        size_t bestFree = iface->getFreeTxSlots();
+        for (uint8_t i = 1; i < numInterfaces; i++) {
+            size_t f = ifaces[i]->getFreeTxSlots();
+            if (f > bestFree) { // on a tie we stay with our primary
+                best = ifaces[i];
+                bestFree = f;
+            }
+        }
+    }
+    return best;
+}
+
 meshtastic_QueueStatus Router::getQueueStatus()
 {
     if (!iface) {
         meshtastic_QueueStatus qs;
         qs.res = qs.mesh_packet_id = qs.free = qs.maxlen = 0;
         return qs;
-    } else
-        return iface->getQueueStatus();
+    }
+
+    // With several radios report their TX queues as if they were one
+    meshtastic_QueueStatus qs = iface->getQueueStatus();
+    for (uint8_t i = 1; i < numInterfaces; i++) {
+        meshtastic_QueueStatus other = ifaces[i]->getQueueStatus();
+        qs.free += other.free;
+        qs.maxlen += other.maxlen;
+    }
+    return qs;
 }
 
 ErrorCode Router::sendLocal(meshtastic_MeshPacket *p, RxSource src)
 {
+    p = packetPool.makeWritable(p); // our caller may have shared it (with the phone), everything below changes it
+
     // No need to deliver externally if the destination is the local node
     if (p->to == nodeDB.getNodeNum()) {
         printPacket("Enqueued local", p);
@@ -178,6 +267,7 @@ ErrorCode Router::sendLocal(meshtastic_MeshPacket *p, RxSource src)
         // this allows local apps (and PCs) to see broadcasts sourced locally
         if (p->to == NODENUM_BROADCAST) {
             handleReceived(p, src);
+            p = packetPool.makeWritable(p); // the phone may be holding it now
         }
 
         if (!p->channel) { // don't override if a channel was requested
@@ -189,6 +279,17 @@ ErrorCode Router::sendLocal(meshtastic_MeshPacket *p, RxSource src)
     }
 }
 
+ErrorCode Router::sendCutThrough(meshtastic_MeshPacket *p)
+{
+    assert(p->hop_limit > 0); // checkCutThrough() should have refused this packet
+    p->hop_limit--;           // bump down the hop count
+
+    printPacket("Cut-through rebroadcast", p);
+
+    // Note: we are careful not to call our hooked version of send(), we've already done all the checks it would
+    return Router::send(p);
+}
+
 void printBytes(const char *label, const uint8_t *p, size_t numbytes)
 {
     LOG_DEBUG("%s: ", label);
@@ -248,31 +349,40 @@ ErrorCode Router::send(meshtastic_MeshPacket *p)
     // If the packet is not yet encrypted, do so now
     if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
         ChannelIndex chIndex = p->channel; // keep as a local because we are about to change it
-        meshtastic_MeshPacket *p_decoded = packetPool.allocCopy(*p);
+        // Only MQTT wants it as it was before encryption, don't copy it for nobody
+        meshtastic_MeshPacket *p_decoded = moduleConfig.mqtt.enabled && mqtt ? packetPool.allocCopy(*p) : NULL;
 
         auto encodeResult = perhapsEncode(p);
         if (encodeResult != meshtastic_Routing_Error_NONE) {
-            packetPool.release(p_decoded);
+            if (p_decoded)
+                packetPool.release(p_decoded);
             abortSendAndNak(encodeResult, p);
             return encodeResult; // FIXME - this isn't a valid ErrorCode
         }
 
-        if (moduleConfig.mqtt.enabled) {
+        // Top the keystream back up while the radio sends this one
+        if (crypto->takeKeystreamUsed())
+            wake();
+
+        if (p_decoded) {
             LOG_INFO("Should encrypt MQTT?: %d\n", moduleConfig.mqtt.encryption_enabled);
-            if (mqtt)
-                mqtt->onSend(*p, *p_decoded, chIndex);
+            mqtt->onSend(*p, *p_decoded, chIndex);
+            packetPool.release(p_decoded);
         }
-        packetPool.release(p_decoded);
     }
 
     assert(iface); // This should have been detected already in sendLocal (or we just received a packet from outside)
-    return iface->send(p);
+    return pickInterface()->send(p);
 }
 
 /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-bool Router::cancelSending(NodeNum from, PacketId id)
+bool Router::cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec)
 {
-    return iface ? iface->cancelSending(from, id) : false;
+    // We don't remember which radio we queued it on, so try them all
+    bool cancelled = false;
+    for (uint8_t i = 0; i < numInterfaces; i++)
+        cancelled = ifaces[i]->cancelSending(from, id, airtimeMsec) || cancelled;
+    return cancelled;
 }
 
 /**
@@ -286,14 +396,12 @@ void Router::sniffReceived(const meshtastic_MeshPacket *p, const meshtastic_Rout
 
 bool perhapsDecode(meshtastic_MeshPacket *p)
 {
-    concurrency::LockGuard g(cryptLock);
-
     if (config.device.role == meshtastic_Config_DeviceConfig_Role_REPEATER &&
         config.device.rebroadcast_mode == meshtastic_Config_DeviceConfig_RebroadcastMode_ALL_SKIP_DECODING)
         return false;
 
     if (config.device.rebroadcast_mode == meshtastic_Config_DeviceConfig_RebroadcastMode_KNOWN_ONLY &&
-        !nodeDB.getMeshNode(p->from)->has_user) {
+        !nodeDB.hasUser(p->from)) {
         LOG_DEBUG("Node 0x%x not in NodeDB. Rebroadcast mode KNOWN_ONLY will ignore packet\n", p->from);
         return false;
     }
@@ -303,52 +411,64 @@ bool perhapsDecode(meshtastic_MeshPacket *p)
 
     // assert(p->which_payloadVariant == MeshPacket_encrypted_tag);
 
-    // Try to find a channel that works with this hash
-    for (ChannelIndex chIndex = 0; chIndex < channels.getNumChannels(); chIndex++) {
-        // Try to use this hash/channel pair
-        if (channels.decryptForHash(chIndex, p->channel)) {
-            // Try to decrypt the packet if we can
-            size_t rawSize = p->encrypted.size;
-            assert(rawSize <= sizeof(bytes));
-            memcpy(bytes, p->encrypted.bytes,
-                   rawSize); // we have to copy into a scratch buffer, because these bytes are a union with the decoded protobuf
-            crypto->decrypt(p->from, p->id, rawSize, bytes);
-
-            // printBytes("plaintext", bytes, p->encrypted.size);
-
-            // Take those raw bytes and convert them back into a well structured protobuf we can understand
-            memset(&p->decoded, 0, sizeof(p->decoded));
-            if (!pb_decode_from_bytes(bytes, rawSize, &meshtastic_Data_msg, &p->decoded)) {
-                LOG_ERROR("Invalid protobufs in received mesh packet (bad psk?)!\n");
-            } else if (p->decoded.portnum == meshtastic_PortNum_UNKNOWN_APP) {
-                LOG_ERROR("Invalid portnum (bad psk?)!\n");
-            } else {
-                // parsing was successful
-                p->which_payload_variant = meshtastic_MeshPacket_decoded_tag; // change type to decoded
-                p->channel = chIndex;                                         // change to store the index instead of the hash
+    size_t rawSize = p->encrypted.size;
+    assert(rawSize <= MAX_RHPACKETLEN);
 
-                // Decompress if needed. jm
-                if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP) {
-                    // Decompress the payload
-                    char compressed_in[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
-                    char decompressed_out[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
-                    int decompressed_len;
+    // Try to find a channel that works with this hash (only channels with a matching hash need to be tried)
+    uint8_t candidates = channels.getChannelsForHash(p->channel);
 
-                    memcpy(compressed_in, p->decoded.payload.bytes, p->decoded.payload.size);
+    // Decoding overwrites the encrypted bytes (they are a union), so if we might need a second attempt keep a copy
+    uint8_t cipherCopy[MAX_RHPACKETLEN];
+    const uint8_t *cipher = p->encrypted.bytes;
+    if (candidates & (candidates - 1)) {
+        memcpy(cipherCopy, p->encrypted.bytes, rawSize);
+        cipher = cipherCopy;
+    }
 
-                    decompressed_len = unishox2_decompress_simple(compressed_in, p->decoded.payload.size, decompressed_out);
+    for (ChannelIndex chIndex = 0; candidates && chIndex < channels.getNumChannels(); chIndex++) {
+        if (!(candidates & (1 << chIndex)))
+            continue;
+        candidates &= ~(1 << chIndex);
 
-                    // LOG_DEBUG("\n\n**\n\nDecompressed length - %d \n", decompressed_len);
+        // Our own buffer (rather than a shared static one), so the lock only needs to cover the cipher
+        uint8_t plaintext[MAX_RHPACKETLEN];
+        {
+            concurrency::LockGuard g(cryptLock);
 
-                    memcpy(p->decoded.payload.bytes, decompressed_out, decompressed_len);
+            // Try to use this hash/channel pair
+            if (!channels.decryptForHash(chIndex, p->channel))
+                continue;
 
-                    // Switch the port from PortNum_TEXT_MESSAGE_COMPRESSED_APP to PortNum_TEXT_MESSAGE_APP
-                    p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
-                }
+            // Try to decrypt the packet if we can
+            memcpy(plaintext, cipher, rawSize);
+            crypto->decrypt(p->from, p->id, rawSize, plaintext);
+        }
 
-                printPacket("decoded message", p);
-                return true;
-            }
+        // printBytes("plaintext", plaintext, rawSize);
+
+        // Take those raw bytes and convert them back into a well structured protobuf we can understand
+        memset(&p->decoded, 0, sizeof(p->decoded));
+        if (!pb_decode_from_bytes(plaintext, rawSize, &meshtastic_Data_msg, &p->decoded)) {
+            LOG_ERROR("Invalid protobufs in received mesh packet (bad psk?)!\n");
+        } else if (p->decoded.portnum == meshtastic_PortNum_UNKNOWN_APP) {
+            LOG_ERROR("Invalid portnum (bad psk?)!\n");
+        } else {
+            // parsing was successful
+            p->which_payload_variant = meshtastic_MeshPacket_decoded_tag; // change type to decoded
+            p->channel = chIndex;                                         // change to store the index instead of the hash
+
+            // Expand the payload if it was sent on a compressed portnum (see PayloadCompression)
+            if (!payloadCompression.perhapsDecompress(*p))
+                return false;
+
+            printPacket("decoded message", p);
+            return true;
+        }
+
+        // That wasn't it, put the packet back the way it was for the next candidate
+        if (candidates) {
+            p->encrypted.size = rawSize;
+            memcpy(p->encrypted.bytes, cipher, rawSize);
         }
     }
 
@@ -356,6 +476,43 @@ bool perhapsDecode(meshtastic_MeshPacket *p)
     return false;
 }
 
+bool peekPortnum(const meshtastic_MeshPacket *p, meshtastic_PortNum *portnum)
+{
+    uint8_t candidates = channels.getChannelsForHash(p->channel);
+    if (!candidates || (candidates & (candidates - 1)))
+        return false; // with more than one key to try, a wrong one could give us a plausible portnum
+    ChannelIndex chIndex = 0;
+    while (!(candidates & (1 << chIndex)))
+        chIndex++;
+
+    // In CTR mode the start of the plaintext only takes the start of the keystream.  Data's first field is its portnum, a tag
+    // byte and a varint
+    uint8_t head[1 + 5];
+    size_t len = std::min<size_t>(p->encrypted.size, sizeof(head));
+    {
+        concurrency::LockGuard g(cryptLock);
+        if (!channels.decryptForHash(chIndex, p->channel))
+            return false;
+        memcpy(head, p->encrypted.bytes, len);
+        crypto->decrypt(p->from, p->id, len, head);
+    }
+
+    pb_istream_t stream = pb_istream_from_buffer(head, len);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    uint64_t value;
+    if (!pb_decode_tag(&stream, &wireType, &tag, &eof) || tag != meshtastic_Data_portnum_tag || wireType != PB_WT_VARINT ||
+        !pb_decode_varint(&stream, &value))
+        return false;
+
+    *portnum = (meshtastic_PortNum)value;
+    const PayloadCodec *codec = payloadCompression.findByCompressedPortNum(*portnum);
+    if (codec)
+        *portnum = codec->portNum;
+    return *portnum != meshtastic_PortNum_UNKNOWN_APP;
+}
+
 /** Return 0 for success or a Routing_Errror code for failure
  */
 meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p)
@@ -364,42 +521,10 @@ meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p)
 
     // If the packet is not yet encrypted, do so now
     if (p->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-        size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
-
-        // Only allow encryption on the text message app.
-        //  TODO: Allow modules to opt into compression.
-        if (p->decoded.portnum == meshtastic_PortNum_TEXT_MESSAGE_APP) {
+        // Compress first (if this portnum has a codec), so it is the compressed form which gets encoded
+        payloadCompression.perhapsCompress(*p);
 
-            char original_payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
-            memcpy(original_payload, p->decoded.payload.bytes, p->decoded.payload.size);
-
-            char compressed_out[meshtastic_Constants_DATA_PAYLOAD_LEN] = {0};
-
-            int compressed_len;
-            compressed_len = unishox2_compress_simple(original_payload, p->decoded.payload.size, compressed_out);
-
-            LOG_DEBUG("Original length - %d \n", p->decoded.payload.size);
-            LOG_DEBUG("Compressed length - %d \n", compressed_len);
-            LOG_DEBUG("Original message - %s \n", p->decoded.payload.bytes);
-
-            // If the compressed length is greater than or equal to the original size, don't use the compressed form
-            if (compressed_len >= p->decoded.payload.size) {
-
-                LOG_DEBUG("Not using compressing message.\n");
-                // Set the uncompressed payload variant anyway. Shouldn't hurt?
-                // p->decoded.which_payloadVariant = Data_payload_tag;
-
-                // Otherwise we use the compressor
-            } else {
-                LOG_DEBUG("Using compressed message.\n");
-                // Copy the compressed data into the meshpacket
-
-                p->decoded.payload.size = compressed_len;
-                memcpy(p->decoded.payload.bytes, compressed_out, compressed_len);
-
-                p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_COMPRESSED_APP;
-            }
-        }
+        size_t numbytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_Data_msg, &p->decoded);
 
         if (numbytes > MAX_RHPACKETLEN)
             return meshtastic_Routing_Error_TOO_LARGE;
@@ -414,7 +539,8 @@ meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p)
 
         // Now that we are encrypting the packet channel should be the hash (no longer the index)
         p->channel = hash;
-        crypto->encrypt(getFrom(p), p->id, numbytes, bytes);
+        if (!crypto->encryptPrecomputed(getFrom(p), p->id, numbytes, bytes))
+            crypto->encrypt(getFrom(p), p->id, numbytes, bytes);
 
         // Copy back into the packet and set the variant type
         memcpy(p->encrypted.bytes, bytes, numbytes);
@@ -430,18 +556,61 @@ NodeNum Router::getNodeNum()
     return nodeDB.getNodeNum();
 }
 
+bool Router::isTransitOnly(const meshtastic_MeshPacket *p, RxSource src, meshtastic_PortNum *portnum)
+{
+#if ROUTER_DEFER_TRANSIT_DECODE
+    // Broadcasts and packets for us go to the phone, which wants them decoded
+    if (src != RX_SRC_RADIO || p->which_payload_variant != meshtastic_MeshPacket_encrypted_tag || p->to == NODENUM_BROADCAST ||
+        p->to == getNodeNum())
+        return false;
+    if (!peekPortnum(p, portnum))
+        return false;
+
+    // We look inside these ourselves as they go past, for acks, trace routes and neighbor info
+    if (*portnum == meshtastic_PortNum_ROUTING_APP || *portnum == meshtastic_PortNum_TRACEROUTE_APP ||
+        *portnum == meshtastic_PortNum_NEIGHBORINFO_APP)
+        return false;
+    return !MeshModule::wantsDecodedTransit(*portnum);
+#else
+    return false;
+#endif
+}
+
 /**
  * Handle any packet that is received by an interface on this node.
  * Note: some packets may merely being passed through this node and will be forwarded elsewhere.
  */
 void Router::handleReceived(meshtastic_MeshPacket *p, RxSource src)
 {
-    // Also, we should set the time from the ISR and it should have msec level resolution
-    p->rx_time = getValidTime(RTCQualityFromNet); // store the arrival timestamp for the phone
+    // store the arrival timestamp for the phone, for a packet off fromRadioQueue when our radio heard it rather than now
+    p->rx_time = getValidTime(RTCQualityFromNet);
+    uint32_t ageSecs = src == RX_SRC_RADIO ? (micros() - rxUsec) / 1000000 : 0;
+    if (p->rx_time > ageSecs)
+        p->rx_time -= ageSecs;
+
+    // What it took on the air, before decoding overwrites its encrypted bytes, to charge to its portnum
+    bool heard = src == RX_SRC_RADIO && !p->via_mqtt && iface && p->which_payload_variant == meshtastic_MeshPacket_encrypted_tag;
+    uint32_t airtimeMsec = heard ? iface->getPacketTime(sizeof(PacketHeader) + p->encrypted.size) : 0;
 
     // Take those raw bytes and convert them back into a well structured protobuf we can understand
-    bool decoded = perhapsDecode(p);
-    if (decoded) {
+    // (unless we only relay it, then it stays encrypted, and anyone who needs to see inside after all calls perhapsDecode())
+    uint32_t decodeStart = micros();
+    meshtastic_PortNum portnum = meshtastic_PortNum_UNKNOWN_APP;
+    bool transit = isTransitOnly(p, src, &portnum);
+    bool decoded = !transit && perhapsDecode(p);
+    if (decoded)
+        portnum = p->decoded.portnum;
+    if (heard && airTime)
+        airTime->logPortAirtime(portnum, airtimeMsec);
+    PACKET_TRACE_MARK(getFrom(p), p->id, RX_DECODED);
+    if (src == RX_SRC_RADIO) {
+        radioStats.record(RadioStats::DECODE, micros() - decodeStart);
+        if (!decoded && !transit)
+            radioStats.countError(RadioStats::RX_UNDECODABLE);
+    }
+    if (transit) {
+        LOG_DEBUG("Relaying packet 0x%x for 0x%x (portnum %d) without decoding it\n", p->id, p->to, portnum);
+    } else if (decoded) {
         // parsing was successful, queue for our recipient
         if (src == RX_SRC_LOCAL)
             printPacket("handleReceived(LOCAL)", p);
@@ -455,6 +624,7 @@ void Router::handleReceived(meshtastic_MeshPacket *p, RxSource src)
 
     // call modules here
     MeshModule::callPlugins(*p, src);
+    PACKET_TRACE_MARK(getFrom(p), p->id, RX_HANDLED);
 }
 
 void Router::perhapsHandleReceived(meshtastic_MeshPacket *p)
@@ -6,8 +6,36 @@
 #include "Observer.h"
 #include "PointerQueue.h"
 #include "RadioInterface.h"
+#include "SPSCQueue.h"
 #include "concurrency/OSThread.h"
 
+/// How many radios a Router can drive at once
+#ifndef MAX_RADIO_INTERFACES
+#define MAX_RADIO_INTERFACES 2
+#endif
+
+/// Max number of received packets waiting for the Router, must be a power of two.  It only holds pointers, but each queued
+/// packet is also a slot in the packet pool (see MAX_PACKETS) so boards with little RAM keep it small.
+#ifndef MAX_RX_FROMRADIO
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define MAX_RX_FROMRADIO 16
+#elif defined(ARCH_STM32WL)
+#define MAX_RX_FROMRADIO 4
+#else
+#define MAX_RX_FROMRADIO 8
+#endif
+#endif
+
+/// Once fewer than this many slots are free in fromRadioQueue we only accept packets which are worth keeping (see
+/// Router::isSheddable()), so a burst of floods can't crowd out something addressed to us
+#define RX_FROMRADIO_RESERVED (MAX_RX_FROMRADIO / 4)
+
+/// Leave packets we only relay (DMs for someone else, on a portnum nobody here looks at) encrypted, rather than decoding them
+/// only to encode them all over again for the rebroadcast
+#ifndef ROUTER_DEFER_TRANSIT_DECODE
+#define ROUTER_DEFER_TRANSIT_DECODE 1
+#endif
+
 /**
  * A mesh aware router that supports multiple interfaces.
  */
@@ -15,12 +43,39 @@ class Router : protected concurrency::OSThread
 {
   private:
     /// Packets which have just arrived from the radio, ready to be processed by this service and possibly
-    /// forwarded to the phone.
-    PointerQueue<meshtastic_MeshPacket> fromRadioQueue;
+    /// forwarded to the phone.  Everyone calling enqueueReceivedMessage() runs on the main thread (or with USE_PACKET_TASK,
+    /// holds packetLock), so it only ever has one producer at a time.
+    SPSCQueue<meshtastic_MeshPacket, MAX_RX_FROMRADIO> fromRadioQueue;
+
+    /// When the packet we are handling now arrived, by micros(), carried through fromRadioQueue as each packet's tag
+    uint32_t rxUsec = 0;
+
+    /// Debugging counts for fromRadioQueue: dropped because it was full / shed to keep the reserve / most ever queued
+    uint32_t rxQueueDropped = 0, rxQueueShed = 0;
+    uint8_t rxQueueHighWater = 0;
+
+    /// @return true if p is something we can afford to lose when fromRadioQueue is nearly full (anything not addressed to us
+    /// and not waiting on an ack, i.e. mostly floods of positions, telemetry and nodeinfo)
+    bool isSheddable(const meshtastic_MeshPacket *p);
+
+    /// @return true if p is a packet we only relay, which nobody here needs to see inside (so handleReceived() can leave it
+    /// encrypted), with the portnum read from its first few bytes in portnum
+    bool isTransitOnly(const meshtastic_MeshPacket *p, RxSource src, meshtastic_PortNum *portnum);
+
+    /// Work out the keystream for our own next few packets on the primary channel, if there's any we don't have yet
+    void precomputeKeystreams();
 
   protected:
+    /// Our primary interface (the first one added), also used for all our airtime calculations
     RadioInterface *iface = NULL;
 
+    /// Every interface we can send on, ifaces[0] is iface
+    RadioInterface *ifaces[MAX_RADIO_INTERFACES] = {};
+    uint8_t numInterfaces = 0;
+
+    /// @return the interface to send our next packet on (the one with the most room in its TX queue)
+    RadioInterface *pickInterface();
+
   public:
     /**
      * Constructor
@@ -29,9 +84,10 @@ class Router : protected concurrency::OSThread
     Router();
 
     /**
-     * Currently we only allow one interface, that may change in the future
+     * Add a radio we can send and receive on (up to MAX_RADIO_INTERFACES).  Each keeps its own TX queue, we send each packet
+     * on whichever has the most room and everything received on any of them goes through the same dedupe.
      */
-    void addInterface(RadioInterface *_iface) { iface = _iface; }
+    void addInterface(RadioInterface *_iface);
 
     /**
      * do idle processing
@@ -47,8 +103,11 @@ class Router : protected concurrency::OSThread
      */
     ErrorCode sendLocal(meshtastic_MeshPacket *p, RxSource src = RX_SRC_RADIO);
 
-    /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-    bool cancelSending(NodeNum from, PacketId id);
+    /**
+     * Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel, and if airtimeMsec is
+     * given sets it to how long that packet would have been on the air
+     */
+    bool cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec = NULL);
 
     /** Allocate and return a meshpacket which defaults as send to broadcast from the current node.
      * The returned packet is guaranteed to have a unique packet ID already assigned
@@ -68,10 +127,17 @@ class Router : protected concurrency::OSThread
     void setReceivedMessage();
 
     /**
-     * RadioInterface calls this to queue up packets that have been received from the radio.  The router is now responsible for
-     * freeing the packet
+     * RadioInterface calls this to queue up packets that have been received from the radio (at rxUsec, by micros(), which
+     * is when its interrupt fired).  The router is now responsible for freeing the packet
      */
-    void enqueueReceivedMessage(meshtastic_MeshPacket *p);
+    void enqueueReceivedMessage(meshtastic_MeshPacket *p, uint32_t rxUsec);
+
+    /// For packets which didn't come through a radio interrupt (MQTT, our own loopback), they arrive now
+    void enqueueReceivedMessage(meshtastic_MeshPacket *p) { enqueueReceivedMessage(p, micros()); }
+
+    /// @return when (by micros()) the packet handleReceived() is working on arrived, for anything which wants better than
+    /// rx_time's seconds (e.g. to time a reply to it)
+    uint32_t getRxUsec() const { return rxUsec; }
 
     /**
      * Send a packet on a suitable interface.  This routine will
@@ -82,6 +148,32 @@ class Router : protected concurrency::OSThread
      */
     virtual ErrorCode send(meshtastic_MeshPacket *p);
 
+    /// What an interface should do with a packet it has just received, see checkCutThrough()
+    enum CutThroughAction {
+        CUT_THROUGH_NONE,       // build a MeshPacket and deliver it to us as usual
+        CUT_THROUGH_DROP,       // we don't want it at all, don't even allocate a packet
+        CUT_THROUGH_REBROADCAST // build a MeshPacket and hand it straight to sendCutThrough()
+    };
+
+    /**
+     * Called by interfaces with the raw header of every received packet (payloadLen bytes follow it, heard at snr and rssi),
+     * before they build a MeshPacket for it.  Duplicates can then be dropped without a packet, a copy, a log line or the
+     * receive queue, and nodes which never decode anything (REPEATER with ALL_SKIP_DECODING) can dedupe and rebroadcast
+     * without the receive queue, modules or a second copy of the packet.
+     */
+    virtual CutThroughAction checkCutThrough(const PacketHeader *h, size_t payloadLen, float snr, int32_t rssi)
+    {
+        return CUT_THROUGH_NONE;
+    }
+
+    /**
+     * Rebroadcast a still encrypted packet the interface just received (after checkCutThrough() said so).  We decrement the
+     * hop limit here.
+     *
+     * NOTE: This method will free the provided packet (even if we return an error code)
+     */
+    ErrorCode sendCutThrough(meshtastic_MeshPacket *p);
+
   protected:
     friend class RoutingModule;
 
@@ -138,6 +230,14 @@ class Router : protected concurrency::OSThread
  */
 bool perhapsDecode(meshtastic_MeshPacket *p);
 
+/**
+ * Decrypt just enough of an encrypted packet to read its portnum (the uncompressed one, for a compressed portnum), leaving the
+ * packet as it was.
+ *
+ * @return false if we can't tell, because no channel gives a plausible portnum or more than one might be the packet's
+ */
+bool peekPortnum(const meshtastic_MeshPacket *p, meshtastic_PortNum *portnum);
+
 /** Return 0 for success or a Routing_Errror code for failure
  */
 meshtastic_Routing_Error perhapsEncode(meshtastic_MeshPacket *p);
@@ -147,3 +247,6 @@ extern Router *router;
 /// Generate a unique packet id
 // FIXME, move this someplace better
 PacketId generatePacketId();
+
+/// The id generatePacketId() will return after handing out ahead more, without using any up
+PacketId peekPacketId(uint32_t ahead);
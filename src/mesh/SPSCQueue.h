@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A fixed size single producer/single consumer ring of pointers.
+ *
+ * enqueue() and dequeue() never block or lock, each side only ever writes its own index, so one context can be filling the
+ * ring (an ISR or radio thread) while another drains it.  More than one context calling enqueue() (or dequeue()) at the
+ * same time is NOT safe.
+ *
+ * Size must be a power of two, the indexes are free running and just wrap.
+ *
+ * Each entry can carry a 32 bit tag (e.g. when it was queued) which travels with it.
+ */
+template <class T, size_t Size> class SPSCQueue
+{
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "SPSCQueue size must be a power of two");
+
+    T *buf[Size];
+    uint32_t tags[Size];
+
+    /// Next slot to write, only changed by the producer
+    std::atomic<uint32_t> head;
+
+    /// Next slot to read, only changed by the consumer
+    std::atomic<uint32_t> tail;
+
+  public:
+    SPSCQueue() : head(0), tail(0) {}
+
+    /// @return false (and leaves the ring untouched) if the ring is full
+    bool enqueue(T *p, uint32_t tag = 0)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= Size)
+            return false;
+
+        buf[h & (Size - 1)] = p;
+        tags[h & (Size - 1)] = tag;
+        head.store(h + 1, std::memory_order_release); // publish the slot only once it is written
+        return true;
+    }
+
+    /// @return the oldest pointer in the ring (and its tag in *tag, if given), or NULL if it is empty
+    T *dequeue(uint32_t *tag = NULL)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return NULL;
+
+        T *p = buf[t & (Size - 1)];
+        if (tag)
+            *tag = tags[t & (Size - 1)]; // read before we hand the slot back
+        tail.store(t + 1, std::memory_order_release);
+        return p;
+    }
+
+    /// Safe from either side, though of course the answer may be stale by the time you look at it
+    size_t numUsed() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    size_t numFree() const { return Size - numUsed(); }
+
+    bool isEmpty() const { return numUsed() == 0; }
+
+    static constexpr size_t capacity() { return Size; }
+};
@@ -1,4 +1,5 @@
 #include "SX126xInterface.h"
+#include "EnergyStats.h"
 #include "configuration.h"
 #include "error.h"
 #include "mesh/NodeDB.h"
@@ -18,6 +19,8 @@ SX126xInterface<T>::SX126xInterface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE cs
     : RadioLibInterface(hal, cs, irq, rst, busy, &lora), lora(&module)
 {
     LOG_WARN("SX126xInterface(cs=%d, irq=%d, rst=%d, busy=%d)\n", cs, irq, rst, busy);
+    spiProbeRegister = RADIOLIB_SX126X_REG_LORA_SYNC_WORD_MSB; // and the LSB, we only ever set them in init()
+    spiProbeLen = 2;
 }
 
 /// Initialise the Driver transport hardware and software.
@@ -32,7 +35,7 @@ template <typename T> bool SX126xInterface<T>::init()
 
 #if ARCH_PORTDUINO
     float tcxoVoltage = 0;
-    if (settingsMap[dio3_tcxo_voltage])
+    if (portduinoSettings.dio3TcxoVoltage)
         tcxoVoltage = 1.8;
 // FIXME: correct logic to default to not using TCXO if no voltage is specified for SX126X_DIO3_TCXO_VOLTAGE
 #elif !defined(SX126X_DIO3_TCXO_VOLTAGE)
@@ -86,7 +89,7 @@ template <typename T> bool SX126xInterface<T>::init()
     bool dio2AsRfSwitch = true;
 #elif defined(ARCH_PORTDUINO)
     bool dio2AsRfSwitch = false;
-    if (settingsMap[dio2_as_rf_switch]) {
+    if (portduinoSettings.dio2AsRfSwitch) {
         LOG_DEBUG("Setting DIO2 as RF switch\n");
         dio2AsRfSwitch = true;
     }
@@ -102,8 +105,9 @@ template <typename T> bool SX126xInterface<T>::init()
     // no effect
 #if ARCH_PORTDUINO
     if (res == RADIOLIB_ERR_NONE) {
-        LOG_DEBUG("Using MCU pin %i as RXEN and pin %i as TXEN to control RF switching\n", settingsMap[rxen], settingsMap[txen]);
-        lora.setRfSwitchPins(settingsMap[rxen], settingsMap[txen]);
+        LOG_DEBUG("Using MCU pin %i as RXEN and pin %i as TXEN to control RF switching\n", portduinoSettings.rxen,
+                  portduinoSettings.txen);
+        lora.setRfSwitchPins(portduinoSettings.rxen, portduinoSettings.txen);
     }
 #else
 #ifndef SX126X_RXEN
@@ -154,56 +158,140 @@ template <typename T> bool SX126xInterface<T>::init()
     if (res == RADIOLIB_ERR_NONE)
         res = lora.setCRC(RADIOLIB_SX126X_LORA_CRC_ON);
 
-    if (res == RADIOLIB_ERR_NONE)
+    if (res == RADIOLIB_ERR_NONE) {
+        setApplied();   // what begin() and the current limit above set
         startReceive(); // start receiving
+    }
 
     return res == RADIOLIB_ERR_NONE;
 }
 
+template <typename T> void SX126xInterface<T>::setApplied()
+{
+    applied.valid = true;
+    applied.freq = getFreq();
+    applied.bw = bw;
+    applied.currentLimit = currentLimit;
+    applied.sf = sf;
+    applied.cr = cr;
+    applied.preambleLength = preambleLength;
+    applied.power = power;
+}
+
 template <typename T> bool SX126xInterface<T>::reconfigure()
 {
     RadioLibInterface::reconfigure();
 
+    if (power > SX126X_MAX_POWER) // This chip has lower power limits than some
+        power = SX126X_MAX_POWER;
+
+#if SX126X_FAST_RECONFIGURE
+    // Only send what changed, each setting is a command or two (and a new frequency a calibration) with the radio not listening
+    bool changedOnly = applied.valid;
+    if (changedOnly && applied.freq == getFreq() && applied.bw == bw && applied.sf == sf && applied.cr == cr &&
+        applied.currentLimit == currentLimit && applied.preambleLength == preambleLength && applied.power == power) {
+        LOG_DEBUG("Radio settings unchanged, keep receiving\n");
+        return RADIOLIB_ERR_NONE;
+    }
+#else
+    bool changedOnly = false;
+#endif
+    applied.valid = false; // until we know the radio took them all
+
     // set mode to standby
     setStandby();
 
     // configure publicly accessible settings
-    int err = lora.setSpreadingFactor(sf);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+    int err;
+    bool ok = true;
+    if (!changedOnly || applied.sf != sf) {
+        err = lora.setSpreadingFactor(sf);
+        if (err != RADIOLIB_ERR_NONE) {
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+            ok = false;
+        }
+    }
 
-    err = lora.setBandwidth(bw);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+    if (!changedOnly || applied.bw != bw) {
+        err = lora.setBandwidth(bw);
+        if (err != RADIOLIB_ERR_NONE) {
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+            ok = false;
+        }
+    }
 
-    err = lora.setCodingRate(cr);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+    if (!changedOnly || applied.cr != cr) {
+        err = lora.setCodingRate(cr);
+        if (err != RADIOLIB_ERR_NONE) {
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+            ok = false;
+        }
+    }
 
-    err = lora.setSyncWord(syncWord);
-    assert(err == RADIOLIB_ERR_NONE);
+    if (!changedOnly) { // it never changes
+        err = lora.setSyncWord(syncWord);
+        assert(err == RADIOLIB_ERR_NONE);
+    }
 
-    err = lora.setCurrentLimit(currentLimit);
-    assert(err == RADIOLIB_ERR_NONE);
+    if (!changedOnly || applied.currentLimit != currentLimit) {
+        err = lora.setCurrentLimit(currentLimit);
+        assert(err == RADIOLIB_ERR_NONE);
+    }
 
-    err = lora.setPreambleLength(preambleLength);
-    assert(err == RADIOLIB_ERR_NONE);
+    if (!changedOnly || applied.preambleLength != preambleLength) {
+        err = lora.setPreambleLength(preambleLength);
+        assert(err == RADIOLIB_ERR_NONE);
+    }
 
-    err = lora.setFrequency(getFreq());
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+    if (!changedOnly || applied.freq != getFreq()) {
+        err = lora.setFrequency(getFreq());
+        if (err != RADIOLIB_ERR_NONE) {
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+            ok = false;
+        }
+    }
 
-    if (power > SX126X_MAX_POWER) // This chip has lower power limits than some
-        power = SX126X_MAX_POWER;
+    if (!changedOnly || applied.power != power) {
+        err = lora.setOutputPower(power);
+        assert(err == RADIOLIB_ERR_NONE);
+    }
 
-    err = lora.setOutputPower(power);
-    assert(err == RADIOLIB_ERR_NONE);
+    if (ok)
+        setApplied();
 
+    logRxCurrent();
     startReceive(); // restart receiving
 
     return RADIOLIB_ERR_NONE;
 }
 
+template <typename T> void SX126xInterface<T>::logRxCurrent()
+{
+    // From the SX1261/2 datasheet: RX with the DC-DC regulator (boosted gain adds 0.7mA), and sleep with warm start
+    float rxMilliAmps = config.lora.sx126x_rx_boosted_gain ? 5.3 : 4.6, sleepMilliAmps = 0.0012;
+#if USE_SX126X_RX_DUTY_CYCLE
+    float listening = rxDutyCycleSleepUsec
+                          ? (float)rxDutyCycleWakeUsec / (rxDutyCycleWakeUsec + rxDutyCycleSleepUsec + RX_DUTY_CYCLE_WAKE_USEC)
+                          : 1;
+#else
+    float listening = 1;
+#endif
+    LOG_INFO("SX126x RX: listening %.0f%% of the time (wake %uus, sleep %uus), about %.2fmA idle\n", listening * 100,
+             rxDutyCycleWakeUsec, rxDutyCycleSleepUsec, listening * rxMilliAmps + (1 - listening) * sleepMilliAmps);
+    energyStats.setRxMilliAmps(listening * rxMilliAmps + (1 - listening) * sleepMilliAmps);
+}
+
+template <typename T> bool SX126xInterface<T>::canSleep()
+{
+    // activeReceiveStart is only kept up to date by isActivelyReceiving(), but that is always asked before we send
+    if (activeReceiveStart && millis() - activeReceiveStart < maxPacketTimeMsec) {
+        LOG_DEBUG("radio wait to sleep, still receiving\n");
+        return false;
+    }
+
+    return RadioLibInterface::canSleep();
+}
+
 template <typename T> void INTERRUPT_ATTR SX126xInterface<T>::disableInterrupt()
 {
     lora.clearDio1Action();
@@ -230,11 +318,16 @@ template <typename T> void SX126xInterface<T>::setStandby()
 /**
  * Add SNR data to received messages
  */
-template <typename T> void SX126xInterface<T>::addReceiveMetadata(meshtastic_MeshPacket *mp)
+template <typename T> void SX126xInterface<T>::getReceiveMetadata(float &snr, int32_t &rssi)
 {
     // LOG_DEBUG("PacketStatus %x\n", lora.getPacketStatus());
-    mp->rx_snr = lora.getSNR();
-    mp->rx_rssi = lround(lora.getRSSI());
+    snr = lora.getSNR();
+    rssi = lround(lora.getRSSI());
+}
+
+template <typename T> bool SX126xInterface<T>::setTxPower(int8_t dBm)
+{
+    return lora.setOutputPower(dBm) == RADIOLIB_ERR_NONE;
 }
 
 /** We override to turn on transmitter power as needed.
@@ -255,17 +348,22 @@ template <typename T> void SX126xInterface<T>::startReceive()
 
     setStandby();
 
+    // We need the PREAMBLE_DETECTED and HEADER_VALID IRQ flag to detect whether we are actively receiving
+    uint16_t irqFlags = RADIOLIB_SX126X_IRQ_RX_DEFAULT | RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED | RADIOLIB_SX126X_IRQ_HEADER_VALID;
+#if USE_SX126X_RX_DUTY_CYCLE
+    // Listen just long enough to catch a preamble, then sleep, see RadioInterface::applyModemConfig()
+    int err = rxDutyCycleSleepUsec ? lora.startReceiveDutyCycle(rxDutyCycleWakeUsec, rxDutyCycleSleepUsec, irqFlags)
+                                     : lora.startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF, irqFlags);
+#else
     // We use a 16 bit preamble so this should save some power by letting radio sit in standby mostly.
-    // Furthermore, we need the PREAMBLE_DETECTED and HEADER_VALID IRQ flag to detect whether we are actively receiving
-    int err = lora.startReceiveDutyCycleAuto(preambleLength, 8,
-                                             RADIOLIB_SX126X_IRQ_RX_DEFAULT | RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED |
-                                                 RADIOLIB_SX126X_IRQ_HEADER_VALID);
+    int err = lora.startReceiveDutyCycleAuto(preambleLength, 8, irqFlags);
+#endif
     assert(err == RADIOLIB_ERR_NONE);
 
     isReceiving = true;
 
     // Must be done AFTER, starting transmit, because startTransmit clears (possibly stale) interrupt pending register bits
-    enableInterrupt(isrRxLevel0);
+    armInterrupt(isrRxLevel0);
 #endif
 }
 
@@ -285,6 +383,23 @@ template <typename T> bool SX126xInterface<T>::isChannelActive()
     return false;
 }
 
+template <typename T> bool SX126xInterface<T>::sampleChannel(bool withCad, float &rssi, bool &detected)
+{
+#if USE_SX126X_RX_DUTY_CYCLE
+    if (rxDutyCycleSleepUsec)
+        return false; // asking would end the sleep phases which save us our power
+#endif
+    if (!isIdleListening())
+        return false;
+
+    rssi = lora.getRSSI(false); // what's on the air right now, not the last packet's
+    if (withCad) {
+        detected = isChannelActive();
+        startReceive();
+    }
+    return true;
+}
+
 /** Could we send right now (i.e. either not actively receiving or transmitting)? */
 template <typename T> bool SX126xInterface<T>::isActivelyReceiving()
 {
@@ -301,16 +416,25 @@ template <typename T> bool SX126xInterface<T>::isActivelyReceiving()
         } else if ((now - activeReceiveStart > 2 * preambleTimeMsec) && !(irq & RADIOLIB_SX126X_IRQ_HEADER_VALID)) {
             // The HEADER_VALID flag should be set by now if it was really a packet, so ignore PREAMBLE_DETECTED flag
             activeReceiveStart = 0;
-            LOG_DEBUG("Ignore false preamble detection.\n");
+            rxFalseDetections++;
+            LOG_DEBUG("Ignore false preamble detection (%u, vs %u good and %u bad packets).\n", rxFalseDetections, rxGood,
+                      rxBad);
             return false;
         } else if (now - activeReceiveStart > maxPacketTimeMsec) {
             // We should have gotten an RX_DONE IRQ by now if it was really a packet, so ignore HEADER_VALID flag
             activeReceiveStart = 0;
-            LOG_DEBUG("Ignore false header detection.\n");
+            rxFalseDetections++;
+            LOG_DEBUG("Ignore false header detection (%u, vs %u good and %u bad packets).\n", rxFalseDetections, rxGood,
+                      rxBad);
             return false;
         }
+    } else {
+        activeReceiveStart = 0;
     }
 
+    // Note: in duty cycle mode, asking for the IRQ status wakes the radio from its sleep phase and ends the cycle.  We are
+    // only asked when we want to send though, and startReceive() restarts it once we have.
+
     // if (detected) LOG_DEBUG("rx detected\n");
     return detected;
 }
@@ -329,6 +453,7 @@ template <typename T> bool SX126xInterface<T>::sleep()
     // put chipset into sleep mode (we've already disabled interrupts by now)
     bool keepConfig = true;
     lora.sleep(keepConfig); // Note: we do not keep the config, full reinit will be needed
+    applied.valid = false;  // so a reconfigure() sends everything again
 
 #ifdef SX126X_POWER_EN
     digitalWrite(SX126X_POWER_EN, LOW);
@@ -2,6 +2,12 @@
 
 #include "RadioLibInterface.h"
 
+/// Have reconfigure() send the radio only the settings which changed, and nothing at all (not even a restart of receiving)
+/// when none did, so switching channel or preset costs a command or two rather than the whole setup
+#ifndef SX126X_FAST_RECONFIGURE
+#define SX126X_FAST_RECONFIGURE 1
+#endif
+
 /**
  * \brief Adapter for SX126x radio family. Implements common logic for child classes.
  * \tparam T RadioLib module type for SX126x: SX1262, SX1268.
@@ -27,6 +33,9 @@ template <class T> class SX126xInterface : public RadioLibInterface
 
     bool isIRQPending() override { return lora.getIrqStatus() != 0; }
 
+    /// We can't sleep in the middle of hearing a packet
+    virtual bool canSleep() override;
+
   protected:
     float currentLimit = 140; // Higher OCP limit for SX126x PA
 
@@ -48,6 +57,8 @@ template <class T> class SX126xInterface : public RadioLibInterface
     /** can we detect a LoRa preamble on the current channel? */
     virtual bool isChannelActive() override;
 
+    virtual bool sampleChannel(bool withCad, float &rssi, bool &detected) override;
+
     /** are we actively receiving a packet (only called during receiving state) */
     virtual bool isActivelyReceiving() override;
 
@@ -64,10 +75,31 @@ template <class T> class SX126xInterface : public RadioLibInterface
     /**
      * Add SNR data to received messages
      */
-    virtual void addReceiveMetadata(meshtastic_MeshPacket *mp) override;
+    virtual void getReceiveMetadata(float &snr, int32_t &rssi) override;
+
+    virtual bool setTxPower(int8_t dBm) override;
 
     virtual void setStandby() override;
 
   private:
     uint32_t activeReceiveStart = 0;
+
+    /// The settings the radio has now, for reconfigure() to send only what changed (valid false when we don't know them)
+    struct AppliedSettings {
+        bool valid = false;
+        float freq = 0, bw = 0, currentLimit = 0;
+        uint8_t sf = 0, cr = 0;
+        uint16_t preambleLength = 0;
+        int8_t power = 0;
+    } applied;
+
+    /// Note our current settings as what the radio has
+    void setApplied();
+
+    /// Debugging counts: preambles (or headers) we detected which never turned into a packet, in duty cycle mode those are
+    /// mostly packets we only woke up for partway through
+    uint32_t rxFalseDetections = 0;
+
+    /// Log what our listening costs with the current modem config
+    void logRxCurrent();
 };
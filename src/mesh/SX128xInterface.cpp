@@ -12,10 +12,34 @@
 #define SX128X_MAX_POWER 13
 #endif
 
+/**
+ * Run this radio with the FLRC modem at this many kbps (260, 325, 520, 650, 1000 or 1300) instead of LoRa, for a short range
+ * backhaul link which moves bulk traffic (store and forward history, file and firmware transfers) hundreds of times faster.
+ * FLRC nodes can not hear LoRa ones (or each other's CAD), so every node on the link must be built the same way.
+ * 0 (the default) means plain LoRa.
+ */
+#ifndef SX128X_FLRC_BITRATE
+#define SX128X_FLRC_BITRATE 0
+#endif
+
+/// FLRC coding rate, 2 = 1/2, 3 = 3/4 or 4 = uncoded
+#ifndef SX128X_FLRC_CR
+#define SX128X_FLRC_CR 3
+#endif
+
+/// FLRC preamble in bits, RadioLib's default
+#define SX128X_FLRC_PREAMBLE_BITS 16
+
+/// FLRC sync word, header and CRC lengths in bits (we use RadioLib's default 4 byte sync word and a 2 byte CRC)
+#define SX128X_FLRC_SYNC_BITS 32
+#define SX128X_FLRC_HEADER_BITS 16
+#define SX128X_FLRC_CRC_BITS 16
+#define SX128X_FLRC_TAIL_BITS 6
+
 template <typename T>
 SX128xInterface<T>::SX128xInterface(LockingArduinoHal *hal, RADIOLIB_PIN_TYPE cs, RADIOLIB_PIN_TYPE irq, RADIOLIB_PIN_TYPE rst,
                                     RADIOLIB_PIN_TYPE busy)
-    : RadioLibInterface(hal, cs, irq, rst, busy, &lora), lora(&module)
+    : RadioLibInterface(hal, cs, irq, rst, busy, &lora), lora(&module), flrcBitrate(SX128X_FLRC_BITRATE), flrcCr(SX128X_FLRC_CR)
 {
     LOG_WARN("SX128xInterface(cs=%d, irq=%d, rst=%d, busy=%d)\n", cs, irq, rst, busy);
 }
@@ -36,13 +60,13 @@ template <typename T> bool SX128xInterface<T>::init()
 #endif
 
 #if ARCH_PORTDUINO
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        pinMode(settingsMap[rxen], OUTPUT);
-        digitalWrite(settingsMap[rxen], LOW); // Set low before becoming an output
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        pinMode(portduinoSettings.rxen, OUTPUT);
+        digitalWrite(portduinoSettings.rxen, LOW); // Set low before becoming an output
     }
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        pinMode(settingsMap[txen], OUTPUT);
-        digitalWrite(settingsMap[txen], LOW); // Set low before becoming an output
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        pinMode(portduinoSettings.txen, OUTPUT);
+        digitalWrite(portduinoSettings.txen, LOW); // Set low before becoming an output
     }
 #else
 #if defined(SX128X_RXEN) && (SX128X_RXEN != RADIOLIB_NC) // set not rx or tx mode
@@ -62,11 +86,18 @@ template <typename T> bool SX128xInterface<T>::init()
 
     limitPower();
 
-    preambleLength = 12; // 12 is the default for this chip, 32 does not RX at all
-
-    int res = lora.begin(getFreq(), bw, sf, cr, syncWord, power, preambleLength);
-    // \todo Display actual typename of the adapter, not just `SX128x`
-    LOG_INFO("SX128x init result %d\n", res);
+    int res;
+    if (isFlrc()) {
+        preambleLength = SX128X_FLRC_PREAMBLE_BITS;
+        res = lora.beginFLRC(getFreq(), flrcBitrate, flrcCr, power, preambleLength);
+        LOG_INFO("SX128x FLRC init result %d, %u kbps, cr %u\n", res, flrcBitrate, flrcCr);
+    } else {
+        preambleLength = 12; // 12 is the default for this chip, 32 does not RX at all
+
+        res = lora.begin(getFreq(), bw, sf, cr, syncWord, power, preambleLength);
+        // \todo Display actual typename of the adapter, not just `SX128x`
+        LOG_INFO("SX128x init result %d\n", res);
+    }
 
     if ((config.lora.region != meshtastic_Config_LoRaConfig_RegionCode_LORA_24) && (res == RADIOLIB_ERR_INVALID_FREQUENCY)) {
         LOG_WARN("Radio chip only supports 2.4GHz LoRa. Adjusting Region and rebooting.\n");
@@ -91,8 +122,8 @@ template <typename T> bool SX128xInterface<T>::init()
         lora.setRfSwitchPins(SX128X_RXEN, SX128X_TXEN);
     }
 #elif ARCH_PORTDUINO
-    if (res == RADIOLIB_ERR_NONE && settingsMap[rxen] != RADIOLIB_NC && settingsMap[txen] != RADIOLIB_NC) {
-        lora.setRfSwitchPins(settingsMap[rxen], settingsMap[txen]);
+    if (res == RADIOLIB_ERR_NONE && portduinoSettings.rxen != RADIOLIB_NC && portduinoSettings.txen != RADIOLIB_NC) {
+        lora.setRfSwitchPins(portduinoSettings.rxen, portduinoSettings.txen);
     }
 #endif
 
@@ -113,20 +144,32 @@ template <typename T> bool SX128xInterface<T>::reconfigure()
     setStandby();
 
     // configure publicly accessible settings
-    int err = lora.setSpreadingFactor(sf);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
-
-    err = lora.setBandwidth(bw);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
-
-    err = lora.setCodingRate(cr);
-    if (err != RADIOLIB_ERR_NONE)
-        RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
-
-    err = lora.setSyncWord(syncWord);
-    assert(err == RADIOLIB_ERR_NONE);
+    int err;
+    if (isFlrc()) {
+        // The LoRa modem settings from our preset don't apply, FLRC only has a bit rate and coding rate
+        err = lora.setBitRate(flrcBitrate);
+        if (err != RADIOLIB_ERR_NONE)
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+
+        err = lora.setCodingRate(flrcCr);
+        if (err != RADIOLIB_ERR_NONE)
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+    } else {
+        err = lora.setSpreadingFactor(sf);
+        if (err != RADIOLIB_ERR_NONE)
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+
+        err = lora.setBandwidth(bw);
+        if (err != RADIOLIB_ERR_NONE)
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+
+        err = lora.setCodingRate(cr);
+        if (err != RADIOLIB_ERR_NONE)
+            RECORD_CRITICALERROR(meshtastic_CriticalErrorCode_INVALID_RADIO_SETTING);
+
+        err = lora.setSyncWord(syncWord);
+        assert(err == RADIOLIB_ERR_NONE);
+    }
 
     err = lora.setPreambleLength(preambleLength);
     assert(err == RADIOLIB_ERR_NONE);
@@ -168,11 +211,11 @@ template <typename T> void SX128xInterface<T>::setStandby()
 
     assert(err == RADIOLIB_ERR_NONE);
 #if ARCH_PORTDUINO
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[rxen], LOW);
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.rxen, LOW);
     }
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[txen], LOW);
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.txen, LOW);
     }
 #else
 #if defined(SX128X_RXEN) && (SX128X_RXEN != RADIOLIB_NC) // we have RXEN/TXEN control - turn off RX and TX power
@@ -191,11 +234,16 @@ template <typename T> void SX128xInterface<T>::setStandby()
 /**
  * Add SNR data to received messages
  */
-template <typename T> void SX128xInterface<T>::addReceiveMetadata(meshtastic_MeshPacket *mp)
+template <typename T> void SX128xInterface<T>::getReceiveMetadata(float &snr, int32_t &rssi)
 {
     // LOG_DEBUG("PacketStatus %x\n", lora.getPacketStatus());
-    mp->rx_snr = lora.getSNR();
-    mp->rx_rssi = lround(lora.getRSSI());
+    snr = lora.getSNR();
+    rssi = lround(lora.getRSSI());
+}
+
+template <typename T> bool SX128xInterface<T>::setTxPower(int8_t dBm)
+{
+    return lora.setOutputPower(dBm) == RADIOLIB_ERR_NONE;
 }
 
 /** We override to turn on transmitter power as needed.
@@ -203,11 +251,11 @@ template <typename T> void SX128xInterface<T>::addReceiveMetadata(meshtastic_Mes
 template <typename T> void SX128xInterface<T>::configHardwareForSend()
 {
 #if ARCH_PORTDUINO
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[txen], HIGH);
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.txen, HIGH);
     }
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[rxen], LOW);
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.rxen, LOW);
     }
 
 #else
@@ -234,11 +282,11 @@ template <typename T> void SX128xInterface<T>::startReceive()
     setStandby();
 
 #if ARCH_PORTDUINO
-    if (settingsMap[rxen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[rxen], HIGH);
+    if (portduinoSettings.rxen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.rxen, HIGH);
     }
-    if (settingsMap[txen] != RADIOLIB_NC) {
-        digitalWrite(settingsMap[txen], LOW);
+    if (portduinoSettings.txen != RADIOLIB_NC) {
+        digitalWrite(portduinoSettings.txen, LOW);
     }
 
 #else
@@ -250,23 +298,28 @@ template <typename T> void SX128xInterface<T>::startReceive()
 #endif
 #endif
 
-    // We use the PREAMBLE_DETECTED and HEADER_VALID IRQ flag to detect whether we are actively receiving
-    int err = lora.startReceive(RADIOLIB_SX128X_RX_TIMEOUT_INF, RADIOLIB_SX128X_IRQ_RX_DEFAULT |
-                                                                    RADIOLIB_SX128X_IRQ_PREAMBLE_DETECTED |
-                                                                    RADIOLIB_SX128X_IRQ_HEADER_VALID);
+    // We use the PREAMBLE_DETECTED and HEADER_VALID IRQ flag to detect whether we are actively receiving, FLRC has no LoRa
+    // header so there SYNC_WORD_VALID does that job
+    int err = lora.startReceive(RADIOLIB_SX128X_RX_TIMEOUT_INF,
+                                RADIOLIB_SX128X_IRQ_RX_DEFAULT | RADIOLIB_SX128X_IRQ_PREAMBLE_DETECTED |
+                                    (isFlrc() ? RADIOLIB_SX128X_IRQ_SYNC_WORD_VALID : RADIOLIB_SX128X_IRQ_HEADER_VALID));
 
     assert(err == RADIOLIB_ERR_NONE);
 
     isReceiving = true;
 
     // Must be done AFTER, starting transmit, because startTransmit clears (possibly stale) interrupt pending register bits
-    enableInterrupt(isrRxLevel0);
+    armInterrupt(isrRxLevel0);
 #endif
 }
 
 /** Is the channel currently active? */
 template <typename T> bool SX128xInterface<T>::isChannelActive()
 {
+    // FLRC packets are over in a few msecs and there is no CAD for them, so we rely on our random backoff alone
+    if (isFlrc())
+        return false;
+
     // check if we can detect a LoRa preamble on the current channel
     int16_t result;
 
@@ -280,18 +333,30 @@ template <typename T> bool SX128xInterface<T>::isChannelActive()
     return false;
 }
 
+template <typename T> bool SX128xInterface<T>::sampleChannel(bool withCad, float &rssi, bool &detected)
+{
+    // RadioLib only reads us the last packet's RSSI, so every sample is a CAD (quick, with 2.4GHz symbols).  FLRC has none
+    if (isFlrc() || !isIdleListening())
+        return false;
+
+    detected = isChannelActive();
+    startReceive();
+    return true;
+}
+
 /** Could we send right now (i.e. either not actively receiving or transmitting)? */
 template <typename T> bool SX128xInterface<T>::isActivelyReceiving()
 {
+    uint16_t headerValid = isFlrc() ? RADIOLIB_SX128X_IRQ_SYNC_WORD_VALID : RADIOLIB_SX128X_IRQ_HEADER_VALID;
     uint16_t irq = lora.getIrqStatus();
-    bool detected = (irq & (RADIOLIB_SX128X_IRQ_HEADER_VALID | RADIOLIB_SX128X_IRQ_PREAMBLE_DETECTED));
+    bool detected = (irq & (headerValid | RADIOLIB_SX128X_IRQ_PREAMBLE_DETECTED));
 
     // Handle false detections
     if (detected) {
         uint32_t now = millis();
         if (!activeReceiveStart) {
             activeReceiveStart = now;
-        } else if ((now - activeReceiveStart > 2 * preambleTimeMsec) && !(irq & RADIOLIB_SX128X_IRQ_HEADER_VALID)) {
+        } else if ((now - activeReceiveStart > 2 * preambleTimeMsec) && !(irq & headerValid)) {
             // The HEADER_VALID flag should be set by now if it was really a packet, so ignore PREAMBLE_DETECTED flag
             activeReceiveStart = 0;
             LOG_DEBUG("Ignore false preamble detection.\n");
@@ -328,3 +393,17 @@ template <typename T> bool SX128xInterface<T>::sleep()
 
     return true;
 }
+
+template <typename T> uint32_t SX128xInterface<T>::computePacketTime(uint32_t pl)
+{
+    if (!isFlrc())
+        return RadioLibInterface::computePacketTime(pl);
+
+    // Preamble and sync word are sent uncoded, the header, payload and CRC (plus the encoder tail) at our coding rate
+    float codedBits = SX128X_FLRC_HEADER_BITS + 8.0f * pl + SX128X_FLRC_CRC_BITS + SX128X_FLRC_TAIL_BITS;
+    float rate = flrcCr == 2 ? 0.5f : (flrcCr == 3 ? 0.75f : 1.0f);
+    float bits = preambleLength + SX128X_FLRC_SYNC_BITS + codedBits / rate;
+
+    // bits / kbps is msecs, round up so even the shortest packet costs us something
+    return (uint32_t)ceilf(bits / flrcBitrate);
+}
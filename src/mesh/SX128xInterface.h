@@ -29,6 +29,9 @@ template <class T> class SX128xInterface : public RadioLibInterface
 
     bool isIRQPending() override { return lora.getIrqStatus() != 0; }
 
+    /// @return true if we are running the high rate FLRC modem (see SX128X_FLRC_BITRATE) rather than LoRa
+    bool isFlrc() const { return flrcBitrate != 0; }
+
   protected:
     /**
      * Specific module instance
@@ -48,6 +51,8 @@ template <class T> class SX128xInterface : public RadioLibInterface
     /** can we detect a LoRa preamble on the current channel? */
     virtual bool isChannelActive() override;
 
+    virtual bool sampleChannel(bool withCad, float &rssi, bool &detected) override;
+
     /** are we actively receiving a packet (only called during receiving state) */
     virtual bool isActivelyReceiving() override;
 
@@ -64,10 +69,19 @@ template <class T> class SX128xInterface : public RadioLibInterface
     /**
      * Add SNR data to received messages
      */
-    virtual void addReceiveMetadata(meshtastic_MeshPacket *mp) override;
+    virtual void getReceiveMetadata(float &snr, int32_t &rssi) override;
+
+    virtual bool setTxPower(int8_t dBm) override;
 
     virtual void setStandby() override;
 
+    /// FLRC airtime if we are using it, otherwise the usual LoRa math
+    virtual uint32_t computePacketTime(uint32_t pl) override;
+
   private:
     uint32_t activeReceiveStart = 0;
+
+    /// FLRC bit rate in kbps and coding rate (2 = 1/2, 3 = 3/4, 4 = uncoded), a bit rate of 0 means we use LoRa
+    uint16_t flrcBitrate;
+    uint8_t flrcCr;
 };
@@ -1,11 +1,27 @@
 #include "StreamAPI.h"
 #include "PowerFSM.h"
+#include "concurrency/LockGuard.h"
 #include "configuration.h"
+#include "memGet.h"
+#include <algorithm>
 
 #define START1 0x94
 #define START2 0xc3
 #define HEADER_LEN 4
 
+StreamAPI::StreamAPI(Stream *_stream) : stream(_stream)
+{
+    rxBuf = static_cast<uint8_t *>(memGet.place(HEAP_SITE_STREAM, MAX_STREAM_BUF_SIZE, true));
+    txBuf = static_cast<uint8_t *>(memGet.place(HEAP_SITE_STREAM, STREAM_TX_BATCH_SIZE, true));
+    assert(rxBuf && txBuf);
+}
+
+StreamAPI::~StreamAPI()
+{
+    memGet.unplace(rxBuf);
+    memGet.unplace(txBuf);
+}
+
 int32_t StreamAPI::runOncePart()
 {
     auto result = readStream();
@@ -26,47 +42,14 @@ int32_t StreamAPI::readStream()
         return recentRx ? 5 : 250;
     } else {
         while (stream->available()) { // Currently we never want to block
-            int cInt = stream->read();
-            if (cInt < 0)
+            // Never more than available() says, so readBytes() has no reason to wait
+            size_t wanted = std::min((size_t)stream->available(), MAX_STREAM_BUF_SIZE - rxLen);
+            size_t got = wanted ? readBytes(rxBuf + rxLen, wanted) : 0;
+            if (!got)
                 break; // We ran out of characters (even though available said otherwise) - this can happen on rf52 adafruit
                        // arduino
-
-            uint8_t c = (uint8_t)cInt;
-
-            // Use the read pointer for a little state machine, first look for framing, then length bytes, then payload
-            size_t ptr = rxPtr;
-
-            rxPtr++;        // assume we will probably advance the rxPtr
-            rxBuf[ptr] = c; // store all bytes (including framing)
-
-            // console->printf("rxPtr %d ptr=%d c=0x%x\n", rxPtr, ptr, c);
-
-            if (ptr == 0) { // looking for START1
-                if (c != START1)
-                    rxPtr = 0;     // failed to find framing
-            } else if (ptr == 1) { // looking for START2
-                if (c != START2)
-                    rxPtr = 0;                             // failed to find framing
-            } else if (ptr >= HEADER_LEN - 1) {            // we have at least read our 4 byte framing
-                uint32_t len = (rxBuf[2] << 8) + rxBuf[3]; // big endian 16 bit length follows framing
-
-                // console->printf("len %d\n", len);
-
-                if (ptr == HEADER_LEN - 1) {
-                    // we _just_ finished our 4 byte header, validate length now (note: a length of zero is a valid
-                    // protobuf also)
-                    if (len > MAX_TO_FROM_RADIO_SIZE)
-                        rxPtr = 0; // length is bogus, restart search for framing
-                }
-
-                if (rxPtr != 0)                        // Is packet still considered 'good'?
-                    if (ptr + 1 >= len + HEADER_LEN) { // have we received all of the payload?
-                        rxPtr = 0;                     // start over again on the next packet
-
-                        // If we didn't just fail the packet and we now have the right # of bytes, parse it
-                        handleToRadio(rxBuf + HEADER_LEN, len);
-                    }
-            }
+            rxLen += got;
+            parseRxBuf();
         }
 
         // we had bytes available this time, so assume we might have them next time also
@@ -75,21 +58,77 @@ int32_t StreamAPI::readStream()
     }
 }
 
+void StreamAPI::parseRxBuf()
+{
+    size_t start = 0;
+    while (start < rxLen) {
+        // Look for framing, a START1 which isn't followed by START2 (or a bogus length) is just junk
+        const uint8_t *found = (const uint8_t *)memchr(rxBuf + start, START1, rxLen - start);
+        if (!found) {
+            start = rxLen;
+            break;
+        }
+        start = found - rxBuf;
+        if (rxLen - start < 2)
+            break; // wait for the rest of the framing
+        if (rxBuf[start + 1] != START2) {
+            start++;
+            continue;
+        }
+        if (rxLen - start < HEADER_LEN)
+            break;
+
+        uint32_t len = (rxBuf[start + 2] << 8) + rxBuf[start + 3]; // big endian 16 bit length follows framing
+        // note: a length of zero is a valid protobuf also
+        if (len > MAX_TO_FROM_RADIO_SIZE) {
+            start++; // length is bogus, restart search for framing
+            continue;
+        }
+        if (rxLen - start < HEADER_LEN + len)
+            break; // wait for the rest of the payload, which always fits in rxBuf
+
+        handleToRadio(rxBuf + start + HEADER_LEN, len);
+        start += HEADER_LEN + len;
+    }
+
+    rxLen -= start;
+    memmove(rxBuf, rxBuf + start, rxLen);
+}
+
 /**
  * call getFromRadio() and deliver encapsulated packets to the Stream
  */
 void StreamAPI::writeStream()
 {
     if (canWrite) {
-        uint32_t len;
+        // Send every packet we can, as few writes as possible
+        size_t used = 0, len;
         do {
-            // Send every packet we can
-            len = getFromRadio(txBuf + HEADER_LEN);
-            emitTxBuffer(len);
+            if (used + MAX_STREAM_BUF_SIZE > STREAM_TX_BATCH_SIZE) {
+                stream->write(txBuf, used);
+                used = 0;
+            }
+            len = getFromRadio(txBuf + used + HEADER_LEN);
+            if (len)
+                used += frame(txBuf + used, len);
         } while (len);
+
+        if (used) {
+            stream->write(txBuf, used);
+            stream->flush();
+        }
     }
 }
 
+size_t StreamAPI::frame(uint8_t *buf, size_t len)
+{
+    buf[0] = START1;
+    buf[1] = START2;
+    buf[2] = (len >> 8) & 0xff;
+    buf[3] = len & 0xff;
+    return len + HEADER_LEN;
+}
+
 /**
  * Send the current txBuffer over our stream
  */
@@ -97,13 +136,7 @@ void StreamAPI::emitTxBuffer(size_t len)
 {
     if (len != 0) {
         // LOG_DEBUG("emit tx %d\n", len);
-        txBuf[0] = START1;
-        txBuf[1] = START2;
-        txBuf[2] = (len >> 8) & 0xff;
-        txBuf[3] = len & 0xff;
-
-        auto totalLen = len + HEADER_LEN;
-        stream->write(txBuf, totalLen);
+        stream->write(txBuf, frame(txBuf, len));
         stream->flush();
     }
 }
@@ -111,6 +144,7 @@ void StreamAPI::emitTxBuffer(size_t len)
 void StreamAPI::emitRebooted()
 {
     // In case we send a FromRadio packet
+    concurrency::LockGuard g(&fromRadioLock);
     memset(&fromRadioScratch, 0, sizeof(fromRadioScratch));
     fromRadioScratch.which_payload_variant = meshtastic_FromRadio_rebooted_tag;
     fromRadioScratch.rebooted = true;
@@ -7,6 +7,15 @@
 // A To/FromRadio packet + our 32 bit header
 #define MAX_STREAM_BUF_SIZE (MAX_TO_FROM_RADIO_SIZE + sizeof(uint32_t))
 
+/// How many bytes of framed FromRadios writeStream() gathers up for one write() to the stream, at least MAX_STREAM_BUF_SIZE
+#ifndef STREAM_TX_BATCH_SIZE
+#ifdef ARCH_NRF52
+#define STREAM_TX_BATCH_SIZE (2 * MAX_STREAM_BUF_SIZE)
+#else
+#define STREAM_TX_BATCH_SIZE (4 * MAX_STREAM_BUF_SIZE)
+#endif
+#endif
+
 /**
  * A version of our 'phone' API that talks over a Stream.  So therefore well suited to use with serial links
  * or TCP connections.
@@ -35,14 +44,17 @@ class StreamAPI : public PhoneAPI
      */
     Stream *stream;
 
-    uint8_t rxBuf[MAX_STREAM_BUF_SIZE] = {0};
-    size_t rxPtr = 0;
+    /// What we have read from the link but not parsed yet (MAX_STREAM_BUF_SIZE bytes, placed as HEAP_SITE_STREAM), which
+    /// always starts with a (possibly partial) frame once parsed
+    uint8_t *rxBuf;
+    size_t rxLen = 0;
 
     /// time of last rx, used, to slow down our polling if we haven't heard from anyone
     uint32_t lastRxMsec = 0;
 
   public:
-    StreamAPI(Stream *_stream) : stream(_stream) {}
+    StreamAPI(Stream *_stream);
+    virtual ~StreamAPI();
 
     /**
      * Currently we require frequent invocation from loop() to check for arrived serial packets and to send new packets to the
@@ -56,6 +68,9 @@ class StreamAPI : public PhoneAPI
      */
     int32_t readStream();
 
+    /// Call handleToRadio for every whole frame in rxBuf, then move whatever is left to the front
+    void parseRxBuf();
+
     /**
      * call getFromRadio() and deliver encapsulated packets to the Stream
      */
@@ -72,14 +87,20 @@ class StreamAPI : public PhoneAPI
     /// Check the current underlying physical link to see if the client is currently connected
     virtual bool checkIsConnected() override = 0;
 
+    /// Read up to len bytes, which the stream says are available, @return how many we got
+    virtual size_t readBytes(uint8_t *buf, size_t len) { return stream->readBytes(buf, len); }
+
     /**
      * Send the current txBuffer over our stream
      */
     void emitTxBuffer(size_t len);
 
+    /// Put our framing in front of the len byte packet at buf + 4, @return the framed length
+    static size_t frame(uint8_t *buf, size_t len);
+
     /// Are we allowed to write packets to our output stream (subclasses can turn this off - i.e. SerialConsole)
     bool canWrite = true;
 
-    /// Subclasses can use this scratch buffer if they wish
-    uint8_t txBuf[MAX_STREAM_BUF_SIZE] = {0};
+    /// Subclasses can use this scratch buffer if they wish (writeStream() batches its packets in here), STREAM_TX_BATCH_SIZE bytes
+    uint8_t *txBuf;
 };
@@ -0,0 +1,104 @@
+#include "TxPowerControl.h"
+#include "configuration.h"
+#include <math.h>
+
+TxPowerControl txPowerControl;
+
+static bool isFresh(bool has, uint32_t msec)
+{
+    return has && millis() - msec < TX_POWER_CONTROL_TTL_SECS * 1000UL;
+}
+
+TxPowerControl::Link *TxPowerControl::find(NodeNum n)
+{
+    for (Link &l : links)
+        if (l.node == n)
+            return &l;
+    return NULL;
+}
+
+TxPowerControl::Link *TxPowerControl::findOrAdd(NodeNum n)
+{
+    Link *l = find(n);
+    if (l)
+        return l;
+
+    // An unused entry, or else the one we heard about longest ago
+    auto age = [](const Link &i) { return millis() - (i.reportedMsec > i.ackMsec ? i.reportedMsec : i.ackMsec); };
+    l = &links[0];
+    for (Link &i : links) {
+        if (!i.node) {
+            l = &i;
+            break;
+        }
+        if (age(i) > age(*l))
+            l = &i;
+    }
+    *l = Link{n, 0, 0, millis(), millis(), false, false, 0};
+    return l;
+}
+
+void TxPowerControl::onReport(NodeNum n, float snr)
+{
+    if (!n || n == NODENUM_BROADCAST)
+        return;
+    Link *l = findOrAdd(n);
+    l->reportedSnr = snr;
+    l->reportedMsec = millis();
+    l->hasReport = true;
+}
+
+void TxPowerControl::onAck(NodeNum n, float snr)
+{
+    if (!n || n == NODENUM_BROADCAST)
+        return;
+    Link *l = findOrAdd(n);
+    l->ackSnr = snr;
+    l->ackMsec = millis();
+    l->hasAck = true;
+    l->boostDb = l->boostDb > BOOST_DECAY_DB ? l->boostDb - BOOST_DECAY_DB : 0;
+}
+
+void TxPowerControl::onAckTimeout(NodeNum n)
+{
+    Link *l = find(n);
+    if (l && l->boostDb < UINT8_MAX - BOOST_STEP_DB) {
+        l->boostDb += BOOST_STEP_DB;
+        LOG_DEBUG("No ack from 0x%x, TX power boost for it now %ddB\n", n, l->boostDb);
+        logStats();
+    }
+}
+
+int8_t TxPowerControl::getPower(NodeNum n, int8_t fullPower, uint8_t sf)
+{
+    if (n == NODENUM_BROADCAST || fullPower <= TX_POWER_CONTROL_MIN)
+        return fullPower;
+    Link *l = find(n);
+    if (!l)
+        return fullPower;
+
+    float snr;
+    if (isFresh(l->hasReport, l->reportedMsec))
+        snr = l->reportedSnr;
+    else if (isFresh(l->hasAck, l->ackMsec))
+        snr = l->ackSnr;
+    else
+        return fullPower;
+
+    // LoRa demodulates down to about -7.5dB SNR at SF7, 2.5dB lower for each step up to -20dB at SF12
+    float floorSnr = -2.5f * (sf - 4);
+    int headroom = (int)floorf(snr - floorSnr - TX_POWER_CONTROL_MARGIN_DB) - l->boostDb;
+    if (headroom <= 0)
+        return fullPower;
+
+    int8_t power = fullPower - headroom < TX_POWER_CONTROL_MIN ? TX_POWER_CONTROL_MIN : fullPower - headroom;
+    numReduced++;
+    dbSaved += fullPower - power;
+    return power;
+}
+
+void TxPowerControl::logStats() const
+{
+    LOG_DEBUG("TX power control: %u packets sent below full power, by %.1fdB on average\n", numReduced,
+              numReduced ? (float)dbSaved / numReduced : 0.0f);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+/// Send our DMs and acks at the least power which keeps a margin on the link to their destination, opt in with
+/// -DUSE_TX_POWER_CONTROL=1
+#ifndef USE_TX_POWER_CONTROL
+#define USE_TX_POWER_CONTROL 0
+#endif
+
+/// How far above the SNR our spreading factor can just demodulate we keep a link
+#ifndef TX_POWER_CONTROL_MARGIN_DB
+#define TX_POWER_CONTROL_MARGIN_DB 10
+#endif
+
+/// The least we ever send at, in dBm
+#ifndef TX_POWER_CONTROL_MIN
+#define TX_POWER_CONTROL_MIN 2
+#endif
+
+/// Nodes we keep a link for, the one we heard about longest ago makes room for a new one
+#ifndef TX_POWER_CONTROL_LINKS
+#define TX_POWER_CONTROL_LINKS 16
+#endif
+
+/// How long an SNR we were told stays good
+#ifndef TX_POWER_CONTROL_TTL_SECS
+#define TX_POWER_CONTROL_TTL_SECS (30 * 60)
+#endif
+
+/**
+ * Closed loop TX power for the packets we send to one node (DMs and the acks we send for theirs): the lowest power which
+ * leaves TX_POWER_CONTROL_MARGIN_DB above what our spreading factor needs, from the SNR of our packets at their end.
+ *
+ * That SNR comes from their NeighborInfo (which lists how they hear us), or failing that from how we heard their acks
+ * (the link both ways, which if they turn their own power down only errs towards more power).  Either was most likely
+ * measured at our full power, and the loop closes on the acks: each of our sends to them which times out adds
+ * BOOST_STEP_DB back (until we are at full power), each ack takes BOOST_DECAY_DB of that off again.
+ *
+ * Broadcasts, and anything we relay for others, always go out at full power: we can't know everyone who needs them.
+ */
+class TxPowerControl
+{
+    struct Link {
+        NodeNum node; // 0 for an unused entry
+        float reportedSnr, ackSnr;
+        uint32_t reportedMsec, ackMsec;
+        bool hasReport, hasAck;
+        uint8_t boostDb;
+    };
+
+    static const uint8_t BOOST_STEP_DB = 3, BOOST_DECAY_DB = 1;
+
+    Link links[TX_POWER_CONTROL_LINKS] = {};
+
+    /// Debugging counts: packets sent below full power, and the dB we saved them
+    uint32_t numReduced = 0, dbSaved = 0;
+
+    Link *find(NodeNum n);
+    Link *findOrAdd(NodeNum n);
+
+  public:
+    /// n says (in its NeighborInfo) it hears us at snr
+    void onReport(NodeNum n, float snr);
+
+    /// We heard an ack from n at snr, for something we were waiting on
+    void onAck(NodeNum n, float snr);
+
+    /// Something we sent to n went unacked
+    void onAckTimeout(NodeNum n);
+
+    /// @return the power (in dBm, no more than fullPower) to send a packet of ours to n at, with spreading factor sf
+    int8_t getPower(NodeNum n, int8_t fullPower, uint8_t sf);
+
+    void logStats() const;
+};
+
+extern TxPowerControl txPowerControl;
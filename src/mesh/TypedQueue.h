@@ -33,19 +33,15 @@ template <class T> class TypedQueue
      * they want */
     bool enqueue(T x, TickType_t maxWait)
     {
-        if (reader) {
-            reader->setInterval(0);
-            concurrency::mainDelay.interrupt();
-        }
+        if (reader)
+            reader->wake();
         return xQueueSendToBack(h, &x, maxWait) == pdTRUE;
     }
 
     bool enqueueFromISR(T x, BaseType_t *higherPriWoken)
     {
-        if (reader) {
-            reader->setInterval(0);
-            concurrency::mainDelay.interruptFromISR(higherPriWoken);
-        }
+        if (reader)
+            reader->wakeFromISR(higherPriWoken);
         return xQueueSendToBackFromISR(h, &x, higherPriWoken) == pdTRUE;
     }
 
@@ -57,22 +53,26 @@ template <class T> class TypedQueue
      * Set a thread that is reading from this queue
      * If a message is pushed to this queue that thread will be scheduled to run ASAP.
      *
-     * Note: thread will not be automatically enabled, just have its interval set to 0
+     * Note: thread will not be automatically enabled, just woken (see OSThread::wake())
      */
     void setReader(concurrency::OSThread *t) { reader = t; }
 };
 
 #else
 
+#include <mutex>
 #include <queue>
 
 /**
  * A wrapper for freertos queues.  Note: each element object should be small
  * and POD (Plain Old Data type) as elements are memcpied by value.
+ *
+ * Locked, as on Linux the packet thread and the main loop (or a socket watcher) enqueue and dequeue from their own threads.
  */
 template <class T> class TypedQueue
 {
     std::queue<T> q;
+    std::mutex mutex;
     concurrency::OSThread *reader = NULL;
 
   public:
@@ -80,18 +80,27 @@ template <class T> class TypedQueue
 
     int numFree() { return 1; } // Always claim 1 free, because we can grow to any size
 
-    bool isEmpty() { return q.empty(); }
+    bool isEmpty()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return q.empty();
+    }
 
-    int numUsed() { return q.size(); }
+    int numUsed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return q.size();
+    }
 
     bool enqueue(T x, TickType_t maxWait = portMAX_DELAY)
     {
-        if (reader) {
-            reader->setInterval(0);
-            concurrency::mainDelay.interrupt();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            q.push(x);
         }
-
-        q.push(x);
+        // Only once it's there to find: woken before, the reader could look, find nothing and sleep out its whole delay
+        if (reader)
+            reader->wake();
         return true;
     }
 
@@ -99,13 +108,12 @@ template <class T> class TypedQueue
 
     bool dequeue(T *p, TickType_t maxWait = portMAX_DELAY)
     {
-        if (isEmpty())
+        std::lock_guard<std::mutex> lock(mutex);
+        if (q.empty())
             return false;
-        else {
-            *p = q.front();
-            q.pop();
-            return true;
-        }
+        *p = q.front();
+        q.pop();
+        return true;
     }
 
     // bool dequeueFromISR(T *p, BaseType_t *higherPriWoken) { return xQueueReceiveFromISR(h, p, higherPriWoken); }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Protobuf style varints, for codecs that pack their own payloads.  buf must have room for 5 bytes at pos
+static inline void putVarint(uint8_t *buf, size_t &pos, uint32_t v)
+{
+    do {
+        buf[pos++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+}
+
+static inline void putZigzag(uint8_t *buf, size_t &pos, int32_t v)
+{
+    putVarint(buf, pos, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+/// @return false if buf ends (at len) before the varint at pos does
+static inline bool getVarint(const uint8_t *buf, size_t len, size_t &pos, uint32_t &v)
+{
+    v = 0;
+    for (int bits = 0; bits < 35 && pos < len; bits += 7) {
+        uint8_t b = buf[pos++];
+        v |= (uint32_t)(b & 0x7f) << bits;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static inline bool getZigzag(const uint8_t *buf, size_t len, size_t &pos, int32_t &v)
+{
+    uint32_t u;
+    if (!getVarint(buf, len, pos, u))
+        return false;
+    v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    return true;
+}
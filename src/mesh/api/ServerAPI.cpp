@@ -25,6 +25,12 @@ template <typename T> bool ServerAPI<T>::checkIsConnected()
     return client.connected();
 }
 
+template <typename T> size_t ServerAPI<T>::readBytes(uint8_t *buf, size_t len)
+{
+    int got = client.read(buf, len);
+    return got > 0 ? got : 0;
+}
+
 template <class T> int32_t ServerAPI<T>::runOnce()
 {
     if (client.connected()) {
@@ -45,16 +51,31 @@ template <class T, class U> void APIServerPort<T, U>::init()
 
 template <class T, class U> int32_t APIServerPort<T, U>::runOnce()
 {
-    auto client = U::available();
-    if (client) {
-        // Close any previous connection (see FIXME in header file)
-        if (openAPI) {
-            LOG_INFO("Force closing previous TCP connection\n");
-            delete openAPI;
+    for (T *&api : openAPIs) {
+        if (api && !api->isServing()) {
+            delete api;
+            api = NULL;
+        }
+    }
+
+    // Take every connection which is waiting, not just one per run
+    for (auto client = U::available(); client; client = U::available()) {
+        T **slot = &openAPIs[0];
+        for (T *&api : openAPIs) {
+            if (!api) {
+                slot = &api;
+                break;
+            }
+            if (millis() - api->getLastContact() > millis() - (*slot)->getLastContact())
+                slot = &api;
+        }
+        if (*slot) {
+            LOG_INFO("Already serving %d TCP clients, closing the one we heard from longest ago\n", MAX_API_CLIENTS);
+            delete *slot;
         }
 
-        openAPI = new T(client);
+        *slot = new T(client);
     }
 
-    return 100; // only check occasionally for incoming connections
+    return API_SERVER_ACCEPT_MSEC;
 }
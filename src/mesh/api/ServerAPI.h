@@ -2,11 +2,26 @@
 
 #include "StreamAPI.h"
 
+/// How many TCP clients can use our API at once, each with its own PhoneAPI state.  When one more connects, the one we heard
+/// from longest ago makes room for it
+#ifndef MAX_API_CLIENTS
+#ifdef ARCH_NRF52
+#define MAX_API_CLIENTS 2
+#else
+#define MAX_API_CLIENTS 4
+#endif
+#endif
+
+/// How often we check for incoming connections (and reap the clients which dropped theirs)
+#ifndef API_SERVER_ACCEPT_MSEC
+#define API_SERVER_ACCEPT_MSEC 20
+#endif
+
 /**
  * Provides both debug printing and, if the client starts sending protobufs to us, switches to send/receive protobufs
  * (and starts dropping debug printing - FIXME, eventually those prints should be encapsulated in protobufs).
  */
-template <class T> class ServerAPI : public StreamAPI, private concurrency::OSThread
+template <class T> class ServerAPI : public StreamAPI, protected concurrency::OSThread
 {
   private:
     T client;
@@ -19,6 +34,12 @@ template <class T> class ServerAPI : public StreamAPI, private concurrency::OSTh
     /// override close to also shutdown the TCP link
     virtual void close();
 
+    /// @return false once our client has dropped the connection and we stopped serving it
+    bool isServing() { return enabled; }
+
+    /// @return the msec we last heard from our client
+    uint32_t getLastContact() const { return lastContactMsec; }
+
   protected:
     /// We override this method to prevent publishing EVENT_SERIAL_CONNECTED/DISCONNECTED for wifi links (we want the board to
     /// stay in the POWERED state to prevent disabling wifi)
@@ -26,6 +47,9 @@ template <class T> class ServerAPI : public StreamAPI, private concurrency::OSTh
 
     virtual int32_t runOnce() override; // Check for dropped client connections
 
+    /// Straight from the client in one go, Stream::readBytes() would fetch it a byte at a time
+    virtual size_t readBytes(uint8_t *buf, size_t len) override;
+
     /// Check the current underlying physical link to see if the client is currently connected
     virtual bool checkIsConnected() override;
 };
@@ -33,14 +57,10 @@ template <class T> class ServerAPI : public StreamAPI, private concurrency::OSTh
 /**
  * Listens for incoming connections and does accepts and creates instances of WiFiServerAPI as needed
  */
-template <class T, class U> class APIServerPort : public U, private concurrency::OSThread
+template <class T, class U> class APIServerPort : public U, protected concurrency::OSThread
 {
-    /** The currently open port
-     *
-     * FIXME: We currently only allow one open TCP connection at a time, because we depend on the loop() call in this class to
-     * delegate to the worker.  Once coroutines are implemented we can relax this restriction.
-     */
-    T *openAPI = NULL;
+    /// Our open connections, each one runs as its own thread
+    T *openAPIs[MAX_API_CLIENTS] = {};
 
   public:
     explicit APIServerPort(int port);
@@ -4,6 +4,7 @@
 #if HAS_ETHERNET
 
 #include "ethServerAPI.h"
+#include "mesh/eth/ethClient.h"
 
 static ethServerPort *apiPort;
 
@@ -20,8 +21,22 @@ void initApiServer(int port)
 ethServerAPI::ethServerAPI(EthernetClient &_client) : ServerAPI(_client)
 {
     LOG_INFO("Incoming ethernet connection\n");
+    setWakeSource(ethWakeOnEvent(this, true));
 }
 
-ethServerPort::ethServerPort(int port) : APIServerPort(port) {}
+ethServerAPI::~ethServerAPI()
+{
+    ethWakeOnEvent(this, false);
+}
+
+ethServerPort::ethServerPort(int port) : APIServerPort(port)
+{
+    setWakeSource(ethWakeOnEvent(this, true)); // for new connections
+}
+
+ethServerPort::~ethServerPort()
+{
+    ethWakeOnEvent(this, false);
+}
 
 #endif
\ No newline at end of file
@@ -11,6 +11,7 @@ class ethServerAPI : public ServerAPI<EthernetClient>
 {
   public:
     explicit ethServerAPI(EthernetClient &_client);
+    virtual ~ethServerAPI();
 };
 
 /**
@@ -20,6 +21,7 @@ class ethServerPort : public APIServerPort<ethServerAPI, EthernetServer>
 {
   public:
     explicit ethServerPort(int port);
+    virtual ~ethServerPort();
 };
 
 void initApiServer(int port = 4403);
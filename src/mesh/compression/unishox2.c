@@ -48,10 +48,17 @@ uint8_t usx_sets[][28] = {{0,   ' ', 'e', 't', 'a', 'o', 'i', 'n', 's', 'r', 'l'
                           {0,   ',', '.', '0', '1', '9', '2', '5', '-', '/', '3', '4', '6', '7',
                            '8', '(', ')', ' ', '=', '+', '$', '%', '#', 0,   0,   0,   0,   0}};
 
-/// Stores position of letter in usx_sets.
+/// Stores position of letter in usx_sets, for the 94 printable characters from '!'.
 /// First 3 bits - position in usx_hcodes
 /// Next  5 bits - position in usx_vcodes
-uint8_t usx_code_94[94];
+/// Precomputed from usx_sets (upper case letters share the codes of lower case ones), rather than filled in on first use,
+/// so it lives in flash and there's no check on every call.
+const uint8_t usx_code_94[94] = {
+    0x33, 0x20, 0x56, 0x54, 0x55, 0x31, 0x2D, 0x4F, 0x50, 0x30, 0x53, 0x41, 0x48, 0x42, 0x49, 0x43, 0x44, 0x46, 0x4A,
+    0x4B, 0x47, 0x4C, 0x4D, 0x4E, 0x45, 0x26, 0x2C, 0x24, 0x52, 0x25, 0x32, 0x2F, 0x04, 0x11, 0x0B, 0x0C, 0x02, 0x14,
+    0x12, 0x0D, 0x06, 0x19, 0x17, 0x0A, 0x10, 0x07, 0x05, 0x0F, 0x18, 0x09, 0x08, 0x03, 0x0E, 0x16, 0x13, 0x1A, 0x15,
+    0x1B, 0x29, 0x2B, 0x2A, 0x34, 0x23, 0x38, 0x04, 0x11, 0x0B, 0x0C, 0x02, 0x14, 0x12, 0x0D, 0x06, 0x19, 0x17, 0x0A,
+    0x10, 0x07, 0x05, 0x0F, 0x18, 0x09, 0x08, 0x03, 0x0E, 0x16, 0x13, 0x1A, 0x15, 0x1B, 0x21, 0x35, 0x22, 0x37};
 
 /// Vertical codes starting from the MSB
 uint8_t usx_vcodes[] = {0x00, 0x40, 0x60, 0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xD8, 0xE0, 0xE4, 0xE8, 0xEC,
@@ -110,30 +117,6 @@ const int UTF8_PREFIX[] = {0xC0, 0xE0, 0xF0};
 /// Offset at which usx_code_94 starts
 #define USX_OFFSET_94 33
 
-/// global to indicate whether initialization is complete or not
-uint8_t is_inited = 0;
-
-/// Fills the usx_code_94 94 letter array based on sets of characters at usx_sets \n
-/// For each element in usx_code_94, first 3 msb bits is set (USX_ALPHA / USX_SYM / USX_NUM) \n
-/// and the rest 5 bits indicate the vertical position in the corresponding set
-void init_coder()
-{
-    if (is_inited)
-        return;
-    memset(usx_code_94, '\0', sizeof(usx_code_94));
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 28; j++) {
-            uint8_t c = usx_sets[i][j];
-            if (c > 32) {
-                usx_code_94[c - USX_OFFSET_94] = (i << 5) + j;
-                if (c >= 'a' && c <= 'z')
-                    usx_code_94[c - USX_OFFSET_94 - ('a' - 'A')] = (i << 5) + j;
-            }
-        }
-    }
-    is_inited = 1;
-}
-
 /// Mask for retrieving each code to be encoded according to its length
 unsigned int usx_mask[] = {0x80, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC, 0xFE, 0xFF};
 
@@ -145,6 +128,22 @@ int append_bits(char *out, int olen, int ol, uint8_t code, int clen)
 
     // printf("%d,%x,%d,%d\n", ol, code, clen, state);
 
+    if (clen <= 0)
+        return ol;
+    uint8_t first_bit = ol % 8;
+    if (clen + first_bit <= 8) {
+        // Fast path, the code fits in the byte we're on (most vcodes and hcodes do)
+        int oidx = ol / 8;
+        if (oidx < 0 || olen <= oidx)
+            return -1;
+        unsigned char a_byte = (code & usx_mask[clen - 1]) >> first_bit;
+        if (first_bit == 0)
+            out[oidx] = a_byte;
+        else
+            out[oidx] |= a_byte;
+        return ol + clen;
+    }
+
     while (clen > 0) {
         int oidx;
         unsigned char a_byte;
@@ -337,6 +336,8 @@ int matchOccurance(const char *in, int len, int l, char *out, int olen, int *ol,
     int longest_dist = 0;
     int longest_len = 0;
     for (j = l - NICE_LEN; j >= 0; j--) {
+        if (in[j] != in[l] || in[j + NICE_LEN - 1] != in[l + NICE_LEN - 1])
+            continue; // can't match for NICE_LEN or more, skip comparing
         for (k = l; k < len && j + k - l < l; k++) {
             if (in[k] != in[j + k - l])
                 break;
@@ -433,34 +434,43 @@ int matchLine(const char *in, int len, int l, char *out, int olen, int *ol, stru
     return -l;
 }
 
+/// Enum indicating nibble type - USX_NIB_NUM means ch is a number '0' to '9', \n
+/// USX_NIB_HEX_LOWER means ch is between 'a' to 'f', \n
+/// USX_NIB_HEX_UPPER means ch is between 'A' to 'F'
+enum { USX_NIB_NUM = 0, USX_NIB_HEX_LOWER, USX_NIB_HEX_UPPER, USX_NIB_NOT };
+
+/// For each byte, its 4 bit code in the first 4 bits and its nibble type in the last 4, the hex and nibble scans
+/// look up every byte they pass
+const uint8_t usx_nibbles[256] = {
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0xA2, 0xB2, 0xC2, 0xD2, 0xE2, 0xF2, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0xA1, 0xB1, 0xC1, 0xD1, 0xE1, 0xF1, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03};
+
 /// Returns 4 bit code assuming ch falls between '0' to '9', \n
 /// 'A' to 'F' or 'a' to 'f'
 uint8_t getBaseCode(char ch)
 {
-    if (ch >= '0' && ch <= '9')
-        return (ch - '0') << 4;
-    else if (ch >= 'A' && ch <= 'F')
-        return (ch - 'A' + 10) << 4;
-    else if (ch >= 'a' && ch <= 'f')
-        return (ch - 'a' + 10) << 4;
-    return 0;
+    return usx_nibbles[(uint8_t)ch] & 0xF0;
 }
 
-/// Enum indicating nibble type - USX_NIB_NUM means ch is a number '0' to '9', \n
-/// USX_NIB_HEX_LOWER means ch is between 'a' to 'f', \n
-/// USX_NIB_HEX_UPPER means ch is between 'A' to 'F'
-enum { USX_NIB_NUM = 0, USX_NIB_HEX_LOWER, USX_NIB_HEX_UPPER, USX_NIB_NOT };
 /// Gets 4 bit code assuming ch falls between '0' to '9', \n
 /// 'A' to 'F' or 'a' to 'f'
 char getNibbleType(char ch)
 {
-    if (ch >= '0' && ch <= '9')
-        return USX_NIB_NUM;
-    else if (ch >= 'a' && ch <= 'f')
-        return USX_NIB_HEX_LOWER;
-    else if (ch >= 'A' && ch <= 'F')
-        return USX_NIB_HEX_UPPER;
-    return USX_NIB_NOT;
+    return usx_nibbles[(uint8_t)ch] & 0x0F;
 }
 
 /// Starts coding of nibble sets
@@ -504,6 +514,17 @@ int append_final_bits(char *const out, const int olen, int ol, const uint8_t sta
     return ol;
 }
 
+/// Returns whether c_in fits the template character c_t: 'f'/'F' a lower/upper case hex digit, 'r'/'t'/'o' an octal
+/// digit / '0' to '3' / a binary digit, or else c_t itself
+uint8_t usx_template_char_ok(char c_t, char c_in)
+{
+    if (c_t == 'f' || c_t == 'F')
+        return getNibbleType(c_in) == (c_t == 'f' ? USX_NIB_HEX_LOWER : USX_NIB_HEX_UPPER) || getNibbleType(c_in) == USX_NIB_NUM;
+    if (c_t == 'r' || c_t == 't' || c_t == 'o')
+        return c_in >= '0' && c_in <= (c_t == 'r' ? '7' : (c_t == 't' ? '3' : '1'));
+    return c_t == c_in;
+}
+
 /// Macro used in the main compress function so that if the output len exceeds given maximum length (olen) it can exit
 #define SAFE_APPEND_BITS2(olen, exp)                                                                                             \
     do {                                                                                                                         \
@@ -538,7 +559,6 @@ int unishox2_compress_lines(const char *in, int len, UNISHOX_API_OUT_AND_LEN(cha
     }
 #endif
 
-    init_coder();
     ol = 0;
     prev_uni = 0;
     state = USX_ALPHA;
@@ -646,21 +666,12 @@ int unishox2_compress_lines(const char *in, int len, UNISHOX_API_OUT_AND_LEN(cha
         if (usx_templates != NULL) {
             int i;
             for (i = 0; i < 5; i++) {
-                if (usx_templates[i]) {
+                // A template matches from its first character on, so most inputs can pass it by without strlen()
+                if (usx_templates[i] && (usx_templates[i][0] == '\0' || usx_template_char_ok(usx_templates[i][0], in[l]))) {
                     int rem = (int)strlen(usx_templates[i]);
                     int j = 0;
                     for (; j < rem && l + j < len; j++) {
-                        char c_t = usx_templates[i][j];
-                        c_in = in[l + j];
-                        if (c_t == 'f' || c_t == 'F') {
-                            if (getNibbleType(c_in) != (c_t == 'f' ? USX_NIB_HEX_LOWER : USX_NIB_HEX_UPPER) &&
-                                getNibbleType(c_in) != USX_NIB_NUM) {
-                                break;
-                            }
-                        } else if (c_t == 'r' || c_t == 't' || c_t == 'o') {
-                            if (c_in < '0' || c_in > (c_t == 'r' ? '7' : (c_t == 't' ? '3' : '1')))
-                                break;
-                        } else if (c_t != c_in)
+                        if (!usx_template_char_ok(usx_templates[i][j], in[l + j]))
                             break;
                     }
                     if (((float)j / rem) > 0.66) {
@@ -693,6 +704,8 @@ int unishox2_compress_lines(const char *in, int len, UNISHOX_API_OUT_AND_LEN(cha
         if (usx_freq_seq != NULL) {
             int i;
             for (i = 0; i < 6; i++) {
+                if (usx_freq_seq[i][0] != in[l] && usx_freq_seq[i][0] != '\0')
+                    continue; // memcmp() below would fail on the first byte
                 int seq_len = (int)strlen(usx_freq_seq[i]);
                 if (len - seq_len >= 0 && l <= len - seq_len) {
                     if (memcmp(usx_freq_seq[i], in + l, seq_len) == 0 && usx_hcode_lens[usx_freq_codes[i] >> 5]) {
@@ -739,6 +752,12 @@ int unishox2_compress_lines(const char *in, int len, UNISHOX_API_OUT_AND_LEN(cha
         if (l + 1 < len)
             c_next = in[l + 1];
 
+        if (state == USX_ALPHA && ((c_in >= 'a' && c_in <= 'z') || c_in == ' ')) {
+            // Fast path for what most of our text is, where append_code() would add only the vcode
+            uint8_t vcode = c_in == ' ' ? 1 : usx_code_94[c_in - USX_OFFSET_94] & 0x1F;
+            SAFE_APPEND_BITS2(rawolen, ol = append_bits(out, olen, ol, usx_vcodes[vcode], usx_vcode_lens[vcode]));
+            continue;
+        }
         if (c_in >= 32 && c_in <= 126) {
             if (is_upper && !is_all_upper) {
                 for (ll = l + 4; ll >= l && ll < len; ll--) {
@@ -1138,7 +1157,6 @@ int unishox2_decompress_lines(const char *in, int len, UNISHOX_API_OUT_AND_LEN(c
     const int olen = INT_MAX - 1;
 #endif
 
-    init_coder();
     int ol = 0;
     bit_no = UNISHOX_MAGIC_BIT_LEN; // ignore the magic bit
     dstate = h = USX_ALPHA;
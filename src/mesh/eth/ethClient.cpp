@@ -8,6 +8,9 @@
 #include "target_specific.h"
 #include <RAK13800_W5100S.h>
 #include <SPI.h>
+#ifdef PIN_ETHERNET_INT
+#include <utility/w5100.h>
+#endif
 
 #ifndef DISABLE_NTP
 #include <NTPClient.h>
@@ -27,6 +30,83 @@ using namespace concurrency;
 
 static Periodic *ethEvent;
 
+#ifdef PIN_ETHERNET_INT
+/// The socket events we take interrupts for.  SEND_OK and TIMEOUT pull INT low too, but the library's send() clears those itself
+#define ETH_SOCKET_EVENTS (SnIR::CON | SnIR::DISCON | SnIR::RECV)
+
+/// The threads serving our sockets, see ethWakeOnEvent()
+static concurrency::OSThread *ethWaiters[ETH_MAX_WAITERS];
+
+/**
+ * Takes the W5100S's interrupts.  Its INT pin stays low for as long as any socket has an event we haven't cleared, so we
+ * clear them (over SPI, which the ISR can't) for the next event to pull it low again, and wake the threads serving our
+ * sockets, which otherwise only poll now and then.
+ */
+class EthInterruptThread : public concurrency::OSThread
+{
+  public:
+    EthInterruptThread() : OSThread("EthInterrupt") {}
+
+    static void onInterrupt();
+
+  protected:
+    virtual int32_t runOnce() override;
+};
+
+static EthInterruptThread *ethInterrupts;
+
+void IRAM_ATTR EthInterruptThread::onInterrupt()
+{
+    BaseType_t higherWake = 0;
+    ethInterrupts->wakeFromISR(&higherWake);
+}
+
+int32_t EthInterruptThread::runOnce()
+{
+    ETH_SPI_PORT.beginTransaction(SPI_ETHERNET_SETTINGS);
+    for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+        uint8_t events = W5100.readSnIR(s) & ETH_SOCKET_EVENTS;
+        if (events)
+            W5100.writeSnIR(s, events); // writing a one clears it
+    }
+    ETH_SPI_PORT.endTransaction();
+
+    for (concurrency::OSThread *t : ethWaiters)
+        if (t)
+            t->wake();
+
+    // An event which came while INT was still low didn't make an edge, so we keep looking until it goes high
+    return digitalRead(PIN_ETHERNET_INT) == LOW ? ETH_INT_RECHECK_MSEC : INT32_MAX;
+}
+
+/// Unmask the W5100S's socket interrupts and start taking them
+static void initEthInterrupts()
+{
+    ETH_SPI_PORT.beginTransaction(SPI_ETHERNET_SETTINGS);
+    W5100.writeIMR((1 << MAX_SOCK_NUM) - 1); // one bit per socket
+    ETH_SPI_PORT.endTransaction();
+
+    ethInterrupts = new EthInterruptThread();
+    pinMode(PIN_ETHERNET_INT, INPUT_PULLUP);
+    attachInterrupt(PIN_ETHERNET_INT, EthInterruptThread::onInterrupt, FALLING);
+    LOG_INFO("Taking Ethernet socket events on pin %d\n", PIN_ETHERNET_INT);
+}
+#endif
+
+bool ethWakeOnEvent(concurrency::OSThread *thread, bool wake)
+{
+#ifdef PIN_ETHERNET_INT
+    for (concurrency::OSThread *&t : ethWaiters)
+        if (t == (wake ? NULL : thread)) {
+            t = wake ? thread : NULL;
+            return wake;
+        }
+    if (wake)
+        LOG_WARN("More than %d threads want Ethernet events, polling\n", ETH_MAX_WAITERS);
+#endif
+    return false;
+}
+
 static int32_t reconnectETH()
 {
     if (config.network.eth_enabled) {
@@ -154,6 +234,9 @@ bool initEthernet()
                      Ethernet.dnsServerIP()[2], Ethernet.dnsServerIP()[3]);
         }
 
+#ifdef PIN_ETHERNET_INT
+        initEthInterrupts();
+#endif
         ethEvent = new Periodic("ethConnect", reconnectETH);
 
         return true;
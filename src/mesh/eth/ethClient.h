@@ -1,8 +1,27 @@
 #pragma once
 
+#include "concurrency/OSThread.h"
 #include "configuration.h"
 #include <Arduino.h>
 #include <functional>
 
+/// How many threads ethWakeOnEvent() can wake: our API server, its clients and MQTT
+#ifndef ETH_MAX_WAITERS
+#define ETH_MAX_WAITERS 6
+#endif
+
+/// While the INT pin stays low (the library hasn't cleared a send's events yet), we look again this often
+#ifndef ETH_INT_RECHECK_MSEC
+#define ETH_INT_RECHECK_MSEC 10
+#endif
+
 bool initEthernet();
 bool isEthernetAvailable();
+
+/**
+ * Have (or stop having) thread woken whenever one of our sockets connects, disconnects or receives, on boards which wire the
+ * W5100S's INT pin up as PIN_ETHERNET_INT.
+ *
+ * @return true if it will be, so its polls are only a fallback
+ */
+bool ethWakeOnEvent(concurrency::OSThread *thread, bool wake);
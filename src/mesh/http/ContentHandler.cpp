@@ -1,18 +1,28 @@
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "NodeDB.h"
 #include "PowerFSM.h"
+#include "Metrics.h"
 #include "RadioLibInterface.h"
+#include "RadioStats.h"
 #include "airtime.h"
+#include "concurrency/OSThread.h"
 #include "main.h"
 #include "mesh/http/ContentHelper.h"
 #include "mesh/http/WebServer.h"
 #include "mesh/wifi/WiFiAPClient.h"
+#include "modules/RangeTestLog.h"
+#include "modules/Telemetry/TelemetryHistory.h"
 #include "mqtt/JSON.h"
+#include "mqtt/JSONWriter.h"
+#include "mqtt/MQTT.h"
 #include "power.h"
 #include "sleep.h"
 #include <FSCommon.h>
 #include <HTTPBodyParser.hpp>
 #include <HTTPMultipartBodyParser.hpp>
 #include <HTTPURLEncodedBodyParser.hpp>
+#include <algorithm>
 
 #ifdef ARCH_ESP32
 #include "esp_task_wdt.h"
@@ -37,6 +47,8 @@
 #include <HTTPSServer.hpp>
 #include <HTTPServer.hpp>
 #include <SSLCert.hpp>
+#include <WebsocketHandler.hpp>
+#include <WebsocketNode.hpp>
 
 // The HTTPS Server comes in a separate namespace. For easier use, include it here.
 using namespace httpsserver;
@@ -50,19 +62,56 @@ HTTPClient httpClient;
 #define DEST_FS_USES_LITTLEFS
 
 // We need to specify some content-type mapping, so the resources get delivered with the
-// right content type and are displayed correctly in the browser
-char contentTypes[][2][32] = {{".txt", "text/plain"},     {".html", "text/html"},
-                              {".js", "text/javascript"}, {".png", "image/png"},
-                              {".jpg", "image/jpg"},      {".gz", "application/gzip"},
-                              {".gif", "image/gif"},      {".json", "application/json"},
-                              {".css", "text/css"},       {".ico", "image/vnd.microsoft.icon"},
-                              {".svg", "image/svg+xml"},  {"", ""}};
+// right content type and are displayed correctly in the browser.  Sorted by extension, for getContentType()
+static const char *const contentTypes[][2] = {{"css", "text/css"},
+                                              {"gif", "image/gif"},
+                                              {"gz", "application/gzip"},
+                                              {"html", "text/html"},
+                                              {"ico", "image/vnd.microsoft.icon"},
+                                              {"jpg", "image/jpg"},
+                                              {"js", "text/javascript"},
+                                              {"json", "application/json"},
+                                              {"png", "image/png"},
+                                              {"svg", "image/svg+xml"},
+                                              {"txt", "text/plain"}};
+
+/// How long browsers may keep our static files (other than html pages, which they always check with us) without asking
+#ifndef HTTP_STATIC_MAX_AGE_SECS
+#define HTTP_STATIC_MAX_AGE_SECS (24 * 60 * 60)
+#endif
+
+/// We send static files in chunks of this size, straight from the file to the response
+#define HTTP_STATIC_CHUNK_SIZE 2048
+
+/// @return the content type for a file name, by its extension
+static const char *getContentType(const std::string &filename)
+{
+    size_t dot = filename.rfind('.');
+    if (dot != std::string::npos) {
+        const char *ext = filename.c_str() + dot + 1;
+        size_t lo = 0, hi = sizeof(contentTypes) / sizeof(contentTypes[0]);
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int cmp = strcmp(ext, contentTypes[mid][0]);
+            if (!cmp)
+                return contentTypes[mid][1];
+            if (cmp < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+    }
+    return "application/octet-stream";
+}
 
 // const char *certificate = NULL; // change this as needed, leave as is for no TLS check (yolo security)
 
 // Our API to handle messages to and from the radio.
 HttpAPI webAPI;
 
+// Our open WebSocket connections, each with its own API state
+static std::vector<WebSocketAPI *> webSockets;
+
 void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
 {
 
@@ -72,6 +121,7 @@ void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
     ResourceNode *nodeAPIv1ToRadioOptions = new ResourceNode("/api/v1/toradio", "OPTIONS", &handleAPIv1ToRadio);
     ResourceNode *nodeAPIv1ToRadio = new ResourceNode("/api/v1/toradio", "PUT", &handleAPIv1ToRadio);
     ResourceNode *nodeAPIv1FromRadio = new ResourceNode("/api/v1/fromradio", "GET", &handleAPIv1FromRadio);
+    WebsocketNode *nodeAPIv1WebSocket = new WebsocketNode("/api/v1/ws", &WebSocketAPI::create);
 
     //    ResourceNode *nodeHotspotApple = new ResourceNode("/hotspot-detect.html", "GET", &handleHotspot);
     //    ResourceNode *nodeHotspotAndroid = new ResourceNode("/generate_204", "GET", &handleHotspot);
@@ -89,15 +139,20 @@ void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
     ResourceNode *nodeJsonScanNetworks = new ResourceNode("/json/scanNetworks", "GET", &handleScanNetworks);
     ResourceNode *nodeJsonBlinkLED = new ResourceNode("/json/blink", "POST", &handleBlinkLED);
     ResourceNode *nodeJsonReport = new ResourceNode("/json/report", "GET", &handleReport);
+    ResourceNode *nodeMetrics = new ResourceNode("/metrics", "GET", &handleMetrics);
+    ResourceNode *nodeTelemetryHistory = new ResourceNode("/json/telemetry/history", "GET", &handleTelemetryHistory);
     ResourceNode *nodeJsonFsBrowseStatic = new ResourceNode("/json/fs/browse/static", "GET", &handleFsBrowseStatic);
     ResourceNode *nodeJsonDelete = new ResourceNode("/json/fs/delete/static", "DELETE", &handleFsDeleteStatic);
 
+    ResourceNode *nodeRangeTest = new ResourceNode("/rangetest.csv", "GET", &handleRangeTest);
+
     ResourceNode *nodeRoot = new ResourceNode("/*", "GET", &handleStatic);
 
     // Secure nodes
     secureServer->registerNode(nodeAPIv1ToRadioOptions);
     secureServer->registerNode(nodeAPIv1ToRadio);
     secureServer->registerNode(nodeAPIv1FromRadio);
+    secureServer->registerNode(nodeAPIv1WebSocket);
     //    secureServer->registerNode(nodeHotspotApple);
     //    secureServer->registerNode(nodeHotspotAndroid);
     secureServer->registerNode(nodeRestart);
@@ -107,9 +162,12 @@ void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
     secureServer->registerNode(nodeJsonFsBrowseStatic);
     secureServer->registerNode(nodeJsonDelete);
     secureServer->registerNode(nodeJsonReport);
+    secureServer->registerNode(nodeMetrics);
+    secureServer->registerNode(nodeTelemetryHistory);
     //    secureServer->registerNode(nodeUpdateFs);
     //    secureServer->registerNode(nodeDeleteFs);
     secureServer->registerNode(nodeAdmin);
+    secureServer->registerNode(nodeRangeTest);
     //    secureServer->registerNode(nodeAdminFs);
     //    secureServer->registerNode(nodeAdminSettings);
     //    secureServer->registerNode(nodeAdminSettingsApply);
@@ -119,6 +177,7 @@ void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
     insecureServer->registerNode(nodeAPIv1ToRadioOptions);
     insecureServer->registerNode(nodeAPIv1ToRadio);
     insecureServer->registerNode(nodeAPIv1FromRadio);
+    insecureServer->registerNode(nodeAPIv1WebSocket);
     //    insecureServer->registerNode(nodeHotspotApple);
     //    insecureServer->registerNode(nodeHotspotAndroid);
     insecureServer->registerNode(nodeRestart);
@@ -128,9 +187,12 @@ void registerHandlers(HTTPServer *insecureServer, HTTPSServer *secureServer)
     insecureServer->registerNode(nodeJsonFsBrowseStatic);
     insecureServer->registerNode(nodeJsonDelete);
     insecureServer->registerNode(nodeJsonReport);
+    insecureServer->registerNode(nodeMetrics);
+    insecureServer->registerNode(nodeTelemetryHistory);
     //    insecureServer->registerNode(nodeUpdateFs);
     //    insecureServer->registerNode(nodeDeleteFs);
     insecureServer->registerNode(nodeAdmin);
+    insecureServer->registerNode(nodeRangeTest);
     //    insecureServer->registerNode(nodeAdminFs);
     //    insecureServer->registerNode(nodeAdminSettings);
     //    insecureServer->registerNode(nodeAdminSettingsApply);
@@ -220,6 +282,69 @@ void handleAPIv1ToRadio(HTTPRequest *req, HTTPResponse *res)
     LOG_DEBUG("webAPI handleAPIv1ToRadio\n");
 }
 
+WebSocketAPI::WebSocketAPI()
+{
+    LOG_INFO("Incoming WebSocket connection\n");
+    webSockets.push_back(this);
+}
+
+WebSocketAPI::~WebSocketAPI()
+{
+    for (auto i = webSockets.begin(); i != webSockets.end(); i++) {
+        if (*i == this) {
+            webSockets.erase(i);
+            break;
+        }
+    }
+}
+
+WebsocketHandler *WebSocketAPI::create()
+{
+    return new WebSocketAPI();
+}
+
+void WebSocketAPI::onMessage(WebsocketInputStreambuf *input)
+{
+    uint8_t buffer[MAX_TO_FROM_RADIO_SIZE];
+    size_t s = input->sgetn((char *)buffer, sizeof(buffer));
+
+    LOG_DEBUG("Received %d bytes from WebSocket\n", s);
+    // Our web server's loop calls us from its task, not as a request handler
+    webServerThread->runOnMeshThread([this, &buffer, s]() {
+        handleToRadio(buffer, s);
+        sendFromRadio(); // the start of a config download, most likely
+    });
+}
+
+void WebSocketAPI::onClose()
+{
+    LOG_INFO("WebSocket closed\n");
+    webServerThread->runOnMeshThread([this]() { PhoneAPI::close(); });
+}
+
+void WebSocketAPI::sendFromRadio()
+{
+    static uint8_t txBuf[MAX_STREAM_BUF_SIZE]; // we only ever run from the web server's loop
+
+    for (int i = 0; i < WEBSOCKET_FRAMES_PER_RUN && !closed(); i++) {
+        size_t len = getFromRadio(txBuf);
+        if (!len)
+            break;
+        send(txBuf, len, SEND_TYPE_BINARY);
+    }
+}
+
+void handleWebSockets()
+{
+    for (WebSocketAPI *ws : webSockets)
+        ws->sendFromRadio();
+}
+
+bool hasWebSockets()
+{
+    return !webSockets.empty();
+}
+
 void htmlDeleteDir(const char *dirname)
 {
     File root = FSCom.open(dirname);
@@ -337,6 +462,7 @@ void handleFsDeleteStatic(HTTPRequest *req, HTTPResponse *res)
     res->setHeader("Access-Control-Allow-Methods", "DELETE");
     if (params->getQueryParameter("delete", paramValDelete)) {
         std::string pathDelete = "/" + paramValDelete;
+        nodeDB.invalidateWarmBoot(); // it might be one of our prefs files
         if (FSCom.remove(pathDelete.c_str())) {
             LOG_INFO("%s\n", pathDelete.c_str());
             JSONObject jsonObjOuter;
@@ -407,32 +533,42 @@ void handleStatic(HTTPRequest *req, HTTPResponse *res)
             }
         }
 
-        res->setHeader("Content-Length", httpsserver::intToString(file.size()));
-
-        // Content-Type is guessed using the definition of the contentTypes-table defined above
-        int cTypeIdx = 0;
-        do {
-            if (filename.rfind(contentTypes[cTypeIdx][0]) != std::string::npos) {
-                res->setHeader("Content-Type", contentTypes[cTypeIdx][1]);
-                has_set_content_type = true;
-                break;
-            }
-            cTypeIdx += 1;
-        } while (strlen(contentTypes[cTypeIdx][0]) > 0);
-
-        if (!has_set_content_type) {
-            // Set a default content type
-            res->setHeader("Content-Type", "application/octet-stream");
+        const char *contentType = has_set_content_type ? "text/html" : getContentType(filename);
+        if (!has_set_content_type)
+            res->setHeader("Content-Type", contentType);
+
+        // Browsers check back with the validators we send them, and if the file hasn't changed it needn't cross the network
+        char etag[32], lastModified[32] = "";
+        time_t mtime = file.getLastWrite();
+        snprintf(etag, sizeof(etag), "\"%x-%lx\"", (unsigned)file.size(), (unsigned long)mtime);
+        struct tm tm;
+        if (mtime > 0 && gmtime_r(&mtime, &tm))
+            strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+        res->setHeader("ETag", etag);
+        if (*lastModified)
+            res->setHeader("Last-Modified", lastModified);
+        if (!strcmp(contentType, "text/html"))
+            res->setHeader("Cache-Control", "no-cache");
+        else
+            res->setHeader("Cache-Control", "public, max-age=" + httpsserver::intToString(HTTP_STATIC_MAX_AGE_SECS));
+
+        std::string ifNoneMatch = req->getHeader("If-None-Match");
+        if (ifNoneMatch.empty() ? (*lastModified && req->getHeader("If-Modified-Since") == lastModified)
+                                : ifNoneMatch.find(etag) != std::string::npos) {
+            res->setStatusCode(304);
+            res->setStatusText("Not Modified");
+            file.close();
+            return;
         }
 
-        // Read the file and write it to the HTTP response body
-        size_t length = 0;
-        do {
-            char buffer[256];
-            length = file.read((uint8_t *)buffer, 256);
-            std::string bufferString(buffer, length);
-            res->write((uint8_t *)bufferString.c_str(), bufferString.size());
-        } while (length > 0);
+        res->setHeader("Content-Length", httpsserver::intToString(file.size()));
+
+        // Read the file and write it to the HTTP response body.  We only ever run from the web server's loop
+        static uint8_t buffer[HTTP_STATIC_CHUNK_SIZE];
+        size_t length;
+        while ((length = file.read(buffer, sizeof(buffer))) > 0)
+            res->write(buffer, length);
 
         file.close();
 
@@ -443,6 +579,47 @@ void handleStatic(HTTPRequest *req, HTTPResponse *res)
     }
 }
 
+void handleRangeTest(HTTPRequest *req, HTTPResponse *res)
+{
+    rangeTestLog.flush(); // so it has everything we've heard
+
+    const char *fileName = RANGE_TEST_LOG_BINARY ? RangeTestLog::binaryFileName : RangeTestLog::csvFileName;
+    File file;
+    if (FSCom.exists(fileName))
+        file = FSCom.open(fileName, FILE_O_READ);
+    if (!file) {
+        res->setStatusCode(404);
+        res->setStatusText("Not Found");
+        res->println("No range test log yet");
+        return;
+    }
+    res->setHeader("Content-Type", "text/csv");
+    res->setHeader("Cache-Control", "no-cache");
+
+#if RANGE_TEST_LOG_BINARY
+    // Our log is binary records, which we turn into the CSV we'd otherwise have kept as we go
+    uint8_t header[RangeTestLog::headerSize];
+    if (file.read(header, sizeof(header)) != sizeof(header) || !RangeTestLog::checkHeader(header, sizeof(header))) {
+        LOG_WARN("%s isn't a range test log we can read\n", fileName);
+        file.close();
+        return;
+    }
+    res->println(RangeTestLog::csvHeader);
+    RangeTestLog::Record r;
+    static char line[160 + 2 * RANGE_TEST_LOG_PAYLOAD]; // we only ever run from the web server's loop
+    while (file.read((uint8_t *)&r, sizeof(r)) == sizeof(r)) {
+        size_t len = RangeTestLog::formatCsv(r, line, sizeof(line));
+        res->write((const uint8_t *)line, std::min(len, sizeof(line) - 1));
+    }
+#else
+    static uint8_t buffer[HTTP_STATIC_CHUNK_SIZE];
+    size_t length;
+    while ((length = file.read(buffer, sizeof(buffer))) > 0)
+        res->write(buffer, length);
+#endif
+    file.close();
+}
+
 void handleFormUpload(HTTPRequest *req, HTTPResponse *res)
 {
 
@@ -584,88 +761,308 @@ void handleReport(HTTPRequest *req, HTTPResponse *res)
         res->println("<pre>");
     }
 
-    // data->airtime->tx_log
-    JSONArray txLogValues;
-    uint32_t *logArray;
-    logArray = airTime->airtimeReport(TX_LOG);
-    for (int i = 0; i < airTime->getPeriodsToLog(); i++) {
-        txLogValues.push_back(new JSONValue((int)logArray[i]));
-    }
-
-    // data->airtime->rx_log
-    JSONArray rxLogValues;
-    logArray = airTime->airtimeReport(RX_LOG);
-    for (int i = 0; i < airTime->getPeriodsToLog(); i++) {
-        rxLogValues.push_back(new JSONValue((int)logArray[i]));
-    }
-
-    // data->airtime->rx_all_log
-    JSONArray rxAllLogValues;
-    logArray = airTime->airtimeReport(RX_ALL_LOG);
-    for (int i = 0; i < airTime->getPeriodsToLog(); i++) {
-        rxAllLogValues.push_back(new JSONValue((int)logArray[i]));
-    }
+    // Written straight to the response as we go, rather than building the whole document first
+    static char jsonBuffer[512];
+    JSONWriter w(jsonBuffer, sizeof(jsonBuffer), res);
+    w.beginObject();
+    w.key("data");
+    w.beginObject();
 
     // data->airtime
-    JSONObject jsonObjAirtime;
-    jsonObjAirtime["tx_log"] = new JSONValue(txLogValues);
-    jsonObjAirtime["rx_log"] = new JSONValue(rxLogValues);
-    jsonObjAirtime["rx_all_log"] = new JSONValue(rxAllLogValues);
-    jsonObjAirtime["channel_utilization"] = new JSONValue(airTime->channelUtilizationPercent());
-    jsonObjAirtime["utilization_tx"] = new JSONValue(airTime->utilizationTXPercent());
-    jsonObjAirtime["seconds_since_boot"] = new JSONValue(int(airTime->getSecondsSinceBoot()));
-    jsonObjAirtime["seconds_per_period"] = new JSONValue(int(airTime->getSecondsPerPeriod()));
-    jsonObjAirtime["periods_to_log"] = new JSONValue(airTime->getPeriodsToLog());
+    w.key("airtime");
+    w.beginObject();
+    const char *logNames[] = {"tx_log", "rx_log", "rx_all_log"};
+    const reportTypes logTypes[] = {TX_LOG, RX_LOG, RX_ALL_LOG};
+    for (int l = 0; l < 3; l++) {
+        uint32_t *logArray = airTime->airtimeReport(logTypes[l]);
+        w.key(logNames[l]);
+        w.beginArray();
+        for (int i = 0; i < airTime->getPeriodsToLog(); i++)
+            w.value((uint32_t)logArray[i]);
+        w.endArray();
+    }
+    w.field("channel_utilization", airTime->channelUtilizationPercent());
+    w.field("utilization_tx", airTime->utilizationTXPercent());
+    w.field("seconds_since_boot", (uint32_t)airTime->getSecondsSinceBoot());
+    w.field("seconds_per_period", (uint32_t)airTime->getSecondsPerPeriod());
+    w.field("periods_to_log", (uint32_t)airTime->getPeriodsToLog());
+    w.endObject();
 
     // data->wifi
-    JSONObject jsonObjWifi;
-    jsonObjWifi["rssi"] = new JSONValue(WiFi.RSSI());
-    jsonObjWifi["ip"] = new JSONValue(WiFi.localIP().toString().c_str());
+    w.key("wifi");
+    w.beginObject();
+    w.field("rssi", (int32_t)WiFi.RSSI());
+    w.field("ip", WiFi.localIP().toString().c_str());
+    w.endObject();
 
     // data->memory
-    JSONObject jsonObjMemory;
-    jsonObjMemory["heap_total"] = new JSONValue((int)memGet.getHeapSize());
-    jsonObjMemory["heap_free"] = new JSONValue((int)memGet.getFreeHeap());
-    jsonObjMemory["psram_total"] = new JSONValue((int)memGet.getPsramSize());
-    jsonObjMemory["psram_free"] = new JSONValue((int)memGet.getFreePsram());
-    jsonObjMemory["fs_total"] = new JSONValue((int)FSCom.totalBytes());
-    jsonObjMemory["fs_used"] = new JSONValue((int)FSCom.usedBytes());
-    jsonObjMemory["fs_free"] = new JSONValue(int(FSCom.totalBytes() - FSCom.usedBytes()));
+    w.key("memory");
+    w.beginObject();
+    w.field("heap_total", (uint32_t)memGet.getHeapSize());
+    w.field("heap_free", (uint32_t)memGet.getFreeHeap());
+    w.field("psram_total", (uint32_t)memGet.getPsramSize());
+    w.field("heap_min_free", (uint32_t)memGet.getMinFreeHeap());
+    w.field("heap_largest_free_block", (uint32_t)memGet.getLargestFreeBlock());
+    w.field("heap_fragmentation_percent", (uint32_t)memGet.getHeapFragmentation());
+    w.field("psram_free", (uint32_t)memGet.getFreePsram());
+    w.field("fs_total", (uint32_t)FSCom.totalBytes());
+    w.field("fs_used", (uint32_t)FSCom.usedBytes());
+    w.field("fs_free", (uint32_t)(FSCom.totalBytes() - FSCom.usedBytes()));
+    w.endObject();
 
     // data->power
-    JSONObject jsonObjPower;
-    jsonObjPower["battery_percent"] = new JSONValue(powerStatus->getBatteryChargePercent());
-    jsonObjPower["battery_voltage_mv"] = new JSONValue(powerStatus->getBatteryVoltageMv());
-    jsonObjPower["has_battery"] = new JSONValue(BoolToString(powerStatus->getHasBattery()));
-    jsonObjPower["has_usb"] = new JSONValue(BoolToString(powerStatus->getHasUSB()));
-    jsonObjPower["is_charging"] = new JSONValue(BoolToString(powerStatus->getIsCharging()));
+    w.key("power");
+    w.beginObject();
+    w.field("battery_percent", (uint32_t)powerStatus->getBatteryChargePercent());
+    w.field("battery_voltage_mv", (int32_t)powerStatus->getBatteryVoltageMv());
+    w.field("has_battery", BoolToString(powerStatus->getHasBattery()));
+    w.field("has_usb", BoolToString(powerStatus->getHasUSB()));
+    w.field("is_charging", BoolToString(powerStatus->getIsCharging()));
+    w.endObject();
 
     // data->device
-    JSONObject jsonObjDevice;
-    jsonObjDevice["reboot_counter"] = new JSONValue((int)myNodeInfo.reboot_count);
+    w.key("device");
+    w.beginObject();
+    w.field("reboot_counter", (uint32_t)myNodeInfo.reboot_count);
+    w.endObject();
 
     // data->radio
-    JSONObject jsonObjRadio;
-    jsonObjRadio["frequency"] = new JSONValue(RadioLibInterface::instance->getFreq());
-    jsonObjRadio["lora_channel"] = new JSONValue((int)RadioLibInterface::instance->getChannelNum() + 1);
+    w.key("radio");
+    w.beginObject();
+    w.field("frequency", RadioLibInterface::instance->getFreq());
+    w.field("lora_channel", (uint32_t)(RadioLibInterface::instance->getChannelNum() + 1));
+    w.field("rx_good", (uint32_t)RadioLibInterface::instance->rxGood);
+    w.field("rx_bad", (uint32_t)RadioLibInterface::instance->rxBad);
+    w.field("tx_good", (uint32_t)RadioLibInterface::instance->txGood);
+    w.endObject();
+
+    // data->radio_stats
+    w.key("radio_stats");
+    w.beginObject();
+
+    // data->radio_stats->latency, one histogram per stage of the packet path
+    w.key("latency");
+    w.beginObject();
+    for (uint8_t i = 0; i < RadioStats::NUM_STAGES; i++) {
+        RadioStats::Stage stage = (RadioStats::Stage)i;
+        const LatencyHistogram &h = radioStats.getHistogram(stage);
+
+        w.key(RadioStats::getStageName(stage));
+        w.beginObject();
+        w.field("unit", RadioStats::getStageUnit(stage));
+        w.field("count", (uint32_t)h.getCount());
+        w.field("avg", (uint32_t)h.getAverage());
+        w.field("p90", (uint32_t)h.getPercentile(0.9f));
+        w.field("max", (uint32_t)h.getMax());
+        w.key("log2_buckets");
+        w.beginArray();
+        for (uint8_t b = 0; b < LATENCY_HISTOGRAM_BUCKETS; b++)
+            w.value((uint32_t)h.getBucket(b));
+        w.endArray();
+        w.endObject();
+    }
+    w.endObject();
+
+    // data->radio_stats->errors
+    w.key("errors");
+    w.beginObject();
+    for (uint8_t i = 0; i < RadioStats::NUM_ERRORS; i++) {
+        RadioStats::Error e = (RadioStats::Error)i;
+        w.field(RadioStats::getErrorName(e), (uint32_t)radioStats.getErrorCount(e));
+    }
+    w.endObject();
+
+    w.endObject(); // radio_stats
+
+    // data->energy, our estimate of where our charge has gone since boot
+    w.key("energy");
+    w.beginObject();
+    for (uint8_t i = 0; i < EnergyStats::NUM_SUBSYSTEMS; i++) {
+        EnergyStats::Subsystem s = (EnergyStats::Subsystem)i;
+        w.key(EnergyStats::getSubsystemName(s));
+        w.beginObject();
+        w.field("mah", energyStats.getMilliAmpHours(s));
+        w.field("on_secs", (uint32_t)energyStats.getOnSecs(s));
+        w.endObject();
+    }
+    w.field("total_mah", energyStats.getTotalMilliAmpHours());
+    w.field("average_ma", energyStats.getAverageMilliAmps());
+    w.field("calibration", energyStats.getCalibration());
+    w.field("forwarded", (uint32_t)energyStats.getForwardedCount());
+    w.field("forwarded_uah", energyStats.getForwardedMicroAmpHours());
+    w.endObject();
+
+#if BOOT_TIMELINE
+    // data->boot, how long each stage of setup() took, and when we got to what came after it
+    w.key("boot");
+    w.beginObject();
+    w.key("stages");
+    w.beginArray();
+    for (uint8_t i = 0; i < bootTimeline.getNumEntries(); i++) {
+        const BootTimeline::Entry &e = bootTimeline.getEntry(i);
+        w.beginObject();
+        w.field("name", e.name);
+        if (!e.isMilestone)
+            w.field("ms", bootTimeline.getStageMsec(i));
+        w.field("at_ms", e.atMsec);
+        w.field("milestone", e.isMilestone);
+        w.endObject();
+    }
+    w.endArray();
+    w.field("setup_ms", bootTimeline.getSetupMsec());
+    w.field("first_rx_ms", bootTimeline.getFirstRxMsec());
+    w.endObject();
+#endif
 
-    // collect data to inner data object
-    JSONObject jsonObjInner;
-    jsonObjInner["airtime"] = new JSONValue(jsonObjAirtime);
-    jsonObjInner["wifi"] = new JSONValue(jsonObjWifi);
-    jsonObjInner["memory"] = new JSONValue(jsonObjMemory);
-    jsonObjInner["power"] = new JSONValue(jsonObjPower);
-    jsonObjInner["device"] = new JSONValue(jsonObjDevice);
-    jsonObjInner["radio"] = new JSONValue(jsonObjRadio);
+#if OSTHREAD_PROFILE
+    // data->threads, the ones which have spent longest running, and how late they got to
+    concurrency::OSThread *costliest[OSTHREAD_PROFILE_TOP];
+    int numCostliest = concurrency::getCostliestThreads(costliest, OSTHREAD_PROFILE_TOP);
+    w.key("threads");
+    w.beginArray();
+    for (int i = 0; i < numCostliest; i++) {
+        const concurrency::OSThread::Profile &p = costliest[i]->getProfile();
+        w.beginObject();
+        w.field("name", costliest[i]->ThreadName.c_str());
+        w.field("scheduler", costliest[i]->getController()->getName());
+        w.field("runs", (uint32_t)p.runs);
+        w.field("total_ms", (uint32_t)(p.totalMicros / 1000));
+        w.field("max_us", (uint32_t)p.maxMicros);
+        w.field("late_total_ms", (uint32_t)p.totalLateMsec);
+        w.field("late_max_ms", (uint32_t)p.maxLateMsec);
+        if (p.minStackFree != UINT32_MAX)
+            w.field("stack_free", (uint32_t)p.minStackFree);
+        w.endObject();
+    }
+    w.endArray();
+#endif
 
-    // create json output structure
-    JSONObject jsonObjOuter;
-    jsonObjOuter["data"] = new JSONValue(jsonObjInner);
-    jsonObjOuter["status"] = new JSONValue("ok");
-    // serialize and write it to the stream
-    JSONValue *value = new JSONValue(jsonObjOuter);
-    res->print(value->Stringify().c_str());
-    delete value;
+    // data->heap_sites, who has been allocating from the heap (see memGet.h)
+    w.key("heap_sites");
+    w.beginArray();
+    for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+        const HeapSiteStats &s = memGet.getSiteStats((HeapSite)i);
+        uint32_t allocs = s.allocs.load(std::memory_order_relaxed);
+        if (!allocs)
+            continue;
+        w.beginObject();
+        w.field("name", MemGet::getSiteName((HeapSite)i));
+        w.field("allocs", allocs);
+        w.field("live", (uint32_t)(allocs - s.frees.load(std::memory_order_relaxed)));
+        w.field("live_bytes", (uint32_t)s.liveBytes.load(std::memory_order_relaxed));
+        w.field("peak_bytes", (uint32_t)s.peakBytes.load(std::memory_order_relaxed));
+        w.field("region", MemGet::getRegionName(MemGet::getPlacement((HeapSite)i)));
+        w.endObject();
+    }
+    w.endArray();
+
+    // data->heap_regions, what MemGet::place() has out in each region, and what's left of it
+    w.key("heap_regions");
+    w.beginArray();
+    for (int i = 0; i < MEM_REGION_COUNT; i++) {
+        w.beginObject();
+        w.field("name", MemGet::getRegionName((MemRegion)i));
+        w.field("placed_bytes", memGet.getPlacedBytes((MemRegion)i));
+        w.field("free", memGet.getRegionFree((MemRegion)i));
+        w.endObject();
+    }
+    w.endArray();
+
+    // data->mqtt, what's waiting for the MQTT server
+    if (mqtt) {
+        const MQTTOutbox &outbox = mqtt->getOutbox();
+        w.key("mqtt");
+        w.beginObject();
+        w.field("queued", (uint32_t)outbox.getNumMessages());
+        w.field("queued_on_flash", (uint32_t)outbox.getNumOnFlash());
+        w.field("queued_ram_bytes", (uint32_t)outbox.getRAMBytes());
+        w.field("spilled", (uint32_t)outbox.getNumSpilled());
+        w.field("sent_from_queue", (uint32_t)outbox.getNumSent());
+        w.field("dropped", (uint32_t)outbox.getNumDropped());
+
+        // and what we chose not to send at all
+        const MQTTUplinkPolicy &policy = mqtt->getUplinkPolicy();
+        w.field("uplinked", policy.getCount(MQTTUplinkPolicy::UPLINK));
+        w.field("uplink_duplicates", policy.getCount(MQTTUplinkPolicy::DROP_DUPLICATE));
+        w.field("uplink_rate_limited", policy.getCount(MQTTUplinkPolicy::DROP_RATE));
+        w.field("uplink_unchanged", policy.getCount(MQTTUplinkPolicy::DROP_UNCHANGED));
+        w.field("uplink_reduced_positions", policy.getNumReducedPositions());
+        w.endObject();
+    }
+    w.endObject(); // data
+
+    w.field("status", "ok");
+    w.endObject();
+    w.flush();
+}
+
+/// Our counters for Prometheus to scrape, see Metrics.h
+void handleMetrics(HTTPRequest *req, HTTPResponse *res)
+{
+    res->setHeader("Content-Type", "text/plain; version=0.0.4");
+    res->setHeader("Access-Control-Allow-Origin", "*");
+    res->setHeader("Access-Control-Allow-Methods", "GET");
+
+    // Written straight to the response as we go, like handleReport()
+    static char metricsBuffer[512];
+    MetricsWriter w(metricsBuffer, sizeof(metricsBuffer), res);
+    metrics.write(w);
+    w.flush();
+}
+
+/**
+ * Our telemetry history: with no series, the series we have, else the points of one over time
+ * (?series=environment_metrics.temperature&tier=raw|minute|hour&from=<epoch>&to=<epoch>)
+ */
+void handleTelemetryHistory(HTTPRequest *req, HTTPResponse *res)
+{
+    res->setHeader("Content-Type", "application/json");
+    res->setHeader("Access-Control-Allow-Origin", "*");
+    res->setHeader("Access-Control-Allow-Methods", "GET");
+
+    ResourceParameters *params = req->getParams();
+    std::string name, tierName, from, to;
+    static char jsonBuffer[512]; // we only ever run from the web server's loop
+    JSONWriter w(jsonBuffer, sizeof(jsonBuffer), res);
+    w.beginObject();
+    if (!params->getQueryParameter("series", name)) {
+        w.key("series");
+        w.beginArray();
+        char seriesName[64];
+        for (size_t i = 0; i < telemetryHistory.getNumSeries(); i++) {
+            telemetryHistory.getSeriesName(i, seriesName, sizeof(seriesName));
+            w.value(seriesName);
+        }
+        w.endArray();
+        w.endObject();
+        w.flush();
+        return;
+    }
+
+    TelemetryHistory::Tier tier = TelemetryHistory::TIER_MINUTE;
+    if (params->getQueryParameter("tier", tierName))
+        tier = tierName == "raw" ? TelemetryHistory::TIER_RAW
+                                 : (tierName == "hour" ? TelemetryHistory::TIER_HOUR : TelemetryHistory::TIER_MINUTE);
+    uint32_t fromEpoch = params->getQueryParameter("from", from) ? strtoul(from.c_str(), NULL, 10) : 0;
+    uint32_t toEpoch = params->getQueryParameter("to", to) ? strtoul(to.c_str(), NULL, 10) : UINT32_MAX;
+
+    w.field("series", name.c_str());
+    w.key("points");
+    w.beginArray();
+    telemetryHistory.query(TelemetryHistory::seriesKey(name.c_str()), tier, fromEpoch, toEpoch,
+                           [&](const TelemetryHistory::Point &p) {
+                               w.beginObject();
+                               w.field("time", p.epoch);
+                               w.field("count", (uint32_t)p.count);
+                               w.field("mean", p.mean);
+                               w.field("min", p.min);
+                               w.field("max", p.max);
+                               w.endObject();
+                               return true;
+                           });
+    w.endArray();
+    w.endObject();
+    w.flush();
 }
 
 /*
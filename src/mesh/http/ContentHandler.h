@@ -6,6 +6,8 @@ void handleAPIv1FromRadio(HTTPRequest *req, HTTPResponse *res);
 void handleAPIv1ToRadio(HTTPRequest *req, HTTPResponse *res);
 void handleHotspot(HTTPRequest *req, HTTPResponse *res);
 void handleStatic(HTTPRequest *req, HTTPResponse *res);
+/// Our range test log as CSV, however we keep it (see RANGE_TEST_LOG_BINARY)
+void handleRangeTest(HTTPRequest *req, HTTPResponse *res);
 void handleRestart(HTTPRequest *req, HTTPResponse *res);
 void handleFormUpload(HTTPRequest *req, HTTPResponse *res);
 void handleScanNetworks(HTTPRequest *req, HTTPResponse *res);
@@ -13,6 +15,8 @@ void handleFsBrowseStatic(HTTPRequest *req, HTTPResponse *res);
 void handleFsDeleteStatic(HTTPRequest *req, HTTPResponse *res);
 void handleBlinkLED(HTTPRequest *req, HTTPResponse *res);
 void handleReport(HTTPRequest *req, HTTPResponse *res);
+void handleMetrics(HTTPRequest *req, HTTPResponse *res);
+void handleTelemetryHistory(HTTPRequest *req, HTTPResponse *res);
 void handleUpdateFs(HTTPRequest *req, HTTPResponse *res);
 void handleDeleteFsContent(HTTPRequest *req, HTTPResponse *res);
 void handleFs(HTTPRequest *req, HTTPResponse *res);
@@ -20,6 +24,17 @@ void handleAdmin(HTTPRequest *req, HTTPResponse *res);
 void handleAdminSettings(HTTPRequest *req, HTTPResponse *res);
 void handleAdminSettingsApply(HTTPRequest *req, HTTPResponse *res);
 
+/// Send our WebSocket clients whatever FromRadios we have for them, called from the web server's loop (on the main thread)
+void handleWebSockets();
+
+/// @return true if we have WebSocket clients for handleWebSockets() to look after
+bool hasWebSockets();
+
+/// How many FromRadios we send each WebSocket client per pass of the web server's loop
+#ifndef WEBSOCKET_FRAMES_PER_RUN
+#define WEBSOCKET_FRAMES_PER_RUN 8
+#endif
+
 // Interface to the PhoneAPI to access the protobufs with messages
 class HttpAPI : public PhoneAPI
 {
@@ -33,4 +48,31 @@ class HttpAPI : public PhoneAPI
   protected:
     /// Check the current underlying physical link to see if the client is currently connected
     virtual bool checkIsConnected() override { return true; } // FIXME, be smarter about this
-};
\ No newline at end of file
+};
+
+/**
+ * Our protobuf API over a WebSocket (/api/v1/ws), one for each connection.  Every binary message from the client is a
+ * ToRadio, and we send each FromRadio as a binary message as soon as we have it, so clients needn't poll /api/v1/fromradio.
+ * The web server deletes us when the connection closes.
+ */
+class WebSocketAPI : public PhoneAPI, public WebsocketHandler
+{
+  public:
+    WebSocketAPI();
+
+    virtual ~WebSocketAPI();
+
+    /// For our WebsocketNode
+    static WebsocketHandler *create();
+
+    virtual void onMessage(WebsocketInputStreambuf *input) override;
+
+    virtual void onClose() override;
+
+    /// Send the client up to WEBSOCKET_FRAMES_PER_RUN of the FromRadios we have for it
+    void sendFromRadio();
+
+  protected:
+    /// Check the current underlying physical link to see if the client is currently connected
+    virtual bool checkIsConnected() override { return !closed(); }
+};
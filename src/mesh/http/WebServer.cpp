@@ -2,6 +2,7 @@
 #include "NodeDB.h"
 #include "graphics/Screen.h"
 #include "main.h"
+#include "memGet.h"
 #include "mesh/wifi/WiFiAPClient.h"
 #include "sleep.h"
 #include <HTTPBodyParser.hpp>
@@ -12,6 +13,7 @@
 #include <WiFi.h>
 
 #ifdef ARCH_ESP32
+#include "concurrency/BinarySemaphoreFreeRTOS.h"
 #include "esp_task_wdt.h"
 #endif
 
@@ -38,6 +40,7 @@ Preferences prefs;
 #include <HTTPSServer.hpp>
 #include <HTTPServer.hpp>
 #include <SSLCert.hpp>
+#include <WebsocketHandler.hpp>
 
 // The HTTPS Server comes in a separate namespace. For easier use, include it here.
 using namespace httpsserver;
@@ -50,6 +53,13 @@ static HTTPServer *insecureServer;
 volatile bool isWebServerReady;
 volatile bool isCertReady;
 
+#if WEB_SERVER_TASK
+static TaskHandle_t webTask;
+
+/// Given by our thread once it has run what our web task handed it
+static concurrency::BinarySemaphoreFreeRTOS *meshWorkDone;
+#endif
+
 static void handleWebResponse()
 {
     if (isWifiAvailable()) {
@@ -58,10 +68,28 @@ static void handleWebResponse()
             if (secureServer)
                 secureServer->loop();
             insecureServer->loop();
+            if (hasWebSockets())
+                webServerThread->runOnMeshThread(handleWebSockets);
         }
     }
 }
 
+/// Every request's handler (and a WebSocket's upgrade) runs on the main thread, see WebServerThread::runOnMeshThread()
+static void runHandlerOnMeshThread(HTTPRequest *req, HTTPResponse *res, std::function<void()> next)
+{
+    webServerThread->runOnMeshThread(next);
+}
+
+#if WEB_SERVER_TASK
+static void webTaskLoop(void *)
+{
+    for (;;) {
+        handleWebResponse();
+        vTaskDelay(pdMS_TO_TICKS(WEB_SERVER_POLL_MSEC));
+    }
+}
+#endif
+
 static void taskCreateCert(void *parameter)
 {
     prefs.begin("MeshtasticHTTPS", false);
@@ -172,31 +200,79 @@ WebServerThread::WebServerThread() : concurrency::OSThread("WebServerThread")
     }
 }
 
+void WebServerThread::runOnMeshThread(const std::function<void()> &work)
+{
+#if WEB_SERVER_TASK
+    if (webTask && xTaskGetCurrentTaskHandle() == webTask) {
+        meshWork = &work;
+        wake();
+        while (!meshWorkDone->take(WEB_SERVER_MESH_POLL_MSEC)) {
+            if (!enabled) {
+                meshWork = NULL; // nobody will run it now, the request just goes unanswered
+                return;
+            }
+        }
+        return;
+    }
+#endif
+    work();
+}
+
 int32_t WebServerThread::runOnce()
 {
+    HeapSiteScope heapSite(HEAP_SITE_HTTP); // the requests we serve from here
     if (!config.network.wifi_enabled) {
         disable();
+#if WEB_SERVER_TASK
+        if (meshWork) { // let our web task go, rather than leave it waiting for a thread which won't run again
+            meshWork = NULL;
+            meshWorkDone->give();
+        }
+#endif
+        return INT32_MAX;
     }
 
+#if WEB_SERVER_TASK
+    // Our web task does the rest, we only run the handlers it hands us
+    if (meshWork) {
+        (*meshWork)();
+        meshWork = NULL;
+        meshWorkDone->give();
+    }
+#else
     handleWebResponse();
+#endif
 
     if (requestRestart && (millis() / 1000) > requestRestart) {
         ESP.restart();
     }
 
+#if WEB_SERVER_TASK
+    // Our web task wakes us, but it may have handed us work after we looked (and run() would then undo its wake()), so we
+    // look again now and then
+    if (meshWork)
+        return 0;
+    return requestRestart ? 1000 : WEB_SERVER_MESH_POLL_MSEC;
+#else
     // Loop every 5ms.
     return (5);
+#endif
 }
 
 void initWebServer()
 {
     LOG_DEBUG("Initializing Web Server ...\n");
 
+    if (isWebServerReady)
+        return; // already running, with our task
+
     // We can now use the new certificate to setup our server as usual.
-    secureServer = new HTTPSServer(cert);
-    insecureServer = new HTTPServer();
+    secureServer = new HTTPSServer(cert, 443, WEB_SERVER_MAX_CONNECTIONS);
+    insecureServer = new HTTPServer(80, WEB_SERVER_MAX_CONNECTIONS);
 
     registerHandlers(insecureServer, secureServer);
+    secureServer->addMiddleware(&runHandlerOnMeshThread);
+    insecureServer->addMiddleware(&runHandlerOnMeshThread);
 
     if (secureServer) {
         LOG_INFO("Starting Secure Web Server...\n");
@@ -207,6 +283,12 @@ void initWebServer()
     if (insecureServer->isRunning()) {
         LOG_INFO("Web Servers Ready! :-) \n");
         isWebServerReady = true;
+#if WEB_SERVER_TASK
+        meshWorkDone = new concurrency::BinarySemaphoreFreeRTOS();
+        BaseType_t r = xTaskCreatePinnedToCore(webTaskLoop, "web", WEB_SERVER_TASK_STACK, NULL, WEB_SERVER_TASK_PRIORITY,
+                                               &webTask, WEB_SERVER_TASK_CORE);
+        assert(r == pdPASS);
+#endif
     } else {
         LOG_ERROR("Web Servers Failed! ;-( \n");
     }
@@ -5,6 +5,47 @@
 #include <Arduino.h>
 #include <functional>
 
+/// Run the web servers' loop (accepting connections, TLS handshakes, reading requests) in a task of its own, the handlers
+/// still run on the main thread (see WebServerThread::runOnMeshThread()).  So a handshake, which takes the ESP32 hundreds of
+/// ms of RSA, no longer holds up the mesh
+#ifndef WEB_SERVER_TASK
+#define WEB_SERVER_TASK 1
+#endif
+
+/// Our web task runs on whichever core loop() isn't on, at loop()'s priority (below the WiFi stack)
+#ifndef WEB_SERVER_TASK_CORE
+#if CONFIG_FREERTOS_UNICORE
+#define WEB_SERVER_TASK_CORE 0
+#else
+#define WEB_SERVER_TASK_CORE (ARDUINO_RUNNING_CORE ? 0 : 1)
+#endif
+#endif
+#ifndef WEB_SERVER_TASK_PRIORITY
+#define WEB_SERVER_TASK_PRIORITY 1
+#endif
+
+/// TLS handshakes and the request parsing are all our web task runs, in bytes
+#ifndef WEB_SERVER_TASK_STACK
+#define WEB_SERVER_TASK_STACK 8192
+#endif
+
+/// How often our web task looks for new connections and requests
+#ifndef WEB_SERVER_POLL_MSEC
+#define WEB_SERVER_POLL_MSEC 5
+#endif
+
+/// How often the main thread looks for work from our web task even if it missed the wake, and how long our web task waits
+/// for it before it checks we haven't been disabled meanwhile
+#ifndef WEB_SERVER_MESH_POLL_MSEC
+#define WEB_SERVER_MESH_POLL_MSEC 100
+#endif
+
+/// How many connections each server keeps open, so a browser's requests reuse a few kept alive connections (and their TLS
+/// sessions) rather than handshaking again.  Each HTTPS one costs the mbedTLS context, some 40KB of heap
+#ifndef WEB_SERVER_MAX_CONNECTIONS
+#define WEB_SERVER_MAX_CONNECTIONS 3
+#endif
+
 void initWebServer();
 void createSSLCert();
 
@@ -15,8 +56,19 @@ class WebServerThread : private concurrency::OSThread
     WebServerThread();
     uint32_t requestRestart = 0;
 
+    /**
+     * Run work on the main thread, as everything touching the mesh (our PhoneAPIs, the NodeDB, the filesystem) has to, and
+     * return once it's done.  From our web task that's a hand off to our thread, waiting meanwhile (so the connection it
+     * writes to is never used by both), anywhere else work just runs.
+     */
+    void runOnMeshThread(const std::function<void()> &work);
+
   protected:
     virtual int32_t runOnce() override;
+
+  private:
+    /// What our web task handed us to run, NULL for nothing
+    const std::function<void()> *volatile meshWork = NULL;
 };
 
 extern WebServerThread *webServerThread;
@@ -46,6 +46,90 @@ Syslog syslog(syslogClient);
 
 Periodic *wifiReconnect;
 
+#if defined(ARCH_ESP32) && USE_WIFI_FAST_RECONNECT
+#include <ErriezCRC32.h>
+#include <stddef.h>
+
+/**
+ * The access point we last got an IP address from, and the lease it gave us, in RTC memory so waking from deep sleep or a
+ * reboot can go straight back to it.  Only trusted if its CRC checks out and it is for the SSID we are configured with.
+ */
+struct WiFiCache {
+    char ssid[sizeof(config.network.wifi_ssid)];
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip, gateway, subnet, dns;
+    uint32_t crc; // of everything above
+};
+
+static RTC_NOINIT_ATTR WiFiCache wifiCache;
+
+static bool fastConnecting;      // we are joining the cached access point, without having scanned for it
+static uint32_t fastConnectMsec; // when we started to
+static bool usingCachedLease;    // we gave our interface the cached lease's address rather than starting DHCP
+
+static uint32_t wifiCacheCRC()
+{
+    return crc32Buffer(&wifiCache, offsetof(WiFiCache, crc));
+}
+
+static bool haveWiFiCache()
+{
+    return wifiCache.crc == wifiCacheCRC() && strncmp(wifiCache.ssid, config.network.wifi_ssid, sizeof(wifiCache.ssid)) == 0;
+}
+
+/// Remember the access point we just got an IP address from
+static void saveWiFiCache()
+{
+    const uint8_t *bssid = WiFi.BSSID();
+    if (!bssid)
+        return;
+    strncpy(wifiCache.ssid, config.network.wifi_ssid, sizeof(wifiCache.ssid));
+    memcpy(wifiCache.bssid, bssid, sizeof(wifiCache.bssid));
+    wifiCache.channel = WiFi.channel();
+    wifiCache.ip = WiFi.localIP();
+    wifiCache.gateway = WiFi.gatewayIP();
+    wifiCache.subnet = WiFi.subnetMask();
+    wifiCache.dns = WiFi.dnsIP();
+    wifiCache.crc = wifiCacheCRC();
+}
+
+/// Our fast reconnect didn't work, so the next reconnect scans (and, if we took the cached lease, asks DHCP)
+static void abandonFastConnect()
+{
+    LOG_WARN("Fast reconnect to %s failed, forgetting it and scanning\n", config.network.wifi_ssid);
+    fastConnecting = false;
+    wifiCache.crc = wifiCacheCRC() + 1;
+    if (usingCachedLease) {
+        WiFi.config(IPAddress(), IPAddress(), IPAddress()); // no address: back to DHCP
+        usingCachedLease = false;
+    }
+}
+#endif
+
+/// Start joining our access point, the one we were last on if we know it, asynchronously: WiFiEvent tells us how it went
+static void beginWiFi(const char *wifiName, const char *wifiPsw)
+{
+#if defined(ARCH_ESP32) && USE_WIFI_FAST_RECONNECT
+    if (haveWiFiCache()) {
+        LOG_INFO("Fast reconnect to %s, %02x:%02x:%02x:%02x:%02x:%02x on channel %d\n", wifiName, wifiCache.bssid[0],
+                 wifiCache.bssid[1], wifiCache.bssid[2], wifiCache.bssid[3], wifiCache.bssid[4], wifiCache.bssid[5],
+                 wifiCache.channel);
+#if WIFI_REUSE_DHCP_LEASE
+        if (config.network.address_mode != meshtastic_Config_NetworkConfig_AddressMode_STATIC && wifiCache.ip) {
+            WiFi.config(wifiCache.ip, wifiCache.gateway, wifiCache.subnet, wifiCache.dns);
+            usingCachedLease = true;
+        }
+#endif
+        fastConnecting = true;
+        fastConnectMsec = millis();
+        WiFi.begin(wifiName, wifiPsw, wifiCache.channel, wifiCache.bssid);
+        return;
+    }
+#endif
+    WiFi.begin(wifiName, wifiPsw);
+}
+
 static void onNetworkConnected()
 {
     if (!APStartupComplete) {
@@ -110,6 +194,13 @@ static int32_t reconnectWiFi()
     const char *wifiName = config.network.wifi_ssid;
     const char *wifiPsw = config.network.wifi_psk;
 
+#if defined(ARCH_ESP32) && USE_WIFI_FAST_RECONNECT
+    if (fastConnecting && !WiFi.isConnected() && millis() - fastConnectMsec >= WIFI_FAST_CONNECT_TIMEOUT_MSEC) {
+        abandonFastConnect();
+        needReconnect = true;
+    }
+#endif
+
     if (config.network.wifi_enabled && needReconnect) {
 
         if (!*wifiPsw) // Treat empty password as no password
@@ -126,10 +217,15 @@ static int32_t reconnectWiFi()
 #endif
         LOG_INFO("Reconnecting to WiFi access point %s\n", wifiName);
 
+#if defined(ARCH_ESP32) && USE_WIFI_FAST_RECONNECT
+        // Skipping the scan is the point of a fast reconnect, so don't keep it waiting as long for the disconnect to settle
+        delay(haveWiFiCache() ? 500 : 5000);
+#else
         delay(5000);
+#endif
 
         if (!WiFi.isConnected()) {
-            WiFi.begin(wifiName, wifiPsw);
+            beginWiFi(wifiName, wifiPsw);
         }
         isReconnecting = false;
     }
@@ -190,6 +286,9 @@ void deinitWifi()
         WiFi.disconnect(true);
 #endif
         WiFi.mode(WIFI_OFF);
+#if defined(ARCH_ESP32) && USE_WIFI_FAST_RECONNECT
+        fastConnecting = false;
+#endif
         LOG_INFO("WiFi Turned Off\n");
         // WiFi.printDiag(Serial);
     }
@@ -280,6 +379,11 @@ static void WiFiEvent(WiFiEvent_t event)
         break;
     case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
         LOG_INFO("Disconnected from WiFi access point\n");
+#if USE_WIFI_FAST_RECONNECT
+        // Most likely the access point moved channel or is gone, so don't wait for the timeout before scanning
+        if (fastConnecting && !isReconnecting)
+            abandonFastConnect();
+#endif
         if (!isReconnecting) {
             WiFi.disconnect(false, true);
             syslog.disable();
@@ -292,6 +396,12 @@ static void WiFiEvent(WiFiEvent_t event)
         break;
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
         LOG_INFO("Obtained IP address: %s\n", WiFi.localIP().toString().c_str());
+#if USE_WIFI_FAST_RECONNECT
+        if (fastConnecting)
+            LOG_INFO("Fast reconnect took %ums\n", millis() - fastConnectMsec);
+        fastConnecting = false;
+        saveWiFiCache();
+#endif
         onNetworkConnected();
         break;
     case ARDUINO_EVENT_WIFI_STA_GOT_IP6:
@@ -9,6 +9,24 @@
 #include <WiFi.h>
 #endif
 
+/// Reconnect to the access point we were last on (its BSSID and channel, kept in RAM which survives deep sleep and reboots)
+/// without scanning for it, falling back to a full scan if that doesn't get us an IP address soon.  ESP32 only, opt out with
+/// -DUSE_WIFI_FAST_RECONNECT=0
+#ifndef USE_WIFI_FAST_RECONNECT
+#define USE_WIFI_FAST_RECONNECT 1
+#endif
+
+/// How long a fast reconnect has to get us an IP address before we forget that access point and scan for one
+#ifndef WIFI_FAST_CONNECT_TIMEOUT_MSEC
+#define WIFI_FAST_CONNECT_TIMEOUT_MSEC 8000
+#endif
+
+/// With DHCP, also take back the address our last lease gave us on a fast reconnect rather than waiting for a new one.  Only
+/// for networks whose DHCP server keeps giving us the same address, opt in with -DWIFI_REUSE_DHCP_LEASE=1
+#ifndef WIFI_REUSE_DHCP_LEASE
+#define WIFI_REUSE_DHCP_LEASE 0
+#endif
+
 extern bool needReconnect;
 extern concurrency::Periodic *wifiReconnect;
 
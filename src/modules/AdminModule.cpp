@@ -1,8 +1,10 @@
 #include "AdminModule.h"
 #include "Channels.h"
+#include "FragmentModule.h"
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "PowerFSM.h"
+#include "Varint.h"
 #include <FSCommon.h>
 #ifdef ARCH_ESP32
 #include "BleOta.h"
@@ -197,6 +199,7 @@ bool AdminModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshta
     }
     case meshtastic_AdminMessage_delete_file_request_tag: {
         LOG_DEBUG("Client is requesting to delete file: %s\n", r->delete_file_request);
+        nodeDB.invalidateWarmBoot(); // it might be one of our prefs files
         if (FSCom.remove(r->delete_file_request)) {
             LOG_DEBUG("Successfully deleted file\n");
         } else {
@@ -428,6 +431,151 @@ void AdminModule::handleSetChannel(const meshtastic_Channel &cc)
     saveChanges(SEGMENT_CHANNELS, false);
 }
 
+/**
+ * Settings bundles
+ */
+
+bool AdminModule::bundleFromPhone(const meshtastic_MeshPacket &p)
+{
+#if ADMIN_BUNDLE_SEND
+    if (!fragmentModule || p.which_payload_variant != meshtastic_MeshPacket_decoded_tag || p.decoded.portnum != ourPortNum ||
+        p.to == NODENUM_BROADCAST || p.to == nodeDB.getNodeNum())
+        return false;
+
+    meshtastic_AdminMessage r = meshtastic_AdminMessage_init_default;
+    if (!pb_decode_from_bytes(p.decoded.payload.bytes, p.decoded.payload.size, &meshtastic_AdminMessage_msg, &r))
+        return false;
+
+    switch (r.which_payload_variant) {
+    case meshtastic_AdminMessage_begin_edit_settings_tag:
+        if (bundle.commitId)
+            return false; // we're still sending the last, so this edit goes the old way
+        LOG_INFO("Gathering the phone's settings for 0x%x to send in one go\n", p.to);
+        bundle.to = p.to;
+        bundle.channel = p.channel;
+        bundle.data.assign(1, BUNDLE_VERSION);
+        answerPhone(p.to, p.id, p.channel, meshtastic_Routing_Error_NONE);
+        return true;
+
+    case meshtastic_AdminMessage_set_owner_tag:
+    case meshtastic_AdminMessage_set_config_tag:
+    case meshtastic_AdminMessage_set_module_config_tag:
+    case meshtastic_AdminMessage_set_channel_tag: {
+        if (bundle.to != p.to || bundle.commitId)
+            return false;
+        uint8_t len[5];
+        size_t n = 0;
+        putVarint(len, n, p.decoded.payload.size);
+        if (bundle.data.size() + n + p.decoded.payload.size > FRAGMENT_MAX_COUNT * FRAGMENT_DATA_LEN) {
+            answerPhone(p.to, p.id, p.channel, meshtastic_Routing_Error_TOO_LARGE);
+            return true;
+        }
+        bundle.data.insert(bundle.data.end(), len, len + n);
+        bundle.data.insert(bundle.data.end(), p.decoded.payload.bytes, p.decoded.payload.bytes + p.decoded.payload.size);
+        answerPhone(p.to, p.id, p.channel, meshtastic_Routing_Error_NONE);
+        return true;
+    }
+
+    case meshtastic_AdminMessage_commit_edit_settings_tag:
+        if (bundle.to != p.to || bundle.commitId)
+            return false;
+        if (!fragmentModule->send(bundle.to, bundle.channel, ADMIN_BUNDLE_PORTNUM, bundle.data.data(), bundle.data.size(),
+                                  bundleSent)) {
+            LOG_WARN("Can't send the settings bundle for 0x%x now\n", bundle.to);
+            answerPhone(p.to, p.id, p.channel, meshtastic_Routing_Error_NO_RESPONSE);
+            bundle = Bundle();
+            return true;
+        }
+        bundle.commitId = p.id;
+        std::vector<uint8_t>().swap(bundle.data); // FragmentModule has its own copy
+        return true;
+
+    default:
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+void AdminModule::bundleSent(NodeNum to, bool succeeded)
+{
+    Bundle &b = adminModule->bundle;
+    if (!b.commitId || b.to != to)
+        return;
+
+    // The phone's commit is acked once the whole bundle is
+    adminModule->answerPhone(b.to, b.commitId, b.channel,
+                             succeeded ? meshtastic_Routing_Error_NONE : meshtastic_Routing_Error_MAX_RETRANSMIT);
+    b = Bundle();
+}
+
+void AdminModule::answerPhone(NodeNum from, PacketId id, ChannelIndex channel, meshtastic_Routing_Error err)
+{
+    meshtastic_MeshPacket *p = allocAckNak(err, nodeDB.getNodeNum(), id, channel);
+    p->from = from;
+    service.sendToPhone(p);
+}
+
+void AdminModule::receiveBundle(NodeNum from, ChannelIndex channel, const uint8_t *data, size_t len)
+{
+    // A bundle is only as trusted as the admin messages in it would be
+    if (!adminModule || channel >= channels.getNumChannels() ||
+        strcasecmp(channels.getByIndex(channel).settings.name, Channels::adminChannel) != 0) {
+        LOG_WARN("Ignoring a settings bundle from 0x%x, it's not on the admin channel\n", from);
+        return;
+    }
+
+    // Everything in it is checked before anything's changed, so a bad bundle changes nothing
+    if (!len || data[0] != BUNDLE_VERSION || !adminModule->applyBundle(data + 1, len - 1, false)) {
+        LOG_WARN("Ignoring a settings bundle from 0x%x we can't make sense of\n", from);
+        return;
+    }
+
+    LOG_INFO("Applying a settings bundle of %u bytes from 0x%x\n", len, from);
+    adminModule->hasOpenEditTransaction = true;
+    adminModule->applyBundle(data + 1, len - 1, true);
+    adminModule->hasOpenEditTransaction = false;
+    adminModule->saveChanges(SEGMENT_CONFIG | SEGMENT_MODULECONFIG | SEGMENT_DEVICESTATE | SEGMENT_CHANNELS);
+}
+
+bool AdminModule::applyBundle(const uint8_t *data, size_t len, bool apply)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        uint32_t n;
+        meshtastic_AdminMessage r = meshtastic_AdminMessage_init_default;
+        if (!getVarint(data, len, pos, n) || n > len - pos ||
+            !pb_decode_from_bytes(data + pos, n, &meshtastic_AdminMessage_msg, &r))
+            return false;
+        pos += n;
+
+        switch (r.which_payload_variant) {
+        case meshtastic_AdminMessage_set_owner_tag:
+            if (apply)
+                handleSetOwner(r.set_owner);
+            break;
+        case meshtastic_AdminMessage_set_config_tag:
+            if (apply)
+                handleSetConfig(r.set_config);
+            break;
+        case meshtastic_AdminMessage_set_module_config_tag:
+            if (apply)
+                handleSetModuleConfig(r.set_module_config);
+            break;
+        case meshtastic_AdminMessage_set_channel_tag:
+            if (r.set_channel.index < 0 || r.set_channel.index >= (int)MAX_NUM_CHANNELS)
+                return false;
+            if (apply)
+                handleSetChannel(r.set_channel);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Getters
  */
@@ -3,6 +3,16 @@
 #if HAS_WIFI
 #include "mesh/wifi/WiFiAPClient.h"
 #endif
+#include <vector>
+
+/// Send the phone's edits of a remote node's settings (from its begin_edit_settings to its commit_edit_settings) as one
+/// FragmentModule transfer, rather than a reliable packet each.  The remote node must have firmware which takes them
+#ifndef ADMIN_BUNDLE_SEND
+#define ADMIN_BUNDLE_SEND 0
+#endif
+
+/// The port FragmentModule carries settings bundles for
+#define ADMIN_BUNDLE_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 17))
 
 /**
  * Admin module for admin messages
@@ -15,6 +25,16 @@ class AdminModule : public ProtobufModule<meshtastic_AdminMessage>
      */
     AdminModule();
 
+    /**
+     * Called with each packet from the phone.  If it's part of an edit of a remote node's settings, we keep it for the bundle
+     * we send that node once the edit's committed.
+     * @return true if we kept it, so it needn't be sent
+     */
+    bool bundleFromPhone(const meshtastic_MeshPacket &p);
+
+    /// FragmentModule's handler for the settings bundles sent us, which we apply all at once
+    static void receiveBundle(NodeNum from, ChannelIndex channel, const uint8_t *data, size_t len);
+
   protected:
     /** Called to handle a particular incoming message
 
@@ -25,6 +45,26 @@ class AdminModule : public ProtobufModule<meshtastic_AdminMessage>
   private:
     bool hasOpenEditTransaction = false;
 
+    /// A settings bundle starts with this, then each AdminMessage in it is a varint length and its encoding
+    static const uint8_t BUNDLE_VERSION = 1;
+
+    /// The edit of a remote node's settings we're gathering for the phone, or sending
+    struct Bundle {
+        NodeNum to = 0; // 0 if we're not
+        ChannelIndex channel = 0;
+        PacketId commitId = 0; // the phone's commit_edit_settings, which we answer once the bundle's sent
+        std::vector<uint8_t> data;
+    };
+    Bundle bundle;
+
+    static void bundleSent(NodeNum to, bool succeeded);
+
+    /// Answer the phone's packet id as though from would have
+    void answerPhone(NodeNum from, PacketId id, ChannelIndex channel, meshtastic_Routing_Error err);
+
+    /// Check (or if apply, carry out) every AdminMessage in a bundle.  @return false if one can't be decoded or isn't a setter
+    bool applyBundle(const uint8_t *data, size_t len, bool apply);
+
     void saveChanges(int saveWhat, bool shouldReboot = true);
 
     /**
@@ -1,14 +1,13 @@
 #include "AtakPluginModule.h"
 #include "MeshService.h"
 #include "NodeDB.h"
+#include "PayloadCompression.h"
 #include "PowerFSM.h"
+#include "TakCodec.h"
 #include "configuration.h"
 #include "main.h"
 #include "meshtastic/atak.pb.h"
-
-extern "C" {
-#include "mesh/compression/unishox2.h"
-}
+#include <algorithm>
 
 AtakPluginModule *atakPluginModule;
 
@@ -16,6 +15,53 @@ AtakPluginModule::AtakPluginModule()
     : ProtobufModule("atak", meshtastic_PortNum_ATAK_PLUGIN, &meshtastic_TAKPacket_msg), concurrency::OSThread("AtakPluginModule")
 {
     ourPortNum = meshtastic_PortNum_ATAK_PLUGIN;
+    altersReceived = true; // we (de)compress the payload in place
+#if ATAK_COMPACT
+    if (!takCodec)
+        takCodec = new TakCodec();
+#endif
+}
+
+int AtakPluginModule::transcodeString(bool compress, const char *in, char *out, size_t outLen)
+{
+    size_t inLen = strlen(in);
+    if (inLen >= ATAK_STRING_CACHE_LEN) {
+        int len = compress ? unishoxCompress(in, inLen, out, outLen - 1) : unishoxDecompress(in, inLen, out, outLen - 1);
+        out[len < 0 ? 0 : len] = '\0';
+        return len;
+    }
+
+    // TAK sends the same few callsigns in every packet, so we've likely done this one already
+    CachedString *slot = &stringCache[0];
+    for (CachedString &c : stringCache) {
+        if (c.used && c.compress == compress && !strcmp(c.in, in) && c.outLen < outLen) {
+            c.lastUsed = ++stringCacheClock;
+            memcpy(out, c.out, c.outLen);
+            out[c.outLen] = '\0';
+            return c.outLen;
+        }
+        if (c.lastUsed < slot->lastUsed)
+            slot = &c;
+    }
+
+    char result[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    size_t resultLen = std::min(sizeof(result), outLen - 1);
+    int len = compress ? unishoxCompress(in, inLen, result, resultLen) : unishoxDecompress(in, inLen, result, resultLen);
+    if (len < 0) {
+        out[0] = '\0';
+        return len;
+    }
+    memcpy(out, result, len);
+    out[len] = '\0';
+    if ((size_t)len < sizeof(slot->out)) {
+        slot->used = true;
+        slot->compress = compress;
+        strcpy(slot->in, in);
+        memcpy(slot->out, result, len);
+        slot->outLen = len;
+        slot->lastUsed = ++stringCacheClock;
+    }
+    return len;
 }
 
 /*
@@ -68,27 +114,24 @@ void AtakPluginModule::alterReceivedProtobuf(meshtastic_MeshPacket &mp, meshtast
         auto compressed = cloneTAKPacketData(t);
         compressed.is_compressed = true;
         if (t->has_contact) {
-            auto length = unishox2_compress_simple(t->contact.callsign, strlen(t->contact.callsign), compressed.contact.callsign);
+            auto length = compressString(t->contact.callsign, compressed.contact.callsign);
             LOG_DEBUG("Uncompressed callsign '%s' - %d bytes\n", t->contact.callsign, strlen(t->contact.callsign));
             LOG_DEBUG("Compressed callsign '%s' - %d bytes\n", t->contact.callsign, length);
 
-            length = unishox2_compress_simple(t->contact.device_callsign, strlen(t->contact.device_callsign),
-                                              compressed.contact.device_callsign);
+            length = compressString(t->contact.device_callsign, compressed.contact.device_callsign);
             LOG_DEBUG("Uncompressed device_callsign '%s' - %d bytes\n", t->contact.device_callsign,
                       strlen(t->contact.device_callsign));
             LOG_DEBUG("Compressed device_callsign '%s' - %d bytes\n", compressed.contact.device_callsign, length);
         }
         if (t->which_payload_variant == meshtastic_TAKPacket_chat_tag) {
-            auto length = unishox2_compress_simple(t->payload_variant.chat.message, strlen(t->payload_variant.chat.message),
-                                                   compressed.payload_variant.chat.message);
+            auto length = compressString(t->payload_variant.chat.message, compressed.payload_variant.chat.message);
             LOG_DEBUG("Uncompressed chat message '%s' - %d bytes\n", t->payload_variant.chat.message,
                       strlen(t->payload_variant.chat.message));
             LOG_DEBUG("Compressed chat message '%s' - %d bytes\n", compressed.payload_variant.chat.message, length);
 
             if (t->payload_variant.chat.has_to) {
                 compressed.payload_variant.chat.has_to = true;
-                length = unishox2_compress_simple(t->payload_variant.chat.to, strlen(t->payload_variant.chat.to),
-                                                  compressed.payload_variant.chat.to);
+                length = compressString(t->payload_variant.chat.to, compressed.payload_variant.chat.to);
                 LOG_DEBUG("Uncompressed chat to '%s' - %d bytes\n", t->payload_variant.chat.to,
                           strlen(t->payload_variant.chat.to));
                 LOG_DEBUG("Compressed chat to '%s' - %d bytes\n", compressed.payload_variant.chat.to, length);
@@ -110,27 +153,24 @@ void AtakPluginModule::alterReceivedProtobuf(meshtastic_MeshPacket &mp, meshtast
         uncompressed.is_compressed = false;
         if (t->has_contact) {
             auto length =
-                unishox2_decompress_simple(t->contact.callsign, strlen(t->contact.callsign), uncompressed.contact.callsign);
+                decompressString(t->contact.callsign, uncompressed.contact.callsign);
 
             LOG_DEBUG("Compressed callsign: %d bytes\n", strlen(t->contact.callsign));
             LOG_DEBUG("Decompressed callsign: '%s' @ %d bytes\n", uncompressed.contact.callsign, length);
 
-            length = unishox2_decompress_simple(t->contact.device_callsign, strlen(t->contact.device_callsign),
-                                                uncompressed.contact.device_callsign);
+            length = decompressString(t->contact.device_callsign, uncompressed.contact.device_callsign);
 
             LOG_DEBUG("Compressed device_callsign: %d bytes\n", strlen(t->contact.device_callsign));
             LOG_DEBUG("Decompressed device_callsign: '%s' @ %d bytes\n", uncompressed.contact.device_callsign, length);
         }
         if (uncompressed.which_payload_variant == meshtastic_TAKPacket_chat_tag) {
-            auto length = unishox2_decompress_simple(t->payload_variant.chat.message, strlen(t->payload_variant.chat.message),
-                                                     uncompressed.payload_variant.chat.message);
+            auto length = decompressString(t->payload_variant.chat.message, uncompressed.payload_variant.chat.message);
             LOG_DEBUG("Compressed chat message: %d bytes\n", strlen(t->payload_variant.chat.message));
             LOG_DEBUG("Decompressed chat message: '%s' @ %d bytes\n", uncompressed.payload_variant.chat.message, length);
 
             if (t->payload_variant.chat.has_to) {
                 uncompressed.payload_variant.chat.has_to = true;
-                length = unishox2_decompress_simple(t->payload_variant.chat.to, strlen(t->payload_variant.chat.to),
-                                                    uncompressed.payload_variant.chat.to);
+                length = decompressString(t->payload_variant.chat.to, uncompressed.payload_variant.chat.to);
                 LOG_DEBUG("Compressed chat to: %d bytes\n", strlen(t->payload_variant.chat.to));
                 LOG_DEBUG("Decompressed chat to: '%s' @ %d bytes\n", uncompressed.payload_variant.chat.to, length);
             }
@@ -2,6 +2,14 @@
 #include "ProtobufModule.h"
 #include "meshtastic/atak.pb.h"
 
+/// How many strings (callsigns, mostly) we keep compressed or decompressed, so repeats needn't be done again
+#ifndef ATAK_STRING_CACHE
+#define ATAK_STRING_CACHE 8
+#endif
+
+/// The longest string we cache
+#define ATAK_STRING_CACHE_LEN 48
+
 /**
  * Waypoint message handling for meshtastic
  */
@@ -21,6 +29,23 @@ class AtakPluginModule : public ProtobufModule<meshtastic_TAKPacket>, private co
 
   private:
     meshtastic_TAKPacket cloneTAKPacketData(meshtastic_TAKPacket *t);
+
+    struct CachedString {
+        bool used;
+        bool compress; // in is what we compressed, else what we decompressed
+        char in[ATAK_STRING_CACHE_LEN];
+        char out[ATAK_STRING_CACHE_LEN + 16];
+        uint8_t outLen;
+        uint32_t lastUsed;
+    };
+    CachedString stringCache[ATAK_STRING_CACHE] = {};
+    uint32_t stringCacheClock = 0;
+
+    /// unishox2 compress (or decompress) in to out (NUL terminated, outLen bytes including that), @return out's length or -1
+    /// if it didn't fit
+    int transcodeString(bool compress, const char *in, char *out, size_t outLen);
+    template <size_t N> int compressString(const char *in, char (&out)[N]) { return transcodeString(true, in, out, N); }
+    template <size_t N> int decompressString(const char *in, char (&out)[N]) { return transcodeString(false, in, out, N); }
 };
 
 extern AtakPluginModule *atakPluginModule;
\ No newline at end of file
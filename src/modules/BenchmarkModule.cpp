@@ -0,0 +1,500 @@
+#include "BenchmarkModule.h"
+#include "Channels.h"
+#include "CryptoEngine.h"
+#include "FSCommon.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "RadioInterface.h"
+#include "Router.h"
+#include "airtime.h"
+#include "configuration.h"
+#include "main.h"
+#include <algorithm>
+#include <stdlib.h>
+
+extern "C" {
+#include "mesh/compression/unishox2.h"
+}
+
+BenchmarkModule *benchmarkModule;
+
+/// How long after our last packet we wait for stragglers before ending the run
+#define BENCHMARK_END_GRACE_MSEC 10000
+
+/// How long we wait before sending again while the tx queue is full or our airtime allowance is spent
+#define BENCHMARK_BUSY_MSEC 500
+
+/// How many times the self benchmark times each thing, enough to read micros() against without holding up the packet path for
+/// long
+#define BENCHMARK_SELF_OPS 64
+
+/// The size of the file the self benchmark writes and reads back
+#define BENCHMARK_SELF_FLASH_BYTES 4096
+
+/// Run fn(i) for i in [0, ops), @return how long that took in nanoseconds per op
+template <typename F> static uint32_t timeOps(uint32_t ops, F fn)
+{
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < ops; i++)
+        fn(i);
+    return std::min<uint64_t>((uint64_t)(micros() - start) * 1000 / ops, UINT32_MAX);
+}
+
+BenchmarkModule::BenchmarkModule() : SinglePortModule("benchmark", BENCHMARK_PORTNUM), concurrency::OSThread("Benchmark")
+{
+    disable(); // until a run starts
+}
+
+ProcessMessage BenchmarkModule::handleReceived(const meshtastic_MeshPacket &mp)
+{
+    if (mp.decoded.portnum == meshtastic_PortNum_ROUTING_APP) {
+        handleAck(mp);
+        return ProcessMessage::CONTINUE;
+    }
+
+    const meshtastic_Data &p = mp.decoded;
+    if (!p.payload.size)
+        return ProcessMessage::CONTINUE;
+    bool fromUs = getFrom(&mp) == nodeDB.getNodeNum();
+
+    switch (p.payload.bytes[0]) {
+    case START: {
+        // Only our own phone starts runs, nobody else gets to make us flood the mesh
+        Start s;
+        if (fromUs && mp.to == nodeDB.getNodeNum() && p.payload.size >= sizeof(s)) {
+            memcpy(&s, p.payload.bytes, sizeof(s));
+            start(s);
+        }
+        break;
+    }
+    case LISTEN: {
+        Listen l;
+        if (fromUs && mp.to == nodeDB.getNodeNum() && p.payload.size >= sizeof(l)) {
+            memcpy(&l, p.payload.bytes, sizeof(l));
+            listening = l.on;
+            LOG_INFO("Benchmark: %s runs we hear
+", listening ? "reporting" : "ignoring");
+            if (!listening && receiving) {
+                receiving->from = 0; // drop what we heard, runOnce() frees it
+                enabled = true;
+                setIntervalFromNow(0);
+            }
+        }
+        break;
+    }
+    case DATA: {
+        // Only receivers our phone opted in count runs, the rest of the mesh just relays them
+        Data d;
+        if (!fromUs && listening && p.payload.size >= sizeof(d)) {
+            memcpy(&d, p.payload.bytes, sizeof(d));
+            handleData(mp, d);
+        }
+        break;
+    }
+    case END: {
+        End e;
+        if (!fromUs && p.payload.size >= sizeof(e) && receiving && receiving->from == getFrom(&mp)) {
+            memcpy(&e, p.payload.bytes, sizeof(e));
+            if (e.runId == receiving->runId && !receiving->reportAtMsec) {
+                receiving->expected = e.sent;
+                receiving->reportAtMsec = millis() + random(BENCHMARK_REPORT_JITTER_MSEC) + 1;
+                enabled = true;
+                setIntervalFromNow(receiving->reportAtMsec - millis());
+            }
+        }
+        break;
+    }
+    case REPORT: {
+        // Only for a run of ours, anyone else's phone never asked to see it
+        Report r;
+        if (!fromUs && mp.to == nodeDB.getNodeNum() && p.payload.size >= sizeof(r)) {
+            memcpy(&r, p.payload.bytes, sizeof(r));
+            if (lastRunId && r.runId == lastRunId)
+                showReport(getFrom(&mp), r);
+        }
+        break;
+    }
+    case SELF: {
+        // It holds everything else up while it runs, so only our own phone or an admin gets to start it
+        bool isAdmin = mp.channel < channels.getNumChannels() &&
+                       strcasecmp(channels.getByIndex(mp.channel).settings.name, Channels::adminChannel) == 0;
+        if (mp.to == nodeDB.getNodeNum() && !selfFor && (fromUs || isAdmin)) {
+            selfFor = getFrom(&mp);
+            selfChannel = mp.channel;
+            enabled = true;
+            setIntervalFromNow(0);
+        }
+        break;
+    }
+    case SELF_REPORT: {
+        // Sent only to whoever asked for it
+        SelfReport r;
+        if (!fromUs && mp.to == nodeDB.getNodeNum() && p.payload.size >= sizeof(r)) {
+            memcpy(&r, p.payload.bytes, sizeof(r));
+            showSelfReport(getFrom(&mp), r);
+        }
+        break;
+    }
+    }
+    return ProcessMessage::STOP;
+}
+
+void BenchmarkModule::start(const Start &s)
+{
+    if (sending.count) {
+        showPhone(nodeDB.getNodeNum(), "benchmark: a run is already going");
+        return;
+    }
+    if (!s.count || s.count > BENCHMARK_MAX_COUNT || s.size < sizeof(Data) || s.size > meshtastic_Constants_DATA_PAYLOAD_LEN ||
+        (s.pattern == UNICAST && (!s.dest || s.dest == NODENUM_BROADCAST || s.dest == nodeDB.getNodeNum())) ||
+        s.pattern > UNICAST) {
+        showPhone(nodeDB.getNodeNum(), "benchmark: bad start");
+        return;
+    }
+
+    sending = Sending();
+    sending.start = s;
+    sending.runId = ++lastRunId;
+    sending.count = s.count;
+    sending.startedMsec = sending.nextMsec = millis();
+    LOG_INFO("Benchmark run %u: %u %s packets of %u bytes every %ums over %u hops\n", sending.runId, s.count,
+             s.pattern == UNICAST ? "unicast" : "broadcast", s.size, s.intervalMsec, s.hopLimit);
+    enabled = true;
+    setIntervalFromNow(0);
+}
+
+void BenchmarkModule::sendData()
+{
+    const Start &s = sending.start;
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = s.pattern == UNICAST ? s.dest : NODENUM_BROADCAST;
+    p->want_ack = s.pattern == UNICAST;
+    p->hop_limit = std::min<uint8_t>(s.hopLimit, HOP_MAX);
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+
+    Data d = {DATA, sending.runId, sending.sent, sending.count, millis()};
+    memset(p->decoded.payload.bytes, 0, s.size);
+    memcpy(p->decoded.payload.bytes, &d, sizeof(d));
+    p->decoded.payload.size = s.size;
+
+    if (p->want_ack) {
+        auto &f = sending.inFlight[sending.sent % BENCHMARK_IN_FLIGHT];
+        f.id = p->id;
+        f.sentMsec = d.sentMsec;
+    }
+    if (rIf)
+        sending.airtimeMsec += rIf->getPacketTime(p);
+    sending.sent++;
+    service.sendToMesh(p);
+}
+
+void BenchmarkModule::sendEnd()
+{
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = sending.start.pattern == UNICAST ? sending.start.dest : NODENUM_BROADCAST;
+    p->hop_limit = std::min<uint8_t>(sending.start.hopLimit, HOP_MAX);
+    End e = {END, sending.runId, sending.sent};
+    memcpy(p->decoded.payload.bytes, &e, sizeof(e));
+    p->decoded.payload.size = sizeof(e);
+    service.sendToMesh(p);
+
+    uint32_t secs = (millis() - sending.startedMsec) / 1000;
+    char text[160];
+    int len = snprintf(text, sizeof(text), "benchmark run %u: sent %u in %us (%u skipped), airtime %ums, chutil %.1f%%",
+                       sending.runId, sending.sent, secs, sending.skipped, sending.airtimeMsec,
+                       airTime->channelUtilizationPercent());
+    if (sending.start.pattern == UNICAST && len > 0 && (size_t)len < sizeof(text))
+        snprintf(text + len, sizeof(text) - len, ", %u acked, rtt p50/p90/p99 %u/%u/%ums", sending.acked,
+                 sending.rtt.getPercentile(0.5), sending.rtt.getPercentile(0.9), sending.rtt.getPercentile(0.99));
+    showPhone(nodeDB.getNodeNum(), text);
+    sending.count = 0;
+}
+
+void BenchmarkModule::handleAck(const meshtastic_MeshPacket &mp)
+{
+    meshtastic_Routing r = meshtastic_Routing_init_default;
+    if (!sending.count || mp.to != nodeDB.getNodeNum() || !mp.decoded.request_id ||
+        !pb_decode_from_bytes(mp.decoded.payload.bytes, mp.decoded.payload.size, &meshtastic_Routing_msg, &r) ||
+        r.which_variant != meshtastic_Routing_error_reason_tag || r.error_reason != meshtastic_Routing_Error_NONE)
+        return;
+
+    for (auto &f : sending.inFlight) {
+        if (f.id && f.id == mp.decoded.request_id) {
+            sending.rtt.record(millis() - f.sentMsec);
+            sending.acked++;
+            f.id = 0;
+            return;
+        }
+    }
+}
+
+void BenchmarkModule::handleData(const meshtastic_MeshPacket &mp, const Data &d)
+{
+    NodeNum from = getFrom(&mp);
+    if (d.seq >= BENCHMARK_MAX_COUNT)
+        return;
+    if (!receiving) {
+        receiving = (Receiving *)malloc(sizeof(Receiving));
+        if (!receiving) {
+            LOG_WARN("No room to keep benchmark results\n");
+            return;
+        }
+        receiving->from = 0;
+    }
+
+    Receiving &r = *receiving;
+    if (r.from != from || r.runId != d.runId) {
+        // A new run, which replaces whatever we heard before
+        if (r.from && !r.reportAtMsec)
+            LOG_INFO("Benchmark run %u from 0x%x never ended, forgetting it\n", r.runId, r.from);
+        memset(&r, 0, sizeof(r));
+        r.from = from;
+        r.runId = d.runId;
+        r.channel = mp.channel;
+        r.lastSeq = d.seq;
+    }
+
+    if (r.seen[d.seq / 8] & (1 << (d.seq % 8))) {
+        r.duplicates++;
+        return;
+    }
+    r.seen[d.seq / 8] |= 1 << (d.seq % 8);
+    r.received++;
+    r.expected = d.count;
+    if (r.received > 1 && (int16_t)(d.seq - r.lastSeq) < 0)
+        r.outOfOrder++;
+    else
+        r.lastSeq = d.seq;
+    if (rIf)
+        r.airtimeMsec += rIf->getPacketTime(&mp);
+    if (r.numOffsets < BENCHMARK_MAX_SAMPLES)
+        r.offsets[r.numOffsets++] = millis() - d.sentMsec;
+}
+
+void BenchmarkModule::sendReport()
+{
+    Receiving &r = *receiving;
+    Report rep = {REPORT, r.runId, r.received, r.expected, r.duplicates, r.outOfOrder, {}, r.airtimeMsec};
+
+    // Latency over the fastest packet's, which stands in for the clocks' difference
+    std::sort(r.offsets, r.offsets + r.numOffsets);
+    static const float percentiles[] = {0.5, 0.9, 0.99};
+    for (size_t i = 0; i < 3 && r.numOffsets; i++) {
+        size_t at = std::min<size_t>(r.numOffsets * percentiles[i], r.numOffsets - 1);
+        rep.latencyMsec[i] = std::min<uint32_t>(r.offsets[at] - r.offsets[0], UINT16_MAX);
+    }
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = r.from;
+    p->channel = r.channel;
+    memcpy(p->decoded.payload.bytes, &rep, sizeof(rep));
+    p->decoded.payload.size = sizeof(rep);
+    service.sendToMesh(p);
+    showReport(nodeDB.getNodeNum(), rep);
+
+    r.from = 0;
+}
+
+void BenchmarkModule::showReport(NodeNum from, const Report &r)
+{
+    char text[160];
+    snprintf(text, sizeof(text),
+             "benchmark run %u at 0x%x: %u/%u received (%u%%), %u dup, %u out of order, latency p50/p90/p99 +%u/+%u/+%ums, "
+             "airtime %ums",
+             r.runId, from, r.received, r.expected, r.expected ? r.received * 100 / r.expected : 0, r.duplicates, r.outOfOrder,
+             r.latencyMsec[0], r.latencyMsec[1], r.latencyMsec[2], r.airtimeMsec);
+    showPhone(from, text);
+}
+
+void BenchmarkModule::showPhone(NodeNum from, const char *text)
+{
+    LOG_INFO("%s\n", text);
+    meshtastic_MeshPacket *p = router->allocForSending();
+    p->from = from;
+    p->to = nodeDB.getNodeNum();
+    p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    p->decoded.payload.size = std::min(strlen(text), sizeof(p->decoded.payload.bytes));
+    memcpy(p->decoded.payload.bytes, text, p->decoded.payload.size);
+    service.sendToPhone(p);
+}
+
+void BenchmarkModule::runSelf(SelfReport &r)
+{
+    uint32_t startMsec = millis();
+    memset(&r, 0, sizeof(r));
+    r.type = SELF_REPORT;
+    r.hwModel = HW_VENDOR;
+    strncpy(r.version, optstr(APP_VERSION), sizeof(r.version) - 1);
+
+    // The engine notes which key its slot now holds, so the packet path sets its channel's key up again after us
+    uint8_t buf[200];
+    memset(buf, 0xa5, sizeof(buf));
+    for (int k = 0; k < 2; k++) {
+        CryptoKey key;
+        memset(key.bytes, 0x42, sizeof(key.bytes));
+        key.length = k ? 32 : 16;
+        crypto->setKey(key);
+        r.aesEncrypt[k] =
+            timeOps(BENCHMARK_SELF_OPS, [&](uint32_t i) { crypto->encrypt(nodeDB.getNodeNum(), i, sizeof(buf), buf); });
+        r.aesDecrypt[k] =
+            timeOps(BENCHMARK_SELF_OPS, [&](uint32_t i) { crypto->decrypt(nodeDB.getNodeNum(), i, sizeof(buf), buf); });
+    }
+
+    static const char *sampleText = "Meet at the trailhead at 7, bring water and a spare battery for the radio. Back by dark?";
+    int textLen = strlen(sampleText);
+    char compressed[256], decompressed[256];
+    int compressedLen = unishox2_compress_simple(sampleText, textLen, compressed);
+    r.unishoxCompress = timeOps(BENCHMARK_SELF_OPS, [&](uint32_t) { unishox2_compress_simple(sampleText, textLen, compressed); });
+    r.unishoxDecompress =
+        timeOps(BENCHMARK_SELF_OPS, [&](uint32_t) { unishox2_decompress_simple(compressed, compressedLen, decompressed); });
+
+    // A position report, as PositionModule sends them
+    meshtastic_Position pos = meshtastic_Position_init_default;
+    pos.latitude_i = 473977420;
+    pos.longitude_i = 85455920;
+    pos.altitude = 408;
+    pos.time = 1700000000;
+    pos.sats_in_view = 9;
+    pos.PDOP = 142;
+    meshtastic_Data data = meshtastic_Data_init_default;
+    data.portnum = meshtastic_PortNum_POSITION_APP;
+    uint8_t encoded[meshtastic_Data_size];
+    size_t encodedLen = 0;
+    r.dataEncode = timeOps(BENCHMARK_SELF_OPS, [&](uint32_t) {
+        data.payload.size = pb_encode_to_bytes(data.payload.bytes, sizeof(data.payload.bytes), &meshtastic_Position_msg, &pos);
+        encodedLen = pb_encode_to_bytes(encoded, sizeof(encoded), &meshtastic_Data_msg, &data);
+    });
+    r.dataDecode = timeOps(BENCHMARK_SELF_OPS, [&](uint32_t) {
+        meshtastic_Data d;
+        meshtastic_Position decodedPos;
+        if (pb_decode_from_bytes(encoded, encodedLen, &meshtastic_Data_msg, &d))
+            pb_decode_from_bytes(d.payload.bytes, d.payload.size, &meshtastic_Position_msg, &decodedPos);
+    });
+
+    // Nodes we have, looked up in turn
+    NodeNum nums[BENCHMARK_SELF_OPS];
+    size_t numNums = std::min<size_t>(nodeDB.getNumMeshNodes(), BENCHMARK_SELF_OPS);
+    for (size_t i = 0; i < numNums; i++)
+        nums[i] = nodeDB.getMeshNodeByIndex(i)->num;
+    r.numNodes = std::min<size_t>(nodeDB.getNumMeshNodes() + nodeDB.getNumExtendedNodes(), UINT16_MAX);
+    if (numNums)
+        r.nodeLookup = timeOps(BENCHMARK_SELF_OPS * 4, [&](uint32_t i) { nodeDB.getMeshNode(nums[i % numNums]); });
+
+#ifdef FSCom
+    static const char *benchFileName = "/bench.tmp";
+    uint8_t *block = (uint8_t *)malloc(BENCHMARK_SELF_FLASH_BYTES);
+    if (block) {
+        memset(block, 0x5a, BENCHMARK_SELF_FLASH_BYTES);
+        uint32_t start = micros();
+        auto w = FSCom.open(benchFileName, FILE_O_WRITE);
+        bool okay = w && w.write(block, BENCHMARK_SELF_FLASH_BYTES) == BENCHMARK_SELF_FLASH_BYTES;
+        if (w)
+            w.close();
+        if (okay)
+            r.flashWrite = std::min<uint64_t>((uint64_t)(micros() - start) * 1000, UINT32_MAX);
+
+        start = micros();
+        auto f = FSCom.open(benchFileName, FILE_O_READ);
+        okay = okay && f && f.read(block, BENCHMARK_SELF_FLASH_BYTES) == BENCHMARK_SELF_FLASH_BYTES;
+        if (f)
+            f.close();
+        if (okay)
+            r.flashRead = std::min<uint64_t>((uint64_t)(micros() - start) * 1000, UINT32_MAX);
+        FSCom.remove(benchFileName);
+        free(block);
+    }
+#endif
+
+    if (rIf)
+        r.spiRead = rIf->timeSpiRead(BENCHMARK_SELF_OPS);
+    LOG_INFO("Self benchmark took %ums\n", millis() - startMsec);
+}
+
+void BenchmarkModule::sendSelfReport(const SelfReport &r)
+{
+    meshtastic_MeshPacket *p = allocDataPacket();
+    memcpy(p->decoded.payload.bytes, &r, sizeof(r));
+    p->decoded.payload.size = sizeof(r);
+    if (selfFor == nodeDB.getNodeNum()) {
+        // Straight to our own phone, as if it came to us
+        p->from = nodeDB.getNodeNum();
+        p->to = nodeDB.getNodeNum();
+        service.sendToPhone(p);
+        showSelfReport(nodeDB.getNodeNum(), r);
+    } else {
+        p->to = selfFor;
+        p->channel = selfChannel;
+        service.sendToMesh(p);
+    }
+}
+
+void BenchmarkModule::showSelfReport(NodeNum from, const SelfReport &r)
+{
+    char text[240];
+    snprintf(text, sizeof(text),
+             "self benchmark at 0x%x (hw %u, %s), ns/op: aes128 %u/%u, aes256 %u/%u, unishox %u/%u, pb %u/%u, lookup %u of "
+             "%u nodes, spi %u; flash 4KB w/r %u/%uus",
+             from, r.hwModel, r.version, r.aesEncrypt[0], r.aesDecrypt[0], r.aesEncrypt[1], r.aesDecrypt[1], r.unishoxCompress,
+             r.unishoxDecompress, r.dataEncode, r.dataDecode, r.nodeLookup, r.numNodes, r.spiRead, r.flashWrite / 1000,
+             r.flashRead / 1000);
+    showPhone(from, text);
+}
+
+int32_t BenchmarkModule::runOnce()
+{
+    if (selfFor) {
+        SelfReport r;
+        runSelf(r);
+        sendSelfReport(r);
+        selfFor = 0;
+    }
+
+    uint32_t now = millis();
+    int32_t wait = INT32_MAX;
+
+    if (receiving && receiving->from && receiving->reportAtMsec) {
+        if ((int32_t)(now - receiving->reportAtMsec) >= 0)
+            sendReport();
+        else
+            wait = receiving->reportAtMsec - now;
+    }
+
+    if (sending.count) {
+        if (sending.ended) {
+            // The run's over once its stragglers (and acks) have had time to arrive
+            if ((int32_t)(now - sending.nextMsec) >= 0)
+                sendEnd();
+            else
+                wait = std::min<int32_t>(wait, sending.nextMsec - now);
+        } else if ((int32_t)(now - sending.nextMsec) >= 0) {
+            if (router->getQueueStatus().free < 2 || !airTime->isTxAllowedAirUtil()) {
+                // We're asking more than the radio (or our duty cycle) can give, which the results should show
+                sending.skipped++;
+                wait = std::min<int32_t>(wait, BENCHMARK_BUSY_MSEC);
+                sending.nextMsec = now + BENCHMARK_BUSY_MSEC;
+            } else {
+                sendData();
+                if (sending.sent >= sending.count) {
+                    sending.ended = true;
+                    sending.nextMsec = now + BENCHMARK_END_GRACE_MSEC;
+                } else {
+                    sending.nextMsec += sending.start.intervalMsec;
+                    if ((int32_t)(now - sending.nextMsec) > 0)
+                        sending.nextMsec = now; // we fell behind, don't try to catch up in a burst
+                }
+                wait = std::min<int32_t>(wait, sending.nextMsec - now);
+            }
+        } else {
+            wait = std::min<int32_t>(wait, sending.nextMsec - now);
+        }
+    }
+
+    if (wait == INT32_MAX) {
+        if (receiving && !receiving->from) {
+            free(receiving);
+            receiving = NULL;
+        }
+        return disable();
+    }
+    return wait;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "SinglePortModule.h"
+#include "concurrency/OSThread.h"
+#include "RadioStats.h"
+
+/// Build in the benchmark module, it does nothing until our phone starts a run (or asks us to listen for them)
+#ifndef BENCHMARK_MODULE
+#define BENCHMARK_MODULE 0
+#endif
+
+/// The portnum benchmark traffic, starts and reports go on, one nothing upstream uses
+#define BENCHMARK_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 19))
+
+/// The most packets in one run
+#define BENCHMARK_MAX_COUNT 1024
+
+/// Latencies a receiver keeps for its percentiles (the rest of a longer run still count towards everything else)
+#ifndef BENCHMARK_MAX_SAMPLES
+#define BENCHMARK_MAX_SAMPLES 256
+#endif
+
+/// Unicast packets we watch for the ack of at once, for their round trip time
+#define BENCHMARK_IN_FLIGHT 32
+
+/// Receivers answer the end of a run after a random delay of up to this, so their reports don't collide
+#ifndef BENCHMARK_REPORT_JITTER_MSEC
+#define BENCHMARK_REPORT_JITTER_MSEC 5000
+#endif
+
+/**
+ * Measures what the mesh can carry.  Our phone starts a run by sending us a Start (on BENCHMARK_PORTNUM, to our own node),
+ * and we then send count Data packets of size bytes every intervalMsec: broadcast, or to one node wanting acks, over up to
+ * hopLimit hops.  Each carries its sequence number and when (by our clock) we sent it.
+ *
+ * Receivers are nodes whose own phone sent them a Listen, nobody else keeps or answers what it hears of a run.  They count
+ * what arrives: how much of the run, duplicates and out of order packets, the airtime it took, and its
+ * latency.  Clocks aren't in step, so latency is one way, over that of the fastest packet of the run: the spread a packet
+ * meets on top of its airtime, from queuing, contention and rebroadcasts.  For a unicast run we also time each packet's ack,
+ * which is a true round trip.  After the last packet we send an End, each receiver sends us a Report, and the phone gets every
+ * report (theirs and our own) as a text message.  Reports are mesh packets, so a channel with MQTT uplink publishes them too.
+ * Only a phone which asked for results (started the run, listened, or asked for a self benchmark) is ever shown any.
+ *
+ * The self benchmark times what the native benchmarks can't show of a real device: its AES (hardware, where it has some),
+ * compression, protobuf coding, NodeDB lookups at the size it's at, its flash and its SPI to the radio.  Our phone (or an admin
+ * on the admin channel) sends us a Self, and gets back a SelfReport, with the same as text for our own phone.
+ */
+class BenchmarkModule : public SinglePortModule, private concurrency::OSThread
+{
+  public:
+    enum Pattern : uint8_t {
+        BROADCAST = 0, // flooded to everyone, within hopLimit
+        UNICAST = 1,   // to dest, wanting an ack for each
+    };
+
+    enum Type : uint8_t {
+        START = 'S',
+        DATA = 'D',
+        END = 'E',
+        REPORT = 'R',
+        SELF = 'B',        // run our self benchmark, from our phone or the admin channel
+        SELF_REPORT = 'b', // ... and what it found
+        LISTEN = 'L',      // from our phone, to count and report the runs we hear (or stop)
+    };
+
+#pragma pack(push, 1)
+    /// From our phone, to start a run
+    struct Start {
+        uint8_t type; // START
+        uint8_t pattern;
+        uint8_t hopLimit;
+        uint8_t size; // of each Data payload, at least sizeof(Data)
+        uint16_t count;
+        uint16_t intervalMsec;
+        uint32_t dest; // for UNICAST
+    };
+
+    /// From our phone, to opt in to (or out of) being a receiver
+    struct Listen {
+        uint8_t type; // LISTEN
+        uint8_t on;
+    };
+
+    struct Data {
+        uint8_t type; // DATA
+        uint8_t runId;
+        uint16_t seq;
+        uint16_t count;
+        uint32_t sentMsec;
+    };
+
+    struct End {
+        uint8_t type; // END
+        uint8_t runId;
+        uint16_t sent;
+    };
+
+    struct Report {
+        uint8_t type; // REPORT
+        uint8_t runId;
+        uint16_t received, expected, duplicates, outOfOrder;
+        uint16_t latencyMsec[3]; // 50th, 90th and 99th percentiles, over the fastest
+        uint32_t airtimeMsec;    // of what we received
+    };
+
+    /// What our self benchmark took, in nanoseconds per op (0 for what we couldn't time)
+    struct SelfReport {
+        uint8_t type;                                // SELF_REPORT
+        uint8_t hwModel;
+        uint16_t numNodes;                           // in our NodeDB, as we looked them up
+        uint32_t aesEncrypt[2], aesDecrypt[2];       // of 200 bytes, AES128 then AES256
+        uint32_t unishoxCompress, unishoxDecompress; // a typical text message
+        uint32_t dataEncode, dataDecode;             // a Data holding a Position, protobuf and all
+        uint32_t nodeLookup;
+        uint32_t flashWrite, flashRead;              // of 4KB
+        uint32_t spiRead;                            // a burst read of the radio's registers
+        char version[18];                            // of our firmware
+    };
+#pragma pack(pop)
+
+    BenchmarkModule();
+
+  protected:
+    virtual ProcessMessage handleReceived(const meshtastic_MeshPacket &mp) override;
+
+    virtual bool wantPacket(const meshtastic_MeshPacket *p) override
+    {
+        return p->decoded.portnum == ourPortNum || (p->decoded.portnum == meshtastic_PortNum_ROUTING_APP && sending.count);
+    }
+
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override
+    {
+        ports.push_back(ourPortNum);
+        ports.push_back(meshtastic_PortNum_ROUTING_APP); // for the acks of a unicast run
+    }
+
+    virtual int32_t runOnce() override;
+
+  private:
+    /// Our run, count == 0 if none
+    struct Sending {
+        Start start;
+        uint8_t runId;
+        uint16_t count, sent, acked, skipped;
+        uint32_t startedMsec, nextMsec, airtimeMsec;
+        bool ended;
+        struct {
+            PacketId id;
+            uint32_t sentMsec;
+        } inFlight[BENCHMARK_IN_FLIGHT];
+        LatencyHistogram rtt;
+    };
+
+    /// The run we're hearing, from == 0 if none
+    struct Receiving {
+        NodeNum from;
+        uint8_t runId;
+        ChannelIndex channel;
+        uint16_t expected, received, duplicates, outOfOrder, lastSeq;
+        uint32_t airtimeMsec;
+        uint8_t seen[BENCHMARK_MAX_COUNT / 8];
+        int32_t offsets[BENCHMARK_MAX_SAMPLES]; // our clock less theirs, for each packet
+        uint16_t numOffsets;
+        uint32_t reportAtMsec; // once the run has ended
+    };
+
+    /// Who wants our self benchmark (0 for nobody), and on which channel
+    NodeNum selfFor = 0;
+    ChannelIndex selfChannel = 0;
+
+    Sending sending = {};
+    Receiving *receiving = NULL; // allocated when we first hear a run
+    bool listening = false;      // our phone asked us to be a receiver, until it says otherwise or we reboot
+    uint8_t lastRunId = 0;
+
+    void start(const Start &s);
+    void sendData();
+    void sendEnd();
+    void sendReport();
+
+    void handleData(const meshtastic_MeshPacket &mp, const Data &d);
+    void handleAck(const meshtastic_MeshPacket &mp);
+
+    void runSelf(SelfReport &r);
+    void sendSelfReport(const SelfReport &r);
+    void showSelfReport(NodeNum from, const SelfReport &r);
+
+    /// Show our phone a line of results, as a text message from from.  Only for results it asked for
+    void showPhone(NodeNum from, const char *text);
+    void showReport(NodeNum from, const Report &r);
+};
+
+extern BenchmarkModule *benchmarkModule;
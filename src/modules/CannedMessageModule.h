@@ -67,6 +67,12 @@ class CannedMessageModule : public SinglePortModule, public Observable<const UIF
         }
     }
 
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override
+    {
+        ports.push_back(meshtastic_PortNum_TEXT_MESSAGE_APP);
+        ports.push_back(meshtastic_PortNum_ROUTING_APP);
+    }
+
   protected:
     virtual int32_t runOnce() override;
 
@@ -4,12 +4,23 @@
 #include "PowerFSM.h"
 #include "configuration.h"
 #include "main.h"
+#include <algorithm>
 
 DetectionSensorModule *detectionSensorModule;
 
-#define GPIO_POLLING_INTERVAL 100
 #define DELAYED_INTERVAL 1000
 
+// How often we read monitor_pin ourselves, in case its interrupt misses an edge (or never fires: some pins can't interrupt,
+// or another handler took it)
+#define DETECTION_POLL_MSEC (60 * 1000)
+
+void IRAM_ATTR DetectionSensorModule::onEdge()
+{
+    detectionSensorModule->edges.add(digitalRead(moduleConfig.detection_sensor.monitor_pin), millis());
+    BaseType_t higherWake = 0;
+    detectionSensorModule->wakeFromISR(&higherWake);
+}
+
 int32_t DetectionSensorModule::runOnce()
 {
     /*
@@ -44,32 +55,73 @@ int32_t DetectionSensorModule::runOnce()
         }
         LOG_INFO("Detection Sensor Module: Initializing\n");
 
+        // We're woken by each edge rather than polling, so even a pulse too short for a poll is counted
+        triggered = hasDetectionEvent();
+#ifdef NOT_AN_INTERRUPT
+        if (digitalPinToInterrupt(moduleConfig.detection_sensor.monitor_pin) == NOT_AN_INTERRUPT) {
+            LOG_WARN("Detection Sensor Module: Pin %u can't interrupt, polling it\n", moduleConfig.detection_sensor.monitor_pin);
+            polling = true;
+        }
+#endif
+        if (!polling)
+            attachInterrupt(moduleConfig.detection_sensor.monitor_pin, onEdge, CHANGE);
         return DELAYED_INTERVAL;
     }
 
     // LOG_DEBUG("Detection Sensor Module: Current pin state: %i\n", digitalRead(moduleConfig.detection_sensor.monitor_pin));
 
-    if ((millis() - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.detection_sensor.minimum_broadcast_secs) &&
-        hasDetectionEvent()) {
-        sendDetectionMessage();
+    // Count each time the sensor went triggered since we last looked
+    uint32_t now = millis();
+    GpioEdgeQueue::Edge e;
+    uint32_t settleMsec;
+    while (edges.take(e, now, settleMsec)) {
+        bool t = isTriggered(e.value);
+        if (t && !triggered)
+            pendingDetections++;
+        triggered = t;
+    }
+    if (!settleMsec && hasDetectionEvent() != triggered) {
+        // Its interrupt missed one (or the pin has none)
+        triggered = !triggered;
+        if (triggered)
+            pendingDetections++;
+    }
+
+    uint32_t sinceSent = now - lastSentToMesh;
+    uint32_t minimumMs = getConfiguredOrDefaultMs(moduleConfig.detection_sensor.minimum_broadcast_secs);
+    if (sinceSent >= minimumMs && (pendingDetections || triggered)) {
+        sendDetectionMessage(pendingDetections ? pendingDetections : 1);
+        pendingDetections = 0;
         return DELAYED_INTERVAL;
     }
     // Even if we haven't detected an event, broadcast our current state to the mesh on the scheduled interval as a sort
     // of heartbeat. We only do this if the minimum broadcast interval is greater than zero, otherwise we'll only broadcast state
     // change detections.
-    else if (moduleConfig.detection_sensor.state_broadcast_secs > 0 &&
-             (millis() - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.detection_sensor.state_broadcast_secs)) {
+    uint32_t stateMs = getConfiguredOrDefaultMs(moduleConfig.detection_sensor.state_broadcast_secs);
+    if (moduleConfig.detection_sensor.state_broadcast_secs > 0 && sinceSent >= stateMs) {
         sendCurrentStateMessage();
         return DELAYED_INTERVAL;
     }
-    return GPIO_POLLING_INTERVAL;
+
+    // Sleep till the next edge, or whatever's due before it (but not so long a missed edge goes unnoticed)
+    uint32_t wait = polling ? DELAYED_INTERVAL : DETECTION_POLL_MSEC;
+    if (pendingDetections || triggered)
+        wait = std::min(wait, minimumMs - sinceSent);
+    else if (moduleConfig.detection_sensor.state_broadcast_secs > 0)
+        wait = std::min(wait, stateMs - sinceSent);
+    if (settleMsec && settleMsec < wait)
+        wait = settleMsec;
+    return wait;
 }
 
-void DetectionSensorModule::sendDetectionMessage()
+void DetectionSensorModule::sendDetectionMessage(uint32_t count)
 {
     LOG_DEBUG("Detected event observed. Sending message\n");
-    char *message = new char[40];
-    sprintf(message, "%s detected", moduleConfig.detection_sensor.name);
+    char *message = new char[48];
+    if (count > 1)
+        snprintf(message, 48, "%s detected %u times", moduleConfig.detection_sensor.name, count);
+    else
+        snprintf(message, 48, "%s detected", moduleConfig.detection_sensor.name);
     meshtastic_MeshPacket *p = allocDataPacket();
     p->want_ack = false;
     p->decoded.payload.size = strlen(message);
@@ -104,5 +156,10 @@ bool DetectionSensorModule::hasDetectionEvent()
 {
     bool currentState = digitalRead(moduleConfig.detection_sensor.monitor_pin);
     // LOG_DEBUG("Detection Sensor Module: Current state: %i\n", currentState);
-    return moduleConfig.detection_sensor.detection_triggered_high ? currentState : !currentState;
+    return isTriggered(currentState);
+}
+
+bool DetectionSensorModule::isTriggered(bool pinState) const
+{
+    return moduleConfig.detection_sensor.detection_triggered_high ? pinState : !pinState;
 }
\ No newline at end of file
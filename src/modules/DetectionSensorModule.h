@@ -1,4 +1,5 @@
 #pragma once
+#include "GpioEdgeQueue.h"
 #include "SinglePortModule.h"
 
 class DetectionSensorModule : public SinglePortModule, private concurrency::OSThread
@@ -7,6 +8,7 @@ class DetectionSensorModule : public SinglePortModule, private concurrency::OSTh
     DetectionSensorModule()
         : SinglePortModule("detection", meshtastic_PortNum_DETECTION_SENSOR_APP), OSThread("DetectionSensorModule")
     {
+        setWakeSource(true); // our pin-change interrupt
     }
 
   protected:
@@ -15,7 +17,21 @@ class DetectionSensorModule : public SinglePortModule, private concurrency::OSTh
   private:
     bool firstTime = true;
     uint32_t lastSentToMesh = 0;
-    void sendDetectionMessage();
+
+    /// monitor_pin has no interrupt, so we read it every DELAYED_INTERVAL instead
+    bool polling = false;
+
+    /// Edges our pin-change interrupt saw on monitor_pin
+    GpioEdgeQueue edges;
+
+    /// Whether the sensor was triggered as of its last edge, and how often it has been since we last told the mesh
+    bool triggered = false;
+    uint32_t pendingDetections = 0;
+
+    static void onEdge();
+    bool isTriggered(bool pinState) const;
+
+    void sendDetectionMessage(uint32_t count);
     void sendCurrentStateMessage();
     bool hasDetectionEvent();
 };
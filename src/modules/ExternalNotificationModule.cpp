@@ -18,11 +18,13 @@
 #include "NodeDB.h"
 #include "RTC.h"
 #include "Router.h"
+#include "buzz/RtttlPlayer.h"
 #include "buzz/buzz.h"
 #include "configuration.h"
 #include "main.h"
 #include "mesh/generated/meshtastic/rtttl.pb.h"
 #include <Arduino.h>
+#include <algorithm>
 
 #ifdef HAS_NCP5623
 #include <graphics/RAKled.h>
@@ -73,9 +75,9 @@ int32_t ExternalNotificationModule::runOnce()
         return INT32_MAX; // we don't need this thread here...
     } else {
 
-        bool isPlaying = rtttl::isPlaying();
+        bool isPlaying = rtttlPlayer.isPlaying();
 #ifdef HAS_I2S
-        isPlaying = rtttl::isPlaying() || audioThread->isPlaying();
+        isPlaying = rtttlPlayer.isPlaying() || audioThread->isPlaying();
 #endif
         if ((nagCycleCutoff < millis()) && !isPlaying) {
             // let the song finish if we reach timeout
@@ -91,25 +93,22 @@ int32_t ExternalNotificationModule::runOnce()
             return INT32_MAX; // save cycles till we're needed again
         }
 
+        // We're next needed when the soonest of the outputs, the song and the nag cutoff says, so sleep till then
+        uint32_t wait = INT32_MAX;
+
         // If the output is turned on, turn it back off after the given period of time.
         if (isNagging) {
-            if (externalTurnedOn[0] + (moduleConfig.external_notification.output_ms ? moduleConfig.external_notification.output_ms
-                                                                                    : EXT_NOTIFICATION_MODULE_OUTPUT_MS) <
-                millis()) {
-                getExternal(0) ? setExternalOff(0) : setExternalOn(0);
-            }
-            if (externalTurnedOn[1] + (moduleConfig.external_notification.output_ms ? moduleConfig.external_notification.output_ms
-                                                                                    : EXT_NOTIFICATION_MODULE_OUTPUT_MS) <
-                millis()) {
-                getExternal(1) ? setExternalOff(1) : setExternalOn(1);
-            }
-            if (externalTurnedOn[2] + (moduleConfig.external_notification.output_ms ? moduleConfig.external_notification.output_ms
-                                                                                    : EXT_NOTIFICATION_MODULE_OUTPUT_MS) <
-                millis()) {
-                getExternal(2) ? setExternalOff(2) : setExternalOn(2);
+            uint32_t outputMs = moduleConfig.external_notification.output_ms ? moduleConfig.external_notification.output_ms
+                                                                             : EXT_NOTIFICATION_MODULE_OUTPUT_MS;
+            for (uint8_t i = 0; i < 3; i++) {
+                if (externalTurnedOn[i] + outputMs < millis()) {
+                    getExternal(i) ? setExternalOff(i) : setExternalOn(i);
+                }
+                wait = std::min<uint32_t>(wait, externalTurnedOn[i] + outputMs + 1 - millis());
             }
 #ifdef HAS_NCP5623
             if (rgb_found.type == ScanI2C::NCP5623) {
+                wait = std::min<uint32_t>(wait, EXT_NOTIFICATION_DEFAULT_THREAD_MS); // fading needs us every step
                 red = (colorState & 4) ? brightnessValues[brightnessIndex] : 0;          // Red enabled on colorState = 4,5,6,7
                 green = (colorState & 2) ? brightnessValues[brightnessIndex] : 0;        // Green enabled on colorState = 2,3,6,7
                 blue = (colorState & 1) ? (brightnessValues[brightnessIndex] * 1.5) : 0; // Blue enabled on colorState = 1,3,5,7
@@ -135,12 +134,14 @@ int32_t ExternalNotificationModule::runOnce()
 
 #ifdef T_WATCH_S3
             drv.go();
+            wait = std::min<uint32_t>(wait, EXT_NOTIFICATION_DEFAULT_THREAD_MS);
 #endif
         }
 
         // Play RTTTL over i2s audio interface if enabled as buzzer
 #ifdef HAS_I2S
         if (moduleConfig.external_notification.use_i2s_as_buzzer) {
+            wait = std::min<uint32_t>(wait, EXT_NOTIFICATION_DEFAULT_THREAD_MS);
             if (audioThread->isPlaying()) {
                 // Continue playing
             } else if (isNagging && (nagCycleCutoff >= millis())) {
@@ -148,17 +149,26 @@ int32_t ExternalNotificationModule::runOnce()
             }
         }
 #endif
-        // now let the PWM buzzer play
+        // now let the PWM buzzer play, which needs us only as often as it says
         if (moduleConfig.external_notification.use_pwm) {
-            if (rtttl::isPlaying()) {
-                rtttl::play();
-            } else if (isNagging && (nagCycleCutoff >= millis())) {
+            uint32_t msec = rtttlPlayer.service();
+            if (!msec && isNagging && (nagCycleCutoff >= millis())) {
                 // start the song again if we have time left
-                rtttl::begin(config.device.buzzer_gpio, rtttlConfig.ringtone);
+                rtttlPlayer.play(config.device.buzzer_gpio, rtttlConfig.ringtone);
+                msec = rtttlPlayer.service();
             }
+            if (msec)
+                wait = std::min(wait, msec);
         }
 
-        return EXT_NOTIFICATION_DEFAULT_THREAD_MS;
+        if (nagCycleCutoff != UINT32_MAX) {
+            if (nagCycleCutoff >= millis())
+                wait = std::min<uint32_t>(wait, nagCycleCutoff - millis() + 1);
+            else if (!rtttlPlayer.isPlaying())
+                wait = std::min<uint32_t>(wait, EXT_NOTIFICATION_DEFAULT_THREAD_MS);
+        }
+
+        return wait;
     }
 }
 
@@ -167,6 +177,11 @@ bool ExternalNotificationModule::wantPacket(const meshtastic_MeshPacket *p)
     return MeshService::isTextPayload(p);
 }
 
+void ExternalNotificationModule::getPortNums(std::vector<meshtastic_PortNum> &ports)
+{
+    MeshService::getTextPayloadPortNums(ports);
+}
+
 /**
  * Sets the external notification on for the specified index.
  *
@@ -242,7 +257,7 @@ bool ExternalNotificationModule::getExternal(uint8_t index)
 
 void ExternalNotificationModule::stopNow()
 {
-    rtttl::stop();
+    rtttlPlayer.stop();
 #ifdef HAS_I2S
     audioThread->stop();
 #endif
@@ -389,7 +404,7 @@ ProcessMessage ExternalNotificationModule::handleReceived(const meshtastic_MeshP
 #ifdef HAS_I2S
                         audioThread->beginRttl(rtttlConfig.ringtone, strlen_P(rtttlConfig.ringtone));
 #else
-                        rtttl::begin(config.device.buzzer_gpio, rtttlConfig.ringtone);
+                        rtttlPlayer.play(config.device.buzzer_gpio, rtttlConfig.ringtone);
 #endif
                     }
                     if (moduleConfig.external_notification.nag_timeout) {
@@ -433,7 +448,7 @@ ProcessMessage ExternalNotificationModule::handleReceived(const meshtastic_MeshP
                         audioThread->beginRttl(rtttlConfig.ringtone, strlen_P(rtttlConfig.ringtone));
                     }
 #else
-                    rtttl::begin(config.device.buzzer_gpio, rtttlConfig.ringtone);
+                    rtttlPlayer.play(config.device.buzzer_gpio, rtttlConfig.ringtone);
 #endif
                 }
                 if (moduleConfig.external_notification.nag_timeout) {
@@ -1,23 +1,9 @@
 #pragma once
 
 #include "SinglePortModule.h"
+#include "buzz/RtttlPlayer.h"
 #include "concurrency/OSThread.h"
 #include "configuration.h"
-#if !defined(ARCH_PORTDUINO) && !defined(ARCH_STM32WL)
-#include <NonBlockingRtttl.h>
-#else
-// Noop class for portduino.
-class rtttl
-{
-  public:
-    explicit rtttl() {}
-    static bool isPlaying() { return false; }
-    static void play() {}
-    static void begin(byte a, const char *b){};
-    static void stop() {}
-    static bool done() { return true; }
-};
-#endif
 #include <Arduino.h>
 #include <functional>
 
@@ -53,9 +39,13 @@ class ExternalNotificationModule : public SinglePortModule, private concurrency:
     virtual int32_t runOnce() override;
 
     virtual bool wantPacket(const meshtastic_MeshPacket *p) override;
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override;
 
     bool isNagging = false;
 
+    /// Plays the ringtone on a PWM buzzer without our polling it
+    RtttlPlayer rtttlPlayer;
+
     virtual AdminMessageHandleResult handleAdminMessageForModule(const meshtastic_MeshPacket &mp,
                                                                  meshtastic_AdminMessage *request,
                                                                  meshtastic_AdminMessage *response) override;
@@ -0,0 +1,605 @@
+#include "FirmwareUpdateModule.h"
+#include "Channels.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "airtime.h"
+#include "configuration.h"
+#include "main.h"
+#include <ErriezCRC32.h>
+#ifdef ARCH_ESP32
+#include "platform/esp32/BleOta.h"
+#endif
+
+FirmwareUpdateModule *firmwareUpdateModule;
+
+#if USE_MESH_FIRMWARE_UPDATE
+
+#ifdef ARCH_PORTDUINO
+const char *firmwareDistributeFile, *firmwareDistributeVersion;
+int firmwareDistributeHwModel;
+uint8_t firmwareDistributeFlags;
+#endif
+
+/*
+ * On the wire each packet starts with a type byte, then (multi byte values little endian)
+ *  offer: session (4), hardware model (2), image size (4), image crc32 (4), flags (1), version (NUL terminated)
+ *  chunk: session (4), index (2), then FIRMWARE_CHUNK_LEN bytes of image (fewer for the last chunk)
+ *  need:  session (4), index of the first chunk (2), bitmap of which of it and the FIRMWARE_NEED_CHUNKS - 1 after we lack
+ */
+#define FIRMWARE_TYPE_OFFER 1
+#define FIRMWARE_TYPE_CHUNK 2
+#define FIRMWARE_TYPE_NEED 3
+#define FIRMWARE_OFFER_HEADER_LEN 16
+#define FIRMWARE_CHUNK_HEADER_LEN 7
+#define FIRMWARE_NEED_CHUNKS 256
+#define FIRMWARE_NEED_LEN (7 + FIRMWARE_NEED_CHUNKS / 8)
+
+/// In an offer's flags: every chunk has been sent, so those missing any should ask for them
+#define FIRMWARE_OFFER_REPAIR 0x80
+
+/// How long we back off while airtime limits (or a full TX queue) say we shouldn't send
+#define FIRMWARE_BUSY_MSEC (10 * 1000)
+
+/// Between booting into a new image being set up and our reboot, so what we logged about it gets out
+#define FIRMWARE_REBOOT_DELAY_MSEC (5 * 1000)
+
+static const char *stagedFileName = "/firmware.bin";
+static const char *partialFileName = "/firmware.part";
+
+static void put16(uint8_t *b, uint16_t v)
+{
+    b[0] = v & 0xff;
+    b[1] = v >> 8;
+}
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        b[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint16_t get16(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+FirmwareUpdateModule::FirmwareUpdateModule()
+    : SinglePortModule("firmware", FIRMWARE_UPDATE_PORTNUM), concurrency::OSThread("FirmwareUpdate")
+{
+    boundChannel = Channels::adminChannel; // a firmware image is as trusted as (and only as) an admin message
+    disable();                             // until we have something to send or receive
+}
+
+int FirmwareUpdateModule::findAdminChannel()
+{
+    for (ChannelIndex i = 0; i < channels.getNumChannels(); i++) {
+        meshtastic_Channel &ch = channels.getByIndex(i);
+        if (ch.role != meshtastic_Channel_Role_DISABLED && strcasecmp(ch.settings.name, Channels::adminChannel) == 0)
+            return i;
+    }
+    return -1;
+}
+
+bool FirmwareUpdateModule::isTxAllowed()
+{
+    return airTime->isTxAllowedChannelUtil(true) && airTime->isTxAllowedAirUtil() && router->getQueueStatus().free >= 2;
+}
+
+bool FirmwareUpdateModule::startDistribution(const char *fileName, meshtastic_HardwareModel hwModel, const char *version,
+                                             uint8_t flags)
+{
+    if (dist.active) {
+        LOG_WARN("Already distributing firmware %s\n", dist.offer.version);
+        return false;
+    }
+    int channel = findAdminChannel();
+    if (channel < 0) {
+        LOG_ERROR("Can't distribute firmware without an admin channel\n");
+        return false;
+    }
+
+    dist = Distribution();
+#ifdef ARCH_PORTDUINO
+    dist.image = fopen(fileName, "rb");
+    long size = -1;
+    if (dist.image && fseek(dist.image, 0, SEEK_END) == 0)
+        size = ftell(dist.image);
+#else
+    dist.image = FSCom.open(fileName, FILE_O_READ);
+    long size = dist.image ? (long)dist.image.size() : -1;
+#endif
+    if (size <= 0 || size > (long)FIRMWARE_MAX_CHUNKS * FIRMWARE_CHUNK_LEN) {
+        LOG_ERROR("Can't distribute %s, it's missing, empty or more than %u bytes\n", fileName,
+                  FIRMWARE_MAX_CHUNKS * FIRMWARE_CHUNK_LEN);
+        endDistribution();
+        return false;
+    }
+
+    Offer &o = dist.offer;
+    o.session = random();
+    o.hwModel = hwModel;
+    o.size = size;
+    o.flags = flags & (FIRMWARE_FLAG_DELTA | FIRMWARE_FLAG_COMPRESSED);
+    strncpy(o.version, version, sizeof(o.version) - 1);
+    o.version[sizeof(o.version) - 1] = '\0';
+
+    uint32_t crc = 0xffffffff;
+    uint8_t buf[FIRMWARE_CHUNK_LEN];
+    for (uint32_t offset = 0; offset < o.size; offset += sizeof(buf)) {
+        size_t len = min((size_t)(o.size - offset), sizeof(buf));
+        if (!readImage(offset, buf, len)) {
+            LOG_ERROR("Can't read %s\n", fileName);
+            endDistribution();
+            return false;
+        }
+        crc = crc32Update(buf, len, crc);
+    }
+    o.crc = crc32Final(crc);
+
+    dist.active = true;
+    dist.channel = channel;
+    dist.pending.assign((o.getNumChunks() + 7) / 8, 0xff);
+    LOG_INFO("Distributing firmware %s for hardware model %d: %s, %u bytes in %u chunks, crc %08x\n", o.version, hwModel,
+             fileName, o.size, o.getNumChunks(), o.crc);
+
+    sendOffer(false);
+    enabled = true;
+    setIntervalFromNow(FIRMWARE_CHUNK_GAP_MSEC);
+    return true;
+}
+
+bool FirmwareUpdateModule::readImage(uint32_t offset, uint8_t *buf, size_t len)
+{
+#ifdef ARCH_PORTDUINO
+    return dist.image && fseek(dist.image, offset, SEEK_SET) == 0 && fread(buf, 1, len, dist.image) == len;
+#else
+    return dist.image && dist.image.seek(offset) && dist.image.read(buf, len) == len;
+#endif
+}
+
+void FirmwareUpdateModule::endDistribution()
+{
+#ifdef ARCH_PORTDUINO
+    if (dist.image)
+        fclose(dist.image);
+#else
+    if (dist.image)
+        dist.image.close();
+#endif
+    dist = Distribution();
+}
+
+void FirmwareUpdateModule::sendOffer(bool repair)
+{
+    const Offer &o = dist.offer;
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = NODENUM_BROADCAST;
+    p->channel = dist.channel;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = FIRMWARE_TYPE_OFFER;
+    put32(b + 1, o.session);
+    put16(b + 5, o.hwModel);
+    put32(b + 7, o.size);
+    put32(b + 11, o.crc);
+    b[15] = o.flags | (repair ? FIRMWARE_OFFER_REPAIR : 0);
+    size_t versionLen = strlen(o.version) + 1;
+    memcpy(b + FIRMWARE_OFFER_HEADER_LEN, o.version, versionLen);
+    p->decoded.payload.size = FIRMWARE_OFFER_HEADER_LEN + versionLen;
+
+    dist.lastOfferMsec = millis();
+    service.sendToMesh(p);
+}
+
+void FirmwareUpdateModule::sendChunk(uint16_t index)
+{
+    uint32_t offset = index * FIRMWARE_CHUNK_LEN;
+    size_t len = min((size_t)(dist.offer.size - offset), (size_t)FIRMWARE_CHUNK_LEN);
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    uint8_t *b = p->decoded.payload.bytes;
+    if (!readImage(offset, b + FIRMWARE_CHUNK_HEADER_LEN, len)) {
+        LOG_ERROR("Can't read firmware chunk %u, giving up distributing it\n", index);
+        packetPool.release(p);
+        endDistribution();
+        return;
+    }
+    p->to = NODENUM_BROADCAST;
+    p->channel = dist.channel;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND; // bulk data shouldn't hold up anyone's chatter
+
+    b[0] = FIRMWARE_TYPE_CHUNK;
+    put32(b + 1, dist.offer.session);
+    put16(b + 5, index);
+    p->decoded.payload.size = FIRMWARE_CHUNK_HEADER_LEN + len;
+
+    service.sendToMesh(p);
+}
+
+void FirmwareUpdateModule::sendNeed()
+{
+    uint16_t numChunks = rx.offer.getNumChunks();
+    uint16_t first = 0;
+    while (first < numChunks && testBit(rx.received, first))
+        first++;
+    if (first == numChunks)
+        return;
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = rx.from;
+    p->channel = rx.channel;
+
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = FIRMWARE_TYPE_NEED;
+    put32(b + 1, rx.offer.session);
+    put16(b + 5, first);
+    memset(b + 7, 0, FIRMWARE_NEED_CHUNKS / 8);
+    uint16_t missing = 0;
+    for (uint16_t i = 0; i < FIRMWARE_NEED_CHUNKS && first + i < numChunks; i++)
+        if (!testBit(rx.received, first + i)) {
+            b[7 + i / 8] |= 1 << (i % 8);
+            missing++;
+        }
+    p->decoded.payload.size = FIRMWARE_NEED_LEN;
+
+    LOG_INFO("Asking 0x%x for %u missing firmware chunks from %u (%u of %u received)\n", rx.from, missing, first,
+             rx.numReceived, numChunks);
+    service.sendToMesh(p);
+}
+
+ProcessMessage FirmwareUpdateModule::handleReceived(const meshtastic_MeshPacket &mp)
+{
+    const uint8_t *b = mp.decoded.payload.bytes;
+    size_t len = mp.decoded.payload.size;
+
+    if (len > 0 && b[0] == FIRMWARE_TYPE_OFFER)
+        handleOffer(mp, b, len);
+    else if (len > 0 && b[0] == FIRMWARE_TYPE_CHUNK)
+        handleChunk(mp, b, len);
+    else if (len > 0 && b[0] == FIRMWARE_TYPE_NEED)
+        handleNeed(mp, b, len);
+    else
+        LOG_WARN("Ignoring malformed firmware packet from 0x%x\n", mp.from);
+
+    return ProcessMessage::STOP;
+}
+
+void FirmwareUpdateModule::handleOffer(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (len <= FIRMWARE_OFFER_HEADER_LEN || b[len - 1] != '\0')
+        return;
+
+    Offer o;
+    o.session = get32(b + 1);
+    o.hwModel = (meshtastic_HardwareModel)get16(b + 5);
+    o.size = get32(b + 7);
+    o.crc = get32(b + 11);
+    o.flags = b[15] & ~FIRMWARE_OFFER_REPAIR;
+    strncpy(o.version, (const char *)b + FIRMWARE_OFFER_HEADER_LEN, sizeof(o.version) - 1);
+    o.version[sizeof(o.version) - 1] = '\0';
+    bool repair = b[15] & FIRMWARE_OFFER_REPAIR;
+
+    if (o.session == doneSession)
+        return;
+
+    if (rx.sink != SINK_NONE) {
+        if (o.session != rx.offer.session || mp.from != rx.from)
+            return; // we are busy with another
+        rx.lastRxMsec = millis();
+        if (repair && !rx.needDue) {
+            // At a random time in the first half of the distributor's wait, so we don't all answer at once
+            rx.needDue = true;
+            rx.needAtMsec = millis() + random(1000, FIRMWARE_OFFER_SECS * 1000 / 2);
+            setIntervalFromNow(0);
+        }
+        return;
+    }
+
+    if (o.hwModel != owner.hw_model)
+        return;
+    if (strcmp(o.version, optstr(APP_VERSION)) == 0) {
+        LOG_DEBUG("Already running firmware %s offered by 0x%x\n", o.version, mp.from);
+        doneSession = o.session;
+        return;
+    }
+    if (startReception(mp, o) && repair) {
+        // We have come in at the end, so might as well ask now
+        rx.needDue = true;
+        rx.needAtMsec = millis() + random(1000, FIRMWARE_OFFER_SECS * 1000 / 2);
+    }
+}
+
+bool FirmwareUpdateModule::startReception(const meshtastic_MeshPacket &mp, const Offer &o)
+{
+    if (o.size == 0 || o.size > (uint32_t)FIRMWARE_MAX_CHUNKS * FIRMWARE_CHUNK_LEN) {
+        LOG_WARN("Refusing firmware %s from 0x%x, its size (%u bytes) is out of bounds\n", o.version, mp.from, o.size);
+        doneSession = o.session;
+        return false;
+    }
+
+    rx = Reception();
+    rx.offer = o;
+    rx.from = mp.from;
+    rx.channel = mp.channel;
+    rx.received.assign((o.getNumChunks() + 7) / 8, 0);
+    rx.lastRxMsec = millis();
+
+#ifdef ARCH_ESP32
+    // A whole image can go straight where it will run from, so long as that's not where the BLE OTA app lives
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (!(o.flags & (FIRMWARE_FLAG_DELTA | FIRMWARE_FLAG_COMPRESSED)) && part && part->size >= o.size &&
+        part != BleOta::findEspOtaAppPartition()) {
+        LOG_INFO("Erasing partition %s for firmware %s\n", part->label, o.version);
+        if (esp_ota_begin(part, o.size, &rx.otaHandle) == ESP_OK) {
+            rx.sink = SINK_OTA;
+            rx.otaPartition = part;
+        }
+    }
+#endif
+#ifdef FSCom
+    if (rx.sink == SINK_NONE) {
+        FSCom.remove(partialFileName);
+        rx.file = FSCom.open(partialFileName, FILE_O_WRITE);
+        if (rx.file)
+            rx.sink = SINK_FILE;
+    }
+#endif
+
+    if (rx.sink == SINK_NONE) {
+        LOG_WARN("Nowhere to put firmware %s from 0x%x, refusing it\n", o.version, mp.from);
+        rx = Reception();
+        doneSession = o.session;
+        return false;
+    }
+
+    LOG_INFO("Receiving firmware %s (%u bytes%s%s) from 0x%x into %s\n", o.version, o.size,
+             (o.flags & FIRMWARE_FLAG_DELTA) ? ", delta" : "", (o.flags & FIRMWARE_FLAG_COMPRESSED) ? ", compressed" : "",
+             mp.from, rx.sink == SINK_OTA ? "our OTA partition" : partialFileName);
+    enabled = true; // so runOnce can time it out, and ask for what we miss
+    setIntervalFromNow(0);
+    return true;
+}
+
+void FirmwareUpdateModule::handleChunk(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (rx.sink == SINK_NONE || len <= FIRMWARE_CHUNK_HEADER_LEN || get32(b + 1) != rx.offer.session || mp.from != rx.from)
+        return;
+
+    uint16_t numChunks = rx.offer.getNumChunks();
+    uint16_t index = get16(b + 5);
+    size_t dataLen = len - FIRMWARE_CHUNK_HEADER_LEN;
+    size_t expected = index == numChunks - 1 ? rx.offer.size - index * FIRMWARE_CHUNK_LEN : FIRMWARE_CHUNK_LEN;
+    if (index >= numChunks || dataLen != expected) {
+        LOG_WARN("Ignoring bad firmware chunk %u from 0x%x\n", index, mp.from);
+        return;
+    }
+
+    rx.lastRxMsec = millis();
+    if (testBit(rx.received, index))
+        return; // a repair for someone else
+
+    if (!writeImage(index * FIRMWARE_CHUNK_LEN, b + FIRMWARE_CHUNK_HEADER_LEN, dataLen)) {
+        LOG_ERROR("Writing firmware chunk %u failed, giving up on it\n", index);
+        doneSession = rx.offer.session;
+        abortReception();
+        return;
+    }
+    setBit(rx.received, index);
+    rx.numReceived++;
+
+    if (rx.numReceived % 256 == 0)
+        LOG_INFO("Firmware %s: %u of %u chunks received\n", rx.offer.version, rx.numReceived, numChunks);
+    if (rx.numReceived == numChunks)
+        finishReception();
+}
+
+void FirmwareUpdateModule::handleNeed(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (!dist.active || len < FIRMWARE_NEED_LEN || mp.to != nodeDB.getNodeNum() || get32(b + 1) != dist.offer.session)
+        return;
+
+    uint16_t numChunks = dist.offer.getNumChunks();
+    uint16_t first = get16(b + 5);
+    uint16_t added = 0;
+    for (uint16_t i = 0; i < FIRMWARE_NEED_CHUNKS && first + i < numChunks; i++)
+        if ((b[7 + i / 8] & (1 << (i % 8))) && !testBit(dist.pending, first + i)) {
+            setBit(dist.pending, first + i);
+            added++;
+        }
+
+    LOG_INFO("0x%x is missing firmware chunks from %u, %u more to send again\n", mp.from, first, added);
+    if (added && dist.awaitingNeeds)
+        setIntervalFromNow(0);
+}
+
+bool FirmwareUpdateModule::writeImage(uint32_t offset, const uint8_t *data, size_t len)
+{
+    switch (rx.sink) {
+#ifdef ARCH_ESP32
+    case SINK_OTA:
+        return esp_ota_write_with_offset(rx.otaHandle, data, len, offset) == ESP_OK;
+#endif
+    case SINK_FILE:
+        return rx.file.seek(offset) && rx.file.write(data, len) == len;
+    default:
+        return false;
+    }
+}
+
+bool FirmwareUpdateModule::crcImage(uint32_t &crc)
+{
+    crc = 0xffffffff;
+    uint8_t buf[256];
+    bool ok = true;
+
+#ifdef FSCom
+    File f;
+    if (rx.sink == SINK_FILE) {
+        rx.file.close();
+        f = FSCom.open(partialFileName, FILE_O_READ);
+        ok = (bool)f;
+    }
+#endif
+
+    for (uint32_t offset = 0; ok && offset < rx.offer.size; offset += sizeof(buf)) {
+        size_t len = min((size_t)(rx.offer.size - offset), sizeof(buf));
+#ifdef ARCH_ESP32
+        if (rx.sink == SINK_OTA)
+            ok = esp_partition_read(rx.otaPartition, offset, buf, len) == ESP_OK;
+#endif
+#ifdef FSCom
+        if (rx.sink == SINK_FILE)
+            ok = f.read(buf, len) == len;
+#endif
+        crc = crc32Update(buf, len, crc);
+    }
+    crc = crc32Final(crc);
+
+#ifdef FSCom
+    if (f)
+        f.close();
+#endif
+    return ok;
+}
+
+void FirmwareUpdateModule::finishReception()
+{
+    const Offer &o = rx.offer;
+    doneSession = o.session;
+
+    uint32_t crc;
+    if (!crcImage(crc) || crc != o.crc) {
+        LOG_ERROR("Firmware %s from 0x%x has crc %08x, not %08x, throwing it away\n", o.version, rx.from, crc, o.crc);
+        abortReception();
+        return;
+    }
+
+#ifdef ARCH_ESP32
+    if (rx.sink == SINK_OTA) {
+        rx.sink = SINK_NONE; // esp_ota_end() frees our handle, whatever it says
+        if (esp_ota_end(rx.otaHandle) == ESP_OK && esp_ota_set_boot_partition(rx.otaPartition) == ESP_OK) {
+            LOG_INFO("Firmware %s written to partition %s, rebooting into it\n", o.version, rx.otaPartition->label);
+            rebootAtMsec = millis() + FIRMWARE_REBOOT_DELAY_MSEC;
+        } else {
+            LOG_ERROR("Firmware %s isn't an app we can boot, not switching to it\n", o.version);
+        }
+        rx = Reception();
+        return;
+    }
+#endif
+
+#ifdef FSCom
+    // crcImage() closed our file
+    FSCom.remove(stagedFileName);
+    if (renameFile(partialFileName, stagedFileName))
+        LOG_INFO("Firmware %s (%u bytes%s%s) staged as %s for the updater\n", o.version, o.size,
+                 (o.flags & FIRMWARE_FLAG_DELTA) ? ", delta" : "", (o.flags & FIRMWARE_FLAG_COMPRESSED) ? ", compressed" : "",
+                 stagedFileName);
+    else
+        LOG_ERROR("Can't move firmware %s to %s\n", o.version, stagedFileName);
+#endif
+    rx = Reception();
+}
+
+void FirmwareUpdateModule::abortReception()
+{
+#ifdef ARCH_ESP32
+    if (rx.sink == SINK_OTA)
+        esp_ota_abort(rx.otaHandle);
+#endif
+#ifdef FSCom
+    if (rx.sink == SINK_FILE) {
+        if (rx.file)
+            rx.file.close();
+        FSCom.remove(partialFileName);
+    }
+#endif
+    rx = Reception();
+}
+
+int32_t FirmwareUpdateModule::findPending()
+{
+    uint16_t numChunks = dist.offer.getNumChunks();
+    for (uint16_t n = 0; n < numChunks; n++) {
+        uint16_t i = (dist.next + n) % numChunks;
+        if (testBit(dist.pending, i))
+            return i;
+    }
+    return -1;
+}
+
+int32_t FirmwareUpdateModule::runDistributor()
+{
+    if (!dist.active)
+        return INT32_MAX;
+
+    uint32_t sinceOffer = millis() - dist.lastOfferMsec;
+    int32_t chunk = findPending();
+    if (chunk < 0) {
+        if (dist.awaitingNeeds) {
+            if (sinceOffer < FIRMWARE_OFFER_SECS * 1000)
+                return FIRMWARE_OFFER_SECS * 1000 - sinceOffer;
+            LOG_INFO("Nobody is missing any of firmware %s, done distributing it\n", dist.offer.version);
+            endDistribution();
+            return INT32_MAX;
+        }
+        // Everyone has had every chunk since the last time we asked, so ask who is still missing some
+        if (!isTxAllowed())
+            return FIRMWARE_BUSY_MSEC;
+        sendOffer(true);
+        dist.awaitingNeeds = true;
+        return FIRMWARE_OFFER_SECS * 1000;
+    }
+
+    dist.awaitingNeeds = false;
+    if (!isTxAllowed())
+        return FIRMWARE_BUSY_MSEC;
+
+    // Now and then, for those who have only just come in range (or booted)
+    if (sinceOffer >= FIRMWARE_OFFER_SECS * 1000) {
+        sendOffer(false);
+        return FIRMWARE_CHUNK_GAP_MSEC;
+    }
+
+    clearBit(dist.pending, chunk);
+    dist.next = chunk + 1;
+    sendChunk(chunk);
+    return FIRMWARE_CHUNK_GAP_MSEC;
+}
+
+int32_t FirmwareUpdateModule::runOnce()
+{
+    int32_t delay = runDistributor();
+
+    if (rx.sink != SINK_NONE) {
+        uint32_t now = millis();
+        uint32_t idle = now - rx.lastRxMsec;
+        if (idle >= FIRMWARE_RX_TIMEOUT_SECS * 1000) {
+            LOG_WARN("Heard nothing of firmware %s for %us, giving up on it\n", rx.offer.version, FIRMWARE_RX_TIMEOUT_SECS);
+            abortReception();
+        } else {
+            delay = min(delay, (int32_t)(FIRMWARE_RX_TIMEOUT_SECS * 1000 - idle));
+            if (rx.needDue) {
+                int32_t until = (int32_t)(rx.needAtMsec - now);
+                if (until <= 0) {
+                    rx.needDue = false;
+                    sendNeed();
+                } else {
+                    delay = min(delay, until);
+                }
+            }
+        }
+    }
+
+    if (delay == INT32_MAX)
+        return disable();
+    return delay;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#pragma once
+#include "FSCommon.h"
+#include "SinglePortModule.h"
+#include "concurrency/OSThread.h"
+#include <stdio.h>
+#include <vector>
+#ifdef ARCH_ESP32
+#include <esp_ota_ops.h>
+#endif
+
+/// Until there is an official portnum for it, firmware images travel on this one from the private range
+#define FIRMWARE_UPDATE_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 20))
+
+/// Image bytes in each chunk, leaves room for our header and the Data encoding in one LoRa frame
+#define FIRMWARE_CHUNK_LEN 192
+
+/// Most chunks in one image (we keep a bit for each), so the largest image is FIRMWARE_MAX_CHUNKS * FIRMWARE_CHUNK_LEN
+#ifndef FIRMWARE_MAX_CHUNKS
+#define FIRMWARE_MAX_CHUNKS 16384
+#endif
+
+/// Between the chunks a distributor sends, while the channel is quiet enough for them at all
+#ifndef FIRMWARE_CHUNK_GAP_MSEC
+#define FIRMWARE_CHUNK_GAP_MSEC (3 * 1000)
+#endif
+
+/// How often a distributor offers its image, and how long after its last chunk it waits for repair requests
+#ifndef FIRMWARE_OFFER_SECS
+#define FIRMWARE_OFFER_SECS (2 * 60)
+#endif
+
+/// A receiver which hears nothing of its image for this long gives up on it
+#ifndef FIRMWARE_RX_TIMEOUT_SECS
+#define FIRMWARE_RX_TIMEOUT_SECS (30 * 60)
+#endif
+
+/// The image is a binary diff against the firmware it replaces, rather than the whole of the new one
+#define FIRMWARE_FLAG_DELTA 0x01
+/// The image is compressed
+#define FIRMWARE_FLAG_COMPRESSED 0x02
+
+/**
+ * Firmware distribution over the mesh, so a fleet of routers on hilltops can be updated from one gateway in the background,
+ * rather than one truck roll (or BLE OTA session) at a time.
+ *
+ * A distributor broadcasts an offer (the hardware model the image is for, the version it brings, its size and CRC) and then
+ * every chunk of the image once, on the admin channel only, one every FIRMWARE_CHUNK_GAP_MSEC and only while AirTime says
+ * the channel is quiet enough for polite traffic.  So all the nodes of that model take the image from the same broadcasts.
+ * Each receiver writes the chunks straight to where the image is going as they arrive, and keeps a bitmap of what it has.
+ * After the last chunk the distributor offers again, and any receiver still missing chunks answers (after a random delay,
+ * so they don't all answer at once) with a bitmap of up to 256 of them.  The distributor sends those again, for everyone,
+ * and stops once an offer goes unanswered.
+ *
+ * Where the image goes: on ESP32 a whole (uncompressed, not delta) image goes straight into the app partition we would
+ * update, provided it's big enough and isn't the one holding the BLE OTA app, and once its CRC checks out (and esp_ota_end()
+ * says it is a valid app) we boot it.  Anything else, delta and compressed images included, is staged as /firmware.bin for
+ * the updater which applies it.
+ */
+class FirmwareUpdateModule : public SinglePortModule, private concurrency::OSThread
+{
+  public:
+    FirmwareUpdateModule();
+
+    /**
+     * Start distributing the image in fileName (with flags FIRMWARE_FLAG_*) to every node of hwModel not already running
+     * version.  @return false (having logged why) if we can't: no admin channel, an unreadable or too big image, or we are
+     * distributing one already
+     */
+    bool startDistribution(const char *fileName, meshtastic_HardwareModel hwModel, const char *version, uint8_t flags);
+
+  protected:
+    virtual ProcessMessage handleReceived(const meshtastic_MeshPacket &mp) override;
+
+    virtual int32_t runOnce() override;
+
+  private:
+    /// What an offer says about its image
+    struct Offer {
+        uint32_t session; // picked at random by the distributor, for all the packets of one distribution
+        meshtastic_HardwareModel hwModel;
+        uint32_t size, crc;
+        uint8_t flags;
+        char version[18];
+
+        uint16_t getNumChunks() const { return (size + FIRMWARE_CHUNK_LEN - 1) / FIRMWARE_CHUNK_LEN; }
+    };
+
+    struct Distribution {
+        bool active = false;
+        Offer offer;
+        ChannelIndex channel = 0;
+#ifdef ARCH_PORTDUINO
+        FILE *image = NULL; // a file on the host, rather than in our filesystem
+#else
+        File image;
+#endif
+        std::vector<uint8_t> pending; // bitmap of the chunks we are yet to send (again)
+        uint16_t next = 0;            // where we look for the next pending chunk
+        uint32_t lastOfferMsec = 0;
+        bool awaitingNeeds = false; // we have sent every chunk, and offered again so those who missed some can say
+    };
+
+    /// Where a receiver writes the image
+    enum Sink { SINK_NONE, SINK_FILE, SINK_OTA };
+
+    struct Reception {
+        Sink sink = SINK_NONE;
+        Offer offer;
+        NodeNum from = 0; // the distributor
+        ChannelIndex channel = 0;
+        std::vector<uint8_t> received; // bitmap of the chunks we have
+        uint16_t numReceived = 0;
+        uint32_t lastRxMsec = 0;
+        bool needDue = false;    // we mean to ask for what we are missing...
+        uint32_t needAtMsec = 0; // ... at this time
+        File file;
+#ifdef ARCH_ESP32
+        esp_ota_handle_t otaHandle = 0;
+        const esp_partition_t *otaPartition = NULL;
+#endif
+    };
+
+    Distribution dist;
+    Reception rx;
+
+    /// The session of the last image we received in full (or refused), so we don't take it again as its offers repeat
+    uint32_t doneSession = 0;
+
+    /// @return the admin channel, or -1 if we don't have one
+    static int findAdminChannel();
+
+    static bool testBit(const std::vector<uint8_t> &bits, uint16_t i) { return bits[i / 8] & (1 << (i % 8)); }
+    static void setBit(std::vector<uint8_t> &bits, uint16_t i) { bits[i / 8] |= 1 << (i % 8); }
+    static void clearBit(std::vector<uint8_t> &bits, uint16_t i) { bits[i / 8] &= ~(1 << (i % 8)); }
+
+    /// @return if we may send a chunk (or offer) now, as far as channel utilization, our airtime and TX queue go
+    static bool isTxAllowed();
+
+    /// @return the next chunk we are yet to send, or -1 if there are none
+    int32_t findPending();
+
+    /// Read len bytes of the image we are distributing at offset
+    bool readImage(uint32_t offset, uint8_t *buf, size_t len);
+
+    /// repair asks those still missing chunks to say which
+    void sendOffer(bool repair);
+    void sendChunk(uint16_t index);
+    void sendNeed();
+
+    void handleOffer(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len);
+    void handleChunk(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len);
+    void handleNeed(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len);
+
+    /// Start taking the image offer describes, @return false if we have nowhere to put it
+    bool startReception(const meshtastic_MeshPacket &mp, const Offer &offer);
+
+    /// Write len bytes of the image at offset to our sink
+    bool writeImage(uint32_t offset, const uint8_t *data, size_t len);
+
+    /// Work out the crc32 of the image we have written, @return false if we couldn't read it back
+    bool crcImage(uint32_t &crc);
+
+    /// We have every chunk: check it and boot or stage it
+    void finishReception();
+
+    /// Give up on our reception, throwing away what we have written
+    void abortReception();
+
+    /// Send the next chunk or offer of our distribution.  @return msecs until we want to run again
+    int32_t runDistributor();
+    void endDistribution();
+};
+
+extern FirmwareUpdateModule *firmwareUpdateModule;
+
+#ifdef ARCH_PORTDUINO
+/// Set by the --distribute, --distribute-hw, --distribute-version and --distribute-delta command line options
+extern const char *firmwareDistributeFile, *firmwareDistributeVersion;
+extern int firmwareDistributeHwModel;
+extern uint8_t firmwareDistributeFlags;
+#endif
@@ -0,0 +1,320 @@
+#include "FragmentModule.h"
+#include "MeshService.h"
+#include "airtime.h"
+#include "configuration.h"
+#include "main.h"
+
+FragmentModule *fragmentModule;
+
+/*
+ * On the wire each packet starts with a type byte (the top bit asks the receiver for an ack), then
+ *  data: transferId, index, count, port (2 bytes little endian), then up to FRAGMENT_DATA_LEN bytes of payload
+ *  ack:  transferId, count, bitmap of the fragments received (4 bytes little endian)
+ */
+#define FRAGMENT_TYPE_DATA 1
+#define FRAGMENT_TYPE_ACK 2
+#define FRAGMENT_WANT_ACK 0x80
+#define FRAGMENT_DATA_HEADER_LEN 6
+#define FRAGMENT_ACK_LEN 7
+
+/// How long we wait for an ack before resending, and how many times we try before giving up on the transfer
+#define FRAGMENT_ACK_TIMEOUT_MSEC (30 * 1000)
+#define FRAGMENT_MAX_RETRIES 4
+
+/// Between handing fragments to the router, the radio does the real spacing but we don't want to fill its queue
+#define FRAGMENT_SEND_GAP_MSEC 250
+
+/// How long we back off while airtime limits (or a full TX queue) say we shouldn't send
+#define FRAGMENT_BUSY_MSEC (5 * 1000)
+
+/// A reassembly we don't hear anything for in this long is thrown away (the sender will have given up)
+#define FRAGMENT_REASSEMBLY_TIMEOUT_MSEC (FRAGMENT_ACK_TIMEOUT_MSEC * (FRAGMENT_MAX_RETRIES + 2))
+
+static uint32_t allFragments(uint8_t count)
+{
+    return count >= 32 ? UINT32_MAX : ((uint32_t)1 << count) - 1;
+}
+
+FragmentModule::FragmentModule() : SinglePortModule("fragment", FRAGMENT_PORTNUM), concurrency::OSThread("Fragment")
+{
+    disable(); // until we have something to send or reassemble
+
+    // Pick a random first transfer id, so after a reboot the receiver doesn't take our new transfer for the one it last saw
+    lastTransferId = random(256);
+}
+
+bool FragmentModule::addHandler(meshtastic_PortNum port, ReceiveHandler handler)
+{
+    for (auto &h : handlers)
+        if (h.port == port)
+            return false;
+
+    handlers.push_back({port, handler});
+    return true;
+}
+
+bool FragmentModule::send(NodeNum to, ChannelIndex channel, meshtastic_PortNum port, const uint8_t *data, size_t len,
+                          SentHandler onSent)
+{
+    if (isSending() || to == NODENUM_BROADCAST || len == 0 || len > FRAGMENT_MAX_COUNT * FRAGMENT_DATA_LEN)
+        return false;
+
+    uint8_t *copy = (uint8_t *)malloc(len);
+    if (!copy)
+        return false;
+    memcpy(copy, data, len);
+
+    outgoing = Outgoing();
+    outgoing.data = copy;
+    outgoing.len = len;
+    outgoing.to = to;
+    outgoing.channel = channel;
+    outgoing.port = port;
+    outgoing.onSent = onSent;
+    outgoing.transferId = ++lastTransferId;
+    outgoing.count = (len + FRAGMENT_DATA_LEN - 1) / FRAGMENT_DATA_LEN;
+
+    LOG_INFO("Fragmenting %u bytes for port %d to 0x%x into %d packets (transfer %d)\n", len, port, to, outgoing.count,
+             outgoing.transferId);
+
+    enabled = true;
+    setIntervalFromNow(0);
+    return true;
+}
+
+void FragmentModule::sendFragment(uint8_t index, bool wantAck)
+{
+    size_t offset = index * FRAGMENT_DATA_LEN;
+    size_t len = min(outgoing.len - offset, (size_t)FRAGMENT_DATA_LEN);
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = outgoing.to;
+    p->channel = outgoing.channel;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND; // bulk data shouldn't hold up anyone's chatter
+
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = FRAGMENT_TYPE_DATA | (wantAck ? FRAGMENT_WANT_ACK : 0);
+    b[1] = outgoing.transferId;
+    b[2] = index;
+    b[3] = outgoing.count;
+    b[4] = outgoing.port & 0xff;
+    b[5] = outgoing.port >> 8;
+    memcpy(b + FRAGMENT_DATA_HEADER_LEN, outgoing.data + offset, len);
+    p->decoded.payload.size = FRAGMENT_DATA_HEADER_LEN + len;
+
+    service.sendToMesh(p);
+}
+
+void FragmentModule::sendAck(NodeNum to, ChannelIndex channel, uint8_t transferId, uint8_t count, uint32_t received)
+{
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = to;
+    p->channel = channel;
+    p->priority = meshtastic_MeshPacket_Priority_ACK;
+
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = FRAGMENT_TYPE_ACK;
+    b[1] = transferId;
+    b[2] = count;
+    for (int i = 0; i < 4; i++)
+        b[3 + i] = (received >> (8 * i)) & 0xff;
+    p->decoded.payload.size = FRAGMENT_ACK_LEN;
+
+    service.sendToMesh(p);
+}
+
+ProcessMessage FragmentModule::handleReceived(const meshtastic_MeshPacket &mp)
+{
+    const uint8_t *b = mp.decoded.payload.bytes;
+    size_t len = mp.decoded.payload.size;
+
+    if (len > 0 && (b[0] & ~FRAGMENT_WANT_ACK) == FRAGMENT_TYPE_DATA)
+        handleData(mp, b, len);
+    else if (len > 0 && b[0] == FRAGMENT_TYPE_ACK)
+        handleAck(mp, b, len);
+    else
+        LOG_WARN("Ignoring malformed fragment from 0x%x\n", mp.from);
+
+    return ProcessMessage::STOP;
+}
+
+void FragmentModule::handleData(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (len < FRAGMENT_DATA_HEADER_LEN || mp.to == NODENUM_BROADCAST)
+        return;
+
+    uint8_t transferId = b[1], index = b[2], count = b[3];
+    meshtastic_PortNum port = (meshtastic_PortNum)(b[4] | (b[5] << 8));
+    size_t dataLen = len - FRAGMENT_DATA_HEADER_LEN;
+
+    // Only the last fragment may be short
+    if (count == 0 || count > FRAGMENT_MAX_COUNT || index >= count || dataLen > FRAGMENT_DATA_LEN ||
+        (index < count - 1 && dataLen != FRAGMENT_DATA_LEN)) {
+        LOG_WARN("Ignoring bad fragment %d/%d from 0x%x\n", index, count, mp.from);
+        return;
+    }
+
+    // Our last ack for this one must have gone missing
+    for (auto &c : completed)
+        if (c.from == mp.from && c.transferId == transferId && c.count == count) {
+            sendAck(mp.from, mp.channel, transferId, count, allFragments(count));
+            return;
+        }
+
+    size_t i = 0;
+    while (i < reassemblies.size() && !(reassemblies[i].from == mp.from && reassemblies[i].transferId == transferId))
+        i++;
+
+    if (i == reassemblies.size()) {
+        size_t needed = count * FRAGMENT_DATA_LEN;
+        uint8_t *buf = reassemblyBytes + needed <= FRAGMENT_REASSEMBLY_RAM ? (uint8_t *)malloc(needed) : NULL;
+        if (!buf) {
+            // No ack, so the sender retries later (by when some other reassembly may have finished)
+            LOG_WARN("No room to reassemble %d fragments from 0x%x, dropping\n", count, mp.from);
+            return;
+        }
+        reassemblyBytes += needed;
+        reassemblies.push_back({mp.from, transferId, count, port, mp.channel, 0, 0, 0, buf});
+
+        enabled = true; // so runOnce can expire it
+        setIntervalFromNow(0);
+    }
+
+    Reassembly &r = reassemblies[i];
+    if (r.count != count || r.port != port) {
+        LOG_WARN("Fragment from 0x%x doesn't match its transfer, ignoring\n", mp.from);
+        return;
+    }
+
+    memcpy(r.buf + index * FRAGMENT_DATA_LEN, b + FRAGMENT_DATA_HEADER_LEN, dataLen);
+    r.received |= (uint32_t)1 << index;
+    r.lastRxMsec = millis();
+    if (index == count - 1)
+        r.lastLen = dataLen;
+
+    if (r.received == allFragments(count)) {
+        size_t total = (count - 1) * FRAGMENT_DATA_LEN + r.lastLen;
+        LOG_INFO("Reassembled %u bytes for port %d from 0x%x\n", total, port, mp.from);
+
+        sendAck(r.from, r.channel, transferId, count, r.received);
+        completed[nextCompleted] = {r.from, transferId, count};
+        nextCompleted = (nextCompleted + 1) % NUM_COMPLETED;
+
+        bool handled = false;
+        for (auto &h : handlers)
+            if (h.port == port) {
+                h.handler(r.from, r.channel, r.buf, total);
+                handled = true;
+            }
+        if (!handled)
+            LOG_WARN("No handler for reassembled port %d\n", port);
+
+        freeReassembly(i);
+    } else if (b[0] & FRAGMENT_WANT_ACK) {
+        sendAck(r.from, r.channel, transferId, count, r.received);
+    }
+}
+
+void FragmentModule::handleAck(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (len < FRAGMENT_ACK_LEN || !isSending() || mp.from != outgoing.to || b[1] != outgoing.transferId ||
+        b[2] != outgoing.count)
+        return;
+
+    uint32_t received = b[3] | (b[4] << 8) | (b[5] << 16) | ((uint32_t)b[6] << 24);
+    outgoing.acked |= received & allFragments(outgoing.count);
+    outgoing.inFlight = 0; // anything in this window it doesn't have went missing, so is due to be sent again
+    outgoing.retries = 0;
+    outgoing.lastActivityMsec = millis();
+
+    LOG_DEBUG("Transfer %d: %d of %d fragments acked\n", outgoing.transferId, __builtin_popcount(outgoing.acked),
+              outgoing.count);
+    setIntervalFromNow(0);
+}
+
+void FragmentModule::finishSending(bool succeeded)
+{
+    if (succeeded)
+        LOG_INFO("Transfer %d of %u bytes to 0x%x complete\n", outgoing.transferId, outgoing.len, outgoing.to);
+    else
+        LOG_WARN("Transfer %d to 0x%x failed, %d of %d fragments acked\n", outgoing.transferId, outgoing.to,
+                 __builtin_popcount(outgoing.acked), outgoing.count);
+
+    free(outgoing.data);
+    NodeNum to = outgoing.to;
+    SentHandler onSent = outgoing.onSent;
+    outgoing = Outgoing();
+    if (onSent)
+        onSent(to, succeeded);
+}
+
+void FragmentModule::freeReassembly(size_t i)
+{
+    reassemblyBytes -= reassemblies[i].count * FRAGMENT_DATA_LEN;
+    free(reassemblies[i].buf);
+    reassemblies.erase(reassemblies.begin() + i);
+}
+
+int32_t FragmentModule::runSender()
+{
+    if (!isSending())
+        return INT32_MAX;
+
+    uint32_t all = allFragments(outgoing.count);
+    if (outgoing.acked == all) {
+        finishSending(true);
+        return INT32_MAX;
+    }
+
+    uint32_t now = millis();
+    uint32_t unsent = all & ~outgoing.acked & ~outgoing.inFlight;
+    if (unsent && __builtin_popcount(outgoing.inFlight) < FRAGMENT_WINDOW) {
+        if (!airTime->isTxAllowedChannelUtil(true) || !airTime->isTxAllowedAirUtil() || router->getQueueStatus().free < 2)
+            return FRAGMENT_BUSY_MSEC;
+
+        uint8_t index = __builtin_ctz(unsent);
+        uint32_t bit = (uint32_t)1 << index;
+        outgoing.inFlight |= bit;
+
+        // Ask for an ack at the end of each window (or of the whole transfer)
+        bool wantAck = __builtin_popcount(outgoing.inFlight) == FRAGMENT_WINDOW || !(unsent & ~bit);
+        sendFragment(index, wantAck);
+        outgoing.lastActivityMsec = now;
+        return FRAGMENT_SEND_GAP_MSEC;
+    }
+
+    // Waiting on an ack
+    uint32_t waited = now - outgoing.lastActivityMsec;
+    if (waited < FRAGMENT_ACK_TIMEOUT_MSEC)
+        return FRAGMENT_ACK_TIMEOUT_MSEC - waited;
+
+    if (++outgoing.retries > FRAGMENT_MAX_RETRIES) {
+        finishSending(false);
+        return INT32_MAX;
+    }
+
+    LOG_DEBUG("Transfer %d: no ack, resending (try %d)\n", outgoing.transferId, outgoing.retries);
+    outgoing.inFlight = 0;
+    return 0;
+}
+
+int32_t FragmentModule::runOnce()
+{
+    int32_t delay = runSender();
+
+    uint32_t now = millis();
+    for (size_t i = 0; i < reassemblies.size();) {
+        uint32_t idle = now - reassemblies[i].lastRxMsec;
+        if (idle >= FRAGMENT_REASSEMBLY_TIMEOUT_MSEC) {
+            LOG_WARN("Giving up reassembling transfer %d from 0x%x\n", reassemblies[i].transferId, reassemblies[i].from);
+            freeReassembly(i);
+        } else {
+            delay = min(delay, (int32_t)(FRAGMENT_REASSEMBLY_TIMEOUT_MSEC - idle));
+            i++;
+        }
+    }
+
+    if (delay == INT32_MAX)
+        return disable();
+    return delay;
+}
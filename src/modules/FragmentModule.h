@@ -0,0 +1,136 @@
+#pragma once
+#include "SinglePortModule.h"
+#include "concurrency/OSThread.h"
+#include <vector>
+
+/// Until there is an official portnum for it, fragments travel on this one from the private range
+#define FRAGMENT_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 16))
+
+/// Payload bytes in each fragment, leaves room for our header and the Data encoding in one LoRa frame
+#define FRAGMENT_DATA_LEN 200
+
+/// Most fragments in one transfer (one bit each in an ack), so the largest payload is FRAGMENT_MAX_COUNT * FRAGMENT_DATA_LEN
+#define FRAGMENT_MAX_COUNT 32
+
+/// Fragments we send before waiting for an ack
+#define FRAGMENT_WINDOW 4
+
+/// RAM we are willing to spend on reassembly, over all senders at once
+#ifndef FRAGMENT_REASSEMBLY_RAM
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define FRAGMENT_REASSEMBLY_RAM (FRAGMENT_MAX_COUNT * FRAGMENT_DATA_LEN * 2)
+#else
+#define FRAGMENT_REASSEMBLY_RAM (16 * FRAGMENT_DATA_LEN)
+#endif
+#endif
+
+/**
+ * A transport for payloads too big for one packet (config pushes, small images, bulk telemetry).
+ *
+ * The payload is split into numbered fragments which go out FRAGMENT_WINDOW at a time, paced by our airtime limits.  The
+ * last fragment of each window asks for an ack, and the receiver answers with one bitmap of everything it has so far, so we
+ * only ever resend what went missing (selective repeat) and never pay for an ack per fragment.  Received payloads are
+ * handed whole to the handler registered for their port (they may not fit in a MeshPacket).
+ *
+ * Only for sending to one node, bitmap acks from a whole mesh would cost more than they save.
+ */
+class FragmentModule : public SinglePortModule, private concurrency::OSThread
+{
+  public:
+    /// Called with each payload we receive in full
+    typedef void (*ReceiveHandler)(NodeNum from, ChannelIndex channel, const uint8_t *data, size_t len);
+
+    /// Called when a transfer we sent has completed or failed
+    typedef void (*SentHandler)(NodeNum to, bool succeeded);
+
+    FragmentModule();
+
+    /** Have handler called with every payload sent to us for port.  @return false if port already has a handler */
+    bool addHandler(meshtastic_PortNum port, ReceiveHandler handler);
+
+    /**
+     * Start sending len bytes (which we copy) for port on node to.  Progress is logged, the receiver's handler is how it finds
+     * out, and onSent (if given) how we do.
+     * @return false if the payload is too big, to is a broadcast or we are still busy with an earlier transfer
+     */
+    bool send(NodeNum to, ChannelIndex channel, meshtastic_PortNum port, const uint8_t *data, size_t len,
+              SentHandler onSent = NULL);
+
+    /// @return true until our current transfer has completed or failed
+    bool isSending() const { return outgoing.data != NULL; }
+
+  protected:
+    virtual ProcessMessage handleReceived(const meshtastic_MeshPacket &mp) override;
+
+    virtual int32_t runOnce() override;
+
+  private:
+    struct Outgoing {
+        uint8_t *data = NULL; // NULL if idle
+        size_t len = 0;
+        NodeNum to = 0;
+        ChannelIndex channel = 0;
+        meshtastic_PortNum port = meshtastic_PortNum_UNKNOWN_APP;
+        uint8_t transferId = 0, count = 0;
+
+        /// Fragments the receiver has told us it has, and those we have sent since its last ack
+        uint32_t acked = 0, inFlight = 0;
+
+        /// When we last sent a fragment or heard an ack, for our ack timeout
+        uint32_t lastActivityMsec = 0;
+        uint8_t retries = 0;
+
+        SentHandler onSent = NULL;
+    };
+
+    struct Reassembly {
+        NodeNum from;
+        uint8_t transferId, count;
+        meshtastic_PortNum port;
+        ChannelIndex channel;
+        uint32_t received;   // bitmap of the fragments we have
+        uint16_t lastLen;    // length of the final fragment, once we have it
+        uint32_t lastRxMsec; // so we can give up on senders which went quiet
+        uint8_t *buf;        // count * FRAGMENT_DATA_LEN bytes
+    };
+
+    /// A transfer we finished recently, so we can ack it again if our ack went missing
+    struct Completed {
+        NodeNum from;
+        uint8_t transferId, count;
+    };
+
+    struct Handler {
+        meshtastic_PortNum port;
+        ReceiveHandler handler;
+    };
+
+    Outgoing outgoing;
+    uint8_t lastTransferId = 0;
+
+    std::vector<Reassembly> reassemblies;
+    size_t reassemblyBytes = 0;
+
+    static const uint8_t NUM_COMPLETED = 4;
+    Completed completed[NUM_COMPLETED] = {};
+    uint8_t nextCompleted = 0;
+
+    std::vector<Handler> handlers;
+
+    /// Send one fragment (the receiver acks if wantAck) or ack
+    void sendFragment(uint8_t index, bool wantAck);
+    void sendAck(NodeNum to, ChannelIndex channel, uint8_t transferId, uint8_t count, uint32_t received);
+
+    void handleData(const meshtastic_MeshPacket &mp, const uint8_t *data, size_t len);
+    void handleAck(const meshtastic_MeshPacket &mp, const uint8_t *data, size_t len);
+
+    /// Free our outgoing transfer
+    void finishSending(bool succeeded);
+
+    void freeReassembly(size_t i);
+
+    /// Send the next fragments of our outgoing transfer, or resend after a timeout.  @return msecs until we want to run again
+    int32_t runSender();
+};
+
+extern FragmentModule *fragmentModule;
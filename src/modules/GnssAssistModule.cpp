@@ -0,0 +1,163 @@
+#include "GnssAssistModule.h"
+#include "MeshService.h"
+#include "NodeDB.h"
+#include "configuration.h"
+#include "gps/GPS.h"
+#include "gps/RTC.h"
+#include "main.h"
+#include "modules/FragmentModule.h"
+
+GnssAssistModule *gnssAssistModule;
+
+/*
+ * On the wire each packet starts with a type byte, then (multi byte values little endian)
+ *  blob: issued (4), expires (4), then the UBX-MGA messages, as GnssAssist keeps them
+ *  ask:  when what we have was issued (4), 0 for nothing
+ */
+#define GNSS_ASSIST_TYPE_BLOB 1
+#define GNSS_ASSIST_TYPE_ASK 2
+#define GNSS_ASSIST_ASK_LEN 5
+
+/// How often we look at whether we should ask, or answer
+#define GNSS_ASSIST_CHECK_MSEC (60 * 1000)
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        b[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint32_t get32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+GnssAssistModule::GnssAssistModule() : SinglePortModule("gnssassist", GNSS_ASSIST_PORTNUM), concurrency::OSThread("GnssAssist")
+{
+    setIntervalFromNow(GNSS_ASSIST_CHECK_MSEC); // give the GPS and our clock a chance first
+}
+
+bool GnssAssistModule::takeBlob(NodeNum from, const uint8_t *b, size_t len)
+{
+    if (len <= 1 + GNSS_ASSIST_HEADER_LEN || len > 1 + GNSS_ASSIST_HEADER_LEN + GNSS_ASSIST_MAX_LEN ||
+        b[0] != GNSS_ASSIST_TYPE_BLOB)
+        return false;
+
+    uint32_t issued = get32(b + 1), expires = get32(b + 5);
+    uint32_t now = getValidTime(RTCQualityDevice);
+    uint32_t haveIssued, haveExpires;
+    if (GnssAssist::getInfo(haveIssued, haveExpires) && issued <= haveIssued) {
+        LOG_DEBUG("Ignoring GNSS assistance from 0x%x, we have it or newer\n", from);
+        return false;
+    }
+    if (expires <= issued || (now && expires <= now)) {
+        LOG_WARN("Ignoring stale GNSS assistance from 0x%x\n", from);
+        return false;
+    }
+
+    const uint8_t *data = b + 1 + GNSS_ASSIST_HEADER_LEN;
+    size_t dataLen = len - 1 - GNSS_ASSIST_HEADER_LEN;
+    if (!GnssAssist::isValid(data, dataLen)) {
+        LOG_WARN("Ignoring malformed GNSS assistance from 0x%x\n", from);
+        return false;
+    }
+    if (!GnssAssist::save(issued, expires, data, dataLen))
+        return false;
+
+    LOG_INFO("Keeping %u bytes of GNSS assistance from 0x%x, good for %us\n", dataLen, from, now ? expires - now : 0);
+    return true;
+}
+
+void GnssAssistModule::receiveBlob(NodeNum from, ChannelIndex channel, const uint8_t *data, size_t len)
+{
+    takeBlob(from, data, len);
+}
+
+ProcessMessage GnssAssistModule::handleReceived(const meshtastic_MeshPacket &mp)
+{
+    const uint8_t *b = mp.decoded.payload.bytes;
+    size_t len = mp.decoded.payload.size;
+
+    if (len > 0 && b[0] == GNSS_ASSIST_TYPE_BLOB) {
+        if (mp.to == nodeDB.getNodeNum()) // from our phone, or sent to us alone
+            takeBlob(getFrom(&mp), b, len);
+    } else if (len > 0 && b[0] == GNSS_ASSIST_TYPE_ASK)
+        handleAsk(mp, b, len);
+    else
+        LOG_WARN("Ignoring malformed GNSS assistance packet from 0x%x\n", mp.from);
+
+    return ProcessMessage::STOP;
+}
+
+void GnssAssistModule::handleAsk(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len)
+{
+    if (len < GNSS_ASSIST_ASK_LEN || mp.from == nodeDB.getNodeNum() || answerTo)
+        return;
+    if (config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER &&
+        config.device.role != meshtastic_Config_DeviceConfig_Role_ROUTER_CLIENT)
+        return; // answering is for the nodes with the airtime to spare
+
+    uint32_t issued, expires;
+    if (!GnssAssist::isFresh(getValidTime(RTCQualityDevice)) || !GnssAssist::getInfo(issued, expires) || issued <= get32(b + 1))
+        return;
+
+    answerTo = mp.from;
+    answerChannel = mp.channel;
+    answerAtMsec = millis() + random(GNSS_ASSIST_ANSWER_MAX_DELAY_MSEC);
+    LOG_DEBUG("Will answer 0x%x's ask for GNSS assistance\n", mp.from);
+    setIntervalFromNow(answerAtMsec - millis());
+}
+
+void GnssAssistModule::sendAsk()
+{
+    uint32_t issued, expires;
+    if (!GnssAssist::getInfo(issued, expires))
+        issued = 0;
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->to = NODENUM_BROADCAST;
+    p->hop_limit = 0; // only our neighbors, it's them who would answer
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = GNSS_ASSIST_TYPE_ASK;
+    put32(b + 1, issued);
+    p->decoded.payload.size = GNSS_ASSIST_ASK_LEN;
+
+    lastAskMsec = millis();
+    LOG_INFO("Asking our neighbors for GNSS assistance\n");
+    service.sendToMesh(p);
+}
+
+void GnssAssistModule::sendAnswer()
+{
+    NodeNum to = answerTo;
+    answerTo = 0;
+    if (!fragmentModule)
+        return;
+
+    uint8_t *buf = new uint8_t[1 + GNSS_ASSIST_HEADER_LEN + GNSS_ASSIST_MAX_LEN];
+    buf[0] = GNSS_ASSIST_TYPE_BLOB;
+    size_t len = GnssAssist::readAll(buf + 1, GNSS_ASSIST_HEADER_LEN + GNSS_ASSIST_MAX_LEN);
+    if (len > GNSS_ASSIST_HEADER_LEN && fragmentModule->send(to, answerChannel, GNSS_ASSIST_PORTNUM, buf, 1 + len))
+        LOG_INFO("Sending 0x%x our %u bytes of GNSS assistance\n", to, len);
+    delete[] buf;
+}
+
+int32_t GnssAssistModule::runOnce()
+{
+    if (answerTo) {
+        if ((int32_t)(millis() - answerAtMsec) < 0)
+            return answerAtMsec - millis();
+        if (fragmentModule && fragmentModule->isSending())
+            return GNSS_ASSIST_CHECK_MSEC / 4; // it takes one transfer at a time
+        sendAnswer();
+    }
+
+    // A GPS with nothing fresh, and a clock to tell stale from fresh by
+    uint32_t now = getValidTime(RTCQualityDevice);
+    if (gps && now && !GnssAssist::isFresh(now) &&
+        (!lastAskMsec || millis() - lastAskMsec >= GNSS_ASSIST_ASK_SECS * 1000UL))
+        sendAsk();
+
+    return GNSS_ASSIST_CHECK_MSEC;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "SinglePortModule.h"
+#include "concurrency/OSThread.h"
+#include "gps/GnssAssist.h"
+
+/// Until there is an official portnum for it, AssistNow data travels on this one from the private range
+#define GNSS_ASSIST_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 22))
+
+/// Most often a node with a GPS and no fresh assistance asks its neighbors for some
+#ifndef GNSS_ASSIST_ASK_SECS
+#define GNSS_ASSIST_ASK_SECS (6 * 60 * 60)
+#endif
+
+/// A router which can answer an ask waits a random time up to this, so those who hear it don't all answer at once
+#ifndef GNSS_ASSIST_ANSWER_MAX_DELAY_MSEC
+#define GNSS_ASSIST_ANSWER_MAX_DELAY_MSEC (30 * 1000)
+#endif
+
+/**
+ * AssistNow data for our GPS, so a receiver waking cold (after hours off, or across the country) has its ephemeris in
+ * seconds rather than the minutes it takes to download it from the sky - most of a tracker's GPS energy on a long interval.
+ *
+ * Data comes to us as a blob: when it was issued and goes stale, then the UBX-MGA messages from u-blox's service.  The phone
+ * (or a gateway, from its MQTT) sends it to us directly, in one packet or through FragmentModule if it's bigger.  A node
+ * with a GPS and no fresh data broadcasts an ask to its neighbors (hop limit 0), at most every GNSS_ASSIST_ASK_SECS, with
+ * what it has.  Routers holding something newer answer it, each after a random delay, by sending it their blob through
+ * FragmentModule.  We keep the newest blob which checks out (GnssAssist), and GPS injects it whenever it wakes cold.
+ */
+class GnssAssistModule : public SinglePortModule, private concurrency::OSThread
+{
+  public:
+    GnssAssistModule();
+
+    /// FragmentModule's handler for our port, for blobs too big for one packet
+    static void receiveBlob(NodeNum from, ChannelIndex channel, const uint8_t *data, size_t len);
+
+  protected:
+    virtual ProcessMessage handleReceived(const meshtastic_MeshPacket &mp) override;
+
+    virtual int32_t runOnce() override;
+
+  private:
+    /// Who we mean to answer with our blob, 0 for no one
+    NodeNum answerTo = 0;
+    ChannelIndex answerChannel = 0;
+    uint32_t answerAtMsec = 0;
+
+    uint32_t lastAskMsec = 0;
+
+    /// Keep the blob in b (type byte and all) if it's newer than ours, valid and not stale.  @return true if we did
+    static bool takeBlob(NodeNum from, const uint8_t *b, size_t len);
+
+    void handleAsk(const meshtastic_MeshPacket &mp, const uint8_t *b, size_t len);
+
+    void sendAsk();
+    void sendAnswer();
+};
+
+extern GnssAssistModule *gnssAssistModule;
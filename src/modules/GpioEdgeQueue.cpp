@@ -0,0 +1,39 @@
+#include "GpioEdgeQueue.h"
+
+void IRAM_ATTR GpioEdgeQueue::add(uint64_t value, uint32_t msec)
+{
+    uint8_t next = (head + 1) % GPIO_EDGE_QUEUE_LEN;
+    if (next == tail) {
+        // Full, so this stands in for the newest we have, which keeps the pins' latest state right
+        uint8_t newest = (head + GPIO_EDGE_QUEUE_LEN - 1) % GPIO_EDGE_QUEUE_LEN;
+        edges[newest].msec = msec;
+        edges[newest].value = value;
+        return;
+    }
+    edges[head].msec = msec;
+    edges[head].value = value;
+    head = next;
+}
+
+bool GpioEdgeQueue::take(Edge &e, uint32_t nowMsec, uint32_t &waitMsec)
+{
+    while (tail != head) {
+        uint8_t next = (tail + 1) % GPIO_EDGE_QUEUE_LEN;
+        uint32_t msec = edges[tail].msec;
+        if (next != head) {
+            if (edges[next].msec - msec < GPIO_DEBOUNCE_MSEC) {
+                tail = next; // it bounced
+                continue;
+            }
+        } else if (nowMsec - msec < GPIO_DEBOUNCE_MSEC) {
+            waitMsec = GPIO_DEBOUNCE_MSEC - (nowMsec - msec); // it may yet bounce
+            return false;
+        }
+        e.msec = msec;
+        e.value = edges[tail].value;
+        tail = next;
+        return true;
+    }
+    waitMsec = 0;
+    return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "configuration.h"
+#include <stdint.h>
+
+/// Edges we can hold until the thread which owns the pins looks at them, a burst beyond that keeps only its latest
+#ifndef GPIO_EDGE_QUEUE_LEN
+#define GPIO_EDGE_QUEUE_LEN 16
+#endif
+
+/// Edges closer together than this are contact bounce, only how the pins settle counts
+#ifndef GPIO_DEBOUNCE_MSEC
+#define GPIO_DEBOUNCE_MSEC 20
+#endif
+
+/**
+ * Edges on a set of GPIOs, timestamped by the pin-change interrupt which saw them and queued for the thread which owns the
+ * pins, so nothing need poll them and a pulse shorter than a poll isn't missed.
+ *
+ * The ISR (our only producer) calls add() with what the pins read now, and the owning thread (our only consumer) take()s the
+ * edges in order, debounced: one followed by another within GPIO_DEBOUNCE_MSEC is dropped, and the newest isn't handed out
+ * until it has held that long.  An edge may read the same as the one before (a bounce we caught only half of), the consumer
+ * just ignores those.
+ */
+class GpioEdgeQueue
+{
+  public:
+    struct Edge {
+        uint32_t msec;
+        uint64_t value;
+    };
+
+    /// From the ISR: the pins read value at msec
+    void add(uint64_t value, uint32_t msec);
+
+    /**
+     * Take the oldest settled edge into e.  @return false if there's none, in which case waitMsec is how long until the newest
+     * will have settled (0 if there's nothing queued at all)
+     */
+    bool take(Edge &e, uint32_t nowMsec, uint32_t &waitMsec);
+
+    /// Forget whatever is queued, from the consumer with the ISR detached
+    void clear() { tail = head; }
+
+  private:
+    volatile Edge edges[GPIO_EDGE_QUEUE_LEN];
+    volatile uint8_t head = 0, tail = 0;
+};
@@ -6,5 +6,5 @@
  *
  */
 
-// Enable development more for StoreForwardModule
-bool StoreForward_Dev = false;
\ No newline at end of file
+// Enable development more for StoreForwardModule (Modules.cpp builds it then too, enabled or not)
+static const bool StoreForward_Dev = false;
\ No newline at end of file
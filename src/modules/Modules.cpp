@@ -7,8 +7,12 @@
 #include "input/kbMatrixImpl.h"
 #include "modules/AdminModule.h"
 #include "modules/AtakPluginModule.h"
+#include "modules/BenchmarkModule.h"
 #include "modules/CannedMessageModule.h"
 #include "modules/DetectionSensorModule.h"
+#include "modules/FirmwareUpdateModule.h"
+#include "modules/FragmentModule.h"
+#include "modules/GnssAssistModule.h"
 #include "modules/NeighborInfoModule.h"
 #include "modules/NodeInfoModule.h"
 #include "modules/PositionModule.h"
@@ -35,6 +39,7 @@
 #ifdef USE_SX1280
 #include "modules/esp32/AudioModule.h"
 #endif
+#include "modules/ModuleDev.h"
 #include "modules/esp32/PaxcounterModule.h"
 #include "modules/esp32/StoreForwardModule.h"
 #endif
@@ -45,8 +50,51 @@
 #include "modules/SerialModule.h"
 #endif
 #endif
+
+/// A module which does nothing until it's enabled in moduleConfig, so we only build it then (changing moduleConfig reboots us)
+struct OptionalModule {
+    const char *name;
+    bool (*isEnabled)();
+    void (*create)();
+};
+
+static const OptionalModule optionalModules[] = {
+#if !MESHTASTIC_EXCLUDE_DETECTIONSENSOR
+    {"DetectionSensor", [] { return moduleConfig.detection_sensor.enabled; },
+     [] { detectionSensorModule = new DetectionSensorModule(); }},
+#endif
+#if (defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_RP2040)) && !defined(CONFIG_IDF_TARGET_ESP32S2) &&               \
+    !defined(CONFIG_IDF_TARGET_ESP32C3) && !MESHTASTIC_EXCLUDE_SERIAL
+    {"Serial", [] { return moduleConfig.serial.enabled; }, [] { new SerialModule(); }},
+#endif
+#ifdef ARCH_ESP32
+#if defined(USE_SX1280) && !MESHTASTIC_EXCLUDE_AUDIO
+    {"Audio", [] { return moduleConfig.audio.codec2_enabled; }, [] { audioModule = new AudioModule(); }},
+#endif
+#if !MESHTASTIC_EXCLUDE_STOREFORWARD
+    {"StoreForward", [] { return moduleConfig.store_forward.enabled || StoreForward_Dev; },
+     [] { storeForwardModule = new StoreForwardModule(); }},
+#endif
+#if !MESHTASTIC_EXCLUDE_PAXCOUNTER
+    {"Paxcounter", [] { return moduleConfig.paxcounter.enabled; }, [] { paxcounterModule = new PaxcounterModule(); }},
+#endif
+#endif
+#if defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_RP2040)
+#if !MESHTASTIC_EXCLUDE_EXTERNALNOTIFICATION
+    {"ExternalNotification", [] { return moduleConfig.external_notification.enabled; },
+     [] { externalNotificationModule = new ExternalNotificationModule(); }},
+#endif
+#if !MESHTASTIC_EXCLUDE_RANGETEST
+    {"RangeTest", [] { return moduleConfig.range_test.enabled; }, [] { new RangeTestModule(); }},
+#endif
+#endif
+    {NULL, NULL, NULL} // so the table is never empty
+};
+
 /**
- * Create module instances here.  If you are adding a new module, you must 'new' it here (or somewhere else)
+ * Create module instances here.  If you are adding a new module, you must 'new' it here (or somewhere else).  One which does
+ * nothing unless it's enabled in moduleConfig belongs in optionalModules instead, and each should have a
+ * MESHTASTIC_EXCLUDE_<MODULE> flag (see configuration.h) for variants which would rather not build it at all.
  */
 void setupModules()
 {
@@ -57,16 +105,37 @@ void setupModules()
         adminModule = new AdminModule();
         nodeInfoModule = new NodeInfoModule();
         positionModule = new PositionModule();
+#if !MESHTASTIC_EXCLUDE_WAYPOINT
         waypointModule = new WaypointModule();
+#endif
         textMessageModule = new TextMessageModule();
+#if !MESHTASTIC_EXCLUDE_TRACEROUTE
         traceRouteModule = new TraceRouteModule();
+#endif
+#if !MESHTASTIC_EXCLUDE_NEIGHBORINFO
         neighborInfoModule = new NeighborInfoModule();
-        detectionSensorModule = new DetectionSensorModule();
+#endif
+#if !MESHTASTIC_EXCLUDE_ATAK
         atakPluginModule = new AtakPluginModule();
+#endif
+        fragmentModule = new FragmentModule();
+        fragmentModule->addHandler(ADMIN_BUNDLE_PORTNUM, AdminModule::receiveBundle);
+#if GPS_UBX_ASSIST
+        gnssAssistModule = new GnssAssistModule();
+        fragmentModule->addHandler(GNSS_ASSIST_PORTNUM, GnssAssistModule::receiveBlob);
+#endif
+#if USE_MESH_FIRMWARE_UPDATE
+        firmwareUpdateModule = new FirmwareUpdateModule();
+#endif
+#if BENCHMARK_MODULE
+        benchmarkModule = new BenchmarkModule();
+#endif
         // Note: if the rest of meshtastic doesn't need to explicitly use your module, you do not need to assign the instance
         // to a global variable.
 
+#if !MESHTASTIC_EXCLUDE_REMOTEHARDWARE
         new RemoteHardwareModule();
+#endif
         new ReplyModule();
 #if HAS_BUTTON || ARCH_PORTDUINO
         rotaryEncoderInterruptImpl1 = new RotaryEncoderInterruptImpl1();
@@ -94,7 +163,7 @@ void setupModules()
         trackballInterruptImpl1 = new TrackballInterruptImpl1();
         trackballInterruptImpl1->init();
 #endif
-#if HAS_SCREEN
+#if HAS_SCREEN && !MESHTASTIC_EXCLUDE_CANNEDMESSAGES
         cannedMessageModule = new CannedMessageModule();
 #endif
 #if HAS_TELEMETRY
@@ -106,33 +175,27 @@ void setupModules()
             new AirQualityTelemetryModule();
         }
 #endif
-#if HAS_TELEMETRY && !defined(ARCH_PORTDUINO)
+#if HAS_TELEMETRY && !defined(ARCH_PORTDUINO) && !MESHTASTIC_EXCLUDE_POWER_TELEMETRY
         new PowerTelemetryModule();
 #endif
-#if (defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_RP2040)) && !defined(CONFIG_IDF_TARGET_ESP32S2) &&               \
-    !defined(CONFIG_IDF_TARGET_ESP32C3)
-        new SerialModule();
-#endif
-#ifdef ARCH_ESP32
-        // Only run on an esp32 based device.
-#ifdef USE_SX1280
-        audioModule = new AudioModule();
-#endif
-        storeForwardModule = new StoreForwardModule();
-        paxcounterModule = new PaxcounterModule();
-#endif
-#if defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_RP2040)
-        externalNotificationModule = new ExternalNotificationModule();
-        new RangeTestModule();
-#endif
+        for (const OptionalModule &m : optionalModules) {
+            if (!m.name)
+                continue;
+            if (m.isEnabled())
+                m.create();
+            else
+                LOG_DEBUG("%s module not enabled, not starting it\n", m.name);
+        }
     } else {
         adminModule = new AdminModule();
 #if HAS_TELEMETRY
         new DeviceTelemetryModule();
 #endif
+#if !MESHTASTIC_EXCLUDE_TRACEROUTE
         traceRouteModule = new TraceRouteModule();
+#endif
     }
     // NOTE! This module must be added LAST because it likes to check for replies from other modules and avoid sending extra
     // acks
     routingModule = new RoutingModule();
-}
\ No newline at end of file
+}
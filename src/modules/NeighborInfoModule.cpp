@@ -1,13 +1,41 @@
 #include "NeighborInfoModule.h"
 #include "MeshService.h"
+#include "NextHopTable.h"
 #include "NodeDB.h"
 #include "RTC.h"
+#include "TxPowerControl.h"
+#include <math.h>
 
 #define MAX_NUM_NEIGHBORS 10 // also defined in NeighborInfo protobuf options
 NeighborInfoModule *neighborInfoModule;
 
 static const char *neighborInfoConfigFile = "/prefs/neighbors.proto";
 
+/*
+ * On NEIGHBORINFO_DELTA_PORTNUM each packet starts with a type byte, then (multi byte values little endian)
+ *  delta: id of the full report it's against (4), sequence number (1), the hop limit we sent it with (1), our broadcast
+ *         interval (4), number changed (1), number removed (1), then for each changed node (4) and SNR (1, signed
+ *         quarter dB), then each removed node (4)
+ *  ask:   id of the sender's full report we have (4), 0 for none
+ * A delta is against the full report, not the delta before, so a lost delta costs nothing - only a lost full report needs
+ * asking for.
+ */
+#define NEIGHBORINFO_TYPE_DELTA 1
+#define NEIGHBORINFO_TYPE_ASK 2
+#define NEIGHBORINFO_DELTA_HEADER_LEN 13
+#define NEIGHBORINFO_ASK_LEN 5
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        b[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint32_t get32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
 /*
 Prints a single neighbor info packet and associated neighbors
 Uses LOG_DEBUG, which equates to Console.log
@@ -143,29 +171,21 @@ size_t NeighborInfoModule::cleanUpNeighbors()
     int num_neighbors = getNumNeighbors();
     NodeNum my_node_id = nodeDB.getNodeNum();
 
-    // Find neighbors to remove
-    std::vector<int> indices_to_remove;
-    for (int i = 0; i < num_neighbors; i++) {
+    // We will remove a neighbor if we haven't heard from them in twice the broadcast interval.  Removing one moves the last into
+    // its place, so look at that place again
+    bool removed = false;
+    for (int i = num_neighbors - 1; i >= 0; i--) {
         const meshtastic_Neighbor *dbEntry = getNeighborByIndex(i);
-        // We will remove a neighbor if we haven't heard from them in twice the broadcast interval
         if ((now - dbEntry->last_rx_time > dbEntry->node_broadcast_interval_secs * 2) && (dbEntry->node_id != my_node_id)) {
-            indices_to_remove.push_back(i);
-        }
-    }
-
-    // Update the neighbor list
-    for (uint i = 0; i < indices_to_remove.size(); i++) {
-        int index = indices_to_remove[i];
-        LOG_DEBUG("Removing neighbor with node ID 0x%x\n", neighbors[index].node_id);
-        for (int j = index; j < num_neighbors - 1; j++) {
-            neighbors[j] = neighbors[j + 1];
+            LOG_DEBUG("Removing neighbor with node ID 0x%x\n", dbEntry->node_id);
+            removeNeighbor(i);
+            removed = true;
         }
-        (*numNeighbors)--;
     }
 
     // Save the neighbor list if we removed any neighbors
-    if (indices_to_remove.size() > 0) {
-        saveProtoForModule();
+    if (removed) {
+        nodeDB.saveToDiskSoon(SEGMENT_NEIGHBORS);
     }
 
     return *numNeighbors;
@@ -176,15 +196,85 @@ void NeighborInfoModule::sendNeighborInfo(NodeNum dest, bool wantReplies)
 {
     meshtastic_NeighborInfo neighborInfo = meshtastic_NeighborInfo_init_zero;
     collectNeighborInfo(&neighborInfo);
+#if NEIGHBORINFO_DELTA
+    if (dest == NODENUM_BROADCAST && !wantReplies && lastFullId && !fullDue && reportsSinceFull + 1 < NEIGHBORINFO_FULL_EVERY &&
+        sendDelta(neighborInfo))
+        return;
+#endif
     meshtastic_MeshPacket *p = allocDataProtobuf(neighborInfo);
     // send regardless of whether or not we have neighbors in our DB,
     // because we want to get neighbors for the next cycle
     p->to = dest;
     p->decoded.want_response = wantReplies;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND; // nobody is waiting on it, so it can wait for a quieter channel
     printNeighborInfo("SENDING", &neighborInfo);
+
+    if (dest == NODENUM_BROADCAST) {
+        lastFull.count = neighborInfo.neighbors_count;
+        for (pb_size_t i = 0; i < lastFull.count; i++) {
+            lastFull.nodes[i] = neighborInfo.neighbors[i].node_id;
+            lastFull.snrs[i] = neighborInfo.neighbors[i].snr;
+        }
+        lastFullId = p->id;
+        deltaSeq = 0;
+        reportsSinceFull = 0;
+        fullDue = false;
+    }
     service.sendToMesh(p, RX_SRC_LOCAL, true);
 }
 
+bool NeighborInfoModule::sendDelta(const meshtastic_NeighborInfo &info)
+{
+    NodeNum changed[REPORT_MAX], removed[REPORT_MAX];
+    int8_t changedSnrs[REPORT_MAX];
+    uint8_t numChanged = 0, numRemoved = 0;
+    for (pb_size_t i = 0; i < info.neighbors_count; i++) {
+        const meshtastic_Neighbor &n = info.neighbors[i];
+        pb_size_t j = 0;
+        while (j < lastFull.count && lastFull.nodes[j] != n.node_id)
+            j++;
+        if (j < lastFull.count && fabsf(n.snr - lastFull.snrs[j]) < NEIGHBORINFO_DELTA_SNR_DB)
+            continue;
+        changed[numChanged] = n.node_id;
+        changedSnrs[numChanged++] = (int8_t)constrain(lroundf(n.snr * 4), -128, 127);
+    }
+    for (pb_size_t j = 0; j < lastFull.count; j++) {
+        pb_size_t i = 0;
+        while (i < info.neighbors_count && info.neighbors[i].node_id != lastFull.nodes[j])
+            i++;
+        if (i == info.neighbors_count)
+            removed[numRemoved++] = lastFull.nodes[j];
+    }
+    if (numChanged + numRemoved > NEIGHBORINFO_DELTA_MAX_CHANGES)
+        return false;
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->decoded.portnum = NEIGHBORINFO_DELTA_PORTNUM;
+    p->to = NODENUM_BROADCAST;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+    uint8_t *b = p->decoded.payload.bytes;
+    b[0] = NEIGHBORINFO_TYPE_DELTA;
+    put32(b + 1, lastFullId);
+    b[5] = ++deltaSeq;
+    b[6] = p->hop_limit;
+    put32(b + 7, info.node_broadcast_interval_secs);
+    b[11] = numChanged;
+    b[12] = numRemoved;
+    uint8_t *e = b + NEIGHBORINFO_DELTA_HEADER_LEN;
+    for (uint8_t i = 0; i < numChanged; i++, e += 5) {
+        put32(e, changed[i]);
+        e[4] = (uint8_t)changedSnrs[i];
+    }
+    for (uint8_t i = 0; i < numRemoved; i++, e += 4)
+        put32(e, removed[i]);
+    p->decoded.payload.size = e - b;
+    reportsSinceFull++;
+
+    LOG_INFO("Sending neighbor delta %u against 0x%x: %u changed, %u removed\n", deltaSeq, lastFullId, numChanged, numRemoved);
+    service.sendToMesh(p, RX_SRC_LOCAL, true);
+    return true;
+}
+
 /*
 Encompasses the full construction and sending packet to mesh
 Will be used for broadcast.
@@ -202,14 +292,163 @@ Pass it to an upper client; do not persist this data on the mesh
 */
 bool NeighborInfoModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_NeighborInfo *np)
 {
+    if (!np) {
+        if (mp.decoded.portnum == NEIGHBORINFO_DELTA_PORTNUM)
+            handleDelta(mp);
+        return false;
+    }
+
+    learnFromReport(getFrom(&mp), np);
+    // Whoever passed it on to us is our own neighbor
+    if (mp.from && np->last_sent_by_id)
+        nextHops.learnRoute(nodeDB.getNodeNum(), np->last_sent_by_id, false);
+
     if (enabled) {
         printNeighborInfo("RECEIVED", np);
         updateNeighbors(mp, np);
     }
+
+    // Keep it for the deltas its sender may send against it
+    NodeNum from = getFrom(&mp);
+    if (from != nodeDB.getNodeNum()) {
+        Peer *peer = findPeer(from, true);
+        peer->fullId = mp.id;
+        peer->seq = 0;
+        peer->lastHeardMsec = millis();
+        peer->report.count = np->neighbors_count;
+        if (peer->report.count > REPORT_MAX)
+            peer->report.count = REPORT_MAX;
+        for (pb_size_t i = 0; i < peer->report.count; i++) {
+            peer->report.nodes[i] = np->neighbors[i].node_id;
+            peer->report.snrs[i] = np->neighbors[i].snr;
+        }
+    }
     // Allow others to handle this packet
     return false;
 }
 
+void NeighborInfoModule::learnFromReport(NodeNum from, const meshtastic_NeighborInfo *np)
+{
+    // The sender hears each of its neighbors directly, so DMs between them need no relay
+    for (pb_size_t i = 0; i < np->neighbors_count; i++) {
+        nextHops.learnRoute(from, np->neighbors[i].node_id, false);
+        if (np->neighbors[i].node_id == nodeDB.getNodeNum())
+            txPowerControl.onReport(from, np->neighbors[i].snr); // how well it hears us
+    }
+}
+
+NeighborInfoModule::Peer *NeighborInfoModule::findPeer(NodeNum n, bool create)
+{
+    Peer *oldest = &peers[0];
+    for (Peer &peer : peers) {
+        if (peer.node == n)
+            return &peer;
+        if (!peer.node || (oldest->node && millis() - peer.lastHeardMsec > millis() - oldest->lastHeardMsec))
+            oldest = &peer; // an empty one, or else the one heard from longest ago
+    }
+    if (!create)
+        return NULL;
+    *oldest = Peer();
+    oldest->node = n;
+    oldest->lastHeardMsec = millis();
+    return oldest;
+}
+
+void NeighborInfoModule::handleDelta(const meshtastic_MeshPacket &mp)
+{
+    NodeNum from = getFrom(&mp);
+    const uint8_t *b = mp.decoded.payload.bytes;
+    size_t len = mp.decoded.payload.size;
+    if (from == nodeDB.getNodeNum() || len < 1)
+        return;
+
+    if (b[0] == NEIGHBORINFO_TYPE_ASK) {
+        if (len >= NEIGHBORINFO_ASK_LEN && mp.to == nodeDB.getNodeNum() && get32(b + 1) != lastFullId && lastFullId) {
+            LOG_INFO("0x%x asked for our full neighbor report, sending it next\n", from);
+            fullDue = true;
+        }
+        return;
+    }
+    if (b[0] != NEIGHBORINFO_TYPE_DELTA || len < NEIGHBORINFO_DELTA_HEADER_LEN)
+        return;
+    uint8_t numChanged = b[11], numRemoved = b[12];
+    if (len < NEIGHBORINFO_DELTA_HEADER_LEN + numChanged * 5 + numRemoved * 4 || numChanged > REPORT_MAX)
+        return;
+
+    Peer *peer = findPeer(from, false);
+    if (!peer || peer->fullId != get32(b + 1)) {
+        askForFull(mp, peer);
+        return;
+    }
+    if ((int8_t)(b[5] - peer->seq) <= 0)
+        return; // one we have applied (by another path), or older than it
+    peer->seq = b[5];
+    peer->lastHeardMsec = millis();
+
+    // The full report less what went or changed, then what changed
+    meshtastic_NeighborInfo info = meshtastic_NeighborInfo_init_zero;
+    bool direct = mp.hop_limit == b[6];
+    info.node_id = from;
+    info.last_sent_by_id = direct ? from : 0;
+    info.node_broadcast_interval_secs = get32(b + 7);
+    const uint8_t *changed = b + NEIGHBORINFO_DELTA_HEADER_LEN, *removed = changed + numChanged * 5;
+    for (pb_size_t i = 0; i < peer->report.count; i++) {
+        bool keep = true;
+        for (uint8_t j = 0; keep && j < numChanged; j++)
+            keep = get32(changed + j * 5) != peer->report.nodes[i];
+        for (uint8_t j = 0; keep && j < numRemoved; j++)
+            keep = get32(removed + j * 4) != peer->report.nodes[i];
+        if (keep) {
+            info.neighbors[info.neighbors_count].node_id = peer->report.nodes[i];
+            info.neighbors[info.neighbors_count++].snr = peer->report.snrs[i];
+        }
+    }
+    for (uint8_t j = 0; j < numChanged && info.neighbors_count < REPORT_MAX; j++) {
+        info.neighbors[info.neighbors_count].node_id = get32(changed + j * 5);
+        info.neighbors[info.neighbors_count++].snr = (int8_t)changed[j * 5 + 4] / 4.0f;
+    }
+
+    learnFromReport(from, &info);
+    if (enabled) {
+        printNeighborInfo("RECEIVED DELTA", &info);
+        if (direct)
+            getOrCreateNeighbor(from, from, info.node_broadcast_interval_secs, mp.rx_snr);
+    }
+
+    // Hand our phone the full report it would have had
+    meshtastic_MeshPacket *p = allocDataProtobuf(info);
+    p->from = from;
+    p->to = mp.to;
+    p->channel = mp.channel;
+    p->hop_limit = mp.hop_limit;
+    p->rx_time = mp.rx_time;
+    p->rx_snr = mp.rx_snr;
+    p->rx_rssi = mp.rx_rssi;
+    service.sendToPhone(p);
+}
+
+void NeighborInfoModule::askForFull(const meshtastic_MeshPacket &mp, Peer *peer)
+{
+    NodeNum from = getFrom(&mp);
+    if (!peer)
+        peer = findPeer(from, true); // with no full report, but it holds off our next ask
+    if (peer->lastResyncMsec && millis() - peer->lastResyncMsec < NEIGHBORINFO_RESYNC_MIN_SECS * 1000UL)
+        return;
+    peer->lastResyncMsec = millis();
+
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->decoded.portnum = NEIGHBORINFO_DELTA_PORTNUM;
+    p->to = from;
+    p->channel = mp.channel;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+    p->decoded.payload.bytes[0] = NEIGHBORINFO_TYPE_ASK;
+    put32(p->decoded.payload.bytes + 1, peer->fullId);
+    p->decoded.payload.size = NEIGHBORINFO_ASK_LEN;
+
+    LOG_INFO("Missed the full neighbor report 0x%x's delta is against, asking for it\n", from);
+    service.sendToMesh(p);
+}
+
 /*
 Copy the content of a current NeighborInfo packet into a new one and update the last_sent_by_id to our NodeNum
 */
@@ -234,6 +473,8 @@ void NeighborInfoModule::resetNeighbors()
     *numNeighbors = 0;
     neighborState.neighbors_count = 0;
     memset(neighborState.neighbors, 0, sizeof(neighborState.neighbors));
+    memset(neighborIndex, 0, sizeof(neighborIndex));
+    lastFullId = 0; // our next report is a full one
     saveProtoForModule();
 }
 
@@ -253,42 +494,107 @@ meshtastic_Neighbor *NeighborInfoModule::getOrCreateNeighbor(NodeNum originalSen
     if (n == 0) {
         n = nodeDB.getNodeNum();
     }
-    // look for one in the existing list
-    for (int i = 0; i < (*numNeighbors); i++) {
-        meshtastic_Neighbor *nbr = &neighbors[i];
-        if (nbr->node_id == n) {
-            // if found, update it
-            nbr->snr = snr;
-            nbr->last_rx_time = getTime();
-            // Only if this is the original sender, the broadcast interval corresponds to it
-            if (originalSender == n)
-                nbr->node_broadcast_interval_secs = node_broadcast_interval_secs;
-            saveProtoForModule(); // Save the updated neighbor
-            return nbr;
-        }
+    // These all get saved along with whatever else changes within NODEDB_SAVE_COALESCE_MSECS, not a write for each packet
+    meshtastic_Neighbor *nbr = findNeighbor(n);
+    if (nbr) {
+        // if found, update it
+        nbr->snr = snr;
+        nbr->last_rx_time = getTime();
+        // Only if this is the original sender, the broadcast interval corresponds to it
+        if (originalSender == n)
+            nbr->node_broadcast_interval_secs = node_broadcast_interval_secs;
+        nodeDB.saveToDiskSoon(SEGMENT_NEIGHBORS); // Save the updated neighbor
+        return nbr;
     }
-    // otherwise, allocate one and assign data to it
+    // otherwise, allocate one and assign data to it (in place of our last if we're full)
     // TODO: max memory for the database should take neighbors into account, but currently doesn't
-    if (*numNeighbors < MAX_NUM_NEIGHBORS) {
-        (*numNeighbors)++;
-    }
-    meshtastic_Neighbor *new_nbr = &neighbors[((*numNeighbors) - 1)];
+    if (*numNeighbors >= MAX_NUM_NEIGHBORS)
+        removeNeighbor(*numNeighbors - 1);
+    meshtastic_Neighbor *new_nbr = &neighbors[(*numNeighbors)++];
+    *new_nbr = meshtastic_Neighbor_init_zero;
     new_nbr->node_id = n;
     new_nbr->snr = snr;
     new_nbr->last_rx_time = getTime();
     // Only if this is the original sender, the broadcast interval corresponds to it
     if (originalSender == n)
         new_nbr->node_broadcast_interval_secs = node_broadcast_interval_secs;
-    saveProtoForModule(); // Save the new neighbor
+    addToNeighborIndex(*numNeighbors - 1);
+    nodeDB.saveToDiskSoon(SEGMENT_NEIGHBORS); // Save the new neighbor
     return new_nbr;
 }
 
+void NeighborInfoModule::rebuildNeighborIndex()
+{
+    memset(neighborIndex, 0, sizeof(neighborIndex));
+    for (size_t i = 0; i < *numNeighbors; i++) {
+        if (findNeighbor(neighbors[i].node_id))
+            LOG_WARN("Neighbor 0x%x is in our list twice\n", neighbors[i].node_id); // only the first will be found
+        else
+            addToNeighborIndex(i);
+    }
+}
+
+void NeighborInfoModule::addToNeighborIndex(size_t i)
+{
+    uint32_t slot = neighborIndexSlot(neighbors[i].node_id);
+    while (neighborIndex[slot]) // we are never more than half full, so there is always an empty slot
+        slot = (slot + 1) & (NEIGHBOR_INDEX_SIZE - 1);
+    neighborIndex[slot] = i + 1;
+}
+
+meshtastic_Neighbor *NeighborInfoModule::findNeighbor(NodeNum n)
+{
+    for (uint32_t slot = neighborIndexSlot(n);; slot = (slot + 1) & (NEIGHBOR_INDEX_SIZE - 1)) {
+        uint8_t entry = neighborIndex[slot];
+        if (!entry)
+            return NULL; // hit the end of the probe run
+        if (entry <= *numNeighbors && neighbors[entry - 1].node_id == n)
+            return &neighbors[entry - 1];
+    }
+}
+
+void NeighborInfoModule::removeFromNeighborIndex(NodeNum n)
+{
+    uint32_t i = neighborIndexSlot(n);
+    while (neighborIndex[i] && neighbors[neighborIndex[i] - 1].node_id != n)
+        i = (i + 1) & (NEIGHBOR_INDEX_SIZE - 1);
+    if (!neighborIndex[i])
+        return;
+
+    // Entries later in the probe run whose home slot isn't between the hole and them need to move back into it
+    for (uint32_t j = (i + 1) & (NEIGHBOR_INDEX_SIZE - 1);; j = (j + 1) & (NEIGHBOR_INDEX_SIZE - 1)) {
+        if (!neighborIndex[j])
+            break;
+
+        uint32_t k = neighborIndexSlot(neighbors[neighborIndex[j] - 1].node_id);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            neighborIndex[i] = neighborIndex[j];
+            i = j;
+        }
+    }
+    neighborIndex[i] = 0;
+}
+
+void NeighborInfoModule::removeNeighbor(size_t i)
+{
+    size_t last = *numNeighbors - 1;
+    removeFromNeighborIndex(neighbors[i].node_id);
+    if (i != last) {
+        removeFromNeighborIndex(neighbors[last].node_id);
+        neighbors[i] = neighbors[last];
+        addToNeighborIndex(i);
+    }
+    (*numNeighbors)--;
+}
+
 void NeighborInfoModule::loadProtoForModule()
 {
     if (!nodeDB.loadProto(neighborInfoConfigFile, meshtastic_NeighborInfo_size, sizeof(meshtastic_NeighborInfo),
                           &meshtastic_NeighborInfo_msg, &neighborState)) {
         neighborState = meshtastic_NeighborInfo_init_zero;
     }
+    rebuildNeighborIndex();
 }
 
 /**
@@ -1,6 +1,40 @@
 #pragma once
 #include "ProtobufModule.h"
 
+/// Broadcast what changed in our neighbors since our last full report in place of the full report, with a full one every
+/// NEIGHBORINFO_FULL_EVERY reports, when too much has changed, or when a node missed it.  Nodes without this only hear our
+/// neighbors that often, so it's for meshes where everyone has it (we always understand others' deltas)
+#ifndef NEIGHBORINFO_DELTA
+#define NEIGHBORINFO_DELTA 0
+#endif
+
+#ifndef NEIGHBORINFO_FULL_EVERY
+#define NEIGHBORINFO_FULL_EVERY 8
+#endif
+
+/// A neighbor's SNR has to move this far (dB) from what our full report said before a delta reports it again
+#ifndef NEIGHBORINFO_DELTA_SNR_DB
+#define NEIGHBORINFO_DELTA_SNR_DB 3
+#endif
+
+/// More changes than this since our last full report and we send a full one instead
+#ifndef NEIGHBORINFO_DELTA_MAX_CHANGES
+#define NEIGHBORINFO_DELTA_MAX_CHANGES 5
+#endif
+
+/// How many other nodes' full reports we keep, to apply their deltas to
+#ifndef NEIGHBORINFO_DELTA_PEERS
+#define NEIGHBORINFO_DELTA_PEERS 8
+#endif
+
+/// Most often we ask one node for its full report again
+#ifndef NEIGHBORINFO_RESYNC_MIN_SECS
+#define NEIGHBORINFO_RESYNC_MIN_SECS (10 * 60)
+#endif
+
+/// The portnum deltas (and asks for a full report) go out on, one nothing upstream uses
+#define NEIGHBORINFO_DELTA_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 23))
+
 /*
  * Neighborinfo module for sending info on each node's 0-hop neighbors to the mesh
  */
@@ -9,6 +43,72 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
     meshtastic_Neighbor *neighbors;
     pb_size_t *numNeighbors;
 
+    /// Our neighbors' places in neighbors[] (plus one, 0 for an empty slot) by node_id, open addressed with linear probing
+    static const uint32_t NEIGHBOR_INDEX_BITS = 5;
+    static const uint32_t NEIGHBOR_INDEX_SIZE = 1 << NEIGHBOR_INDEX_BITS;
+    static_assert(sizeof(meshtastic_NeighborInfo::neighbors) / sizeof(meshtastic_Neighbor) * 2 <= NEIGHBOR_INDEX_SIZE,
+                  "NEIGHBOR_INDEX_BITS is too small for our neighbors");
+    uint8_t neighborIndex[NEIGHBOR_INDEX_SIZE] = {};
+
+    /// Home slot in neighborIndex for a node
+    static uint32_t neighborIndexSlot(NodeNum n) { return (uint32_t)(n * 2654435761UL) >> (32 - NEIGHBOR_INDEX_BITS); }
+
+    /// Throw away neighborIndex and rebuild it from neighbors, after loading them
+    void rebuildNeighborIndex();
+
+    /// Add neighbors[i] to neighborIndex (it must not already be there)
+    void addToNeighborIndex(size_t i);
+
+    /// Remove n from neighborIndex, moving later entries of its probe run back so they can still be found
+    void removeFromNeighborIndex(NodeNum n);
+
+    /// @return our neighbor n, NULL if we have none
+    meshtastic_Neighbor *findNeighbor(NodeNum n);
+
+    /// Forget neighbors[i], moving our last neighbor into its place
+    void removeNeighbor(size_t i);
+
+    static const pb_size_t REPORT_MAX = sizeof(meshtastic_NeighborInfo::neighbors) / sizeof(meshtastic_Neighbor);
+
+    /// The neighbors a full report listed
+    struct Report {
+        pb_size_t count = 0;
+        NodeNum nodes[REPORT_MAX];
+        float snrs[REPORT_MAX];
+    };
+
+    /// Our last full report (its packet id, 0 for none), and the deltas we have sent against it
+    Report lastFull;
+    PacketId lastFullId = 0;
+    uint8_t deltaSeq = 0;
+    uint8_t reportsSinceFull = 0;
+    bool fullDue = false; // a node asked for a full report, it's what we send next
+
+    /// Another node's last full report, as we heard it, to apply its deltas to
+    struct Peer {
+        NodeNum node = 0; // 0 for an empty slot
+        PacketId fullId = 0;
+        uint8_t seq = 0; // of the last delta we applied
+        uint32_t lastHeardMsec = 0, lastResyncMsec = 0;
+        Report report;
+    };
+    Peer peers[NEIGHBORINFO_DELTA_PEERS];
+
+    /// @return our Peer for n, NULL if we have none and create is false (else the one heard from longest ago, emptied)
+    Peer *findPeer(NodeNum n, bool create);
+
+    /// Learn routes (and how well we're heard) from a full report from, or one we rebuilt from its delta
+    void learnFromReport(NodeNum from, const meshtastic_NeighborInfo *np);
+
+    /// @return true if we sent a delta of info against lastFull, false if a full report should go instead
+    bool sendDelta(const meshtastic_NeighborInfo &info);
+
+    /// A delta, or an ask for our full report, from another node
+    void handleDelta(const meshtastic_MeshPacket &mp);
+
+    /// Ask from (which sent a delta against a full report we don't have) for its full report, unless we did lately
+    void askForFull(const meshtastic_MeshPacket &mp, Peer *peer);
+
   public:
     /*
      * Expose the constructor
@@ -23,6 +123,9 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
     // Let FloodingRouter call updateLastSentById upon rebroadcasting a NeighborInfo packet
     friend class FloodingRouter;
 
+    // Let RadioInterface weigh its flood rebroadcast delays by how many neighbors we have, and how well we hear them
+    friend class RadioInterface;
+
   protected:
     // Note: this holds our local info.
     meshtastic_NeighborInfo neighborState;
@@ -33,6 +136,17 @@ class NeighborInfoModule : public ProtobufModule<meshtastic_NeighborInfo>, priva
      */
     virtual bool handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_NeighborInfo *nb) override;
 
+    virtual bool wantPacket(const meshtastic_MeshPacket *p) override
+    {
+        return p->decoded.portnum == ourPortNum || p->decoded.portnum == NEIGHBORINFO_DELTA_PORTNUM;
+    }
+
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override
+    {
+        ports.push_back(ourPortNum);
+        ports.push_back(NEIGHBORINFO_DELTA_PORTNUM);
+    }
+
     /*
      * Collect neighbor info from the nodeDB's history, capping at a maximum number of entries and max time
      * @return the number of entries collected
@@ -5,11 +5,17 @@
 #include "Router.h"
 #include "configuration.h"
 #include "main.h"
+#include <ErriezCRC32.h>
 
 NodeInfoModule *nodeInfoModule;
 
 bool NodeInfoModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_User *pptr)
 {
+    if (!pptr) {
+        if (mp.decoded.portnum == NODEINFO_DIGEST_PORTNUM)
+            handleDigest(mp);
+        return false;
+    }
     auto p = *pptr;
 
     bool hasChanged = nodeDB.updateUser(getFrom(&mp), p, mp.channel);
@@ -25,7 +31,7 @@ bool NodeInfoModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, mes
 
     // if user has changed while packet was not for us, inform phone
     if (hasChanged && !wasBroadcast && mp.to != nodeDB.getNodeNum())
-        service.sendToPhone(packetPool.allocCopy(mp));
+        service.sendToPhone(MeshModule::mayAlter(mp) ? packetPool.allocCopy(mp) : packetPool.share(&mp));
 
     // LOG_DEBUG("did handleReceived\n");
     return false; // Let others look at this message also if they want
@@ -50,11 +56,56 @@ void NodeInfoModule::sendOurNodeInfo(NodeNum dest, bool wantReplies, uint8_t cha
         }
 
         prevPacketId = p->id;
+        if (dest == NODENUM_BROADCAST) {
+            lastSentHash = hashUser(owner);
+            lastSentTime = getValidTime(RTCQualityDevice);
+            digestsSinceFull = 0;
+        }
 
         service.sendToMesh(p);
     }
 }
 
+uint32_t NodeInfoModule::hashUser(const meshtastic_User &u)
+{
+    uint8_t buf[meshtastic_User_size];
+    size_t len = pb_encode_to_bytes(buf, sizeof(buf), &meshtastic_User_msg, &u);
+    return crc32Final(crc32Update(buf, len, 0xffffffff));
+}
+
+void NodeInfoModule::sendDigest(uint32_t hash)
+{
+    meshtastic_MeshPacket *p = allocDataPacket();
+    p->decoded.portnum = NODEINFO_DIGEST_PORTNUM;
+    p->priority = meshtastic_MeshPacket_Priority_BACKGROUND;
+    memcpy(p->decoded.payload.bytes, &hash, sizeof(hash));
+    memcpy(p->decoded.payload.bytes + sizeof(hash), &lastSentTime, sizeof(lastSentTime));
+    p->decoded.payload.size = sizeof(hash) + sizeof(lastSentTime);
+    digestsSinceFull++;
+
+    LOG_INFO("Sending our nodeinfo digest 0x%08x to mesh\n", hash);
+    service.sendToMesh(p);
+}
+
+void NodeInfoModule::handleDigest(const meshtastic_MeshPacket &mp)
+{
+    NodeNum from = getFrom(&mp);
+    uint32_t hash, sentTime;
+    if (from == nodeDB.getNodeNum() || mp.decoded.payload.size < sizeof(hash) + sizeof(sentTime))
+        return;
+    memcpy(&hash, mp.decoded.payload.bytes, sizeof(hash));
+    memcpy(&sentTime, mp.decoded.payload.bytes + sizeof(hash), sizeof(sentTime));
+
+    const meshtastic_NodeInfoLite *n = nodeDB.getMeshNode(from);
+    if (n && n->has_user && hashUser(n->user) == hash)
+        return; // what we have is current
+
+    // Asking is sending ours wanting a reply, which allocReply() holds to one a minute however many digests we miss
+    LOG_INFO("NodeInfo digest 0x%08x from 0x%x (of its User sent at %u) isn't what we have, asking for it\n", hash, from,
+             sentTime);
+    sendOurNodeInfo(from, true, mp.channel);
+}
+
 meshtastic_MeshPacket *NodeInfoModule::allocReply()
 {
     uint32_t now = millis();
@@ -88,8 +139,17 @@ int32_t NodeInfoModule::runOnce()
     currentGeneration = radioGeneration;
 
     if (airTime->isTxAllowedAirUtil() && config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_HIDDEN) {
-        LOG_INFO("Sending our nodeinfo to mesh (wantReplies=%d)\n", requestReplies);
-        sendOurNodeInfo(NODENUM_BROADCAST, requestReplies); // Send our info (don't request replies)
+#if NODEINFO_DIGEST
+        // Nobody needs our User again if it's the one we sent, anyone who missed it asks
+        uint32_t hash = hashUser(owner);
+        if (!requestReplies && lastSentHash == hash && digestsSinceFull + 1 < NODEINFO_FULL_EVERY)
+            sendDigest(hash);
+        else
+#endif
+        {
+            LOG_INFO("Sending our nodeinfo to mesh (wantReplies=%d)\n", requestReplies);
+            sendOurNodeInfo(NODENUM_BROADCAST, requestReplies); // Send our info (don't request replies)
+        }
     }
 
     return getConfiguredOrDefaultMs(config.device.node_info_broadcast_secs, default_broadcast_interval_secs);
@@ -1,6 +1,19 @@
 #pragma once
 #include "ProtobufModule.h"
 
+/// Broadcast a digest of our User (a hash of it) in place of the User itself, unless it changed, every NODEINFO_FULL_EVERY
+/// broadcasts, or when asked.  Nodes without this only hear our User that often, so it's for meshes where everyone has it
+#ifndef NODEINFO_DIGEST
+#define NODEINFO_DIGEST 0
+#endif
+
+#ifndef NODEINFO_FULL_EVERY
+#define NODEINFO_FULL_EVERY 8
+#endif
+
+/// The portnum digests go out on, one nothing upstream uses
+#define NODEINFO_DIGEST_PORTNUM ((meshtastic_PortNum)(meshtastic_PortNum_PRIVATE_APP + 18))
+
 /**
  * NodeInfo module for sending/receiving NodeInfos into the mesh
  */
@@ -11,6 +24,11 @@ class NodeInfoModule : public ProtobufModule<meshtastic_User>, private concurren
 
     uint32_t currentGeneration = 0;
 
+    /// The hash of the User we last broadcast, when, and how many digests of it we have sent since
+    uint32_t lastSentHash = 0;
+    uint32_t lastSentTime = 0;
+    uint8_t digestsSinceFull = 0;
+
   public:
     /** Constructor
      * name is for debugging output
@@ -36,8 +54,27 @@ class NodeInfoModule : public ProtobufModule<meshtastic_User>, private concurren
     /** Does our periodic broadcast */
     virtual int32_t runOnce() override;
 
+    virtual bool wantPacket(const meshtastic_MeshPacket *p) override
+    {
+        return p->decoded.portnum == ourPortNum || p->decoded.portnum == NODEINFO_DIGEST_PORTNUM;
+    }
+
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override
+    {
+        ports.push_back(ourPortNum);
+        ports.push_back(NODEINFO_DIGEST_PORTNUM);
+    }
+
   private:
     uint32_t lastSentToMesh = 0; // Last time we sent our NodeInfo to the mesh
+
+    /// A digest is this hash of the User's encoding, then lastSentTime, each 4 bytes
+    static uint32_t hashUser(const meshtastic_User &u);
+
+    void sendDigest(uint32_t hash);
+
+    /// Ask the sender of a digest for its User, unless the one we have matches it
+    void handleDigest(const meshtastic_MeshPacket &mp);
 };
 
 extern NodeInfoModule *nodeInfoModule;
@@ -0,0 +1,150 @@
+#include "PositionCodec.h"
+#include "NodeDB.h"
+#include "PayloadCompression.h"
+#include "Varint.h"
+#include "concurrency/LockGuard.h"
+#include "configuration.h"
+#include <algorithm>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include <string.h>
+
+PositionCodec *positionCodec;
+
+/// 1e-7 degrees to the nearest 1 << shift of them
+static int32_t quantize(int32_t v, uint8_t shift)
+{
+    return shift ? (int32_t)(((int64_t)v + (1 << (shift - 1))) >> shift) : v;
+}
+
+static int32_t unquantize(int32_t q, uint8_t shift)
+{
+    return (int32_t)((int64_t)q * (1 << shift));
+}
+
+static int compressPosition(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return positionCodec->compress(p, in, inLen, out, outLen);
+}
+
+static int decompressPosition(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return positionCodec->decompress(p, in, inLen, out, outLen);
+}
+
+PositionCodec::PositionCodec()
+{
+    memset(shifts, POSITION_COMPACT_SHIFT, sizeof(shifts));
+    if (!payloadCompression.add(
+            {meshtastic_PortNum_POSITION_APP, POSITION_COMPACT_PORTNUM, "position", compressPosition, decompressPosition}))
+        LOG_WARN("No room for the compact position codec, positions will go whole\n");
+}
+
+void PositionCodec::setPrecision(ChannelIndex channel, uint8_t shift)
+{
+    if (channel < MAX_NUM_CHANNELS)
+        shifts[channel] = std::min<uint8_t>(shift, 15);
+}
+
+PositionCodec::Heard *PositionCodec::findHeard(NodeNum from, ChannelIndex channel, bool orOldest)
+{
+    Heard *slot = &heard[0];
+    for (Heard &h : heard) {
+        if (h.from == from && h.channel == channel)
+            return &h;
+        if (slot->from && (!h.from || h.atMsec - slot->atMsec > INT32_MAX)) // empty or older
+            slot = &h;
+    }
+    return orOldest ? slot : NULL;
+}
+
+int PositionCodec::compress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    meshtastic_Position pos = meshtastic_Position_init_default;
+    if (p.channel >= MAX_NUM_CHANNELS || !pb_decode_from_bytes(in, inLen, &meshtastic_Position_msg, &pos))
+        return -1;
+
+    concurrency::LockGuard g(&lock);
+    uint8_t shift = shifts[p.channel];
+    int32_t lat = quantize(pos.latitude_i, shift), lon = quantize(pos.longitude_i, shift);
+    uint32_t now = millis();
+
+    // Only our own broadcasts are worth a keyframe, anyone else mightn't have it
+    Sent &s = sent[p.channel];
+    bool ours = p.from == nodeDB.getNodeNum() && p.to == NODENUM_BROADCAST;
+    bool delta = ours && s.valid && s.shift == shift && s.deltas + 1 < POSITION_COMPACT_KEYFRAME_EVERY &&
+                 now - s.atMsec < POSITION_COMPACT_KEYFRAME_SECS * 1000;
+    bool keyframe = ours && !delta;
+
+    uint8_t head[2 + 3 * 5]; // three varints at most 5 bytes each
+    size_t len = 0;
+    head[len++] = shift | (delta ? 0 : WHOLE) | (keyframe ? KEYFRAME : 0);
+    head[len++] = keyframe ? s.seq + 1 : (delta ? s.seq : 0);
+    if (delta) {
+        putZigzag(head, len, lat - s.lat);
+        putZigzag(head, len, lon - s.lon);
+        putZigzag(head, len, (int32_t)(pos.time - s.time));
+    } else {
+        putZigzag(head, len, lat);
+        putZigzag(head, len, lon);
+        putVarint(head, len, pos.time);
+    }
+    if (len > outLen)
+        return -1;
+    memcpy(out, head, len);
+
+    // The rest as it was, less what we've already said
+    uint32_t time = pos.time;
+    pos.latitude_i = pos.longitude_i = 0;
+    pos.time = 0;
+    pb_ostream_t stream = pb_ostream_from_buffer(out + len, outLen - len);
+    if (!pb_encode(&stream, &meshtastic_Position_msg, &pos))
+        return -1; // wouldn't fit
+    len += stream.bytes_written;
+
+    if (keyframe)
+        s = {true, head[1], shift, lat, lon, time, 0, now};
+    else if (delta)
+        s.deltas++;
+    return len;
+}
+
+int PositionCodec::decompress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    size_t len = 2;
+    int32_t lat, lon, dTime;
+    uint32_t time;
+    if (inLen < len || (in[0] & 0xc0) || !getZigzag(in, inLen, len, lat) || !getZigzag(in, inLen, len, lon))
+        return -1;
+    uint8_t shift = in[0] & 0xf, seq = in[1];
+    bool whole = in[0] & WHOLE;
+    if (whole ? !getVarint(in, inLen, len, time) : !getZigzag(in, inLen, len, dTime))
+        return -1;
+
+    meshtastic_Position pos = meshtastic_Position_init_default;
+    if (len < inLen && !pb_decode_from_bytes(in + len, inLen - len, &meshtastic_Position_msg, &pos))
+        return -1;
+
+    concurrency::LockGuard g(&lock);
+    if (!whole) {
+        Heard *k = findHeard(p.from, p.channel, false);
+        if (!k || k->seq != seq || k->shift != shift) {
+            LOG_DEBUG("Position from 0x%x is against keyframe %u, which we missed\n", p.from, seq);
+            return -1;
+        }
+        lat += k->lat;
+        lon += k->lon;
+        time = k->time + dTime;
+    }
+    pos.latitude_i = unquantize(lat, shift);
+    pos.longitude_i = unquantize(lon, shift);
+    pos.time = time;
+
+    pb_ostream_t stream = pb_ostream_from_buffer(out, outLen);
+    if (!pb_encode(&stream, &meshtastic_Position_msg, &pos))
+        return -1;
+
+    if (in[0] & KEYFRAME)
+        *findHeard(p.from, p.channel, true) = {p.from, p.channel, seq, shift, lat, lon, time, millis()};
+    return stream.bytes_written;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "concurrency/Lock.h"
+#include "mesh-pb-constants.h"
+
+/// Send positions compactly (see PositionCodec).  Nodes without it won't see positions sent this way, so it's for meshes
+/// where everyone has it
+#ifndef POSITION_COMPACT
+#define POSITION_COMPACT 0
+#endif
+
+/// The portnum compact positions go out on, one nothing upstream uses
+#ifndef POSITION_COMPACT_PORTNUM
+#define POSITION_COMPACT_PORTNUM ((meshtastic_PortNum)259)
+#endif
+
+/// Positions are rounded to 1 << this many 1e-7 degrees (3 is about 9cm, well inside any GPS's error), unless
+/// setPrecision() says otherwise for the channel
+#ifndef POSITION_COMPACT_SHIFT
+#define POSITION_COMPACT_SHIFT 3
+#endif
+
+/// Send a keyframe (a position others can work out the next ones from) at least every this many broadcasts
+#ifndef POSITION_COMPACT_KEYFRAME_EVERY
+#define POSITION_COMPACT_KEYFRAME_EVERY 4
+#endif
+
+/// And at least this often, so nobody who missed one waits too long
+#ifndef POSITION_COMPACT_KEYFRAME_SECS
+#define POSITION_COMPACT_KEYFRAME_SECS (60 * 60)
+#endif
+
+/// How many other nodes' keyframes we keep, to work out their positions from
+#ifndef POSITION_COMPACT_SENDERS
+#define POSITION_COMPACT_SENDERS 16
+#endif
+
+/**
+ * A PayloadCodec for POSITION_APP: our broadcasts go out as deltas against the last keyframe we sent on the channel, so a
+ * tracker that moved a few metres sends a couple of bytes for each of lat, lon and time where the protobuf takes twelve or
+ * so.  Everything else in the Position follows as the protobuf, minus those three.  Receivers turn it back into the whole
+ * Position before any module (or NodeDB, or the phone) sees it.
+ *
+ * Deltas are all against a keyframe rather than the one before, so losing one loses no more than that one; one which we
+ * lack the keyframe for can't be decoded, and is dropped.  Positions sent to one node, and others' positions we relay, go
+ * whole (compactly, but against nothing) so the receiver needs no keyframe.
+ *
+ * Our payload: a header byte (the precision shift, and the flags below), the keyframe's sequence number, then lat, lon
+ * (in 1 << shift units) and time (seconds) as zigzag varints - whole, or less the keyframe's - and then the protobuf.
+ */
+class PositionCodec
+{
+  public:
+    /// What our header byte says besides the shift (in its low nibble)
+    enum : uint8_t {
+        WHOLE = 0x10,    // lat, lon and time are whole, not deltas
+        KEYFRAME = 0x20, // and the sender's next deltas will be against them
+    };
+
+    /// Makes us payloadCompression's codec for POSITION_APP
+    PositionCodec();
+
+    /// Round positions we send on channel to 1 << shift 1e-7 degrees (up to 15)
+    void setPrecision(ChannelIndex channel, uint8_t shift);
+
+    int compress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+    int decompress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+
+  private:
+    /// The last keyframe we sent on a channel
+    struct Sent {
+        bool valid;
+        uint8_t seq, shift;
+        int32_t lat, lon; // in 1 << shift units
+        uint32_t time;
+        uint8_t deltas; // sent since
+        uint32_t atMsec;
+    };
+
+    /// The last keyframe we heard from a node on a channel
+    struct Heard {
+        NodeNum from; // 0 for an empty slot
+        ChannelIndex channel;
+        uint8_t seq, shift;
+        int32_t lat, lon;
+        uint32_t time;
+        uint32_t atMsec;
+    };
+
+    concurrency::Lock lock; // the router and the phone API can both decode
+    uint8_t shifts[MAX_NUM_CHANNELS];
+    Sent sent[MAX_NUM_CHANNELS] = {};
+    Heard heard[POSITION_COMPACT_SENDERS] = {};
+
+    Heard *findHeard(NodeNum from, ChannelIndex channel, bool orOldest);
+};
+
+extern PositionCodec *positionCodec;
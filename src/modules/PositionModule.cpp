@@ -1,5 +1,6 @@
 #include "PositionModule.h"
 #include "GPS.h"
+#include "PositionCodec.h"
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "RTC.h"
@@ -18,6 +19,10 @@ PositionModule::PositionModule()
       concurrency::OSThread("PositionModule")
 {
     isPromiscuous = true; // We always want to update our nodedb, even if we are sniffing on others
+#if POSITION_COMPACT
+    if (!positionCodec)
+        positionCodec = new PositionCodec();
+#endif
     if (config.device.role != meshtastic_Config_DeviceConfig_Role_TRACKER)
         setIntervalFromNow(60 * 1000);
 
@@ -35,6 +40,7 @@ void PositionModule::clearPosition()
     node->position.longitude_i = 0;
     node->position.altitude = 0;
     node->position.time = 0;
+    nodeDB.notePositionChanged(node);
     nodeDB.setLocalPosition(meshtastic_Position_init_default);
 }
 
@@ -74,6 +80,26 @@ bool PositionModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp, mes
 
     nodeDB.updatePosition(getFrom(&mp), p);
 
+#if POSITION_DEAD_RECKONING
+    if (!isLocal) {
+        // Keep their track (the same slot as before, else the oldest) while they're moving, forget it once they stop
+        Track *slot = &tracks[0];
+        for (Track &t : tracks) {
+            if (t.num == getFrom(&mp)) {
+                slot = &t;
+                break;
+            }
+            if (slot->num && (!t.num || t.atMsec - slot->atMsec > INT32_MAX)) // empty or older
+                slot = &t;
+        }
+        bool moving = p.ground_speed && (p.latitude_i || p.longitude_i);
+        if (moving)
+            *slot = Track{getFrom(&mp), p.latitude_i, p.longitude_i, p.ground_speed, p.ground_track, millis()};
+        else if (slot->num == getFrom(&mp))
+            *slot = Track{};
+    }
+#endif
+
     // Only respond to location requests on the channel where we broadcast location.
     if (channels.getByIndex(mp.channel).role == meshtastic_Channel_Role_PRIMARY) {
         ignoreRequest = false;
@@ -194,6 +220,56 @@ void PositionModule::sendOurPosition(NodeNum dest, bool wantReplies, uint8_t cha
 
 #define RUNONCE_INTERVAL 5000;
 
+uint32_t PositionModule::msecUntilNextBroadcast() const
+{
+    if (lastGpsSend == 0)
+        return UINT32_MAX;
+    uint32_t intervalMs = getConfiguredOrDefaultMs(config.position.position_broadcast_secs, default_broadcast_interval_secs);
+    uint32_t msSinceLastSend = millis() - lastGpsSend;
+    return msSinceLastSend >= intervalMs ? 0 : intervalMs - msSinceLastSend;
+}
+
+bool PositionModule::predictPosition(NodeNum node, int32_t &lat, int32_t &lon) const
+{
+#if POSITION_DEAD_RECKONING
+    for (const Track &t : tracks) {
+        if (t.num != node || !t.num)
+            continue;
+        uint32_t secs = (millis() - t.atMsec) / 1000;
+        if (secs > POSITION_DEAD_RECKONING_MAX_SECS)
+            secs = POSITION_DEAD_RECKONING_MAX_SECS;
+        GeoCoord::deadReckon(t.lat, t.lon, t.speed, t.track, secs, lat, lon);
+        return true;
+    }
+#endif
+    return false;
+}
+
+void PositionModule::predictOurPosition(int32_t &lat, int32_t &lon) const
+{
+    uint32_t secs = (millis() - lastGpsSend) / 1000;
+    if (secs > POSITION_DEAD_RECKONING_MAX_SECS)
+        secs = POSITION_DEAD_RECKONING_MAX_SECS;
+    GeoCoord::deadReckon(lastGpsLatitude, lastGpsLongitude, lastGpsSpeed, lastGpsTrack, secs, lat, lon);
+}
+
+void PositionModule::rememberSentPosition(const meshtastic_PositionLite &pos)
+{
+    lastGpsLatitude = pos.latitude_i;
+    lastGpsLongitude = pos.longitude_i;
+#if POSITION_DEAD_RECKONING
+    // Only if position_flags let the speed and heading go out with it, else our neighbours have nothing to dead reckon us by
+    const uint32_t velocityFlags =
+        meshtastic_Config_PositionConfig_PositionFlags_SPEED | meshtastic_Config_PositionConfig_PositionFlags_HEADING;
+    bool sentVelocity = config.position.position_broadcast_smart_enabled &&
+                        (config.position.position_flags & velocityFlags) == velocityFlags;
+#else
+    bool sentVelocity = false;
+#endif
+    lastGpsSpeed = sentVelocity ? localPosition.ground_speed : 0;
+    lastGpsTrack = sentVelocity ? localPosition.ground_track : 0;
+}
+
 int32_t PositionModule::runOnce()
 {
     if (sleepOnNextExecution == true) {
@@ -220,8 +296,7 @@ int32_t PositionModule::runOnce()
         if (hasValidPosition(node)) {
             lastGpsSend = now;
 
-            lastGpsLatitude = node->position.latitude_i;
-            lastGpsLongitude = node->position.longitude_i;
+            rememberSentPosition(node->position);
 
             // If we changed channels, ask everyone else for their latest info
             bool requestReplies = currentGeneration != radioGeneration;
@@ -254,8 +329,7 @@ int32_t PositionModule::runOnce()
                 sendOurPosition(NODENUM_BROADCAST, requestReplies);
 
                 // Set the current coords as our last ones, after we've compared distance with current and decided to send
-                lastGpsLatitude = node->position.latitude_i;
-                lastGpsLongitude = node->position.longitude_i;
+                rememberSentPosition(node->position);
 
                 /* Update lastGpsSend to now. This means if the device is stationary, then
                     getPref_position_broadcast_secs will still apply.
@@ -288,9 +362,12 @@ struct SmartPosition PositionModule::getDistanceTraveledSinceLastSend(meshtastic
     // The minimum distance to travel before we are able to send a new position packet.
     const uint32_t distanceTravelThreshold = getConfiguredOrDefault(config.position.broadcast_smart_minimum_distance, 100);
 
-    // Determine the distance in meters between two points on the globe
-    float distanceTraveledSinceLastSend = GeoCoord::latLongToMeter(
-        lastGpsLatitude * 1e-7, lastGpsLongitude * 1e-7, currentPosition.latitude_i * 1e-7, currentPosition.longitude_i * 1e-7);
+    // Determine the distance in meters between where our neighbours think we are (where we last said, and with
+    // POSITION_DEAD_RECKONING as far on as the speed and heading we said it with) and where we are
+    int32_t predictedLatitude, predictedLongitude;
+    predictOurPosition(predictedLatitude, predictedLongitude);
+    float distanceTraveledSinceLastSend =
+        GeoCoord::distanceE7(predictedLatitude, predictedLongitude, currentPosition.latitude_i, currentPosition.longitude_i);
 
 #ifdef GPS_EXTRAVERBOSE
     LOG_DEBUG("--------LAST POSITION------------------------------------\n");
@@ -333,8 +410,7 @@ void PositionModule::handleNewPosition()
             sendOurPosition(NODENUM_BROADCAST, requestReplies);
 
             // Set the current coords as our last ones, after we've compared distance with current and decided to send
-            lastGpsLatitude = node->position.latitude_i;
-            lastGpsLongitude = node->position.longitude_i;
+            rememberSentPosition(node->position);
 
             /* Update lastGpsSend to now. This means if the device is stationary, then
                 getPref_position_broadcast_secs will still apply.
@@ -2,6 +2,24 @@
 #include "ProtobufModule.h"
 #include "concurrency/OSThread.h"
 
+/// With smart broadcast on and the SPEED and HEADING position_flags set, only send again (short of position_broadcast_secs)
+/// once we're broadcast_smart_minimum_distance from where the speed and heading we sent say we'd be.  Neighbours dead reckon
+/// us the same way (see predictPosition()), so a vehicle going steadily needs no more than the odd correction.  Opt in with
+/// -DPOSITION_DEAD_RECKONING=1
+#ifndef POSITION_DEAD_RECKONING
+#define POSITION_DEAD_RECKONING 0
+#endif
+
+/// Dead reckon no further than this past a position, on both ends: past that we've likely stopped or turned
+#ifndef POSITION_DEAD_RECKONING_MAX_SECS
+#define POSITION_DEAD_RECKONING_MAX_SECS 300
+#endif
+
+/// How many neighbours' tracks we keep, to dead reckon them by
+#ifndef POSITION_DEAD_RECKONING_NODES
+#define POSITION_DEAD_RECKONING_NODES 8
+#endif
+
 /**
  * Position module for sending/receiving positions into the mesh
  */
@@ -17,6 +35,21 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
     int32_t lastGpsLatitude = 0;
     int32_t lastGpsLongitude = 0;
 
+    /// And the speed (km/h) and heading (1e-5 degrees) we sent with them, so where our neighbours think we are now
+    uint32_t lastGpsSpeed = 0;
+    uint32_t lastGpsTrack = 0;
+
+#if POSITION_DEAD_RECKONING
+    /// A neighbour's last position, and the speed and heading it came with
+    struct Track {
+        NodeNum num;
+        int32_t lat, lon;
+        uint32_t speed, track;
+        uint32_t atMsec;
+    };
+    Track tracks[POSITION_DEAD_RECKONING_NODES] = {};
+#endif
+
     /// We force a rebroadcast if the radio settings change
     uint32_t currentGeneration = 0;
 
@@ -33,6 +66,15 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
 
     void handleNewPosition();
 
+    /// How long until our next periodic broadcast is due, 0 if it's overdue and UINT32_MAX if we haven't sent one yet
+    uint32_t msecUntilNextBroadcast() const;
+
+    /**
+     * If we have node's speed and heading, put where they say it is now in lat and lon (1e-7 degrees)
+     * @return true if we did, false to use where it last said it was
+     */
+    bool predictPosition(NodeNum node, int32_t &lat, int32_t &lon) const;
+
   protected:
     /** Called to handle a particular incoming message
 
@@ -50,6 +92,12 @@ class PositionModule : public ProtobufModule<meshtastic_Position>, private concu
   private:
     struct SmartPosition getDistanceTraveledSinceLastSend(meshtastic_PositionLite currentPosition);
 
+    /// Where our last broadcast (with its speed and heading) says we are now
+    void predictOurPosition(int32_t &lat, int32_t &lon) const;
+
+    /// We just broadcast pos, from now on what we travel is measured from it
+    void rememberSentPosition(const meshtastic_PositionLite &pos);
+
     /** Only used in power saving trackers for now */
     void clearPosition();
     void sendLostAndFoundText();
@@ -0,0 +1,178 @@
+#include "RangeTestLog.h"
+#include "FSCommon.h"
+#include "NodeDB.h"
+#include "RTC.h"
+#include "configuration.h"
+#include "gps/GeoCoord.h"
+#include "main.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+RangeTestLog rangeTestLog;
+
+const char *RangeTestLog::csvHeader =
+    "time,from,sender name,sender lat,sender long,rx lat,rx long,rx elevation,rx snr,distance,hop limit,payload";
+const char *RangeTestLog::csvFileName = "/static/rangetest.csv";
+const char *RangeTestLog::binaryFileName = "/static/rangetest.bin";
+
+static_assert(RangeTestLog::headerSize == 8, "RangeTestLog::headerSize doesn't match FileHeader");
+static_assert(RANGE_TEST_LOG_PAYLOAD <= 255, "RANGE_TEST_LOG_PAYLOAD must fit in a Record's payloadSize");
+
+bool RangeTestLog::checkHeader(const uint8_t *data, size_t len)
+{
+    FileHeader h;
+    if (len < sizeof(h))
+        return false;
+    memcpy(&h, data, sizeof(h));
+    return h.magic == FILE_MAGIC && h.recordSize == sizeof(Record);
+}
+
+size_t RangeTestLog::formatCsv(const Record &r, char *buf, size_t size)
+{
+    long hms = r.time % SEC_PER_DAY;
+    const meshtastic_NodeInfoLite *n = nodeDB.getMeshNode(r.from);
+    char distance[16] = "0";
+    if (r.distance)
+        snprintf(distance, sizeof(distance), "%f", r.distance);
+
+    int len = snprintf(buf, size, "%02d:%02d:%02d,%d,%s,%f,%f,%f,%f,%d,%f,%s,%d,\"", (int)(hms / SEC_PER_HOUR),
+                       (int)(hms % SEC_PER_HOUR / SEC_PER_MIN), (int)(hms % SEC_PER_MIN), (int)r.from, n ? n->user.long_name : "",
+                       r.senderLat * 1e-7, r.senderLon * 1e-7, r.rxLat * 1e-7, r.rxLon * 1e-7, r.rxAltitude, r.snr, distance,
+                       r.hopLimit);
+    size_t pos = len > 0 ? len : 0;
+
+    // Then the payload, up to any NUL, with its quotes doubled so a spreadsheet reads it as one field
+    auto put = [&](char c) {
+        if (pos + 1 < size)
+            buf[pos] = c;
+        pos++;
+    };
+    for (size_t i = 0; i < r.payloadSize && r.payload[i]; i++) {
+        if (r.payload[i] == '"')
+            put('"');
+        put(r.payload[i]);
+    }
+    put('"');
+    put('\n');
+    if (size)
+        buf[std::min(pos, size - 1)] = '\0';
+    return pos;
+}
+
+bool RangeTestLog::reserve(size_t len)
+{
+    if (!buf) {
+        buf = static_cast<uint8_t *>(malloc(RANGE_TEST_LOG_BUFFER));
+        if (!buf) {
+            LOG_ERROR("No room to buffer the range test log\n");
+            return false;
+        }
+    }
+    if (used + len > RANGE_TEST_LOG_BUFFER)
+        flush();
+    return used + len <= RANGE_TEST_LOG_BUFFER;
+}
+
+bool RangeTestLog::add(const meshtastic_MeshPacket &mp)
+{
+#ifdef ARCH_ESP32
+    Record r = {};
+    r.time = getTime();
+    r.from = getFrom(&mp);
+    const meshtastic_NodeInfoLite *n = nodeDB.getMeshNode(r.from);
+    if (n) {
+        r.senderLat = n->position.latitude_i;
+        r.senderLon = n->position.longitude_i;
+    }
+    r.rxLat = gpsStatus->getLatitude();
+    r.rxLon = gpsStatus->getLongitude();
+    r.rxAltitude = gpsStatus->getAltitude();
+    r.snr = mp.rx_snr;
+    if (r.senderLat && r.senderLon && r.rxLat && r.rxLon)
+        r.distance = GeoCoord::distanceE7(r.senderLat, r.senderLon, r.rxLat, r.rxLon);
+    r.hopLimit = mp.hop_limit;
+    r.payloadSize = std::min<size_t>(mp.decoded.payload.size, RANGE_TEST_LOG_PAYLOAD);
+    memcpy(r.payload, mp.decoded.payload.bytes, r.payloadSize);
+
+    if (!reserve(RANGE_TEST_LOG_BINARY ? sizeof(r) : 0))
+        return false;
+    if (!used)
+        oldestMsec = millis();
+#if RANGE_TEST_LOG_BINARY
+    memcpy(buf + used, &r, sizeof(r));
+    used += sizeof(r);
+#else
+    // Format it straight into our buffer, and if it didn't fit write out what's there and try again
+    size_t len = formatCsv(r, (char *)buf + used, RANGE_TEST_LOG_BUFFER - used);
+    if (len >= RANGE_TEST_LOG_BUFFER - used && used) {
+        flush();
+        oldestMsec = millis();
+        len = formatCsv(r, (char *)buf, RANGE_TEST_LOG_BUFFER);
+    }
+    used += std::min<size_t>(len, RANGE_TEST_LOG_BUFFER - 1 - used);
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RangeTestLog::flush()
+{
+    if (!used)
+        return;
+#ifdef ARCH_ESP32
+    const char *fileName = RANGE_TEST_LOG_BINARY ? binaryFileName : csvFileName;
+    if (!FSBegin()) {
+        LOG_DEBUG("An Error has occurred while mounting the filesystem\n");
+    } else if (FSCom.totalBytes() - FSCom.usedBytes() < 51200) {
+        LOG_DEBUG("Filesystem doesn't have enough free space. Dropping %u bytes of range test log.\n", used);
+    } else {
+        FSCom.mkdir("/static");
+
+        // A binary log some other build wrote would be misread with our records after it, so start afresh
+        if (RANGE_TEST_LOG_BINARY && !checkedFile && FSCom.exists(fileName)) {
+            uint8_t h[headerSize];
+            File f = FSCom.open(fileName, FILE_O_READ);
+            bool ours = f && f.read(h, sizeof(h)) == sizeof(h) && checkHeader(h, sizeof(h));
+            if (f)
+                f.close();
+            if (!ours) {
+                LOG_WARN("%s isn't a range test log we can read, starting it again\n", fileName);
+                FSCom.remove(fileName);
+            }
+        }
+        checkedFile = true;
+
+        bool fresh = !FSCom.exists(fileName);
+        File f = FSCom.open(fileName, fresh ? FILE_WRITE : FILE_APPEND);
+        if (!f) {
+            LOG_ERROR("There was an error opening %s\n", fileName);
+        } else {
+            if (fresh) {
+#if RANGE_TEST_LOG_BINARY
+                FileHeader h = {FILE_MAGIC, sizeof(Record)};
+                f.write((const uint8_t *)&h, sizeof(h));
+#else
+                f.println(csvHeader);
+#endif
+            }
+            if (f.write(buf, used) != used)
+                LOG_ERROR("Range test log write failed\n");
+            f.close();
+        }
+    }
+#endif
+    used = 0;
+}
+
+uint32_t RangeTestLog::flushIfDue()
+{
+    uint32_t held = millis() - oldestMsec;
+    if (!used || held >= RANGE_TEST_LOG_FLUSH_SECS * 1000) {
+        flush();
+        return RANGE_TEST_LOG_FLUSH_SECS * 1000;
+    }
+    return RANGE_TEST_LOG_FLUSH_SECS * 1000 - held;
+}
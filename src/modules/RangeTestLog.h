@@ -0,0 +1,88 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// How much of what range test receivers log we hold in RAM before writing it out
+#ifndef RANGE_TEST_LOG_BUFFER
+#define RANGE_TEST_LOG_BUFFER 4096
+#endif
+
+/// And the longest we hold it
+#ifndef RANGE_TEST_LOG_FLUSH_SECS
+#define RANGE_TEST_LOG_FLUSH_SECS 60
+#endif
+
+/// Log fixed size binary records to /static/rangetest.bin instead of CSV lines, which the web server turns into CSV as it
+/// serves /rangetest.csv.  About a third of the flash, and no formatting as packets arrive
+#ifndef RANGE_TEST_LOG_BINARY
+#define RANGE_TEST_LOG_BINARY 0
+#endif
+
+/// How much of each payload a binary record keeps
+#ifndef RANGE_TEST_LOG_PAYLOAD
+#define RANGE_TEST_LOG_PAYLOAD 32
+#endif
+
+/**
+ * What a range test receiver logs of the packets it hears.  Rather than opening the file for every packet and writing it a
+ * field at a time, records are gathered in a RAM buffer and appended together, when the buffer is full, once
+ * RANGE_TEST_LOG_FLUSH_SECS have passed since the oldest of them, or before we reboot or sleep.
+ */
+class RangeTestLog
+{
+  public:
+    /// One packet we heard, as a binary log holds it
+    struct Record {
+        uint32_t time; // RTC seconds
+        uint32_t from;
+        int32_t senderLat, senderLon; // 1e-7 degrees, where NodeDB last had it
+        int32_t rxLat, rxLon;         // and where we were
+        int32_t rxAltitude;
+        float snr;
+        float distance; // metres, 0 if either position is unknown
+        uint8_t hopLimit;
+        uint8_t payloadSize;
+        uint8_t payload[RANGE_TEST_LOG_PAYLOAD];
+    };
+
+    /// Log mp, @return false if we couldn't
+    bool add(const meshtastic_MeshPacket &mp);
+
+    /// Write out whatever we're holding
+    void flush();
+
+    /// Flush if we've held our oldest record RANGE_TEST_LOG_FLUSH_SECS, @return ms until we next need calling
+    uint32_t flushIfDue();
+
+    /// Put r as a line of CSV (with its newline) in buf, @return its length, which may be more than size if it didn't fit
+    static size_t formatCsv(const Record &r, char *buf, size_t size);
+
+    /// The header line of our CSV
+    static const char *csvHeader;
+
+    static const char *csvFileName, *binaryFileName;
+
+    /// How long a binary log's header is, and @return whether data is one we can read
+    static const size_t headerSize = 8;
+    static bool checkHeader(const uint8_t *data, size_t len);
+
+  private:
+    /// What a binary log starts with, so records a different build laid out differently aren't misread
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t recordSize;
+    };
+    static const uint32_t FILE_MAGIC = 0x52544c31; // "RTL1"
+
+    uint8_t *buf = NULL; // RANGE_TEST_LOG_BUFFER of it, once we have something to log
+    size_t used = 0;
+    uint32_t oldestMsec = 0;
+    bool checkedFile = false; // whether we've seen that the log we're appending to is one of ours
+
+    /// Make room for at least len more bytes, @return false if we can't
+    bool reserve(size_t len);
+};
+
+extern RangeTestLog rangeTestLog;
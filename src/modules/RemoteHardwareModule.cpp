@@ -5,6 +5,7 @@
 #include "Router.h"
 #include "configuration.h"
 #include "main.h"
+#include <algorithm>
 
 #define NUM_GPIOS 64
 
@@ -14,6 +15,15 @@
 // a max of one change per 30 seconds
 #define WATCH_INTERVAL_MSEC (30 * 1000)
 
+// Changes this close to the first of them go in one message
+#define WATCH_BATCH_MSEC 1000
+
+// How often we read the watched pins ourselves, for those our interrupt doesn't get
+#define WATCH_POLL_MSEC (60 * 1000)
+
+// The module whose pins our interrupt reads
+static RemoteHardwareModule *watching;
+
 /// Set pin modes for every set bit in a mask
 static void pinModes(uint64_t mask, uint8_t mode)
 {
@@ -24,13 +34,11 @@ static void pinModes(uint64_t mask, uint8_t mode)
     }
 }
 
-/// Read all the pins mentioned in a mask
-static uint64_t digitalReads(uint64_t mask)
+/// Read all the pins mentioned in a mask, as they're set up already
+static uint64_t IRAM_ATTR readPins(uint64_t mask)
 {
     uint64_t res = 0;
 
-    pinModes(mask, INPUT_PULLUP);
-
     for (uint64_t i = 0; i < NUM_GPIOS; i++) {
         uint64_t m = 1ULL << i;
         if (mask & m) {
@@ -43,10 +51,104 @@ static uint64_t digitalReads(uint64_t mask)
     return res;
 }
 
+/// Read all the pins mentioned in a mask
+static uint64_t digitalReads(uint64_t mask)
+{
+    pinModes(mask, INPUT_PULLUP);
+    return readPins(mask);
+}
+
+/// The pins the board or another module already has an interrupt on: a watch would take it from them (attachInterrupt() keeps
+/// one handler a pin), and INPUT_PULLUP could upset the radio or whatever else drives them
+static uint64_t reservedPins()
+{
+    const int pins[] = {
+#ifdef BUTTON_PIN
+        config.device.button_gpio ? (int)config.device.button_gpio : BUTTON_PIN,
+#endif
+#ifdef BUTTON_PIN_ALT
+        BUTTON_PIN_ALT,
+#endif
+#ifdef RF95_IRQ
+        RF95_IRQ,
+#endif
+#ifdef RF95_DIO1
+        RF95_DIO1,
+#endif
+#ifdef SX126X_DIO1
+        SX126X_DIO1,
+#endif
+#ifdef SX126X_BUSY
+        SX126X_BUSY,
+#endif
+#ifdef SX128X_DIO1
+        SX128X_DIO1,
+#endif
+#ifdef SX128X_BUSY
+        SX128X_BUSY,
+#endif
+#ifdef ACCELEROMETER_INT_PIN
+        ACCELEROMETER_INT_PIN,
+#endif
+#ifdef PMU_IRQ
+        PMU_IRQ,
+#endif
+#ifdef PIN_GPS_PPS
+        PIN_GPS_PPS,
+#endif
+#ifdef PIN_ETHERNET_INT
+        PIN_ETHERNET_INT,
+#endif
+        -1};
+
+    uint64_t mask = 0;
+    for (int pin : pins)
+        if (pin >= 0 && pin < NUM_GPIOS)
+            mask |= 1ULL << pin;
+
+    if (moduleConfig.detection_sensor.enabled && moduleConfig.detection_sensor.monitor_pin > 0 &&
+        moduleConfig.detection_sensor.monitor_pin < NUM_GPIOS)
+        mask |= 1ULL << moduleConfig.detection_sensor.monitor_pin;
+    if (moduleConfig.canned_message.rotary1_enabled || moduleConfig.canned_message.updown1_enabled) {
+        const uint32_t inputPins[] = {moduleConfig.canned_message.inputbroker_pin_a,
+                                      moduleConfig.canned_message.inputbroker_pin_b,
+                                      moduleConfig.canned_message.inputbroker_pin_press};
+        for (uint32_t pin : inputPins)
+            if (pin < NUM_GPIOS)
+                mask |= 1ULL << pin;
+    }
+    return mask;
+}
+
 RemoteHardwareModule::RemoteHardwareModule()
     : ProtobufModule("remotehardware", meshtastic_PortNum_REMOTE_HARDWARE_APP, &meshtastic_HardwareMessage_msg),
       concurrency::OSThread("RemoteHardwareModule")
 {
+    setWakeSource(true); // our pin-change interrupt
+}
+
+void IRAM_ATTR RemoteHardwareModule::onWatchEdge()
+{
+    if (!watching)
+        return;
+    watching->watchEdges.add(readPins(watching->watchGpios), millis());
+    BaseType_t higherWake = 0;
+    watching->wakeFromISR(&higherWake);
+}
+
+void RemoteHardwareModule::setWatch(uint64_t mask)
+{
+    for (uint8_t i = 0; i < NUM_GPIOS; i++)
+        if (watchGpios & (1ULL << i))
+            detachInterrupt(i);
+    watchEdges.clear();
+
+    watchGpios = mask;
+    watching = mask ? this : NULL;
+    previousWatch = digitalReads(mask);
+    for (uint8_t i = 0; i < NUM_GPIOS; i++)
+        if (mask & (1ULL << i))
+            attachInterrupt(i, onWatchEdge, CHANGE);
 }
 
 bool RemoteHardwareModule::handleReceivedProtobuf(const meshtastic_MeshPacket &req, meshtastic_HardwareMessage *pptr)
@@ -90,10 +192,13 @@ bool RemoteHardwareModule::handleReceivedProtobuf(const meshtastic_MeshPacket &r
         }
 
         case meshtastic_HardwareMessage_Type_WATCH_GPIOS: {
-            watchGpios = p.gpio_mask;
-            lastWatchMsec = 0; // Force a new publish soon
-            previousWatch =
-                ~watchGpios;   // generate a 'previous' value which is guaranteed to not match (to force an initial publish)
+            uint64_t refused = p.gpio_mask & reservedPins();
+            if (refused)
+                LOG_WARN("Not watching GPIOs 0x%llx, they are in use\n", refused);
+            setWatch(p.gpio_mask & ~refused);
+            lastWatchMsec = millis() - WATCH_INTERVAL_MSEC; // Force a new publish soon
+            changedWatch = watchGpios;                      // of every pin, as though they all just changed
+            firstChangeMsec = millis() - WATCH_BATCH_MSEC;
             enabled = true;    // Let our thread run at least once
             setInterval(2000); // Set a new interval so we'll run soon
             LOG_INFO("Now watching GPIOs 0x%llx\n", watchGpios);
@@ -118,26 +223,50 @@ int32_t RemoteHardwareModule::runOnce()
     if (moduleConfig.remote_hardware.enabled && watchGpios) {
         uint32_t now = millis();
 
-        if (now - lastWatchMsec >= WATCH_INTERVAL_MSEC) {
-            uint64_t curVal = digitalReads(watchGpios);
-            lastWatchMsec = now;
-
+        // Note every pin which changed, even if it has since changed back
+        GpioEdgeQueue::Edge e;
+        uint32_t settleMsec;
+        while (watchEdges.take(e, now, settleMsec)) {
+            if (e.value == previousWatch)
+                continue;
+            if (!changedWatch)
+                firstChangeMsec = e.msec;
+            changedWatch |= e.value ^ previousWatch;
+            previousWatch = e.value;
+        }
+        if (!settleMsec) {
+            uint64_t curVal = readPins(watchGpios); // in case its interrupt missed one
             if (curVal != previousWatch) {
+                if (!changedWatch)
+                    firstChangeMsec = now;
+                changedWatch |= curVal ^ previousWatch;
                 previousWatch = curVal;
-                LOG_INFO("Broadcasting GPIOS 0x%llx changed!\n", curVal);
+            }
+        }
+
+        int32_t wait = settleMsec ? settleMsec : WATCH_POLL_MSEC;
+        if (changedWatch) {
+            uint32_t sendAt = std::max(lastWatchMsec + WATCH_INTERVAL_MSEC, firstChangeMsec + WATCH_BATCH_MSEC);
+            if ((int32_t)(now - sendAt) >= 0) {
+                LOG_INFO("Broadcasting GPIOS 0x%llx changed (0x%llx)!\n", previousWatch, changedWatch);
 
                 // Something changed!  Tell the world with a broadcast message
                 meshtastic_HardwareMessage r = meshtastic_HardwareMessage_init_default;
                 r.type = meshtastic_HardwareMessage_Type_GPIOS_CHANGED;
-                r.gpio_value = curVal;
+                r.gpio_value = previousWatch;
+                r.gpio_mask = changedWatch;
                 meshtastic_MeshPacket *p = allocDataProtobuf(r);
                 service.sendToMesh(p);
+                lastWatchMsec = now;
+                changedWatch = 0;
+            } else {
+                wait = std::min<int32_t>(wait, sendAt - now);
             }
         }
+        return wait;
     } else {
         // No longer watching anything - stop using CPU
+        setWatch(0);
         return disable();
     }
-
-    return 2000; // Poll our GPIOs every 2000ms
 }
\ No newline at end of file
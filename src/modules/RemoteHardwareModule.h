@@ -1,4 +1,5 @@
 #pragma once
+#include "GpioEdgeQueue.h"
 #include "ProtobufModule.h"
 #include "concurrency/OSThread.h"
 #include "mesh/generated/meshtastic/remote_hardware.pb.h"
@@ -11,12 +12,24 @@ class RemoteHardwareModule : public ProtobufModule<meshtastic_HardwareMessage>,
     /// The current set of GPIOs we've been asked to watch for changes
     uint64_t watchGpios = 0;
 
-    /// The previously read value of watched pins
+    /// The value of watched pins as of their last edge
     uint64_t previousWatch = 0;
 
+    /// The pins which changed since we last told the mesh, and when the first of them did
+    uint64_t changedWatch = 0;
+    uint32_t firstChangeMsec = 0;
+
     /// The timestamp of our last watch event (we throttle watches to 1 change every 30 seconds)
     uint32_t lastWatchMsec = 0;
 
+    /// Edges our pin-change interrupt saw on the watched pins
+    GpioEdgeQueue watchEdges;
+
+    static void onWatchEdge();
+
+    /// Stop (or start, for the pins in mask) watching
+    void setWatch(uint64_t mask);
+
   public:
     /** Constructor
      * name is for debugging output
@@ -31,8 +44,9 @@ class RemoteHardwareModule : public ProtobufModule<meshtastic_HardwareMessage>,
     virtual bool handleReceivedProtobuf(const meshtastic_MeshPacket &mp, meshtastic_HardwareMessage *p) override;
 
     /**
-     * Periodically read the gpios we have been asked to WATCH, if they have changed,
-     * broadcast a message with the change information.
+     * Take the edges our interrupt saw on the gpios we have been asked to WATCH, and broadcast a message with the change
+     * information (all the edges over a short while, in one).  The pins are read now and then too, for any without an
+     * interrupt.
      *
      * The method that will be called each time our thread gets a chance to run
      *
@@ -30,6 +30,9 @@ class RoutingModule : public ProtobufModule<meshtastic_Routing>
 
     /// Override wantPacket to say we want to see all packets, not just those for our port number
     virtual bool wantPacket(const meshtastic_MeshPacket *p) override { return true; }
+
+    /// And so we don't list any portnums
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override {}
 };
 
 extern RoutingModule *routingModule;
@@ -5,7 +5,9 @@
 #include "RTC.h"
 #include "Router.h"
 #include "configuration.h"
+#include "main.h"
 #include <Arduino.h>
+#include <algorithm>
 
 /*
     SerialModule
@@ -49,7 +51,6 @@
 
 #define RX_BUFFER 256
 #define TIMEOUT 250
-#define BAUD 38400
 #define ACK 1
 
 // API: Defaulting to the formerly removed phone_timeout_secs value of 15 minutes
@@ -134,8 +135,11 @@ int32_t SerialModule::runOnce()
 #ifdef ARCH_ESP32
 
             if (moduleConfig.serial.rxd && moduleConfig.serial.txd) {
-                Serial2.setRxBufferSize(RX_BUFFER);
+                Serial2.setRxBufferSize(getRxBufferSize(baud));
                 Serial2.begin(baud, SERIAL_8N1, moduleConfig.serial.rxd, moduleConfig.serial.txd);
+                // The driver's task calls us when its FIFO fills or the line goes idle, so bursts don't wait for our next poll
+                Serial2.onReceive([this]() { wake(); }, false);
+                rxWake = true;
             } else {
                 Serial.begin(baud);
                 Serial.setTimeout(moduleConfig.serial.timeout > 0 ? moduleConfig.serial.timeout : TIMEOUT);
@@ -143,7 +147,7 @@ int32_t SerialModule::runOnce()
 #elif !defined(TTGO_T_ECHO) && !defined(CANARYONE)
             if (moduleConfig.serial.rxd && moduleConfig.serial.txd) {
 #ifdef ARCH_RP2040
-                Serial2.setFIFOSize(RX_BUFFER);
+                Serial2.setFIFOSize(getRxBufferSize(baud));
                 Serial2.setPinout(moduleConfig.serial.txd, moduleConfig.serial.rxd);
 #else
                 Serial2.setPins(moduleConfig.serial.rxd, moduleConfig.serial.txd);
@@ -168,7 +172,9 @@ int32_t SerialModule::runOnce()
             }
         } else {
             if (moduleConfig.serial.mode == meshtastic_ModuleConfig_SerialConfig_Serial_Mode_PROTO) {
-                return runOncePart();
+                int32_t result = runOncePart();
+                // StreamAPI polls quickly while bytes keep coming, which the UART waking us makes needless
+                return (rxWake && result > 0) ? SERIAL_MODULE_IDLE_MSEC : result;
             } else if (moduleConfig.serial.mode == meshtastic_ModuleConfig_SerialConfig_Serial_Mode_NMEA) {
                 // in NMEA mode send out GGA every 2 seconds, Don't read from Port
                 if (millis() - lastNmeaTime > 2000) {
@@ -179,21 +185,19 @@ int32_t SerialModule::runOnce()
             } else if (moduleConfig.serial.mode == meshtastic_ModuleConfig_SerialConfig_Serial_Mode_CALTOPO) {
                 if (millis() - lastNmeaTime > 10000) {
                     lastNmeaTime = millis();
-                    uint32_t readIndex = 0;
-                    const meshtastic_NodeInfoLite *tempNodeInfo = nodeDB.readNextMeshNode(readIndex);
+                    static NodeDB::MeshNodeWalk walk; // too big for our stack
+                    walk.index = 0;
+                    const meshtastic_NodeInfoLite *tempNodeInfo = nodeDB.readNextMeshNode(walk);
                     while (tempNodeInfo != NULL && tempNodeInfo->has_user && hasValidPosition(tempNodeInfo)) {
                         printWPL(outbuf, sizeof(outbuf), tempNodeInfo->position, tempNodeInfo->user.long_name, true);
                         serialPrint->printf("%s", outbuf);
-                        tempNodeInfo = nodeDB.readNextMeshNode(readIndex);
+                        tempNodeInfo = nodeDB.readNextMeshNode(walk);
                     }
                 }
             }
 #if !defined(TTGO_T_ECHO) && !defined(CANARYONE)
             else {
-                while (Serial2.available()) {
-                    serialPayloadSize = Serial2.readBytes(serialBytes, meshtastic_Constants_DATA_PAYLOAD_LEN);
-                    serialModuleRadio->sendPayload();
-                }
+                return readPayloads();
             }
 #endif
         }
@@ -203,6 +207,50 @@ int32_t SerialModule::runOnce()
     }
 }
 
+size_t SerialModule::getRxBufferSize(uint32_t baud)
+{
+    size_t size = baud / 10 * SERIAL_MODULE_RX_BUFFER_MSEC / 1000; // 10 bits a byte with 8N1
+    return size < RX_BUFFER ? RX_BUFFER : (size > SERIAL_MODULE_RX_BUFFER_MAX ? SERIAL_MODULE_RX_BUFFER_MAX : size);
+}
+
+void SerialModule::wake()
+{
+    setIntervalFromNow(0);
+    runASAP = true;
+    mainDelay.interrupt();
+}
+
+int32_t SerialModule::readPayloads()
+{
+#if !defined(TTGO_T_ECHO) && !defined(CANARYONE)
+    uint32_t now = millis();
+    uint32_t timeout = moduleConfig.serial.timeout > 0 ? moduleConfig.serial.timeout : TIMEOUT;
+    int available;
+    while ((available = Serial2.available()) > 0) {
+        // Never more than available() says, so readBytes() has no reason to wait
+        size_t wanted = std::min((size_t)available, sizeof(serialBytes) - serialPayloadSize);
+        size_t got = Serial2.readBytes(serialBytes + serialPayloadSize, wanted);
+        if (!got)
+            break;
+        serialPayloadSize += got;
+        lastByteMsec = now;
+        if (serialPayloadSize == sizeof(serialBytes)) {
+            serialModuleRadio->sendPayload();
+            serialPayloadSize = 0;
+        }
+    }
+
+    if (serialPayloadSize) {
+        uint32_t idle = now - lastByteMsec;
+        if (idle < timeout)
+            return timeout - idle;
+        serialModuleRadio->sendPayload();
+        serialPayloadSize = 0;
+    }
+#endif
+    return rxWake ? SERIAL_MODULE_IDLE_MSEC : 10;
+}
+
 /**
  * Allocates a new mesh packet for use as a reply to a received packet.
  *
@@ -344,6 +392,6 @@ uint32_t SerialModule::getBaudRate()
     } else if (moduleConfig.serial.baud == meshtastic_ModuleConfig_SerialConfig_Serial_Baud_BAUD_921600) {
         return 921600;
     }
-    return BAUD;
+    return SERIAL_MODULE_BAUD;
 }
 #endif
\ No newline at end of file
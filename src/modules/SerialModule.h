@@ -11,12 +11,36 @@
 #if (defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_RP2040)) && !defined(CONFIG_IDF_TARGET_ESP32S2) &&               \
     !defined(CONFIG_IDF_TARGET_ESP32C3)
 
+/// The baud rate we use when moduleConfig.serial.baud is BAUD_DEFAULT, so a build can pick one it has no value for (1000000)
+#ifndef SERIAL_MODULE_BAUD
+#define SERIAL_MODULE_BAUD 38400
+#endif
+
+/// How many milliseconds of bytes at our baud rate the UART receive buffer holds, within 256 and SERIAL_MODULE_RX_BUFFER_MAX
+#ifndef SERIAL_MODULE_RX_BUFFER_MSEC
+#define SERIAL_MODULE_RX_BUFFER_MSEC 50
+#endif
+#ifndef SERIAL_MODULE_RX_BUFFER_MAX
+#define SERIAL_MODULE_RX_BUFFER_MAX 8192
+#endif
+
+/// How long we sleep for with nothing to do, where the UART wakes us as bytes arrive (elsewhere we poll every 10ms)
+#ifndef SERIAL_MODULE_IDLE_MSEC
+#define SERIAL_MODULE_IDLE_MSEC 250
+#endif
+
 class SerialModule : public StreamAPI, private concurrency::OSThread
 {
     bool firstTime = 1;
     unsigned long lastNmeaTime = millis();
     char outbuf[90] = "";
 
+    /// Does the UART driver call wake() when bytes arrive, so we don't need to poll
+    bool rxWake = false;
+
+    /// When we last got a byte of the payload we are gathering
+    uint32_t lastByteMsec = 0;
+
   public:
     SerialModule();
 
@@ -26,8 +50,24 @@ class SerialModule : public StreamAPI, private concurrency::OSThread
     /// Check the current underlying physical link to see if the client is currently connected
     virtual bool checkIsConnected() override;
 
+    /// We have something for the client in PROTO mode, so write it out now rather than when we next poll
+    virtual void onNowHasData(uint32_t fromRadioNum) override { setIntervalFromNow(0); }
+
   private:
     uint32_t getBaudRate();
+
+    /// How big a UART receive buffer we want at baud
+    static size_t getRxBufferSize(uint32_t baud);
+
+    /// Run us as soon as we can, from the UART driver's task
+    void wake();
+
+    /**
+     * Gather what arrived into payloads, sending each one of them to the mesh as soon as it's full and whatever is left once
+     * nothing more has arrived for moduleConfig.serial.timeout.  So a long burst becomes back to back full payloads, and we never
+     * wait for bytes.  @return when to run again
+     */
+    int32_t readPayloads();
 };
 
 extern SerialModule *serialModule;
@@ -63,6 +103,8 @@ class SerialModuleRadio : public MeshModule
 
     virtual bool wantPacket(const meshtastic_MeshPacket *p) override { return p->decoded.portnum == ourPortNum; }
 
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override { ports.push_back(ourPortNum); }
+
     meshtastic_MeshPacket *allocDataPacket()
     {
         // Update our local node info with our position (even if we don't decide to update anyone else)
@@ -0,0 +1,206 @@
+#include "TakCodec.h"
+#include "NodeDB.h"
+#include "PayloadCompression.h"
+#include "Varint.h"
+#include "concurrency/LockGuard.h"
+#include "configuration.h"
+#include "meshtastic/atak.pb.h"
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include <string.h>
+
+TakCodec *takCodec;
+
+static int compressTak(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return takCodec->compress(p, in, inLen, out, outLen);
+}
+
+static int decompressTak(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    return takCodec->decompress(p, in, inLen, out, outLen);
+}
+
+static void putString(uint8_t *buf, size_t &pos, const char *s)
+{
+    size_t len = strlen(s);
+    putVarint(buf, pos, len);
+    memcpy(buf + pos, s, len);
+    pos += len;
+}
+
+static bool getString(const uint8_t *buf, size_t len, size_t &pos, char *s, size_t size)
+{
+    uint32_t n;
+    if (!getVarint(buf, len, pos, n) || n >= size || n > len - pos)
+        return false;
+    memcpy(s, buf + pos, n);
+    s[n] = '\0';
+    pos += n;
+    return true;
+}
+
+TakCodec::TakCodec()
+{
+    if (!payloadCompression.add({meshtastic_PortNum_ATAK_PLUGIN, ATAK_COMPACT_PORTNUM, "tak", compressTak, decompressTak}))
+        LOG_WARN("No room for the compact TAK codec, TAK packets will go whole\n");
+}
+
+TakCodec::Heard *TakCodec::findHeard(NodeNum from, ChannelIndex channel, bool orOldest)
+{
+    Heard *slot = &heard[0];
+    for (Heard &h : heard) {
+        if (h.from == from && h.channel == channel)
+            return &h;
+        if (slot->from && (!h.from || h.k.atMsec - slot->k.atMsec > INT32_MAX)) // empty or older
+            slot = &h;
+    }
+    return orOldest ? slot : NULL;
+}
+
+int TakCodec::compress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    meshtastic_TAKPacket t = meshtastic_TAKPacket_init_default;
+    if (p.channel >= MAX_NUM_CHANNELS || !pb_decode_from_bytes(in, inLen, &meshtastic_TAKPacket_msg, &t) ||
+        t.which_payload_variant != meshtastic_TAKPacket_pli_tag)
+        return -1;
+    const meshtastic_PLI &pli = t.payload_variant.pli;
+
+    concurrency::LockGuard g(&lock);
+    uint32_t now = millis();
+
+    // Only our own broadcasts are worth a keyframe, and only if it can stand in for our callsigns
+    Sent &s = sent[p.channel];
+    bool ours = p.from == nodeDB.getNodeNum() && p.to == NODENUM_BROADCAST;
+    bool fits = !t.has_contact || (strlen(t.contact.callsign) < ATAK_COMPACT_STRING_LEN &&
+                                   strlen(t.contact.device_callsign) < ATAK_COMPACT_STRING_LEN);
+    bool same = s.valid && s.k.hasContact == t.has_contact &&
+                (!t.has_contact ||
+                 (!strcmp(s.k.callsign, t.contact.callsign) && !strcmp(s.k.deviceCallsign, t.contact.device_callsign)));
+    bool delta = ours && fits && same && s.deltas + 1 < ATAK_COMPACT_KEYFRAME_EVERY &&
+                 now - s.k.atMsec < ATAK_COMPACT_KEYFRAME_SECS * 1000;
+    bool keyframe = ours && fits && !delta;
+
+    uint8_t buf[2 + 2 * (5 + sizeof(t.contact.callsign)) + 9 * 5];
+    size_t len = 0;
+    buf[len++] = (delta ? 0 : WHOLE) | (keyframe ? KEYFRAME : 0) | (t.is_compressed ? COMPRESSED : 0) |
+                 (t.has_contact ? CONTACT : 0) | (t.has_group ? GROUP : 0) | (t.has_status ? STATUS : 0);
+    buf[len++] = keyframe ? s.k.seq + 1 : (delta ? s.k.seq : 0);
+    if (t.has_contact && !delta) {
+        putString(buf, len, t.contact.callsign);
+        putString(buf, len, t.contact.device_callsign);
+    }
+    if (t.has_group) {
+        putVarint(buf, len, t.group.role);
+        putVarint(buf, len, t.group.team);
+    }
+    if (t.has_status)
+        putVarint(buf, len, t.status.battery);
+    if (delta) {
+        putZigzag(buf, len, pli.latitude_i - s.k.lat);
+        putZigzag(buf, len, pli.longitude_i - s.k.lon);
+        putZigzag(buf, len, (int32_t)(pli.altitude - s.k.altitude));
+    } else {
+        putZigzag(buf, len, pli.latitude_i);
+        putZigzag(buf, len, pli.longitude_i);
+        putVarint(buf, len, pli.altitude);
+    }
+    putVarint(buf, len, pli.speed);
+    putVarint(buf, len, pli.course);
+    if (len > outLen)
+        return -1;
+    memcpy(out, buf, len);
+
+    if (keyframe) {
+        s.valid = true;
+        s.deltas = 0;
+        s.k.seq = buf[1];
+        s.k.hasContact = t.has_contact;
+        strcpy(s.k.callsign, t.has_contact ? t.contact.callsign : "");
+        strcpy(s.k.deviceCallsign, t.has_contact ? t.contact.device_callsign : "");
+        s.k.lat = pli.latitude_i;
+        s.k.lon = pli.longitude_i;
+        s.k.altitude = pli.altitude;
+        s.k.atMsec = now;
+    } else if (delta) {
+        s.deltas++;
+    }
+    return len;
+}
+
+int TakCodec::decompress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+    if (inLen < 2 || (in[0] & 0xc0))
+        return -1;
+    uint8_t flags = in[0], seq = in[1];
+    bool whole = flags & WHOLE;
+
+    meshtastic_TAKPacket t = meshtastic_TAKPacket_init_default;
+    t.is_compressed = flags & COMPRESSED;
+    t.has_contact = flags & CONTACT;
+    t.has_group = flags & GROUP;
+    t.has_status = flags & STATUS;
+    t.which_payload_variant = meshtastic_TAKPacket_pli_tag;
+    meshtastic_PLI &pli = t.payload_variant.pli;
+
+    size_t len = 2;
+    uint32_t role, team, battery, altitude, speed, course;
+    int32_t lat, lon, dAltitude;
+    if (t.has_contact && whole &&
+        (!getString(in, inLen, len, t.contact.callsign, sizeof(t.contact.callsign)) ||
+         !getString(in, inLen, len, t.contact.device_callsign, sizeof(t.contact.device_callsign))))
+        return -1;
+    if (t.has_group && (!getVarint(in, inLen, len, role) || !getVarint(in, inLen, len, team)))
+        return -1;
+    if (t.has_status && !getVarint(in, inLen, len, battery))
+        return -1;
+    if (!getZigzag(in, inLen, len, lat) || !getZigzag(in, inLen, len, lon) ||
+        (whole ? !getVarint(in, inLen, len, altitude) : !getZigzag(in, inLen, len, dAltitude)) ||
+        !getVarint(in, inLen, len, speed) || !getVarint(in, inLen, len, course) || len != inLen)
+        return -1;
+    if (t.has_group) {
+        t.group.role = (meshtastic_MemberRole)role;
+        t.group.team = (meshtastic_Team)team;
+    }
+    if (t.has_status)
+        t.status.battery = battery;
+
+    concurrency::LockGuard g(&lock);
+    if (!whole) {
+        Heard *h = findHeard(p.from, p.channel, false);
+        if (!h || h->k.seq != seq || h->k.hasContact != t.has_contact) {
+            LOG_DEBUG("TAK PLI from 0x%x is against keyframe %u, which we missed\n", p.from, seq);
+            return -1;
+        }
+        strcpy(t.contact.callsign, h->k.callsign);
+        strcpy(t.contact.device_callsign, h->k.deviceCallsign);
+        lat += h->k.lat;
+        lon += h->k.lon;
+        altitude = h->k.altitude + dAltitude;
+    }
+    pli.latitude_i = lat;
+    pli.longitude_i = lon;
+    pli.altitude = altitude;
+    pli.speed = speed;
+    pli.course = course;
+
+    pb_ostream_t stream = pb_ostream_from_buffer(out, outLen);
+    if (!pb_encode(&stream, &meshtastic_TAKPacket_msg, &t))
+        return -1;
+
+    if ((flags & KEYFRAME) && strlen(t.contact.callsign) < ATAK_COMPACT_STRING_LEN &&
+        strlen(t.contact.device_callsign) < ATAK_COMPACT_STRING_LEN) {
+        Heard *h = findHeard(p.from, p.channel, true);
+        h->from = p.from;
+        h->channel = p.channel;
+        h->k.seq = seq;
+        h->k.hasContact = t.has_contact;
+        strcpy(h->k.callsign, t.contact.callsign);
+        strcpy(h->k.deviceCallsign, t.contact.device_callsign);
+        h->k.lat = lat;
+        h->k.lon = lon;
+        h->k.altitude = altitude;
+        h->k.atMsec = millis();
+    }
+    return stream.bytes_written;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "concurrency/Lock.h"
+#include "mesh-pb-constants.h"
+
+/// Send ATAK plugin PLIs compactly (see TakCodec).  Nodes without it won't see TAK packets sent this way, so it's for meshes
+/// where everyone has it
+#ifndef ATAK_COMPACT
+#define ATAK_COMPACT 0
+#endif
+
+/// The portnum compact TAK packets go out on, one nothing upstream uses
+#ifndef ATAK_COMPACT_PORTNUM
+#define ATAK_COMPACT_PORTNUM ((meshtastic_PortNum)260)
+#endif
+
+/// Send a keyframe (everything, for others to work out the next PLIs from) at least every this many broadcasts
+#ifndef ATAK_COMPACT_KEYFRAME_EVERY
+#define ATAK_COMPACT_KEYFRAME_EVERY 8
+#endif
+
+/// And at least this often, so nobody who missed one waits too long
+#ifndef ATAK_COMPACT_KEYFRAME_SECS
+#define ATAK_COMPACT_KEYFRAME_SECS (10 * 60)
+#endif
+
+/// How many other nodes' keyframes we keep
+#ifndef ATAK_COMPACT_SENDERS
+#define ATAK_COMPACT_SENDERS 8
+#endif
+
+/// The longest (compressed) callsign a keyframe can stand in for, longer ones are sent in every packet
+#define ATAK_COMPACT_STRING_LEN 32
+
+/**
+ * A PayloadCodec for ATAK_PLUGIN, which packs each PLI by hand rather than as a protobuf.  A keyframe carries the callsign
+ * and device callsign (as AtakPluginModule compressed them) and the position whole.  The broadcasts after it just say which
+ * keyframe they follow, leaving out the callsigns (so TAK's same few strings aren't sent over and over) and sending lat, lon
+ * and altitude as deltas against it.  A new keyframe goes out whenever a callsign changes.
+ *
+ * As with PositionCodec, a delta whose keyframe the receiver missed can't be decoded, and is dropped.  Packets to one node,
+ * and others' which we relay, go whole.  Chats go as the protobuf they are.
+ *
+ * Our payload: a header byte (the flags below), the keyframe's sequence number, then for a keyframe or whole packet the
+ * callsigns, each as a varint length and its bytes, then the group's role and team, the status's battery, and the PLI's lat,
+ * lon, altitude, speed and course, all varints (zigzag for the signed and the deltas), present as the flags say.
+ */
+class TakCodec
+{
+  public:
+    enum : uint8_t {
+        WHOLE = 0x01,      // the callsigns and position are whole, not against a keyframe
+        KEYFRAME = 0x02,   // and the sender's next deltas will be against them
+        COMPRESSED = 0x04, // the TAKPacket's is_compressed
+        CONTACT = 0x08,
+        GROUP = 0x10,
+        STATUS = 0x20,
+    };
+
+    /// Makes us payloadCompression's codec for ATAK_PLUGIN
+    TakCodec();
+
+    int compress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+    int decompress(const meshtastic_MeshPacket &p, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+
+  private:
+    /// What a keyframe stood for
+    struct Keyframe {
+        uint8_t seq;
+        bool hasContact;
+        char callsign[ATAK_COMPACT_STRING_LEN];
+        char deviceCallsign[ATAK_COMPACT_STRING_LEN];
+        int32_t lat, lon;
+        uint32_t altitude;
+        uint32_t atMsec;
+    };
+
+    /// The last keyframe we sent on a channel
+    struct Sent {
+        bool valid;
+        uint8_t deltas; // sent since
+        Keyframe k;
+    };
+
+    /// The last keyframe we heard from a node on a channel
+    struct Heard {
+        NodeNum from; // 0 for an empty slot
+        ChannelIndex channel;
+        Keyframe k;
+    };
+
+    concurrency::Lock lock; // the router and the phone API can both decode
+    Sent sent[MAX_NUM_CHANNELS] = {};
+    Heard heard[ATAK_COMPACT_SENDERS] = {};
+
+    Heard *findHeard(NodeNum from, ChannelIndex channel, bool orOldest);
+};
+
+extern TakCodec *takCodec;
@@ -5,6 +5,7 @@
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "Router.h"
+#include "TelemetryHistory.h"
 #include "configuration.h"
 #include "main.h"
 #include <OLEDDisplay.h>
@@ -12,20 +13,39 @@
 
 #define MAGIC_USB_BATTERY_LEVEL 101
 
+const TelemetryMetric DeviceTelemetryModule::windowMetrics[] = {
+    TELEMETRY_METRIC(device_metrics, voltage, TELEMETRY_CHANGE_VOLTAGE),
+    TELEMETRY_METRIC(device_metrics, channel_utilization, 0),
+    TELEMETRY_METRIC(device_metrics, air_util_tx, 0)};
+const size_t DeviceTelemetryModule::numWindowMetrics = sizeof(windowMetrics) / sizeof(windowMetrics[0]);
+
 int32_t DeviceTelemetryModule::runOnce()
 {
     uint32_t now = millis();
-    if (((lastSentToMesh == 0) ||
+    meshtastic_Telemetry telemetry = getDeviceTelemetry();
+#if TELEMETRY_HISTORY
+    telemetryHistory.record(telemetry, windowMetrics, numWindowMetrics);
+#endif
+#if TELEMETRY_AGGREGATE
+    bool jumped = window.add(telemetry) && now - lastSentToMesh >= TELEMETRY_CHANGE_HOLDOFF_SECS * 1000;
+#else
+    bool jumped = false;
+#endif
+    if (((lastSentToMesh == 0) || jumped ||
          ((now - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.telemetry.device_update_interval))) &&
         airTime->isTxAllowedChannelUtil() && airTime->isTxAllowedAirUtil() &&
         config.device.role != meshtastic_Config_DeviceConfig_Role_REPEATER &&
         config.device.role != meshtastic_Config_DeviceConfig_Role_CLIENT_HIDDEN) {
-        sendTelemetry();
+        meshtastic_Telemetry summary = telemetry;
+#if TELEMETRY_AGGREGATE
+        window.summarize(summary);
+#endif
+        sendTelemetry(summary);
         lastSentToMesh = now;
     } else if (service.isToPhoneQueueEmpty()) {
         // Just send to phone when it's not our time to send to mesh yet
         // Only send while queue is empty (phone assumed connected)
-        sendTelemetry(NODENUM_BROADCAST, true);
+        sendTelemetry(telemetry, NODENUM_BROADCAST, true);
     }
     return sendToPhoneIntervalMs;
 }
@@ -81,9 +101,8 @@ meshtastic_Telemetry DeviceTelemetryModule::getDeviceTelemetry()
     return t;
 }
 
-bool DeviceTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
+bool DeviceTelemetryModule::sendTelemetry(const meshtastic_Telemetry &telemetry, NodeNum dest, bool phoneOnly)
 {
-    meshtastic_Telemetry telemetry = getDeviceTelemetry();
     LOG_INFO("(Sending): air_util_tx=%f, channel_utilization=%f, battery_level=%i, voltage=%f\n",
              telemetry.variant.device_metrics.air_util_tx, telemetry.variant.device_metrics.channel_utilization,
              telemetry.variant.device_metrics.battery_level, telemetry.variant.device_metrics.voltage);
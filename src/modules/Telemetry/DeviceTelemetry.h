@@ -2,6 +2,7 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "ProtobufModule.h"
+#include "TelemetryWindow.h"
 #include <OLEDDisplay.h>
 #include <OLEDDisplayUi.h>
 
@@ -10,7 +11,8 @@ class DeviceTelemetryModule : private concurrency::OSThread, public ProtobufModu
   public:
     DeviceTelemetryModule()
         : concurrency::OSThread("DeviceTelemetryModule"),
-          ProtobufModule("DeviceTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg)
+          ProtobufModule("DeviceTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg),
+          window(windowMetrics, numWindowMetrics)
     {
         setIntervalFromNow(45 * 1000); // Wait until NodeInfo is sent
     }
@@ -26,10 +28,15 @@ class DeviceTelemetryModule : private concurrency::OSThread, public ProtobufModu
     /**
      * Send our Telemetry into the mesh
      */
-    bool sendTelemetry(NodeNum dest = NODENUM_BROADCAST, bool phoneOnly = false);
+    bool sendTelemetry(const meshtastic_Telemetry &telemetry, NodeNum dest = NODENUM_BROADCAST, bool phoneOnly = false);
 
   private:
     meshtastic_Telemetry getDeviceTelemetry();
     uint32_t sendToPhoneIntervalMs = SECONDS_IN_MINUTE * 1000; // Send to phone every minute
     uint32_t lastSentToMesh = 0;
+
+    /// What our window aggregates, sampled each runOnce()
+    static const TelemetryMetric windowMetrics[];
+    static const size_t numWindowMetrics;
+    TelemetryWindow window;
 };
@@ -5,6 +5,7 @@
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "Router.h"
+#include "TelemetryHistory.h"
 #include "configuration.h"
 #include "main.h"
 #include "power.h"
@@ -30,6 +31,16 @@ SHTC3Sensor shtc3Sensor;
 LPS22HBSensor lps22hbSensor;
 SHT31Sensor sht31Sensor;
 
+/// Our sensors in the order their readings go into a measurement (later ones win where they overlap)
+static TelemetrySensor *const environmentSensors[] = {&sht31Sensor,   &lps22hbSensor, &shtc3Sensor,
+                                                      &bmp280Sensor,  &bme280Sensor,  &bme680Sensor,
+                                                      &mcp9808Sensor, &ina219Sensor,  &ina260Sensor};
+#define NUM_ENVIRONMENT_SENSORS (sizeof(environmentSensors) / sizeof(environmentSensors[0]))
+
+/// Whether each is converting for startSampling(), and when its next step is due
+static bool sensorConverting[NUM_ENVIRONMENT_SENSORS];
+static uint32_t sensorDueMsec[NUM_ENVIRONMENT_SENSORS];
+
 #define FAILED_STATE_SENSOR_READ_MULTIPLIER 10
 #define DISPLAY_RECEIVEID_MEASUREMENTS_ON_SCREEN true
 
@@ -113,22 +124,100 @@ int32_t EnvironmentTelemetryModule::runOnce()
         }
 
         uint32_t now = millis();
-        if (((lastSentToMesh == 0) ||
-             ((now - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.telemetry.environment_update_interval))) &&
-            airTime->isTxAllowedAirUtil()) {
-            sendTelemetry();
+        uint32_t started = micros();
+        if (sampling) {
+            uint32_t wait = pollSampling();
+            if (wait) {
+                result = min(result, wait);
+            } else {
+                sampling = false;
+                sampled();
+                cycleStallUs += micros() - started;
+                maxCycleStallUs = max(maxCycleStallUs, cycleStallUs);
+                LOG_DEBUG("Environment Telemetry: reading sensors held up the loop for %uus (at worst %uus)\n", cycleStallUs,
+                          maxCycleStallUs);
+                return min(sendToPhoneIntervalMs, result);
+            }
+        } else if (((lastSentToMesh == 0) ||
+                    ((now - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.telemetry.environment_update_interval))) &&
+                   airTime->isTxAllowedAirUtil()) {
+            startSampling(SAMPLE_FOR_MESH);
             lastSentToMesh = now;
+            result = min(result, pollSampling());
         } else if (((lastSentToPhone == 0) || ((now - lastSentToPhone) >= sendToPhoneIntervalMs)) &&
                    (service.isToPhoneQueueEmpty())) {
             // Just send to phone when it's not our time to send to mesh yet
             // Only send while queue is empty (phone assumed connected)
-            sendTelemetry(NODENUM_BROADCAST, true);
+            startSampling(SAMPLE_FOR_PHONE);
             lastSentToPhone = now;
+            result = min(result, pollSampling());
+        } else if (TELEMETRY_AGGREGATE && now - lastSampled >= TELEMETRY_SAMPLE_SECS * 1000) {
+            startSampling(SAMPLE_ONLY);
+            result = min(result, pollSampling());
         }
+        if (sampling)
+            cycleStallUs += micros() - started;
+        if (sampling && !result)
+            result = 1; // all ready already, send next time round
     }
     return min(sendToPhoneIntervalMs, result);
 }
 
+/**
+ * Starts a conversion on each of our sensors which has one, a bus at a time so each bus's transactions go back to back.  They
+ * then all convert at once, while the loop gets on with other things, rather than each in turn with the loop waiting.
+ */
+const TelemetryMetric EnvironmentTelemetryModule::windowMetrics[] = {
+    TELEMETRY_METRIC(environment_metrics, temperature, TELEMETRY_CHANGE_TEMPERATURE),
+    TELEMETRY_METRIC(environment_metrics, relative_humidity, TELEMETRY_CHANGE_HUMIDITY),
+    TELEMETRY_METRIC(environment_metrics, barometric_pressure, TELEMETRY_CHANGE_PRESSURE),
+    TELEMETRY_METRIC(environment_metrics, gas_resistance, 0),
+    TELEMETRY_METRIC(environment_metrics, voltage, TELEMETRY_CHANGE_VOLTAGE),
+    TELEMETRY_METRIC(environment_metrics, current, TELEMETRY_CHANGE_CURRENT)};
+const size_t EnvironmentTelemetryModule::numWindowMetrics = sizeof(windowMetrics) / sizeof(windowMetrics[0]);
+
+void EnvironmentTelemetryModule::startSampling(SamplePurpose purpose)
+{
+    sampling = true;
+    samplePurpose = purpose;
+    lastSampled = millis();
+    cycleStallUs = 0;
+
+    bool started[NUM_ENVIRONMENT_SENSORS] = {};
+    uint32_t now = millis();
+    for (size_t i = 0; i < NUM_ENVIRONMENT_SENSORS; i++) {
+        if (started[i])
+            continue;
+        TwoWire *bus = environmentSensors[i]->getBus();
+        for (size_t j = i; j < NUM_ENVIRONMENT_SENSORS; j++) {
+            TelemetrySensor *sensor = environmentSensors[j];
+            if (started[j] || sensor->getBus() != bus)
+                continue;
+            started[j] = true;
+            uint32_t wait = sensor->hasSensor() ? sensor->startMeasurement() : 0;
+            sensorConverting[j] = wait != 0;
+            sensorDueMsec[j] = now + wait;
+        }
+    }
+}
+
+uint32_t EnvironmentTelemetryModule::pollSampling()
+{
+    uint32_t now = millis(), wait = UINT32_MAX;
+    for (size_t i = 0; i < NUM_ENVIRONMENT_SENSORS; i++) {
+        if (!sensorConverting[i])
+            continue;
+        if ((int32_t)(sensorDueMsec[i] - now) <= 0) {
+            uint32_t next = environmentSensors[i]->pollMeasurement();
+            sensorConverting[i] = next != 0;
+            sensorDueMsec[i] = now + next;
+        }
+        if (sensorConverting[i])
+            wait = min(wait, max(sensorDueMsec[i] - now, (uint32_t)1));
+    }
+    return wait == UINT32_MAX ? 0 : wait;
+}
+
 bool EnvironmentTelemetryModule::wantUIFrame()
 {
     return moduleConfig.telemetry.environment_screen_enabled;
@@ -215,73 +304,92 @@ bool EnvironmentTelemetryModule::handleReceivedProtobuf(const meshtastic_MeshPac
     return false; // Let others look at this message also if they want
 }
 
-bool EnvironmentTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
+void EnvironmentTelemetryModule::sampled()
 {
     meshtastic_Telemetry m;
+    if (!readMetrics(&m))
+        return;
+#if TELEMETRY_HISTORY
+    telemetryHistory.record(m, windowMetrics, numWindowMetrics);
+#endif
+
+#if TELEMETRY_AGGREGATE
+    // Between sends we only add to our window, unless a reading jumps
+    uint32_t now = millis();
+    bool early = window.add(m) && samplePurpose != SAMPLE_FOR_MESH &&
+                 now - lastSentToMesh >= TELEMETRY_CHANGE_HOLDOFF_SECS * 1000 && airTime->isTxAllowedAirUtil();
+    if (samplePurpose == SAMPLE_FOR_MESH || early) {
+        if (early)
+            lastSentToMesh = now;
+        meshtastic_Telemetry summary = m;
+        window.summarize(summary);
+        sendTelemetry(summary);
+        return;
+    }
+#else
+    if (samplePurpose == SAMPLE_FOR_MESH) {
+        sendTelemetry(m);
+        return;
+    }
+#endif
+    if (samplePurpose == SAMPLE_FOR_PHONE)
+        sendTelemetry(m, NODENUM_BROADCAST, true); // the phone gets what we read just now
+}
+
+bool EnvironmentTelemetryModule::readMetrics(meshtastic_Telemetry *m)
+{
     bool valid = false;
-    m.time = getTime();
-    m.which_variant = meshtastic_Telemetry_environment_metrics_tag;
-
-    m.variant.environment_metrics.barometric_pressure = 0;
-    m.variant.environment_metrics.current = 0;
-    m.variant.environment_metrics.gas_resistance = 0;
-    m.variant.environment_metrics.relative_humidity = 0;
-    m.variant.environment_metrics.temperature = 0;
-    m.variant.environment_metrics.voltage = 0;
-
-    if (sht31Sensor.hasSensor())
-        valid = sht31Sensor.getMetrics(&m);
-    if (lps22hbSensor.hasSensor())
-        valid = lps22hbSensor.getMetrics(&m);
-    if (shtc3Sensor.hasSensor())
-        valid = shtc3Sensor.getMetrics(&m);
-    if (bmp280Sensor.hasSensor())
-        valid = bmp280Sensor.getMetrics(&m);
-    if (bme280Sensor.hasSensor())
-        valid = bme280Sensor.getMetrics(&m);
-    if (bme680Sensor.hasSensor())
-        valid = bme680Sensor.getMetrics(&m);
-    if (mcp9808Sensor.hasSensor())
-        valid = mcp9808Sensor.getMetrics(&m);
-    if (ina219Sensor.hasSensor())
-        valid = ina219Sensor.getMetrics(&m);
-    if (ina260Sensor.hasSensor())
-        valid = ina260Sensor.getMetrics(&m);
-
-    if (valid) {
-        LOG_INFO("(Sending): barometric_pressure=%f, current=%f, gas_resistance=%f, relative_humidity=%f, temperature=%f, "
-                 "voltage=%f\n",
-                 m.variant.environment_metrics.barometric_pressure, m.variant.environment_metrics.current,
-                 m.variant.environment_metrics.gas_resistance, m.variant.environment_metrics.relative_humidity,
-                 m.variant.environment_metrics.temperature, m.variant.environment_metrics.voltage);
-
-        sensor_read_error_count = 0;
-
-        meshtastic_MeshPacket *p = allocDataProtobuf(m);
-        p->to = dest;
-        p->decoded.want_response = false;
-        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
-            p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
-        else
-            p->priority = meshtastic_MeshPacket_Priority_MIN;
-        // release previous packet before occupying a new spot
-        if (lastMeasurementPacket != nullptr)
-            packetPool.release(lastMeasurementPacket);
+    m->time = getTime();
+    m->which_variant = meshtastic_Telemetry_environment_metrics_tag;
+
+    m->variant.environment_metrics.barometric_pressure = 0;
+    m->variant.environment_metrics.current = 0;
+    m->variant.environment_metrics.gas_resistance = 0;
+    m->variant.environment_metrics.relative_humidity = 0;
+    m->variant.environment_metrics.temperature = 0;
+    m->variant.environment_metrics.voltage = 0;
+
+    // Those with conversions startSampling() started have their readings ready, so none of this waits
+    for (TelemetrySensor *sensor : environmentSensors)
+        if (sensor->hasSensor())
+            valid = sensor->getMetrics(m);
+    return valid;
+}
 
-        lastMeasurementPacket = packetPool.allocCopy(*p);
-        if (phoneOnly) {
-            LOG_INFO("Sending packet to phone\n");
-            service.sendToPhone(p);
-        } else {
-            LOG_INFO("Sending packet to mesh\n");
-            service.sendToMesh(p, RX_SRC_LOCAL, true);
+bool EnvironmentTelemetryModule::sendTelemetry(const meshtastic_Telemetry &m, NodeNum dest, bool phoneOnly)
+{
+    LOG_INFO("(Sending): barometric_pressure=%f, current=%f, gas_resistance=%f, relative_humidity=%f, temperature=%f, "
+             "voltage=%f\n",
+             m.variant.environment_metrics.barometric_pressure, m.variant.environment_metrics.current,
+             m.variant.environment_metrics.gas_resistance, m.variant.environment_metrics.relative_humidity,
+             m.variant.environment_metrics.temperature, m.variant.environment_metrics.voltage);
+
+    sensor_read_error_count = 0;
+
+    meshtastic_MeshPacket *p = allocDataProtobuf(m);
+    p->to = dest;
+    p->decoded.want_response = false;
+    if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
+        p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
+    else
+        p->priority = meshtastic_MeshPacket_Priority_MIN;
+    // release previous packet before occupying a new spot
+    if (lastMeasurementPacket != nullptr)
+        packetPool.release(lastMeasurementPacket);
+
+    lastMeasurementPacket = packetPool.allocCopy(*p);
+    if (phoneOnly) {
+        LOG_INFO("Sending packet to phone\n");
+        service.sendToPhone(p);
+    } else {
+        LOG_INFO("Sending packet to mesh\n");
+        service.sendToMesh(p, RX_SRC_LOCAL, true);
 
-            if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
-                LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
-                sleepOnNextExecution = true;
-                setIntervalFromNow(5000);
-            }
+        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
+            LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
+            sleepOnNextExecution = true;
+            setIntervalFromNow(5000);
         }
     }
-    return valid;
+    return true;
 }
\ No newline at end of file
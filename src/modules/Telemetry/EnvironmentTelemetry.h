@@ -2,6 +2,7 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "ProtobufModule.h"
+#include "TelemetryWindow.h"
 #include <OLEDDisplay.h>
 #include <OLEDDisplayUi.h>
 
@@ -10,7 +11,8 @@ class EnvironmentTelemetryModule : private concurrency::OSThread, public Protobu
   public:
     EnvironmentTelemetryModule()
         : concurrency::OSThread("EnvironmentTelemetryModule"),
-          ProtobufModule("EnvironmentTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg)
+          ProtobufModule("EnvironmentTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg),
+          window(windowMetrics, numWindowMetrics)
     {
         lastMeasurementPacket = nullptr;
         setIntervalFromNow(10 * 1000);
@@ -31,7 +33,22 @@ class EnvironmentTelemetryModule : private concurrency::OSThread, public Protobu
     /**
      * Send our Telemetry into the mesh
      */
-    bool sendTelemetry(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
+    bool sendTelemetry(const meshtastic_Telemetry &m, NodeNum dest = NODENUM_BROADCAST, bool phoneOnly = false);
+
+    /// What we read our sensors for: just our window, or to send to the phone or mesh as well
+    enum SamplePurpose : uint8_t { SAMPLE_ONLY, SAMPLE_FOR_PHONE, SAMPLE_FOR_MESH };
+
+    /// Start reading our sensors, which runOnce() carries on with until they're all ready
+    void startSampling(SamplePurpose purpose);
+
+    /// Move on any sensor whose next step is due, @return ms until the next is, or 0 when they're all ready
+    uint32_t pollSampling();
+
+    /// Read what our sensors have ready into m, @return false if none had anything
+    bool readMetrics(meshtastic_Telemetry *m);
+
+    /// Our sensors are ready: add what they read to our window, and send whatever our purpose (or a jump) calls for
+    void sampled();
 
   private:
     float CelsiusToFahrenheit(float c);
@@ -41,4 +58,18 @@ class EnvironmentTelemetryModule : private concurrency::OSThread, public Protobu
     uint32_t lastSentToMesh = 0;
     uint32_t lastSentToPhone = 0;
     uint32_t sensor_read_error_count = 0;
+
+    /// What we're reading our sensors for, if we are
+    bool sampling = false;
+    SamplePurpose samplePurpose = SAMPLE_ONLY;
+    uint32_t lastSampled = 0;
+
+    /// What our window aggregates
+    static const TelemetryMetric windowMetrics[];
+    static const size_t numWindowMetrics;
+    TelemetryWindow window;
+
+    /// How long we've held up the main loop reading sensors this time round, and at worst since boot
+    uint32_t cycleStallUs = 0;
+    uint32_t maxCycleStallUs = 0;
 };
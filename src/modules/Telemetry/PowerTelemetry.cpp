@@ -1,10 +1,12 @@
 #include "PowerTelemetry.h"
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
+#include "EnergyStats.h"
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "PowerFSM.h"
 #include "RTC.h"
 #include "Router.h"
+#include "TelemetryHistory.h"
 #include "configuration.h"
 #include "main.h"
 #include "power.h"
@@ -81,16 +83,35 @@ int32_t PowerTelemetryModule::runOnce()
             return disable();
 
         uint32_t now = millis();
-        if (((lastSentToMesh == 0) ||
+        meshtastic_Telemetry m;
+        if (!readMetrics(&m))
+            return min(sendToPhoneIntervalMs, result);
+        // An INA on our own battery is what our energy estimates are really costing us
+        if (config.power.device_battery_ina_address)
+            energyStats.calibrate(ina3221Sensor.hasSensor() ? m.variant.power_metrics.ch1_current
+                                                            : m.variant.environment_metrics.current);
+#if TELEMETRY_HISTORY
+        telemetryHistory.record(m, windowMetrics, numWindowMetrics);
+#endif
+#if TELEMETRY_AGGREGATE
+        bool jumped = window.add(m) && now - lastSentToMesh >= TELEMETRY_CHANGE_HOLDOFF_SECS * 1000;
+#else
+        bool jumped = false;
+#endif
+        if (((lastSentToMesh == 0) || jumped ||
              ((now - lastSentToMesh) >= getConfiguredOrDefaultMs(moduleConfig.telemetry.power_update_interval))) &&
             airTime->isTxAllowedAirUtil()) {
-            sendTelemetry();
+            meshtastic_Telemetry summary = m;
+#if TELEMETRY_AGGREGATE
+            window.summarize(summary);
+#endif
+            sendTelemetry(summary);
             lastSentToMesh = now;
         } else if (((lastSentToPhone == 0) || ((now - lastSentToPhone) >= sendToPhoneIntervalMs)) &&
                    (service.isToPhoneQueueEmpty())) {
             // Just send to phone when it's not our time to send to mesh yet
             // Only send while queue is empty (phone assumed connected)
-            sendTelemetry(NODENUM_BROADCAST, true);
+            sendTelemetry(m, NODENUM_BROADCAST, true);
             lastSentToPhone = now;
         }
     }
@@ -175,61 +196,71 @@ bool PowerTelemetryModule::handleReceivedProtobuf(const meshtastic_MeshPacket &m
     return false; // Let others look at this message also if they want
 }
 
-bool PowerTelemetryModule::sendTelemetry(NodeNum dest, bool phoneOnly)
+const TelemetryMetric PowerTelemetryModule::windowMetrics[] = {
+    TELEMETRY_METRIC(power_metrics, ch1_voltage, TELEMETRY_CHANGE_VOLTAGE),
+    TELEMETRY_METRIC(power_metrics, ch1_current, TELEMETRY_CHANGE_CURRENT),
+    TELEMETRY_METRIC(power_metrics, ch2_voltage, TELEMETRY_CHANGE_VOLTAGE),
+    TELEMETRY_METRIC(power_metrics, ch2_current, TELEMETRY_CHANGE_CURRENT),
+    TELEMETRY_METRIC(power_metrics, ch3_voltage, TELEMETRY_CHANGE_VOLTAGE),
+    TELEMETRY_METRIC(power_metrics, ch3_current, TELEMETRY_CHANGE_CURRENT)};
+const size_t PowerTelemetryModule::numWindowMetrics = sizeof(windowMetrics) / sizeof(windowMetrics[0]);
+
+bool PowerTelemetryModule::readMetrics(meshtastic_Telemetry *m)
 {
-    meshtastic_Telemetry m;
     bool valid = false;
-    m.time = getTime();
-    m.which_variant = meshtastic_Telemetry_power_metrics_tag;
-
-    m.variant.power_metrics.ch1_voltage = 0;
-    m.variant.power_metrics.ch1_current = 0;
-    m.variant.power_metrics.ch2_voltage = 0;
-    m.variant.power_metrics.ch2_current = 0;
-    m.variant.power_metrics.ch3_voltage = 0;
-    m.variant.power_metrics.ch3_current = 0;
+    m->time = getTime();
+    m->which_variant = meshtastic_Telemetry_power_metrics_tag;
+
+    m->variant.power_metrics.ch1_voltage = 0;
+    m->variant.power_metrics.ch1_current = 0;
+    m->variant.power_metrics.ch2_voltage = 0;
+    m->variant.power_metrics.ch2_current = 0;
+    m->variant.power_metrics.ch3_voltage = 0;
+    m->variant.power_metrics.ch3_current = 0;
 #if HAS_TELEMETRY && !defined(ARCH_PORTDUINO)
     if (ina219Sensor.hasSensor())
-        valid = ina219Sensor.getMetrics(&m);
+        valid = ina219Sensor.getMetrics(m);
     if (ina260Sensor.hasSensor())
-        valid = ina260Sensor.getMetrics(&m);
+        valid = ina260Sensor.getMetrics(m);
     if (ina3221Sensor.hasSensor())
-        valid = ina3221Sensor.getMetrics(&m);
+        valid = ina3221Sensor.getMetrics(m);
 #endif
+    return valid;
+}
 
-    if (valid) {
-        LOG_INFO("(Sending): ch1_voltage=%f, ch1_current=%f, ch2_voltage=%f, ch2_current=%f, "
-                 "ch3_voltage=%f, ch3_current=%f\n",
-                 m.variant.power_metrics.ch1_voltage, m.variant.power_metrics.ch1_current, m.variant.power_metrics.ch2_voltage,
-                 m.variant.power_metrics.ch2_current, m.variant.power_metrics.ch3_voltage, m.variant.power_metrics.ch3_current);
-
-        sensor_read_error_count = 0;
-
-        meshtastic_MeshPacket *p = allocDataProtobuf(m);
-        p->to = dest;
-        p->decoded.want_response = false;
-        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
-            p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
-        else
-            p->priority = meshtastic_MeshPacket_Priority_MIN;
-        // release previous packet before occupying a new spot
-        if (lastMeasurementPacket != nullptr)
-            packetPool.release(lastMeasurementPacket);
+bool PowerTelemetryModule::sendTelemetry(const meshtastic_Telemetry &m, NodeNum dest, bool phoneOnly)
+{
+    LOG_INFO("(Sending): ch1_voltage=%f, ch1_current=%f, ch2_voltage=%f, ch2_current=%f, "
+             "ch3_voltage=%f, ch3_current=%f\n",
+             m.variant.power_metrics.ch1_voltage, m.variant.power_metrics.ch1_current, m.variant.power_metrics.ch2_voltage,
+             m.variant.power_metrics.ch2_current, m.variant.power_metrics.ch3_voltage, m.variant.power_metrics.ch3_current);
+
+    sensor_read_error_count = 0;
 
-        lastMeasurementPacket = packetPool.allocCopy(*p);
-        if (phoneOnly) {
-            LOG_INFO("Sending packet to phone\n");
-            service.sendToPhone(p);
-        } else {
-            LOG_INFO("Sending packet to mesh\n");
-            service.sendToMesh(p, RX_SRC_LOCAL, true);
-
-            if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
-                LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
-                sleepOnNextExecution = true;
-                setIntervalFromNow(5000);
-            }
+    meshtastic_MeshPacket *p = allocDataProtobuf(m);
+    p->to = dest;
+    p->decoded.want_response = false;
+    if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR)
+        p->priority = meshtastic_MeshPacket_Priority_RELIABLE;
+    else
+        p->priority = meshtastic_MeshPacket_Priority_MIN;
+    // release previous packet before occupying a new spot
+    if (lastMeasurementPacket != nullptr)
+        packetPool.release(lastMeasurementPacket);
+
+    lastMeasurementPacket = packetPool.allocCopy(*p);
+    if (phoneOnly) {
+        LOG_INFO("Sending packet to phone\n");
+        service.sendToPhone(p);
+    } else {
+        LOG_INFO("Sending packet to mesh\n");
+        service.sendToMesh(p, RX_SRC_LOCAL, true);
+
+        if (config.device.role == meshtastic_Config_DeviceConfig_Role_SENSOR && config.power.is_power_saving) {
+            LOG_DEBUG("Starting next execution in 5 seconds and then going to sleep.\n");
+            sleepOnNextExecution = true;
+            setIntervalFromNow(5000);
         }
     }
-    return valid;
+    return true;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "ProtobufModule.h"
+#include "TelemetryWindow.h"
 #include <OLEDDisplay.h>
 #include <OLEDDisplayUi.h>
 
@@ -10,7 +11,8 @@ class PowerTelemetryModule : private concurrency::OSThread, public ProtobufModul
   public:
     PowerTelemetryModule()
         : concurrency::OSThread("PowerTelemetryModule"),
-          ProtobufModule("PowerTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg)
+          ProtobufModule("PowerTelemetry", meshtastic_PortNum_TELEMETRY_APP, &meshtastic_Telemetry_msg),
+          window(windowMetrics, numWindowMetrics)
     {
         lastMeasurementPacket = nullptr;
         setIntervalFromNow(10 * 1000);
@@ -31,7 +33,10 @@ class PowerTelemetryModule : private concurrency::OSThread, public ProtobufModul
     /**
      * Send our Telemetry into the mesh
      */
-    bool sendTelemetry(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
+    bool sendTelemetry(const meshtastic_Telemetry &m, NodeNum dest = NODENUM_BROADCAST, bool phoneOnly = false);
+
+    /// Read our sensors into m, @return false if none had anything
+    bool readMetrics(meshtastic_Telemetry *m);
 
   private:
     bool firstTime = 1;
@@ -40,4 +45,9 @@ class PowerTelemetryModule : private concurrency::OSThread, public ProtobufModul
     uint32_t lastSentToMesh = 0;
     uint32_t lastSentToPhone = 0;
     uint32_t sensor_read_error_count = 0;
+
+    /// What our window aggregates, sampled each runOnce()
+    static const TelemetryMetric windowMetrics[];
+    static const size_t numWindowMetrics;
+    TelemetryWindow window;
 };
@@ -14,22 +14,35 @@ int32_t BME280Sensor::runOnce()
         return DEFAULT_SENSOR_MINIMUM_WAIT_TIME_BETWEEN_READS;
     }
     status = bme280.begin(nodeTelemetrySensorsMap[sensorType].first, nodeTelemetrySensorsMap[sensorType].second);
+    setSampling();
 
+    return initI2CSensor();
+}
+
+void BME280Sensor::setup() {}
+
+void BME280Sensor::setSampling()
+{
     bme280.setSampling(Adafruit_BME280::MODE_FORCED,
                        Adafruit_BME280::SAMPLING_X1, // Temp. oversampling
                        Adafruit_BME280::SAMPLING_X1, // Pressure oversampling
                        Adafruit_BME280::SAMPLING_X1, // Humidity oversampling
                        Adafruit_BME280::FILTER_OFF, Adafruit_BME280::STANDBY_MS_1000);
-
-    return initI2CSensor();
 }
 
-void BME280Sensor::setup() {}
+uint32_t BME280Sensor::startMeasurement()
+{
+    setSampling();
+    measuring = true;
+    return 10; // at most 9.3ms at these oversamplings
+}
 
 bool BME280Sensor::getMetrics(meshtastic_Telemetry *measurement)
 {
     LOG_DEBUG("BME280Sensor::getMetrics\n");
-    bme280.takeForcedMeasurement();
+    if (!measuring)
+        bme280.takeForcedMeasurement();
+    measuring = false;
     measurement->variant.environment_metrics.temperature = bme280.readTemperature();
     measurement->variant.environment_metrics.relative_humidity = bme280.readHumidity();
     measurement->variant.environment_metrics.barometric_pressure = bme280.readPressure() / 100.0F;
@@ -6,6 +6,10 @@ class BME280Sensor : public TelemetrySensor
 {
   private:
     Adafruit_BME280 bme280;
+    bool measuring = false; // startMeasurement() has started a conversion getMetrics() hasn't read
+
+    /// Our settings, which (being in forced mode) also start a conversion
+    void setSampling();
 
   protected:
     virtual void setup() override;
@@ -13,5 +17,6 @@ class BME280Sensor : public TelemetrySensor
   public:
     BME280Sensor();
     virtual int32_t runOnce() override;
+    virtual uint32_t startMeasurement() override;
     virtual bool getMetrics(meshtastic_Telemetry *measurement) override;
 };
\ No newline at end of file
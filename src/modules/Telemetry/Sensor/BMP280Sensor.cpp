@@ -15,21 +15,34 @@ int32_t BMP280Sensor::runOnce()
     }
     bmp280 = Adafruit_BMP280(nodeTelemetrySensorsMap[sensorType].second);
     status = bmp280.begin(nodeTelemetrySensorsMap[sensorType].first);
+    setSampling();
 
+    return initI2CSensor();
+}
+
+void BMP280Sensor::setup() {}
+
+void BMP280Sensor::setSampling()
+{
     bmp280.setSampling(Adafruit_BMP280::MODE_FORCED,
                        Adafruit_BMP280::SAMPLING_X1, // Temp. oversampling
                        Adafruit_BMP280::SAMPLING_X1, // Pressure oversampling
                        Adafruit_BMP280::FILTER_OFF, Adafruit_BMP280::STANDBY_MS_1000);
-
-    return initI2CSensor();
 }
 
-void BMP280Sensor::setup() {}
+uint32_t BMP280Sensor::startMeasurement()
+{
+    setSampling();
+    measuring = true;
+    return 7; // at most 6.4ms at these oversamplings
+}
 
 bool BMP280Sensor::getMetrics(meshtastic_Telemetry *measurement)
 {
     LOG_DEBUG("BMP280Sensor::getMetrics\n");
-    bmp280.takeForcedMeasurement();
+    if (!measuring)
+        bmp280.takeForcedMeasurement();
+    measuring = false;
     measurement->variant.environment_metrics.temperature = bmp280.readTemperature();
     measurement->variant.environment_metrics.barometric_pressure = bmp280.readPressure() / 100.0F;
 
@@ -21,10 +21,33 @@ void SHT31Sensor::setup()
     // Set up oversampling and filter initialization
 }
 
+uint32_t SHT31Sensor::startMeasurement()
+{
+    // A single shot at high repeatability, without clock stretching so the bus is free while it converts
+    measured = false;
+    return i2cCommand(0x2400) ? 16 : 0; // at most 15ms
+}
+
+uint32_t SHT31Sensor::pollMeasurement()
+{
+    uint16_t words[2];
+    measured = i2cReadWords(words, 2);
+    if (measured) {
+        temperature = -45 + 175.0f * words[0] / 65535;
+        humidity = 100.0f * words[1] / 65535;
+    }
+    return 0;
+}
+
 bool SHT31Sensor::getMetrics(meshtastic_Telemetry *measurement)
 {
-    measurement->variant.environment_metrics.temperature = sht31.readTemperature();
-    measurement->variant.environment_metrics.relative_humidity = sht31.readHumidity();
+    if (!measured) {
+        temperature = sht31.readTemperature();
+        humidity = sht31.readHumidity();
+    }
+    measured = false;
+    measurement->variant.environment_metrics.temperature = temperature;
+    measurement->variant.environment_metrics.relative_humidity = humidity;
 
     return true;
 }
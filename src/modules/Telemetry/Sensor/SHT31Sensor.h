@@ -7,11 +7,17 @@ class SHT31Sensor : public TelemetrySensor
   private:
     Adafruit_SHT31 sht31 = Adafruit_SHT31();
 
+    /// What pollMeasurement() read, for getMetrics()
+    bool measured = false;
+    float temperature = 0, humidity = 0;
+
   protected:
     virtual void setup() override;
 
   public:
     SHT31Sensor();
     virtual int32_t runOnce() override;
+    virtual uint32_t startMeasurement() override;
+    virtual uint32_t pollMeasurement() override;
     virtual bool getMetrics(meshtastic_Telemetry *measurement) override;
 };
@@ -21,13 +21,45 @@ void SHTC3Sensor::setup()
     // Set up oversampling and filter initialization
 }
 
-bool SHTC3Sensor::getMetrics(meshtastic_Telemetry *measurement)
+uint32_t SHTC3Sensor::startMeasurement()
 {
-    sensors_event_t humidity, temp;
-    shtc3.getEvent(&humidity, &temp);
+    // It sleeps between readings (the library leaves it so), and takes up to 240us to wake
+    measured = false;
+    step = i2cCommand(0x3517) ? SHTC3_WAKING : SHTC3_IDLE;
+    return step == SHTC3_WAKING ? 1 : 0;
+}
+
+uint32_t SHTC3Sensor::pollMeasurement()
+{
+    if (step == SHTC3_WAKING) {
+        // Temperature first, at normal power, without clock stretching so the bus is free while it converts
+        step = i2cCommand(0x7866) ? SHTC3_CONVERTING : SHTC3_IDLE;
+        return step == SHTC3_CONVERTING ? 13 : 0; // at most 12.1ms
+    }
+    if (step == SHTC3_CONVERTING) {
+        uint16_t words[2];
+        measured = i2cReadWords(words, 2);
+        if (measured) {
+            temperature = -45 + 175.0f * words[0] / 65536;
+            humidity = 100.0f * words[1] / 65536;
+        }
+        i2cCommand(0xb098); // back to sleep
+    }
+    step = SHTC3_IDLE;
+    return 0;
+}
 
-    measurement->variant.environment_metrics.temperature = temp.temperature;
-    measurement->variant.environment_metrics.relative_humidity = humidity.relative_humidity;
+bool SHTC3Sensor::getMetrics(meshtastic_Telemetry *measurement)
+{
+    if (!measured) {
+        sensors_event_t humidityEvent, tempEvent;
+        shtc3.getEvent(&humidityEvent, &tempEvent);
+        temperature = tempEvent.temperature;
+        humidity = humidityEvent.relative_humidity;
+    }
+    measured = false;
+    measurement->variant.environment_metrics.temperature = temperature;
+    measurement->variant.environment_metrics.relative_humidity = humidity;
 
     return true;
 }
\ No newline at end of file
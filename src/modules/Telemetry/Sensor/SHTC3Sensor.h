@@ -7,11 +7,18 @@ class SHTC3Sensor : public TelemetrySensor
   private:
     Adafruit_SHTC3 shtc3 = Adafruit_SHTC3();
 
+    /// Where startMeasurement() and pollMeasurement() are: waking it, converting, or done (measured, for getMetrics())
+    enum { SHTC3_IDLE, SHTC3_WAKING, SHTC3_CONVERTING } step = SHTC3_IDLE;
+    bool measured = false;
+    float temperature = 0, humidity = 0;
+
   protected:
     virtual void setup() override;
 
   public:
     SHTC3Sensor();
     virtual int32_t runOnce() override;
+    virtual uint32_t startMeasurement() override;
+    virtual uint32_t pollMeasurement() override;
     virtual bool getMetrics(meshtastic_Telemetry *measurement) override;
 };
\ No newline at end of file
@@ -2,3 +2,39 @@
 #include "../mesh/generated/meshtastic/telemetry.pb.h"
 #include "NodeDB.h"
 #include "main.h"
+#include <Wire.h>
+
+/// CRC-8 (polynomial 0x31, from 0xff) which Sensirion's sensors follow each word with
+static uint8_t sensirionCRC(uint16_t word)
+{
+    uint8_t crc = 0xff;
+    for (int i = 1; i >= 0; i--) {
+        crc ^= (uint8_t)(word >> (8 * i));
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+bool TelemetrySensor::i2cCommand(uint16_t command)
+{
+    TwoWire *bus = getBus();
+    bus->beginTransmission(nodeTelemetrySensorsMap[sensorType].first);
+    bus->write((uint8_t)(command >> 8));
+    bus->write((uint8_t)command);
+    return bus->endTransmission() == 0;
+}
+
+bool TelemetrySensor::i2cReadWords(uint16_t *words, size_t n)
+{
+    TwoWire *bus = getBus();
+    if (bus->requestFrom(nodeTelemetrySensorsMap[sensorType].first, (uint8_t)(n * 3)) != n * 3)
+        return false;
+    bool okay = true;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t hi = bus->read(), lo = bus->read(), crc = bus->read();
+        words[i] = (hi << 8) | lo;
+        okay &= sensirionCRC(words[i]) == crc;
+    }
+    return okay;
+}
@@ -37,9 +37,27 @@ class TelemetrySensor
     }
     virtual void setup();
 
+    /// Send our sensor a 16 bit command (as Sensirion's take them), @return false if it didn't ack
+    bool i2cCommand(uint16_t command);
+
+    /// Read n 16 bit words from our sensor, each followed by its Sensirion CRC, @return false if any is bad
+    bool i2cReadWords(uint16_t *words, size_t n);
+
   public:
     bool hasSensor() { return nodeTelemetrySensorsMap[sensorType].first > 0; }
 
+    /// The bus our sensor is on
+    TwoWire *getBus() { return nodeTelemetrySensorsMap[sensorType].second; }
+
+    /**
+     * Reading without blocking, for EnvironmentTelemetryModule's scheduler: startMeasurement() starts a conversion and
+     * pollMeasurement() moves it along, each returning how many ms until the next step is due, or 0 once getMetrics() can read
+     * the result without waiting.  Sensors which never wait keep these defaults, and getMetrics() still works (blocking) for
+     * anyone who doesn't start a measurement first.
+     */
+    virtual uint32_t startMeasurement() { return 0; }
+    virtual uint32_t pollMeasurement() { return 0; }
+
     virtual int32_t runOnce() = 0;
     virtual bool isInitialized() { return initialized; }
     virtual bool isRunning() { return status > 0; }
@@ -0,0 +1,300 @@
+#include "TelemetryHistory.h"
+#include "FSCommon.h"
+#include "gps/RTC.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
+#include <stdio.h>
+
+#if TELEMETRY_HISTORY && defined(FSCom)
+#define TELEMETRY_HISTORY_USE_FLASH 1
+#else
+#define TELEMETRY_HISTORY_USE_FLASH 0
+#endif
+
+/// How many records we read from a file at a time
+#define HISTORY_READ_BLOCK 16
+
+TelemetryHistory telemetryHistory;
+
+/// The slot seq goes in, seq 1 in the first so a file grows one slot at a time
+static uint32_t slotFor(uint32_t seq, uint32_t capacity)
+{
+    return (seq - 1) % capacity;
+}
+
+uint32_t TelemetryHistory::recordCRC(const Record &r)
+{
+    return crc32Buffer(&r, offsetof(Record, crc));
+}
+
+uint16_t TelemetryHistory::seriesKey(const char *name)
+{
+    uint32_t hash = 2166136261u; // FNV-1a, folded to 16 bits
+    for (const char *c = name; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return (hash >> 16) ^ (hash & 0xffff);
+}
+
+void TelemetryHistory::getSeriesName(size_t i, char *buf, size_t len) const
+{
+    const TelemetryMetric *m = i < numSeries ? series[i].metric : NULL;
+    snprintf(buf, len, "%s.%s", m ? m->kind : "", m ? m->name : "");
+}
+
+void TelemetryHistory::init()
+{
+#if TELEMETRY_HISTORY_USE_FLASH
+    FSCom.mkdir("/telemetry");
+    sizeRings();
+    scan(minutes);
+    scan(hours);
+    LOG_INFO("Telemetry history holds %u minute and %u hour records\n", std::min(minutes.nextSeq - 1, minutes.capacity),
+             std::min(hours.nextSeq - 1, hours.capacity));
+#endif
+    ready = true;
+}
+
+void TelemetryHistory::sizeRings()
+{
+#if TELEMETRY_HISTORY_USE_FLASH
+    // What our files take already is ours to keep using
+    uint64_t room = 0;
+    for (RingFile *f : {&minutes, &hours}) {
+        auto file = FSCom.open(f->name, FILE_O_READ);
+        if (file) {
+            room += file.size();
+            file.close();
+        }
+    }
+    size_t used = FSCom.usedBytes(), total = FSCom.totalBytes();
+    room = (room + (used < total ? total - used : 0)) * TELEMETRY_HISTORY_FREE_PERCENT / 100;
+
+    // Shrink both alike.  The records of a file which shrank are in the wrong slots now, so scan() skips them
+    uint64_t want = (uint64_t)(minutes.capacity + hours.capacity) * sizeof(Record);
+    if (want > room) {
+        minutes.capacity = std::max<uint32_t>(minutes.capacity * room / want, 1);
+        hours.capacity = std::max<uint32_t>(hours.capacity * room / want, 1);
+        LOG_WARN("Only room for %u minute and %u hour telemetry records\n", minutes.capacity, hours.capacity);
+    }
+#endif
+}
+
+void TelemetryHistory::scan(RingFile &f)
+{
+#if TELEMETRY_HISTORY_USE_FLASH
+    auto file = FSCom.open(f.name, FILE_O_READ);
+    if (!file)
+        return;
+    f.numFile = std::min<uint32_t>(file.size() / sizeof(Record), f.capacity);
+
+    // Our newest record tells us where to carry on from
+    uint32_t newestSeq = 0;
+    Record block[HISTORY_READ_BLOCK];
+    for (uint32_t i = 0; i < f.numFile; i += HISTORY_READ_BLOCK) {
+        uint32_t n = std::min<uint32_t>(f.numFile - i, HISTORY_READ_BLOCK);
+        if (file.read((uint8_t *)block, n * sizeof(Record)) != (int)(n * sizeof(Record)))
+            break;
+        for (uint32_t j = 0; j < n; j++) {
+            const Record &r = block[j];
+            if (r.seq && slotFor(r.seq, f.capacity) == i + j && recordCRC(r) == r.crc)
+                newestSeq = std::max(newestSeq, r.seq);
+        }
+    }
+    file.close();
+    f.nextSeq = newestSeq + 1;
+#endif
+}
+
+TelemetryHistory::Series *TelemetryHistory::findSeries(const TelemetryMetric *metric)
+{
+    for (size_t i = 0; i < numSeries; i++)
+        if (series[i].metric == metric)
+            return &series[i];
+    if (numSeries == TELEMETRY_HISTORY_SERIES)
+        return NULL;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s.%s", metric->kind, metric->name);
+    uint16_t key = seriesKey(name);
+    for (size_t i = 0; i < numSeries; i++)
+        if (series[i].key == key) {
+            LOG_WARN("Telemetry history can't keep %s, its key is taken\n", name);
+            return NULL;
+        }
+    Series &s = series[numSeries++];
+    s = {metric, key, {}, {}};
+    return &s;
+}
+
+void TelemetryHistory::add(Bucket &b, uint32_t epoch, float sum, uint16_t count, float min, float max)
+{
+    if (!b.count) {
+        b = {epoch, count, sum, min, max};
+    } else {
+        b.count += count;
+        b.sum += sum;
+        b.min = std::min(b.min, min);
+        b.max = std::max(b.max, max);
+    }
+}
+
+void TelemetryHistory::record(const meshtastic_Telemetry &t, const TelemetryMetric *metrics, size_t numMetrics)
+{
+    if (!TELEMETRY_HISTORY)
+        return;
+    uint32_t epoch = getValidTime(RTCQualityDevice);
+    if (!epoch)
+        return; // we couldn't tell when it was
+    if (!ready)
+        init();
+
+    for (size_t i = 0; i < numMetrics; i++) {
+        Series *s = findSeries(&metrics[i]);
+        if (!s)
+            continue;
+        float v = TelemetryWindow::get(t, metrics[i]);
+
+        raw[nextRaw] = {epoch, s->key, v};
+        nextRaw = (nextRaw + 1) % TELEMETRY_HISTORY_RAW;
+        numRaw = std::min<size_t>(numRaw + 1, TELEMETRY_HISTORY_RAW);
+
+        uint32_t minute = epoch - epoch % 60;
+        if (s->minute.count && s->minute.epoch != minute)
+            closeMinute(*s);
+        add(s->minute, minute, v, 1, v, v);
+    }
+
+    if ((minutes.numPending || hours.numPending) && millis() - pendingSinceMsec >= TELEMETRY_HISTORY_FLUSH_SECS * 1000)
+        flush();
+}
+
+void TelemetryHistory::closeMinute(Series &s)
+{
+    Bucket &m = s.minute;
+    uint32_t hour = m.epoch - m.epoch % 3600;
+    if (s.hour.count && s.hour.epoch != hour)
+        close(hours, s.key, s.hour);
+    add(s.hour, hour, m.sum, m.count, m.min, m.max);
+    close(minutes, s.key, m);
+}
+
+void TelemetryHistory::close(RingFile &f, uint16_t key, Bucket &b)
+{
+    if (!b.count)
+        return;
+    if (f.numPending == TELEMETRY_HISTORY_PENDING)
+        write(f);
+    if (!minutes.numPending && !hours.numPending)
+        pendingSinceMsec = millis();
+    f.pending[f.numPending++] = {0, b.epoch, key, b.count, b.sum / b.count, b.min, b.max, 0};
+    b.count = 0;
+}
+
+void TelemetryHistory::flush()
+{
+    write(minutes);
+    write(hours);
+}
+
+void TelemetryHistory::write(RingFile &f)
+{
+    if (!f.numPending)
+        return;
+    for (size_t i = 0; i < f.numPending; i++) {
+        f.pending[i].seq = f.nextSeq + i;
+        f.pending[i].crc = recordCRC(f.pending[i]);
+    }
+
+    bool okay = false;
+#if TELEMETRY_HISTORY_USE_FLASH
+    // A run of slots at a time, two if we wrap around the end of the file
+    auto file = FSCom.open(f.name, f.numFile ? FILE_O_PATCH : FILE_O_WRITE);
+    if (file) {
+        okay = true;
+        for (size_t i = 0; okay && i < f.numPending;) {
+            uint32_t slot = slotFor(f.pending[i].seq, f.capacity);
+            size_t n = std::min<size_t>(f.numPending - i, f.capacity - slot);
+            okay = file.seek(slot * sizeof(Record)) &&
+                   file.write((const uint8_t *)&f.pending[i], n * sizeof(Record)) == n * sizeof(Record);
+            i += n;
+        }
+        file.close();
+    }
+#endif
+    if (okay) {
+        f.nextSeq += f.numPending;
+        f.numFile = std::min(f.capacity, std::max(f.numFile, f.nextSeq - 1));
+    } else {
+        LOG_ERROR("Error: can't write %u records to %s\n", f.numPending, f.name);
+    }
+    f.numPending = 0;
+}
+
+void TelemetryHistory::readAll(const RingFile &f, const std::function<bool(const Record &)> &visit)
+{
+#if TELEMETRY_HISTORY_USE_FLASH
+    if (f.nextSeq == 1)
+        return;
+    auto file = FSCom.open(f.name, FILE_O_READ);
+    if (!file)
+        return;
+
+    // From our oldest record on, a block of slots at a time
+    uint32_t seq = f.nextSeq > f.capacity ? f.nextSeq - f.capacity : 1;
+    Record block[HISTORY_READ_BLOCK];
+    while (seq != f.nextSeq) {
+        uint32_t slot = slotFor(seq, f.capacity);
+        uint32_t n = std::min<uint32_t>(std::min<uint32_t>(f.nextSeq - seq, f.capacity - slot), HISTORY_READ_BLOCK);
+        if (!file.seek(slot * sizeof(Record)) || file.read((uint8_t *)block, n * sizeof(Record)) != (int)(n * sizeof(Record)))
+            break;
+        for (uint32_t i = 0; i < n; i++) {
+            const Record &r = block[i];
+            if (r.seq == seq + i && recordCRC(r) == r.crc && !visit(r)) {
+                file.close();
+                return;
+            }
+        }
+        seq += n;
+    }
+    file.close();
+#endif
+}
+
+size_t TelemetryHistory::query(uint16_t key, Tier tier, uint32_t from, uint32_t to,
+                               const std::function<bool(const Point &)> &visit)
+{
+    if (!ready)
+        init();
+    size_t numPoints = 0;
+    bool more = true;
+    auto take = [&](const Point &p) {
+        if (p.epoch >= from && p.epoch <= to) {
+            numPoints++;
+            more = visit(p);
+        }
+        return more;
+    };
+
+    if (tier == TIER_RAW) {
+        size_t first = numRaw < TELEMETRY_HISTORY_RAW ? 0 : nextRaw;
+        for (size_t i = 0; more && i < numRaw; i++) {
+            const RawSample &r = raw[(first + i) % TELEMETRY_HISTORY_RAW];
+            if (r.key == key)
+                take({r.epoch, 1, r.value, r.value, r.value});
+        }
+        return numPoints;
+    }
+
+    // What's on flash, then what's still waiting to go there, then what we're rolling up now
+    RingFile &f = tier == TIER_MINUTE ? minutes : hours;
+    auto takeRecord = [&](const Record &r) { return r.key != key || take({r.epoch, r.count, r.mean, r.min, r.max}); };
+    readAll(f, takeRecord);
+    for (size_t i = 0; more && i < f.numPending; i++)
+        takeRecord(f.pending[i]);
+    for (size_t i = 0; more && i < numSeries; i++) {
+        const Bucket &b = tier == TIER_MINUTE ? series[i].minute : series[i].hour;
+        if (series[i].key == key && b.count)
+            take({b.epoch, b.count, b.sum / b.count, b.min, b.max});
+    }
+    return numPoints;
+}
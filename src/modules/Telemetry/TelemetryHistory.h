@@ -0,0 +1,175 @@
+#pragma once
+
+#include "TelemetryWindow.h"
+#include "configuration.h"
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Keep a history of our own telemetry (see TelemetryHistory), so it can be read back from us rather than asked for again.
+/// Opt in with -DTELEMETRY_HISTORY=1
+#ifndef TELEMETRY_HISTORY
+#define TELEMETRY_HISTORY 0
+#endif
+
+/// How many of our latest samples (of all metrics together) we keep as they were, in RAM
+#ifndef TELEMETRY_HISTORY_RAW
+#if !TELEMETRY_HISTORY
+#define TELEMETRY_HISTORY_RAW 1 // we keep nothing, so take next to no RAM
+#elif defined(ARCH_NRF52)
+#define TELEMETRY_HISTORY_RAW 64
+#else
+#define TELEMETRY_HISTORY_RAW 256
+#endif
+#endif
+
+/// How many minute and hour records (of all metrics together) our files on flash hold, before the oldest are written over.
+/// Each takes 28 bytes.  Both files together never hold more than TELEMETRY_HISTORY_FREE_PERCENT of what's free
+#ifndef TELEMETRY_HISTORY_MINUTES
+#ifdef ARCH_NRF52
+#define TELEMETRY_HISTORY_MINUTES 128
+#else
+#define TELEMETRY_HISTORY_MINUTES 2048
+#endif
+#endif
+#ifndef TELEMETRY_HISTORY_HOURS
+#ifdef ARCH_NRF52
+#define TELEMETRY_HISTORY_HOURS 128
+#else
+#define TELEMETRY_HISTORY_HOURS 4096
+#endif
+#endif
+
+/// Finished records wait in RAM for up to this long (or until there are TELEMETRY_HISTORY_PENDING of them), so flash is
+/// written a batch at a time rather than every minute
+#ifndef TELEMETRY_HISTORY_FLUSH_SECS
+#define TELEMETRY_HISTORY_FLUSH_SECS (15 * 60)
+#endif
+#ifndef TELEMETRY_HISTORY_PENDING
+#define TELEMETRY_HISTORY_PENDING (TELEMETRY_HISTORY ? 48 : 1)
+#endif
+
+/// The most of the filesystem's free space (counting what our files already take) our ring files are sized to fill
+#ifndef TELEMETRY_HISTORY_FREE_PERCENT
+#define TELEMETRY_HISTORY_FREE_PERCENT 50
+#endif
+
+/// The most metrics we keep a history of
+#define TELEMETRY_HISTORY_SERIES 16
+
+/**
+ * Our own telemetry over time, so a dashboard or phone can read it back from us in one go rather than asking the mesh for
+ * it again and again.  Each metric a telemetry module samples is a series, kept three ways:
+ *
+ * - the latest samples as they were, in a ring in RAM shared by every series
+ * - one record per minute (the mean, min and max of that minute's samples) in a ring file on flash
+ * - one record per hour, rolled up from those minutes, in another
+ *
+ * The ring files are fixed size arrays of records, each with its own sequence number and CRC, so after a reboot we find
+ * where we left off (and skip a record we didn't finish writing) by reading them through once.  Besides query(), they can
+ * be fetched as they are with the API's file transfer.  We only keep samples taken while we know the time.
+ */
+class TelemetryHistory
+{
+  public:
+    enum Tier { TIER_RAW, TIER_MINUTE, TIER_HOUR };
+
+    /// What a series held over a time; for TIER_RAW one sample, with mean, min and max the same
+    struct Point {
+        uint32_t epoch; // start of its minute or hour, when it was sampled for TIER_RAW
+        uint16_t count; // samples it's over
+        float mean, min, max;
+    };
+
+    /// One minute or hour of a series in our files, just as it's kept on flash
+    struct Record {
+        uint32_t seq;   // bumped by every record of the file, 0 for a slot we haven't written
+        uint32_t epoch; // start of its minute or hour
+        uint16_t key;   // its series, see seriesKey()
+        uint16_t count;
+        float mean, min, max;
+        uint32_t crc; // crc32Buffer() of all of the above
+    };
+
+    /// Add what metrics sampled in t (of the telemetry module which keeps them)
+    void record(const meshtastic_Telemetry &t, const TelemetryMetric *metrics, size_t numMetrics);
+
+    /// Write what's waiting to flash now, say before we reboot
+    void flush();
+
+    size_t getNumSeries() const { return numSeries; }
+
+    /// Put series i's name ("environment_metrics.temperature", say) in buf
+    void getSeriesName(size_t i, char *buf, size_t len) const;
+
+    /// @return the key of the series with this name (we may not have it)
+    static uint16_t seriesKey(const char *name);
+
+    /// Call visit for each point of series key in tier from from to to (epochs, inclusive) in time order, until it returns
+    /// false.  @return how many points it was called for
+    size_t query(uint16_t key, Tier tier, uint32_t from, uint32_t to, const std::function<bool(const Point &)> &visit);
+
+  private:
+    /// What we are rolling up into the current minute or hour of a series
+    struct Bucket {
+        uint32_t epoch; // its start, 0 for none yet
+        uint16_t count;
+        float sum, min, max;
+    };
+
+    struct Series {
+        const TelemetryMetric *metric;
+        uint16_t key;
+        Bucket minute, hour;
+    };
+    Series series[TELEMETRY_HISTORY_SERIES];
+    size_t numSeries = 0;
+
+    struct RawSample {
+        uint32_t epoch;
+        uint16_t key;
+        float value;
+    };
+    RawSample raw[TELEMETRY_HISTORY_RAW];
+    size_t numRaw = 0, nextRaw = 0;
+
+    /// One of our ring files, and its records which haven't been written to it yet
+    struct RingFile {
+        const char *name;
+        uint32_t capacity; // in records
+        uint32_t nextSeq;
+        uint32_t numFile; // records the file has room for so far
+        Record pending[TELEMETRY_HISTORY_PENDING];
+        size_t numPending;
+    };
+    RingFile minutes = {"/telemetry/minutes.dat", TELEMETRY_HISTORY_MINUTES, 1, 0, {}, 0};
+    RingFile hours = {"/telemetry/hours.dat", TELEMETRY_HISTORY_HOURS, 1, 0, {}, 0};
+
+    /// When (by millis()) the oldest record still pending went in
+    uint32_t pendingSinceMsec = 0;
+    bool ready = false;
+
+    /// Size our files to the room we have, and find where they left off
+    void init();
+    void sizeRings();
+    void scan(RingFile &f);
+
+    Series *findSeries(const TelemetryMetric *metric);
+
+    /// Take count samples adding up to sum into b, which starts at epoch
+    static void add(Bucket &b, uint32_t epoch, float sum, uint16_t count, float min, float max);
+
+    /// Close s's minute into a record, and roll it up into its hour
+    void closeMinute(Series &s);
+
+    /// Close b into a record of f (if it holds anything)
+    void close(RingFile &f, uint16_t key, Bucket &b);
+    void write(RingFile &f);
+
+    /// Call visit for every valid record of f in order, until it returns false
+    void readAll(const RingFile &f, const std::function<bool(const Record &)> &visit);
+
+    static uint32_t recordCRC(const Record &r);
+};
+
+extern TelemetryHistory telemetryHistory;
@@ -0,0 +1,62 @@
+#include "TelemetryWindow.h"
+#include "configuration.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+TelemetryWindow::TelemetryWindow(const TelemetryMetric *metrics, size_t numMetrics)
+    : metrics(metrics), numMetrics(std::min<size_t>(numMetrics, TELEMETRY_WINDOW_METRICS))
+{
+}
+
+float TelemetryWindow::get(const meshtastic_Telemetry &t, const TelemetryMetric &m)
+{
+    float v;
+    memcpy(&v, (const uint8_t *)&t + m.offset, sizeof(v));
+    return v;
+}
+
+void TelemetryWindow::set(meshtastic_Telemetry &t, const TelemetryMetric &m, float v)
+{
+    memcpy((uint8_t *)&t + m.offset, &v, sizeof(v));
+}
+
+bool TelemetryWindow::add(const meshtastic_Telemetry &t)
+{
+    bool jumped = false;
+    for (size_t i = 0; i < numMetrics; i++) {
+        float v = get(t, metrics[i]);
+        Aggregate &a = aggregates[i];
+        if (!count) {
+            a = {v, v, v};
+        } else {
+            a.min = std::min(a.min, v);
+            a.max = std::max(a.max, v);
+            a.sum += v;
+        }
+        if (haveSent && metrics[i].threshold > 0 && fabsf(v - lastSent[i]) >= metrics[i].threshold) {
+            LOG_INFO("Telemetry: %s went from %f to %f\n", metrics[i].name, lastSent[i], v);
+            jumped = true;
+        }
+    }
+    count++;
+    return jumped;
+}
+
+size_t TelemetryWindow::summarize(meshtastic_Telemetry &t)
+{
+    size_t n = count;
+    for (size_t i = 0; n && i < numMetrics; i++) {
+        const Aggregate &a = aggregates[i];
+        float mean = a.sum / n;
+        LOG_DEBUG("Telemetry: %s over %u samples min=%f mean=%f max=%f\n", metrics[i].name, n, a.min, mean, a.max);
+        set(t, metrics[i], mean);
+    }
+
+    // Jumps are measured from what we're about to send
+    for (size_t i = 0; i < numMetrics; i++)
+        lastSent[i] = get(t, metrics[i]);
+    haveSent = true;
+    count = 0;
+    return n;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "../mesh/generated/meshtastic/telemetry.pb.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Sample telemetry every TELEMETRY_SAMPLE_SECS and send the means since our last send (see TelemetryWindow), rather than
+/// whatever we read at the moment we send.  0 sends samples as they are
+#ifndef TELEMETRY_AGGREGATE
+#define TELEMETRY_AGGREGATE 1
+#endif
+
+#ifndef TELEMETRY_SAMPLE_SECS
+#define TELEMETRY_SAMPLE_SECS 60
+#endif
+
+/// Send early when a reading moves this far from what we last sent (0 never): degrees C, percent, hPa, volts and mA
+#ifndef TELEMETRY_CHANGE_TEMPERATURE
+#define TELEMETRY_CHANGE_TEMPERATURE 2.0f
+#endif
+#ifndef TELEMETRY_CHANGE_HUMIDITY
+#define TELEMETRY_CHANGE_HUMIDITY 10.0f
+#endif
+#ifndef TELEMETRY_CHANGE_PRESSURE
+#define TELEMETRY_CHANGE_PRESSURE 3.0f
+#endif
+#ifndef TELEMETRY_CHANGE_VOLTAGE
+#define TELEMETRY_CHANGE_VOLTAGE 0.5f
+#endif
+#ifndef TELEMETRY_CHANGE_CURRENT
+#define TELEMETRY_CHANGE_CURRENT 0.0f
+#endif
+
+/// But no sooner than this after our last send
+#ifndef TELEMETRY_CHANGE_HOLDOFF_SECS
+#define TELEMETRY_CHANGE_HOLDOFF_SECS (5 * 60)
+#endif
+
+/// The most metrics a window aggregates
+#define TELEMETRY_WINDOW_METRICS 6
+
+/// A float field of meshtastic_Telemetry which a TelemetryWindow aggregates
+struct TelemetryMetric {
+    const char *name;
+    size_t offset;    // in meshtastic_Telemetry, see TELEMETRY_METRIC()
+    float threshold;  // how far from what we last sent counts as a jump, 0 for never
+    const char *kind; // the variant of meshtastic_Telemetry it's in
+};
+
+/// A TelemetryMetric for field of variant kind (environment_metrics, say) of meshtastic_Telemetry
+#define TELEMETRY_METRIC(kind, field, threshold) {#field, offsetof(meshtastic_Telemetry, variant.kind.field), threshold, #kind}
+
+/**
+ * What a telemetry module has sampled since it last sent: the min, max and mean of each metric, kept as running totals so
+ * the window costs the same however many samples it spans.  The mean is what goes out, in the usual fields so every client
+ * understands it (and min and max are logged), and a sample which jumps past a metric's threshold from what we last sent
+ * can send early.
+ */
+class TelemetryWindow
+{
+  public:
+    TelemetryWindow(const TelemetryMetric *metrics, size_t numMetrics);
+
+    /// Add a sample, @return whether one of its metrics has jumped past its threshold from what we last sent
+    bool add(const meshtastic_Telemetry &t);
+
+    /// Put the means since the last summarize() in t's metrics (leaving its other fields) and start a new window, @return how
+    /// many samples they're over (if none t is left as it is)
+    size_t summarize(meshtastic_Telemetry &t);
+
+    /// @return m's value in t
+    static float get(const meshtastic_Telemetry &t, const TelemetryMetric &m);
+
+  private:
+    struct Aggregate {
+        float min, max, sum;
+    };
+
+    const TelemetryMetric *metrics;
+    size_t numMetrics;
+    Aggregate aggregates[TELEMETRY_WINDOW_METRICS];
+    uint32_t count = 0;
+
+    float lastSent[TELEMETRY_WINDOW_METRICS];
+    bool haveSent = false;
+
+    static void set(meshtastic_Telemetry &t, const TelemetryMetric &m, float v);
+};
@@ -27,4 +27,9 @@ ProcessMessage TextMessageModule::handleReceived(const meshtastic_MeshPacket &mp
 bool TextMessageModule::wantPacket(const meshtastic_MeshPacket *p)
 {
     return MeshService::isTextPayload(p);
+}
+
+void TextMessageModule::getPortNums(std::vector<meshtastic_PortNum> &ports)
+{
+    MeshService::getTextPayloadPortNums(ports);
 }
\ No newline at end of file
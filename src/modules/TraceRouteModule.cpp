@@ -1,6 +1,9 @@
 #include "TraceRouteModule.h"
 #include "FloodingRouter.h"
 #include "MeshService.h"
+#include "NextHopTable.h"
+#include "RTC.h"
+#include "Router.h"
 
 TraceRouteModule *traceRouteModule;
 
@@ -34,6 +37,87 @@ void TraceRouteModule::updateRoute(meshtastic_MeshPacket *p)
     }
 }
 
+void TraceRouteModule::updateNextHops(const meshtastic_MeshPacket *p)
+{
+    meshtastic_RouteDiscovery route;
+    memset(&route, 0, sizeof(route));
+    if (!pb_decode_from_bytes(p->decoded.payload.bytes, p->decoded.payload.size, &meshtastic_RouteDiscovery_msg, &route))
+        return;
+
+    // The reply lists the nodes its request passed through (between p->to and p->from), see whether we are one of them
+    bool viaUs = false;
+    for (uint8_t i = 0; i < route.route_count; i++)
+        if (route.route[i] == nodeDB.getNodeNum())
+            viaUs = true;
+
+    nextHops.learnRoute(p->to, getFrom(p), viaUs);
+
+    // Every node it lists is a route of its own, from us (or whichever end we are on)
+    NodeNum us = nodeDB.getNodeNum();
+    if (p->to == us || viaUs) {
+        if (p->to != us)
+            nextHops.learnRoute(us, p->to, false);
+        nextHops.learnRoute(us, getFrom(p), false);
+        for (uint8_t i = 0; i < route.route_count; i++)
+            nextHops.learnRoute(us, route.route[i], false);
+    }
+    if (p->to == us) {
+        // It lists the relays between us in the order our request went through them
+        nodeDB.noteHopsAway(getFrom(p), route.route_count, true);
+        for (uint8_t i = 0; i < route.route_count; i++)
+            nodeDB.noteHopsAway(route.route[i], i, true);
+        cacheRoute(getFrom(p), route);
+    }
+}
+
+void TraceRouteModule::cacheRoute(NodeNum dest, const meshtastic_RouteDiscovery &route)
+{
+    // Its entry, an unused one, or else the one we learned longest ago
+    CachedRoute *c = &cache[0];
+    for (CachedRoute &i : cache) {
+        if (i.dest == dest || !i.dest) {
+            c = &i;
+            break;
+        }
+        if (millis() - i.learnedMsec > millis() - c->learnedMsec)
+            c = &i;
+    }
+    c->dest = dest;
+    c->route = route;
+    c->learnedMsec = millis();
+}
+
+bool TraceRouteModule::answerFromCache(const meshtastic_MeshPacket &p)
+{
+    if (!TRACEROUTE_ANSWER_FROM_CACHE)
+        return false;
+    if (p.which_payload_variant != meshtastic_MeshPacket_decoded_tag || p.decoded.portnum != ourPortNum ||
+        p.decoded.request_id || p.to == NODENUM_BROADCAST || p.to == nodeDB.getNodeNum())
+        return false;
+
+    for (const CachedRoute &c : cache) {
+        uint32_t age = millis() - c.learnedMsec;
+        if (c.dest != p.to || age >= TRACEROUTE_CACHE_SECS * 1000UL)
+            continue;
+
+        LOG_INFO("Answering trace route to 0x%x with the %u hop route we traced %us ago\n", c.dest, c.route.route_count + 1,
+                 age / 1000);
+        meshtastic_MeshPacket *reply = router->allocForSending();
+        reply->from = c.dest;
+        reply->to = nodeDB.getNodeNum();
+        reply->channel = p.channel;
+        uint32_t now = getValidTime(RTCQualityFromNet);
+        reply->rx_time = now ? now - age / 1000 : 0; // when we really heard it, so the phone can tell it isn't live
+        reply->decoded.portnum = ourPortNum;
+        reply->decoded.request_id = p.id;
+        reply->decoded.payload.size = pb_encode_to_bytes(reply->decoded.payload.bytes, sizeof(reply->decoded.payload.bytes),
+                                                         &meshtastic_RouteDiscovery_msg, &c.route);
+        service.sendToPhone(reply);
+        return true;
+    }
+    return false;
+}
+
 void TraceRouteModule::appendMyID(meshtastic_RouteDiscovery *updated)
 {
     // Length of route array can normally not be exceeded due to the max. hop_limit of 7
@@ -1,6 +1,22 @@
 #pragma once
 #include "ProtobufModule.h"
 
+/// How long a route we traced stays good for answering the phone's next trace route to the same node
+#ifndef TRACEROUTE_CACHE_SECS
+#define TRACEROUTE_CACHE_SECS (5 * 60)
+#endif
+
+/// Answer the phone's trace route from a route we traced lately rather than flooding the mesh again.  Off by default, as the
+/// phone can't tell a cached answer from a live one (all it has to go on is rx_time, which we set to when we traced it)
+#ifndef TRACEROUTE_ANSWER_FROM_CACHE
+#define TRACEROUTE_ANSWER_FROM_CACHE 0
+#endif
+
+/// How many of the routes we traced we keep, the oldest makes room for a new one
+#ifndef TRACEROUTE_CACHE_ROUTES
+#define TRACEROUTE_CACHE_ROUTES 8
+#endif
+
 /**
  * A module that traces the route to a certain destination node
  */
@@ -9,7 +25,14 @@ class TraceRouteModule : public ProtobufModule<meshtastic_RouteDiscovery>
   public:
     TraceRouteModule();
 
-    // Let FloodingRouter call updateRoute upon rebroadcasting a TraceRoute request
+    /**
+     * If p is the phone's trace route to a node we traced lately (and TRACEROUTE_ANSWER_FROM_CACHE), answer it with the route
+     * we found then, stamped with when we found it, rather than flooding the mesh again.  @return true if we did, so p needn't
+     * be sent
+     */
+    bool answerFromCache(const meshtastic_MeshPacket &p);
+
+    // Let FloodingRouter call updateRoute upon rebroadcasting a TraceRoute request, and updateNextHops with every reply
     friend class FloodingRouter;
 
   protected:
@@ -21,7 +44,20 @@ class TraceRouteModule : public ProtobufModule<meshtastic_RouteDiscovery>
        the route array containing the IDs of nodes this packet went through */
     void updateRoute(meshtastic_MeshPacket *p);
 
+    // Call with every trace route reply we receive or overhear, to learn the route it lists for NextHopTable
+    void updateNextHops(const meshtastic_MeshPacket *p);
+
   private:
+    struct CachedRoute {
+        NodeNum dest;                    // 0 for an unused entry
+        meshtastic_RouteDiscovery route; // the nodes between us and dest
+        uint32_t learnedMsec;
+    };
+    CachedRoute cache[TRACEROUTE_CACHE_ROUTES] = {};
+
+    // Keep the route of a trace route reply to us
+    void cacheRoute(NodeNum dest, const meshtastic_RouteDiscovery &route);
+
     // Call to add your ID to the route array of a RouteDiscovery message
     void appendMyID(meshtastic_RouteDiscovery *r);
 
@@ -0,0 +1,87 @@
+#include "configuration.h"
+#if defined(ARCH_ESP32) && defined(USE_SX1280)
+#include "AudioJitterBuffer.h"
+#include "concurrency/LockGuard.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+bool AudioJitterBuffer::anyAfter(uint8_t seq) const
+{
+    for (size_t i = 0; i < AUDIO_JITTER_PACKETS; i++)
+        if (full[i] && (int8_t)(slots[i].seq - seq) > 0)
+            return true;
+    return false;
+}
+
+bool AudioJitterBuffer::push(uint8_t seq, uint8_t mode, const uint8_t *frames, size_t size, uint32_t durationMsec,
+                             uint32_t nowMsec)
+{
+    concurrency::LockGuard g(&lock);
+
+    // How far this packet's arrival strayed from the audio sent since the last, which a pause between spurts says nothing of
+    if (lastArrivalMsec && (int8_t)(seq - lastSeq) > 0) {
+        int32_t expected = (uint8_t)(seq - lastSeq) * lastDurationMsec;
+        int32_t spacing = nowMsec - lastArrivalMsec;
+        if (spacing < expected + AUDIO_JITTER_MAX_MS)
+            jitter16 += abs(spacing - expected) - jitter16 / 16;
+    }
+    if (!lastArrivalMsec || (int8_t)(seq - lastSeq) > 0) {
+        lastSeq = seq;
+        lastArrivalMsec = nowMsec;
+        lastDurationMsec = durationMsec;
+    }
+
+    if (!playing) {
+        // A new talk spurt, held back by a few times the jitter we've seen
+        playing = true;
+        nextSeq = seq;
+        delayMsec = std::min<uint32_t>(std::max<uint32_t>(jitter16 / 4, AUDIO_JITTER_MIN_MS), AUDIO_JITTER_MAX_MS);
+        playAtMsec = nowMsec + delayMsec;
+        memset(full, 0, sizeof(full));
+    } else {
+        int8_t ahead = seq - nextSeq;
+        if (ahead < 0)
+            return false; // we've played (or concealed) its place already
+        if (ahead >= AUDIO_JITTER_PACKETS) {
+            // We're too far behind to hold all that's between, so give up on the oldest
+            nextSeq = seq - AUDIO_JITTER_PACKETS + 1;
+            for (size_t i = 0; i < AUDIO_JITTER_PACKETS; i++)
+                if (full[i] && (int8_t)(slots[i].seq - nextSeq) < 0)
+                    full[i] = false;
+        }
+    }
+
+    size_t i = seq % AUDIO_JITTER_PACKETS;
+    Packet &p = slots[i];
+    p.seq = seq;
+    p.mode = mode;
+    p.size = std::min(size, sizeof(p.frames));
+    memcpy(p.frames, frames, p.size);
+    full[i] = true;
+    return true;
+}
+
+AudioJitterBuffer::Take AudioJitterBuffer::take(Packet &p, uint32_t nowMsec)
+{
+    concurrency::LockGuard g(&lock);
+    if (!playing || (int32_t)(nowMsec - playAtMsec) < 0)
+        return WAIT;
+
+    size_t i = nextSeq % AUDIO_JITTER_PACKETS;
+    if (full[i] && slots[i].seq == nextSeq) {
+        p = slots[i];
+        full[i] = false;
+        nextSeq++;
+        return PLAY;
+    }
+    if (anyAfter(nextSeq)) {
+        nextSeq++; // a later one came, so this one isn't coming
+        return CONCEAL;
+    }
+    if (nowMsec - lastArrivalMsec < 2 * lastDurationMsec + delayMsec)
+        return WAIT; // it may still be on its way, or lost with the next behind it
+    playing = false;
+    return DONE;
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "concurrency/Lock.h"
+#include "mesh-pb-constants.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// How many audio packets we can hold waiting to be played
+#ifndef AUDIO_JITTER_PACKETS
+#define AUDIO_JITTER_PACKETS 8
+#endif
+
+/// The least and most we hold the first packet of each talk spurt before playing it, to ride out late packets behind it
+#ifndef AUDIO_JITTER_MIN_MS
+#define AUDIO_JITTER_MIN_MS 100
+#endif
+#ifndef AUDIO_JITTER_MAX_MS
+#define AUDIO_JITTER_MAX_MS 2000
+#endif
+
+/**
+ * Where AudioModule keeps the packets it hears until their turn to be played, in the order of their sequence numbers
+ * rather than that the mesh delivered them in.  Each talk spurt is held back a little before playing, by as much as the
+ * packets' arrival times have lately varied (the RFC 3550 estimate of jitter), so one arriving late is still in time.  One
+ * that never arrives is reported as a gap for the caller to conceal, once a later packet shows it was lost.
+ *
+ * push() is called from the main thread, and take() from the codec2 task, which plays what it gets.
+ */
+class AudioJitterBuffer
+{
+  public:
+    struct Packet {
+        uint8_t seq;
+        uint8_t mode; // codec2 mode its frames are in
+        uint8_t size;
+        uint8_t frames[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    };
+
+    enum Take {
+        WAIT,    // nothing to play yet
+        PLAY,    // here's the next packet
+        CONCEAL, // the next packet was lost, fill in for it
+        DONE,    // the talk spurt is over
+    };
+
+    /// Hold a packet we heard at nowMsec, which carries durationMsec of audio.  @return false if it came too late to play
+    bool push(uint8_t seq, uint8_t mode, const uint8_t *frames, size_t size, uint32_t durationMsec, uint32_t nowMsec);
+
+    /// Take the next packet to play at nowMsec into p, if it's time
+    Take take(Packet &p, uint32_t nowMsec);
+
+    /// How long we hold talk spurts back for now
+    uint32_t getDelayMsec() const { return delayMsec; }
+
+  private:
+    concurrency::Lock lock;
+    Packet slots[AUDIO_JITTER_PACKETS];
+    bool full[AUDIO_JITTER_PACKETS] = {};
+
+    bool playing = false; // whether we're in a talk spurt
+    uint8_t nextSeq = 0;  // the packet we play next
+    uint32_t playAtMsec = 0;
+
+    /// What we last heard, for our estimate of jitter (in msec, scaled by 16)
+    uint8_t lastSeq = 0;
+    uint32_t lastArrivalMsec = 0, lastDurationMsec = 0;
+    uint32_t jitter16 = 0;
+    uint32_t delayMsec = AUDIO_JITTER_MIN_MS;
+
+    bool anyAfter(uint8_t seq) const;
+};
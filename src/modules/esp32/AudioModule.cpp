@@ -6,7 +6,11 @@
 #include "MeshService.h"
 #include "NodeDB.h"
 #include "RTC.h"
+#include "RadioInterface.h"
 #include "Router.h"
+#include "airtime.h"
+#include "main.h"
+#include <algorithm>
 
 #ifdef OLED_RU
 #include "graphics/fonts/OLEDDisplayFontsRU.h"
@@ -41,13 +45,6 @@ ButterworthFilter hp_filter(240, 8000, ButterworthFilter::ButterworthFilter::Hig
 TaskHandle_t codec2HandlerTask;
 AudioModule *audioModule;
 
-#ifdef ARCH_ESP32
-// ESP32 doesn't use that flag
-#define YIELD_FROM_ISR(x) portYIELD_FROM_ISR()
-#else
-#define YIELD_FROM_ISR(x) portYIELD_FROM_ISR(x)
-#endif
-
 #if (defined(USE_EINK) || defined(ILI9341_DRIVER) || defined(ST7735_CS) || defined(ST7789_CS)) &&                                \
     !defined(DISPLAY_FORCE_SMALL_FONTS)
 
@@ -77,51 +74,156 @@ AudioModule *audioModule;
 
 void run_codec2(void *parameter)
 {
-    // 4 bytes of header in each frame hex c0 de c2 plus the bitrate
-    memcpy(audioModule->tx_encode_frame, &audioModule->tx_header, sizeof(audioModule->tx_header));
-
     LOG_INFO("Starting codec2 task\n");
 
     while (true) {
-        uint32_t tcount = ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(10000));
+        if (audioModule->radio_state == RadioState::tx) {
+            audioModule->encodeSpeech(); // waits on I2S for each frame
+            continue;
+        }
+        audioModule->flushSpeech(); // anything left from before PTT was released
+        if (!audioModule->playSpeech())
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)); // until a packet arrives or PTT is pressed
+    }
+}
 
-        if (tcount != 0) {
-            if (audioModule->radio_state == RadioState::tx) {
-                for (int i = 0; i < audioModule->adc_buffer_size; i++)
-                    audioModule->speech[i] = (int16_t)hp_filter.Update((float)audioModule->speech[i]);
+void AudioModule::encodeSpeech()
+{
+    if (!tx_encode_frame_index) {
+        // Hex c0 de c2 plus the bitrate, or c0 de c3 and then our sequence number for peers which understand it
+        tx_header_size = peers_numbered ? AUDIO_HEADER_SIZE : sizeof(c2_header);
+        memcpy(tx_header.magic, peers_numbered ? c2_magic_seq : c2_magic, sizeof(tx_header.magic));
+        memcpy(tx_encode_frame, &tx_header, sizeof(tx_header));
+        tx_encode_frame_index = tx_header_size;
+        tx_frames_per_packet = framesPerPacket(); // for the airtime we have as each packet starts
+    }
 
-                codec2_encode(audioModule->codec2, audioModule->tx_encode_frame + audioModule->tx_encode_frame_index,
-                              audioModule->speech);
-                audioModule->tx_encode_frame_index += audioModule->encode_codec_size;
+    // A whole frame from the microphone; I2S records the next into another DMA buffer while we encode this one
+    size_t bytesIn = 0;
+    size_t bytes = adc_buffer_size * sizeof(int16_t);
+    if (i2s_read(I2S_PORT, speech, bytes, &bytesIn, pdMS_TO_TICKS(2 * frame_msec + 10)) != ESP_OK || bytesIn != bytes)
+        return;
 
-                if (audioModule->tx_encode_frame_index == (audioModule->encode_frame_size + sizeof(audioModule->tx_header))) {
-                    LOG_INFO("Sending %d codec2 bytes\n", audioModule->encode_frame_size);
-                    audioModule->sendPayload();
-                    audioModule->tx_encode_frame_index = sizeof(audioModule->tx_header);
-                }
-            }
-            if (audioModule->radio_state == RadioState::rx) {
-                size_t bytesOut = 0;
-                if (memcmp(audioModule->rx_encode_frame, &audioModule->tx_header, sizeof(audioModule->tx_header)) == 0) {
-                    for (int i = 4; i < audioModule->rx_encode_frame_index; i += audioModule->encode_codec_size) {
-                        codec2_decode(audioModule->codec2, audioModule->output_buffer, audioModule->rx_encode_frame + i);
-                        i2s_write(I2S_PORT, &audioModule->output_buffer, audioModule->adc_buffer_size, &bytesOut,
-                                  pdMS_TO_TICKS(500));
-                    }
-                } else {
-                    // if the buffer header does not match our own codec, make a temp decoding setup.
-                    CODEC2 *tmp_codec2 = codec2_create(audioModule->rx_encode_frame[3]);
-                    codec2_set_lpc_post_filter(tmp_codec2, 1, 0, 0.8, 0.2);
-                    int tmp_encode_codec_size = (codec2_bits_per_frame(tmp_codec2) + 7) / 8;
-                    int tmp_adc_buffer_size = codec2_samples_per_frame(tmp_codec2);
-                    for (int i = 4; i < audioModule->rx_encode_frame_index; i += tmp_encode_codec_size) {
-                        codec2_decode(tmp_codec2, audioModule->output_buffer, audioModule->rx_encode_frame + i);
-                        i2s_write(I2S_PORT, &audioModule->output_buffer, tmp_adc_buffer_size, &bytesOut, pdMS_TO_TICKS(500));
-                    }
-                    codec2_destroy(tmp_codec2);
-                }
-            }
+    for (int i = 0; i < adc_buffer_size; i++)
+        speech[i] = (int16_t)hp_filter.Update((float)speech[i]);
+    codec2_encode(codec2, tx_encode_frame + tx_encode_frame_index, speech);
+    tx_encode_frame_index += encode_codec_size;
+
+    if (tx_encode_frame_index >= tx_header_size + tx_frames_per_packet * encode_codec_size) {
+        LOG_INFO("Sending %d codec2 bytes\n", tx_encode_frame_index - tx_header_size);
+        sendPayload();
+    }
+}
+
+void AudioModule::flushSpeech()
+{
+    if (tx_encode_frame_index > tx_header_size) {
+        LOG_INFO("Sending %d codec2 bytes (incomplete)\n", tx_encode_frame_index - tx_header_size);
+        sendPayload();
+    }
+}
+
+int AudioModule::framesPerPacket()
+{
+    int frames = std::min(std::max(AUDIO_MAX_PACKET_MS / frame_msec, 1), encode_frame_num);
+    if (!rIf)
+        return frames;
+
+    // Each packet has its preamble and headers to send too, so more frames in each is less airtime for the same speech
+    int budget = std::max(AUDIO_AIRTIME_PERCENT - (int)airTime->channelUtilizationPercent(), 10);
+    for (; frames < encode_frame_num; frames++) {
+        uint32_t len = sizeof(PacketHeader) + AUDIO_PACKET_OVERHEAD + AUDIO_HEADER_SIZE + frames * encode_codec_size;
+        if (rIf->getPacketTime(len) * 100 <= (uint32_t)(frames * frame_msec * budget))
+            break;
+    }
+    return frames;
+}
+
+struct CODEC2 *AudioModule::codecFor(int mode)
+{
+    if (mode == tx_header.mode)
+        return codec2;
+    if (rx_codec2 && mode == rx_mode)
+        return rx_codec2;
+
+    // Someone in a different mode to ours, keep a codec for them rather than making one for each packet
+    if (rx_codec2)
+        codec2_destroy(rx_codec2);
+    rx_codec2 = codec2_create(mode);
+    rx_mode = mode;
+    if (rx_codec2)
+        codec2_set_lpc_post_filter(rx_codec2, 1, 0, 0.8, 0.2);
+    else
+        LOG_WARN("Can't decode codec2 mode %d\n", mode);
+    return rx_codec2;
+}
+
+void AudioModule::writeSpeech(int samples)
+{
+    // Blocks while I2S has all its DMA buffers queued, which is what paces our playing
+    size_t bytesOut = 0;
+    i2s_write(I2S_PORT, output_buffer, samples * sizeof(int16_t), &bytesOut, pdMS_TO_TICKS(500));
+}
+
+void AudioModule::decodePacket(const AudioJitterBuffer::Packet &p)
+{
+    struct CODEC2 *c = codecFor(p.mode);
+    if (!c)
+        return;
+    int size = (codec2_bits_per_frame(c) + 7) / 8, samples = codec2_samples_per_frame(c);
+    if (size > (int)sizeof(last_frame) || samples > ADC_BUFFER_SIZE_MAX)
+        return;
+
+    int i;
+    for (i = 0; i + size <= p.size; i += size) {
+        codec2_decode(c, output_buffer, p.frames + i);
+        writeSpeech(samples);
+    }
+    if (i) {
+        memcpy(last_frame, p.frames + i - size, size);
+        last_mode = p.mode;
+        last_frames = i / size;
+        plc_count = 0;
+    }
+}
+
+void AudioModule::concealPacket()
+{
+    struct CODEC2 *c = last_frames ? codecFor(last_mode) : NULL;
+    if (!c)
+        return;
+    int samples = codec2_samples_per_frame(c);
+
+    // Codec2 frames are vocoder parameters, so repeating the last stretches its sound over the gap; fade it, then silence
+    for (int f = 0; f < last_frames; f++) {
+        if (plc_count < AUDIO_PLC_FRAMES) {
+            codec2_decode(c, output_buffer, last_frame);
+            plc_count++;
+            for (int s = 0; s < samples; s++)
+                output_buffer[s] >>= plc_count;
+        } else {
+            memset(output_buffer, 0, samples * sizeof(int16_t));
         }
+        writeSpeech(samples);
+    }
+}
+
+bool AudioModule::playSpeech()
+{
+    switch (jitterBuffer.take(rx_packet, millis())) {
+    case AudioJitterBuffer::PLAY:
+        decodePacket(rx_packet);
+        return true;
+    case AudioJitterBuffer::CONCEAL:
+        LOG_DEBUG("Audio packet lost, concealing it\n");
+        concealPacket();
+        return true;
+    case AudioJitterBuffer::DONE:
+        LOG_DEBUG("Audio talk spurt over, next will be held %u ms\n", jitterBuffer.getDelayMsec());
+        last_frames = 0;
+        return false;
+    default:
+        return false;
     }
 }
 
@@ -138,13 +240,13 @@ AudioModule::AudioModule() : SinglePortModule("AudioModule", meshtastic_PortNum_
         LOG_INFO("Setting up codec2 in mode %u",
                  (moduleConfig.audio.bitrate ? moduleConfig.audio.bitrate : AUDIO_MODULE_MODE) - 1);
         codec2 = codec2_create((moduleConfig.audio.bitrate ? moduleConfig.audio.bitrate : AUDIO_MODULE_MODE) - 1);
-        memcpy(tx_header.magic, c2_magic, sizeof(c2_magic));
         tx_header.mode = (moduleConfig.audio.bitrate ? moduleConfig.audio.bitrate : AUDIO_MODULE_MODE) - 1;
         codec2_set_lpc_post_filter(codec2, 1, 0, 0.8, 0.2);
         encode_codec_size = (codec2_bits_per_frame(codec2) + 7) / 8;
-        encode_frame_num = (meshtastic_Constants_DATA_PAYLOAD_LEN - sizeof(tx_header)) / encode_codec_size;
-        encode_frame_size = encode_frame_num * encode_codec_size; // max 233 bytes + 4 header bytes
+        encode_frame_num = (meshtastic_Constants_DATA_PAYLOAD_LEN - AUDIO_HEADER_SIZE) / encode_codec_size;
+        encode_frame_size = encode_frame_num * encode_codec_size; // max 232 bytes + 5 header bytes
         adc_buffer_size = codec2_samples_per_frame(codec2);
+        frame_msec = adc_buffer_size / 8; // at 8 kHz
         LOG_INFO("using %d frames of %d bytes for a total payload length of %d bytes\n", encode_frame_num, encode_codec_size,
                  encode_frame_size);
         xTaskCreate(&run_codec2, "codec2_task", 30000, NULL, 5, &codec2HandlerTask);
@@ -191,8 +293,8 @@ int32_t AudioModule::runOnce()
                                        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
                                        .communication_format = (i2s_comm_format_t)(I2S_COMM_FORMAT_STAND_I2S),
                                        .intr_alloc_flags = 0,
-                                       .dma_buf_count = 8,
-                                       .dma_buf_len = adc_buffer_size, // 320 * 2 bytes
+                                       .dma_buf_count = AUDIO_DMA_BUFFERS,
+                                       .dma_buf_len = adc_buffer_size, // a frame, up to 320 * 2 bytes
                                        .use_apll = false,
                                        .tx_desc_auto_clear = true,
                                        .fixed_mclk = 0};
@@ -230,43 +332,18 @@ int32_t AudioModule::runOnce()
                 if (radio_state == RadioState::rx) {
                     LOG_INFO("PTT pressed, switching to TX\n");
                     radio_state = RadioState::tx;
+                    xTaskNotifyGive(codec2HandlerTask);
                     e.frameChanged = true;
                     this->notifyObservers(&e);
                 }
             } else {
                 if (radio_state == RadioState::tx) {
                     LOG_INFO("PTT released, switching to RX\n");
-                    if (tx_encode_frame_index > sizeof(tx_header)) {
-                        // Send the incomplete frame
-                        LOG_INFO("Sending %d codec2 bytes (incomplete)\n", tx_encode_frame_index);
-                        sendPayload();
-                    }
-                    tx_encode_frame_index = sizeof(tx_header);
-                    radio_state = RadioState::rx;
+                    radio_state = RadioState::rx; // the codec2 task sends what it has left
                     e.frameChanged = true;
                     this->notifyObservers(&e);
                 }
             }
-            if (radio_state == RadioState::tx) {
-                // Get I2S data from the microphone and place in data buffer
-                size_t bytesIn = 0;
-                res = i2s_read(I2S_PORT, adc_buffer + adc_buffer_index, adc_buffer_size - adc_buffer_index, &bytesIn,
-                               pdMS_TO_TICKS(40)); // wait 40ms for audio to arrive.
-
-                if (res == ESP_OK) {
-                    adc_buffer_index += bytesIn;
-                    if (adc_buffer_index == adc_buffer_size) {
-                        adc_buffer_index = 0;
-                        memcpy((void *)speech, (void *)adc_buffer, 2 * adc_buffer_size);
-                        // Notify run_codec2 task that the buffer is ready.
-                        radio_state = RadioState::tx;
-                        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-                        vTaskNotifyGiveFromISR(codec2HandlerTask, &xHigherPriorityTaskWoken);
-                        if (xHigherPriorityTaskWoken == pdTRUE)
-                            YIELD_FROM_ISR(xHigherPriorityTaskWoken);
-                    }
-                }
-            }
         }
         return 100;
     } else {
@@ -297,8 +374,11 @@ void AudioModule::sendPayload(NodeNum dest, bool wantReplies)
     p->want_ack = false;                              // Audio is shoot&forget. No need to wait for ACKs.
     p->priority = meshtastic_MeshPacket_Priority_MAX; // Audio is important, because realtime
 
+    if (tx_header_size == (int)AUDIO_HEADER_SIZE)
+        tx_encode_frame[sizeof(c2_header)] = tx_seq++;
     p->decoded.payload.size = tx_encode_frame_index;
     memcpy(p->decoded.payload.bytes, tx_encode_frame, p->decoded.payload.size);
+    tx_encode_frame_index = 0;
 
     service.sendToMesh(p);
 }
@@ -307,15 +387,22 @@ ProcessMessage AudioModule::handleReceived(const meshtastic_MeshPacket &mp)
 {
     if ((moduleConfig.audio.codec2_enabled) && (myRegion->audioPermitted)) {
         auto &p = mp.decoded;
-        if (getFrom(&mp) != nodeDB.getNodeNum()) {
-            memcpy(rx_encode_frame, p.payload.bytes, p.payload.size);
-            radio_state = RadioState::rx;
-            rx_encode_frame_index = p.payload.size;
-            // Notify run_codec2 task that the buffer is ready.
-            BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-            vTaskNotifyGiveFromISR(codec2HandlerTask, &xHigherPriorityTaskWoken);
-            if (xHigherPriorityTaskWoken == pdTRUE)
-                YIELD_FROM_ISR(xHigherPriorityTaskWoken);
+        bool numbered = p.payload.size >= AUDIO_HEADER_SIZE && memcmp(p.payload.bytes, c2_magic_seq, sizeof(c2_magic_seq)) == 0;
+        bool unnumbered = p.payload.size >= sizeof(c2_header) && memcmp(p.payload.bytes, c2_magic, sizeof(c2_magic)) == 0;
+        if (getFrom(&mp) != nodeDB.getNodeNum() && (numbered || unnumbered)) {
+            // Number ours only while those we hear do, someone on older firmware would drop every packet we sent
+            if (peers_numbered != numbered)
+                LOG_INFO("Heard %s audio, %s numbering ours\n", numbered ? "numbered" : "unnumbered",
+                         numbered ? "now" : "no longer");
+            peers_numbered = numbered;
+            // Senders from before we numbered packets get theirs played in the order they come
+            size_t headerSize = numbered ? AUDIO_HEADER_SIZE : sizeof(c2_header);
+            uint8_t seq = numbered ? p.payload.bytes[sizeof(c2_header)] : rx_unnumbered_seq++;
+            size_t size = p.payload.size - headerSize;
+            uint32_t durationMsec = size * frame_msec / encode_codec_size; // near enough, if their mode isn't ours
+            if (!jitterBuffer.push(seq, p.payload.bytes[3], p.payload.bytes + headerSize, size, durationMsec, millis()))
+                LOG_DEBUG("Audio packet %u came too late to play\n", seq);
+            xTaskNotifyGive(codec2HandlerTask);
         }
     }
 
@@ -4,6 +4,7 @@
 #include "concurrency/NotifiedWorkerThread.h"
 #include "configuration.h"
 #if defined(ARCH_ESP32) && defined(USE_SX1280)
+#include "AudioJitterBuffer.h"
 #include "NodeDB.h"
 #include <Arduino.h>
 #include <ButterworthFilter.h>
@@ -15,13 +16,18 @@
 
 enum RadioState { standby, rx, tx };
 
-const char c2_magic[3] = {0xc0, 0xde, 0xc2}; // Magic number for codec2 header
+const char c2_magic[3] = {0xc0, 0xde, 0xc2};     // Magic number for codec2 header
+const char c2_magic_seq[3] = {0xc0, 0xde, 0xc3}; // The same, followed by a sequence number byte
 
 struct c2_header {
     char magic[3];
     char mode;
 };
 
+/// What we start our numbered packets with: a c2_header with c2_magic_seq, and their sequence number.  We only number ours
+/// once we've heard a numbered packet from someone else, as firmware from before numbering ignores c2_magic_seq
+#define AUDIO_HEADER_SIZE (sizeof(c2_header) + 1)
+
 #define ADC_BUFFER_SIZE_MAX 320
 #define PTT_PIN 39
 
@@ -30,25 +36,62 @@ struct c2_header {
 #define AUDIO_MODULE_RX_BUFFER 128
 #define AUDIO_MODULE_MODE meshtastic_ModuleConfig_AudioConfig_Audio_Baud_CODEC2_700
 
+/// How many frames of DMA buffer I2S has each way, so it records (or plays) one while we encode (or decode) another
+#ifndef AUDIO_DMA_BUFFERS
+#define AUDIO_DMA_BUFFERS 4
+#endif
+
+/// How much speech we put in a packet, unless the airtime we have calls for more
+#ifndef AUDIO_MAX_PACKET_MS
+#define AUDIO_MAX_PACKET_MS 1000
+#endif
+
+/// The most of the channel our speech should take (less whatever others are using): frames are packed into packets until
+/// their airtime is within it
+#ifndef AUDIO_AIRTIME_PERCENT
+#define AUDIO_AIRTIME_PERCENT 50
+#endif
+
+/// What a packet takes besides its payload and the LoRa header, for the Data protobuf around it
+#define AUDIO_PACKET_OVERHEAD 5
+
+/// How many frames we fill a lost packet with by repeating (and fading) the last we heard, before going silent
+#ifndef AUDIO_PLC_FRAMES
+#define AUDIO_PLC_FRAMES 3
+#endif
+
 class AudioModule : public SinglePortModule, public Observable<const UIFrameEvent *>, private concurrency::OSThread
 {
   public:
-    unsigned char rx_encode_frame[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
     unsigned char tx_encode_frame[meshtastic_Constants_DATA_PAYLOAD_LEN] = {};
     c2_header tx_header = {};
     int16_t speech[ADC_BUFFER_SIZE_MAX] = {};
     int16_t output_buffer[ADC_BUFFER_SIZE_MAX] = {};
-    uint16_t adc_buffer[ADC_BUFFER_SIZE_MAX] = {};
     int adc_buffer_size = 0;
-    uint16_t adc_buffer_index = 0;
-    int tx_encode_frame_index = sizeof(c2_header); // leave room for header
-    int rx_encode_frame_index = 0;
+    int frame_msec = 0;
+    int tx_encode_frame_index = 0; // 0 until encodeSpeech() starts a packet with its header
+    int tx_header_size = sizeof(c2_header);
+    int tx_frames_per_packet = 1;
+    uint8_t tx_seq = 0;
+    bool peers_numbered = false; // the last audio we heard from someone else was numbered, so we number ours too
     int encode_codec_size = 0;
     int encode_frame_size = 0;
     volatile RadioState radio_state = RadioState::rx;
 
     struct CODEC2 *codec2 = NULL;
-    // int16_t sample;
+
+    /// What we've heard, until it's time to play it
+    AudioJitterBuffer jitterBuffer;
+    AudioJitterBuffer::Packet rx_packet;
+    uint8_t rx_unnumbered_seq = 0; // what we number packets from senders that don't
+
+    /// For decoding what others send in a mode other than ours
+    struct CODEC2 *rx_codec2 = NULL;
+    int rx_mode = -1;
+
+    /// The last frame we played, which we repeat when a packet is lost
+    uint8_t last_frame[8] = {};
+    int last_mode = -1, last_frames = 0, plc_count = 0;
 
     AudioModule();
 
@@ -59,7 +102,27 @@ class AudioModule : public SinglePortModule, public Observable<const UIFrameEven
      */
     void sendPayload(NodeNum dest = NODENUM_BROADCAST, bool wantReplies = false);
 
+    /// From the codec2 task: record and encode a frame of speech, sending the packet it's in once it's full
+    void encodeSpeech();
+
+    /// From the codec2 task: send what we've encoded since our last packet, if anything
+    void flushSpeech();
+
+    /// From the codec2 task: play the next packet we've heard if it's time, @return false if there was nothing to do
+    bool playSpeech();
+
   protected:
+    /// @return how many frames to put in our next packet: as few as keep it to AUDIO_MAX_PACKET_MS, or if those would take
+    /// more than our share of the airtime, as many more as bring it within that
+    int framesPerPacket();
+
+    /// @return a codec for mode, ours or one we keep for others
+    struct CODEC2 *codecFor(int mode);
+
+    void decodePacket(const AudioJitterBuffer::Packet &p);
+    void concealPacket();
+    void writeSpeech(int samples);
+
     int encode_frame_num = 0;
     bool firstTime = true;
 
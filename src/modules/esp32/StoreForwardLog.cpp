@@ -0,0 +1,372 @@
+#include "StoreForwardLog.h"
+#include "FSCommon.h"
+#include "StoreForwardModule.h"
+#include <ErriezCRC32.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if STORE_FORWARD_LOG && defined(FSCom)
+#define STORE_FORWARD_USE_LOG 1
+#else
+#define STORE_FORWARD_USE_LOG 0
+#endif
+
+uint32_t StoreForwardLog::getNumRecords() const
+{
+    uint32_t n = 0;
+    for (size_t i = 0; i < numSegments; i++)
+        n += segments[(firstIndex + i) % STORE_FORWARD_LOG_SEGMENTS].records;
+    return n;
+}
+
+StoreForwardLog::Segment *StoreForwardLog::findSegment(uint32_t number)
+{
+    if (!numSegments || number - segments[firstIndex].number >= numSegments)
+        return NULL;
+    return &segments[(firstIndex + (number - segments[firstIndex].number)) % STORE_FORWARD_LOG_SEGMENTS];
+}
+
+uint32_t StoreForwardLog::getLastSeq()
+{
+    for (size_t i = numSegments; i-- > 0;) {
+        const Segment &s = segments[(firstIndex + i) % STORE_FORWARD_LOG_SEGMENTS];
+        if (s.lastSeq)
+            return s.lastSeq;
+    }
+    return 0;
+}
+
+StoreForwardLog::Cursor StoreForwardLog::seekEpoch(uint32_t epoch)
+{
+    // The newest segment whose records all predate epoch (or that have no time) can't hold any we want, nor any before it
+    Cursor c = {numSegments ? segments[firstIndex].number : nextNumber, 0};
+    for (size_t i = 0; i < numSegments; i++) {
+        const Segment &s = segments[(firstIndex + i) % STORE_FORWARD_LOG_SEGMENTS];
+        if (s.lastEpoch && s.lastEpoch < epoch)
+            c.segment = s.number + 1;
+    }
+    return c;
+}
+
+StoreForwardLog::Cursor StoreForwardLog::seekNewest(size_t bytes)
+{
+    Cursor c = {nextNumber, 0};
+    size_t total = 0;
+    for (size_t i = numSegments; i-- > 0 && total < bytes;) {
+        const Segment &s = segments[(firstIndex + i) % STORE_FORWARD_LOG_SEGMENTS];
+        total += s.size;
+        c.segment = s.number;
+    }
+    return c;
+}
+
+bool StoreForwardLog::next(Cursor &c, PacketHistoryStruct &r, uint32_t *epoch)
+{
+    while (numSegments) {
+        if (c.segment - segments[firstIndex].number > UINT32_MAX / 2)
+            c = {segments[firstIndex].number, 0}; // dropped while we were reading it
+        Segment *s = findSegment(c.segment);
+        if (!s)
+            return false;
+
+        Header h;
+        if (c.offset < s->size && readRecord(c.segment, c.offset, s->size, h, r.payload())) {
+            c.offset += sizeof(h) + h.payloadSize;
+            r.seq = h.seq;
+            r.time = 0;
+            r.to = h.to;
+            r.from = h.from;
+            r.prevSameTo = r.nextSameTo = 0;
+            r.channel = h.channel;
+            r.flags = h.flags;
+            r.payload_size = h.payloadSize;
+            *epoch = h.epoch;
+            return true;
+        }
+        c = {c.segment + 1, 0};
+    }
+    return false;
+}
+
+#if STORE_FORWARD_USE_LOG
+static const char *stateFileName = "/sf/state.dat";
+
+/// Which segments we have, what we save in stateFileName
+struct SavedState {
+    uint32_t magic;
+    uint32_t firstNumber, nextNumber;
+};
+static const uint32_t STATE_MAGIC = 0x53464c31;
+
+static void segmentFileName(char *name, size_t size, uint32_t segment)
+{
+    snprintf(name, size, "/sf/%lu.log", (unsigned long)segment);
+}
+
+static uint32_t recordCRC(const void *header, size_t headerSize, const uint8_t *payload, size_t payloadSize)
+{
+    uint32_t crc = 0xffffffff;
+    crc = crc32Update(header, headerSize, crc);
+    crc = crc32Update(payload, payloadSize, crc);
+    return crc32Final(crc);
+}
+
+bool StoreForwardLog::init()
+{
+    readBuf = static_cast<uint8_t *>(malloc(STORE_FORWARD_LOG_READ_SIZE));
+    if (!readBuf) {
+        LOG_WARN("*** No room to read a S&F log\n");
+        return false;
+    }
+    maxBytes = (uint64_t)FSCom.totalBytes() * STORE_FORWARD_LOG_MAX_FS_PERCENT / 100;
+    if (maxBytes < STORE_FORWARD_LOG_SEGMENT_SIZE) {
+        LOG_WARN("*** Our share of the filesystem is too small for a S&F log\n");
+        free(readBuf);
+        readBuf = NULL;
+        return false;
+    }
+    FSCom.mkdir("/sf");
+    loadState();
+    ready = true;
+    LOG_INFO("*** S&F log has %u records in %u files\n", getNumRecords(), numSegments);
+    return true;
+}
+
+bool StoreForwardLog::readRecord(uint32_t segment, uint32_t offset, uint32_t limit, Header &h, uint8_t *payload)
+{
+    if (offset + sizeof(h) > limit)
+        return false;
+
+    // Our records are read in order, so read ahead as much as we can hold
+    bool inBuf = readSegment == segment && offset >= readBufOffset && offset + sizeof(h) <= readBufOffset + readBufLen;
+    if (inBuf) {
+        memcpy(&h, readBuf + (offset - readBufOffset), sizeof(h));
+        inBuf = offset + sizeof(h) + h.payloadSize <= readBufOffset + readBufLen;
+    }
+    if (!inBuf) {
+        char name[24];
+        segmentFileName(name, sizeof(name), segment);
+        readSegment = segment;
+        readBufOffset = offset;
+        readBufLen = 0;
+        auto f = FSCom.open(name, FILE_O_READ);
+        if (f) {
+            if (f.seek(offset)) {
+                int n = f.read(readBuf, std::min<uint32_t>(STORE_FORWARD_LOG_READ_SIZE, limit - offset));
+                if (n > 0)
+                    readBufLen = n;
+            }
+            f.close();
+        }
+        if (sizeof(h) > readBufLen)
+            return false;
+    }
+
+    const uint8_t *p = readBuf + (offset - readBufOffset);
+    memcpy(&h, p, sizeof(h));
+    if (h.magic != HEADER_MAGIC || h.payloadSize > meshtastic_Constants_DATA_PAYLOAD_LEN ||
+        offset + sizeof(h) + h.payloadSize > readBufOffset + readBufLen)
+        return false;
+    uint32_t crc = h.crc;
+    h.crc = 0;
+    if (recordCRC(&h, sizeof(h), p + sizeof(h), h.payloadSize) != crc)
+        return false; // one we didn't finish writing, or worse
+    h.crc = crc;
+    memcpy(payload, p + sizeof(h), h.payloadSize);
+    return true;
+}
+
+bool StoreForwardLog::append(const PacketHistoryStruct &r, uint32_t epoch)
+{
+    if (!ready)
+        return false;
+
+    uint8_t buf[sizeof(Header) + meshtastic_Constants_DATA_PAYLOAD_LEN];
+    Header h = {HEADER_MAGIC, r.payload_size, r.seq, epoch, r.to, r.from, r.channel, r.flags, 0, 0};
+    h.crc = recordCRC(&h, sizeof(h), r.payload(), r.payload_size);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), r.payload(), r.payload_size);
+    size_t size = sizeof(h) + r.payload_size;
+
+    // A second go after dropping our oldest segment, which may be what was keeping the filesystem full
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if ((!numSegments || newest().size + size > STORE_FORWARD_LOG_SEGMENT_SIZE) && !startSegment())
+            continue;
+
+        Segment &s = newest();
+        char name[24];
+        segmentFileName(name, sizeof(name), s.number);
+        bool okay = false;
+        auto f = FSCom.open(name, s.size ? FILE_O_PATCH : FILE_O_WRITE);
+        if (f) {
+            okay = f.seek(s.size) && f.write(buf, size) == size;
+            f.close();
+        }
+        if (readSegment == s.number)
+            readBufLen = 0; // we may have read what was there before
+        if (okay) {
+            if (!s.firstSeq) {
+                s.firstSeq = r.seq;
+                s.firstEpoch = epoch;
+            }
+            s.lastSeq = r.seq;
+            s.lastEpoch = std::max(s.lastEpoch, epoch);
+            s.records++;
+            s.size += size;
+            return true;
+        }
+
+        LOG_ERROR("*** Can't append to %s, dropping our oldest S&F records\n", name);
+        if (numSegments > 1)
+            dropSegment();
+        else
+            s.size = STORE_FORWARD_LOG_SEGMENT_SIZE; // start afresh
+    }
+    return false;
+}
+
+bool StoreForwardLog::makeRoom()
+{
+    for (;;) {
+        size_t logBytes = STORE_FORWARD_LOG_SEGMENT_SIZE; // the one we're about to start, once it's full
+        for (size_t i = 0; i < numSegments; i++)
+            logBytes += segments[(firstIndex + i) % STORE_FORWARD_LOG_SEGMENTS].size;
+        size_t used = FSCom.usedBytes(), total = FSCom.totalBytes();
+        size_t freeBytes = used < total ? total - used : 0;
+        bool fits = numSegments < STORE_FORWARD_LOG_SEGMENTS && logBytes <= maxBytes &&
+                    freeBytes >= STORE_FORWARD_LOG_MIN_FREE + STORE_FORWARD_LOG_SEGMENT_SIZE;
+        if (fits)
+            return true;
+        if (!numSegments) {
+            LOG_WARN("*** Only %u bytes free, not starting a S&F log file\n", freeBytes);
+            return false;
+        }
+        dropSegment();
+    }
+}
+
+bool StoreForwardLog::startSegment()
+{
+    if (!makeRoom())
+        return false;
+    segments[(firstIndex + numSegments) % STORE_FORWARD_LOG_SEGMENTS] = Segment{nextNumber, 0, 0, 0, 0, 0, 0};
+    numSegments++;
+    nextNumber++;
+    saveState();
+
+    char name[24];
+    segmentFileName(name, sizeof(name), newest().number);
+    auto f = FSCom.open(name, FILE_O_WRITE);
+    if (!f) {
+        LOG_ERROR("*** Can't create %s\n", name);
+        return false;
+    }
+    f.close();
+    return true;
+}
+
+void StoreForwardLog::dropSegment()
+{
+    char name[24];
+    segmentFileName(name, sizeof(name), segments[firstIndex].number);
+    if (FSCom.exists(name))
+        FSCom.remove(name);
+    LOG_INFO("*** S&F log dropping %s, %u records\n", name, segments[firstIndex].records);
+    firstIndex = (firstIndex + 1) % STORE_FORWARD_LOG_SEGMENTS;
+    numSegments--;
+    saveState();
+}
+
+void StoreForwardLog::saveState()
+{
+    SavedState s = {STATE_MAGIC, numSegments ? segments[firstIndex].number : nextNumber, nextNumber};
+    auto f = FSCom.open(stateFileName, FILE_O_WRITE);
+    if (!f || f.write((const uint8_t *)&s, sizeof(s)) != sizeof(s))
+        LOG_ERROR("*** Can't write %s\n", stateFileName);
+    if (f)
+        f.close();
+}
+
+void StoreForwardLog::loadState()
+{
+    SavedState s;
+    bool okay = false;
+    auto f = FSCom.open(stateFileName, FILE_O_READ);
+    if (f) {
+        okay = f.read((uint8_t *)&s, sizeof(s)) == (int)sizeof(s) && s.magic == STATE_MAGIC &&
+               s.nextNumber - s.firstNumber <= STORE_FORWARD_LOG_SEGMENTS;
+        f.close();
+    }
+    if (!okay)
+        return;
+
+    nextNumber = s.nextNumber;
+    for (uint32_t n = s.firstNumber; n < s.nextNumber; n++) {
+        Segment &seg = segments[numSegments++];
+        seg = Segment{n, 0, 0, 0, 0, 0, 0};
+        scanSegment(seg);
+    }
+}
+
+void StoreForwardLog::scanSegment(Segment &s)
+{
+    char name[24];
+    segmentFileName(name, sizeof(name), s.number);
+    auto f = FSCom.open(name, FILE_O_READ);
+    if (!f)
+        return;
+    uint32_t fileSize = f.size();
+    f.close();
+
+    // Stop at anything which isn't a whole record, such as the end of a write we didn't finish, the next goes there
+    Header h;
+    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    while (readRecord(s.number, s.size, fileSize, h, payload)) {
+        if (!s.firstSeq) {
+            s.firstSeq = h.seq;
+            s.firstEpoch = h.epoch;
+        }
+        s.lastSeq = h.seq;
+        s.lastEpoch = std::max(s.lastEpoch, h.epoch);
+        s.records++;
+        s.size += sizeof(h) + h.payloadSize;
+    }
+    if (s.size < fileSize)
+        LOG_WARN("*** %s ends in %u bytes which aren't a whole record, writing over them\n", name, fileSize - s.size);
+}
+#else
+bool StoreForwardLog::init()
+{
+    return false;
+}
+
+bool StoreForwardLog::readRecord(uint32_t segment, uint32_t offset, uint32_t limit, Header &h, uint8_t *payload)
+{
+    return false;
+}
+
+bool StoreForwardLog::append(const PacketHistoryStruct &r, uint32_t epoch)
+{
+    return false;
+}
+
+bool StoreForwardLog::makeRoom()
+{
+    return false;
+}
+
+bool StoreForwardLog::startSegment()
+{
+    return false;
+}
+
+void StoreForwardLog::dropSegment() {}
+
+void StoreForwardLog::saveState() {}
+
+void StoreForwardLog::loadState() {}
+
+void StoreForwardLog::scanSegment(Segment &s) {}
+#endif
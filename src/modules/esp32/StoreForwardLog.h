@@ -0,0 +1,139 @@
+#pragma once
+
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Keep our S&F history in files on flash too, so it outlives a reboot and can go back further than PSRAM holds.  Opt in
+/// with -DSTORE_FORWARD_LOG=1
+#ifndef STORE_FORWARD_LOG
+#define STORE_FORWARD_LOG 0
+#endif
+
+/// The most of the filesystem our log may take, in percent of its size
+#ifndef STORE_FORWARD_LOG_MAX_FS_PERCENT
+#define STORE_FORWARD_LOG_MAX_FS_PERCENT 25
+#endif
+
+/// What we always leave free on the filesystem, for our prefs and node store, before starting a segment
+#ifndef STORE_FORWARD_LOG_MIN_FREE
+#define STORE_FORWARD_LOG_MIN_FREE 65536
+#endif
+
+/// How many files our log is split into; once we have them all (or we're out of our share of the filesystem) the oldest is
+/// dropped
+#ifndef STORE_FORWARD_LOG_SEGMENTS
+#define STORE_FORWARD_LOG_SEGMENTS 16
+#endif
+
+/// How big each of them grows before we start the next
+#ifndef STORE_FORWARD_LOG_SEGMENT_SIZE
+#define STORE_FORWARD_LOG_SEGMENT_SIZE 32768
+#endif
+
+/// How much of a segment we read at a time
+#ifndef STORE_FORWARD_LOG_READ_SIZE
+#define STORE_FORWARD_LOG_READ_SIZE 2048
+#endif
+
+struct PacketHistoryStruct;
+
+/**
+ * The flash tier of StoreForwardModule's history: every record it keeps is appended here, to one of up to
+ * STORE_FORWARD_LOG_SEGMENTS files, while PSRAM holds the newest of them for quick answers.  All we keep in RAM is a summary of
+ * each segment (the seqs and times it holds), which is enough to find where a query should start reading; from there records
+ * are read in order, a block at a time.
+ *
+ * Each record has a CRC, so after a crash or power cut a record we didn't finish writing is found when we scan our segments
+ * again, and is written over.  Times are kept as RTC seconds (0 if we had no time then), as millis() starts again each boot.
+ */
+class StoreForwardLog
+{
+  public:
+    /// Where the next record to read is
+    struct Cursor {
+        uint32_t segment; // its number, not its place in segments[]
+        uint32_t offset;
+    };
+
+  private:
+    /// What each record on flash starts with, its payload follows
+    struct Header {
+        uint16_t magic;
+        uint16_t payloadSize;
+        uint32_t seq;
+        uint32_t epoch;
+        uint32_t to;
+        uint32_t from;
+        uint8_t channel;
+        uint8_t flags;
+        uint16_t reserved;
+        uint32_t crc; // of all of this (with crc 0) and the payload
+    };
+    static const uint16_t HEADER_MAGIC = 0x5346;
+
+    struct Segment {
+        uint32_t number;
+        uint32_t firstSeq, lastSeq; // 0 for none
+        uint32_t firstEpoch, lastEpoch;
+        uint32_t records;
+        uint32_t size; // of its whole records, where the next goes
+    };
+
+    /// Our segments, oldest first, as a ring of numSegments from segments[firstIndex]
+    Segment segments[STORE_FORWARD_LOG_SEGMENTS];
+    size_t firstIndex = 0, numSegments = 0;
+    uint32_t nextNumber = 0;
+    bool ready = false;
+
+    /// Our share of the filesystem, see STORE_FORWARD_LOG_MAX_FS_PERCENT
+    size_t maxBytes = 0;
+
+    /// What we last read from a segment
+    uint8_t *readBuf = NULL;
+    uint32_t readSegment = 0, readBufOffset = 0, readBufLen = 0;
+
+    Segment *findSegment(uint32_t number);
+    Segment &newest() { return segments[(firstIndex + numSegments - 1) % STORE_FORWARD_LOG_SEGMENTS]; }
+
+    /// Read the record at offset in segment (no further than limit into it) into h and payload, @return false if none
+    bool readRecord(uint32_t segment, uint32_t offset, uint32_t limit, Header &h, uint8_t *payload);
+
+    /// Find out what a segment we had before we rebooted holds, and where its whole records end
+    void scanSegment(Segment &s);
+
+    /// Drop our oldest segments until another whole one fits in our share and leaves STORE_FORWARD_LOG_MIN_FREE free,
+    /// @return false if it still doesn't
+    bool makeRoom();
+
+    bool startSegment();
+    void dropSegment();
+    void saveState();
+    void loadState();
+
+  public:
+    /// Find what we left on flash, @return false if we can't keep a log
+    bool init();
+
+    bool isReady() const { return ready; }
+
+    /// Append a record (whose payload follows it), @return false if it couldn't be written
+    bool append(const PacketHistoryStruct &r, uint32_t epoch);
+
+    /// @return the seq of our newest record, 0 if we have none
+    uint32_t getLastSeq();
+
+    /// @return the start of the oldest segment which may hold records from epoch on
+    Cursor seekEpoch(uint32_t epoch);
+
+    /// @return the start of the oldest segment among those holding about the newest bytes of our records
+    Cursor seekNewest(size_t bytes);
+
+    /**
+     * Read the record at c into r, which must have room for a whole payload after it, and move c on to the next.  Segments
+     * dropped since c was made are skipped.  r->time is left 0, @return false at the end of our log
+     */
+    bool next(Cursor &c, PacketHistoryStruct &r, uint32_t *epoch);
+
+    uint32_t getNumRecords() const;
+};
@@ -15,6 +15,7 @@
 #include "StoreForwardModule.h"
 #include "MeshService.h"
 #include "NodeDB.h"
+#include "PayloadCompression.h"
 #include "RTC.h"
 #include "Router.h"
 #include "airtime.h"
@@ -24,32 +25,52 @@
 #include "mesh/generated/meshtastic/storeforward.pb.h"
 #include "modules/ModuleDev.h"
 #include <Arduino.h>
+#include <algorithm>
 #include <iterator>
 #include <map>
 
 StoreForwardModule *storeForwardModule;
 
+/// Room for a record and the biggest payload, where we make new ones and read them back from our log
+static uint32_t recordScratch[PacketHistoryStruct::sizeFor(meshtastic_Constants_DATA_PAYLOAD_LEN) / sizeof(uint32_t)];
+
+static PacketHistoryStruct &scratchRecord()
+{
+    return *reinterpret_cast<PacketHistoryStruct *>(recordScratch);
+}
+
+/// Don't trust ages from the log beyond this, millis() based times only go back 49 days
+#define STORE_FORWARD_MAX_AGE_SECS (40 * 24 * 60 * 60)
+
 int32_t StoreForwardModule::runOnce()
 {
 #ifdef ARCH_ESP32
     if (moduleConfig.store_forward.enabled && is_server) {
-        // Send out the message queue.
-        if (this->busy) {
-            // Only send packets if the channel is less than 25% utilized.
-            if (airTime->isTxAllowedChannelUtil(true)) {
-                storeForwardModule->sendPayload(this->busyTo, this->packetHistoryTXQueue_index);
-                if (this->packetHistoryTXQueue_index == packetHistoryTXQueue_size) {
-                    // Tell the client we're done sending
-                    meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
-                    sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_PING;
-                    storeForwardModule->sendMessage(this->busyTo, sf);
-                    LOG_INFO("*** S&F - Done. (ROUTER_PING)\n");
-                    this->packetHistoryTXQueue_index = 0;
-                    this->busy = false;
-                } else {
-                    this->packetHistoryTXQueue_index++;
-                }
+        // Send out the message queues, a packet from each in turn
+        HistoryStream *s = NULL;
+        for (size_t i = 0; i < STORE_FORWARD_STREAMS && !s; i++) {
+            size_t n = (this->nextStream + i) % STORE_FORWARD_STREAMS;
+            if (this->streams[n].to) {
+                s = &this->streams[n];
+                this->nextStream = n + 1;
+            }
+        }
+        if (s) {
+            uint32_t gap = replayGap();
+            if (!gap)
+                return STORE_FORWARD_REPLAY_MAX_MS; // live traffic first
+            const PacketHistoryStruct *record = historyNext(*s);
+            if (record) {
+                storeForwardModule->sendPayload(s->to, *record);
+            } else {
+                // Tell the client we're done sending
+                meshtastic_StoreAndForward sf = meshtastic_StoreAndForward_init_zero;
+                sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_PING;
+                storeForwardModule->sendMessage(s->to, sf);
+                LOG_INFO("*** S&F - Done. (ROUTER_PING)\n");
+                s->to = 0;
             }
+            return gap;
         } else if ((millis() - lastHeartbeat > (heartbeatInterval * 1000)) && airTime->isTxAllowedChannelUtil(true)) {
             lastHeartbeat = millis();
             LOG_INFO("*** Sending heartbeat\n");
@@ -79,21 +100,31 @@ void StoreForwardModule::populatePSRAM()
     LOG_DEBUG("*** Before PSRAM initialization: heap %d/%d PSRAM %d/%d\n", memGet.getFreeHeap(), memGet.getHeapSize(),
               memGet.getFreePsram(), memGet.getPsramSize());
 
-    this->packetHistoryTXQueue =
-        static_cast<PacketHistoryStruct *>(ps_calloc(this->historyReturnMax, sizeof(PacketHistoryStruct)));
-
-    /* Use a maximum of 2/3 the available PSRAM unless otherwise specified.
+    /* Use a maximum of 2/3 the available PSRAM unless otherwise specified (in which case as much as that many records could
+        ever need), split between our arena and index by what we expect a record to take.
         Note: This needs to be done after every thing that would use PSRAM
     */
-    uint32_t numberOfPackets =
-        (this->records ? this->records : (((memGet.getFreePsram() / 3) * 2) / sizeof(PacketHistoryStruct)));
+    size_t perRecord = PacketHistoryStruct::sizeFor(STORE_FORWARD_TYPICAL_PAYLOAD) + sizeof(uint32_t);
+    size_t perBiggestRecord = PacketHistoryStruct::sizeFor(meshtastic_Constants_DATA_PAYLOAD_LEN) + sizeof(uint32_t);
+    uint32_t budget = this->records ? this->records * perBiggestRecord : ((memGet.getFreePsram() / 3) * 2);
+    uint32_t numberOfPackets = (this->records ? this->records : budget / perRecord);
     this->records = numberOfPackets;
-
-    this->packetHistory = static_cast<PacketHistoryStruct *>(ps_calloc(numberOfPackets, sizeof(PacketHistoryStruct)));
+    this->arenaSize = (budget - numberOfPackets * sizeof(uint32_t)) & ~3;
+
+    this->packetHistory = static_cast<uint32_t *>(ps_calloc(numberOfPackets, sizeof(uint32_t)));
+    this->arena = static_cast<uint8_t *>(ps_malloc(this->arenaSize));
+    if (!this->packetHistory || !this->arena) {
+        LOG_ERROR("*** Can't allocate %u bytes of S&F history\n", budget);
+        free(this->packetHistory);
+        free(this->arena);
+        this->packetHistory = NULL;
+        this->arena = NULL;
+        this->records = this->arenaSize = 0;
+    }
 
     LOG_DEBUG("*** After PSRAM initialization: heap %d/%d PSRAM %d/%d\n", memGet.getFreeHeap(), memGet.getHeapSize(),
               memGet.getFreePsram(), memGet.getPsramSize());
-    LOG_DEBUG("*** numberOfPackets for packetHistory - %u\n", numberOfPackets);
+    LOG_DEBUG("*** numberOfPackets for packetHistory - %u, in %u bytes\n", this->records, this->arenaSize);
 }
 
 /**
@@ -104,12 +135,20 @@ void StoreForwardModule::populatePSRAM()
  */
 void StoreForwardModule::historySend(uint32_t msAgo, uint32_t to)
 {
-    uint32_t queueSize = storeForwardModule->historyQueueCreate(msAgo, to);
+    HistoryStream *s = streamFor(to);
+    if (!s)
+        return;
+    uint32_t queueSize;
+    if (s->to) {
+        queueSize = s->txRemaining + s->coldRemaining; // carry on where we are
+    } else {
+        queueSize = historyQueueCreate(*s, msAgo, to);
+        if (queueSize)
+            s->to = to; // runOnce() will pick up the next steps
+    }
 
     if (queueSize) {
         LOG_INFO("*** S&F - Sending %u message(s)\n", queueSize);
-        this->busy = true; // runOnce() will pickup the next steps once busy = true.
-        this->busyTo = to;
     } else {
         LOG_INFO("*** S&F - No history to send\n");
     }
@@ -122,70 +161,263 @@ void StoreForwardModule::historySend(uint32_t msAgo, uint32_t to)
 }
 
 /**
- * Creates a new history queue with messages that were received within the specified time frame.
+ * Lines up the records sent to the specified node (or broadcast) within the specified time frame, for historyNext() to hand
+ * out.  Nothing is copied, and only those records are looked at: we walk back from the newest of each (broadcast and to)
+ * along their prevSameTo links until they're older than the window, or we have historyReturnMax of them.
  *
  * @param msAgo The number of milliseconds ago to start the history queue.
- * @param to The maximum number of messages to include in the history queue.
- * @return The ID of the newly created history queue.
+ * @param to The node the records are for.
+ * @return The number of records lined up.
  */
-uint32_t StoreForwardModule::historyQueueCreate(uint32_t msAgo, uint32_t to)
+uint32_t StoreForwardModule::historyQueueCreate(HistoryStream &s, uint32_t msAgo, uint32_t to)
 {
+    auto lastTo = [this](NodeNum n) {
+        auto i = historyLastTo.find(n);
+        return i == historyLastTo.end() ? 0 : i->second;
+    };
+    uint32_t now = millis();
+    uint32_t broadcast = lastTo(NODENUM_BROADCAST), direct = to != NODENUM_BROADCAST ? lastTo(to) : 0;
+    s.txBroadcast = s.txDirect = s.txRemaining = 0;
+
+    while (s.txRemaining < this->historyReturnMax) {
+        PacketHistoryStruct *b = historyGet(broadcast), *d = historyGet(direct);
+        if (b && now - b->time >= msAgo)
+            b = NULL;
+        if (d && now - d->time >= msAgo)
+            d = NULL;
+        if (!b && !d)
+            break;
+
+        // The newer of the two, so we end up with the newest historyReturnMax between them
+        if (b && (!d || b->seq > d->seq)) {
+            s.txBroadcast = b->seq;
+            broadcast = b->prevSameTo;
+        } else {
+            s.txDirect = d->seq;
+            direct = d->prevSameTo;
+        }
+        s.txRemaining++;
+    }
 
-    this->packetHistoryTXQueue_size = 0;
+    // If that's not all we can send, what's older than PSRAM holds is in our log (by RTC time, as it may be from before we
+    // rebooted).  We count it first, reading it through once, so we can say how many and send only the newest
+    s.coldRemaining = s.coldSkip = 0;
+    uint32_t nowEpoch = getValidTime(RTCQualityFromNet);
+    if (historyLog.isReady() && nowEpoch && s.txRemaining < this->historyReturnMax) {
+        s.coldBelowSeq = this->historySeq - this->packetHistoryCurrent + 1;
+        s.coldFromEpoch = nowEpoch - std::min(nowEpoch, msAgo / 1000);
+        s.coldCursor = historyLog.seekEpoch(s.coldFromEpoch);
+
+        StoreForwardLog::Cursor c = s.coldCursor;
+        PacketHistoryStruct &r = scratchRecord();
+        uint32_t n = 0, epoch;
+        while (historyLog.next(c, r, &epoch) && r.seq < s.coldBelowSeq)
+            if (epoch >= s.coldFromEpoch && historyFor(r, to))
+                n++;
+        s.coldRemaining = std::min(n, this->historyReturnMax - s.txRemaining);
+        s.coldSkip = n - s.coldRemaining;
+    }
+    return s.txRemaining + s.coldRemaining;
+}
 
-    for (int i = 0; i < this->packetHistoryCurrent; i++) {
-        /*
-            LOG_DEBUG("SF historyQueueCreate\n");
-            LOG_DEBUG("SF historyQueueCreate - time %d\n", this->packetHistory[i].time);
-            LOG_DEBUG("SF historyQueueCreate - millis %d\n", millis());
-            LOG_DEBUG("SF historyQueueCreate - math %d\n", (millis() - msAgo));
-        */
-        if (this->packetHistory[i].time && (this->packetHistory[i].time < (millis() - msAgo))) {
-            LOG_DEBUG("*** SF historyQueueCreate - Time matches - ok\n");
-            /*
-                Copy the messages that were received by the router in the last msAgo
-                to the packetHistoryTXQueue structure.
-
-                TODO: The condition (this->packetHistory[i].to & NODENUM_BROADCAST) == to) is not tested since
-                I don't have an easy way to target a specific user. Will need to do this soon.
-            */
-            if ((this->packetHistory[i].to & NODENUM_BROADCAST) == NODENUM_BROADCAST ||
-                ((this->packetHistory[i].to & NODENUM_BROADCAST) == to)) {
-                this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].time = this->packetHistory[i].time;
-                this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].to = this->packetHistory[i].to;
-                this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].from = this->packetHistory[i].from;
-                this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].channel = this->packetHistory[i].channel;
-                this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].payload_size = this->packetHistory[i].payload_size;
-                memcpy(this->packetHistoryTXQueue[this->packetHistoryTXQueue_size].payload, this->packetHistory[i].payload,
-                       meshtastic_Constants_DATA_PAYLOAD_LEN);
-                this->packetHistoryTXQueue_size++;
-
-                LOG_DEBUG("*** PacketHistoryStruct time=%d\n", this->packetHistory[i].time);
-                LOG_DEBUG("*** PacketHistoryStruct msg=%s\n", this->packetHistory[i].payload);
-            }
+PacketHistoryStruct *StoreForwardModule::historyGet(uint32_t seq)
+{
+    if (!seq || seq > this->historySeq || this->historySeq - seq >= this->packetHistoryCurrent)
+        return NULL; // never was, or dropped since
+    return reinterpret_cast<PacketHistoryStruct *>(this->arena + this->packetHistory[seq % this->records]);
+}
+
+int32_t StoreForwardModule::historyFit(size_t size) const
+{
+    if (size > this->arenaSize)
+        return -1;
+    if (!this->packetHistoryCurrent)
+        return 0;
+    if (this->arenaHead > this->arenaTail) // we hold [arenaTail, arenaHead)
+        return this->arenaHead + size <= this->arenaSize ? this->arenaHead : (size <= this->arenaTail ? 0 : -1);
+    return this->arenaHead + size <= this->arenaTail ? this->arenaHead : -1; // we hold the rest, wrapping round
+}
+
+void StoreForwardModule::historyDropOldest()
+{
+    uint32_t oldest = this->historySeq - this->packetHistoryCurrent + 1;
+    const PacketHistoryStruct *r = historyGet(oldest);
+    auto last = historyLastTo.find(r->to);
+    if (last != historyLastTo.end() && last->second == oldest)
+        historyLastTo.erase(last); // that was the only one left for its to
+
+    this->packetHistoryCurrent--;
+    if (this->packetHistoryCurrent)
+        this->arenaTail = this->packetHistory[(oldest + 1) % this->records];
+    else
+        this->arenaHead = this->arenaTail = 0;
+}
+
+PacketHistoryStruct *StoreForwardModule::historyNext(HistoryStream &s)
+{
+    // The oldest first, from our log
+    while (s.coldRemaining) {
+        PacketHistoryStruct &r = scratchRecord();
+        uint32_t epoch;
+        if (!historyLog.next(s.coldCursor, r, &epoch) || r.seq >= s.coldBelowSeq) {
+            s.coldRemaining = 0; // dropped while we were sending them
+            break;
+        }
+        if (epoch < s.coldFromEpoch || !historyFor(r, s.to))
+            continue;
+        if (s.coldSkip) {
+            s.coldSkip--;
+            continue;
         }
+        s.coldRemaining--;
+        return &r;
     }
-    return this->packetHistoryTXQueue_size;
+
+    if (!s.txRemaining)
+        return NULL;
+
+    PacketHistoryStruct *b = historyGet(s.txBroadcast), *d = historyGet(s.txDirect);
+    if (!b && !d) {
+        s.txRemaining = 0; // written over while we were sending them
+        return NULL;
+    }
+    s.txRemaining--;
+    if (b && (!d || b->seq < d->seq)) { // the older of the two
+        s.txBroadcast = b->nextSameTo;
+        return b;
+    }
+    s.txDirect = d->nextSameTo;
+    return d;
+}
+
+StoreForwardModule::HistoryStream *StoreForwardModule::streamFor(NodeNum to)
+{
+    HistoryStream *free = NULL;
+    for (HistoryStream &s : this->streams) {
+        if (s.to == to)
+            return &s;
+        if (!s.to && !free)
+            free = &s;
+    }
+    return free;
 }
 
 /**
- * Adds a mesh packet to the history buffer for store-and-forward functionality.
+ * Paces the history we stream by what live traffic leaves of the channel: packets go STORE_FORWARD_REPLAY_MIN_MS apart on a
+ * quiet one, further apart as channel utilization (or, where there's a duty cycle, our share of it) nears the polite limit,
+ * and not at all past it, or while our TX queue is backing up.  All our streams share this, taking turns.
+ */
+uint32_t StoreForwardModule::replayGap()
+{
+    meshtastic_QueueStatus qs = router->getQueueStatus();
+    if (qs.maxlen - qs.free > STORE_FORWARD_REPLAY_QUEUE)
+        return 0;
+
+    float headroom = 1 - airTime->channelUtilizationPercent() / STORE_FORWARD_REPLAY_CHANNEL_UTIL;
+    if (!config.lora.override_duty_cycle && myRegion->dutyCycle < 100)
+        headroom = std::min(headroom, 1 - airTime->utilizationTXPercent() / (myRegion->dutyCycle / 2));
+    if (headroom <= 0) {
+        LOG_DEBUG("*** S&F - Channel is busy, holding history back\n");
+        return 0;
+    }
+    return STORE_FORWARD_REPLAY_MIN_MS + (STORE_FORWARD_REPLAY_MAX_MS - STORE_FORWARD_REPLAY_MIN_MS) * (1 - headroom);
+}
+
+/**
+ * Adds a mesh packet to the history buffer for store-and-forward functionality, and to our log.  Records take only the arena
+ * space their payload needs, and once there isn't enough (or our index is full) the oldest make way.
  *
  * @param mp The mesh packet to add to the history buffer.
  */
 void StoreForwardModule::historyAdd(const meshtastic_MeshPacket &mp)
 {
     const auto &p = mp.decoded;
+    PacketHistoryStruct &r = scratchRecord();
+    r.seq = this->historySeq + 1;
+    r.time = millis();
+    r.to = mp.to;
+    r.from = mp.from;
+    r.channel = mp.channel;
+    r.flags = 0;
+    r.payload_size = p.payload.size;
+    memcpy(r.payload(), p.payload.bytes, p.payload.size);
+#if STORE_FORWARD_COMPRESS
+    char compressed[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    int compressedSize = unishoxCompress((const char *)p.payload.bytes, p.payload.size, compressed, sizeof(compressed));
+    if (compressedSize > 0 && compressedSize < r.payload_size) {
+        memcpy(r.payload(), compressed, compressedSize);
+        r.payload_size = compressedSize;
+        r.flags |= PacketHistoryStruct::COMPRESSED;
+    }
+#endif
+
+    historyStore(r);
+    this->historySeq = r.seq;
+    this->packetHistoryMax++;
+    historyLog.append(r, getValidTime(RTCQualityFromNet));
+}
 
-    this->packetHistory[this->packetHistoryCurrent].time = millis();
-    this->packetHistory[this->packetHistoryCurrent].to = mp.to;
-    this->packetHistory[this->packetHistoryCurrent].channel = mp.channel;
-    this->packetHistory[this->packetHistoryCurrent].from = mp.from;
-    this->packetHistory[this->packetHistoryCurrent].payload_size = p.payload.size;
-    memcpy(this->packetHistory[this->packetHistoryCurrent].payload, p.payload.bytes, meshtastic_Constants_DATA_PAYLOAD_LEN);
+void StoreForwardModule::historyStore(const PacketHistoryStruct &record)
+{
+    if (!this->arena)
+        return;
+    if (record.seq != this->historySeq + 1) {
+        // A gap in what we logged, which our index can't span, so start again from here
+        this->packetHistoryCurrent = 0;
+        this->arenaHead = this->arenaTail = 0;
+        historyLastTo.clear();
+    }
 
+    size_t size = PacketHistoryStruct::sizeFor(record.payload_size);
+    while (this->packetHistoryCurrent && (this->packetHistoryCurrent >= this->records || historyFit(size) < 0))
+        historyDropOldest();
+    int32_t at = historyFit(size);
+    if (at < 0) {
+        this->packetHistoryCurrent = 0; // bigger than our whole arena, and the seqs we hold must have no gaps
+        return;
+    }
+
+    this->historySeq = record.seq;
+    this->packetHistory[record.seq % this->records] = at;
+    this->arenaHead = at + size;
     this->packetHistoryCurrent++;
-    this->packetHistoryMax++;
+
+    PacketHistoryStruct &r = *reinterpret_cast<PacketHistoryStruct *>(this->arena + at);
+    memcpy(&r, &record, sizeof(r) + record.payload_size);
+    r.nextSameTo = 0;
+
+    uint32_t &lastTo = historyLastTo[r.to];
+    r.prevSameTo = lastTo;
+    PacketHistoryStruct *prev = historyGet(lastTo);
+    if (prev)
+        prev->nextSameTo = r.seq;
+    lastTo = r.seq;
+}
+
+void StoreForwardModule::historyWarm()
+{
+    // Without the time we can't tell how old what we logged is, so it stays on flash (queries will find it there)
+    uint32_t nowEpoch = getValidTime(RTCQualityFromNet);
+    if (this->arena && nowEpoch) {
+        StoreForwardLog::Cursor c = historyLog.seekNewest(this->arenaSize);
+        PacketHistoryStruct &r = scratchRecord();
+        uint32_t epoch, n = 0;
+        while (historyLog.next(c, r, &epoch)) {
+            uint32_t age = (epoch && epoch <= nowEpoch) ? nowEpoch - epoch : STORE_FORWARD_MAX_AGE_SECS;
+            r.time = millis() - std::min<uint32_t>(age, STORE_FORWARD_MAX_AGE_SECS) * 1000;
+            historyStore(r);
+            n++;
+        }
+        LOG_INFO("*** S&F read %u records back from our log, holding %u\n", n, this->packetHistoryCurrent);
+    }
+
+    uint32_t lastSeq = historyLog.getLastSeq();
+    if (lastSeq > this->historySeq) {
+        this->packetHistoryCurrent = 0; // we don't hold the newest, and can't have gaps
+        this->arenaHead = this->arenaTail = 0;
+        historyLastTo.clear();
+        this->historySeq = lastSeq;
+    }
 }
 
 meshtastic_MeshPacket *StoreForwardModule::allocReply()
@@ -198,25 +430,36 @@ meshtastic_MeshPacket *StoreForwardModule::allocReply()
  * Sends a payload to a specified destination node using the store and forward mechanism.
  *
  * @param dest The destination node number.
- * @param packetHistory_index The index of the packet in the packet history buffer.
+ * @param record The record in the packet history buffer.
  */
-void StoreForwardModule::sendPayload(NodeNum dest, uint32_t packetHistory_index)
+void StoreForwardModule::sendPayload(NodeNum dest, const PacketHistoryStruct &record)
 {
     LOG_INFO("*** Sending S&F Payload\n");
+    const uint8_t *payload = record.payload();
+    size_t payloadSize = record.payload_size;
+    char expanded[meshtastic_Constants_DATA_PAYLOAD_LEN];
+    if (record.flags & PacketHistoryStruct::COMPRESSED) {
+        int len = unishoxDecompress((const char *)payload, payloadSize, expanded, sizeof(expanded));
+        if (len < 0) {
+            LOG_ERROR("*** Can't decompress S&F record %u\n", record.seq);
+            return;
+        }
+        payload = (const uint8_t *)expanded;
+        payloadSize = len;
+    }
+
     meshtastic_MeshPacket *p = allocReply();
 
     p->to = dest;
-    p->from = this->packetHistoryTXQueue[packetHistory_index].from;
-    p->channel = this->packetHistoryTXQueue[packetHistory_index].channel;
+    p->from = record.from;
+    p->channel = record.channel;
 
     // Let's assume that if the router received the S&F request that the client is in range.
     //   TODO: Make this configurable.
     p->want_ack = false;
 
-    p->decoded.payload.size =
-        this->packetHistoryTXQueue[packetHistory_index].payload_size; // You must specify how many bytes are in the reply
-    memcpy(p->decoded.payload.bytes, this->packetHistoryTXQueue[packetHistory_index].payload,
-           this->packetHistoryTXQueue[packetHistory_index].payload_size);
+    p->decoded.payload.size = payloadSize; // You must specify how many bytes are in the reply
+    memcpy(p->decoded.payload.bytes, payload, payloadSize);
 
     service.sendToMesh(p);
 }
@@ -273,7 +516,7 @@ void StoreForwardModule::statsSend(uint32_t to)
     sf.rr = meshtastic_StoreAndForward_RequestResponse_ROUTER_STATS;
     sf.which_variant = meshtastic_StoreAndForward_stats_tag;
     sf.variant.stats.messages_total = this->packetHistoryMax;
-    sf.variant.stats.messages_saved = this->packetHistoryCurrent;
+    sf.variant.stats.messages_saved = historyLog.isReady() ? historyLog.getNumRecords() : this->packetHistoryCurrent;
     sf.variant.stats.messages_max = this->records;
     sf.variant.stats.up_time = millis() / 1000;
     sf.variant.stats.requests = this->requests;
@@ -306,7 +549,7 @@ ProcessMessage StoreForwardModule::handleReceived(const meshtastic_MeshPacket &m
                     LOG_DEBUG("*** Legacy Request to send\n");
 
                     // Send the last 60 minutes of messages.
-                    if (this->busy) {
+                    if (!streamFor(getFrom(&mp))) {
                         storeForwardModule->sendMessage(getFrom(&mp), meshtastic_StoreAndForward_RequestResponse_ROUTER_BUSY);
                         LOG_INFO("*** S&F - Busy. Try again shortly.\n");
                         meshtastic_MeshPacket *pr = allocReply();
@@ -369,10 +612,10 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
     case meshtastic_StoreAndForward_RequestResponse_CLIENT_ABORT:
         if (is_server) {
             // stop sending stuff, the client wants to abort or has another error
-            if ((this->busy) && (this->busyTo == getFrom(&mp))) {
+            HistoryStream *s = streamFor(getFrom(&mp));
+            if (s && s->to) {
                 LOG_ERROR("*** Client in ERROR or ABORT requested\n");
-                this->packetHistoryTXQueue_index = 0;
-                this->busy = false;
+                s->to = 0;
             }
         }
         break;
@@ -382,7 +625,7 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
             requests_history++;
             LOG_INFO("*** Client Request to send HISTORY\n");
             // Send the last 60 minutes of messages.
-            if (this->busy) {
+            if (!streamFor(getFrom(&mp))) {
                 storeForwardModule->sendMessage(getFrom(&mp), meshtastic_StoreAndForward_RequestResponse_ROUTER_BUSY);
                 LOG_INFO("*** S&F - Busy. Try again shortly.\n");
             } else {
@@ -414,7 +657,7 @@ bool StoreForwardModule::handleReceivedProtobuf(const meshtastic_MeshPacket &mp,
     case meshtastic_StoreAndForward_RequestResponse_CLIENT_STATS:
         if (is_server) {
             LOG_INFO("*** Client Request to send STATS\n");
-            if (this->busy) {
+            if (!streamFor(getFrom(&mp))) {
                 storeForwardModule->sendMessage(getFrom(&mp), meshtastic_StoreAndForward_RequestResponse_ROUTER_BUSY);
                 LOG_INFO("*** S&F - Busy. Try again shortly.\n");
             } else {
@@ -535,6 +778,8 @@ StoreForwardModule::StoreForwardModule()
 
                     // Popupate PSRAM with our data structures.
                     this->populatePSRAM();
+                    if (historyLog.init())
+                        historyWarm();
                     is_server = true;
                 } else {
                     LOG_INFO("*** Device has less than 1M of PSRAM free.\n");
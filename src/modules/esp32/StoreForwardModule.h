@@ -1,36 +1,106 @@
 #pragma once
 
 #include "ProtobufModule.h"
+#include "StoreForwardLog.h"
 #include "concurrency/OSThread.h"
 #include "mesh/generated/meshtastic/storeforward.pb.h"
 
 #include "configuration.h"
 #include <Arduino.h>
 #include <functional>
-
+#include <map>
+
+/// Compress text we store with unishox2 (where it comes out smaller), fitting more in but costing a little CPU each way
+#ifndef STORE_FORWARD_COMPRESS
+#define STORE_FORWARD_COMPRESS 0
+#endif
+
+/// What we expect a record's payload to average, to size our index of records by (see populatePSRAM())
+#ifndef STORE_FORWARD_TYPICAL_PAYLOAD
+#define STORE_FORWARD_TYPICAL_PAYLOAD 48
+#endif
+
+/// How many nodes we stream history to at once, sharing what the channel has to spare between them (see replayGap())
+#ifndef STORE_FORWARD_STREAMS
+#define STORE_FORWARD_STREAMS 3
+#endif
+
+/// The least and most time between history packets we stream, on a quiet channel and on one near our limits
+#ifndef STORE_FORWARD_REPLAY_MIN_MS
+#define STORE_FORWARD_REPLAY_MIN_MS 1000
+#endif
+#ifndef STORE_FORWARD_REPLAY_MAX_MS
+#define STORE_FORWARD_REPLAY_MAX_MS 15000
+#endif
+
+/// Hold history back while our TX queue has more than this many packets waiting, so live traffic goes first
+#ifndef STORE_FORWARD_REPLAY_QUEUE
+#define STORE_FORWARD_REPLAY_QUEUE 2
+#endif
+
+/// Channel utilization (percent) history may use up to, the polite limit of isTxAllowedChannelUtil()
+#ifndef STORE_FORWARD_REPLAY_CHANNEL_UTIL
+#define STORE_FORWARD_REPLAY_CHANNEL_UTIL 25
+#endif
+
+/**
+ * One record of our history, which is an arena of these (see historyAdd()), each followed by its payload_size bytes of
+ * payload and padded to 4 bytes
+ */
 struct PacketHistoryStruct {
+    uint32_t seq; // which record this is since boot (from 1), 0 for the gap before the arena wraps
     uint32_t time;
     uint32_t to;
     uint32_t from;
+    uint32_t prevSameTo; // the seq of the record before (and after) it with the same to, 0 for none
+    uint32_t nextSameTo;
     uint8_t channel;
-    bool ack;
-    uint8_t payload[meshtastic_Constants_DATA_PAYLOAD_LEN];
-    pb_size_t payload_size;
+    uint8_t flags; // COMPRESSED
+    uint16_t payload_size;
+
+    enum : uint8_t { COMPRESSED = 0x1 }; // payload is unishox2
+
+    const uint8_t *payload() const { return (const uint8_t *)(this + 1); }
+    uint8_t *payload() { return (uint8_t *)(this + 1); }
+
+    /// The bytes a record with this much payload takes in the arena
+    static constexpr size_t sizeFor(size_t payloadSize) { return (sizeof(PacketHistoryStruct) + payloadSize + 3) & ~3; }
 };
 
 class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<meshtastic_StoreAndForward>
 {
-    bool busy = 0;
-    uint32_t busyTo = 0;
     char routerMessage[meshtastic_Constants_DATA_PAYLOAD_LEN] = {0};
 
-    PacketHistoryStruct *packetHistory = 0;
-    uint32_t packetHistoryCurrent = 0;
-    uint32_t packetHistoryMax = 0;
+    /// Our records, oldest at arenaTail and the next to go at arenaHead (byte offsets), wrapping round at arenaSize
+    uint8_t *arena = 0;
+    uint32_t arenaSize = 0, arenaHead = 0, arenaTail = 0;
+
+    /// Where each record we hold starts in arena, by seq % records
+    uint32_t *packetHistory = 0;
+    uint32_t packetHistoryCurrent = 0; // records we hold
+    uint32_t packetHistoryMax = 0;     // records we've stored since boot
+
+    /// The seq of the newest record (records are in time order, so seq order), and that of the newest for each to
+    uint32_t historySeq = 0;
+    std::map<NodeNum, uint32_t> historyLastTo;
+
+    /// Everything we keep, on flash
+    StoreForwardLog historyLog;
 
-    PacketHistoryStruct *packetHistoryTXQueue = 0;
-    uint32_t packetHistoryTXQueue_size = 0;
-    uint32_t packetHistoryTXQueue_index = 0;
+    /// Where we are in what historySend() is streaming to a node, which a new request from it carries on from
+    struct HistoryStream {
+        NodeNum to; // 0 for a free slot
+
+        /// The next broadcast and direct records in PSRAM (seqs, 0 for none) and how many more
+        uint32_t txBroadcast, txDirect, txRemaining;
+
+        /// What we stream from our log before those: the records for to from coldFromEpoch on and older than coldBelowSeq
+        /// (those after are in PSRAM), but not the first coldSkip of them
+        StoreForwardLog::Cursor coldCursor;
+        uint32_t coldBelowSeq, coldFromEpoch, coldSkip, coldRemaining;
+    };
+    HistoryStream streams[STORE_FORWARD_STREAMS] = {};
+    size_t nextStream = 0; // which runOnce() sends from next, round robin
 
     uint32_t packetTimeMax = 5000;
 
@@ -51,12 +121,10 @@ class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<
     void statsSend(uint32_t to);
     void historySend(uint32_t msAgo, uint32_t to);
 
-    uint32_t historyQueueCreate(uint32_t msAgo, uint32_t to);
-
     /**
      * Send our payload into the mesh
      */
-    void sendPayload(NodeNum dest = NODENUM_BROADCAST, uint32_t packetHistory_index = 0);
+    void sendPayload(NodeNum dest, const PacketHistoryStruct &record);
     void sendMessage(NodeNum dest, const meshtastic_StoreAndForward &payload);
     void sendMessage(NodeNum dest, meshtastic_StoreAndForward_RequestResponse rr);
 
@@ -75,9 +143,51 @@ class StoreForwardModule : private concurrency::OSThread, public ProtobufModule<
         }
     }
 
+    virtual void getPortNums(std::vector<meshtastic_PortNum> &ports) override
+    {
+        ports.push_back(meshtastic_PortNum_TEXT_MESSAGE_APP);
+        ports.push_back(meshtastic_PortNum_STORE_FORWARD_APP);
+    }
+
   private:
     void populatePSRAM();
 
+    /// @return the record seq if we still have it, else NULL
+    PacketHistoryStruct *historyGet(uint32_t seq);
+
+    /// @return where a record of size bytes would go in arena, or -1 if there's no room without losing our oldest
+    int32_t historyFit(size_t size) const;
+
+    /// Lose our oldest record (from PSRAM, the log keeps it)
+    void historyDropOldest();
+
+    /// Put r (whose payload follows it) in PSRAM as our newest record, making room as needed
+    void historyStore(const PacketHistoryStruct &r);
+
+    /// Fill PSRAM with the newest of what we logged before we rebooted
+    void historyWarm();
+
+    /// @return whether a record is one historyQueueCreate() wants for to
+    static bool historyFor(const PacketHistoryStruct &r, uint32_t to)
+    {
+        return r.to == NODENUM_BROADCAST || (to != NODENUM_BROADCAST && r.to == to);
+    }
+
+    /**
+     * Line up in s what was sent to to (or broadcast) in the last msAgo, at most historyReturnMax records of it.
+     * @return how many records that is
+     */
+    uint32_t historyQueueCreate(HistoryStream &s, uint32_t msAgo, uint32_t to);
+
+    /// @return the next record historyQueueCreate() lined up in s (oldest first), NULL once there are no more
+    PacketHistoryStruct *historyNext(HistoryStream &s);
+
+    /// @return the stream we have going to to, else a free one, else NULL (we're busy)
+    HistoryStream *streamFor(NodeNum to);
+
+    /// @return how long to wait before the next history packet we stream, 0 to hold them back for now
+    uint32_t replayGap();
+
     // S&F Defaults
     uint32_t historyReturnMax = 250;    // 250 records
     uint32_t historyReturnWindow = 240; // 4 hours
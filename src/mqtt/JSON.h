@@ -25,6 +25,7 @@
 #ifndef _JSON_H_
 #define _JSON_H_
 
+#include "memGet.h"
 #include <cstring>
 #include <map>
 #include <string>
@@ -47,8 +48,10 @@ static inline bool simplejson_csnlen(const char *s, size_t n)
 
 // Custom types
 class JSONValue;
-typedef std::vector<JSONValue *> JSONArray;
-typedef std::map<std::string, JSONValue *> JSONObject;
+typedef std::vector<JSONValue *, HeapSiteAllocator<JSONValue *, HEAP_SITE_JSON>> JSONArray;
+typedef std::map<std::string, JSONValue *, std::less<std::string>,
+                 HeapSiteAllocator<std::pair<const std::string, JSONValue *>, HEAP_SITE_JSON>>
+    JSONObject;
 
 #include "JSONValue.h"
 
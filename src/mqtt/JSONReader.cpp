@@ -0,0 +1,245 @@
+#include "JSONReader.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool JSONReader::parse(char *json, Callback cb, void *context)
+{
+    JSONReader r(json, cb, context);
+    if (!r.parseValue(0, NULL))
+        return false;
+    r.skipSpace();
+    return *r.p == 0; // nothing but whitespace after the document
+}
+
+bool JSONReader::isValid(const char *json)
+{
+    return parse(const_cast<char *>(json), NULL, NULL); // with no callback we never write to it
+}
+
+void JSONReader::skipSpace()
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+}
+
+bool JSONReader::parseLiteral(const char *word)
+{
+    size_t n = strlen(word);
+    if (strncmp(p, word, n))
+        return false;
+    p += n;
+    return true;
+}
+
+bool JSONReader::parseValue(uint8_t depth, const char *key)
+{
+    Event e = {};
+    e.depth = depth;
+    e.key = key;
+
+    skipSpace();
+    switch (*p) {
+    case '{':
+    case '[':
+        return parseContainer(e);
+    case '"':
+        e.type = JSON_STRING;
+        if (!parseString(&e.str, &e.len))
+            return false;
+        break;
+    case 't':
+        e.type = JSON_BOOL;
+        e.boolean = true;
+        if (!parseLiteral("true"))
+            return false;
+        break;
+    case 'f':
+        e.type = JSON_BOOL;
+        if (!parseLiteral("false"))
+            return false;
+        break;
+    case 'n':
+        e.type = JSON_NULL;
+        if (!parseLiteral("null"))
+            return false;
+        break;
+    default:
+        e.type = JSON_NUMBER;
+        if (!parseNumber(e))
+            return false;
+    }
+    return !cb || cb(e, context);
+}
+
+bool JSONReader::parseContainer(Event &e)
+{
+    bool isObject = *p++ == '{';
+    e.type = isObject ? JSON_OBJECT : JSON_ARRAY;
+    if (e.depth + 1 >= JSON_MAX_DEPTH || (cb && !cb(e, context)))
+        return false;
+
+    char close = isObject ? '}' : ']';
+    skipSpace();
+    if (*p == close) {
+        p++;
+        return true;
+    }
+
+    for (;;) {
+        const char *key = NULL;
+        if (isObject) {
+            skipSpace();
+            size_t keyLen;
+            if (*p != '"' || !parseString(&key, &keyLen))
+                return false;
+            skipSpace();
+            if (*p++ != ':')
+                return false;
+        }
+        if (!parseValue(e.depth + 1, key))
+            return false;
+
+        skipSpace();
+        if (*p == close) {
+            p++;
+            return true;
+        }
+        if (*p++ != ',')
+            return false;
+    }
+}
+
+bool JSONReader::parseNumber(Event &e)
+{
+    // Check the grammar ourselves, strtod() takes more than JSON allows (hex, inf and so on)
+    const char *start = p;
+    if (*p == '-')
+        p++;
+    if (*p == '0')
+        p++;
+    else if (*p >= '1' && *p <= '9')
+        while (*p >= '0' && *p <= '9')
+            p++;
+    else
+        return false;
+
+    if (*p == '.') {
+        p++;
+        if (*p < '0' || *p > '9')
+            return false;
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-')
+            p++;
+        if (*p < '0' || *p > '9')
+            return false;
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+
+    e.number = strtod(start, NULL);
+    return true;
+}
+
+/// @return the value of a hex digit, or -1
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/// @return the code unit of the \uXXXX escape at s (just after its 'u'), or -1 if it isn't one
+static int32_t parseUnicodeEscape(const char *s)
+{
+    int32_t u = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hexDigit(s[i]);
+        if (d < 0)
+            return -1;
+        u = (u << 4) | d;
+    }
+    return u;
+}
+
+bool JSONReader::parseString(const char **str, size_t *len)
+{
+    // Escapes are never shorter than what they stand for, so unescaping in place never overtakes us
+    char *out = const_cast<char *>(++p);
+    *str = out;
+    for (;;) {
+        unsigned char c = *p++;
+        if (c == '"')
+            break;
+        if (c < ' ')
+            return false; // control characters (and the end of the document) can't be in a string
+
+        if (c != '\\') {
+            if (cb)
+                *out = c;
+            out++;
+            continue;
+        }
+
+        char esc = *p++;
+        const char *simple = strchr("\"\\/bfnrt", esc);
+        if (esc && simple) {
+            if (cb)
+                *out = "\"\\/\b\f\n\r\t"[simple - "\"\\/bfnrt"];
+            out++;
+            continue;
+        }
+        if (esc != 'u')
+            return false;
+
+        int32_t u = parseUnicodeEscape(p);
+        if (u < 0)
+            return false;
+        p += 4;
+        if (u >= 0xd800 && u < 0xdc00 && p[0] == '\\' && p[1] == 'u') {
+            int32_t low = parseUnicodeEscape(p + 2);
+            if (low >= 0xdc00 && low < 0xe000) {
+                u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            }
+        }
+
+        // As UTF-8
+        char utf8[4];
+        size_t n;
+        if (u < 0x80) {
+            utf8[0] = u;
+            n = 1;
+        } else if (u < 0x800) {
+            utf8[0] = 0xc0 | (u >> 6);
+            utf8[1] = 0x80 | (u & 0x3f);
+            n = 2;
+        } else if (u < 0x10000) {
+            utf8[0] = 0xe0 | (u >> 12);
+            utf8[1] = 0x80 | ((u >> 6) & 0x3f);
+            utf8[2] = 0x80 | (u & 0x3f);
+            n = 3;
+        } else {
+            utf8[0] = 0xf0 | (u >> 18);
+            utf8[1] = 0x80 | ((u >> 12) & 0x3f);
+            utf8[2] = 0x80 | ((u >> 6) & 0x3f);
+            utf8[3] = 0x80 | (u & 0x3f);
+            n = 4;
+        }
+        if (cb)
+            memcpy(out, utf8, n);
+        out += n;
+    }
+
+    *len = out - *str;
+    if (cb)
+        *out = 0; // where our closing quote (or some of what we unescaped) was
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "JSONWriter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A SAX style JSON parser, the reading half of JSONWriter: rather than building a tree of JSONValues, parse() calls back with
+ * each value as it comes to it.  Nothing is allocated, strings are unescaped in place in the document, so they (and their
+ * keys) stay valid for as long as the document does.
+ */
+class JSONReader
+{
+  public:
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_OBJECT, JSON_ARRAY };
+
+    /// A value we came to
+    struct Event {
+        uint8_t depth;   // 0 for the document itself, 1 for what it holds and so on
+        const char *key; // its name in the object holding it, NULL in an array or for the document
+        Type type;
+        const char *str; // JSON_STRING, unescaped and NUL terminated
+        size_t len;
+        double number; // JSON_NUMBER
+        bool boolean;  // JSON_BOOL
+    };
+
+    /// Called for each value, objects and arrays before whatever they hold.  Return false to stop parsing
+    typedef bool (*Callback)(const Event &e, void *context);
+
+    /// Parse the NUL terminated document in json, calling cb for each of its values.  @return false if it isn't valid JSON (or
+    /// cb stopped us), in which case cb may have been called for the values before the problem
+    static bool parse(char *json, Callback cb, void *context);
+
+    /// @return true if json (which we leave as it is) is a valid document
+    static bool isValid(const char *json);
+
+  private:
+    const char *p;
+    Callback cb;
+    void *context;
+
+    JSONReader(const char *json, Callback cb, void *context) : p(json), cb(cb), context(context) {}
+
+    void skipSpace();
+    bool parseValue(uint8_t depth, const char *key);
+    bool parseContainer(Event &e);
+    bool parseNumber(Event &e);
+
+    /// Parse the string starting at our opening quote, unescaping it in place if we have a callback
+    bool parseString(const char **str, size_t *len);
+
+    bool parseLiteral(const char *word);
+};
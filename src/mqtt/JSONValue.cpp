@@ -476,6 +476,34 @@ JSONValue::~JSONValue()
     }
 }
 
+/**
+ * Allocates a JSON Value object, counting it against HEAP_SITE_JSON
+ *
+ * @access public
+ */
+void *JSONValue::operator new(size_t bytes)
+{
+#if MEMGET_TRACE_NEW
+    HeapSiteScope scope(HEAP_SITE_JSON); // operator new counts it
+#else
+    memGet.noteAlloc(HEAP_SITE_JSON, bytes);
+#endif
+    return ::operator new(bytes);
+}
+
+/**
+ * Frees a JSON Value object
+ *
+ * @access public
+ */
+void JSONValue::operator delete(void *p, size_t bytes)
+{
+#if !MEMGET_TRACE_NEW
+    memGet.noteFree(HEAP_SITE_JSON, bytes);
+#endif
+    ::operator delete(p);
+}
+
 /**
  * Checks if the value is a NULL
  *
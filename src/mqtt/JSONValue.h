@@ -51,6 +51,10 @@ class JSONValue
     JSONValue(const JSONValue &m_source);
     ~JSONValue();
 
+    // Counted against HEAP_SITE_JSON, see memGet
+    static void *operator new(size_t bytes);
+    static void operator delete(void *p, size_t bytes);
+
     bool IsNull() const;
     bool IsString() const;
     bool IsBool() const;
@@ -0,0 +1,196 @@
+#include "JSONWriter.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+JSONWriter::JSONWriter(char *_buf, size_t _size, Print *_out) : buf(_buf), size(_size), out(_out)
+{
+    if (size)
+        buf[0] = 0;
+    else
+        overflow = true;
+}
+
+void JSONWriter::flush()
+{
+    if (out && len && !overflow) {
+        out->write((const uint8_t *)buf, len);
+        len = 0;
+        buf[0] = 0;
+    }
+}
+
+void JSONWriter::put(const char *s, size_t n)
+{
+    while (n && !overflow) {
+        size_t room = size - 1 - len; // keeping room for our NUL terminator
+        if (!room) {
+            if (!out || size < 2) {
+                overflow = true;
+                return;
+            }
+            flush();
+            continue;
+        }
+        size_t chunk = n < room ? n : room;
+        memcpy(buf + len, s, chunk);
+        len += chunk;
+        s += chunk;
+        n -= chunk;
+        buf[len] = 0;
+    }
+}
+
+void JSONWriter::put(char c)
+{
+    put(&c, 1);
+}
+
+void JSONWriter::separate()
+{
+    if (afterKey) {
+        afterKey = false; // an object's value, its key had the comma
+        return;
+    }
+    uint32_t bit = 1UL << depth;
+    if (hasItems & bit)
+        put(',');
+    hasItems |= bit;
+}
+
+void JSONWriter::open(char c)
+{
+    separate();
+    if (depth + 1 >= JSON_MAX_DEPTH) {
+        overflow = true; // nested deeper than we can keep track of
+        return;
+    }
+    put(c);
+    hasItems &= ~(1UL << ++depth);
+}
+
+void JSONWriter::close(char c)
+{
+    if (depth)
+        depth--;
+    put(c);
+}
+
+void JSONWriter::key(const char *name)
+{
+    separate();
+    put('"');
+    put(name, strlen(name));
+    put("\":", 2);
+    afterKey = true;
+}
+
+void JSONWriter::value(uint32_t v)
+{
+    char s[12];
+    separate();
+    put(s, snprintf(s, sizeof(s), "%lu", (unsigned long)v));
+}
+
+void JSONWriter::value(int32_t v)
+{
+    char s[12];
+    separate();
+    put(s, snprintf(s, sizeof(s), "%ld", (long)v));
+}
+
+void JSONWriter::value(float v)
+{
+    if (isnan(v) || isinf(v)) {
+        valueNull(); // JSON has no such numbers
+        return;
+    }
+    char s[20];
+    separate();
+    put(s, snprintf(s, sizeof(s), "%.7g", (double)v));
+}
+
+void JSONWriter::value(double v)
+{
+    if (isnan(v) || isinf(v)) {
+        valueNull();
+        return;
+    }
+    char s[28];
+    separate();
+    put(s, snprintf(s, sizeof(s), "%.15g", v));
+}
+
+void JSONWriter::value(bool v)
+{
+    separate();
+    if (v)
+        put("true", 4);
+    else
+        put("false", 5);
+}
+
+void JSONWriter::valueNull()
+{
+    separate();
+    put("null", 4);
+}
+
+void JSONWriter::value(const char *s)
+{
+    value(s, strlen(s));
+}
+
+void JSONWriter::value(const char *s, size_t n)
+{
+    separate();
+    putString(s, n);
+}
+
+void JSONWriter::raw(const char *json, size_t n)
+{
+    separate();
+    put(json, n);
+}
+
+void JSONWriter::putString(const char *s, size_t n)
+{
+    put('"');
+    const char *run = s; // characters we can copy as they are, UTF-8 included
+    for (const char *end = s + n; s < end; s++) {
+        unsigned char c = *s;
+        if (c >= ' ' && c != '"' && c != '\\')
+            continue;
+
+        put(run, s - run);
+        run = s + 1;
+        char esc[7];
+        switch (c) {
+        case '"':
+            put("\\\"", 2);
+            break;
+        case '\\':
+            put("\\\\", 2);
+            break;
+        case '\b':
+            put("\\b", 2);
+            break;
+        case '\f':
+            put("\\f", 2);
+            break;
+        case '\n':
+            put("\\n", 2);
+            break;
+        case '\r':
+            put("\\r", 2);
+            break;
+        case '\t':
+            put("\\t", 2);
+            break;
+        default:
+            put(esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+        }
+    }
+    put(run, s - run);
+    put('"');
+}
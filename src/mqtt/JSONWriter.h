@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Print.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// How deeply JSONWriter and JSONReader let objects and arrays nest
+#define JSON_MAX_DEPTH 16
+
+/**
+ * Writes JSON straight into a buffer as we go, rather than building a tree of JSONValues first.  Nothing is allocated:
+ * field names are string literals (written as they are, so they must not need escaping) and values go into the buffer
+ * as they are given.  With a Print to write to, a full buffer is flushed there, so the document can be any size.
+ * Otherwise, a document which doesn't fit leaves us overflowed() and the caller should throw it away.
+ *
+ *     JSONWriter w(buf, sizeof(buf));
+ *     w.beginObject();
+ *     w.field("id", p->id);
+ *     w.key("payload");
+ *     w.beginObject();
+ *     w.field("text", text);
+ *     w.endObject();
+ *     w.endObject();
+ */
+class JSONWriter
+{
+    char *buf;
+    size_t size, len = 0;
+    Print *out;
+    bool overflow = false;
+
+    /// Bit d is set once the container at depth d has something in it, so the next thing needs a comma first
+    uint32_t hasItems = 0;
+    uint8_t depth = 0;
+
+    /// The next value belongs to the key we just wrote
+    bool afterKey = false;
+
+    void put(char c);
+    void put(const char *s, size_t n);
+
+    /// Comma before the next key or array item, if it needs one
+    void separate();
+
+    void open(char c);
+    void close(char c);
+
+    void putString(const char *s, size_t n);
+
+  public:
+    /// Write into buf, flushing to out whenever it fills up (if we have one)
+    JSONWriter(char *buf, size_t size, Print *out = NULL);
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    /// Start an object field, its value comes next
+    void key(const char *name);
+
+    void value(uint32_t v);
+    void value(int32_t v);
+    void value(float v);
+    void value(double v);
+    void value(bool v);
+    void value(const char *s);
+    void value(const char *s, size_t n);
+    void valueNull();
+
+    /// An already encoded JSON value, copied as it is
+    void raw(const char *json, size_t n);
+
+    template <typename T> void field(const char *name, T v)
+    {
+        key(name);
+        value(v);
+    }
+
+    /// Write whatever is left in our buffer to our Print
+    void flush();
+
+    /// @return true if the document didn't fit our buffer (and we have no Print to flush it to)
+    bool overflowed() const { return overflow; }
+
+    /// @return the length of the document so far, which (unless we overflowed) is NUL terminated in our buffer
+    size_t length() const { return len; }
+};
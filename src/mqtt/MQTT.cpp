@@ -8,37 +8,53 @@
 #include "mesh/generated/meshtastic/mqtt.pb.h"
 #include "mesh/generated/meshtastic/telemetry.pb.h"
 #include "modules/RoutingModule.h"
+#include "mqtt/JSONWriter.h"
 #if defined(ARCH_ESP32)
 #include "../mesh/generated/meshtastic/paxcount.pb.h"
 #endif
 #include "mesh/generated/meshtastic/remote_hardware.pb.h"
 #include "sleep.h"
 #if HAS_WIFI
+#include "memGet.h"
 #include "mesh/wifi/WiFiAPClient.h"
 #include <WiFi.h>
 #endif
+#if HAS_ETHERNET
+#include "mesh/eth/ethClient.h"
+#endif
 #include <assert.h>
 
 const int reconnectMax = 5;
 
 MQTT *mqtt;
 
-static MemoryDynamic<meshtastic_ServiceEnvelope> staticMqttPool;
-
-Allocator<meshtastic_ServiceEnvelope> &mqttPool = staticMqttPool;
+/// Where we write the JSON version of the packets we uplink, we only ever do that from our own thread
+static char jsonBuffer[MQTT_JSON_BUFFER_SIZE];
 
 void MQTT::mqttCallback(char *topic, byte *payload, unsigned int length)
 {
     mqtt->onReceive(topic, payload, length);
 }
 
-void MQTT::onClientProxyReceive(meshtastic_MqttClientProxyMessage msg)
+void MQTT::onClientProxyReceive(meshtastic_MqttClientProxyMessage &msg)
 {
     onReceive(msg.topic, msg.payload_variant.data.bytes, msg.payload_variant.data.size);
 }
 
+void MQTT::onClientProxyTaken()
+{
+    if (!outbox.isEmpty())
+        wake();
+}
+
+bool MQTT::canPublishToProxy(bool withJson)
+{
+    return service.getMqttClientProxyWindowFree() >= (withJson ? 2 : 1);
+}
+
 void MQTT::onReceive(char *topic, byte *payload, size_t length)
 {
+    HeapSiteScope heapSite(HEAP_SITE_MQTT);
     meshtastic_ServiceEnvelope e = meshtastic_ServiceEnvelope_init_default;
 
     if (moduleConfig.mqtt.json_enabled && (strncmp(topic, jsonTopic.c_str(), jsonTopic.length()) == 0)) {
@@ -46,12 +62,8 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
         char payloadStr[length + 1];
         memcpy(payloadStr, payload, length);
         payloadStr[length] = 0; // null terminated string
-        JSONValue *json_value = JSON::Parse(payloadStr);
-        if (json_value != NULL) {
-            // check if it is a valid envelope
-            JSONObject json;
-            json = json_value->AsObject();
-
+        JSONDownlink json;
+        if (JSONReader::parse(payloadStr, &JSONDownlink::onValue, &json)) {
             // parse the channel name from the topic string by looking for "json/"
             const char *jsonSlash = "json/";
             char *ptr = strstr(topic, jsonSlash) + sizeof(jsonSlash) + 1; // set pointer to after "json/"
@@ -62,51 +74,37 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
                 sendChannel.settings.downlink_enabled) {
                 if (isValidJsonEnvelope(json)) {
                     // this is a valid envelope
-                    if (json["type"]->AsString().compare("sendtext") == 0 && json["payload"]->IsString()) {
-                        std::string jsonPayloadStr = json["payload"]->AsString();
-                        LOG_INFO("JSON payload %s, length %u\n", jsonPayloadStr.c_str(), jsonPayloadStr.length());
+                    if (strcmp(json.type, "sendtext") == 0 && json.payloadType == JSONReader::JSON_STRING) {
+                        LOG_INFO("JSON payload %s, length %u\n", json.payloadStr, json.payloadLen);
 
                         // construct protobuf data packet using TEXT_MESSAGE, send it to the mesh
                         meshtastic_MeshPacket *p = router->allocForSending();
                         p->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
-                        if (json.find("channel") != json.end() && json["channel"]->IsNumber() &&
-                            (json["channel"]->AsNumber() < channels.getNumChannels()))
-                            p->channel = json["channel"]->AsNumber();
-                        if (json.find("to") != json.end() && json["to"]->IsNumber())
-                            p->to = json["to"]->AsNumber();
-                        if (jsonPayloadStr.length() <= sizeof(p->decoded.payload.bytes)) {
-                            memcpy(p->decoded.payload.bytes, jsonPayloadStr.c_str(), jsonPayloadStr.length());
-                            p->decoded.payload.size = jsonPayloadStr.length();
-                            meshtastic_MeshPacket *packet = packetPool.allocCopy(*p);
-                            service.sendToMesh(packet, RX_SRC_LOCAL);
+                        if (json.hasChannel && json.channel < channels.getNumChannels())
+                            p->channel = json.channel;
+                        if (json.hasTo)
+                            p->to = json.to;
+                        if (json.payloadLen <= sizeof(p->decoded.payload.bytes)) {
+                            memcpy(p->decoded.payload.bytes, json.payloadStr, json.payloadLen);
+                            p->decoded.payload.size = json.payloadLen;
+                            service.sendToMesh(p, RX_SRC_LOCAL);
                         } else {
                             LOG_WARN("Received MQTT json payload too long, dropping\n");
+                            packetPool.release(p);
                         }
-                    } else if (json["type"]->AsString().compare("sendposition") == 0 && json["payload"]->IsObject()) {
-                        // invent the "sendposition" type for a valid envelope
-                        JSONObject posit;
-                        posit = json["payload"]->AsObject(); // get nested JSON Position
-                        meshtastic_Position pos = meshtastic_Position_init_default;
-                        if (posit.find("latitude_i") != posit.end() && posit["latitude_i"]->IsNumber())
-                            pos.latitude_i = posit["latitude_i"]->AsNumber();
-                        if (posit.find("longitude_i") != posit.end() && posit["longitude_i"]->IsNumber())
-                            pos.longitude_i = posit["longitude_i"]->AsNumber();
-                        if (posit.find("altitude") != posit.end() && posit["altitude"]->IsNumber())
-                            pos.altitude = posit["altitude"]->AsNumber();
-                        if (posit.find("time") != posit.end() && posit["time"]->IsNumber())
-                            pos.time = posit["time"]->AsNumber();
+                    } else if (strcmp(json.type, "sendposition") == 0 && json.payloadType == JSONReader::JSON_OBJECT) {
+                        // invent the "sendposition" type for a valid envelope, its payload is a nested JSON Position
 
                         // construct protobuf data packet using POSITION, send it to the mesh
                         meshtastic_MeshPacket *p = router->allocForSending();
                         p->decoded.portnum = meshtastic_PortNum_POSITION_APP;
-                        if (json.find("channel") != json.end() && json["channel"]->IsNumber() &&
-                            (json["channel"]->AsNumber() < channels.getNumChannels()))
-                            p->channel = json["channel"]->AsNumber();
-                        if (json.find("to") != json.end() && json["to"]->IsNumber())
-                            p->to = json["to"]->AsNumber();
+                        if (json.hasChannel && json.channel < channels.getNumChannels())
+                            p->channel = json.channel;
+                        if (json.hasTo)
+                            p->to = json.to;
                         p->decoded.payload.size =
                             pb_encode_to_bytes(p->decoded.payload.bytes, sizeof(p->decoded.payload.bytes),
-                                               &meshtastic_Position_msg, &pos); // make the Data protobuf from position
+                                               &meshtastic_Position_msg, &json.position); // make the Data protobuf from position
                         service.sendToMesh(p, RX_SRC_LOCAL);
                     } else {
                         LOG_DEBUG("JSON Ignoring downlink message with unsupported type.\n");
@@ -121,7 +119,6 @@ void MQTT::onReceive(char *topic, byte *payload, size_t length)
             // no json, this is an invalid payload
             LOG_ERROR("JSON Received payload on MQTT but not a valid JSON\n");
         }
-        delete json_value;
     } else {
         if (length == 0) {
             LOG_WARN("Empty MQTT payload received, topic %s!\n", topic);
@@ -171,9 +168,9 @@ void mqttInit()
 }
 
 #ifdef HAS_NETWORKING
-MQTT::MQTT() : concurrency::OSThread("mqtt"), pubSub(mqttClient), mqttQueue(MAX_MQTT_QUEUE)
+MQTT::MQTT() : concurrency::OSThread("mqtt"), pubSub(mqttClient)
 #else
-MQTT::MQTT() : concurrency::OSThread("mqtt"), mqttQueue(MAX_MQTT_QUEUE)
+MQTT::MQTT() : concurrency::OSThread("mqtt")
 #endif
 {
     if (moduleConfig.mqtt.enabled) {
@@ -181,6 +178,9 @@ MQTT::MQTT() : concurrency::OSThread("mqtt"), mqttQueue(MAX_MQTT_QUEUE)
 
         assert(!mqtt);
         mqtt = this;
+#if HAS_ETHERNET
+        ethWakeOnEvent(this, true); // what the server sends gets to us sooner than our next poll
+#endif
 
         if (*moduleConfig.mqtt.root) {
             statusTopic = moduleConfig.mqtt.root + statusTopic;
@@ -196,6 +196,7 @@ MQTT::MQTT() : concurrency::OSThread("mqtt"), mqttQueue(MAX_MQTT_QUEUE)
         if (!moduleConfig.mqtt.proxy_to_client_enabled)
             pubSub.setCallback(mqttCallback);
 #endif
+        outbox.init();
 
         if (moduleConfig.mqtt.proxy_to_client_enabled) {
             LOG_INFO("MQTT configured to use client proxy...\n");
@@ -213,7 +214,8 @@ MQTT::MQTT() : concurrency::OSThread("mqtt"), mqttQueue(MAX_MQTT_QUEUE)
 bool MQTT::isConnectedDirectly()
 {
 #ifdef HAS_NETWORKING
-    return pubSub.connected();
+    // Leave pubSub alone while our connect task has it
+    return connectState == CONNECT_CONNECTED && pubSub.connected();
 #else
     return false;
 #endif
@@ -271,6 +273,9 @@ void MQTT::reconnect()
             return; // Don't try to connect directly to the server
         }
 #ifdef HAS_NETWORKING
+        if (isConnecting() || connectState == CONNECT_SUBSCRIBE || isConnectedDirectly())
+            return; // already on our way
+
         // Defaults
         int serverPort = 1883;
         const char *serverAddr = default_mqtt_address;
@@ -282,25 +287,20 @@ void MQTT::reconnect()
             mqttUsername = moduleConfig.mqtt.username;
             mqttPassword = moduleConfig.mqtt.password;
         }
+        connectTLS = false;
+        connectClient = &mqttClient;
 #if HAS_WIFI && !defined(ARCH_PORTDUINO)
         if (moduleConfig.mqtt.tls_enabled) {
             // change default for encrypted to 8883
-            try {
-                serverPort = 8883;
-                wifiSecureClient.setInsecure();
-
-                pubSub.setClient(wifiSecureClient);
-                LOG_INFO("Using TLS-encrypted session\n");
-            } catch (const std::exception &e) {
-                LOG_ERROR("MQTT ERROR: %s\n", e.what());
-            }
+            serverPort = 8883;
+            connectTLS = true;
+            connectClient = &wifiSecureClient;
+            LOG_INFO("Using TLS-encrypted session\n");
         } else {
             LOG_INFO("Using non-TLS-encrypted session\n");
-            pubSub.setClient(mqttClient);
         }
-#elif HAS_NETWORKING
-        pubSub.setClient(mqttClient);
 #endif
+        pubSub.setClient(*connectClient);
 
         String server = String(serverAddr);
         int delimIndex = server.indexOf(':');
@@ -312,38 +312,124 @@ void MQTT::reconnect()
         }
         pubSub.setServer(serverAddr, serverPort);
         pubSub.setBufferSize(512);
+        pubSub.setSocketTimeout(MQTT_CONNACK_TIMEOUT_SECS);
 
         LOG_INFO("Attempting to connect directly to MQTT server %s, port: %d, username: %s, password: %s\n", serverAddr,
                  serverPort, mqttUsername, mqttPassword);
 
-        auto myStatus = (statusTopic + owner.id);
-        bool connected = pubSub.connect(owner.id, mqttUsername, mqttPassword, myStatus.c_str(), 1, true, "offline");
-        if (connected) {
-            LOG_INFO("MQTT connected\n");
-            enabled = true; // Start running background process again
-            runASAP = true;
-            reconnectCount = 0;
+        connectHost = serverAddr;
+        connectPort = serverPort;
+        connectUsername = mqttUsername;
+        connectPassword = mqttPassword;
+        connectClientId = owner.id;
+        connectWillTopic = statusTopic + owner.id;
+        connectState = CONNECT_RESOLVING;
+        lastConnectMsec = millis();
+        connectAttempted = true;
 
-            publishStatus();
-            sendSubscriptions();
-        } else {
-#if HAS_WIFI && !defined(ARCH_PORTDUINO)
-            reconnectCount++;
-            LOG_ERROR("Failed to contact MQTT server directly (%d/%d)...\n", reconnectCount, reconnectMax);
-            if (reconnectCount >= reconnectMax) {
-                needReconnect = true;
-                wifiReconnect->setIntervalFromNow(0);
-                reconnectCount = 0;
-            }
+#if MQTT_CONNECT_TASK
+        if (xTaskCreatePinnedToCore(connectTask, "mqttconnect", MQTT_CONNECT_TASK_STACK, this, 1, NULL, ARDUINO_RUNNING_CORE) ==
+            pdPASS) {
+            setIntervalFromNow(MQTT_CONNECT_POLL_MSEC); // to pick up where it leaves us
+            return;
+        }
+        LOG_WARN("Can't start the MQTT connect task, connecting from the main loop\n");
+#endif
+        connectSteps();
+        finishConnect();
 #endif
+    }
+}
+
+#if MQTT_CONNECT_TASK
+void MQTT::connectTask(void *mqtt)
+{
+    static_cast<MQTT *>(mqtt)->connectSteps();
+    vTaskDelete(NULL);
+}
+#endif
+
+void MQTT::connectSteps()
+{
+#ifdef HAS_NETWORKING
+    bool okay = true;
+#if HAS_WIFI
+    connectState = CONNECT_RESOLVING;
+    IPAddress ip;
+    if (!ip.fromString(connectHost.c_str()) && !WiFi.hostByName(connectHost.c_str(), ip)) {
+        LOG_ERROR("MQTT can't resolve %s\n", connectHost.c_str());
+        okay = false;
+    }
+#if !defined(ARCH_PORTDUINO)
+    if (okay && connectTLS) {
+        // By name again (which DNS has cached by now), so the server gets it for SNI
+        connectState = CONNECT_TLS;
+        wifiSecureClient.setInsecure();
+        wifiSecureClient.setHandshakeTimeout(MQTT_TLS_TIMEOUT_SECS);
+        okay = wifiSecureClient.connect(connectHost.c_str(), connectPort, MQTT_TCP_TIMEOUT_MSEC);
+    }
+#endif
+    if (okay && !connectTLS) {
+        connectState = CONNECT_TCP;
+#ifdef ARCH_ESP32
+        okay = mqttClient.connect(ip, connectPort, MQTT_TCP_TIMEOUT_MSEC);
+#else
+        okay = mqttClient.connect(ip, connectPort);
+#endif
+    }
+#else
+    // EthernetClient looks up the address itself
+    connectState = CONNECT_TCP;
+    okay = mqttClient.connect(connectHost.c_str(), connectPort);
+#endif
+    if (!okay)
+        LOG_ERROR("MQTT can't open a connection to %s:%u\n", connectHost.c_str(), connectPort);
+
+    // pubSub sees our client is connected already, so this is only CONNECT and waiting (at most its socket timeout) for CONNACK
+    if (okay) {
+        connectState = CONNECT_MQTT;
+        okay = pubSub.connect(connectClientId.c_str(), connectUsername.c_str(), connectPassword.c_str(),
+                              connectWillTopic.c_str(), 1, true, "offline");
+    }
+    if (!okay)
+        connectClient->stop();
+    connectState = okay ? CONNECT_SUBSCRIBE : CONNECT_FAILED;
+#endif
+}
+
+void MQTT::finishConnect()
+{
+#ifdef HAS_NETWORKING
+    if (connectState == CONNECT_SUBSCRIBE) {
+        LOG_INFO("MQTT connected\n");
+        connectState = CONNECT_CONNECTED;
+        enabled = true; // Start running background process again
+        runASAP = true;
+        reconnectCount = 0;
+
+        publishStatus();
+        sendSubscriptions();
+        LOG_INFO("MQTT outbox has %u messages (%u on flash), %u dropped so far\n", outbox.getNumMessages(),
+                 outbox.getNumOnFlash(), outbox.getNumDropped());
+    } else if (connectState == CONNECT_FAILED) {
+        connectState = CONNECT_IDLE;
+#if HAS_WIFI && !defined(ARCH_PORTDUINO)
+        reconnectCount++;
+        LOG_ERROR("Failed to contact MQTT server directly (%d/%d)...\n", reconnectCount, reconnectMax);
+        if (reconnectCount >= reconnectMax) {
+            needReconnect = true;
+            wifiReconnect->setIntervalFromNow(0);
+            reconnectCount = 0;
         }
 #endif
     }
+#endif
 }
 
 void MQTT::sendSubscriptions()
 {
 #ifdef HAS_NETWORKING
+    updateTopics(); // so we don't work them out on our first message
     size_t numChan = channels.getNumChannels();
     for (size_t i = 0; i < numChan; i++) {
         const auto &ch = channels.getByIndex(i);
@@ -390,6 +476,7 @@ bool MQTT::wantsLink() const
 
 int32_t MQTT::runOnce()
 {
+    HeapSiteScope heapSite(HEAP_SITE_MQTT);
     if (!moduleConfig.mqtt.enabled)
         return disable();
 
@@ -397,28 +484,47 @@ int32_t MQTT::runOnce()
 
     // If connected poll rapidly, otherwise only occasionally check for a wifi connection change and ability to contact server
     if (moduleConfig.mqtt.proxy_to_client_enabled) {
+        // Fill the client proxy's window, as it takes them onClientProxyTaken() wakes us for the next batch
         publishQueuedMessages();
-        return 200;
+        return outbox.isEmpty() || !canPublishToProxy(false) ? 200 : MQTT_OUTBOX_DRAIN_MSEC;
     }
 #ifdef HAS_NETWORKING
-    else if (!pubSub.loop()) {
+    finishConnect();
+    if (isConnecting())
+        return MQTT_CONNECT_POLL_MSEC; // keep away from pubSub until our connect task is done with it
+
+    if (connectState != CONNECT_CONNECTED || !pubSub.loop()) {
+        if (connectState == CONNECT_CONNECTED) {
+            LOG_WARN("MQTT connection lost\n");
+            connectState = CONNECT_IDLE;
+        }
+        outbox.flushIfStale();
         if (!wantConnection)
             return 5000; // If we don't want connection now, check again in 5 secs
-        else {
-            reconnect();
-            // If we succeeded, empty the queue one by one and start reading rapidly, else try again in 30 seconds (TCP
-            // connections are EXPENSIVE so try rarely)
-            if (isConnectedDirectly()) {
-                publishQueuedMessages();
-                return 200;
-            } else
-                return 30000;
-        }
+
+        // TCP connections are EXPENSIVE so try rarely
+        uint32_t sinceAttempt = millis() - lastConnectMsec;
+        if (connectAttempted && sinceAttempt < MQTT_RECONNECT_MSEC)
+            return MQTT_RECONNECT_MSEC - sinceAttempt;
+        reconnect();
+        if (isConnecting())
+            return MQTT_CONNECT_POLL_MSEC;
+        // Connected from the main loop: start emptying the queue and reading rapidly, else try again later
+        if (isConnectedDirectly()) {
+            publishQueuedMessages();
+            return 200;
+        } else
+            return MQTT_RECONNECT_MSEC;
     } else {
+        // drain what queued up while we were away, a batch at a time
+        if (!outbox.isEmpty() && millis() - lastDrainMsec >= MQTT_OUTBOX_DRAIN_MSEC)
+            publishQueuedMessages();
+
         // we are connected to server, check often for new requests on the TCP port
         if (!wantConnection) {
             LOG_INFO("MQTT link not needed, dropping\n");
             pubSub.disconnect();
+            connectState = CONNECT_IDLE;
         }
 
         powerFSM.trigger(EVENT_CONTACT_FROM_PHONE); // Suppress entering light sleep (because that would turn off bluetooth)
@@ -438,34 +544,73 @@ void MQTT::publishStatus()
 
 void MQTT::publishQueuedMessages()
 {
-    if (!mqttQueue.isEmpty()) {
+    lastDrainMsec = millis();
+    MQTTOutbox::Message m;
+    for (int i = 0; i < MQTT_OUTBOX_BATCH && millis() - lastDrainMsec < MQTT_OUTBOX_BATCH_MSEC; i++) {
+        if (!outbox.peek(m))
+            break;
+        // Through the client proxy, wait for the phone to take what we've handed it rather than push it out
+        if (moduleConfig.mqtt.proxy_to_client_enabled && !canPublishToProxy(m.json != NULL))
+            break;
         LOG_DEBUG("Publishing enqueued MQTT message\n");
-        // FIXME - this size calculation is super sloppy, but it will go away once we dynamically alloc meshpackets
-        meshtastic_ServiceEnvelope *env = mqttQueue.dequeuePtr(0);
-        static uint8_t bytes[meshtastic_MeshPacket_size + 64];
-        size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, env);
-
-        std::string topic = cryptTopic + env->channel_id + "/" + owner.id;
-        LOG_INFO("publish %s, %u bytes from queue\n", topic.c_str(), numBytes);
+        if (!publishEnvelope(m.channelId, m.envelope, m.envelopeLen, m.json, m.jsonLen))
+            break; // lost our connection, it stays queued
+        outbox.pop();
+    }
+}
 
-        publish(topic.c_str(), bytes, numBytes, false);
+bool MQTT::publishEnvelope(const char *channelId, const uint8_t *envelope, size_t envelopeLen, const char *json,
+                           size_t jsonLen)
+{
+    const ChannelTopics &topics = getTopics(channelId);
+    LOG_DEBUG("MQTT Publish %s, %u bytes\n", topics.crypt, envelopeLen);
+    if (!publish(topics.crypt, envelope, envelopeLen, false))
+        return false;
 
-        if (moduleConfig.mqtt.json_enabled) {
-            // handle json topic
-            auto jsonString = this->meshPacketToJson(env->packet);
-            if (jsonString.length() != 0) {
-                std::string topicJson = jsonTopic + env->channel_id + "/" + owner.id;
-                LOG_INFO("JSON publish message to %s, %u bytes: %s\n", topicJson.c_str(), jsonString.length(),
-                         jsonString.c_str());
-                publish(topicJson.c_str(), jsonString.c_str(), false);
-            }
-        }
-        mqttPool.release(env);
+    if (json) {
+        LOG_INFO("JSON publish message to %s, %u bytes: %s\n", topics.json, jsonLen, json);
+        publish(topics.json, json, false);
     }
+    return true;
+}
+
+void MQTT::makeTopics(ChannelTopics &t, const std::string &crypt, const std::string &json, const char *channelId)
+{
+    strncpy(t.channelId, channelId, sizeof(t.channelId) - 1);
+    t.channelId[sizeof(t.channelId) - 1] = 0;
+    if ((size_t)snprintf(t.crypt, sizeof(t.crypt), "%s%s/%s", crypt.c_str(), channelId, owner.id) >= sizeof(t.crypt) ||
+        (size_t)snprintf(t.json, sizeof(t.json), "%s%s/%s", json.c_str(), channelId, owner.id) >= sizeof(t.json))
+        LOG_WARN("MQTT topics for channel %s are longer than %u characters\n", channelId, MQTT_TOPIC_SIZE - 1);
+}
+
+void MQTT::updateTopics()
+{
+    if (topicsGeneration == channels.getGeneration() && numChannelTopics && strcmp(topicsOwner, owner.id) == 0)
+        return;
+
+    numChannelTopics = channels.getNumChannels();
+    for (uint8_t i = 0; i < numChannelTopics; i++)
+        makeTopics(channelTopics[i], cryptTopic, jsonTopic, channels.getGlobalId(i));
+    topicsGeneration = channels.getGeneration();
+    strncpy(topicsOwner, owner.id, sizeof(topicsOwner) - 1);
+    otherTopics.channelId[0] = 0;
+}
+
+const MQTT::ChannelTopics &MQTT::getTopics(const char *channelId)
+{
+    updateTopics();
+    for (uint8_t i = 0; i < numChannelTopics; i++)
+        if (strcmp(channelTopics[i].channelId, channelId) == 0)
+            return channelTopics[i];
+
+    if (strcmp(otherTopics.channelId, channelId) != 0)
+        makeTopics(otherTopics, cryptTopic, jsonTopic, channelId);
+    return otherTopics;
 }
 
 void MQTT::onSend(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex)
 {
+    HeapSiteScope heapSite(HEAP_SITE_MQTT);
     if (mp.via_mqtt)
         return; // Don't send messages that came from MQTT back into MQTT
 
@@ -479,67 +624,82 @@ void MQTT::onSend(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket &
     }
 
     if (ch.settings.uplink_enabled) {
+        // Decide before we encode anything, so what we drop costs us next to nothing
+        MQTTUplinkPolicy::Verdict verdict = uplinkPolicy.check(mp_decoded);
+        if (verdict != MQTTUplinkPolicy::UPLINK) {
+            LOG_DEBUG("MQTT onSend - Not uplinking packet 0x%x from 0x%x (%d)\n", mp_decoded.id, mp_decoded.from, verdict);
+            return;
+        }
+
+        // Positions go with less precision, especially to the public server
+        const meshtastic_MeshPacket *decoded = &mp_decoded;
+        uint8_t positionBits = MQTT_UPLINK_POSITION_BITS;
+        if ((!*moduleConfig.mqtt.address || strcmp(moduleConfig.mqtt.address, default_mqtt_address) == 0) &&
+            MQTT_UPLINK_PUBLIC_POSITION_BITS < positionBits)
+            positionBits = MQTT_UPLINK_PUBLIC_POSITION_BITS;
+        static meshtastic_MeshPacket reduced; // too big for our stack
+        if (positionBits < 32 && mp_decoded.which_payload_variant == meshtastic_MeshPacket_decoded_tag &&
+            mp_decoded.decoded.portnum == meshtastic_PortNum_POSITION_APP) {
+            reduced = mp_decoded;
+            if (uplinkPolicy.reducePosition(reduced, positionBits))
+                decoded = &reduced;
+        }
+
         const char *channelId = channels.getGlobalId(chIndex); // FIXME, for now we just use the human name for the channel
 
-        meshtastic_ServiceEnvelope *env = mqttPool.allocZeroed();
-        env->channel_id = (char *)channelId;
-        env->gateway_id = owner.id;
+        // Its fields are all pointers, so this is just a few words on our stack
+        meshtastic_ServiceEnvelope env = meshtastic_ServiceEnvelope_init_default;
+        env.channel_id = (char *)channelId;
+        env.gateway_id = owner.id;
 
         if (moduleConfig.mqtt.encryption_enabled) {
-            env->packet = (meshtastic_MeshPacket *)&mp;
+            env.packet = (meshtastic_MeshPacket *)&mp;
+            // Anyone can read a channel with a well known key, so the position in what we publish must be the reduced one:
+            // encrypt that instead.  (With a key of its own the server can't read it, so the packet goes as it is)
+            static meshtastic_MeshPacket reducedCipher;
+            if (decoded == &reduced && ch.settings.psk.size <= 1) {
+                reducedCipher = reduced;
+                reducedCipher.channel = chIndex;
+                if (perhapsEncode(&reducedCipher) == meshtastic_Routing_Error_NONE) {
+                    env.packet = &reducedCipher;
+                } else {
+                    LOG_WARN("MQTT onSend - Can't encrypt reduced position, not uplinking it\n");
+                    return;
+                }
+            }
         } else {
-            env->packet = (meshtastic_MeshPacket *)&mp_decoded;
+            env.packet = (meshtastic_MeshPacket *)decoded;
         }
 
-        LOG_DEBUG("MQTT onSend - Publishing portnum %i message\n", env->packet->decoded.portnum);
-
-        if (moduleConfig.mqtt.proxy_to_client_enabled || this->isConnectedDirectly()) {
-            // FIXME - this size calculation is super sloppy, but it will go away once we dynamically alloc meshpackets
-            static uint8_t bytes[meshtastic_MeshPacket_size + 64];
-            size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, env);
-
-            std::string topic = cryptTopic + channelId + "/" + owner.id;
-            LOG_DEBUG("MQTT Publish %s, %u bytes\n", topic.c_str(), numBytes);
+        LOG_DEBUG("MQTT onSend - Publishing portnum %i message\n", env.packet->decoded.portnum);
 
-            publish(topic.c_str(), bytes, numBytes, false);
+        // FIXME - this size calculation is super sloppy, but it will go away once we dynamically alloc meshpackets
+        static uint8_t bytes[meshtastic_MeshPacket_size + 64];
+        size_t numBytes = pb_encode_to_bytes(bytes, sizeof(bytes), &meshtastic_ServiceEnvelope_msg, &env);
 
-            if (moduleConfig.mqtt.json_enabled) {
-                // handle json topic
-                auto jsonString = this->meshPacketToJson((meshtastic_MeshPacket *)&mp_decoded);
-                if (jsonString.length() != 0) {
-                    std::string topicJson = jsonTopic + channelId + "/" + owner.id;
-                    LOG_INFO("JSON publish message to %s, %u bytes: %s\n", topicJson.c_str(), jsonString.length(),
-                             jsonString.c_str());
-                    publish(topicJson.c_str(), jsonString.c_str(), false);
-                }
-            }
+        size_t jsonLength = 0;
+        if (moduleConfig.mqtt.json_enabled)
+            jsonLength = this->meshPacketToJson((meshtastic_MeshPacket *)decoded, jsonBuffer, sizeof(jsonBuffer));
+        const char *json = jsonLength ? jsonBuffer : NULL;
 
-        } else {
+        // Anything already waiting goes first, so we keep them in order.  A client proxy's window full counts as not connected
+        bool connected =
+            moduleConfig.mqtt.proxy_to_client_enabled ? canPublishToProxy(json != NULL) : this->isConnectedDirectly();
+        if (!connected || !outbox.isEmpty() || !publishEnvelope(channelId, bytes, numBytes, json, jsonLength)) {
             LOG_INFO("MQTT not connected, queueing packet\n");
-            if (mqttQueue.numFree() == 0) {
-                LOG_WARN("NOTE: MQTT queue is full, discarding oldest\n");
-                meshtastic_ServiceEnvelope *d = mqttQueue.dequeuePtr(0);
-                if (d)
-                    mqttPool.release(d);
-            }
-            // make a copy of serviceEnvelope and queue it
-            meshtastic_ServiceEnvelope *copied = mqttPool.allocCopy(*env);
-            assert(mqttQueue.enqueue(copied, 0));
+            outbox.enqueue(channelId, bytes, numBytes, json, jsonLength);
         }
-        mqttPool.release(env);
     }
 }
 
 // converts a downstream packet into a json message
-std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
+size_t MQTT::meshPacketToJson(meshtastic_MeshPacket *mp, char *buf, size_t size)
 {
-    // the created jsonObj is immutable after creation, so
-    // we need to do the heavy lifting before assembling it.
-    std::string msgType;
-    JSONObject jsonObj;
+    JSONWriter w(buf, size);
+    const char *msgType = "";
+    w.beginObject();
 
     if (mp->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
-        JSONObject msgPayload;
         switch (mp->decoded.portnum) {
         case meshtastic_PortNum_TEXT_MESSAGE_APP: {
             msgType = "text";
@@ -549,17 +709,18 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memcpy(payloadStr, mp->decoded.payload.bytes, mp->decoded.payload.size);
             payloadStr[mp->decoded.payload.size] = 0; // null terminated string
             // check if this is a JSON payload
-            JSONValue *json_value = JSON::Parse(payloadStr);
-            if (json_value != NULL) {
+            w.key("payload");
+            if (JSONReader::isValid(payloadStr)) {
                 LOG_INFO("text message payload is of type json\n");
-                // if it is, then we can just use the json object
-                jsonObj["payload"] = json_value;
+                // if it is, then we can just use the json as it is
+                w.raw(payloadStr, strlen(payloadStr));
             } else {
                 // if it isn't, then we need to create a json object
                 // with the string as the value
                 LOG_INFO("text message payload is of type plaintext\n");
-                msgPayload["text"] = new JSONValue(payloadStr);
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.beginObject();
+                w.field("text", (const char *)payloadStr);
+                w.endObject();
             }
             break;
         }
@@ -570,27 +731,29 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memset(&scratch, 0, sizeof(scratch));
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_Telemetry_msg, &scratch)) {
                 decoded = &scratch;
+                w.key("payload");
+                w.beginObject();
                 if (decoded->which_variant == meshtastic_Telemetry_device_metrics_tag) {
-                    msgPayload["battery_level"] = new JSONValue((uint)decoded->variant.device_metrics.battery_level);
-                    msgPayload["voltage"] = new JSONValue(decoded->variant.device_metrics.voltage);
-                    msgPayload["channel_utilization"] = new JSONValue(decoded->variant.device_metrics.channel_utilization);
-                    msgPayload["air_util_tx"] = new JSONValue(decoded->variant.device_metrics.air_util_tx);
+                    w.field("battery_level", (uint32_t)decoded->variant.device_metrics.battery_level);
+                    w.field("voltage", decoded->variant.device_metrics.voltage);
+                    w.field("channel_utilization", decoded->variant.device_metrics.channel_utilization);
+                    w.field("air_util_tx", decoded->variant.device_metrics.air_util_tx);
                 } else if (decoded->which_variant == meshtastic_Telemetry_environment_metrics_tag) {
-                    msgPayload["temperature"] = new JSONValue(decoded->variant.environment_metrics.temperature);
-                    msgPayload["relative_humidity"] = new JSONValue(decoded->variant.environment_metrics.relative_humidity);
-                    msgPayload["barometric_pressure"] = new JSONValue(decoded->variant.environment_metrics.barometric_pressure);
-                    msgPayload["gas_resistance"] = new JSONValue(decoded->variant.environment_metrics.gas_resistance);
-                    msgPayload["voltage"] = new JSONValue(decoded->variant.environment_metrics.voltage);
-                    msgPayload["current"] = new JSONValue(decoded->variant.environment_metrics.current);
+                    w.field("temperature", decoded->variant.environment_metrics.temperature);
+                    w.field("relative_humidity", decoded->variant.environment_metrics.relative_humidity);
+                    w.field("barometric_pressure", decoded->variant.environment_metrics.barometric_pressure);
+                    w.field("gas_resistance", decoded->variant.environment_metrics.gas_resistance);
+                    w.field("voltage", decoded->variant.environment_metrics.voltage);
+                    w.field("current", decoded->variant.environment_metrics.current);
                 } else if (decoded->which_variant == meshtastic_Telemetry_power_metrics_tag) {
-                    msgPayload["voltage_ch1"] = new JSONValue(decoded->variant.power_metrics.ch1_voltage);
-                    msgPayload["current_ch1"] = new JSONValue(decoded->variant.power_metrics.ch1_current);
-                    msgPayload["voltage_ch2"] = new JSONValue(decoded->variant.power_metrics.ch2_voltage);
-                    msgPayload["current_ch2"] = new JSONValue(decoded->variant.power_metrics.ch2_current);
-                    msgPayload["voltage_ch3"] = new JSONValue(decoded->variant.power_metrics.ch3_voltage);
-                    msgPayload["current_ch3"] = new JSONValue(decoded->variant.power_metrics.ch3_current);
+                    w.field("voltage_ch1", decoded->variant.power_metrics.ch1_voltage);
+                    w.field("current_ch1", decoded->variant.power_metrics.ch1_current);
+                    w.field("voltage_ch2", decoded->variant.power_metrics.ch2_voltage);
+                    w.field("current_ch2", decoded->variant.power_metrics.ch2_current);
+                    w.field("voltage_ch3", decoded->variant.power_metrics.ch3_voltage);
+                    w.field("current_ch3", decoded->variant.power_metrics.ch3_current);
                 }
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for telemetry message!\n");
             }
@@ -603,11 +766,13 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memset(&scratch, 0, sizeof(scratch));
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_User_msg, &scratch)) {
                 decoded = &scratch;
-                msgPayload["id"] = new JSONValue(decoded->id);
-                msgPayload["longname"] = new JSONValue(decoded->long_name);
-                msgPayload["shortname"] = new JSONValue(decoded->short_name);
-                msgPayload["hardware"] = new JSONValue(decoded->hw_model);
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.key("payload");
+                w.beginObject();
+                w.field("id", (const char *)decoded->id);
+                w.field("longname", (const char *)decoded->long_name);
+                w.field("shortname", (const char *)decoded->short_name);
+                w.field("hardware", (uint32_t)decoded->hw_model);
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for nodeinfo message!\n");
             }
@@ -620,36 +785,38 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memset(&scratch, 0, sizeof(scratch));
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_Position_msg, &scratch)) {
                 decoded = &scratch;
+                w.key("payload");
+                w.beginObject();
                 if ((int)decoded->time) {
-                    msgPayload["time"] = new JSONValue((uint)decoded->time);
+                    w.field("time", (uint32_t)decoded->time);
                 }
                 if ((int)decoded->timestamp) {
-                    msgPayload["timestamp"] = new JSONValue((uint)decoded->timestamp);
+                    w.field("timestamp", (uint32_t)decoded->timestamp);
                 }
-                msgPayload["latitude_i"] = new JSONValue((int)decoded->latitude_i);
-                msgPayload["longitude_i"] = new JSONValue((int)decoded->longitude_i);
+                w.field("latitude_i", (int32_t)decoded->latitude_i);
+                w.field("longitude_i", (int32_t)decoded->longitude_i);
                 if ((int)decoded->altitude) {
-                    msgPayload["altitude"] = new JSONValue((int)decoded->altitude);
+                    w.field("altitude", (int32_t)decoded->altitude);
                 }
                 if ((int)decoded->ground_speed) {
-                    msgPayload["ground_speed"] = new JSONValue((uint)decoded->ground_speed);
+                    w.field("ground_speed", (uint32_t)decoded->ground_speed);
                 }
                 if (int(decoded->ground_track)) {
-                    msgPayload["ground_track"] = new JSONValue((uint)decoded->ground_track);
+                    w.field("ground_track", (uint32_t)decoded->ground_track);
                 }
                 if (int(decoded->sats_in_view)) {
-                    msgPayload["sats_in_view"] = new JSONValue((uint)decoded->sats_in_view);
+                    w.field("sats_in_view", (uint32_t)decoded->sats_in_view);
                 }
                 if ((int)decoded->PDOP) {
-                    msgPayload["PDOP"] = new JSONValue((int)decoded->PDOP);
+                    w.field("PDOP", (int32_t)decoded->PDOP);
                 }
                 if ((int)decoded->HDOP) {
-                    msgPayload["HDOP"] = new JSONValue((int)decoded->HDOP);
+                    w.field("HDOP", (int32_t)decoded->HDOP);
                 }
                 if ((int)decoded->VDOP) {
-                    msgPayload["VDOP"] = new JSONValue((int)decoded->VDOP);
+                    w.field("VDOP", (int32_t)decoded->VDOP);
                 }
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for position message!\n");
             }
@@ -662,14 +829,16 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memset(&scratch, 0, sizeof(scratch));
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_Waypoint_msg, &scratch)) {
                 decoded = &scratch;
-                msgPayload["id"] = new JSONValue((uint)decoded->id);
-                msgPayload["name"] = new JSONValue(decoded->name);
-                msgPayload["description"] = new JSONValue(decoded->description);
-                msgPayload["expire"] = new JSONValue((uint)decoded->expire);
-                msgPayload["locked_to"] = new JSONValue((uint)decoded->locked_to);
-                msgPayload["latitude_i"] = new JSONValue((int)decoded->latitude_i);
-                msgPayload["longitude_i"] = new JSONValue((int)decoded->longitude_i);
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.key("payload");
+                w.beginObject();
+                w.field("id", (uint32_t)decoded->id);
+                w.field("name", (const char *)decoded->name);
+                w.field("description", (const char *)decoded->description);
+                w.field("expire", (uint32_t)decoded->expire);
+                w.field("locked_to", (uint32_t)decoded->locked_to);
+                w.field("latitude_i", (int32_t)decoded->latitude_i);
+                w.field("longitude_i", (int32_t)decoded->longitude_i);
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for position message!\n");
             }
@@ -683,19 +852,22 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_NeighborInfo_msg,
                                      &scratch)) {
                 decoded = &scratch;
-                msgPayload["node_id"] = new JSONValue((uint)decoded->node_id);
-                msgPayload["node_broadcast_interval_secs"] = new JSONValue((uint)decoded->node_broadcast_interval_secs);
-                msgPayload["last_sent_by_id"] = new JSONValue((uint)decoded->last_sent_by_id);
-                msgPayload["neighbors_count"] = new JSONValue(decoded->neighbors_count);
-                JSONArray neighbors;
+                w.key("payload");
+                w.beginObject();
+                w.field("node_id", (uint32_t)decoded->node_id);
+                w.field("node_broadcast_interval_secs", (uint32_t)decoded->node_broadcast_interval_secs);
+                w.field("last_sent_by_id", (uint32_t)decoded->last_sent_by_id);
+                w.field("neighbors_count", (uint32_t)decoded->neighbors_count);
+                w.key("neighbors");
+                w.beginArray();
                 for (uint8_t i = 0; i < decoded->neighbors_count; i++) {
-                    JSONObject neighborObj;
-                    neighborObj["node_id"] = new JSONValue((uint)decoded->neighbors[i].node_id);
-                    neighborObj["snr"] = new JSONValue((int)decoded->neighbors[i].snr);
-                    neighbors.push_back(new JSONValue(neighborObj));
+                    w.beginObject();
+                    w.field("node_id", (uint32_t)decoded->neighbors[i].node_id);
+                    w.field("snr", (int32_t)decoded->neighbors[i].snr);
+                    w.endObject();
                 }
-                msgPayload["neighbors"] = new JSONValue(neighbors);
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.endArray();
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for neighborinfo message!\n");
             }
@@ -710,24 +882,25 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
                 if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_RouteDiscovery_msg,
                                          &scratch)) {
                     decoded = &scratch;
-                    JSONArray route; // Route this message took
                     // Lambda function for adding a long name to the route
-                    auto addToRoute = [](JSONArray *route, NodeNum num) {
-                        char long_name[40] = "Unknown";
+                    auto addToRoute = [](JSONWriter &w, NodeNum num) {
                         meshtastic_NodeInfoLite *node = nodeDB.getMeshNode(num);
-                        bool name_known = node ? node->has_user : false;
-                        if (name_known)
-                            memcpy(long_name, node->user.long_name, sizeof(long_name));
-                        route->push_back(new JSONValue(long_name));
+                        if (node && node->has_user)
+                            w.value(node->user.long_name, strnlen(node->user.long_name, sizeof(node->user.long_name)));
+                        else
+                            w.value("Unknown");
                     };
-                    addToRoute(&route, mp->to); // Started at the original transmitter (destination of response)
+                    w.key("payload");
+                    w.beginObject();
+                    w.key("route"); // Route this message took
+                    w.beginArray();
+                    addToRoute(w, mp->to); // Started at the original transmitter (destination of response)
                     for (uint8_t i = 0; i < decoded->route_count; i++) {
-                        addToRoute(&route, decoded->route[i]);
+                        addToRoute(w, decoded->route[i]);
                     }
-                    addToRoute(&route, mp->from); // Ended at the original destination (source of response)
-
-                    msgPayload["route"] = new JSONValue(route);
-                    jsonObj["payload"] = new JSONValue(msgPayload);
+                    addToRoute(w, mp->from); // Ended at the original destination (source of response)
+                    w.endArray();
+                    w.endObject();
                 } else {
                     LOG_ERROR("Error decoding protobuf for traceroute message!\n");
                 }
@@ -736,11 +909,12 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
         }
         case meshtastic_PortNum_DETECTION_SENSOR_APP: {
             msgType = "detection";
-            char payloadStr[(mp->decoded.payload.size) + 1];
-            memcpy(payloadStr, mp->decoded.payload.bytes, mp->decoded.payload.size);
-            payloadStr[mp->decoded.payload.size] = 0; // null terminated string
-            msgPayload["text"] = new JSONValue(payloadStr);
-            jsonObj["payload"] = new JSONValue(msgPayload);
+            w.key("payload");
+            w.beginObject();
+            w.key("text");
+            const char *text = (const char *)mp->decoded.payload.bytes;
+            w.value(text, strnlen(text, mp->decoded.payload.size));
+            w.endObject();
             break;
         }
 #ifdef ARCH_ESP32
@@ -751,10 +925,12 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
             memset(&scratch, 0, sizeof(scratch));
             if (pb_decode_from_bytes(mp->decoded.payload.bytes, mp->decoded.payload.size, &meshtastic_Paxcount_msg, &scratch)) {
                 decoded = &scratch;
-                msgPayload["wifi_count"] = new JSONValue((uint)decoded->wifi);
-                msgPayload["ble_count"] = new JSONValue((uint)decoded->ble);
-                msgPayload["uptime"] = new JSONValue((uint)decoded->uptime);
-                jsonObj["payload"] = new JSONValue(msgPayload);
+                w.key("payload");
+                w.beginObject();
+                w.field("wifi_count", (uint32_t)decoded->wifi);
+                w.field("ble_count", (uint32_t)decoded->ble);
+                w.field("uptime", (uint32_t)decoded->uptime);
+                w.endObject();
             } else {
                 LOG_ERROR("Error decoding protobuf for Paxcount message!\n");
             }
@@ -770,13 +946,17 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
                 decoded = &scratch;
                 if (decoded->type == meshtastic_HardwareMessage_Type_GPIOS_CHANGED) {
                     msgType = "gpios_changed";
-                    msgPayload["gpio_value"] = new JSONValue((uint)decoded->gpio_value);
-                    jsonObj["payload"] = new JSONValue(msgPayload);
+                    w.key("payload");
+                    w.beginObject();
+                    w.field("gpio_value", (uint32_t)decoded->gpio_value);
+                    w.endObject();
                 } else if (decoded->type == meshtastic_HardwareMessage_Type_READ_GPIOS_REPLY) {
                     msgType = "gpios_read_reply";
-                    msgPayload["gpio_value"] = new JSONValue((uint)decoded->gpio_value);
-                    msgPayload["gpio_mask"] = new JSONValue((uint)decoded->gpio_mask);
-                    jsonObj["payload"] = new JSONValue(msgPayload);
+                    w.key("payload");
+                    w.beginObject();
+                    w.field("gpio_value", (uint32_t)decoded->gpio_value);
+                    w.field("gpio_mask", (uint32_t)decoded->gpio_mask);
+                    w.endObject();
                 }
             } else {
                 LOG_ERROR("Error decoding protobuf for RemoteHardware message!\n");
@@ -791,34 +971,76 @@ std::string MQTT::meshPacketToJson(meshtastic_MeshPacket *mp)
         LOG_WARN("Couldn't convert encrypted payload of MeshPacket to JSON\n");
     }
 
-    jsonObj["id"] = new JSONValue((uint)mp->id);
-    jsonObj["timestamp"] = new JSONValue((uint)mp->rx_time);
-    jsonObj["to"] = new JSONValue((uint)mp->to);
-    jsonObj["from"] = new JSONValue((uint)mp->from);
-    jsonObj["channel"] = new JSONValue((uint)mp->channel);
-    jsonObj["type"] = new JSONValue(msgType.c_str());
-    jsonObj["sender"] = new JSONValue(owner.id);
+    w.field("id", (uint32_t)mp->id);
+    w.field("timestamp", (uint32_t)mp->rx_time);
+    w.field("to", (uint32_t)mp->to);
+    w.field("from", (uint32_t)mp->from);
+    w.field("channel", (uint32_t)mp->channel);
+    w.field("type", msgType);
+    w.field("sender", (const char *)owner.id);
     if (mp->rx_rssi != 0)
-        jsonObj["rssi"] = new JSONValue((int)mp->rx_rssi);
+        w.field("rssi", (int32_t)mp->rx_rssi);
     if (mp->rx_snr != 0)
-        jsonObj["snr"] = new JSONValue((float)mp->rx_snr);
+        w.field("snr", (float)mp->rx_snr);
+    w.endObject();
 
-    // serialize and write it to the stream
-    JSONValue *value = new JSONValue(jsonObj);
-    std::string jsonStr = value->Stringify();
+    if (w.overflowed()) {
+        LOG_ERROR("JSON message doesn't fit our %u byte buffer\n", size);
+        return 0;
+    }
+
+    LOG_INFO("serialized json message: %s\n", buf);
+    return w.length();
+}
 
-    LOG_INFO("serialized json message: %s\n", jsonStr.c_str());
+bool JSONDownlink::onValue(const JSONReader::Event &e, void *context)
+{
+    JSONDownlink &json = *static_cast<JSONDownlink *>(context);
+    if (e.depth == 0)
+        return e.type == JSONReader::JSON_OBJECT; // the envelope
 
-    delete value;
-    return jsonStr;
+    if (e.depth == 1) {
+        json.inPayload = false;
+        bool isNumber = e.type == JSONReader::JSON_NUMBER, isString = e.type == JSONReader::JSON_STRING;
+        if (!strcmp(e.key, "sender")) {
+            json.sender = isString ? e.str : "";
+        } else if (!strcmp(e.key, "from")) {
+            json.hasFrom = isNumber;
+            json.from = e.number;
+        } else if (!strcmp(e.key, "type")) {
+            json.type = isString ? e.str : NULL;
+        } else if (!strcmp(e.key, "channel")) {
+            json.hasChannel = isNumber;
+            json.channel = e.number;
+        } else if (!strcmp(e.key, "to")) {
+            json.hasTo = isNumber;
+            json.to = e.number;
+        } else if (!strcmp(e.key, "payload")) {
+            json.hasPayload = true;
+            json.payloadType = e.type;
+            json.payloadStr = e.str;
+            json.payloadLen = e.len;
+            json.position = meshtastic_Position_init_default;
+            json.inPayload = e.type == JSONReader::JSON_OBJECT;
+        }
+    } else if (e.depth == 2 && json.inPayload && e.type == JSONReader::JSON_NUMBER) {
+        if (!strcmp(e.key, "latitude_i"))
+            json.position.latitude_i = e.number;
+        else if (!strcmp(e.key, "longitude_i"))
+            json.position.longitude_i = e.number;
+        else if (!strcmp(e.key, "altitude"))
+            json.position.altitude = e.number;
+        else if (!strcmp(e.key, "time"))
+            json.position.time = e.number;
+    }
+    return true;
 }
 
-bool MQTT::isValidJsonEnvelope(JSONObject &json)
+bool MQTT::isValidJsonEnvelope(const JSONDownlink &json)
 {
     // if "sender" is provided, avoid processing packets we uplinked
-    return (json.find("sender") != json.end() ? (json["sender"]->AsString().compare(owner.id) != 0) : true) &&
-           (json.find("from") != json.end()) && json["from"]->IsNumber() &&
-           (json["from"]->AsNumber() == nodeDB.getNodeNum()) &&             // only accept message if the "from" is us
-           (json.find("type") != json.end()) && json["type"]->IsString() && // should specify a type
-           (json.find("payload") != json.end());                            // should have a payload
+    return (json.sender ? (strcmp(json.sender, owner.id) != 0) : true) &&
+           json.hasFrom && (json.from == nodeDB.getNodeNum()) && // only accept message if the "from" is us
+           json.type &&                                          // should specify a type
+           json.hasPayload;                                      // should have a payload
 }
\ No newline at end of file
@@ -5,7 +5,9 @@
 #include "concurrency/OSThread.h"
 #include "mesh/Channels.h"
 #include "mesh/generated/meshtastic/mqtt.pb.h"
-#include "mqtt/JSON.h"
+#include "mqtt/JSONReader.h"
+#include "mqtt/MQTTOutbox.h"
+#include "mqtt/MQTTUplinkPolicy.h"
 #if HAS_WIFI
 #include <WiFiClient.h>
 #define HAS_NETWORKING 1
@@ -22,7 +24,84 @@
 #include <PubSubClient.h>
 #endif
 
-#define MAX_MQTT_QUEUE 16
+/// At most how many messages waiting in our outbox we publish at a time, and how long we give that
+#ifndef MQTT_OUTBOX_BATCH
+#define MQTT_OUTBOX_BATCH 8
+#endif
+#ifndef MQTT_OUTBOX_BATCH_MSEC
+#define MQTT_OUTBOX_BATCH_MSEC 10
+#endif
+
+/// How long we leave the rest of the loop to run between batches, so a big backlog doesn't starve it
+#ifndef MQTT_OUTBOX_DRAIN_MSEC
+#define MQTT_OUTBOX_DRAIN_MSEC 100
+#endif
+
+/// Longest topic we publish to: our root, "/2/json/", a channel's global id and our node id.  The client proxy takes at most 60
+#ifndef MQTT_TOPIC_SIZE
+#define MQTT_TOPIC_SIZE 60
+#endif
+
+/// Connect to the server on a task of our own, so the main loop (and the mesh) keeps running while we wait for it
+#ifndef MQTT_CONNECT_TASK
+#if defined(ARCH_ESP32) && HAS_WIFI
+#define MQTT_CONNECT_TASK 1
+#else
+#define MQTT_CONNECT_TASK 0
+#endif
+#endif
+
+/// The TLS handshake runs on the connect task, so it needs plenty of stack
+#ifndef MQTT_CONNECT_TASK_STACK
+#define MQTT_CONNECT_TASK_STACK 8192
+#endif
+
+/// How long each step of connecting may take: the TCP connection, the TLS handshake and waiting for the server's CONNACK.
+/// (The ESP32's DNS lookups give up by themselves after a few seconds)
+#ifndef MQTT_TCP_TIMEOUT_MSEC
+#define MQTT_TCP_TIMEOUT_MSEC 5000
+#endif
+#ifndef MQTT_TLS_TIMEOUT_SECS
+#define MQTT_TLS_TIMEOUT_SECS 10
+#endif
+#ifndef MQTT_CONNACK_TIMEOUT_SECS
+#define MQTT_CONNACK_TIMEOUT_SECS 5
+#endif
+
+/// How long we wait after a failed attempt before trying to connect to the server again
+#ifndef MQTT_RECONNECT_MSEC
+#define MQTT_RECONNECT_MSEC 30000
+#endif
+
+/// How often the main loop looks whether the connect task is done
+#ifndef MQTT_CONNECT_POLL_MSEC
+#define MQTT_CONNECT_POLL_MSEC 100
+#endif
+
+/// The longest JSON message we uplink, longer ones (text messages full of characters which need escaping) are dropped
+#ifndef MQTT_JSON_BUFFER_SIZE
+#define MQTT_JSON_BUFFER_SIZE 1024
+#endif
+
+/// What we take from a JSON (downlink) envelope as JSONReader parses it, all the strings point into the message
+struct JSONDownlink {
+    const char *sender = NULL; // "" if it isn't a string
+    const char *type = NULL;
+    bool hasFrom = false, hasChannel = false, hasTo = false;
+    double from = 0, channel = 0, to = 0;
+
+    bool hasPayload = false;
+    JSONReader::Type payloadType = JSONReader::JSON_NULL;
+    const char *payloadStr = NULL; // for a string payload
+    size_t payloadLen = 0;
+    meshtastic_Position position = meshtastic_Position_init_default; // from an object payload
+
+    /// We are in a payload object, so the fields we come to are our position's
+    bool inPayload = false;
+
+    /// A JSONReader::Callback, context is the JSONDownlink
+    static bool onValue(const JSONReader::Event &e, void *context);
+};
 
 /**
  * Our wrapper/singleton for sending/receiving MQTT "udp" packets.  This object isolates the MQTT protocol implementation from
@@ -58,7 +137,8 @@ class MQTT : private concurrency::OSThread
      */
     void onSend(const meshtastic_MeshPacket &mp, const meshtastic_MeshPacket &mp_decoded, ChannelIndex chIndex);
 
-    /** Attempt to connect to server if necessary
+    /** Attempt to connect to server if necessary.  With MQTT_CONNECT_TASK this only starts connecting, we are
+     * isConnectedDirectly() once our connect task is done
      */
     void reconnect();
 
@@ -68,10 +148,54 @@ class MQTT : private concurrency::OSThread
 
     bool publish(const char *topic, const uint8_t *payload, size_t length, const bool retained);
 
-    void onClientProxyReceive(meshtastic_MqttClientProxyMessage msg);
+    /// A publish the client proxy got from the server, msg is the ToRadio's scratch copy which we may write to
+    void onClientProxyReceive(meshtastic_MqttClientProxyMessage &msg);
+
+    /// The client proxy took one of our messages, so we can hand it the next.  Safe to call from any task
+    void onClientProxyTaken();
+
+    /// The messages waiting for us to be connected, for their counters
+    const MQTTOutbox &getOutbox() const { return outbox; }
+
+    /// What decides which packets we uplink, for its counters
+    const MQTTUplinkPolicy &getUplinkPolicy() const { return uplinkPolicy; }
+
+    /// Where we are in connecting directly to the server
+    enum ConnectState {
+        CONNECT_IDLE,      // not connected, nor trying to be
+        CONNECT_RESOLVING, // looking up the server's address
+        CONNECT_TCP,
+        CONNECT_TLS,       // the TCP connection and TLS handshake, WiFiClientSecure does them together
+        CONNECT_MQTT,      // sent CONNECT, waiting for the server's CONNACK
+        CONNECT_SUBSCRIBE, // connected, the main loop still has to subscribe
+        CONNECT_FAILED,    // the main loop still has to count the failure
+        CONNECT_CONNECTED,
+    };
+
+    ConnectState getConnectState() const { return connectState; }
 
   protected:
-    PointerQueue<meshtastic_ServiceEnvelope> mqttQueue;
+    MQTTOutbox outbox;
+    MQTTUplinkPolicy uplinkPolicy;
+
+    /// Only our connect task moves us between CONNECT_RESOLVING and CONNECT_SUBSCRIBE (or CONNECT_FAILED), and while it
+    /// does, it is the only one to touch pubSub and our clients
+    volatile ConnectState connectState = CONNECT_IDLE;
+
+    /// When we last started connecting
+    uint32_t lastConnectMsec = 0;
+    bool connectAttempted = false;
+
+#ifdef HAS_NETWORKING
+    /// What the connect steps need, copied by reconnect() so they never look at our config
+    Client *connectClient = NULL;
+    std::string connectHost, connectUsername, connectPassword, connectClientId, connectWillTopic;
+    uint16_t connectPort = 0;
+    bool connectTLS = false;
+#endif
+
+    /// When we last published a batch from our outbox
+    uint32_t lastDrainMsec = 0;
 
     int reconnectCount = 0;
 
@@ -81,6 +205,30 @@ class MQTT : private concurrency::OSThread
     std::string statusTopic = "/2/stat/";
     std::string cryptTopic = "/2/c/";   // msh/2/c/CHANNELID/NODEID
     std::string jsonTopic = "/2/json/"; // msh/2/json/CHANNELID/NODEID
+
+    /// The topics we publish a channel's messages to, worked out once rather than for every message
+    struct ChannelTopics {
+        char channelId[sizeof(meshtastic_ChannelSettings::name) + 8]; // its global id
+        char crypt[MQTT_TOPIC_SIZE];
+        char json[MQTT_TOPIC_SIZE];
+    };
+    ChannelTopics channelTopics[MAX_NUM_CHANNELS];
+    uint8_t numChannelTopics = 0;
+
+    /// What channelTopics were worked out from, they are worked out again when our channels or owner change
+    uint32_t topicsGeneration = 0;
+    char topicsOwner[sizeof(meshtastic_User::id)] = "";
+
+    /// For a channel we no longer have, a message which waited in our outbox while it was renamed
+    ChannelTopics otherTopics = {};
+
+    static void makeTopics(ChannelTopics &t, const std::string &crypt, const std::string &json, const char *channelId);
+
+    /// Work out channelTopics again if we need to
+    void updateTopics();
+
+    /// @return the topics for a channel, by its global id
+    const ChannelTopics &getTopics(const char *channelId);
     /** return true if we have a channel that wants uplink/downlink
      */
     bool wantsLink() const;
@@ -92,17 +240,38 @@ class MQTT : private concurrency::OSThread
     /// Callback for direct mqtt subscription messages
     static void mqttCallback(char *topic, byte *payload, unsigned int length);
 
+    /// @return true if the client proxy's window has room for a message, and its JSON version if we have one
+    bool canPublishToProxy(bool withJson);
+
     /// Called when a new publish arrives from the MQTT server
     void onReceive(char *topic, byte *payload, size_t length);
 
-    /// Called when a new publish arrives from the MQTT server
-    std::string meshPacketToJson(meshtastic_MeshPacket *mp);
+    /// @return true while our connect steps are running
+    bool isConnecting() const { return connectState >= CONNECT_RESOLVING && connectState <= CONNECT_MQTT; }
+
+    /// Connect to the server: DNS, TCP, TLS then MQTT's CONNECT, each bounded in time.  Runs on our connect task if we have one
+    void connectSteps();
+
+#if MQTT_CONNECT_TASK
+    static void connectTask(void *mqtt);
+#endif
+
+    /// Back on the main loop once the connect steps are done: subscribe, or count the failure
+    void finishConnect();
+
+    /// Write the JSON version of a packet we uplink into buf, @return its length or 0 if it doesn't fit
+    size_t meshPacketToJson(meshtastic_MeshPacket *mp, char *buf, size_t size);
 
     void publishStatus();
+
+    /// Publish a batch of the messages waiting in our outbox
     void publishQueuedMessages();
 
+    /// Publish an encoded ServiceEnvelope, and its JSON version if we have one.  @return false if we couldn't publish it
+    bool publishEnvelope(const char *channelId, const uint8_t *envelope, size_t envelopeLen, const char *json, size_t jsonLen);
+
     // returns true if this is a valid JSON envelope which we accept on downlink
-    bool isValidJsonEnvelope(JSONObject &json);
+    bool isValidJsonEnvelope(const JSONDownlink &json);
 
     /// Return 0 if sleep is okay, veto sleep if we are connected to pubsub server
     // int preflightSleepCb(void *unused = NULL) { return pubSub.connected() ? 1 : 0; }
@@ -0,0 +1,388 @@
+#include "MQTTOutbox.h"
+#include "FSCommon.h"
+#include "memGet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if MQTT_OUTBOX_FLASH_SEGMENTS && defined(FSCom)
+#define MQTT_OUTBOX_USE_FLASH 1
+#else
+#define MQTT_OUTBOX_USE_FLASH 0
+#endif
+
+#if MQTT_OUTBOX_USE_FLASH
+static const char *stateFileName = "/prefs/mqttout.dat";
+
+/// Which flash files we have, what we save in stateFileName
+struct SavedState {
+    uint32_t magic;
+    uint32_t firstSegment, nextSegment;
+};
+static const uint32_t STATE_MAGIC = 0x4d514f31;
+
+static void segmentFileName(char *name, size_t size, uint32_t segment)
+{
+    snprintf(name, size, "/prefs/mqttout%lu.dat", (unsigned long)segment);
+}
+#endif
+
+size_t MQTTOutbox::recordSize(const Header &h)
+{
+    return sizeof(Header) + h.channelIdLen + 1 + h.envelopeLen + (h.jsonLen ? h.jsonLen + 1 : 0);
+}
+
+bool MQTTOutbox::parse(const uint8_t *p, size_t len, Message &m, size_t *size)
+{
+    Header h;
+    if (len < sizeof(h)) {
+        *size = sizeof(h);
+        return false;
+    }
+    memcpy(&h, p, sizeof(h));
+    if (h.magic != HEADER_MAGIC) {
+        *size = 0; // not a message at all
+        return false;
+    }
+    *size = recordSize(h);
+    if (len < *size)
+        return false;
+
+    p += sizeof(h);
+    m.channelId = (const char *)p;
+    p += h.channelIdLen + 1;
+    m.envelope = p;
+    m.envelopeLen = h.envelopeLen;
+    p += h.envelopeLen;
+    m.json = h.jsonLen ? (const char *)p : NULL;
+    m.jsonLen = h.jsonLen;
+    return true;
+}
+
+bool MQTTOutbox::init()
+{
+    ram = static_cast<uint8_t *>(memGet.place(HEAP_SITE_MQTT, MQTT_OUTBOX_RAM_SIZE));
+#if MQTT_OUTBOX_USE_FLASH
+    readBuf = static_cast<uint8_t *>(malloc(MQTT_OUTBOX_READ_SIZE));
+    if (!readBuf) {
+        memGet.unplace(ram);
+        ram = NULL;
+    }
+#endif
+    if (!ram) {
+        LOG_WARN("No room for an MQTT outbox of %u bytes\n", MQTT_OUTBOX_RAM_SIZE);
+        return false;
+    }
+
+#if MQTT_OUTBOX_USE_FLASH
+    loadState();
+#endif
+    LOG_INFO("MQTT outbox holds %u bytes in RAM and %u files on flash, %u messages waiting\n", MQTT_OUTBOX_RAM_SIZE,
+             MQTT_OUTBOX_FLASH_SEGMENTS, flashRecords);
+    return true;
+}
+
+bool MQTTOutbox::enqueue(const char *channelId, const uint8_t *envelope, size_t envelopeLen, const char *json, size_t jsonLen)
+{
+    size_t channelIdLen = strlen(channelId);
+    if (!json)
+        jsonLen = 0;
+    Header h = {HEADER_MAGIC, (uint8_t)channelIdLen, (uint16_t)envelopeLen, (uint16_t)jsonLen};
+    size_t size = recordSize(h);
+    if (!ram || channelIdLen > UINT8_MAX || envelopeLen > UINT16_MAX || jsonLen > UINT16_MAX || size > MQTT_OUTBOX_RAM_SIZE ||
+        (MQTT_OUTBOX_USE_FLASH && size > MQTT_OUTBOX_READ_SIZE)) {
+        LOG_WARN("MQTT message of %u bytes doesn't fit our outbox, discarding it\n", size);
+        dropped++;
+        return false;
+    }
+
+    if (ramWrite + size > MQTT_OUTBOX_RAM_SIZE) {
+        if ((ramWrite - ramRead) + size > MQTT_OUTBOX_RAM_SIZE && !flush()) {
+            LOG_WARN("NOTE: MQTT outbox is full, discarding oldest\n");
+            while ((ramWrite - ramRead) + size > MQTT_OUTBOX_RAM_SIZE)
+                dropOldestRAM();
+        }
+        // Move what's left down to the start of our buffer, so we have all our free space at its end
+        memmove(ram, ram + ramRead, ramWrite - ramRead);
+        ramWrite -= ramRead;
+        ramRead = 0;
+    }
+
+    if (!ramRecords)
+        ramSinceMsec = millis();
+    uint8_t *p = ram + ramWrite;
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    memcpy(p, channelId, channelIdLen + 1);
+    p += channelIdLen + 1;
+    memcpy(p, envelope, envelopeLen);
+    p += envelopeLen;
+    if (jsonLen) {
+        memcpy(p, json, jsonLen);
+        p[jsonLen] = 0;
+    }
+    ramWrite += size;
+    ramRecords++;
+    return true;
+}
+
+void MQTTOutbox::dropOldestRAM()
+{
+    Header h;
+    memcpy(&h, ram + ramRead, sizeof(h));
+    ramRead += recordSize(h);
+    ramRecords--;
+    dropped++;
+    if (!ramRecords)
+        ramRead = ramWrite = 0;
+}
+
+bool MQTTOutbox::peek(Message &m)
+{
+#if MQTT_OUTBOX_USE_FLASH
+    // Whatever is on flash is older than what's in RAM.  peekFlash() drops files it can't read, so this ends
+    while (flashRecords) {
+        if (peekFlash(m))
+            return true;
+    }
+#endif
+    if (!ramRecords)
+        return false;
+    size_t size;
+    return parse(ram + ramRead, ramWrite - ramRead, m, &size);
+}
+
+void MQTTOutbox::pop()
+{
+    Header h;
+    if (flashRecords) {
+#if MQTT_OUTBOX_USE_FLASH
+        // peekFlash() left the message in readBuf
+        memcpy(&h, readBuf + (readOffset - readBufOffset), sizeof(h));
+        readOffset += recordSize(h);
+        flashRecords--;
+        if (!--segmentRecords[firstSegment % MQTT_OUTBOX_FLASH_SEGMENTS])
+            dropSegment();
+#endif
+    } else if (ramRecords) {
+        memcpy(&h, ram + ramRead, sizeof(h));
+        ramRead += recordSize(h);
+        if (!--ramRecords)
+            ramRead = ramWrite = 0;
+    } else {
+        return;
+    }
+    sent++;
+}
+
+void MQTTOutbox::flushIfStale()
+{
+    if (MQTT_OUTBOX_USE_FLASH && ramRecords && millis() - ramSinceMsec >= MQTT_OUTBOX_FLUSH_SECS * 1000UL)
+        flush();
+}
+
+#if MQTT_OUTBOX_USE_FLASH
+bool MQTTOutbox::flush()
+{
+    while (ramRecords) {
+        // Append as many whole messages as fit in our newest file, with a single write
+        size_t span = 0;
+        uint32_t n = 0;
+        if (firstSegment != nextSegment) {
+            while (n < ramRecords) {
+                Header h;
+                memcpy(&h, ram + ramRead + span, sizeof(h));
+                size_t size = recordSize(h);
+                if ((n || writeOffset) && writeOffset + span + size > MQTT_OUTBOX_SEGMENT_SIZE)
+                    break;
+                span += size;
+                n++;
+            }
+        }
+        if (!n) {
+            if (!startSegment())
+                return false;
+            continue;
+        }
+
+        char name[32];
+        segmentFileName(name, sizeof(name), nextSegment - 1);
+        bool okay = false;
+        auto f = FSCom.open(name, writeOffset ? FILE_O_PATCH : FILE_O_WRITE);
+        if (f) {
+            okay = f.seek(writeOffset) && f.write(ram + ramRead, span) == span;
+            f.close();
+        }
+        if (nextSegment - 1 == firstSegment)
+            readBufLen = 0; // we may have read what was there before
+        if (!okay) {
+            LOG_ERROR("Error: can't write %u MQTT messages to %s\n", n, name);
+            return false;
+        }
+
+        writeOffset += span;
+        segmentRecords[(nextSegment - 1) % MQTT_OUTBOX_FLASH_SEGMENTS] += n;
+        flashRecords += n;
+        spilled += n;
+        ramRead += span;
+        ramRecords -= n;
+    }
+    ramRead = ramWrite = 0;
+    return true;
+}
+
+bool MQTTOutbox::peekFlash(Message &m)
+{
+    while (flashRecords && !segmentRecords[firstSegment % MQTT_OUTBOX_FLASH_SEGMENTS])
+        dropSegment(); // a file we had finished with when we rebooted
+    if (!flashRecords)
+        return false;
+
+    size_t size;
+    if (readBufLen && readOffset >= readBufOffset && readOffset - readBufOffset <= readBufLen &&
+        parse(readBuf + (readOffset - readBufOffset), readBufLen - (readOffset - readBufOffset), m, &size))
+        return true;
+
+    // Read as much of the file as we can hold from where we are up to, so the next few messages come from RAM
+    char name[32];
+    segmentFileName(name, sizeof(name), firstSegment);
+    readBufOffset = readOffset;
+    readBufLen = 0;
+    auto f = FSCom.open(name, FILE_O_READ);
+    if (f) {
+        if (f.seek(readOffset)) {
+            int n = f.read(readBuf, MQTT_OUTBOX_READ_SIZE);
+            if (n > 0)
+                readBufLen = n;
+        }
+        f.close();
+    }
+    if (parse(readBuf, readBufLen, m, &size))
+        return true;
+
+    LOG_ERROR("Error: can't read %s, dropping the %u MQTT messages left in it\n", name,
+              segmentRecords[firstSegment % MQTT_OUTBOX_FLASH_SEGMENTS]);
+    dropSegment();
+    return false;
+}
+
+bool MQTTOutbox::startSegment()
+{
+    if (nextSegment - firstSegment >= MQTT_OUTBOX_FLASH_SEGMENTS) {
+        LOG_WARN("NOTE: MQTT outbox is full, discarding the %u oldest messages\n",
+                 segmentRecords[firstSegment % MQTT_OUTBOX_FLASH_SEGMENTS]);
+        dropSegment();
+    }
+    segmentRecords[nextSegment % MQTT_OUTBOX_FLASH_SEGMENTS] = 0;
+    nextSegment++;
+    writeOffset = 0;
+    saveState();
+
+    char name[32];
+    segmentFileName(name, sizeof(name), nextSegment - 1);
+    auto f = FSCom.open(name, FILE_O_WRITE);
+    if (!f) {
+        LOG_ERROR("Error: can't create %s\n", name);
+        return false;
+    }
+    f.close();
+    return true;
+}
+
+void MQTTOutbox::dropSegment()
+{
+    uint16_t &n = segmentRecords[firstSegment % MQTT_OUTBOX_FLASH_SEGMENTS];
+    dropped += n;
+    flashRecords -= n;
+    n = 0;
+
+    char name[32];
+    segmentFileName(name, sizeof(name), firstSegment);
+    if (FSCom.exists(name))
+        FSCom.remove(name);
+    firstSegment++;
+    readOffset = readBufOffset = readBufLen = 0;
+    saveState();
+}
+
+void MQTTOutbox::saveState()
+{
+    SavedState s = {STATE_MAGIC, firstSegment, nextSegment};
+    FSCom.mkdir("/prefs");
+    auto f = FSCom.open(stateFileName, FILE_O_WRITE);
+    if (!f || f.write((const uint8_t *)&s, sizeof(s)) != sizeof(s))
+        LOG_ERROR("Error: can't write %s\n", stateFileName);
+    if (f)
+        f.close();
+}
+
+void MQTTOutbox::loadState()
+{
+    SavedState s;
+    bool okay = false;
+    auto f = FSCom.open(stateFileName, FILE_O_READ);
+    if (f) {
+        okay = f.read((uint8_t *)&s, sizeof(s)) == (int)sizeof(s) && s.magic == STATE_MAGIC &&
+               s.nextSegment - s.firstSegment <= MQTT_OUTBOX_FLASH_SEGMENTS;
+        f.close();
+    }
+    if (!okay)
+        return;
+
+    firstSegment = s.firstSegment;
+    nextSegment = s.nextSegment;
+    for (uint32_t i = firstSegment; i < nextSegment; i++) {
+        uint16_t n = countRecords(i, &writeOffset);
+        segmentRecords[i % MQTT_OUTBOX_FLASH_SEGMENTS] = n;
+        flashRecords += n;
+    }
+}
+
+uint16_t MQTTOutbox::countRecords(uint32_t segment, size_t *size)
+{
+    char name[32];
+    segmentFileName(name, sizeof(name), segment);
+    uint16_t n = 0;
+    *size = 0;
+    auto f = FSCom.open(name, FILE_O_READ);
+    if (!f)
+        return 0;
+
+    // Stop at anything which isn't a whole message, such as the end of a write we didn't finish
+    size_t fileSize = f.size();
+    Header h;
+    while (f.seek(*size) && f.read((uint8_t *)&h, sizeof(h)) == (int)sizeof(h) && h.magic == HEADER_MAGIC &&
+           *size + recordSize(h) <= fileSize) {
+        *size += recordSize(h);
+        n++;
+    }
+    f.close();
+    return n;
+}
+#else
+bool MQTTOutbox::flush()
+{
+    return false;
+}
+
+bool MQTTOutbox::peekFlash(Message &m)
+{
+    return false;
+}
+
+bool MQTTOutbox::startSegment()
+{
+    return false;
+}
+
+void MQTTOutbox::dropSegment() {}
+
+void MQTTOutbox::saveState() {}
+
+void MQTTOutbox::loadState() {}
+
+uint16_t MQTTOutbox::countRecords(uint32_t segment, size_t *size)
+{
+    return 0;
+}
+#endif
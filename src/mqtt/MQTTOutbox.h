@@ -0,0 +1,145 @@
+#pragma once
+
+#include "configuration.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// How many bytes of messages we hold in RAM (PSRAM where we have it) before spilling them to flash
+#ifndef MQTT_OUTBOX_RAM_SIZE
+#ifdef BOARD_HAS_PSRAM
+#define MQTT_OUTBOX_RAM_SIZE 65536
+#else
+#define MQTT_OUTBOX_RAM_SIZE 4096
+#endif
+#endif
+
+/// How many files of spilled messages we keep on flash, 0 to never spill (and drop the oldest message instead)
+#ifndef MQTT_OUTBOX_FLASH_SEGMENTS
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define MQTT_OUTBOX_FLASH_SEGMENTS 8
+#else
+#define MQTT_OUTBOX_FLASH_SEGMENTS 0
+#endif
+#endif
+
+/// How big each of those files grows before we start the next one, once we have them all the oldest is dropped
+#ifndef MQTT_OUTBOX_SEGMENT_SIZE
+#define MQTT_OUTBOX_SEGMENT_SIZE 8192
+#endif
+
+/// Messages don't wait in RAM for longer than this before we write them to flash, so few are lost if we reboot
+#ifndef MQTT_OUTBOX_FLUSH_SECS
+#define MQTT_OUTBOX_FLUSH_SECS 60
+#endif
+
+/// How much of a flash file we read at a time
+#ifndef MQTT_OUTBOX_READ_SIZE
+#define MQTT_OUTBOX_READ_SIZE 2048
+#endif
+
+/**
+ * The messages we couldn't publish yet, because we aren't connected to the MQTT server.  Each message is the encoded
+ * ServiceEnvelope we publish to the crypt topic, plus (if we have one) the JSON we publish to the json topic.  Encoding them
+ * as they come in means a message no longer holds on to the MeshPacket it was made from.
+ *
+ * Messages go into a buffer in RAM.  When that fills up (or a message has waited there for MQTT_OUTBOX_FLUSH_SECS) all of them
+ * are appended to a file on flash, one of up to MQTT_OUTBOX_FLASH_SEGMENTS which are kept across reboots.  Flash holds older
+ * messages than RAM, so taking them from flash first keeps them in order.  Once all our files are full, the oldest file is
+ * dropped to make room.  Delivery is at least once: after a reboot a file we were part way through is sent again from its start.
+ */
+class MQTTOutbox
+{
+  public:
+    /// A message as peek() sees it, only valid until the next call to us
+    struct Message {
+        const char *channelId;
+        const uint8_t *envelope;
+        size_t envelopeLen;
+        const char *json; // NULL if we have no JSON version of it
+        size_t jsonLen;
+    };
+
+  private:
+    /// What each message starts with, in RAM and on flash
+    struct Header {
+        uint8_t magic;
+        uint8_t channelIdLen; // the strings are kept with their NUL terminators, which these don't count
+        uint16_t envelopeLen;
+        uint16_t jsonLen;
+    };
+    static const uint8_t HEADER_MAGIC = 0xa7;
+
+    uint8_t *ram = NULL;
+    size_t ramRead = 0, ramWrite = 0;
+    uint32_t ramRecords = 0;
+    uint32_t ramSinceMsec = 0; // when the oldest of them was added
+
+    /// Our flash files are numbered firstSegment up to (not including) nextSegment
+    uint32_t firstSegment = 0, nextSegment = 0;
+    uint16_t segmentRecords[MQTT_OUTBOX_FLASH_SEGMENTS ? MQTT_OUTBOX_FLASH_SEGMENTS : 1] = {};
+    uint32_t flashRecords = 0;
+    size_t writeOffset = 0; // how much of the newest file we've written
+    size_t readOffset = 0;  // where the next message in the oldest file starts
+
+    /// What we last read from the oldest file
+    uint8_t *readBuf = NULL;
+    size_t readBufOffset = 0, readBufLen = 0;
+
+    uint32_t dropped = 0, spilled = 0, sent = 0;
+
+    static size_t recordSize(const Header &h);
+
+    /// @return the message at p, or false if it isn't a whole one within len bytes
+    static bool parse(const uint8_t *p, size_t len, Message &m, size_t *size);
+
+    void dropOldestRAM();
+
+    /// Save which files we have, so we find them again after a reboot
+    void saveState();
+    void loadState();
+
+    /// Start a new flash file, dropping the oldest if we already have all of them
+    bool startSegment();
+
+    /// Forget the oldest flash file, once we've sent it or to make room
+    void dropSegment();
+
+    /// How many messages the flash file holds, we only need this when we find it after a reboot
+    uint16_t countRecords(uint32_t segment, size_t *size);
+
+    bool peekFlash(Message &m);
+
+  public:
+    /// Allocate our RAM buffer and find whatever we left on flash, @return false if there's no room for us
+    bool init();
+
+    /// Keep a message for later.  Makes room by spilling what we hold to flash, or by dropping the oldest message
+    bool enqueue(const char *channelId, const uint8_t *envelope, size_t envelopeLen, const char *json, size_t jsonLen);
+
+    /// @return the oldest message (without removing it), or false if we have none
+    bool peek(Message &m);
+
+    /// Remove the message peek() just returned, as we've sent it
+    void pop();
+
+    /// Write everything we hold in RAM to flash, @return false if we couldn't (so it's still in RAM)
+    bool flush();
+
+    /// flush() if something has waited in RAM for longer than MQTT_OUTBOX_FLUSH_SECS
+    void flushIfStale();
+
+    bool isEmpty() const { return !ramRecords && !flashRecords; }
+
+    uint32_t getNumMessages() const { return ramRecords + flashRecords; }
+    uint32_t getNumOnFlash() const { return flashRecords; }
+    size_t getRAMBytes() const { return ramWrite - ramRead; }
+
+    /// How many messages we threw away, for lack of room
+    uint32_t getNumDropped() const { return dropped; }
+
+    /// How many messages we wrote to flash
+    uint32_t getNumSpilled() const { return spilled; }
+
+    /// How many messages were sent after waiting in here
+    uint32_t getNumSent() const { return sent; }
+};
@@ -0,0 +1,116 @@
+#include "MQTTUplinkPolicy.h"
+#include "mesh/mesh-pb-constants.h"
+#include "mesh/generated/meshtastic/telemetry.pb.h"
+#include <ErriezCRC32.h>
+
+uint32_t MQTTUplinkPolicy::getMinIntervalSecs(meshtastic_PortNum port)
+{
+    switch (port) {
+    case meshtastic_PortNum_POSITION_APP:
+        return MQTT_UPLINK_POSITION_SECS;
+    case meshtastic_PortNum_TELEMETRY_APP:
+        return MQTT_UPLINK_TELEMETRY_SECS;
+    case meshtastic_PortNum_NODEINFO_APP:
+        return MQTT_UPLINK_NODEINFO_SECS;
+    case meshtastic_PortNum_NEIGHBORINFO_APP:
+        return MQTT_UPLINK_NEIGHBORINFO_SECS;
+    default:
+        return 0; // text messages and the like always go
+    }
+}
+
+MQTTUplinkPolicy::Verdict MQTTUplinkPolicy::check(const meshtastic_MeshPacket &p)
+{
+    Verdict v = UPLINK;
+    if (!MQTT_UPLINK_POLICY) {
+        counts[v]++;
+        return v;
+    }
+    if (p.id) {
+        for (const Seen &s : seen)
+            if (s.id == p.id && s.from == p.from)
+                v = DROP_DUPLICATE;
+    }
+
+    if (v == UPLINK && p.which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+        uint32_t minMsec = getMinIntervalSecs(p.decoded.portnum) * 1000UL;
+        uint16_t key = (uint16_t)p.decoded.portnum << 8;
+
+        // Telemetry is compared by what it measured, so leave out when it did
+        bool isTelemetry = false;
+        uint32_t crc = 0;
+        if (MQTT_UPLINK_UNCHANGED_SECS && p.decoded.portnum == meshtastic_PortNum_TELEMETRY_APP) {
+            meshtastic_Telemetry t;
+            memset(&t, 0, sizeof(t));
+            if (pb_decode_from_bytes(p.decoded.payload.bytes, p.decoded.payload.size, &meshtastic_Telemetry_msg, &t)) {
+                isTelemetry = true;
+                key |= t.which_variant;
+                t.time = 0;
+                crc = crc32Buffer(&t, sizeof(t));
+            }
+        }
+
+        if (minMsec || isTelemetry) {
+            uint32_t now = millis();
+            Rate *r = NULL, *oldest = &rates[0];
+            for (Rate &e : rates) {
+                if (e.from == p.from && e.key == key) {
+                    r = &e;
+                    break;
+                }
+                if (!e.from || (oldest->from && now - e.lastMsec > now - oldest->lastMsec))
+                    oldest = &e;
+            }
+
+            if (r) {
+                uint32_t since = now - r->lastMsec;
+                if (since < minMsec)
+                    v = DROP_RATE;
+                else if (isTelemetry && r->lastCRC == crc && since < MQTT_UPLINK_UNCHANGED_SECS * 1000UL)
+                    v = DROP_UNCHANGED;
+            } else {
+                r = oldest;
+            }
+            if (v == UPLINK) {
+                r->from = p.from;
+                r->key = key;
+                r->lastMsec = now;
+                r->lastCRC = crc;
+            }
+        }
+    }
+
+    if (v == UPLINK && p.id) {
+        seen[nextSeen].from = p.from;
+        seen[nextSeen].id = p.id;
+        nextSeen = (nextSeen + 1) % MQTT_UPLINK_DEDUPE_ENTRIES;
+    }
+    counts[v]++;
+    return v;
+}
+
+bool MQTTUplinkPolicy::reducePosition(meshtastic_MeshPacket &p, uint8_t bits)
+{
+    if (!MQTT_UPLINK_POLICY || bits >= 32 || p.which_payload_variant != meshtastic_MeshPacket_decoded_tag ||
+        p.decoded.portnum != meshtastic_PortNum_POSITION_APP)
+        return false;
+
+    meshtastic_Position pos;
+    memset(&pos, 0, sizeof(pos));
+    if (!pb_decode_from_bytes(p.decoded.payload.bytes, p.decoded.payload.size, &meshtastic_Position_msg, &pos) ||
+        (!pos.latitude_i && !pos.longitude_i))
+        return false;
+
+    // The middle of the cell we fall in, so we are never more than half a cell off
+    if (!bits)
+        bits = 1;
+    uint32_t mask = UINT32_MAX << (32 - bits);
+    int32_t half = (int32_t)(1UL << (31 - bits));
+    pos.latitude_i = (int32_t)((uint32_t)pos.latitude_i & mask) + half;
+    pos.longitude_i = (int32_t)((uint32_t)pos.longitude_i & mask) + half;
+
+    p.decoded.payload.size =
+        pb_encode_to_bytes(p.decoded.payload.bytes, sizeof(p.decoded.payload.bytes), &meshtastic_Position_msg, &pos);
+    reducedPositions++;
+    return true;
+}
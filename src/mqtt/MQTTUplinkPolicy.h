@@ -0,0 +1,96 @@
+#pragma once
+
+#include "mesh/MeshTypes.h"
+#include "configuration.h"
+
+/// Drop duplicate, too frequent and unchanged packets before we uplink them, and reduce the precision of positions.  Opt in
+/// with -DMQTT_UPLINK_POLICY=1
+#ifndef MQTT_UPLINK_POLICY
+#define MQTT_UPLINK_POLICY 0
+#endif
+
+/// The least time (in seconds) between two packets of a port we uplink from the same node, 0 for no limit
+#ifndef MQTT_UPLINK_POSITION_SECS
+#define MQTT_UPLINK_POSITION_SECS 120
+#endif
+#ifndef MQTT_UPLINK_TELEMETRY_SECS
+#define MQTT_UPLINK_TELEMETRY_SECS 120
+#endif
+#ifndef MQTT_UPLINK_NODEINFO_SECS
+#define MQTT_UPLINK_NODEINFO_SECS 600
+#endif
+#ifndef MQTT_UPLINK_NEIGHBORINFO_SECS
+#define MQTT_UPLINK_NEIGHBORINFO_SECS 600
+#endif
+
+/// Telemetry which is the same as what we last uplinked from that node (but for its time) waits for this long before we send
+/// it again anyway, 0 to send unchanged telemetry like any other
+#ifndef MQTT_UPLINK_UNCHANGED_SECS
+#define MQTT_UPLINK_UNCHANGED_SECS 3600
+#endif
+
+/// How many bits of latitude_i and longitude_i we keep in positions we uplink, 32 for all of them.  Out of 32,
+/// 16 is about 700m, 20 about 45m
+#ifndef MQTT_UPLINK_POSITION_BITS
+#define MQTT_UPLINK_POSITION_BITS 32
+#endif
+
+/// Likewise, on the default (public) server
+#ifndef MQTT_UPLINK_PUBLIC_POSITION_BITS
+#define MQTT_UPLINK_PUBLIC_POSITION_BITS 16
+#endif
+
+/// How many packets we remember by (from, id), so we uplink one which reaches us on more than one channel only once
+#ifndef MQTT_UPLINK_DEDUPE_ENTRIES
+#define MQTT_UPLINK_DEDUPE_ENTRIES 32
+#endif
+
+/// How many (node, port) pairs we track for rate limits, the one we heard from longest ago makes room for a new one
+#ifndef MQTT_UPLINK_RATE_ENTRIES
+#define MQTT_UPLINK_RATE_ENTRIES 64
+#endif
+
+/**
+ * Decides which of the packets MQTT::onSend() gets are worth uplinking, before they are encoded: a packet we've already
+ * uplinked (by from and id), one from a node we uplinked the same port from too recently, or telemetry which hasn't changed
+ * are dropped.  It also takes the precision off positions.  Without MQTT_UPLINK_POLICY everything is uplinked as it is.
+ */
+class MQTTUplinkPolicy
+{
+  public:
+    enum Verdict { UPLINK, DROP_DUPLICATE, DROP_RATE, DROP_UNCHANGED, NUM_VERDICTS };
+
+  private:
+    struct Seen {
+        NodeNum from;
+        PacketId id;
+    };
+    Seen seen[MQTT_UPLINK_DEDUPE_ENTRIES] = {};
+    uint8_t nextSeen = 0;
+
+    /// When we last uplinked a port (and for telemetry, which of its variants) from a node
+    struct Rate {
+        NodeNum from;
+        uint16_t key; // port << 8 | telemetry variant
+        uint32_t lastMsec;
+        uint32_t lastCRC; // of what we uplinked, for telemetry
+    };
+    Rate rates[MQTT_UPLINK_RATE_ENTRIES] = {};
+
+    uint32_t counts[NUM_VERDICTS] = {};
+    uint32_t reducedPositions = 0;
+
+    static uint32_t getMinIntervalSecs(meshtastic_PortNum port);
+
+  public:
+    /// @return whether to uplink a decoded packet, remembering it if so
+    Verdict check(const meshtastic_MeshPacket &p);
+
+    /// Keep only bits of its latitude and longitude, if p is a position.  @return true if we changed p
+    bool reducePosition(meshtastic_MeshPacket &p, uint8_t bits);
+
+    /// How many packets we gave each verdict
+    uint32_t getCount(Verdict v) const { return counts[v]; }
+
+    uint32_t getNumReducedPositions() const { return reducedPositions; }
+};
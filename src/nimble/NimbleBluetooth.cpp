@@ -9,11 +9,29 @@
 #include <NimBLEDevice.h>
 
 NimBLECharacteristic *fromNumCharacteristic;
+NimBLECharacteristic *fromRadioStreamCharacteristic;
 NimBLECharacteristic *BatteryCharacteristic;
 NimBLEServer *bleServer;
 
 static bool passkeyShowing;
 
+static BluetoothFromRadioStream *fromRadioStreamer;
+
+class NimbleFromNumNotifier : public BluetoothFromNumNotifier
+{
+  protected:
+    virtual void notify(uint32_t fromRadioNum) override
+    {
+        uint8_t val[4];
+        put_le32(val, fromRadioNum);
+
+        fromNumCharacteristic->setValue(val, sizeof(val));
+        fromNumCharacteristic->notify();
+    }
+};
+
+static NimbleFromNumNotifier *fromNumNotifier;
+
 class BluetoothPhoneAPI : public PhoneAPI
 {
     /**
@@ -23,13 +41,8 @@ class BluetoothPhoneAPI : public PhoneAPI
     {
         PhoneAPI::onNowHasData(fromRadioNum);
 
-        LOG_INFO("BLE notify fromNum\n");
-
-        uint8_t val[4];
-        put_le32(val, fromRadioNum);
-
-        fromNumCharacteristic->setValue(val, sizeof(val));
-        fromNumCharacteristic->notify();
+        fromNumNotifier->onNowHasData(fromRadioNum);
+        fromRadioStreamer->wake();
     }
 
     /// Check the current underlying physical link to see if the client is currently connected
@@ -37,6 +50,51 @@ class BluetoothPhoneAPI : public PhoneAPI
 };
 
 static BluetoothPhoneAPI *bluetoothPhoneAPI;
+
+/// The connection of our FROMRADIO_STREAM subscriber
+static uint16_t streamConnHandle;
+
+/// The connection our BluetoothLinkManager tunes (we have one client at a time)
+static uint16_t linkConnHandle;
+
+class NimbleLinkManager : public BluetoothLinkManager
+{
+  public:
+    explicit NimbleLinkManager(PhoneAPI *api) : BluetoothLinkManager(api) {}
+
+  protected:
+    virtual bool requestParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) override
+    {
+        if (!bleServer)
+            return false;
+        bleServer->updateConnParams(linkConnHandle, minInterval, maxInterval, latency, timeout);
+        return true;
+    }
+};
+
+static NimbleLinkManager *linkManager;
+
+/// Set by our onStatus() callback, which NimBLE calls from within notify()
+static bool streamNotifyFailed;
+
+class NimbleFromRadioStream : public BluetoothFromRadioStream
+{
+  public:
+    explicit NimbleFromRadioStream(PhoneAPI *api) : BluetoothFromRadioStream(api) {}
+
+  protected:
+    virtual bool isSubscribed() override { return fromRadioStreamCharacteristic->getSubscribedCount() > 0; }
+
+    virtual size_t getMaxChunk() override { return bleServer->getPeerMTU(streamConnHandle) - 3; }
+
+    virtual bool notify(const uint8_t *bytes, size_t len) override
+    {
+        streamNotifyFailed = false;
+        fromRadioStreamCharacteristic->notify(bytes, len);
+        return !streamNotifyFailed;
+    }
+};
+
 /**
  * Subclasses can use this as a hook to provide custom notifications for their transport (i.e. bluetooth notifies)
  */
@@ -48,7 +106,9 @@ class NimbleBluetoothToRadioCallback : public NimBLECharacteristicCallbacks
         LOG_INFO("To Radio onwrite\n");
         auto val = pCharacteristic->getValue();
 
+        linkManager->noteActivity();
         bluetoothPhoneAPI->handleToRadio(val.data(), val.length());
+        fromRadioStreamer->wake();
     }
 };
 
@@ -59,10 +119,29 @@ class NimbleBluetoothFromRadioCallback : public NimBLECharacteristicCallbacks
         LOG_INFO("From Radio onread\n");
         uint8_t fromRadioBytes[meshtastic_FromRadio_size];
         size_t numBytes = bluetoothPhoneAPI->getFromRadio(fromRadioBytes);
+        linkManager->noteActivity();
 
-        std::string fromRadioByteString(fromRadioBytes, fromRadioBytes + numBytes);
+        pCharacteristic->setValue(fromRadioBytes, numBytes);
+    }
+};
 
-        pCharacteristic->setValue(fromRadioByteString);
+class NimbleBluetoothFromRadioStreamCallback : public NimBLECharacteristicCallbacks
+{
+    virtual void onSubscribe(NimBLECharacteristic *pCharacteristic, ble_gap_conn_desc *desc, uint16_t subValue)
+    {
+        if (subValue) {
+            // This client wants throughput: the longest data length (linkManager already keeps the interval short while busy)
+            streamConnHandle = desc->conn_handle;
+            bleServer->setDataLen(desc->conn_handle, 251);
+            linkManager->noteActivity();
+        }
+        fromRadioStreamer->onSubscribe(subValue != 0);
+    }
+
+    virtual void onStatus(NimBLECharacteristic *pCharacteristic, Status s, int code)
+    {
+        if (s != SUCCESS_NOTIFY)
+            streamNotifyFailed = true;
     }
 };
 
@@ -96,11 +175,23 @@ class NimbleBluetoothServerCallback : public NimBLEServerCallbacks
         }
     }
 
-    virtual void onDisconnect(NimBLEServer *pServer, ble_gap_conn_desc *desc) { LOG_INFO("BLE disconnect\n"); }
+    virtual void onConnect(NimBLEServer *pServer, ble_gap_conn_desc *desc)
+    {
+        LOG_INFO("BLE connect\n");
+        linkConnHandle = desc->conn_handle;
+        linkManager->onConnect();
+    }
+
+    virtual void onDisconnect(NimBLEServer *pServer, ble_gap_conn_desc *desc)
+    {
+        LOG_INFO("BLE disconnect\n");
+        linkManager->onDisconnect();
+    }
 };
 
 static NimbleBluetoothToRadioCallback *toRadioCallbacks;
 static NimbleBluetoothFromRadioCallback *fromRadioCallbacks;
+static NimbleBluetoothFromRadioStreamCallback *fromRadioStreamCallbacks;
 
 void NimbleBluetooth::shutdown()
 {
@@ -146,6 +237,7 @@ void NimbleBluetooth::setup()
         NimBLEDevice::setSecurityAuth(true, true, true);
         NimBLEDevice::setSecurityIOCap(BLE_HS_IO_DISPLAY_ONLY);
     }
+    NimBLEDevice::setMTU(517); // so FROMRADIO_STREAM notifications can be as big as BLE allows
     bleServer = NimBLEDevice::createServer();
 
     NimbleBluetoothServerCallback *serverCallbacks = new NimbleBluetoothServerCallback();
@@ -173,7 +265,16 @@ void NimbleBluetooth::setupService()
             bleService->createCharacteristic(FROMNUM_UUID, NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::READ |
                                                                NIMBLE_PROPERTY::READ_AUTHEN | NIMBLE_PROPERTY::READ_ENC);
     }
+    // Secured like FromRadio, which it streams: with READ_ENC/READ_AUTHEN NimBLE only lets a bonded client subscribe to it
+    if (config.bluetooth.mode == meshtastic_Config_BluetoothConfig_PairingMode_NO_PIN)
+        fromRadioStreamCharacteristic = bleService->createCharacteristic(FROMRADIO_STREAM_UUID, NIMBLE_PROPERTY::NOTIFY);
+    else
+        fromRadioStreamCharacteristic = bleService->createCharacteristic(
+            FROMRADIO_STREAM_UUID, NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::READ_AUTHEN | NIMBLE_PROPERTY::READ_ENC);
     bluetoothPhoneAPI = new BluetoothPhoneAPI();
+    fromRadioStreamer = new NimbleFromRadioStream(bluetoothPhoneAPI);
+    linkManager = new NimbleLinkManager(bluetoothPhoneAPI);
+    fromNumNotifier = new NimbleFromNumNotifier();
 
     toRadioCallbacks = new NimbleBluetoothToRadioCallback();
     ToRadioCharacteristic->setCallbacks(toRadioCallbacks);
@@ -181,6 +282,9 @@ void NimbleBluetooth::setupService()
     fromRadioCallbacks = new NimbleBluetoothFromRadioCallback();
     FromRadioCharacteristic->setCallbacks(fromRadioCallbacks);
 
+    fromRadioStreamCallbacks = new NimbleBluetoothFromRadioStreamCallback();
+    fromRadioStreamCharacteristic->setCallbacks(fromRadioStreamCallbacks);
+
     bleService->start();
 
     // Setup the battery service
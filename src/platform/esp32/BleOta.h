@@ -12,9 +12,11 @@ class BleOta
     static String getOtaAppVersion();
     static bool switchToOtaApp();
 
+    /// @return the partition holding the BLE OTA app, NULL if we don't have one
+    static const esp_partition_t *findEspOtaAppPartition();
+
   private:
     String mUserAgent;
-    static const esp_partition_t *findEspOtaAppPartition();
 };
 
 #endif // BLEOTA_H
\ No newline at end of file
@@ -6,12 +6,21 @@
 class ESP32CryptoEngine : public CryptoEngine
 {
 
-    mbedtls_aes_context aes;
+    /// One expanded key schedule per key slot, so switching channels doesn't redo mbedtls_aes_setkey_enc()
+    mbedtls_aes_context aes[CRYPTO_KEY_SLOTS];
 
   public:
-    ESP32CryptoEngine() { mbedtls_aes_init(&aes); }
+    ESP32CryptoEngine()
+    {
+        for (int i = 0; i < CRYPTO_KEY_SLOTS; i++)
+            mbedtls_aes_init(&aes[i]);
+    }
 
-    ~ESP32CryptoEngine() { mbedtls_aes_free(&aes); }
+    ~ESP32CryptoEngine()
+    {
+        for (int i = 0; i < CRYPTO_KEY_SLOTS; i++)
+            mbedtls_aes_free(&aes[i]);
+    }
 
     /**
      * Set the key used for encrypt, decrypt.
@@ -27,7 +36,7 @@ class ESP32CryptoEngine : public CryptoEngine
         CryptoEngine::setKey(k);
 
         if (key.length != 0) {
-            auto res = mbedtls_aes_setkey_enc(&aes, key.bytes, key.length * 8);
+            auto res = mbedtls_aes_setkey_enc(&aes[activeSlot], key.bytes, key.length * 8);
             assert(!res);
         }
     }
@@ -39,23 +48,8 @@ class ESP32CryptoEngine : public CryptoEngine
      */
     virtual void encrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes) override
     {
-        if (key.length > 0) {
-            LOG_DEBUG("ESP32 crypt fr=%x, num=%x, numBytes=%d!\n", fromNode, (uint32_t)packetId, numBytes);
-            initNonce(fromNode, packetId);
-            if (numBytes <= MAX_BLOCKSIZE) {
-                static uint8_t scratch[MAX_BLOCKSIZE];
-                uint8_t stream_block[16];
-                size_t nc_off = 0;
-                memcpy(scratch, bytes, numBytes);
-                memset(scratch + numBytes, 0,
-                       sizeof(scratch) - numBytes); // Fill rest of buffer with zero (in case cypher looks at it)
-
-                auto res = mbedtls_aes_crypt_ctr(&aes, numBytes, &nc_off, nonce, stream_block, scratch, bytes);
-                assert(!res);
-            } else {
-                LOG_ERROR("Packet too large for crypto engine: %d. noop encryption!\n", numBytes);
-            }
-        }
+        if (key.length > 0)
+            crypt(fromNode, packetId, numBytes, bytes);
     }
 
     virtual void decrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes) override
@@ -64,7 +58,35 @@ class ESP32CryptoEngine : public CryptoEngine
         encrypt(fromNode, packetId, numBytes, bytes);
     }
 
+    virtual void encryptBatch(const CryptoJob *jobs, size_t numJobs) override
+    {
+        if (key.length > 0) {
+            LOG_DEBUG("ESP32 crypt %u packets\n", numJobs);
+            for (size_t i = 0; i < numJobs; i++)
+                crypt(jobs[i].fromNode, jobs[i].packetId, jobs[i].numBytes, jobs[i].bytes);
+        }
+    }
+
+    virtual void decryptBatch(const CryptoJob *jobs, size_t numJobs) override { encryptBatch(jobs, numJobs); }
+
   private:
+    /**
+     * AES-CTR bytes in place, with the current key.  mbedtls works in place, and on the ESP32-S2, S3 and C3 its driver
+     * hands the whole packet to the AES peripheral by DMA, so there's no need for a scratch copy (or to zero what's past the
+     * end of it, which CTR never reads).
+     */
+    void crypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes)
+    {
+        if (numBytes > MAX_BLOCKSIZE) {
+            LOG_ERROR("Packet too large for crypto engine: %d. noop encryption!\n", numBytes);
+            return;
+        }
+        initNonce(fromNode, packetId);
+        uint8_t stream_block[16];
+        size_t nc_off = 0;
+        auto res = mbedtls_aes_crypt_ctr(&aes[activeSlot], numBytes, &nc_off, nonce, stream_block, bytes, bytes);
+        assert(!res);
+    }
 };
 
 CryptoEngine *crypto = new ESP32CryptoEngine();
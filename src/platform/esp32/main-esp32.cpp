@@ -1,3 +1,5 @@
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "PowerFSM.h"
 #include "configuration.h"
 #include "esp_task_wdt.h"
@@ -28,9 +30,11 @@ void setBluetoothEnable(bool on)
         }
         if (on && !nimbleBluetooth->isActive()) {
             nimbleBluetooth->setup();
+            BOOT_MILESTONE("bluetooth");
         } else if (!on) {
             nimbleBluetooth->shutdown();
         }
+        energyStats.setOn(EnergyStats::BLUETOOTH, on);
     }
 }
 #else
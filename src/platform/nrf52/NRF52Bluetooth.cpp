@@ -11,6 +11,7 @@ static BLEService meshBleService = BLEService(BLEUuid(MESH_SERVICE_UUID_16));
 static BLECharacteristic fromNum = BLECharacteristic(BLEUuid(FROMNUM_UUID_16));
 static BLECharacteristic fromRadio = BLECharacteristic(BLEUuid(FROMRADIO_UUID_16));
 static BLECharacteristic toRadio = BLECharacteristic(BLEUuid(TORADIO_UUID_16));
+static BLECharacteristic fromRadioStream = BLECharacteristic(BLEUuid(FROMRADIO_STREAM_UUID_16));
 
 static BLEDis bledis; // DIS (Device Information Service) helper class instance
 static BLEBas blebas; // BAS (Battery Service) helper class instance
@@ -24,6 +25,32 @@ static uint8_t toRadioBytes[meshtastic_ToRadio_size];
 
 static uint16_t connectionHandle;
 
+static BluetoothFromRadioStream *fromRadioStreamer;
+
+class NRF52FromNumNotifier : public BluetoothFromNumNotifier
+{
+  protected:
+    virtual void notify(uint32_t fromRadioNum) override { fromNum.notify32(fromRadioNum); }
+};
+
+static NRF52FromNumNotifier *fromNumNotifier;
+
+class NRF52LinkManager : public BluetoothLinkManager
+{
+  public:
+    explicit NRF52LinkManager(PhoneAPI *api) : BluetoothLinkManager(api) {}
+
+  protected:
+    /// Bluefruit asks for one interval, so we ask for the longest we'd take (the central picks what it can give)
+    virtual bool requestParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) override
+    {
+        BLEConnection *connection = Bluefruit.Connection(connectionHandle);
+        return connection && connection->requestConnectionParameter(maxInterval, latency, timeout);
+    }
+};
+
+static NRF52LinkManager *linkManager;
+
 class BluetoothPhoneAPI : public PhoneAPI
 {
     /**
@@ -33,8 +60,8 @@ class BluetoothPhoneAPI : public PhoneAPI
     {
         PhoneAPI::onNowHasData(fromRadioNum);
 
-        LOG_INFO("BLE notify fromNum\n");
-        fromNum.notify32(fromRadioNum);
+        fromNumNotifier->onNowHasData(fromRadioNum);
+        fromRadioStreamer->wake();
     }
 
     /// Check the current underlying physical link to see if the client is currently connected
@@ -47,6 +74,23 @@ class BluetoothPhoneAPI : public PhoneAPI
 
 static BluetoothPhoneAPI *bluetoothPhoneAPI;
 
+class NRF52FromRadioStream : public BluetoothFromRadioStream
+{
+  public:
+    explicit NRF52FromRadioStream(PhoneAPI *api) : BluetoothFromRadioStream(api) {}
+
+  protected:
+    virtual bool isSubscribed() override { return fromRadioStream.notifyEnabled(connectionHandle); }
+
+    virtual size_t getMaxChunk() override { return Bluefruit.Connection(connectionHandle)->getMtu() - 3; }
+
+    /// notify() would split anything bigger than the MTU allows, but we never give it that much
+    virtual bool notify(const uint8_t *bytes, size_t len) override
+    {
+        return fromRadioStream.notify(connectionHandle, bytes, len);
+    }
+};
+
 void onConnect(uint16_t conn_handle)
 {
     // Get the reference to current connection
@@ -57,6 +101,7 @@ void onConnect(uint16_t conn_handle)
     connection->getPeerName(central_name, sizeof(central_name));
 
     LOG_INFO("BLE Connected to %s\n", central_name);
+    linkManager->onConnect();
 }
 
 /**
@@ -68,6 +113,7 @@ void onDisconnect(uint16_t conn_handle, uint8_t reason)
 {
     // FIXME - we currently assume only one active connection
     LOG_INFO("BLE Disconnected, reason = 0x%x\n", reason);
+    linkManager->onDisconnect();
 }
 
 void onCccd(uint16_t conn_hdl, BLECharacteristic *chr, uint16_t cccd_value)
@@ -83,6 +129,17 @@ void onCccd(uint16_t conn_hdl, BLECharacteristic *chr, uint16_t cccd_value)
         } else {
             LOG_INFO("fromNum 'Notify' disabled\n");
         }
+    } else if (chr->uuid == fromRadioStream.uuid) {
+        bool subscribed = chr->notifyEnabled(conn_hdl);
+        if (subscribed) {
+            // This client wants throughput: the biggest MTU and data length we configured (linkManager already keeps the
+            // connection interval short while it's busy)
+            BLEConnection *connection = Bluefruit.Connection(conn_hdl);
+            connection->requestMtuExchange(247); // the most BANDWIDTH_MAX gives us
+            connection->requestDataLengthUpdate();
+            linkManager->noteActivity();
+        }
+        fromRadioStreamer->onSubscribe(subscribed);
     }
 }
 
@@ -131,6 +188,7 @@ void onFromRadioAuthorize(uint16_t conn_hdl, BLECharacteristic *chr, ble_gatts_e
     if (request->offset == 0) {
         // If the read is long, we will get multiple authorize invocations - we only populate data on the first
         size_t numBytes = bluetoothPhoneAPI->getFromRadio(fromRadioBytes);
+        linkManager->noteActivity();
 
         // Someone is going to read our value as soon as this callback returns.  So fill it with the next message in the queue
         // or make empty if the queue is empty
@@ -144,8 +202,10 @@ void onFromRadioAuthorize(uint16_t conn_hdl, BLECharacteristic *chr, ble_gatts_e
 void onToRadioWrite(uint16_t conn_hdl, BLECharacteristic *chr, uint8_t *data, uint16_t len)
 {
     LOG_INFO("toRadioWriteCb data %p, len %u\n", data, len);
+    linkManager->noteActivity();
 
     bluetoothPhoneAPI->handleToRadio(data, len);
+    fromRadioStreamer->wake();
 }
 
 /**
@@ -161,6 +221,9 @@ void onFromNumAuthorize(uint16_t conn_hdl, BLECharacteristic *chr, ble_gatts_evt
 void setupMeshService(void)
 {
     bluetoothPhoneAPI = new BluetoothPhoneAPI();
+    fromRadioStreamer = new NRF52FromRadioStream(bluetoothPhoneAPI);
+    linkManager = new NRF52LinkManager(bluetoothPhoneAPI);
+    fromNumNotifier = new NRF52FromNumNotifier();
 
     meshBleService.begin();
 
@@ -200,6 +263,12 @@ void setupMeshService(void)
     // We don't call this callback via the adafruit queue, because we can safely run in the BLE context
     toRadio.setWriteCallback(onToRadioWrite, false);
     toRadio.begin();
+
+    fromRadioStream.setProperties(CHR_PROPS_NOTIFY);
+    fromRadioStream.setPermission(secMode, SECMODE_NO_ACCESS);
+    fromRadioStream.setMaxLen(FROMRADIO_STREAM_CHUNK_SIZE);
+    fromRadioStream.setCccdWriteCallback(onCccd);
+    fromRadioStream.begin();
 }
 
 // FIXME, turn off soft device access for debugging
@@ -2,13 +2,43 @@
 #include "aes-256/tiny-aes.h"
 #include "configuration.h"
 #include <Adafruit_nRFCrypto.h>
+
+/**
+ * AES128 runs on the CryptoCell-310.  The CC310 AES engine only takes 128 bit keys, so AES256 stays in software (tiny-aes),
+ * but with the key schedule expanded once per key slot rather than once per packet.
+ *
+ * Build with -DDEBUG_CRYPTO_TIMING to log how many microseconds each packet takes on either path.
+ */
 class NRF52CryptoEngine : public CryptoEngine
 {
+    /// Expanded software AES256 keys, one per key slot (the hardware AES128 path doesn't need any)
+    AES_ctx aes256[CRYPTO_KEY_SLOTS];
+
+    /// The CC310 session, opened on first use and then kept open (powering it up and down per packet costs more than the
+    /// encryption itself)
+    nRFCrypto_AES hwAes;
+    bool hwBegun = false;
+
+    /// Output buffer for the CC310, which always writes whole blocks
+    uint8_t hwBuf[MAX_BLOCKSIZE];
+
+#ifdef DEBUG_CRYPTO_TIMING
+    uint32_t timedPackets[2] = {}, timedMicros[2] = {}; // [0] software AES256, [1] hardware AES128
+#endif
+
   public:
     NRF52CryptoEngine() {}
 
     ~NRF52CryptoEngine() {}
 
+    virtual void setKey(const CryptoKey &k) override
+    {
+        CryptoEngine::setKey(k);
+
+        if (key.length > 16)
+            AES_init_ctx(&aes256[activeSlot], key.bytes);
+    }
+
     /**
      * Encrypt a packet
      *
@@ -16,25 +46,41 @@ class NRF52CryptoEngine : public CryptoEngine
      */
     virtual void encrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes) override
     {
+#ifdef DEBUG_CRYPTO_TIMING
+        uint32_t start = micros();
+#endif
+        if (numBytes > MAX_BLOCKSIZE) {
+            LOG_ERROR("Packet too large for crypto engine: %d. noop encryption!\n", numBytes);
+            return;
+        }
+
         if (key.length > 16) {
             LOG_DEBUG("Software encrypt fr=%x, num=%x, numBytes=%d!\n", fromNode, (uint32_t)packetId, numBytes);
-            AES_ctx ctx;
+            AES_ctx &ctx = aes256[activeSlot];
             initNonce(fromNode, packetId);
-            AES_init_ctx_iv(&ctx, key.bytes, nonce);
+            AES_ctx_set_iv(&ctx, nonce);
             AES_CTR_xcrypt_buffer(&ctx, bytes, numBytes);
         } else if (key.length > 0) {
             LOG_DEBUG("nRF52 encrypt fr=%x, num=%x, numBytes=%d!\n", fromNode, (uint32_t)packetId, numBytes);
-            nRFCrypto.begin();
-            nRFCrypto_AES ctx;
-            uint8_t myLen = ctx.blockLen(numBytes);
-            char encBuf[myLen] = {0};
+            if (!hwBegun) {
+                nRFCrypto.begin();
+                hwAes.begin();
+                hwBegun = true;
+            }
             initNonce(fromNode, packetId);
-            ctx.begin();
-            ctx.Process((char *)bytes, numBytes, nonce, key.bytes, key.length, encBuf, ctx.encryptFlag, ctx.ctrMode);
-            ctx.end();
-            nRFCrypto.end();
-            memcpy(bytes, encBuf, numBytes);
+            hwAes.Process((char *)bytes, numBytes, nonce, key.bytes, key.length, (char *)hwBuf, hwAes.encryptFlag, hwAes.ctrMode);
+            memcpy(bytes, hwBuf, numBytes);
+        }
+#ifdef DEBUG_CRYPTO_TIMING
+        if (key.length > 0) {
+            int path = (key.length > 16) ? 0 : 1;
+            timedPackets[path]++;
+            timedMicros[path] += micros() - start;
+            LOG_DEBUG("crypto timing: sw AES256 %u packets %u us avg, hw AES128 %u packets %u us avg\n", timedPackets[0],
+                      timedPackets[0] ? timedMicros[0] / timedPackets[0] : 0, timedPackets[1],
+                      timedPackets[1] ? timedMicros[1] / timedPackets[1] : 0);
         }
+#endif
     }
 
     virtual void decrypt(uint32_t fromNode, uint64_t packetId, size_t numBytes, uint8_t *bytes) override
@@ -8,6 +8,8 @@
 #include <memory.h>
 #include <stdio.h>
 // #include <Adafruit_USBD_Device.h>
+#include "BootTimeline.h"
+#include "EnergyStats.h"
 #include "NodeDB.h"
 #include "error.h"
 #include "main.h"
@@ -76,6 +78,7 @@ void setBluetoothEnable(bool on)
                 else {
                     nrf52Bluetooth = new NRF52Bluetooth();
                     nrf52Bluetooth->setup();
+                    BOOT_MILESTONE("bluetooth");
 
                     // We delay brownout init until after BLE because BLE starts soft device
                     initBrownout();
@@ -85,6 +88,7 @@ void setBluetoothEnable(bool on)
             nrf52Bluetooth->shutdown();
         }
         bleOn = on;
+        energyStats.setOn(EnergyStats::BLUETOOTH, on && nrf52Bluetooth);
     }
 }
 
@@ -0,0 +1,401 @@
+#include "Benchmark.h"
+#include "Channels.h"
+#include "CryptoEngine.h"
+#include "FSCommon.h"
+#include "MeshModule.h"
+#include "MeshPacketQueue.h"
+#include "NodeDB.h"
+#include "PacketHistory.h"
+#include "RadioInterface.h"
+#include "Router.h"
+#include "configuration.h"
+#include "mqtt/JSON.h"
+#include "mqtt/JSONReader.h"
+#include "mqtt/JSONWriter.h"
+
+extern "C" {
+#include "mesh/compression/unishox2.h"
+}
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+bool benchmarkMode;
+
+static std::atomic<uint64_t> numAllocs;
+
+#if PORTDUINO_COUNT_ALLOCS && defined(__GLIBC__)
+// Count every heap allocation (operator new ends up here too) by standing in front of glibc's allocator
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t num, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    numAllocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t num, size_t size)
+{
+    numAllocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(num, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    numAllocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+uint64_t getBenchmarkAllocs()
+{
+    return numAllocs.load(std::memory_order_relaxed);
+}
+
+/// Run fn(i) for i in [0, ops) and print how long that took and how much it allocated
+template <typename F> static void bench(const char *name, uint32_t ops, F fn)
+{
+    uint64_t allocsBefore = numAllocs.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < ops; i++)
+        fn(i);
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocs = numAllocs.load(std::memory_order_relaxed) - allocsBefore;
+
+    printf("%-40s %9u ops %10.1f ns/op %12.0f ops/s %7.2f allocs/op\n", name, ops, ns / ops, ops / (ns / 1e9),
+           (double)allocs / ops);
+}
+
+/// A synthetic outgoing packet, as it would sit in our TX queue
+static WirePacket *makeWirePacket(NodeNum from, PacketId id, uint8_t priority)
+{
+    const uint8_t size = 32;
+    WirePacket *w = WirePacket::alloc(size);
+    memset(w, 0, sizeof(WirePacket) + size);
+    w->header.from = from;
+    w->header.to = NODENUM_BROADCAST;
+    w->header.id = id;
+    w->priority = priority;
+    w->size = size;
+    return w;
+}
+
+/// A decoded broadcast from us, the way a phone would hand it to the Router
+static meshtastic_MeshPacket makeTextPacket(PacketId id, const char *text)
+{
+    meshtastic_MeshPacket p = meshtastic_MeshPacket_init_default;
+    p.from = nodeDB.getNodeNum();
+    p.to = NODENUM_BROADCAST;
+    p.id = id;
+    p.channel = channels.getPrimaryIndex();
+    p.hop_limit = HOP_RELIABLE;
+    p.which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+    p.decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    p.decoded.payload.size = strlen(text);
+    memcpy(p.decoded.payload.bytes, text, p.decoded.payload.size);
+    return p;
+}
+
+static const char *sampleText = "Heading back to the trailhead now, should be at the car park by 5pm. Anyone need anything?";
+
+static void benchPacketHistory()
+{
+    static PacketHistory history; // big, keep it off the stack
+
+    bench("PacketHistory::wasSeenRecently (new)", 1000000, [](uint32_t i) { history.wasSeenRecently(0x1000 + (i & 63), i + 1); });
+
+    // The same 128 packets over and over, as while a flood echoes around us
+    bench("PacketHistory::wasSeenRecently (seen)", 1000000,
+          [](uint32_t i) { history.wasSeenRecently(0x2000 + (i & 7), (i & 127) + 1); });
+}
+
+static void benchMeshPacketQueue()
+{
+    MeshPacketQueue queue(MAX_TX_QUEUE);
+
+    // Keep the queue half full so each enqueue has to find its place among others
+    for (uint32_t i = 0; i < MAX_TX_QUEUE / 2; i++)
+        queue.enqueue(makeWirePacket(0x1000, 1000000 + i, meshtastic_MeshPacket_Priority_DEFAULT));
+
+    static const uint8_t priorities[] = {meshtastic_MeshPacket_Priority_BACKGROUND, meshtastic_MeshPacket_Priority_DEFAULT,
+                                         meshtastic_MeshPacket_Priority_RELIABLE, meshtastic_MeshPacket_Priority_ACK};
+    bench("MeshPacketQueue enqueue+dequeue", 1000000, [&](uint32_t i) {
+        queue.enqueue(makeWirePacket(0x1000, i + 1, priorities[i & 3]));
+        WirePacket::release(queue.dequeue());
+    });
+
+    bench("MeshPacketQueue enqueue+remove", 1000000, [&](uint32_t i) {
+        queue.enqueue(makeWirePacket(0x2000, i + 1, priorities[i & 3]));
+        WirePacket::release(queue.remove(0x2000, i + 1));
+    });
+
+    WirePacket *p;
+    while ((p = queue.dequeue()) != NULL)
+        WirePacket::release(p);
+}
+
+static void benchNodeDB()
+{
+    size_t numNodes = nodeDB.getNumMeshNodes();
+    printf("(NodeDB has %u nodes)\n", (unsigned)numNodes);
+
+    bench("NodeDB::getMeshNode (known)", 1000000,
+          [&](uint32_t i) { nodeDB.getMeshNode(nodeDB.getMeshNodeByIndex(i % numNodes)->num); });
+    bench("NodeDB::getMeshNode (unknown)", 1000000, [](uint32_t i) { nodeDB.getMeshNode(0x7f000000 + i); });
+}
+
+static void benchProtoFiles()
+{
+    // Our biggest prefs files, through the same buffered streams NodeDB uses for them (in a file of our own)
+    static const char *benchFileName = "/prefs/bench.proto";
+    static meshtastic_LocalModuleConfig scratch;
+
+    bench("NodeDB::saveProto (module config)", 1000, [](uint32_t i) {
+        nodeDB.saveProto(benchFileName, meshtastic_LocalModuleConfig_size, &meshtastic_LocalModuleConfig_msg, &moduleConfig);
+    });
+    bench("NodeDB::loadProto (module config)", 1000, [](uint32_t i) {
+        nodeDB.loadProto(benchFileName, meshtastic_LocalModuleConfig_size, sizeof(scratch), &meshtastic_LocalModuleConfig_msg,
+                         &scratch);
+    });
+    FSCom.remove("/prefs/bench.proto.a"); // its two slots
+    FSCom.remove("/prefs/bench.proto.b");
+}
+
+static void benchEncodeDecode()
+{
+    const meshtastic_MeshPacket plain = makeTextPacket(1, sampleText);
+
+    bench("perhapsEncode (primary channel)", 100000, [&](uint32_t i) {
+        meshtastic_MeshPacket p = plain;
+        p.id = i + 1;
+        perhapsEncode(&p);
+    });
+
+    meshtastic_MeshPacket encrypted = plain;
+    if (perhapsEncode(&encrypted) != meshtastic_Routing_Error_NONE) {
+        printf("perhapsEncode failed, skipping perhapsDecode\n");
+        return;
+    }
+
+    bench("perhapsDecode (primary channel)", 100000, [&](uint32_t i) {
+        meshtastic_MeshPacket p = encrypted;
+        perhapsDecode(&p);
+    });
+
+    bench("perhapsDecode (no matching channel)", 100000, [&](uint32_t i) {
+        meshtastic_MeshPacket p = encrypted;
+        p.channel ^= 0x55; // a hash none of our channels have, so we give up without trying to decrypt
+        perhapsDecode(&p);
+    });
+}
+
+static void benchCrypto()
+{
+    // Each key length picks a different engine path: no crypto, AES128 and AES256
+    static const int8_t keyLengths[] = {0, 16, 32};
+    static const char *names[] = {"CryptoEngine encrypt 200B (no key)", "CryptoEngine encrypt 200B (AES128)",
+                                  "CryptoEngine encrypt 200B (AES256)"};
+
+    uint8_t buf[200];
+    memset(buf, 0xa5, sizeof(buf));
+    for (uint8_t k = 0; k < sizeof(keyLengths); k++) {
+        CryptoKey key;
+        memset(key.bytes, 0x42, sizeof(key.bytes));
+        key.length = keyLengths[k];
+        crypto->setKey(key);
+
+        bench(names[k], 100000, [&](uint32_t i) { crypto->encrypt(nodeDB.getNodeNum(), i, sizeof(buf), buf); });
+    }
+
+#if CRYPTO_KEYSTREAM_AHEAD
+    // Working out our own packets' keystream ahead of time (AES256 still set from above), which leaves just an XOR to send
+    // them, and which has to come out as encrypt() would
+    uint8_t plain[CRYPTO_KEYSTREAM_BYTES], viaEncrypt[CRYPTO_KEYSTREAM_BYTES];
+    for (size_t i = 0; i < sizeof(plain); i++)
+        plain[i] = i * 7;
+    memcpy(viaEncrypt, plain, sizeof(plain));
+    crypto->encrypt(nodeDB.getNodeNum(), 1234, sizeof(viaEncrypt), viaEncrypt);
+    crypto->precomputeKeystream(nodeDB.getNodeNum(), 1234);
+    if (!crypto->encryptPrecomputed(nodeDB.getNodeNum(), 1234, sizeof(plain), plain) || memcmp(plain, viaEncrypt, sizeof(plain)))
+        printf("CryptoEngine precomputed keystream FAILED to match encrypt()\n");
+    bench("CryptoEngine precomputeKeystream (AES256)", 100000,
+          [&](uint32_t i) { crypto->precomputeKeystream(nodeDB.getNodeNum(), i); });
+#endif
+
+    // The bulk path, a batch of packets at a time (each op is the whole batch)
+    static const size_t batchSize = 16;
+    static uint8_t bufs[batchSize][200];
+    CryptoJob jobs[batchSize];
+    for (size_t j = 0; j < batchSize; j++) {
+        memset(bufs[j], 0xa5, sizeof(bufs[j]));
+        jobs[j] = {nodeDB.getNodeNum(), 0, sizeof(bufs[j]), bufs[j]};
+    }
+    static const char *batchNames[] = {"CryptoEngine encryptBatch 16x200B (no key)", "CryptoEngine encryptBatch 16x200B (AES128)",
+                                       "CryptoEngine encryptBatch 16x200B (AES256)"};
+    for (uint8_t k = 0; k < sizeof(keyLengths); k++) {
+        CryptoKey key;
+        memset(key.bytes, 0x42, sizeof(key.bytes));
+        key.length = keyLengths[k];
+        crypto->setKey(key);
+
+        bench(batchNames[k], 100000 / batchSize, [&](uint32_t i) {
+            for (size_t j = 0; j < batchSize; j++)
+                jobs[j].packetId = i * batchSize + j;
+            crypto->encryptBatch(jobs, batchSize);
+        });
+    }
+}
+
+/// Text messages like the ones our meshes carry, for the compression ratio and per byte costs
+static const char *const messageCorpus[] = {
+    "Heading back to the trailhead now, should be at the car park by 5pm. Anyone need anything?",
+    "ok",
+    "Copy that",
+    "Is anyone on the mesh tonight? Testing from the ridge with a new antenna.",
+    "Check in: all good at base camp, 3 of us, water at 40%",
+    "https://meshtastic.org/docs/getting-started",
+    "LOL \xf0\x9f\x98\x82 see you there",
+    "Temp\xc3\xa9rature 21\xc2\xb0" "C, humidit\xc3\xa9 45%",
+    "2023-09-14T18:22:05.000Z position update",
+    "Call me at (555) 123-4567 when you get this",
+    "N47.3977 E008.5456 alt 408m",
+    "ALERT: STORM WARNING FOR THE VALLEY",
+    "The quick brown fox jumps over the lazy dog",
+};
+
+static void benchUnishox()
+{
+    int len = strlen(sampleText);
+    char compressed[256], decompressed[256];
+    int compressedLen = unishox2_compress_simple(sampleText, len, compressed);
+    printf("(unishox2 sample %d -> %d bytes)\n", len, compressedLen);
+
+    bench("unishox2_compress_simple", 100000, [&](uint32_t i) { unishox2_compress_simple(sampleText, len, compressed); });
+    bench("unishox2_decompress_simple", 100000,
+          [&](uint32_t i) { unishox2_decompress_simple(compressed, compressedLen, decompressed); });
+
+    // The whole corpus, per byte of text, checking each message comes back as it was
+    const size_t numMessages = sizeof(messageCorpus) / sizeof(messageCorpus[0]);
+    uint32_t textBytes = 0, compressedBytes = 0;
+    for (size_t m = 0; m < numMessages; m++) {
+        int textLen = strlen(messageCorpus[m]);
+        int n = unishox2_compress_simple(messageCorpus[m], textLen, compressed);
+        if (unishox2_decompress_simple(compressed, n, decompressed) != textLen ||
+            memcmp(decompressed, messageCorpus[m], textLen) != 0)
+            printf("unishox2 round trip FAILED for \"%s\"\n", messageCorpus[m]);
+        textBytes += textLen;
+        compressedBytes += n;
+    }
+    const uint32_t rounds = 10000;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++)
+        for (size_t m = 0; m < numMessages; m++)
+            unishox2_compress_simple(messageCorpus[m], strlen(messageCorpus[m]), compressed);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-40s %9.2f ns/byte %8.3f ratio (%u messages, %u -> %u bytes)\n", "unishox2_compress_simple corpus",
+           ns / rounds / textBytes, (double)compressedBytes / textBytes, (unsigned)numMessages, textBytes, compressedBytes);
+}
+
+/// An uplinked telemetry message, as MQTT::meshPacketToJson() writes one
+static const char *sampleJson = "{\"id\":1234567,\"channel\":0,\"from\":305419896,\"to\":4294967295,\"timestamp\":1700000000,"
+                                "\"type\":\"telemetry\",\"payload\":{\"battery_level\":87,\"voltage\":4.05,"
+                                "\"channel_utilization\":12.5,\"air_util_tx\":1.75},\"sender\":\"!12345678\"}";
+
+static bool countJsonValue(const JSONReader::Event &e, void *context)
+{
+    (*(uint32_t *)context)++;
+    return true;
+}
+
+static void benchJSON()
+{
+    // Writing the same message with JSONWriter (what MQTT uplinks with) and as a JSONValue tree (what it did before)
+    static char buf[512];
+    bench("JSONWriter telemetry", 100000, [&](uint32_t i) {
+        JSONWriter w(buf, sizeof(buf));
+        w.beginObject();
+        w.field("id", i);
+        w.field("channel", (uint32_t)0);
+        w.field("from", (uint32_t)0x12345678);
+        w.field("to", (uint32_t)NODENUM_BROADCAST);
+        w.field("timestamp", (uint32_t)1700000000);
+        w.field("type", "telemetry");
+        w.key("payload");
+        w.beginObject();
+        w.field("battery_level", (uint32_t)87);
+        w.field("voltage", 4.05f);
+        w.field("channel_utilization", 12.5f);
+        w.field("air_util_tx", 1.75f);
+        w.endObject();
+        w.field("sender", "!12345678");
+        w.endObject();
+    });
+
+    bench("JSONValue telemetry", 100000, [&](uint32_t i) {
+        JSONObject payload;
+        payload["battery_level"] = new JSONValue((uint)87);
+        payload["voltage"] = new JSONValue(4.05);
+        payload["channel_utilization"] = new JSONValue(12.5);
+        payload["air_util_tx"] = new JSONValue(1.75);
+        JSONObject msg;
+        msg["id"] = new JSONValue((uint)i);
+        msg["channel"] = new JSONValue((uint)0);
+        msg["from"] = new JSONValue((uint)0x12345678);
+        msg["to"] = new JSONValue((uint)NODENUM_BROADCAST);
+        msg["timestamp"] = new JSONValue((uint)1700000000);
+        msg["type"] = new JSONValue("telemetry");
+        msg["payload"] = new JSONValue(payload);
+        msg["sender"] = new JSONValue("!12345678");
+        JSONValue *value = new JSONValue(msg);
+        std::string json = value->Stringify();
+        strncpy(buf, json.c_str(), sizeof(buf) - 1);
+        delete value;
+    });
+
+    // And reading it back, as a downlink would be.  JSONReader unescapes in place, so it gets a fresh copy each time
+    uint32_t numValues = 0;
+    bench("JSONReader::parse telemetry", 100000, [&](uint32_t i) {
+        strcpy(buf, sampleJson);
+        JSONReader::parse(buf, countJsonValue, &numValues);
+    });
+
+    bench("JSON::Parse telemetry", 100000, [&](uint32_t i) { delete JSON::Parse(sampleJson); });
+}
+
+static void benchCallPlugins()
+{
+    // A port no module claims, so we time the dispatch itself rather than some module's work
+    meshtastic_MeshPacket plain = makeTextPacket(1, "x");
+    plain.decoded.portnum = meshtastic_PortNum_PRIVATE_APP;
+
+    // From packetPool as the Router's would be, modules may share it
+    bench("MeshModule::callPlugins", 100000, [&](uint32_t i) {
+        meshtastic_MeshPacket *p = packetPool.allocCopy(plain);
+        p->id = i + 1;
+        MeshModule::callPlugins(*p, RX_SRC_RADIO);
+        packetPool.release(p);
+    });
+}
+
+void runBenchmarks()
+{
+    printf("Running packet path benchmarks\n");
+
+    benchPacketHistory();
+    benchMeshPacketQueue();
+    benchNodeDB();
+    benchProtoFiles();
+    benchEncodeDecode();
+    benchUnishox();
+    benchJSON();
+    benchCallPlugins();
+    benchCrypto(); // last, it leaves junk keys installed
+
+    printf("Benchmarks done\n");
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Count heap allocations for the benchmarks by replacing malloc(), calloc() and realloc() for the whole program (glibc only).
+/// On in the native-benchmark env and in unit test builds, never in the daemon we ship
+#ifndef PORTDUINO_COUNT_ALLOCS
+#ifdef PIO_UNIT_TESTING
+#define PORTDUINO_COUNT_ALLOCS 1
+#else
+#define PORTDUINO_COUNT_ALLOCS 0
+#endif
+#endif
+
+/// Set by the --benchmark command line option
+extern bool benchmarkMode;
+
+/**
+ * Time the packet path's hot spots (packet history, TX queue, NodeDB lookups, encode/decode and crypto, compression, MQTT's
+ * JSON and module dispatch) with synthetic traffic, and saving and loading our prefs files, printing ns/op, ops/sec and heap
+ * allocations per op for each.  Run once setup() is done, as it uses the real nodeDB, channels and modules.
+ */
+void runBenchmarks();
+
+/// How many heap allocations we've made so far (with PORTDUINO_COUNT_ALLOCS on glibc; 0 elsewhere)
+uint64_t getBenchmarkAllocs();
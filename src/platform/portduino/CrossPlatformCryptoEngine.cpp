@@ -8,12 +8,17 @@
 class CrossPlatformCryptoEngine : public CryptoEngine
 {
 
-    CTRCommon *ctr = NULL;
+    /// One cipher per key slot, so switching channels doesn't reallocate and rekey
+    CTRCommon *ctrs[CRYPTO_KEY_SLOTS] = {};
 
   public:
     CrossPlatformCryptoEngine() {}
 
-    ~CrossPlatformCryptoEngine() {}
+    ~CrossPlatformCryptoEngine()
+    {
+        for (int i = 0; i < CRYPTO_KEY_SLOTS; i++)
+            delete ctrs[i];
+    }
 
     /**
      * Set the key used for encrypt, decrypt.
@@ -28,6 +33,7 @@ class CrossPlatformCryptoEngine : public CryptoEngine
     {
         CryptoEngine::setKey(k);
         LOG_DEBUG("Installing AES%d key!\n", key.length * 8);
+        CTRCommon *&ctr = ctrs[activeSlot];
         if (ctr) {
             delete ctr;
             ctr = NULL;
@@ -57,6 +63,7 @@ class CrossPlatformCryptoEngine : public CryptoEngine
                 memset(scratch + numBytes, 0,
                        sizeof(scratch) - numBytes); // Fill rest of buffer with zero (in case cypher looks at it)
 
+                CTRCommon *ctr = ctrs[activeSlot];
                 ctr->setIV(nonce, sizeof(nonce));
                 ctr->setCounterSize(4);
                 ctr->encrypt(bytes, scratch, numBytes);
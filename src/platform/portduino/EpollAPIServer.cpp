@@ -0,0 +1,237 @@
+#include "EpollAPIServer.h"
+
+#if PORTDUINO_GATEWAY
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static EpollAPIServer *apiServer;
+
+void initGatewayApiServer(int port)
+{
+    if (!apiServer) {
+        apiServer = new EpollAPIServer();
+        if (apiServer->init(port))
+            LOG_INFO("API server listening on TCP port %d (epoll, up to %d clients)\n", port, EPOLL_API_MAX_CLIENTS);
+    }
+}
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+void SocketStream::close()
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    pending.clear();
+}
+
+void SocketStream::fill()
+{
+    if (rxStart != rxEnd || !readable || fd < 0)
+        return;
+    rxStart = rxEnd = 0;
+    ssize_t n = recv(fd, rxBuf, sizeof(rxBuf), 0);
+    if (n > 0)
+        rxEnd = n;
+    else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        close(); // they hung up, or the connection broke
+    else
+        readable = false; // nothing more until epoll says so
+}
+
+int SocketStream::available()
+{
+    fill();
+    return rxEnd - rxStart;
+}
+
+int SocketStream::read()
+{
+    fill();
+    return rxStart != rxEnd ? rxBuf[rxStart++] : -1;
+}
+
+int SocketStream::peek()
+{
+    fill();
+    return rxStart != rxEnd ? rxBuf[rxStart] : -1;
+}
+
+size_t SocketStream::write(const uint8_t *buf, size_t len)
+{
+    if (fd < 0)
+        return 0;
+    flush(); // what's already waiting goes first
+    size_t sent = 0;
+    if (pending.empty()) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            close();
+            return 0;
+        }
+        sent = n > 0 ? n : 0;
+    }
+    if (sent < len) {
+        if (pending.size() + len - sent > EPOLL_API_MAX_PENDING) {
+            LOG_WARN("API client isn't reading what we send it, dropping it\n");
+            close();
+            return 0;
+        }
+        pending.append((const char *)buf + sent, len - sent);
+    }
+    return len;
+}
+
+void SocketStream::flush()
+{
+    while (fd >= 0 && !pending.empty()) {
+        ssize_t n = send(fd, pending.data(), pending.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            pending.erase(0, n);
+        } else {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                close();
+            return; // the socket's full, we'll try again next pass
+        }
+    }
+}
+
+bool EpollAPIServer::init(int port)
+{
+    listenFd = socket(AF_INET6, SOCK_STREAM, 0);
+    int on = 1, off = 0;
+    sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+        setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) || // IPv4 clients too
+        bind(listenFd, (sockaddr *)&addr, sizeof(addr)) || listen(listenFd, SOMAXCONN) || !setNonBlocking(listenFd)) {
+        LOG_ERROR("Can't listen on TCP port %d: %s\n", port, strerror(errno));
+        return false;
+    }
+
+    epollFd = epoll_create1(0);
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listenFd;
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev)) {
+        LOG_ERROR("Can't start epoll: %s\n", strerror(errno));
+        return false;
+    }
+
+    std::thread(&EpollAPIServer::watch, this).detach();
+    notify(1, true); // take any connections which beat the watcher to it
+    return true;
+}
+
+void EpollAPIServer::watch()
+{
+    epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(epollFd, events, sizeof(events) / sizeof(events[0]), -1);
+        if (n <= 0)
+            continue; // EINTR
+        {
+            std::lock_guard<std::mutex> guard(readyLock);
+            for (int i = 0; i < n; i++)
+                ready.push_back(events[i].data.fd);
+        }
+        notify(1, true); // wakes the main loop
+    }
+}
+
+void EpollAPIServer::acceptAll()
+{
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0)
+            return; // EAGAIN, we've taken them all
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // our writes are already batched
+        if (!setNonBlocking(fd)) {
+            ::close(fd);
+            continue;
+        }
+
+        if (clients.size() >= EPOLL_API_MAX_CLIENTS) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < clients.size(); i++)
+                if (millis() - clients[i]->getLastContact() > millis() - clients[oldest]->getLastContact())
+                    oldest = i;
+            LOG_INFO("Already serving %d TCP clients, closing the one we heard from longest ago\n", EPOLL_API_MAX_CLIENTS);
+            drop(oldest);
+        }
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev)) {
+            ::close(fd);
+            continue;
+        }
+        clients.push_back(new EpollAPIClient(fd));
+        LOG_INFO("Incoming API connection, %u clients\n", (unsigned)clients.size());
+    }
+}
+
+void EpollAPIServer::drop(size_t i)
+{
+    EpollAPIClient *c = clients[i];
+    if (c->socket.isOpen())
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, c->socket.getFd(), NULL);
+    delete c; // closes its socket
+    clients[i] = clients.back();
+    clients.pop_back();
+}
+
+int32_t EpollAPIServer::runOnce()
+{
+    checkNotification();
+
+    std::vector<int> woken;
+    {
+        std::lock_guard<std::mutex> guard(readyLock);
+        woken.swap(ready);
+    }
+    for (int fd : woken) {
+        if (fd == listenFd) {
+            acceptAll();
+            continue;
+        }
+        for (EpollAPIClient *c : clients)
+            if (c->socket.getFd() == fd)
+                c->socket.readable = true;
+    }
+
+    // Everyone gets to send what's waiting for them, only those epoll woke us for have anything to read
+    for (size_t i = 0; i < clients.size();) {
+        EpollAPIClient *c = clients[i];
+        c->runOncePart();
+        c->socket.flush();
+        if (!c->socket.isOpen()) {
+            LOG_INFO("API client dropped connection, %u clients left\n", (unsigned)clients.size() - 1);
+            drop(i);
+        } else {
+            i++;
+        }
+    }
+
+    return EPOLL_API_POLL_MSEC;
+}
+
+#endif
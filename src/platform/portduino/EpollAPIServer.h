@@ -0,0 +1,117 @@
+#pragma once
+
+#include "configuration.h"
+
+#if PORTDUINO_GATEWAY
+
+#include "StreamAPI.h"
+#include "concurrency/NotifiedWorkerThread.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// How many TCP API clients we serve at once.  When one more connects, the one we heard from longest ago makes room for it
+#ifndef EPOLL_API_MAX_CLIENTS
+#define EPOLL_API_MAX_CLIENTS 256
+#endif
+
+/// What we hold for a client which isn't reading what we send it, before we give up on it
+#ifndef EPOLL_API_MAX_PENDING
+#define EPOLL_API_MAX_PENDING (64 * 1024)
+#endif
+
+/// How often every client gets to send what's waiting for it, when none of their sockets has woken us
+#ifndef EPOLL_API_POLL_MSEC
+#define EPOLL_API_POLL_MSEC 20
+#endif
+
+/// A Stream over a nonblocking socket.  What the socket won't take yet waits in pending, and is sent by flush()
+class SocketStream : public Stream
+{
+  public:
+    explicit SocketStream(int _fd) : fd(_fd) {}
+    ~SocketStream() { close(); }
+
+    virtual int available() override;
+    virtual int read() override;
+    virtual int peek() override;
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+    virtual size_t write(const uint8_t *buf, size_t len) override;
+    virtual void flush() override;
+
+    bool isOpen() const { return fd >= 0; }
+    int getFd() const { return fd; }
+    void close();
+
+    /// epoll says there's something to read, until recv() says there isn't we try it whenever we're asked
+    bool readable = true;
+
+  private:
+    int fd;
+    uint8_t rxBuf[256];
+    size_t rxStart = 0, rxEnd = 0;
+    std::string pending;
+
+    /// recv() what's waiting into rxBuf, if it's empty
+    void fill();
+};
+
+/// One client of our API, run by EpollAPIServer rather than by a thread of its own
+class EpollAPIClient : public StreamAPI
+{
+  public:
+    explicit EpollAPIClient(int fd) : StreamAPI(&socket), socket(fd) {}
+
+    SocketStream socket;
+
+    uint32_t getLastContact() const { return lastContactMsec; }
+
+    /// Also hang up on our client
+    virtual void close() override
+    {
+        socket.close();
+        StreamAPI::close();
+    }
+
+  protected:
+    /// Like ServerAPI, a TCP client doesn't keep us in the POWERED state
+    virtual void onConnectionChanged(bool connected) override {}
+
+    virtual bool checkIsConnected() override { return socket.isOpen(); }
+};
+
+/**
+ * Serves the TCP API to up to EPOLL_API_MAX_CLIENTS clients from one thread on the main loop, with the mesh single threaded
+ * as ever.  A watcher thread waits in epoll_wait() for any of their sockets (and our listening one) and wakes the main loop
+ * straight away, so a client's ToRadio is handled as soon as it arrives rather than when its thread next polls, and clients
+ * which aren't talking to us cost no syscalls.
+ */
+class EpollAPIServer : public concurrency::NotifiedWorkerThread
+{
+  public:
+    EpollAPIServer() : concurrency::NotifiedWorkerThread("ApiServer") {}
+
+    /// Listen on port, @return false if we can't
+    bool init(int port);
+
+  protected:
+    virtual int32_t runOnce() override;
+    virtual void onNotify(uint32_t notification) override {}
+
+  private:
+    int listenFd = -1, epollFd = -1;
+    std::vector<EpollAPIClient *> clients;
+
+    /// The fds epoll has told the watcher about since we last looked, guarded by readyLock
+    std::vector<int> ready;
+    std::mutex readyLock;
+
+    void watch();
+    void acceptAll();
+    void drop(size_t i);
+};
+
+/// Start our API server on port, in place of initApiServer()'s
+void initGatewayApiServer(int port);
+
+#endif
@@ -0,0 +1,238 @@
+#include "LoadGenerator.h"
+#include "Channels.h"
+#include "MeshService.h"
+#include "Metrics.h"
+#include "NodeDB.h"
+#include "Router.h"
+#include "configuration.h"
+#include "gps/RTC.h"
+#include "mesh-pb-constants.h"
+#include "mesh/generated/meshtastic/telemetry.pb.h"
+#include "mqtt/MQTT.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool loadGeneratorMode;
+LoadGenerator::Spec loadGeneratorSpec;
+
+static const char *kindNames[LoadGenerator::NUM_KINDS] = {"nodeinfo", "position", "telemetry", "text"};
+
+/// Our virtual nodes are numbered from here, well clear of anything a real node picks for itself in a test
+#define LOAD_FIRST_NODE 0x4c000000
+
+bool LoadGenerator::parseSpec(const char *s, Spec &spec)
+{
+    bool anyWeight = false;
+    while (s && *s) {
+        char key[16];
+        unsigned value;
+        int used = 0;
+        if (sscanf(s, "%15[a-z]=%u%n", key, &value, &used) != 2)
+            return false;
+
+        uint32_t *weight = NULL;
+        for (uint8_t k = 0; k < NUM_KINDS; k++)
+            if (strcmp(key, kindNames[k]) == 0)
+                weight = &spec.weights[k];
+
+        if (weight) {
+            if (!anyWeight) // naming any of the mix replaces our default mix
+                memset(spec.weights, 0, sizeof(spec.weights));
+            anyWeight = true;
+            *weight = value;
+        } else if (strcmp(key, "rate") == 0 && value) {
+            spec.rate = value;
+        } else if (strcmp(key, "nodes") == 0 && value) {
+            spec.nodes = value;
+        } else if (strcmp(key, "secs") == 0) {
+            spec.secs = value;
+        } else if (strcmp(key, "dups") == 0 && value <= 100) {
+            spec.dupPercent = value;
+        } else {
+            return false;
+        }
+
+        s += used;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return false;
+    }
+    return !anyWeight || spec.weights[NODEINFO] + spec.weights[POSITION] + spec.weights[TELEMETRY] + spec.weights[TEXT];
+}
+
+LoadGenerator::LoadGenerator(const Spec &_spec) : concurrency::OSThread("LoadGenerator"), spec(_spec)
+{
+    for (uint8_t k = 0; k < NUM_KINDS; k++)
+        totalWeight += spec.weights[k];
+
+    for (uint8_t i = 0; i < RadioStats::NUM_ERRORS; i++)
+        startErrors[i] = radioStats.getErrorCount((RadioStats::Error)i);
+    startFiltered = metrics.get(Metrics::RX_DUPLICATE);
+    startToPhoneDropped = metrics.get(Metrics::TOPHONE_DROPPED);
+    startNodes = nodeDB.getNumMeshNodes();
+    if (mqtt) {
+        startMqttUplinked = mqtt->getUplinkPolicy().getCount(MQTTUplinkPolicy::UPLINK);
+        startMqttDropped = mqtt->getOutbox().getNumDropped();
+    }
+
+    startMsec = lastReportMsec = millis();
+    LOG_INFO("Load generator: %u packets/s from %u nodes for %us, %u%% duplicates, mix nodeinfo=%u position=%u telemetry=%u "
+             "text=%u\n",
+             spec.rate, spec.nodes, spec.secs, spec.dupPercent, spec.weights[NODEINFO], spec.weights[POSITION],
+             spec.weights[TELEMETRY], spec.weights[TEXT]);
+}
+
+int32_t LoadGenerator::runOnce()
+{
+    uint32_t now = millis();
+    bool done = spec.secs && now - startMsec >= spec.secs * 1000;
+
+    // However many we are behind, by the rate we were asked for
+    uint64_t due = (uint64_t)(now - startMsec) * spec.rate;
+    for (uint32_t n = 0; !done && injectedPerMille + 1000 <= due && n < LOAD_MAX_BURST; n++) {
+        injectOne();
+        injectedPerMille += 1000;
+    }
+    if (due > injectedPerMille + LOAD_MAX_BURST * 1000)
+        injectedPerMille = due - LOAD_MAX_BURST * 1000; // we fell too far behind, don't try to catch all of it up
+
+    if (done || now - lastReportMsec >= LOAD_REPORT_SECS * 1000) {
+        lastReportMsec = now;
+        report(done);
+    }
+    if (done)
+        return disable();
+
+    uint32_t interval = 1000 / spec.rate;
+    return interval ? interval : 1;
+}
+
+LoadGenerator::Kind LoadGenerator::pickKind()
+{
+    uint32_t r = random(totalWeight);
+    uint8_t k = 0;
+    while (k < NUM_KINDS - 1 && r >= spec.weights[k])
+        r -= spec.weights[k++];
+    return (Kind)k;
+}
+
+void LoadGenerator::makePayload(meshtastic_MeshPacket &p, Kind kind, NodeNum from)
+{
+    uint32_t index = from - LOAD_FIRST_NODE;
+    meshtastic_Data &d = p.decoded;
+    p.which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+
+    switch (kind) {
+    case NODEINFO: {
+        meshtastic_User u = meshtastic_User_init_default;
+        snprintf(u.id, sizeof(u.id), "!%08x", from);
+        snprintf(u.long_name, sizeof(u.long_name), "Load node %u", index);
+        snprintf(u.short_name, sizeof(u.short_name), "%04x", index & 0xffff);
+        u.hw_model = meshtastic_HardwareModel_PORTDUINO;
+        d.portnum = meshtastic_PortNum_NODEINFO_APP;
+        d.payload.size = pb_encode_to_bytes(d.payload.bytes, sizeof(d.payload.bytes), &meshtastic_User_msg, &u);
+        break;
+    }
+    case POSITION: {
+        // Spread around one spot, moving a little each time
+        meshtastic_Position pos = meshtastic_Position_init_default;
+        pos.latitude_i = 377700000 + (int32_t)(index % 1000) * 1000 + random(-500, 500);
+        pos.longitude_i = -1224000000 + (int32_t)(index / 1000) * 1000 + random(-500, 500);
+        pos.altitude = 10 + index % 100;
+        pos.time = getValidTime(RTCQualityFromNet);
+        d.portnum = meshtastic_PortNum_POSITION_APP;
+        d.payload.size = pb_encode_to_bytes(d.payload.bytes, sizeof(d.payload.bytes), &meshtastic_Position_msg, &pos);
+        break;
+    }
+    case TELEMETRY: {
+        meshtastic_Telemetry t = meshtastic_Telemetry_init_default;
+        t.time = getValidTime(RTCQualityFromNet);
+        t.which_variant = meshtastic_Telemetry_device_metrics_tag;
+        t.variant.device_metrics.battery_level = 50 + index % 50;
+        t.variant.device_metrics.voltage = 3.7f + (index % 50) / 100.0f;
+        t.variant.device_metrics.channel_utilization = random(0, 40);
+        t.variant.device_metrics.air_util_tx = random(0, 5);
+        d.portnum = meshtastic_PortNum_TELEMETRY_APP;
+        d.payload.size = pb_encode_to_bytes(d.payload.bytes, sizeof(d.payload.bytes), &meshtastic_Telemetry_msg, &t);
+        break;
+    }
+    default:
+        d.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+        d.payload.size = snprintf((char *)d.payload.bytes, sizeof(d.payload.bytes), "Load test message %u from node %u",
+                                  numInjected, index);
+        break;
+    }
+}
+
+void LoadGenerator::injectOne()
+{
+    meshtastic_MeshPacket *p = packetPool.tryAllocZeroed();
+    if (!p) {
+        numPoolEmpty++;
+        return;
+    }
+
+    bool isDuplicate = numRecent && (uint32_t)random(100) < spec.dupPercent;
+    if (isDuplicate) {
+        *p = recent[random(numRecent)];
+        p->hop_limit = p->hop_limit ? p->hop_limit - 1 : 0; // as if it came back to us through a neighbour
+        numDuplicates++;
+    } else {
+        Kind kind = pickKind();
+        p->from = LOAD_FIRST_NODE + random(spec.nodes);
+        p->to = NODENUM_BROADCAST;
+        p->id = generatePacketId();
+        p->channel = channels.getPrimaryIndex();
+        p->hop_limit = HOP_RELIABLE;
+        makePayload(*p, kind, p->from);
+        if (perhapsEncode(p) != meshtastic_Routing_Error_NONE) {
+            numEncodeFailed++;
+            packetPool.release(p);
+            return;
+        }
+        numByKind[kind]++;
+
+        recent[nextRecent] = *p;
+        nextRecent = (nextRecent + 1) % LOAD_RECENT_PACKETS;
+        if (numRecent < LOAD_RECENT_PACKETS)
+            numRecent++;
+    }
+
+    p->rx_time = getValidTime(RTCQualityFromNet);
+    p->rx_snr = random(-150, 100) / 10.0f;
+    p->rx_rssi = random(-120, -60);
+    numInjected++;
+    router->enqueueReceivedMessage(p);
+}
+
+void LoadGenerator::report(bool done)
+{
+    uint32_t secs = (millis() - startMsec) / 1000;
+    LOG_INFO("Load %s after %us: injected %u (nodeinfo=%u position=%u telemetry=%u text=%u, %u duplicates), %u not injected "
+             "(pool empty %u, encode failed %u)\n",
+             done ? "done" : "report", secs, numInjected, numByKind[NODEINFO], numByKind[POSITION], numByKind[TELEMETRY],
+             numByKind[TEXT], numDuplicates, numPoolEmpty + numEncodeFailed, numPoolEmpty, numEncodeFailed);
+
+    // What each stage dropped since we started
+    auto since = [&](RadioStats::Error e) { return radioStats.getErrorCount(e) - startErrors[e]; };
+    LOG_INFO("Load drops: rx queue %u, rx pool %u, undecodable %u, tx queue %u, tx rate limited %u, duplicates filtered %u, "
+             "to phone %u\n",
+             since(RadioStats::RX_QUEUE_FULL), since(RadioStats::RX_POOL_EMPTY), since(RadioStats::RX_UNDECODABLE),
+             since(RadioStats::TX_QUEUE_FULL) + since(RadioStats::TX_FAIR_DROPPED), since(RadioStats::TX_RATE_LIMITED),
+             metrics.get(Metrics::RX_DUPLICATE) - startFiltered, metrics.get(Metrics::TOPHONE_DROPPED) - startToPhoneDropped);
+    LOG_INFO("Load nodedb: %u nodes (%d since we started)\n", (unsigned)nodeDB.getNumMeshNodes(),
+             (int)(nodeDB.getNumMeshNodes() - startNodes));
+    if (mqtt)
+        LOG_INFO("Load mqtt: uplinked %u, outbox dropped %u, %u queued\n",
+                 mqtt->getUplinkPolicy().getCount(MQTTUplinkPolicy::UPLINK) - startMqttUplinked,
+                 mqtt->getOutbox().getNumDropped() - startMqttDropped, mqtt->getOutbox().getNumMessages());
+
+    // Latency through the Router's queue and decode, since boot, as RadioStats keeps it
+    char line[96];
+    for (RadioStats::Stage stage : {RadioStats::RX_QUEUE, RadioStats::DECODE}) {
+        radioStats.getSummaryLine(stage, line, sizeof(line));
+        LOG_INFO("Load latency %s\n", line);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "RadioStats.h"
+#include "concurrency/OSThread.h"
+#include <stdint.h>
+
+/// How often a running LoadGenerator logs its report
+#ifndef LOAD_REPORT_SECS
+#define LOAD_REPORT_SECS 10
+#endif
+
+/// The most packets we inject in one run, however late we got to it, so a stalled loop doesn't get a burst all at once
+#ifndef LOAD_MAX_BURST
+#define LOAD_MAX_BURST 32
+#endif
+
+/// The recent packets we keep, to inject again as the duplicates a flood brings
+#define LOAD_RECENT_PACKETS 16
+
+/**
+ * Soak testing without a room full of radios: injects synthetic packets, from many virtual nodes, through
+ * Router::enqueueReceivedMessage() as if our radio had heard them.  They are encrypted on our primary channel and decode to
+ * the real thing (nodeinfo, positions, device telemetry and text), so they go all the way through PacketHistory, the
+ * NodeDB, callPlugins(), MQTT and the phone queues.  A share of them are repeats of recent packets, as a flood brings.
+ *
+ * Every LOAD_REPORT_SECS (and when we're done) we log what we injected and what each stage dropped since we started, from
+ * radioStats and metrics, with the RX_QUEUE and DECODE latencies.
+ *
+ * Started by the --load command line option, e.g. --load rate=50,nodes=500,secs=600,dups=30,position=4,text=1 (see
+ * parseSpec()).
+ */
+class LoadGenerator : private concurrency::OSThread
+{
+  public:
+    enum Kind { NODEINFO, POSITION, TELEMETRY, TEXT, NUM_KINDS };
+
+    struct Spec {
+        uint32_t rate = 10;                          // packets a second
+        uint32_t nodes = 100;                        // virtual originators
+        uint32_t secs = 0;                           // how long to run, 0 for ever
+        uint32_t dupPercent = 20;                    // of our packets which are repeats of a recent one
+        uint32_t weights[NUM_KINDS] = {1, 4, 3, 1}; // the mix of the others
+    };
+
+    /// Parse a comma separated list of key=value (rate, nodes, secs, dups, nodeinfo, position, telemetry, text) into spec.
+    /// @return false if there is something in it we don't know
+    static bool parseSpec(const char *s, Spec &spec);
+
+    explicit LoadGenerator(const Spec &spec);
+
+  protected:
+    virtual int32_t runOnce() override;
+
+  private:
+    Spec spec;
+    uint32_t totalWeight = 0;
+    uint32_t startMsec = 0, lastReportMsec = 0;
+    uint64_t injectedPerMille = 0; // how many we should have injected by now, in thousandths
+
+    uint32_t numInjected = 0, numDuplicates = 0, numPoolEmpty = 0, numEncodeFailed = 0;
+    uint32_t numByKind[NUM_KINDS] = {};
+
+    /// The packets we inject again as duplicates, oldest overwritten first
+    meshtastic_MeshPacket recent[LOAD_RECENT_PACKETS];
+    uint8_t numRecent = 0, nextRecent = 0;
+
+    /// The counters we report as deltas, as they were when we started
+    uint32_t startErrors[RadioStats::NUM_ERRORS] = {};
+    uint32_t startFiltered = 0, startToPhoneDropped = 0, startNodes = 0;
+    uint32_t startMqttUplinked = 0, startMqttDropped = 0;
+
+    void injectOne();
+
+    /// Fill in p's payload (decoded) as node from would send it
+    void makePayload(meshtastic_MeshPacket &p, Kind kind, NodeNum from);
+
+    Kind pickKind();
+
+    void report(bool done);
+};
+
+/// Set by the --load command line option
+extern bool loadGeneratorMode;
+extern LoadGenerator::Spec loadGeneratorSpec;
@@ -0,0 +1,110 @@
+#include "PacketReplay.h"
+#include "Metrics.h"
+#include "PacketCapture.h"
+#include "RadioLibInterface.h"
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+const char *replayFileName;
+float replaySpeed = 1;
+
+PacketReplay *PacketReplay::open(const char *fileName, float speed)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (!f) {
+        LOG_ERROR("Can't open capture %s\n", fileName);
+        return NULL;
+    }
+    std::vector<uint8_t> capture;
+    uint8_t block[4096];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0)
+        capture.insert(capture.end(), block, block + n);
+    fclose(f);
+
+    if (!PacketCapture::checkHeader(capture.data(), capture.size())) {
+        LOG_ERROR("%s isn't a capture we can read (written by a build with a different PacketHeader?)\n", fileName);
+        return NULL;
+    }
+    LOG_INFO("Replaying %s (%u bytes) at %gx\n", fileName, capture.size(), speed);
+    return new PacketReplay(capture, speed);
+}
+
+PacketReplay::PacketReplay(std::vector<uint8_t> &_capture, float _speed)
+    : concurrency::OSThread("PacketReplay"), pos(sizeof(PacketCapture::FileHeader)), speed(_speed)
+{
+    capture.swap(_capture);
+    randomSeed(REPLAY_RANDOM_SEED);
+
+    for (uint8_t i = 0; i < RadioStats::NUM_ERRORS; i++)
+        startErrors[i] = radioStats.getErrorCount((RadioStats::Error)i);
+    startFiltered = metrics.get(Metrics::RX_DUPLICATE);
+    startMsec = millis();
+}
+
+int32_t PacketReplay::runOnce()
+{
+    for (uint32_t n = 0; n < REPLAY_MAX_BURST; n++) {
+        PacketCapture::Record r;
+        if (pos + sizeof(r) > capture.size()) {
+            report();
+            return disable();
+        }
+        memcpy(&r, &capture[pos], sizeof(r));
+
+        // How far into the capture it came, a frame from before the capturing node last rebooted comes straight after
+        uint32_t atMsec = captureMsec;
+        if (numRead && r.msec >= lastRecordMsec)
+            atMsec += r.msec - lastRecordMsec;
+        if (speed > 0) {
+            // When it is due, as far into our replay as it was into the capture
+            uint32_t dueMsec = (uint32_t)(atMsec / speed);
+            uint32_t sinceStart = millis() - startMsec;
+            if (dueMsec > sinceStart)
+                return dueMsec - sinceStart;
+        }
+
+        if (pos + sizeof(r) + r.len > capture.size()) {
+            LOG_WARN("Capture is cut short, its last frame is missing %u bytes\n", pos + sizeof(r) + r.len - capture.size());
+            pos = capture.size();
+            continue;
+        }
+        const uint8_t *frame = &capture[pos + sizeof(r)];
+        pos += sizeof(r) + r.len;
+        captureMsec = atMsec;
+        lastRecordMsec = r.msec;
+        numRead++;
+
+        if (r.len < sizeof(PacketHeader)) {
+            numMalformed++;
+            continue;
+        }
+        PacketHeader h;
+        memcpy(&h, frame, sizeof(h));
+        RadioLibInterface::deliverReceivedPacket(h, frame + sizeof(h), r.len - sizeof(h), r.snr / 4.0f, r.rssi, millis(),
+                                                 micros());
+        numDelivered++;
+    }
+    return 0; // more to come, but let everyone else have a turn
+}
+
+void PacketReplay::report()
+{
+    LOG_INFO("Replay done: %u frames (%u malformed) from %us of capture, in %ums\n", numDelivered, numMalformed,
+             captureMsec / 1000, millis() - startMsec);
+
+    // What each stage dropped while we replayed
+    auto since = [&](RadioStats::Error e) { return radioStats.getErrorCount(e) - startErrors[e]; };
+    LOG_INFO("Replay drops: no sender %u, rx queue %u, rx pool %u, undecodable %u, tx queue %u, tx rate limited %u, "
+             "duplicates filtered %u\n",
+             since(RadioStats::RX_NO_SENDER), since(RadioStats::RX_QUEUE_FULL), since(RadioStats::RX_POOL_EMPTY),
+             since(RadioStats::RX_UNDECODABLE), since(RadioStats::TX_QUEUE_FULL) + since(RadioStats::TX_FAIR_DROPPED),
+             since(RadioStats::TX_RATE_LIMITED), metrics.get(Metrics::RX_DUPLICATE) - startFiltered);
+
+    char line[96];
+    for (RadioStats::Stage stage : {RadioStats::RX_QUEUE, RadioStats::DECODE}) {
+        radioStats.getSummaryLine(stage, line, sizeof(line));
+        LOG_INFO("Replay latency %s\n", line);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "RadioStats.h"
+#include "concurrency/OSThread.h"
+#include <stdint.h>
+#include <vector>
+
+/// The most frames we deliver in one run, however late we got to it, so a stalled loop doesn't get a burst all at once
+#ifndef REPLAY_MAX_BURST
+#define REPLAY_MAX_BURST 32
+#endif
+
+/// The seed we give random() as we start, so the Router's TX delays (and the packet ids we pick) are the same every replay
+#ifndef REPLAY_RANDOM_SEED
+#define REPLAY_RANDOM_SEED 0x5eed
+#endif
+
+/**
+ * Feeds a PacketCapture file back in, through RadioLibInterface::deliverReceivedPacket() as if our radio had just heard each
+ * frame again: the cut-through check, the Router's receive queue, FloodingRouter and ReliableRouter, the modules.  At the
+ * original pace (or speed times it, 0 for as fast as we can take them), so a dedupe miss or a flood storm from the field
+ * can be run again and again, and a change to the packet path measured against the same traffic.
+ *
+ * When the capture runs out we log what we delivered, how long it took, and what each stage dropped, with the RX_QUEUE and
+ * DECODE latencies.
+ *
+ * Started by the --replay command line option, with --replay-speed.
+ */
+class PacketReplay : private concurrency::OSThread
+{
+  public:
+    /// Read the capture in fileName, @return NULL (having logged why) if we can't
+    static PacketReplay *open(const char *fileName, float speed);
+
+  protected:
+    virtual int32_t runOnce() override;
+
+  private:
+    std::vector<uint8_t> capture;
+    size_t pos; // of the next record in capture
+    float speed;
+
+    uint32_t startMsec = 0;
+    uint32_t captureMsec = 0;    // how far into the capture our last frame was
+    uint32_t lastRecordMsec = 0; // millis() of our last frame, as the capturing node had it
+    uint32_t numRead = 0, numDelivered = 0, numMalformed = 0;
+    uint32_t startErrors[RadioStats::NUM_ERRORS] = {};
+    uint32_t startFiltered = 0;
+
+    PacketReplay(std::vector<uint8_t> &capture, float speed);
+
+    void report();
+};
+
+/// Set by the --replay and --replay-speed command line options
+extern const char *replayFileName;
+extern float replaySpeed;
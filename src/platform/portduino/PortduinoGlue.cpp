@@ -8,15 +8,18 @@
 #include <Utility.h>
 #include <assert.h>
 
+#include "Benchmark.h"
+#include "LoadGenerator.h"
+#include "PacketReplay.h"
+#include "ScreenBenchmark.h"
+#include "modules/FirmwareUpdateModule.h"
 #include "PortduinoGlue.h"
 #include "linux/gpio/LinuxGPIOPin.h"
 #include "yaml-cpp/yaml.h"
 #include <iostream>
-#include <map>
 #include <unistd.h>
 
-std::map<configNames, int> settingsMap;
-std::map<configNames, std::string> settingsStrings;
+PortduinoSettings portduinoSettings;
 char *configPath = nullptr;
 
 // FIXME - move setBluetoothEnable into a HALPlatform class
@@ -34,6 +37,17 @@ void updateBatteryLevel(uint8_t level) NOT_IMPLEMENTED("updateBatteryLevel");
 
 int TCPPort = 4403;
 
+/// argp key for our long only options
+#define OPT_BENCHMARK 0x100
+#define OPT_LOAD 0x101
+#define OPT_REPLAY 0x102
+#define OPT_REPLAY_SPEED 0x103
+#define OPT_DISTRIBUTE 0x104
+#define OPT_DISTRIBUTE_HW 0x105
+#define OPT_DISTRIBUTE_VERSION 0x106
+#define OPT_DISTRIBUTE_DELTA 0x107
+#define OPT_BENCHMARK_SCREEN 0x108
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
 {
     switch (key) {
@@ -46,6 +60,45 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     case 'c':
         configPath = arg;
         break;
+    case OPT_BENCHMARK:
+        benchmarkMode = true;
+        break;
+    case OPT_BENCHMARK_SCREEN:
+        screenBenchmarkFrames = 1000;
+        if (arg && (sscanf(arg, "%u", &screenBenchmarkFrames) < 1 || !screenBenchmarkFrames))
+            argp_error(state, "Can't parse frame count '%s'", arg);
+        break;
+    case OPT_LOAD:
+        if (!LoadGenerator::parseSpec(arg, loadGeneratorSpec))
+            argp_error(state, "Can't parse load spec '%s'", arg);
+        loadGeneratorMode = true;
+        break;
+    case OPT_REPLAY:
+        replayFileName = arg;
+        break;
+    case OPT_REPLAY_SPEED:
+        if (sscanf(arg, "%f", &replaySpeed) < 1 || replaySpeed < 0)
+            argp_error(state, "Can't parse replay speed '%s'", arg);
+        break;
+#if USE_MESH_FIRMWARE_UPDATE
+    case OPT_DISTRIBUTE:
+        firmwareDistributeFile = arg;
+        break;
+    case OPT_DISTRIBUTE_HW:
+        if (sscanf(arg, "%d", &firmwareDistributeHwModel) < 1 || firmwareDistributeHwModel <= 0)
+            argp_error(state, "Can't parse hardware model '%s'", arg);
+        break;
+    case OPT_DISTRIBUTE_VERSION:
+        firmwareDistributeVersion = arg;
+        break;
+    case OPT_DISTRIBUTE_DELTA:
+        firmwareDistributeFlags = FIRMWARE_FLAG_DELTA | FIRMWARE_FLAG_COMPRESSED;
+        break;
+    case ARGP_KEY_END:
+        if (firmwareDistributeFile && (!firmwareDistributeHwModel || !firmwareDistributeVersion))
+            argp_error(state, "--distribute needs --distribute-hw and --distribute-version");
+        return 0;
+#endif
     case ARGP_KEY_ARG:
         return 0;
     default:
@@ -58,6 +111,24 @@ void portduinoCustomInit()
 {
     static struct argp_option options[] = {{"port", 'p', "PORT", 0, "The TCP port to use."},
                                            {"config", 'c', "CONFIG_PATH", 0, "Full path of the .yaml config file to use."},
+                                           {"benchmark", OPT_BENCHMARK, 0, 0, "Run the packet path benchmarks, then exit."},
+                                           {"benchmark-screen", OPT_BENCHMARK_SCREEN, "FRAMES", OPTION_ARG_OPTIONAL,
+                                            "Time rendering each screen frame FRAMES times (default 1000), then exit."},
+                                           {"load", OPT_LOAD, "SPEC", 0,
+                                            "Inject synthetic mesh traffic, e.g. rate=50,nodes=500,secs=600,dups=30"},
+                                           {"replay", OPT_REPLAY, "FILE", 0, "Feed a packet capture through our Router."},
+                                           {"replay-speed", OPT_REPLAY_SPEED, "SPEED", 0,
+                                            "Replay at SPEED times the captured pace, 0 for as fast as we can (default 1)."},
+#if USE_MESH_FIRMWARE_UPDATE
+                                           {"distribute", OPT_DISTRIBUTE, "FILE", 0,
+                                            "Distribute the firmware image in FILE over the mesh (on the admin channel)."},
+                                           {"distribute-hw", OPT_DISTRIBUTE_HW, "MODEL", 0,
+                                            "The HardwareModel number of the nodes the image is for."},
+                                           {"distribute-version", OPT_DISTRIBUTE_VERSION, "VERSION", 0,
+                                            "The version the image brings, nodes already running it ignore it."},
+                                           {"distribute-delta", OPT_DISTRIBUTE_DELTA, 0, 0,
+                                            "The image is a compressed binary diff, to be staged for the updater."},
+#endif
                                            {0}};
     static void *childArguments;
     static char doc[] = "Meshtastic native build.";
@@ -111,150 +182,160 @@ void portduinoSetup()
         return;
     }
 
+    PortduinoSettings &ps = portduinoSettings;
     try {
         if (yamlConfig["Logging"]) {
-            if (yamlConfig["Logging"]["LogLevel"].as<std::string>("info") == "debug") {
-                settingsMap[logoutputlevel] = level_debug;
-            } else if (yamlConfig["Logging"]["LogLevel"].as<std::string>("info") == "info") {
-                settingsMap[logoutputlevel] = level_info;
-            } else if (yamlConfig["Logging"]["LogLevel"].as<std::string>("info") == "warn") {
-                settingsMap[logoutputlevel] = level_warn;
-            } else if (yamlConfig["Logging"]["LogLevel"].as<std::string>("info") == "error") {
-                settingsMap[logoutputlevel] = level_error;
-            }
+            std::string level = yamlConfig["Logging"]["LogLevel"].as<std::string>("info");
+            if (level == "debug")
+                ps.logLevel = level_debug;
+            else if (level == "info")
+                ps.logLevel = level_info;
+            else if (level == "warn")
+                ps.logLevel = level_warn;
+            else if (level == "error")
+                ps.logLevel = level_error;
+            else
+                std::cout << "Unknown Logging LogLevel " << level << std::endl;
         }
         if (yamlConfig["Lora"]) {
-            settingsMap[use_sx1262] = false;
-            settingsMap[use_rf95] = false;
-            settingsMap[use_sx1280] = false;
+            std::string module = yamlConfig["Lora"]["Module"].as<std::string>("");
+            if (module == "sx1262")
+                ps.loraModule = lora_sx1262;
+            else if (module == "RF95")
+                ps.loraModule = lora_rf95;
+            else if (module == "sx1280")
+                ps.loraModule = lora_sx1280;
+            else if (module != "")
+                std::cout << "Unknown Lora Module " << module << std::endl;
+            ps.dio2AsRfSwitch = yamlConfig["Lora"]["DIO2_AS_RF_SWITCH"].as<bool>(false);
+            ps.dio3TcxoVoltage = yamlConfig["Lora"]["DIO3_TCXO_VOLTAGE"].as<bool>(false);
+            ps.cs = yamlConfig["Lora"]["CS"].as<int>(RADIOLIB_NC);
+            ps.irq = yamlConfig["Lora"]["IRQ"].as<int>(RADIOLIB_NC);
+            ps.busy = yamlConfig["Lora"]["Busy"].as<int>(RADIOLIB_NC);
+            ps.reset = yamlConfig["Lora"]["Reset"].as<int>(RADIOLIB_NC);
+            ps.txen = yamlConfig["Lora"]["TXen"].as<int>(RADIOLIB_NC);
+            ps.rxen = yamlConfig["Lora"]["RXen"].as<int>(RADIOLIB_NC);
+            ps.gpiochip = yamlConfig["Lora"]["gpiochip"].as<int>(0);
+            gpioChipName += std::to_string(ps.gpiochip);
 
-            if (yamlConfig["Lora"]["Module"] && yamlConfig["Lora"]["Module"].as<std::string>("") == "sx1262") {
-                settingsMap[use_sx1262] = true;
-            } else if (yamlConfig["Lora"]["Module"] && yamlConfig["Lora"]["Module"].as<std::string>("") == "RF95") {
-                settingsMap[use_rf95] = true;
-            } else if (yamlConfig["Lora"]["Module"] && yamlConfig["Lora"]["Module"].as<std::string>("") == "sx1280") {
-                settingsMap[use_sx1280] = true;
-            }
-            settingsMap[dio2_as_rf_switch] = yamlConfig["Lora"]["DIO2_AS_RF_SWITCH"].as<bool>(false);
-            settingsMap[dio3_tcxo_voltage] = yamlConfig["Lora"]["DIO3_TCXO_VOLTAGE"].as<bool>(false);
-            settingsMap[cs] = yamlConfig["Lora"]["CS"].as<int>(RADIOLIB_NC);
-            settingsMap[irq] = yamlConfig["Lora"]["IRQ"].as<int>(RADIOLIB_NC);
-            settingsMap[busy] = yamlConfig["Lora"]["Busy"].as<int>(RADIOLIB_NC);
-            settingsMap[reset] = yamlConfig["Lora"]["Reset"].as<int>(RADIOLIB_NC);
-            settingsMap[txen] = yamlConfig["Lora"]["TXen"].as<int>(RADIOLIB_NC);
-            settingsMap[rxen] = yamlConfig["Lora"]["RXen"].as<int>(RADIOLIB_NC);
-            settingsMap[gpiochip] = yamlConfig["Lora"]["gpiochip"].as<int>(0);
-            gpioChipName += std::to_string(settingsMap[gpiochip]);
-
-            settingsStrings[spidev] = "/dev/" + yamlConfig["Lora"]["spidev"].as<std::string>("spidev0.0");
+            ps.spidev = "/dev/" + yamlConfig["Lora"]["spidev"].as<std::string>("spidev0.0");
+            ps.spiSpeed = yamlConfig["Lora"]["spiSpeed"].as<uint32_t>(4000000);
         }
         if (yamlConfig["GPIO"]) {
-            settingsMap[user] = yamlConfig["GPIO"]["User"].as<int>(RADIOLIB_NC);
+            ps.userButton = yamlConfig["GPIO"]["User"].as<int>(RADIOLIB_NC);
         }
         if (yamlConfig["GPS"]) {
             std::string serialPath = yamlConfig["GPS"]["SerialPath"].as<std::string>("");
             if (serialPath != "") {
                 Serial1.setPath(serialPath);
-                settingsMap[has_gps] = 1;
+                ps.hasGps = true;
             }
         }
         if (yamlConfig["I2C"]) {
-            settingsStrings[i2cdev] = yamlConfig["I2C"]["I2CDevice"].as<std::string>("");
+            ps.i2cdev = yamlConfig["I2C"]["I2CDevice"].as<std::string>("");
         }
-        settingsMap[displayPanel] = no_screen;
         if (yamlConfig["Display"]) {
-            if (yamlConfig["Display"]["Panel"].as<std::string>("") == "ST7789")
-                settingsMap[displayPanel] = st7789;
-            else if (yamlConfig["Display"]["Panel"].as<std::string>("") == "ST7735")
-                settingsMap[displayPanel] = st7735;
-            else if (yamlConfig["Display"]["Panel"].as<std::string>("") == "ST7735S")
-                settingsMap[displayPanel] = st7735s;
-            else if (yamlConfig["Display"]["Panel"].as<std::string>("") == "ILI9341")
-                settingsMap[displayPanel] = ili9341;
-            settingsMap[displayHeight] = yamlConfig["Display"]["Height"].as<int>(0);
-            settingsMap[displayWidth] = yamlConfig["Display"]["Width"].as<int>(0);
-            settingsMap[displayDC] = yamlConfig["Display"]["DC"].as<int>(-1);
-            settingsMap[displayCS] = yamlConfig["Display"]["CS"].as<int>(-1);
-            settingsMap[displayBacklight] = yamlConfig["Display"]["Backlight"].as<int>(-1);
-            settingsMap[displayReset] = yamlConfig["Display"]["Reset"].as<int>(-1);
-            settingsMap[displayOffsetX] = yamlConfig["Display"]["OffsetX"].as<int>(0);
-            settingsMap[displayOffsetY] = yamlConfig["Display"]["OffsetY"].as<int>(0);
-            settingsMap[displayRotate] = yamlConfig["Display"]["Rotate"].as<bool>(false);
-            settingsMap[displayInvert] = yamlConfig["Display"]["Invert"].as<bool>(false);
+            std::string panel = yamlConfig["Display"]["Panel"].as<std::string>("");
+            if (panel == "ST7789")
+                ps.displayPanel = st7789;
+            else if (panel == "ST7735")
+                ps.displayPanel = st7735;
+            else if (panel == "ST7735S")
+                ps.displayPanel = st7735s;
+            else if (panel == "ILI9341")
+                ps.displayPanel = ili9341;
+            else if (panel != "")
+                std::cout << "Unknown Display Panel " << panel << std::endl;
+            ps.displayHeight = yamlConfig["Display"]["Height"].as<int>(0);
+            ps.displayWidth = yamlConfig["Display"]["Width"].as<int>(0);
+            ps.displayDC = yamlConfig["Display"]["DC"].as<int>(-1);
+            ps.displayCS = yamlConfig["Display"]["CS"].as<int>(-1);
+            ps.displayBacklight = yamlConfig["Display"]["Backlight"].as<int>(-1);
+            ps.displayReset = yamlConfig["Display"]["Reset"].as<int>(-1);
+            ps.displayOffsetX = yamlConfig["Display"]["OffsetX"].as<int>(0);
+            ps.displayOffsetY = yamlConfig["Display"]["OffsetY"].as<int>(0);
+            ps.displayRotate = yamlConfig["Display"]["Rotate"].as<bool>(false);
+            ps.displayInvert = yamlConfig["Display"]["Invert"].as<bool>(false);
         }
-        settingsMap[touchscreenModule] = no_touchscreen;
         if (yamlConfig["Touchscreen"]) {
-            if (yamlConfig["Touchscreen"]["Module"].as<std::string>("") == "XPT2046")
-                settingsMap[touchscreenModule] = xpt2046;
-            else if (yamlConfig["Touchscreen"]["Module"].as<std::string>("") == "STMPE610")
-                settingsMap[touchscreenModule] = stmpe610;
-            settingsMap[touchscreenCS] = yamlConfig["Touchscreen"]["CS"].as<int>(-1);
-            settingsMap[touchscreenIRQ] = yamlConfig["Touchscreen"]["IRQ"].as<int>(-1);
+            std::string module = yamlConfig["Touchscreen"]["Module"].as<std::string>("");
+            if (module == "XPT2046")
+                ps.touchscreenModule = xpt2046;
+            else if (module == "STMPE610")
+                ps.touchscreenModule = stmpe610;
+            else if (module != "")
+                std::cout << "Unknown Touchscreen Module " << module << std::endl;
+            ps.touchscreenCS = yamlConfig["Touchscreen"]["CS"].as<int>(-1);
+            ps.touchscreenIRQ = yamlConfig["Touchscreen"]["IRQ"].as<int>(-1);
         }
         if (yamlConfig["Input"]) {
-            settingsStrings[keyboardDevice] = (yamlConfig["Input"]["KeyboardDevice"]).as<std::string>("");
+            ps.keyboardDevice = (yamlConfig["Input"]["KeyboardDevice"]).as<std::string>("");
         }
 
     } catch (YAML::Exception e) {
         std::cout << "*** Exception " << e.what() << std::endl;
         exit(EXIT_FAILURE);
     }
+    ps.validate();
 
     // Need to bind all the configured GPIO pins so they're not simulated
-    if (settingsMap.count(cs) > 0 && settingsMap[cs] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[cs], gpioChipName) != ERRNO_OK) {
-            settingsMap[cs] = RADIOLIB_NC;
-        }
-    }
-    if (settingsMap.count(irq) > 0 && settingsMap[irq] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[irq], gpioChipName) != ERRNO_OK) {
-            settingsMap[irq] = RADIOLIB_NC;
-        }
+    int *pins[] = {&ps.cs,
+#if !PORTDUINO_SPIDEV_HAL // SpidevHal requests the IRQ line for edge events itself
+                   &ps.irq,
+#endif
+                   &ps.busy, &ps.reset, &ps.userButton, &ps.rxen, &ps.txen};
+    for (int *pin : pins)
+        if (*pin != RADIOLIB_NC && initGPIOPin(*pin, gpioChipName) != ERRNO_OK)
+            *pin = RADIOLIB_NC;
+
+    if (ps.displayPanel != no_screen) {
+        if (ps.displayCS > 0)
+            initGPIOPin(ps.displayCS, gpioChipName);
+        if (ps.displayDC > 0)
+            initGPIOPin(ps.displayDC, gpioChipName);
+        if (ps.displayBacklight > 0)
+            initGPIOPin(ps.displayBacklight, gpioChipName);
+        if (ps.displayReset > 0)
+            initGPIOPin(ps.displayReset, gpioChipName);
     }
-    if (settingsMap.count(busy) > 0 && settingsMap[busy] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[busy], gpioChipName) != ERRNO_OK) {
-            settingsMap[busy] = RADIOLIB_NC;
-        }
+    if (ps.touchscreenModule != no_touchscreen) {
+        if (ps.touchscreenCS > 0)
+            initGPIOPin(ps.touchscreenCS, gpioChipName);
+        if (ps.touchscreenIRQ > 0)
+            initGPIOPin(ps.touchscreenIRQ, gpioChipName);
     }
-    if (settingsMap.count(reset) > 0 && settingsMap[reset] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[reset], gpioChipName) != ERRNO_OK) {
-            settingsMap[reset] = RADIOLIB_NC;
-        }
+
+    return;
+}
+
+bool PortduinoSettings::validate() const
+{
+    bool okay = true;
+    if (loraModule != no_lora && (cs == RADIOLIB_NC || irq == RADIOLIB_NC)) {
+        std::cout << "Lora needs CS and IRQ pins" << std::endl;
+        okay = false;
     }
-    if (settingsMap.count(user) > 0 && settingsMap[user] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[user], gpioChipName) != ERRNO_OK) {
-            settingsMap[user] = RADIOLIB_NC;
-        }
+    if ((loraModule == lora_sx1262 || loraModule == lora_sx1280) && busy == RADIOLIB_NC) {
+        std::cout << "Lora " << (loraModule == lora_sx1262 ? "sx1262" : "sx1280") << " needs a Busy pin" << std::endl;
+        okay = false;
     }
-    if (settingsMap.count(rxen) > 0 && settingsMap[rxen] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[rxen], gpioChipName) != ERRNO_OK) {
-            settingsMap[rxen] = RADIOLIB_NC;
-        }
+    if ((txen == RADIOLIB_NC) != (rxen == RADIOLIB_NC) && loraModule == lora_sx1280) {
+        std::cout << "Lora sx1280 needs both TXen and RXen for its RF switch, or neither" << std::endl;
+        okay = false;
     }
-    if (settingsMap.count(txen) > 0 && settingsMap[txen] != RADIOLIB_NC) {
-        if (initGPIOPin(settingsMap[txen], gpioChipName) != ERRNO_OK) {
-            settingsMap[txen] = RADIOLIB_NC;
-        }
+    if (loraModule != no_lora && !spiSpeed) {
+        std::cout << "Lora spiSpeed can't be 0" << std::endl;
+        okay = false;
     }
-
-    if (settingsMap[displayPanel] != no_screen) {
-        if (settingsMap[displayCS] > 0)
-            initGPIOPin(settingsMap[displayCS], gpioChipName);
-        if (settingsMap[displayDC] > 0)
-            initGPIOPin(settingsMap[displayDC], gpioChipName);
-        if (settingsMap[displayBacklight] > 0)
-            initGPIOPin(settingsMap[displayBacklight], gpioChipName);
-        if (settingsMap[displayReset] > 0)
-            initGPIOPin(settingsMap[displayReset], gpioChipName);
+    if (displayPanel != no_screen && (displayWidth <= 0 || displayHeight <= 0)) {
+        std::cout << "Display needs a Width and Height" << std::endl;
+        okay = false;
     }
-    if (settingsMap[touchscreenModule] != no_touchscreen) {
-        if (settingsMap[touchscreenCS] > 0)
-            initGPIOPin(settingsMap[touchscreenCS], gpioChipName);
-        if (settingsMap[touchscreenIRQ] > 0)
-            initGPIOPin(settingsMap[touchscreenIRQ], gpioChipName);
+    if (touchscreenModule != no_touchscreen && displayPanel == no_screen) {
+        std::cout << "Touchscreen needs a Display Panel" << std::endl;
+        okay = false;
     }
-
-    return;
+    return okay;
 }
 
 int initGPIOPin(int pinNum, std::string gpioChipName)
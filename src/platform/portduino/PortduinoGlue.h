@@ -1,44 +1,50 @@
 #pragma once
-#include <map>
-
-enum configNames {
-    use_sx1262,
-    cs,
-    irq,
-    busy,
-    reset,
-    txen,
-    rxen,
-    dio2_as_rf_switch,
-    dio3_tcxo_voltage,
-    use_rf95,
-    use_sx1280,
-    user,
-    gpiochip,
-    spidev,
-    i2cdev,
-    has_gps,
-    touchscreenModule,
-    touchscreenCS,
-    touchscreenIRQ,
-    displayPanel,
-    displayWidth,
-    displayHeight,
-    displayCS,
-    displayDC,
-    displayBacklight,
-    displayReset,
-    displayRotate,
-    displayOffsetX,
-    displayOffsetY,
-    displayInvert,
-    keyboardDevice,
-    logoutputlevel
-};
+#include <stdint.h>
+#include <string>
+
+enum { no_lora, lora_sx1262, lora_rf95, lora_sx1280 };
 enum { no_screen, st7789, st7735, st7735s, ili9341 };
 enum { no_touchscreen, xpt2046, stmpe610 };
 enum { level_error, level_warn, level_info, level_debug };
 
-extern std::map<configNames, int> settingsMap;
-extern std::map<configNames, std::string> settingsStrings;
-int initGPIOPin(int pinNum, std::string gpioChipname);
\ No newline at end of file
+/**
+ * What our YAML config says, parsed once by portduinoSetup() so the code which runs all the time (logging, buttons, radio
+ * switching, every frame of the display) reads a field rather than looking it up.  Pins are -1 (RADIOLIB_NC) for none, and
+ * anything the config leaves out stays at its default here.
+ */
+struct PortduinoSettings {
+    int logLevel = level_error;
+
+    // Lora
+    int loraModule = no_lora;
+    bool dio2AsRfSwitch = false;
+    bool dio3TcxoVoltage = false;
+    int cs = -1, irq = -1, busy = -1, reset = -1, txen = -1, rxen = -1;
+    int gpiochip = 0;
+    std::string spidev;
+    uint32_t spiSpeed = 4000000; // Hz, for SpidevHal
+
+    // GPIO, GPS, I2C and Input
+    int userButton = -1;
+    bool hasGps = false;
+    std::string i2cdev;
+    std::string keyboardDevice;
+
+    // Display
+    int displayPanel = no_screen;
+    int displayWidth = 0, displayHeight = 0;
+    int displayCS = -1, displayDC = -1, displayBacklight = -1, displayReset = -1;
+    int displayOffsetX = 0, displayOffsetY = 0;
+    bool displayRotate = false;
+    bool displayInvert = false;
+
+    // Touchscreen
+    int touchscreenModule = no_touchscreen;
+    int touchscreenCS = -1, touchscreenIRQ = -1;
+
+    /// Print what doesn't make sense (a radio without the pins it needs, a panel without a size).  @return false if anything
+    bool validate() const;
+};
+
+extern PortduinoSettings portduinoSettings;
+int initGPIOPin(int pinNum, std::string gpioChipname);
@@ -0,0 +1,179 @@
+#include "ScreenBenchmark.h"
+#include "Benchmark.h"
+#include "GPSStatus.h"
+#include "NodeDB.h"
+#include "configuration.h"
+#include "gps/RTC.h"
+#include "graphics/Screen.h"
+#include "main.h"
+
+#include <OLEDDisplay.h>
+#include <OLEDDisplayUi.h>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+uint32_t screenBenchmarkFrames;
+
+/// The nodes we make up for the node frames to show, besides ourself
+#define SCREEN_BENCH_NODES 40
+
+/// What TFTDisplay::pushFrame() spends setting a window, and the gap between changed pixels it still sends as one span
+#define SCREEN_BENCH_TFT_WINDOW_BYTES 11
+#define SCREEN_BENCH_TFT_SPAN_MERGE_GAP 6
+
+/**
+ * An OLEDDisplay with no panel behind it: display() adds up what the frame would have cost on the bus instead.  An OLED
+ * takes all of its buffer every frame, a TFT the spans of each row which changed since the frame before (as TFTDisplay
+ * works them out).
+ */
+class BenchDisplay : public OLEDDisplay
+{
+    std::vector<uint8_t> onPanel; // what the TFT would be showing
+
+    /// @return the bytes TFTDisplay would send for row y, with page the buffer's page holding it
+    uint32_t countRowBytes(const uint8_t *page, const uint8_t *before, uint16_t y)
+    {
+        uint8_t mask = 1 << (y & 7);
+        uint32_t bytes = 0;
+        uint16_t x = 0;
+        for (;;) {
+            while (x < displayWidth && !((page[x] ^ before[x]) & mask))
+                x++;
+            if (x == displayWidth)
+                return bytes;
+            uint16_t start = x, end = x + 1;
+            for (x++; x < displayWidth && x - end <= SCREEN_BENCH_TFT_SPAN_MERGE_GAP; x++)
+                if ((page[x] ^ before[x]) & mask)
+                    end = x + 1;
+            bytes += SCREEN_BENCH_TFT_WINDOW_BYTES + 2 * (end - start);
+            x = end;
+        }
+    }
+
+  public:
+    uint64_t oledBytes = 0, tftBytes = 0;
+
+    BenchDisplay(uint16_t width, uint16_t height) { setGeometry(GEOMETRY_RAWMODE, width, height); }
+
+    virtual void display() override
+    {
+        size_t size = displayWidth * (displayHeight / 8);
+        oledBytes += size;
+        if (onPanel.size() != size)
+            onPanel.assign(size, 0); // blank
+        for (uint16_t p = 0; p * 8 < displayHeight; p++)
+            for (uint16_t y = p * 8; y < p * 8 + 8 && y < displayHeight; y++)
+                tftBytes += countRowBytes(buffer + p * displayWidth, &onPanel[p * displayWidth], y);
+        memcpy(onPanel.data(), buffer, size);
+    }
+
+  protected:
+    virtual int getBufferOffset() override { return 0; }
+    virtual void sendCommand(uint8_t com) override {}
+    virtual bool connect() override { return true; }
+};
+
+/// Make up a mesh for our frames to show: ourself with a GPS fix, SCREEN_BENCH_NODES others heard over the last hours
+/// (every other one with a position, so the compass has somewhere to point), and a text message from one of them
+static void makeMesh()
+{
+    uint32_t now = getTime();
+    meshtastic_Position pos = meshtastic_Position_init_default;
+    pos.latitude_i = 473977420;
+    pos.longitude_i = 85455920;
+    pos.altitude = 408;
+    pos.time = now;
+    pos.sats_in_view = 9;
+    pos.PDOP = 142;
+    nodeDB.updatePosition(nodeDB.getNodeNum(), pos, RX_SRC_LOCAL);
+    static meshtastic::GPSStatus fix(true, true, false, pos);
+    gpsStatus->updateStatus(&fix);
+
+    for (uint32_t i = 0; i < SCREEN_BENCH_NODES; i++) {
+        NodeNum num = 0x5c000000 + i;
+        meshtastic_User user = meshtastic_User_init_default;
+        snprintf(user.id, sizeof(user.id), "!%08x", num);
+        snprintf(user.long_name, sizeof(user.long_name), "Benchmark node %u", i);
+        snprintf(user.short_name, sizeof(user.short_name), "B%02u", i % 100);
+        nodeDB.updateUser(num, user);
+
+        if (i % 2 == 0) {
+            meshtastic_Position theirs = pos;
+            theirs.latitude_i += (i + 1) * 1370;
+            theirs.longitude_i -= (i + 1) * 910;
+            nodeDB.updatePosition(num, theirs, RX_SRC_RADIO);
+        }
+
+        meshtastic_MeshPacket mp = meshtastic_MeshPacket_init_default;
+        mp.from = num;
+        mp.to = NODENUM_BROADCAST;
+        mp.which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+        mp.rx_time = now - i * 7 * 60;
+        mp.rx_snr = 9.5f - i * 0.5f;
+        nodeDB.updateFrom(mp);
+    }
+
+    static const char *text = "Heading back to the trailhead now, should be at the car park by 5pm. Anyone need anything?";
+    meshtastic_MeshPacket &t = devicestate.rx_text_message;
+    t = meshtastic_MeshPacket_init_default;
+    t.from = 0x5c000000;
+    t.to = NODENUM_BROADCAST;
+    t.rx_time = now - 90;
+    t.which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+    t.decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    t.decoded.payload.size = strlen(text);
+    memcpy(t.decoded.payload.bytes, text, t.decoded.payload.size);
+    devicestate.has_rx_text_message = true;
+}
+
+static void benchDisplay(const char *displayName, uint16_t width, uint16_t height, uint32_t frames)
+{
+    BenchDisplay display(width, height);
+    if (!display.init()) {
+        printf("Can't set up a %ux%u display\n", width, height);
+        return;
+    }
+
+    graphics::Screen::BenchmarkFrame types[8];
+    size_t numTypes = screen->getBenchmarkFrames(&display, types, sizeof(types) / sizeof(types[0]));
+    uint8_t numNodeFrames = std::min<size_t>(nodeDB.getNumMeshNodes() - 1, SCREEN_NODE_FRAMES);
+
+    OLEDDisplayUiState state;
+    memset(&state, 0, sizeof(state));
+    state.userData = screen;
+    printf("Rendering on a %ux%u %s\n", width, height, displayName);
+
+    for (size_t t = 0; t < numTypes; t++) {
+        display.clear();
+        display.display(); // start from a blank panel
+        display.oledBytes = display.tftBytes = 0;
+
+        double renderNs = 0;
+        uint64_t allocsBefore = getBenchmarkAllocs();
+        for (uint32_t i = 0; i < frames; i++) {
+            state.currentFrame = numNodeFrames ? i % numNodeFrames : 0;
+            auto start = std::chrono::steady_clock::now();
+            display.clear();
+            types[t].draw(&display, &state, 0, 0);
+            renderNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            display.display();
+        }
+        uint64_t allocs = getBenchmarkAllocs() - allocsBefore;
+
+        printf("%-30s %7u frames %10.1f us/frame %8.0f oled bytes/frame %8.0f tft bytes/frame %7.2f allocs/frame\n",
+               types[t].name, frames, renderNs / frames / 1000, (double)display.oledBytes / frames,
+               (double)display.tftBytes / frames, (double)allocs / frames);
+    }
+}
+
+void runScreenBenchmark(uint32_t frames)
+{
+    printf("Running screen benchmarks\n");
+    makeMesh();
+    benchDisplay("OLED", 128, 64, frames);
+    benchDisplay("TFT", 320, 240, frames);
+    printf("Screen benchmarks done\n");
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Set by the --benchmark-screen command line option, how many times to render each frame (0 for not at all)
+extern uint32_t screenBenchmarkFrames;
+
+/**
+ * Time our Screen's frames (node info, compass, text message, DebugInfo) rendering on virtual displays, a 128x64 OLED and a
+ * 320x240 TFT, against a made up NodeDB, text message and GPS fix.  For each it prints the render time per frame, the
+ * bytes each frame would put on the bus (all of the buffer for the OLED, the changed spans TFTDisplay sends for the TFT)
+ * and heap allocations per frame.  The frames step deterministically, each node frame showing the next node along, so runs
+ * compare.  Run once setup() is done, as it uses the real screen, nodeDB and config.
+ */
+void runScreenBenchmark(uint32_t frames);
@@ -5,6 +5,7 @@
 SimRadio::SimRadio() : NotifiedWorkerThread("SimRadio")
 {
     instance = this;
+    setPriority(PRIORITY_RADIO);
 }
 
 SimRadio *SimRadio::instance;
@@ -13,10 +14,17 @@ ErrorCode SimRadio::send(meshtastic_MeshPacket *p)
 {
     printPacket("enqueuing for send", p);
 
-    ErrorCode res = txQueue.enqueue(p) ? ERRNO_OK : ERRNO_UNKNOWN;
+    WirePacket *w = WirePacket::fromMeshPacket(p);
+    packetPool.release(p);
+    if (!w) {
+        LOG_WARN("Out of memory, dropping tx packet\n");
+        return ERRNO_UNKNOWN;
+    }
+
+    ErrorCode res = txQueue.enqueue(w) ? ERRNO_OK : ERRNO_UNKNOWN;
 
     if (res != ERRNO_OK) { // we weren't able to queue it, so we must drop it to prevent leaks
-        packetPool.release(p);
+        WirePacket::release(w);
         return res;
     }
 
@@ -29,7 +37,7 @@ ErrorCode SimRadio::send(meshtastic_MeshPacket *p)
 
 void SimRadio::setTransmitDelay()
 {
-    meshtastic_MeshPacket *p = txQueue.getFront();
+    WirePacket *p = txQueue.getFront();
     // We want all sending/receiving to be done by our daemon thread.
     // We use a delay here because this packet might have been sent in response to a packet we just received.
     // So we want to make sure the other side has had a chance to reconfigure its radio.
@@ -42,7 +50,7 @@ void SimRadio::setTransmitDelay()
         startTransmitTimer(true);
     } else {
         // If there is a SNR, start a timer scaled based on that SNR.
-        LOG_DEBUG("rx_snr found. hop_limit:%d rx_snr:%f\n", p->hop_limit, p->rx_snr);
+        LOG_DEBUG("rx_snr found. hop_limit:%d rx_snr:%f\n", p->getHopLimit(), p->rx_snr);
         startTransmitTimerSNR(p->rx_snr);
     }
 }
@@ -87,7 +95,7 @@ void SimRadio::completeSending()
         printPacket("Completed sending", p);
 
         // We are done sending that packet, release it
-        packetPool.release(p);
+        WirePacket::release(p);
         // LOG_DEBUG("Done with send\n");
     }
 }
@@ -113,20 +121,23 @@ bool SimRadio::canSendImmediately()
 
 bool SimRadio::isActivelyReceiving()
 {
-    return false; // TODO check how this should be simulated
+    return receivingPacket != NULL;
 }
 
 bool SimRadio::isChannelActive()
 {
-    return false; // TODO ask simulator
+    return receivingPacket != NULL; // the simulator tells us about each packet as it starts, so we always know
 }
 
 /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-bool SimRadio::cancelSending(NodeNum from, PacketId id)
+bool SimRadio::cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec)
 {
     auto p = txQueue.remove(from, id);
-    if (p)
-        packetPool.release(p); // free the packet we just removed
+    if (p) {
+        if (airtimeMsec)
+            *airtimeMsec = getPacketTime(p);
+        WirePacket::release(p); // free the packet we just removed
+    }
 
     bool result = (p != NULL);
     LOG_DEBUG("cancelSending id=0x%x, removed=%d\n", id, result);
@@ -142,6 +153,7 @@ void SimRadio::onNotify(uint32_t notification)
         startTransmitTimer();
         break;
     case ISR_RX:
+        handleReceiveInterrupt();
         //  LOG_DEBUG("rx complete - starting timer\n");
         startTransmitTimer();
         break;
@@ -157,17 +169,25 @@ void SimRadio::onNotify(uint32_t notification)
             } else {
                 if (isChannelActive()) { // check if there is currently a LoRa packet on the channel
                     // LOG_DEBUG("Channel is active: set random delay\n");
+                    contention.onChannelBusy();
                     setTransmitDelay(); // reset random delay
                 } else {
+                    contention.onChannelClear();
                     // Send any outgoing packets we have ready
-                    meshtastic_MeshPacket *txp = txQueue.dequeue();
+                    WirePacket *txp = txQueue.dequeue();
                     assert(txp);
+                    NodeNum from = txp->header.from;
+                    uint32_t xmitMsec = getPacketTime(txp); // before startSend(), which may release it
                     startSend(txp);
-                    // Packet has been sent, count it toward our TX airtime utilization.
-                    uint32_t xmitMsec = getPacketTime(txp);
-                    airTime->logAirtime(TX_LOG, xmitMsec);
-
-                    notifyLater(xmitMsec, ISR_TX, false); // Model the time it is busy sending
+                    if (sendingPacket) {
+                        // Packet has been sent, count it toward our TX airtime utilization.
+                        airTime->logAirtime(TX_LOG, xmitMsec);
+                        airTime->logNodeAirtime(from, xmitMsec);
+
+                        notifyLater(xmitMsec, ISR_TX, false); // Model the time it is busy sending
+                    } else {
+                        startTransmitTimer(); // on to the next one, if any
+                    }
                 }
             }
         } else {
@@ -180,11 +200,18 @@ void SimRadio::onNotify(uint32_t notification)
 }
 
 /** start an immediate transmit */
-void SimRadio::startSend(meshtastic_MeshPacket *txp)
+void SimRadio::startSend(WirePacket *txp)
 {
     printPacket("Starting low level send", txp);
     size_t numbytes = beginSending(txp);
-    meshtastic_MeshPacket *p = packetPool.allocCopy(*txp);
+    meshtastic_MeshPacket *p = txp->toMeshPacket();
+    if (!p) {
+        LOG_WARN("packetPool is empty, not sending back to simulator\n");
+        // It never went on the air, so we're not busy sending it
+        sendingPacket = NULL;
+        WirePacket::release(txp);
+        return;
+    }
     perhapsDecode(p);
     meshtastic_Compressed c = meshtastic_Compressed_init_default;
     c.portnum = p->decoded.portnum;
@@ -205,11 +232,57 @@ void SimRadio::startSend(meshtastic_MeshPacket *txp)
 
 void SimRadio::startReceive(meshtastic_MeshPacket *p)
 {
+    uint32_t now = millis();
+    uint32_t xmitMsec = getPacketTime(getPacketLength(p));
+
+    // Like a real radio we are half duplex, anything which starts while we are sending is lost to us
+    if (sendingPacket) {
+        rxWhileSending++;
+        rxBad++;
+        airTime->logAirtime(RX_ALL_LOG, xmitMsec);
+        LOG_DEBUG("Simulated packet arrived while we were sending, lost (%u so far)\n", rxWhileSending);
+        return;
+    }
+
+    if (receivingPacket) {
+        rxCollisions++;
+        if (p->rx_snr < receivingPacket->rx_snr + CAPTURE_THRESHOLD_DB) {
+            // Unless the packet we were already receiving is much stronger, the two garble each other and we stay busy until
+            // the later of them finishes
+            airTime->logAirtime(RX_ALL_LOG, xmitMsec);
+            if (p->rx_snr > receivingPacket->rx_snr - CAPTURE_THRESHOLD_DB) {
+                rxCollided = true;
+                if ((int32_t)(now + xmitMsec - rxEndMsec) > 0) {
+                    rxEndMsec = now + xmitMsec;
+                    notifyLater(xmitMsec, ISR_RX, true);
+                }
+            }
+            LOG_DEBUG("Simulated collision with 0x%x (snr %.1f vs %.1f, %u so far)\n", p->from, p->rx_snr,
+                      receivingPacket->rx_snr, rxCollisions);
+            return;
+        }
+
+        // The newcomer is strong enough to capture our receiver, so what we had so far is lost
+        LOG_DEBUG("Simulated packet from 0x%x captured the receiver (%u collisions so far)\n", p->from, rxCollisions);
+        airTime->logAirtime(RX_ALL_LOG, getPacketTime(getPacketLength(receivingPacket)));
+        rxBad++;
+        packetPool.release(receivingPacket);
+        receivingPacket = NULL;
+    }
+
+    receivingPacket = packetPool.tryAllocCopy(*p); // keep a copy in packetPool
+    if (!receivingPacket) {
+        LOG_WARN("packetPool is running low, dropping received packet\n");
+        return;
+    }
+
+    rxCollided = false;
+    rxEndMsec = now + xmitMsec;
     isReceiving = true;
-    size_t length = getPacketLength(p);
-    uint32_t xmitMsec = getPacketTime(length);
-    delay(xmitMsec); // Model the time it is busy receiving
-    handleReceiveInterrupt(p);
+
+    // Model the time it is busy receiving, this supersedes any transmit delay we were waiting for (like a real radio's
+    // interrupt does), we start a new one once the packet is done
+    notifyLater(xmitMsec, ISR_RX, true);
 }
 
 meshtastic_QueueStatus SimRadio::getQueueStatus()
@@ -219,32 +292,43 @@ meshtastic_QueueStatus SimRadio::getQueueStatus()
     qs.res = qs.mesh_packet_id = 0;
     qs.free = txQueue.getFree();
     qs.maxlen = txQueue.getMaxLen();
+    txQueue.printDropped(); // QueueStatus has no room for these, so at least get them into the log
 
     return qs;
 }
 
-void SimRadio::handleReceiveInterrupt(meshtastic_MeshPacket *p)
+void SimRadio::handleReceiveInterrupt()
 {
     LOG_DEBUG("HANDLE RECEIVE INTERRUPT\n");
     uint32_t xmitMsec;
 
-    if (!isReceiving) {
+    meshtastic_MeshPacket *mp = receivingPacket;
+    if (!isReceiving || !mp) {
         LOG_DEBUG("*** WAS_ASSERT *** handleReceiveInterrupt called when not in receive mode\n");
         return;
     }
 
     isReceiving = false;
+    receivingPacket = NULL;
 
     // read the number of actually received bytes
-    size_t length = getPacketLength(p);
+    size_t length = getPacketLength(mp);
     xmitMsec = getPacketTime(length);
-    // LOG_DEBUG("Payload size %d vs length (includes header) %d\n", p->decoded.payload.size, length);
+    // LOG_DEBUG("Payload size %d vs length (includes header) %d\n", mp->decoded.payload.size, length);
 
-    meshtastic_MeshPacket *mp = packetPool.allocCopy(*p); // keep a copy in packetPool
+    if (rxCollided) {
+        LOG_DEBUG("Simulated packet from 0x%x was garbled by a collision\n", mp->from);
+        rxBad++;
+        airTime->logAirtime(RX_ALL_LOG, xmitMsec);
+        packetPool.release(mp);
+        return;
+    }
 
+    rxGood++;
     printPacket("Lora RX", mp);
 
     airTime->logAirtime(RX_LOG, xmitMsec);
+    airTime->logNodeAirtime(mp->from, xmitMsec);
 
     deliverToReceiver(mp);
 }
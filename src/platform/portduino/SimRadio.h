@@ -18,6 +18,19 @@ class SimRadio : public RadioInterface, protected concurrency::NotifiedWorkerThr
 
     MeshPacketQueue txQueue = MeshPacketQueue(MAX_TX_QUEUE);
 
+    /// The packet we are hearing right now (from packetPool), NULL if the channel is quiet
+    meshtastic_MeshPacket *receivingPacket = NULL;
+
+    /// When the last packet overlapping receivingPacket finishes, and whether one did (which garbles it)
+    uint32_t rxEndMsec = 0;
+    bool rxCollided = false;
+
+    /// Collisions and packets we missed because we were sending, for debugging the mesh simulator
+    uint32_t rxCollisions = 0, rxWhileSending = 0;
+
+    /// A packet this much stronger than the one it overlaps still gets through (LoRa's capture effect)
+    static constexpr float CAPTURE_THRESHOLD_DB = 6;
+
   public:
     SimRadio();
 
@@ -35,11 +48,17 @@ class SimRadio : public RadioInterface, protected concurrency::NotifiedWorkerThr
      */
     virtual bool isActivelyReceiving();
 
-    /** Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel */
-    virtual bool cancelSending(NodeNum from, PacketId id) override;
+    virtual size_t getFreeTxSlots() override { return txQueue.getFree(); }
+
+    /**
+     * Attempt to cancel a previously sent packet.  Returns true if a packet was found we could cancel, and if airtimeMsec is
+     * given sets it to how long that packet would have been on the air
+     */
+    virtual bool cancelSending(NodeNum from, PacketId id, uint32_t *airtimeMsec = NULL) override;
 
     /**
-     * Start waiting to receive a message
+     * The simulator has just started a packet on the air within our range (with rx_snr and rx_rssi saying how well we hear
+     * it).  We are busy receiving it for its airtime and only deliver it if nothing else overlapped it in the meantime.
      *
      * External functions can call this method to wake the device from sleep.
      */
@@ -61,12 +80,12 @@ class SimRadio : public RadioInterface, protected concurrency::NotifiedWorkerThr
     void startTransmitTimerSNR(float snr);
 
     void handleTransmitInterrupt();
-    void handleReceiveInterrupt(meshtastic_MeshPacket *p);
+    void handleReceiveInterrupt();
 
     void onNotify(uint32_t notification);
 
     // start an immediate transmit
-    virtual void startSend(meshtastic_MeshPacket *txp);
+    virtual void startSend(WirePacket *txp);
 
     // derive packet length
     size_t getPacketLength(meshtastic_MeshPacket *p);
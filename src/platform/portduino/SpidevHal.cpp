@@ -0,0 +1,224 @@
+#include "SpidevHal.h"
+
+#if PORTDUINO_SPIDEV_HAL
+
+#include "PortduinoGlue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+SpidevStats spidevStats;
+
+static uint64_t monotonicUsec()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool SpidevStats::getSummaryLine(uint8_t line, char *buf, size_t bufLen)
+{
+    switch (line) {
+    case 0:
+        // each transfer used to be one ioctl per byte
+        snprintf(buf, bufLen, "spi n=%u bytes=%u avg=%uus max=%uus ioctls saved=%u", transfers, bytes,
+                 transfers ? (uint32_t)(transferUsec / transfers) : 0, maxTransferUsec, bytes - transfers);
+        return true;
+    case 1:
+        snprintf(buf, bufLen, "irq n=%u avg=%uus max=%uus", irqs, irqs ? (uint32_t)(irqUsec / irqs) : 0, maxIrqUsec);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void SpidevStats::log()
+{
+    char line[96];
+    for (uint8_t i = 0; i < NUM_SUMMARY_LINES; i++) {
+        getSummaryLine(i, line, sizeof(line));
+        LOG_DEBUG("Spidev %s\n", line);
+    }
+}
+
+SpidevHal::SpidevHal(SPIClass &spi, SPISettings spiSettings, const char *device, uint32_t _hz, int gpiochip, int _irqPin)
+    : LockingArduinoHal(spi, spiSettings), hz(_hz), irqPin(_irqPin), irqCb(NULL), irqMode(0)
+{
+    if (!openSpi(device))
+        LOG_WARN("Can't open %s (%s), using the framework's SPI\n", device, strerror(errno));
+
+    if (irqPin != RADIOLIB_NC && !openIrq(gpiochip)) {
+        // The framework polls the pin instead, once it has it
+        LOG_WARN("Can't have IRQ events for GPIO%d (%s), using the framework's\n", irqPin, strerror(errno));
+        initGPIOPin(irqPin, "gpiochip" + std::to_string(gpiochip));
+    }
+}
+
+SpidevHal::~SpidevHal()
+{
+    if (irqThread.joinable()) {
+        char c = 0;
+        if (write(stopFds[1], &c, 1) == 1)
+            irqThread.join();
+        else
+            irqThread.detach();
+    }
+    for (int fd : {spiFd, irqFd, stopFds[0], stopFds[1]})
+        if (fd >= 0)
+            close(fd);
+}
+
+bool SpidevHal::openSpi(const char *device)
+{
+    spiFd = open(device, O_RDWR);
+    if (spiFd < 0)
+        return false;
+
+    uint8_t mode = SPI_MODE_0, bits = 8;
+    if (ioctl(spiFd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &hz) < 0) {
+        close(spiFd);
+        spiFd = -1;
+        return false;
+    }
+    LOG_INFO("Radio SPI on %s at %uHz, one ioctl per transfer\n", device, hz);
+    return true;
+}
+
+bool SpidevHal::openIrq(int gpiochip)
+{
+    std::string chip = "/dev/gpiochip" + std::to_string(gpiochip);
+    int chipFd = open(chip.c_str(), O_RDWR);
+    if (chipFd < 0)
+        return false;
+
+    // Both edges, as we don't know yet which RadioLib wants: irqLoop() ignores the other
+    gpioevent_request req = {};
+    req.lineoffset = irqPin;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+    strncpy(req.consumer_label, "meshtastic irq", sizeof(req.consumer_label) - 1);
+    int err = ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &req);
+    int savedErrno = errno;
+    close(chipFd);
+    if (err < 0 || pipe(stopFds) < 0) {
+        if (err >= 0)
+            close(req.fd);
+        errno = savedErrno;
+        return false;
+    }
+    irqFd = req.fd;
+    irqThread = std::thread(&SpidevHal::irqLoop, this);
+    LOG_INFO("Radio IRQ on %s line %d, as edge events\n", chip.c_str(), irqPin);
+    return true;
+}
+
+void SpidevHal::spiTransfer(uint8_t *out, size_t len, uint8_t *in)
+{
+    if (spiFd < 0) {
+        ArduinoHal::spiTransfer(out, len, in);
+        return;
+    }
+
+    spi_ioc_transfer xfer = {};
+    xfer.tx_buf = (uintptr_t)out;
+    xfer.rx_buf = (uintptr_t)in;
+    xfer.len = len;
+    xfer.speed_hz = hz;
+    xfer.bits_per_word = 8;
+
+    uint64_t start = monotonicUsec();
+    if (ioctl(spiFd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+        LOG_ERROR("SPI transfer of %u bytes failed: %s\n", (unsigned)len, strerror(errno));
+        memset(in, 0, len);
+        return;
+    }
+    uint32_t usec = monotonicUsec() - start;
+
+    spidevStats.transfers++;
+    spidevStats.bytes += len;
+    spidevStats.transferUsec += usec;
+    if (usec > spidevStats.maxTransferUsec)
+        spidevStats.maxTransferUsec = usec;
+}
+
+void SpidevHal::attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode)
+{
+    if (!isIrq(interruptNum)) {
+        ArduinoHal::attachInterrupt(interruptNum, interruptCb, mode);
+        return;
+    }
+    irqMode = mode;
+    irqCb = interruptCb;
+}
+
+void SpidevHal::detachInterrupt(uint32_t interruptNum)
+{
+    if (isIrq(interruptNum))
+        irqCb = NULL;
+    else
+        ArduinoHal::detachInterrupt(interruptNum);
+}
+
+uint32_t SpidevHal::digitalRead(uint32_t pin)
+{
+    if (irqFd < 0 || (int)pin != irqPin)
+        return ArduinoHal::digitalRead(pin);
+
+    gpiohandle_data data = {};
+    if (ioctl(irqFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
+        return 0;
+    return data.values[0];
+}
+
+void SpidevHal::irqLoop()
+{
+    pollfd fds[2] = {{irqFd, POLLIN, 0}, {stopFds[0], POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Waiting for radio IRQs failed: %s\n", strerror(errno));
+            return;
+        }
+        if (fds[1].revents)
+            return;
+
+        gpioevent_data event;
+        if (read(irqFd, &event, sizeof(event)) != sizeof(event))
+            continue;
+
+        void (*cb)(void) = irqCb;
+        uint32_t mode = irqMode;
+        bool rising = event.id == GPIOEVENT_EVENT_RISING_EDGE;
+        if (!cb || (mode == GpioInterruptRising && !rising) || (mode == GpioInterruptFalling && rising))
+            continue;
+
+        // Since Linux 5.7 the kernel stamps events by CLOCK_MONOTONIC, before that by the wall clock, which we don't count
+        uint64_t now = monotonicUsec(), at = event.timestamp / 1000;
+        if (at <= now && now - at < 1000000) {
+            uint32_t usec = now - at;
+            spidevStats.irqs++;
+            spidevStats.irqUsec += usec;
+            if (usec > spidevStats.maxIrqUsec)
+                spidevStats.maxIrqUsec = usec;
+        }
+        cb();
+    }
+}
+
+LockingArduinoHal *newSpidevHal(SPIClass &spi, SPISettings spiSettings)
+{
+    int irqPin = portduinoSettings.irq;
+    return new SpidevHal(spi, spiSettings, portduinoSettings.spidev.c_str(), portduinoSettings.spiSpeed,
+                         portduinoSettings.gpiochip, irqPin);
+}
+
+#endif
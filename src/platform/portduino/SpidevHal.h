@@ -0,0 +1,74 @@
+#pragma once
+
+#include "configuration.h"
+
+#if PORTDUINO_SPIDEV_HAL
+
+#include "mesh/RadioLibInterface.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+/// What our radio's SPI transfers and IRQs cost, the latter from the kernel seeing the edge to our handler running
+struct SpidevStats {
+    uint32_t transfers = 0, bytes = 0;
+    uint64_t transferUsec = 0;
+    uint32_t maxTransferUsec = 0;
+    uint32_t irqs = 0;
+    uint64_t irqUsec = 0;
+    uint32_t maxIrqUsec = 0;
+
+    static const uint8_t NUM_SUMMARY_LINES = 2;
+
+    /// Like RadioStats::getSummaryLine().  @return false if there is no such line
+    bool getSummaryLine(uint8_t line, char *buf, size_t bufLen);
+
+    void log();
+};
+
+extern SpidevStats spidevStats;
+
+/**
+ * The radio HAL for Linux.  The framework's SPI shim makes an ioctl of each byte RadioLib sends, so reading a 255 byte FIFO
+ * costs hundreds of syscalls.  RadioLib already gathers each command and its data into one buffer, which we send as one
+ * SPI_IOC_MESSAGE on our own spidev handle.  Its IRQ line we request from the GPIO chardev for edge events, and a thread
+ * blocks on them, so no one polls the pin.
+ *
+ * Should either handle not open we fall back to the framework's, as LockingArduinoHal would.
+ */
+class SpidevHal : public LockingArduinoHal
+{
+  public:
+    /// device is the spidev (e.g. /dev/spidev0.0) we clock at hz, irqPin the radio's IRQ line on /dev/gpiochip<gpiochip>
+    SpidevHal(SPIClass &spi, SPISettings spiSettings, const char *device, uint32_t hz, int gpiochip, int irqPin);
+    ~SpidevHal();
+
+    void spiTransfer(uint8_t *out, size_t len, uint8_t *in) override;
+
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override;
+    void detachInterrupt(uint32_t interruptNum) override;
+    uint32_t digitalRead(uint32_t pin) override;
+
+  private:
+    int spiFd = -1;
+    uint32_t hz;
+
+    int irqPin;
+    int irqFd = -1;            // the line's event handle, -1 if we left the pin to the framework
+    int stopFds[2] = {-1, -1}; // a pipe, to wake irqThread when we're done
+    std::thread irqThread;
+    std::atomic<void (*)(void)> irqCb;
+    std::atomic<uint32_t> irqMode;
+
+    bool openSpi(const char *device);
+    bool openIrq(int gpiochip);
+    bool isIrq(uint32_t interruptNum) { return irqFd >= 0 && interruptNum == pinToInterrupt(irqPin); }
+
+    void irqLoop();
+};
+
+/// The HAL for our radio, on the spidev (at its spiSpeed), gpiochip and IRQ pin of our config
+LockingArduinoHal *newSpidevHal(SPIClass &spi, SPISettings spiSettings);
+
+#endif
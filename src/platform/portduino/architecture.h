@@ -11,6 +11,23 @@
 #ifndef HAS_WIFI
 #define HAS_WIFI 1
 #endif
+
+// Linux gateway mode, for a Pi serving many API clients: the radio and the Router get a thread of their own (USE_PACKET_TASK)
+// and the TCP API is served from epoll (see EpollAPIServer.h) rather than by a thread per client polling its socket.  Opt in
+// with -DPORTDUINO_GATEWAY=1
+#ifndef PORTDUINO_GATEWAY
+#define PORTDUINO_GATEWAY 0
+#endif
+#if PORTDUINO_GATEWAY && !defined(USE_PACKET_TASK)
+#define USE_PACKET_TASK 1
+#endif
+
+// Talk to the radio through our own spidev and GPIO chardev handles (see SpidevHal.h), one ioctl per RadioLib transfer and
+// a blocking wait for its IRQ line, rather than through the framework's SPI and GPIO shims.  Its SPI clock is spiSpeed in
+// the Lora section of our config.  Opt in with -DPORTDUINO_SPIDEV_HAL=1
+#ifndef PORTDUINO_SPIDEV_HAL
+#define PORTDUINO_SPIDEV_HAL 0
+#endif
 #ifndef HAS_RTC
 #define HAS_RTC 1
 #endif
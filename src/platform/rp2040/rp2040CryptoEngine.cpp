@@ -6,17 +6,23 @@
 class RP2040CryptoEngine : public CryptoEngine
 {
 
-    CTRCommon *ctr = NULL;
+    /// One cipher per key slot, so switching channels doesn't reallocate and rekey
+    CTRCommon *ctrs[CRYPTO_KEY_SLOTS] = {};
 
   public:
     RP2040CryptoEngine() {}
 
-    ~RP2040CryptoEngine() {}
+    ~RP2040CryptoEngine()
+    {
+        for (int i = 0; i < CRYPTO_KEY_SLOTS; i++)
+            delete ctrs[i];
+    }
 
     virtual void setKey(const CryptoKey &k) override
     {
         CryptoEngine::setKey(k);
         LOG_DEBUG("Installing AES%d key!\n", key.length * 8);
+        CTRCommon *&ctr = ctrs[activeSlot];
         if (ctr) {
             delete ctr;
             ctr = NULL;
@@ -45,6 +51,7 @@ class RP2040CryptoEngine : public CryptoEngine
                 memset(scratch + numBytes, 0,
                        sizeof(scratch) - numBytes); // Fill rest of buffer with zero (in case cypher looks at it)
 
+                CTRCommon *ctr = ctrs[activeSlot];
                 ctr->setIV(nonce, sizeof(nonce));
                 ctr->setCounterSize(4);
                 ctr->encrypt(bytes, scratch, numBytes);
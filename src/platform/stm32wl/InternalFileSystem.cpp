@@ -24,6 +24,7 @@
 
 #include "InternalFileSystem.h"
 #include <EEPROM.h>
+#include <stm32_eeprom.h>
 
 //--------------------------------------------------------------------+
 // LFS Disk IO
@@ -34,17 +35,34 @@ static inline uint32_t lba2addr(uint32_t block)
     return ((uint32_t)LFS_FLASH_ADDR) + block * LFS_BLOCK_SIZE;
 }
 
+// The whole filesystem is the one flash page the EEPROM library emulates, and every EEPROM.read() copies that page into RAM
+// while every EEPROM.update() which changes a byte erases and reprograms it.  So we use the library's own RAM copy of the page
+// instead: read once at mount, then read from and written in RAM, and only programmed back to flash (one erase, one program)
+// when LittleFS syncs, or when the last of a batch of writes is done (see InternalFileSystem::beginBatch()).
+static uint8_t lfs_read_buffer[LFS_CACHE_SIZE] = {0};
+static uint8_t lfs_prog_buffer[LFS_CACHE_SIZE] = {0};
+static uint8_t lfs_lookahead_buffer[LFS_LOOKAHEAD_SIZE] = {0};
+
+static bool dirty;
+static uint8_t batchDepth;
+static uint32_t numFlushes;
+
+static void flush()
+{
+    if (dirty) {
+        eeprom_buffer_flush();
+        dirty = false;
+        numFlushes++;
+    }
+}
+
 static int _internal_flash_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
 {
     (void)c;
 
     uint32_t addr = lba2addr(block) + off;
-    uint8_t prom;
-
-    for (int i = 0; i < size; i++) {
-        prom = EEPROM.read(addr + i);
-        memcpy((char *)buffer + i, &prom, 1);
-    }
+    for (lfs_size_t i = 0; i < size; i++)
+        ((uint8_t *)buffer)[i] = eeprom_buffered_read_byte(addr + i);
     return 0;
 }
 
@@ -56,12 +74,9 @@ static int _internal_flash_prog(const struct lfs_config *c, lfs_block_t block, l
     (void)c;
 
     uint32_t addr = lba2addr(block) + off;
-    uint8_t prom;
-
-    for (int i = 0; i < size; i++) {
-        memcpy(&prom, (char *)buffer + i, 1);
-        EEPROM.update(addr + i, prom);
-    }
+    for (lfs_size_t i = 0; i < size; i++)
+        eeprom_buffered_write_byte(addr + i, ((const uint8_t *)buffer)[i]);
+    dirty = true;
     return 0;
 }
 
@@ -75,10 +90,10 @@ static int _internal_flash_erase(const struct lfs_config *c, lfs_block_t block)
 
     uint32_t addr = lba2addr(block);
 
-    // implement as write 0xff to whole block address
-    for (int i = 0; i < LFS_BLOCK_SIZE; i++) {
-        EEPROM.update(addr, 0xff);
-    }
+    // implement as write 0xff to whole block address (in our RAM copy, the page itself is erased when we flush)
+    for (int i = 0; i < LFS_BLOCK_SIZE; i++)
+        eeprom_buffered_write_byte(addr + i, 0xff);
+    dirty = true;
 
     return 0;
 }
@@ -87,7 +102,10 @@ static int _internal_flash_erase(const struct lfs_config *c, lfs_block_t block)
 // are propagated to the user.
 static int _internal_flash_sync(const struct lfs_config *c)
 {
-    // we don't use a ram cache, this is a noop
+    (void)c;
+
+    if (!batchDepth)
+        flush();
     return 0;
 }
 
@@ -98,14 +116,14 @@ static struct lfs_config _InternalFSConfig = {.context = NULL,
                                               .erase = _internal_flash_erase,
                                               .sync = _internal_flash_sync,
 
-                                              .read_size = LFS_CACHE_SIZE,
-                                              .prog_size = LFS_CACHE_SIZE,
+                                              .read_size = LFS_READ_SIZE,
+                                              .prog_size = LFS_READ_SIZE,
                                               .block_size = LFS_BLOCK_SIZE,
                                               .block_count = LFS_FLASH_TOTAL_SIZE / LFS_BLOCK_SIZE,
                                               .block_cycles =
                                                   500, // protection against wear leveling (suggested values between 100-1000)
                                               .cache_size = LFS_CACHE_SIZE,
-                                              .lookahead_size = LFS_CACHE_SIZE,
+                                              .lookahead_size = LFS_LOOKAHEAD_SIZE,
 
                                               .read_buffer = lfs_read_buffer,
                                               .prog_buffer = lfs_prog_buffer,
@@ -121,16 +139,20 @@ InternalFileSystem::InternalFileSystem(void) : LittleFS(&_InternalFSConfig) {}
 
 bool InternalFileSystem::begin(void)
 {
+    eeprom_buffer_fill(); // our RAM copy of the filesystem
+
     // failed to mount, erase all sector then format and mount again
     if (!LittleFS::begin()) {
         // Erase all sectors of internal flash region for Filesystem.
         // implement as write 0xff to whole block address
         for (uint32_t addr = LFS_FLASH_ADDR; addr < (LFS_FLASH_ADDR + LFS_FLASH_TOTAL_SIZE); addr++) {
-            EEPROM.update(addr, 0xff);
+            eeprom_buffered_write_byte(addr, 0xff);
         }
+        dirty = true;
 
         // lfs format
         this->format();
+        flush(); // in case format() didn't sync
 
         // mount again if still failed, give up
         if (!LittleFS::begin())
@@ -139,3 +161,19 @@ bool InternalFileSystem::begin(void)
 
     return true;
 }
+
+void InternalFileSystem::beginBatch()
+{
+    batchDepth++;
+}
+
+void InternalFileSystem::endBatch()
+{
+    if (batchDepth && !--batchDepth)
+        flush();
+}
+
+uint32_t InternalFileSystem::getNumFlushes() const
+{
+    return numFlushes;
+}
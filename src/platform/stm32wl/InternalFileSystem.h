@@ -32,13 +32,18 @@
 
 // use the built in EEPROM emulation. Total Size is 2Kbyte
 #define LFS_BLOCK_SIZE 128 // min. block size is 128 to fit CTZ pointers
-#define LFS_CACHE_SIZE 16
+#define LFS_READ_SIZE 16
+
+// Reads and writes come from our RAM copy of the page, so a whole block of cache saves LittleFS calling us for every 16 bytes
+#ifndef LFS_CACHE_SIZE
+#define LFS_CACHE_SIZE LFS_BLOCK_SIZE
+#endif
 
 #define LFS_FLASH_TOTAL_SIZE FLASH_PAGE_SIZE
 
-static uint8_t lfs_read_buffer[LFS_CACHE_SIZE] = {0};
-static uint8_t lfs_prog_buffer[LFS_CACHE_SIZE] = {0};
-static uint8_t lfs_lookahead_buffer[LFS_CACHE_SIZE] = {0};
+// One bit per block, and there are only LFS_FLASH_TOTAL_SIZE / LFS_BLOCK_SIZE (16) of them, so the smallest LittleFS allows
+// covers the whole filesystem in one pass
+#define LFS_LOOKAHEAD_SIZE 8
 
 class InternalFileSystem : public LittleFS
 {
@@ -47,6 +52,14 @@ class InternalFileSystem : public LittleFS
 
     // overwrite to also perform low level format (sector erase of whole flash region)
     bool begin(void);
+
+    /// Hold what LittleFS writes in RAM until the matching endBatch(), so saving several files costs one erase of our flash
+    /// page rather than one for each of LittleFS's commits.  Batches nest
+    void beginBatch();
+    void endBatch();
+
+    /// How many times we've erased and programmed our flash page
+    uint32_t getNumFlushes() const;
 };
 
 extern InternalFileSystem InternalFS;
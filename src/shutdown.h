@@ -2,6 +2,10 @@
 #include "configuration.h"
 #include "graphics/Screen.h"
 #include "main.h"
+#include "mesh/PacketCapture.h"
+#include "modules/RangeTestLog.h"
+#include "modules/Telemetry/TelemetryHistory.h"
+#include "modules/Telemetry/TelemetryHistory.h"
 #include "power.h"
 #if defined(ARCH_PORTDUINO)
 #include "api/WiFiServerAPI.h"
@@ -13,6 +17,15 @@ void powerCommandsCheck()
 {
     if (rebootAtMsec && millis() > rebootAtMsec) {
         LOG_INFO("Rebooting\n");
+        nodeDB.flushPendingSaves();
+        rangeTestLog.flush();
+#if TELEMETRY_HISTORY
+        telemetryHistory.flush();
+#endif
+#if PACKET_CAPTURE
+        if (packetCapture)
+            packetCapture->flush();
+#endif
 #if defined(ARCH_ESP32)
         ESP.restart();
 #elif defined(ARCH_NRF52)
@@ -41,6 +54,15 @@ void powerCommandsCheck()
 
     if (shutdownAtMsec && millis() > shutdownAtMsec) {
         LOG_INFO("Shutting down from admin command\n");
+        nodeDB.flushPendingSaves();
+        rangeTestLog.flush();
+#if TELEMETRY_HISTORY
+        telemetryHistory.flush();
+#endif
+#if PACKET_CAPTURE
+        if (packetCapture)
+            packetCapture->flush();
+#endif
 #if defined(ARCH_NRF52) || defined(ARCH_ESP32)
         playShutdownMelody();
         power->shutdown();
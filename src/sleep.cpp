@@ -1,4 +1,5 @@
 #include "sleep.h"
+#include "EnergyStats.h"
 #include "GPS.h"
 #include "MeshRadio.h"
 #include "MeshService.h"
@@ -255,6 +256,7 @@ esp_sleep_wakeup_cause_t doLightSleep(uint64_t sleepMsec) // FIXME, use a more r
     // LOG_DEBUG("Enter light sleep\n");
 
     waitEnterSleep(false);
+    nodeDB.flushPendingSaves(); // don't leave queued writes sitting in RAM while we sleep
 
     uint64_t sleepUsec = sleepMsec * 1000LL;
 
@@ -316,7 +318,9 @@ esp_sleep_wakeup_cause_t doLightSleep(uint64_t sleepMsec) // FIXME, use a more r
         LOG_DEBUG("esp_sleep_enable_timer_wakeup result %d\n", res);
     }
     assert(res == ESP_OK);
+    uint32_t sleepStart = millis();
     res = esp_light_sleep_start();
+    energyStats.addSleep(millis() - sleepStart);
     if (res != ESP_OK) {
         LOG_DEBUG("esp_light_sleep_start result %d\n", res);
     }
@@ -360,4 +364,74 @@ void enableModemSleep()
     int rv = esp_pm_configure(&esp32_config);
     LOG_DEBUG("Sleep request result %x\n", rv);
 }
+
+#if ESP32_AUTO_LIGHT_SLEEP && defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+#define HAS_AUTO_LIGHT_SLEEP 1
+
+/// Set once enableAutoLightSleep() has turned it on
+static bool autoLightSleepOn;
+
+/// Held while a serial client is connected
+static esp_pm_lock_handle_t serialAwakeLock;
+#endif
+
+void radioInterruptArmed()
+{
+#ifdef HAS_AUTO_LIGHT_SLEEP
+    if (!autoLightSleepOn)
+        return;
+#if defined(LORA_DIO1) && (LORA_DIO1 != RADIOLIB_NC)
+    gpio_wakeup_enable((gpio_num_t)LORA_DIO1, GPIO_INTR_HIGH_LEVEL); // SX126x/SX128x interrupt, active high
+#endif
+#ifdef RF95_IRQ
+    gpio_wakeup_enable((gpio_num_t)RF95_IRQ, GPIO_INTR_HIGH_LEVEL); // RF95 interrupt, active high
+#endif
+#endif
+}
+
+void setSerialClientAwake(bool awake)
+{
+#ifdef HAS_AUTO_LIGHT_SLEEP
+    static bool held;
+    if (!serialAwakeLock || held == awake)
+        return;
+    held = awake;
+    if (awake)
+        esp_pm_lock_acquire(serialAwakeLock);
+    else
+        esp_pm_lock_release(serialAwakeLock);
+#endif
+}
+
+void enableAutoLightSleep()
+{
+#ifdef HAS_AUTO_LIGHT_SLEEP
+    // The wakes doLightSleep() uses, but for the PMU (which can keep waking us with no battery)
+#ifdef BUTTON_PIN
+    gpio_wakeup_enable((gpio_num_t)(config.device.button_gpio ? config.device.button_gpio : BUTTON_PIN), GPIO_INTR_LOW_LEVEL);
+#endif
+    autoLightSleepOn = true;
+    radioInterruptArmed(); // RadioLib armed it on an edge already
+    esp_sleep_enable_gpio_wakeup();
+
+#if ESP32_UART_WAKE_THRESHOLD && !ARDUINO_USB_CDC_ON_BOOT
+    // A USB CDC console is the USB stack's to wake us for, a UART counts edges on RX
+    if (uart_set_wakeup_threshold(UART_NUM_0, ESP32_UART_WAKE_THRESHOLD) == ESP_OK)
+        esp_sleep_enable_uart_wakeup(0);
+#endif
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "serial", &serialAwakeLock);
+
+    // Tickless idle sleeps until the first task's timeout, which for loop() is Scheduler::runOrDelay()'s next deadline
+    static esp_pm_config_esp32_t esp32_config;
+    esp32_config.max_freq_mhz = getCpuFrequencyMhz();
+    esp32_config.min_freq_mhz = esp32_config.max_freq_mhz; // no DFS, so our UART baud rates stay put
+    esp32_config.light_sleep_enable = true;
+    int rv = esp_pm_configure(&esp32_config);
+    LOG_DEBUG("Auto light sleep result %x\n", rv);
+    if (rv != ESP_OK)
+        autoLightSleepOn = false; // leave the radio's interrupt on its edge
+#else
+    LOG_DEBUG("Auto light sleep not built in\n");
+#endif
+}
 #endif
\ No newline at end of file
@@ -10,7 +10,35 @@ void doDeepSleep(uint32_t msecToWake, bool skipPreflight), cpuDeepSleep(uint32_t
 #include "esp_sleep.h"
 esp_sleep_wakeup_cause_t doLightSleep(uint64_t msecToWake);
 
+/// In power saving mode, let FreeRTOS light sleep the CPU whenever every task is waiting (on nrf52 its tickless idle already
+/// does), between packets and with bluetooth still connected.  Needs an SDK built with CONFIG_FREERTOS_USE_TICKLESS_IDLE, and
+/// for a BLE connection to last through our sleeps the controller's modem sleep (CONFIG_BTDM_CTRL_MODEM_SLEEP): without it
+/// the controller keeps us awake while bluetooth is on, as before
+#ifndef ESP32_AUTO_LIGHT_SLEEP
+#define ESP32_AUTO_LIGHT_SLEEP 1
+#endif
+
+/// Wake from automatic light sleep on this many rising edges on our serial port's RX, 0 not to.  The bytes which wake us are
+/// lost, our clients send a run of START2s first for that, and once one talks to us we stay awake (see setSerialClientAwake())
+#ifndef ESP32_UART_WAKE_THRESHOLD
+#define ESP32_UART_WAKE_THRESHOLD 3
+#endif
+
+void enableAutoLightSleep();
+
+/// Call after (re)arming the radio's interrupt, which RadioLib attaches on an edge - and an edge can't wake us from light sleep.
+/// With automatic light sleep on, this makes it a high level instead, which can.  Our ISR disarms the interrupt as it runs,
+/// so a level still fires once per interrupt
+void radioInterruptArmed();
+
+/// Keep us out of automatic light sleep while a client talks to us over the serial port, a UART can't receive asleep
+void setSerialClientAwake(bool awake);
+
 extern esp_sleep_source_t wakeCause;
+#else
+// Nothing sleeps automatically here unless its interrupts wake it
+inline void radioInterruptArmed() {}
+inline void setSerialClientAwake(bool awake) {}
 #endif
 
 #ifdef HAS_PMU
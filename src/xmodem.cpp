@@ -49,6 +49,7 @@
  **********************************************************************************************************************/
 
 #include "xmodem.h"
+#include "NodeDB.h"
 
 XModemAdapter xModem;
 
@@ -91,10 +92,11 @@ int XModemAdapter::check(const pb_byte_t *buf, int sz, unsigned short tcrc)
     return crc16_ccitt(buf, sz) == tcrc;
 }
 
-void XModemAdapter::sendControl(meshtastic_XModem_Control c)
+void XModemAdapter::sendControl(meshtastic_XModem_Control c, uint16_t seq)
 {
     xmodemStore = meshtastic_XModem_init_zero;
     xmodemStore.control = c;
+    xmodemStore.seq = seq;
     LOG_DEBUG("XModem: Notify Sending control %d.\n", c);
     packetReady.notifyObservers(packetno);
 }
@@ -107,6 +109,114 @@ meshtastic_XModem XModemAdapter::getForPhone()
 void XModemAdapter::resetForPhone()
 {
     xmodemStore = meshtastic_XModem_init_zero;
+    fillForPhone(); // the client is reading, so have the next block of our window ready for it
+}
+
+bool XModemAdapter::startWindow(uint16_t wanted)
+{
+    free(blocks); // left over from a transfer the client never finished
+    blocks = NULL;
+    startMsec = millis();
+    numBytes = numResent = 0;
+    pending = 0;
+    nakSent = false;
+    window = 1;
+    if (wanted < 2 || XMODEM_WINDOW_SIZE < 2)
+        return false;
+
+    uint8_t w = wanted < XMODEM_WINDOW_SIZE ? wanted : XMODEM_WINDOW_SIZE;
+    blocks = (uint8_t *)malloc(w * BLOCK_SIZE);
+    if (!blocks) {
+        LOG_WARN("XModem: No room for a window of %u blocks, doing stop and wait\n", w);
+        return false;
+    }
+    window = w;
+    base = nextSeq = nextRead = 1;
+    lastSeq = 0;
+    atEOF = false;
+    resend = 0;
+    return true;
+}
+
+void XModemAdapter::finishTransfer(const char *what)
+{
+    uint32_t msec = millis() - startMsec;
+    LOG_INFO("XModem: %s %s, %u bytes in %u ms (%u bytes/s), window %u, %u retries\n", what, filename, numBytes, msec,
+             msec ? (uint32_t)((uint64_t)numBytes * 1000 / msec) : numBytes, window, numResent);
+    free(blocks);
+    blocks = NULL;
+    window = 1;
+    pending = 0;
+}
+
+void XModemAdapter::readAhead()
+{
+    while (!atEOF && nextRead < base + window) {
+        // One read for as many blocks as are free up to the end of our ring
+        uint8_t slot = nextRead % window;
+        uint32_t n = base + window - nextRead;
+        if (n > (uint32_t)(window - slot))
+            n = window - slot;
+        int r = file.read(blocks + slot * BLOCK_SIZE, n * BLOCK_SIZE);
+        size_t got = r > 0 ? r : 0;
+        numBytes += got;
+        if (got < n * BLOCK_SIZE)
+            atEOF = true;
+
+        // and the crc16 of each of them, which we keep in case we have to send one again
+        for (; got; slot++) {
+            size_t size = got < BLOCK_SIZE ? got : BLOCK_SIZE;
+            blockSize[slot] = size;
+            blockCRC[slot] = crc16_ccitt(blocks + slot * BLOCK_SIZE, size);
+            got -= size;
+            nextRead++;
+        }
+    }
+    if (atEOF)
+        lastSeq = nextRead - 1;
+}
+
+bool XModemAdapter::fillForPhone()
+{
+    if (!isTransmitting || !blocks || xmodemStore.control != meshtastic_XModem_Control_NUL)
+        return false;
+
+    uint32_t seq;
+    if (resend) {
+        uint8_t i = 0;
+        while (!(resend & (1UL << i)))
+            i++;
+        resend &= ~(1UL << i);
+        seq = base + i;
+        numResent++;
+    } else if (nextSeq < nextRead) {
+        seq = nextSeq++;
+    } else if (atEOF && base > lastSeq) {
+        xmodemStore = meshtastic_XModem_init_zero; // the callers tell the client, resetForPhone() is called as it reads
+        xmodemStore.control = meshtastic_XModem_Control_EOT;
+        file.close();
+        isTransmitting = false;
+        finishTransfer("Sent");
+        return true;
+    } else {
+        return false;
+    }
+
+    uint8_t slot = seq % window;
+    xmodemStore = meshtastic_XModem_init_zero;
+    xmodemStore.control = meshtastic_XModem_Control_SOH;
+    xmodemStore.seq = seq;
+    xmodemStore.buffer.size = blockSize[slot];
+    memcpy(xmodemStore.buffer.bytes, blocks + slot * BLOCK_SIZE, blockSize[slot]);
+    xmodemStore.crc16 = blockCRC[slot];
+    return true;
+}
+
+void XModemAdapter::writeBlocks()
+{
+    if (pending)
+        file.write(blocks, pending);
+    pending = 0;
 }
 
 void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
@@ -118,9 +228,12 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
             // NULL packet has the destination filename
             memcpy(filename, &xmodemPacket.buffer.bytes, xmodemPacket.buffer.size);
             if (xmodemPacket.control == meshtastic_XModem_Control_SOH) { // Receive this file and put to Flash
+                nodeDB.invalidateWarmBoot(); // it might be one of our prefs files
                 file = FSCom.open(filename, FILE_O_WRITE);
                 if (file) {
+                    startWindow(xmodemPacket.crc16);
                     sendControl(meshtastic_XModem_Control_ACK);
+                    xmodemStore.crc16 = window; // so the client knows how many blocks it can send without waiting
                     isReceiving = true;
                     packetno = 1;
                     break;
@@ -131,6 +244,13 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
             } else { // Transmit this file from Flash
                 LOG_INFO("XModem: Transmitting file %s\n", filename);
                 file = FSCom.open(filename, FILE_O_READ);
+                if (file && startWindow(xmodemPacket.crc16)) {
+                    isTransmitting = true;
+                    readAhead();
+                    if (fillForPhone())
+                        packetReady.notifyObservers(nextSeq);
+                    break;
+                }
                 if (file) {
                     packetno = 1;
                     isTransmitting = true;
@@ -157,13 +277,32 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
                 if ((xmodemPacket.seq == packetno) &&
                     check(xmodemPacket.buffer.bytes, xmodemPacket.buffer.size, xmodemPacket.crc16)) {
                     // valid packet
-                    file.write(xmodemPacket.buffer.bytes, xmodemPacket.buffer.size);
-                    sendControl(meshtastic_XModem_Control_ACK);
+                    numBytes += xmodemPacket.buffer.size;
+                    if (blocks) {
+                        if (pending + xmodemPacket.buffer.size > window * BLOCK_SIZE)
+                            writeBlocks();
+                        memcpy(blocks + pending, xmodemPacket.buffer.bytes, xmodemPacket.buffer.size);
+                        pending += xmodemPacket.buffer.size;
+                    } else {
+                        file.write(xmodemPacket.buffer.bytes, xmodemPacket.buffer.size);
+                    }
+                    // If the client hasn't read our last ACK yet this one replaces it, so it gets fewer of them
+                    sendControl(meshtastic_XModem_Control_ACK, packetno);
                     packetno++;
+                    nakSent = false;
                     break;
                 }
-                // invalid packet
-                sendControl(meshtastic_XModem_Control_NAK);
+                if (blocks && xmodemPacket.seq != packetno && (uint16_t)(packetno - xmodemPacket.seq) <= window) {
+                    // one we already have, which the client sent again as it didn't see our ACK
+                    sendControl(meshtastic_XModem_Control_ACK, packetno - 1);
+                    break;
+                }
+                // invalid packet, the rest of the window after it will be too so we ask for it just once
+                if (!nakSent) {
+                    sendControl(meshtastic_XModem_Control_NAK, packetno);
+                    nakSent = blocks != NULL;
+                    numResent++;
+                }
                 break;
             } else if (isTransmitting) {
                 // just received something weird.
@@ -176,6 +315,10 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
     case meshtastic_XModem_Control_EOT:
         // End of transmission
         sendControl(meshtastic_XModem_Control_ACK);
+        if (isReceiving) {
+            writeBlocks();
+            finishTransfer("Received");
+        }
         file.flush();
         file.close();
         isReceiving = false;
@@ -183,18 +326,36 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
     case meshtastic_XModem_Control_CAN:
         // Cancel transmission and remove file
         sendControl(meshtastic_XModem_Control_ACK);
+        if (isReceiving || isTransmitting)
+            finishTransfer("Cancelled");
         file.flush();
         file.close();
-        FSCom.remove(filename);
+        if (!isTransmitting) // not the file the client was getting from us
+            FSCom.remove(filename);
         isReceiving = false;
+        isTransmitting = false;
         break;
     case meshtastic_XModem_Control_ACK:
         // Acknowledge Send the next packet
+        if (isTransmitting && blocks) {
+            // everything up to seq arrived, which frees that much of our window
+            uint32_t acked = base - 1 + (uint16_t)(xmodemPacket.seq - (uint16_t)(base - 1));
+            if (acked >= base && acked < nextSeq) {
+                resend = acked + 1 - base < 32 ? resend >> (acked + 1 - base) : 0;
+                base = acked + 1;
+                retrans = MAXRETRANS;
+                readAhead();
+            }
+            if (fillForPhone())
+                packetReady.notifyObservers(nextSeq);
+            break;
+        }
         if (isTransmitting) {
             if (isEOT) {
                 sendControl(meshtastic_XModem_Control_EOT);
+                numBytes = file.size();
                 file.close();
-                LOG_INFO("XModem: Finished sending file %s\n", filename);
+                finishTransfer("Sent");
                 isTransmitting = false;
                 isEOT = false;
                 break;
@@ -219,6 +380,21 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
         break;
     case meshtastic_XModem_Control_NAK:
         // Negative acknowledge. Send the same buffer again
+        if (isTransmitting && blocks) {
+            uint32_t seq = base + (uint16_t)(xmodemPacket.seq - (uint16_t)base);
+            if (--retrans <= 0) {
+                sendControl(meshtastic_XModem_Control_CAN);
+                file.close();
+                isTransmitting = false;
+                finishTransfer("Retransmit timeout, cancelled");
+                break;
+            }
+            if (seq < nextSeq)
+                resend |= 1UL << (seq - base);
+            if (fillForPhone())
+                packetReady.notifyObservers(nextSeq);
+            break;
+        }
         if (isTransmitting) {
             if (--retrans <= 0) {
                 sendControl(meshtastic_XModem_Control_CAN);
@@ -227,6 +403,7 @@ void XModemAdapter::handlePacket(meshtastic_XModem xmodemPacket)
                 isTransmitting = false;
                 break;
             }
+            numResent++;
             xmodemStore = meshtastic_XModem_init_zero;
             xmodemStore.control = meshtastic_XModem_Control_SOH;
             xmodemStore.seq = packetno;
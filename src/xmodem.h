@@ -38,6 +38,21 @@
 
 #define MAXRETRANS 25
 
+/// The most blocks a client can have us keep in flight at once (up to 32), 1 to only ever do stop and wait
+#ifndef XMODEM_WINDOW_SIZE
+#define XMODEM_WINDOW_SIZE 8
+#endif
+
+/**
+ * A client asks for a window by putting the number of blocks it wants in flight in the crc16 of the packet with the filename
+ * (seq 0), otherwise we do stop and wait as before.  The ACK of an upload's filename has the window we granted in its crc16.
+ *
+ * Every ACK (either way) is cumulative: its seq is the last block which arrived with everything before it.  A NAK asks for
+ * just the block in its seq.  Sending a file we keep the blocks in flight in RAM, reading them (and working out their crc16)
+ * a window at a time, so the client can NAK any of them.  Receiving a file we take blocks only in order, NAKing the first one
+ * we miss, and write them to the file a window at a time.
+ */
+
 class XModemAdapter
 {
   public:
@@ -51,6 +66,8 @@ class XModemAdapter
     void resetForPhone();
 
   private:
+    static const size_t BLOCK_SIZE = sizeof(meshtastic_XModem_buffer_t::bytes);
+
     bool isReceiving = false;
     bool isTransmitting = false;
     bool isEOT = false;
@@ -59,6 +76,26 @@ class XModemAdapter
 
     uint16_t packetno = 0;
 
+    /// How many blocks we let be in flight, 1 for stop and wait
+    uint8_t window = 1;
+
+    /// Sending with a window: the blocks in flight, block n is in slot n % window.  Receiving: what we haven't written yet
+    uint8_t *blocks = NULL;
+    uint16_t blockSize[XMODEM_WINDOW_SIZE] = {};
+    uint16_t blockCRC[XMODEM_WINDOW_SIZE] = {};
+    size_t pending = 0; // receiving: how many bytes of blocks we hold
+
+    /// Sending with a window, by block number (which seq is the bottom 16 bits of): the oldest block not yet ACKed, the next
+    /// one to send for the first time, the next one to read and the last one of the file (0 until we've read to its end)
+    uint32_t base = 1, nextSeq = 1, nextRead = 1, lastSeq = 0;
+    bool atEOF = false;
+    uint32_t resend = 0; // the blocks NAKed, bit i for block base + i
+
+    bool nakSent = false; // receiving: we've asked for the block we miss, and wait for it rather than asking again
+
+    /// For reporting the throughput of each transfer
+    uint32_t startMsec = 0, numBytes = 0, numResent = 0;
+
 #if defined(ARCH_NRF52) || defined(ARCH_STM32WL)
     File file = File(FSCom);
 #else
@@ -71,7 +108,23 @@ class XModemAdapter
     meshtastic_XModem xmodemStore = meshtastic_XModem_init_zero;
     unsigned short crc16_ccitt(const pb_byte_t *buffer, int length);
     int check(const pb_byte_t *buf, int sz, unsigned short tcrc);
-    void sendControl(meshtastic_XModem_Control c);
+    void sendControl(meshtastic_XModem_Control c, uint16_t seq = 0);
+
+    /// Start keeping wanted blocks in flight (at most XMODEM_WINDOW_SIZE), @return false to do stop and wait instead
+    bool startWindow(uint16_t wanted);
+
+    /// Free our window and log how fast the transfer went
+    void finishTransfer(const char *what);
+
+    /// Sending with a window: read as many blocks as fit in the window
+    void readAhead();
+
+    /// Sending with a window: put the next block the client should get (or our EOT) where it can get it, @return false if
+    /// there's nothing to send until the client ACKs or NAKs something
+    bool fillForPhone();
+
+    /// Receiving: write the blocks we hold to the file
+    void writeBlocks();
 };
 
 extern XModemAdapter xModem;
@@ -0,0 +1,41 @@
+#include "mesh/PacketHistory.h"
+#include <unity.h>
+
+/// A sender/id pair for each record we store, spread over a few senders like a busy mesh
+static NodeNum senderFor(uint32_t i)
+{
+    return 0x1000 + i % 7;
+}
+
+void test_fill_then_expire()
+{
+    static PacketHistory history; // too big for some test stacks
+    uint32_t now = 1000;
+
+    // Far more packets than the table has slots, all within FLOOD_EXPIRE_TIME
+    for (uint32_t id = 1; id <= 4 * PACKETHISTORY_MAX; id++) {
+        TEST_ASSERT_FALSE(history.wasSeenRecently(senderFor(id), id, true, now++));
+        TEST_ASSERT_LESS_OR_EQUAL(PACKETHISTORY_MAX_RECORDS, history.getNumRecords());
+    }
+    TEST_ASSERT_EQUAL(PACKETHISTORY_MAX_RECORDS, history.getNumRecords());
+    for (uint32_t id = 4 * PACKETHISTORY_MAX - 15; id <= 4 * PACKETHISTORY_MAX; id++)
+        TEST_ASSERT_TRUE(history.wasSeenRecently(senderFor(id), id, false, now));
+
+    // Once they're all old, lookups sweep them away while we keep finding the new ones
+    now += FLOOD_EXPIRE_TIME + 1;
+    for (uint32_t i = 0; i < 2 * PACKETHISTORY_MAX; i++) {
+        PacketId id = 1000000 + i % 3;
+        TEST_ASSERT_EQUAL(i >= 3, history.wasSeenRecently(0x2000, id, true, now));
+    }
+    TEST_ASSERT_EQUAL(3, history.getNumRecords());
+    TEST_ASSERT_FALSE(history.wasSeenRecently(senderFor(1), 1, false, now));
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fill_then_expire);
+    exit(UNITY_END());
+}
+
+void loop() {}
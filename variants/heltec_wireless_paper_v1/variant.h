@@ -11,7 +11,7 @@
 #define USE_EINK_DYNAMIC_PARTIAL
 #define EINK_LOWPRIORITY_LIMIT_SECONDS 30
 #define EINK_HIGHPRIORITY_LIMIT_SECONDS 1
-#define EINK_PARTIAL_REPEAT_LIMIT 5
+#define EINK_PARTIAL_REPEAT_LIMIT 20 // a backstop, EINK_GHOST_BUDGET_PERCENT decides when we clean
 
 /*
  * eink display pins